@@ -0,0 +1,88 @@
+#ifndef SG_ALUA_H
+#define SG_ALUA_H
+
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/* Asymmetric logical unit access (ALUA) discovery across many paths. Each
+ * path (i.e. a DEVICE such as /dev/sg3) is asked, concurrently, for its
+ * Device Identification VPD page and its REPORT TARGET PORT GROUPS
+ * response. The logical unit designator then allows the paths to be
+ * grouped by logical unit, and the relative target port and target port
+ * group designators tell which target port group each path goes through.
+ * Used by sg_rtpg and sg_stpg when given several DEVICEs. */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SG_ALUA_LU_ID_LEN 264   /* "naa." plus hex of 16 bytes fits */
+#define SG_ALUA_TPORT_ID_LEN 264
+#define SG_ALUA_MAX_TPGS 64
+#define SG_ALUA_MAX_PARALLEL 256
+#define SG_ALUA_DEF_PARALLEL 32
+
+struct sg_alua_tpg {
+    bool pref;
+    int id;             /* target port group identifier */
+    int state;          /* asymmetric access state: 0x0 to 0xf */
+    int sup;            /* T_SUP ... AO_SUP byte, see state_sup_mask */
+    int status;         /* status code */
+    int num_tports;     /* target port count */
+};
+
+struct sg_alua_path {
+    bool keep_open;     /* [in] leave sg_fd open after discovery */
+    bool vpd_only;      /* [in] no REPORT TARGET PORT GROUPS; a missing
+                         * Device Identification VPD page is not an error */
+    int sg_fd;          /* -1 when closed */
+    int res;            /* 0 or an exit status (e.g. SG_LIB_CAT_*) */
+    int rel_tport;      /* relative target port identifier, or -1 */
+    int tpg;            /* target port group of this path, or -1 */
+    int num_tpgs;       /* elements used in tpg_arr */
+    int64_t elapsed_ms; /* time taken by the discovery commands */
+    const char * dev_name;      /* [in] */
+    char lu_id[SG_ALUA_LU_ID_LEN];      /* "" if no LU designator */
+    char tport_id[SG_ALUA_TPORT_ID_LEN];        /* target port, or "" */
+    struct sg_alua_tpg tpg_arr[SG_ALUA_MAX_TPGS];
+};
+
+/* Sets grp_arr[k] so that elements of pa_arr with the same tport_id (or,
+ * lacking that, the same target port group) share a group number. Returns
+ * the number of groups. */
+int sg_alua_tport_groups(const struct sg_alua_path * pa_arr, int num,
+                         int * grp_arr);
+
+/* Opens each element of pa_arr read-write (or read-only), then fetches its
+ * Device Identification VPD page and the REPORT TARGET PORT GROUPS
+ * response, on at most num_parallel threads. Returns the number of
+ * elements whose res is other than 0. Unless keep_open is set each
+ * sg_fd is closed before this function returns. */
+int sg_alua_discover(struct sg_alua_path * pa_arr, int num, int num_parallel,
+                     bool o_readonly, int verbose);
+
+/* Closes all elements of pa_arr that are still open. */
+void sg_alua_close(struct sg_alua_path * pa_arr, int num);
+
+/* Returns the element of pa's tpg_arr whose id is tpg_id, or NULL. */
+const struct sg_alua_tpg * sg_alua_find_tpg(const struct sg_alua_path * pa,
+                                            int tpg_id);
+
+/* Returns a name for asymmetric access state, e.g. "active/optimized" for
+ * 0. Never returns NULL. */
+const char * sg_alua_state_str(int state);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif          /* SG_ALUA_H */
@@ -0,0 +1,102 @@
+#ifndef SG_BROKER_H
+#define SG_BROKER_H
+
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/* Client side of the device broker (the sg_broker utility), Linux only.
+ * The broker is a long-lived process that keeps local devices open,
+ * remembers what kind of pass-through each one is and holds a snapshot of
+ * its identification (standard INQUIRY, some VPD pages and READ CAPACITY).
+ * When the SG3_UTILS_BROKER environment variable names the broker's Unix
+ * socket, scsi_pt_open_device() and scsi_pt_open_flags() first ask the
+ * broker for the device. The reply carries a file descriptor (passed with
+ * SCM_RIGHTS) that this process then uses directly, so commands do not go
+ * through the broker. The file descriptor is leased: no other client is
+ * given the same open of the device until this process closes it (or
+ * exits). The driver type probe of the pass-through is answered from the
+ * snapshot and so are sg_ll_inquiry_v2() and sg_ll_readcap_*() when the
+ * snapshot holds the requested response. When there is no broker, or it
+ * declines, the device is opened directly as before. */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SG_BROKER_ENV "SG3_UTILS_BROKER"
+#define SG_BROKER_DEF_SOCKET "/run/sg_broker.sock"
+
+#define SG_BROKER_MAGIC 0x53474231      /* "SGB1" */
+#define SG_BROKER_NAME_MAX 256          /* device name, including NUL */
+#define SG_BROKER_NUM_IDS 6
+#define SG_BROKER_ID_MAX_LEN 252
+
+#define SG_BROKER_FL_RDWR 0x1           /* else read-only */
+
+/* A response the broker fetched from the device. name is as used by the
+ * response cache (see sg_rcache.h), e.g. "inq_00", "vpd_83" or "rcap16". */
+struct sg_broker_id {
+    char name[8];
+    uint16_t alloc_len;         /* allocation length it was fetched with */
+    uint16_t len;               /* 0 -> not available */
+    uint8_t resp[SG_BROKER_ID_MAX_LEN];
+};
+
+/* The broker's snapshot of one device */
+struct sg_broker_info {
+    uint8_t is_sg;
+    uint8_t is_bsg;
+    uint8_t is_nvme;
+    uint8_t is_nvme_gen;
+    uint32_t nvme_nsid;
+    int32_t sg_version;         /* 0 if not a sg device */
+    uint32_t st_mode;
+    uint64_t st_rdev;
+    struct sg_broker_id id_arr[SG_BROKER_NUM_IDS];
+};
+
+struct sg_broker_req {
+    uint32_t magic;
+    uint32_t flags;             /* SG_BROKER_FL_* */
+    char dev_name[SG_BROKER_NAME_MAX];
+};
+
+/* Sent with one file descriptor when err is 0 */
+struct sg_broker_rep {
+    uint32_t magic;
+    int32_t err;                /* 0 or an errno value */
+    struct sg_broker_info info;
+};
+
+/* If the SG3_UTILS_BROKER environment variable is set, asks the broker for
+ * dev_name opened with 'flags' (only O_RDONLY or O_RDWR together with
+ * O_NONBLOCK are brokered). Returns the leased file descriptor (>= 0) or
+ * -1 if the caller should open dev_name itself. */
+int sg_broker_open(const char * dev_name, int flags, int verbose);
+
+/* Returns the broker's snapshot if dev_fd was leased from the broker,
+ * else NULL. */
+const struct sg_broker_info * sg_broker_info(int dev_fd);
+
+/* Copies up to mx_len bytes of the response called 'name' of a leased
+ * dev_fd to rp. Returns the number of bytes copied or -1 if that response
+ * is not in the snapshot (or only a shorter prefix of it is). */
+int sg_broker_get(int dev_fd, const char * name, uint8_t * rp, int mx_len);
+
+/* Ends the lease of dev_fd, if any. Call after dev_fd is closed. */
+void sg_broker_release(int dev_fd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* SG_BROKER_H */
@@ -0,0 +1,131 @@
+#ifndef SG_CIMG_H
+#define SG_CIMG_H
+
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/* Compressed images of a block device (or part of one). The data is cut
+ * into chunks of a fixed number of blocks, each compressed on its own into
+ * a frame, so chunks can be compressed (and later decompressed) by several
+ * threads at once and any chunk can be read back without the others. The
+ * layout of an image file, with all integers little endian, is:
+ *     header      SG_CIMG_HDR_LEN bytes: magic "sg3cimg1", version, alg,
+ *                 block size, blocks per chunk
+ *     frames      in the order they were written, not necessarily block
+ *                 order
+ *     index       one SG_CIMG_ENT_LEN byte entry per frame, in block order:
+ *                 block offset, file offset, stored length, blocks, CRC32C
+ *                 of the uncompressed chunk, flags
+ *     trailer     SG_CIMG_TRL_LEN bytes: index file offset, number of
+ *                 entries, blocks in image, magic "sg3cidx1"
+ * A chunk that does not shrink is stored as is, with SG_CIMG_F_RAW set.
+ * The compressors (zstd and lz4) are only available if their libraries
+ * were found when sg3_utils was built.
+ *
+ * A sparse image (alg SG_CIMG_RAW) uses the same layout with nothing
+ * compressed: each entry is an extent of up to chunk_blks blocks holding
+ * data, stored as is. Blocks in no extent, up to the blocks in image given
+ * in the trailer, are holes that read as zeros. */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SG_CIMG_NONE 0
+#define SG_CIMG_ZSTD 1
+#define SG_CIMG_LZ4 2
+#define SG_CIMG_RAW 3           /* sparse image, extents stored as is */
+
+#define SG_CIMG_HDR_LEN 64
+#define SG_CIMG_ENT_LEN 32
+#define SG_CIMG_TRL_LEN 32
+
+#define SG_CIMG_F_RAW 0x1       /* frame holds chunk uncompressed */
+
+struct sg_cimg_hdr {
+    int alg;                    /* SG_CIMG_ZSTD, SG_CIMG_LZ4 or SG_CIMG_RAW */
+    int bs;                     /* block size in bytes */
+    int chunk_blks;             /* blocks per chunk, the last may be less;
+                                 * SG_CIMG_RAW: most blocks per extent */
+};
+
+struct sg_cimg_ent {
+    uint64_t blk;               /* block offset from start of image */
+    uint64_t pos;               /* byte offset of frame in image file */
+    uint32_t clen;              /* bytes in frame */
+    uint32_t num_blks;          /* blocks in chunk; 0: no frame (yet) */
+    uint32_t crc;               /* CRC32C of uncompressed chunk */
+    uint32_t flags;             /* SG_CIMG_F_* */
+};
+
+struct sg_cimg_ctx;             /* per thread compressor state */
+
+/* Returns SG_CIMG_* value for name ("zstd" or "lz4"), or -1 if unknown.
+ * SG_CIMG_RAW has a name ("raw") but is not a compressor so not found. */
+int sg_cimg_alg_from_name(const char * name);
+/* Returns name of alg, or NULL if unknown */
+const char * sg_cimg_alg_name(int alg);
+/* Returns true if this build of the library can (de)compress with alg */
+bool sg_cimg_alg_avail(int alg);
+
+/* Returns a context for one thread to compress and decompress with alg at
+ * level (0 for the compressor's default; lz4 takes it as its acceleration
+ * factor). Returns NULL if alg is not available or out of memory. */
+struct sg_cimg_ctx * sg_cimg_ctx_new(int alg, int level);
+void sg_cimg_ctx_free(struct sg_cimg_ctx * czp);
+
+/* Returns the size a buffer needs to hold a frame of a len byte chunk */
+int sg_cimg_bound(int alg, int len);
+/* Compresses slen bytes at src into dst. Returns the length of the frame,
+ * or 0 if it would not be shorter than slen (store the chunk raw), or -1
+ * on error. */
+int sg_cimg_compress(struct sg_cimg_ctx * czp, const uint8_t * src,
+                     int slen, uint8_t * dst, int dlen);
+/* Decompresses the slen byte frame at src into dst. Returns the number of
+ * bytes placed in dst, or -1 if the frame is corrupt or too big. */
+int sg_cimg_decompress(struct sg_cimg_ctx * czp, const uint8_t * src,
+                       int slen, uint8_t * dst, int dlen);
+/* Returns the CRC32C of len bytes at bp, as kept in the index */
+uint32_t sg_cimg_crc(const uint8_t * bp, int len);
+
+/* Places header *hp in b, which needs SG_CIMG_HDR_LEN bytes */
+void sg_cimg_hdr_enc(const struct sg_cimg_hdr * hp, uint8_t * b);
+
+/* Writes the index of the n entries in ents (in block order, entries with
+ * num_blks of 0 are left out) followed by the trailer to fd, starting at
+ * byte offset pos. If seq is true fd can't be positioned (e.g. a pipe) and
+ * is written with write() as it is expected to be at pos already. The
+ * image holds tot_blks blocks, or up to the end of the last entry if that
+ * is more (so 0 can be given when there are no trailing holes). Returns 0
+ * or a SG_LIB_* error. */
+int sg_cimg_write_index(int fd, bool seq, uint64_t pos,
+                        const struct sg_cimg_ent * ents, int64_t n,
+                        uint64_t tot_blks);
+
+/* Reads the header, trailer and index of the image file open on fd and
+ * checks they are consistent. On success returns 0 with *entsp set to an
+ * array of *np entries (to be free()-ed) and *tot_blksp to the number of
+ * blocks in the image. Otherwise returns a SG_LIB_* error. */
+int sg_cimg_load(int fd, struct sg_cimg_hdr * hp, struct sg_cimg_ent ** entsp,
+                 int64_t * np, int64_t * tot_blksp, int vb);
+
+/* Binary search of the n entries in ents. Returns the entry holding block
+ * offset blk or, if blk is in a hole, the first entry after it. Returns
+ * NULL if there is none. */
+const struct sg_cimg_ent * sg_cimg_find(const struct sg_cimg_ent * ents,
+                                        int64_t n, uint64_t blk);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif          /* SG_CIMG_H */
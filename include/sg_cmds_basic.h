@@ -2,7 +2,7 @@
 #define SG_CMDS_BASIC_H
 
 /*
- * Copyright (c) 2004-2023 Douglas Gilbert.
+ * Copyright (c) 2004-2026 Douglas Gilbert.
  * All rights reserved.
  * Use of this source code is governed by a BSD-style
  * license that can be found in the BSD_LICENSE file.
@@ -321,6 +321,25 @@ int sg_get_mode_page_controls(int sg_fd, bool mode6, int pg_code,
                               void * pcontrol_arr[], int * reported_lenp,
                               int verbose);
 
+/* Sends a REPORT SUPPORTED OPERATION CODES (all commands) to sg_fd, or
+ * takes its response from the response cache (see sg_rcache.h) when that
+ * is open for sg_fd, and keeps which opcodes and service actions are
+ * supported. Only the last device fetched is kept. Returns 0 if
+ * successful, otherwise a SG_LIB_CAT type error or -1. */
+int sg_supp_ops_fetch(int sg_fd, bool noisy, int verbose);
+
+/* Returns 1 if the device reported opcode (with service action serv_act,
+ * ignored if negative) as supported, 0 if it did not, or -1 if that is
+ * not known. A command need not be sent when this returns 0. If sg_fd
+ * differs from the last fetched device and the response cache is open for
+ * sg_fd then sg_supp_ops_fetch() is called first. Some sg_ll_*() functions
+ * (e.g. sg_ll_readcap_16() and sg_ll_unmap_v2()) use this and return
+ * SG_LIB_CAT_INVALID_OP without sending their command when it yields 0. */
+int sg_supp_ops_query(int sg_fd, int opcode, int serv_act);
+
+/* Forgets the supported operation codes kept by sg_supp_ops_fetch() */
+void sg_supp_ops_free(void);
+
 /* Returns file descriptor >= 0 if successful. If error in Unix returns
    negated errno. Implementation calls scsi_pt_open_device(). */
 int sg_cmds_open_device(const char * device_name, bool read_only, int verbose);
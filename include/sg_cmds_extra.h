@@ -2,7 +2,7 @@
 #define SG_CMDS_EXTRA_H
 
 /*
- * Copyright (c) 2004-2018 Douglas Gilbert.
+ * Copyright (c) 2004-2026 Douglas Gilbert.
  * All rights reserved.
  * Use of this source code is governed by a BSD-style
  * license that can be found in the BSD_LICENSE file.
@@ -92,6 +92,16 @@ int sg_ll_get_lba_status32(int sg_fd, uint64_t start_llba, uint32_t scan_len,
                            void * resp, int alloc_len, bool noisy,
                            int verbose);
 
+/* Invokes a SCSI REPORT ZONES command (ZBC) starting at zone start LBA
+ * zs_lba. If partial is true the PARTIAL bit is set so the zone list
+ * length only covers the descriptors returned. report_opts is placed in
+ * the REPORTING OPTIONS field (6 bits). If residp is non-NULL, the residual
+ * count is placed there. Returns 0 -> success, various SG_LIB_CAT_* positive
+ * values or -1 -> other errors */
+int sg_ll_report_zones(int sg_fd, uint64_t zs_lba, bool partial,
+                       int report_opts, void * resp, int mx_resp_len,
+                       int * residp, bool noisy, int verbose);
+
 /* Invokes a SCSI PERSISTENT RESERVE IN command (SPC). Returns 0
  * when successful, SG_LIB_CAT_INVALID_OP if command not supported,
  * SG_LIB_CAT_ILLEGAL_REQ if field in cdb not supported,
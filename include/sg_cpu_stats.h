@@ -0,0 +1,94 @@
+#ifndef SG_CPU_STATS_H
+#define SG_CPU_STATS_H
+
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/* CPU cost accounting for the dd family of utilities. A snapshot holds the
+ * monotonic clock, the process's user and system CPU times, context
+ * switches and page faults (from getrusage(RUSAGE_SELF)) and the calling
+ * thread's CPU time. The difference between two snapshots, together with
+ * the bytes moved and commands issued in between, gives the CPU seconds
+ * per GiB and per million commands, which is what capacity planning needs
+ * rather than elapsed time alone. Snapshots are cheap enough to take at
+ * each progress interval. */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sg_json.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct sg_cpu_snap {
+    bool valid;                 /* false if nothing could be sampled */
+    uint64_t wall_ns;           /* CLOCK_MONOTONIC */
+    uint64_t user_ns;           /* process user CPU time */
+    uint64_t sys_ns;            /* process system CPU time */
+    uint64_t thr_ns;            /* calling thread's CPU time, 0 if n/a */
+    int64_t nvcsw;              /* voluntary context switches */
+    int64_t nivcsw;             /* involuntary context switches */
+    int64_t minflt;             /* minor page faults */
+    int64_t majflt;             /* major page faults */
+};
+
+struct sg_cpu_cost {
+    double secs;                /* elapsed (wall clock) seconds */
+    double user_secs;
+    double sys_secs;
+    double thr_secs;            /* CPU time of the thread(s) sampled */
+    double util_pct;            /* (user + sys) / elapsed, as a percentage;
+                                 * may exceed 100 when multi-threaded */
+    double cpu_s_per_gib;       /* (user + sys) seconds per GiB; -1 if no
+                                 * bytes were moved */
+    double cpu_s_per_mcmd;      /* (user + sys) seconds per million
+                                 * commands; -1 if no commands */
+    int64_t nvcsw;
+    int64_t nivcsw;
+    int64_t minflt;
+    int64_t majflt;
+};
+
+/* Takes a snapshot of the process's (and calling thread's) CPU usage. On
+ * platforms without getrusage() ssp->valid is set false. */
+void sg_cpu_snap(struct sg_cpu_snap * ssp);
+
+/* Returns the calling thread's CPU time in nanoseconds, or 0 if that is
+ * not available. Worker threads may add this to a total on exit. */
+uint64_t sg_cpu_thread_ns(void);
+
+/* Computes the cost of the work done between snapshots *ap (earlier) and
+ * *bp, during which bytes were moved by cmds commands. Either count may be
+ * 0. Returns false (and zeroes *cp) if either snapshot is not valid. */
+bool sg_cpu_cost(const struct sg_cpu_snap * ap, const struct sg_cpu_snap * bp,
+                 uint64_t bytes, uint64_t cmds, struct sg_cpu_cost * cp);
+
+/* Places a short one line summary (e.g. "cpu=43% 0.52 s/GiB 1.20 s/Mcmd")
+ * in b, without a trailing newline. Returns b. */
+char * sg_cpu_cost_str(const struct sg_cpu_cost * cp, char * b, int blen);
+
+/* Sends two lines to stderr via pr2serr(), each starting with leadin (may
+ * be NULL): CPU times and utilization, then the costs per GiB and per
+ * million commands, context switches and page faults. */
+void sg_cpu_cost_pr(const struct sg_cpu_cost * cp, const char * leadin);
+
+/* Adds an object named name (e.g. "cpu_cost") to jop holding the times in
+ * microseconds, the costs in microseconds per GiB and per million commands
+ * (omitted when there were none), context switches and page faults.
+ * Returns that object, or NULL if JSON output is not active. */
+sgj_opaque_p sg_cpu_cost_js(sgj_state * jsp, sgj_opaque_p jop,
+                            const char * name, const struct sg_cpu_cost * cp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif          /* SG_CPU_STATS_H */
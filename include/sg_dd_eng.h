@@ -0,0 +1,245 @@
+#ifndef SG_DD_ENG_H
+#define SG_DD_ENG_H
+
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/* Helpers shared by the dd family (sg_dd, sgp_dd, sgm_dd and, in the
+ * testing directory, sgh_dd and sg_mrq_dd): classifying IFILE and OFILE,
+ * fetching their capacity and transfer limits, sizing the sg reserve
+ * buffer and building READ and WRITE cdbs. This is not a copy engine,
+ * each utility keeps its own copy loop; the zone append writer and the
+ * io_uring below are for those loops to call. */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* File types returned by sg_dde_filetype(), can be OR-ed together */
+#define SG_DDE_FT_OTHER 1       /* probably a regular file */
+#define SG_DDE_FT_SG 2          /* sg (or bsg, or NVMe char) device */
+#define SG_DDE_FT_RAW 4         /* raw char device */
+#define SG_DDE_FT_DEV_NULL 8    /* either "/dev/null" or "." as filename */
+#define SG_DDE_FT_ST 16         /* st char device (tape) */
+#define SG_DDE_FT_BLOCK 32      /* block device */
+#define SG_DDE_FT_FIFO 64       /* fifo (named or unnamed pipe) */
+#define SG_DDE_FT_NVME 128      /* NVMe char(-generic)/block device */
+#define SG_DDE_FT_ERROR 512     /* unable to stat() file */
+
+/* ft_flags for sg_dde_filetype() */
+#define SG_DDE_FTF_FIFO 0x1     /* report fifos, else they are FT_OTHER */
+#define SG_DDE_FTF_BSG_NVME 0x2 /* bsg and NVMe char devices are FT_SG */
+
+/* Classifies the file or device 'fname' ("." is the null device). Returns
+ * one or more of the SG_DDE_FT_* values OR-ed together. */
+int sg_dde_filetype(const char * fname, int ft_flags, int verbose);
+
+/* Places a description of 'ft' in 'b' (of length blen). Returns b. */
+char * sg_dde_filetype_str(int ft, char * b, int blen);
+
+/* Sends READ CAPACITY(10), then READ CAPACITY(16) if the former reports
+ * 0xffffffff blocks. Returns 0 on success, else see sg_ll_readcap_10(). */
+int sg_dde_read_capacity(int sg_fd, int64_t * num_blks, int * blk_sz,
+                         bool noisy, int verbose);
+
+/* Capacity of the block device open on fd from the BLKSSZGET and
+ * BLKGETSIZE64 (or BLKGETSIZE) ioctls. Returns 0 on success, else -1. */
+int sg_dde_blkdev_capacity(int fd, int64_t * num_blks, int * blk_sz,
+                           int verbose);
+
+/* Returns the largest transfer, in blocks of blk_sz bytes, that fd (of
+ * SG_DDE_FT_* type ft) will take, or 0 if not known. For SCSI devices that
+ * is the MAXIMUM TRANSFER LENGTH in the Block Limits VPD page; for sg and
+ * block devices max_sectors_kb of the block layer's request queue (Linux)
+ * also applies. The OPTIMAL TRANSFER LENGTH is placed in *optp (0 if not
+ * known). */
+int sg_dde_xfer_limits(int fd, int ft, int blk_sz, int * optp, int verbose);
+
+/* 'want' flags of sg_dde_resbuf_size() */
+#define SG_DDE_RB_MMAP 0x1      /* the reserve buffer will be mmap-ed */
+#define SG_DDE_RB_DIO 0x2       /* direct IO is wanted */
+#define SG_DDE_RB_FIT 0x4       /* lower *bptp rather than lose either */
+
+/* What sg_dde_resbuf_size() found, -1 for limits that are not known */
+struct sg_dde_resbuf {
+    int need;                   /* bs*bpt rounded up to a page */
+    int reserved_sz;            /* from SG_GET_RESERVED_SIZE once set */
+    int def_reserved_size;      /* sg module parameters */
+    int allow_dio;
+    int max_sectors_kb;         /* of the disk's request queue */
+    int max_hw_sectors_kb;
+    int got;                    /* SG_DDE_RB_MMAP and/or SG_DDE_RB_DIO */
+};
+
+/* Sizes the reserve buffer of the sg device open on sg_fd for transfers of
+ * *bptp blocks of blk_sz bytes, taking account of the sg module parameters
+ * and the request queue limits in sysfs. If want has SG_DDE_RB_FIT then
+ * *bptp may be lowered so that mmap-ed IO (SG_DDE_RB_MMAP) and direct IO
+ * (SG_DDE_RB_DIO) fit within those limits. Those wanted but not possible
+ * are left out of rbp->got and the reason is sent to stderr, prefixed by
+ * leadin (may be NULL). Returns 0 or an exit status if an ioctl fails. */
+int sg_dde_resbuf_size(int sg_fd, int blk_sz, int * bptp, int want,
+                       struct sg_dde_resbuf * rbp, const char * leadin,
+                       int verbose);
+
+/* Builds a READ (or WRITE when write_true) cdb of cdb_sz bytes (6, 10, 12
+ * or 16) at cdbp for 'blocks' blocks starting at 'lba'. Returns 0 or, if
+ * those do not fit that cdb, SG_LIB_SYNTAX_ERROR after a message prefixed
+ * by leadin (may be NULL) is sent to stderr. */
+int sg_dde_build_rw_cdb(uint8_t * cdbp, int cdb_sz, unsigned int blocks,
+                        int64_t lba, bool write_true, bool fua, bool dpo,
+                        const char * leadin);
+
+/* A READ or WRITE cdb whose opcode and flags (e.g. FUA and DPO) are set
+ * up once, by sg_dde_cdb_tmpl_init(), for all the commands of one stream.
+ * Per command sg_dde_cdb_tmpl_fill() copies it and patches in the LBA and
+ * TRANSFER LENGTH fields, with no branching on the cdb size or flags. The
+ * caller may OR other fixed fields into cdb[] after initialization. */
+struct sg_dde_cdb_tmpl {
+    int cdb_sz;                 /* 6, 10, 12 or 16 */
+    uint32_t max_blks;          /* largest TRANSFER LENGTH */
+    uint64_t lba_end;           /* lba + blocks may not exceed this */
+    void (*patch)(uint8_t * cdbp, uint32_t blocks, uint64_t lba);
+    uint8_t cdb[16];
+};
+
+/* Prepares *tp for READ (or WRITE when write_true) cdbs of cdb_sz bytes.
+ * Returns 0 or, if the combination is not valid, SG_LIB_SYNTAX_ERROR after
+ * a message prefixed by leadin (may be NULL) is sent to stderr. */
+int sg_dde_cdb_tmpl_init(struct sg_dde_cdb_tmpl * tp, int cdb_sz,
+                         bool write_true, bool fua, bool dpo,
+                         const char * leadin);
+
+/* Places the cdb for 'blocks' blocks starting at 'lba' at cdbp, which must
+ * have room for 16 bytes. Returns 0, or -1 if blocks or lba do not fit in
+ * that cdb (nothing is printed). */
+static inline int
+sg_dde_cdb_tmpl_fill(const struct sg_dde_cdb_tmpl * tp, uint8_t * cdbp,
+                     uint32_t blocks, int64_t lba)
+{
+    if ((blocks > tp->max_blks) || ((uint64_t)lba > tp->lba_end - blocks))
+        return -1;
+    memcpy(cdbp, tp->cdb, sizeof(tp->cdb));
+    tp->patch(cdbp, blocks, (uint64_t)lba);
+    return 0;
+}
+
+/* The OFILE of a zone append writer, set up by the caller */
+struct sg_dde_ep {
+    int cdb_sz;         /* of the WRITEs in tmpl (ZBC) */
+    int blk_sz;
+    int timeout_secs;   /* 0 -> the pass-through default */
+    int verbose;
+    int fd;             /* open for writing with the pass-through */
+    const char * fname;
+    struct sg_dde_cdb_tmpl tmpl;        /* WRITE, for ZBC */
+};
+
+/* Zone append writer for zoned OFILEs: a ZNS namespace reached through
+ * its NVMe generic char device (e.g. /dev/ng0n1) or a ZBC disk reached
+ * through sg. Sequential writes to a zone must each wait for the previous
+ * one to move the write pointer, so a zone has a queue depth of 1. With
+ * Zone Append the device (NVMe) or this writer (ZBC) chooses where in the
+ * zone each write goes, so up to qd of them can be outstanding in one
+ * zone. The LBA each append landed at is reported to a callback. Zones
+ * are filled in order starting at the zone holding start_lba; full, read
+ * only, offline and conventional zones are passed over. For ZBC each
+ * append is a WRITE at a write pointer kept here; a WRITE that overtakes
+ * an earlier one in the same zone fails with UNALIGNED WRITE COMMAND and
+ * is sent again after those before it have completed. Not shared between
+ * threads. */
+struct sg_dde_zapp;
+
+/* Called as each append completes, in completion order: the num_blks
+ * blocks given to sg_dde_zapp_submit() with tag are now at lba. */
+typedef void (*sg_dde_zapp_done_f)(void * ctx, int64_t tag, uint64_t lba,
+                                   int num_blks);
+
+struct sg_dde_zapp_stats {
+    int64_t appends;
+    int64_t blocks;
+    int64_t resent;     /* ZBC: WRITEs sent again in write pointer order */
+    int zones;          /* zones appended to */
+    int max_in_zone;    /* most appends outstanding in one zone */
+};
+
+/* Prepares to append to ep which must be open for writing with the
+ * pass-through. The zones are found with REPORT ZONES (for ZNS via the
+ * SNTL). *max_blksp is the most blocks that will be given to
+ * one append; for ZNS it may be lowered to the Zone Append Size Limit. qd
+ * buffers of that size are allocated, page aligned. Returns 0 and places
+ * the new writer in *zapp, else an exit status. */
+int sg_dde_zapp_new(struct sg_dde_ep * ep, int64_t start_lba, int qd,
+                    int * max_blksp, sg_dde_zapp_done_f done, void * ctx,
+                    struct sg_dde_zapp ** zapp);
+
+/* Places a free buffer of *max_blksp blocks in *bpp, first waiting for
+ * an append to complete if all qd are busy. Returns 0 or the exit status
+ * of a failed append. */
+int sg_dde_zapp_get_buf(struct sg_dde_zapp * zap, uint8_t ** bpp);
+
+/* Starts an append of the first num_blks blocks of the buffer from the
+ * last sg_dde_zapp_get_buf(). Returns 0 or an exit status,
+ * SG_LIB_LBA_OUT_OF_RANGE if no zone has room left for num_blks. */
+int sg_dde_zapp_submit(struct sg_dde_zapp * zap, int64_t tag, int num_blks);
+
+/* Waits for all appends to complete. Returns 0 or the exit status of the
+ * first that failed. */
+int sg_dde_zapp_drain(struct sg_dde_zapp * zap);
+
+void sg_dde_zapp_get_stats(const struct sg_dde_zapp * zap,
+                           struct sg_dde_zapp_stats * sp);
+
+/* Waits for appends still outstanding then frees zap (may be NULL) */
+void sg_dde_zapp_free(struct sg_dde_zapp * zap);
+
+/* An io_uring (Linux, lk 5.6 or later) for reading and writing block
+ * devices and regular files, several transfers per io_uring_enter(2)
+ * call. Not shared between threads. */
+struct sg_dde_uring;
+
+struct sg_dde_uring_io {
+    bool write_true;    /* [in] */
+    int fd;             /* [in] */
+    int len;            /* [in] bytes to read or write */
+    int64_t off;        /* [in] byte offset in fd */
+    uint8_t * bp;       /* [in] */
+    int res;            /* bytes moved or negated errno */
+};
+
+/* Sets up a ring of at least 'entries' entries. The num_fds file
+ * descriptors in fd_arr and the num_bufs buffers, each buf_len bytes, in
+ * buf_arr are registered with it so transfers using them need not look up
+ * the file nor pin the pages each time; if the kernel refuses either they
+ * are used unregistered. Returns NULL with errno set if io_uring is not
+ * available. */
+struct sg_dde_uring * sg_dde_uring_new(int entries, const int * fd_arr,
+                                       int num_fds, uint8_t * const * buf_arr,
+                                       int num_bufs, int buf_len,
+                                       int verbose);
+
+/* Starts the n transfers in io_arr then waits for all of them to finish,
+ * placing the outcome of each in its res field. Returns 0 or, if the ring
+ * itself fails, negated errno in which case the res fields are not
+ * valid. */
+int sg_dde_uring_rw(struct sg_dde_uring * urp,
+                    struct sg_dde_uring_io * io_arr, int n);
+
+/* Closes the ring, urp may be NULL */
+void sg_dde_uring_free(struct sg_dde_uring * urp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif          /* SG_DD_ENG_H */
@@ -0,0 +1,113 @@
+#ifndef SG_ERR_STATS_H
+#define SG_ERR_STATS_H
+
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/* Error accounting for the dd family of utilities. Each worker thread owns
+ * a struct sg_err_stats and counts the outcome of each command in it, by
+ * sense category (e.g. from sg_err_category_sense() or
+ * sg_cmds_process_resp(), which are the SG_LIB_CAT_* values) and by
+ * operating system errno. The counting functions are inline, take no locks
+ * and use no read-modify-write atomics, so they cost next to nothing in
+ * the I/O path. Another thread may merge them at any time (e.g. for a
+ * SIGUSR1 progress report) and sees consistent, if slightly stale,
+ * counts. */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sg_json.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SG_ERR_STATS_NUM_CAT 128        /* SG_LIB_CAT_* values are < 128 */
+#define SG_ERR_STATS_NUM_ERRNO 136      /* errno values >= 135 go in 135 */
+
+struct sg_err_stats {
+    uint64_t cmds;              /* commands completed (or failed to start) */
+    uint64_t retries;           /* commands resent after an error */
+    uint64_t cat[SG_ERR_STATS_NUM_CAT];     /* [0] (SG_LIB_CAT_CLEAN) is
+                                             * good completions */
+    uint64_t os_err[SG_ERR_STATS_NUM_ERRNO];        /* [0] unused */
+};
+
+#if defined(__GNUC__) || defined(__clang__)
+#define SG_ERR_STATS_INC(x) \
+        __atomic_store_n(&(x), __atomic_load_n(&(x), __ATOMIC_RELAXED) + 1, \
+                         __ATOMIC_RELAXED)
+#define SG_ERR_STATS_LD(x) __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#else
+#define SG_ERR_STATS_INC(x) (++(x))
+#define SG_ERR_STATS_LD(x) (x)
+#endif
+
+/* Counts a completed command whose (sense) category is cat; 0 for good.
+ * Values outside 0 to 127 are counted as SG_LIB_CAT_OTHER (99). Only the
+ * owning thread should call this. */
+static inline void
+sg_err_stats_cat(struct sg_err_stats * esp, int cat)
+{
+    SG_ERR_STATS_INC(esp->cmds);
+    if ((cat < 0) || (cat >= SG_ERR_STATS_NUM_CAT))
+        cat = 99;
+    SG_ERR_STATS_INC(esp->cat[cat]);
+}
+
+/* Counts an operating system error; err may be negated (e.g. -EBUSY).
+ * Unlike sg_err_stats_cat() the command count is not changed, since
+ * errors like EBUSY and EINTR are followed by a retry of the same
+ * system call. */
+static inline void
+sg_err_stats_errno(struct sg_err_stats * esp, int err)
+{
+    if (err < 0)
+        err = -err;
+    if (0 == err)
+        return;
+    if (err >= SG_ERR_STATS_NUM_ERRNO)
+        err = SG_ERR_STATS_NUM_ERRNO - 1;
+    SG_ERR_STATS_INC(esp->os_err[err]);
+}
+
+static inline void
+sg_err_stats_retry(struct sg_err_stats * esp)
+{
+    SG_ERR_STATS_INC(esp->retries);
+}
+
+/* Adds the counts in *srcp to *dstp. *srcp may be in use by another
+ * thread. */
+void sg_err_stats_merge(struct sg_err_stats * dstp,
+                        const struct sg_err_stats * srcp);
+
+/* Number of commands counted in a category other than good (0), recovered
+ * error or no sense. */
+uint64_t sg_err_stats_num_bad(const struct sg_err_stats * esp);
+
+/* Sends one line per non-zero count (other than good completions) to
+ * stderr via pr2serr(), each starting with leadin (may be NULL). */
+void sg_err_stats_pr(const struct sg_err_stats * esp, const char * leadin);
+
+/* Adds an object named name (e.g. "error_statistics") to jop, holding the
+ * commands and retries counts and two arrays: "sense_category_list" and
+ * "os_errno_list" whose elements have "category" (or "errno"), "name" and
+ * "count" members. Only non-zero counts appear. Returns that object, or
+ * NULL if JSON output is not active. */
+sgj_opaque_p sg_err_stats_js(sgj_state * jsp, sgj_opaque_p jop,
+                             const char * name,
+                             const struct sg_err_stats * esp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif          /* SG_ERR_STATS_H */
@@ -0,0 +1,84 @@
+#ifndef SG_GEOM_H
+#define SG_GEOM_H
+
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/* Geometry of a direct access block device (e.g. a disk): what READ
+ * CAPACITY and the Block Limits and Logical Block Provisioning VPD pages
+ * report. It is fetched once per open file descriptor and kept, so the
+ * several parts of a utility (or of the library, e.g. the dd helpers) that
+ * need the block size, protection type or unmap limits don't each send
+ * those commands again. When the response cache (see sg_rcache.h) is open
+ * the commands themselves may be answered from disk. */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* flags for sg_geom_get() */
+#define SG_GEOM_BL 0x1          /* also want the Block Limits VPD page */
+#define SG_GEOM_LBP 0x2         /* also want Logical Block Provisioning */
+#define SG_GEOM_REFRESH 0x4     /* discard what is held, fetch again */
+#define SG_GEOM_RC10_FIRST 0x8  /* READ CAPACITY(10), then (16) only if
+                                 * needed; for devices (e.g. USB) that
+                                 * mishandle READ CAPACITY(16) */
+
+struct sg_geom {
+    bool rc16;          /* from READ CAPACITY(16), else (10) */
+    bool prot_en;
+    bool lbpme;         /* logical block provisioning (thin) */
+    bool lbprz;
+    bool have_bl;       /* Block Limits VPD page (SBC-3 length) given */
+    bool have_lbp;      /* Logical Block Provisioning fields are valid */
+    int prot_type;      /* 0 when prot_en is false, else 1, 2 or 3 */
+    int p_i_exp;
+    int lbppbe;         /* logical blocks per physical block exponent */
+    uint32_t blk_sz;    /* logical block size in bytes */
+    uint32_t lowest_aligned;
+    uint64_t num_blks;  /* capacity: the last LBA plus 1 */
+    /* Block Limits VPD page, 0 when not given. The transfer length
+     * fields may be set from a short (SBC-2) page when have_bl is false */
+    bool ugavalid;
+    uint16_t opt_xfer_gran;
+    uint32_t max_xfer_len;
+    uint32_t opt_xfer_len;
+    uint32_t max_unmap_lba_cnt;
+    uint32_t max_unmap_desc_cnt;
+    uint32_t unmap_gran;
+    uint32_t unmap_align;
+    uint64_t max_ws_len;
+    /* Logical Block Provisioning VPD page */
+    bool lbpu;
+    bool lbpws;
+    bool lbpws10;
+    int prov_type;
+};
+
+/* Places the geometry of the device open on sg_fd in *gp, sending only
+ * the commands whose responses are not held for that fd. A missing VPD
+ * page is not an error, have_bl or have_lbp is then false. Returns 0 or
+ * the SG_LIB_CAT_* value of the failed READ CAPACITY, after a message if
+ * noisy is true. */
+int sg_geom_get(int sg_fd, int flags, struct sg_geom * gp, bool noisy,
+                int verbose);
+
+/* Discards what is held for sg_fd. Call it after a command that changes
+ * the geometry (e.g. FORMAT UNIT). A closed sg_fd being reused for another
+ * device is noticed without it. */
+void sg_geom_forget(int sg_fd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif          /* SG_GEOM_H */
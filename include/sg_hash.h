@@ -0,0 +1,68 @@
+#ifndef SG_HASH_H
+#define SG_HASH_H
+
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/* Streaming digests used by the dd family of utilities to fingerprint the
+ * data as it passes through their transfer buffers. */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SG_HASH_NONE 0
+#define SG_HASH_CRC32C 1        /* Castagnoli, as used by iSCSI and ext4 */
+#define SG_HASH_XXH64 2         /* xxHash 64 bit, seed 0 */
+#define SG_HASH_SHA256 3        /* FIPS 180-4 */
+
+#define SG_HASH_MAX_DIGEST_LEN 32       /* bytes, SHA-256 */
+
+struct sg_hash_ctx {
+    int alg;                    /* one of SG_HASH_* */
+    uint32_t blen;              /* bytes held in buf[] */
+    uint64_t total;             /* bytes given to sg_hash_update() */
+    union {
+        uint32_t crc;
+        uint64_t xv[4];
+        uint32_t sh[8];
+    } u;
+    uint8_t buf[64];            /* partial block (XXH64: 32, SHA-256: 64) */
+};
+
+/* Returns SG_HASH_* value for 'name' (e.g. "sha256"), or -1 if unknown. */
+int sg_hash_alg_from_name(const char * name);
+/* Returns name of 'alg' or NULL if unknown. */
+const char * sg_hash_alg_name(int alg);
+/* Returns digest length in bytes of 'alg', 0 if unknown. */
+int sg_hash_digest_len(int alg);
+/* Returns true if CRC32C is being calculated with CPU instructions */
+bool sg_hash_crc32c_hw(void);
+
+/* The first call of sg_hash_init() also builds the software lookup table
+ * so it should be made before any threads that hash are started. */
+void sg_hash_init(struct sg_hash_ctx * hcp, int alg);
+void sg_hash_update(struct sg_hash_ctx * hcp, const void * p, size_t len);
+/* Places digest (big endian, as printed by sha256sum, xxhsum, etc) in
+ * 'digest' which should have SG_HASH_MAX_DIGEST_LEN bytes. Returns digest
+ * length. The context needs sg_hash_init() before it is used again. */
+int sg_hash_final(struct sg_hash_ctx * hcp, uint8_t * digest);
+/* Writes digest as lower case hex into 'b' (NUL terminated, needs
+ * 2 * dlen + 1 bytes). Returns number of characters, excluding NUL. */
+int sg_hash_hex(const uint8_t * digest, int dlen, char * b, int blen);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif          /* end of SG_HASH_H */
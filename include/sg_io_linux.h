@@ -2,7 +2,7 @@
 #define SG_IO_LINUX_H
 
 /*
- * Copyright (c) 2004-2020 Douglas Gilbert.
+ * Copyright (c) 2004-2026 Douglas Gilbert.
  * All rights reserved.
  * Use of this source code is governed by a BSD-style
  * license that can be found in the BSD_LICENSE file.
@@ -189,6 +189,32 @@ int sg_err_category_new(int scsi_status, int host_status, int driver_status,
  * sg_io_v4 interface use sg_err_category_new() function instead */
 int sg_err_category3(struct sg_io_hdr * hp);
 
+#define SG_LINUX_CAPS_SG_V4 40000       /* sg driver version with v4 */
+#define SG_LINUX_CAPS_SG_V4_MRQ 40045   /* ... and multiple requests */
+
+/* What this system's kernel and drivers offer, independent of any one
+ * device. Found by the first sg_linux_get_caps() call then kept for the
+ * life of the process, so opening many devices does not read procfs each
+ * time. */
+struct sg_linux_caps {
+    bool sg_v4;         /* sg driver has the v4 interface */
+    bool sg_v4_mrq;     /* sg driver accepts multiple requests (mrq) */
+    bool uring;         /* io_uring_setup(2) works */
+    int bsg_major;      /* char device majors from /proc/devices, 0 when */
+    int nvme_major;     /*   that driver is not present */
+    int nvme_gen_major;
+    int sg_version;     /* e.g. 40045 for 4.0.45; 0 if sg not loaded */
+    long page_size;
+};
+
+/* Returns the capabilities, finding them on the first call. Safe to call
+ * from several threads. Never returns NULL. */
+const struct sg_linux_caps * sg_linux_get_caps(int verbose);
+
+/* The next sg_linux_get_caps() call finds the capabilities again, e.g.
+ * after a driver module has been loaded. */
+void sg_linux_caps_reset(void);
+
 
 /* Note about SCSI status codes found in older versions of Linux.
  * Linux has traditionally used a 1 bit right shifted and masked
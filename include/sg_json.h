@@ -52,6 +52,7 @@ typedef struct sgj_state_t {
     /* the following set by default, the SG3_UTILS_JSON_OPTS environment
      * variable or command line argument to --json option, in that order. */
     bool pr_as_json;            /* = false (def: is plain text output) */
+    bool pr_cbor;               /* 'c' CBOR binary output (def: false) */
     bool pr_exit_status;        /* 'e' (def: true) */
     bool pr_hex;                /* 'h' (def: false) */
     bool pr_leadin;             /* 'l' (def: true) */
@@ -59,6 +60,7 @@ typedef struct sgj_state_t {
     bool pr_out_hr;             /* 'o' (def: false) */
     bool pr_packed;             /* 'k' (def: false) only when !pr_pretty */
     bool pr_pretty;             /* 'p' (def: true) */
+    bool pr_rec_lines;          /* 'r' JSON lines (def: false) */
     bool pr_string;             /* 's' (def: true) */
     char pr_format;             /*  (def: '\0') */
     int pr_indent_size;         /* digit (def: 4) */
@@ -73,6 +75,11 @@ typedef struct sgj_state_t {
                                  * element contains a line of plain text. The
                                  * array's JSON name is 'plain_text_output' */
     sgj_opaque_p userp;         /* for temporary usage */
+    FILE * stream_fp;           /* non-NULL while an array is streamed */
+    sgj_opaque_p stream_arrp;   /* array being streamed, member of basep */
+    int stream_count;           /* elements of stream_arrp already output */
+    sgj_opaque_p arenap;        /* allocator for in-core tree nodes */
+    sgj_opaque_p snake_memop;   /* names already converted to snake_case */
 } sgj_state;
 
 /* This function tries to convert the in_name C string to the "snake_case"
@@ -123,6 +130,13 @@ bool sgj_is_snake_name(const char * in_name);
  * characters. */
 void sgj_pr_hr(sgj_state * jsp, const char * fmt, ...) __printf(2, 3);
 
+/* When stdout is not a terminal (e.g. a pipe or file) gives it a large
+ * (64 KB) buffer so plain text output, from sgj_pr_hr(), the sgj_haj_*()
+ * functions and printf(), is written in a few big pieces; what remains is
+ * written at exit or by fflush(stdout). Must be called before anything is
+ * output to stdout. Returns true if the buffer was set. */
+bool sgj_hr_buffered(void);
+
 /* Initializes the state object pointed to by jsp based on the argument
  * given to the right of --json= pointed to by j_optarg. If it is NULL
  * then state object gets its default values. Returns true if argument
@@ -143,7 +157,9 @@ bool sgj_init_state(sgj_state * jsp, const char * j_optarg);
  * "utility_invoked" object  (creating it in the case when jsp->pr_leadin is
  * false) and a pointer to that array object is placed in jsp->objectp . The
  * returned pointer is not usually needed but if it is NULL then a heap
- * allocation has failed. */
+ * allocation has failed. Until sgj_finish() is called, JSON objects made
+ * in this thread are carved out of an arena owned by jsp so that they can
+ * be released together. */
 sgj_opaque_p sgj_start_r(const char * util_name, const char * ver_str,
                          int argc, char *argv[], sgj_state * jsp);
 
@@ -185,6 +201,20 @@ sgj_opaque_p sgj_named_subarray_r(sgj_state * jsp, sgj_opaque_p jop,
 sgj_opaque_p sgj_snake_named_subarray_r(sgj_state * jsp, sgj_opaque_p jop,
                                         const char * conv2sname);
 
+/* Similar to sgj_named_subarray_r() with 'jop' being jsp->basep but the
+ * returned array is "streamed": everything already placed in jsp->basep is
+ * serialized to 'fp' by this call, then each element later added to the
+ * returned array with sgj_js_nv_o() is written to 'fp' and freed. This keeps
+ * heap usage bounded when the array has a very large number of elements.
+ * The output is the same as it would be without streaming. Objects already
+ * in the jsp->basep tree should not be modified after this call; fields
+ * added to jsp->basep afterwards are output by sgj_js2file_estr() (which
+ * must be called and writes to this 'fp'). Only one array can be streamed
+ * at a time. If jsp->pr_out_hr is true, an array is already being streamed
+ * or 'fp' is NULL then this function acts like sgj_named_subarray_r(). */
+sgj_opaque_p sgj_stream_subarray_r(sgj_state * jsp, const char * sn_name,
+                                   FILE * fp);
+
 /* If either jsp or value is NULL or jsp->pr_as_json is false then nothing
  * happens and NULL is returned. The insertion point is at jop but if it is
  * NULL jsp->basep is used. If 'sn_name' is non-NULL a new named JSON object
@@ -233,7 +263,10 @@ sgj_opaque_p sgj_js_nv_b(sgj_state * jsp, sgj_opaque_p jop,
  * added to it. If successful returns ua_jop . The "ua_" prefix stands for
  * unattached. That should be the case before invocation and it will be
  * attached to jop after a successful invocation. This means that ua_jop
- * must have been created by sgj_new_unattached_object_r() or similar. */
+ * must have been created by sgj_new_unattached_object_r() or similar. If
+ * 'jop' is an array being streamed (see sgj_stream_subarray_r()) and
+ * 'sn_name' is NULL then ua_jop is written out and freed, and NULL is
+ * returned. */
 sgj_opaque_p sgj_js_nv_o(sgj_state * jsp, sgj_opaque_p jop,
                          const char * sn_name, sgj_opaque_p ua_jop);
 
@@ -293,7 +326,8 @@ void sgj_js_nv_s_nex(sgj_state * jsp, sgj_opaque_p jop, const char * sn_name,
 /* Add named field whose value is a (large) JSON string made up of num_bytes
  * ASCII hexadecimal bytes (each two hex digits separated by a space) starting
  * at byte_arr. The heap is used for intermediate storage so num_bytes can
- * be arbitrarily large. */
+ * be arbitrarily large. If jsp->pr_cbor is true the value is a CBOR byte
+ * string holding the num_bytes bytes as is. */
 void sgj_js_nv_hex_bytes(sgj_state * jsp, sgj_opaque_p jop,
                          const char * sn_name, const uint8_t * byte_arr,
                          int num_bytes);
@@ -361,7 +395,11 @@ void sgj_hr_str_out(sgj_state * jsp, const char * sp, int slen);
  * or jsp->basep is NULL then this function does nothing. If jsp->exit_status
  * is true then a new JSON object named "exit_status" and the 'exit_status'
  * value rendered as a JSON integer is appended to jsp->basep. The in-core
- * JSON tree with jsp->basep as its root is streamed to 'fp'. */
+ * JSON tree with jsp->basep as its root is streamed to 'fp'. If an array
+ * is being streamed (see sgj_stream_subarray_r()) and 'jop' is NULL then
+ * it is closed and the rest of jsp->basep is written to the FILE given to
+ * sgj_stream_subarray_r(), 'fp' is ignored. If jsp->pr_cbor is true the
+ * tree is written to 'fp' in the binary CBOR format (RFC 8949) instead. */
 void sgj_js2file_estr(sgj_state * jsp, sgj_opaque_p jop, int exit_status,
                       const char * estr, FILE * fp);
 
@@ -373,8 +411,10 @@ void sgj_free_unattached(sgj_opaque_p jop);
 /* If jsp is NULL or jsp->basep is NULL then this function does nothing.
  * This function does bottom up, heap freeing of all the in-core JSON
  * objects and arrays attached to the root JSON object assumed to be
- * found at jsp->basep . After this call jsp->basep, jsp->out_hrp and
- * jsp->userp will all be set to NULL.  */
+ * found at jsp->basep . When all of them came from the arena set up by
+ * sgj_start_r() this is done in one step. After this call jsp->basep,
+ * jsp->out_hrp and jsp->userp will all be set to NULL. Unattached objects
+ * made since sgj_start_r() must not be used after this call. */
 void sgj_finish(sgj_state * jsp);
 
 /* Forms a string of the JSON command line options help and assumes,
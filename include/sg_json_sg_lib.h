@@ -46,6 +46,14 @@ bool sgj_js_designation_descriptor(sgj_state * jsp, sgj_opaque_p jop,
 void sgj_js2file(sgj_state * jsp, sgj_opaque_p jop, int exit_status,
                  FILE * fp);
 
+struct sg_pt_lat_hist;          /* defined in sg_pt.h */
+
+/* Adds a JSON array named "latency_histogram_list" at 'jop' with one
+ * element for each of the 'num' histograms in 'arr' (e.g. as filled by
+ * sg_pt_lat_snapshot()). Only non-empty buckets are listed. */
+void sgj_js_pt_lat(sgj_state * jsp, sgj_opaque_p jop,
+                   const struct sg_pt_lat_hist * arr, int num);
+
 #ifdef __cplusplus
 }
 #endif
@@ -284,6 +284,52 @@ bool sg_get_sense_filemark_eom_ili(const uint8_t * sensep, int sb_len,
 bool sg_get_sense_progress_fld(const uint8_t * sensep, int sb_len,
                                int * progress_outp);
 
+#define SG_SENSE_DECODE_MAX_DESC 16
+
+/* Salient fields of a sense buffer, decoded in one pass by sg_decode_sense()
+ * without any string formatting. Descriptors (descriptor format only) are
+ * given as byte offsets into the original sense buffer. */
+struct sg_sense_decode_t {
+    bool valid;         /* response code 0x70 to 0x73 */
+    bool desc_fmt;      /* response code 0x72 or 0x73 */
+    bool deferred;      /* response code 0x71 or 0x73 */
+    bool info_valid;    /* VALID bit (fixed) or in information desc */
+    bool cmd_spec_valid;
+    bool progress_valid;
+    bool sksv;          /* sense key specific bytes valid */
+    bool filemark;
+    bool eom;
+    bool ili;
+    bool sdat_ovfl;     /* descriptor format: sense data overflow */
+    uint8_t resp_code;
+    uint8_t sense_key;
+    uint8_t asc;
+    uint8_t ascq;
+    uint8_t fru;        /* field replaceable unit code */
+    uint8_t num_desc;   /* may exceed SG_SENSE_DECODE_MAX_DESC */
+    uint8_t sks[3];     /* sense key specific bytes, SKSV in sks[0] */
+    uint16_t desc_off[SG_SENSE_DECODE_MAX_DESC];
+    int category;       /* as sg_err_category_sense() would return */
+    int progress;       /* 0 to 65535 when progress_valid */
+    int sb_len;         /* bytes of sense buffer decoded */
+    uint64_t info;
+    uint64_t cmd_spec;
+};
+
+/* Decodes the sense buffer into *sdp (which is zeroed first). Does no
+ * memory allocation or string formatting so it is safe to call from
+ * multiple threads. Returns true if the response code is valid (0x70 to
+ * 0x73), else false. */
+bool sg_decode_sense(const uint8_t * sensep, int sb_len,
+                     struct sg_sense_decode_t * sdp);
+
+/* Formats a one line summary (no trailing '\n') of what sg_decode_sense()
+ * placed in *sdp. For the full decode use sg_get_sense_str() on the
+ * original sense buffer. Returns number of bytes written to 'b' excluding
+ * the trailing '\0'. */
+int sg_sense_decode_str(const struct sg_sense_decode_t * sdp, int blen,
+                        char * b);
+
 /* Closely related to sg_print_sense(). Puts decoded sense data in 'buff'.
  * Usually multiline with multiple '\n' including one trailing. If
  * 'raw_sinfo' set appends sense buffer in hex. 'leadin' is string prepended
@@ -607,6 +653,37 @@ int sg_vpd_dev_id_iter(const uint8_t * initial_desig_desc, int page_len,
                        int * off, int m_assoc, int m_desig_type,
                        int m_code_set);
 
+#define SG_VPD_DI_IDX_MAX 64    /* designation descriptors indexed */
+
+/* Offsets of the designation descriptors in a device identification VPD
+ * page, found in one pass. Those with the same association, and with the
+ * same association and designator type, are chained (-1 ends a chain) so
+ * a lookup only visits descriptors that might match. */
+struct sg_vpd_dev_id_idx {
+    const uint8_t * bp;         /* initial_desig_desc */
+    int page_len;
+    int num;                    /* -1 if more than SG_VPD_DI_IDX_MAX */
+    int end_res;                /* -1 or -2, as from sg_vpd_dev_id_iter() */
+    int8_t a_head[4];           /* by association */
+    int8_t at_head[4][16];      /* by association and designator type */
+    int8_t a_next[SG_VPD_DI_IDX_MAX];
+    int8_t at_next[SG_VPD_DI_IDX_MAX];
+    int off[SG_VPD_DI_IDX_MAX];
+};
+
+/* Walks the designation descriptors at 'initial_desig_desc' (with
+ * 'page_len' valid bytes) once, placing their offsets in *ixp. The page
+ * must remain valid while *ixp is used. */
+void sg_vpd_dev_id_index(const uint8_t * initial_desig_desc, int page_len,
+                         struct sg_vpd_dev_id_idx * ixp);
+
+/* Like sg_vpd_dev_id_iter() (same 'off' convention, matching and return
+ * values) but using the index made by sg_vpd_dev_id_index(). When the
+ * association and designator type are both given the first match is
+ * found without looking at any other descriptor. */
+int sg_vpd_dev_id_next(const struct sg_vpd_dev_id_idx * ixp, int * off,
+                       int m_assoc, int m_desig_type, int m_code_set);
+
 
 /* <<< General purpose (i.e. not SCSI specific) utility functions >>> */
 
@@ -698,6 +775,30 @@ void hex2stderr(const uint8_t * b_str, int len, int no_ascii);
 int sg_f2hex_arr(const char * fname, bool as_binary, bool no_space,
                  uint8_t * mp_arr, int * mp_arr_len, int max_arr_len_and);
 
+/* The contents of a file, decoded by sg_f2hex_mmap(), are the len bytes at
+ * bp. The other fields are for sg_f2hex_unmap(). */
+struct sg_f2hex_map {
+    uint8_t * bp;
+    int len;
+    bool mapped;        /* true -> map_p is a memory map of the file */
+    void * map_p;       /* to unmap or free */
+    size_t map_len;
+};
+
+/* Like sg_f2hex_arr() but suited to large files (e.g. many responses
+ * captured one after another) as the result is not copied into an array
+ * given by the caller. With as_binary, a regular file is mapped (zero copy)
+ * while anything else (e.g. stdin) is read into a heap buffer. ASCII hex is
+ * decoded in place, within a private mapping of the file or within that
+ * heap buffer. Writes to hmp->bp are never seen in the file. If
+ * max_len_and is 0 the result length is only limited by the file size.
+ * Returns 0 if ok, or an error code. On SG_LIB_LBA_OUT_OF_RANGE hmp holds
+ * what was decoded. Unless an error other than that is returned,
+ * sg_f2hex_unmap() should be called when hmp->bp is no longer needed. */
+int sg_f2hex_mmap(const char * fname, bool as_binary, bool no_space,
+                  struct sg_f2hex_map * hmp, int max_len_and);
+void sg_f2hex_unmap(struct sg_f2hex_map * hmp);
+
 /* Returns true when executed on big endian machine; else returns false.
  * Useful for displaying ATA identify words (which need swapping on a
  * big endian machine). */
@@ -709,6 +810,11 @@ bool sg_is_big_endian();
 bool sg_all_zeros(const uint8_t * bp, int b_len);
 bool sg_all_ffs(const uint8_t * bp, int b_len);
 
+/* Treats bp as num_blks blocks each blk_sz bytes long. Returns the index
+ * (origin 0) of the first block that is not all zeros, or num_blks if they
+ * all are. Returns -1 if bp is NULL or blk_sz <= 0 . */
+int sg_first_non_zero_blk(const uint8_t * bp, int num_blks, int blk_sz);
+
 /* Returns true and exits when a byte < 0x20 or DEL is detected. If no
  * such byte is found by *(up + len - 1) then false is returned. */
 bool sg_has_control_char(const uint8_t * up, int len);
@@ -784,6 +890,58 @@ int64_t sg_get_llnum_nomult(const char * buf);
 uint8_t * sg_memalign(uint32_t num_bytes, uint32_t align_to,
                       uint8_t ** buff_to_free, bool vb);
 
+/* Values sent back via kindp by sg_memalign_hugepage() */
+#define SG_HUGEPAGE_NONE 0      /* fell back to sg_memalign() */
+#define SG_HUGEPAGE_HUGETLB 1   /* explicit huge pages (mmap-ed) */
+#define SG_HUGEPAGE_THP 2       /* transparent huge pages (heap) */
+
+/* Like sg_memalign() but tries to back the buffer with huge pages: first
+ * explicit huge pages, then transparent huge pages, finally falling back to
+ * sg_memalign(). *kindp is set to one of the SG_HUGEPAGE_* values. The
+ * buffer should be freed with sg_free_hugepage(*buff_to_free, num_bytes,
+ * *kindp). If vb is true then any fallback is reported. */
+uint8_t * sg_memalign_hugepage(uint32_t num_bytes, uint8_t ** buff_to_free,
+                               int * kindp, bool vb);
+
+/* Frees a buffer obtained from sg_memalign_hugepage() */
+void sg_free_hugepage(uint8_t * buff_to_free, uint32_t num_bytes, int kind);
+
+/* Returns a monotonic time in nanoseconds, only differences between two
+ * calls are meaningful. Falls back to the wall clock (gettimeofday()) where
+ * CLOCK_MONOTONIC is not available and returns 0 if neither is. */
+uint64_t sg_get_mono_ns(void);
+
+/* Rate limiter with two token buckets, one counting bytes and the other
+ * commands, that may be shared by the threads of a copy. Zero the object
+ * before the first sg_rate_lim_set() call. Bursts of up to
+ * SG_RATE_LIM_BURST_MS of credit are allowed after a pause. */
+#define SG_RATE_LIM_BURST_MS 100
+
+struct sg_rate_lim {
+    int64_t bytes_ps;   /* bytes per second, 0 -> not limited */
+    int64_t iops;       /* commands per second, 0 -> not limited */
+    uint64_t b_tat_ns;  /* next theoretical arrival time of each bucket, */
+    uint64_t c_tat_ns;  /* only touched by sg_rate_lim_*() */
+};
+
+/* Sets or changes the limits; may be called while other threads are in
+ * sg_rate_lim_wait(). Negative values are treated as 0 (not limited). */
+void sg_rate_lim_set(struct sg_rate_lim * rlp, int64_t bytes_ps,
+                     int64_t iops);
+
+/* Decodes 'arg' of the form BPS[,IOPS] where BPS may have a multiplier
+ * suffix (e.g. '200m') and sets the limits via sg_rate_lim_set(). If 'arg'
+ * starts with '@' then the rest of 'arg' is a file name and BPS[,IOPS] is
+ * read from the start of that file. Returns true on success; on failure
+ * the limits are unchanged. */
+bool sg_rate_lim_parse(struct sg_rate_lim * rlp, const char * arg);
+
+/* Blocks the caller until 'num_bytes' and 'num_cmds' can be sent without
+ * exceeding the limits then charges them. Returns at once if neither limit
+ * is set or this OS lacks a monotonic clock. */
+void sg_rate_lim_wait(struct sg_rate_lim * rlp, uint64_t num_bytes,
+                      int num_cmds);
+
 /* Returns OS page size in bytes. If uncertain returns 4096. */
 uint32_t sg_get_page_size(void);
 
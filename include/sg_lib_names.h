@@ -24,6 +24,10 @@ extern struct sg_lib_simple_value_name_t sg_lib_names_vpd_arr[];
 extern const size_t sg_lib_names_mode_len;
 extern const size_t sg_lib_names_vpd_len;
 
+/* Binary searches of the above arrays, NULL returned if not found */
+const char * sg_lib_names_mode_find(int value);
+const char * sg_lib_names_vpd_find(int value);
+
 #ifdef __cplusplus
 }
 #endif
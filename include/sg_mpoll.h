@@ -0,0 +1,90 @@
+#ifndef SG_MPOLL_H
+#define SG_MPOLL_H
+
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/* Progress polling of long running commands (e.g. FORMAT UNIT and
+ * SANITIZE) that have been started with the IMMED bit set on several
+ * devices. One loop polls every device that is still busy, with TEST UNIT
+ * READY or REQUEST SENSE. The wait between rounds starts short and doubles
+ * up to a maximum, but is never much beyond the time the nearest device
+ * expects to finish. After each round a table with the progress and
+ * estimated time to completion of each device is output. */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sg_json.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SG_MPOLL_DEF_MIN_SECS 5
+#define SG_MPOLL_DEF_MAX_SECS 60
+
+struct sg_mpoll_dev {
+    bool active;        /* command started, not yet seen to finish */
+    bool started;       /* command was started (perhaps without IMMED) */
+    bool use_rs;        /* poll with REQUEST SENSE, else TEST UNIT READY */
+    bool until_ready;   /* TEST UNIT READY only, NOT READY means active */
+    bool desc;          /* DESC bit in REQUEST SENSE cdb */
+    int sg_fd;          /* open device file descriptor or -1 */
+    int res;            /* 0 or an exit status (e.g. SG_LIB_CAT_*) */
+    int progress;       /* last progress indication (0 to 65535), or -1 */
+    int num_polls;
+    int64_t start_ms;   /* monotonic time when the command was started */
+    int64_t end_ms;     /* monotonic time it was seen to finish, or 0 */
+    const char * dev_name;
+};
+
+struct sg_mpoll_opts {
+    int min_secs;       /* wait before the first round, 0 -> default */
+    int max_secs;       /* longest wait between rounds, 0 -> default */
+    int verbose;
+};
+
+/* Monotonic time in milliseconds (arbitrary origin). */
+int64_t sg_mpoll_now_ms(void);
+
+/* Sleeps for ms milliseconds. */
+void sg_mpoll_sleep_ms(int ms);
+
+/* Call once the command has been started on the device open on sg_fd.
+ * If immed is true, the device is polled by sg_mpoll_run(), otherwise
+ * the command has already finished with result res. */
+void sg_mpoll_started(struct sg_mpoll_dev * mdp, int sg_fd, bool immed,
+                      int res);
+
+/* Polls the active element mdp once. For callers with their own event
+ * loop (e.g. one that is still starting commands on other devices). */
+void sg_mpoll_poll(struct sg_mpoll_dev * mdp, int verbose);
+
+/* Polls all active elements of mdp_arr until none are left. The table
+ * headed by cmd_name (e.g. "FORMAT UNIT") is output with sgj_pr_hr() so
+ * it is suppressed when jsp is outputting JSON. Returns the number of
+ * elements whose res is other than 0. */
+int sg_mpoll_run(struct sg_mpoll_dev * mdp_arr, int num,
+                 const char * cmd_name, const struct sg_mpoll_opts * mop,
+                 sgj_state * jsp);
+
+/* Adds an array named "device_list" to jop, one object per element of
+ * mdp_arr with "device_name", "started", "exit_status" (and its meaning),
+ * "number_of_polls", "elapsed_seconds" and, when known, the last
+ * "progress_percent". Returns that array or NULL if JSON output is not
+ * active. */
+sgj_opaque_p sg_mpoll_js(sgj_state * jsp, sgj_opaque_p jop,
+                         const struct sg_mpoll_dev * mdp_arr, int num);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif          /* SG_MPOLL_H */
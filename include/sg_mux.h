@@ -0,0 +1,184 @@
+#ifndef SG_MUX_H
+#define SG_MUX_H
+
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/* Completion multiplexer for commands started with do_scsi_pt_submit() on
+ * many devices at once. Each device file descriptor is registered with
+ * one epoll instance (Linux); a single thread then waits on all of them
+ * and, as responses arrive, fetches them with do_scsi_pt_receive() and
+ * calls the done() callback of each command. Devices that cannot be
+ * polled (e.g. bsg and NVMe) complete their commands at submission and
+ * the callback is made by the next sg_mux_run(). A mux is not shared
+ * between threads, a program wanting more than one thread for its
+ * completions uses a mux per thread. Those muxes may register the same
+ * device fd since packet ids are unique within the process.
+ *
+ * A command may also have a soft deadline, much shorter than the timeout
+ * given to the kernel. Deadlines are kept on a two level timer wheel so
+ * that arming, cancelling and expiring each cost O(1) however many
+ * commands are in flight. When one passes, expired() chooses between
+ * waiting longer, a reset (then waiting) and giving up on the command.
+ * A command given up on (released) is still held by the kernel, which may
+ * write its data-in buffer (directly with dio) until it responds. So the
+ * mux takes its pt object: done() sees ptp as NULL and the late response
+ * is read, and discarded, by a later sg_mux_run() which then hands the pt
+ * object, and so the buffers set in it, back through reclaim().
+ *
+ * An adaptive concurrency controller may be turned on with
+ * sg_mux_set_aimd(). Then each device has a window: the number of its
+ * commands that may be in flight; each host (HBA, as reported by the
+ * SCSI_IOCTL_GET_IDLUN ioctl) may also have one for all its devices in
+ * that mux. A command submitted when either window is full is held by the
+ * mux, in submission order per device, until completions make room. The
+ * windows follow AIMD (additive increase, multiplicative decrease): a good
+ * response grows its device's window by 1/window when that window was
+ * full, so by about one command per round trip. A device's window shrinks
+ * by a quarter when its smoothed latency is above target, and is halved by
+ * BUSY or TASK SET FULL (the latter also caps it below the number that
+ * were in flight) or an expired soft deadline; at most once per round
+ * trip. BUSY halves the host's window as well. Responses, including BUSY
+ * and TASK SET FULL, still go to done() which decides whether to submit
+ * the command again. */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sg_pt.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct sg_mux;
+
+/* Return values of the expired() callback */
+#define SG_MUX_EXP_RELEASE 0    /* done() now, res is -ETIMEDOUT */
+#define SG_MUX_EXP_WAIT 1       /* wait another soft_ms */
+#define SG_MUX_EXP_RESET_LU 2   /* logical unit reset, then wait */
+#define SG_MUX_EXP_RESET_TARGET 3       /* target reset, then wait */
+
+/* One command. Fields marked [in] are set by the caller before
+ * sg_mux_submit(); the caller owns the storage which must stay valid
+ * until done() is called. */
+struct sg_mux_cmd {
+    int fd;             /* [in] device, registered with sg_mux_add_fd() */
+    int timeout_secs;   /* [in] */
+    int soft_ms;        /* [in] soft deadline after submission, 0: none */
+    int num_expired;    /* times the soft deadline has passed */
+    int res;            /* do_scsi_pt_receive() result, 0 is good */
+    int cat;            /* SG_LIB_CAT_* of the response, 0 is good;
+                         * SG_LIB_CAT_TIMEOUT when released */
+    struct sg_pt_base * ptp;    /* [in] cdb, buffers, sense set up */
+    void * ctx;         /* [in] for the caller, not used by the mux */
+    /* [in] called from sg_mux_run() once the response is in ptp; may
+     * submit further commands (e.g. to the same device). ptp is NULL if
+     * the command was released */
+    void (*done)(struct sg_mux_cmd * mcp, void * ctx);
+    /* [in] called from sg_mux_run() each time the soft deadline passes,
+     * returns one of SG_MUX_EXP_*. NULL acts as SG_MUX_EXP_RELEASE */
+    int (*expired)(struct sg_mux_cmd * mcp, void * ctx);
+    /* [in] called from sg_mux_run() with the pt object of a released
+     * command once its late response has been read: ptp, and the buffers
+     * set in it, may then be reused or freed. NULL: the mux destructs ptp
+     * and the buffers must outlive the file descriptor */
+    void (*reclaim)(struct sg_pt_base * ptp, void * ctx);
+    /* the rest are used by the mux */
+    int64_t t_sub_us;   /* when sent to the device */
+    int64_t tw_tick;
+    struct sg_mux_cmd * tw_next;
+    struct sg_mux_cmd ** tw_pprev;      /* NULL when not on the wheel */
+    struct sg_mux_cmd * next;
+};
+
+/* Returns a new mux or NULL with errno set (ENOSYS when the OS has no
+ * suitable mechanism, then commands are best done with do_scsi_pt()). */
+struct sg_mux * sg_mux_new(int verbose);
+
+/* Closes the epoll instance and frees mxp (may be NULL). The registered
+ * file descriptors are not closed. Commands still in flight are
+ * abandoned, their done() callbacks are not made. The pt objects of
+ * released commands still waiting for their responses are handed back
+ * as described for reclaim(), so close the file descriptors first. */
+void sg_mux_free(struct sg_mux * mxp);
+
+/* Registers device fd, setting O_NONBLOCK on it. Returns 0 or a negated
+ * errno. */
+int sg_mux_add_fd(struct sg_mux * mxp, int fd);
+
+/* Removes fd. Returns 0, -EBUSY if it has commands in flight (including
+ * released ones whose responses have not come), or -ENOENT if it was not
+ * registered. */
+int sg_mux_del_fd(struct sg_mux * mxp, int fd);
+
+/* Starts mcp with do_scsi_pt_submit(), after giving it a packet id unique
+ * within the process. Returns 0, in which case done() will be called later, or
+ * the value from do_scsi_pt_submit() (negated errno or SCSI_PT_DO_*),
+ * in which case it will not. With the adaptive controller on mcp may be
+ * held and started later; if do_scsi_pt_submit() then fails done() is
+ * called with its value in res. */
+int sg_mux_submit(struct sg_mux * mxp, struct sg_mux_cmd * mcp);
+
+/* Waits up to timeout_ms milliseconds (-1 for no limit, 0 to check and
+ * return at once) for responses, then calls done() of each command whose
+ * response has arrived and reclaim() of each released command whose late
+ * response has. The wait is shortened so that expired() is called close
+ * to (within a few milliseconds after) each soft deadline. Returns the
+ * number of done() calls or a negated errno. Returns 0 at once if nothing
+ * is in flight and no released command is outstanding. */
+int sg_mux_run(struct sg_mux * mxp, int timeout_ms);
+
+/* Number of commands submitted whose done() has not yet been called */
+int sg_mux_in_flight(const struct sg_mux * mxp);
+
+/* Number of released commands whose late response has not yet been read,
+ * each holds one of the sg driver's request slots on its device */
+int sg_mux_num_released(const struct sg_mux * mxp);
+
+/* Limits of the adaptive concurrency controller, zeroed fields take the
+ * defaults */
+struct sg_mux_aimd {
+    int max_dev;        /* largest window per device, 0: 64 */
+    int max_host;       /* largest (and first) window per host, 0: none */
+    int init_dev;       /* first window per device, 0: 4 */
+    int lat_target_us;  /* congested above this smoothed latency; 0: above
+                         * lat_pct percent of the lowest latency seen in
+                         * the last 5 to 10 seconds */
+    int lat_pct;        /* 0: 300 */
+};
+
+struct sg_mux_aimd_stats {
+    int win;            /* window of the device, in whole commands */
+    int in_flight;      /* sent to the device */
+    int held;           /* held by the mux until there is room */
+    int host;           /* host number, -1 if not known */
+    int host_win;       /* window of that host, 0 if it has none */
+    int64_t min_lat_us; /* lowest recent latency, 0 if none yet */
+    int64_t srtt_us;    /* smoothed latency */
+    uint64_t num_inc;   /* times the window grew by a whole command */
+    uint64_t num_dec;   /* times it shrank, for whatever reason */
+    uint64_t num_busy;  /* BUSY and TASK SET FULL responses */
+};
+
+/* Turns the adaptive concurrency controller on with the limits in *ap, or
+ * off if ap is NULL. Devices start with a window of init_dev. Returns 0,
+ * or -EBUSY if any commands are in flight. */
+int sg_mux_set_aimd(struct sg_mux * mxp, const struct sg_mux_aimd * ap);
+
+/* Places the controller's view of device fd in *sp. Returns 0, -ENOENT if
+ * fd is not registered, or -EINVAL if the controller is off. */
+int sg_mux_get_aimd_stats(const struct sg_mux * mxp, int fd,
+                          struct sg_mux_aimd_stats * sp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif          /* SG_MUX_H */
@@ -0,0 +1,61 @@
+#ifndef SG_PAR_H
+#define SG_PAR_H
+
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/* A pool of threads for utilities with a --parallel=Q option. The work is
+ * split into jobs numbered from 0 (e.g. one per DEVICE, per zone run or per
+ * chunk of LBAs) and each thread, the caller being one of them, takes the
+ * lowest numbered job not yet taken until none are left. Where POSIX
+ * threads are not available the jobs are done one after another by the
+ * caller. */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SG_PAR_MAX 256          /* most threads in one pool */
+
+/* Job k of num. If a job returns other than 0 no further jobs are started
+ * (those already started are finished). */
+typedef int (*sg_par_fn)(int64_t k, void * ctx);
+
+/* Decodes the argument of a --parallel= option, which should be a number
+ * from min_par (0 or 1) to max_par. Returns that number, or -1 after
+ * reporting a bad argument on stderr. */
+int sg_par_get_num(const char * arg, int min_par, int max_par);
+
+/* Calls fn(k, ctx) for k from 0 to num - 1 on a pool of at most num_par
+ * threads (and no more than SG_PAR_MAX). Calls are started in order of k.
+ * Returns the value of the first job that returned other than 0, or 0. */
+int sg_par_each(int64_t num, int num_par, sg_par_fn fn, void * ctx);
+
+/* Like sg_par_each() but grp_arr[k] (0 or more) names a group for each k
+ * and at most per_grp jobs of any one group run at once (e.g. commands to
+ * logical units owned by the same controller). Jobs are started in order
+ * of k, as far as the group limits allow. */
+int sg_par_each_grouped(int64_t num, int num_par, int per_grp,
+                        const int * grp_arr, sg_par_fn fn, void * ctx);
+
+/* Serialize the updates that jobs make to state they share (e.g. counts
+ * and progress reports). The lock is not held while a job is running
+ * unless the job itself takes it; it should not be held while calling
+ * sg_par_each(). */
+void sg_par_lock(void);
+void sg_par_unlock(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif          /* SG_PAR_H */
@@ -0,0 +1,76 @@
+#ifndef SG_PAT_H
+#define SG_PAT_H
+
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/* Built-in data patterns for utilities that write. Given in place of an
+ * input file name as "pat:<pattern>", so the data is generated in the
+ * transfer buffer rather than read from /dev/zero or a pattern file. The
+ * <pattern> is one of:
+ *     zero            each byte is 0x0
+ *     ff              each byte is 0xff
+ *     <hex>           the given 1 to SG_PAT_MAX_BYTES bytes, e.g. "deadbeef"
+ *                     or "0xa55a", repeated from the start of each block
+ *     lba             each 8 bytes of a block hold its LBA, big endian
+ *     prng[,<seed>]   pseudo random bytes that depend only on seed and
+ *                     the LBA, so any block can be regenerated to check it
+ * The first three do not depend on the LBA so a buffer once filled can be
+ * written again and again. */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SG_PAT_PREFIX "pat:"
+#define SG_PAT_MAX_BYTES 64
+
+enum sg_pat_kind {
+    SG_PAT_NONE = 0,
+    SG_PAT_BYTES,       /* zero, ff and <hex> */
+    SG_PAT_LBA,
+    SG_PAT_PRNG,
+};
+
+struct sg_pat {
+    enum sg_pat_kind kind;
+    bool seed_given;            /* prng,<seed> rather than a random seed */
+    int num_bytes;              /* SG_PAT_BYTES: 1 to SG_PAT_MAX_BYTES */
+    uint8_t bytes[SG_PAT_MAX_BYTES];
+    uint64_t seed;              /* SG_PAT_PRNG */
+};
+
+/* Returns true if name (e.g. given as if=) starts with SG_PAT_PREFIX */
+bool sg_pat_is_pat(const char * name);
+
+/* Decodes name, which should start with SG_PAT_PREFIX, into *pp. Without
+ * a seed, prng takes one from getrandom() (or the time). Returns false if
+ * name is not a valid pattern. */
+bool sg_pat_parse(const char * name, struct sg_pat * pp);
+
+/* True if the pattern is the same for every block */
+bool sg_pat_lba_indep(const struct sg_pat * pp);
+
+/* Fills num_blks blocks of blk_sz bytes at bp with the pattern, the first
+ * block being at lba. */
+void sg_pat_fill(const struct sg_pat * pp, uint8_t * bp, int blk_sz,
+                 uint64_t lba, int num_blks);
+
+/* Places the pattern in b, in the form that sg_pat_parse() accepts and
+ * with the seed that prng is using. Returns b. */
+char * sg_pat_str(const struct sg_pat * pp, char * b, int blen);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif          /* SG_PAT_H */
@@ -0,0 +1,93 @@
+#ifndef SG_PI_H
+#define SG_PI_H
+
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/* Generation and checking of T10 protection information (PI, also known
+ * as DIF) by the application client, as defined in SBC-4 for Type 1, 2
+ * and 3 protection. Each logical block is followed by an 8 byte tuple: a
+ * 2 byte guard (CRC16 T10-DIF of the block's data), a 2 byte application
+ * tag and a 4 byte reference tag, all big endian. Tuples are either
+ * interleaved with the data (as SCSI transfers them) or held in a
+ * separate metadata buffer (as NVMe can, see set_pt_metadata_xfer()). */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SG_PI_TUPLE_LEN 8
+
+#define SG_PI_APP_ESCAPE 0xffff         /* tuple not checked when app tag */
+#define SG_PI_REF_ESCAPE 0xffffffff     /* ... and, for Type 3, ref tag */
+
+/* Returned by sg_pi_verify() */
+#define SG_PI_OK 0
+#define SG_PI_BAD_GUARD 1
+#define SG_PI_BAD_APP_TAG 2
+#define SG_PI_BAD_REF_TAG 3
+
+struct sg_pi_ctx {
+    int prot_type;      /* 1, 2 or 3 */
+    uint32_t blk_len;   /* logical block length, not including the tuple */
+    uint16_t app_tag;   /* placed by sg_pi_generate() */
+    uint16_t app_mask;  /* app_tag bits sg_pi_verify() checks, 0 -> none */
+    /* Type 2: expected initial ref tag, incremented for each block. Type 3:
+     * ref tag placed in each tuple, checked if chk_ref3 is true. Ignored by
+     * Type 1 which uses the low 32 bits of each block's LBA. */
+    uint32_t ref_tag;
+    bool chk_ref3;
+};
+
+/* CRC16 T10-DIF (polynomial 0x8bb7, not reflected, no final xor), 0 is
+ * the initial value of crc. On x86_64 this uses carry-less multiply
+ * (PCLMULQDQ) when the CPU has it, otherwise (and elsewhere) a slice-by-8
+ * table. */
+uint16_t sg_pi_crc16(uint16_t crc, const void * p, size_t len);
+/* Returns true if sg_pi_crc16() uses CPU instructions */
+bool sg_pi_crc16_hw(void);
+/* Builds the table and checks the CPU; called by the first use of
+ * sg_pi_crc16() so should be called before any threads do. */
+void sg_pi_init(void);
+
+/* Places a tuple for each of num_blks blocks starting at lba. When pip is
+ * NULL the tuples are interleaved: bp holds num_blks * (blk_len + 8) bytes
+ * and each tuple is written after its block. Otherwise bp holds the data
+ * contiguously and the tuples are written to pip. */
+void sg_pi_generate(const struct sg_pi_ctx * pcp, uint64_t lba, int num_blks,
+                    uint8_t * bp, uint8_t * pip);
+
+/* Checks the tuples of num_blks blocks starting at lba, laid out as for
+ * sg_pi_generate(). Returns SG_PI_OK or the SG_PI_BAD_* value of the first
+ * failing block, whose index is then placed in *bad_idxp (if non-NULL). */
+int sg_pi_verify(const struct sg_pi_ctx * pcp, uint64_t lba, int num_blks,
+                 const uint8_t * bp, const uint8_t * pip, int * bad_idxp);
+
+/* Copies num_blks blocks of blk_len bytes from dp to ip leaving room for
+ * a tuple after each. If pip is given the tuples are copied from there,
+ * otherwise their space is untouched (for sg_pi_generate()). */
+void sg_pi_interleave(uint32_t blk_len, int num_blks, const uint8_t * dp,
+                      const uint8_t * pip, uint8_t * ip);
+/* The inverse of sg_pi_interleave(); pip may be NULL to discard tuples.
+ * ip and dp may be the same buffer. */
+void sg_pi_deinterleave(uint32_t blk_len, int num_blks, const uint8_t * ip,
+                        uint8_t * dp, uint8_t * pip);
+
+/* Returns a string for a SG_PI_* value */
+const char * sg_pi_err_str(int pi_err);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* SG_PI_H */
@@ -2,7 +2,7 @@
 #define SG_PR2SERR_H
 
 /*
- * Copyright (c) 2004-2023 Douglas Gilbert.
+ * Copyright (c) 2004-2026 Douglas Gilbert.
  * All rights reserved.
  * Use of this source code is governed by a BSD-style
  * license that can be found in the BSD_LICENSE file.
@@ -12,6 +12,7 @@
 
 #include <inttypes.h>
 #include <stdio.h>
+#include <stdarg.h>
 #include <stdbool.h>
 
 #ifdef __cplusplus
@@ -65,6 +66,36 @@ int sg_scnpr(char * cp, int cp_max_len, const char * fmt, ...) __printf(3, 4);
 int sg_scn3pr(char * fcp, int fcp_len, int off,
               const char * fmt, ...) __printf(4, 5);
 
+/* Asynchronous logging for multi-threaded utilities. Once sg_log_start()
+ * has been called, the output of pr2serr(), pr2ws() (when it would go to
+ * stderr) and sg_log_vpr() is formatted into a buffer private to the
+ * calling thread and written to stderr by a logger thread. So the callers
+ * neither block on stderr nor on one another. Each message (up to 1023
+ * characters, longer ones are truncated) is kept whole and the messages of
+ * one thread stay in order. When a thread's buffer is full its messages are
+ * dropped and counted; the logger thread reports how many were dropped.
+ * buf_sz is the size in bytes of each thread's buffer (rounded up to a
+ * power of 2), 0 selects the default of 64 KiB. Returns 0 on success,
+ * otherwise an errno value: ENOSYS where this is not supported, in which
+ * case the output goes to stderr as before. Not for use from signal
+ * handlers. */
+int sg_log_start(int buf_sz);
+
+/* Waits for the logger thread to write everything that is buffered then
+ * stops it; output then goes directly to stderr again. Also called at
+ * exit() when sg_log_start() has been successful. */
+void sg_log_stop(void);
+
+/* True between sg_log_start() and sg_log_stop() . */
+bool sg_log_active(void);
+
+/* Number of messages dropped because a thread's buffer was full. */
+uint64_t sg_log_dropped(void);
+
+/* Like vfprintf(stderr, fmt, args) but goes through the logger thread when
+ * it is active. For pr2serr()-like helpers in utilities. */
+int sg_log_vpr(const char * fmt, va_list args);
+
 #ifdef __cplusplus
 }
 #endif
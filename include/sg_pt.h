@@ -2,7 +2,7 @@
 #define SG_PT_H
 
 /*
- * Copyright (c) 2005-2021 Douglas Gilbert.
+ * Copyright (c) 2005-2026 Douglas Gilbert.
  * All rights reserved.
  * Use of this source code is governed by a BSD-style
  * license that can be found in the BSD_LICENSE file.
@@ -12,6 +12,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -145,6 +146,11 @@ void set_scsi_pt_task_attr(struct sg_pt_base * objp, int attribute,
  * are given, use the pass-through default. */
 #define SCSI_PT_FLAGS_QUEUE_AT_TAIL 0x10
 #define SCSI_PT_FLAGS_QUEUE_AT_HEAD 0x20
+/* Use polled rather than interrupt driven completion where available:
+ * Linux sg driver 4.0.45+ (SGV4_FLAG_POLLED, spins briefly then falls
+ * back to sleeping) and NVMe NVM commands on the io_uring engine (see
+ * SG3_UTILS_LINUX_URING). Otherwise ignored. */
+#define SCSI_PT_FLAGS_POLLED 0x40
 /* Set (potentially OS dependent) flags for pass-through mechanism.
  * Apart from contradictions, flags can be OR-ed together. */
 void set_scsi_pt_flags(struct sg_pt_base * objp, int flags);
@@ -178,6 +184,68 @@ int do_scsi_pt(struct sg_pt_base * objp, int fd, int timeout_secs,
 int do_nvm_pt(struct sg_pt_base * objp, int submq, int timeout_secs,
               int verbose);
 
+/* Following is a guard which is defined when do_scsi_pt_submit() and
+ * do_scsi_pt_receive() are present. Older versions of this library may not
+ * have these functions. */
+#define SCSI_PT_ASYNC_FUNCTIONS 1
+/* Asynchronous (split) alternative to do_scsi_pt(). do_scsi_pt_submit()
+ * issues the command held in *objp and returns without waiting for it to
+ * complete; the response is later fetched with do_scsi_pt_receive() using
+ * the same objp. Several objects can be in flight on the same file
+ * descriptor at once, each should be given a unique pack_id (see
+ * set_scsi_pt_packet_id()) before submission so that
+ * do_scsi_pt_receive() fetches the response belonging to objp. Return
+ * values are as for do_scsi_pt(). Where the OS or device (e.g. NVMe or
+ * Linux bsg) has no asynchronous pass-through, do_scsi_pt_submit() does
+ * the command synchronously and do_scsi_pt_receive() then returns 0
+ * immediately. */
+int do_scsi_pt_submit(struct sg_pt_base * objp, int fd, int timeout_secs,
+                      int verbose);
+
+/* Asynchronous alternative to do_nvm_pt() for NVMe NVM commands. The
+ * completion is fetched with do_scsi_pt_receive(). Falls back to
+ * synchronous operation in the same way as do_scsi_pt_submit(). */
+int do_nvm_pt_submit(struct sg_pt_base * objp, int submq, int timeout_secs,
+                     int verbose);
+
+/* Fetches the response of a command previously started with
+ * do_scsi_pt_submit() into objp. After that the get_scsi_pt_*() functions
+ * can be used as they are after do_scsi_pt(). If 'fd' was opened
+ * O_NONBLOCK (scsi_pt_open_device() does that) and the response is not
+ * yet available then -EAGAIN is returned, otherwise this call waits for
+ * the response. Returns 0 if okay, otherwise values as for do_scsi_pt(). */
+int do_scsi_pt_receive(struct sg_pt_base * objp, int fd, int verbose);
+
+/* Waits up to 'timeout_ms' milliseconds (-1 for no limit, 0 to check and
+ * return at once) for at least one response of an asynchronous command
+ * started on 'fd' to become available. Returns 1 if so, 0 on timeout or
+ * a negated errno. Always returns 1 when do_scsi_pt_submit() completes
+ * commands synchronously. */
+int scsi_pt_wait_for_response(int fd, int timeout_ms, int verbose);
+
+/* Following is a guard which is defined when do_scsi_pt_mrq() is present.
+ * Older versions of this library may not have this function. */
+#define SCSI_PT_MRQ_FUNCTION 1
+/* Issues a batch of 'num' commands, each held in its own object in the
+ * array 'objp_arr', to the same device. For the Linux sg driver (version
+ * 4.0.45 or later) the whole batch is sent with a single ioctl using the
+ * multiple requests (mrq) feature; otherwise the commands are issued one
+ * after the other with do_scsi_pt(). The number of commands completed is
+ * placed in *num_donep (if non-NULL); those are the first objects in
+ * objp_arr and the get_scsi_pt_*() functions then report the status,
+ * sense data and residual of each one. Returns 0 if all 'num' commands
+ * were done, otherwise values as for do_scsi_pt() (from the first
+ * command that failed or from the mrq ioctl). */
+int do_scsi_pt_mrq(struct sg_pt_base * objp_arr[], int num, int fd,
+                   int timeout_secs, int * num_donep, int verbose);
+
+/* do_scsi_pt_mrq() for OS interfaces without a batched submission: issues
+ * the commands in objp_arr one after the other with do_scsi_pt(), stopping
+ * at the first that fails. Arguments and return value as for
+ * do_scsi_pt_mrq(). */
+int sg_pt_mrq_sequential(struct sg_pt_base * objp_arr[], int num, int fd,
+                         int timeout_secs, int * num_donep, int verbose);
+
 #define SCSI_PT_RESULT_GOOD 0
 #define SCSI_PT_RESULT_STATUS 1 /* other than GOOD and CHECK CONDITION */
 #define SCSI_PT_RESULT_SENSE 2
@@ -242,6 +310,163 @@ int get_scsi_pt_duration_ms(const struct sg_pt_base * objp);
  * lower layers (and hardware) took to execute the command just completed. */
 uint64_t get_pt_duration_ns(const struct sg_pt_base * objp);
 
+/* Following is a guard which is defined when the sg_pt_lat_*() functions
+ * are present. Older versions of this library may not have them. */
+#define SCSI_PT_LAT_FUNCTIONS 1
+#define SG_PT_LAT_NUM_BUCKETS 64
+#define SG_PT_LAT_SCSI 0        /* values for sg_pt_lat_hist::cmd_set */
+#define SG_PT_LAT_NVME_ADMIN 1
+#define SG_PT_LAT_NVME_NVM 2
+
+/* Latency histogram of one opcode sent to one device. Bucket 0 counts
+ * latencies under 1024 nanoseconds, bucket 63 those of 2**41 nanoseconds
+ * (about 37 minutes) or more. In between there are 2 buckets for each
+ * power of two, see sg_pt_lat_bucket_ns() . */
+struct sg_pt_lat_hist {
+    uint64_t dev_id;    /* OS device identifier (e.g. st_rdev), 0: unknown */
+    uint64_t count;
+    uint64_t sum_ns;
+    uint64_t min_ns;
+    uint64_t max_ns;
+    uint64_t bucket[SG_PT_LAT_NUM_BUCKETS];
+    uint8_t opcode;
+    uint8_t cmd_set;    /* SG_PT_LAT_SCSI, SG_PT_LAT_NVME_ADMIN or _NVM */
+};
+
+/* When enabled, the elapsed time of each command sent by do_scsi_pt() and
+ * do_nvm_pt() is accumulated into a per-thread histogram keyed by device
+ * and opcode (up to 128 per thread, then further keys are dropped).
+ * Disabled by default. Returns true if this build supports it; currently
+ * Linux only. */
+bool sg_pt_lat_enable(bool enable);
+bool sg_pt_lat_is_enabled(void);
+
+/* Adds one command's elapsed time to this thread's histograms. Called by
+ * the pass-through code but also available for applications that time
+ * their own commands. Does nothing if not enabled. */
+void sg_pt_lat_record(uint64_t dev_id, uint8_t opcode, int cmd_set,
+                      uint64_t elapsed_ns);
+
+/* Merges the histograms of all threads into 'arr' which has room for
+ * 'max_num' elements, one per device+opcode, without stopping other
+ * threads. Returns the number of elements written. If 'reset' is true
+ * all counters are then cleared (each thread clears its own on its next
+ * command). */
+int sg_pt_lat_snapshot(struct sg_pt_lat_hist * arr, int max_num,
+                       bool reset);
+
+/* Returns the lowest elapsed time (in nanoseconds) counted by bucket
+ * 'k'. */
+uint64_t sg_pt_lat_bucket_ns(int k);
+
+/* Returns the index of the bucket that counts an elapsed time of 'ns'
+ * nanoseconds, as sg_pt_lat_record() does. For programs that keep their
+ * own histograms in a struct sg_pt_lat_hist. */
+int sg_pt_lat_bucket_idx(uint64_t ns);
+
+/* Returns an upper bound (in nanoseconds) of the percentile 'pct' (e.g.
+ * 99.9) of the latencies in *hp; 0 if hp->count is 0. */
+uint64_t sg_pt_lat_percentile(const struct sg_pt_lat_hist * hp, double pct);
+
+/* Following is a guard which is defined when the sg_pt_trace_*()
+ * functions and set_pt_trace() are present. */
+#define SCSI_PT_TRACE_FUNCTIONS 1
+#define SG_PT_TRACE_SUBMIT 1    /* values for sg_pt_trace_rec::event */
+#define SG_PT_TRACE_COMPLETE 2
+#define SG_PT_TRACE_CMD_MAX 64  /* NVMe commands are 64 bytes long */
+
+/* One trace event, passed to the trace callback. Fixed size so it can be
+ * copied into a ring buffer. Fields marked "complete" are 0 in submit
+ * events. */
+struct sg_pt_trace_rec {
+    uint64_t seq;       /* process wide, incremented for each command */
+    uint64_t ts_ns;     /* CLOCK_MONOTONIC time of this event */
+    uint64_t dev_id;    /* as sg_pt_lat_hist::dev_id */
+    uint64_t duration_ns;       /* complete: since the submit event */
+    int32_t result;     /* complete: do_scsi_pt() or do_nvm_pt() result */
+    uint32_t status;    /* complete: SCSI status or NVMe SCT|SC */
+    int32_t resid;      /* complete: data-in (else data-out) residual */
+    uint32_t tid;       /* OS thread id */
+    uint32_t din_len;   /* data-in bytes requested */
+    uint32_t dout_len;  /* data-out bytes requested */
+    uint8_t event;      /* SG_PT_TRACE_SUBMIT or SG_PT_TRACE_COMPLETE */
+    uint8_t cmd_set;    /* SG_PT_LAT_SCSI, SG_PT_LAT_NVME_ADMIN or _NVM */
+    uint8_t cmd_len;    /* bytes in cmd[], longer commands are truncated */
+    uint8_t sense_key;  /* complete: from sense data, if any */
+    uint8_t asc;
+    uint8_t ascq;
+    uint8_t reserved[2];
+    uint8_t cmd[SG_PT_TRACE_CMD_MAX];   /* cdb or NVMe command */
+};
+
+/* Trace callback, invoked in the thread issuing the command, before it is
+ * sent and after it completes. Should be quick and must not issue pass-
+ * through commands itself. */
+typedef void (*sg_pt_trace_fn)(const struct sg_pt_trace_rec * trp,
+                               void * priv);
+
+/* Sets (or clears with fn=NULL) the callback used for all commands sent
+ * by do_scsi_pt() and do_nvm_pt() from pt objects without their own (see
+ * set_pt_trace()). When no callback is set the cost per command is one
+ * test of a flag that is also used by sg_pt_lat_*() . To swap one callback
+ * for another, set NULL first. Returns true if this build supports it;
+ * currently Linux only. */
+bool sg_pt_trace_set(sg_pt_trace_fn fn, void * priv);
+
+/* Sets (or clears with fn=NULL) the callback used for commands sent using
+ * objp, overriding the one given to sg_pt_trace_set(). Survives
+ * clear_scsi_pt_obj(). Returns false if not supported. */
+bool set_pt_trace(struct sg_pt_base * objp, sg_pt_trace_fn fn,
+                  void * priv);
+
+/* Built-in trace sink: a ring buffer of the last 'num_recs' (rounded up
+ * to a power of two) events. Pass sg_pt_trace_ring_fn (priv ignored) to
+ * sg_pt_trace_set() or set_pt_trace() once sg_pt_trace_ring_init() has
+ * succeeded. Threads add records without taking locks. num_recs of 0
+ * frees the ring (after the callback has been cleared). Returns 0 or an
+ * errno value. */
+int sg_pt_trace_ring_init(int num_recs);
+void sg_pt_trace_ring_fn(const struct sg_pt_trace_rec * trp, void * priv);
+
+/* Writes the ring to 'fd', oldest first. If 'text' is true one line per
+ * record (as sg_pt_trace_rec_str() ), otherwise a struct
+ * sg_pt_trace_ring_hdr followed by the records as is. Only calls write()
+ * so it can be used from a signal handler. Returns the number of records
+ * written or a negated errno value. */
+int sg_pt_trace_ring_dump(int fd, bool text);
+
+/* Installs a handler for signal 'sig_num' (e.g. SIGUSR2) that calls
+ * sg_pt_trace_ring_dump(fd, text). Returns 0 or an errno value. */
+int sg_pt_trace_ring_dump_on_signal(int sig_num, int fd, bool text);
+
+#define SG_PT_TRACE_RING_MAGIC "sgpttrc1"
+
+/* Starts a binary dump, in host byte order */
+struct sg_pt_trace_ring_hdr {
+    char magic[8];      /* SG_PT_TRACE_RING_MAGIC, not NUL terminated */
+    uint32_t rec_sz;    /* sizeof(struct sg_pt_trace_rec) */
+    uint32_t num_recs;  /* that follow, 0 in a stream: read to end of file */
+    uint64_t total;     /* events given to the ring since init */
+};
+
+/* Built-in trace sink for capturing every command: rather than keeping
+ * the last events in a ring, each completion event (which holds the
+ * submit time as ts_ns less duration_ns) is appended to 'fd' in the binary
+ * dump format, buffered and written in large chunks. Pass
+ * sg_pt_trace_stream_fn (priv ignored) to sg_pt_trace_set() or
+ * set_pt_trace() once sg_pt_trace_stream_init() has succeeded. fd of -1
+ * flushes the buffer, completes the header (if fd is seekable) and ends
+ * the stream, after the callback has been cleared. Returns 0 or an errno
+ * value. */
+int sg_pt_trace_stream_init(int fd);
+void sg_pt_trace_stream_fn(const struct sg_pt_trace_rec * trp, void * priv);
+
+/* Places a one line (no trailing newline) description of *trp in 'b',
+ * which has 'blen' bytes, and returns b. 256 bytes is enough for a 16
+ * byte cdb, 420 bytes for a NVMe command. Does not use stdio. */
+char * sg_pt_trace_rec_str(const struct sg_pt_trace_rec * trp, int blen,
+                           char * b);
+
 /* The two functions yield requested and actual data transfer lengths in
  * bytes. The second argument is a pointer to the data-in length; the third
  * argument is a pointer to the data-out length. The pointers may be NULL.
@@ -272,17 +497,187 @@ uint32_t get_pt_nvme_nsid(const struct sg_pt_base * objp);
  * scsi_pt_close_device() ).  */
 void destruct_scsi_pt_obj(struct sg_pt_base * objp);
 
+/* Following is a guard which is defined when the sg_pt_pool_*() functions
+ * are present. Older versions of this library may not have them. */
+#define SCSI_PT_POOL_FUNCTIONS 1
+/* Each thread may have a pool of up to 32 pt objects and as many page
+ * sized, page aligned data buffers which are recycled rather than freed.
+ * The sg_ll_*() functions in sg_cmds_*.c draw their pt objects from the
+ * pool, so a long running thread that repeatedly sends commands does not
+ * churn the heap. The pool is disabled (max_objs is 0) until this
+ * function is called in a thread. Returns the size actually set (0 if
+ * thread local storage is not available). Lowering max_objs drains. */
+int sg_pt_pool_enable(int max_objs);
+
+/* Frees all pt objects and buffers held in this thread's pool. Done
+ * automatically when a thread (other than main) exits where pthreads are
+ * available. A pooled object keeps the file type of its dev_fd only while
+ * that file descriptor still refers to the same device. */
+void sg_pt_pool_drain(void);
+
+/* Like construct_scsi_pt_obj_with_fd() but takes a cleared object from
+ * this thread's pool if one is available. Release with
+ * sg_pt_pool_put_obj() rather than destruct_scsi_pt_obj(). */
+struct sg_pt_base * sg_pt_pool_get_obj(int dev_fd, int verbose);
+
+/* Returns objp to this thread's pool, or destructs it if the pool is
+ * disabled or full. Its registered buffers and trace callback are
+ * dropped. */
+void sg_pt_pool_put_obj(struct sg_pt_base * objp);
+
+/* Like sg_memalign(num_bytes, 0, buff_to_free, vb) (see sg_lib.h) but a
+ * request of up to a page is served from this thread's pool when a
+ * buffer is available. buff_to_free must not be NULL. Release with
+ * sg_pt_pool_put_buf() giving the same num_bytes. */
+uint8_t * sg_pt_pool_get_buf(uint32_t num_bytes, uint8_t ** buff_to_free,
+                             bool vb);
+void sg_pt_pool_put_buf(uint8_t * buff_to_free, uint32_t num_bytes);
+
+/* Following is a guard which is defined when the registered buffer
+ * functions are present. Older versions of this library may not have them.
+ * Registered buffers are long lived, page aligned data buffers that belong
+ * to objp (and its device) and are set up once so that the OS need not map
+ * user memory for each command. On Linux the sg driver's reserve buffer is
+ * mmap-ed (num must be 1, transfers use SG_FLAG_MMAP_IO and only one such
+ * command may be outstanding on the file descriptor), and for NVMe generic
+ * char devices using the io_uring engine the buffers become io_uring fixed
+ * buffers of the calling thread's ring. Otherwise plain page aligned
+ * buffers are given which still work, just without the zero-copy. */
+#define SCSI_PT_REG_BUFS_FUNCTIONS 1
+#define SCSI_PT_REG_BUFS_MAX 16
+
+/* Allocates (and if possible registers) num buffers of buf_len bytes each
+ * for the device already associated with objp. On success places the
+ * buffer addresses in bufs[] and returns 0. Otherwise returns a positive
+ * errno value (e.g. ENOTTY when not supported by this OS). Replaces any
+ * earlier registration on objp. */
+int sg_pt_reg_bufs(struct sg_pt_base * objp, int num, uint32_t buf_len,
+                   uint8_t * bufs[], int verbose);
+
+/* Releases the registered buffers of objp, destruct_scsi_pt_obj() and
+ * giving a different dev_fd to set_pt_file_handle() also do this. */
+void sg_pt_unreg_bufs(struct sg_pt_base * objp);
+
+/* Returns true if data in the registered buffers of objp move without
+ * the OS mapping them on each command (i.e. sg mmap or io_uring fixed). */
+bool sg_pt_reg_bufs_zero_copy(const struct sg_pt_base * objp);
+
+/* Like set_scsi_pt_data_in() and set_scsi_pt_data_out() but use the
+ * registered buffer at index buf_idx (origin 0) of objp. */
+void set_scsi_pt_data_in_reg(struct sg_pt_base * objp, int buf_idx,
+                             int dxfer_ilen);
+void set_scsi_pt_data_out_reg(struct sg_pt_base * objp, int buf_idx,
+                              int dxfer_olen);
+
+/* Following is a guard which is defined when the vectored data buffer
+ * functions are present. Older versions of this library may not have them.
+ * The data of one command may be spread over up to SCSI_PT_IOV_MAX
+ * separate buffers (e.g. pages of a cache or network buffers) rather than
+ * first being copied into one. On Linux the iovec array goes to the sg
+ * driver (v3 iovec_count or v4 din_iovec_count/dout_iovec_count) and to
+ * the SG_IO ioctl of block devices; for bsg and NVMe devices the data is
+ * copied through a buffer held by objp. Other OSes only accept an iov_cnt
+ * of 1. The iovec array and the buffers it points to must stay valid until
+ * the command completes. */
+#define SCSI_PT_IOV_FUNCTIONS 1
+#define SCSI_PT_IOV_MAX 1024
+
+/* Same layout as POSIX struct iovec and the Linux sg driver's sg_iovec */
+struct sg_pt_iovec {
+    void * iov_base;
+    size_t iov_len;
+};
+
+/* Like set_scsi_pt_data_in() and set_scsi_pt_data_out() but the data is
+ * held in the iov_cnt buffers described by iovp, in that order. */
+void set_scsi_pt_data_in_iov(struct sg_pt_base * objp,
+                             const struct sg_pt_iovec * iovp, int iov_cnt);
+void set_scsi_pt_data_out_iov(struct sg_pt_base * objp,
+                              const struct sg_pt_iovec * iovp, int iov_cnt);
+
+/* Following is a guard which is defined when the sg_pt_nvme_cache_*()
+ * functions are present. Older versions of this library may not have them.
+ * The SCSI to NVMe translation (SNTL) keeps the Identify controller and
+ * Identify namespace responses, plus the volatile write cache setting, of
+ * each NVMe device it sees in a process wide cache. So a device opened many
+ * times needs those Admin commands once, after which SNTL INQUIRY, MODE
+ * SENSE and READ CAPACITY are answered from memory. It is enabled by
+ * default. NVMe Admin commands sent via this library that may change what
+ * is cached (e.g. Format NVM, Namespace Management, Set Features, Sanitize)
+ * invalidate it, as does SNTL MODE SELECT. If a device may be changed by
+ * another process call sg_pt_nvme_cache_invalidate() . */
+#define SCSI_PT_NVME_CACHE_FUNCTIONS 1
+void sg_pt_nvme_cache_enable(bool enable);
+void sg_pt_nvme_cache_invalidate(void);
+/* Generation counter, bumped by each invalidation */
+uint32_t sg_pt_nvme_cache_gen(void);
+
+/* Following is a guard which is defined when the sg_pt_tmo_*() functions
+ * are present. Older versions of this library may not have them. A device
+ * may report, in the command timeouts descriptors of REPORT SUPPORTED
+ * OPERATION CODES (RSOC with RCTD set), a nominal processing time and a
+ * recommended timeout for each command it supports. Once those have been
+ * recorded for a device, a SCSI command sent to it by do_scsi_pt() or
+ * do_scsi_pt_submit() with a timeout of 0 (or less), as the sg_ll_*()
+ * functions do when their caller has no preference, uses the recommended
+ * timeout for its opcode and service action. If there is none, twice the
+ * nominal time is used; if neither then the default of 60 seconds. If the
+ * SG3_UTILS_RSOC_TMO environment variable is set, do_scsi_pt() records
+ * them the first time it sends a command with a default timeout to each
+ * device. Currently Linux only, up to 32 devices per process. */
+#define SCSI_PT_TMO_FUNCTIONS 1
+
+struct sg_pt_cmd_tmo {
+    uint32_t nominal_secs;      /* 0: not given */
+    uint32_t recommended_secs;  /* 0: not given */
+    uint16_t sa;                /* service action if sa_valid */
+    uint8_t opcode;
+    bool sa_valid;
+};
+
+/* Sends RSOC (all commands, RCTD set) to the device open on dev_fd and
+ * records the timeouts it reports, replacing any recorded earlier for that
+ * device. A device that does not support RSOC (or RCTD) is recorded with
+ * none, so it is not asked again. Returns 0, an SG_LIB_CAT_* value or
+ * another exit status (e.g. from sg_convert_errno()). */
+int sg_pt_tmo_load(int dev_fd, int verbose);
+
+/* Like sg_pt_tmo_load() but decodes the RSOC response (reporting options
+ * 0, RCTD set) of resp_len bytes in resp, fetched by the caller. Returns
+ * the number of commands with timeouts recorded or a negated errno. */
+int sg_pt_tmo_set_rsoc(int dev_fd, const uint8_t * resp, int resp_len);
+
+/* Returns the timeout, in seconds, that a default timeout becomes for the
+ * command in cdbp when sent to the device open on dev_fd; 0 if nothing is
+ * recorded for it (i.e. the default stands). If tp is non-NULL and the
+ * device reported timeouts for the command, they are placed in *tp. */
+int sg_pt_tmo_get(int dev_fd, const uint8_t * cdbp, int cdb_len,
+                  struct sg_pt_cmd_tmo * tp);
+
+/* Forgets what was recorded for the device open on dev_fd or, if dev_fd
+ * is negative, for all devices. */
+void sg_pt_tmo_clear(int dev_fd);
+
 #ifdef SG_LIB_WIN32
 #define SG_LIB_WIN32_DIRECT 1
 
-/* Request SPT direct interface when state_direct is 1, state_direct set
- * to 0 for the SPT indirect interface. Default setting selected by build
- * (i.e. library compile time) and is usually indirect. */
+/* Request SPT direct interface for every command when state_direct is 1.
+ * When state_direct is 0 each command uses the direct interface if its
+ * data buffer meets the adapter's alignment (as buffers from sg_memalign()
+ * do), otherwise the indirect (double buffered) interface. Default setting
+ * selected by build (i.e. library compile time) and is usually 0. */
 void scsi_pt_win32_direct(int state_direct);
 
-/* Returns current SPT interface state, 1 for direct, 0 for indirect */
+/* Returns current SPT interface state, 1 for direct, 0 for per command */
 int scsi_pt_win32_spt_state(void);
 
+/* Places the maximum data transfer length in bytes (0 if not known) and
+ * the buffer alignment mask of the adapter behind device_fd in *max_lenp
+ * and *align_maskp (either may be NULL). The adapter is asked once per
+ * open device. Returns 0 or a negated errno. */
+int scsi_pt_win32_adapter_limits(int device_fd, uint32_t * max_lenp,
+                                 uint32_t * align_maskp, int verbose);
+
 #endif
 
 #ifdef __cplusplus
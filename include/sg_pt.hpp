@@ -0,0 +1,714 @@
+#ifndef SG_PT_HPP
+#define SG_PT_HPP
+
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+// Header-only C++ (C++11 or later) layer over the pass-through interface
+// in sg_pt.h and the completion multiplexer in sg_mux.h . Nothing here
+// adds a copy or an allocation to what the C interface does: buffers are
+// passed by span (pointer and length) views, pt objects and page sized
+// data buffers come from the calling thread's pool (see
+// sg_pt_pool_enable()) and each owning class is move-only, releasing its
+// resource in its destructor. Link with libsgutils2 as a C program does.
+//
+//   sgpt::device dev("/dev/sg1", true /* read_only */);
+//   if (! dev.ok()) ... dev.error() is a negated errno
+//   uint8_t resp[36];
+//   sgpt::command cmd(dev);
+//   cmd.set_cdb(sgpt::inquiry(false, 0, sizeof(resp)));
+//   cmd.data_in(resp);
+//   int res = cmd.run();    // 0 or SG_LIB_CAT_* etc, as sg_ll_*() return
+//
+// Several commands in flight, completed by callback or future:
+//
+//   sgpt::mux mx;
+//   mx.add(dev);
+//   mx.submit(std::move(cmd), [](sgpt::command & c, int res) { ... });
+//   while (mx.in_flight() > 0)
+//       mx.run(-1);
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <array>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "sg_lib.h"
+#include "sg_pt.h"
+#include "sg_mux.h"
+#include "sg_cmds_basic.h"
+#include "sg_unaligned.h"
+
+namespace sgpt {
+
+// Non-owning view of count elements at ptr, in the manner of C++20's
+// std::span (which this header does not require).
+template <typename T>
+class basic_span {
+public:
+    basic_span() : ptr_(nullptr), count_(0) { }
+    basic_span(T * ptr, std::size_t count) : ptr_(ptr), count_(count) { }
+    template <std::size_t N>
+    basic_span(T (&arr)[N]) : ptr_(arr), count_(N) { }
+    template <typename U, typename A, typename = typename
+              std::enable_if<std::is_convertible<U *, T *>::value>::type>
+    basic_span(std::vector<U, A> & v) : ptr_(v.data()), count_(v.size()) { }
+    template <typename U, typename A, typename = typename
+              std::enable_if<std::is_convertible<const U *, T *>::value>::type>
+    basic_span(const std::vector<U, A> & v)
+        : ptr_(v.data()), count_(v.size()) { }
+    template <typename U, std::size_t N, typename = typename
+              std::enable_if<std::is_convertible<U *, T *>::value>::type>
+    basic_span(std::array<U, N> & a) : ptr_(a.data()), count_(N) { }
+    template <typename U, std::size_t N, typename = typename
+              std::enable_if<std::is_convertible<const U *, T *>::value>::type>
+    basic_span(const std::array<U, N> & a) : ptr_(a.data()), count_(N) { }
+    // e.g. byte_span to const_byte_span
+    template <typename U, typename = typename
+              std::enable_if<std::is_convertible<U *, T *>::value>::type>
+    basic_span(const basic_span<U> & s) : ptr_(s.data()), count_(s.size()) { }
+
+    T * data() const { return ptr_; }
+    std::size_t size() const { return count_; }
+    bool empty() const { return 0 == count_; }
+    T & operator[](std::size_t k) const { return ptr_[k]; }
+    T * begin() const { return ptr_; }
+    T * end() const { return ptr_ + count_; }
+
+    // Clamped to this span, so never points outside it
+    basic_span subspan(std::size_t off,
+                       std::size_t count = static_cast<std::size_t>(-1))
+        const {
+        if (off > count_)
+            off = count_;
+        if (count > count_ - off)
+            count = count_ - off;
+        return basic_span(ptr_ + off, count);
+    }
+    basic_span first(std::size_t count) const { return subspan(0, count); }
+
+private:
+    T * ptr_;
+    std::size_t count_;
+};
+
+typedef basic_span<uint8_t> byte_span;
+typedef basic_span<const uint8_t> const_byte_span;
+
+
+// A device opened with scsi_pt_open_device() (so possibly leased from
+// sg_broker) and closed by the destructor.
+class device {
+public:
+    device() : fd_(-1) { }
+    device(const char * name, bool read_only, int verbose = 0)
+        : fd_(scsi_pt_open_device(name, read_only, verbose)) { }
+    // flags as for open(2), e.g. O_RDWR | O_NONBLOCK | O_EXCL
+    device(const char * name, int flags, int verbose)
+        : fd_(scsi_pt_open_flags(name, flags, verbose)) { }
+    // Takes ownership of an fd opened by the caller
+    static device adopt(int fd) { device d; d.fd_ = fd; return d; }
+    ~device() { close(); }
+
+    device(device && o) noexcept : fd_(o.fd_) { o.fd_ = -1; }
+    device & operator=(device && o) noexcept {
+        if (this != &o) {
+            close();
+            fd_ = o.fd_;
+            o.fd_ = -1;
+        }
+        return *this;
+    }
+    device(const device &) = delete;
+    device & operator=(const device &) = delete;
+
+    bool ok() const { return fd_ >= 0; }
+    // 0 or the negated errno from the open
+    int error() const { return (fd_ < 0) ? fd_ : 0; }
+    int fd() const { return fd_; }
+    // Caller now owns the fd
+    int release() { int fd = fd_; fd_ = -1; return fd; }
+    // Returns 0 or a negated errno
+    int close() {
+        int res = 0;
+
+        if (fd_ >= 0)
+            res = scsi_pt_close_device(fd_);
+        fd_ = -1;
+        return res;
+    }
+
+private:
+    int fd_;            // negated errno when open failed
+};
+
+
+// A data buffer from sg_pt_pool_get_buf(): page aligned, and served from
+// the calling thread's pool when it is at most a page. Should be released
+// in the thread it was obtained in.
+class pooled_buf {
+public:
+    pooled_buf() : bp_(nullptr), free_(nullptr), len_(0) { }
+    explicit pooled_buf(uint32_t num_bytes, bool vb = false)
+        : free_(nullptr), len_(num_bytes) {
+        bp_ = sg_pt_pool_get_buf(num_bytes, &free_, vb);
+        if (nullptr == bp_)
+            len_ = 0;
+    }
+    ~pooled_buf() { reset(); }
+
+    pooled_buf(pooled_buf && o) noexcept
+        : bp_(o.bp_), free_(o.free_), len_(o.len_) {
+        o.bp_ = nullptr;
+        o.free_ = nullptr;
+        o.len_ = 0;
+    }
+    pooled_buf & operator=(pooled_buf && o) noexcept {
+        if (this != &o) {
+            reset();
+            std::swap(bp_, o.bp_);
+            std::swap(free_, o.free_);
+            std::swap(len_, o.len_);
+        }
+        return *this;
+    }
+    pooled_buf(const pooled_buf &) = delete;
+    pooled_buf & operator=(const pooled_buf &) = delete;
+
+    bool ok() const { return nullptr != bp_; }
+    uint8_t * data() const { return bp_; }
+    uint32_t size() const { return len_; }
+    byte_span span() const { return byte_span(bp_, len_); }
+    operator byte_span() const { return span(); }
+    operator const_byte_span() const { return const_byte_span(bp_, len_); }
+
+    void reset() {
+        if (free_)
+            sg_pt_pool_put_buf(free_, len_);
+        bp_ = nullptr;
+        free_ = nullptr;
+        len_ = 0;
+    }
+
+private:
+    uint8_t * bp_;
+    uint8_t * free_;
+    uint32_t len_;
+};
+
+
+// CDB builders. Each returns a cdb<N> by value (N bytes, no heap) which
+// command::set_cdb() copies into the command.
+template <std::size_t N>
+struct cdb {
+    static_assert((N >= 6) && (N <= 32), "CDB length must be 6 to 32");
+    uint8_t b[N];
+
+    cdb() { std::memset(b, 0, N); }
+    explicit cdb(uint8_t opcode) { std::memset(b, 0, N); b[0] = opcode; }
+    static constexpr std::size_t size() { return N; }
+    uint8_t & operator[](std::size_t k) { return b[k]; }
+    const uint8_t & operator[](std::size_t k) const { return b[k]; }
+    operator const_byte_span() const { return const_byte_span(b, N); }
+};
+
+inline cdb<6>
+test_unit_ready()
+{
+    return cdb<6>(0x0);
+}
+
+inline cdb<6>
+request_sense(uint8_t alloc_len, bool desc = false)
+{
+    cdb<6> c(0x3);
+
+    c[1] = desc ? 0x1 : 0x0;
+    c[4] = alloc_len;
+    return c;
+}
+
+inline cdb<6>
+inquiry(bool evpd, uint8_t page_code, uint16_t alloc_len)
+{
+    cdb<6> c(0x12);
+
+    c[1] = evpd ? 0x1 : 0x0;
+    c[2] = page_code;
+    sg_put_unaligned_be16(alloc_len, c.b + 3);
+    return c;
+}
+
+inline cdb<10>
+read_capacity10()
+{
+    return cdb<10>(0x25);
+}
+
+inline cdb<16>
+read_capacity16(uint32_t alloc_len)
+{
+    cdb<16> c(0x9e);
+
+    c[1] = 0x10;        // service action: READ CAPACITY(16)
+    sg_put_unaligned_be32(alloc_len, c.b + 10);
+    return c;
+}
+
+inline cdb<10>
+synchronize_cache10(uint32_t lba = 0, uint16_t num_blocks = 0,
+                    bool immed = false)
+{
+    cdb<10> c(0x35);
+
+    c[1] = immed ? 0x2 : 0x0;
+    sg_put_unaligned_be32(lba, c.b + 2);
+    sg_put_unaligned_be16(num_blocks, c.b + 7);
+    return c;
+}
+
+namespace detail {
+
+// READ or WRITE of N bytes (10, 12 or 16). The caller checks that lba and
+// num_blocks fit: the upper bits are dropped as they are in sg_dd.
+template <std::size_t N>
+inline cdb<N>
+rw(bool write, uint64_t lba, uint32_t num_blocks, bool fua, bool dpo)
+{
+    static_assert((10 == N) || (12 == N) || (16 == N),
+                  "READ and WRITE CDBs are 10, 12 or 16 bytes long");
+    cdb<N> c;
+
+    c[1] = (fua ? 0x8 : 0x0) | (dpo ? 0x10 : 0x0);
+    switch (N) {
+    case 10:
+        c[0] = write ? 0x2a : 0x28;
+        sg_put_unaligned_be32(static_cast<uint32_t>(lba), c.b + 2);
+        sg_put_unaligned_be16(static_cast<uint16_t>(num_blocks), c.b + 7);
+        break;
+    case 12:
+        c[0] = write ? 0xaa : 0xa8;
+        sg_put_unaligned_be32(static_cast<uint32_t>(lba), c.b + 2);
+        sg_put_unaligned_be32(num_blocks, c.b + 6);
+        break;
+    default:
+        c[0] = write ? 0x8a : 0x88;
+        sg_put_unaligned_be64(lba, c.b + 2);
+        sg_put_unaligned_be32(num_blocks, c.b + 10);
+        break;
+    }
+    return c;
+}
+
+}   // namespace detail
+
+template <std::size_t N = 16>
+inline cdb<N>
+read(uint64_t lba, uint32_t num_blocks, bool fua = false, bool dpo = false)
+{
+    return detail::rw<N>(false, lba, num_blocks, fua, dpo);
+}
+
+template <std::size_t N = 16>
+inline cdb<N>
+write(uint64_t lba, uint32_t num_blocks, bool fua = false, bool dpo = false)
+{
+    return detail::rw<N>(true, lba, num_blocks, fua, dpo);
+}
+
+
+// One SCSI command: a pt object from the calling thread's pool together
+// with storage for its CDB and sense data. Data buffers are not owned,
+// they are given as spans and must outlive the command's completion.
+// Moving a command re-points its pt object at the moved-to storage, so a
+// command must not be moved while it is in flight.
+class command {
+public:
+    static const int max_cdb_len = 32;
+    static const int max_sense_len = 64;
+
+    command() : ptp_(nullptr), fd_(-1), vb_(0) { init(); }
+    explicit command(const device & dev, int verbose = 0)
+        : ptp_(sg_pt_pool_get_obj(dev.fd(), verbose)), fd_(dev.fd()),
+          vb_(verbose) { init(); }
+    command(int fd, int verbose)
+        : ptp_(sg_pt_pool_get_obj(fd, verbose)), fd_(fd), vb_(verbose) {
+        init();
+    }
+    ~command() { if (ptp_) sg_pt_pool_put_obj(ptp_); }
+
+    command(command && o) noexcept
+        : ptp_(o.ptp_), fd_(o.fd_), vb_(o.vb_), cdb_len_(o.cdb_len_),
+          pt_res_(o.pt_res_), res_(o.res_), din_len_(o.din_len_) {
+        o.ptp_ = nullptr;
+        std::memcpy(cdb_, o.cdb_, sizeof(cdb_));
+        repoint(o.sense_);
+    }
+    command & operator=(command && o) noexcept {
+        if (this != &o) {
+            if (ptp_)
+                sg_pt_pool_put_obj(ptp_);
+            ptp_ = o.ptp_;
+            o.ptp_ = nullptr;
+            fd_ = o.fd_;
+            vb_ = o.vb_;
+            cdb_len_ = o.cdb_len_;
+            pt_res_ = o.pt_res_;
+            res_ = o.res_;
+            din_len_ = o.din_len_;
+            std::memcpy(cdb_, o.cdb_, sizeof(cdb_));
+            repoint(o.sense_);
+        }
+        return *this;
+    }
+    command(const command &) = delete;
+    command & operator=(const command &) = delete;
+
+    // false if no pt object could be had (out of memory)
+    bool ok() const { return nullptr != ptp_; }
+    int fd() const { return fd_; }
+    // For the sg_pt.h functions not wrapped here
+    struct sg_pt_base * native() const { return ptp_; }
+
+    template <std::size_t N>
+    command & set_cdb(const cdb<N> & c) {
+        static_assert(N <= max_cdb_len, "CDB too long");
+        return set_cdb(const_byte_span(c.b, N));
+    }
+    command & set_cdb(const_byte_span c) {
+        cdb_len_ = (c.size() > max_cdb_len) ? max_cdb_len
+                                            : static_cast<int>(c.size());
+        std::memcpy(cdb_, c.data(), cdb_len_);
+        if (ptp_)
+            set_scsi_pt_cdb(ptp_, cdb_, cdb_len_);
+        return *this;
+    }
+    command & data_in(byte_span s) {
+        din_len_ = static_cast<int>(s.size());
+        if (ptp_)
+            set_scsi_pt_data_in(ptp_, s.data(), din_len_);
+        return *this;
+    }
+    command & data_out(const_byte_span s) {
+        if (ptp_)
+            set_scsi_pt_data_out(ptp_, s.data(),
+                                 static_cast<int>(s.size()));
+        return *this;
+    }
+    // SCSI_PT_FLAGS_* OR-ed together
+    command & flags(int f) {
+        if (ptp_)
+            set_scsi_pt_flags(ptp_, f);
+        return *this;
+    }
+
+    // Synchronous: returns 0, a SG_LIB_CAT_* value, SG_LIB_TRANSPORT_ERROR
+    // or sg_convert_errno() of an OS error, as the sg_ll_*() functions do.
+    int run(int timeout_secs = 60) {
+        if (nullptr == ptp_)
+            return sg_convert_errno(ENOMEM);
+        return complete(do_scsi_pt(ptp_, fd_, timeout_secs, vb_));
+    }
+    // Split alternative to run(). submit() returns as do_scsi_pt_submit()
+    // does. receive() returns -EAGAIN if the response is not yet there
+    // (on an O_NONBLOCK fd), otherwise the same as run().
+    int submit(int timeout_secs = 60) {
+        if (nullptr == ptp_)
+            return -ENOMEM;
+        return do_scsi_pt_submit(ptp_, fd_, timeout_secs, vb_);
+    }
+    int receive() {
+        if (nullptr == ptp_)
+            return sg_convert_errno(ENOMEM);
+        int pt_res = do_scsi_pt_receive(ptp_, fd_, vb_);
+
+        return (-EAGAIN == pt_res) ? pt_res : complete(pt_res);
+    }
+
+    // Clears the data buffers and the outcome of the last run so the
+    // command (with the same CDB unless set again) can be reused.
+    void reuse() {
+        if (ptp_) {
+            partial_clear_scsi_pt_obj(ptp_);
+            set_scsi_pt_sense(ptp_, sense_, max_sense_len);
+        }
+        pt_res_ = 0;
+        res_ = -1;
+        din_len_ = 0;
+    }
+
+    // The following describe the last completed run
+    int result() const { return res_; }
+    int pt_result() const { return pt_res_; }
+    int resid() const { return ptp_ ? get_scsi_pt_resid(ptp_) : 0; }
+    // Bytes received, din_len less resid, never negative
+    int din_received() const {
+        int n = din_len_ - resid();
+
+        return (n < 0) ? 0 : n;
+    }
+    int status() const {
+        return ptp_ ? get_scsi_pt_status_response(ptp_) : -1;
+    }
+    const_byte_span sense() const {
+        int n = ptp_ ? get_scsi_pt_sense_len(ptp_) : 0;
+
+        if (n > max_sense_len)
+            n = max_sense_len;
+        return const_byte_span(sense_, (n > 0) ? n : 0);
+    }
+    const_byte_span cdb_bytes() const {
+        return const_byte_span(cdb_, cdb_len_);
+    }
+    int duration_ms() const {
+        return ptp_ ? get_scsi_pt_duration_ms(ptp_) : -1;
+    }
+
+    // Takes a do_scsi_pt*() return value and sets result() from it, as
+    // the sg_ll_*() functions do after sg_cmds_process_resp().
+    int complete(int pt_res) {
+        if (nullptr == ptp_)
+            return (res_ = sg_convert_errno(ENOMEM));
+        int sense_cat = 0;
+        int ret = sg_cmds_process_resp(ptp_, "sgpt", pt_res, false, vb_,
+                                       &sense_cat);
+
+        pt_res_ = pt_res;
+        if (-1 == ret) {
+            if (pt_res < 0)
+                ret = sg_convert_errno(-pt_res);
+            else if (SCSI_PT_DO_TIMEOUT == pt_res)
+                ret = SG_LIB_CAT_TIMEOUT;
+            else if (get_scsi_pt_transport_err(ptp_))
+                ret = SG_LIB_TRANSPORT_ERROR;
+            else if (get_scsi_pt_os_err(ptp_))
+                ret = sg_convert_errno(get_scsi_pt_os_err(ptp_));
+            else
+                ret = SG_LIB_CAT_OTHER;
+        } else if (-2 == ret) {
+            switch (sense_cat) {
+            case SG_LIB_CAT_RECOVERED:
+            case SG_LIB_CAT_NO_SENSE:
+                ret = 0;
+                break;
+            default:
+                ret = sense_cat;
+                break;
+            }
+        } else
+            ret = 0;
+        res_ = ret;
+        return ret;
+    }
+
+private:
+    void init() {
+        cdb_len_ = 0;
+        pt_res_ = 0;
+        res_ = -1;
+        din_len_ = 0;
+        std::memset(cdb_, 0, sizeof(cdb_));
+        if (ptp_)
+            set_scsi_pt_sense(ptp_, sense_, max_sense_len);
+    }
+    // set_scsi_pt_sense() clears the buffer so copy the old sense after
+    void repoint(const uint8_t * old_sense) {
+        if (ptp_) {
+            set_scsi_pt_cdb(ptp_, cdb_len_ ? cdb_ : nullptr, cdb_len_);
+            set_scsi_pt_sense(ptp_, sense_, max_sense_len);
+        }
+        std::memcpy(sense_, old_sense, sizeof(sense_));
+    }
+
+    struct sg_pt_base * ptp_;
+    int fd_;
+    int vb_;
+    int cdb_len_;
+    int pt_res_;
+    int res_;           // -1 until completed
+    int din_len_;
+    uint8_t cdb_[max_cdb_len];
+    uint8_t sense_[max_sense_len];
+};
+
+
+// What a future from mux::submit_future() holds
+struct completion {
+    int result;         // as command::result()
+    command cmd;
+};
+
+// Asynchronous completion of commands on many devices with one thread,
+// over sg_mux (see sg_mux.h). Commands are moved into the mux and handed
+// back, completed, to their callback from within run(). Like sg_mux, a
+// mux is used by one thread. An exception thrown by a callback is held
+// and rethrown by run() once the other completions it found are done.
+class mux {
+public:
+    typedef std::function<void(command & cmd, int result)> callback;
+
+    explicit mux(int verbose = 0)
+        : mxp_(sg_mux_new(verbose)), head_(nullptr) { }
+    ~mux() {
+        // sg_mux_free() abandons what is in flight, so free those after
+        sg_mux_free(mxp_);
+        while (head_) {
+            node * np = head_;
+
+            head_ = np->next;
+            delete np;
+        }
+    }
+    // commands in flight point back at their mux, so it does not move
+    mux(mux &&) = delete;
+    mux & operator=(mux &&) = delete;
+    mux(const mux &) = delete;
+    mux & operator=(const mux &) = delete;
+
+    // false with errno set if sg_mux_new() failed (ENOSYS: no mux on
+    // this OS, use command::run() instead)
+    bool ok() const { return nullptr != mxp_; }
+    int add(const device & dev) { return sg_mux_add_fd(mxp_, dev.fd()); }
+    int remove(const device & dev) {
+        return sg_mux_del_fd(mxp_, dev.fd());
+    }
+
+    // Starts cmd. Returns 0 then cb is called, from run(), when it
+    // completes. Otherwise returns the sg_mux_submit() error and cb is not
+    // called. No soft deadline is set: a command given up on would still
+    // be held by the kernel after its storage was handed back.
+    int submit(command && cmd, callback cb, int timeout_secs = 60) {
+        node * np = new node(std::move(cmd), std::move(cb));
+
+        std::memset(&np->mc, 0, sizeof(np->mc));
+        np->mc.fd = np->cmd.fd();
+        np->mc.timeout_secs = timeout_secs;
+        np->mc.ptp = np->cmd.native();
+        np->mc.ctx = np;
+        np->mc.done = &mux::done_tramp;
+        np->owner = this;
+        int res = np->cmd.ok() ? sg_mux_submit(mxp_, &np->mc) : -ENOMEM;
+        if (res) {
+            delete np;
+            return res;
+        }
+        link(np);
+        return 0;
+    }
+
+    // As submit() but the completion is delivered through a future. If
+    // the submission fails the future holds that failure, with result set
+    // from the sg_mux_submit() error as command::complete() would.
+    std::future<completion> submit_future(command && cmd,
+                                          int timeout_secs = 60) {
+        std::shared_ptr<std::promise<completion> > pp =
+                std::make_shared<std::promise<completion> >();
+        std::future<completion> f = pp->get_future();
+        node * np = new node(std::move(cmd), callback());
+
+        np->pp = pp;
+        std::memset(&np->mc, 0, sizeof(np->mc));
+        np->mc.fd = np->cmd.fd();
+        np->mc.timeout_secs = timeout_secs;
+        np->mc.ptp = np->cmd.native();
+        np->mc.ctx = np;
+        np->mc.done = &mux::done_tramp;
+        np->owner = this;
+        int res = np->cmd.ok() ? sg_mux_submit(mxp_, &np->mc) : -ENOMEM;
+        if (res) {
+            int r = np->cmd.ok() ? np->cmd.complete(res)
+                                 : sg_convert_errno(-res);
+
+            pp->set_value(completion{r, std::move(np->cmd)});
+            delete np;
+        } else
+            link(np);
+        return f;
+    }
+
+    // Waits up to timeout_ms (-1: no limit) and makes the callbacks of the
+    // commands that completed. Returns their number or a negated errno.
+    int run(int timeout_ms) {
+        int res = sg_mux_run(mxp_, timeout_ms);
+
+        if (pending_) {
+            std::exception_ptr ep = pending_;
+
+            pending_ = nullptr;
+            std::rethrow_exception(ep);
+        }
+        return res;
+    }
+    int in_flight() const { return mxp_ ? sg_mux_in_flight(mxp_) : 0; }
+
+private:
+    struct node {
+        node(command && c, callback && f)
+            : cmd(std::move(c)), cb(std::move(f)), owner(nullptr),
+              prev(nullptr), next(nullptr) { }
+        struct sg_mux_cmd mc;
+        command cmd;
+        callback cb;
+        std::shared_ptr<std::promise<completion> > pp;
+        mux * owner;
+        node * prev;
+        node * next;
+    };
+
+    void link(node * np) {
+        np->next = head_;
+        if (head_)
+            head_->prev = np;
+        head_ = np;
+    }
+    void unlink(node * np) {
+        if (np->prev)
+            np->prev->next = np->next;
+        else
+            head_ = np->next;
+        if (np->next)
+            np->next->prev = np->prev;
+    }
+
+    // Called from within sg_mux_run(), a C function: no exception may
+    // pass through it.
+    static void done_tramp(struct sg_mux_cmd * mcp, void * ctx) {
+        node * np = static_cast<node *>(ctx);
+        mux * mx = np->owner;
+        int r = np->cmd.complete(mcp->res);
+
+        mx->unlink(np);
+        try {
+            if (np->pp)
+                np->pp->set_value(completion{r, std::move(np->cmd)});
+            else if (np->cb)
+                np->cb(np->cmd, r);
+        } catch (...) {
+            if (! mx->pending_)
+                mx->pending_ = std::current_exception();
+        }
+        delete np;
+    }
+
+    struct sg_mux * mxp_;
+    node * head_;       // in flight, freed by the destructor
+    std::exception_ptr pending_;
+};
+
+}   // namespace sgpt
+
+#endif  // SG_PT_HPP
@@ -2,7 +2,7 @@
 #define SG_PT_LINUX_H
 
 /*
- * Copyright (c) 2017-2018 Douglas Gilbert.
+ * Copyright (c) 2017-2026 Douglas Gilbert.
  * All rights reserved.
  * Use of this source code is governed by a BSD-style
  * license that can be found in the BSD_LICENSE file.
@@ -15,6 +15,7 @@
 
 #include <linux/types.h>
 
+#include "sg_pt.h"
 #include "sg_pt_nvme.h"
 
 /* This header is for internal use by the sg3_utils library (libsgutils)
@@ -112,16 +113,43 @@ struct sg_io_v4 {
 #endif
 
 
+/* Kinds of registered buffers (see sg_pt_reg_bufs() in sg_pt.h) */
+#define SG_PT_RB_PLAIN 0        /* page aligned heap buffers */
+#define SG_PT_RB_SG_MMAP 1      /* sg driver reserve buffer, mmap-ed */
+#define SG_PT_RB_URING 2        /* io_uring fixed buffers */
+
+struct sg_pt_reg_bufs_t {
+    int num;
+    int kind;                   /* one of SG_PT_RB_* */
+    uint32_t buf_len;
+    const void * ring;          /* io_uring holding the fixed buffers */
+    uint8_t * bufs[16];         /* 16 is SCSI_PT_REG_BUFS_MAX */
+    uint8_t * free_bufs[16];    /* only for SG_PT_RB_PLAIN and _URING */
+};
+
 struct sg_pt_linux_scsi {
     struct sg_io_v4 io_hdr;     /* use v4 header as it is more general */
     /* Leave io_hdr in first place of this structure */
     bool is_sg;
     bool is_bsg;
     bool is_nvme;       /* OS device type, if false ignore nvme_our_sntl */
+    bool is_nvme_gen;   /* NVMe generic char device (e.g. /dev/ng0n1) */
+    bool is_nonblock;   /* dev_fd is O_NONBLOCK, only checked if is_nvme_gen */
     bool nvme_our_sntl; /* true: our SNTL; false: received NVMe command */
     bool nvme_stat_dnr; /* Do No Retry, part of completion status field */
     bool nvme_stat_more; /* More, part of completion status field */
     bool mdxfer_out;    /* direction of metadata xfer, true->data-out */
+    bool async_done;    /* do_scsi_pt_submit() completed synchronously */
+    bool async_v4;      /* async command submitted with SG_IOSUBMIT */
+    bool force_pack_id; /* SG_SET_FORCE_PACK_ID done on dev_fd */
+    bool async_uring;   /* async NVMe command queued on io_uring */
+    bool uring_done;    /* io_uring completion placed in this object */
+    bool async_admin;   /* async NVMe command is Admin (else NVM) */
+    bool polled;        /* SCSI_PT_FLAGS_POLLED given */
+    bool uring_polled;  /* command queued on this thread's IOPOLL ring */
+    bool nvm_rw_tmpl_ok; /* nvm_rw_tmpl built for this device */
+    bool iov_bounced;   /* io_hdr data points at iov_bouncep, not iovec */
+    bool iov_din;       /* bounced iovec was for data-in */
     int dev_fd;                 /* -1 if not given (yet) */
     int in_err;
     int os_err;
@@ -136,7 +164,19 @@ struct sg_pt_linux_scsi {
                                  * The whole 16 byte completion q entry is
                                  * sent back as sense data */
     uint32_t mdxfer_len;
+    uint64_t dev_id;            /* st_rdev of dev_fd, for sg_pt_lat_*() */
+    sg_pt_trace_fn trace_fn;    /* from set_pt_trace() */
+    void * trace_priv;
+    int uring_res;              /* io_uring cqe::res, NVMe status or -errno */
+    uint32_t uring_result;      /* io_uring DW0 from completion queue */
     struct sg_sntl_dev_state_t dev_stat;
+    struct sg_pt_reg_bufs_t * rbp;      /* from sg_pt_reg_bufs() */
+    uint32_t iov_cnt;           /* of the iovec array while bounced */
+    uint32_t iov_bounce_sz;
+    __u64 iov_xferp;            /* the iovec array while bounced */
+    uint8_t * iov_bouncep;      /* for iovec transfers to bsg and NVMe */
+    uint8_t * free_iov_bouncep;
+    struct sg_nvme_passthru_cmd nvm_rw_tmpl; /* SNTL READ/WRITE fast path */
     void * mdxferp;
     uint8_t * nvme_id_ctlp;     /* cached response to controller IDENTIFY */
     uint8_t * free_nvme_id_ctlp;
@@ -187,6 +227,57 @@ extern long sg_lin_page_size;
 void sg_find_bsg_nvme_char_major(int verbose);
 int sg_do_nvme_pt(struct sg_pt_base * vp, int fd, int time_secs, int vb);
 int sg_linux_get_sg_version(const struct sg_pt_base * vp);
+int sg_nvme_pt_submit(struct sg_pt_base * vp, bool admin, int time_secs,
+                      int vb);
+int sg_nvme_pt_receive(struct sg_pt_base * vp, bool wait, int vb);
+
+/* io_uring engine for NVMe generic char devices (sg_pt_linux_uring.c) */
+bool sg_uring_usable(const struct sg_pt_linux_scsi * ptp);
+int sg_uring_queue(struct sg_pt_linux_scsi * ptp,
+                   const struct sg_nvme_passthru_cmd * cmdp, bool admin,
+                   int vb);
+int sg_uring_reap(struct sg_pt_linux_scsi * ptp, bool wait, int vb);
+int sg_uring_nvme_cmd(struct sg_pt_linux_scsi * ptp,
+                      struct sg_nvme_passthru_cmd * cmdp, bool admin, int vb);
+int sg_uring_nvme_cmds(struct sg_pt_linux_scsi * ptp,
+                       struct sg_nvme_passthru_cmd * cmd_arr, int num,
+                       int * failp, int vb);
+int sg_uring_busy_fd(int vb);
+bool sg_uring_polled_busy(void);
+int sg_uring_reg_bufs(struct sg_pt_reg_bufs_t * rbp, int vb);
+void sg_uring_unreg_bufs(struct sg_pt_reg_bufs_t * rbp);
+
+/* Monotonic time in nanoseconds, used to time commands for sg_pt_lat_*() */
+uint64_t sg_pt_linux_now_ns(void);
+
+/* For pass-throughs that cannot take an iovec (bsg and NVMe): start copies
+ * a data-out iovec into a contiguous buffer, or points data-in at one, in
+ * place of the iovec; end copies data-in back out to the iovec and
+ * restores it. start returns 0, SCSI_PT_DO_BAD_PARAMS or -ENOMEM. */
+int sg_pt_iov_bounce_start(struct sg_pt_linux_scsi * ptp, int vb);
+void sg_pt_iov_bounce_end(struct sg_pt_linux_scsi * ptp);
+
+/* Instrumentation of do_scsi_pt() and do_nvm_pt(), see sg_pt_common.c .
+ * When sg_pt_instr is 0 commands are neither timed nor traced. */
+#define SG_PT_INSTR_LAT 0x1     /* sg_pt_lat_enable(true) */
+#define SG_PT_INSTR_TRACE 0x2   /* sg_pt_trace_set() has a callback */
+#define SG_PT_INSTR_OBJ 0x4     /* set_pt_trace() was given a callback */
+
+extern int sg_pt_instr;
+
+sg_pt_trace_fn sg_pt_trace_get(void ** privp);
+void sg_pt_trace_start(struct sg_pt_trace_rec * trp, uint64_t now_ns);
+void sg_pt_trace_check_env(void);
+void sg_pt_linux_trace_done(const struct sg_pt_linux_scsi * ptp,
+                            sg_pt_trace_fn fn, void * priv,
+                            struct sg_pt_trace_rec * trp, int res,
+                            uint64_t now_ns);
+
+/* Timeout, in seconds, to use for a SCSI command sent with a default
+ * timeout; 0 if the device's figure is not known (see sg_pt_tmo_load()).
+ * dev_fd may be -1 to look up without fetching. */
+int sg_pt_tmo_for_cmd(uint64_t dev_id, int dev_fd, const uint8_t * cdbp,
+                      int cdb_len);
 
 /* This trims given NVMe block device name in Linux (e.g. /dev/nvme0n1p5)
  * to the name of its associated char device (e.g. /dev/nvme0). If this
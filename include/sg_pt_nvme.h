@@ -197,6 +197,21 @@ int sg_make_vpd_devid_for_nvme(const uint8_t * nvme_id_ctl_p,
                                const uint8_t * nvme_id_ns_p, int pdt,
                                int tproto, uint8_t * dop, int max_do_len);
 
+/* Process wide cache used by the SNTL (see sg_pt_nvme_cache_enable() in
+ * sg_pt.h). Entries are keyed by dev_id (non-zero, e.g. st_rdev) and nsid.
+ * The two Identify responses are SG_NVME_CACHE_ID_LEN bytes long, the
+ * volatile write cache (feature 0x6) current value is held in val. The get
+ * returns true on a hit after copying into bp (or *valp). */
+#define SG_NVME_CACHE_ID_CTL 0x1        /* Identify controller (CNS 1) */
+#define SG_NVME_CACHE_ID_NS 0x2         /* Identify namespace (CNS 0) */
+#define SG_NVME_CACHE_WCE 0x4           /* Get Features 0x6, current */
+#define SG_NVME_CACHE_ID_LEN 4096
+
+bool sg_nvme_cache_get(uint64_t dev_id, uint32_t nsid, int which,
+                       uint8_t * bp, uint32_t * valp);
+void sg_nvme_cache_put(uint64_t dev_id, uint32_t nsid, int which,
+                       const uint8_t * bp, uint32_t val);
+
 /* Initialize dev_stat pointed to by dsp */
 void sntl_init_dev_stat(struct sg_sntl_dev_state_t * dsp);
 
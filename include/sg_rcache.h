@@ -0,0 +1,62 @@
+#ifndef SG_RCACHE_H
+#define SG_RCACHE_H
+
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/* On-disk cache of responses that seldom change: the standard INQUIRY
+ * response, VPD pages, READ CAPACITY and REPORT SUPPORTED OPERATION CODES.
+ * It lives in a directory chosen by the user (e.g. with the --cache=DIR
+ * option of sg_inq, sg_vpd, sg_opcodes and sg_readcap). The entries of a
+ * logical unit are found via the NAA designator in its Device
+ * Identification VPD page. When the cache is opened for a device a TEST
+ * UNIT READY is sent: if that reports a UNIT ATTENTION, or the device node
+ * has been re-created (e.g. after a hotplug event or a reboot) since it was
+ * last seen, that logical unit's entries are discarded. While open,
+ * sg_ll_inquiry*() and sg_ll_readcap_*() on that device are answered from
+ * the cache when they can be, otherwise the response from the device is
+ * saved there. Only one device at a time may use the cache. */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Opens the response cache in directory 'dir' (which must exist) for the
+ * device 'dev_name' that is already open as 'sg_fd'. Sends a TEST UNIT
+ * READY and perhaps an INQUIRY for the Device Identification VPD page.
+ * Returns true if the cache is usable for this device; false when it is
+ * not (e.g. no NAA designator) in which case the caller carries on
+ * without it. */
+bool sg_rcache_open(const char * dir, const char * dev_name, int sg_fd,
+                    int verbose);
+
+/* Returns true if the cache is open for sg_fd */
+bool sg_rcache_active(int sg_fd);
+
+/* Looks up the response called 'name' (e.g. "vpd_83") for sg_fd and copies
+ * up to mx_len bytes of it to rp. Returns the number of bytes copied,
+ * which may be less than mx_len when the cached response is complete, or
+ * -1 if that response is not cached (or only a shorter prefix of it is). */
+int sg_rcache_get(int sg_fd, const char * name, uint8_t * rp, int mx_len);
+
+/* Saves the len bytes at rp as the response called 'name', mx_len being
+ * the allocation length used to fetch it. Errors are ignored. */
+void sg_rcache_put(int sg_fd, const char * name, const uint8_t * rp,
+                   int mx_len, int len);
+
+void sg_rcache_close(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* SG_RCACHE_H */
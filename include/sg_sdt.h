@@ -0,0 +1,56 @@
+#ifndef SG_SDT_H
+#define SG_SDT_H
+
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/* User space statically defined tracing (USDT) probes, with provider name
+ * "sg3_utils", for tracers such as bpftrace. Until a tracer attaches each
+ * probe is a single nop instruction, its arguments are only evaluated
+ * into registers. The probes are compiled out when ./configure does not
+ * find <sys/sdt.h> (e.g. from the systemtap-sdt-dev package) or when
+ * --disable-usdt is given. Includers should include config.h first.
+ *
+ * Current probes:
+ *   pt_submit(objp, dev_id, cmdp, cmd_len, cmd_set)  before a command is
+ *       sent by do_scsi_pt() [cmd_set=0] or do_nvm_pt() [cmd_set=2]
+ *   pt_complete(objp, dev_id, result, status, cmd_set)  after it
+ *       completes; status is the SCSI status or NVMe SCT|SC
+ *   dd_seg_start(skip, seek, blocks)  sg_dd, before each segment
+ *   dd_seg_done(skip, seek, blocks)  sg_dd, after it is written
+ *   dd_seg_start(thread_id, offset, in_lba, blocks)  sgp_dd
+ *   dd_seg_done(thread_id, offset, blocks, out_err)  sgp_dd
+ *
+ * For example, the latency of each command opcode in microseconds:
+ *   bpftrace -e 'usdt:/usr/lib/libsgutils2.so.2:sg3_utils:pt_submit
+ *       { @ts[arg0] = nsecs; @op[arg0] = *(uint8 *)arg2; }
+ *     usdt:/usr/lib/libsgutils2.so.2:sg3_utils:pt_complete /@ts[arg0]/
+ *       { @us[@op[arg0]] = hist((nsecs - @ts[arg0]) / 1000);
+ *         delete(@ts[arg0]); }'
+ */
+
+#if defined(HAVE_SYS_SDT_H) && (! defined(IGNORE_USDT))
+#include <sys/sdt.h>
+
+#define SG_USDT_ENABLED 1
+#define SG_USDT3(name, a1, a2, a3) DTRACE_PROBE3(sg3_utils, name, a1, a2, a3)
+#define SG_USDT4(name, a1, a2, a3, a4) \
+        DTRACE_PROBE4(sg3_utils, name, a1, a2, a3, a4)
+#define SG_USDT5(name, a1, a2, a3, a4, a5) \
+        DTRACE_PROBE5(sg3_utils, name, a1, a2, a3, a4, a5)
+
+#else
+
+#define SG_USDT3(name, a1, a2, a3) do { } while (0)
+#define SG_USDT4(name, a1, a2, a3, a4) do { } while (0)
+#define SG_USDT5(name, a1, a2, a3, a4, a5) do { } while (0)
+
+#endif
+
+#endif          /* SG_SDT_H */
@@ -0,0 +1,142 @@
+#ifndef SG_SGL_H
+#define SG_SGL_H
+
+/*
+ * Copyright (c) 2014-2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/* Scatter gather lists of LBA ranges for the skip= and seek= operands of
+ * the dd family of utilities. This is a C version of the scat_gath_list
+ * class in testing/sg_scat_gath.cpp (used by sg_mrq_dd) and accepts the
+ * same syntax: "LBA0,NUM0[,LBA1,NUM1...]" on the command line, or "@FN"
+ * to read LBA,NUM pairs from file FN ("H@FN" when they are hex, "-" for
+ * stdin). FN may also be a binary sgl file, see below. */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SG_SGL_MAX_ELEMENTS 16384       /* when read from a file */
+/* Larger NUMs are split into several consecutive elements */
+#define SG_SGL_MAX_NUM (INT32_MAX - 1)
+
+/* Scatter gather list "linearity", strongest first */
+#define SG_SGL_LINEAR 0         /* empty list and 0,0 considered linear */
+#define SG_SGL_MONOTONIC 1      /* since not linear, implies holes */
+#define SG_SGL_MONO_OVERLAP 2   /* monotonic but same LBA in two elements */
+#define SG_SGL_NON_MONOTONIC 3
+
+struct sg_sgl_elem {
+    uint64_t lba;       /* of start block */
+    uint32_t num;       /* number of blocks from and including lba */
+};
+
+struct sg_sgl {
+    struct sg_sgl_elem * elems;
+    int64_t * starts;   /* [k] is sum of num in elems[0..k-1] */
+    int num_elems;
+    int alloc_elems;
+    /* following set by sg_sgl_sum_scan() */
+    int linearity;      /* one of SG_SGL_* */
+    int64_t sum;        /* of all num fields */
+    int64_t lowest_lba;
+    int64_t high_lba_p1;        /* highest LBA plus 1 */
+};
+
+/* Returns true if 'arg' (of skip= or seek=) is a list or a file name
+ * rather than a single number. */
+bool sg_sgl_is_list(const char * arg);
+
+/* Parses 'arg' into *sglp, which should be zeroed or sg_sgl_free()-ed
+ * beforehand, then calls sg_sgl_sum_scan(). Returns 0 on success,
+ * SG_LIB_SYNTAX_ERROR or SG_LIB_FILE_ERROR otherwise; 'id' (e.g. "skip")
+ * is used in error messages which are only output when 'vb' is true. */
+int sg_sgl_parse(struct sg_sgl * sglp, const char * id, const char * arg,
+                 bool vb);
+
+/* Appends an element, splitting it if num exceeds SG_SGL_MAX_NUM. Returns
+ * false if out of memory. */
+bool sg_sgl_append(struct sg_sgl * sglp, uint64_t lba, int64_t num);
+
+/* Sets linearity, sum, lowest_lba, high_lba_p1 and the starts[] array
+ * used by sg_sgl_idx_to_lba(). Returns false if out of memory. */
+bool sg_sgl_sum_scan(struct sg_sgl * sglp);
+
+/* For block index 'idx' (0 being the first block of the first element)
+ * returns its LBA and places the number of blocks from there to the end
+ * of that element in *remp. Returns -1 if idx is not less than sum. Uses
+ * a binary search so suits threads copying ranges in any order. */
+int64_t sg_sgl_idx_to_lba(const struct sg_sgl * sglp, int64_t idx,
+                          int * remp);
+
+/* Appends the extents of the num blocks starting at lba that are mapped
+ * (or whose state is unknown) according to GET LBA STATUS(16) sent to
+ * sg_fd; deallocated and anchored ranges are left out. Adjacent extents
+ * are merged, then sg_sgl_sum_scan() is called. Returns 0 on success,
+ * otherwise the (error) value of sg_ll_get_lba_status16() or
+ * SG_LIB_CAT_MALFORMED if the response is unusable. */
+int sg_sgl_from_lba_status(struct sg_sgl * sglp, int sg_fd, uint64_t lba,
+                           int64_t num, int verbose);
+
+/* A binary sgl file is a 64 byte header (holding SG_SGL_BIN_MAGIC, a byte
+ * order mark, SG_SGL_BIN_VERSION, then the number of elements, their sum,
+ * the lowest LBA, the highest LBA plus 1 and the linearity) followed by
+ * the elements as struct sg_sgl_elem in native byte order. It can be
+ * memory mapped and used as is, so very long lists load quickly.
+ * sg_sgl_parse() recognizes one given as "@FN". */
+#define SG_SGL_BIN_MAGIC "SGSGLB1"      /* with trailing NUL: 8 bytes */
+#define SG_SGL_BIN_VERSION 1
+
+/* A binary sgl file, mapped read-only by sg_sgl_bin_map() */
+struct sg_sgl_bin {
+    const struct sg_sgl_elem * elems;
+    int64_t num_elems;
+    int64_t sum;        /* following as saved in the header */
+    int64_t lowest_lba;
+    int64_t high_lba_p1;
+    int linearity;
+    bool mapped;
+    void * basep;
+    size_t total_len;
+};
+
+/* Returns true if the file named fn starts with SG_SGL_BIN_MAGIC */
+bool sg_sgl_is_bin_file(const char * fn);
+
+/* Writes *sglp, which should have been sg_sgl_sum_scan()-ed, to the file
+ * named fn in the binary format via a temporary file that is renamed.
+ * Returns 0 on success, else an errno based error */
+int sg_sgl_bin_save(const struct sg_sgl * sglp, const char * fn);
+
+/* Memory maps the file named fn, checking it was written by
+ * sg_sgl_bin_save() on a machine with the same byte order. Returns 0 on
+ * success; SG_LIB_FILE_ERROR if fn is not a valid binary sgl file, or an
+ * errno based error if it cannot be opened. Release with
+ * sg_sgl_bin_unmap(). */
+int sg_sgl_bin_map(const char * fn, struct sg_sgl_bin * sbp, bool vb);
+void sg_sgl_bin_unmap(struct sg_sgl_bin * sbp);
+
+/* Copies the elements of binary sgl file fn into *sglp (which should be
+ * zeroed or sg_sgl_free()-ed beforehand), then calls sg_sgl_sum_scan().
+ * Returns as sg_sgl_bin_map() does. */
+int sg_sgl_bin_load(struct sg_sgl * sglp, const char * fn, bool vb);
+
+const char * sg_sgl_linearity_str(int linearity);
+void sg_sgl_print(const struct sg_sgl * sglp, const char * id, bool show,
+                  FILE * fp);
+void sg_sgl_free(struct sg_sgl * sglp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* SG_SGL_H */
@@ -0,0 +1,102 @@
+#ifndef SG_ZMAP_H
+#define SG_ZMAP_H
+
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/* Zone state map: a packed array with one 16 byte entry per zone of a ZBC
+ * device (rather than the 64 byte descriptors of the REPORT ZONES response)
+ * holding each zone's start LBA, type, condition and write pointer offset.
+ * Zones are contiguous so the length of a zone is the distance to the start
+ * of the next one (or past the Maximum LBA for the last zone). A map is
+ * built from a full walk of the zones with REPORT ZONES, can be saved to a
+ * file and later loaded by memory mapping that file, then refreshed by
+ * re-reading only the zones selected by a reporting option. Lookups by LBA
+ * are a binary search of the array. */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SG_ZMAP_NO_WP 0xffffffffU       /* wp_off when there is none */
+
+/* Given as report_opts to sg_zmap_refresh(): re-reads the zones whose
+ * write pointer may move other than by the map's owner: those implicitly
+ * opened, explicitly opened or closed */
+#define SG_ZMAP_RO_ACTIVE 0x40
+
+struct sg_zmap_ent {
+    uint64_t start_lba;
+    uint32_t wp_off;    /* write pointer LBA - start_lba or SG_ZMAP_NO_WP */
+    uint8_t type;       /* zone type (e.g. 1: conventional, 2: SWR) */
+    uint8_t cond;       /* zone condition (e.g. 1: empty, 0xe: full) */
+    uint8_t flags;      /* PUEP, NON_SEQ and RESET bits as in descriptor */
+    uint8_t rsvd;       /* used internally while refreshing */
+};
+
+struct sg_zmap;         /* opaque */
+
+/* Builds a map of all zones of the ZBC device open as sg_fd. Each REPORT
+ * ZONES command uses an allocation length of mx_resp_len (0 for a default
+ * of 64 KiB). On success returns 0 and places the new map in *zmpp which
+ * should later be given to sg_zmap_free(). */
+int sg_zmap_build(int sg_fd, int mx_resp_len, struct sg_zmap ** zmpp,
+                  int verbose);
+
+/* Updates the entries of zmp for the zones that REPORT ZONES returns with
+ * report_opts in its REPORTING OPTIONS field (0 -> all zones) and the
+ * PARTIAL bit set. When report_opts selects a zone condition (1 to 8 or
+ * 0x3f), entries that had that condition but were not reported are also
+ * re-read since they have moved to another condition. SG_ZMAP_RO_ACTIVE
+ * does that for the open and closed conditions. The number of entries
+ * updated is placed in *num_updp if it is non-NULL. Returns 0 on success;
+ * SG_LIB_CAT_MALFORMED if the device's zones no longer correspond to the
+ * map (the map should then be rebuilt). */
+int sg_zmap_refresh(int sg_fd, struct sg_zmap * zmp, int report_opts,
+                    int mx_resp_len, uint32_t * num_updp, int verbose);
+
+/* Writes zmp to the file named fn, via a temporary file that is renamed.
+ * Entries are in native byte order. Returns 0 on success */
+int sg_zmap_save(const struct sg_zmap * zmp, const char * fn);
+
+/* Memory maps the file named fn, checking it was written by sg_zmap_save()
+ * on a machine with the same byte order. The mapping is private so a
+ * refresh does not change the file until it is saved. Returns 0 on success
+ * and places the map in *zmpp; SG_LIB_FILE_ERROR if fn is not a valid map
+ * file, or an errno based error if it cannot be opened. */
+int sg_zmap_load(const char * fn, struct sg_zmap ** zmpp, int verbose);
+
+void sg_zmap_free(struct sg_zmap * zmp);
+
+uint32_t sg_zmap_num_zones(const struct sg_zmap * zmp);
+uint64_t sg_zmap_max_lba(const struct sg_zmap * zmp);
+
+/* Returns entry idx or NULL if idx is out of range */
+const struct sg_zmap_ent * sg_zmap_entry(const struct sg_zmap * zmp,
+                                         uint32_t idx);
+
+/* Returns the length in logical blocks of zone idx, 0 if out of range */
+uint64_t sg_zmap_zone_len(const struct sg_zmap * zmp, uint32_t idx);
+
+/* Returns the index of the zone containing lba, or -1 if lba is beyond
+ * the Maximum LBA */
+int64_t sg_zmap_find(const struct sg_zmap * zmp, uint64_t lba);
+
+/* Returns the write pointer LBA of the zone containing lba, or UINT64_MAX
+ * if that zone has no valid write pointer (e.g. conventional or full) */
+uint64_t sg_zmap_wp(const struct sg_zmap * zmp, uint64_t lba);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* SG_ZMAP_H */
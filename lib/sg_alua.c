@@ -0,0 +1,325 @@
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/* sg_alua version 1.03 20261015 */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "sg_lib.h"
+#include "sg_cmds_basic.h"
+#include "sg_cmds_extra.h"
+#include "sg_unaligned.h"
+#include "sg_alua.h"
+#include "sg_mpoll.h"
+#include "sg_par.h"
+#include "sg_pr2serr.h"
+
+#define ALUA_VPD_DEVICE_ID 0x83
+#define ALUA_VPD_DI_LEN 2048
+#define ALUA_RTPG_LEN 8192
+
+struct alua_disc_t {
+    struct sg_alua_path * pa_arr;
+    bool o_readonly;
+    int verbose;
+};
+
+
+/* Logical unit designator as a string, preferring NAA, then EUI-64, then
+ * SCSI name string and lastly T10 vendor identification. */
+static void
+alua_lu_id(const struct sg_vpd_dev_id_idx * ixp, char * b, int blen)
+{
+    static const int pref_arr[] = {3, 2, 8, 1};
+    static const char * pfx_arr[] = {"naa.", "eui.", "", "t10."};
+    int k, j, n, off, d_len;
+    int len = ixp->page_len;
+    const uint8_t * bp = ixp->bp;
+    const uint8_t * dp;
+
+    b[0] = '\0';
+    for (k = 0; k < (int)(sizeof(pref_arr) / sizeof(pref_arr[0])); ++k) {
+        off = -1;
+        if (sg_vpd_dev_id_next(ixp, &off, 0 /* LU */, pref_arr[k], -1))
+            continue;
+        dp = bp + off;
+        d_len = dp[3];
+        if ((off + 4 + d_len) > len)
+            return;
+        n = snprintf(b, blen, "%s", pfx_arr[k]);
+        for (j = 0; (j < d_len) && (n < (blen - 3)); ++j) {
+            if ((dp[0] & 0xf) == 1)     /* binary */
+                n += snprintf(b + n, blen - n, "%02x", dp[4 + j]);
+            else if (isprint(dp[4 + j]) && (' ' != dp[4 + j]))
+                b[n++] = dp[4 + j];
+            else if (dp[4 + j])
+                b[n++] = '_';
+        }
+        b[n] = '\0';
+        return;
+    }
+}
+
+/* Relative target port, (primary) target port group and the first NAA or
+ * SCSI name designator of the target port of this path */
+static void
+alua_tport(const struct sg_vpd_dev_id_idx * ixp, struct sg_alua_path * pap)
+{
+    int j, n, d_len;
+    int off = -1;
+    int len = ixp->page_len;
+    const uint8_t * bp = ixp->bp;
+    const uint8_t * dp;
+
+    while (0 == sg_vpd_dev_id_next(ixp, &off, 1 /* target port */, -1,
+                                   -1)) {
+        dp = bp + off;
+        d_len = dp[3];
+        if ((off + 4 + d_len) > len)
+            break;
+        switch (dp[1] & 0xf) {
+        case 3:         /* NAA */
+        case 8:         /* SCSI name string */
+            if (pap->tport_id[0])
+                break;
+            for (j = 0, n = 0; (j < d_len) &&
+                 (n < (SG_ALUA_TPORT_ID_LEN - 3)); ++j) {
+                if (1 == (dp[0] & 0xf))
+                    n += snprintf(pap->tport_id + n,
+                                  SG_ALUA_TPORT_ID_LEN - n, "%02x",
+                                  dp[4 + j]);
+                else if (dp[4 + j])
+                    pap->tport_id[n++] = isprint(dp[4 + j]) ? dp[4 + j] :
+                                                              '_';
+            }
+            pap->tport_id[n] = '\0';
+            break;
+        case 4:         /* Relative target port */
+            if (4 == d_len)
+                pap->rel_tport = sg_get_unaligned_be16(dp + 6);
+            break;
+        case 5:         /* Target port group */
+            if (4 == d_len)
+                pap->tpg = sg_get_unaligned_be16(dp + 6);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+static int
+alua_rtpg(struct sg_alua_path * pap, uint8_t * rp, int vb)
+{
+    int k, n, off, len, res;
+    const uint8_t * bp;
+    struct sg_alua_tpg * tp;
+
+    res = sg_ll_report_tgt_prt_grp2(pap->sg_fd, rp, ALUA_RTPG_LEN, false,
+                                    vb > 0, vb > 1 ? vb - 1 : 0);
+    if (res)
+        return res;
+    len = sg_get_unaligned_be32(rp + 0) + 4;
+    if (len > ALUA_RTPG_LEN) {
+        if (vb)
+            pr2serr("%s: REPORT TARGET PORT GROUPS response truncated\n",
+                    pap->dev_name);
+        len = ALUA_RTPG_LEN;
+    }
+    for (k = 4, bp = rp + 4, n = 0; ((k + 8) <= len) &&
+         (n < SG_ALUA_MAX_TPGS); k += off, bp += off, ++n) {
+        tp = pap->tpg_arr + n;
+        tp->pref = !!(bp[0] & 0x80);
+        tp->state = bp[0] & 0xf;
+        tp->sup = bp[1];
+        tp->id = sg_get_unaligned_be16(bp + 2);
+        tp->status = bp[5];
+        tp->num_tports = bp[7];
+        off = 8 + (bp[7] * 4);
+    }
+    pap->num_tpgs = n;
+    return 0;
+}
+
+static int
+alua_disc_one(int64_t k, void * ctx)
+{
+    int res, len;
+    int vb;
+    int64_t t0;
+    struct alua_disc_t * dp = (struct alua_disc_t *)ctx;
+    struct sg_alua_path * pap = dp->pa_arr + k;
+    uint8_t * rp;
+    uint8_t * free_rp = NULL;
+    struct sg_vpd_dev_id_idx di_idx;
+
+    vb = dp->verbose;
+    t0 = sg_mpoll_now_ms();
+    pap->sg_fd = -1;
+    pap->rel_tport = -1;
+    pap->tpg = -1;
+    pap->num_tpgs = 0;
+    pap->lu_id[0] = '\0';
+    pap->tport_id[0] = '\0';
+    rp = sg_memalign(ALUA_RTPG_LEN, 0, &free_rp, false);
+    if (NULL == rp) {
+        pap->res = sg_convert_errno(ENOMEM);
+        return 0;
+    }
+    pap->sg_fd = sg_cmds_open_device(pap->dev_name, dp->o_readonly, vb);
+    if (pap->sg_fd < 0) {
+        pr2serr("open error: %s: %s\n", pap->dev_name,
+                safe_strerror(-pap->sg_fd));
+        pap->res = sg_convert_errno(-pap->sg_fd);
+        pap->sg_fd = -1;
+        goto fini;
+    }
+    res = sg_ll_inquiry(pap->sg_fd, false, true /* EVPD */,
+                        ALUA_VPD_DEVICE_ID, rp, ALUA_VPD_DI_LEN, vb > 0,
+                        vb > 1 ? vb - 1 : 0);
+    if (res) {
+        if (pap->vpd_only)
+            goto fini;
+        pr2serr("%s: Device Identification VPD page not available\n",
+                pap->dev_name);
+        pap->res = res;
+        goto fini;
+    }
+    len = sg_get_unaligned_be16(rp + 2) + 4;
+    if ((ALUA_VPD_DEVICE_ID != rp[1]) || (len > ALUA_VPD_DI_LEN)) {
+        if (pap->vpd_only)
+            goto fini;
+        pr2serr("%s: bad Device Identification VPD page\n", pap->dev_name);
+        pap->res = SG_LIB_CAT_MALFORMED;
+        goto fini;
+    }
+    sg_vpd_dev_id_index(rp + 4, len - 4, &di_idx);
+    alua_lu_id(&di_idx, pap->lu_id, sizeof(pap->lu_id));
+    alua_tport(&di_idx, pap);
+    if (pap->vpd_only)
+        goto fini;
+    res = alua_rtpg(pap, rp, vb);
+    if (res) {
+        char b[80];
+
+        sg_get_category_sense_str(res, sizeof(b), b, vb);
+        pr2serr("%s: Report Target Port Groups: %s\n", pap->dev_name, b);
+        pap->res = res;
+    }
+fini:
+    if (free_rp)
+        free(free_rp);
+    if ((pap->sg_fd >= 0) && (pap->res || (! pap->keep_open))) {
+        sg_cmds_close_device(pap->sg_fd);
+        pap->sg_fd = -1;
+    }
+    pap->elapsed_ms = sg_mpoll_now_ms() - t0;
+    return 0;
+}
+
+int
+sg_alua_discover(struct sg_alua_path * pa_arr, int num, int num_parallel,
+                 bool o_readonly, int verbose)
+{
+    int k, n_bad;
+    struct alua_disc_t disc;
+
+    disc.pa_arr = pa_arr;
+    disc.o_readonly = o_readonly;
+    disc.verbose = verbose;
+    for (k = 0; k < num; ++k)
+        pa_arr[k].res = 0;
+    sg_par_each(num, num_parallel, alua_disc_one, &disc);
+    for (k = 0, n_bad = 0; k < num; ++k) {
+        if (pa_arr[k].res)
+            ++n_bad;
+    }
+    return n_bad;
+}
+
+int
+sg_alua_tport_groups(const struct sg_alua_path * pa_arr, int num,
+                     int * grp_arr)
+{
+    int k, j;
+    int num_grps = 0;
+    const struct sg_alua_path * pap;
+    const struct sg_alua_path * qp;
+
+    for (k = 0, pap = pa_arr; k < num; ++k, ++pap) {
+        for (j = 0, qp = pa_arr; j < k; ++j, ++qp) {
+            if (pap->tport_id[0] || qp->tport_id[0]) {
+                if (0 == strcmp(pap->tport_id, qp->tport_id))
+                    break;
+            } else if (pap->tpg == qp->tpg)
+                break;  /* includes both unknown (-1) */
+        }
+        grp_arr[k] = (j < k) ? grp_arr[j] : num_grps++;
+    }
+    return num_grps;
+}
+
+void
+sg_alua_close(struct sg_alua_path * pa_arr, int num)
+{
+    int k;
+
+    for (k = 0; k < num; ++k) {
+        if (pa_arr[k].sg_fd >= 0) {
+            sg_cmds_close_device(pa_arr[k].sg_fd);
+            pa_arr[k].sg_fd = -1;
+        }
+    }
+}
+
+const struct sg_alua_tpg *
+sg_alua_find_tpg(const struct sg_alua_path * pa, int tpg_id)
+{
+    int k;
+
+    for (k = 0; k < pa->num_tpgs; ++k) {
+        if (pa->tpg_arr[k].id == tpg_id)
+            return pa->tpg_arr + k;
+    }
+    return NULL;
+}
+
+const char *
+sg_alua_state_str(int state)
+{
+    switch (state) {
+    case 0x0:
+        return "active/optimized";
+    case 0x1:
+        return "active/non optimized";
+    case 0x2:
+        return "standby";
+    case 0x3:
+        return "unavailable";
+    case 0x4:
+        return "logical block dependent";
+    case 0xe:
+        return "offline";
+    case 0xf:
+        return "transitioning between states";
+    default:
+        return "unknown";
+    }
+}
@@ -0,0 +1,271 @@
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/* sg_broker version 1.00 20261015 */
+
+/* Client side of the device broker, see sg_broker.h . Each lease holds the
+ * connected socket to the broker: the broker takes the device back when
+ * that socket is closed, either by sg_broker_release() or by this process
+ * exiting. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef SG_LIB_LINUX
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+#include "sg_lib.h"
+#include "sg_broker.h"
+#include "sg_pr2serr.h"
+
+#ifdef SG_LIB_LINUX
+
+#define SG_BROKER_MAX_LEASES 16
+
+struct sg_broker_lease {
+    int dev_fd;                 /* -1 when slot free */
+    int sock_fd;
+    struct sg_broker_info info;
+};
+
+static int broker_env = -1;     /* -1: not checked, 0: unset, 1: set */
+static const char * broker_path;
+static int num_leases;
+static struct sg_broker_lease lease_arr[SG_BROKER_MAX_LEASES];
+
+
+/* A leased file descriptor closed without sg_broker_release() may have
+ * been reused, so check it still refers to the same device. */
+static struct sg_broker_lease *
+broker_find(int dev_fd)
+{
+    int k;
+    struct sg_broker_lease * lp;
+    struct stat st;
+
+    if (dev_fd < 0)
+        return NULL;
+    for (k = 0, lp = lease_arr; k < num_leases; ++k, ++lp) {
+        if (dev_fd != lp->dev_fd)
+            continue;
+        if ((fstat(dev_fd, &st) < 0) ||
+            ((uint64_t)st.st_rdev != lp->info.st_rdev) ||
+            ((uint32_t)st.st_mode != lp->info.st_mode)) {
+            close(lp->sock_fd);
+            lp->sock_fd = -1;
+            lp->dev_fd = -1;
+            return NULL;
+        }
+        return lp;
+    }
+    return NULL;
+}
+
+/* Receives the reply and, if it has one, the file descriptor. Returns the
+ * file descriptor or -1. */
+static int
+broker_recv(int sock_fd, struct sg_broker_rep * repp, int verbose)
+{
+    int fd = -1;
+    ssize_t n;
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr * cmp;
+    union {
+        char b[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } cbuf;
+
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = repp;
+    iov.iov_len = sizeof(*repp);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf.b;
+    msg.msg_controllen = sizeof(cbuf.b);
+    do {
+        n = recvmsg(sock_fd, &msg, 0);
+    } while ((n < 0) && (EINTR == errno));
+    if (n != (ssize_t)sizeof(*repp)) {
+        if (verbose > 1)
+            pr2ws("%s: short reply from broker\n", __func__);
+        return -1;
+    }
+    for (cmp = CMSG_FIRSTHDR(&msg); cmp; cmp = CMSG_NXTHDR(&msg, cmp)) {
+        if ((SOL_SOCKET == cmp->cmsg_level) &&
+            (SCM_RIGHTS == cmp->cmsg_type) &&
+            (cmp->cmsg_len >= CMSG_LEN(sizeof(int))))
+            memcpy(&fd, CMSG_DATA(cmp), sizeof(int));
+    }
+    if ((SG_BROKER_MAGIC != repp->magic) || repp->err) {
+        if (verbose > 1)
+            pr2ws("%s: broker declined: %s\n", __func__,
+                  repp->err ? safe_strerror(repp->err) : "bad magic");
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int
+sg_broker_open(const char * dev_name, int flags, int verbose)
+{
+    int sock_fd, dev_fd, k;
+    int acc = flags & O_ACCMODE;
+    struct sg_broker_lease * lp;
+    struct sockaddr_un sun;
+    struct sg_broker_req req;
+    struct sg_broker_rep rep;
+
+    if (broker_env < 0) {
+        broker_path = getenv(SG_BROKER_ENV);
+        if (broker_path && ('\0' == broker_path[0]))
+            broker_path = SG_BROKER_DEF_SOCKET;
+        broker_env = broker_path ? 1 : 0;
+    }
+    if (0 == broker_env)
+        return -1;
+    /* other flags (e.g. O_EXCL or O_DIRECT) need an open of their own */
+    if ((flags & ~(O_ACCMODE | O_NONBLOCK)) || (! (flags & O_NONBLOCK)) ||
+        ((O_RDONLY != acc) && (O_RDWR != acc)) ||
+        (strlen(dev_name) >= SG_BROKER_NAME_MAX))
+        return -1;
+    for (k = 0; k < num_leases; ++k) {
+        if (lease_arr[k].dev_fd < 0)
+            break;
+    }
+    if (k >= SG_BROKER_MAX_LEASES)
+        return -1;
+    lp = lease_arr + k;
+
+    sock_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock_fd < 0)
+        return -1;
+    memset(&sun, 0, sizeof(sun));
+    sun.sun_family = AF_UNIX;
+    strncpy(sun.sun_path, broker_path, sizeof(sun.sun_path) - 1);
+    if (connect(sock_fd, (const struct sockaddr *)&sun, sizeof(sun)) < 0) {
+        if (verbose > 1)
+            pr2ws("%s: no broker at %s: %s\n", __func__, broker_path,
+                  safe_strerror(errno));
+        close(sock_fd);
+        return -1;
+    }
+    memset(&req, 0, sizeof(req));
+    req.magic = SG_BROKER_MAGIC;
+    req.flags = (O_RDWR == acc) ? SG_BROKER_FL_RDWR : 0;
+    strcpy(req.dev_name, dev_name);
+    if (send(sock_fd, &req, sizeof(req), MSG_NOSIGNAL) !=
+        (ssize_t)sizeof(req)) {
+        close(sock_fd);
+        return -1;
+    }
+    dev_fd = broker_recv(sock_fd, &rep, verbose);
+    if (dev_fd < 0) {
+        close(sock_fd);
+        return -1;
+    }
+    lp->dev_fd = dev_fd;
+    lp->sock_fd = sock_fd;
+    lp->info = rep.info;
+    if (k == num_leases)
+        ++num_leases;
+    if (verbose > 1)
+        pr2ws("%s: %s leased from broker as fd=%d\n", __func__, dev_name,
+              dev_fd);
+    return dev_fd;
+}
+
+const struct sg_broker_info *
+sg_broker_info(int dev_fd)
+{
+    const struct sg_broker_lease * lp = broker_find(dev_fd);
+
+    return lp ? &lp->info : NULL;
+}
+
+int
+sg_broker_get(int dev_fd, const char * name, uint8_t * rp, int mx_len)
+{
+    int k, n;
+    const struct sg_broker_id * idp;
+    const struct sg_broker_lease * lp = broker_find(dev_fd);
+
+    if ((NULL == lp) || (mx_len <= 0))
+        return -1;
+    for (k = 0, idp = lp->info.id_arr; k < SG_BROKER_NUM_IDS; ++k, ++idp) {
+        if (idp->len && (0 == strncmp(name, idp->name, sizeof(idp->name))))
+            break;
+    }
+    if (k >= SG_BROKER_NUM_IDS)
+        return -1;
+    /* if the device filled the allocation length there may be more */
+    if ((mx_len > idp->len) && (idp->len >= idp->alloc_len))
+        return -1;
+    n = (mx_len < idp->len) ? mx_len : idp->len;
+    memcpy(rp, idp->resp, n);
+    return n;
+}
+
+void
+sg_broker_release(int dev_fd)
+{
+    struct sg_broker_lease * lp = broker_find(dev_fd);
+
+    if (lp) {
+        close(lp->sock_fd);
+        lp->sock_fd = -1;
+        lp->dev_fd = -1;
+    }
+}
+
+#else   /* not SG_LIB_LINUX */
+
+int
+sg_broker_open(const char * dev_name, int flags, int verbose)
+{
+    if (dev_name || flags || verbose) { }
+    return -1;
+}
+
+const struct sg_broker_info *
+sg_broker_info(int dev_fd)
+{
+    if (dev_fd) { }
+    return NULL;
+}
+
+int
+sg_broker_get(int dev_fd, const char * name, uint8_t * rp, int mx_len)
+{
+    if (dev_fd || name || rp || mx_len) { }
+    return -1;
+}
+
+void
+sg_broker_release(int dev_fd)
+{
+    if (dev_fd) { }
+}
+
+#endif  /* SG_LIB_LINUX */
@@ -0,0 +1,467 @@
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/* sg_cimg version 1.00 20261015 */
+
+#define _XOPEN_SOURCE 600
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_ZSTD_H
+#include <zstd.h>
+#endif
+#ifdef HAVE_LZ4_H
+#include <lz4.h>
+#endif
+
+#include "sg_lib.h"
+#include "sg_cimg.h"
+#include "sg_hash.h"
+#include "sg_unaligned.h"
+#include "sg_pr2serr.h"
+
+#define SG_CIMG_VERSION 1
+
+static const uint8_t cimg_hdr_magic[8] = {'s', 'g', '3', 'c', 'i', 'm', 'g',
+                                          '1'};
+static const uint8_t cimg_trl_magic[8] = {'s', 'g', '3', 'c', 'i', 'd', 'x',
+                                          '1'};
+
+struct sg_cimg_ctx {
+    int alg;
+    int level;
+#ifdef HAVE_ZSTD_H
+    ZSTD_CCtx * zcp;            /* each made on first use */
+    ZSTD_DCtx * zdp;
+#endif
+};
+
+
+int
+sg_cimg_alg_from_name(const char * name)
+{
+    if (NULL == name)
+        return -1;
+    if (0 == strcmp(name, "zstd"))
+        return SG_CIMG_ZSTD;
+    if (0 == strcmp(name, "lz4"))
+        return SG_CIMG_LZ4;
+    return -1;
+}
+
+const char *
+sg_cimg_alg_name(int alg)
+{
+    switch (alg) {
+    case SG_CIMG_ZSTD:
+        return "zstd";
+    case SG_CIMG_LZ4:
+        return "lz4";
+    case SG_CIMG_RAW:
+        return "raw";
+    default:
+        return NULL;
+    }
+}
+
+bool
+sg_cimg_alg_avail(int alg)
+{
+    switch (alg) {
+    case SG_CIMG_RAW:
+        return true;
+#ifdef HAVE_ZSTD_H
+    case SG_CIMG_ZSTD:
+        return true;
+#endif
+#ifdef HAVE_LZ4_H
+    case SG_CIMG_LZ4:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+struct sg_cimg_ctx *
+sg_cimg_ctx_new(int alg, int level)
+{
+    struct sg_cimg_ctx * czp;
+
+    if (! sg_cimg_alg_avail(alg))
+        return NULL;
+    czp = (struct sg_cimg_ctx *)calloc(1, sizeof(*czp));
+    if (NULL == czp)
+        return NULL;
+    czp->alg = alg;
+    czp->level = level;
+    return czp;
+}
+
+void
+sg_cimg_ctx_free(struct sg_cimg_ctx * czp)
+{
+    if (NULL == czp)
+        return;
+#ifdef HAVE_ZSTD_H
+    if (czp->zcp)
+        ZSTD_freeCCtx(czp->zcp);
+    if (czp->zdp)
+        ZSTD_freeDCtx(czp->zdp);
+#endif
+    free(czp);
+}
+
+int
+sg_cimg_bound(int alg, int len)
+{
+    switch (alg) {
+#ifdef HAVE_ZSTD_H
+    case SG_CIMG_ZSTD:
+        return (int)ZSTD_compressBound((size_t)len);
+#endif
+#ifdef HAVE_LZ4_H
+    case SG_CIMG_LZ4:
+        return LZ4_compressBound(len);
+#endif
+    default:
+        return len;
+    }
+}
+
+int
+sg_cimg_compress(struct sg_cimg_ctx * czp, const uint8_t * src, int slen,
+                 uint8_t * dst, int dlen)
+{
+    int n = -1;
+
+    if ((NULL == czp) || (NULL == src) || (NULL == dst) || (slen < 0) ||
+        (dlen < 0))
+        return -1;
+    switch (czp->alg) {
+#ifdef HAVE_ZSTD_H
+    case SG_CIMG_ZSTD:
+        {
+            size_t r;
+
+            if (NULL == czp->zcp) {
+                czp->zcp = ZSTD_createCCtx();
+                if (NULL == czp->zcp)
+                    return -1;
+            }
+            r = ZSTD_compressCCtx(czp->zcp, dst, dlen, src, slen,
+                                  (czp->level > 0) ? czp->level : 3);
+            if (ZSTD_isError(r))
+                return -1;
+            n = (int)r;
+        }
+        break;
+#endif
+#ifdef HAVE_LZ4_H
+    case SG_CIMG_LZ4:
+        n = LZ4_compress_fast((const char *)src, (char *)dst, slen, dlen,
+                              (czp->level > 0) ? czp->level : 1);
+        if (n <= 0)
+            return -1;
+        break;
+#endif
+    case SG_CIMG_RAW:
+        return 0;
+    default:
+        return -1;
+    }
+    return (n < slen) ? n : 0;
+}
+
+int
+sg_cimg_decompress(struct sg_cimg_ctx * czp, const uint8_t * src, int slen,
+                   uint8_t * dst, int dlen)
+{
+    if ((NULL == czp) || (NULL == src) || (NULL == dst) || (slen < 0) ||
+        (dlen < 0))
+        return -1;
+    switch (czp->alg) {
+#ifdef HAVE_ZSTD_H
+    case SG_CIMG_ZSTD:
+        {
+            size_t r;
+
+            if (NULL == czp->zdp) {
+                czp->zdp = ZSTD_createDCtx();
+                if (NULL == czp->zdp)
+                    return -1;
+            }
+            r = ZSTD_decompressDCtx(czp->zdp, dst, dlen, src, slen);
+            return ZSTD_isError(r) ? -1 : (int)r;
+        }
+#endif
+#ifdef HAVE_LZ4_H
+    case SG_CIMG_LZ4:
+        {
+            int n = LZ4_decompress_safe((const char *)src, (char *)dst,
+                                        slen, dlen);
+
+            return (n < 0) ? -1 : n;
+        }
+#endif
+    case SG_CIMG_RAW:
+        if (slen > dlen)
+            return -1;
+        memcpy(dst, src, slen);
+        return slen;
+    default:
+        return -1;
+    }
+}
+
+uint32_t
+sg_cimg_crc(const uint8_t * bp, int len)
+{
+    struct sg_hash_ctx hc;
+    uint8_t d[SG_HASH_MAX_DIGEST_LEN];
+
+    sg_hash_init(&hc, SG_HASH_CRC32C);
+    sg_hash_update(&hc, bp, len);
+    sg_hash_final(&hc, d);
+    return sg_get_unaligned_be32(d);
+}
+
+void
+sg_cimg_hdr_enc(const struct sg_cimg_hdr * hp, uint8_t * b)
+{
+    memset(b, 0, SG_CIMG_HDR_LEN);
+    memcpy(b, cimg_hdr_magic, sizeof(cimg_hdr_magic));
+    sg_put_unaligned_le32(SG_CIMG_VERSION, b + 8);
+    sg_put_unaligned_le32(hp->alg, b + 12);
+    sg_put_unaligned_le32(hp->bs, b + 16);
+    sg_put_unaligned_le32(hp->chunk_blks, b + 20);
+}
+
+/* Writes or reads all len bytes, retrying after EINTR and partial
+ * transfers. Returns 0 or errno (EIO if the file ended early). */
+static int
+cimg_xfer(int fd, bool wr, bool seq, uint8_t * bp, size_t len, off_t pos)
+{
+    ssize_t res;
+
+    while (len > 0) {
+        if (wr)
+            res = seq ? write(fd, bp, len) : pwrite(fd, bp, len, pos);
+        else
+            res = pread(fd, bp, len, pos);
+        if (res < 0) {
+            if ((EINTR == errno) || (EAGAIN == errno))
+                continue;
+            return errno;
+        }
+        if (0 == res)
+            return EIO;
+        bp += res;
+        len -= res;
+        pos += res;
+    }
+    return 0;
+}
+
+int
+sg_cimg_write_index(int fd, bool seq, uint64_t pos,
+                    const struct sg_cimg_ent * ents, int64_t n,
+                    uint64_t tot_blks)
+{
+    int err;
+    int64_t k, m;
+    uint8_t * bp;
+    uint8_t * ip;
+    size_t len;
+
+    for (k = 0, m = 0; k < n; ++k) {
+        if (ents[k].num_blks > 0)
+            ++m;
+    }
+    len = (m * SG_CIMG_ENT_LEN) + SG_CIMG_TRL_LEN;
+    bp = (uint8_t *)calloc(1, len);
+    if (NULL == bp)
+        return sg_convert_errno(ENOMEM);
+    for (k = 0, ip = bp; k < n; ++k) {
+        if (0 == ents[k].num_blks)
+            continue;
+        sg_put_unaligned_le64(ents[k].blk, ip + 0);
+        sg_put_unaligned_le64(ents[k].pos, ip + 8);
+        sg_put_unaligned_le32(ents[k].clen, ip + 16);
+        sg_put_unaligned_le32(ents[k].num_blks, ip + 20);
+        sg_put_unaligned_le32(ents[k].crc, ip + 24);
+        sg_put_unaligned_le32(ents[k].flags, ip + 28);
+        ip += SG_CIMG_ENT_LEN;
+        if (tot_blks < ents[k].blk + ents[k].num_blks)
+            tot_blks = ents[k].blk + ents[k].num_blks;
+    }
+    sg_put_unaligned_le64(pos, ip + 0);
+    sg_put_unaligned_le64((uint64_t)m, ip + 8);
+    sg_put_unaligned_le64(tot_blks, ip + 16);
+    memcpy(ip + 24, cimg_trl_magic, sizeof(cimg_trl_magic));
+    err = cimg_xfer(fd, true, seq, bp, len, (off_t)pos);
+    free(bp);
+    return err ? sg_convert_errno(err) : 0;
+}
+
+int
+sg_cimg_load(int fd, struct sg_cimg_hdr * hp, struct sg_cimg_ent ** entsp,
+              int64_t * np, int64_t * tot_blksp, int vb)
+{
+    int err, bound;
+    int64_t k, n;
+    uint64_t ipos, tot_blks, end;
+    struct stat st;
+    struct sg_cimg_ent * ents;
+    struct sg_cimg_ent * ep;
+    const uint8_t * ip;
+    uint8_t * bp;
+    uint8_t b[SG_CIMG_HDR_LEN];
+
+    *entsp = NULL;
+    *np = 0;
+    if (fstat(fd, &st) < 0)
+        return sg_convert_errno(errno);
+    if (st.st_size < (SG_CIMG_HDR_LEN + SG_CIMG_TRL_LEN)) {
+        pr2ws("%s: too short to be a compressed image\n", __func__);
+        return SG_LIB_FILE_ERROR;
+    }
+    err = cimg_xfer(fd, false, false, b, SG_CIMG_HDR_LEN, 0);
+    if (err)
+        return sg_convert_errno(err);
+    if (memcmp(b, cimg_hdr_magic, sizeof(cimg_hdr_magic))) {
+        pr2ws("%s: not a compressed image (bad magic)\n", __func__);
+        return SG_LIB_FILE_ERROR;
+    }
+    if (SG_CIMG_VERSION != sg_get_unaligned_le32(b + 8)) {
+        pr2ws("%s: compressed image version %u not supported\n", __func__,
+              sg_get_unaligned_le32(b + 8));
+        return SG_LIB_FILE_ERROR;
+    }
+    hp->alg = (int)sg_get_unaligned_le32(b + 12);
+    hp->bs = (int)sg_get_unaligned_le32(b + 16);
+    hp->chunk_blks = (int)sg_get_unaligned_le32(b + 20);
+    if ((NULL == sg_cimg_alg_name(hp->alg)) || (hp->bs < 1) ||
+        (hp->chunk_blks < 1) ||
+        ((int64_t)hp->bs * hp->chunk_blks > INT32_MAX)) {
+        pr2ws("%s: bad compressed image header\n", __func__);
+        return SG_LIB_FILE_ERROR;
+    }
+    err = cimg_xfer(fd, false, false, b, SG_CIMG_TRL_LEN,
+                    st.st_size - SG_CIMG_TRL_LEN);
+    if (err)
+        return sg_convert_errno(err);
+    if (memcmp(b + 24, cimg_trl_magic, sizeof(cimg_trl_magic))) {
+        pr2ws("%s: no index at end of compressed image, was it "
+              "finished?\n", __func__);
+        return SG_LIB_FILE_ERROR;
+    }
+    ipos = sg_get_unaligned_le64(b + 0);
+    n = (int64_t)sg_get_unaligned_le64(b + 8);
+    tot_blks = sg_get_unaligned_le64(b + 16);
+    if ((ipos < SG_CIMG_HDR_LEN) || (n < 0) ||
+        (n > (int64_t)((st.st_size - SG_CIMG_HDR_LEN) / SG_CIMG_ENT_LEN)) ||
+        (ipos + ((uint64_t)n * SG_CIMG_ENT_LEN) + SG_CIMG_TRL_LEN !=
+         (uint64_t)st.st_size)) {
+        pr2ws("%s: bad compressed image trailer\n", __func__);
+        return SG_LIB_FILE_ERROR;
+    }
+    bp = (uint8_t *)malloc((n * SG_CIMG_ENT_LEN) + 1);
+    ents = (struct sg_cimg_ent *)calloc(n + 1, sizeof(*ents));
+    if ((NULL == bp) || (NULL == ents)) {
+        free(bp);
+        free(ents);
+        return sg_convert_errno(ENOMEM);
+    }
+    err = cimg_xfer(fd, false, false, bp, n * SG_CIMG_ENT_LEN, ipos);
+    if (err) {
+        free(bp);
+        free(ents);
+        return sg_convert_errno(err);
+    }
+    bound = sg_cimg_bound(hp->alg, hp->bs * hp->chunk_blks);
+    for (k = 0, end = 0, ip = bp; k < n; ++k, ip += SG_CIMG_ENT_LEN) {
+        ep = ents + k;
+        ep->blk = sg_get_unaligned_le64(ip + 0);
+        ep->pos = sg_get_unaligned_le64(ip + 8);
+        ep->clen = sg_get_unaligned_le32(ip + 16);
+        ep->num_blks = sg_get_unaligned_le32(ip + 20);
+        ep->crc = sg_get_unaligned_le32(ip + 24);
+        ep->flags = sg_get_unaligned_le32(ip + 28);
+        /* in block order without overlaps, frames between header and
+         * index */
+        if ((ep->blk < end) || (0 == ep->num_blks) ||
+            (ep->num_blks > (uint32_t)hp->chunk_blks) ||
+            (ep->pos < SG_CIMG_HDR_LEN) || (ep->pos + ep->clen > ipos) ||
+            ((SG_CIMG_RAW == hp->alg) && (! (ep->flags & SG_CIMG_F_RAW))) ||
+            ((ep->flags & SG_CIMG_F_RAW) ?
+             (ep->clen != ep->num_blks * (uint32_t)hp->bs) :
+             ((sg_cimg_alg_avail(hp->alg) && (ep->clen > (uint32_t)bound)) ||
+              (0 == ep->clen)))) {
+            pr2ws("%s: bad compressed image index entry %" PRId64 "\n",
+                  __func__, k);
+            free(bp);
+            free(ents);
+            return SG_LIB_FILE_ERROR;
+        }
+        end = ep->blk + ep->num_blks;
+    }
+    free(bp);
+    if (tot_blks < end) {
+        pr2ws("%s: compressed image trailer: %" PRIu64 " blocks but index "
+              "goes to %" PRIu64 "\n", __func__, tot_blks, end);
+        free(ents);
+        return SG_LIB_FILE_ERROR;
+    }
+    if (vb && (SG_CIMG_RAW == hp->alg))
+        pr2ws("sparse image: bs=%d, %" PRId64 " extents, %" PRIu64
+              " blocks\n", hp->bs, n, tot_blks);
+    else if (vb)
+        pr2ws("compressed image: %s, bs=%d, %d blocks per chunk, %" PRId64
+              " frames, %" PRIu64 " blocks\n", sg_cimg_alg_name(hp->alg),
+              hp->bs, hp->chunk_blks, n, tot_blks);
+    *entsp = ents;
+    *np = n;
+    *tot_blksp = (int64_t)tot_blks;
+    return 0;
+}
+
+const struct sg_cimg_ent *
+sg_cimg_find(const struct sg_cimg_ent * ents, int64_t n, uint64_t blk)
+{
+    int64_t lo = 0;
+    int64_t hi = n - 1;
+    int64_t mid;
+
+    /* find the first entry that ends after blk */
+    while (lo <= hi) {
+        mid = lo + ((hi - lo) / 2);
+        if (ents[mid].blk + ents[mid].num_blks <= blk)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+    return (lo < n) ? (ents + lo) : NULL;
+}
@@ -35,6 +35,8 @@
 #include "sg_pt.h"
 #include "sg_unaligned.h"
 #include "sg_pr2serr.h"
+#include "sg_rcache.h"
+#include "sg_broker.h"
 
 /* Needs to be after config.h */
 #ifdef SG_LIB_LINUX
@@ -42,13 +44,13 @@
 #endif
 
 
-static const char * const version_str = "2.02 20230311";
+static const char * const version_str = "2.04 20261015";
 
 
 #define SENSE_BUFF_LEN 64       /* Arbitrary, could be larger */
 #define EBUFF_SZ 256
 
-#define DEF_PT_TIMEOUT 60       /* 60 seconds */
+#define DEF_PT_TIMEOUT 0        /* device RSOC figure (if known) else 60 s */
 #define START_PT_TIMEOUT 120    /* 120 seconds == 2 minutes */
 #define LONG_PT_TIMEOUT 7200    /* 7,200 seconds == 120 minutes */
 
@@ -367,9 +369,9 @@ sg_cmds_is_nvme(const struct sg_pt_base * ptvp)
 }
 
 static struct sg_pt_base *
-create_pt_obj(const char * cname)
+create_pt_obj(int sg_fd, const char * cname)
 {
-    struct sg_pt_base * ptvp = construct_scsi_pt_obj();
+    struct sg_pt_base * ptvp = sg_pt_pool_get_obj(sg_fd, 0);
     if (NULL == ptvp)
         pr2ws("%s: out of memory\n", cname);
     return ptvp;
@@ -388,8 +390,9 @@ sg_ll_inquiry_com(struct sg_pt_base * ptvp, int sg_fd, bool cmddt, bool evpd,
     bool ptvp_given = false;
     bool local_sense = true;
     bool local_cdb = true;
-    int res, ret, sense_cat, resid;
+    int res, ret, sense_cat, resid, fd;
     uint8_t inq_cdb[INQUIRY_CMDLEN] = {INQUIRY_CMD, 0, 0, 0, 0, 0};
+    char rc_name[16];
     uint8_t sense_b[SENSE_BUFF_LEN] SG_C_CPP_ZERO_INIT;
     uint8_t * up;
 
@@ -412,6 +415,24 @@ sg_ll_inquiry_com(struct sg_pt_base * ptvp, int sg_fd, bool cmddt, bool evpd,
               sg_get_command_str(inq_cdb, INQUIRY_CMDLEN, false, sizeof(b),
                                  b));
     }
+    fd = ptvp ? get_pt_file_handle(ptvp) : sg_fd;
+    if (cmddt || (ptvp && get_scsi_pt_cdb_buf(ptvp)) ||
+        (! (sg_rcache_active(fd) || sg_broker_info(fd))))
+        rc_name[0] = '\0';
+    else {
+        snprintf(rc_name, sizeof(rc_name), "%s_%02x", evpd ? "vpd" : "inq",
+                 pg_op & 0xff);
+        ret = sg_rcache_get(fd, rc_name, (uint8_t *)resp, mx_resp_len);
+        if (ret >= 4) {
+            if (verbose)
+                pr2ws("    %s response from cache\n", inquiry_s);
+            if (ret < mx_resp_len)
+                memset((uint8_t *)resp + ret, 0, mx_resp_len - ret);
+            if (residp)
+                *residp = mx_resp_len - ret;
+            return 0;
+        }
+    }
     if (mx_resp_len > 0) {
         up = (uint8_t *)resp;
         up[0] = 0x7f;   /* defensive prefill */
@@ -432,7 +453,7 @@ sg_ll_inquiry_com(struct sg_pt_base * ptvp, int sg_fd, bool cmddt, bool evpd,
         else
             set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
     } else {
-        ptvp = construct_scsi_pt_obj_with_fd(sg_fd, verbose);
+        ptvp = sg_pt_pool_get_obj(sg_fd, verbose);
         if (NULL == ptvp)
             return sg_convert_errno(ENOMEM);
         set_scsi_pt_cdb(ptvp, inq_cdb, sizeof(inq_cdb));
@@ -478,6 +499,9 @@ sg_ll_inquiry_com(struct sg_pt_base * ptvp, int sg_fd, bool cmddt, bool evpd,
         /* zero unfilled section of response buffer, based on resid */
         memset((uint8_t *)resp + (mx_resp_len - resid), 0, resid);
     }
+    if ((0 == ret) && rc_name[0])
+        sg_rcache_put(fd, rc_name, (const uint8_t *)resp, mx_resp_len,
+                      mx_resp_len - resid);
 fini:
     if (ptvp_given) {
         if (local_sense)    /* stop caller trying to access local sense */
@@ -486,7 +510,7 @@ fini:
             set_scsi_pt_cdb(ptvp, NULL, 0);
     } else {
         if (ptvp)
-            destruct_scsi_pt_obj(ptvp);
+            sg_pt_pool_put_obj(ptvp);
     }
     return ret;
 }
@@ -552,7 +576,7 @@ sg_simple_inquiry(int sg_fd, struct sg_simple_inquiry_resp * inq_data,
         inq_data->peripheral_qualifier = 0x3;
         inq_data->peripheral_type = PDT_UNKNOWN;
     }
-    inq_resp = sg_memalign(SAFE_STD_INQ_RESP_LEN, 0, &free_irp, false);
+    inq_resp = sg_pt_pool_get_buf(SAFE_STD_INQ_RESP_LEN, &free_irp, false);
     if (NULL == inq_resp) {
         pr2ws("%s: out of memory\n", __func__);
         return sg_convert_errno(ENOMEM);
@@ -573,8 +597,7 @@ sg_simple_inquiry(int sg_fd, struct sg_simple_inquiry_resp * inq_data,
         memcpy(inq_data->product, inq_resp + 16, 16);
         memcpy(inq_data->revision, inq_resp + 32, 4);
     }
-    if (free_irp)
-        free(free_irp);
+    sg_pt_pool_put_buf(free_irp, SAFE_STD_INQ_RESP_LEN);
     return ret;
 }
 
@@ -594,7 +617,7 @@ sg_simple_inquiry_pt(struct sg_pt_base * ptvp,
         inq_data->peripheral_qualifier = 0x3;
         inq_data->peripheral_type = PDT_MASK;
     }
-    inq_resp = sg_memalign(SAFE_STD_INQ_RESP_LEN, 0, &free_irp, false);
+    inq_resp = sg_pt_pool_get_buf(SAFE_STD_INQ_RESP_LEN, &free_irp, false);
     if (NULL == inq_resp) {
         pr2ws("%s: out of memory\n", __func__);
         return sg_convert_errno(ENOMEM);
@@ -615,8 +638,7 @@ sg_simple_inquiry_pt(struct sg_pt_base * ptvp,
         memcpy(inq_data->product, inq_resp + 16, 16);
         memcpy(inq_data->revision, inq_resp + 32, 4);
     }
-    if (free_irp)
-        free(free_irp);
+    sg_pt_pool_put_buf(free_irp, SAFE_STD_INQ_RESP_LEN);
     return ret;
 }
 
@@ -658,7 +680,7 @@ sg_ll_test_unit_ready_com(struct sg_pt_base * ptvp, int sg_fd, int pack_id,
         else
             set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
     } else {
-        ptvp = construct_scsi_pt_obj_with_fd(sg_fd, verbose);
+        ptvp = sg_pt_pool_get_obj(sg_fd, verbose);
         if (NULL == ptvp)
             return sg_convert_errno(ENOMEM);
         set_scsi_pt_cdb(ptvp, tur_cdb, sizeof(tur_cdb));
@@ -697,7 +719,7 @@ sg_ll_test_unit_ready_com(struct sg_pt_base * ptvp, int sg_fd, int pack_id,
             set_scsi_pt_cdb(ptvp, NULL, 0);
     } else {
         if (ptvp)
-            destruct_scsi_pt_obj(ptvp);
+            sg_pt_pool_put_obj(ptvp);
     }
     return ret;
 }
@@ -776,7 +798,7 @@ sg_ll_request_sense_com(struct sg_pt_base * ptvp, int sg_fd, bool desc,
         else
             set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
     } else {
-        ptvp = construct_scsi_pt_obj_with_fd(sg_fd, verbose);
+        ptvp = sg_pt_pool_get_obj(sg_fd, verbose);
         if (NULL == ptvp)
             return sg_convert_errno(ENOMEM);
         set_scsi_pt_cdb(ptvp, rs_cdb, sizeof(rs_cdb));
@@ -815,7 +837,7 @@ sg_ll_request_sense_com(struct sg_pt_base * ptvp, int sg_fd, bool desc,
         if (local_cdb)  /* stop caller accessing local sense */
         set_scsi_pt_cdb(ptvp, NULL, 0);
     } else if (ptvp)
-        destruct_scsi_pt_obj(ptvp);
+        sg_pt_pool_put_obj(ptvp);
     return ret;
 }
 
@@ -871,7 +893,7 @@ sg_ll_report_luns_com(struct sg_pt_base * ptvp, int sg_fd, int select_report,
         else
             set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
     } else {
-        if (NULL == ((ptvp = create_pt_obj(report_luns_s))))
+        if (NULL == ((ptvp = create_pt_obj(sg_fd, report_luns_s))))
             return sg_convert_errno(ENOMEM);
         set_scsi_pt_cdb(ptvp, rl_cdb, sizeof(rl_cdb));
         set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -904,7 +926,7 @@ sg_ll_report_luns_com(struct sg_pt_base * ptvp, int sg_fd, int select_report,
             set_scsi_pt_cdb(ptvp, NULL, 0);
     } else {
         if (ptvp)
-            destruct_scsi_pt_obj(ptvp);
+            sg_pt_pool_put_obj(ptvp);
     }
     return ret;
 }
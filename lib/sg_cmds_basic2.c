@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 1999-2023 Douglas Gilbert.
+ * Copyright (c) 1999-2026 Douglas Gilbert.
  * All rights reserved.
  * Use of this source code is governed by a BSD-style
  * license that can be found in the BSD_LICENSE file.
@@ -32,13 +32,14 @@
 #include "sg_pt.h"
 #include "sg_unaligned.h"
 #include "sg_pr2serr.h"
+#include "sg_rcache.h"
 
 
 
 #define SENSE_BUFF_LEN 64       /* Arbitrary, could be larger */
 #define EBUFF_SZ 256
 
-#define DEF_PT_TIMEOUT 60       /* 60 seconds */
+#define DEF_PT_TIMEOUT 0        /* device RSOC figure (if known) else 60 s */
 #define START_PT_TIMEOUT 120    /* 120 seconds == 2 minutes */
 #define LONG_PT_TIMEOUT 7200    /* 7,200 seconds == 120 minutes */
 
@@ -49,6 +50,10 @@
 #define READ_CAPACITY_16_SA 0x10
 #define READ_CAPACITY_10_CMD 0x25
 #define READ_CAPACITY_10_CMDLEN 10
+#define MAINTENANCE_IN_CMD 0xa3
+#define MAINTENANCE_IN_CMDLEN 12
+#define RSOC_SA 0xc
+#define SUPP_OPS_ALLOC_LEN 8192
 #define MODE_SENSE6_CMD      0x1a
 #define MODE_SENSE6_CMDLEN   6
 #define MODE_SENSE10_CMD     0x5a
@@ -74,9 +79,9 @@
 
 
 static struct sg_pt_base *
-create_pt_obj(const char * cname)
+create_pt_obj(int sg_fd, const char * cname)
 {
-    struct sg_pt_base * ptvp = construct_scsi_pt_obj();
+    struct sg_pt_base * ptvp = sg_pt_pool_get_obj(sg_fd, 0);
     if (NULL == ptvp)
         pr2ws("%s: out of memory\n", cname);
     return ptvp;
@@ -115,7 +120,7 @@ sg_ll_sync_cache_10(int sg_fd, bool sync_nv, bool immed, int group,
               sg_get_command_str(sc_cdb, SYNCHRONIZE_CACHE_CMDLEN, false,
                                  sizeof(b), b));
     }
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return -1;
     set_scsi_pt_cdb(ptvp, sc_cdb, sizeof(sc_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -139,7 +144,7 @@ sg_ll_sync_cache_10(int sg_fd, bool sync_nv, bool immed, int group,
     } else
         ret = 0;
 
-    destruct_scsi_pt_obj(ptvp);
+    sg_pt_pool_put_obj(ptvp);
     return ret;
 }
 
@@ -170,7 +175,19 @@ sg_ll_readcap_16(int sg_fd, bool pmi, uint64_t llba, void * resp,
               sg_get_command_str(rc_cdb, SERVICE_ACTION_IN_16_CMDLEN, false,
                                  sizeof(b), b));
     }
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (0 == sg_supp_ops_query(sg_fd, SERVICE_ACTION_IN_16_CMD,
+                               READ_CAPACITY_16_SA)) {
+        if (verbose)
+            pr2ws("    %s not in supported operation codes\n", cdb_s);
+        return SG_LIB_CAT_INVALID_OP;
+    }
+    if ((! pmi) &&
+        (sg_rcache_get(sg_fd, "rcap16", (uint8_t *)resp, mx_resp_len) > 0)) {
+        if (verbose)
+            pr2ws("    %s response from cache\n", cdb_s);
+        return 0;
+    }
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return -1;
     set_scsi_pt_cdb(ptvp, rc_cdb, sizeof(rc_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -192,10 +209,15 @@ sg_ll_readcap_16(int sg_fd, bool pmi, uint64_t llba, void * resp,
             ret = sense_cat;
             break;
         }
-    } else
+    } else {
         ret = 0;
+        if (! pmi)
+            sg_rcache_put(sg_fd, "rcap16", (const uint8_t *)resp,
+                          mx_resp_len,
+                          mx_resp_len - get_scsi_pt_resid(ptvp));
+    }
 
-    destruct_scsi_pt_obj(ptvp);
+    sg_pt_pool_put_obj(ptvp);
     return ret;
 }
 
@@ -223,7 +245,13 @@ sg_ll_readcap_10(int sg_fd, bool pmi, unsigned int lba, void * resp,
               sg_get_command_str(rc_cdb, READ_CAPACITY_10_CMDLEN, false,
                                  sizeof(b), b));
     }
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if ((! pmi) &&
+        (sg_rcache_get(sg_fd, "rcap10", (uint8_t *)resp, mx_resp_len) > 0)) {
+        if (verbose)
+            pr2ws("    %s response from cache\n", cdb_s);
+        return 0;
+    }
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return -1;
     set_scsi_pt_cdb(ptvp, rc_cdb, sizeof(rc_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -245,10 +273,15 @@ sg_ll_readcap_10(int sg_fd, bool pmi, unsigned int lba, void * resp,
             ret = sense_cat;
             break;
         }
-    } else
+    } else {
         ret = 0;
+        if (! pmi)
+            sg_rcache_put(sg_fd, "rcap10", (const uint8_t *)resp,
+                          mx_resp_len,
+                          mx_resp_len - get_scsi_pt_resid(ptvp));
+    }
 
-    destruct_scsi_pt_obj(ptvp);
+    sg_pt_pool_put_obj(ptvp);
     return ret;
 }
 
@@ -280,7 +313,7 @@ sg_ll_mode_sense6(int sg_fd, bool dbd, int pc, int pg_code, int sub_pg_code,
               sg_get_command_str(modes_cdb, MODE_SENSE6_CMDLEN, false,
                                  sizeof(b), b));
     }
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return -1;
     set_scsi_pt_cdb(ptvp, modes_cdb, sizeof(modes_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -317,7 +350,7 @@ sg_ll_mode_sense6(int sg_fd, bool dbd, int pc, int pg_code, int sub_pg_code,
         }
         ret = 0;
     }
-    destruct_scsi_pt_obj(ptvp);
+    sg_pt_pool_put_obj(ptvp);
 
     if (resid > 0) {
         if (resid > mx_resp_len) {
@@ -381,7 +414,7 @@ sg_ll_mode_sense10_v2(int sg_fd, bool llbaa, bool dbd, int pc, int pg_code,
     if (timeout_secs <= 0)
         timeout_secs = DEF_PT_TIMEOUT;
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         goto gen_err;
     set_scsi_pt_cdb(ptvp, modes_cdb, sizeof(modes_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -420,7 +453,7 @@ sg_ll_mode_sense10_v2(int sg_fd, bool llbaa, bool dbd, int pc, int pg_code,
         }
         ret = 0;
     }
-    destruct_scsi_pt_obj(ptvp);
+    sg_pt_pool_put_obj(ptvp);
 
     if (resid > 0) {
         if (resid > mx_resp_len) {
@@ -471,7 +504,7 @@ sg_ll_mode_select6_v2(int sg_fd, bool pf, bool rtd, bool sp, void * paramp,
         hex2stderr((const uint8_t *)paramp, param_len, -1);
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return -1;
     set_scsi_pt_cdb(ptvp, modes_cdb, sizeof(modes_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -496,7 +529,7 @@ sg_ll_mode_select6_v2(int sg_fd, bool pf, bool rtd, bool sp, void * paramp,
     } else
         ret = 0;
 
-    destruct_scsi_pt_obj(ptvp);
+    sg_pt_pool_put_obj(ptvp);
     return ret;
 }
 
@@ -542,7 +575,7 @@ sg_ll_mode_select10_v2(int sg_fd, bool pf, bool rtd, bool sp, void * paramp,
         hex2stderr((const uint8_t *)paramp, param_len, -1);
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return -1;
     set_scsi_pt_cdb(ptvp, modes_cdb, sizeof(modes_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -567,7 +600,7 @@ sg_ll_mode_select10_v2(int sg_fd, bool pf, bool rtd, bool sp, void * paramp,
     } else
         ret = 0;
 
-    destruct_scsi_pt_obj(ptvp);
+    sg_pt_pool_put_obj(ptvp);
     return ret;
 }
 
@@ -853,7 +886,7 @@ sg_ll_log_sense_v2(int sg_fd, bool ppc, bool sp, int pc, int pg_code,
     if (timeout_secs <= 0)
         timeout_secs = DEF_PT_TIMEOUT;
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         goto gen_err;
     set_scsi_pt_cdb(ptvp, logs_cdb, sizeof(logs_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -886,7 +919,7 @@ sg_ll_log_sense_v2(int sg_fd, bool ppc, bool sp, int pc, int pg_code,
         }
         ret = 0;
     }
-    destruct_scsi_pt_obj(ptvp);
+    sg_pt_pool_put_obj(ptvp);
 
     if (resid > 0) {
         if (resid > mx_resp_len) {
@@ -938,7 +971,7 @@ sg_ll_log_select(int sg_fd, bool pcr, bool sp, int pc, int pg_code,
         hex2stderr(paramp, param_len, -1);
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return -1;
     set_scsi_pt_cdb(ptvp, logs_cdb, sizeof(logs_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -963,7 +996,7 @@ sg_ll_log_select(int sg_fd, bool pcr, bool sp, int pc, int pg_code,
     } else
         ret = 0;
 
-    destruct_scsi_pt_obj(ptvp);
+    sg_pt_pool_put_obj(ptvp);
     return ret;
 }
 
@@ -1017,7 +1050,7 @@ sg_ll_start_stop_unit_com(struct sg_pt_base * ptvp, int sg_fd, bool immed,
         else
             set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
     } else {
-        ptvp = construct_scsi_pt_obj_with_fd(sg_fd, verbose);
+        ptvp = sg_pt_pool_get_obj(sg_fd, verbose);
         if (NULL == ptvp)
             return sg_convert_errno(ENOMEM);
         set_scsi_pt_cdb(ptvp, ssuBlk, sizeof(ssuBlk));
@@ -1049,7 +1082,7 @@ sg_ll_start_stop_unit_com(struct sg_pt_base * ptvp, int sg_fd, bool immed,
             set_scsi_pt_cdb(ptvp, NULL, 0);
     } else {
         if (ptvp)
-            destruct_scsi_pt_obj(ptvp);
+            sg_pt_pool_put_obj(ptvp);
     }
     return ret;
 }
@@ -1102,7 +1135,7 @@ sg_ll_prevent_allow(int sg_fd, int prevent, bool noisy, int verbose)
                                  sizeof(b), b));
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return -1;
     set_scsi_pt_cdb(ptvp, p_cdb, sizeof(p_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -1125,6 +1158,166 @@ sg_ll_prevent_allow(int sg_fd, int prevent, bool noisy, int verbose)
         }
     } else
             ret = 0;
-    destruct_scsi_pt_obj(ptvp);
+    sg_pt_pool_put_obj(ptvp);
     return ret;
 }
+
+/* Supported operation codes of the last device fetched. op_bm has a bit set
+ * for each opcode reported without a service action, sa_op_bm for each
+ * opcode reported with one; sa_arr holds (opcode << 16 | service action)
+ * for the latter, sorted. */
+struct sg_supp_ops_t {
+    bool valid;
+    int fd;
+    int num_sa;
+    uint8_t op_bm[32];
+    uint8_t sa_op_bm[32];
+    uint32_t * sa_arr;
+};
+
+static struct sg_supp_ops_t sg_so = {false, -1, 0, {0}, {0}, NULL};
+
+static int
+supp_ops_cmp(const void * a, const void * b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+
+    return (x < y) ? -1 : ((x > y) ? 1 : 0);
+}
+
+/* Decodes a REPORT SUPPORTED OPERATION CODES response (all commands, with
+ * or without command timeout descriptors) of len bytes into sg_so */
+static bool
+supp_ops_decode(const uint8_t * rp, int len)
+{
+    int k, n, step, opcode;
+
+    n = (int)sg_get_unaligned_be32(rp + 0) + 4;
+    if (n < len)
+        len = n;
+    sg_so.sa_arr = (uint32_t *)calloc((len / 8) + 1, sizeof(uint32_t));
+    if (NULL == sg_so.sa_arr)
+        return false;
+    for (k = 4; (k + 8) <= len; k += step) {
+        const uint8_t * bp = rp + k;
+
+        opcode = bp[0];
+        step = (0x2 & bp[5]) ? 20 : 8;  /* CTDP: timeouts descriptor */
+        if (0x1 & bp[5]) {              /* SERVACTV */
+            sg_so.sa_op_bm[opcode >> 3] |= (1 << (opcode & 7));
+            sg_so.sa_arr[sg_so.num_sa++] = ((uint32_t)opcode << 16) |
+                                           sg_get_unaligned_be16(bp + 2);
+        } else
+            sg_so.op_bm[opcode >> 3] |= (1 << (opcode & 7));
+    }
+    qsort(sg_so.sa_arr, sg_so.num_sa, sizeof(uint32_t), supp_ops_cmp);
+    return true;
+}
+
+int
+sg_supp_ops_fetch(int sg_fd, bool noisy, int verbose)
+{
+    static const char * const cdb_s = "report supported operation codes";
+    /* same name and allocation length as sg_opcodes, so they share it */
+    static const char * const rc_name = "rsoc_00_00_0000";
+    int ret, res, sense_cat, len;
+    uint8_t rsoc_cdb[MAINTENANCE_IN_CMDLEN] = {MAINTENANCE_IN_CMD, RSOC_SA,
+                                    0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    uint8_t sense_b[SENSE_BUFF_LEN] SG_C_CPP_ZERO_INIT;
+    uint8_t * resp;
+    uint8_t * free_resp;
+    struct sg_pt_base * ptvp;
+
+    sg_supp_ops_free();
+    sg_so.fd = sg_fd;
+    resp = sg_memalign(SUPP_OPS_ALLOC_LEN, 0, &free_resp, false);
+    if (NULL == resp)
+        return sg_convert_errno(ENOMEM);
+    len = sg_rcache_get(sg_fd, rc_name, resp, SUPP_OPS_ALLOC_LEN);
+    if (len >= 4) {
+        if (verbose)
+            pr2ws("    %s response from cache\n", cdb_s);
+        ret = supp_ops_decode(resp, len) ? 0 : sg_convert_errno(ENOMEM);
+        goto fini;
+    }
+    sg_put_unaligned_be32((uint32_t)SUPP_OPS_ALLOC_LEN, rsoc_cdb + 6);
+    if (verbose) {
+        char b[128];
+
+        pr2ws("    %s cdb: %s\n", cdb_s,
+              sg_get_command_str(rsoc_cdb, MAINTENANCE_IN_CMDLEN, false,
+                                 sizeof(b), b));
+    }
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s)))) {
+        ret = -1;
+        goto fini;
+    }
+    set_scsi_pt_cdb(ptvp, rsoc_cdb, sizeof(rsoc_cdb));
+    set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
+    set_scsi_pt_data_in(ptvp, resp, SUPP_OPS_ALLOC_LEN);
+    res = do_scsi_pt(ptvp, sg_fd, DEF_PT_TIMEOUT, verbose);
+    ret = sg_cmds_process_resp(ptvp, cdb_s, res, noisy, verbose, &sense_cat);
+    if (-1 == ret) {
+        if (get_scsi_pt_transport_err(ptvp))
+            ret = SG_LIB_TRANSPORT_ERROR;
+        else
+            ret = sg_convert_errno(get_scsi_pt_os_err(ptvp));
+    } else if (-2 == ret) {
+        switch (sense_cat) {
+        case SG_LIB_CAT_RECOVERED:
+        case SG_LIB_CAT_NO_SENSE:
+            ret = 0;
+            break;
+        default:
+            ret = sense_cat;
+            break;
+        }
+    } else {
+        len = ret;
+        ret = 0;
+        if (len < 4)
+            ret = SG_LIB_CAT_MALFORMED;
+        else if (supp_ops_decode(resp, len))
+            sg_rcache_put(sg_fd, rc_name, resp, SUPP_OPS_ALLOC_LEN, len);
+        else
+            ret = sg_convert_errno(ENOMEM);
+    }
+    sg_pt_pool_put_obj(ptvp);
+fini:
+    sg_so.valid = (0 == ret);
+    free(free_resp);
+    return ret;
+}
+
+int
+sg_supp_ops_query(int sg_fd, int opcode, int serv_act)
+{
+    uint32_t k;
+    const uint8_t mask = 1 << (opcode & 7);
+
+    if ((sg_fd < 0) || (opcode < 0) || (opcode > 0xff))
+        return -1;
+    if (sg_fd != sg_so.fd) {
+        /* only worth a fetch when it can be reused by later invocations */
+        if (! sg_rcache_active(sg_fd))
+            return -1;
+        sg_supp_ops_fetch(sg_fd, false, 0);
+    }
+    if (! sg_so.valid)
+        return -1;
+    if ((serv_act < 0) || (! (sg_so.sa_op_bm[opcode >> 3] & mask)))
+        return ((sg_so.op_bm[opcode >> 3] | sg_so.sa_op_bm[opcode >> 3]) &
+                mask) ? 1 : 0;
+    k = ((uint32_t)opcode << 16) | (serv_act & 0xffff);
+    return bsearch(&k, sg_so.sa_arr, sg_so.num_sa, sizeof(uint32_t),
+                   supp_ops_cmp) ? 1 : 0;
+}
+
+void
+sg_supp_ops_free(void)
+{
+    free(sg_so.sa_arr);
+    memset(&sg_so, 0, sizeof(sg_so));
+    sg_so.fd = -1;
+}
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 1999-2023 Douglas Gilbert.
+ * Copyright (c) 1999-2026 Douglas Gilbert.
  * All rights reserved.
  * Use of this source code is governed by a BSD-style
  * license that can be found in the BSD_LICENSE file.
@@ -32,7 +32,7 @@
 
 #define SENSE_BUFF_LEN 64       /* Arbitrary, could be larger */
 
-#define DEF_PT_TIMEOUT 60       /* 60 seconds */
+#define DEF_PT_TIMEOUT 0        /* device RSOC figure (if known) else 60 s */
 #define LONG_PT_TIMEOUT 7200    /* 7,200 seconds == 120 minutes */
 
 #define SERVICE_ACTION_IN_16_CMD 0x9e
@@ -103,13 +103,15 @@
 #define SET_TGT_PRT_GRP_SA 0xa
 #define WRITE_LONG_16_SA 0x11
 #define REPORT_REFERRALS_SA 0x13
+#define REPORT_ZONES_SA 0x0
+#define REPORT_ZONES_CMDLEN 16
 #define EXTENDED_COPY_LID1_SA 0x0
 
 
 static struct sg_pt_base *
-create_pt_obj(const char * cname)
+create_pt_obj(int sg_fd, const char * cname)
 {
-    struct sg_pt_base * ptvp = construct_scsi_pt_obj();
+    struct sg_pt_base * ptvp = sg_pt_pool_get_obj(sg_fd, 0);
     if (NULL == ptvp)
         pr2ws("%s: out of memory\n", cname);
     return ptvp;
@@ -143,7 +145,7 @@ sg_ll_get_lba_status16(int sg_fd, uint64_t start_llba, uint8_t rt,
                                  false, sizeof(b), b));
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return sg_convert_errno(ENOMEM);
     set_scsi_pt_cdb(ptvp, getLbaStatCmd, sizeof(getLbaStatCmd));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -179,7 +181,7 @@ sg_ll_get_lba_status16(int sg_fd, uint64_t start_llba, uint8_t rt,
         }
         ret = 0;
     }
-    destruct_scsi_pt_obj(ptvp);
+    sg_pt_pool_put_obj(ptvp);
     return ret;
 }
 
@@ -222,7 +224,7 @@ sg_ll_get_lba_status32(int sg_fd, uint64_t start_llba, uint32_t scan_len,
                                  b));
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return sg_convert_errno(ENOMEM);
     set_scsi_pt_cdb(ptvp, gls32_cmd, sizeof(gls32_cmd));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -258,7 +260,66 @@ sg_ll_get_lba_status32(int sg_fd, uint64_t start_llba, uint32_t scan_len,
         }
         ret = 0;
     }
-    destruct_scsi_pt_obj(ptvp);
+    sg_pt_pool_put_obj(ptvp);
+    return ret;
+}
+
+/* Invokes a SCSI REPORT ZONES command (ZBC). Return of 0 -> success,
+ * various SG_LIB_CAT_* positive values or -1 -> other errors */
+int
+sg_ll_report_zones(int sg_fd, uint64_t zs_lba, bool partial, int report_opts,
+                   void * resp, int mx_resp_len, int * residp, bool noisy,
+                   int vb)
+{
+    static const char * const cdb_s = "Report zones";
+    int res, s_cat, ret;
+    uint8_t rz_cdb[REPORT_ZONES_CMDLEN] SG_C_CPP_ZERO_INIT;
+    uint8_t sense_b[SENSE_BUFF_LEN] SG_C_CPP_ZERO_INIT;
+    struct sg_pt_base * ptvp;
+
+    rz_cdb[0] = SG_ZONING_IN;
+    rz_cdb[1] = REPORT_ZONES_SA;
+    sg_put_unaligned_be64(zs_lba, rz_cdb + 2);
+    sg_put_unaligned_be32((uint32_t)mx_resp_len, rz_cdb + 10);
+    rz_cdb[14] = report_opts & 0x3f;
+    if (partial)
+        rz_cdb[14] |= 0x80;
+    if (vb) {
+        char b[128];
+
+        pr2ws("    %s cdb: %s\n", cdb_s,
+              sg_get_command_str(rz_cdb, REPORT_ZONES_CMDLEN, false,
+                                 sizeof(b), b));
+    }
+    if (residp)
+        *residp = mx_resp_len;
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
+        return sg_convert_errno(ENOMEM);
+    set_scsi_pt_cdb(ptvp, rz_cdb, sizeof(rz_cdb));
+    set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
+    set_scsi_pt_data_in(ptvp, (uint8_t *)resp, mx_resp_len);
+    res = do_scsi_pt(ptvp, sg_fd, DEF_PT_TIMEOUT, vb);
+    ret = sg_cmds_process_resp(ptvp, cdb_s, res, noisy, vb, &s_cat);
+    if (-1 == ret) {
+        if (get_scsi_pt_transport_err(ptvp))
+            ret = SG_LIB_TRANSPORT_ERROR;
+        else
+            ret = sg_convert_errno(get_scsi_pt_os_err(ptvp));
+    } else if (-2 == ret) {
+        switch (s_cat) {
+        case SG_LIB_CAT_RECOVERED:
+        case SG_LIB_CAT_NO_SENSE:
+            ret = 0;
+            break;
+        default:
+            ret = s_cat;
+            break;
+        }
+    } else
+        ret = 0;
+    if (residp)
+        *residp = get_scsi_pt_resid(ptvp);
+    sg_pt_pool_put_obj(ptvp);
     return ret;
 }
 
@@ -295,7 +356,7 @@ sg_ll_report_tgt_prt_grp2(int sg_fd, void * resp, int mx_resp_len,
                                  false, sizeof(b), b));
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return sg_convert_errno(ENOMEM);
     set_scsi_pt_cdb(ptvp, rtpg_cdb, sizeof(rtpg_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -331,7 +392,7 @@ sg_ll_report_tgt_prt_grp2(int sg_fd, void * resp, int mx_resp_len,
         }
         ret = 0;
     }
-    destruct_scsi_pt_obj(ptvp);
+    sg_pt_pool_put_obj(ptvp);
     return ret;
 }
 
@@ -362,7 +423,7 @@ sg_ll_set_tgt_prt_grp(int sg_fd, void * paramp, int param_len, bool noisy,
         }
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return sg_convert_errno(ENOMEM);
     set_scsi_pt_cdb(ptvp, stpg_cdb, sizeof(stpg_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -386,7 +447,7 @@ sg_ll_set_tgt_prt_grp(int sg_fd, void * paramp, int param_len, bool noisy,
         }
     } else
         ret = 0;
-    destruct_scsi_pt_obj(ptvp);
+    sg_pt_pool_put_obj(ptvp);
     return ret;
 }
 
@@ -417,7 +478,7 @@ sg_ll_report_referrals(int sg_fd, uint64_t start_llba, bool one_seg,
                                  false, sizeof(b), b));
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return sg_convert_errno(ENOMEM);
     set_scsi_pt_cdb(ptvp, repRef_cdb, sizeof(repRef_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -453,7 +514,7 @@ sg_ll_report_referrals(int sg_fd, uint64_t start_llba, bool one_seg,
         }
         ret = 0;
     }
-    destruct_scsi_pt_obj(ptvp);
+    sg_pt_pool_put_obj(ptvp);
     return ret;
 }
 
@@ -503,7 +564,10 @@ sg_ll_send_diag_com(struct sg_pt_base * ptvp, int sg_fd, int st_code,
                 pr2ws("    %s parameter list:\n", cdb_s);
                 hex2stderr((const uint8_t *)paramp, param_len, -1);
             }
-            pr2ws("    %s timeout: %d seconds\n", cdb_s, tmout);
+            if (tmout > 0)
+                pr2ws("    %s timeout: %d seconds\n", cdb_s, tmout);
+            else
+                pr2ws("    %s timeout: default\n", cdb_s);
         }
     }
     if (ptvp) {
@@ -518,7 +582,7 @@ sg_ll_send_diag_com(struct sg_pt_base * ptvp, int sg_fd, int st_code,
         else
             set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
     } else {
-        ptvp = construct_scsi_pt_obj_with_fd(sg_fd, vb);
+        ptvp = sg_pt_pool_get_obj(sg_fd, vb);
         if (NULL == ptvp)
             return sg_convert_errno(ENOMEM);
         set_scsi_pt_cdb(ptvp, senddiag_cdb, sizeof(senddiag_cdb));
@@ -552,7 +616,7 @@ sg_ll_send_diag_com(struct sg_pt_base * ptvp, int sg_fd, int st_code,
             set_scsi_pt_cdb(ptvp, NULL, 0);
     } else {
         if (ptvp)
-            destruct_scsi_pt_obj(ptvp);
+            sg_pt_pool_put_obj(ptvp);
     }
     return ret;
 }
@@ -622,7 +686,7 @@ sg_ll_receive_diag_com(struct sg_pt_base * ptvp, int sg_fd, bool pcv,
         else
             set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
     } else {
-        ptvp = construct_scsi_pt_obj_with_fd(sg_fd, vb);
+        ptvp = sg_pt_pool_get_obj(sg_fd, vb);
         if (NULL == ptvp)
             return sg_convert_errno(ENOMEM);
         set_scsi_pt_cdb(ptvp, rcvdiag_cdb, sizeof(rcvdiag_cdb));
@@ -671,7 +735,7 @@ sg_ll_receive_diag_com(struct sg_pt_base * ptvp, int sg_fd, bool pcv,
             set_scsi_pt_cdb(ptvp, NULL, 0);
     } else {
         if (ptvp)
-            destruct_scsi_pt_obj(ptvp);
+            sg_pt_pool_put_obj(ptvp);
     }
     return ret;
 }
@@ -736,7 +800,7 @@ sg_ll_read_defect10(int sg_fd, bool req_plist, bool req_glist, int dl_format,
                                  false, sizeof(b), b));
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return sg_convert_errno(ENOMEM);
     set_scsi_pt_cdb(ptvp, rdef_cdb, sizeof(rdef_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -772,7 +836,7 @@ sg_ll_read_defect10(int sg_fd, bool req_plist, bool req_glist, int dl_format,
         }
         ret = 0;
     }
-    destruct_scsi_pt_obj(ptvp);
+    sg_pt_pool_put_obj(ptvp);
     return ret;
 }
 
@@ -799,7 +863,7 @@ sg_ll_read_media_serial_num(int sg_fd, void * resp, int mx_resp_len,
                                  false, sizeof(b), b));
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return sg_convert_errno(ENOMEM);
     set_scsi_pt_cdb(ptvp, rmsn_cdb, sizeof(rmsn_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -835,7 +899,7 @@ sg_ll_read_media_serial_num(int sg_fd, void * resp, int mx_resp_len,
         }
         ret = 0;
     }
-    destruct_scsi_pt_obj(ptvp);
+    sg_pt_pool_put_obj(ptvp);
     return ret;
 }
 
@@ -865,7 +929,7 @@ sg_ll_report_id_info(int sg_fd, int itype, void * resp, int max_resp_len,
                                  false, sizeof(b), b));
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return sg_convert_errno(ENOMEM);
     set_scsi_pt_cdb(ptvp, rii_cdb, sizeof(rii_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -901,7 +965,7 @@ sg_ll_report_id_info(int sg_fd, int itype, void * resp, int max_resp_len,
         }
         ret = 0;
     }
-    destruct_scsi_pt_obj(ptvp);
+    sg_pt_pool_put_obj(ptvp);
     return ret;
 }
 
@@ -934,7 +998,7 @@ sg_ll_set_id_info(int sg_fd, int itype, void * paramp, int param_len,
         }
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return sg_convert_errno(ENOMEM);
     set_scsi_pt_cdb(ptvp, sii_cdb, sizeof(sii_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -959,7 +1023,7 @@ sg_ll_set_id_info(int sg_fd, int itype, void * paramp, int param_len,
     } else
         ret = 0;
 
-    destruct_scsi_pt_obj(ptvp);
+    sg_pt_pool_put_obj(ptvp);
     return ret;
 }
 
@@ -1026,11 +1090,14 @@ sg_ll_format_unit_v2(int sg_fd, int fmtpinfo, bool longlist, bool fmtdata,
                 pr2ws("    %s parameter list:\n", cdb_s);
                 hex2stderr((const uint8_t *)paramp, param_len, -1);
             }
-            pr2ws("    %s timeout: %d seconds\n", cdb_s, tmout);
+            if (tmout > 0)
+                pr2ws("    %s timeout: %d seconds\n", cdb_s, tmout);
+            else
+                pr2ws("    %s timeout: default\n", cdb_s);
         }
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return sg_convert_errno(ENOMEM);
     set_scsi_pt_cdb(ptvp, fu_cdb, sizeof(fu_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -1055,7 +1122,7 @@ sg_ll_format_unit_v2(int sg_fd, int fmtpinfo, bool longlist, bool fmtdata,
     } else
         ret = 0;
 
-    destruct_scsi_pt_obj(ptvp);
+    sg_pt_pool_put_obj(ptvp);
     return ret;
 }
 
@@ -1088,7 +1155,7 @@ sg_ll_reassign_blocks(int sg_fd, bool longlba, bool longlist, void * paramp,
         hex2stderr((const uint8_t *)paramp, param_len, -1);
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return sg_convert_errno(ENOMEM);
     set_scsi_pt_cdb(ptvp, reass_cdb, sizeof(reass_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -1113,7 +1180,7 @@ sg_ll_reassign_blocks(int sg_fd, bool longlba, bool longlist, void * paramp,
     } else
         ret = 0;
 
-    destruct_scsi_pt_obj(ptvp);
+    sg_pt_pool_put_obj(ptvp);
     return ret;
 }
 
@@ -1143,7 +1210,7 @@ sg_ll_persistent_reserve_in(int sg_fd, int rq_servact, void * resp,
                                  false, sizeof(b), b));
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return sg_convert_errno(ENOMEM);
     set_scsi_pt_cdb(ptvp, prin_cdb, sizeof(prin_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -1179,7 +1246,7 @@ sg_ll_persistent_reserve_in(int sg_fd, int rq_servact, void * resp,
         }
         ret = 0;
     }
-    destruct_scsi_pt_obj(ptvp);
+    sg_pt_pool_put_obj(ptvp);
     return ret;
 }
 
@@ -1215,7 +1282,7 @@ sg_ll_persistent_reserve_out(int sg_fd, int rq_servact, int rq_scope,
         }
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return sg_convert_errno(ENOMEM);
     set_scsi_pt_cdb(ptvp, prout_cdb, sizeof(prout_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -1240,7 +1307,7 @@ sg_ll_persistent_reserve_out(int sg_fd, int rq_servact, int rq_scope,
     } else
         ret = 0;
 
-    destruct_scsi_pt_obj(ptvp);
+    sg_pt_pool_put_obj(ptvp);
     return ret;
 }
 
@@ -1294,7 +1361,7 @@ sg_ll_read_long10(int sg_fd, bool pblock, bool correct, unsigned int lba,
                                  false, sizeof(b), b));
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return sg_convert_errno(ENOMEM);
     set_scsi_pt_cdb(ptvp, readLong_cdb, sizeof(readLong_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -1351,7 +1418,7 @@ sg_ll_read_long10(int sg_fd, bool pblock, bool correct, unsigned int lba,
         }
         ret = 0;
     }
-    destruct_scsi_pt_obj(ptvp);
+    sg_pt_pool_put_obj(ptvp);
     return ret;
 }
 
@@ -1387,7 +1454,7 @@ sg_ll_read_long16(int sg_fd, bool pblock, bool correct, uint64_t llba,
                                  false, sizeof(b), b));
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return sg_convert_errno(ENOMEM);
     set_scsi_pt_cdb(ptvp, readLong_cdb, sizeof(readLong_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -1444,7 +1511,7 @@ sg_ll_read_long16(int sg_fd, bool pblock, bool correct, uint64_t llba,
         }
         ret = 0;
     }
-    destruct_scsi_pt_obj(ptvp);
+    sg_pt_pool_put_obj(ptvp);
     return ret;
 }
 
@@ -1481,7 +1548,7 @@ sg_ll_write_long10(int sg_fd, bool cor_dis, bool wr_uncor, bool pblock,
                                  false, sizeof(b), b));
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return sg_convert_errno(ENOMEM);
     set_scsi_pt_cdb(ptvp, writeLong_cdb, sizeof(writeLong_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -1526,7 +1593,7 @@ sg_ll_write_long10(int sg_fd, bool cor_dis, bool wr_uncor, bool pblock,
     } else
         ret = 0;
 
-    destruct_scsi_pt_obj(ptvp);
+    sg_pt_pool_put_obj(ptvp);
     return ret;
 }
 
@@ -1564,7 +1631,7 @@ sg_ll_write_long16(int sg_fd, bool cor_dis, bool wr_uncor, bool pblock,
                                  false, sizeof(b), b));
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return sg_convert_errno(ENOMEM);
     set_scsi_pt_cdb(ptvp, writeLong_cdb, sizeof(writeLong_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -1610,7 +1677,7 @@ sg_ll_write_long16(int sg_fd, bool cor_dis, bool wr_uncor, bool pblock,
     } else
         ret = 0;
 
-    destruct_scsi_pt_obj(ptvp);
+    sg_pt_pool_put_obj(ptvp);
     return ret;
 }
 
@@ -1651,7 +1718,7 @@ sg_ll_verify10(int sg_fd, int vrprotect, bool dpo, int bytchk,
             hex2stderr((const uint8_t *)data_out, k, vb < 5);
         }
     }
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return sg_convert_errno(ENOMEM);
     set_scsi_pt_cdb(ptvp, v_cdb, sizeof(v_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -1692,7 +1759,7 @@ sg_ll_verify10(int sg_fd, int vrprotect, bool dpo, int bytchk,
     } else
         ret = 0;
 
-    destruct_scsi_pt_obj(ptvp);
+    sg_pt_pool_put_obj(ptvp);
     return ret;
 }
 
@@ -1733,7 +1800,7 @@ sg_ll_verify16(int sg_fd, int vrprotect, bool dpo, int bytchk, uint64_t llba,
             hex2stderr((const uint8_t *)data_out, k, vb < 5);
         }
     }
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return sg_convert_errno(ENOMEM);
     set_scsi_pt_cdb(ptvp, v_cdb, sizeof(v_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -1774,7 +1841,7 @@ sg_ll_verify16(int sg_fd, int vrprotect, bool dpo, int bytchk, uint64_t llba,
     } else
         ret = 0;
 
-    destruct_scsi_pt_obj(ptvp);
+    sg_pt_pool_put_obj(ptvp);
     return ret;
 }
 
@@ -1867,7 +1934,7 @@ sg_ll_ata_pt(int sg_fd, const uint8_t * cdbp, int cdb_len,
             hex2stderr(apt_cdb, cdb_len, -1);
         }
     }
-    if (NULL == ((ptvp = create_pt_obj(cnamep))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cnamep))))
         return -1;
     set_scsi_pt_cdb(ptvp, apt_cdb, cdb_len);
     set_scsi_pt_sense(ptvp, sp, slen);
@@ -1975,7 +2042,7 @@ sg_ll_ata_pt(int sg_fd, const uint8_t * cdbp, int cdb_len,
     }
 
 out:
-    destruct_scsi_pt_obj(ptvp);
+    sg_pt_pool_put_obj(ptvp);
     return ret;
 }
 
@@ -2004,7 +2071,7 @@ sg_ll_read_buffer(int sg_fd, int mode, int buffer_id, int buffer_offset,
                                  false, sizeof(b), b));
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return -1;
     set_scsi_pt_cdb(ptvp, rbuf_cdb, sizeof(rbuf_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -2040,7 +2107,7 @@ sg_ll_read_buffer(int sg_fd, int mode, int buffer_id, int buffer_offset,
         }
         ret = 0;
     }
-    destruct_scsi_pt_obj(ptvp);
+    sg_pt_pool_put_obj(ptvp);
     return ret;
 }
 
@@ -2080,7 +2147,7 @@ sg_ll_write_buffer(int sg_fd, int mode, int buffer_id, int buffer_offset,
         }
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return -1;
     set_scsi_pt_cdb(ptvp, wbuf_cdb, sizeof(wbuf_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -2105,7 +2172,7 @@ sg_ll_write_buffer(int sg_fd, int mode, int buffer_id, int buffer_offset,
     } else
         ret = 0;
 
-    destruct_scsi_pt_obj(ptvp);
+    sg_pt_pool_put_obj(ptvp);
     return ret;
 }
 
@@ -2157,7 +2224,7 @@ sg_ll_write_buffer_v2(int sg_fd, int mode, int m_specific, int buffer_id,
     if (timeout_secs <= 0)
         timeout_secs = DEF_PT_TIMEOUT;
 
-    ptvp = construct_scsi_pt_obj();
+    ptvp = sg_pt_pool_get_obj(sg_fd, 0);
     if (NULL == ptvp) {
         pr2ws("%s: out of memory\n", __func__);
         return -1;
@@ -2185,7 +2252,7 @@ sg_ll_write_buffer_v2(int sg_fd, int mode, int m_specific, int buffer_id,
     } else
         ret = 0;
 
-    destruct_scsi_pt_obj(ptvp);
+    sg_pt_pool_put_obj(ptvp);
     return ret;
 }
 
@@ -2229,7 +2296,12 @@ sg_ll_unmap_v2(int sg_fd, bool anchor, int group_num, int timeout_secs,
         }
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (0 == sg_supp_ops_query(sg_fd, UNMAP_CMD, -1)) {
+        if (vb)
+            pr2ws("    %s not in supported operation codes\n", cdb_s);
+        return SG_LIB_CAT_INVALID_OP;
+    }
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return -1;
     set_scsi_pt_cdb(ptvp, u_cdb, sizeof(u_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -2253,7 +2325,7 @@ sg_ll_unmap_v2(int sg_fd, bool anchor, int group_num, int timeout_secs,
         }
     } else
         ret = 0;
-    destruct_scsi_pt_obj(ptvp);
+    sg_pt_pool_put_obj(ptvp);
     return ret;
 }
 
@@ -2282,7 +2354,7 @@ sg_ll_read_block_limits_v2(int sg_fd, bool mloi, void * resp,
                                  false, sizeof(b), b));
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return -1;
     set_scsi_pt_cdb(ptvp, rl_cdb, sizeof(rl_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -2323,7 +2395,7 @@ sg_ll_read_block_limits_v2(int sg_fd, bool mloi, void * resp,
         }
         ret = 0;
     }
-    destruct_scsi_pt_obj(ptvp);
+    sg_pt_pool_put_obj(ptvp);
     return ret;
 }
 
@@ -2365,7 +2437,7 @@ sg_ll_receive_copy_results(int sg_fd, int sa, int list_id, void * resp,
                                  false, sizeof(d), d));
     }
 
-    if (NULL == ((ptvp = create_pt_obj(b))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, b))))
         return -1;
     set_scsi_pt_cdb(ptvp, rcvcopyres_cdb, sizeof(rcvcopyres_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -2389,7 +2461,7 @@ sg_ll_receive_copy_results(int sg_fd, int sa, int list_id, void * resp,
         }
     } else
         ret = 0;
-    destruct_scsi_pt_obj(ptvp);
+    sg_pt_pool_put_obj(ptvp);
     return ret;
 }
 
@@ -2427,7 +2499,7 @@ sg_ll_extended_copy(int sg_fd, void * paramp, int param_len, bool noisy,
         }
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return -1;
     set_scsi_pt_cdb(ptvp, xcopy_cdb, sizeof(xcopy_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -2451,7 +2523,7 @@ sg_ll_extended_copy(int sg_fd, void * paramp, int param_len, bool noisy,
         }
     } else
         ret = 0;
-    destruct_scsi_pt_obj(ptvp);
+    sg_pt_pool_put_obj(ptvp);
     return ret;
 }
 
@@ -2507,7 +2579,7 @@ sg_ll_3party_copy_out(int sg_fd, int sa, unsigned int list_id, int group_num,
         }
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cname))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cname))))
         return -1;
     set_scsi_pt_cdb(ptvp, xcopy_cdb, sizeof(xcopy_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -2531,7 +2603,7 @@ sg_ll_3party_copy_out(int sg_fd, int sa, unsigned int list_id, int group_num,
         }
     } else
         ret = 0;
-    destruct_scsi_pt_obj(ptvp);
+    sg_pt_pool_put_obj(ptvp);
     return ret;
 }
 
@@ -2543,7 +2615,7 @@ sg_ll_3party_copy_out(int sg_fd, int sa, unsigned int list_id, int group_num,
  * cannot fit in device's cache. If do_seek10==true then does a SEEK(10)
  * command with given lba, if that LBA is < 2**32 . Unclear what SEEK(10)
  * does, assume it is like PRE-FETCH. If timeout_secs is 0 (or less) then
- * use DEF_PT_TIMEOUT (60 seconds) as command timeout. */
+ * use the default timeout (see sg_pt_tmo_load()). */
 int
 sg_ll_pre_fetch_x(int sg_fd, bool do_seek10, bool cdb16, bool immed,
                   uint64_t lba, uint32_t num_blocks, int group_num,
@@ -2605,7 +2677,7 @@ sg_ll_pre_fetch_x(int sg_fd, bool do_seek10, bool cdb16, bool immed,
         pr2ws("    %s cdb: %s\n", cdb_s,
               sg_get_command_str(preFetchCdb, cdb_len, false, sizeof(b), b));
     }
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return -1;
     set_scsi_pt_cdb(ptvp, preFetchCdb, cdb_len);
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -2639,6 +2711,6 @@ sg_ll_pre_fetch_x(int sg_fd, bool do_seek10, bool cdb16, bool immed,
     } else
         ret = 0;
 fini:
-    destruct_scsi_pt_obj(ptvp);
+    sg_pt_pool_put_obj(ptvp);
     return ret;
 }
@@ -0,0 +1,190 @@
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/* sg_cpu_stats version 1.00 20261015 */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifndef SG_LIB_WIN32
+#include <sys/time.h>
+#include <sys/resource.h>
+#endif
+
+#include "sg_lib.h"
+#include "sg_cpu_stats.h"
+#include "sg_pr2serr.h"
+
+#define SG_CPU_GIB (1024.0 * 1024.0 * 1024.0)
+
+#ifndef SG_LIB_WIN32
+static uint64_t
+tv_to_ns(const struct timeval * tvp)
+{
+    return ((uint64_t)tvp->tv_sec * 1000000000) +
+           ((uint64_t)tvp->tv_usec * 1000);
+}
+#endif
+
+uint64_t
+sg_cpu_thread_ns(void)
+{
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_THREAD_CPUTIME_ID)
+    struct timespec ts;
+
+    if (0 == clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts))
+        return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+#endif
+    return 0;
+}
+
+void
+sg_cpu_snap(struct sg_cpu_snap * ssp)
+{
+#ifndef SG_LIB_WIN32
+    struct rusage ru;
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+#else
+    struct timeval tv;
+#endif
+
+    memset(ssp, 0, sizeof(*ssp));
+    if (getrusage(RUSAGE_SELF, &ru) < 0)
+        return;
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ssp->wall_ns = ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+#else
+    gettimeofday(&tv, NULL);
+    ssp->wall_ns = tv_to_ns(&tv);
+#endif
+    ssp->user_ns = tv_to_ns(&ru.ru_utime);
+    ssp->sys_ns = tv_to_ns(&ru.ru_stime);
+    ssp->thr_ns = sg_cpu_thread_ns();
+    ssp->nvcsw = ru.ru_nvcsw;
+    ssp->nivcsw = ru.ru_nivcsw;
+    ssp->minflt = ru.ru_minflt;
+    ssp->majflt = ru.ru_majflt;
+    ssp->valid = true;
+#else
+    memset(ssp, 0, sizeof(*ssp));
+#endif
+}
+
+bool
+sg_cpu_cost(const struct sg_cpu_snap * ap, const struct sg_cpu_snap * bp,
+            uint64_t bytes, uint64_t cmds, struct sg_cpu_cost * cp)
+{
+    double cpu;
+
+    memset(cp, 0, sizeof(*cp));
+    if ((! ap->valid) || (! bp->valid) || (bp->wall_ns < ap->wall_ns))
+        return false;
+    cp->secs = (double)(bp->wall_ns - ap->wall_ns) / 1000000000.0;
+    cp->user_secs = (double)(int64_t)(bp->user_ns - ap->user_ns) /
+                    1000000000.0;
+    cp->sys_secs = (double)(int64_t)(bp->sys_ns - ap->sys_ns) /
+                   1000000000.0;
+    cp->thr_secs = (double)(int64_t)(bp->thr_ns - ap->thr_ns) /
+                   1000000000.0;
+    cpu = cp->user_secs + cp->sys_secs;
+    cp->util_pct = (cp->secs > 0.0) ? (100.0 * cpu / cp->secs) : 0.0;
+    cp->cpu_s_per_gib = (bytes > 0) ?
+                        (cpu * SG_CPU_GIB / (double)bytes) : -1.0;
+    cp->cpu_s_per_mcmd = (cmds > 0) ?
+                         (cpu * 1000000.0 / (double)cmds) : -1.0;
+    cp->nvcsw = bp->nvcsw - ap->nvcsw;
+    cp->nivcsw = bp->nivcsw - ap->nivcsw;
+    cp->minflt = bp->minflt - ap->minflt;
+    cp->majflt = bp->majflt - ap->majflt;
+    return true;
+}
+
+char *
+sg_cpu_cost_str(const struct sg_cpu_cost * cp, char * b, int blen)
+{
+    int n;
+
+    if (blen < 1)
+        return b;
+    n = sg_scnpr(b, blen, "cpu=%.0f%%", cp->util_pct);
+    if (cp->cpu_s_per_gib >= 0.0)
+        n += sg_scnpr(b + n, blen - n, " %.3f s/GiB", cp->cpu_s_per_gib);
+    if (cp->cpu_s_per_mcmd >= 0.0)
+        sg_scnpr(b + n, blen - n, " %.2f s/Mcmd", cp->cpu_s_per_mcmd);
+    return b;
+}
+
+void
+sg_cpu_cost_pr(const struct sg_cpu_cost * cp, const char * leadin)
+{
+    int n;
+    const char * lip = leadin ? leadin : "";
+    char b[160];
+
+    n = sg_scnpr(b, sizeof(b), "CPU: user %.3f s, system %.3f s",
+                 cp->user_secs, cp->sys_secs);
+    if (cp->thr_secs > 0.0)
+        n += sg_scnpr(b + n, sizeof(b) - n, ", threads %.3f s",
+                      cp->thr_secs);
+    pr2serr("%s%s; %.1f%% of %.3f s elapsed\n", lip, b, cp->util_pct,
+            cp->secs);
+    n = 0;
+    b[0] = '\0';
+    if (cp->cpu_s_per_gib >= 0.0)
+        n += sg_scnpr(b + n, sizeof(b) - n, "%.3f CPU s/GiB, ",
+                      cp->cpu_s_per_gib);
+    if (cp->cpu_s_per_mcmd >= 0.0)
+        n += sg_scnpr(b + n, sizeof(b) - n, "%.2f CPU s/million cmds, ",
+                      cp->cpu_s_per_mcmd);
+    pr2serr("%s%sctx switches: %" PRId64 " vol, %" PRId64 " invol; page "
+            "faults: %" PRId64 " minor, %" PRId64 " major\n", lip, b,
+            cp->nvcsw, cp->nivcsw, cp->minflt, cp->majflt);
+}
+
+sgj_opaque_p
+sg_cpu_cost_js(sgj_state * jsp, sgj_opaque_p jop, const char * name,
+               const struct sg_cpu_cost * cp)
+{
+    sgj_opaque_p jo2p;
+
+    if ((NULL == jsp) || (! jsp->pr_as_json))
+        return NULL;
+    jo2p = sgj_named_subobject_r(jsp, jop, name);
+    sgj_js_nv_i(jsp, jo2p, "elapsed_us", (int64_t)(cp->secs * 1000000.0));
+    sgj_js_nv_i(jsp, jo2p, "user_us", (int64_t)(cp->user_secs * 1000000.0));
+    sgj_js_nv_i(jsp, jo2p, "system_us",
+                (int64_t)(cp->sys_secs * 1000000.0));
+    if (cp->thr_secs > 0.0)
+        sgj_js_nv_i(jsp, jo2p, "thread_us",
+                    (int64_t)(cp->thr_secs * 1000000.0));
+    sgj_js_nv_i(jsp, jo2p, "utilization_percent",
+                (int64_t)(cp->util_pct + 0.5));
+    if (cp->cpu_s_per_gib >= 0.0)
+        sgj_js_nv_i(jsp, jo2p, "cpu_us_per_gib",
+                    (int64_t)(cp->cpu_s_per_gib * 1000000.0));
+    if (cp->cpu_s_per_mcmd >= 0.0)
+        sgj_js_nv_i(jsp, jo2p, "cpu_us_per_million_commands",
+                    (int64_t)(cp->cpu_s_per_mcmd * 1000000.0));
+    sgj_js_nv_i(jsp, jo2p, "voluntary_context_switches", cp->nvcsw);
+    sgj_js_nv_i(jsp, jo2p, "involuntary_context_switches", cp->nivcsw);
+    sgj_js_nv_i(jsp, jo2p, "minor_page_faults", cp->minflt);
+    sgj_js_nv_i(jsp, jo2p, "major_page_faults", cp->majflt);
+    return jo2p;
+}
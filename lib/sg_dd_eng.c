@@ -0,0 +1,1367 @@
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/* sg_dd_eng version 1.06 20261015 */
+
+/* Helpers shared by the dd family of utilities, see sg_dd_eng.h . The
+ * file type, capacity and cdb helpers were copies in each of those
+ * utilities; they live here now so that fixes reach all of them. */
+
+#define _XOPEN_SOURCE 600
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1
+#endif
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef SG_LIB_LINUX
+#include <sys/ioctl.h>
+#include <sys/sysmacros.h>
+#include <linux/major.h>        /* for MEM_MAJOR, SCSI_GENERIC_MAJOR, etc */
+#include <linux/fs.h>           /* for BLKSSZGET and friends */
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include "sg_linux_inc.h"       /* for SG_SET_RESERVED_SIZE and friends */
+#include "sg_io_linux.h"        /* for sg_linux_get_caps() */
+#ifdef HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>
+#endif
+#endif
+
+#include "sg_dd_eng.h"
+#include "sg_geom.h"
+#include "sg_lib.h"
+#include "sg_cmds_basic.h"
+#include "sg_pt.h"
+#include "sg_zmap.h"
+#include "sg_unaligned.h"
+#include "sg_pr2serr.h"
+
+#ifdef SG_LIB_LINUX
+#ifndef RAW_MAJOR
+#define RAW_MAJOR 255   /* unlikely value */
+#endif
+#ifndef BLOCK_EXT_MAJOR
+#define BLOCK_EXT_MAJOR 259     /* used by NVMe block devices */
+#endif
+#define DEV_NULL_MINOR_NUM 3
+#endif
+
+#define SENSE_BUFF_LEN 64       /* Arbitrary, could be larger */
+
+
+int
+sg_dde_filetype(const char * fname, int ft_flags, int verbose)
+{
+    struct stat st;
+
+    if ((1 == strlen(fname)) && ('.' == fname[0]))
+        return SG_DDE_FT_DEV_NULL;
+    if (stat(fname, &st) < 0)
+        return SG_DDE_FT_ERROR;
+#ifdef SG_LIB_LINUX
+    if (S_ISCHR(st.st_mode)) {
+        int maj = (int)major(st.st_rdev);
+
+        /* major() and minor() defined in sys/sysmacros.h */
+        if ((MEM_MAJOR == maj) &&
+            (DEV_NULL_MINOR_NUM == minor(st.st_rdev)))
+            return SG_DDE_FT_DEV_NULL;
+        if (RAW_MAJOR == maj)
+            return SG_DDE_FT_RAW;
+        if (SCSI_GENERIC_MAJOR == maj)
+            return SG_DDE_FT_SG;
+        if (SCSI_TAPE_MAJOR == maj)
+            return SG_DDE_FT_ST;
+        if (SG_DDE_FTF_BSG_NVME & ft_flags) {
+            const struct sg_linux_caps * capsp = sg_linux_get_caps(verbose);
+
+            if (capsp->bsg_major == maj)
+                return SG_DDE_FT_SG;
+            if ((capsp->nvme_major == maj) ||      /* e.g. /dev/nvme0 */
+                (capsp->nvme_gen_major == maj))    /* e.g. /dev/ng0n1 */
+                return SG_DDE_FT_SG | SG_DDE_FT_NVME;
+        }
+    } else if (S_ISBLK(st.st_mode)) {
+        if ((SG_DDE_FTF_BSG_NVME & ft_flags) &&
+            (BLOCK_EXT_MAJOR == (int)major(st.st_rdev)))
+            return SG_DDE_FT_BLOCK | SG_DDE_FT_NVME;
+        return SG_DDE_FT_BLOCK;
+    }
+#else
+    if (verbose > 5)
+        pr2serr("%s: %s: no device classification\n", __func__, fname);
+    if (S_ISBLK(st.st_mode))
+        return SG_DDE_FT_BLOCK;
+#endif
+    if ((SG_DDE_FTF_FIFO & ft_flags) && S_ISFIFO(st.st_mode))
+        return SG_DDE_FT_FIFO;
+    return SG_DDE_FT_OTHER;
+}
+
+char *
+sg_dde_filetype_str(int ft, char * b, int blen)
+{
+    int off = 0;
+
+    if (blen < 1)
+        return b;
+    b[0] = '\0';
+    if (SG_DDE_FT_DEV_NULL & ft)
+        off += sg_scn3pr(b, blen, off, "null device ");
+    if (SG_DDE_FT_NVME & ft)
+        off += sg_scn3pr(b, blen, off, "NVMe ");
+    if (SG_DDE_FT_SG & ft)
+        off += sg_scn3pr(b, blen, off, "SCSI generic (sg) device ");
+    if (SG_DDE_FT_BLOCK & ft)
+        off += sg_scn3pr(b, blen, off, "block device ");
+    if (SG_DDE_FT_FIFO & ft)
+        off += sg_scn3pr(b, blen, off, "fifo (named or unnamed pipe) ");
+    if (SG_DDE_FT_ST & ft)
+        off += sg_scn3pr(b, blen, off, "SCSI tape device ");
+    if (SG_DDE_FT_RAW & ft)
+        off += sg_scn3pr(b, blen, off, "raw device ");
+    if (SG_DDE_FT_OTHER & ft)
+        off += sg_scn3pr(b, blen, off, "other (perhaps ordinary file) ");
+    if (SG_DDE_FT_ERROR & ft)
+        sg_scn3pr(b, blen, off, "unable to 'stat' file ");
+    return b;
+}
+
+int
+sg_dde_read_capacity(int sg_fd, int64_t * num_blks, int * blk_sz,
+                     bool noisy, int verbose)
+{
+    int res;
+    struct sg_geom g;
+
+    /* held per fd so later callers don't send it again */
+    res = sg_geom_get(sg_fd, SG_GEOM_RC10_FIRST, &g, noisy, verbose);
+    if (0 != res)
+        return res;
+    *num_blks = (int64_t)g.num_blks;
+    *blk_sz = (int)g.blk_sz;
+    if (verbose)
+        pr2serr("      number of blocks=%" PRId64 " [0x%" PRIx64 "], "
+                "logical block size=%d\n", *num_blks, *num_blks, *blk_sz);
+    return 0;
+}
+
+/* BLKGETSIZE64, BLKGETSIZE and BLKSSZGET macros problematic (from
+ * <linux/fs.h> or <sys/mount.h>). */
+int
+sg_dde_blkdev_capacity(int fd, int64_t * num_blks, int * blk_sz,
+                       int verbose)
+{
+#ifdef BLKSSZGET
+    if ((ioctl(fd, BLKSSZGET, blk_sz) < 0) && (*blk_sz > 0)) {
+        perror("BLKSSZGET ioctl error");
+        return -1;
+    } else {
+ #ifdef BLKGETSIZE64
+        uint64_t ull;
+
+        if (ioctl(fd, BLKGETSIZE64, &ull) < 0) {
+            perror("BLKGETSIZE64 ioctl error");
+            return -1;
+        }
+        *num_blks = ((int64_t)ull / (int64_t)*blk_sz);
+        if (verbose)
+            pr2serr("      [bgs64] number of blocks=%" PRId64 " [0x%" PRIx64
+                    "], logical block size=%d\n", *num_blks, *num_blks,
+                    *blk_sz);
+ #else
+        unsigned long ul;
+
+        if (ioctl(fd, BLKGETSIZE, &ul) < 0) {
+            perror("BLKGETSIZE ioctl error");
+            return -1;
+        }
+        *num_blks = (int64_t)ul;
+        if (verbose)
+            pr2serr("      [bgs] number of blocks=%" PRId64 " [0x%" PRIx64
+                    "], logical block size=%d\n", *num_blks, *num_blks,
+                    *blk_sz);
+ #endif
+    }
+    return 0;
+#else
+    if (verbose)
+        pr2serr("      BLKSSZGET+BLKGETSIZE ioctl not available\n");
+    if (fd) { ; }       /* suppress warning */
+    *num_blks = 0;
+    *blk_sz = 0;
+    return -1;
+#endif
+}
+
+#ifdef SG_LIB_LINUX
+
+/* Reads a decimal number from the sysfs file fn, returns -1 on failure */
+static int64_t
+dde_sysfs_num(const char * fn)
+{
+    int64_t v = -1;
+    FILE * fp = fopen(fn, "r");
+
+    if (fp) {
+        if (1 != fscanf(fp, "%" SCNd64, &v))
+            v = -1;
+        fclose(fp);
+    }
+    return v;
+}
+
+/* Fills the sg module parameters and the request queue limits of the
+ * disk behind sg_fd in *rbp, -1 for those that can't be found. */
+static void
+dde_resbuf_limits(int sg_fd, struct sg_dde_resbuf * rbp)
+{
+    int n;
+    struct stat st;
+    DIR * dp;
+    struct dirent * dep;
+    char fn[256];
+
+    rbp->def_reserved_size =
+        (int)dde_sysfs_num("/sys/module/sg/parameters/def_reserved_size");
+    rbp->allow_dio =
+        (int)dde_sysfs_num("/sys/module/sg/parameters/allow_dio");
+    rbp->max_sectors_kb = -1;
+    rbp->max_hw_sectors_kb = -1;
+    if (fstat(sg_fd, &st) < 0)
+        return;
+    snprintf(fn, sizeof(fn), "/sys/dev/char/%u:%u/device/block",
+             major(st.st_rdev), minor(st.st_rdev));
+    if (NULL == (dp = opendir(fn)))
+        return;         /* not a disk (e.g. an enclosure) */
+    while ((dep = readdir(dp))) {
+        if ('.' == dep->d_name[0])
+            continue;
+        n = strlen(fn);
+        snprintf(fn + n, sizeof(fn) - n, "/%.64s/queue/max_sectors_kb",
+                 dep->d_name);
+        rbp->max_sectors_kb = (int)dde_sysfs_num(fn);
+        snprintf(fn + n, sizeof(fn) - n, "/%.64s/queue/max_hw_sectors_kb",
+                 dep->d_name);
+        rbp->max_hw_sectors_kb = (int)dde_sysfs_num(fn);
+        break;
+    }
+    closedir(dp);
+}
+
+/* max_sectors_kb of the request queue of the block device, or of the disk
+ * behind the sg device, open on fd; -1 if not found */
+static int64_t
+dde_max_sectors_kb(int fd, int ft)
+{
+    int64_t kb = -1;
+    struct stat st;
+    DIR * dp;
+    struct dirent * dep;
+    char fn[256];
+
+    if ((fd < 0) || (fstat(fd, &st) < 0))
+        return -1;
+    if (SG_DDE_FT_BLOCK & ft) {
+        snprintf(fn, sizeof(fn), "/sys/dev/block/%u:%u/queue/max_sectors_kb",
+                 major(st.st_rdev), minor(st.st_rdev));
+        kb = dde_sysfs_num(fn);
+        if (kb < 0) {   /* partitions use the queue of their disk */
+            snprintf(fn, sizeof(fn), "/sys/dev/block/%u:%u/../queue/"
+                     "max_sectors_kb", major(st.st_rdev), minor(st.st_rdev));
+            kb = dde_sysfs_num(fn);
+        }
+    } else if (SG_DDE_FT_SG & ft) {
+        snprintf(fn, sizeof(fn), "/sys/dev/char/%u:%u/device/block",
+                 major(st.st_rdev), minor(st.st_rdev));
+        if ((dp = opendir(fn))) {
+            while ((dep = readdir(dp))) {
+                if ('.' == dep->d_name[0])
+                    continue;
+                snprintf(fn + strlen(fn), sizeof(fn) - strlen(fn),
+                         "/%.64s/queue/max_sectors_kb", dep->d_name);
+                kb = dde_sysfs_num(fn);
+                break;
+            }
+            closedir(dp);
+        }
+    }
+    return kb;
+}
+
+#endif          /* SG_LIB_LINUX */
+
+int
+sg_dde_xfer_limits(int fd, int ft, int blk_sz, int * optp, int verbose)
+{
+    int mx = 0;
+    int64_t kb = -1;
+    struct sg_geom g;
+
+    *optp = 0;
+    if (fd < 0)
+        return 0;
+    if ((SG_DDE_FT_SG & ft) &&
+        (0 == sg_geom_get(fd, SG_GEOM_BL | SG_GEOM_RC10_FIRST, &g, false,
+                          (verbose > 1) ? verbose - 1 : 0))) {
+        mx = (int)(g.max_xfer_len & 0x7fffffff);
+        *optp = (int)(g.opt_xfer_len & 0x7fffffff);
+    }
+#ifdef SG_LIB_LINUX
+    kb = dde_max_sectors_kb(fd, ft);
+#endif
+    if ((kb > 0) && (blk_sz > 0) && ((kb * 1024 / blk_sz) < INT_MAX)) {
+        if ((0 == mx) || ((kb * 1024 / blk_sz) < mx))
+            mx = (int)(kb * 1024 / blk_sz);
+    }
+    if (verbose > 1)
+        pr2serr("bpt=auto: fd=%d limits: max=%d opt=%d blocks\n", fd, mx,
+                *optp);
+    return mx;
+}
+
+int
+sg_dde_resbuf_size(int sg_fd, int blk_sz, int * bptp, int want,
+                   struct sg_dde_resbuf * rbp, const char * leadin,
+                   int verbose)
+{
+    int n, err;
+    int pg_sz = (int)sg_get_page_size();
+    int lost = 0;
+    const char * why_mmap = NULL;
+    const char * why_dio = NULL;
+
+    if (NULL == leadin)
+        leadin = "";
+    memset(rbp, 0, sizeof(*rbp));
+    if (blk_sz < 1)
+        blk_sz = 512;
+    if (*bptp < 1)
+        *bptp = 1;
+#ifdef SG_LIB_LINUX
+    dde_resbuf_limits(sg_fd, rbp);
+    if ((SG_DDE_RB_FIT & want) && (rbp->max_hw_sectors_kb > 0) &&
+        ((int64_t)blk_sz * *bptp > (int64_t)rbp->max_hw_sectors_kb * 1024)) {
+        n = (rbp->max_hw_sectors_kb * 1024) / blk_sz;
+        if (verbose)
+            pr2serr("%sbpt=%d exceeds max_hw_sectors_kb=%d, using bpt=%d\n",
+                    leadin, *bptp, rbp->max_hw_sectors_kb, (n ? n : 1));
+        *bptp = n ? n : 1;
+    }
+    rbp->need = blk_sz * *bptp;
+    rbp->need = ((rbp->need + pg_sz - 1) / pg_sz) * pg_sz;
+    n = rbp->need;
+    if (ioctl(sg_fd, SG_SET_RESERVED_SIZE, &n) < 0) {
+        err = errno;
+        pr2serr("%sSG_SET_RESERVED_SIZE(%d) failed: %s\n", leadin, n,
+                safe_strerror(err));
+        return sg_convert_errno(err);
+    }
+    if (ioctl(sg_fd, SG_GET_RESERVED_SIZE, &rbp->reserved_sz) < 0) {
+        err = errno;
+        pr2serr("%sSG_GET_RESERVED_SIZE failed: %s\n", leadin,
+                safe_strerror(err));
+        return sg_convert_errno(err);
+    }
+    if (rbp->reserved_sz < rbp->need) {
+        /* the driver caps the reserve buffer, mmap() can't exceed it */
+        if ((SG_DDE_RB_FIT & want) && (rbp->reserved_sz >= blk_sz)) {
+            n = rbp->reserved_sz / blk_sz;
+            if (verbose)
+                pr2serr("%sreserve buffer truncated to %d bytes, using "
+                        "bpt=%d\n", leadin, rbp->reserved_sz, n);
+            *bptp = n;
+            rbp->need = n * blk_sz;
+        } else {
+            lost |= SG_DDE_RB_MMAP;
+            why_mmap = "reserve buffer smaller than bs*bpt";
+        }
+    }
+    if (0 == rbp->allow_dio) {
+        lost |= SG_DDE_RB_DIO;
+        why_dio = "/sys/module/sg/parameters/allow_dio is 0";
+    }
+    if ((rbp->max_hw_sectors_kb > 0) &&
+        (rbp->need > rbp->max_hw_sectors_kb * 1024)) {
+        /* both map user pages into a single request */
+        if (NULL == why_dio)
+            why_dio = "bs*bpt exceeds the queue's max_hw_sectors_kb";
+        if (NULL == why_mmap)
+            why_mmap = "bs*bpt exceeds the queue's max_hw_sectors_kb";
+        lost |= (SG_DDE_RB_MMAP | SG_DDE_RB_DIO);
+    }
+#else
+    if (sg_fd) { ; }    /* suppress warning */
+    rbp->max_sectors_kb = -1;
+    rbp->max_hw_sectors_kb = -1;
+    rbp->def_reserved_size = -1;
+    rbp->allow_dio = -1;
+    rbp->need = blk_sz * *bptp;
+    lost = SG_DDE_RB_MMAP | SG_DDE_RB_DIO;
+    why_mmap = "no sg driver";
+    why_dio = why_mmap;
+#endif
+    rbp->got = want & (SG_DDE_RB_MMAP | SG_DDE_RB_DIO) & ~lost;
+    if ((SG_DDE_RB_MMAP & want) && (SG_DDE_RB_MMAP & lost))
+        pr2serr("%smmap-ed IO not used: %s\n", leadin, why_mmap);
+    if ((SG_DDE_RB_DIO & want) && (SG_DDE_RB_DIO & lost))
+        pr2serr("%sdirect IO not used: %s\n", leadin, why_dio);
+    if (verbose > 1)
+        pr2serr("%sreserve buffer: need=%d got=%d; def_reserved_size=%d "
+                "allow_dio=%d max_sectors_kb=%d max_hw_sectors_kb=%d\n",
+                leadin, rbp->need, rbp->reserved_sz, rbp->def_reserved_size,
+                rbp->allow_dio, rbp->max_sectors_kb, rbp->max_hw_sectors_kb);
+    return 0;
+}
+
+/* The patch functions of the cdb templates, one per cdb size */
+static void
+dde_patch6(uint8_t * cdbp, uint32_t blocks, uint64_t lba)
+{
+    sg_put_unaligned_be24((uint32_t)lba, cdbp + 1);
+    cdbp[4] = (uint8_t)blocks;          /* 256 blocks is encoded as 0 */
+}
+
+static void
+dde_patch10(uint8_t * cdbp, uint32_t blocks, uint64_t lba)
+{
+    sg_put_unaligned_be32((uint32_t)lba, cdbp + 2);
+    sg_put_unaligned_be16((uint16_t)blocks, cdbp + 7);
+}
+
+static void
+dde_patch12(uint8_t * cdbp, uint32_t blocks, uint64_t lba)
+{
+    sg_put_unaligned_be32((uint32_t)lba, cdbp + 2);
+    sg_put_unaligned_be32(blocks, cdbp + 6);
+}
+
+static void
+dde_patch16(uint8_t * cdbp, uint32_t blocks, uint64_t lba)
+{
+    sg_put_unaligned_be64(lba, cdbp + 2);
+    sg_put_unaligned_be32(blocks, cdbp + 10);
+}
+
+int
+sg_dde_cdb_tmpl_init(struct sg_dde_cdb_tmpl * tp, int cdb_sz,
+                     bool write_true, bool fua, bool dpo, const char * leadin)
+{
+    static const uint8_t rd_opcode[] = {0x8, 0x28, 0xa8, 0x88};
+    static const uint8_t wr_opcode[] = {0xa, 0x2a, 0xaa, 0x8a};
+    int sz_ind;
+
+    if (NULL == leadin)
+        leadin = "";
+    memset(tp, 0, sizeof(*tp));
+    switch (cdb_sz) {
+    case 6:
+        if (dpo || fua) {
+            pr2serr("%sfor 6 byte commands, neither dpo nor fua bits "
+                    "supported\n", leadin);
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        sz_ind = 0;
+        tp->max_blks = 256;
+        tp->lba_end = 0x200000;
+        tp->patch = dde_patch6;
+        break;
+    case 10:
+        sz_ind = 1;
+        tp->max_blks = 0xffff;
+        tp->lba_end = 0x100000000ULL;
+        tp->patch = dde_patch10;
+        break;
+    case 12:
+        sz_ind = 2;
+        tp->max_blks = 0xffffffff;
+        tp->lba_end = 0x100000000ULL;
+        tp->patch = dde_patch12;
+        break;
+    case 16:
+        sz_ind = 3;
+        tp->max_blks = 0xffffffff;
+        tp->lba_end = UINT64_MAX;
+        tp->patch = dde_patch16;
+        break;
+    default:
+        pr2serr("%sexpected cdb size of 6, 10, 12, or 16 but got %d\n",
+                leadin, cdb_sz);
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    tp->cdb_sz = cdb_sz;
+    tp->cdb[0] = write_true ? wr_opcode[sz_ind] : rd_opcode[sz_ind];
+    if (dpo)
+        tp->cdb[1] |= 0x10;
+    if (fua)
+        tp->cdb[1] |= 0x8;
+    return 0;
+}
+
+int
+sg_dde_build_rw_cdb(uint8_t * cdbp, int cdb_sz, unsigned int blocks,
+                    int64_t lba, bool write_true, bool fua, bool dpo,
+                    const char * leadin)
+{
+    int res;
+    struct sg_dde_cdb_tmpl tmpl;
+
+    res = sg_dde_cdb_tmpl_init(&tmpl, cdb_sz, write_true, fua, dpo, leadin);
+    if (res)
+        return res;
+    if (0 == sg_dde_cdb_tmpl_fill(&tmpl, cdbp, blocks, lba))
+        return 0;
+    if (NULL == leadin)
+        leadin = "";
+    if (blocks > tmpl.max_blks)
+        pr2serr("%sfor %d byte commands, maximum number of blocks is %u\n",
+                leadin, cdb_sz, tmpl.max_blks);
+    else
+        pr2serr("%sfor %d byte commands, can't address blocks beyond "
+                "%" PRIu64 "\n", leadin, cdb_sz, tmpl.lba_end - 1);
+    return SG_LIB_SYNTAX_ERROR;
+}
+
+/* Zone append writer, see sg_dd_eng.h */
+
+#define DDE_ZAPP_MAX_RESEND 4   /* times one append is sent again */
+#define DDE_NVME_ID_LEN 4096
+
+#define DDE_ZS_FREE 0
+#define DDE_ZS_QUEUED 1         /* waiting to be (re)sent */
+#define DDE_ZS_IN_FLIGHT 2
+
+struct dde_zapp_slot {
+    int state;          /* DDE_ZS_* */
+    int num_blks;
+    int resends;
+    int sub_res;        /* from submission, NVMe may complete there */
+    int64_t tag;
+    int64_t zone;       /* index in zone map */
+    uint64_t lba;       /* ZBC: where written, ZNS: start of zone */
+    struct sg_pt_base * ptvp;
+    uint8_t * bp;
+    uint8_t cmd[64];    /* 64 byte NVMe command or SCSI cdb */
+    uint8_t sense[SENSE_BUFF_LEN];
+};
+
+struct sg_dde_zapp {
+    bool nvme;
+    bool ordered;       /* ZBC: one WRITE at a time until queue empties */
+    int qd;
+    int max_blks;
+    int num_in_flight;
+    int num_queued;
+    int cur_slot;       /* from last sg_dde_zapp_get_buf(), else -1 */
+    int first_err;
+    int64_t zone;       /* zone being filled, -1 before the first */
+    int64_t next_zone;  /* next index to look at */
+    uint64_t zone_lba;
+    uint64_t zone_cap;  /* writable blocks (ZNS: zone capacity) */
+    uint64_t zone_used;
+    struct sg_dde_ep * ep;
+    struct sg_zmap * zmp;
+    sg_dde_zapp_done_f done;
+    void * ctx;
+    uint8_t * free_bufs;
+    struct dde_zapp_slot * slots;
+    struct sg_dde_zapp_stats st;
+};
+
+/* ZNS Zone Append Size Limit (ZASL) and Maximum Data Transfer Size
+ * (MDTS) are powers of two in units of the controller's minimum memory
+ * page size, assumed here to be 4096 bytes. Returns the lower of them in
+ * logical blocks, 0 if neither is known. */
+static int
+dde_zapp_nvme_limit(struct sg_dde_zapp * zap, struct sg_pt_base * ptvp)
+{
+    int k, res, shift;
+    int lim = 0;
+    uint8_t * bp;
+    uint8_t * free_bp = NULL;
+    uint8_t cmd[64];
+    struct sg_dde_ep * ep = zap->ep;
+    int vb = ep->verbose ? ep->verbose - 1 : 0;
+
+    bp = sg_memalign(DDE_NVME_ID_LEN, 0, &free_bp, false);
+    if (NULL == bp)
+        return 0;
+    /* CNS 1: Identify Controller (MDTS), CNS 6 CSI 2: ZNS one (ZASL) */
+    for (k = 0; k < 2; ++k) {
+        memset(cmd, 0, sizeof(cmd));
+        cmd[0] = 0x6;                   /* Identify */
+        cmd[40] = k ? 0x6 : 0x1;        /* CNS in CDW10 */
+        if (k)
+            cmd[47] = 0x2;              /* CSI in CDW11 */
+        partial_clear_scsi_pt_obj(ptvp);
+        set_scsi_pt_cdb(ptvp, cmd, sizeof(cmd));
+        set_scsi_pt_data_in(ptvp, bp, DDE_NVME_ID_LEN);
+        res = do_scsi_pt(ptvp, -1, ep->timeout_secs, vb);
+        if (res || get_scsi_pt_status_response(ptvp))
+            continue;
+        shift = k ? bp[0] : bp[77];
+        if ((0 == shift) || (shift > 20))
+            continue;
+        res = (int)(((int64_t)4096 << shift) / ep->blk_sz);
+        if ((0 == lim) || (res < lim))
+            lim = res;
+    }
+    free(free_bp);
+    return lim;
+}
+
+/* Moves on to the next zone with room for num_blks blocks. Returns 0 or
+ * SG_LIB_LBA_OUT_OF_RANGE if there is none. */
+static int
+dde_zapp_next_zone(struct sg_dde_zapp * zap, int num_blks)
+{
+    int64_t k;
+    int64_t n = sg_zmap_num_zones(zap->zmp);
+    uint64_t len;
+    const struct sg_zmap_ent * zep;
+
+    for (k = zap->next_zone; k < n; ++k) {
+        zep = sg_zmap_entry(zap->zmp, (uint32_t)k);
+        /* sequential write required or preferred, with a write pointer */
+        if (((2 != zep->type) && (3 != zep->type)) ||
+            (SG_ZMAP_NO_WP == zep->wp_off) || (zep->cond >= 0xd))
+            continue;
+        /* for ZNS a gap zone follows holding what is past the capacity */
+        len = sg_zmap_zone_len(zap->zmp, (uint32_t)k);
+        if (len < (uint64_t)zep->wp_off + num_blks)
+            continue;
+        zap->zone = k;
+        zap->next_zone = k + 1;
+        zap->zone_lba = zep->start_lba;
+        zap->zone_cap = len;
+        zap->zone_used = zep->wp_off;
+        ++zap->st.zones;
+        if (zap->ep->verbose > 1)
+            pr2serr("%s: appending to zone at lba 0x%" PRIx64 ", %" PRIu64
+                    " of %" PRIu64 " blocks used\n", zap->ep->fname,
+                    zap->zone_lba, zap->zone_used, zap->zone_cap);
+        return 0;
+    }
+    zap->next_zone = n;
+    pr2serr("%s: no zone has room for %d more blocks\n", zap->ep->fname,
+            num_blks);
+    return SG_LIB_LBA_OUT_OF_RANGE;
+}
+
+/* Sends slp to the device. Returns 0 or an exit status. */
+static int
+dde_zapp_send(struct sg_dde_zapp * zap, struct dde_zapp_slot * slp)
+{
+    int k, res;
+    int n = 0;
+    struct sg_dde_ep * ep = zap->ep;
+    struct sg_pt_base * ptvp = slp->ptvp;
+
+    partial_clear_scsi_pt_obj(ptvp);
+    set_scsi_pt_data_out(ptvp, slp->bp, slp->num_blks * ep->blk_sz);
+    if (zap->nvme) {
+        set_scsi_pt_cdb(ptvp, slp->cmd, 64);
+        res = do_nvm_pt_submit(ptvp, 0, ep->timeout_secs, ep->verbose);
+        if (res && (SG_LIB_NVME_STATUS != res))
+            goto err;
+    } else {
+        memset(slp->sense, 0, sizeof(slp->sense));
+        set_scsi_pt_cdb(ptvp, slp->cmd, ep->cdb_sz);
+        set_scsi_pt_sense(ptvp, slp->sense, sizeof(slp->sense));
+        set_scsi_pt_packet_id(ptvp, 1 + (int)(slp - zap->slots));
+        res = do_scsi_pt_submit(ptvp, ep->fd, ep->timeout_secs, ep->verbose);
+        if (res)
+            goto err;
+    }
+    slp->sub_res = res;
+    slp->state = DDE_ZS_IN_FLIGHT;
+    ++zap->num_in_flight;
+    for (k = 0; k < zap->qd; ++k) {
+        if ((DDE_ZS_IN_FLIGHT == zap->slots[k].state) &&
+            (slp->zone == zap->slots[k].zone))
+            ++n;
+    }
+    if (n > zap->st.max_in_zone)
+        zap->st.max_in_zone = n;
+    return 0;
+err:
+    pr2serr("%s: unable to submit append: %s\n", ep->fname,
+            (res < 0) ? safe_strerror(-res) : "pass-through error");
+    return (res < 0) ? sg_convert_errno(-res) : SG_LIB_CAT_OTHER;
+}
+
+/* Sends queued appends: all of them unless ordered, in which case only
+ * the lowest LBA and only when nothing is in flight. Returns 0 or an exit
+ * status. */
+static int
+dde_zapp_kick(struct sg_dde_zapp * zap)
+{
+    int k, res;
+    struct dde_zapp_slot * slp;
+    struct dde_zapp_slot * low_slp;
+
+    while (zap->num_queued > 0) {
+        if (zap->ordered && (zap->num_in_flight > 0))
+            return 0;
+        for (k = 0, low_slp = NULL; k < zap->qd; ++k) {
+            slp = zap->slots + k;
+            if ((DDE_ZS_QUEUED == slp->state) &&
+                ((NULL == low_slp) || (slp->lba < low_slp->lba)))
+                low_slp = slp;
+        }
+        if (NULL == low_slp)
+            break;
+        --zap->num_queued;
+        res = dde_zapp_send(zap, low_slp);
+        if (res) {
+            low_slp->state = DDE_ZS_FREE;
+            if (0 == zap->first_err)
+                zap->first_err = res;
+            return res;
+        }
+    }
+    zap->ordered = false;
+    return 0;
+}
+
+/* Processes the response of slp. Returns 0 (also when slp has been
+ * queued to be sent again) or an exit status. */
+static int
+dde_zapp_complete(struct sg_dde_zapp * zap, struct dde_zapp_slot * slp,
+                  int res)
+{
+    bool resend = false;
+    int ret, sense_cat;
+    uint64_t lba = slp->lba;
+    struct sg_dde_ep * ep = zap->ep;
+    struct sg_pt_base * ptvp = slp->ptvp;
+    struct sg_scsi_sense_hdr ssh;
+    char b[80];
+
+    --zap->num_in_flight;
+    if (zap->nvme) {
+        if (0 == res)
+            res = slp->sub_res;
+        if ((0 == res) && get_scsi_pt_status_response(ptvp))
+            res = SG_LIB_NVME_STATUS;
+        if (SG_LIB_NVME_STATUS == res) {
+            sg_get_nvme_cmd_status_str(get_scsi_pt_status_response(ptvp),
+                                       sizeof(b), b);
+            pr2serr("%s: Zone Append to zone at lba 0x%" PRIx64 ": %s\n",
+                    ep->fname, lba, b);
+            ret = res;
+        } else if (res) {
+            pr2serr("%s: Zone Append to zone at lba 0x%" PRIx64 " failed\n",
+                    ep->fname, lba);
+            ret = (res < 0) ? sg_convert_errno(-res) : SG_LIB_CAT_OTHER;
+        } else {
+            /* the ALBA is CDW0 and CDW1 of the completion but only CDW0
+             * reaches here; zones are far smaller than 2**32 blocks so
+             * its offset from the start of the zone is enough */
+            lba += (uint32_t)(get_pt_result(ptvp) - (uint32_t)lba);
+            ret = 0;
+        }
+    } else {
+        ret = sg_cmds_process_resp(ptvp, "zone append (WRITE)", res, false,
+                                   ep->verbose, &sense_cat);
+        if (-1 == ret)
+            ret = get_scsi_pt_transport_err(ptvp) ? SG_LIB_TRANSPORT_ERROR :
+                        sg_convert_errno(get_scsi_pt_os_err(ptvp));
+        else if (-2 == ret) {
+            ret = sense_cat;
+            if ((SG_LIB_CAT_RECOVERED == sense_cat) ||
+                (SG_LIB_CAT_NO_SENSE == sense_cat))
+                ret = 0;
+            else if (sg_scsi_normalize_sense(slp->sense,
+                                             get_scsi_pt_sense_len(ptvp),
+                                             &ssh) &&
+                     (SPC_SK_ILLEGAL_REQUEST == ssh.sense_key) &&
+                     (0x21 == ssh.asc) && (0x4 == ssh.ascq)) {
+                /* UNALIGNED WRITE COMMAND: overtook an earlier WRITE */
+                resend = true;
+                zap->ordered = true;
+            } else if ((SG_LIB_CAT_UNIT_ATTENTION == sense_cat) ||
+                       (SG_LIB_CAT_ABORTED_COMMAND == sense_cat))
+                resend = true;
+        } else
+            ret = 0;
+        if (resend && (slp->resends++ < DDE_ZAPP_MAX_RESEND)) {
+            ++zap->st.resent;
+            slp->state = DDE_ZS_QUEUED;
+            ++zap->num_queued;
+            return 0;
+        }
+        if (ret) {
+            sg_get_category_sense_str(ret, sizeof(b), b, ep->verbose);
+            pr2serr("%s: WRITE of %d blocks at lba 0x%" PRIx64 ": %s\n",
+                    ep->fname, slp->num_blks, lba, b);
+        }
+    }
+    slp->state = DDE_ZS_FREE;
+    if (ret)
+        return ret;
+    ++zap->st.appends;
+    zap->st.blocks += slp->num_blks;
+    if (zap->done)
+        zap->done(zap->ctx, slp->tag, lba, slp->num_blks);
+    return 0;
+}
+
+/* Processes the responses that have arrived, waiting for at least one
+ * if 'wait'. Returns 0 or the exit status of the first failed append. */
+static int
+dde_zapp_reap(struct sg_dde_zapp * zap, bool wait)
+{
+    int k, res, num;
+    struct sg_dde_ep * ep = zap->ep;
+    struct dde_zapp_slot * slp;
+
+    while (zap->num_in_flight > 0) {
+        for (k = 0, num = 0; k < zap->qd; ++k) {
+            slp = zap->slots + k;
+            if (DDE_ZS_IN_FLIGHT != slp->state)
+                continue;
+            res = do_scsi_pt_receive(slp->ptvp, ep->fd, ep->verbose);
+            if (-EAGAIN == res)
+                continue;
+            ++num;
+            res = dde_zapp_complete(zap, slp, res);
+            if (res && (0 == zap->first_err))
+                zap->first_err = res;
+        }
+        res = dde_zapp_kick(zap);
+        if (res && (0 == zap->first_err))
+            zap->first_err = res;
+        if (num && (! zap->ordered))
+            break;
+        if ((! wait) && (0 == num))
+            break;
+        if (0 == num) {
+            res = scsi_pt_wait_for_response(ep->fd, 1000, ep->verbose);
+            if (res < 0) {
+                if (0 == zap->first_err)
+                    zap->first_err = sg_convert_errno(-res);
+                break;
+            }
+        }
+    }
+    return zap->first_err;
+}
+
+int
+sg_dde_zapp_new(struct sg_dde_ep * ep, int64_t start_lba, int qd,
+                int * max_blksp, sg_dde_zapp_done_f done, void * ctx,
+                struct sg_dde_zapp ** zapp)
+{
+    int k, lim, res;
+    int64_t idx;
+    uint8_t * bp;
+    struct sg_dde_zapp * zap;
+    struct sg_pt_base * ptvp;
+
+    *zapp = NULL;
+    if ((ep->fd < 0) || (qd < 1) || (*max_blksp < 1) || (ep->blk_sz < 1)) {
+        pr2serr("%s: bad argument\n", __func__);
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    zap = (struct sg_dde_zapp *)calloc(1, sizeof(*zap));
+    if (NULL == zap)
+        return sg_convert_errno(ENOMEM);
+    zap->ep = ep;
+    zap->qd = qd;
+    zap->done = done;
+    zap->ctx = ctx;
+    zap->cur_slot = -1;
+    zap->zone = -1;
+    zap->slots = (struct dde_zapp_slot *)calloc(qd, sizeof(*zap->slots));
+    if (NULL == zap->slots) {
+        res = sg_convert_errno(ENOMEM);
+        goto fini;
+    }
+    for (k = 0; k < qd; ++k) {
+        zap->slots[k].ptvp = construct_scsi_pt_obj_with_fd(ep->fd,
+                                                           ep->verbose);
+        if (NULL == zap->slots[k].ptvp) {
+            res = sg_convert_errno(ENOMEM);
+            goto fini;
+        }
+    }
+    ptvp = zap->slots[0].ptvp;
+    zap->nvme = pt_device_is_nvme(ptvp);
+    if (zap->nvme) {
+        lim = dde_zapp_nvme_limit(zap, ptvp);
+        if ((lim > 0) && (*max_blksp > lim)) {
+            if (ep->verbose)
+                pr2serr("%s: Zone Append limit is %d blocks, lowered from "
+                        "%d\n", ep->fname, lim, *max_blksp);
+            *max_blksp = lim;
+        }
+    }
+    zap->max_blks = *max_blksp;
+    res = sg_zmap_build(ep->fd, 0, &zap->zmp,
+                        ep->verbose ? ep->verbose - 1 : 0);
+    if (res) {
+        pr2serr("%s: unable to fetch zones, is it zoned?\n", ep->fname);
+        goto fini;
+    }
+    idx = sg_zmap_find(zap->zmp, (start_lba > 0) ? start_lba : 0);
+    if (idx < 0) {
+        pr2serr("%s: lba 0x%" PRIx64 " is past the end\n", ep->fname,
+                (uint64_t)start_lba);
+        res = SG_LIB_LBA_OUT_OF_RANGE;
+        goto fini;
+    }
+    zap->next_zone = idx;
+    bp = sg_memalign((uint32_t)qd * zap->max_blks * ep->blk_sz, 0,
+                     &zap->free_bufs, false);
+    if (NULL == bp) {
+        pr2serr("%s: not enough user memory for %d buffers\n", __func__,
+                qd);
+        res = sg_convert_errno(ENOMEM);
+        goto fini;
+    }
+    for (k = 0; k < qd; ++k)
+        zap->slots[k].bp = bp + ((size_t)k * zap->max_blks * ep->blk_sz);
+    if (ep->verbose)
+        pr2serr("%s: zone append, %s, %u zones, queue depth %d\n",
+                ep->fname, zap->nvme ? "NVMe Zone Append" :
+                "emulated with WRITE", sg_zmap_num_zones(zap->zmp), qd);
+    *zapp = zap;
+    return 0;
+fini:
+    sg_dde_zapp_free(zap);
+    return res;
+}
+
+int
+sg_dde_zapp_get_buf(struct sg_dde_zapp * zap, uint8_t ** bpp)
+{
+    int k, res;
+
+    *bpp = NULL;
+    if (zap->cur_slot >= 0) {           /* not submitted, hand it out again */
+        *bpp = zap->slots[zap->cur_slot].bp;
+        return 0;
+    }
+    while (true) {
+        for (k = 0; k < zap->qd; ++k) {
+            if (DDE_ZS_FREE == zap->slots[k].state)
+                break;
+        }
+        if (k < zap->qd)
+            break;
+        res = dde_zapp_reap(zap, true);
+        if (res)
+            return res;
+    }
+    zap->cur_slot = k;
+    *bpp = zap->slots[k].bp;
+    return 0;
+}
+
+int
+sg_dde_zapp_submit(struct sg_dde_zapp * zap, int64_t tag, int num_blks)
+{
+    int res;
+    struct dde_zapp_slot * slp;
+    struct sg_dde_ep * ep = zap->ep;
+
+    if ((zap->cur_slot < 0) || (num_blks < 1) ||
+        (num_blks > zap->max_blks)) {
+        pr2serr("%s: no buffer or bad number of blocks\n", __func__);
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if (zap->first_err)
+        return zap->first_err;
+    if ((zap->zone < 0) || (zap->zone_used + num_blks > zap->zone_cap)) {
+        res = dde_zapp_next_zone(zap, num_blks);
+        if (res)
+            return res;
+    }
+    slp = zap->slots + zap->cur_slot;
+    zap->cur_slot = -1;
+    slp->num_blks = num_blks;
+    slp->resends = 0;
+    slp->tag = tag;
+    slp->zone = zap->zone;
+    memset(slp->cmd, 0, sizeof(slp->cmd));
+    if (zap->nvme) {
+        slp->lba = zap->zone_lba;
+        slp->cmd[0] = 0x7d;             /* Zone Append */
+        sg_put_unaligned_le32(get_pt_nvme_nsid(slp->ptvp), slp->cmd + 4);
+        sg_put_unaligned_le64(slp->lba, slp->cmd + 40);  /* ZSLBA */
+        sg_put_unaligned_le32(num_blks - 1, slp->cmd + 48);      /* NLB */
+    } else {
+        slp->lba = zap->zone_lba + zap->zone_used;
+        if (sg_dde_cdb_tmpl_fill(&ep->tmpl, slp->cmd, num_blks,
+                                 (int64_t)slp->lba)) {
+            pr2serr("%s: %d blocks at lba 0x%" PRIx64 " do not fit a %d "
+                    "byte cdb\n", ep->fname, num_blks, slp->lba,
+                    ep->cdb_sz);
+            slp->state = DDE_ZS_FREE;
+            return SG_LIB_SYNTAX_ERROR;
+        }
+    }
+    zap->zone_used += num_blks;
+    slp->state = DDE_ZS_QUEUED;
+    ++zap->num_queued;
+    res = dde_zapp_kick(zap);
+    if (res)
+        return res;
+    return dde_zapp_reap(zap, false);
+}
+
+int
+sg_dde_zapp_drain(struct sg_dde_zapp * zap)
+{
+    while ((zap->num_in_flight > 0) || (zap->num_queued > 0)) {
+        if (zap->num_in_flight > 0)
+            dde_zapp_reap(zap, true);
+        else if (zap->first_err)
+            break;
+        else
+            dde_zapp_kick(zap);
+    }
+    return zap->first_err;
+}
+
+void
+sg_dde_zapp_get_stats(const struct sg_dde_zapp * zap,
+                      struct sg_dde_zapp_stats * sp)
+{
+    *sp = zap->st;
+}
+
+void
+sg_dde_zapp_free(struct sg_dde_zapp * zap)
+{
+    int k;
+
+    if (NULL == zap)
+        return;
+    if (zap->slots) {
+        zap->num_queued = 0;    /* do not send those */
+        while (zap->num_in_flight > 0)
+            dde_zapp_reap(zap, true);
+        for (k = 0; k < zap->qd; ++k) {
+            if (zap->slots[k].ptvp)
+                destruct_scsi_pt_obj(zap->slots[k].ptvp);
+        }
+        free(zap->slots);
+    }
+    if (zap->zmp)
+        sg_zmap_free(zap->zmp);
+    free(zap->free_bufs);
+    free(zap);
+}
+
+
+/* IORING_OP_READ is an enum, IORING_FEAT_RW_CUR_POS came with it (lk 5.6) */
+#if defined(SG_LIB_LINUX) && defined(HAVE_LINUX_IO_URING_H) && \
+    defined(IORING_FEAT_RW_CUR_POS) && defined(__NR_io_uring_setup) && \
+    defined(__NR_io_uring_enter) && defined(__NR_io_uring_register)
+
+#define DDE_URING_MAX_FDS 8
+
+/* A plain ring (64 byte SQEs, 16 byte CQEs) using the raw system calls,
+ * like the NVMe pass-through one in sg_pt_linux_uring.c */
+struct sg_dde_uring {
+    int ring_fd;
+    int num_fds;        /* registered files, 0 if registration failed */
+    int num_bufs;       /* registered buffers, likewise */
+    int buf_len;
+    uint32_t sq_entries;
+    uint32_t * sq_head;
+    uint32_t * sq_tail;
+    uint32_t * sq_mask;
+    uint32_t * sq_array;
+    uint32_t * cq_head;
+    uint32_t * cq_tail;
+    uint32_t * cq_mask;
+    struct io_uring_sqe * sqes;
+    struct io_uring_cqe * cqes;
+    void * sq_ptr;
+    void * cq_ptr;
+    size_t sq_sz;
+    size_t cq_sz;
+    size_t sqes_sz;
+    int fds[DDE_URING_MAX_FDS];
+    uint8_t ** bufs;
+};
+
+static int
+dde_uring_enter(int ring_fd, uint32_t to_submit, uint32_t min_complete)
+{
+    int res;
+
+    do {
+        res = (int)syscall(__NR_io_uring_enter, ring_fd, to_submit,
+                           min_complete,
+                           min_complete ? IORING_ENTER_GETEVENTS : 0,
+                           NULL, 0);
+    } while ((res < 0) && (EINTR == errno));
+    return (res < 0) ? -errno : res;
+}
+
+struct sg_dde_uring *
+sg_dde_uring_new(int entries, const int * fd_arr, int num_fds,
+                 uint8_t * const * buf_arr, int num_bufs, int buf_len,
+                 int verbose)
+{
+    int k, fd, err;
+    uint8_t * sqp;
+    uint8_t * cqp;
+    struct sg_dde_uring * urp;
+    struct iovec * iovp;
+    struct io_uring_params p;
+
+    urp = (struct sg_dde_uring *)calloc(1, sizeof(*urp));
+    if (NULL == urp)
+        return NULL;
+    urp->ring_fd = -1;
+    memset(&p, 0, sizeof(p));
+    fd = (int)syscall(__NR_io_uring_setup, (entries > 0) ? entries : 1, &p);
+    if (fd < 0) {
+        err = errno;
+        if (verbose)
+            pr2serr("%s: io_uring_setup() failed: %s\n", __func__,
+                    safe_strerror(err));
+        goto err_out;
+    }
+    urp->ring_fd = fd;
+    urp->sq_entries = p.sq_entries;
+    urp->sq_sz = p.sq_off.array + (p.sq_entries * sizeof(uint32_t));
+    urp->cq_sz = p.cq_off.cqes + (p.cq_entries * sizeof(struct io_uring_cqe));
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (urp->cq_sz > urp->sq_sz)
+            urp->sq_sz = urp->cq_sz;
+        urp->cq_sz = urp->sq_sz;
+    }
+    urp->sq_ptr = mmap(NULL, urp->sq_sz, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (MAP_FAILED == urp->sq_ptr) {
+        urp->sq_ptr = NULL;
+        goto mmap_err;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+        urp->cq_ptr = urp->sq_ptr;
+    else {
+        urp->cq_ptr = mmap(NULL, urp->cq_sz, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_POPULATE, fd,
+                           IORING_OFF_CQ_RING);
+        if (MAP_FAILED == urp->cq_ptr) {
+            urp->cq_ptr = NULL;
+            goto mmap_err;
+        }
+    }
+    urp->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+    urp->sqes = (struct io_uring_sqe *)
+                mmap(NULL, urp->sqes_sz, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (MAP_FAILED == (void *)urp->sqes) {
+        urp->sqes = NULL;
+        goto mmap_err;
+    }
+    sqp = (uint8_t *)urp->sq_ptr;
+    cqp = (uint8_t *)urp->cq_ptr;
+    urp->sq_head = (uint32_t *)(sqp + p.sq_off.head);
+    urp->sq_tail = (uint32_t *)(sqp + p.sq_off.tail);
+    urp->sq_mask = (uint32_t *)(sqp + p.sq_off.ring_mask);
+    urp->sq_array = (uint32_t *)(sqp + p.sq_off.array);
+    urp->cq_head = (uint32_t *)(cqp + p.cq_off.head);
+    urp->cq_tail = (uint32_t *)(cqp + p.cq_off.tail);
+    urp->cq_mask = (uint32_t *)(cqp + p.cq_off.ring_mask);
+    urp->cqes = (struct io_uring_cqe *)(cqp + p.cq_off.cqes);
+
+    /* registration is an optimization, the ring works without it */
+    if (num_fds > DDE_URING_MAX_FDS)
+        num_fds = DDE_URING_MAX_FDS;
+    for (k = 0; k < num_fds; ++k)
+        urp->fds[k] = fd_arr[k];
+    if ((num_fds > 0) &&
+        (syscall(__NR_io_uring_register, fd, IORING_REGISTER_FILES,
+                 urp->fds, num_fds) >= 0))
+        urp->num_fds = num_fds;
+    else if ((num_fds > 0) && verbose)
+        pr2serr("%s: IORING_REGISTER_FILES failed: %s\n", __func__,
+                safe_strerror(errno));
+    if ((num_bufs > 0) && (buf_len > 0)) {
+        iovp = (struct iovec *)calloc(num_bufs, sizeof(struct iovec));
+        urp->bufs = (uint8_t **)calloc(num_bufs, sizeof(uint8_t *));
+        if (iovp && urp->bufs) {
+            for (k = 0; k < num_bufs; ++k) {
+                iovp[k].iov_base = buf_arr[k];
+                iovp[k].iov_len = buf_len;
+                urp->bufs[k] = buf_arr[k];
+            }
+            if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_BUFFERS,
+                        iovp, num_bufs) >= 0) {
+                urp->num_bufs = num_bufs;
+                urp->buf_len = buf_len;
+            } else if (verbose)     /* e.g. RLIMIT_MEMLOCK on older kernels */
+                pr2serr("%s: IORING_REGISTER_BUFFERS failed: %s\n",
+                        __func__, safe_strerror(errno));
+        }
+        free(iovp);
+    }
+    if (verbose > 1)
+        pr2serr("%s: ring_fd=%d, sq_entries=%u, %d files and %d buffers "
+                "registered\n", __func__, fd, p.sq_entries, urp->num_fds,
+                urp->num_bufs);
+    return urp;
+
+mmap_err:
+    err = errno;
+    if (verbose)
+        pr2serr("%s: mmap() of ring failed: %s\n", __func__,
+                safe_strerror(err));
+err_out:
+    sg_dde_uring_free(urp);
+    errno = err;
+    return NULL;
+}
+
+void
+sg_dde_uring_free(struct sg_dde_uring * urp)
+{
+    if (NULL == urp)
+        return;
+    if (urp->sqes)
+        munmap(urp->sqes, urp->sqes_sz);
+    if (urp->cq_ptr && (urp->cq_ptr != urp->sq_ptr))
+        munmap(urp->cq_ptr, urp->cq_sz);
+    if (urp->sq_ptr)
+        munmap(urp->sq_ptr, urp->sq_sz);
+    if (urp->ring_fd >= 0)
+        close(urp->ring_fd);        /* drops registered files and buffers */
+    free(urp->bufs);
+    free(urp);
+}
+
+/* Fills the next SQE for iop, which is element idx of the caller's array */
+static void
+dde_uring_prep(struct sg_dde_uring * urp, const struct sg_dde_uring_io * iop,
+               int idx)
+{
+    int k;
+    uint32_t tail = *urp->sq_tail;
+    uint32_t slot = tail & *urp->sq_mask;
+    struct io_uring_sqe * sqep = urp->sqes + slot;
+
+    memset(sqep, 0, sizeof(*sqep));
+    sqep->opcode = iop->write_true ? IORING_OP_WRITE : IORING_OP_READ;
+    sqep->fd = iop->fd;
+    for (k = 0; k < urp->num_fds; ++k) {
+        if (iop->fd == urp->fds[k]) {
+            sqep->fd = k;
+            sqep->flags |= IOSQE_FIXED_FILE;
+            break;
+        }
+    }
+    /* buffers may be swapped around by the caller, so look for it */
+    for (k = 0; k < urp->num_bufs; ++k) {
+        if ((iop->bp >= urp->bufs[k]) &&
+            ((iop->bp + iop->len) <= (urp->bufs[k] + urp->buf_len))) {
+            sqep->opcode = iop->write_true ? IORING_OP_WRITE_FIXED :
+                                             IORING_OP_READ_FIXED;
+            sqep->buf_index = k;
+            break;
+        }
+    }
+    sqep->off = (uint64_t)iop->off;
+    sqep->addr = (uint64_t)(sg_uintptr_t)iop->bp;
+    sqep->len = iop->len;
+    sqep->user_data = (uint64_t)idx;
+    urp->sq_array[slot] = slot;
+    __atomic_store_n(urp->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+int
+sg_dde_uring_rw(struct sg_dde_uring * urp, struct sg_dde_uring_io * io_arr,
+                int n)
+{
+    int k, m, res, done;
+    uint32_t head, tail;
+    const struct io_uring_cqe * cqep;
+
+    for (k = 0; k < n; k += m) {
+        m = n - k;
+        if (m > (int)urp->sq_entries)
+            m = (int)urp->sq_entries;
+        for (done = 0; done < m; ++done)
+            dde_uring_prep(urp, io_arr + k + done, k + done);
+        res = dde_uring_enter(urp->ring_fd, m, m);
+        if (res < 0)
+            return res;
+        for (done = 0; done < m; ) {
+            head = *urp->cq_head;
+            tail = __atomic_load_n(urp->cq_tail, __ATOMIC_ACQUIRE);
+            if (head == tail) {
+                res = dde_uring_enter(urp->ring_fd, 0, m - done);
+                if (res < 0)
+                    return res;
+                continue;
+            }
+            for ( ; head != tail; ++head, ++done) {
+                cqep = urp->cqes + (head & *urp->cq_mask);
+                io_arr[cqep->user_data].res = cqep->res;
+            }
+            __atomic_store_n(urp->cq_head, head, __ATOMIC_RELEASE);
+        }
+    }
+    return 0;
+}
+
+#else
+
+struct sg_dde_uring *
+sg_dde_uring_new(int entries, const int * fd_arr, int num_fds,
+                 uint8_t * const * buf_arr, int num_bufs, int buf_len,
+                 int verbose)
+{
+    if (entries || fd_arr || num_fds || buf_arr || num_bufs || buf_len ||
+        verbose) { ; }  /* suppress warnings */
+    errno = ENOSYS;
+    return NULL;
+}
+
+void
+sg_dde_uring_free(struct sg_dde_uring * urp)
+{
+    if (urp) { ; }      /* suppress warning */
+}
+
+int
+sg_dde_uring_rw(struct sg_dde_uring * urp, struct sg_dde_uring_io * io_arr,
+                int n)
+{
+    if (urp || io_arr || n) { ; }       /* suppress warnings */
+    return -ENOSYS;
+}
+
+#endif
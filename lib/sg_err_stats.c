@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/* sg_err_stats version 1.00 20261014 */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "sg_lib.h"
+#include "sg_err_stats.h"
+#include "sg_pr2serr.h"
+
+
+void
+sg_err_stats_merge(struct sg_err_stats * dstp,
+                   const struct sg_err_stats * srcp)
+{
+    int k;
+
+    dstp->cmds += SG_ERR_STATS_LD(srcp->cmds);
+    dstp->retries += SG_ERR_STATS_LD(srcp->retries);
+    for (k = 0; k < SG_ERR_STATS_NUM_CAT; ++k)
+        dstp->cat[k] += SG_ERR_STATS_LD(srcp->cat[k]);
+    for (k = 0; k < SG_ERR_STATS_NUM_ERRNO; ++k)
+        dstp->os_err[k] += SG_ERR_STATS_LD(srcp->os_err[k]);
+}
+
+uint64_t
+sg_err_stats_num_bad(const struct sg_err_stats * esp)
+{
+    int k;
+    uint64_t n = 0;
+
+    for (k = 1; k < SG_ERR_STATS_NUM_CAT; ++k) {
+        if ((SG_LIB_CAT_RECOVERED != k) && (SG_LIB_CAT_NO_SENSE != k))
+            n += esp->cat[k];
+    }
+    return n;
+}
+
+void
+sg_err_stats_pr(const struct sg_err_stats * esp, const char * leadin)
+{
+    int k;
+    const char * lip = leadin ? leadin : "";
+    char b[144];
+
+    if (esp->retries > 0)
+        pr2serr("%s%" PRIu64 " retries attempted\n", lip, esp->retries);
+    for (k = 1; k < SG_ERR_STATS_NUM_CAT; ++k) {
+        if (0 == esp->cat[k])
+            continue;
+        pr2serr("%s%" PRIu64 " x %s [category %d]\n", lip, esp->cat[k],
+                sg_get_category_sense_str(k, sizeof(b), b, 0), k);
+    }
+    for (k = 1; k < SG_ERR_STATS_NUM_ERRNO; ++k) {
+        if (0 == esp->os_err[k])
+            continue;
+        pr2serr("%s%" PRIu64 " x %s [errno %d%s]\n", lip, esp->os_err[k],
+                safe_strerror(k), k,
+                ((SG_ERR_STATS_NUM_ERRNO - 1) == k) ? " or more" : "");
+    }
+}
+
+sgj_opaque_p
+sg_err_stats_js(sgj_state * jsp, sgj_opaque_p jop, const char * name,
+                const struct sg_err_stats * esp)
+{
+    int k;
+    sgj_opaque_p jo2p, jo3p, jap;
+    char b[144];
+
+    if ((NULL == jsp) || (! jsp->pr_as_json))
+        return NULL;
+    jo2p = sgj_named_subobject_r(jsp, jop, name);
+    sgj_js_nv_i(jsp, jo2p, "commands", (int64_t)esp->cmds);
+    sgj_js_nv_i(jsp, jo2p, "good", (int64_t)esp->cat[0]);
+    sgj_js_nv_i(jsp, jo2p, "retries", (int64_t)esp->retries);
+    jap = sgj_named_subarray_r(jsp, jo2p, "sense_category_list");
+    for (k = 1; k < SG_ERR_STATS_NUM_CAT; ++k) {
+        if (0 == esp->cat[k])
+            continue;
+        jo3p = sgj_new_unattached_object_r(jsp);
+        sgj_js_nv_i(jsp, jo3p, "category", k);
+        sgj_js_nv_s(jsp, jo3p, "name",
+                    sg_get_category_sense_str(k, sizeof(b), b, 0));
+        sgj_js_nv_i(jsp, jo3p, "count", (int64_t)esp->cat[k]);
+        sgj_js_nv_o(jsp, jap, NULL /* name */, jo3p);
+    }
+    jap = sgj_named_subarray_r(jsp, jo2p, "os_errno_list");
+    for (k = 1; k < SG_ERR_STATS_NUM_ERRNO; ++k) {
+        if (0 == esp->os_err[k])
+            continue;
+        jo3p = sgj_new_unattached_object_r(jsp);
+        sgj_js_nv_i(jsp, jo3p, "errno", k);
+        sgj_js_nv_s(jsp, jo3p, "name", safe_strerror(k));
+        sgj_js_nv_i(jsp, jo3p, "count", (int64_t)esp->os_err[k]);
+        sgj_js_nv_o(jsp, jap, NULL /* name */, jo3p);
+    }
+    return jo2p;
+}
@@ -0,0 +1,313 @@
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/* sg_geom version 1.00 20261015 */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#ifndef SG_LIB_WIN32
+#define SG_GEOM_THREADS 1
+#include <pthread.h>
+#endif
+
+#include "sg_lib.h"
+#include "sg_cmds_basic.h"
+#include "sg_unaligned.h"
+#include "sg_geom.h"
+#include "sg_pr2serr.h"
+
+#define GEOM_MAX_FDS 16
+#define RCAP10_RESP_LEN 8
+#define RCAP16_RESP_LEN 32
+#define VPD_BLOCK_LIMITS 0xb0
+#define VPD_LB_PROVISIONING 0xb2
+
+/* which parts of an entry have been fetched (or tried) */
+#define GEOM_HAVE_RC 0x1
+#define GEOM_TRIED_BL 0x2
+#define GEOM_TRIED_LBP 0x4
+#define GEOM_TRIED_RC16 0x8
+
+struct geom_ent {
+    int sg_fd;          /* -1 when the entry is free */
+    int have;           /* GEOM_HAVE_RC and friends */
+    dev_t rdev;         /* to notice sg_fd now being another device */
+    ino_t ino;
+    struct sg_geom g;
+};
+
+static struct geom_ent geom_tbl[GEOM_MAX_FDS];
+static bool geom_tbl_init;
+#ifdef SG_GEOM_THREADS
+static pthread_mutex_t geom_mtx = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+
+static void
+geom_lock(void)
+{
+#ifdef SG_GEOM_THREADS
+    pthread_mutex_lock(&geom_mtx);
+#endif
+    if (! geom_tbl_init) {
+        int k;
+
+        for (k = 0; k < GEOM_MAX_FDS; ++k)
+            geom_tbl[k].sg_fd = -1;
+        geom_tbl_init = true;
+    }
+}
+
+static void
+geom_unlock(void)
+{
+#ifdef SG_GEOM_THREADS
+    pthread_mutex_unlock(&geom_mtx);
+#endif
+}
+
+/* Returns the entry for sg_fd, or NULL. Called with the lock held. */
+static struct geom_ent *
+geom_find(int sg_fd, const struct stat * stp)
+{
+    int k;
+    struct geom_ent * ep;
+
+    for (k = 0, ep = geom_tbl; k < GEOM_MAX_FDS; ++k, ++ep) {
+        if (sg_fd != ep->sg_fd)
+            continue;
+        if ((stp->st_rdev == ep->rdev) && (stp->st_ino == ep->ino))
+            return ep;
+        ep->sg_fd = -1;         /* closed and reused for another device */
+        return NULL;
+    }
+    return NULL;
+}
+
+/* Keeps a copy of *gp for sg_fd, replacing the least useful entry when
+ * the table is full. Called with the lock held. */
+static void
+geom_save(int sg_fd, const struct stat * stp, int have,
+          const struct sg_geom * gp)
+{
+    int k;
+    struct geom_ent * ep = geom_find(sg_fd, stp);
+
+    for (k = 0; (NULL == ep) && (k < GEOM_MAX_FDS); ++k) {
+        if (geom_tbl[k].sg_fd < 0)
+            ep = geom_tbl + k;
+    }
+    if (NULL == ep)
+        ep = geom_tbl + (sg_fd % GEOM_MAX_FDS);
+    ep->sg_fd = sg_fd;
+    ep->rdev = stp->st_rdev;
+    ep->ino = stp->st_ino;
+    ep->have = have;
+    ep->g = *gp;
+}
+
+static void
+geom_rc16_decode(const uint8_t * bp, struct sg_geom * gp)
+{
+    gp->rc16 = true;
+    gp->num_blks = sg_get_unaligned_be64(bp + 0) + 1;
+    gp->blk_sz = sg_get_unaligned_be32(bp + 8);
+    gp->prot_en = !! (0x1 & bp[12]);
+    gp->prot_type = gp->prot_en ? (((bp[12] >> 1) & 0x7) + 1) : 0;
+    gp->p_i_exp = (bp[13] >> 4) & 0xf;
+    gp->lbppbe = bp[13] & 0xf;
+    gp->lbpme = !! (0x80 & bp[14]);
+    gp->lbprz = !! (0x40 & bp[14]);
+    gp->lowest_aligned = sg_get_unaligned_be16(bp + 14) & 0x3fff;
+}
+
+static int
+geom_rc16(int sg_fd, struct sg_geom * gp, int * havep, bool noisy, int vb)
+{
+    int res;
+    uint8_t b[RCAP16_RESP_LEN];
+
+    *havep |= GEOM_TRIED_RC16;
+    res = sg_ll_readcap_16(sg_fd, false, 0, b, RCAP16_RESP_LEN, noisy, vb);
+    if (SG_LIB_CAT_UNIT_ATTENTION == res)
+        res = sg_ll_readcap_16(sg_fd, false, 0, b, RCAP16_RESP_LEN, noisy,
+                               vb);
+    if (0 == res)
+        geom_rc16_decode(b, gp);
+    return res;
+}
+
+/* READ CAPACITY(16), falling back to (10); or with rc10_first the other
+ * way around. Returns 0 or the SG_LIB_CAT_* value of the failing
+ * command. */
+static int
+geom_rcap(int sg_fd, bool rc10_first, struct sg_geom * gp, int * havep,
+          bool noisy, int vb)
+{
+    int res;
+    uint8_t b[RCAP10_RESP_LEN];
+    char e[80];
+
+    if (! rc10_first) {
+        res = geom_rc16(sg_fd, gp, havep, noisy, vb);
+        if ((SG_LIB_CAT_INVALID_OP != res) && (SG_LIB_CAT_ILLEGAL_REQ != res))
+            goto fini;
+        if (vb)
+            pr2serr("READ CAPACITY(16) not supported, trying READ "
+                    "CAPACITY(10)\n");
+    }
+    res = sg_ll_readcap_10(sg_fd, false, 0, b, RCAP10_RESP_LEN, noisy, vb);
+    if (SG_LIB_CAT_UNIT_ATTENTION == res)
+        res = sg_ll_readcap_10(sg_fd, false, 0, b, RCAP10_RESP_LEN, noisy,
+                               vb);
+    if (0 != res)
+        goto fini;
+    if (0xffffffff == sg_get_unaligned_be32(b + 0)) {
+        if (! rc10_first) {
+            res = SG_LIB_CAT_MALFORMED; /* 16 failed, 10 says to use it */
+            goto fini;
+        }
+        res = geom_rc16(sg_fd, gp, havep, noisy, vb);
+        goto fini;
+    }
+    gp->rc16 = false;
+    gp->num_blks = (uint64_t)sg_get_unaligned_be32(b + 0) + 1;
+    gp->blk_sz = sg_get_unaligned_be32(b + 4);
+fini:
+    if (res && noisy) {
+        sg_get_category_sense_str(res, sizeof(e), e, vb);
+        pr2serr("READ CAPACITY: %s\n", e);
+    }
+    return res;
+}
+
+static void
+geom_bl(int sg_fd, struct sg_geom * gp, int vb)
+{
+    int len;
+    uint8_t b[64];
+
+    if (sg_ll_inquiry(sg_fd, false, true, VPD_BLOCK_LIMITS, b, sizeof(b),
+                      false, vb) || (VPD_BLOCK_LIMITS != b[1]))
+        return;
+    len = sg_get_unaligned_be16(b + 2);
+    if (len < 0xc)
+        return;
+    gp->opt_xfer_gran = sg_get_unaligned_be16(b + 6);
+    gp->max_xfer_len = sg_get_unaligned_be32(b + 8);
+    gp->opt_xfer_len = sg_get_unaligned_be32(b + 12);
+    if (len < 0x3c)     /* SBC-2 length, no unmap fields */
+        return;
+    gp->have_bl = true;
+    gp->max_unmap_lba_cnt = sg_get_unaligned_be32(b + 20);
+    gp->max_unmap_desc_cnt = sg_get_unaligned_be32(b + 24);
+    gp->unmap_gran = sg_get_unaligned_be32(b + 28);
+    gp->ugavalid = !! (0x80 & b[32]);
+    gp->unmap_align = sg_get_unaligned_be32(b + 32) & 0x7fffffff;
+    gp->max_ws_len = sg_get_unaligned_be64(b + 36);
+}
+
+static void
+geom_lbp(int sg_fd, struct sg_geom * gp, int vb)
+{
+    uint8_t b[8];
+
+    if (sg_ll_inquiry(sg_fd, false, true, VPD_LB_PROVISIONING, b, sizeof(b),
+                      false, vb) || (VPD_LB_PROVISIONING != b[1]))
+        return;
+    gp->have_lbp = true;
+    gp->lbpu = !! (0x80 & b[5]);
+    gp->lbpws = !! (0x40 & b[5]);
+    gp->lbpws10 = !! (0x20 & b[5]);
+    gp->prov_type = b[6] & 0x7;
+}
+
+int
+sg_geom_get(int sg_fd, int flags, struct sg_geom * gp, bool noisy,
+            int verbose)
+{
+    bool keep;
+    int res;
+    int have = 0;
+    struct stat st;
+    struct geom_ent * ep;
+
+    memset(gp, 0, sizeof(*gp));
+    /* without something to tell devices apart, fetch each time */
+    keep = (sg_fd >= 0) && (0 == fstat(sg_fd, &st));
+    if (keep) {
+        geom_lock();
+        ep = geom_find(sg_fd, &st);
+        if (ep && (SG_GEOM_REFRESH & flags))
+            ep->sg_fd = -1;
+        else if (ep) {
+            have = ep->have;
+            *gp = ep->g;
+        }
+        geom_unlock();
+    }
+    if (! (GEOM_HAVE_RC & have)) {
+        res = geom_rcap(sg_fd, !! (SG_GEOM_RC10_FIRST & flags), gp, &have,
+                        noisy, verbose);
+        if (res)
+            return res;
+        have |= GEOM_HAVE_RC;
+    } else if ((! gp->rc16) && (! (SG_GEOM_RC10_FIRST & flags)) &&
+               (! (GEOM_TRIED_RC16 & have))) {
+        /* held from READ CAPACITY(10) which lacks protection and
+         * provisioning fields; a failure here changes nothing */
+        struct sg_geom g = *gp;
+
+        if (0 == geom_rc16(sg_fd, &g, &have, false, verbose))
+            *gp = g;
+    } else if (verbose > 1)
+        pr2serr("%s: READ CAPACITY response held for fd=%d\n", __func__,
+                sg_fd);
+    if ((SG_GEOM_BL & flags) && (! (GEOM_TRIED_BL & have))) {
+        geom_bl(sg_fd, gp, verbose);
+        have |= GEOM_TRIED_BL;
+    }
+    if ((SG_GEOM_LBP & flags) && (! (GEOM_TRIED_LBP & have))) {
+        geom_lbp(sg_fd, gp, verbose);
+        have |= GEOM_TRIED_LBP;
+    }
+    if (keep) {
+        geom_lock();
+        geom_save(sg_fd, &st, have, gp);
+        geom_unlock();
+    }
+    if (verbose > 2)
+        pr2serr("%s: fd=%d: %" PRIu64 " blocks of %u bytes, prot_type=%d, "
+                "lbpme=%d\n", __func__, sg_fd, gp->num_blks, gp->blk_sz,
+                gp->prot_type, (int)gp->lbpme);
+    return 0;
+}
+
+void
+sg_geom_forget(int sg_fd)
+{
+    int k;
+
+    geom_lock();
+    for (k = 0; k < GEOM_MAX_FDS; ++k) {
+        if (sg_fd == geom_tbl[k].sg_fd)
+            geom_tbl[k].sg_fd = -1;
+    }
+    geom_unlock();
+}
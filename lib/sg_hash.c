@@ -0,0 +1,478 @@
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/* sg_hash version 1.00 20261014 */
+
+/* Streaming CRC32C, XXH64 and SHA-256 digests for the dd family of
+ * utilities. They are computed in place on the transfer buffers so that
+ * fingerprinting a copy does not need another pass over the data (e.g.
+ * through a pipe to sha256sum). On x86_64 CRC32C uses the SSE4.2 crc32
+ * instruction when the CPU has it, otherwise (and on other architectures)
+ * a slice-by-8 table is used. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "sg_hash.h"
+#include "sg_unaligned.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define SG_HASH_X86_CRC 1
+#include <nmmintrin.h>
+#endif
+
+
+static const char * const hash_names[] = {"none", "crc32c", "xxh64",
+                                          "sha256"};
+
+int
+sg_hash_alg_from_name(const char * name)
+{
+    int k;
+
+    if (NULL == name)
+        return -1;
+    for (k = SG_HASH_CRC32C; k <= SG_HASH_SHA256; ++k) {
+        if (0 == strcmp(name, hash_names[k]))
+            return k;
+    }
+    if (0 == strcmp(name, "sha-256"))
+        return SG_HASH_SHA256;
+    if ((0 == strcmp(name, "xxhash")) || (0 == strcmp(name, "xxh")))
+        return SG_HASH_XXH64;
+    return -1;
+}
+
+const char *
+sg_hash_alg_name(int alg)
+{
+    if ((alg < SG_HASH_CRC32C) || (alg > SG_HASH_SHA256))
+        return NULL;
+    return hash_names[alg];
+}
+
+int
+sg_hash_digest_len(int alg)
+{
+    switch (alg) {
+    case SG_HASH_CRC32C:
+        return 4;
+    case SG_HASH_XXH64:
+        return 8;
+    case SG_HASH_SHA256:
+        return 32;
+    default:
+        return 0;
+    }
+}
+
+/* ------------------------------ CRC32C ------------------------------ */
+
+#define CRC32C_POLY 0x82f63b78  /* reflected 0x1edc6f41 */
+
+static uint32_t crc32c_tbl[8][256];
+static bool crc32c_tbl_built;
+static int crc32c_hw = -1;      /* -1: not checked yet */
+
+static void
+crc32c_build(void)
+{
+    int j, k;
+    uint32_t c;
+
+    for (k = 0; k < 256; ++k) {
+        c = k;
+        for (j = 0; j < 8; ++j)
+            c = (c & 1) ? ((c >> 1) ^ CRC32C_POLY) : (c >> 1);
+        crc32c_tbl[0][k] = c;
+    }
+    for (k = 0; k < 256; ++k) {
+        c = crc32c_tbl[0][k];
+        for (j = 1; j < 8; ++j) {
+            c = crc32c_tbl[0][c & 0xff] ^ (c >> 8);
+            crc32c_tbl[j][k] = c;
+        }
+    }
+    crc32c_tbl_built = true;
+}
+
+static uint32_t
+crc32c_sw(uint32_t crc, const uint8_t * bp, size_t len)
+{
+    uint64_t v;
+
+    for ( ; len && ((uintptr_t)bp & 7); --len)
+        crc = crc32c_tbl[0][(crc ^ *bp++) & 0xff] ^ (crc >> 8);
+    for ( ; len >= 8; len -= 8, bp += 8) {
+        v = sg_get_unaligned_le64(bp) ^ crc;
+        crc = crc32c_tbl[7][v & 0xff] ^
+              crc32c_tbl[6][(v >> 8) & 0xff] ^
+              crc32c_tbl[5][(v >> 16) & 0xff] ^
+              crc32c_tbl[4][(v >> 24) & 0xff] ^
+              crc32c_tbl[3][(v >> 32) & 0xff] ^
+              crc32c_tbl[2][(v >> 40) & 0xff] ^
+              crc32c_tbl[1][(v >> 48) & 0xff] ^
+              crc32c_tbl[0][v >> 56];
+    }
+    while (len--)
+        crc = crc32c_tbl[0][(crc ^ *bp++) & 0xff] ^ (crc >> 8);
+    return crc;
+}
+
+#ifdef SG_HASH_X86_CRC
+__attribute__((target("sse4.2")))
+static uint32_t
+crc32c_x86(uint32_t crc, const uint8_t * bp, size_t len)
+{
+    uint64_t c = crc;
+
+    for ( ; len && ((uintptr_t)bp & 7); --len)
+        c = _mm_crc32_u8((uint32_t)c, *bp++);
+    for ( ; len >= 8; len -= 8, bp += 8)
+        c = _mm_crc32_u64(c, sg_get_unaligned_le64(bp));
+    while (len--)
+        c = _mm_crc32_u8((uint32_t)c, *bp++);
+    return (uint32_t)c;
+}
+#endif
+
+bool
+sg_hash_crc32c_hw(void)
+{
+    if (crc32c_hw < 0) {
+#ifdef SG_HASH_X86_CRC
+        __builtin_cpu_init();
+        crc32c_hw = !! __builtin_cpu_supports("sse4.2");
+#else
+        crc32c_hw = 0;
+#endif
+    }
+    return !! crc32c_hw;
+}
+
+/* ------------------------------ XXH64 ------------------------------- */
+
+#define XXH_P1 0x9e3779b185ebca87ULL
+#define XXH_P2 0xc2b2ae3d27d4eb4fULL
+#define XXH_P3 0x165667b19e3779f9ULL
+#define XXH_P4 0x85ebca77c2b2ae63ULL
+#define XXH_P5 0x27d4eb2f165667c5ULL
+
+static inline uint64_t
+xxh_rotl(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t
+xxh_round(uint64_t acc, uint64_t in)
+{
+    acc += in * XXH_P2;
+    acc = xxh_rotl(acc, 31);
+    return acc * XXH_P1;
+}
+
+static inline uint64_t
+xxh_merge(uint64_t acc, uint64_t v)
+{
+    acc ^= xxh_round(0, v);
+    return acc * XXH_P1 + XXH_P4;
+}
+
+static void
+xxh_stripes(uint64_t * v, const uint8_t * bp, size_t n_stripes)
+{
+    uint64_t v0 = v[0], v1 = v[1], v2 = v[2], v3 = v[3];
+
+    for ( ; n_stripes > 0; --n_stripes, bp += 32) {
+        v0 = xxh_round(v0, sg_get_unaligned_le64(bp));
+        v1 = xxh_round(v1, sg_get_unaligned_le64(bp + 8));
+        v2 = xxh_round(v2, sg_get_unaligned_le64(bp + 16));
+        v3 = xxh_round(v3, sg_get_unaligned_le64(bp + 24));
+    }
+    v[0] = v0;
+    v[1] = v1;
+    v[2] = v2;
+    v[3] = v3;
+}
+
+static uint64_t
+xxh_final(struct sg_hash_ctx * hcp)
+{
+    const uint64_t * v = hcp->u.xv;
+    const uint8_t * bp = hcp->buf;
+    uint32_t n = hcp->blen;
+    uint64_t h;
+
+    if (hcp->total >= 32) {
+        h = xxh_rotl(v[0], 1) + xxh_rotl(v[1], 7) + xxh_rotl(v[2], 12) +
+            xxh_rotl(v[3], 18);
+        h = xxh_merge(h, v[0]);
+        h = xxh_merge(h, v[1]);
+        h = xxh_merge(h, v[2]);
+        h = xxh_merge(h, v[3]);
+    } else
+        h = XXH_P5;     /* seed is 0 */
+    h += hcp->total;
+    for ( ; n >= 8; n -= 8, bp += 8) {
+        h ^= xxh_round(0, sg_get_unaligned_le64(bp));
+        h = xxh_rotl(h, 27) * XXH_P1 + XXH_P4;
+    }
+    if (n >= 4) {
+        h ^= (uint64_t)sg_get_unaligned_le32(bp) * XXH_P1;
+        h = xxh_rotl(h, 23) * XXH_P2 + XXH_P3;
+        n -= 4;
+        bp += 4;
+    }
+    for ( ; n > 0; --n, ++bp) {
+        h ^= (*bp) * XXH_P5;
+        h = xxh_rotl(h, 11) * XXH_P1;
+    }
+    h ^= h >> 33;
+    h *= XXH_P2;
+    h ^= h >> 29;
+    h *= XXH_P3;
+    h ^= h >> 32;
+    return h;
+}
+
+/* ----------------------------- SHA-256 ------------------------------ */
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static inline uint32_t
+sha_ror(uint32_t x, int r)
+{
+    return (x >> r) | (x << (32 - r));
+}
+
+static void
+sha256_blocks(uint32_t * h, const uint8_t * bp, size_t n_blocks)
+{
+    int k;
+    uint32_t a, b, c, d, e, f, g, hh, t1, t2;
+    uint32_t w[64];
+
+    for ( ; n_blocks > 0; --n_blocks, bp += 64) {
+        for (k = 0; k < 16; ++k)
+            w[k] = sg_get_unaligned_be32(bp + (4 * k));
+        for (k = 16; k < 64; ++k)
+            w[k] = (sha_ror(w[k - 2], 17) ^ sha_ror(w[k - 2], 19) ^
+                    (w[k - 2] >> 10)) + w[k - 7] +
+                   (sha_ror(w[k - 15], 7) ^ sha_ror(w[k - 15], 18) ^
+                    (w[k - 15] >> 3)) + w[k - 16];
+        a = h[0];
+        b = h[1];
+        c = h[2];
+        d = h[3];
+        e = h[4];
+        f = h[5];
+        g = h[6];
+        hh = h[7];
+        for (k = 0; k < 64; ++k) {
+            t1 = hh + (sha_ror(e, 6) ^ sha_ror(e, 11) ^ sha_ror(e, 25)) +
+                 ((e & f) ^ (~e & g)) + sha256_k[k] + w[k];
+            t2 = (sha_ror(a, 2) ^ sha_ror(a, 13) ^ sha_ror(a, 22)) +
+                 ((a & b) ^ (a & c) ^ (b & c));
+            hh = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+        h[5] += f;
+        h[6] += g;
+        h[7] += hh;
+    }
+}
+
+/* ---------------------------- common API ---------------------------- */
+
+void
+sg_hash_init(struct sg_hash_ctx * hcp, int alg)
+{
+    static const uint32_t sha256_iv[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+
+    memset(hcp, 0, sizeof(*hcp));
+    hcp->alg = alg;
+    switch (alg) {
+    case SG_HASH_CRC32C:
+        if ((! sg_hash_crc32c_hw()) && (! crc32c_tbl_built))
+            crc32c_build();
+        hcp->u.crc = 0xffffffff;
+        break;
+    case SG_HASH_XXH64:
+        hcp->u.xv[0] = XXH_P1 + XXH_P2;
+        hcp->u.xv[1] = XXH_P2;
+        hcp->u.xv[2] = 0;
+        hcp->u.xv[3] = 0 - XXH_P1;
+        break;
+    case SG_HASH_SHA256:
+        memcpy(hcp->u.sh, sha256_iv, sizeof(sha256_iv));
+        break;
+    default:
+        hcp->alg = SG_HASH_NONE;
+        break;
+    }
+}
+
+/* Feeds whole blocks of 'bsz' bytes to 'fn', keeping any remainder in
+ * hcp->buf for the next call or sg_hash_final(). */
+static void
+hash_blocked(struct sg_hash_ctx * hcp, const uint8_t * bp, size_t len,
+             uint32_t bsz, void (*fn)(struct sg_hash_ctx *, const uint8_t *,
+                                      size_t))
+{
+    uint32_t n;
+
+    if (hcp->blen > 0) {
+        n = bsz - hcp->blen;
+        if (n > len)
+            n = len;
+        memcpy(hcp->buf + hcp->blen, bp, n);
+        hcp->blen += n;
+        bp += n;
+        len -= n;
+        if (hcp->blen < bsz)
+            return;
+        fn(hcp, hcp->buf, 1);
+        hcp->blen = 0;
+    }
+    if (len >= bsz) {
+        fn(hcp, bp, len / bsz);
+        bp += (len / bsz) * bsz;
+        len %= bsz;
+    }
+    if (len > 0) {
+        memcpy(hcp->buf, bp, len);
+        hcp->blen = len;
+    }
+}
+
+static void
+xxh_fn(struct sg_hash_ctx * hcp, const uint8_t * bp, size_t n)
+{
+    xxh_stripes(hcp->u.xv, bp, n);
+}
+
+static void
+sha_fn(struct sg_hash_ctx * hcp, const uint8_t * bp, size_t n)
+{
+    sha256_blocks(hcp->u.sh, bp, n);
+}
+
+void
+sg_hash_update(struct sg_hash_ctx * hcp, const void * p, size_t len)
+{
+    const uint8_t * bp = (const uint8_t *)p;
+
+    if ((NULL == bp) || (0 == len))
+        return;
+    hcp->total += len;
+    switch (hcp->alg) {
+    case SG_HASH_CRC32C:
+#ifdef SG_HASH_X86_CRC
+        if (crc32c_hw > 0) {
+            hcp->u.crc = crc32c_x86(hcp->u.crc, bp, len);
+            break;
+        }
+#endif
+        hcp->u.crc = crc32c_sw(hcp->u.crc, bp, len);
+        break;
+    case SG_HASH_XXH64:
+        hash_blocked(hcp, bp, len, 32, xxh_fn);
+        break;
+    case SG_HASH_SHA256:
+        hash_blocked(hcp, bp, len, 64, sha_fn);
+        break;
+    default:
+        break;
+    }
+}
+
+int
+sg_hash_final(struct sg_hash_ctx * hcp, uint8_t * digest)
+{
+    int k;
+    uint32_t n;
+    uint64_t bits;
+
+    switch (hcp->alg) {
+    case SG_HASH_CRC32C:
+        sg_put_unaligned_be32(~hcp->u.crc, digest);
+        return 4;
+    case SG_HASH_XXH64:
+        sg_put_unaligned_be64(xxh_final(hcp), digest);
+        return 8;
+    case SG_HASH_SHA256:
+        bits = hcp->total << 3;
+        n = hcp->blen;
+        hcp->buf[n++] = 0x80;
+        if (n > 56) {
+            memset(hcp->buf + n, 0, 64 - n);
+            sha256_blocks(hcp->u.sh, hcp->buf, 1);
+            n = 0;
+        }
+        memset(hcp->buf + n, 0, 56 - n);
+        sg_put_unaligned_be64(bits, hcp->buf + 56);
+        sha256_blocks(hcp->u.sh, hcp->buf, 1);
+        for (k = 0; k < 8; ++k)
+            sg_put_unaligned_be32(hcp->u.sh[k], digest + (4 * k));
+        return 32;
+    default:
+        return 0;
+    }
+}
+
+int
+sg_hash_hex(const uint8_t * digest, int dlen, char * b, int blen)
+{
+    static const char * const hexd = "0123456789abcdef";
+    int k;
+
+    if (blen < 1)
+        return 0;
+    if ((2 * dlen) >= blen)
+        dlen = (blen - 1) / 2;
+    for (k = 0; k < dlen; ++k) {
+        b[2 * k] = hexd[digest[k] >> 4];
+        b[(2 * k) + 1] = hexd[digest[k] & 0xf];
+    }
+    b[2 * dlen] = '\0';
+    return 2 * dlen;
+}
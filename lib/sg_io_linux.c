@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 1999-2021 Douglas Gilbert.
+ * Copyright (c) 1999-2026 Douglas Gilbert.
  * All rights reserved.
  * Use of this source code is governed by a BSD-style
  * license that can be found in the BSD_LICENSE file.
@@ -13,6 +13,8 @@
 #include <stdbool.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -20,11 +22,25 @@
 
 #ifdef SG_LIB_LINUX
 
+#include <pthread.h>
+#include <sys/syscall.h>
+#ifdef HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>
+#endif
+
 #include "sg_io_linux.h"
 #include "sg_pr2serr.h"
 
 
-/* Version 1.13 20210831 */
+/* Version 1.14 20261015 */
+
+#define SG_LIN_PROC_DEVICES "/proc/devices"
+#define SG_LIN_PROC_SG_VERSION "/proc/scsi/sg/version"
+#define SG_LIN_SYS_SG_VERSION "/sys/module/sg/version"
+
+static struct sg_linux_caps sg_lin_caps;
+static bool sg_lin_caps_ok;
+static pthread_mutex_t sg_lin_caps_mtx = PTHREAD_MUTEX_INITIALIZER;
 
 
 void
@@ -232,4 +248,123 @@ sg_err_category_new(int scsi_status, int host_status, int driver_status,
     return SG_LIB_CAT_OTHER;
 }
 
+/* Finds the char device majors of bsg, nvme and nvme-generic in
+ * /proc/devices and places them in *cp. */
+static void
+caps_find_majors(struct sg_linux_caps * cp, int vb)
+{
+    int n;
+    char * lp;
+    FILE * fp;
+    char a[128];
+    char b[128];
+
+    if (NULL == (fp = fopen(SG_LIN_PROC_DEVICES, "r"))) {
+        if (vb)
+            pr2ws("fopen %s failed: %s\n", SG_LIN_PROC_DEVICES,
+                  strerror(errno));
+        return;
+    }
+    while ((lp = fgets(b, sizeof(b), fp))) {
+        if ((1 == sscanf(b, "%126s", a)) &&
+            (0 == memcmp(a, "Character", 9)))
+            break;
+    }
+    while (lp && (lp = fgets(b, sizeof(b), fp))) {
+        if (2 != sscanf(b, "%d %126s", &n, a))
+            break;      /* blank line before "Block devices:" */
+        if (0 == strcmp("bsg", a))
+            cp->bsg_major = n;
+        else if (0 == strcmp("nvme-generic", a))
+            cp->nvme_gen_major = n;
+        else if (0 == strcmp("nvme", a))
+            cp->nvme_major = n;
+    }
+    fclose(fp);
+}
+
+/* The sg driver version from procfs or, failing that, sysfs; 0 if the sg
+ * driver is not loaded. */
+static int
+caps_sg_version(void)
+{
+    int j, k, l;
+    int ver = 0;
+    FILE * fp;
+    char b[96];
+
+    if ((fp = fopen(SG_LIN_PROC_SG_VERSION, "r"))) {
+        if (! (fgets(b, sizeof(b), fp) && (1 == sscanf(b, "%d", &ver))))
+            ver = 0;
+        fclose(fp);
+    } else if ((fp = fopen(SG_LIN_SYS_SG_VERSION, "r"))) {
+        if (fgets(b, sizeof(b), fp) &&
+            (3 == sscanf(b, "%d.%d.%d", &j, &k, &l)))
+            ver = (j * 10000) + (k * 100) + l;
+        fclose(fp);
+    }
+    return (ver > 0) ? ver : 0;
+}
+
+/* Sets up, and immediately closes, a one entry io_uring */
+static bool
+caps_uring_works(int vb)
+{
+#if defined(HAVE_LINUX_IO_URING_H) && defined(__NR_io_uring_setup)
+    int fd;
+    struct io_uring_params p;
+
+    memset(&p, 0, sizeof(p));
+    fd = (int)syscall(__NR_io_uring_setup, 1, &p);
+    if (fd < 0) {
+        if (vb > 3)
+            pr2ws("%s: io_uring_setup() failed: %s\n", __func__,
+                  strerror(errno));
+        return false;
+    }
+    close(fd);
+    return true;
+#else
+    if (vb) { }
+    return false;
+#endif
+}
+
+const struct sg_linux_caps *
+sg_linux_get_caps(int verbose)
+{
+    struct sg_linux_caps c;
+    struct sg_linux_caps * cp = &c;
+
+    pthread_mutex_lock(&sg_lin_caps_mtx);
+    if (! sg_lin_caps_ok) {
+        memset(cp, 0, sizeof(*cp));
+        cp->page_size = sysconf(_SC_PAGESIZE);
+        if (cp->page_size <= 0)
+            cp->page_size = 4096;
+        caps_find_majors(cp, verbose);
+        cp->sg_version = caps_sg_version();
+        cp->sg_v4 = (cp->sg_version >= SG_LINUX_CAPS_SG_V4);
+        cp->sg_v4_mrq = (cp->sg_version >= SG_LINUX_CAPS_SG_V4_MRQ);
+        cp->uring = caps_uring_works(verbose);
+        if (verbose > 3)
+            pr2ws("%s: bsg_major=%d, nvme_major=%d, nvme_gen_major=%d, "
+                  "sg_version=%d, io_uring %savailable\n", __func__,
+                  cp->bsg_major, cp->nvme_major, cp->nvme_gen_major,
+                  cp->sg_version, cp->uring ? "" : "not ");
+        sg_lin_caps = c;        /* no zeroed window after a reset */
+        sg_lin_caps_ok = true;
+    }
+    pthread_mutex_unlock(&sg_lin_caps_mtx);
+    return &sg_lin_caps;
+}
+
+void
+sg_linux_caps_reset(void)
+{
+    pthread_mutex_lock(&sg_lin_caps_mtx);
+    sg_lin_caps_ok = false;
+    pthread_mutex_unlock(&sg_lin_caps_mtx);
+}
+
 #endif  /* if SG_LIB_LINUX defined */
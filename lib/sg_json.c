@@ -23,6 +23,8 @@
 
 #define sgj_opts_ev "SG3_UTILS_JSON_OPTS"
 
+#define SGJ_HR_BUF_SZ (64 * 1024)       /* stdout buffer when not a tty */
+
 /*
  * #define json_serialize_mode_multiline     0
  * #define json_serialize_mode_single_line   1
@@ -44,6 +46,73 @@ static const json_serialize_opts def_out_settings = {
 
 static int sgj_name_to_snake(const char * in, char * out, int maxlen_out);
 
+/* Snake names memo, one per sgj_state. Decoders mostly pass the same
+ * string literals as names, element after element, so each slot is keyed
+ * by the address of the name. A buffer reused for different names is
+ * caught by also comparing the name with the copy kept in the slot.
+ * Direct mapped: a collision just converts again and takes the slot. */
+#define SGJ_SNAKE_MEMO_SZ 256           /* power of 2 */
+#define SGJ_SNAKE_MEMO_LEN 96           /* longer names are not kept */
+
+struct sgj_snake_ent {
+    const char * key;                   /* NULL when slot is empty */
+    char name[SGJ_SNAKE_MEMO_LEN];
+    char sname[SGJ_SNAKE_MEMO_LEN];
+};
+
+struct sgj_snake_memo {
+    struct sgj_snake_ent ent[SGJ_SNAKE_MEMO_SZ];
+};
+
+static void
+sgj_arena_release(sgj_state * jsp)
+{
+    json_arena * ap = (json_arena *)jsp->arenap;
+    json_arena * prevp;
+
+    if (ap) {
+        prevp = json_arena_use(NULL);
+        if (prevp != ap)
+            json_arena_use(prevp);
+        json_arena_free(ap);
+        jsp->arenap = NULL;
+    }
+}
+
+/* Returns the snake name of 'in', from jsp's memo when it is there,
+ * otherwise it is converted and kept in the memo. Falls back to
+ * converting into 'out' (of maxlen_out bytes) when 'in' is too long for
+ * the memo or the memo can't be allocated. */
+static const char *
+sgj_snake(sgj_state * jsp, const char * in, char * out, int maxlen_out)
+{
+    uintptr_t u = (uintptr_t)in;
+    size_t len;
+    struct sgj_snake_ent * ep;
+    struct sgj_snake_memo * mp;
+
+    mp = jsp ? (struct sgj_snake_memo *)jsp->snake_memop : NULL;
+    if ((NULL == mp) && jsp) {
+        mp = (struct sgj_snake_memo *)calloc(1, sizeof(*mp));
+        jsp->snake_memop = mp;
+    }
+    if (NULL == mp)
+        goto no_memo;
+    ep = mp->ent + (((u >> 4) ^ (u >> 12)) & (SGJ_SNAKE_MEMO_SZ - 1));
+    if ((ep->key == in) && (0 == strcmp(ep->name, in)))
+        return ep->sname;
+    len = strlen(in);
+    if (len >= SGJ_SNAKE_MEMO_LEN)
+        goto no_memo;
+    memcpy(ep->name, in, len + 1);
+    sgj_name_to_snake(in, ep->sname, SGJ_SNAKE_MEMO_LEN);
+    ep->key = in;
+    return ep->sname;
+no_memo:
+    sgj_name_to_snake(in, out, maxlen_out);
+    return out;
+}
+
 
 static bool
 sgj_parse_opts(sgj_state * jsp, const char * j_optarg)
@@ -86,6 +155,9 @@ sgj_parse_opts(sgj_state * jsp, const char * j_optarg)
         case '8':
             jsp->pr_indent_size = 8;
             break;
+        case 'c':
+            jsp->pr_cbor = ! prev_negate;
+            break;
         case 'e':
             jsp->pr_exit_status = ! prev_negate;
             break;
@@ -113,6 +185,9 @@ sgj_parse_opts(sgj_state * jsp, const char * j_optarg)
         case 'q':
             ++jsp->q_counter;
             break;
+        case 'r':
+            jsp->pr_rec_lines = ! prev_negate;
+            break;
         case 's':
             jsp->pr_string = ! prev_negate;
             break;
@@ -158,6 +233,8 @@ sg_json_usage(int char_if_not_j, char * b, int blen)
     n += sg_scn3pr(b, blen, n, "      8    tab pretty output to 8 spaces\n");
     if (n >= (blen - 1))
         goto fini;
+    n += sg_scn3pr(b, blen, n, "      c    CBOR (binary) output rather than "
+                   "JSON text\n");
     n += sg_scn3pr(b, blen, n, "      e    show 'exit_status' field\n");
     n += sg_scn3pr(b, blen, n, "      h    show 'hex' fields\n");
     n += sg_scn3pr(b, blen, n,
@@ -172,6 +249,8 @@ sg_json_usage(int char_if_not_j, char * b, int blen)
     if (n >= (blen - 1))
         goto fini;
     n += sg_scn3pr(b, blen, n, "      p    pretty print the JSON output\n");
+    n += sg_scn3pr(b, blen, n, "      r    JSON lines output, one record per "
+                   "line (array element)\n");
     n += sg_scn3pr(b, blen, n,
                    "      s    show string output (usually fields named "
                    "'meaning')\n");
@@ -194,11 +273,13 @@ fini:
 static char *
 sg_json_settings(sgj_state * jsp, char * b, int blen)
 {
-    snprintf(b, blen, "%d%se%sh%sk%sl%sn%so%sp%ss%sv", jsp->pr_indent_size,
-             jsp->pr_exit_status ? "" : "-", jsp->pr_hex ? "" : "-",
-             jsp->pr_packed ? "" : "-", jsp->pr_leadin ? "" : "-",
-             jsp->pr_name_ex ? "" : "-", jsp->pr_out_hr ? "" : "-",
-             jsp->pr_pretty ? "" : "-", jsp->pr_string ? "" : "-",
+    snprintf(b, blen, "%d%sc%se%sh%sk%sl%sn%so%sp%sr%ss%sv",
+             jsp->pr_indent_size, jsp->pr_cbor ? "" : "-",
+             jsp->pr_exit_status ? "" : "-",
+             jsp->pr_hex ? "" : "-", jsp->pr_packed ? "" : "-",
+             jsp->pr_leadin ? "" : "-", jsp->pr_name_ex ? "" : "-",
+             jsp->pr_out_hr ? "" : "-", jsp->pr_pretty ? "" : "-",
+             jsp->pr_rec_lines ? "" : "-", jsp->pr_string ? "" : "-",
              jsp->verbose ? "" : "-");
     return b;
 }
@@ -207,6 +288,7 @@ static void
 sgj_def_opts(sgj_state * jsp)
 {
     jsp->pr_as_json = true;
+    jsp->pr_cbor = false;
     jsp->pr_exit_status = true;
     jsp->pr_hex = false;
     jsp->pr_leadin = true;
@@ -214,6 +296,7 @@ sgj_def_opts(sgj_state * jsp)
     jsp->pr_name_ex = false;
     jsp->pr_packed = false;     /* 'k' control character, needs '-p' */
     jsp->pr_pretty = true;
+    jsp->pr_rec_lines = false;
     jsp->pr_string = true;
     jsp->pr_format = 0;
     jsp->first_bad_char = 0;
@@ -232,6 +315,11 @@ sgj_init_state(sgj_state * jsp, const char * j_optarg)
     jsp->basep = NULL;
     jsp->out_hrp = NULL;
     jsp->userp = NULL;
+    jsp->stream_fp = NULL;
+    jsp->stream_arrp = NULL;
+    jsp->stream_count = 0;
+    jsp->arenap = NULL;
+    jsp->snake_memop = NULL;
 
     cp = getenv(sgj_opts_ev);
     if (cp) {
@@ -256,15 +344,23 @@ sgj_start_r(const char * util_name, const char * ver_str, int argc,
 
     if (NULL == jsp)
         return NULL;
+    /* many small nodes: take them from an arena, released by sgj_finish() */
+    jsp->arenap = json_arena_new();
+    if (jsp->arenap)
+        json_arena_use((json_arena *)jsp->arenap);
     jvp = json_object_new(0);
-    if (NULL == jvp)
+    if (NULL == jvp) {
+        sgj_arena_release(jsp);
         return NULL;
+    }
 
     jsp->basep = jvp;
     if (jsp->pr_leadin) {
         jap = json_array_new(0);
         if  (NULL == jap) {
             json_builder_free((json_value *)jvp);
+            sgj_arena_release(jsp);
+            jsp->basep = NULL;
             return NULL;
         }
         /* assume rest of json_*_new() calls succeed */
@@ -325,6 +421,453 @@ sgj_start_r(const char * util_name, const char * ver_str, int argc,
     return jvp;
 }
 
+static void
+sgj_out_settings(const sgj_state * jsp, json_serialize_opts * osp)
+{
+    memcpy(osp, &def_out_settings, sizeof(*osp));
+    if (jsp->pr_indent_size != def_out_settings.indent_size)
+        osp->indent_size = jsp->pr_indent_size;
+    if (jsp->pr_rec_lines)
+        osp->mode = json_serialize_mode_packed;
+    else if (! jsp->pr_pretty)
+        osp->mode = jsp->pr_packed ? json_serialize_mode_packed :
+                                     json_serialize_mode_single_line;
+}
+
+/* Serializes the JSON value at jvp (and anything below it) into a newly
+ * allocated C string which the caller should free. The serializer walks
+ * back up through parent pointers so jvp is briefly detached from its
+ * parent. Returns NULL if the heap allocation fails. */
+static char *
+sgj_serialize_r(const sgj_state * jsp, json_value * jvp,
+                json_serialize_opts out_settings)
+{
+    size_t len;
+    char * b;
+    json_value * parentp = jvp->parent;
+
+    jvp->parent = NULL;
+    len = json_measure_ex(jvp, out_settings);
+    b = (len > 0) ? (char *)calloc(len, 1) : NULL;
+    if (b)
+        json_serialize_ex(b, jvp, out_settings);
+    else if (jsp->verbose > 3)
+        pr2serr("%s: unable to get %zu bytes on heap\n", __func__, len);
+    jvp->parent = parentp;
+    return b;
+}
+
+/* Writes serialized JSON in 'b' to 'fp' with 'pad' extra spaces after each
+ * line feed. JSON strings have their line feeds escaped so this re-indents
+ * a value to the depth it would have had in a full serialization. */
+static void
+sgj_stream_out(const char * b, int pad, FILE * fp)
+{
+    const char * cp;
+
+    while ((pad > 0) && (cp = strchr(b, '\n'))) {
+        fwrite(b, 1, cp + 1 - b, fp);
+        fprintf(fp, "%*s", pad, "");
+        b = cp + 1;
+    }
+    fputs(b, fp);
+}
+
+/* Outputs what precedes a value (or closing bracket when 'closing' is true)
+ * at 'depth' in a container which already has 'count' members output. */
+static void
+sgj_stream_sep(const json_serialize_opts * osp, int depth, int count,
+               bool closing, FILE * fp)
+{
+    if (json_serialize_mode_packed == osp->mode) {
+        if (count && (! closing))
+            fputc(',', fp);
+    } else if (json_serialize_mode_single_line == osp->mode)
+        fputs((count && (! closing)) ? ", " : " ", fp);
+    else
+        fprintf(fp, "%s\n%*s", (count && (! closing)) ? "," : "",
+                depth * osp->indent_size, "");
+}
+
+/* CBOR output (the 'c' option), see RFC 8949. The same in-core tree is
+ * encoded: objects as maps, strings as text strings (or byte strings when
+ * made by json_bytes_new()), integers as unsigned or negative integers. A
+ * streamed array and its enclosing base object use indefinite lengths.
+ * The output starts with the self-describe CBOR tag (55799). */
+static void
+sgj_cbor_head(int major, uint64_t val, FILE * fp)
+{
+    int k, n;
+    uint8_t b[9];
+
+    if (val < 24) {
+        b[0] = (major << 5) | (uint8_t)val;
+        n = 0;
+    } else if (val <= 0xff) {
+        b[0] = (major << 5) | 24;
+        n = 1;
+    } else if (val <= 0xffff) {
+        b[0] = (major << 5) | 25;
+        n = 2;
+    } else if (val <= 0xffffffff) {
+        b[0] = (major << 5) | 26;
+        n = 4;
+    } else {
+        b[0] = (major << 5) | 27;
+        n = 8;
+    }
+    for (k = n; k > 0; --k, val >>= 8)
+        b[k] = val & 0xff;
+    fwrite(b, 1, n + 1, fp);
+}
+
+static void
+sgj_cbor_str(int major, const char * cp, unsigned int len, FILE * fp)
+{
+    sgj_cbor_head(major, len, fp);
+    fwrite(cp, 1, len, fp);
+}
+
+static void
+sgj_cbor_value(const json_value * jvp, FILE * fp)
+{
+    unsigned int k;
+    uint64_t u;
+    double d;
+    uint8_t b[9];
+
+    switch (jvp->type) {
+    case json_object:
+        sgj_cbor_head(5, jvp->u.object.length, fp);
+        for (k = 0; k < jvp->u.object.length; ++k) {
+            sgj_cbor_str(3, jvp->u.object.values[k].name,
+                         jvp->u.object.values[k].name_length, fp);
+            sgj_cbor_value(jvp->u.object.values[k].value, fp);
+        }
+        break;
+    case json_array:
+        sgj_cbor_head(4, jvp->u.array.length, fp);
+        for (k = 0; k < jvp->u.array.length; ++k)
+            sgj_cbor_value(jvp->u.array.values[k], fp);
+        break;
+    case json_integer:
+        if (jvp->u.integer >= 0)
+            sgj_cbor_head(0, (uint64_t)jvp->u.integer, fp);
+        else
+            sgj_cbor_head(1, (uint64_t)(-(jvp->u.integer + 1)), fp);
+        break;
+    case json_string:
+        sgj_cbor_str(json_is_bytes(jvp) ? 2 : 3, jvp->u.string.ptr,
+                     jvp->u.string.length, fp);
+        break;
+    case json_double:
+        d = jvp->u.dbl;
+        memcpy(&u, &d, sizeof(u));
+        b[0] = 0xfb;
+        for (k = 8; k > 0; --k, u >>= 8)
+            b[k] = u & 0xff;
+        fwrite(b, 1, 9, fp);
+        break;
+    case json_boolean:
+        fputc(jvp->u.boolean ? 0xf5 : 0xf4, fp);
+        break;
+    case json_null:
+        fputc(0xf6, fp);
+        break;
+    default:
+        fputc(0xf7, fp);        /* undefined */
+        break;
+    }
+}
+
+/* Outputs members [start, end) of the object at jvp as CBOR map pairs */
+static void
+sgj_cbor_members(const json_value * jvp, unsigned int start,
+                 unsigned int end, FILE * fp)
+{
+    unsigned int k;
+
+    for (k = start; k < end; ++k) {
+        sgj_cbor_str(3, jvp->u.object.values[k].name,
+                     jvp->u.object.values[k].name_length, fp);
+        sgj_cbor_value(jvp->u.object.values[k].value, fp);
+    }
+}
+
+static const uint8_t sgj_cbor_self_tag[3] = {0xd9, 0xd9, 0xf7};
+
+/* JSON lines output (the 'r' option). Each element of an array of objects
+ * becomes one line (record). Arrays of objects in sub-objects are split out
+ * in the same way. Other members are grouped, in order, into lines between
+ * those records. Each line is wrapped in the names of the objects that lead
+ * to it from the base object, and an element appears as the value of its
+ * array's name. So a deep merge of all the lines (appending elements to
+ * arrays) gives back the JSON of the non 'r' output. */
+#define SGJ_REC_MAX_DEPTH 16
+
+struct sgj_rec_path {
+    int depth;
+    const char * names[SGJ_REC_MAX_DEPTH];
+};
+
+static bool
+sgj_is_rec_array(const json_value * jvp)
+{
+    return (json_array == jvp->type) && (jvp->u.array.length > 0) &&
+           (json_object == jvp->u.array.values[0]->type);
+}
+
+/* Does object at jvp contain arrays of objects, directly or below? */
+static bool
+sgj_has_recs(const json_value * jvp, int depth)
+{
+    unsigned int k;
+    const json_value * vp;
+
+    if ((json_object != jvp->type) || (depth >= SGJ_REC_MAX_DEPTH))
+        return false;
+    for (k = 0; k < jvp->u.object.length; ++k) {
+        vp = jvp->u.object.values[k].value;
+        if (sgj_is_rec_array(vp) || sgj_has_recs(vp, depth + 1))
+            return true;
+    }
+    return false;
+}
+
+static void
+sgj_rec_open(const struct sgj_rec_path * pp, FILE * fp)
+{
+    int k;
+
+    fputc('{', fp);
+    for (k = 0; k < pp->depth; ++k)
+        fprintf(fp, "\"%s\":{", pp->names[k]);
+}
+
+static void
+sgj_rec_close(const struct sgj_rec_path * pp, FILE * fp)
+{
+    fprintf(fp, "%.*s}\n", pp->depth, "}}}}}}}}}}}}}}}}");
+}
+
+/* Outputs one line: {<path>"name":value} where value is serialized in 'b' */
+static void
+sgj_rec_line(const struct sgj_rec_path * pp, const char * name,
+             const char * b, FILE * fp)
+{
+    sgj_rec_open(pp, fp);
+    fprintf(fp, "\"%s\":%s", name, b);
+    sgj_rec_close(pp, fp);
+}
+
+/* Outputs members [start, end) of the object at jvp as JSON lines */
+static void
+sgj_rec_members(sgj_state * jsp, json_value * jvp, unsigned int start,
+                unsigned int end, struct sgj_rec_path * pp, FILE * fp)
+{
+    bool in_line = false;
+    unsigned int k, j;
+    char * b;
+    json_object_entry * ep;
+    json_value * vp;
+    json_serialize_opts out_settings;
+
+    sgj_out_settings(jsp, &out_settings);
+    for (k = start; k < end; ++k) {
+        ep = jvp->u.object.values + k;
+        vp = ep->value;
+        if (pp->depth < SGJ_REC_MAX_DEPTH) {
+            if (sgj_is_rec_array(vp)) {
+                if (in_line)
+                    sgj_rec_close(pp, fp);
+                in_line = false;
+                for (j = 0; j < vp->u.array.length; ++j) {
+                    b = sgj_serialize_r(jsp, vp->u.array.values[j],
+                                        out_settings);
+                    if (b) {
+                        sgj_rec_line(pp, ep->name, b, fp);
+                        free(b);
+                    }
+                }
+                continue;
+            } else if (sgj_has_recs(vp, pp->depth + 1)) {
+                if (in_line)
+                    sgj_rec_close(pp, fp);
+                in_line = false;
+                pp->names[pp->depth++] = ep->name;
+                sgj_rec_members(jsp, vp, 0, vp->u.object.length, pp, fp);
+                --pp->depth;
+                continue;
+            }
+        }
+        b = sgj_serialize_r(jsp, vp, out_settings);
+        if (NULL == b)
+            continue;
+        if (in_line)
+            fputc(',', fp);
+        else
+            sgj_rec_open(pp, fp);
+        in_line = true;
+        fprintf(fp, "\"%s\":%s", ep->name, b);
+        free(b);
+    }
+    if (in_line)
+        sgj_rec_close(pp, fp);
+}
+
+/* Returns index of the streamed array in jsp->basep's members */
+static unsigned int
+sgj_stream_idx(const sgj_state * jsp)
+{
+    unsigned int k;
+    const json_value * jvp = (const json_value *)jsp->basep;
+
+    for (k = 0; k < jvp->u.object.length; ++k) {
+        if (jvp->u.object.values[k].value == jsp->stream_arrp)
+            break;
+    }
+    return k;
+}
+
+static void
+sgj_stream_elem(sgj_state * jsp, json_value * jvp)
+{
+    char * b;
+    json_serialize_opts out_settings;
+
+    if (jsp->pr_cbor) {
+        sgj_cbor_value(jvp, jsp->stream_fp);
+        ++jsp->stream_count;
+        return;
+    }
+    sgj_out_settings(jsp, &out_settings);
+    b = sgj_serialize_r(jsp, jvp, out_settings);
+    if (NULL == b)
+        return;
+    if (jsp->pr_rec_lines) {
+        struct sgj_rec_path path;
+
+        path.depth = 0;
+        sgj_rec_line(&path, ((json_value *)jsp->basep)->u.object.values
+                                [sgj_stream_idx(jsp)].name, b,
+                     jsp->stream_fp);
+    } else {
+        sgj_stream_sep(&out_settings, 2, jsp->stream_count, false,
+                       jsp->stream_fp);
+        sgj_stream_out(b, 2 * out_settings.indent_size, jsp->stream_fp);
+    }
+    ++jsp->stream_count;
+    free(b);
+}
+
+sgj_opaque_p
+sgj_stream_subarray_r(sgj_state * jsp, const char * sn_name, FILE * fp)
+{
+    char * b;
+    char * cp;
+    char * lastp = NULL;
+    sgj_opaque_p jap;
+    json_serialize_opts out_settings;
+
+    if ((NULL == jsp) || (NULL == jsp->basep))
+        return NULL;
+    jap = sgj_named_subarray_r(jsp, NULL, sn_name);
+    if ((NULL == jap) || (NULL == fp) || jsp->pr_out_hr || jsp->stream_fp)
+        return jap;
+    if (jsp->pr_cbor) {
+        json_value * jvp = (json_value *)jsp->basep;
+
+        fwrite(sgj_cbor_self_tag, 1, sizeof(sgj_cbor_self_tag), fp);
+        fputc(0xbf, fp);        /* map, indefinite length */
+        sgj_cbor_members(jvp, 0, jvp->u.object.length - 1, fp);
+        sgj_cbor_str(3, sn_name, strlen(sn_name), fp);
+        fputc(0x9f, fp);        /* array, indefinite length */
+    } else if (jsp->pr_rec_lines) {
+        struct sgj_rec_path path;
+        json_value * jvp = (json_value *)jsp->basep;
+
+        path.depth = 0;
+        sgj_rec_members(jsp, jvp, 0, jvp->u.object.length - 1, &path, fp);
+    } else {
+        /* jap is the last member of jsp->basep so is the last "[]" output */
+        sgj_out_settings(jsp, &out_settings);
+        b = sgj_serialize_r(jsp, (json_value *)jsp->basep, out_settings);
+        if (NULL == b)
+            return jap;     /* fall back to in-core tree */
+        for (cp = b; (cp = strstr(cp, "[]")); ++cp)
+            lastp = cp;
+        if (lastp)
+            fwrite(b, 1, lastp + 1 - b, fp);
+        free(b);
+        if (NULL == lastp)
+            return jap;
+    }
+    jsp->stream_fp = fp;
+    jsp->stream_arrp = jap;
+    jsp->stream_count = 0;
+    /* streamed elements are freed once output so keep them on the heap,
+     * an arena only gives memory back in sgj_finish() */
+    if (jsp->arenap)
+        json_arena_use(NULL);
+    return jap;
+}
+
+/* Closes the streamed array then outputs the members of jsp->basep that
+ * follow it and the closing brace. */
+static void
+sgj_stream_fini(sgj_state * jsp)
+{
+    unsigned int k, j;
+    char * b;
+    FILE * fp = jsp->stream_fp;
+    json_value * jvp = (json_value *)jsp->basep;
+    json_value * jap = (json_value *)jsp->stream_arrp;
+    json_serialize_opts out_settings;
+
+    sgj_out_settings(jsp, &out_settings);
+    /* elements added to the array by other than sgj_js_nv_o() */
+    for (k = 0; k < jap->u.array.length; ++k)
+        sgj_stream_elem(jsp, jap->u.array.values[k]);
+    k = sgj_stream_idx(jsp);
+    if (jsp->pr_cbor) {
+        fputc(0xff, fp);        /* "break" ends the streamed array */
+        sgj_cbor_members(jvp, k + 1, jvp->u.object.length, fp);
+        fputc(0xff, fp);        /* and then the base object */
+        goto fini;
+    }
+    if (jsp->pr_rec_lines) {
+        struct sgj_rec_path path;
+
+        path.depth = 0;
+        if (0 == jsp->stream_count)
+            sgj_rec_line(&path, jvp->u.object.values[k].name, "[]", fp);
+        sgj_rec_members(jsp, jvp, k + 1, jvp->u.object.length, &path, fp);
+        goto fini;
+    }
+    if (jsp->stream_count > 0)
+        sgj_stream_sep(&out_settings, 1, jsp->stream_count, true, fp);
+    fputc(']', fp);
+    for (j = k + 1; j < jvp->u.object.length; ++j) {
+        b = sgj_serialize_r(jsp, jvp->u.object.values[j].value,
+                            out_settings);
+        if (NULL == b)
+            continue;
+        sgj_stream_sep(&out_settings, 1, 1, false, fp);
+        fprintf(fp, "\"%s\":%s", jvp->u.object.values[j].name,
+                (json_serialize_mode_packed == out_settings.mode) ? "" : " ");
+        sgj_stream_out(b, out_settings.indent_size, fp);
+        free(b);
+    }
+    sgj_stream_sep(&out_settings, 0, 1, true, fp);
+    fputs("}\n", fp);
+fini:
+    jsp->stream_fp = NULL;
+    jsp->stream_arrp = NULL;
+    jsp->stream_count = 0;
+    if (jsp->arenap)
+        json_arena_use((json_arena *)jsp->arenap);
+}
+
 void
 sgj_js2file_estr(sgj_state * jsp, sgj_opaque_p jop, int exit_status,
                  const char * estr, FILE * fp)
@@ -353,12 +896,23 @@ sgj_js2file_estr(sgj_state * jsp, sgj_opaque_p jop, int exit_status,
         }
         sgj_js_nv_istr(jsp, jop, "exit_status", exit_status, NULL, ccp);
     }
-    memcpy(&out_settings, &def_out_settings, sizeof(out_settings));
-    if (jsp->pr_indent_size != def_out_settings.indent_size)
-        out_settings.indent_size = jsp->pr_indent_size;
-    if (! jsp->pr_pretty)
-        out_settings.mode = jsp->pr_packed ? json_serialize_mode_packed :
-                                json_serialize_mode_single_line;
+    if ((NULL == jop) && jsp->stream_fp) {
+        sgj_stream_fini(jsp);
+        return;
+    }
+    if (jsp->pr_cbor) {
+        fwrite(sgj_cbor_self_tag, 1, sizeof(sgj_cbor_self_tag), fp);
+        sgj_cbor_value(jvp, fp);
+        return;
+    }
+    if (jsp->pr_rec_lines && (json_object == jvp->type)) {
+        struct sgj_rec_path path;
+
+        path.depth = 0;
+        sgj_rec_members(jsp, jvp, 0, jvp->u.object.length, &path, fp);
+        return;
+    }
+    sgj_out_settings(jsp, &out_settings);
 
     len = json_measure_ex(jvp, out_settings);
     if (len < 1)
@@ -382,10 +936,20 @@ void
 sgj_finish(sgj_state * jsp)
 {
     if (jsp && jsp->basep) {
-        json_builder_free((json_value *)jsp->basep);
+        if ((NULL == jsp->arenap) ||
+            json_arena_mixed((const json_arena *)jsp->arenap))
+            json_builder_free((json_value *)jsp->basep);
+        sgj_arena_release(jsp);
         jsp->basep = NULL;
         jsp->out_hrp = NULL;
         jsp->userp = NULL;
+        jsp->stream_fp = NULL;
+        jsp->stream_arrp = NULL;
+        jsp->stream_count = 0;
+    }
+    if (jsp && jsp->snake_memop) {
+        free(jsp->snake_memop);
+        jsp->snake_memop = NULL;
     }
 }
 
@@ -461,6 +1025,16 @@ sgj_pr_hr(sgj_state * jsp, const char * fmt, ...)
     }
 }
 
+bool
+sgj_hr_buffered(void)
+{
+    static char hr_buf[SGJ_HR_BUF_SZ];  /* in use until exit */
+
+    if (isatty(fileno(stdout)))
+        return false;
+    return (0 == setvbuf(stdout, hr_buf, _IOFBF, sizeof(hr_buf)));
+}
+
 /* jop will 'own' returned value (if non-NULL) */
 sgj_opaque_p
 sgj_named_subobject_r(sgj_state * jsp, sgj_opaque_p jop, const char * sn_name)
@@ -478,13 +1052,25 @@ sgj_snake_named_subobject_r(sgj_state * jsp, sgj_opaque_p jop,
                             const char * conv2sname)
 {
     if (jsp && jsp->pr_as_json && conv2sname) {
+        sgj_opaque_p resp;
+        const char * sname;
+        char * free_b = NULL;
         int olen = strlen(conv2sname);
-        char * sname = (char *)malloc(olen + 8);
-        int nlen = sgj_name_to_snake(conv2sname, sname, olen + 8);
+        char b[256];
 
-        if (nlen > 0)
-            return json_object_push((json_value *)(jop ? jop : jsp->basep),
-                                    sname, json_object_new(0));
+        if (olen >= (int)sizeof(b)) {   /* too long for memo and b */
+            free_b = (char *)malloc(olen + 8);
+            if (NULL == free_b)
+                return NULL;
+        }
+        if (free_b)
+            sname = sgj_snake(jsp, conv2sname, free_b, olen + 8);
+        else
+            sname = sgj_snake(jsp, conv2sname, b, sizeof(b));
+        resp = json_object_push((json_value *)(jop ? jop : jsp->basep),
+                                sname, json_object_new(0));
+        free(free_b);
+        return resp;
     }
     return NULL;
 }
@@ -506,13 +1092,25 @@ sgj_snake_named_subarray_r(sgj_state * jsp, sgj_opaque_p jop,
                            const char * conv2sname)
 {
     if (jsp && jsp->pr_as_json && conv2sname) {
+        sgj_opaque_p resp;
+        const char * sname;
+        char * free_b = NULL;
         int olen = strlen(conv2sname);
-        char * sname = (char *)malloc(olen + 8);
-        int nlen = sgj_name_to_snake(conv2sname, sname, olen + 8);
+        char b[256];
 
-        if (nlen > 0)
-            return json_object_push((json_value *)(jop ? jop : jsp->basep),
-                                    sname, json_array_new(0));
+        if (olen >= (int)sizeof(b)) {   /* too long for memo and b */
+            free_b = (char *)malloc(olen + 8);
+            if (NULL == free_b)
+                return NULL;
+        }
+        if (free_b)
+            sname = sgj_snake(jsp, conv2sname, free_b, olen + 8);
+        else
+            sname = sgj_snake(jsp, conv2sname, b, sizeof(b));
+        resp = json_object_push((json_value *)(jop ? jop : jsp->basep),
+                                sname, json_array_new(0));
+        free(free_b);
+        return resp;
     }
     return NULL;
 }
@@ -684,7 +1282,11 @@ sgj_js_nv_o(sgj_state * jsp, sgj_opaque_p jop, const char * sn_name,
         if (sn_name)
             return json_object_push((json_value *)(jop ? jop : jsp->basep),
                                     sn_name, (json_value *)ua_jop);
-        else
+        else if (jsp->stream_fp && jop && (jop == jsp->stream_arrp)) {
+            sgj_stream_elem(jsp, (json_value *)ua_jop);
+            json_builder_free((json_value *)ua_jop);
+            return NULL;
+        } else
             return json_array_push((json_value *)(jop ? jop : jsp->basep),
                                    (json_value *)ua_jop);
     } else
@@ -846,6 +1448,19 @@ sgj_js_nv_hex_bytes(sgj_state * jsp, sgj_opaque_p jop, const char * sn_name,
 
     if ((NULL == jsp) || (! jsp->pr_as_json))
         return;
+    if (jsp->pr_cbor) {         /* raw bytes, no need for hex */
+        json_value * jvp = (json_value *)(jop ? jop : jsp->basep);
+        json_value * bvp = json_bytes_new(num_bytes,
+                                          (const char *)byte_arr);
+
+        if (NULL == bvp)
+            return;
+        if (sn_name)
+            json_object_push(jvp, sn_name, bvp);
+        else
+            json_array_push(jvp, bvp);
+        return;
+    }
     bp = (char *)calloc(blen + 4, 1);
     if (bp) {
         h2str(byte_arr, num_bytes, bp, blen);
@@ -1133,8 +1748,9 @@ sgj_haj_xx(sgj_state * jsp, sgj_opaque_p jop, int leadin_sp,
     bool done;
     int n;
     json_type jtype = jvp ? jvp->type : json_none;
+    const char * jname;
     char b[256];
-    char jname[96];
+    char jn_b[96];
     static const int blen = sizeof(b);
 
     if (leadin_sp > 128)
@@ -1143,7 +1759,8 @@ sgj_haj_xx(sgj_state * jsp, sgj_opaque_p jop, int leadin_sp,
         b[n] = ' ';
     b[n] = '\0';
     if (NULL == aname) {
-        if ((! as_json) || (jsp && jsp->pr_out_hr)) {
+        /* with JSON, the 'o' output mirror takes jvp itself */
+        if (! as_json) {
             sgj_jtype_to_s(b + n, blen - n, jvp, hex_haj);
             printf("%s\n", b);
         }
@@ -1163,12 +1780,10 @@ sgj_haj_xx(sgj_state * jsp, sgj_opaque_p jop, int leadin_sp,
         goto fini;
     }
     if (as_json) {
-        int k;
-
         if (NULL == jop)
             jop = jsp->basep;
-        k = sgj_name_to_snake(aname, jname, sizeof(jname));
-        if (k > 0) {
+        jname = sgj_snake(jsp, aname, jn_b, sizeof(jn_b));
+        if (jname[0]) {
             done = false;
             if (nex_s && (strlen(nex_s) > 0)) {
                 switch (jtype) {
@@ -1317,8 +1932,8 @@ sgj_haj_subo_r(sgj_state * jsp, sgj_opaque_p jop, int leadin_sp,
         printf("%s\n", b);
 
     if (as_json) {
-        sgj_name_to_snake(aname, b, blen);
-        jo2p = sgj_named_subobject_r(jsp, jop, b);
+        jo2p = sgj_named_subobject_r(jsp, jop,
+                                     sgj_snake(jsp, aname, b, blen));
         if (jo2p) {
             sgj_js_nv_i(jsp, jo2p, "i", value);
             if (hex_haj && jsp->pr_hex) {
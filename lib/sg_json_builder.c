@@ -60,11 +60,203 @@ typedef struct json_builder_value
    size_t additional_length_allocated;
    size_t length_iterated;
 
+   json_arena * arena;   /* NULL -> this value and its buffers on the heap */
+   int is_bytes;         /* json_string holding binary, see json_bytes_new() */
+
 } json_builder_value;
 
 /* Use this to silence clang --analyze warning about 'unix.MallocSizeof' */
 static const int jbv_sz = sizeof (json_builder_value);
 
+/* Arena (bump) allocator. Values and their buffers are carved out of large
+ * chunks which are only released, all together, by json_arena_free(). The
+ * json_*_new() functions use the calling thread's current arena (see
+ * json_arena_use()); buffers later added to a value (e.g. by
+ * json_array_push()) come from the same place as that value.
+ */
+#if defined(__GNUC__) || defined(__clang__)
+#define JB_THREAD_LOCAL __thread
+#endif
+
+#define JB_ARENA_CHUNK (64 * 1024)
+#define JB_ARENA_ALIGN 16
+
+typedef struct json_arena_chunk
+{
+   struct json_arena_chunk * next;
+   size_t size;
+   size_t used;
+
+} json_arena_chunk;
+
+struct json_arena
+{
+   json_arena_chunk * chunks;   /* first is the one being carved up */
+   void * last;                 /* most recent allocation, can grow */
+   int mixed;                   /* heap values attached to arena values */
+};
+
+#define JB_CHUNK_HDR ((sizeof (json_arena_chunk) + JB_ARENA_ALIGN - 1) & \
+                      ~(size_t)(JB_ARENA_ALIGN - 1))
+
+#ifdef JB_THREAD_LOCAL
+static JB_THREAD_LOCAL json_arena * jb_cur_arena;
+#endif
+
+json_arena * json_arena_new (void)
+{
+#ifdef JB_THREAD_LOCAL
+   return (json_arena *) calloc (1, sizeof (json_arena));
+#else
+   return NULL;
+#endif
+}
+
+json_arena * json_arena_use (json_arena * arena)
+{
+#ifdef JB_THREAD_LOCAL
+   json_arena * prev = jb_cur_arena;
+
+   jb_cur_arena = arena;
+   return prev;
+#else
+   if (arena) { }
+   return NULL;
+#endif
+}
+
+int json_arena_mixed (const json_arena * arena)
+{
+   return arena ? arena->mixed : 0;
+}
+
+void json_arena_free (json_arena * arena)
+{
+   json_arena_chunk * cp;
+
+   if (!arena)
+      return;
+
+   while ((cp = arena->chunks))
+   {
+      arena->chunks = cp->next;
+      free (cp);
+   }
+   free (arena);
+}
+
+static void * jb_arena_alloc (json_arena * arena, size_t size)
+{
+   json_arena_chunk * cp = arena->chunks;
+   size_t csize;
+
+   /* zero length allocations still need their own address */
+   size = size ? (size + JB_ARENA_ALIGN - 1) & ~(size_t)(JB_ARENA_ALIGN - 1)
+               : JB_ARENA_ALIGN;
+
+   if (!cp || (cp->size - cp->used) < size)
+   {
+      csize = JB_CHUNK_HDR + size;
+
+      if (csize < JB_ARENA_CHUNK)
+         csize = JB_ARENA_CHUNK;
+
+      if (! (cp = (json_arena_chunk *) malloc (csize)))
+         return NULL;
+
+      cp->size = csize;
+      cp->used = JB_CHUNK_HDR;
+      cp->next = arena->chunks;
+      arena->chunks = cp;
+   }
+
+   arena->last = (char *) cp + cp->used;
+   cp->used += size;
+
+   return arena->last;
+}
+
+static void * jb_malloc (json_arena * arena, size_t size)
+{
+   return arena ? jb_arena_alloc (arena, size) : malloc (size);
+}
+
+static void * jb_calloc (json_arena * arena, size_t num, size_t size)
+{
+   void * p;
+
+   if (!arena)
+      return calloc (num, size);
+
+   if ((p = jb_arena_alloc (arena, num * size)))
+      memset (p, 0, num * size);
+
+   return p;
+}
+
+/* old_size is only needed for arena buffers */
+static void * jb_realloc (json_arena * arena, void * p, size_t old_size,
+                          size_t size)
+{
+   json_arena_chunk * cp;
+   void * p_new;
+
+   if (!arena)
+      return realloc (p, size);
+
+   cp = arena->chunks;
+
+   if (p && p == arena->last &&
+       (size_t) ((char *) p - (char *) cp) + size <= cp->size)
+   {
+      /* grow (or shrink) the most recent allocation in place */
+      cp->used = (size_t) ((char *) p - (char *) cp) +
+                 ((size + JB_ARENA_ALIGN - 1) & ~(size_t)(JB_ARENA_ALIGN - 1));
+      return p;
+   }
+
+   if ((p_new = jb_arena_alloc (arena, size)) && p)
+      memcpy (p_new, p, old_size < size ? old_size : size);
+
+   return p_new;
+}
+
+static void jb_free (json_arena * arena, void * p)
+{
+   if (!arena)
+      free (p);
+}
+
+static json_value * jb_value_new (json_arena * arena)
+{
+   json_value * value = (json_value *) jb_calloc (arena, 1, jbv_sz);
+
+   if (!value)
+      return NULL;
+
+   ((json_builder_value *) value)->is_builder_value = 1;
+   ((json_builder_value *) value)->arena = arena;
+
+   return value;
+}
+
+#ifdef JB_THREAD_LOCAL
+#define JB_CUR_ARENA jb_cur_arena
+#else
+#define JB_CUR_ARENA NULL
+#endif
+
+#define JB_ARENA(v) (((json_builder_value *) (v))->arena)
+
+/* Note when a heap value is attached to an arena value so that
+ * json_builder_free() is still used on the tree before json_arena_free().
+ */
+static void jb_note_attach (json_value * parent, json_value * value)
+{
+   if (JB_ARENA (parent) && JB_ARENA (parent) != JB_ARENA (value))
+      JB_ARENA (parent)->mixed = 1;
+}
+
 
 static int builderize (json_value * value)
 {
@@ -138,18 +330,16 @@ static int get_serialize_flags (json_serialize_opts opts)
 json_value * json_array_new (size_t length)
 {
     /* 'value' will be pointer to an instance of the base class json_value */
-    json_value * value = (json_value *) calloc (1, jbv_sz);
+    json_value * value = jb_value_new (JB_CUR_ARENA);
 
     if (!value)
        return NULL;
 
-    ((json_builder_value *) value)->is_builder_value = 1;
-
     value->type = json_array;
 
-    if (! (value->u.array.values = (json_value **) malloc (length * sizeof (json_value *))))
+    if (! (value->u.array.values = (json_value **) jb_malloc (JB_ARENA (value), length * sizeof (json_value *))))
     {
-       free (value);
+       jb_free (JB_ARENA (value), value);
        return NULL;
     }
 
@@ -171,38 +361,42 @@ json_value * json_array_push (json_value * array, json_value * value)
    }
    else
    {
-      json_value ** values_new = (json_value **) realloc
-            (array->u.array.values, sizeof (json_value *) * (array->u.array.length + 1));
+      /* grow geometrically so long arrays are not copied on every push */
+      size_t grow = array->u.array.length < 4 ? 4 : array->u.array.length;
+      json_value ** values_new = (json_value **) jb_realloc
+            (JB_ARENA (array), array->u.array.values,
+             sizeof (json_value *) * array->u.array.length,
+             sizeof (json_value *) * (array->u.array.length + grow));
 
       if (!values_new)
          return NULL;
 
       array->u.array.values = values_new;
+      ((json_builder_value *) array)->additional_length_allocated = grow - 1;
    }
 
    array->u.array.values [array->u.array.length] = value;
    ++ array->u.array.length;
 
    value->parent = array;
+   jb_note_attach (array, value);
 
    return value;
 }
 
 json_value * json_object_new (size_t length)
 {
-    json_value * value = (json_value *) calloc (1, jbv_sz);
+    json_value * value = jb_value_new (JB_CUR_ARENA);
 
     if (!value)
        return NULL;
 
-    ((json_builder_value *) value)->is_builder_value = 1;
-
     value->type = json_object;
 
-    if (! (value->u.object.values = (json_object_entry *) calloc
-           (length, sizeof (*value->u.object.values))))
+    if (! (value->u.object.values = (json_object_entry *) jb_calloc
+           (JB_ARENA (value), length, sizeof (*value->u.object.values))))
     {
-       free (value);
+       jb_free (JB_ARENA (value), value);
        return NULL;
     }
 
@@ -226,7 +420,7 @@ json_value * json_object_push_length (json_value * object,
 
    assert (object->type == json_object);
 
-   if (! (name_copy = (json_char *) malloc ((name_length + 1) * sizeof (json_char))))
+   if (! (name_copy = (json_char *) jb_malloc (JB_ARENA (object), (name_length + 1) * sizeof (json_char))))
       return NULL;
    
    memcpy (name_copy, name, name_length * sizeof (json_char));
@@ -234,7 +428,7 @@ json_value * json_object_push_length (json_value * object,
 
    if (!json_object_push_nocopy (object, name_length, name_copy, value))
    {
-      free (name_copy);
+      jb_free (JB_ARENA (object), name_copy);
       return NULL;
    }
 
@@ -258,14 +452,19 @@ json_value * json_object_push_nocopy (json_value * object,
    }
    else
    {
+      size_t grow = object->u.object.length < 4 ? 4 : object->u.object.length;
       json_object_entry * values_new = (json_object_entry *)
-            realloc (object->u.object.values, sizeof (*object->u.object.values)
-                            * (object->u.object.length + 1));
+            jb_realloc (JB_ARENA (object), object->u.object.values,
+                        sizeof (*object->u.object.values)
+                            * object->u.object.length,
+                        sizeof (*object->u.object.values)
+                            * (object->u.object.length + grow));
 
       if (!values_new)
          return NULL;
 
       object->u.object.values = values_new;
+      ((json_builder_value *) object)->additional_length_allocated = grow - 1;
    }
 
    entry = object->u.object.values + object->u.object.length;
@@ -277,6 +476,7 @@ json_value * json_object_push_nocopy (json_value * object,
    ++ object->u.object.length;
 
    value->parent = object;
+   jb_note_attach (object, value);
 
    return value;
 }
@@ -289,32 +489,52 @@ json_value * json_string_new (const json_char * buf)
 json_value * json_string_new_length (unsigned int length, const json_char * buf)
 {
    json_value * value;
-   json_char * copy = (json_char *) malloc ((length + 1) * sizeof (json_char));
+   json_char * copy;
 
-   if (!copy)
+   if (! (value = jb_value_new (JB_CUR_ARENA)))
       return NULL;
-   
-   memcpy (copy, buf, length * sizeof (json_char));
-   copy [length] = 0;
 
-   if (! (value = json_string_new_nocopy (length, copy)))
+   if (! (copy = (json_char *) jb_malloc (JB_ARENA (value), (length + 1) * sizeof (json_char))))
    {
-      free (copy);
+      jb_free (JB_ARENA (value), value);
       return NULL;
    }
+   
+   memcpy (copy, buf, length * sizeof (json_char));
+   copy [length] = 0;
+
+   value->type = json_string;
+   value->u.string.length = length;
+   value->u.string.ptr = copy;
+
+   return value;
+}
+
+json_value * json_bytes_new (unsigned int length, const json_char * buf)
+{
+   json_value * value = json_string_new_length (length, buf);
+
+   if (value)
+      ((json_builder_value *) value)->is_bytes = 1;
 
    return value;
 }
 
+int json_is_bytes (const json_value * value)
+{
+   return value->type == json_string &&
+          ((const json_builder_value *) value)->is_bytes;
+}
+
 json_value * json_string_new_nocopy (unsigned int length, json_char * buf)
 {
-   json_value * value = (json_value *) calloc (1, jbv_sz);
+   /* buf is from the heap so keep this value there too, then both are
+    * released by json_builder_free() */
+   json_value * value = jb_value_new (NULL);
    
    if (!value)
       return NULL;
 
-   ((json_builder_value *) value)->is_builder_value = 1;
-
    value->type = json_string;
    value->u.string.length = length;
    value->u.string.ptr = buf;
@@ -324,13 +544,11 @@ json_value * json_string_new_nocopy (unsigned int length, json_char * buf)
 
 json_value * json_integer_new (json_int_t integer)
 {
-   json_value * value = (json_value *) calloc (1, jbv_sz);
+   json_value * value = jb_value_new (JB_CUR_ARENA);
    
    if (!value)
       return NULL;
 
-   ((json_builder_value *) value)->is_builder_value = 1;
-
    value->type = json_integer;
    value->u.integer = integer;
 
@@ -339,13 +557,11 @@ json_value * json_integer_new (json_int_t integer)
 
 json_value * json_double_new (double dbl)
 {
-   json_value * value = (json_value *) calloc (1, jbv_sz);
+   json_value * value = jb_value_new (JB_CUR_ARENA);
    
    if (!value)
       return NULL;
 
-   ((json_builder_value *) value)->is_builder_value = 1;
-
    value->type = json_double;
    value->u.dbl = dbl;
 
@@ -354,13 +570,11 @@ json_value * json_double_new (double dbl)
 
 json_value * json_boolean_new (int b)
 {
-   json_value * value = (json_value *) calloc (1, jbv_sz);
+   json_value * value = jb_value_new (JB_CUR_ARENA);
    
    if (!value)
       return NULL;
 
-   ((json_builder_value *) value)->is_builder_value = 1;
-
    value->type = json_boolean;
    value->u.boolean = b;
 
@@ -369,13 +583,11 @@ json_value * json_boolean_new (int b)
 
 json_value * json_null_new (void)
 {
-   json_value * value = (json_value *) calloc (1, jbv_sz);
+   json_value * value = jb_value_new (JB_CUR_ARENA);
    
    if (!value)
       return NULL;
 
-   ((json_builder_value *) value)->is_builder_value = 1;
-
    value->type = json_null;
 
    return value;
@@ -441,7 +653,10 @@ json_value * json_object_merge (json_value * objectA, json_value * objectB)
               + objectB->u.object.length;
 
       if (! (values_new = (json_object_entry *)
-            realloc (objectA->u.object.values, sizeof (json_object_entry) * alloc)))
+            jb_realloc (JB_ARENA (objectA), objectA->u.object.values,
+                        sizeof (json_object_entry) * (objectA->u.object.length
+                          + ((json_builder_value *) objectA)->additional_length_allocated),
+                        sizeof (json_object_entry) * alloc)))
       {
           return NULL;
       }
@@ -455,12 +670,16 @@ json_value * json_object_merge (json_value * objectA, json_value * objectB)
 
       *entry = objectB->u.object.values[i];
       entry->value->parent = objectA;
+      jb_note_attach (objectA, entry->value);
    }
 
    objectA->u.object.length += objectB->u.object.length;
 
-   free (objectB->u.object.values);
-   free (objectB);
+   if (JB_ARENA (objectA) != JB_ARENA (objectB) && JB_ARENA (objectA))
+      JB_ARENA (objectA)->mixed = 1;   /* names came from objectB */
+
+   jb_free (JB_ARENA (objectB), objectB->u.object.values);
+   jb_free (JB_ARENA (objectB), objectB);
 
    return objectA;
 }
@@ -954,7 +1173,7 @@ void json_builder_free (json_value * value)
 
             if (!value->u.array.length)
             {
-               free (value->u.array.values);
+               jb_free (JB_ARENA (value), value->u.array.values);
                break;
             }
 
@@ -965,7 +1184,7 @@ void json_builder_free (json_value * value)
 
             if (!value->u.object.length)
             {
-               free (value->u.object.values);
+               jb_free (JB_ARENA (value), value->u.object.values);
                break;
             }
 
@@ -977,7 +1196,7 @@ void json_builder_free (json_value * value)
                 * values, they are part of the same allocation as the values array
                 * itself.
                 */
-               free (value->u.object.values [value->u.object.length].name);
+               jb_free (JB_ARENA (value), value->u.object.values [value->u.object.length].name);
             }
 
             value = value->u.object.values [value->u.object.length].value;
@@ -985,7 +1204,7 @@ void json_builder_free (json_value * value)
 
          case json_string:
 
-            free (value->u.string.ptr);
+            jb_free (JB_ARENA (value), value->u.string.ptr);
             break;
 
          default:
@@ -994,7 +1213,7 @@ void json_builder_free (json_value * value)
 
       cur_value = value;
       value = value->parent;
-      free (cur_value);
+      jb_free (JB_ARENA (cur_value), cur_value);
    }
 }
 
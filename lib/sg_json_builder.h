@@ -229,6 +229,27 @@ void json_value_free_ex (json_settings * settings,
 extern const size_t json_builder_extra;
 
 
+/*** Arenas (sg3_utils addition)
+ ***
+ * While an arena is the calling thread's current arena, json_*_new() take
+ * their memory from it rather than from malloc(). Buffers later needed by
+ * a value (e.g. when pushing to an array) come from where that value came
+ * from. json_builder_free() skips memory owned by an arena; everything in
+ * an arena is released by json_arena_free(). json_arena_mixed() returns
+ * non-zero if heap values have been attached to values in the arena, in
+ * which case json_builder_free() should be called on the tree before
+ * json_arena_free(). json_arena_use() returns the previous current arena,
+ * NULL makes json_*_new() use the heap again. json_arena_new() returns
+ * NULL if arenas are not supported (no thread local storage).
+ */
+typedef struct json_arena json_arena;
+
+json_arena * json_arena_new (void);
+json_arena * json_arena_use (json_arena * arena);
+int json_arena_mixed (const json_arena * arena);
+void json_arena_free (json_arena * arena);
+
+
 /*** Arrays
  ***
  * Note that all of these length arguments are just a hint to allow for
@@ -276,6 +297,13 @@ json_value * json_string_new (const json_char *);
 json_value * json_string_new_length (unsigned int length, const json_char *);
 json_value * json_string_new_nocopy (unsigned int length, json_char *);
 
+/* sg3_utils addition: a json_string that holds 'length' bytes of binary
+ * data. Only meant for non-JSON serializers (e.g. CBOR) which can tell it
+ * apart with json_is_bytes().
+ */
+json_value * json_bytes_new (unsigned int length, const json_char * buf);
+int json_is_bytes (const json_value * value);
+
 
 /*** Everything else
  ***/
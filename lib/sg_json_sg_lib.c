@@ -20,6 +20,7 @@
 
 #include "sg_lib.h"
 #include "sg_lib_data.h"
+#include "sg_pt.h"
 #include "sg_unaligned.h"
 #include "sg_json_builder.h"
 
@@ -841,3 +842,53 @@ sgj_js2file(sgj_state * jsp, sgj_opaque_p jop, int exit_status, FILE * fp)
     }
     sgj_js2file_estr(jsp, jop, exit_status, estr, fp);
 }
+
+void
+sgj_js_pt_lat(sgj_state * jsp, sgj_opaque_p jop,
+              const struct sg_pt_lat_hist * arr, int num)
+{
+    int k, j;
+    sgj_opaque_p jap, ja2p, jo2p, jo3p;
+    const struct sg_pt_lat_hist * hp;
+    char b[80];
+    static const int blen = sizeof(b);
+
+    if ((NULL == jsp) || (! jsp->pr_as_json))
+        return;
+    jap = sgj_named_subarray_r(jsp, jop, "latency_histogram_list");
+    for (k = 0; k < num; ++k) {
+        hp = arr + k;
+        jo2p = sgj_new_unattached_object_r(jsp);
+        sgj_js_nv_ihex(jsp, jo2p, "device_id", hp->dev_id);
+        if (SG_PT_LAT_SCSI == hp->cmd_set)
+            sg_get_opcode_name(hp->opcode, -1, blen, b);
+        else
+            sg_get_nvme_opcode_name(hp->opcode,
+                                    (SG_PT_LAT_NVME_ADMIN == hp->cmd_set),
+                                    blen, b);
+        sgj_js_nv_ihexstr(jsp, jo2p, "opcode", hp->opcode, "name", b);
+        sgj_js_nv_s(jsp, jo2p, "command_set",
+                    (SG_PT_LAT_SCSI == hp->cmd_set) ? "scsi" :
+                    ((SG_PT_LAT_NVME_ADMIN == hp->cmd_set) ? "nvme_admin" :
+                                                             "nvme_nvm"));
+        sgj_js_nv_i(jsp, jo2p, "count", hp->count);
+        sgj_js_nv_i(jsp, jo2p, "min_ns", hp->count ? hp->min_ns : 0);
+        sgj_js_nv_i(jsp, jo2p, "mean_ns",
+                    hp->count ? (hp->sum_ns / hp->count) : 0);
+        sgj_js_nv_i(jsp, jo2p, "max_ns", hp->max_ns);
+        sgj_js_nv_i(jsp, jo2p, "p50_ns", sg_pt_lat_percentile(hp, 50.0));
+        sgj_js_nv_i(jsp, jo2p, "p90_ns", sg_pt_lat_percentile(hp, 90.0));
+        sgj_js_nv_i(jsp, jo2p, "p99_ns", sg_pt_lat_percentile(hp, 99.0));
+        sgj_js_nv_i(jsp, jo2p, "p99_9_ns", sg_pt_lat_percentile(hp, 99.9));
+        ja2p = sgj_named_subarray_r(jsp, jo2p, "bucket_list");
+        for (j = 0; j < SG_PT_LAT_NUM_BUCKETS; ++j) {
+            if (0 == hp->bucket[j])
+                continue;       /* sparse: only non-empty buckets */
+            jo3p = sgj_new_unattached_object_r(jsp);
+            sgj_js_nv_i(jsp, jo3p, "lower_ns", sg_pt_lat_bucket_ns(j));
+            sgj_js_nv_i(jsp, jo3p, "count", hp->bucket[j]);
+            sgj_js_nv_o(jsp, ja2p, NULL /* name */, jo3p);
+        }
+        sgj_js_nv_o(jsp, jap, NULL /* name */, jo2p);
+    }
+}
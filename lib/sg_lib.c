@@ -30,6 +30,9 @@
  */
 
 #define _POSIX_C_SOURCE 200809L         /* for posix_memalign() */
+#if defined(__linux__) && ! defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE 1               /* for MAP_HUGETLB and madvise() */
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
@@ -44,11 +47,24 @@
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <time.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
 
+#ifdef SG_LIB_LINUX
+#include <sys/mman.h>
+#endif
+#ifdef HAVE_GETTIMEOFDAY
+#include <sys/time.h>
+#endif
+
 #include "sg_lib.h"
 #include "sg_lib_data.h"
 #include "sg_unaligned.h"
@@ -112,6 +128,26 @@ sg_get_initial_dsense(void)
     return false;
 }
 
+/* 'vp' points at the first of a run of entries with the same value. Yields
+ * the first in that run matching 'peri_type', else the first in the run. */
+static const struct sg_lib_value_name_t *
+get_value_name_run(const struct sg_lib_value_name_t * vp, int peri_type)
+{
+    int value = vp->value;
+    const struct sg_lib_value_name_t * holdp = vp;
+
+    if (peri_type < 0)
+        peri_type = 0;
+    if (sg_pdt_s_eq(peri_type, vp->peri_dev_type))
+        return vp;
+    while ((vp + 1)->name && (value == (vp + 1)->value)) {
+        ++vp;
+        if (sg_pdt_s_eq(peri_type, vp->peri_dev_type))
+            return vp;
+    }
+    return holdp;
+}
+
 /* Searches 'arr' for match on 'value' then 'peri_type'. If matches
    'value' but not 'peri_type' then yields first 'value' match entry.
    Last element of 'arr' has NULL 'name'. If no match returns NULL. */
@@ -120,26 +156,50 @@ get_value_name(const struct sg_lib_value_name_t * arr, int value,
                int peri_type)
 {
     const struct sg_lib_value_name_t * vp = arr;
-    const struct sg_lib_value_name_t * holdp;
 
-    if (peri_type < 0)
-        peri_type = 0;
     for (; vp->name; ++vp) {
-        if (value == vp->value) {
-            if (sg_pdt_s_eq(peri_type, vp->peri_dev_type))
-                return vp;
-            holdp = vp;
-            while ((vp + 1)->name && (value == (vp + 1)->value)) {
-                ++vp;
-                if (sg_pdt_s_eq(peri_type, vp->peri_dev_type))
-                    return vp;
-            }
-            return holdp;
-        }
+        if (value == vp->value)
+            return get_value_name_run(vp, peri_type);
     }
     return NULL;
 }
 
+/* Number of entries in 'arr' (before its NULL 'name' sentinel) if they are
+ * in ascending order of 'value', else -1. */
+static int
+value_name_sorted_num(const struct sg_lib_value_name_t * arr)
+{
+    int k;
+
+    for (k = 0; arr[k].name; ++k) {
+        if ((k > 0) && (arr[k].value < arr[k - 1].value))
+            return -1;
+    }
+    return k;
+}
+
+/* Like get_value_name() but 'arr' has 'num' entries sorted by 'value' (as
+ * checked by value_name_sorted_num()) so a binary search finds the first
+ * of the run with 'value'. If num is negative searches linearly. */
+static const struct sg_lib_value_name_t *
+get_value_name_sorted(const struct sg_lib_value_name_t * arr, int num,
+                      int value, int peri_type)
+{
+    int lo, mid;
+
+    if (num < 0)
+        return get_value_name(arr, value, peri_type);
+    for (lo = 0; lo < num; ) {
+        mid = (lo + num) / 2;
+        if (arr[mid].value < value)
+            lo = mid + 1;
+        else
+            num = mid;
+    }
+    return (arr[lo].name && (value == arr[lo].value)) ?
+           get_value_name_run(arr + lo, peri_type) : NULL;
+}
+
 /* If this function is not called, sg_warnings_strm will be NULL and all users
  * (mainly fprintf() ) need to check and substitute stderr as required */
 void
@@ -346,6 +406,60 @@ sg_get_sense_key_str(int sense_key, int buff_len, char * buff)
     return buff;
 }
 
+/* Direct index from (asc << 8 | ascq) to the entry in sg_lib_asc_ascq[]
+ * (index + 1) or, with SG_ASC_ASCQ_IDX_RANGE set, in
+ * sg_lib_asc_ascq_range[]. 0 means no entry. Range entries are expanded
+ * and, as in the linear search that this replaces, take precedence over
+ * the single entries; within each table the last match wins. */
+#define SG_ASC_ASCQ_IDX_RANGE 0x8000
+#define SG_ASC_ASCQ_IDX_MASK 0x7fff
+
+static uint16_t sg_asc_ascq_idx[0x10000];
+static int sg_asc_ascq_idx_state;
+
+/* Guards a lookup index built on first use: *statep is 0 when unbuilt, 1
+ * while building and 2 when ready. The first caller runs build_fn(). Returns
+ * true when the index can be used; false if another thread is still
+ * building it, in which case the caller should search linearly. */
+static bool
+sg_lib_idx_ready(int * statep, void (*build_fn)(void))
+{
+    int expect = 0;
+
+    if (2 == __atomic_load_n(statep, __ATOMIC_ACQUIRE))
+        return true;
+    if (! __atomic_compare_exchange_n(statep, &expect, 1, false,
+                                      __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        return false;
+    build_fn();
+    __atomic_store_n(statep, 2, __ATOMIC_RELEASE);
+    return true;
+}
+
+static void
+sg_asc_ascq_idx_build(void)
+{
+    int k, j;
+
+    for (k = 0; sg_lib_asc_ascq[k].text; ++k) {
+        const struct sg_lib_asc_ascq_t * eip = &sg_lib_asc_ascq[k];
+
+        if (k >= SG_ASC_ASCQ_IDX_MASK)
+            break;
+        sg_asc_ascq_idx[(eip->asc << 8) | eip->ascq] = k + 1;
+    }
+    for (k = 0; sg_lib_asc_ascq_range[k].text; ++k) {
+        const struct sg_lib_asc_ascq_range_t * ei2p =
+                                &sg_lib_asc_ascq_range[k];
+
+        if (k >= SG_ASC_ASCQ_IDX_MASK)
+            break;
+        for (j = ei2p->ascq_min; j <= ei2p->ascq_max; ++j)
+            sg_asc_ascq_idx[(ei2p->asc << 8) | j] =
+                                SG_ASC_ASCQ_IDX_RANGE | (k + 1);
+    }
+}
+
 /* Yield string associated with ASC/ASCQ values. Returns 'buff'. */
 char *
 sg_get_additional_sense_str(int asc, int ascq, bool add_sense_leadin,
@@ -353,41 +467,51 @@ sg_get_additional_sense_str(int asc, int ascq, bool add_sense_leadin,
 {
     int k, num, rlen;
     bool found = false;
+    const struct sg_lib_asc_ascq_t * eip = NULL;
+    const struct sg_lib_asc_ascq_range_t * ei2p = NULL;
 
     if (1 == buff_len) {
         buff[0] = '\0';
         return buff;
     }
-    for (k = 0; sg_lib_asc_ascq_range[k].text; ++k) {
-        struct sg_lib_asc_ascq_range_t * ei2p = &sg_lib_asc_ascq_range[k];
-
-        if ((ei2p->asc == asc) &&
-            (ascq >= ei2p->ascq_min)  &&
-            (ascq <= ei2p->ascq_max)) {
-            found = true;
-            if (add_sense_leadin)
-                num = sg_scnpr(buff, buff_len, "Additional sense: ");
-            else
-                num = 0;
-            rlen = buff_len - num;
-            sg_scnpr(buff + num, ((rlen > 0) ? rlen : 0), ei2p->text, ascq);
+    if ((asc >= 0) && (asc <= 0xff) && (ascq >= 0) && (ascq <= 0xff) &&
+        sg_lib_idx_ready(&sg_asc_ascq_idx_state, sg_asc_ascq_idx_build)) {
+        unsigned int u = sg_asc_ascq_idx[(asc << 8) | ascq];
+
+        if (u & SG_ASC_ASCQ_IDX_RANGE)
+            ei2p = &sg_lib_asc_ascq_range[(u & SG_ASC_ASCQ_IDX_MASK) - 1];
+        else if (u)
+            eip = &sg_lib_asc_ascq[u - 1];
+    } else {
+        for (k = 0; sg_lib_asc_ascq_range[k].text; ++k) {
+            if ((sg_lib_asc_ascq_range[k].asc == asc) &&
+                (ascq >= sg_lib_asc_ascq_range[k].ascq_min)  &&
+                (ascq <= sg_lib_asc_ascq_range[k].ascq_max))
+                ei2p = &sg_lib_asc_ascq_range[k];
         }
-    }
-    if (found)
-        return buff;
-
-    for (k = 0; sg_lib_asc_ascq[k].text; ++k) {
-        struct sg_lib_asc_ascq_t * eip = &sg_lib_asc_ascq[k];
-
-        if (eip->asc == asc &&
-            eip->ascq == ascq) {
-            found = true;
-            if (add_sense_leadin)
-                sg_scnpr(buff, buff_len, "Additional sense: %s", eip->text);
-            else
-                sg_scnpr(buff, buff_len, "%s", eip->text);
+        if (NULL == ei2p) {
+            for (k = 0; sg_lib_asc_ascq[k].text; ++k) {
+                if ((sg_lib_asc_ascq[k].asc == asc) &&
+                    (sg_lib_asc_ascq[k].ascq == ascq))
+                    eip = &sg_lib_asc_ascq[k];
+            }
         }
     }
+    if (ei2p) {
+        found = true;
+        if (add_sense_leadin)
+            num = sg_scnpr(buff, buff_len, "Additional sense: ");
+        else
+            num = 0;
+        rlen = buff_len - num;
+        sg_scnpr(buff + num, ((rlen > 0) ? rlen : 0), ei2p->text, ascq);
+    } else if (eip) {
+        found = true;
+        if (add_sense_leadin)
+            sg_scnpr(buff, buff_len, "Additional sense: %s", eip->text);
+        else
+            sg_scnpr(buff, buff_len, "%s", eip->text);
+    }
     if (! found) {
         if (asc >= 0x80)
             sg_scnpr(buff, buff_len, "vendor specific ASC=%02x, ASCQ=%02x "
@@ -2282,6 +2406,58 @@ sg_scsi_normalize_sense(const uint8_t * sbp, int sb_len,
     return true;
 }
 
+/* Maps sense key, asc and ascq to a SG_LIB_CAT_* value */
+static int
+sg_err_category_sk(int sense_key, int asc, int ascq)
+{
+    switch (sense_key) {        /* 0 to 0x1f */
+    case SPC_SK_NO_SENSE:
+        return SG_LIB_CAT_NO_SENSE;
+    case SPC_SK_RECOVERED_ERROR:
+        return SG_LIB_CAT_RECOVERED;
+    case SPC_SK_NOT_READY:
+        if ((0x04 == asc) && (0x0b == ascq))
+            return SG_LIB_CAT_STANDBY;
+        if ((0x04 == asc) && (0x0c == ascq))
+            return SG_LIB_CAT_UNAVAILABLE;
+        return SG_LIB_CAT_NOT_READY;
+    case SPC_SK_MEDIUM_ERROR:
+    case SPC_SK_HARDWARE_ERROR:
+    case SPC_SK_BLANK_CHECK:
+        return SG_LIB_CAT_MEDIUM_HARD;
+    case SPC_SK_UNIT_ATTENTION:
+        return SG_LIB_CAT_UNIT_ATTENTION;
+        /* used to return SG_LIB_CAT_MEDIA_CHANGED when asc==0x28 */
+    case SPC_SK_ILLEGAL_REQUEST:
+        if ((0x20 == asc) && (0x0 == ascq))
+            return SG_LIB_CAT_INVALID_OP;
+        else if ((0x21 == asc) && (0x0 == ascq))
+            return SG_LIB_LBA_OUT_OF_RANGE;
+        else if ((0x26 == asc) && (0x0 == ascq))
+            return SG_LIB_CAT_INVALID_PARAM;
+        else
+            return SG_LIB_CAT_ILLEGAL_REQ;
+        break;
+    case SPC_SK_ABORTED_COMMAND:
+        if (0x10 == asc)
+            return SG_LIB_CAT_PROTECTION;
+        else
+            return SG_LIB_CAT_ABORTED_COMMAND;
+    case SPC_SK_MISCOMPARE:
+        return SG_LIB_CAT_MISCOMPARE;
+    case SPC_SK_DATA_PROTECT:
+        return SG_LIB_CAT_DATA_PROTECT;
+    case SPC_SK_COPY_ABORTED:
+        return SG_LIB_CAT_COPY_ABORTED;
+    case SPC_SK_COMPLETED:
+    case SPC_SK_VOLUME_OVERFLOW:
+        return SG_LIB_CAT_SENSE;
+    default:
+        ;   /* reserved and vendor specific sense keys fall through */
+    }
+    return SG_LIB_CAT_SENSE;
+}
+
 /* Returns a SG_LIB_CAT_* value. If cannot decode sense buffer (sbp) or a
  * less common sense key then return SG_LIB_CAT_SENSE .*/
 int
@@ -2290,54 +2466,199 @@ sg_err_category_sense(const uint8_t * sbp, int sb_len)
     struct sg_scsi_sense_hdr ssh;
 
     if ((sbp && (sb_len > 2)) &&
-        (sg_scsi_normalize_sense(sbp, sb_len, &ssh))) {
-        switch (ssh.sense_key) {        /* 0 to 0x1f */
-        case SPC_SK_NO_SENSE:
-            return SG_LIB_CAT_NO_SENSE;
-        case SPC_SK_RECOVERED_ERROR:
-            return SG_LIB_CAT_RECOVERED;
-        case SPC_SK_NOT_READY:
-            if ((0x04 == ssh.asc) && (0x0b == ssh.ascq))
-                return SG_LIB_CAT_STANDBY;
-            if ((0x04 == ssh.asc) && (0x0c == ssh.ascq))
-                return SG_LIB_CAT_UNAVAILABLE;
-            return SG_LIB_CAT_NOT_READY;
-        case SPC_SK_MEDIUM_ERROR:
-        case SPC_SK_HARDWARE_ERROR:
-        case SPC_SK_BLANK_CHECK:
-            return SG_LIB_CAT_MEDIUM_HARD;
-        case SPC_SK_UNIT_ATTENTION:
-            return SG_LIB_CAT_UNIT_ATTENTION;
-            /* used to return SG_LIB_CAT_MEDIA_CHANGED when ssh.asc==0x28 */
-        case SPC_SK_ILLEGAL_REQUEST:
-            if ((0x20 == ssh.asc) && (0x0 == ssh.ascq))
-                return SG_LIB_CAT_INVALID_OP;
-            else if ((0x21 == ssh.asc) && (0x0 == ssh.ascq))
-                return SG_LIB_LBA_OUT_OF_RANGE;
-            else if ((0x26 == ssh.asc) && (0x0 == ssh.ascq))
-                return SG_LIB_CAT_INVALID_PARAM;
-            else
-                return SG_LIB_CAT_ILLEGAL_REQ;
-            break;
-        case SPC_SK_ABORTED_COMMAND:
-            if (0x10 == ssh.asc)
-                return SG_LIB_CAT_PROTECTION;
-            else
-                return SG_LIB_CAT_ABORTED_COMMAND;
-        case SPC_SK_MISCOMPARE:
-            return SG_LIB_CAT_MISCOMPARE;
-        case SPC_SK_DATA_PROTECT:
-            return SG_LIB_CAT_DATA_PROTECT;
-        case SPC_SK_COPY_ABORTED:
-            return SG_LIB_CAT_COPY_ABORTED;
-        case SPC_SK_COMPLETED:
-        case SPC_SK_VOLUME_OVERFLOW:
-            return SG_LIB_CAT_SENSE;
-        default:
-            ;   /* reserved and vendor specific sense keys fall through */
+        (sg_scsi_normalize_sense(sbp, sb_len, &ssh)))
+        return sg_err_category_sk(ssh.sense_key, ssh.asc, ssh.ascq);
+    return SG_LIB_CAT_SENSE;
+}
+
+/* Decodes one sense data descriptor at bp (of dlen bytes, header included)
+ * into *sdp. Only the first descriptor of each type is used, as do the
+ * sg_get_sense_*_fld() functions. */
+static void
+sg_decode_sense_desc(const uint8_t * bp, int dlen,
+                     struct sg_sense_decode_t * sdp, bool * seenp)
+{
+    int d_type = bp[0];
+
+    if ((d_type < 16) && seenp[d_type])
+        return;
+    switch (d_type) {
+    case 0:     /* Information */
+        if (0xa != bp[1])
+            return;
+        sdp->info_valid = !!(bp[2] & 0x80);
+        sdp->info = sg_get_unaligned_be64(bp + 4);
+        break;
+    case 1:     /* Command specific information */
+        if (0xa != bp[1])
+            return;
+        sdp->cmd_spec_valid = true;
+        sdp->cmd_spec = sg_get_unaligned_be64(bp + 4);
+        break;
+    case 2:     /* Sense key specific */
+        if (0x6 != bp[1])
+            return;
+        memcpy(sdp->sks, bp + 4, 3);
+        sdp->sksv = !!(bp[4] & 0x80);
+        break;
+    case 3:     /* Field replaceable unit */
+        if (dlen < 4)
+            return;
+        sdp->fru = bp[3];
+        break;
+    case 4:     /* Stream commands */
+        if (bp[1] < 2)
+            return;
+        sdp->filemark = !!(bp[3] & 0x80);
+        sdp->eom = !!(bp[3] & 0x40);
+        sdp->ili = !!(bp[3] & 0x20);
+        break;
+    case 0xa:   /* Progress indication */
+        if (0x6 != bp[1])
+            return;
+        seenp[d_type] = true;
+        if (! sdp->progress_valid) {   /* sense key specific has priority */
+            sdp->progress_valid = true;
+            sdp->progress = sg_get_unaligned_be16(bp + 6);
         }
+        return;
+    default:
+        return;
     }
-    return SG_LIB_CAT_SENSE;
+    seenp[d_type] = true;
+}
+
+/* See description in sg_lib.h header file */
+bool
+sg_decode_sense(const uint8_t * sbp, int sb_len,
+                struct sg_sense_decode_t * sdp)
+{
+    bool seen[16];
+    int k, len, add_len, dlen, sk;
+    const uint8_t * bp;
+
+    memset(sdp, 0, sizeof(*sdp));
+    sdp->category = SG_LIB_CAT_SENSE;
+    if ((NULL == sbp) || (sb_len < 1))
+        return false;
+    sdp->resp_code = 0x7f & sbp[0];
+    if ((sdp->resp_code < 0x70) || (sdp->resp_code > 0x73))
+        return false;
+    sdp->valid = true;
+    sdp->deferred = !! (sdp->resp_code & 0x1);
+    if (sdp->resp_code >= 0x72) {       /* descriptor format */
+        sdp->desc_fmt = true;
+        if (sb_len > 1)
+            sdp->sense_key = 0xf & sbp[1];
+        if (sb_len > 2)
+            sdp->asc = sbp[2];
+        if (sb_len > 3)
+            sdp->ascq = sbp[3];
+        if (sb_len > 4)
+            sdp->sdat_ovfl = !! (0x80 & sbp[4]);
+        add_len = (sb_len > 7) ? sbp[7] : 0;
+        len = ((add_len + 8) < sb_len) ? (add_len + 8) : sb_len;
+        sdp->sb_len = len;
+        memset(seen, 0, sizeof(seen));
+        /* sense key specific progress must be seen before descriptor 0xa */
+        for (k = 8; (k + 1) < len; k += dlen) {
+            bp = sbp + k;
+            dlen = bp[1] + 2;
+            if ((k + dlen) > len)
+                break;
+            if (sdp->num_desc < SG_SENSE_DECODE_MAX_DESC)
+                sdp->desc_off[sdp->num_desc] = (uint16_t)k;
+            ++sdp->num_desc;
+            if (0xa != bp[0])
+                sg_decode_sense_desc(bp, dlen, sdp, seen);
+        }
+        sk = sdp->sense_key;
+        if (sdp->sksv &&
+            ((SPC_SK_NO_SENSE == sk) || (SPC_SK_NOT_READY == sk))) {
+            sdp->progress_valid = true;
+            sdp->progress = sg_get_unaligned_be16(sdp->sks + 1);
+        }
+        for (k = 0; (k < (int)sdp->num_desc) &&
+                    (k < SG_SENSE_DECODE_MAX_DESC); ++k) {
+            bp = sbp + sdp->desc_off[k];
+            if (0xa == bp[0])
+                sg_decode_sense_desc(bp, bp[1] + 2, sdp, seen);
+        }
+    } else {                            /* fixed format */
+        if (sb_len > 2) {
+            sdp->sense_key = 0xf & sbp[2];
+            sdp->filemark = !! (0x80 & sbp[2]);
+            sdp->eom = !! (0x40 & sbp[2]);
+            sdp->ili = !! (0x20 & sbp[2]);
+        }
+        /* as sg_scsi_normalize_sense(), asc and ascq heed the additional
+         * length; as sg_get_sense_*_fld(), the other fields do not */
+        len = sb_len;
+        if (sb_len > 7)
+            len = (sb_len < (sbp[7] + 8)) ? sb_len : (sbp[7] + 8);
+        sdp->sb_len = len;
+        if (len > 12)
+            sdp->asc = sbp[12];
+        if (len > 13)
+            sdp->ascq = sbp[13];
+        if (sb_len > 6) {
+            sdp->info_valid = !! (0x80 & sbp[0]);
+            sdp->info = sg_get_unaligned_be32(sbp + 3);
+        }
+        if (sb_len > 11) {
+            sdp->cmd_spec_valid = true;
+            sdp->cmd_spec = sg_get_unaligned_be32(sbp + 8);
+        }
+        if (sb_len > 14)
+            sdp->fru = sbp[14];
+        if (sb_len > 17) {
+            memcpy(sdp->sks, sbp + 15, 3);
+            sdp->sksv = !! (0x80 & sbp[15]);
+            sk = sdp->sense_key;
+            if (sdp->sksv &&
+                ((SPC_SK_NO_SENSE == sk) || (SPC_SK_NOT_READY == sk))) {
+                sdp->progress_valid = true;
+                sdp->progress = sg_get_unaligned_be16(sbp + 16);
+            }
+        }
+    }
+    if (sb_len > 2)
+        sdp->category = sg_err_category_sk(sdp->sense_key, sdp->asc,
+                                           sdp->ascq);
+    return true;
+}
+
+/* See description in sg_lib.h header file */
+int
+sg_sense_decode_str(const struct sg_sense_decode_t * sdp, int blen,
+                    char * b)
+{
+    int n;
+    char sk_b[48];
+    char as_b[128];
+
+    if ((NULL == b) || (blen < 1))
+        return 0;
+    b[0] = '\0';
+    if ((NULL == sdp) || (! sdp->valid))
+        return sg_scnpr(b, blen, "%s", "no valid sense data");
+    sg_get_sense_key_str(sdp->sense_key, sizeof(sk_b), sk_b);
+    sg_get_additional_sense_str(sdp->asc, sdp->ascq, false, sizeof(as_b),
+                                as_b);
+    n = sg_scnpr(b, blen, "%s%s: %s", (sdp->deferred ? "Deferred " : ""),
+                 sk_b, as_b);
+    if (sdp->info_valid)
+        n += sg_scn3pr(b, blen, n, "; info=0x%" PRIx64, sdp->info);
+    if (sdp->progress_valid)
+        n += sg_scn3pr(b, blen, n, "; progress=%d%%",
+                       (sdp->progress * 100) / 65536);
+    if (sdp->fru)
+        n += sg_scn3pr(b, blen, n, "; fru=0x%x", sdp->fru);
+    if (sdp->filemark || sdp->eom || sdp->ili)
+        n += sg_scn3pr(b, blen, n, ";%s%s%s", (sdp->filemark ?
+                       " filemark" : ""), (sdp->eom ? " eom" : ""),
+                       (sdp->ili ? " ili" : ""));
+    return n;
 }
 
 /* Beware: gives wrong answer for variable length command (opcode=0x7f) */
@@ -2410,11 +2731,50 @@ static struct op_code2sa_t op_code2sa_arr[] = {
     {0xffff, -1, NULL, NULL},
 };
 
+/* Opcode and service action indexes, built on first use. Each holds the
+ * position (plus 1, 0 for none) of the first entry with that value, which
+ * is where get_value_name() would have started its run. Service actions
+ * beyond SG_SA_IDX_NUM (e.g. variable length) are still searched. */
+#define SG_SA_IDX_NUM 32
+
+static uint16_t sg_opcode_idx[256];     /* into sg_lib_normal_opcodes[] */
+static uint8_t sg_op2sa_idx[256];       /* into op_code2sa_arr[] */
+static uint16_t sg_sa_idx[SG_ARRAY_SIZE(op_code2sa_arr)][SG_SA_IDX_NUM];
+/* entries in each service action array if sorted, else -1 */
+static int sg_sa_num[SG_ARRAY_SIZE(op_code2sa_arr)];
+static int sg_sfs_num;          /* likewise for sg_lib_scsi_feature_sets[] */
+static int sg_opcode_idx_state;
+
+static void
+sg_opcode_idx_build(void)
+{
+    int k, j, v;
+    const struct sg_lib_value_name_t * vnp;
+
+    for (k = 0; sg_lib_normal_opcodes[k].name; ++k) {
+        v = sg_lib_normal_opcodes[k].value;
+        if ((v >= 0) && (v < 256) && (0 == sg_opcode_idx[v]))
+            sg_opcode_idx[v] = k + 1;
+    }
+    for (k = 0; op_code2sa_arr[k].arr; ++k) {
+        v = op_code2sa_arr[k].op_code;
+        if ((v >= 0) && (v < 256) && (0 == sg_op2sa_idx[v]))
+            sg_op2sa_idx[v] = k + 1;
+        sg_sa_num[k] = value_name_sorted_num(op_code2sa_arr[k].arr);
+        for (j = 0, vnp = op_code2sa_arr[k].arr; vnp->name; ++j, ++vnp) {
+            v = vnp->value;
+            if ((v >= 0) && (v < SG_SA_IDX_NUM) && (0 == sg_sa_idx[k][v]))
+                sg_sa_idx[k][v] = j + 1;
+        }
+    }
+    sg_sfs_num = value_name_sorted_num(sg_lib_scsi_feature_sets);
+}
+
 void
 sg_get_opcode_sa_name(uint8_t cmd_byte0, int service_action,
                       int peri_type, int buff_len, char * buff)
 {
-    int d_pdt;
+    int d_pdt, k, j;
     const struct sg_lib_value_name_t * vnp;
     const struct op_code2sa_t * osp;
     char b[80];
@@ -2429,25 +2789,38 @@ sg_get_opcode_sa_name(uint8_t cmd_byte0, int service_action,
     if (peri_type < 0)
         peri_type = 0;
     d_pdt = sg_lib_pdt_decay(peri_type);
-    for (osp = op_code2sa_arr; osp->arr; ++osp) {
-        if ((int)cmd_byte0 == osp->op_code) {
-            if (sg_pdt_s_eq(osp->pdt_s, d_pdt)) {
-                vnp = get_value_name(osp->arr, service_action, peri_type);
-                if (vnp) {
-                    if (osp->prefix)
-                        sg_scnpr(buff, buff_len, "%s, %s", osp->prefix,
-                                 vnp->name);
-                    else
-                        sg_scnpr(buff, buff_len, "%s", vnp->name);
-                } else {
-                    sg_get_opcode_name(cmd_byte0, peri_type, sizeof(b), b);
-                    sg_scnpr(buff, buff_len, "%s service action=0x%x", b,
-                             service_action);
-                }
-            } else
-                sg_get_opcode_name(cmd_byte0, peri_type, buff_len, buff);
-            return;
+    if (sg_lib_idx_ready(&sg_opcode_idx_state, sg_opcode_idx_build)) {
+        k = sg_op2sa_idx[cmd_byte0];
+        osp = k ? (op_code2sa_arr + k - 1) : NULL;
+    } else {
+        for (osp = op_code2sa_arr; osp->arr; ++osp) {
+            if ((int)cmd_byte0 == osp->op_code)
+                break;
         }
+        if (NULL == osp->arr)
+            osp = NULL;
+        k = 0;
+    }
+    if (osp && sg_pdt_s_eq(osp->pdt_s, d_pdt)) {
+        if (k && (service_action >= 0) && (service_action < SG_SA_IDX_NUM)) {
+            j = sg_sa_idx[k - 1][service_action];
+            vnp = j ? get_value_name_run(osp->arr + j - 1, peri_type) : NULL;
+        } else if (k)   /* e.g. variable length service actions */
+            vnp = get_value_name_sorted(osp->arr, sg_sa_num[k - 1],
+                                        service_action, peri_type);
+        else
+            vnp = get_value_name(osp->arr, service_action, peri_type);
+        if (vnp) {
+            if (osp->prefix)
+                sg_scnpr(buff, buff_len, "%s, %s", osp->prefix, vnp->name);
+            else
+                sg_scnpr(buff, buff_len, "%s", vnp->name);
+        } else {
+            sg_get_opcode_name(cmd_byte0, peri_type, sizeof(b), b);
+            sg_scnpr(buff, buff_len, "%s service action=0x%x", b,
+                     service_action);
+        }
+        return;
     }
     sg_get_opcode_name(cmd_byte0, peri_type, buff_len, buff);
 }
@@ -2476,7 +2849,14 @@ sg_get_opcode_name(uint8_t cmd_byte0, int peri_type, int buff_len,
     case 2:
     case 4:
     case 5:
-        vnp = get_value_name(sg_lib_normal_opcodes, cmd_byte0, peri_type);
+        if (sg_lib_idx_ready(&sg_opcode_idx_state, sg_opcode_idx_build)) {
+            int k = sg_opcode_idx[cmd_byte0];
+
+            vnp = k ? get_value_name_run(sg_lib_normal_opcodes + k - 1,
+                                         peri_type) : NULL;
+        } else
+            vnp = get_value_name(sg_lib_normal_opcodes, cmd_byte0,
+                                 peri_type);
         if (vnp)
             sg_scnpr(buff, buff_len, "%s", vnp->name);
         else
@@ -2492,6 +2872,41 @@ sg_get_opcode_name(uint8_t cmd_byte0, int peri_type, int buff_len,
     }
 }
 
+/* NVMe opcode and status indexes, built on first use. Like the opcode
+ * indexes above each holds the position (plus 1, 0 for none) of the first
+ * entry with that value. The status index is keyed by the 10 bit SCT and
+ * SC, which is all that the NVMe to SCSI translation looks at. */
+static uint16_t sg_nvme_op_idx[2][256];         /* [admin][opcode] */
+static uint16_t sg_nvme_status_idx[0x400];
+static int sg_nvme_sss_num;     /* entries in sg_lib_scsi_status_sense_arr */
+static int sg_nvme_idx_state;
+
+static void
+sg_nvme_idx_build(void)
+{
+    int k, j, v;
+    const struct sg_lib_simple_value_name_t * svp;
+
+    for (j = 0; j < 2; ++j) {
+        svp = j ? sg_lib_nvme_admin_cmd_arr : sg_lib_nvme_nvm_cmd_arr;
+        for (k = 0; svp[k].name; ++k) {
+            v = (uint8_t)svp[k].value;
+            if (0 == sg_nvme_op_idx[j][v])
+                sg_nvme_op_idx[j][v] = k + 1;
+        }
+    }
+    for (k = 0; sg_lib_nvme_cmd_status_arr[k].name; ++k) {
+        v = 0x3ff & sg_lib_nvme_cmd_status_arr[k].value;
+        if (((uint16_t)sg_lib_nvme_cmd_status_arr[k].value == v) &&
+            (0 == sg_nvme_status_idx[v]))
+            sg_nvme_status_idx[v] = k + 1;
+    }
+    for (k = 0; (0xff != sg_lib_scsi_status_sense_arr[k].t2) && (k < 1000);
+         ++k)
+        ;
+    sg_nvme_sss_num = k;
+}
+
 /* Fetch NVMe command name given first byte (byte offset 0 in 64 byte
  * command) of command. Gets Admin NVMe command name if 'admin' is true
  * (e.g. opcode=0x6 -> Identify), otherwise gets NVM command set name
@@ -2509,11 +2924,20 @@ sg_get_nvme_opcode_name(uint8_t cmd_byte0, bool admin, int buff_len,
         buff[0] = '\0';
         return buff;
     }
-    for ( ; vnp->name; ++vnp) {
-        if (cmd_byte0 == (uint8_t)vnp->value) {
-            snprintf(buff, buff_len, "%s", vnp->name);
+    if (sg_lib_idx_ready(&sg_nvme_idx_state, sg_nvme_idx_build)) {
+        int k = sg_nvme_op_idx[admin ? 1 : 0][cmd_byte0];
+
+        if (k) {
+            snprintf(buff, buff_len, "%s", vnp[k - 1].name);
             return buff;
         }
+    } else {
+        for ( ; vnp->name; ++vnp) {
+            if (cmd_byte0 == (uint8_t)vnp->value) {
+                snprintf(buff, buff_len, "%s", vnp->name);
+                return buff;
+            }
+        }
     }
     if (admin) {
         if (cmd_byte0 >= 0xc0)
@@ -2575,6 +2999,108 @@ sg_vpd_dev_id_iter(const uint8_t * initial_desig_desc, int page_len,
     return (k == page_len) ? -1 : -2;
 }
 
+void
+sg_vpd_dev_id_index(const uint8_t * initial_desig_desc, int page_len,
+                    struct sg_vpd_dev_id_idx * ixp)
+{
+    int k, n, a, t, res;
+    int off = -1;
+    int8_t a_tail[4];
+    int8_t at_tail[4][16];
+    const uint8_t * bp = initial_desig_desc;
+
+    ixp->bp = bp;
+    ixp->page_len = page_len;
+    memset(ixp->a_head, 0xff, sizeof(ixp->a_head));
+    memset(ixp->at_head, 0xff, sizeof(ixp->at_head));
+    memset(a_tail, 0xff, sizeof(a_tail));
+    memset(at_tail, 0xff, sizeof(at_tail));
+    for (n = 0; 0 == (res = sg_vpd_dev_id_iter(bp, page_len, &off, -1, -1,
+                                                -1)); ++n) {
+        if (n >= SG_VPD_DI_IDX_MAX) {
+            ixp->num = -1;      /* sg_vpd_dev_id_next() will iterate */
+            return;
+        }
+        k = off;
+        a = (bp[k + 1] >> 4) & 0x3;
+        t = bp[k + 1] & 0xf;
+        ixp->off[n] = k;
+        ixp->a_next[n] = -1;
+        ixp->at_next[n] = -1;
+        if (a_tail[a] < 0)
+            ixp->a_head[a] = n;
+        else
+            ixp->a_next[a_tail[a]] = n;
+        a_tail[a] = n;
+        if (at_tail[a][t] < 0)
+            ixp->at_head[a][t] = n;
+        else
+            ixp->at_next[at_tail[a][t]] = n;
+        at_tail[a][t] = n;
+    }
+    ixp->num = n;
+    ixp->end_res = res;
+}
+
+/* Index of the descriptor after n in the chain selected by m_assoc and
+ * m_desig_type, -1 (or ixp->num) at its end */
+static int
+dev_id_idx_step(const struct sg_vpd_dev_id_idx * ixp, int n, int m_assoc,
+                int m_desig_type)
+{
+    if (m_assoc < 0)
+        return n + 1;
+    else if (m_desig_type < 0)
+        return ixp->a_next[n];
+    else
+        return ixp->at_next[n];
+}
+
+int
+sg_vpd_dev_id_next(const struct sg_vpd_dev_id_idx * ixp, int * off,
+                   int m_assoc, int m_desig_type, int m_code_set)
+{
+    int n, lo, hi;
+    const uint8_t * dp;
+
+    if (ixp->num < 0)
+        return sg_vpd_dev_id_iter(ixp->bp, ixp->page_len, off, m_assoc,
+                                  m_desig_type, m_code_set);
+    if ((m_assoc > 3) || (m_desig_type > 15))
+        return ixp->end_res;
+    if (*off < 0) {
+        if (m_assoc < 0)
+            n = 0;
+        else if (m_desig_type < 0)
+            n = ixp->a_head[m_assoc];
+        else
+            n = ixp->at_head[m_assoc][m_desig_type];
+    } else {    /* binary search for the previous descriptor */
+        for (lo = 0, hi = ixp->num; lo < hi; ) {
+            n = (lo + hi) / 2;
+            if (ixp->off[n] < *off)
+                lo = n + 1;
+            else
+                hi = n;
+        }
+        if ((lo >= ixp->num) || (ixp->off[lo] != *off))
+            return sg_vpd_dev_id_iter(ixp->bp, ixp->page_len, off, m_assoc,
+                                      m_desig_type, m_code_set);
+        n = dev_id_idx_step(ixp, lo, m_assoc, m_desig_type);
+    }
+    while ((n >= 0) && (n < ixp->num)) {
+        dp = ixp->bp + ixp->off[n];
+        if (((m_assoc < 0) || (((dp[1] >> 4) & 0x3) == m_assoc)) &&
+            ((m_desig_type < 0) || ((dp[1] & 0xf) == m_desig_type)) &&
+            ((m_code_set < 0) || ((dp[0] & 0xf) == m_code_set))) {
+            *off = ixp->off[n];
+            return 0;
+        }
+        n = dev_id_idx_step(ixp, n, m_assoc, m_desig_type);
+    }
+    return ixp->end_res;
+}
+
 static const char * sg_sfs_spc_reserved = "SPC Reserved";
 static const char * sg_sfs_sbc_reserved = "SBC Reserved";
 static const char * sg_sfs_ssc_reserved = "SSC Reserved";
@@ -2614,7 +3140,11 @@ sg_get_sfs_str(uint16_t sfs_code, int peri_type, int buff_len, char * buff,
         return NULL;
     }
     my_pdt = ((peri_type < -1) || (peri_type > PDT_MAX)) ? -2 : peri_type;
-    vnp = get_value_name(sg_lib_scsi_feature_sets, sfs_code, my_pdt);
+    if (sg_lib_idx_ready(&sg_opcode_idx_state, sg_opcode_idx_build))
+        vnp = get_value_name_sorted(sg_lib_scsi_feature_sets, sg_sfs_num,
+                                    sfs_code, my_pdt);
+    else
+        vnp = get_value_name(sg_lib_scsi_feature_sets, sfs_code, my_pdt);
     if (vnp && (-2 != my_pdt)) {
         if (! sg_pdt_s_eq(my_pdt, vnp->peri_dev_type))
             vnp = NULL;      /* shouldn't really happen */
@@ -2757,6 +3287,16 @@ sg_get_nvme_cmd_status_str(uint16_t sct_sc, int b_len, char * b)
         b[0] = '\0';
         return b;
     }
+    if (sg_lib_idx_ready(&sg_nvme_idx_state, sg_nvme_idx_build)) {
+        k = sg_nvme_status_idx[s];
+        if (k) {
+            strncpy(b, vp[k - 1].name, b_len);
+            b[b_len - 1] = '\0';
+            return b;
+        }
+        snprintf(b, b_len, "Reserved [0x%x]", sct_sc);
+        return b;
+    }
     for (k = 0; (vp->name && (k < 1000)); ++k, ++vp) {
         if (s == (uint16_t)vp->value) {
             strncpy(b, vp->name, b_len);
@@ -2783,6 +3323,16 @@ sg_nvme_status2scsi(uint16_t sct_sc, uint8_t * status_p, uint8_t * sk_p,
     struct sg_lib_value_name_t * vp = sg_lib_nvme_cmd_status_arr;
     struct sg_lib_4tuple_u8 * mp = sg_lib_scsi_status_sense_arr;
 
+    if (sg_lib_idx_ready(&sg_nvme_idx_state, sg_nvme_idx_build)) {
+        k = sg_nvme_status_idx[s];
+        if (0 == k)
+            return false;
+        ind = vp[k - 1].peri_dev_type;
+        if ((ind < 0) || (ind >= sg_nvme_sss_num))
+            return false;
+        mp += ind;
+        goto fini;
+    }
     for (k = 0; (vp->name && (k < 1000)); ++k, ++vp) {
         if (s == (uint16_t)vp->value)
             break;
@@ -2807,6 +3357,7 @@ sg_nvme_status2scsi(uint16_t sct_sc, uint8_t * status_p, uint8_t * sk_p,
         return false;
 
     mp = sg_lib_scsi_status_sense_arr + ind;
+fini:
     if (status_p)
         *status_p = mp->t1;
     if (sk_p)
@@ -2893,34 +3444,57 @@ trimTrailingSpaces(char * b)
     return n;
 }
 
+/* Places two ASCII hex digits for 'c' at 'p', no trailing null */
+static inline void
+hex_2digits(char * p, uint8_t c)
+{
+    p[0] = bin2hexascii[c >> 4];
+    p[1] = bin2hexascii[c & 0xf];
+}
+
+/* Same as sprintf(p, "%.2x", v) but without the trailing null. Returns the
+ * number of characters placed at 'p'. */
+static int
+hex_addr_digits(char * p, uint32_t v)
+{
+    int k, n;
+    char d[8];
+
+    for (n = 0; (n < 2) || v; ++n, v >>= 4)
+        d[n] = bin2hexascii[v & 0xf];
+    for (k = 0; k < n; ++k)
+        p[k] = d[n - 1 - k];
+    return n;
+}
+
+#define DSHF_OBUF_LEN 8192      /* dStrHexFp() output buffer size */
+
 /* Read binary starting at 'str' for 'len' bytes and output as ASCII
  * hexadecinal into file pointer (fp). 16 bytes per line are output with an
  * additional space between 8th and 9th byte on each line (for readability).
  * 'no_ascii' selects one of 3 output format types:
  *     > 0     each line has address then up to 16 ASCII-hex bytes
  *     = 0     in addition, the bytes are listed in ASCII to the right
- *     < 0     only the ASCII-hex bytes are listed (i.e. without address) */
+ *     < 0     only the ASCII-hex bytes are listed (i.e. without address)
+ * Lines are built with table lookups and gathered in a buffer that is
+ * written with fwrite() when nearly full. */
 void
 dStrHexFp(const char* str, int len, int no_ascii, FILE * fp)
 {
-    const char * p = str;
-    const char * formatstr;
+    const uint8_t * p = (const uint8_t *)str;
     uint8_t c;
     char buff[82];
+    char obuf[DSHF_OBUF_LEN];
     int a = 0;
     int bpstart = 5;
     const int cpstart = 60;
     int cpos = cpstart;
     int bpos = bpstart;
-    int i, k, blen;
+    int i, k, on;
 
     if (len <= 0)
         return;
-    blen = (int)sizeof(buff);
-    if (0 == no_ascii)  /* address at left and ASCII at right */
-        formatstr = "%.76s\n";
-    else                        /* previously when > 0 str was "%.58s\n" */
-        formatstr = "%s\n";     /* when < 0 str was: "%.48s\n" */
+    on = 0;
     memset(buff, ' ', 80);
     buff[80] = '\0';
     if (no_ascii < 0) {
@@ -2930,25 +3504,31 @@ dStrHexFp(const char* str, int len, int no_ascii, FILE * fp)
             c = *p++;
             if (bpos == (bpstart + (8 * 3)))
                 bpos++;
-            sg_scn3pr(buff, blen, bpos, "%.2x", (int)(uint8_t)c);
-            buff[bpos + 2] = ' ';
+            hex_2digits(buff + bpos, c);
             if ((k > 0) && (0 == ((k + 1) % 16))) {
-                trimTrailingSpaces(buff);
-                fprintf(fp, formatstr, buff);
+                /* full line: last hex digit is last non-space */
+                memcpy(obuf + on, buff, bpos + 2);
+                on += bpos + 2;
+                obuf[on++] = '\n';
+                if (on > (DSHF_OBUF_LEN - 84)) {
+                    fwrite(obuf, 1, on, fp);
+                    on = 0;
+                }
                 bpos = bpstart;
                 memset(buff, ' ', 80);
             } else
                 bpos += 3;
         }
         if (bpos > bpstart) {
-            buff[bpos + 2] = '\0';
-            trimTrailingSpaces(buff);
-            fprintf(fp, "%s\n", buff);
+            buff[bpos - 1] = '\0';
+            on += sg_scnpr(obuf + on, (int)sizeof(obuf) - on, "%s\n", buff);
         }
+        if (on > 0)
+            fwrite(obuf, 1, on, fp);
         return;
     }
     /* no_ascii>=0, start each line with address (offset) */
-    k = sg_scnpr(buff + 1, blen - 1, "%.2x", a);
+    k = hex_addr_digits(buff + 1, a);
     buff[k + 1] = ' ';
 
     for (i = 0; i < len; i++) {
@@ -2956,8 +3536,7 @@ dStrHexFp(const char* str, int len, int no_ascii, FILE * fp)
         bpos += 3;
         if (bpos == (bpstart + (9 * 3)))
             bpos++;
-        sg_scn3pr(buff, blen, bpos, "%.2x", (int)(uint8_t)c);
-        buff[bpos + 2] = ' ';
+        hex_2digits(buff + bpos, c);
         if (no_ascii)
             buff[cpos++] = ' ';
         else {
@@ -2966,14 +3545,25 @@ dStrHexFp(const char* str, int len, int no_ascii, FILE * fp)
             buff[cpos++] = c;
         }
         if (cpos > (cpstart + 15)) {
-            if (no_ascii)
-                trimTrailingSpaces(buff);
-            fprintf(fp, formatstr, buff);
+            if (no_ascii) {
+                k = trimTrailingSpaces(buff);
+                memcpy(obuf + on, buff, k);
+                on += k;
+                buff[k] = ' ';
+            } else {
+                memcpy(obuf + on, buff, 76);
+                on += 76;
+            }
+            obuf[on++] = '\n';
+            if (on > (DSHF_OBUF_LEN - 84)) {
+                fwrite(obuf, 1, on, fp);
+                on = 0;
+            }
             bpos = bpstart;
             cpos = cpstart;
             a += 16;
             memset(buff, ' ', 80);
-            k = sg_scnpr(buff + 1, blen - 1, "%.2x", a);
+            k = hex_addr_digits(buff + 1, a);
             buff[k + 1] = ' ';
         }
     }
@@ -2981,8 +3571,10 @@ dStrHexFp(const char* str, int len, int no_ascii, FILE * fp)
         buff[cpos] = '\0';
         if (no_ascii)
             trimTrailingSpaces(buff);
-        fprintf(fp, "%s\n", buff);
+        on += sg_scnpr(obuf + on, (int)sizeof(obuf) - on, "%s\n", buff);
     }
+    if (on > 0)
+        fwrite(obuf, 1, on, fp);
 }
 
 void
@@ -3001,6 +3593,23 @@ dStrHexErr(const char* str, int len, int no_ascii)
 #define DSHS_LINE_BLEN 160      /* maximum characters per line */
 #define DSHS_BPL 16             /* bytes per line */
 
+/* Appends 'slen' chars from 'src' to 'b' at offset 'n' truncating, and
+ * returning the count, exactly as sg_scn3pr(b, b_len, n, "%s", src) would
+ * but without the format parsing. */
+static int
+hex_scn3cpy(char * b, int b_len, int n, const char * src, int slen)
+{
+    const int max_len = b_len - n;
+
+    if (max_len < 2)
+        return 0;
+    if (slen > (max_len - 1))
+        slen = max_len - 1;
+    memcpy(b + n, src, slen);
+    b[n + slen] = '\0';
+    return slen;
+}
+
 /* Read 'len' bytes from 'str' and output as ASCII-Hex bytes (space separated)
  * to 'b' not to exceed 'b_len' characters. Each line starts with 'leadin'
  * (NULL for no leadin) and there are 16 bytes per line with an extra space
@@ -3016,12 +3625,12 @@ dStrHexStr(const char * str, int len, const char * leadin, int oformat,
            int b_len, char * b)
 {
     bool want_ascii = (0 == oformat);
-    int bpstart, bpos, k, n, prior_ascii_len;
+    int bpstart, bpos, k, n, m, prior_ascii_len;
     char buff[DSHS_LINE_BLEN + 2];      /* allow for trailing null */
     char a[DSHS_BPL + 1];               /* printable ASCII bytes or '.' */
     const char * p = str;
     const char * lf_or = (oformat > 1) ? "  " : "\n";
-    static const int bufflen = sizeof(buff);
+    const int lf_or_len = (oformat > 1) ? 2 : 1;
 
     if (len <= 0) {
         if (b_len > 0)
@@ -3057,18 +3666,25 @@ dStrHexStr(const char * str, int len, const char * leadin, int oformat,
 
         if (bpos == (bpstart + ((DSHS_BPL / 2) * 3)))
             bpos++;     /* for extra space in middle of each line's hex */
-        sg_scn3pr(buff, bufflen, bpos, "%.2x", (int)(uint8_t)c);
-        buff[bpos + 2] = ' ';
+        hex_2digits(buff + bpos, c);
         if (want_ascii)
             a[k % DSHS_BPL] = my_isprint(c) ? c : '.';
         if ((k > 0) && (0 == ((k + 1) % DSHS_BPL))) {
-            trimTrailingSpaces(buff);
+            /* full line so last hex digit is at bpos + 1 */
+            m = bpos + 2;
             if (want_ascii) {
-                n += sg_scn3pr(b, b_len, n, "%-*s   %s\n", prior_ascii_len,
-                               buff, a);
+                /* as "%-*s   %s\n" with prior_ascii_len, buff and a */
+                for ( ; m < prior_ascii_len; ++m)
+                    buff[m] = ' ';
+                memcpy(buff + m, "   ", 3);
+                memcpy(buff + m + 3, a, DSHS_BPL);
+                buff[m + 3 + DSHS_BPL] = '\n';
+                n += hex_scn3cpy(b, b_len, n, buff, m + 4 + DSHS_BPL);
                 memset(a, ' ', DSHS_BPL);
-            } else
-                n += sg_scn3pr(b, b_len, n, "%s%s", buff, lf_or);
+            } else {
+                memcpy(buff + m, lf_or, lf_or_len);
+                n += hex_scn3cpy(b, b_len, n, buff, m + lf_or_len);
+            }
             if (n >= (b_len - 1))
                 goto fini;
             memset(buff, ' ', DSHS_LINE_BLEN);
@@ -3115,17 +3731,22 @@ void
 hex2fp(const uint8_t * b_str, int len, const char * leadin, int oformat,
        FILE * fp)
 {
-    int k, num;
-    char b[800];        /* allow for 4 lines of 16 bytes (in hex) each */
+    /* oformat > 1 puts leadin at the start of each hex2str() call, so keep
+     * its 64 byte chunks; otherwise any multiple of 16 gives the same output
+     * so use bigger chunks (64 lines, each less than DSHS_LINE_BLEN) */
+    const int chunk = (oformat > 1) ? 64 : 1024;
+    int k, n, num;
+    char b[(1024 / DSHS_BPL) * DSHS_LINE_BLEN];
 
     if (leadin && (strlen(leadin) > 118)) {
         fprintf(fp, ">>> leadin parameter is too large\n");
         return;
     }
     for (k = 0; k < len; k += num) {
-        num = ((k + 64) < len) ? 64 : (len - k);
-        hex2str(b_str + k, num, leadin, oformat, sizeof(b), b);
-        fprintf(fp, "%s", b);
+        num = ((k + chunk) < len) ? chunk : (len - k);
+        n = hex2str(b_str + k, num, leadin, oformat, sizeof(b), b);
+        if (n > 0)
+            fwrite(b, 1, n, fp);
     }
 }
 
@@ -3145,16 +3766,74 @@ sg_is_big_endian()
                                     the most significant byte */
 }
 
+/* Returns true if all n bytes at bp equal val. Once bp is 16 byte aligned
+ * 64 bytes are checked per iteration. SSE2 and NEON are baseline on x86_64
+ * and aarch64 respectively (so no runtime dispatch is needed), elsewhere
+ * 8 byte words are compared. */
+static bool
+sg_all_bytes_eq(const uint8_t * bp, size_t n, uint8_t val)
+{
+    uint64_t u, w;
+
+    for ( ; (n > 0) && ((uintptr_t)bp & 0xf); --n, ++bp) {
+        if (val != *bp)
+            return false;
+    }
+#if defined(__SSE2__)
+    {
+        const __m128i v = _mm_set1_epi8((char)val);
+        const __m128i z = _mm_setzero_si128();
+        __m128i x;
+
+        for ( ; n >= 64; n -= 64, bp += 64) {
+            x = _mm_or_si128(
+                    _mm_or_si128(
+                        _mm_xor_si128(_mm_load_si128((const __m128i *)bp), v),
+                        _mm_xor_si128(_mm_load_si128(
+                                        (const __m128i *)(bp + 16)), v)),
+                    _mm_or_si128(
+                        _mm_xor_si128(_mm_load_si128(
+                                        (const __m128i *)(bp + 32)), v),
+                        _mm_xor_si128(_mm_load_si128(
+                                        (const __m128i *)(bp + 48)), v)));
+            if (0xffff != _mm_movemask_epi8(_mm_cmpeq_epi8(x, z)))
+                return false;
+        }
+    }
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+    {
+        const uint8x16_t v = vdupq_n_u8(val);
+        uint8x16_t x;
+
+        for ( ; n >= 64; n -= 64, bp += 64) {
+            x = vorrq_u8(vorrq_u8(veorq_u8(vld1q_u8(bp), v),
+                                  veorq_u8(vld1q_u8(bp + 16), v)),
+                         vorrq_u8(veorq_u8(vld1q_u8(bp + 32), v),
+                                  veorq_u8(vld1q_u8(bp + 48), v)));
+            if (vmaxvq_u8(x))
+                return false;
+        }
+    }
+#endif
+    w = 0x0101010101010101ULL * val;
+    for ( ; n >= 8; n -= 8, bp += 8) {
+        memcpy(&u, bp, sizeof(u));
+        if (w != u)
+            return false;
+    }
+    for ( ; n > 0; --n, ++bp) {
+        if (val != *bp)
+            return false;
+    }
+    return true;
+}
+
 bool
 sg_all_zeros(const uint8_t * bp, int b_len)
 {
     if ((NULL == bp) || (b_len <= 0))
         return false;
-    for (--b_len; b_len >= 0; --b_len) {
-        if (0x0 != bp[b_len])
-            return false;
-    }
-    return true;
+    return sg_all_bytes_eq(bp, (size_t)b_len, 0x0);
 }
 
 bool
@@ -3162,11 +3841,21 @@ sg_all_ffs(const uint8_t * bp, int b_len)
 {
     if ((NULL == bp) || (b_len <= 0))
         return false;
-    for (--b_len; b_len >= 0; --b_len) {
-        if (0xff != bp[b_len])
-            return false;
+    return sg_all_bytes_eq(bp, (size_t)b_len, 0xff);
+}
+
+int
+sg_first_non_zero_blk(const uint8_t * bp, int num_blks, int blk_sz)
+{
+    int k;
+
+    if ((NULL == bp) || (blk_sz <= 0))
+        return -1;
+    for (k = 0; k < num_blks; ++k, bp += blk_sz) {
+        if (! sg_all_bytes_eq(bp, (size_t)blk_sz, 0x0))
+            break;
     }
-    return true;
+    return k;
 }
 
 /* If its all printable then return value equals b_len */
@@ -3636,7 +4325,319 @@ sg_get_llnum_nomult(const char * buf)
     return (1 == res) ? num : -1;
 }
 
-#define MAX_NUM_ASCII_LINES 1048576
+/* Character classes used when decoding ASCII hexadecimal. A hex digit maps
+ * to 0x10 plus its value, anything not listed maps to 0 (a syntax error). */
+#define HX_IS_DIGIT(c) (0x10 == ((c) & 0xf0))
+#define HS 0x20         /* separator: space, tab, comma or hyphen */
+#define HN 0x21         /* newline */
+#define HC 0x22         /* '#' or carriage return: rest of line ignored */
+
+static const uint8_t sg_hx_class[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, HS, HN, 0, 0, HC, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    HS, 0, 0, HC, 0, 0, 0, 0, 0, 0, 0, 0, HS, HS, 0, 0,
+    0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17,
+    0x18, 0x19, 0, 0, 0, 0, 0, 0,
+    0, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+};
+
+#if defined(__SSE2__) || (defined(__aarch64__) && defined(__ARM_NEON))
+#define SG_HEX_SIMD 1
+
+/* Decodes the 16 ASCII hex digits at ip into 8 bytes at op. Returns false,
+ * having written nothing, if any of the 16 is not a hex digit. op may be
+ * at or below ip (all 16 are loaded before anything is stored). */
+static inline bool
+sg_hex16_2bin(const uint8_t * ip, uint8_t * op)
+{
+#if defined(__SSE2__)
+    const __m128i v = _mm_loadu_si128((const __m128i *)ip);
+    const __m128i lc = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    __m128i is_d, is_a, n, w;
+
+    /* signed compares, so bytes 0x80 and above are in neither range */
+    is_d = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                         _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+    is_a = _mm_and_si128(_mm_cmpgt_epi8(lc, _mm_set1_epi8('a' - 1)),
+                         _mm_cmplt_epi8(lc, _mm_set1_epi8('f' + 1)));
+    if (0xffff != _mm_movemask_epi8(_mm_or_si128(is_d, is_a)))
+        return false;
+    n = _mm_or_si128(
+            _mm_and_si128(is_d, _mm_sub_epi8(v, _mm_set1_epi8('0'))),
+            _mm_and_si128(is_a, _mm_sub_epi8(lc, _mm_set1_epi8('a' - 10))));
+    /* the first (high) nibble of each pair is in the low byte of a lane */
+    w = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(n, _mm_set1_epi16(0xff)),
+                                    4),
+                     _mm_srli_epi16(n, 8));
+    _mm_storel_epi64((__m128i *)op, _mm_packus_epi16(w, w));
+    return true;
+#else
+    const uint8x8x2_t v = vld2_u8(ip);  /* [0]: high, [1]: low nibbles */
+    uint8x8_t d[2], a[2], is_d[2], is_a[2], ok;
+    int k;
+
+    for (k = 0; k < 2; ++k) {
+        /* unsigned wrap around puts non digits at 10 or more */
+        d[k] = vsub_u8(v.val[k], vdup_n_u8('0'));
+        a[k] = vsub_u8(vorr_u8(v.val[k], vdup_n_u8(0x20)), vdup_n_u8('a'));
+        is_d[k] = vclt_u8(d[k], vdup_n_u8(10));
+        is_a[k] = vclt_u8(a[k], vdup_n_u8(6));
+        d[k] = vorr_u8(vand_u8(is_d[k], d[k]),
+                       vand_u8(is_a[k], vadd_u8(a[k], vdup_n_u8(10))));
+    }
+    ok = vand_u8(vorr_u8(is_d[0], is_a[0]), vorr_u8(is_d[1], is_a[1]));
+    if (0xff != vminv_u8(ok))
+        return false;
+    vst1_u8(op, vorr_u8(vshl_n_u8(d[0], 4), d[1]));
+    return true;
+#endif
+}
+#endif
+
+/* Decodes ilen bytes of ASCII hex at ip into binary at op, see
+ * sg_f2hex_arr() for the syntax. Each output byte is stored only after the
+ * input that it came from has been read, and never above it, so op may be
+ * equal to ip (i.e. decode in place). The whole input is in memory so,
+ * unlike reading with fgets(), there are no split lines to worry about.
+ * One table lookup classifies each character. With no_space, runs of 16
+ * hex digits are decoded 8 bytes at a time with SSE2 or NEON when
+ * available. */
+static int
+sg_hex_txt2bin(const uint8_t * ip, int ilen, bool no_space, bool skip_first,
+               uint8_t * op, int * op_len, int max_op_len)
+{
+    bool first = skip_first;
+    int c, h;
+    int line = 1;
+    int off = 0;
+    int carry = -1;     /* no_space: first nibble of a pair split by newline */
+    const uint8_t * p = ip;
+    const uint8_t * lp = ip;    /* start of current line */
+    const uint8_t * tp;
+    const uint8_t * ep = ip + ilen;
+
+    while (p < ep) {
+        c = sg_hx_class[*p];
+        if (HS == c) {
+            ++p;
+            continue;
+        } else if (HN == c) {
+            lp = ++p;
+            ++line;
+            first = skip_first;
+            continue;
+        } else if (HC == c) {
+            p = (const uint8_t *)memchr(p, '\n', ep - p);
+            if (NULL == p)
+                break;
+            continue;
+        } else if (! HX_IS_DIGIT(c)) {
+            pr2ws("%s: syntax error at line %d, pos %d\n", __func__, line,
+                  (int)(p - lp) + 1);
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        tp = p;
+        if (no_space) {
+            if (carry >= 0) {
+                h = (carry << 4) | (c & 0xf);
+                carry = -1;
+                ++p;
+                goto store;
+            }
+#ifdef SG_HEX_SIMD
+            if (((ep - p) >= 16) && ((max_op_len - off) >= 8) &&
+                sg_hex16_2bin(p, op + off)) {
+                p += 16;
+                off += 8;
+                continue;
+            }
+#endif
+            h = ((p + 1) < ep) ? sg_hx_class[p[1]] : HN;
+            if (HX_IS_DIGIT(h)) {
+                h = ((c & 0xf) << 4) | (h & 0xf);
+                p += 2;
+                goto store;
+            } else if ((HN == h) || (HC == h)) {
+                /* pair with the first hex digit on the next line */
+                carry = c & 0xf;
+                ++p;
+                continue;
+            }
+            pr2ws("%s: odd number of hex digits at line %d, pos %d\n",
+                  __func__, line, (int)(p - lp) + 2);
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        /* (white)space separated ASCII hexadecimal bytes */
+        for (h = 0; (p < ep) && HX_IS_DIGIT(c = sg_hx_class[*p]); ++p) {
+            if (h <= 0xff)      /* once too large, stays too large */
+                h = (h << 4) | (c & 0xf);
+        }
+        if ((p < ep) && (0 == c)) {
+            pr2ws("%s: syntax error at line %d, pos %d\n", __func__, line,
+                  (int)(p - lp) + 1);
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        if (first) {    /* skip a running address, however large */
+            first = false;
+            continue;
+        }
+        if (h > 0xff) {
+            pr2ws("%s: hex number larger than 0xff in line %d, pos %d\n",
+                  __func__, line, (int)(tp - lp) + 1);
+            return SG_LIB_SYNTAX_ERROR;
+        }
+store:
+        if (off >= max_op_len) {
+            pr2ws("%s: array length [%d>=%d] exceeded\n", __func__, off,
+                  max_op_len);
+            *op_len = max_op_len;
+            return SG_LIB_LBA_OUT_OF_RANGE;
+        }
+        op[off++] = (uint8_t)h;
+    }
+    *op_len = off;
+    return 0;
+}
+
+#undef HS
+#undef HN
+#undef HC
+
+#define SG_F2HEX_READ_CHUNK (64 * 1024)
+
+/* Makes the contents of the file open on fd available at hmp->bp. A
+ * regular file is mapped privately and writable, so changes are never seen
+ * in the file. Anything else (e.g. stdin or a pipe) is read until end of
+ * file into a heap buffer that grows as needed. If max_len is greater than
+ * 0 then at most max_len bytes are taken. */
+static int
+sg_f2hex_load(int fd, const char * fname, int max_len,
+              struct sg_f2hex_map * hmp)
+{
+    int err;
+    int64_t fsize = -1;
+    size_t sz, len;
+    ssize_t m;
+    uint8_t * bp;
+    struct stat a_stat;
+
+    if ((0 == fstat(fd, &a_stat)) && S_ISREG(a_stat.st_mode))
+        fsize = a_stat.st_size;
+    if ((fsize > INT32_MAX) && (max_len <= 0)) {
+        pr2ws("%s: %s is too large (%" PRId64 " bytes)\n", __func__, fname,
+              fsize);
+        return SG_LIB_FILE_ERROR;
+    }
+#ifdef SG_LIB_LINUX
+    if (fsize > 0) {
+        len = ((max_len > 0) && (max_len < fsize)) ? (size_t)max_len :
+                                                     (size_t)fsize;
+        hmp->map_p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                          fd, 0);
+        if (MAP_FAILED != hmp->map_p) {
+#ifdef MADV_SEQUENTIAL
+            madvise(hmp->map_p, len, MADV_SEQUENTIAL);
+#endif
+            hmp->mapped = true;
+            hmp->map_len = len;
+            hmp->bp = (uint8_t *)hmp->map_p;
+            hmp->len = (int)len;
+            return 0;
+        }
+        hmp->map_p = NULL;      /* fall back to read() */
+    }
+#endif
+    sz = (fsize > 0) ? (size_t)fsize : SG_F2HEX_READ_CHUNK;
+    if ((max_len > 0) && (sz > (size_t)max_len))
+        sz = max_len;
+    for (len = 0, bp = NULL; ; len += m) {
+        if (len >= sz) {
+            if ((max_len > 0) && (len >= (size_t)max_len))
+                break;
+            sz *= 2;
+            if ((max_len > 0) && (sz > (size_t)max_len))
+                sz = max_len;
+            else if (sz > INT32_MAX) {
+                pr2ws("%s: %s is too large\n", __func__, fname);
+                free(bp);
+                return SG_LIB_FILE_ERROR;
+            }
+        }
+        if (NULL == bp) {
+            if (NULL == (bp = (uint8_t *)malloc(sz)))
+                goto nomem;
+        } else if (len >= hmp->map_len) {
+            uint8_t * nbp = (uint8_t *)realloc(bp, sz);
+
+            if (NULL == nbp) {
+                free(bp);
+                goto nomem;
+            }
+            bp = nbp;
+        }
+        hmp->map_len = sz;
+        m = read(fd, bp + len, sz - len);
+        if (0 == m)
+            break;
+        if (m < 0) {
+            err = errno;
+            if (EINTR == err) {
+                m = 0;
+                continue;
+            }
+            pr2ws("%s: read from %s: %s\n", __func__, fname,
+                  safe_strerror(err));
+            free(bp);
+            return sg_convert_errno(err);
+        }
+    }
+    hmp->map_p = bp;
+    hmp->bp = bp;
+    hmp->len = (int)len;
+    return 0;
+nomem:
+    pr2ws("%s: out of memory\n", __func__);
+    return sg_convert_errno(ENOMEM);
+}
+
+/* Opens fname ('-' is stdin) and loads it with sg_f2hex_load(). */
+static int
+sg_f2hex_open_load(const char * fname, int max_len, struct sg_f2hex_map * hmp)
+{
+    bool has_stdin;
+    int fd, err, ret;
+
+    memset(hmp, 0, sizeof(*hmp));
+    if ((NULL == fname) || ('\0' == fname[0]))
+        return SG_LIB_SYNTAX_ERROR;
+    has_stdin = (0 == strcmp(fname, "-"));
+    if (has_stdin)
+        fd = STDIN_FILENO;
+    else {
+        fd = open(fname, O_RDONLY);
+        if (fd < 0) {
+            err = errno;
+            pr2ws("unable to open file %s: %s\n", fname,
+                  safe_strerror(err));
+            return sg_convert_errno(err);
+        }
+    }
+    ret = sg_f2hex_load(fd, fname, max_len, hmp);
+    if (! has_stdin)
+        close(fd);
+    return ret;
+}
 
 /* Read ASCII hex bytes or binary from fname (a file named '-' taken as
  * stdin). If reading ASCII hex then there should be either one entry per
@@ -3655,16 +4656,11 @@ int
 sg_f2hex_arr(const char * fname, bool as_binary, bool no_space,
              uint8_t * mp_arr, int * mp_arr_len, int max_arr_len_and)
 {
-    bool has_stdin, split_line, skip_first, redo_first;
-    int fn_len, in_len, k, j, m, fd, err, max_arr_len;
-    int off = 0;
+    bool has_stdin, skip_first;
+    int fn_len, k, m, fd, err, max_arr_len;
     int ret = 0;
-    unsigned int h;
-    const char * lcp;
-    FILE * fp = NULL;
     struct stat a_stat;
-    char line[512];
-    char carry_over[4];
+    struct sg_f2hex_map hm;
 
     if ((NULL == fname) || (NULL == mp_arr) || (NULL == mp_arr_len)) {
         pr2ws("%s: bad arguments\n", __func__);
@@ -3727,163 +4723,72 @@ sg_f2hex_arr(const char * fname, bool as_binary, bool no_space,
         return ret;
     }
 
-    /* So read the file as ASCII hex */
-    if (has_stdin)
-        fp = stdin;
-    else {
-        fp = fopen(fname, "r");
-        if (NULL == fp) {
-            err = errno;
-            pr2ws("Unable to open %s for reading: %s\n", fname,
-                    safe_strerror(err));
-            ret = sg_convert_errno(err);
-            goto fini;
-        }
-    }
+    /* So read the whole file as ASCII hex, then decode it */
+    if ((ret = sg_f2hex_open_load(fname, 0, &hm)))
+        return ret;
+    ret = sg_hex_txt2bin(hm.bp, hm.len, no_space, skip_first, mp_arr,
+                         mp_arr_len, max_arr_len);
+    sg_f2hex_unmap(&hm);
+    return ret;
+}
 
-    carry_over[0] = 0;
-    for (j = 0; j < MAX_NUM_ASCII_LINES; ++j) {
-        if (NULL == fgets(line, sizeof(line), fp))
-            break;
-        in_len = strlen(line);
-        if (in_len > 0) {
-            if ('\n' == line[in_len - 1]) {
-                --in_len;
-                line[in_len] = '\0';
-                split_line = false;
-            } else
-                split_line = true;
-        }
-        if (in_len < 1) {
-            carry_over[0] = 0;
-            continue;
-        }
-        if (carry_over[0]) {
-            if (isxdigit(line[0])) {
-                carry_over[1] = line[0];
-                carry_over[2] = '\0';
-                if (1 == sscanf(carry_over, "%4x", &h)) {
-                    if (off > 0) {
-                        if (off > max_arr_len) {
-                            pr2ws("%s: array length [%d>%d] exceeded\n",
-                                  __func__, off, max_arr_len);
-                            ret = SG_LIB_LBA_OUT_OF_RANGE;
-                            *mp_arr_len = max_arr_len;
-                            goto fini;
-                        } else
-                            mp_arr[off - 1] = h; /* back up and overwrite */
-                    }
-                } else {
-                    pr2ws("%s: carry_over error ['%s'] around line %d\n",
-                            __func__, carry_over, j + 1);
-                    ret = SG_LIB_SYNTAX_ERROR;
-                    goto fini;
-                }
-                lcp = line + 1;
-                --in_len;
-            } else
-                lcp = line;
-            carry_over[0] = 0;
-        } else
-            lcp = line;
+/* Like sg_f2hex_arr() but the caller does not supply the array. A binary
+ * regular file is mapped, not copied. ASCII hex is decoded in place, into
+ * the (private) mapping of the file or into the buffer it was read into
+ * (e.g. from stdin). Either way the result is found at hmp->bp and is
+ * hmp->len bytes long. If max_len_and is 0 there is no limit on the length
+ * of the result. */
+int
+sg_f2hex_mmap(const char * fname, bool as_binary, bool no_space,
+              struct sg_f2hex_map * hmp, int max_len_and)
+{
+    bool skip_first = false;
+    int ret, max_len;
 
-        m = strspn(lcp, " \t");
-        if (m == in_len)
-            continue;
-        lcp += m;
-        in_len -= m;
-        if ('#' == *lcp)
-            continue;
-        k = strspn(lcp, "0123456789aAbBcCdDeEfF ,-\t");
-        if ((k < in_len) && ('#' != lcp[k]) && ('\r' != lcp[k])) {
-            pr2ws("%s: syntax error at line %d, pos %d\n", __func__,
-                    j + 1, m + k + 1);
-            ret = SG_LIB_SYNTAX_ERROR;
-            goto fini;
-        }
-        if (no_space) {
-            for (k = 0; isxdigit(*lcp) && isxdigit(*(lcp + 1));
-                 ++k, lcp += 2) {
-                if (1 != sscanf(lcp, "%2x", &h)) {
-                    pr2ws("%s: bad hex number in line %d, pos %d\n",
-                            __func__, j + 1, (int)(lcp - line + 1));
-                    ret = SG_LIB_SYNTAX_ERROR;
-                    goto fini;
-                }
-                if ((off + k) >= max_arr_len) {
-                    pr2ws("%s: array length [%d>=%d] exceeded\n",
-                          __func__, off + k, max_arr_len);
-                    *mp_arr_len = max_arr_len;
-                    ret = SG_LIB_LBA_OUT_OF_RANGE;
-                    goto fini;
-                } else
-                    mp_arr[off + k] = h;
-            }
-            if (isxdigit(*lcp) && (! isxdigit(*(lcp + 1))))
-                carry_over[0] = *lcp;
-            off += k;
-        } else {        /* (white)space separated ASCII hexadecimal bytes */
-            for (redo_first = false, k = 0; k < 1024;
-                 k = (redo_first ? k : k + 1)) {
-                if (1 == sscanf(lcp, "%10x", &h)) {
-                    if (h > 0xff) {
-                        pr2ws("%s: hex number larger than 0xff in line "
-                                "%d, pos %d\n", __func__, j + 1,
-                                (int)(lcp - line + 1));
-                        ret = SG_LIB_SYNTAX_ERROR;
-                        goto fini;
-                    }
-                    if (split_line && (1 == strlen(lcp))) {
-                        /* single trailing hex digit might be a split pair */
-                        carry_over[0] = *lcp;
-                    }
-                    if ((off + k) >= max_arr_len) {
-                        pr2ws("%s: array length [%d>=%d] exceeded\n",
-                              __func__, off + k, max_arr_len);
-                        ret = SG_LIB_LBA_OUT_OF_RANGE;
-                        *mp_arr_len = max_arr_len;
-                        goto fini;
-                    } else if ((0 == k) && skip_first && (! redo_first))
-                        redo_first = true;
-                    else {
-                        redo_first = false;
-                        mp_arr[off + k] = h;
-                    }
-                    lcp = strpbrk(lcp, " ,-\t");
-                    if (NULL == lcp)
-                        break;
-                    lcp += strspn(lcp, " ,-\t");
-                    if ('\0' == *lcp)
-                        break;
-                } else {
-                    if (('#' == *lcp) || ('\r' == *lcp)) {
-                        --k;
-                        break;
-                    }
-                    pr2ws("%s: error in line %d, at pos %d\n", __func__,
-                            j + 1, (int)(lcp - line + 1));
-                    ret = SG_LIB_SYNTAX_ERROR;
-                    goto fini;
-                }
-            }
-            off += (k + 1);
+    if ((NULL == fname) || (NULL == hmp)) {
+        pr2ws("%s: bad arguments\n", __func__);
+        return SG_LIB_LOGIC_ERROR;
+    }
+    if (max_len_and < 0) {
+        skip_first = ! (as_binary || no_space);
+        max_len = -max_len_and;
+    } else
+        max_len = max_len_and;
+    if (as_binary) {
+        if ((ret = sg_f2hex_open_load(fname, max_len, hmp)))
+            return ret;
+        if (0 == hmp->len) {
+            pr2ws("read 0 bytes from binary file %s\n", fname);
+            sg_f2hex_unmap(hmp);
+            return SG_LIB_FILE_ERROR;
         }
-    }           /* end of per line loop */
-    if (j >= MAX_NUM_ASCII_LINES) {
-        pr2ws("%s: wow, more than %d lines of ASCII, give up\n", __func__,
-              SG_LIB_LBA_OUT_OF_RANGE);
-        return SG_LIB_LBA_OUT_OF_RANGE;
-    }
-    *mp_arr_len = off;
-    if (fp && (! has_stdin))
-        fclose(fp);
-    return 0;
-fini:
-    if (fp && (! has_stdin))
-        fclose(fp);
+        return 0;
+    }
+    if ((ret = sg_f2hex_open_load(fname, 0, hmp)))
+        return ret;
+    ret = sg_hex_txt2bin(hmp->bp, hmp->len, no_space, skip_first, hmp->bp,
+                         &hmp->len, (max_len > 0) ? max_len : hmp->len);
+    if (ret && (SG_LIB_LBA_OUT_OF_RANGE != ret))
+        sg_f2hex_unmap(hmp);
     return ret;
 }
 
+void
+sg_f2hex_unmap(struct sg_f2hex_map * hmp)
+{
+    if (NULL == hmp)
+        return;
+    if (hmp->map_p) {
+#ifdef SG_LIB_LINUX
+        if (hmp->mapped)
+            munmap(hmp->map_p, hmp->map_len);
+        else
+#endif
+            free(hmp->map_p);
+    }
+    memset(hmp, 0, sizeof(*hmp));
+}
+
 /* Extract character sequence from ATA words as in the model string
  * in a IDENTIFY DEVICE response. Returns number of characters
  * written to 'ochars' before 0 character is found or 'num' words
@@ -4053,6 +4958,251 @@ sg_memalign(uint32_t num_bytes, uint32_t align_to, uint8_t ** buff_to_free,
 #endif
 }
 
+#ifdef SG_LIB_LINUX
+/* Returns the default huge page size from /proc/meminfo, if that fails
+ * assumes 2 MiB (x86_64 and arm64 with 4 KiB base pages). */
+static uint32_t
+sg_hugepage_size(void)
+{
+    static uint32_t hp_sz;
+    uint32_t kb;
+    FILE * fp;
+    char b[128];
+
+    if (hp_sz > 0)
+        return hp_sz;
+    hp_sz = 2 * 1024 * 1024;
+    if (NULL == (fp = fopen("/proc/meminfo", "r")))
+        return hp_sz;
+    while (fgets(b, sizeof(b), fp)) {
+        if ((1 == sscanf(b, "Hugepagesize: %u kB", &kb)) && (kb > 0)) {
+            hp_sz = kb * 1024;
+            break;
+        }
+    }
+    fclose(fp);
+    return hp_sz;
+}
+#endif
+
+/* Like sg_memalign() but tries to back the buffer with huge pages so that
+ * the number of pages an OS must pin and map for (direct) IO is reduced.
+ * First tries explicit huge pages (MAP_HUGETLB), then a heap buffer aligned
+ * to the huge page size and advised as such (transparent huge pages) and
+ * finally falls back to sg_memalign(). *kindp is set to one of the
+ * SG_HUGEPAGE_* values and should be given with *buff_to_free to
+ * sg_free_hugepage() when the buffer is no longer needed. If vb is true
+ * then any fallback is reported. Sets all returned memory to zeros. */
+uint8_t *
+sg_memalign_hugepage(uint32_t num_bytes, uint8_t ** buff_to_free,
+                     int * kindp, bool vb)
+{
+#ifdef SG_LIB_LINUX
+    uint32_t hp_sz = sg_hugepage_size();
+    size_t len;
+    void * wp;
+
+    if (0 == num_bytes)
+        num_bytes = sg_get_page_size();
+    len = ((num_bytes + hp_sz - 1) / hp_sz) * hp_sz;
+#ifdef MAP_HUGETLB
+    wp = mmap(NULL, len, PROT_READ | PROT_WRITE,
+              MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (MAP_FAILED != wp) {
+        /* anonymous mappings are zero filled */
+        *buff_to_free = (uint8_t *)wp;
+        *kindp = SG_HUGEPAGE_HUGETLB;
+        return (uint8_t *)wp;
+    }
+    if (vb)
+        pr2ws("%s: MAP_HUGETLB for %u bytes failed: %s, try transparent "
+              "huge pages\n", __func__, num_bytes, safe_strerror(errno));
+#endif
+#if defined(HAVE_POSIX_MEMALIGN) && defined(MADV_HUGEPAGE)
+    wp = NULL;
+    if ((0 == posix_memalign(&wp, hp_sz, len)) && wp) {
+        if (0 == madvise(wp, len, MADV_HUGEPAGE)) {
+            memset(wp, 0, len);
+            *buff_to_free = (uint8_t *)wp;
+            *kindp = SG_HUGEPAGE_THP;
+            return (uint8_t *)wp;
+        }
+        if (vb)
+            pr2ws("%s: madvise(MADV_HUGEPAGE) failed: %s\n", __func__,
+                  safe_strerror(errno));
+        free(wp);
+    }
+#endif
+    if (vb)
+        pr2ws("%s: huge pages unavailable, using %u byte pages\n",
+              __func__, sg_get_page_size());
+#else
+    if (vb)
+        pr2ws("%s: huge pages not supported on this OS\n", __func__);
+#endif
+    *kindp = SG_HUGEPAGE_NONE;
+    return sg_memalign(num_bytes, 0, buff_to_free, false);
+}
+
+/* Frees the buffer obtained from sg_memalign_hugepage(). num_bytes and kind
+ * should be the values given to, and sent back by, that function. */
+void
+sg_free_hugepage(uint8_t * buff_to_free, uint32_t num_bytes, int kind)
+{
+    if (NULL == buff_to_free)
+        return;
+#ifdef SG_LIB_LINUX
+    if (SG_HUGEPAGE_HUGETLB == kind) {
+        uint32_t hp_sz = sg_hugepage_size();
+
+        if (0 == num_bytes)
+            num_bytes = sg_get_page_size();
+        munmap(buff_to_free, ((num_bytes + hp_sz - 1) / hp_sz) * hp_sz);
+        return;
+    }
+#else
+    if (num_bytes || kind) { }  /* suppress warning */
+#endif
+    free(buff_to_free);
+}
+
+uint64_t
+sg_get_mono_ns(void)
+{
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+#elif defined(HAVE_GETTIMEOFDAY)
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return ((uint64_t)tv.tv_sec * 1000000000) + (tv.tv_usec * 1000);
+#else
+    return 0;
+#endif
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+#define SG_RL_LD(x) __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define SG_RL_ST(x, v) __atomic_store_n(&(x), (v), __ATOMIC_RELAXED)
+#define SG_RL_CAS(x, oldp, v) __atomic_compare_exchange_n(&(x), (oldp), (v), \
+                                  true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)
+#else
+#define SG_RL_LD(x) (x)
+#define SG_RL_ST(x, v) ((x) = (v))
+#define SG_RL_CAS(x, oldp, v) ((x) = (v), true)    /* not thread safe */
+#endif
+
+void
+sg_rate_lim_set(struct sg_rate_lim * rlp, int64_t bytes_ps, int64_t iops)
+{
+    if (NULL == rlp)
+        return;
+    SG_RL_ST(rlp->bytes_ps, (bytes_ps > 0) ? bytes_ps : 0);
+    SG_RL_ST(rlp->iops, (iops > 0) ? iops : 0);
+    /* forget debt run up at the previous rates */
+    SG_RL_ST(rlp->b_tat_ns, 0);
+    SG_RL_ST(rlp->c_tat_ns, 0);
+}
+
+bool
+sg_rate_lim_parse(struct sg_rate_lim * rlp, const char * arg)
+{
+    int k;
+    int64_t bps, iops = 0;
+    const char * cp;
+    char b[64];
+
+    if ((NULL == rlp) || (NULL == arg))
+        return false;
+    if ('@' == arg[0]) {
+        FILE * fp = fopen(arg + 1, "r");
+
+        if (NULL == fp)
+            return false;
+        cp = fgets(b, sizeof(b), fp);
+        fclose(fp);
+        if (NULL == cp)
+            return false;
+        for (k = (int)strlen(b) - 1; (k >= 0) && isspace((uint8_t)b[k]); --k)
+            b[k] = '\0';
+        arg = b;
+    }
+    bps = sg_get_llnum(arg);
+    if (bps < 0)
+        return false;
+    cp = strchr(arg, ',');
+    if (cp) {
+        iops = sg_get_llnum(cp + 1);
+        if (iops < 0)
+            return false;
+    }
+    sg_rate_lim_set(rlp, bps, iops);
+    return true;
+}
+
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+/* Reserves cost_ns on the bucket whose theoretical arrival time is *tatp.
+ * Returns the time at which the reservation may be used: a bucket allows
+ * a reservation when its theoretical arrival time is no more than the burst
+ * allowance ahead of now (the "virtual scheduling" form of GCRA). */
+static uint64_t
+sg_rate_lim_take(uint64_t * tatp, uint64_t cost_ns, uint64_t now)
+{
+    uint64_t old, base;
+    static const uint64_t burst_ns = SG_RATE_LIM_BURST_MS * 1000000ULL;
+
+    old = SG_RL_LD(*tatp);
+    do {
+        base = (old > now) ? old : now;
+    } while (! SG_RL_CAS(*tatp, &old, base + cost_ns));
+    return (base > (now + burst_ns)) ? (base - burst_ns) : now;
+}
+#endif
+
+void
+sg_rate_lim_wait(struct sg_rate_lim * rlp, uint64_t num_bytes, int num_cmds)
+{
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+    int64_t bps, iops;
+    uint64_t now, go, t;
+    struct timespec ts;
+
+    if (NULL == rlp)
+        return;
+    bps = SG_RL_LD(rlp->bytes_ps);
+    iops = SG_RL_LD(rlp->iops);
+    if ((0 == bps) && (0 == iops))
+        return;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    now = ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+    go = now;
+    if ((bps > 0) && (num_bytes > 0)) {
+        t = sg_rate_lim_take(&rlp->b_tat_ns, (uint64_t)((double)num_bytes *
+                             1000000000.0 / (double)bps), now);
+        if (t > go)
+            go = t;
+    }
+    if ((iops > 0) && (num_cmds > 0)) {
+        t = sg_rate_lim_take(&rlp->c_tat_ns,
+                             ((uint64_t)num_cmds * 1000000000) / iops, now);
+        if (t > go)
+            go = t;
+    }
+    if (go > now) {
+        t = go - now;
+        ts.tv_sec = t / 1000000000;
+        ts.tv_nsec = t % 1000000000;
+        while ((nanosleep(&ts, &ts) < 0) && (EINTR == errno))
+            ;
+    }
+#else
+    if (rlp || num_bytes || num_cmds) { }   /* suppress warning */
+#endif
+}
+
 /* If byte_count is 0 or less then the OS page size is used as denominator.
  * Returns true  if the remainder of ((unsigned)pointer % byte_count) is 0,
  * else returns false. */
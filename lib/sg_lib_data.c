@@ -19,7 +19,7 @@
 #include "sg_lib_data.h"
 
 
-const char * sg_lib_version_str = "3.07 20230329";
+const char * sg_lib_version_str = "3.12 20261014";
 /* spc6r08, sbc5r04, zbc2r13 */
 
 
@@ -1728,6 +1728,9 @@ struct sg_lib_simple_value_name_t sg_lib_nvme_nvm_cmd_arr[] =
     {0xe,  "Reservation Report"},
     {0x11, "Reservation Acquire"},
     {0x15, "Reservation Release"},      /* last optional command in 1.3a */
+    {0x79, "Zone Management Send"},     /* Zoned Namespace command set */
+    {0x7a, "Zone Management Receive"},
+    {0x7d, "Zone Append"},
 
     /* Vendor specific 0x80 to 0xff */
     {0xffff, NULL},                     /* Sentinel */
@@ -130,3 +130,41 @@ struct sg_lib_simple_value_name_t sg_lib_names_vpd_arr[] = {
 /* Don't count sentinel when doing binary searches, etc */
 const size_t sg_lib_names_vpd_len =
                 SG_ARRAY_SIZE(sg_lib_names_vpd_arr) - 1;
+
+/* Binary search of one of the (sorted) arrays above. Where a value is
+ * repeated the first such entry is used. Returns NULL if not found. */
+static const char *
+sg_lib_names_bsearch(const struct sg_lib_simple_value_name_t * arr,
+                     size_t num, int value)
+{
+    size_t lo = 0;
+    size_t hi = num;
+
+    while (lo < hi) {
+        size_t mid = lo + ((hi - lo) / 2);
+
+        if (arr[mid].value < value)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return ((lo < num) && (arr[lo].value == value)) ? arr[lo].name : NULL;
+}
+
+/* Returns name of mode page given value: (mode_page << 8) | mode_subpage ,
+ * or NULL if not known. */
+const char *
+sg_lib_names_mode_find(int value)
+{
+    return sg_lib_names_bsearch(sg_lib_names_mode_arr,
+                                sg_lib_names_mode_len, value);
+}
+
+/* Returns name of VPD page given value as in sg_lib_names_vpd_arr[], or
+ * NULL if not known. */
+const char *
+sg_lib_names_vpd_find(int value)
+{
+    return sg_lib_names_bsearch(sg_lib_names_vpd_arr,
+                                sg_lib_names_vpd_len, value);
+}
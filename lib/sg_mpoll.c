@@ -0,0 +1,363 @@
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/* sg_mpoll version 1.01 20261015 */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#ifdef SG_LIB_WIN32
+#include <windows.h>
+#endif
+
+#include "sg_lib.h"
+#include "sg_cmds_basic.h"
+#include "sg_mpoll.h"
+#include "sg_pr2serr.h"
+
+#define MPOLL_RS_LEN 252
+
+
+int64_t
+sg_mpoll_now_ms(void)
+{
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+
+    if (0 == clock_gettime(CLOCK_MONOTONIC, &ts))
+        return ((int64_t)ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+#endif
+    return (int64_t)time(NULL) * 1000;
+}
+
+void
+sg_mpoll_sleep_ms(int ms)
+{
+    if (ms <= 0)
+        return;
+#if defined(SG_LIB_WIN32)
+    Sleep(ms);
+#elif defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+    {
+        struct timespec wait_period, rem;
+
+        wait_period.tv_sec = ms / 1000;
+        wait_period.tv_nsec = (ms % 1000) * 1000000;
+        while ((nanosleep(&wait_period, &rem) < 0) && (EINTR == errno))
+            wait_period = rem;
+    }
+#else
+    sg_sleep_secs((ms + 999) / 1000);
+#endif
+}
+
+void
+sg_mpoll_started(struct sg_mpoll_dev * mdp, int sg_fd, bool immed, int res)
+{
+    mdp->sg_fd = sg_fd;
+    mdp->started = true;
+    mdp->progress = -1;
+    mdp->res = (res < 0) ? SG_LIB_CAT_OTHER : res;
+    mdp->start_ms = sg_mpoll_now_ms();
+    mdp->active = (immed && (0 == res));
+    mdp->end_ms = mdp->active ? 0 : mdp->start_ms;
+}
+
+static void
+mpoll_done(struct sg_mpoll_dev * mdp, int res)
+{
+    mdp->active = false;
+    mdp->res = (res < 0) ? SG_LIB_CAT_OTHER : res;
+    mdp->end_ms = sg_mpoll_now_ms();
+}
+
+/* Polls once, following what sg_format has long done for a single device:
+ * when TEST UNIT READY yields NOT READY without a progress indication,
+ * switch to REQUEST SENSE for the following polls. With until_ready (e.g.
+ * spinning up after START STOP UNIT) only TEST UNIT READY is used and
+ * NOT READY, or a unit attention, means the device is still busy. */
+static void
+mpoll_one(struct sg_mpoll_dev * mdp, uint8_t * rsp, int vb)
+{
+    int res, resp_len, cat;
+    int progress = -1;
+    int vb2 = (vb > 1) ? (vb - 1) : 0;
+
+    ++mdp->num_polls;
+    if (! mdp->use_rs) {
+        res = sg_ll_test_unit_ready_progress(mdp->sg_fd, 0, &progress,
+                                             false, vb2);
+        if (progress >= 0) {
+            mdp->progress = progress;
+            return;
+        }
+        if (mdp->until_ready && ((SG_LIB_CAT_NOT_READY == res) ||
+                                 (SG_LIB_CAT_UNIT_ATTENTION == res)))
+            return;
+        switch (res) {
+        case SG_LIB_CAT_NOT_READY:
+            mdp->use_rs = true;
+            return;
+        case SG_LIB_CAT_UNIT_ATTENTION:
+        case SG_LIB_CAT_RECOVERED:
+        case SG_LIB_CAT_NO_SENSE:
+            res = 0;
+            break;
+        default:
+            break;
+        }
+        mpoll_done(mdp, res);
+        return;
+    }
+    memset(rsp, 0, MPOLL_RS_LEN);
+    res = sg_ll_request_sense(mdp->sg_fd, mdp->desc, rsp, MPOLL_RS_LEN,
+                              vb > 0, vb2);
+    if (res) {
+        if ((SG_LIB_CAT_ILLEGAL_REQ == res) && mdp->desc) {
+            if (vb)
+                pr2serr("%s: descriptor sense may not be supported, try "
+                        "fixed\n", mdp->dev_name);
+            mdp->desc = false;
+            return;
+        }
+        mpoll_done(mdp, res);
+        return;
+    }
+    /* "Additional sense length" same in descriptor and fixed */
+    resp_len = rsp[7] + 8;
+    if (resp_len > MPOLL_RS_LEN)
+        resp_len = MPOLL_RS_LEN;
+    if (vb > 2) {
+        pr2serr("%s: REQUEST SENSE parameter data in hex:\n",
+                mdp->dev_name);
+        hex2stderr(rsp, resp_len, 1);
+    }
+    if (sg_get_sense_progress_fld(rsp, resp_len, &progress)) {
+        mdp->progress = progress;
+        return;
+    }
+    /* finished; a failed format or sanitize reports a MEDIUM ERROR */
+    cat = sg_err_category_sense(rsp, resp_len);
+    mpoll_done(mdp, (SG_LIB_CAT_MEDIUM_HARD == cat) ? cat : 0);
+}
+
+void
+sg_mpoll_poll(struct sg_mpoll_dev * mdp, int verbose)
+{
+    uint8_t rsp[MPOLL_RS_LEN];
+
+    if (mdp->active)
+        mpoll_one(mdp, rsp, verbose);
+}
+
+/* Estimated milliseconds until the device finishes, or -1 if unknown */
+static int64_t
+mpoll_eta_ms(const struct sg_mpoll_dev * mdp, int64_t now)
+{
+    if ((! mdp->active) || (mdp->progress <= 0))
+        return -1;
+    return ((now - mdp->start_ms) * (65536 - mdp->progress)) /
+           mdp->progress;
+}
+
+static char *
+mpoll_hms(int64_t ms, int b_len, char * b)
+{
+    int64_t s = (ms + 500) / 1000;
+
+    snprintf(b, b_len, "%d:%02d:%02d", (int)(s / 3600), (int)((s / 60) % 60),
+             (int)(s % 60));
+    return b;
+}
+
+static void
+mpoll_pr_table(const struct sg_mpoll_dev * mdp_arr, int num,
+               const char * cmd_name, int64_t t0, sgj_state * jsp)
+{
+    int k, pct, w, n_act, n_started;
+    int64_t now, eta, max_eta;
+    double sum;
+    const struct sg_mpoll_dev * mdp;
+    char pb[16];
+    char eb[16];
+    char tb[16];
+    char b[80];
+
+    now = sg_mpoll_now_ms();
+    w = 6;
+    n_act = 0;
+    n_started = 0;
+    sum = 0.0;
+    max_eta = -1;
+    for (k = 0, mdp = mdp_arr; k < num; ++k, ++mdp) {
+        if ((int)strlen(mdp->dev_name) > w)
+            w = (int)strlen(mdp->dev_name);
+        if (! mdp->started)
+            continue;
+        ++n_started;
+        if (mdp->active) {
+            ++n_act;
+            if (mdp->progress > 0)
+                sum += (double)mdp->progress / 65536.0;
+            eta = mpoll_eta_ms(mdp, now);
+            if (eta > max_eta)
+                max_eta = eta;
+        } else if (0 == mdp->res)
+            sum += 1.0;
+    }
+    sgj_pr_hr(jsp, "\n%s after %s: %d of %d active", cmd_name,
+              mpoll_hms(now - t0, sizeof(tb), tb), n_act, n_started);
+    if (n_started > 0)
+        sgj_pr_hr(jsp, ", %.2f%% done", (100.0 * sum) / n_started);
+    if (max_eta >= 0)
+        sgj_pr_hr(jsp, ", ETA %s", mpoll_hms(max_eta, sizeof(eb), eb));
+    sgj_pr_hr(jsp, "\n  %-*s  Progress   Elapsed       ETA  Status\n", w,
+              "Device");
+    for (k = 0, mdp = mdp_arr; k < num; ++k, ++mdp) {
+        pb[0] = '\0';
+        eb[0] = '\0';
+        tb[0] = '\0';
+        if (! mdp->started)
+            snprintf(b, sizeof(b), "not started");
+        else if (mdp->active) {
+            if (mdp->progress >= 0) {
+                pct = (mdp->progress * 10000) / 65536;
+                snprintf(pb, sizeof(pb), "%d.%02d%%", pct / 100, pct % 100);
+            }
+            eta = mpoll_eta_ms(mdp, now);
+            if (eta >= 0)
+                mpoll_hms(eta, sizeof(eb), eb);
+            mpoll_hms(now - mdp->start_ms, sizeof(tb), tb);
+            snprintf(b, sizeof(b), "in progress");
+        } else {
+            if (0 == mdp->res)
+                snprintf(pb, sizeof(pb), "100.00%%");
+            mpoll_hms(mdp->end_ms - mdp->start_ms, sizeof(tb), tb);
+            if (0 == mdp->res)
+                snprintf(b, sizeof(b), "completed");
+            else if (! sg_exit2str(mdp->res, false, sizeof(b), b))
+                snprintf(b, sizeof(b), "failed [%d]", mdp->res);
+        }
+        sgj_pr_hr(jsp, "  %-*s  %8s  %8s  %8s  %s\n", w, mdp->dev_name, pb,
+                  tb, eb, b);
+    }
+}
+
+int
+sg_mpoll_run(struct sg_mpoll_dev * mdp_arr, int num, const char * cmd_name,
+             const struct sg_mpoll_opts * mop, sgj_state * jsp)
+{
+    int k, n_act, n_bad, min_s, max_s, wait_s, vb;
+    int64_t t0, now, eta, min_eta;
+    struct sg_mpoll_dev * mdp;
+    uint8_t * rsp;
+    uint8_t * free_rsp = NULL;
+
+    min_s = (mop && (mop->min_secs > 0)) ? mop->min_secs :
+                                           SG_MPOLL_DEF_MIN_SECS;
+    max_s = (mop && (mop->max_secs > 0)) ? mop->max_secs :
+                                           SG_MPOLL_DEF_MAX_SECS;
+    if (max_s < min_s)
+        max_s = min_s;
+    vb = mop ? mop->verbose : 0;
+    rsp = sg_memalign(MPOLL_RS_LEN, 0, &free_rsp, false);
+    if (NULL == rsp) {
+        pr2serr("%s: unable to obtain heap for Request Sense\n", __func__);
+        return num;
+    }
+    t0 = -1;
+    for (k = 0, mdp = mdp_arr; k < num; ++k, ++mdp) {
+        if (mdp->started && ((t0 < 0) || (mdp->start_ms < t0)))
+            t0 = mdp->start_ms;
+    }
+    if (t0 < 0)
+        t0 = sg_mpoll_now_ms();
+    wait_s = min_s;
+    while (1) {
+        for (k = 0, n_act = 0, mdp = mdp_arr; k < num; ++k, ++mdp) {
+            if (mdp->active)
+                ++n_act;
+        }
+        if (0 == n_act)
+            break;
+        if (vb > 1)
+            pr2serr("%s: %d active, wait %d seconds\n", __func__, n_act,
+                    wait_s);
+        sg_sleep_secs(wait_s);
+        min_eta = -1;
+        now = sg_mpoll_now_ms();
+        for (k = 0, mdp = mdp_arr; k < num; ++k, ++mdp) {
+            if (! mdp->active)
+                continue;
+            mpoll_one(mdp, rsp, vb);
+            eta = mpoll_eta_ms(mdp, now);
+            if ((eta >= 0) && ((min_eta < 0) || (eta < min_eta)))
+                min_eta = eta;
+        }
+        mpoll_pr_table(mdp_arr, num, cmd_name, t0, jsp);
+        fflush(stdout);
+        /* back-off, but don't oversleep the nearest completion */
+        wait_s = (wait_s < (max_s / 2)) ? (wait_s * 2) : max_s;
+        if (min_eta >= 0) {
+            eta = (min_eta + 999) / 1000;
+            if (eta < wait_s)
+                wait_s = (eta < min_s) ? min_s : (int)eta;
+        }
+    }
+    if (free_rsp)
+        free(free_rsp);
+    for (k = 0, n_bad = 0, mdp = mdp_arr; k < num; ++k, ++mdp) {
+        if (mdp->res)
+            ++n_bad;
+    }
+    return n_bad;
+}
+
+sgj_opaque_p
+sg_mpoll_js(sgj_state * jsp, sgj_opaque_p jop,
+            const struct sg_mpoll_dev * mdp_arr, int num)
+{
+    int k;
+    const struct sg_mpoll_dev * mdp;
+    sgj_opaque_p jo2p, jap;
+    char b[80];
+
+    if ((NULL == jsp) || (! jsp->pr_as_json))
+        return NULL;
+    jap = sgj_named_subarray_r(jsp, jop, "device_list");
+    for (k = 0, mdp = mdp_arr; k < num; ++k, ++mdp) {
+        jo2p = sgj_new_unattached_object_r(jsp);
+        sgj_js_nv_s(jsp, jo2p, "device_name", mdp->dev_name);
+        sgj_js_nv_b(jsp, jo2p, "started", mdp->started);
+        if (! sg_exit2str(mdp->res, true, sizeof(b), b))
+            b[0] = '\0';
+        sgj_js_nv_istr(jsp, jo2p, "exit_status", mdp->res, NULL, b);
+        sgj_js_nv_i(jsp, jo2p, "number_of_polls", mdp->num_polls);
+        if (mdp->started)
+            sgj_js_nv_i(jsp, jo2p, "elapsed_seconds",
+                        ((mdp->active ? sg_mpoll_now_ms() : mdp->end_ms) -
+                         mdp->start_ms + 500) / 1000);
+        if (mdp->started && (! mdp->active) && (0 == mdp->res))
+            sgj_js_nv_i(jsp, jo2p, "progress_percent", 100);
+        else if (mdp->progress >= 0)
+            sgj_js_nv_i(jsp, jo2p, "progress_percent",
+                        (mdp->progress * 100) / 65536);
+        sgj_js_nv_o(jsp, jap, NULL /* name */, jo2p);
+    }
+    return jap;
+}
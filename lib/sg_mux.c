@@ -0,0 +1,1089 @@
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/* sg_mux version 1.02 20261015 */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef SG_LIB_LINUX
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <time.h>
+#endif
+
+#include "sg_lib.h"
+#include "sg_pt.h"
+#include "sg_mux.h"
+#include "sg_mpoll.h"
+#include "sg_pr2serr.h"
+
+#ifdef SG_LIB_LINUX
+
+#ifndef SG_SCSI_RESET
+#define SG_SCSI_RESET 0x2284
+#endif
+#ifndef SG_SCSI_RESET_DEVICE
+#define SG_SCSI_RESET_DEVICE 1
+#endif
+#ifndef SG_SCSI_RESET_TARGET
+#define SG_SCSI_RESET_TARGET 4
+#endif
+#ifndef SG_SCSI_RESET_NO_ESCALATE
+#define SG_SCSI_RESET_NO_ESCALATE 0x100
+#endif
+#ifndef SCSI_IOCTL_GET_IDLUN
+#define SCSI_IOCTL_GET_IDLUN 0x5382
+#endif
+
+#define MUX_MAX_EVENTS 64       /* fetched per epoll_wait() call */
+
+/* Packet ids are taken from one counter for the whole process so that
+ * muxes in different threads may share a device fd: the sg driver then
+ * matches each response to its command by packet id. */
+static unsigned int mux_pack_id;
+
+/* Soft deadlines are rounded up to ticks. The inner wheel has a slot per
+ * tick for the next 256 ticks (about 2 seconds); the outer wheel has a
+ * slot per 256 ticks for the next 64 of those (about 2 minutes). An outer
+ * slot is moved onto the inner wheel when the inner wheel comes round to
+ * its start. Deadlines further out wait in the last outer slot and are
+ * placed again when it is moved. */
+#define MUX_TICK_MS 8
+#define MUX_TW0_BITS 8
+#define MUX_TW0_SZ (1 << MUX_TW0_BITS)
+#define MUX_TW1_SZ 64
+
+/* Adaptive controller: the lowest latency is taken over the current and
+ * the previous period. Latency targets derived from it are not set below
+ * a floor, so that jitter on fast devices is not taken for congestion. */
+#define MUX_MIN_PERIOD_US 5000000
+#define MUX_LAT_FLOOR_US 100
+
+struct mux_idlun {      /* as filled by SCSI_IOCTL_GET_IDLUN */
+    int dev_id;         /* host in bits 31:24, channel, lun, target */
+    int host_unique_id;
+};
+
+struct mux_win {        /* a device's concurrency window */
+    double win;         /* commands that may be in flight */
+    int in_flight;      /* sent to the device */
+    int64_t min_cur_us; /* lowest latency in this period, 0: none */
+    int64_t min_prev_us;        /* ... in the previous period */
+    int64_t period_end_us;
+    int64_t srtt_us;    /* smoothed latency, 0: none yet */
+    int64_t hold_until_us;      /* no decrease before this */
+    uint64_t num_inc;
+    uint64_t num_dec;
+    uint64_t num_busy;
+};
+
+struct mux_host {       /* a host's concurrency window */
+    int host_no;
+    int in_flight;
+    double win;
+    int64_t hold_until_us;
+};
+
+/* The pt object of a released command, until its late response is read */
+struct mux_orphan {
+    struct sg_pt_base * ptp;
+    void * ctx;
+    void (*reclaim)(struct sg_pt_base * ptp, void * ctx);
+    struct mux_orphan * next;
+};
+
+struct mux_fd {
+    bool sync;          /* epoll refused it: commands done at submission */
+    int fd;
+    int host_idx;       /* into host_arr, -1: host not known */
+    int num_held;
+    struct sg_mux_cmd * head;   /* in flight, in submission order */
+    struct sg_mux_cmd * held_head;      /* held by the controller */
+    struct sg_mux_cmd * held_tail;
+    struct mux_orphan * orphans;        /* released, still in the kernel */
+    struct mux_win w;
+};
+
+struct sg_mux {
+    int ep_fd;
+    int verbose;
+    int in_flight;
+    int num_polled;     /* in flight on fds that epoll watches, including
+                         * released commands */
+    int num_orphans;    /* released commands */
+    int num_fds;
+    int max_fds;
+    int slot_len;       /* elements in slot_of_fd */
+    struct mux_fd * fd_arr;
+    int * slot_of_fd;   /* fd_arr index + 1, indexed by fd; 0: none */
+    struct sg_mux_cmd * ready_head;     /* response in, done() not called */
+    struct sg_mux_cmd * ready_tail;
+    int num_timers;     /* commands on the timer wheel */
+    int64_t t0_ms;      /* tick 0 */
+    int64_t cur_tick;   /* last tick whose deadlines were expired */
+    struct sg_mux_cmd * tw0[MUX_TW0_SZ];
+    struct sg_mux_cmd * tw1[MUX_TW1_SZ];
+    bool aimd;          /* adaptive controller on */
+    struct sg_mux_aimd lim;     /* its limits, defaults filled in */
+    int num_held;       /* over all devices */
+    int rr_next;        /* fd_arr index the next dispatch starts at */
+    int num_hosts;
+    int max_hosts;
+    struct mux_host * host_arr;
+};
+
+struct sg_mux *
+sg_mux_new(int verbose)
+{
+    struct sg_mux * mxp = (struct sg_mux *)calloc(1, sizeof(*mxp));
+
+    if (NULL == mxp)
+        return NULL;
+    mxp->ep_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (mxp->ep_fd < 0) {
+        int err = errno;
+
+        if (verbose)
+            pr2ws("%s: epoll_create1() failed: %s\n", __func__,
+                  safe_strerror(err));
+        free(mxp);
+        errno = err;
+        return NULL;
+    }
+    mxp->verbose = verbose;
+    mxp->t0_ms = sg_mpoll_now_ms();
+    return mxp;
+}
+
+/* Hands the pt object of a released command back to its owner */
+static void
+mux_reclaim(struct mux_orphan * op)
+{
+    if (op->reclaim)
+        op->reclaim(op->ptp, op->ctx);
+    else
+        destruct_scsi_pt_obj(op->ptp);
+    free(op);
+}
+
+void
+sg_mux_free(struct sg_mux * mxp)
+{
+    int k;
+    struct mux_orphan * op;
+
+    if (NULL == mxp)
+        return;
+    for (k = 0; k < mxp->num_fds; ++k) {
+        while ((op = mxp->fd_arr[k].orphans)) {
+            mxp->fd_arr[k].orphans = op->next;
+            mux_reclaim(op);
+        }
+    }
+    close(mxp->ep_fd);
+    free(mxp->fd_arr);
+    free(mxp->host_arr);
+    free(mxp->slot_of_fd);
+    free(mxp);
+}
+
+static struct mux_fd *
+mux_find(const struct sg_mux * mxp, int fd)
+{
+    if ((fd < 0) || (fd >= mxp->slot_len) || (0 == mxp->slot_of_fd[fd]))
+        return NULL;
+    return mxp->fd_arr + (mxp->slot_of_fd[fd] - 1);
+}
+
+static int64_t
+mux_now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((int64_t)ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+}
+
+/* Returns the host_arr index of the host that device fd hangs off, adding
+ * it if need be, or -1 if that can't be found (e.g. NVMe). */
+static int
+mux_host_idx(struct sg_mux * mxp, int fd)
+{
+    int k, host_no;
+    struct mux_idlun idl;
+    struct mux_host * hp;
+
+    memset(&idl, 0, sizeof(idl));
+    if (ioctl(fd, SCSI_IOCTL_GET_IDLUN, &idl) < 0)
+        return -1;
+    host_no = (idl.dev_id >> 24) & 0xff;
+    for (k = 0; k < mxp->num_hosts; ++k) {
+        if (host_no == mxp->host_arr[k].host_no)
+            return k;
+    }
+    if (mxp->num_hosts >= mxp->max_hosts) {
+        k = (mxp->max_hosts < 4) ? 4 : (2 * mxp->max_hosts);
+        hp = (struct mux_host *)realloc(mxp->host_arr, k * sizeof(*hp));
+        if (NULL == hp)
+            return -1;
+        mxp->host_arr = hp;
+        mxp->max_hosts = k;
+    }
+    hp = mxp->host_arr + mxp->num_hosts;
+    memset(hp, 0, sizeof(*hp));
+    hp->host_no = host_no;
+    hp->win = mxp->lim.max_host;
+    return mxp->num_hosts++;
+}
+
+static void
+mux_win_init(const struct sg_mux * mxp, struct mux_fd * mfp)
+{
+    memset(&mfp->w, 0, sizeof(mfp->w));
+    mfp->w.win = mxp->lim.init_dev;
+}
+
+int
+sg_mux_add_fd(struct sg_mux * mxp, int fd)
+{
+    int fl, n;
+    struct mux_fd * mfp;
+    struct epoll_event ev;
+
+    if (fd < 0)
+        return -EBADF;
+    if (mux_find(mxp, fd))
+        return -EEXIST;
+    if (fd >= mxp->slot_len) {
+        int * ip;
+
+        n = (fd < 64) ? 64 : (2 * fd);
+        ip = (int *)realloc(mxp->slot_of_fd, n * sizeof(int));
+        if (NULL == ip)
+            return -ENOMEM;
+        memset(ip + mxp->slot_len, 0, (n - mxp->slot_len) * sizeof(int));
+        mxp->slot_of_fd = ip;
+        mxp->slot_len = n;
+    }
+    if (mxp->num_fds >= mxp->max_fds) {
+        n = (mxp->max_fds < 16) ? 16 : (2 * mxp->max_fds);
+        mfp = (struct mux_fd *)realloc(mxp->fd_arr, n * sizeof(*mfp));
+        if (NULL == mfp)
+            return -ENOMEM;
+        mxp->fd_arr = mfp;
+        mxp->max_fds = n;
+    }
+    fl = fcntl(fd, F_GETFL);
+    if ((fl >= 0) && (! (O_NONBLOCK & fl)))
+        fcntl(fd, F_SETFL, fl | O_NONBLOCK);
+    mfp = mxp->fd_arr + mxp->num_fds;
+    memset(mfp, 0, sizeof(*mfp));
+    mfp->fd = fd;
+    mfp->host_idx = mux_host_idx(mxp, fd);
+    mux_win_init(mxp, mfp);
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    if (epoll_ctl(mxp->ep_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        if (EPERM != errno) {   /* EPERM: fd does not support poll */
+            n = errno;
+            if (mxp->verbose)
+                pr2ws("%s: epoll_ctl(ADD, fd=%d) failed: %s\n", __func__,
+                      fd, safe_strerror(n));
+            return -n;
+        }
+        mfp->sync = true;
+        if (mxp->verbose > 2)
+            pr2ws("%s: fd=%d can't be polled, its commands complete when "
+                  "submitted\n", __func__, fd);
+    }
+    mxp->slot_of_fd[fd] = ++mxp->num_fds;
+    return 0;
+}
+
+int
+sg_mux_del_fd(struct sg_mux * mxp, int fd)
+{
+    int k;
+    struct mux_fd * mfp = mux_find(mxp, fd);
+    struct mux_fd * last_p;
+
+    if (NULL == mfp)
+        return -ENOENT;
+    if (mfp->head || mfp->held_head || mfp->orphans)
+        return -EBUSY;
+    if (! mfp->sync)
+        epoll_ctl(mxp->ep_fd, EPOLL_CTL_DEL, fd, NULL);
+    k = (int)(mfp - mxp->fd_arr);
+    last_p = mxp->fd_arr + (--mxp->num_fds);
+    if (mfp != last_p) {        /* last element fills the hole */
+        *mfp = *last_p;
+        mxp->slot_of_fd[mfp->fd] = k + 1;
+    }
+    mxp->slot_of_fd[fd] = 0;
+    return 0;
+}
+
+static int64_t
+mux_now_tick(const struct sg_mux * mxp)
+{
+    return (sg_mpoll_now_ms() - mxp->t0_ms) / MUX_TICK_MS;
+}
+
+/* Places mcp, whose deadline is tick mcp->tw_tick, on the timer wheel */
+static void
+tw_insert(struct sg_mux * mxp, struct sg_mux_cmd * mcp)
+{
+    int64_t t = mcp->tw_tick;
+    int64_t cur = mxp->cur_tick;
+    struct sg_mux_cmd ** headp;
+
+    if (t - cur < MUX_TW0_SZ)
+        headp = mxp->tw0 + (t & (MUX_TW0_SZ - 1));
+    else if ((t >> MUX_TW0_BITS) - (cur >> MUX_TW0_BITS) < MUX_TW1_SZ)
+        headp = mxp->tw1 + ((t >> MUX_TW0_BITS) & (MUX_TW1_SZ - 1));
+    else        /* beyond the outer wheel, placed again later */
+        headp = mxp->tw1 + (((cur >> MUX_TW0_BITS) + MUX_TW1_SZ - 1) &
+                            (MUX_TW1_SZ - 1));
+    mcp->tw_next = *headp;
+    if (*headp)
+        (*headp)->tw_pprev = &mcp->tw_next;
+    *headp = mcp;
+    mcp->tw_pprev = headp;
+}
+
+static void
+tw_remove(struct sg_mux * mxp, struct sg_mux_cmd * mcp)
+{
+    if (NULL == mcp->tw_pprev)
+        return;
+    *mcp->tw_pprev = mcp->tw_next;
+    if (mcp->tw_next)
+        mcp->tw_next->tw_pprev = mcp->tw_pprev;
+    mcp->tw_next = NULL;
+    mcp->tw_pprev = NULL;
+    --mxp->num_timers;
+}
+
+/* Arms the soft deadline of mcp, soft_ms from now */
+static void
+tw_arm(struct sg_mux * mxp, struct sg_mux_cmd * mcp)
+{
+    int64_t now = mux_now_tick(mxp);
+
+    if ((0 == mxp->num_timers) && (mxp->cur_tick < now))
+        mxp->cur_tick = now;    /* nothing to expire in between */
+    mcp->tw_tick = now + ((mcp->soft_ms + MUX_TICK_MS - 1) / MUX_TICK_MS);
+    if (mcp->tw_tick <= mxp->cur_tick)
+        mcp->tw_tick = mxp->cur_tick + 1;
+    tw_insert(mxp, mcp);
+    ++mxp->num_timers;
+}
+
+/* Milliseconds until the nearest soft deadline (0 if one has passed), or
+ * -1 when none is armed. */
+static int
+tw_wait_ms(const struct sg_mux * mxp)
+{
+    int k;
+    int64_t t, t1, ms;
+
+    if (0 == mxp->num_timers)
+        return -1;
+    for (k = 1; k < MUX_TW0_SZ; ++k) {
+        if (mxp->tw0[(mxp->cur_tick + k) & (MUX_TW0_SZ - 1)])
+            break;
+    }
+    t = mxp->cur_tick + k;
+    for (k = 0; k < MUX_TW1_SZ; ++k) {
+        if (mxp->tw1[k]) {
+            /* an outer deadline may be nearer by the next time the outer
+             * wheel is looked at */
+            t1 = ((mxp->cur_tick >> MUX_TW0_BITS) + 1) << MUX_TW0_BITS;
+            if (t1 < t)
+                t = t1;
+            break;
+        }
+    }
+    ms = mxp->t0_ms + (t * MUX_TICK_MS) - sg_mpoll_now_ms();
+    return (ms > 0) ? (int)((ms < INT_MAX) ? ms : INT_MAX) : 0;
+}
+
+/* Returns the SG_LIB_CAT_* of the response to mcp, res being what
+ * do_scsi_pt_receive() returned */
+static int
+mux_cat(const struct sg_mux_cmd * mcp, int res)
+{
+    if (-ETIMEDOUT == res)
+        return SG_LIB_CAT_TIMEOUT;
+    if (res)
+        return SG_LIB_CAT_OTHER;
+    switch (get_scsi_pt_result_category(mcp->ptp)) {
+    case SCSI_PT_RESULT_GOOD:
+        return 0;
+    case SCSI_PT_RESULT_STATUS:
+        switch (get_scsi_pt_status_response(mcp->ptp) & 0xfe) {
+        case SAM_STAT_BUSY:
+            return SG_LIB_CAT_BUSY;
+        case SAM_STAT_TASK_SET_FULL:
+            return SG_LIB_CAT_TS_FULL;
+        case SAM_STAT_CONDITION_MET:
+            return SG_LIB_CAT_CONDITION_MET;
+        case SAM_STAT_RESERVATION_CONFLICT:
+            return SG_LIB_CAT_RES_CONFLICT;
+        default:
+            return SG_LIB_CAT_OTHER;
+        }
+    case SCSI_PT_RESULT_SENSE:
+        return sg_err_category_sense(get_scsi_pt_sense_buf(mcp->ptp),
+                                     get_scsi_pt_sense_len(mcp->ptp));
+    default:
+        return SG_LIB_CAT_OTHER;
+    }
+}
+
+static void
+mux_ready(struct sg_mux * mxp, struct sg_mux_cmd * mcp, int res)
+{
+    tw_remove(mxp, mcp);
+    mcp->res = res;
+    mcp->cat = mux_cat(mcp, res);
+    mcp->next = NULL;
+    if (mxp->ready_tail)
+        mxp->ready_tail->next = mcp;
+    else
+        mxp->ready_head = mcp;
+    mxp->ready_tail = mcp;
+}
+
+/* Returns true if the windows of the device on mfp and of its host have
+ * room for another command */
+static bool
+mux_room(const struct sg_mux * mxp, const struct mux_fd * mfp)
+{
+    const struct mux_host * hp;
+
+    if (mfp->w.in_flight >= (int)mfp->w.win)
+        return false;
+    if ((mfp->host_idx < 0) || (0 == mxp->lim.max_host))
+        return true;
+    hp = mxp->host_arr + mfp->host_idx;
+    return hp->in_flight < (int)hp->win;
+}
+
+/* Sends mcp to the device on mfp, which can be polled. Returns 0 or the
+ * value from do_scsi_pt_submit(). */
+static int
+mux_start(struct sg_mux * mxp, struct mux_fd * mfp, struct sg_mux_cmd * mcp)
+{
+    int res;
+    unsigned int pack_id;
+    struct sg_mux_cmd * p;
+
+    pack_id = __atomic_add_fetch(&mux_pack_id, 1, __ATOMIC_RELAXED);
+    set_scsi_pt_packet_id(mcp->ptp, 1 + (int)(pack_id % INT_MAX));
+    res = do_scsi_pt_submit(mcp->ptp, mcp->fd, mcp->timeout_secs,
+                            mxp->verbose);
+    if (res)
+        return res;
+    if (mxp->aimd) {
+        mcp->t_sub_us = mux_now_us();
+        ++mfp->w.in_flight;
+        if (mfp->host_idx >= 0)
+            ++mxp->host_arr[mfp->host_idx].in_flight;
+    }
+    mcp->next = NULL;
+    if (mfp->head) {
+        for (p = mfp->head; p->next; p = p->next)
+            ;
+        p->next = mcp;
+    } else
+        mfp->head = mcp;
+    ++mxp->num_polled;
+    if (mcp->soft_ms > 0)
+        tw_arm(mxp, mcp);
+    return 0;
+}
+
+int
+sg_mux_submit(struct sg_mux * mxp, struct sg_mux_cmd * mcp)
+{
+    int res;
+    int vb = mxp->verbose;
+    unsigned int pack_id;
+    struct mux_fd * mfp = mux_find(mxp, mcp->fd);
+
+    if (NULL == mfp) {
+        if (vb)
+            pr2ws("%s: fd=%d not registered\n", __func__, mcp->fd);
+        return SCSI_PT_DO_BAD_PARAMS;
+    }
+    mcp->num_expired = 0;
+    mcp->tw_next = NULL;
+    mcp->tw_pprev = NULL;
+    if (! mfp->sync) {
+        if (mxp->aimd && (mfp->held_head || (! mux_room(mxp, mfp)))) {
+            mcp->next = NULL;
+            if (mfp->held_tail)
+                mfp->held_tail->next = mcp;
+            else
+                mfp->held_head = mcp;
+            mfp->held_tail = mcp;
+            ++mfp->num_held;
+            ++mxp->num_held;
+        } else if ((res = mux_start(mxp, mfp, mcp)))
+            return res;
+        ++mxp->in_flight;
+        return 0;
+    }
+    pack_id = __atomic_add_fetch(&mux_pack_id, 1, __ATOMIC_RELAXED);
+    set_scsi_pt_packet_id(mcp->ptp, 1 + (int)(pack_id % INT_MAX));
+    res = do_scsi_pt_submit(mcp->ptp, mcp->fd, mcp->timeout_secs, vb);
+    if (res)
+        return res;
+    ++mxp->in_flight;
+    /* usually done already, the NVMe io_uring engine may need a wait */
+    while (-EAGAIN == (res = do_scsi_pt_receive(mcp->ptp, mcp->fd, vb)))
+        scsi_pt_wait_for_response(mcp->fd, -1, vb);
+    mux_ready(mxp, mcp, res);
+    return 0;
+}
+
+/* Starts held commands while their windows have room, taking one per
+ * device in turn so that no device (nor the first on a shared host) is
+ * favoured. Commands that fail to start go to done() with the error. */
+static void
+mux_dispatch(struct sg_mux * mxp)
+{
+    int k, res;
+    bool started;
+    struct mux_fd * mfp;
+    struct sg_mux_cmd * mcp;
+    struct sg_mux_cmd * next_p;
+
+    while (mxp->num_held > 0) {
+        started = false;
+        for (k = 0; k < mxp->num_fds; ++k) {
+            mfp = mxp->fd_arr + ((mxp->rr_next + k) % mxp->num_fds);
+            if ((NULL == mfp->held_head) || (! mux_room(mxp, mfp)))
+                continue;
+            mcp = mfp->held_head;
+            next_p = mcp->next;
+            res = mux_start(mxp, mfp, mcp);
+            if (((-EAGAIN == res) || (-EBUSY == res)) &&
+                (mfp->w.in_flight > 0)) {
+                /* driver queue full: stay held, window to what fits */
+                mfp->w.win = mfp->w.in_flight;
+                ++mfp->w.num_dec;
+                continue;
+            }
+            mfp->held_head = next_p;
+            if (NULL == next_p)
+                mfp->held_tail = NULL;
+            --mfp->num_held;
+            --mxp->num_held;
+            if (res)
+                mux_ready(mxp, mcp, res);
+            started = true;
+        }
+        mxp->rr_next = (mxp->rr_next + 1) % mxp->num_fds;
+        if (! started)
+            break;
+    }
+}
+
+/* Multiplies the window at *winp by factor (never below 1 command) unless
+ * it was cut within the last round trip. Returns true if it shrank. */
+static bool
+mux_cut(double * winp, int64_t * hold_untilp, double factor, int64_t now,
+        int64_t rtt_us)
+{
+    double nw;
+
+    if (now < *hold_untilp)
+        return false;
+    nw = *winp * factor;
+    if (nw < 1.0)
+        nw = 1.0;
+    if (nw >= *winp)
+        return false;
+    *winp = nw;
+    *hold_untilp = now + rtt_us;
+    return true;
+}
+
+/* Adjusts the windows of the device on mfp, and of its host, for the
+ * response to mcp which was in flight there */
+static void
+mux_account(struct sg_mux * mxp, struct mux_fd * mfp,
+            const struct sg_mux_cmd * mcp)
+{
+    int was = mfp->w.in_flight--;
+    int host_was = 0;
+    bool dec;
+    int64_t base, target;
+    int64_t now = mux_now_us();
+    int64_t lat = now - mcp->t_sub_us;
+    struct mux_win * wp = &mfp->w;
+    struct mux_host * hp = NULL;
+
+    if (mfp->host_idx >= 0) {
+        hp = mxp->host_arr + mfp->host_idx;
+        host_was = hp->in_flight--;
+        if (0 == mxp->lim.max_host)
+            hp = NULL;          /* counted, but no window */
+    }
+    switch (mcp->cat) {
+    case SG_LIB_CAT_BUSY:
+        ++wp->num_busy;
+        if (mux_cut(&wp->win, &wp->hold_until_us, 0.5, now, lat))
+            ++wp->num_dec;
+        if (hp)
+            mux_cut(&hp->win, &hp->hold_until_us, 0.5, now, lat);
+        return;
+    case SG_LIB_CAT_TS_FULL:
+        ++wp->num_busy;
+        dec = mux_cut(&wp->win, &wp->hold_until_us, 0.5, now, lat);
+        /* the device's queue is full at fewer than was */
+        if ((was > 1) && (wp->win > was - 1)) {
+            wp->win = was - 1;
+            dec = true;
+        }
+        if (dec)
+            ++wp->num_dec;
+        return;
+    case SG_LIB_CAT_TIMEOUT:
+        if (mux_cut(&wp->win, &wp->hold_until_us, 0.5, now,
+                    wp->srtt_us ? wp->srtt_us : lat))
+            ++wp->num_dec;
+        return;
+    case 0:
+    case SG_LIB_CAT_RECOVERED:
+    case SG_LIB_CAT_NO_SENSE:
+    case SG_LIB_CAT_CONDITION_MET:
+        break;
+    default:            /* says nothing about congestion */
+        return;
+    }
+    if (now >= wp->period_end_us) {
+        wp->min_prev_us = wp->min_cur_us;
+        wp->min_cur_us = 0;
+        wp->period_end_us = now + MUX_MIN_PERIOD_US;
+    }
+    if ((0 == wp->min_cur_us) || (lat < wp->min_cur_us))
+        wp->min_cur_us = lat;
+    if (0 == wp->srtt_us)
+        wp->srtt_us = lat;
+    else
+        wp->srtt_us += (lat - wp->srtt_us) / 8;
+    if (mxp->lim.lat_target_us > 0)
+        target = mxp->lim.lat_target_us;
+    else {
+        base = wp->min_cur_us;
+        if ((wp->min_prev_us > 0) && (wp->min_prev_us < base))
+            base = wp->min_prev_us;
+        target = base * mxp->lim.lat_pct / 100;
+        if (target < MUX_LAT_FLOOR_US)
+            target = MUX_LAT_FLOOR_US;
+    }
+    if (wp->srtt_us > target) {
+        if (mux_cut(&wp->win, &wp->hold_until_us, 0.75, now, wp->srtt_us))
+            ++wp->num_dec;
+    } else if ((was >= (int)wp->win) && (wp->win < mxp->lim.max_dev)) {
+        int before = (int)wp->win;
+
+        /* only grow a window that is in use */
+        wp->win += 1.0 / wp->win;
+        if (wp->win > mxp->lim.max_dev)
+            wp->win = mxp->lim.max_dev;
+        if ((int)wp->win > before)
+            ++wp->num_inc;
+    }
+    if (hp && (host_was >= (int)hp->win) && (hp->win < mxp->lim.max_host)) {
+        hp->win += 1.0 / hp->win;
+        if (hp->win > mxp->lim.max_host)
+            hp->win = mxp->lim.max_host;
+    }
+}
+
+/* The device on mfp has at least one response ready. Each of its commands
+ * in flight is asked for its response (they are few per device compared
+ * with the number of devices), those that have one move to the ready
+ * list. Late responses to released commands are read and discarded, their
+ * pt objects are handed back. */
+static void
+mux_collect(struct sg_mux * mxp, struct mux_fd * mfp)
+{
+    int res;
+    struct sg_mux_cmd * mcp;
+    struct sg_mux_cmd ** pp = &mfp->head;
+    struct mux_orphan * op;
+    struct mux_orphan ** opp = &mfp->orphans;
+
+    while ((op = *opp)) {
+        res = do_scsi_pt_receive(op->ptp, mfp->fd, mxp->verbose);
+        if (-EAGAIN == res) {
+            opp = &op->next;
+            continue;
+        }
+        if (mxp->verbose > 2)
+            pr2ws("%s: fd=%d, late response to released command, res=%d\n",
+                  __func__, mfp->fd, res);
+        *opp = op->next;
+        --mxp->num_polled;
+        --mxp->num_orphans;
+        mux_reclaim(op);
+    }
+
+    while ((mcp = *pp)) {
+        res = do_scsi_pt_receive(mcp->ptp, mfp->fd, mxp->verbose);
+        if (-EAGAIN == res) {
+            pp = &mcp->next;
+            continue;
+        }
+        *pp = mcp->next;
+        --mxp->num_polled;
+        mux_ready(mxp, mcp, res);
+        if (mxp->aimd)
+            mux_account(mxp, mfp, mcp);
+    }
+}
+
+/* Sends a logical unit or target reset (sg devices only). The command
+ * should then complete, with an error, in the usual way. */
+static void
+mux_reset(struct sg_mux * mxp, int fd, bool target)
+{
+    int k = (target ? SG_SCSI_RESET_TARGET : SG_SCSI_RESET_DEVICE) |
+            SG_SCSI_RESET_NO_ESCALATE;
+
+    if ((ioctl(fd, SG_SCSI_RESET, &k) < 0) && mxp->verbose)
+        pr2ws("%s: fd=%d, ioctl(SG_SCSI_RESET, %s) failed: %s\n", __func__,
+              fd, target ? "target" : "lu", safe_strerror(errno));
+}
+
+/* Gives up waiting for mcp: it is taken off its device's list and will be
+ * handed to done() with -ETIMEDOUT and without its pt object. That moves
+ * to the device's orphan list, where it stays (still counted as polled)
+ * until mux_collect() reads its late response. Returns false, leaving mcp
+ * in flight, if there is no memory for that. */
+static bool
+mux_release(struct sg_mux * mxp, struct sg_mux_cmd * mcp)
+{
+    struct mux_fd * mfp = mux_find(mxp, mcp->fd);
+    struct sg_mux_cmd ** pp;
+    struct mux_orphan * op;
+
+    if (NULL == mfp)
+        return true;
+    op = (struct mux_orphan *)malloc(sizeof(*op));
+    if (NULL == op)
+        return false;
+    for (pp = &mfp->head; *pp; pp = &(*pp)->next) {
+        if (*pp == mcp) {
+            *pp = mcp->next;
+            break;
+        }
+    }
+    op->ptp = mcp->ptp;
+    op->ctx = mcp->ctx;
+    op->reclaim = mcp->reclaim;
+    op->next = mfp->orphans;
+    mfp->orphans = op;
+    ++mxp->num_orphans;
+    mux_ready(mxp, mcp, -ETIMEDOUT);
+    mcp->ptp = NULL;
+    if (mxp->aimd)
+        mux_account(mxp, mfp, mcp);
+    return true;
+}
+
+static void
+mux_expire(struct sg_mux * mxp, struct sg_mux_cmd * mcp)
+{
+    int act;
+
+    ++mcp->num_expired;
+    act = mcp->expired ? mcp->expired(mcp, mcp->ctx) : SG_MUX_EXP_RELEASE;
+    if (mxp->verbose > 2)
+        pr2ws("%s: fd=%d, soft deadline passed (%d), action=%d\n",
+              __func__, mcp->fd, mcp->num_expired, act);
+    switch (act) {
+    case SG_MUX_EXP_RESET_LU:
+    case SG_MUX_EXP_RESET_TARGET:
+        mux_reset(mxp, mcp->fd, (SG_MUX_EXP_RESET_TARGET == act));
+        /* fall through */
+    case SG_MUX_EXP_WAIT:
+        tw_arm(mxp, mcp);
+        break;
+    default:
+        if (! mux_release(mxp, mcp))
+            tw_arm(mxp, mcp);   /* out of memory: wait instead */
+        break;
+    }
+}
+
+/* Moves the timer wheel forward to now, expiring the deadlines passed */
+static void
+tw_advance(struct sg_mux * mxp)
+{
+    int64_t t;
+    int64_t now = mux_now_tick(mxp);
+    struct sg_mux_cmd * mcp;
+    struct sg_mux_cmd * next_p;
+    struct sg_mux_cmd ** headp;
+
+    while ((mxp->num_timers > 0) && (mxp->cur_tick < now)) {
+        t = ++mxp->cur_tick;
+        if (0 == (t & (MUX_TW0_SZ - 1))) {
+            /* the inner wheel came round, bring in the next outer slot */
+            headp = mxp->tw1 + ((t >> MUX_TW0_BITS) & (MUX_TW1_SZ - 1));
+            mcp = *headp;
+            *headp = NULL;
+            for ( ; mcp; mcp = next_p) {
+                next_p = mcp->tw_next;
+                tw_insert(mxp, mcp);
+            }
+        }
+        headp = mxp->tw0 + (t & (MUX_TW0_SZ - 1));
+        while ((mcp = *headp)) {
+            tw_remove(mxp, mcp);
+            mux_expire(mxp, mcp);
+        }
+    }
+    if (mxp->cur_tick < now)    /* wheel empty, skip ahead */
+        mxp->cur_tick = now;
+}
+
+int
+sg_mux_run(struct sg_mux * mxp, int timeout_ms)
+{
+    int k, n, err, tw_ms;
+    int num = 0;
+    struct mux_fd * mfp;
+    struct sg_mux_cmd * mcp;
+    struct epoll_event evs[MUX_MAX_EVENTS];
+
+    if ((0 == mxp->in_flight) && (0 == mxp->num_orphans))
+        return 0;
+    tw_ms = tw_wait_ms(mxp);
+    if ((tw_ms >= 0) && ((timeout_ms < 0) || (tw_ms < timeout_ms)))
+        timeout_ms = tw_ms;
+    if (mxp->num_polled > 0) {
+        n = epoll_wait(mxp->ep_fd, evs, MUX_MAX_EVENTS,
+                       mxp->ready_head ? 0 : timeout_ms);
+        if (n < 0) {
+            err = errno;
+            if (EINTR != err) {
+                if (mxp->verbose)
+                    pr2ws("%s: epoll_wait() failed: %s\n", __func__,
+                          safe_strerror(err));
+                return -err;
+            }
+            n = 0;
+        }
+        for (k = 0; k < n; ++k) {
+            if ((mfp = mux_find(mxp, evs[k].data.fd)))
+                mux_collect(mxp, mfp);
+        }
+        tw_advance(mxp);
+    }
+    /* room made by those responses goes to held commands before done()
+     * can submit more */
+    mux_dispatch(mxp);
+    /* done() may submit more, those wait for the next call */
+    mcp = mxp->ready_head;
+    mxp->ready_head = NULL;
+    mxp->ready_tail = NULL;
+    while (mcp) {
+        struct sg_mux_cmd * next_p = mcp->next;
+
+        --mxp->in_flight;
+        ++num;
+        mcp->next = NULL;
+        mcp->done(mcp, mcp->ctx);
+        mcp = next_p;
+    }
+    return num;
+}
+
+int
+sg_mux_in_flight(const struct sg_mux * mxp)
+{
+    return mxp->in_flight;
+}
+
+int
+sg_mux_num_released(const struct sg_mux * mxp)
+{
+    return mxp->num_orphans;
+}
+
+int
+sg_mux_set_aimd(struct sg_mux * mxp, const struct sg_mux_aimd * ap)
+{
+    int k;
+    struct sg_mux_aimd * lp = &mxp->lim;
+
+    if (mxp->in_flight > 0)
+        return -EBUSY;
+    if (NULL == ap) {
+        mxp->aimd = false;
+        return 0;
+    }
+    if ((ap->max_dev < 0) || (ap->max_host < 0) || (ap->init_dev < 0) ||
+        (ap->lat_target_us < 0) || (ap->lat_pct < 0))
+        return -EINVAL;
+    *lp = *ap;
+    if (0 == lp->max_dev)
+        lp->max_dev = 64;
+    if ((0 == lp->init_dev) || (lp->init_dev > lp->max_dev))
+        lp->init_dev = (lp->max_dev < 4) ? lp->max_dev : 4;
+    if (0 == lp->lat_pct)
+        lp->lat_pct = 300;
+    for (k = 0; k < mxp->num_fds; ++k)
+        mux_win_init(mxp, mxp->fd_arr + k);
+    for (k = 0; k < mxp->num_hosts; ++k) {
+        mxp->host_arr[k].in_flight = 0;
+        mxp->host_arr[k].win = lp->max_host;
+        mxp->host_arr[k].hold_until_us = 0;
+    }
+    mxp->aimd = true;
+    if (mxp->verbose > 1)
+        pr2ws("%s: windows per device %d to %d, per host %d\n", __func__,
+              lp->init_dev, lp->max_dev, lp->max_host);
+    return 0;
+}
+
+int
+sg_mux_get_aimd_stats(const struct sg_mux * mxp, int fd,
+                      struct sg_mux_aimd_stats * sp)
+{
+    const struct mux_fd * mfp = mux_find(mxp, fd);
+    const struct mux_win * wp;
+
+    if (NULL == mfp)
+        return -ENOENT;
+    if (! mxp->aimd)
+        return -EINVAL;
+    wp = &mfp->w;
+    memset(sp, 0, sizeof(*sp));
+    sp->win = (int)wp->win;
+    sp->in_flight = wp->in_flight;
+    sp->held = mfp->num_held;
+    sp->host = -1;
+    if (mfp->host_idx >= 0) {
+        sp->host = mxp->host_arr[mfp->host_idx].host_no;
+        if (mxp->lim.max_host > 0)
+            sp->host_win = (int)mxp->host_arr[mfp->host_idx].win;
+    }
+    sp->min_lat_us = wp->min_cur_us;
+    if ((wp->min_prev_us > 0) &&
+        ((0 == sp->min_lat_us) || (wp->min_prev_us < sp->min_lat_us)))
+        sp->min_lat_us = wp->min_prev_us;
+    sp->srtt_us = wp->srtt_us;
+    sp->num_inc = wp->num_inc;
+    sp->num_dec = wp->num_dec;
+    sp->num_busy = wp->num_busy;
+    return 0;
+}
+
+#else           /* not SG_LIB_LINUX */
+
+struct sg_mux *
+sg_mux_new(int verbose)
+{
+    if (verbose > 1)
+        pr2ws("%s: not available on this OS\n", __func__);
+    errno = ENOSYS;
+    return NULL;
+}
+
+void
+sg_mux_free(struct sg_mux * mxp)
+{
+    if (mxp) { }
+}
+
+int
+sg_mux_add_fd(struct sg_mux * mxp, int fd)
+{
+    if (mxp) { }
+    if (fd) { }
+    return -ENOSYS;
+}
+
+int
+sg_mux_del_fd(struct sg_mux * mxp, int fd)
+{
+    if (mxp) { }
+    if (fd) { }
+    return -ENOSYS;
+}
+
+int
+sg_mux_submit(struct sg_mux * mxp, struct sg_mux_cmd * mcp)
+{
+    if (mxp) { }
+    if (mcp) { }
+    return -ENOSYS;
+}
+
+int
+sg_mux_run(struct sg_mux * mxp, int timeout_ms)
+{
+    if (mxp) { }
+    if (timeout_ms) { }
+    return -ENOSYS;
+}
+
+int
+sg_mux_in_flight(const struct sg_mux * mxp)
+{
+    if (mxp) { }
+    return 0;
+}
+
+int
+sg_mux_num_released(const struct sg_mux * mxp)
+{
+    if (mxp) { }
+    return 0;
+}
+
+int
+sg_mux_set_aimd(struct sg_mux * mxp, const struct sg_mux_aimd * ap)
+{
+    if (mxp) { }
+    if (ap) { }
+    return -ENOSYS;
+}
+
+int
+sg_mux_get_aimd_stats(const struct sg_mux * mxp, int fd,
+                      struct sg_mux_aimd_stats * sp)
+{
+    if (mxp) { }
+    if (fd) { }
+    if (sp) { }
+    return -ENOSYS;
+}
+
+#endif          /* SG_LIB_LINUX */
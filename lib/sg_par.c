@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/* sg_par version 1.00 20261015 */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#ifndef SG_LIB_WIN32
+#define SG_PAR_THREADS 1
+#include <pthread.h>
+#endif
+
+#include "sg_lib.h"
+#include "sg_par.h"
+#include "sg_pr2serr.h"
+
+struct sg_par_pool {
+    bool stop;                  /* a job returned other than 0, under mtx */
+    int res;                    /* that value, under mtx */
+    int per_grp;                /* 0 -> no group limit */
+    int64_t num;
+    int64_t next;               /* under mtx */
+    const int * grp_arr;
+    int * busy_arr;             /* jobs running per group, under mtx */
+    bool * taken_arr;           /* under mtx */
+    sg_par_fn fn;
+    void * ctx;
+#ifdef SG_PAR_THREADS
+    pthread_mutex_t mtx;
+    pthread_cond_t cv;
+#endif
+};
+
+#ifdef SG_PAR_THREADS
+static pthread_mutex_t sg_par_mtx = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+
+int
+sg_par_get_num(const char * arg, int min_par, int max_par)
+{
+    int n = sg_get_num(arg);
+
+    if ((n < min_par) || (n > max_par)) {
+        pr2serr("bad argument to '--parallel=', expect %d to %d\n", min_par,
+                max_par);
+        return -1;
+    }
+    return n;
+}
+
+void
+sg_par_lock(void)
+{
+#ifdef SG_PAR_THREADS
+    pthread_mutex_lock(&sg_par_mtx);
+#endif
+}
+
+void
+sg_par_unlock(void)
+{
+#ifdef SG_PAR_THREADS
+    pthread_mutex_unlock(&sg_par_mtx);
+#endif
+}
+
+/* Returns the lowest k not yet taken whose group is below its limit, -1
+ * if all have been taken (or a job has failed) or -2 if the caller should
+ * wait. Call with mtx held. */
+static int64_t
+par_next(struct sg_par_pool * pp)
+{
+    int64_t k;
+
+    if (pp->stop)
+        return -1;
+    if (0 == pp->per_grp)
+        return (pp->next < pp->num) ? pp->next++ : -1;
+    while ((pp->next < pp->num) && pp->taken_arr[pp->next])
+        ++pp->next;
+    if (pp->next >= pp->num)
+        return -1;
+    for (k = pp->next; k < pp->num; ++k) {
+        if ((! pp->taken_arr[k]) &&
+            (pp->busy_arr[pp->grp_arr[k]] < pp->per_grp)) {
+            pp->taken_arr[k] = true;
+            ++pp->busy_arr[pp->grp_arr[k]];
+            return k;
+        }
+    }
+    return -2;
+}
+
+static void *
+par_worker(void * v_pp)
+{
+    int res;
+    int64_t k;
+    struct sg_par_pool * pp = (struct sg_par_pool *)v_pp;
+
+#ifdef SG_PAR_THREADS
+    pthread_mutex_lock(&pp->mtx);
+#endif
+    while (true) {
+        k = par_next(pp);
+        if (-1 == k)
+            break;
+        if (-2 == k) {
+#ifdef SG_PAR_THREADS
+            pthread_cond_wait(&pp->cv, &pp->mtx);
+            continue;
+#else
+            break;      /* not reached: one caller never waits */
+#endif
+        }
+#ifdef SG_PAR_THREADS
+        pthread_mutex_unlock(&pp->mtx);
+#endif
+        res = pp->fn(k, pp->ctx);
+#ifdef SG_PAR_THREADS
+        pthread_mutex_lock(&pp->mtx);
+#endif
+        if (res && (! pp->stop)) {
+            pp->stop = true;
+            pp->res = res;
+        }
+        if (pp->per_grp > 0) {
+            --pp->busy_arr[pp->grp_arr[k]];
+#ifdef SG_PAR_THREADS
+            pthread_cond_broadcast(&pp->cv);
+#endif
+        }
+    }
+#ifdef SG_PAR_THREADS
+    pthread_mutex_unlock(&pp->mtx);
+#endif
+    return NULL;
+}
+
+static int
+par_run(struct sg_par_pool * pp, int num_par)
+{
+#ifdef SG_PAR_THREADS
+    int k, num_thr;
+    pthread_t thr_arr[SG_PAR_MAX];
+
+    if (num_par > SG_PAR_MAX)
+        num_par = SG_PAR_MAX;
+    num_thr = (num_par < pp->num) ? num_par : (int)pp->num;
+    pthread_mutex_init(&pp->mtx, NULL);
+    pthread_cond_init(&pp->cv, NULL);
+    /* the calling thread is one of the workers */
+    for (k = 0; k < (num_thr - 1); ++k) {
+        if (pthread_create(thr_arr + k, NULL, par_worker, pp))
+            break;
+    }
+    num_thr = k;
+    par_worker(pp);
+    for (k = 0; k < num_thr; ++k)
+        pthread_join(thr_arr[k], NULL);
+    pthread_cond_destroy(&pp->cv);
+    pthread_mutex_destroy(&pp->mtx);
+#else
+    if (num_par) { ; }          /* suppress warning; one at a time */
+    par_worker(pp);
+#endif
+    return pp->res;
+}
+
+int
+sg_par_each(int64_t num, int num_par, sg_par_fn fn, void * ctx)
+{
+    struct sg_par_pool pool;
+
+    if (num <= 0)
+        return 0;
+    memset(&pool, 0, sizeof(pool));
+    pool.num = num;
+    pool.fn = fn;
+    pool.ctx = ctx;
+    return par_run(&pool, num_par);
+}
+
+int
+sg_par_each_grouped(int64_t num, int num_par, int per_grp,
+                    const int * grp_arr, sg_par_fn fn, void * ctx)
+{
+    int num_grps, res;
+    int64_t k;
+    struct sg_par_pool pool;
+
+    if (num <= 0)
+        return 0;
+    memset(&pool, 0, sizeof(pool));
+    pool.num = num;
+    pool.fn = fn;
+    pool.ctx = ctx;
+    for (k = 0, num_grps = 0; grp_arr && (per_grp > 0) && (k < num); ++k) {
+        if (grp_arr[k] >= num_grps)
+            num_grps = grp_arr[k] + 1;
+    }
+    if (num_grps > 0) {
+        pool.busy_arr = (int *)calloc(num_grps, sizeof(int));
+        pool.taken_arr = (bool *)calloc(num, sizeof(bool));
+        if (pool.busy_arr && pool.taken_arr) {
+            pool.per_grp = per_grp;
+            pool.grp_arr = grp_arr;
+        }
+    }
+    res = par_run(&pool, num_par);
+    free(pool.busy_arr);
+    free(pool.taken_arr);
+    return res;
+}
@@ -0,0 +1,219 @@
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/* sg_pat version 1.00 20261015 */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_GETRANDOM
+#include <sys/random.h>         /* for getrandom() system call */
+#endif
+
+#include "sg_lib.h"
+#include "sg_pat.h"
+#include "sg_unaligned.h"
+#include "sg_pr2serr.h"
+
+#define SG_PAT_GAMMA 0x9e3779b97f4a7c15ULL     /* 2**64 / golden ratio */
+
+
+/* The splitmix64 finalizer: a bijection on 64 bit values whose outputs for
+ * consecutive inputs pass statistical tests. Each word of a prng block is
+ * computed from its index alone, so there is no dependency between words
+ * and the compiler can interleave (or vectorize) the multiplies. */
+static inline uint64_t
+pat_mix64(uint64_t z)
+{
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+bool
+sg_pat_is_pat(const char * name)
+{
+    return name && (0 == strncmp(name, SG_PAT_PREFIX,
+                                 sizeof(SG_PAT_PREFIX) - 1));
+}
+
+bool
+sg_pat_parse(const char * name, struct sg_pat * pp)
+{
+    int k, n;
+    int64_t ll;
+    const char * cp;
+    unsigned int h;
+
+    memset(pp, 0, sizeof(*pp));
+    if (! sg_pat_is_pat(name))
+        return false;
+    cp = name + sizeof(SG_PAT_PREFIX) - 1;
+    if (0 == strcmp(cp, "zero")) {
+        pp->kind = SG_PAT_BYTES;
+        pp->num_bytes = 1;
+        return true;
+    }
+    if (0 == strcmp(cp, "lba")) {
+        pp->kind = SG_PAT_LBA;
+        return true;
+    }
+    if (0 == strncmp(cp, "prng", 4)) {
+        pp->kind = SG_PAT_PRNG;
+        if (',' == cp[4]) {
+            ll = sg_get_llnum_nomult(cp + 5);
+            if (ll < 0)
+                return false;
+            pp->seed = (uint64_t)ll;
+            pp->seed_given = true;
+            return true;
+        } else if (cp[4])
+            return false;
+#ifdef HAVE_GETRANDOM
+        if (getrandom(&pp->seed, sizeof(pp->seed), GRND_NONBLOCK) ==
+            (ssize_t)sizeof(pp->seed))
+            return true;
+#endif
+        pp->seed = pat_mix64((uint64_t)time(NULL));
+        return true;
+    }
+    /* otherwise hex digits, two per byte, with optional leading 0x */
+    if (('0' == cp[0]) && ('x' == tolower((uint8_t)cp[1])))
+        cp += 2;
+    n = strlen(cp);
+    if ((n < 2) || (n & 1) || (n > (2 * SG_PAT_MAX_BYTES)))
+        return false;
+    for (k = 0; k < n; k += 2) {
+        if ((! isxdigit((uint8_t)cp[k])) || (! isxdigit((uint8_t)cp[k + 1])))
+            return false;
+        if (1 != sscanf(cp + k, "%2x", &h))
+            return false;
+        pp->bytes[k / 2] = (uint8_t)h;
+    }
+    pp->kind = SG_PAT_BYTES;
+    pp->num_bytes = n / 2;
+    /* "0000" is the same as "00" but can be filled with memset() */
+    for (k = 1; k < pp->num_bytes; ++k) {
+        if (pp->bytes[k] != pp->bytes[0])
+            break;
+    }
+    if (k >= pp->num_bytes)
+        pp->num_bytes = 1;
+    return true;
+}
+
+bool
+sg_pat_lba_indep(const struct sg_pat * pp)
+{
+    return (SG_PAT_BYTES == pp->kind);
+}
+
+/* Fills n bytes at bp with the len bytes at pp repeated, by doubling the
+ * copied run so memcpy() does the (wide) work. */
+static void
+pat_repeat(uint8_t * bp, int n, const uint8_t * pp, int len)
+{
+    int k;
+
+    k = (len < n) ? len : n;
+    memcpy(bp, pp, k);
+    for ( ; k < n; k *= 2)
+        memcpy(bp + k, bp, ((2 * k) <= n) ? k : (n - k));
+}
+
+void
+sg_pat_fill(const struct sg_pat * pp, uint8_t * bp, int blk_sz,
+            uint64_t lba, int num_blks)
+{
+    int k, j, rem;
+    int words = blk_sz / 8;
+    uint64_t s;
+    uint8_t b[8];
+
+    if ((blk_sz < 1) || (num_blks < 1))
+        return;
+    rem = blk_sz - (words * 8);
+    switch (pp->kind) {
+    case SG_PAT_BYTES:
+        if (1 == pp->num_bytes) {
+            memset(bp, pp->bytes[0], (size_t)blk_sz * num_blks);
+            break;
+        }
+        /* each block starts with the first byte of the pattern */
+        pat_repeat(bp, blk_sz, pp->bytes, pp->num_bytes);
+        if (num_blks > 1)
+            pat_repeat(bp + blk_sz, blk_sz * (num_blks - 1), bp, blk_sz);
+        break;
+    case SG_PAT_LBA:
+        for (k = 0; k < num_blks; ++k, ++lba, bp += blk_sz) {
+            sg_put_unaligned_be64(lba, b);
+            for (j = 0; j < words; ++j)
+                memcpy(bp + (8 * j), b, 8);
+            if (rem)
+                memcpy(bp + (8 * words), b, rem);
+        }
+        break;
+    case SG_PAT_PRNG:
+        for (k = 0; k < num_blks; ++k, ++lba, bp += blk_sz) {
+            s = pat_mix64(pp->seed ^ pat_mix64(lba));
+            for (j = 0; j < words; ++j)
+                sg_put_unaligned_le64(pat_mix64(s + (j + 1) * SG_PAT_GAMMA),
+                                      bp + (8 * j));
+            if (rem) {
+                sg_put_unaligned_le64(pat_mix64(s + (j + 1) * SG_PAT_GAMMA),
+                                      b);
+                memcpy(bp + (8 * words), b, rem);
+            }
+        }
+        break;
+    default:
+        memset(bp, 0, (size_t)blk_sz * num_blks);
+        break;
+    }
+}
+
+char *
+sg_pat_str(const struct sg_pat * pp, char * b, int blen)
+{
+    int k, n;
+
+    if (blen < 1)
+        return b;
+    switch (pp->kind) {
+    case SG_PAT_BYTES:
+        if ((1 == pp->num_bytes) && (0 == pp->bytes[0])) {
+            sg_scnpr(b, blen, "%szero", SG_PAT_PREFIX);
+            break;
+        }
+        n = sg_scnpr(b, blen, "%s0x", SG_PAT_PREFIX);
+        for (k = 0; k < pp->num_bytes; ++k)
+            n += sg_scnpr(b + n, blen - n, "%02x", pp->bytes[k]);
+        break;
+    case SG_PAT_LBA:
+        sg_scnpr(b, blen, "%slba", SG_PAT_PREFIX);
+        break;
+    case SG_PAT_PRNG:
+        sg_scnpr(b, blen, "%sprng,%" PRIu64, SG_PAT_PREFIX, pp->seed);
+        break;
+    default:
+        b[0] = '\0';
+        break;
+    }
+    return b;
+}
@@ -0,0 +1,340 @@
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/* sg_pi version 1.00 20261014 */
+
+/* T10 protection information (PI) generation and checking for the dd
+ * family of utilities, so data copied from a file to a PI formatted
+ * logical unit (or between them) is protected end to end. The guard is a
+ * CRC16 T10-DIF. On x86_64 it is computed by folding 64 bytes at a time
+ * with carry-less multiplies when the CPU has PCLMULQDQ, otherwise (and
+ * on other architectures) a slice-by-8 table is used. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "sg_pi.h"
+#include "sg_unaligned.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define SG_PI_X86_CLMUL 1
+#include <tmmintrin.h>          /* _mm_shuffle_epi8() */
+#include <wmmintrin.h>          /* _mm_clmulepi64_si128() */
+#endif
+
+#define CRC16_T10DIF_POLY 0x8bb7
+
+
+static uint16_t crc16_tbl[8][256];
+static bool crc16_tbl_built;
+static int crc16_hw = -1;       /* -1: not checked yet */
+
+#ifdef SG_PI_X86_CLMUL
+/* fold constants: x^n mod P(x) */
+static uint64_t k_128, k_192, k_512, k_576;
+
+static uint64_t
+xpow_mod(int n)
+{
+    int k;
+    uint32_t r = 1;
+
+    for (k = 0; k < n; ++k) {
+        r <<= 1;
+        if (r & 0x10000)
+            r ^= (0x10000 | CRC16_T10DIF_POLY);
+    }
+    return r;
+}
+#endif
+
+static void
+crc16_build(void)
+{
+    int j, k;
+    uint16_t c;
+
+    for (k = 0; k < 256; ++k) {
+        c = (uint16_t)(k << 8);
+        for (j = 0; j < 8; ++j)
+            c = (c & 0x8000) ? (uint16_t)((c << 1) ^ CRC16_T10DIF_POLY) :
+                               (uint16_t)(c << 1);
+        crc16_tbl[0][k] = c;
+    }
+    for (k = 0; k < 256; ++k) {
+        c = crc16_tbl[0][k];
+        for (j = 1; j < 8; ++j) {
+            c = (uint16_t)(c << 8) ^ crc16_tbl[0][c >> 8];
+            crc16_tbl[j][k] = c;
+        }
+    }
+#ifdef SG_PI_X86_CLMUL
+    k_128 = xpow_mod(128);
+    k_192 = xpow_mod(192);
+    k_512 = xpow_mod(512);
+    k_576 = xpow_mod(576);
+#endif
+    crc16_tbl_built = true;
+}
+
+static uint16_t
+crc16_sw(uint16_t crc, const uint8_t * bp, size_t len)
+{
+    for ( ; len >= 8; len -= 8, bp += 8) {
+        crc = crc16_tbl[7][bp[0] ^ (crc >> 8)] ^
+              crc16_tbl[6][bp[1] ^ (crc & 0xff)] ^
+              crc16_tbl[5][bp[2]] ^ crc16_tbl[4][bp[3]] ^
+              crc16_tbl[3][bp[4]] ^ crc16_tbl[2][bp[5]] ^
+              crc16_tbl[1][bp[6]] ^ crc16_tbl[0][bp[7]];
+    }
+    while (len--)
+        crc = (uint16_t)(crc << 8) ^ crc16_tbl[0][(crc >> 8) ^ *bp++];
+    return crc;
+}
+
+#ifdef SG_PI_X86_CLMUL
+/* Each 16 bytes is loaded byte reversed so it is a 128 bit polynomial with
+ * its first byte holding the highest powers. A 128 bit remainder is moved
+ * 128 (or 512) bits further along by multiplying its two halves by
+ * x^192 and x^128 (or x^576 and x^512) mod P. At the end the 128 bits left
+ * are reduced with the table. */
+__attribute__((target("pclmul,ssse3")))
+static inline __m128i
+fold_128(__m128i x, __m128i k, __m128i d)
+{
+    return _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x11),
+                                       _mm_clmulepi64_si128(x, k, 0x00)), d);
+}
+
+__attribute__((target("pclmul,ssse3")))
+static uint16_t
+crc16_x86(uint16_t crc, const uint8_t * bp, size_t len)
+{
+    const __m128i bswap = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8,
+                                        7, 6, 5, 4, 3, 2, 1, 0);
+    const __m128i k1 = _mm_set_epi64x((int64_t)k_192, (int64_t)k_128);
+    __m128i x0, x1, x2, x3;
+    uint8_t b[16];
+
+    if (len < 16)
+        return crc16_sw(crc, bp, len);
+    /* the initial crc goes over the first 16 bits of the data */
+    x0 = _mm_xor_si128(_mm_shuffle_epi8(
+                        _mm_loadu_si128((const __m128i *)bp), bswap),
+                       _mm_set_epi64x((int64_t)((uint64_t)crc << 48), 0));
+    if (len >= 64) {
+        const __m128i k4 = _mm_set_epi64x((int64_t)k_576, (int64_t)k_512);
+
+        x1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(bp + 16)),
+                              bswap);
+        x2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(bp + 32)),
+                              bswap);
+        x3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(bp + 48)),
+                              bswap);
+        for (bp += 64, len -= 64; len >= 64; bp += 64, len -= 64) {
+            x0 = fold_128(x0, k4, _mm_shuffle_epi8(
+                          _mm_loadu_si128((const __m128i *)bp), bswap));
+            x1 = fold_128(x1, k4, _mm_shuffle_epi8(
+                          _mm_loadu_si128((const __m128i *)(bp + 16)),
+                          bswap));
+            x2 = fold_128(x2, k4, _mm_shuffle_epi8(
+                          _mm_loadu_si128((const __m128i *)(bp + 32)),
+                          bswap));
+            x3 = fold_128(x3, k4, _mm_shuffle_epi8(
+                          _mm_loadu_si128((const __m128i *)(bp + 48)),
+                          bswap));
+        }
+        x0 = fold_128(fold_128(fold_128(x0, k1, x1), k1, x2), k1, x3);
+    } else {
+        bp += 16;
+        len -= 16;
+    }
+    for ( ; len >= 16; bp += 16, len -= 16)
+        x0 = fold_128(x0, k1, _mm_shuffle_epi8(
+                      _mm_loadu_si128((const __m128i *)bp), bswap));
+    _mm_storeu_si128((__m128i *)b, _mm_shuffle_epi8(x0, bswap));
+    crc = crc16_sw(0, b, sizeof(b));
+    return crc16_sw(crc, bp, len);
+}
+#endif
+
+void
+sg_pi_init(void)
+{
+    if (! crc16_tbl_built)
+        crc16_build();
+    if (crc16_hw < 0) {
+#ifdef SG_PI_X86_CLMUL
+        __builtin_cpu_init();
+        crc16_hw = (__builtin_cpu_supports("pclmul") &&
+                    __builtin_cpu_supports("ssse3"));
+#else
+        crc16_hw = 0;
+#endif
+    }
+}
+
+bool
+sg_pi_crc16_hw(void)
+{
+    sg_pi_init();
+    return !! crc16_hw;
+}
+
+uint16_t
+sg_pi_crc16(uint16_t crc, const void * p, size_t len)
+{
+    const uint8_t * bp = (const uint8_t *)p;
+
+    if (crc16_hw < 0)
+        sg_pi_init();
+#ifdef SG_PI_X86_CLMUL
+    if (crc16_hw > 0)
+        return crc16_x86(crc, bp, len);
+#endif
+    return crc16_sw(crc, bp, len);
+}
+
+static uint32_t
+exp_ref_tag(const struct sg_pi_ctx * pcp, uint64_t lba, int k)
+{
+    switch (pcp->prot_type) {
+    case 1:
+        return (uint32_t)(lba + k);
+    case 2:
+        return pcp->ref_tag + (uint32_t)k;
+    default:
+        return pcp->ref_tag;
+    }
+}
+
+void
+sg_pi_generate(const struct sg_pi_ctx * pcp, uint64_t lba, int num_blks,
+               uint8_t * bp, uint8_t * pip)
+{
+    int k;
+    uint32_t bl = pcp->blk_len;
+    uint8_t * tp;
+
+    for (k = 0; k < num_blks; ++k) {
+        if (pip) {
+            tp = pip + (k * SG_PI_TUPLE_LEN);
+            sg_put_unaligned_be16(sg_pi_crc16(0, bp, bl), tp + 0);
+            bp += bl;
+        } else {
+            tp = bp + bl;
+            sg_put_unaligned_be16(sg_pi_crc16(0, bp, bl), tp + 0);
+            bp += bl + SG_PI_TUPLE_LEN;
+        }
+        sg_put_unaligned_be16(pcp->app_tag, tp + 2);
+        sg_put_unaligned_be32(exp_ref_tag(pcp, lba, k), tp + 4);
+    }
+}
+
+int
+sg_pi_verify(const struct sg_pi_ctx * pcp, uint64_t lba, int num_blks,
+             const uint8_t * bp, const uint8_t * pip, int * bad_idxp)
+{
+    int k;
+    int res = SG_PI_OK;
+    uint16_t at;
+    uint32_t bl = pcp->blk_len;
+    uint32_t rt;
+    const uint8_t * dp;
+    const uint8_t * tp;
+
+    for (k = 0; k < num_blks; ++k) {
+        if (pip) {
+            dp = bp + ((size_t)k * bl);
+            tp = pip + (k * SG_PI_TUPLE_LEN);
+        } else {
+            dp = bp + ((size_t)k * (bl + SG_PI_TUPLE_LEN));
+            tp = dp + bl;
+        }
+        at = sg_get_unaligned_be16(tp + 2);
+        rt = sg_get_unaligned_be32(tp + 4);
+        if (SG_PI_APP_ESCAPE == at) {
+            if ((3 != pcp->prot_type) || (SG_PI_REF_ESCAPE == rt))
+                continue;       /* tuple not checked */
+        }
+        if (sg_get_unaligned_be16(tp + 0) != sg_pi_crc16(0, dp, bl))
+            res = SG_PI_BAD_GUARD;
+        else if ((at & pcp->app_mask) != (pcp->app_tag & pcp->app_mask))
+            res = SG_PI_BAD_APP_TAG;
+        else if (((3 != pcp->prot_type) || pcp->chk_ref3) &&
+                 (rt != exp_ref_tag(pcp, lba, k)))
+            res = SG_PI_BAD_REF_TAG;
+        if (res) {
+            if (bad_idxp)
+                *bad_idxp = k;
+            return res;
+        }
+    }
+    return SG_PI_OK;
+}
+
+void
+sg_pi_interleave(uint32_t blk_len, int num_blks, const uint8_t * dp,
+                 const uint8_t * pip, uint8_t * ip)
+{
+    int k;
+
+    for (k = 0; k < num_blks; ++k) {
+        memcpy(ip, dp, blk_len);
+        ip += blk_len;
+        dp += blk_len;
+        if (pip) {
+            memcpy(ip, pip, SG_PI_TUPLE_LEN);
+            pip += SG_PI_TUPLE_LEN;
+        }
+        ip += SG_PI_TUPLE_LEN;
+    }
+}
+
+void
+sg_pi_deinterleave(uint32_t blk_len, int num_blks, const uint8_t * ip,
+                   uint8_t * dp, uint8_t * pip)
+{
+    int k;
+
+    /* moving forward, dp never passes ip so memmove suffices in place */
+    for (k = 0; k < num_blks; ++k) {
+        memmove(dp, ip, blk_len);
+        ip += blk_len;
+        dp += blk_len;
+        if (pip) {
+            memcpy(pip, ip, SG_PI_TUPLE_LEN);
+            pip += SG_PI_TUPLE_LEN;
+        }
+        ip += SG_PI_TUPLE_LEN;
+    }
+}
+
+const char *
+sg_pi_err_str(int pi_err)
+{
+    switch (pi_err) {
+    case SG_PI_OK:
+        return "good";
+    case SG_PI_BAD_GUARD:
+        return "guard check failed";
+    case SG_PI_BAD_APP_TAG:
+        return "application tag check failed";
+    case SG_PI_BAD_REF_TAG:
+        return "reference tag check failed";
+    default:
+        return "unknown";
+    }
+}
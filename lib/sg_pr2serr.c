@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2022-2023 Douglas Gilbert.
+ * Copyright (c) 2022-2026 Douglas Gilbert.
  * All rights reserved.
  * Use of this source code is governed by a BSD-style
  * license that can be found in the BSD_LICENSE file.
@@ -14,11 +14,330 @@
 #include <stdbool.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
 
 #include "sg_pr2serr.h"
 
 FILE * sg_warnings_strm = NULL;        /* would like to default to stderr */
 
+#if defined(SG_LIB_LINUX) && (defined(__GNUC__) || defined(__clang__))
+#define SG_LOG_ASYNC 1
+#endif
+
+#ifdef SG_LOG_ASYNC
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#define SG_LOG_DEF_BUF_SZ (64 * 1024)
+#define SG_LOG_MAX_BUF_SZ (16 * 1024 * 1024)
+#define SG_LOG_MSG_MAX 1024     /* longer messages are truncated */
+#define SG_LOG_IDLE_MIN_NS 1000000      /* 1 ms */
+#define SG_LOG_IDLE_MAX_NS 50000000     /* 50 ms */
+
+/* Single producer (the owning thread), single consumer (the logger thread)
+ * byte ring. head and tail are free running; sz is a power of 2. Rings are
+ * never freed since their owners keep a thread-local pointer to them. */
+struct sg_log_ring {
+    struct sg_log_ring * nextp;
+    uint32_t sz;
+    uint32_t head;              /* written by owner */
+    uint32_t tail;              /* written by logger */
+    int busy;                   /* owner is between checks and head store */
+    uint64_t dropped;           /* written by owner */
+    uint64_t reported;          /* logger only */
+    char * bufp;
+};
+
+static struct sg_log_ring * sg_log_headp;
+static __thread struct sg_log_ring * sg_log_my_ringp;
+static int sg_log_on;
+static int sg_log_stop_req;
+static uint32_t sg_log_buf_sz = SG_LOG_DEF_BUF_SZ;
+static bool sg_log_atexit_set;
+static pthread_t sg_log_thr;
+static pthread_mutex_t sg_log_mut = PTHREAD_MUTEX_INITIALIZER;
+/* the logger thread sleeps on sg_log_cv when idle; a producer only wakes it
+ * (the one system call on that path) when a ring fills beyond half */
+static int sg_log_sleeping;
+static pthread_mutex_t sg_log_wait_mut = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sg_log_cv = PTHREAD_COND_INITIALIZER;
+
+static void
+sg_log_write(const char * bp, size_t len)
+{
+    ssize_t n;
+
+    while (len > 0) {
+        n = write(STDERR_FILENO, bp, len);
+        if (n < 0) {
+            if (EINTR == errno)
+                continue;
+            return;     /* nowhere to report it */
+        }
+        bp += n;
+        len -= n;
+    }
+}
+
+/* Writes out what is in the ring that rp points to. Returns the number of
+ * bytes written. Only called by the logger thread (or by sg_log_stop()
+ * after that thread has exited). */
+static uint32_t
+sg_log_drain(struct sg_log_ring * rp)
+{
+    uint32_t tail = rp->tail;
+    uint32_t head = __atomic_load_n(&rp->head, __ATOMIC_ACQUIRE);
+    uint32_t len = head - tail;
+    uint32_t off = tail & (rp->sz - 1);
+    uint64_t dropped;
+    int n;
+    char b[80];
+
+    if (len > 0) {
+        if ((off + len) > rp->sz) {
+            sg_log_write(rp->bufp + off, rp->sz - off);
+            sg_log_write(rp->bufp, len - (rp->sz - off));
+        } else
+            sg_log_write(rp->bufp + off, len);
+        __atomic_store_n(&rp->tail, head, __ATOMIC_RELEASE);
+    }
+    dropped = __atomic_load_n(&rp->dropped, __ATOMIC_RELAXED);
+    if (dropped != rp->reported) {
+        n = snprintf(b, sizeof(b), "sg_log: %" PRIu64 " message(s) dropped, "
+                     "buffer full\n", dropped - rp->reported);
+        sg_log_write(b, n);
+        rp->reported = dropped;
+    }
+    return len;
+}
+
+static void *
+sg_log_thread(void * vp)
+{
+    uint32_t n;
+    long idle_ns = SG_LOG_IDLE_MIN_NS;
+    struct sg_log_ring * rp;
+    struct timespec ts;
+
+    while (! __atomic_load_n(&sg_log_stop_req, __ATOMIC_ACQUIRE)) {
+        rp = __atomic_load_n(&sg_log_headp, __ATOMIC_ACQUIRE);
+        for (n = 0; rp; rp = rp->nextp)
+            n += sg_log_drain(rp);
+        if (n > 0) {
+            idle_ns = SG_LOG_IDLE_MIN_NS;
+            continue;
+        }
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += idle_ns;
+        if (ts.tv_nsec >= 1000000000) {
+            ++ts.tv_sec;
+            ts.tv_nsec -= 1000000000;
+        }
+        pthread_mutex_lock(&sg_log_wait_mut);
+        __atomic_store_n(&sg_log_sleeping, 1, __ATOMIC_SEQ_CST);
+        pthread_cond_timedwait(&sg_log_cv, &sg_log_wait_mut, &ts);
+        __atomic_store_n(&sg_log_sleeping, 0, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&sg_log_wait_mut);
+        if (idle_ns < SG_LOG_IDLE_MAX_NS)
+            idle_ns *= 2;
+    }
+    return vp;
+}
+
+static struct sg_log_ring *
+sg_log_my_ring(void)
+{
+    struct sg_log_ring * rp = sg_log_my_ringp;
+
+    if (rp)
+        return rp;
+    rp = (struct sg_log_ring *)calloc(1, sizeof(*rp));
+    if (NULL == rp)
+        return NULL;
+    rp->sz = __atomic_load_n(&sg_log_buf_sz, __ATOMIC_RELAXED);
+    rp->bufp = (char *)malloc(rp->sz);
+    if (NULL == rp->bufp) {
+        free(rp);
+        return NULL;
+    }
+    rp->nextp = __atomic_load_n(&sg_log_headp, __ATOMIC_RELAXED);
+    while (! __atomic_compare_exchange_n(&sg_log_headp, &rp->nextp, rp,
+                                         true, __ATOMIC_RELEASE,
+                                         __ATOMIC_RELAXED))
+        ;
+    sg_log_my_ringp = rp;
+    return rp;
+}
+
+/* Returns -1 if the message was not queued, so the caller should send it
+ * to stderr itself. */
+static int
+sg_log_queue(const char * fmt, va_list args)
+{
+    int n;
+    uint32_t head, tail, off;
+    struct sg_log_ring * rp;
+    char b[SG_LOG_MSG_MAX];
+
+    if (! __atomic_load_n(&sg_log_on, __ATOMIC_ACQUIRE))
+        return -1;
+    rp = sg_log_my_ring();
+    if (NULL == rp)
+        return -1;
+    __atomic_store_n(&rp->busy, 1, __ATOMIC_SEQ_CST);
+    if (! __atomic_load_n(&sg_log_on, __ATOMIC_SEQ_CST)) {
+        __atomic_store_n(&rp->busy, 0, __ATOMIC_RELEASE);
+        return -1;      /* sg_log_stop() got in first */
+    }
+    n = vsnprintf(b, sizeof(b), fmt, args);
+    if (n < 0)
+        n = 0;
+    else if (n >= (int)sizeof(b))
+        n = sizeof(b) - 1;
+    head = rp->head;
+    tail = __atomic_load_n(&rp->tail, __ATOMIC_ACQUIRE);
+    if ((uint32_t)n > (rp->sz - (head - tail)))
+        __atomic_add_fetch(&rp->dropped, 1, __ATOMIC_RELAXED);
+    else if (n > 0) {
+        off = head & (rp->sz - 1);
+        if ((off + n) > rp->sz) {
+            memcpy(rp->bufp + off, b, rp->sz - off);
+            memcpy(rp->bufp, b + (rp->sz - off), n - (rp->sz - off));
+        } else
+            memcpy(rp->bufp + off, b, n);
+        __atomic_store_n(&rp->head, head + n, __ATOMIC_SEQ_CST);
+        if (((head + n - tail) > (rp->sz / 2)) &&
+            __atomic_exchange_n(&sg_log_sleeping, 0, __ATOMIC_SEQ_CST))
+            pthread_cond_signal(&sg_log_cv);
+    }
+    __atomic_store_n(&rp->busy, 0, __ATOMIC_RELEASE);
+    return n;
+}
+
+static void
+sg_log_atexit(void)
+{
+    sg_log_stop();
+}
+
+int
+sg_log_start(int buf_sz)
+{
+    uint32_t sz;
+    int res = 0;
+
+    if ((buf_sz < 0) || (buf_sz > SG_LOG_MAX_BUF_SZ))
+        return EINVAL;
+    pthread_mutex_lock(&sg_log_mut);
+    if (__atomic_load_n(&sg_log_on, __ATOMIC_RELAXED))
+        goto fini;
+    if (buf_sz > 0) {
+        for (sz = SG_LOG_MSG_MAX; sz < (uint32_t)buf_sz; sz <<= 1)
+            ;
+        __atomic_store_n(&sg_log_buf_sz, sz, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&sg_log_stop_req, 0, __ATOMIC_RELAXED);
+    res = pthread_create(&sg_log_thr, NULL, sg_log_thread, NULL);
+    if (res)
+        goto fini;
+    if (! sg_log_atexit_set) {
+        atexit(sg_log_atexit);
+        sg_log_atexit_set = true;
+    }
+    __atomic_store_n(&sg_log_on, 1, __ATOMIC_RELEASE);
+fini:
+    pthread_mutex_unlock(&sg_log_mut);
+    return res;
+}
+
+void
+sg_log_stop(void)
+{
+    struct sg_log_ring * rp;
+
+    pthread_mutex_lock(&sg_log_mut);
+    if (! __atomic_load_n(&sg_log_on, __ATOMIC_RELAXED)) {
+        pthread_mutex_unlock(&sg_log_mut);
+        return;
+    }
+    __atomic_store_n(&sg_log_on, 0, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&sg_log_stop_req, 1, __ATOMIC_RELEASE);
+    pthread_join(sg_log_thr, NULL);
+    /* wait for producers that saw sg_log_on set, then write what is left */
+    for (rp = __atomic_load_n(&sg_log_headp, __ATOMIC_ACQUIRE); rp;
+         rp = rp->nextp) {
+        while (__atomic_load_n(&rp->busy, __ATOMIC_SEQ_CST))
+            sched_yield();
+        sg_log_drain(rp);
+    }
+    pthread_mutex_unlock(&sg_log_mut);
+}
+
+bool
+sg_log_active(void)
+{
+    return !! __atomic_load_n(&sg_log_on, __ATOMIC_RELAXED);
+}
+
+uint64_t
+sg_log_dropped(void)
+{
+    uint64_t cnt = 0;
+    struct sg_log_ring * rp;
+
+    for (rp = __atomic_load_n(&sg_log_headp, __ATOMIC_ACQUIRE); rp;
+         rp = rp->nextp)
+        cnt += __atomic_load_n(&rp->dropped, __ATOMIC_RELAXED);
+    return cnt;
+}
+
+#else           /* no SG_LOG_ASYNC */
+
+#define sg_log_queue(fmt, args) (-1)
+
+int
+sg_log_start(int buf_sz)
+{
+    return (buf_sz < 0) ? EINVAL : ENOSYS;
+}
+
+void
+sg_log_stop(void)
+{
+}
+
+bool
+sg_log_active(void)
+{
+    return false;
+}
+
+uint64_t
+sg_log_dropped(void)
+{
+    return 0;
+}
+
+#endif          /* SG_LOG_ASYNC */
+
+int
+sg_log_vpr(const char * fmt, va_list args)
+{
+    int n;
+    va_list args2;
+
+    va_copy(args2, args);
+    n = sg_log_queue(fmt, args2);
+    va_end(args2);
+    if (n < 0)
+        n = vfprintf(stderr, fmt, args);
+    return n;
+}
 
 int
 pr2serr(const char * fmt, ...)
@@ -27,7 +346,7 @@ pr2serr(const char * fmt, ...)
     int n;
 
     va_start(args, fmt);
-    n = vfprintf(stderr, fmt, args);
+    n = sg_log_vpr(fmt, args);
     va_end(args);
     return n;
 }
@@ -39,7 +358,10 @@ pr2ws(const char * fmt, ...)
     int n;
 
     va_start(args, fmt);
-    n = vfprintf(sg_warnings_strm ? sg_warnings_strm : stderr, fmt, args);
+    if ((NULL == sg_warnings_strm) || (stderr == sg_warnings_strm))
+        n = sg_log_vpr(fmt, args);
+    else
+        n = vfprintf(sg_warnings_strm, fmt, args);
     va_end(args);
     return n;
 }
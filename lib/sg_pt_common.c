@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2009-2023 Douglas Gilbert.
+ * Copyright (c) 2009-2026 Douglas Gilbert.
  * All rights reserved.
  * Use of this source code is governed by a BSD-style
  * license that can be found in the BSD_LICENSE file.
@@ -21,6 +21,15 @@
 #include "config.h"
 #endif
 
+#ifdef SG_LIB_LINUX
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#endif
+
 #include "sg_lib.h"
 #include "sg_pt.h"
 #include "sg_unaligned.h"
@@ -31,7 +40,11 @@
 #include "sg_pt_nvme.h"
 #endif
 
-static const char * scsi_pt_version_str = "3.20 20230311";
+#ifdef SG_LIB_LINUX
+#include "sg_pt_linux.h"
+#endif
+
+static const char * scsi_pt_version_str = "3.25 20261015";
 
 /* List of external functions that need to be defined for each OS are
  * listed at the top of sg_pt_dummy.c   */
@@ -48,6 +61,1628 @@ sg_pt_version()
     return scsi_pt_version_str;
 }
 
+int
+sg_pt_mrq_sequential(struct sg_pt_base * vp_arr[], int num, int fd,
+                     int time_secs, int * num_donep, int verbose)
+{
+    int k, res;
+
+    for (k = 0, res = 0; k < num; ++k) {
+        res = do_scsi_pt(vp_arr[k], fd, time_secs, verbose);
+        if (res)
+            break;
+    }
+    if (num_donep)
+        *num_donep = k;
+    return res;
+}
+
+/* Per-thread pool of pt objects and page aligned data buffers. Since each
+ * thread has its own pool, no locking is needed. Only active after
+ * sg_pt_pool_enable() has been called (with max_objs > 0) in a thread. A
+ * thread's pool is drained when it exits. */
+#if defined(__GNUC__) || defined(__clang__)
+#define SG_PT_THREAD_LOCAL __thread
+#ifndef SG_LIB_WIN32
+#define SG_PT_POOL_KEY 1
+#include <pthread.h>
+#endif
+#endif
+
+#define SG_PT_POOL_MAX 32
+
+struct sg_pt_pool_t {
+    int max_objs;
+    int num_objs;
+    int num_bufs;
+    uint32_t buf_sz;            /* page size, set at enable time */
+    struct sg_pt_base * objs[SG_PT_POOL_MAX];
+    uint8_t * bufs[SG_PT_POOL_MAX];     /* same as buff_to_free */
+};
+
+#ifdef SG_PT_THREAD_LOCAL
+static SG_PT_THREAD_LOCAL struct sg_pt_pool_t sg_pt_pool;
+#endif
+
+#ifdef SG_PT_POOL_KEY
+static pthread_once_t sg_pt_pool_once = PTHREAD_ONCE_INIT;
+static bool sg_pt_pool_key_ok = false;
+static pthread_key_t sg_pt_pool_key;    /* its destructor drains the pool */
+
+static void
+pool_thread_dtor(void * arg)
+{
+    if (arg) { }
+    sg_pt_pool_drain();
+}
+
+static void
+pool_key_init(void)
+{
+    sg_pt_pool_key_ok = (0 == pthread_key_create(&sg_pt_pool_key,
+                                                 pool_thread_dtor));
+}
+#endif
+
+/* True if dev_fd still refers to the device that ptvp was set up for. File
+ * descriptors are reused after close() so an equal dev_fd is not enough,
+ * the device id (st_rdev) saved in ptvp is compared as well. */
+static bool
+pool_same_dev(const struct sg_pt_base * ptvp, int dev_fd)
+{
+#ifdef SG_LIB_LINUX
+    struct stat a_stat;
+
+    if ((dev_fd < 0) || (get_pt_file_handle(ptvp) != dev_fd) ||
+        (0 == ptvp->impl.dev_id))
+        return false;
+    if (fstat(dev_fd, &a_stat) < 0)
+        return false;
+    return ptvp->impl.dev_id == (uint64_t)a_stat.st_rdev;
+#else
+    if (ptvp || dev_fd) { }
+    return false;       /* always re-check the file type */
+#endif
+}
+
+int
+sg_pt_pool_enable(int max_objs)
+{
+#ifdef SG_PT_THREAD_LOCAL
+    struct sg_pt_pool_t * pp = &sg_pt_pool;
+
+    if (max_objs > SG_PT_POOL_MAX)
+        max_objs = SG_PT_POOL_MAX;
+    else if (max_objs < 0)
+        max_objs = 0;
+    if (max_objs < pp->max_objs)
+        sg_pt_pool_drain();
+#ifdef SG_PT_POOL_KEY
+    if ((max_objs > 0) && (0 == pp->max_objs)) {
+        pthread_once(&sg_pt_pool_once, pool_key_init);
+        /* any non-NULL value makes the destructor run at thread exit */
+        if (sg_pt_pool_key_ok)
+            pthread_setspecific(sg_pt_pool_key, pp);
+    }
+#endif
+    pp->max_objs = max_objs;
+    if (0 == pp->buf_sz)
+        pp->buf_sz = sg_get_page_size();
+    return max_objs;
+#else
+    if (max_objs) { }
+    return 0;
+#endif
+}
+
+void
+sg_pt_pool_drain(void)
+{
+#ifdef SG_PT_THREAD_LOCAL
+    struct sg_pt_pool_t * pp = &sg_pt_pool;
+
+    while (pp->num_objs > 0)
+        destruct_scsi_pt_obj(pp->objs[--pp->num_objs]);
+    while (pp->num_bufs > 0)
+        free(pp->bufs[--pp->num_bufs]);
+#endif
+}
+
+struct sg_pt_base *
+sg_pt_pool_get_obj(int dev_fd, int verbose)
+{
+#ifdef SG_PT_THREAD_LOCAL
+    struct sg_pt_pool_t * pp = &sg_pt_pool;
+
+    if (pp->num_objs > 0) {
+        struct sg_pt_base * ptvp = pp->objs[--pp->num_objs];
+
+        clear_scsi_pt_obj(ptvp);
+        /* same device: skip re-checking the file type */
+        if (! pool_same_dev(ptvp, dev_fd))
+            set_pt_file_handle(ptvp, dev_fd, verbose);
+        return ptvp;
+    }
+#endif
+    return construct_scsi_pt_obj_with_fd(dev_fd, verbose);
+}
+
+void
+sg_pt_pool_put_obj(struct sg_pt_base * ptvp)
+{
+    if (NULL == ptvp)
+        return;
+#ifdef SG_PT_THREAD_LOCAL
+    {
+        struct sg_pt_pool_t * pp = &sg_pt_pool;
+
+        if (pp->num_objs < pp->max_objs) {
+            /* these survive clear_scsi_pt_obj(), the next user of ptvp
+             * must not inherit them */
+            sg_pt_unreg_bufs(ptvp);
+            set_pt_trace(ptvp, NULL, NULL);
+            pp->objs[pp->num_objs++] = ptvp;
+            return;
+        }
+    }
+#endif
+    destruct_scsi_pt_obj(ptvp);
+}
+
+uint8_t *
+sg_pt_pool_get_buf(uint32_t num_bytes, uint8_t ** buff_to_free, bool vb)
+{
+#ifdef SG_PT_THREAD_LOCAL
+    struct sg_pt_pool_t * pp = &sg_pt_pool;
+    uint32_t pg_sz = pp->buf_sz ? pp->buf_sz : sg_get_page_size();
+
+    if (num_bytes <= pg_sz) {
+        if (pp->num_bufs > 0) {
+            sg_uintptr_t align_1 = pg_sz - 1;
+            uint8_t * bp = pp->bufs[--pp->num_bufs];
+
+            if (buff_to_free)
+                *buff_to_free = bp;
+            /* same alignment step as sg_memalign() */
+            bp = (uint8_t *)(((sg_uintptr_t)bp + align_1) & (~align_1));
+            memset(bp, 0, pg_sz);
+            return bp;
+        }
+        /* allocate a whole page so it can be pooled when put back */
+        num_bytes = pg_sz;
+    }
+#endif
+    return sg_memalign(num_bytes, 0, buff_to_free, vb);
+}
+
+void
+sg_pt_pool_put_buf(uint8_t * buff_to_free, uint32_t num_bytes)
+{
+    if (NULL == buff_to_free)
+        return;
+#ifdef SG_PT_THREAD_LOCAL
+    {
+        struct sg_pt_pool_t * pp = &sg_pt_pool;
+
+        if ((num_bytes <= pp->buf_sz) && (pp->num_bufs < pp->max_objs)) {
+            pp->bufs[pp->num_bufs++] = buff_to_free;
+            return;
+        }
+    }
+#else
+    if (num_bytes) { }
+#endif
+    free(buff_to_free);
+}
+
+/* Per-thread latency histograms. Each thread only ever writes to its own
+ * table; tables are pushed (never removed) onto a global list with a
+ * compare and swap so sg_pt_lat_snapshot() can merge them. When a thread
+ * exits its table is marked free, keeping its counts, and is taken over by
+ * the next thread that needs one, so the list is only as long as the most
+ * threads that have recorded latencies at the same time. Counters are
+ * 64 bit, written and read with relaxed atomics to avoid torn values. A
+ * reset bumps a global epoch and each thread clears its own table when it
+ * notices. */
+#define SG_PT_LAT_TBL_SZ 128    /* must be a power of 2 */
+#define SG_PT_LAT_MIN_SHIFT 10  /* bucket 1 starts at 1024 nanoseconds */
+
+struct sg_pt_lat_tbl {
+    struct sg_pt_lat_tbl * nextp;
+    uint32_t epoch;
+    bool in_use;                /* owned by a live thread */
+    struct sg_pt_lat_hist ent[SG_PT_LAT_TBL_SZ];
+};
+
+#if defined(SG_PT_THREAD_LOCAL) && defined(SG_LIB_LINUX)
+#define SG_PT_LAT_SUPPORTED 1
+
+#define SG_PT_LAT_LD(x) __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define SG_PT_LAT_ST(x, v) __atomic_store_n(&(x), (v), __ATOMIC_RELAXED)
+
+static bool sg_pt_lat_on;
+static uint32_t sg_pt_lat_epoch;
+static struct sg_pt_lat_tbl * sg_pt_lat_headp;
+static SG_PT_THREAD_LOCAL struct sg_pt_lat_tbl * sg_pt_lat_tblp;
+static pthread_once_t sg_pt_lat_once = PTHREAD_ONCE_INIT;
+static bool sg_pt_lat_key_ok = false;
+static pthread_key_t sg_pt_lat_key;     /* destructor gives table back */
+
+static void
+lat_thread_dtor(void * arg)
+{
+    struct sg_pt_lat_tbl * tp = (struct sg_pt_lat_tbl *)arg;
+
+    __atomic_store_n(&tp->in_use, false, __ATOMIC_RELEASE);
+}
+
+static void
+lat_key_init(void)
+{
+    sg_pt_lat_key_ok = (0 == pthread_key_create(&sg_pt_lat_key,
+                                                lat_thread_dtor));
+}
+
+/* Takes over a table left by a thread that has exited, else allocates a
+ * new one and adds it to the list. */
+static struct sg_pt_lat_tbl *
+lat_get_tbl(uint32_t epoch)
+{
+    bool expect;
+    struct sg_pt_lat_tbl * tp;
+
+    pthread_once(&sg_pt_lat_once, lat_key_init);
+    tp = __atomic_load_n(&sg_pt_lat_headp, __ATOMIC_ACQUIRE);
+    for ( ; tp; tp = tp->nextp) {
+        expect = false;
+        if (__atomic_compare_exchange_n(&tp->in_use, &expect, true, false,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            break;
+    }
+    if (NULL == tp) {
+        tp = (struct sg_pt_lat_tbl *)calloc(1, sizeof(*tp));
+        if (NULL == tp)
+            return NULL;
+        tp->epoch = epoch;
+        tp->in_use = true;
+        tp->nextp = __atomic_load_n(&sg_pt_lat_headp, __ATOMIC_RELAXED);
+        while (! __atomic_compare_exchange_n(&sg_pt_lat_headp, &tp->nextp,
+                                             tp, true, __ATOMIC_RELEASE,
+                                             __ATOMIC_RELAXED))
+            ;
+    }
+    /* without the key the table is never given back, as before */
+    if (sg_pt_lat_key_ok)
+        pthread_setspecific(sg_pt_lat_key, tp);
+    return tp;
+}
+
+static struct sg_pt_lat_tbl *
+lat_my_tbl(void)
+{
+    struct sg_pt_lat_tbl * tp = sg_pt_lat_tblp;
+    uint32_t epoch = __atomic_load_n(&sg_pt_lat_epoch, __ATOMIC_ACQUIRE);
+
+    if (NULL == tp) {
+        tp = lat_get_tbl(epoch);
+        if (NULL == tp)
+            return NULL;
+        sg_pt_lat_tblp = tp;
+    }
+    if (tp->epoch != epoch) {
+        int k;
+
+        for (k = 0; k < SG_PT_LAT_TBL_SZ; ++k)
+            SG_PT_LAT_ST(tp->ent[k].count, 0);
+        __atomic_store_n(&tp->epoch, epoch, __ATOMIC_RELEASE);
+    }
+    return tp;
+}
+#endif
+
+bool
+sg_pt_lat_enable(bool enable)
+{
+#ifdef SG_PT_LAT_SUPPORTED
+    __atomic_store_n(&sg_pt_lat_on, enable, __ATOMIC_RELAXED);
+    if (enable)
+        __atomic_or_fetch(&sg_pt_instr, SG_PT_INSTR_LAT, __ATOMIC_RELEASE);
+    else
+        __atomic_and_fetch(&sg_pt_instr, ~SG_PT_INSTR_LAT, __ATOMIC_RELEASE);
+    return true;
+#else
+    if (enable) { }
+    return false;
+#endif
+}
+
+/* Cheap check made by the pass-through code before timing each command */
+bool
+sg_pt_lat_is_enabled(void)
+{
+#ifdef SG_PT_LAT_SUPPORTED
+    return __atomic_load_n(&sg_pt_lat_on, __ATOMIC_RELAXED);
+#else
+    return false;
+#endif
+}
+
+void
+sg_pt_lat_record(uint64_t dev_id, uint8_t opcode, int cmd_set,
+                 uint64_t elapsed_ns)
+{
+#ifdef SG_PT_LAT_SUPPORTED
+    int k, n;
+    uint64_t cnt;
+    struct sg_pt_lat_tbl * tp;
+    struct sg_pt_lat_hist * hp;
+
+    if (! sg_pt_lat_is_enabled())
+        return;
+    tp = lat_my_tbl();
+    if (NULL == tp)
+        return;
+    /* open addressing with linear probing, keyed on dev_id+opcode */
+    k = (int)((dev_id * 0x9e3779b97f4a7c15ULL) >> 57) ^ opcode ^
+        (cmd_set << 5);
+    for (n = 0; n < SG_PT_LAT_TBL_SZ; ++n, ++k) {
+        hp = tp->ent + (k & (SG_PT_LAT_TBL_SZ - 1));
+        cnt = hp->count;        /* only this thread writes */
+        if (0 == cnt) {
+            hp->dev_id = dev_id;
+            hp->opcode = opcode;
+            hp->cmd_set = (uint8_t)cmd_set;
+            SG_PT_LAT_ST(hp->sum_ns, 0);
+            SG_PT_LAT_ST(hp->min_ns, elapsed_ns);
+            SG_PT_LAT_ST(hp->max_ns, 0);
+            memset(hp->bucket, 0, sizeof(hp->bucket));
+            break;
+        }
+        if ((hp->dev_id == dev_id) && (hp->opcode == opcode) &&
+            (hp->cmd_set == cmd_set))
+            break;
+    }
+    if (n >= SG_PT_LAT_TBL_SZ)
+        return;         /* table full, drop */
+    k = sg_pt_lat_bucket_idx(elapsed_ns);
+    SG_PT_LAT_ST(hp->bucket[k], hp->bucket[k] + 1);
+    SG_PT_LAT_ST(hp->sum_ns, hp->sum_ns + elapsed_ns);
+    if (elapsed_ns < hp->min_ns)
+        SG_PT_LAT_ST(hp->min_ns, elapsed_ns);
+    if (elapsed_ns > hp->max_ns)
+        SG_PT_LAT_ST(hp->max_ns, elapsed_ns);
+    /* count last: readers ignore elements while count is 0 */
+    __atomic_store_n(&hp->count, cnt + 1, __ATOMIC_RELEASE);
+#else
+    if (dev_id || opcode || cmd_set || elapsed_ns) { }
+#endif
+}
+
+int
+sg_pt_lat_snapshot(struct sg_pt_lat_hist * arr, int max_num, bool reset)
+{
+    int num = 0;
+#ifdef SG_PT_LAT_SUPPORTED
+    int j, k, m;
+    uint32_t epoch = __atomic_load_n(&sg_pt_lat_epoch, __ATOMIC_ACQUIRE);
+    uint64_t cnt, v;
+    const struct sg_pt_lat_tbl * tp;
+    const struct sg_pt_lat_hist * hp;
+    struct sg_pt_lat_hist * ahp;
+
+    if ((NULL == arr) || (max_num < 1))
+        goto fini;
+    tp = __atomic_load_n(&sg_pt_lat_headp, __ATOMIC_ACQUIRE);
+    for ( ; tp; tp = tp->nextp) {
+        if (__atomic_load_n(&tp->epoch, __ATOMIC_ACQUIRE) != epoch)
+            continue;   /* not cleared since last reset */
+        for (j = 0; j < SG_PT_LAT_TBL_SZ; ++j) {
+            hp = tp->ent + j;
+            cnt = __atomic_load_n(&hp->count, __ATOMIC_ACQUIRE);
+            if (0 == cnt)
+                continue;
+            for (m = 0; m < num; ++m) {
+                ahp = arr + m;
+                if ((ahp->dev_id == hp->dev_id) &&
+                    (ahp->opcode == hp->opcode) &&
+                    (ahp->cmd_set == hp->cmd_set))
+                    break;
+            }
+            ahp = arr + m;
+            if (m >= num) {
+                if (num >= max_num)
+                    continue;
+                memset(ahp, 0, sizeof(*ahp));
+                ahp->dev_id = hp->dev_id;
+                ahp->opcode = hp->opcode;
+                ahp->cmd_set = hp->cmd_set;
+                ahp->min_ns = UINT64_MAX;
+                ++num;
+            }
+            ahp->count += cnt;
+            ahp->sum_ns += SG_PT_LAT_LD(hp->sum_ns);
+            v = SG_PT_LAT_LD(hp->min_ns);
+            if (v < ahp->min_ns)
+                ahp->min_ns = v;
+            v = SG_PT_LAT_LD(hp->max_ns);
+            if (v > ahp->max_ns)
+                ahp->max_ns = v;
+            for (k = 0; k < SG_PT_LAT_NUM_BUCKETS; ++k)
+                ahp->bucket[k] += SG_PT_LAT_LD(hp->bucket[k]);
+        }
+    }
+fini:
+    if (reset)
+        __atomic_add_fetch(&sg_pt_lat_epoch, 1, __ATOMIC_RELEASE);
+#else
+    if (arr || max_num || reset) { }
+#endif
+    return num;
+}
+
+uint64_t
+sg_pt_lat_bucket_ns(int k)
+{
+    int msb;
+
+    if (k <= 0)
+        return 0;
+    if (k >= (SG_PT_LAT_NUM_BUCKETS - 1))
+        k = SG_PT_LAT_NUM_BUCKETS - 1;
+    msb = SG_PT_LAT_MIN_SHIFT + ((k - 1) / 2);
+    return (1ULL << msb) + (((k - 1) % 2) ? (1ULL << (msb - 1)) : 0);
+}
+
+int
+sg_pt_lat_bucket_idx(uint64_t ns)
+{
+    int msb, k;
+
+    if (ns < (1ULL << SG_PT_LAT_MIN_SHIFT))
+        return 0;
+#if defined(__GNUC__) || defined(__clang__)
+    msb = 63 - __builtin_clzll(ns);
+#else
+    for (msb = SG_PT_LAT_MIN_SHIFT; (ns >> msb) > 1; ++msb)
+        ;
+#endif
+    k = 1 + (2 * (msb - SG_PT_LAT_MIN_SHIFT)) + (int)((ns >> (msb - 1)) & 1);
+    return (k < SG_PT_LAT_NUM_BUCKETS) ? k : (SG_PT_LAT_NUM_BUCKETS - 1);
+}
+
+uint64_t
+sg_pt_lat_percentile(const struct sg_pt_lat_hist * hp, double pct)
+{
+    int k;
+    uint64_t want, sum;
+
+    if ((NULL == hp) || (0 == hp->count))
+        return 0;
+    if (pct >= 100.0)
+        return hp->max_ns;
+    want = (uint64_t)(((double)hp->count * pct) / 100.0);
+    if (want < 1)
+        want = 1;
+    for (k = 0, sum = 0; k < SG_PT_LAT_NUM_BUCKETS - 1; ++k) {
+        sum += hp->bucket[k];
+        if (sum >= want)
+            break;
+    }
+    /* upper edge of bucket k, but no more than the maximum seen */
+    if (k >= (SG_PT_LAT_NUM_BUCKETS - 1))
+        return hp->max_ns;
+    return (sg_pt_lat_bucket_ns(k + 1) < hp->max_ns) ?
+           sg_pt_lat_bucket_ns(k + 1) : hp->max_ns;
+}
+
+/* Trace hooks. The callback given to sg_pt_trace_set() is kept in
+ * sg_pt_trace_gfn and SG_PT_INSTR_TRACE is set in sg_pt_instr so the OS
+ * pass-through code only needs to test sg_pt_instr when nothing is being
+ * traced or timed. The built-in sink is a ring of fixed size records; each
+ * writer claims the next slot with an atomic add then zeroes its seq field,
+ * copies the record and sets seq last, so a dump skips (rather than
+ * shows half of) a slot being written. */
+#ifdef SG_LIB_LINUX
+int sg_pt_instr;
+#endif
+
+#ifdef SG_PT_LAT_SUPPORTED
+#define SG_PT_TRACE_SUPPORTED 1
+
+static sg_pt_trace_fn sg_pt_trace_gfn;
+static void * sg_pt_trace_gpriv;
+static uint64_t sg_pt_trace_seq;
+static SG_PT_THREAD_LOCAL uint32_t sg_pt_trace_tid;
+
+static struct sg_pt_trace_rec * sg_pt_ring_arr;
+static uint32_t sg_pt_ring_mask;        /* number of records less 1 */
+static uint64_t sg_pt_ring_next;        /* total records given to ring */
+static int sg_pt_ring_sig_fd = -1;
+static bool sg_pt_ring_sig_text;
+#endif
+
+bool
+sg_pt_trace_set(sg_pt_trace_fn fn, void * priv)
+{
+#ifdef SG_PT_TRACE_SUPPORTED
+    if (fn) {
+        __atomic_store_n(&sg_pt_trace_gpriv, priv, __ATOMIC_RELAXED);
+        __atomic_store_n(&sg_pt_trace_gfn, fn, __ATOMIC_RELEASE);
+        __atomic_or_fetch(&sg_pt_instr, SG_PT_INSTR_TRACE, __ATOMIC_RELEASE);
+    } else {
+        __atomic_and_fetch(&sg_pt_instr, ~SG_PT_INSTR_TRACE,
+                           __ATOMIC_RELEASE);
+        __atomic_store_n(&sg_pt_trace_gfn, NULL, __ATOMIC_RELEASE);
+    }
+    return true;
+#else
+    if (fn || priv) { }
+    return false;
+#endif
+}
+
+#ifdef SG_LIB_LINUX
+
+/* Returns the callback set by sg_pt_trace_set() (or NULL) and places its
+ * private pointer in *privp. For the OS pass-through code. */
+sg_pt_trace_fn
+sg_pt_trace_get(void ** privp)
+{
+#ifdef SG_PT_TRACE_SUPPORTED
+    sg_pt_trace_fn fn = __atomic_load_n(&sg_pt_trace_gfn, __ATOMIC_ACQUIRE);
+
+    *privp = __atomic_load_n(&sg_pt_trace_gpriv, __ATOMIC_RELAXED);
+    return fn;
+#else
+    *privp = NULL;
+    return NULL;
+#endif
+}
+
+/* Fills in the seq, ts_ns, tid and event fields of a new submit event. The
+ * caller fills the rest. */
+void
+sg_pt_trace_start(struct sg_pt_trace_rec * trp, uint64_t now_ns)
+{
+#ifdef SG_PT_TRACE_SUPPORTED
+    if (0 == sg_pt_trace_tid)
+        sg_pt_trace_tid = (uint32_t)syscall(SYS_gettid);
+    trp->tid = sg_pt_trace_tid;
+    trp->seq = __atomic_add_fetch(&sg_pt_trace_seq, 1, __ATOMIC_RELAXED);
+#else
+    trp->tid = 0;
+    trp->seq = 0;
+#endif
+    trp->ts_ns = now_ns;
+    trp->event = SG_PT_TRACE_SUBMIT;
+}
+
+#endif          /* SG_LIB_LINUX */
+
+int
+sg_pt_trace_ring_init(int num_recs)
+{
+#ifdef SG_PT_TRACE_SUPPORTED
+    uint32_t n;
+    struct sg_pt_trace_rec * arr;
+
+    if (num_recs < 0)
+        return EINVAL;
+    if (0 == num_recs) {
+        arr = __atomic_exchange_n(&sg_pt_ring_arr, NULL, __ATOMIC_ACQ_REL);
+        if (arr)
+            free(arr);
+        return 0;
+    }
+    for (n = 1; n < (uint32_t)num_recs; n <<= 1)
+        ;
+    if (__atomic_load_n(&sg_pt_ring_arr, __ATOMIC_ACQUIRE))
+        return EBUSY;
+    arr = (struct sg_pt_trace_rec *)calloc(n, sizeof(*arr));
+    if (NULL == arr)
+        return ENOMEM;
+    sg_pt_ring_mask = n - 1;
+    __atomic_store_n(&sg_pt_ring_next, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&sg_pt_ring_arr, arr, __ATOMIC_RELEASE);
+    return 0;
+#else
+    if (num_recs) { }
+    return ENOTTY;
+#endif
+}
+
+void
+sg_pt_trace_ring_fn(const struct sg_pt_trace_rec * trp,
+                    void * priv __attribute__ ((unused)))
+{
+#ifdef SG_PT_TRACE_SUPPORTED
+    uint64_t k;
+    struct sg_pt_trace_rec * arr;
+    struct sg_pt_trace_rec * rp;
+
+    arr = __atomic_load_n(&sg_pt_ring_arr, __ATOMIC_ACQUIRE);
+    if (NULL == arr)
+        return;
+    k = __atomic_fetch_add(&sg_pt_ring_next, 1, __ATOMIC_RELAXED);
+    rp = arr + (k & sg_pt_ring_mask);
+    __atomic_store_n(&rp->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy((uint8_t *)rp + sizeof(rp->seq), (const uint8_t *)trp +
+           sizeof(trp->seq), sizeof(*rp) - sizeof(rp->seq));
+    __atomic_store_n(&rp->seq, trp->seq, __ATOMIC_RELEASE);
+#else
+    if (trp) { }
+#endif
+}
+
+/* Appends decimal (if 'base' is 10) or hex representation of 'v' to b[*np]
+ * with at least 'min_dig' digits. Used rather than snprintf() since it is
+ * async-signal-safe. */
+static void
+trc_num(char * b, int blen, int * np, uint64_t v, int base, int min_dig)
+{
+    int k = 0;
+    char t[24];
+
+    do {
+        t[k++] = "0123456789abcdef"[v % base];
+        v /= base;
+    } while ((v > 0) || (k < min_dig));
+    while ((k > 0) && (*np < (blen - 1)))
+        b[(*np)++] = t[--k];
+}
+
+static void
+trc_str(char * b, int blen, int * np, const char * s)
+{
+    while (*s && (*np < (blen - 1)))
+        b[(*np)++] = *s++;
+}
+
+char *
+sg_pt_trace_rec_str(const struct sg_pt_trace_rec * trp, int blen, char * b)
+{
+    int k;
+    int n = 0;
+    bool complete;
+
+    if ((NULL == b) || (blen < 1))
+        return b;
+    if (NULL == trp) {
+        b[0] = '\0';
+        return b;
+    }
+    complete = (SG_PT_TRACE_COMPLETE == trp->event);
+    trc_num(b, blen, &n, trp->seq, 10, 1);
+    trc_str(b, blen, &n, " ");
+    trc_num(b, blen, &n, trp->ts_ns / 1000000000, 10, 1);
+    trc_str(b, blen, &n, ".");
+    trc_num(b, blen, &n, trp->ts_ns % 1000000000, 10, 9);
+    trc_str(b, blen, &n, " tid=");
+    trc_num(b, blen, &n, trp->tid, 10, 1);
+    trc_str(b, blen, &n, " dev=");
+    trc_num(b, blen, &n, trp->dev_id, 16, 1);
+    trc_str(b, blen, &n, complete ? " done " : " sent ");
+    trc_str(b, blen, &n, (SG_PT_LAT_SCSI == trp->cmd_set) ? "cdb:" :
+                         ((SG_PT_LAT_NVME_ADMIN == trp->cmd_set) ?
+                          "nvme_admin:" : "nvme_nvm:"));
+    for (k = 0; k < trp->cmd_len; ++k) {
+        trc_str(b, blen, &n, " ");
+        trc_num(b, blen, &n, trp->cmd[k], 16, 2);
+    }
+    if (trp->din_len > 0) {
+        trc_str(b, blen, &n, " din=");
+        trc_num(b, blen, &n, trp->din_len, 10, 1);
+    }
+    if (trp->dout_len > 0) {
+        trc_str(b, blen, &n, " dout=");
+        trc_num(b, blen, &n, trp->dout_len, 10, 1);
+    }
+    if (complete) {
+        trc_str(b, blen, &n, " result=");
+        if (trp->result < 0) {
+            trc_str(b, blen, &n, "-");
+            trc_num(b, blen, &n, -(int64_t)trp->result, 10, 1);
+        } else
+            trc_num(b, blen, &n, trp->result, 10, 1);
+        trc_str(b, blen, &n, " status=0x");
+        trc_num(b, blen, &n, trp->status, 16, 2);
+        if (trp->sense_key || trp->asc || trp->ascq) {
+            trc_str(b, blen, &n, " sense=");
+            trc_num(b, blen, &n, trp->sense_key, 16, 1);
+            trc_str(b, blen, &n, "/");
+            trc_num(b, blen, &n, trp->asc, 16, 2);
+            trc_str(b, blen, &n, "/");
+            trc_num(b, blen, &n, trp->ascq, 16, 2);
+        }
+        trc_str(b, blen, &n, " resid=");
+        trc_num(b, blen, &n, (uint32_t)trp->resid, 10, 1);
+        trc_str(b, blen, &n, " ns=");
+        trc_num(b, blen, &n, trp->duration_ns, 10, 1);
+    }
+    b[n] = '\0';
+    return b;
+}
+
+#ifdef SG_PT_TRACE_SUPPORTED
+/* write() all of b, retrying after signals and partial writes */
+static int
+trc_write(int fd, const void * b, size_t len)
+{
+    ssize_t res;
+    const uint8_t * p = (const uint8_t *)b;
+
+    while (len > 0) {
+        res = write(fd, p, len);
+        if (res < 0) {
+            if (EINTR == errno)
+                continue;
+            return -errno;
+        }
+        p += res;
+        len -= res;
+    }
+    return 0;
+}
+#endif
+
+int
+sg_pt_trace_ring_dump(int fd, bool text)
+{
+#ifdef SG_PT_TRACE_SUPPORTED
+    int res, n;
+    int num = 0;
+    uint32_t avail;
+    uint64_t k, first, total;
+    const struct sg_pt_trace_rec * arr;
+    const struct sg_pt_trace_rec * rp;
+    struct sg_pt_trace_rec rec;
+    struct sg_pt_trace_ring_hdr hdr;
+    char b[512];
+
+    arr = __atomic_load_n(&sg_pt_ring_arr, __ATOMIC_ACQUIRE);
+    if (NULL == arr)
+        return 0;
+    total = __atomic_load_n(&sg_pt_ring_next, __ATOMIC_RELAXED);
+    avail = sg_pt_ring_mask + 1;
+    first = (total > avail) ? (total - avail) : 0;
+    if (! text) {
+        memset(&hdr, 0, sizeof(hdr));
+        memcpy(hdr.magic, SG_PT_TRACE_RING_MAGIC, sizeof(hdr.magic));
+        hdr.rec_sz = sizeof(rec);
+        hdr.num_recs = (uint32_t)(total - first);
+        hdr.total = total;
+        res = trc_write(fd, &hdr, sizeof(hdr));
+        if (res)
+            return res;
+    }
+    for (k = first; k < total; ++k) {
+        rp = arr + (k & sg_pt_ring_mask);
+        rec.seq = __atomic_load_n(&rp->seq, __ATOMIC_ACQUIRE);
+        memcpy((uint8_t *)&rec + sizeof(rec.seq), (const uint8_t *)rp +
+               sizeof(rp->seq), sizeof(rec) - sizeof(rec.seq));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if ((0 == rec.seq) ||
+            (rec.seq != __atomic_load_n(&rp->seq, __ATOMIC_RELAXED))) {
+            if (text)
+                continue;       /* being written, skip */
+            memset(&rec, 0, sizeof(rec));
+        }
+        if (text) {
+            sg_pt_trace_rec_str(&rec, sizeof(b) - 1, b);
+            n = strlen(b);
+            b[n++] = '\n';
+            res = trc_write(fd, b, n);
+        } else
+            res = trc_write(fd, &rec, sizeof(rec));
+        if (res)
+            return res;
+        ++num;
+    }
+    return num;
+#else
+    if (fd || text) { }
+    return 0;
+#endif
+}
+
+#ifdef SG_PT_TRACE_SUPPORTED
+static void
+trc_sig_handler(int sig_num __attribute__ ((unused)))
+{
+    int err = errno;
+
+    if (sg_pt_ring_sig_fd >= 0)
+        sg_pt_trace_ring_dump(sg_pt_ring_sig_fd, sg_pt_ring_sig_text);
+    errno = err;
+}
+#endif
+
+int
+sg_pt_trace_ring_dump_on_signal(int sig_num, int fd, bool text)
+{
+#ifdef SG_PT_TRACE_SUPPORTED
+    struct sigaction sigact;
+
+    if (fd < 0)
+        return EBADF;
+    sg_pt_ring_sig_fd = fd;
+    sg_pt_ring_sig_text = text;
+    memset(&sigact, 0, sizeof(sigact));
+    sigact.sa_handler = trc_sig_handler;
+    sigemptyset(&sigact.sa_mask);
+    sigact.sa_flags = SA_RESTART;
+    if (sigaction(sig_num, &sigact, NULL) < 0)
+        return errno;
+    return 0;
+#else
+    if (sig_num || fd || text) { }
+    return ENOTTY;
+#endif
+}
+
+/* The stream sink: writers copy completion events into a buffer under a
+ * spin lock, the one that fills it writes it out (still holding the lock
+ * so records stay in order). */
+#ifdef SG_PT_TRACE_SUPPORTED
+#define SG_PT_STREAM_BUF_RECS 512
+
+static int sg_pt_stream_fd = -1;
+static char sg_pt_stream_lock;
+static int sg_pt_stream_num;    /* records in sg_pt_stream_buf */
+static uint64_t sg_pt_stream_total;     /* records given to stream */
+static off_t sg_pt_stream_hdr_off = -1; /* where header was written */
+static struct sg_pt_trace_rec * sg_pt_stream_buf;
+
+static void
+trc_stream_flush(void)
+{
+    if (sg_pt_stream_num > 0) {
+        trc_write(sg_pt_stream_fd, sg_pt_stream_buf,
+                  sg_pt_stream_num * sizeof(*sg_pt_stream_buf));
+        sg_pt_stream_num = 0;
+    }
+}
+#endif
+
+int
+sg_pt_trace_stream_init(int fd)
+{
+#ifdef SG_PT_TRACE_SUPPORTED
+    int res;
+    struct sg_pt_trace_ring_hdr hdr;
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, SG_PT_TRACE_RING_MAGIC, sizeof(hdr.magic));
+    hdr.rec_sz = sizeof(struct sg_pt_trace_rec);
+    if (fd < 0) {
+        if (sg_pt_stream_fd < 0)
+            return 0;
+        while (__atomic_test_and_set(&sg_pt_stream_lock, __ATOMIC_ACQUIRE))
+            ;
+        trc_stream_flush();
+        if ((sg_pt_stream_hdr_off >= 0) &&
+            (sg_pt_stream_total <= UINT32_MAX)) {
+            hdr.num_recs = (uint32_t)sg_pt_stream_total;
+            hdr.total = sg_pt_stream_total;
+            if (pwrite(sg_pt_stream_fd, &hdr, sizeof(hdr),
+                       sg_pt_stream_hdr_off) < 0) { }
+        }
+        free(sg_pt_stream_buf);
+        sg_pt_stream_buf = NULL;
+        sg_pt_stream_fd = -1;
+        __atomic_clear(&sg_pt_stream_lock, __ATOMIC_RELEASE);
+        return 0;
+    }
+    if (sg_pt_stream_fd >= 0)
+        return EBUSY;
+    sg_pt_stream_buf = (struct sg_pt_trace_rec *)
+                calloc(SG_PT_STREAM_BUF_RECS, sizeof(*sg_pt_stream_buf));
+    if (NULL == sg_pt_stream_buf)
+        return ENOMEM;
+    sg_pt_stream_hdr_off = lseek(fd, 0, SEEK_CUR);
+    res = trc_write(fd, &hdr, sizeof(hdr));
+    if (res) {
+        free(sg_pt_stream_buf);
+        sg_pt_stream_buf = NULL;
+        return -res;
+    }
+    sg_pt_stream_num = 0;
+    sg_pt_stream_total = 0;
+    sg_pt_stream_fd = fd;
+    return 0;
+#else
+    if (fd) { }
+    return ENOTTY;
+#endif
+}
+
+void
+sg_pt_trace_stream_fn(const struct sg_pt_trace_rec * trp,
+                      void * priv __attribute__ ((unused)))
+{
+#ifdef SG_PT_TRACE_SUPPORTED
+    if (SG_PT_TRACE_COMPLETE != trp->event)
+        return;
+    while (__atomic_test_and_set(&sg_pt_stream_lock, __ATOMIC_ACQUIRE))
+        ;
+    if (sg_pt_stream_buf) {
+        sg_pt_stream_buf[sg_pt_stream_num++] = *trp;
+        ++sg_pt_stream_total;
+        if (sg_pt_stream_num >= SG_PT_STREAM_BUF_RECS)
+            trc_stream_flush();
+    }
+    __atomic_clear(&sg_pt_stream_lock, __ATOMIC_RELEASE);
+#else
+    if (trp) { }
+#endif
+}
+
+#ifdef SG_PT_TRACE_SUPPORTED
+static void
+trc_env_atexit(void)
+{
+    if (sg_pt_stream_fd >= 0) {
+        sg_pt_trace_set(NULL, NULL);
+        sg_pt_trace_stream_init(-1);
+    } else if (sg_pt_ring_sig_fd >= 0)
+        sg_pt_trace_ring_dump(sg_pt_ring_sig_fd, sg_pt_ring_sig_text);
+}
+#endif
+
+#ifdef SG_LIB_LINUX
+
+/* Checks the SG3_UTILS_PT_TRACE environment variable once per process.
+ * If it names a file then the trace ring is set up (with
+ * SG3_UTILS_PT_TRACE_NUM or 1024 records) and dumped as text to that file
+ * on SIGUSR2 (unless the application already handles that signal) and at
+ * exit. If the name ends in ".bin" the dump is binary. If
+ * SG3_UTILS_PT_TRACE_NUM is 0 every command is streamed to the file, in
+ * binary, instead. */
+void
+sg_pt_trace_check_env(void)
+{
+#ifdef SG_PT_TRACE_SUPPORTED
+    static bool checked = false;
+    int fd, num, len;
+    const char * cp;
+    struct sigaction sigact;
+
+    if (__atomic_exchange_n(&checked, true, __ATOMIC_ACQ_REL))
+        return;
+    cp = getenv("SG3_UTILS_PT_TRACE");
+    if ((NULL == cp) || ('\0' == *cp))
+        return;
+    num = 1024;
+    if (getenv("SG3_UTILS_PT_TRACE_NUM")) {
+        num = sg_get_num(getenv("SG3_UTILS_PT_TRACE_NUM"));
+        if (num < 0)
+            num = 1024;
+    }
+    if (0 == num) {
+        /* each process writes its own stream so start the file afresh */
+        fd = open(cp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            pr2ws("SG3_UTILS_PT_TRACE: unable to open %s: %s\n", cp,
+                  safe_strerror(errno));
+            return;
+        }
+        if (sg_pt_trace_stream_init(fd)) {
+            close(fd);
+            return;
+        }
+        atexit(trc_env_atexit);
+        sg_pt_trace_set(sg_pt_trace_stream_fn, NULL);
+        return;
+    }
+    if (sg_pt_trace_ring_init(num))
+        return;
+    fd = open(cp, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        pr2ws("SG3_UTILS_PT_TRACE: unable to open %s: %s\n", cp,
+              safe_strerror(errno));
+        sg_pt_trace_ring_init(0);
+        return;
+    }
+    len = strlen(cp);
+    sg_pt_ring_sig_fd = fd;
+    sg_pt_ring_sig_text = ! ((len > 4) && (0 == strcmp(cp + len - 4,
+                                                       ".bin")));
+    if ((0 == sigaction(SIGUSR2, NULL, &sigact)) &&
+        (SIG_DFL == sigact.sa_handler))
+        sg_pt_trace_ring_dump_on_signal(SIGUSR2, fd, sg_pt_ring_sig_text);
+    atexit(trc_env_atexit);
+    sg_pt_trace_set(sg_pt_trace_ring_fn, NULL);
+#endif
+}
+
+#endif          /* SG_LIB_LINUX */
+
+
+/* Per device command timeouts from the command timeouts descriptors of
+ * REPORT SUPPORTED OPERATION CODES, keyed by device id (st_rdev). Each
+ * device has an array sorted on opcode then service action so a lookup is
+ * a binary search. When nothing is recorded (the usual case) a lookup is a
+ * single relaxed load. The spin lock is as for the NVMe cache below. */
+#ifdef SG_LIB_LINUX
+#define SG_PT_TMO_SUPPORTED 1
+
+#define SG_PT_TMO_NUM 32
+#define SG_PT_TMO_RSOC_LEN 65536
+#define SG_PT_TMO_RSOC_SECS 20
+#define SG_PT_TMO_MAX_SECS 2000000      /* so milliseconds fit 31 bits */
+
+struct sg_pt_tmo_ent {
+    uint64_t dev_id;            /* 0 --> unused */
+    int num;                    /* elements in arr, 0 if none reported */
+    struct sg_pt_cmd_tmo * arr;
+};
+
+static int sg_pt_tmo_used;      /* elements of sg_pt_tmo_arr in use */
+static int sg_pt_tmo_env = -1;  /* SG3_UTILS_RSOC_TMO set: 1, -1 unknown */
+static char sg_pt_tmo_lock;
+static int sg_pt_tmo_victim;
+static struct sg_pt_tmo_ent sg_pt_tmo_arr[SG_PT_TMO_NUM];
+
+static void
+tmo_lock(void)
+{
+    while (__atomic_test_and_set(&sg_pt_tmo_lock, __ATOMIC_ACQUIRE))
+        ;
+}
+
+static void
+tmo_unlock(void)
+{
+    __atomic_clear(&sg_pt_tmo_lock, __ATOMIC_RELEASE);
+}
+
+static uint64_t
+tmo_dev_id(int dev_fd)
+{
+    struct stat a_stat;
+
+    if ((dev_fd < 0) || (fstat(dev_fd, &a_stat) < 0))
+        return 0;
+    return (uint64_t)a_stat.st_rdev;
+}
+
+static uint32_t
+tmo_key(uint8_t opcode, uint16_t sa)
+{
+    return ((uint32_t)opcode << 16) | sa;
+}
+
+static int
+tmo_cmp(const void * ap, const void * bp)
+{
+    const struct sg_pt_cmd_tmo * a = (const struct sg_pt_cmd_tmo *)ap;
+    const struct sg_pt_cmd_tmo * b = (const struct sg_pt_cmd_tmo *)bp;
+    uint32_t ka = tmo_key(a->opcode, a->sa);
+    uint32_t kb = tmo_key(b->opcode, b->sa);
+
+    return (ka < kb) ? -1 : (ka > kb);
+}
+
+/* Call with lock held. Returns matching entry or NULL. */
+static struct sg_pt_tmo_ent *
+tmo_find(uint64_t dev_id)
+{
+    int k;
+    struct sg_pt_tmo_ent * ep;
+
+    for (k = 0, ep = sg_pt_tmo_arr; k < SG_PT_TMO_NUM; ++k, ++ep) {
+        if (dev_id == ep->dev_id)
+            return ep;
+    }
+    return NULL;
+}
+
+/* Takes ownership of arr (may be NULL when num is 0), which must be sorted
+ * with tmo_cmp() */
+static void
+tmo_store(uint64_t dev_id, struct sg_pt_cmd_tmo * arr, int num)
+{
+    struct sg_pt_tmo_ent * ep;
+    struct sg_pt_cmd_tmo * old_arr;
+
+    tmo_lock();
+    ep = tmo_find(dev_id);
+    if (NULL == ep) {
+        ep = tmo_find(0);
+        if (ep)
+            __atomic_add_fetch(&sg_pt_tmo_used, 1, __ATOMIC_RELAXED);
+        else {  /* full, replace one round robin */
+            ep = sg_pt_tmo_arr + sg_pt_tmo_victim;
+            sg_pt_tmo_victim = (sg_pt_tmo_victim + 1) % SG_PT_TMO_NUM;
+        }
+    }
+    old_arr = ep->arr;
+    ep->dev_id = dev_id;
+    ep->arr = arr;
+    ep->num = num;
+    tmo_unlock();
+    free(old_arr);
+}
+
+/* Returns the timeout, in seconds, recorded for dev_id and cdbp, 0 if
+ * none. If known is non-NULL it is set true when dev_id has an entry
+ * (even an empty one). */
+static int
+tmo_lookup(uint64_t dev_id, const uint8_t * cdbp, int cdb_len,
+           struct sg_pt_cmd_tmo * tp, bool * known)
+{
+    int lo, hi, mid, secs;
+    uint32_t key, k;
+    const struct sg_pt_tmo_ent * ep;
+    const struct sg_pt_cmd_tmo * ctp = NULL;
+
+    if (known)
+        *known = false;
+    if ((0 == dev_id) || (NULL == cdbp) || (cdb_len < 6))
+        return 0;
+    tmo_lock();
+    ep = tmo_find(dev_id);
+    if (NULL == ep) {
+        tmo_unlock();
+        return 0;
+    }
+    if (known)
+        *known = true;
+    /* first element with this opcode, then exact match if it has an SA */
+    key = tmo_key(cdbp[0], 0);
+    for (lo = 0, hi = ep->num; lo < hi; ) {
+        mid = (lo + hi) / 2;
+        if (tmo_key(ep->arr[mid].opcode, ep->arr[mid].sa) < key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if ((lo < ep->num) && (ep->arr[lo].opcode == cdbp[0])) {
+        if (! ep->arr[lo].sa_valid)
+            ctp = ep->arr + lo;
+        else {
+            if (0x7f == cdbp[0])        /* variable length cdb */
+                key = tmo_key(cdbp[0], (cdb_len >= 10) ?
+                                       sg_get_unaligned_be16(cdbp + 8) : 0);
+            else
+                key = tmo_key(cdbp[0], cdbp[1] & 0x1f);
+            for (hi = ep->num; lo < hi; ) {
+                mid = (lo + hi) / 2;
+                k = tmo_key(ep->arr[mid].opcode, ep->arr[mid].sa);
+                if (k == key) {
+                    ctp = ep->arr + mid;
+                    break;
+                } else if (k < key)
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+        }
+    }
+    secs = 0;
+    if (ctp) {
+        if (ctp->recommended_secs > 0)
+            secs = (ctp->recommended_secs < SG_PT_TMO_MAX_SECS) ?
+                   (int)ctp->recommended_secs : SG_PT_TMO_MAX_SECS;
+        else if (ctp->nominal_secs > 0)
+            secs = (ctp->nominal_secs < (SG_PT_TMO_MAX_SECS / 2)) ?
+                   (int)(2 * ctp->nominal_secs) : SG_PT_TMO_MAX_SECS;
+        if (tp)
+            *tp = *ctp;
+    }
+    tmo_unlock();
+    return secs;
+}
+
+/* Decodes an RSOC response with reporting options 0 and RCTD set. Returns
+ * a sorted array (NULL if none, else free() it) and the number of its
+ * elements in *nump. Returns NULL with *nump set to a negated errno when
+ * out of memory. */
+static struct sg_pt_cmd_tmo *
+tmo_decode_rsoc(const uint8_t * resp, int resp_len, int * nump)
+{
+    int k, len, num, max_num;
+    const uint8_t * bp;
+    struct sg_pt_cmd_tmo * arr;
+
+    *nump = 0;
+    if ((NULL == resp) || (resp_len < 4))
+        return NULL;
+    len = sg_get_unaligned_be32(resp) + 4;
+    if (len > resp_len)
+        len = resp_len;
+    max_num = (len - 4) / 20;   /* each with CTDP is 8 + 12 bytes */
+    if (max_num < 1)
+        return NULL;
+    arr = (struct sg_pt_cmd_tmo *)calloc(max_num, sizeof(*arr));
+    if (NULL == arr) {
+        *nump = -ENOMEM;
+        return NULL;
+    }
+    for (k = 4, num = 0; (k + 8) <= len; ) {
+        bp = resp + k;
+        k += 8;
+        if (0 == (0x2 & bp[5]))         /* CTDP clear: no timeouts */
+            continue;
+        if ((k + 12) > len)
+            break;
+        if ((num < max_num) && (sg_get_unaligned_be16(resp + k) >= 0xa)) {
+            arr[num].opcode = bp[0];
+            arr[num].sa_valid = !! (0x1 & bp[5]);
+            arr[num].sa = arr[num].sa_valid ?
+                          sg_get_unaligned_be16(bp + 2) : 0;
+            arr[num].nominal_secs = sg_get_unaligned_be32(resp + k + 4);
+            arr[num].recommended_secs = sg_get_unaligned_be32(resp + k + 8);
+            if (arr[num].nominal_secs || arr[num].recommended_secs)
+                ++num;
+        }
+        k += 12;
+    }
+    if (0 == num) {
+        free(arr);
+        return NULL;
+    }
+    qsort(arr, num, sizeof(*arr), tmo_cmp);
+    *nump = num;
+    return arr;
+}
+
+static bool
+tmo_auto(void)
+{
+    int env = __atomic_load_n(&sg_pt_tmo_env, __ATOMIC_RELAXED);
+
+    if (env < 0) {
+        env = getenv("SG3_UTILS_RSOC_TMO") ? 1 : 0;
+        __atomic_store_n(&sg_pt_tmo_env, env, __ATOMIC_RELAXED);
+    }
+    return !! env;
+}
+
+/* Called by do_scsi_pt() and do_scsi_pt_submit() for a SCSI command with
+ * a default timeout. If dev_fd is not negative and SG3_UTILS_RSOC_TMO is
+ * set, then the first such command to each device fetches its timeouts.
+ * Returns seconds or 0 for the default. */
+int
+sg_pt_tmo_for_cmd(uint64_t dev_id, int dev_fd, const uint8_t * cdbp,
+                  int cdb_len)
+{
+    int secs;
+    bool known;
+
+    if (0 == __atomic_load_n(&sg_pt_tmo_used, __ATOMIC_RELAXED)) {
+        if ((dev_fd < 0) || (! tmo_auto()))
+            return 0;
+    }
+    secs = tmo_lookup(dev_id, cdbp, cdb_len, NULL, &known);
+    if (known || (dev_fd < 0) || (0 == dev_id) || (! tmo_auto()))
+        return secs;
+    sg_pt_tmo_load(dev_fd, 0);  /* sends RSOC with a timeout, no recursion */
+    return tmo_lookup(dev_id, cdbp, cdb_len, NULL, NULL);
+}
+#endif  /* SG_LIB_LINUX */
+
+int
+sg_pt_tmo_set_rsoc(int dev_fd, const uint8_t * resp, int resp_len)
+{
+#ifdef SG_PT_TMO_SUPPORTED
+    int num;
+    uint64_t dev_id = tmo_dev_id(dev_fd);
+    struct sg_pt_cmd_tmo * arr;
+
+    if (0 == dev_id)
+        return -ENODEV;
+    arr = tmo_decode_rsoc(resp, resp_len, &num);
+    if (num < 0)
+        return num;
+    tmo_store(dev_id, arr, num);
+    return num;
+#else
+    if (dev_fd || resp || resp_len) { }
+    return -ENOSYS;
+#endif
+}
+
+int
+sg_pt_tmo_load(int dev_fd, int verbose)
+{
+#ifdef SG_PT_TMO_SUPPORTED
+    int res, num;
+    uint64_t dev_id = tmo_dev_id(dev_fd);
+    uint8_t * rp;
+    uint8_t * free_rp = NULL;
+    struct sg_pt_base * ptvp;
+    uint8_t rsoc_cdb[12] = {0xa3, 0xc, 0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    uint8_t sense_b[32] SG_C_CPP_ZERO_INIT;
+
+    if (0 == dev_id)
+        return sg_convert_errno(ENODEV);
+    tmo_store(dev_id, NULL, 0);         /* asked once, even if it fails */
+    rp = sg_memalign(SG_PT_TMO_RSOC_LEN, 0, &free_rp, false);
+    ptvp = construct_scsi_pt_obj_with_fd(dev_fd, verbose);
+    if ((NULL == rp) || (NULL == ptvp)) {
+        free(free_rp);
+        if (ptvp)
+            destruct_scsi_pt_obj(ptvp);
+        return sg_convert_errno(ENOMEM);
+    }
+    sg_put_unaligned_be32(SG_PT_TMO_RSOC_LEN, rsoc_cdb + 6);
+    set_scsi_pt_cdb(ptvp, rsoc_cdb, sizeof(rsoc_cdb));
+    set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
+    set_scsi_pt_data_in(ptvp, rp, SG_PT_TMO_RSOC_LEN);
+    res = do_scsi_pt(ptvp, -1, SG_PT_TMO_RSOC_SECS, verbose);
+    if (res < 0)
+        res = sg_convert_errno(-res);
+    else if (res)
+        res = SG_LIB_CAT_OTHER;
+    else {
+        switch (get_scsi_pt_result_category(ptvp)) {
+        case SCSI_PT_RESULT_GOOD:
+            res = 0;
+            break;
+        case SCSI_PT_RESULT_SENSE:
+            res = sg_err_category_sense(sense_b,
+                                        get_scsi_pt_sense_len(ptvp));
+            if (SG_LIB_CAT_RECOVERED == res)
+                res = 0;
+            break;
+        default:
+            res = SG_LIB_CAT_OTHER;
+            break;
+        }
+    }
+    if (0 == res) {
+        num = sg_pt_tmo_set_rsoc(dev_fd, rp, SG_PT_TMO_RSOC_LEN -
+                                             get_scsi_pt_resid(ptvp));
+        if (num < 0)
+            res = sg_convert_errno(-num);
+        else if (verbose > 1)
+            pr2ws("%s: %d command timeouts recorded\n", __func__, num);
+    } else if (verbose)
+        pr2ws("%s: RSOC with RCTD failed, command timeouts not known\n",
+              __func__);
+    destruct_scsi_pt_obj(ptvp);
+    free(free_rp);
+    return res;
+#else
+    if (dev_fd || verbose) { }
+    return SG_LIB_SYNTAX_ERROR;
+#endif
+}
+
+int
+sg_pt_tmo_get(int dev_fd, const uint8_t * cdbp, int cdb_len,
+              struct sg_pt_cmd_tmo * tp)
+{
+#ifdef SG_PT_TMO_SUPPORTED
+    if (0 == __atomic_load_n(&sg_pt_tmo_used, __ATOMIC_RELAXED))
+        return 0;
+    return tmo_lookup(tmo_dev_id(dev_fd), cdbp, cdb_len, tp, NULL);
+#else
+    if (dev_fd || cdbp || cdb_len || tp) { }
+    return 0;
+#endif
+}
+
+void
+sg_pt_tmo_clear(int dev_fd)
+{
+#ifdef SG_PT_TMO_SUPPORTED
+    int k;
+    uint64_t dev_id = (dev_fd < 0) ? 0 : tmo_dev_id(dev_fd);
+    struct sg_pt_tmo_ent * ep;
+
+    if ((dev_fd >= 0) && (0 == dev_id))
+        return;
+    tmo_lock();
+    for (k = 0, ep = sg_pt_tmo_arr; k < SG_PT_TMO_NUM; ++k, ++ep) {
+        if ((0 == ep->dev_id) || (dev_id && (dev_id != ep->dev_id)))
+            continue;
+        free(ep->arr);
+        ep->arr = NULL;
+        ep->num = 0;
+        ep->dev_id = 0;
+        __atomic_sub_fetch(&sg_pt_tmo_used, 1, __ATOMIC_RELAXED);
+    }
+    tmo_unlock();
+#else
+    if (dev_fd) { }
+#endif
+}
+
+
+/* Process wide cache of NVMe Identify responses and the volatile write
+ * cache setting, keyed by device id (e.g. st_rdev) and nsid. Used by the
+ * SNTL so that pt objects opened on the same device do not each reissue
+ * those Admin commands. A spin lock is enough since the critical sections
+ * are short (at most a 4096 byte copy). Invalidation bumps a generation
+ * counter, entries filled under an older generation are ignored. */
+#if (HAVE_NVME && (! IGNORE_NVME)) && (defined(__GNUC__) || defined(__clang__))
+#define SG_NVME_CACHE_SUPPORTED 1
+
+#define SG_NVME_CACHE_NUM 32
+
+struct sg_nvme_cache_ent {
+    uint64_t dev_id;            /* 0 --> unused */
+    uint32_t nsid;
+    uint32_t gen;               /* sg_nvme_cache_gen when filled */
+    int valid;                  /* OR-ed SG_NVME_CACHE_* values */
+    uint32_t wce;
+    uint8_t * id_ctl;           /* SG_NVME_CACHE_ID_LEN bytes */
+    uint8_t * id_ns;
+};
+
+static bool sg_nvme_cache_off;
+static char sg_nvme_cache_lock;
+static uint32_t sg_nvme_cache_gen = 1;
+static int sg_nvme_cache_victim;
+static struct sg_nvme_cache_ent sg_nvme_cache_arr[SG_NVME_CACHE_NUM];
+
+static void
+nvme_cache_lock(void)
+{
+    while (__atomic_test_and_set(&sg_nvme_cache_lock, __ATOMIC_ACQUIRE))
+        ;
+}
+
+static void
+nvme_cache_unlock(void)
+{
+    __atomic_clear(&sg_nvme_cache_lock, __ATOMIC_RELEASE);
+}
+
+/* Call with lock held. Returns matching entry or NULL. */
+static struct sg_nvme_cache_ent *
+nvme_cache_find(uint64_t dev_id, uint32_t nsid)
+{
+    int k;
+    struct sg_nvme_cache_ent * ep;
+
+    for (k = 0, ep = sg_nvme_cache_arr; k < SG_NVME_CACHE_NUM; ++k, ++ep) {
+        if ((dev_id == ep->dev_id) && (nsid == ep->nsid)) {
+            if (ep->gen != sg_nvme_cache_gen)
+                ep->valid = 0;  /* stale */
+            return ep;
+        }
+    }
+    return NULL;
+}
+
+bool
+sg_nvme_cache_get(uint64_t dev_id, uint32_t nsid, int which, uint8_t * bp,
+                  uint32_t * valp)
+{
+    bool found = false;
+    const struct sg_nvme_cache_ent * ep;
+
+    if ((0 == dev_id) || __atomic_load_n(&sg_nvme_cache_off,
+                                         __ATOMIC_RELAXED))
+        return false;
+    nvme_cache_lock();
+    ep = nvme_cache_find(dev_id, nsid);
+    if (ep && (which & ep->valid)) {
+        found = true;
+        if (SG_NVME_CACHE_ID_CTL == which)
+            memcpy(bp, ep->id_ctl, SG_NVME_CACHE_ID_LEN);
+        else if (SG_NVME_CACHE_ID_NS == which)
+            memcpy(bp, ep->id_ns, SG_NVME_CACHE_ID_LEN);
+        else if (valp)
+            *valp = ep->wce;
+    }
+    nvme_cache_unlock();
+    return found;
+}
+
+void
+sg_nvme_cache_put(uint64_t dev_id, uint32_t nsid, int which,
+                  const uint8_t * bp, uint32_t val)
+{
+    uint8_t ** upp = NULL;
+    struct sg_nvme_cache_ent * ep;
+
+    if ((0 == dev_id) || __atomic_load_n(&sg_nvme_cache_off,
+                                         __ATOMIC_RELAXED))
+        return;
+    nvme_cache_lock();
+    ep = nvme_cache_find(dev_id, nsid);
+    if (NULL == ep) {   /* take over an entry, round robin */
+        ep = sg_nvme_cache_arr + sg_nvme_cache_victim;
+        sg_nvme_cache_victim = (sg_nvme_cache_victim + 1) %
+                               SG_NVME_CACHE_NUM;
+        ep->dev_id = dev_id;
+        ep->nsid = nsid;
+        ep->valid = 0;
+    }
+    if (0 == ep->valid)
+        ep->gen = sg_nvme_cache_gen;
+    if (SG_NVME_CACHE_ID_CTL == which)
+        upp = &ep->id_ctl;
+    else if (SG_NVME_CACHE_ID_NS == which)
+        upp = &ep->id_ns;
+    else
+        ep->wce = val;
+    if (upp) {
+        if (NULL == *upp)
+            *upp = (uint8_t *)malloc(SG_NVME_CACHE_ID_LEN);
+        if (NULL == *upp) {
+            nvme_cache_unlock();
+            return;
+        }
+        memcpy(*upp, bp, SG_NVME_CACHE_ID_LEN);
+    }
+    ep->valid |= which;
+    nvme_cache_unlock();
+}
+
+void
+sg_pt_nvme_cache_enable(bool enable)
+{
+    __atomic_store_n(&sg_nvme_cache_off, ! enable, __ATOMIC_RELAXED);
+    if (! enable)
+        sg_pt_nvme_cache_invalidate();
+}
+
+void
+sg_pt_nvme_cache_invalidate(void)
+{
+    nvme_cache_lock();
+    ++sg_nvme_cache_gen;
+    nvme_cache_unlock();
+}
+
+uint32_t
+sg_pt_nvme_cache_gen(void)
+{
+    return __atomic_load_n(&sg_nvme_cache_gen, __ATOMIC_RELAXED);
+}
+
+#else   /* no cache */
+
+void
+sg_pt_nvme_cache_enable(bool enable)
+{
+    if (enable) { }
+}
+
+void
+sg_pt_nvme_cache_invalidate(void)
+{
+}
+
+uint32_t
+sg_pt_nvme_cache_gen(void)
+{
+    return 0;
+}
+
+#if (HAVE_NVME && (! IGNORE_NVME))
+
+bool
+sg_nvme_cache_get(uint64_t dev_id, uint32_t nsid, int which, uint8_t * bp,
+                  uint32_t * valp)
+{
+    if (dev_id) { }
+    if (nsid) { }
+    if (which) { }
+    if (bp) { }
+    if (valp) { }
+    return false;
+}
+
+void
+sg_nvme_cache_put(uint64_t dev_id, uint32_t nsid, int which,
+                  const uint8_t * bp, uint32_t val)
+{
+    if (dev_id) { }
+    if (nsid) { }
+    if (which) { }
+    if (bp) { }
+    if (val) { }
+}
+
+#endif
+#endif  /* SG_NVME_CACHE_SUPPORTED */
 
 #if (HAVE_NVME && (! IGNORE_NVME))
 /* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
@@ -7,7 +7,7 @@
  * SPDX-License-Identifier: BSD-2-Clause
  */
 
-/* sg_pt_freebsd version 1.48 20220811 */
+/* sg_pt_freebsd version 1.50 20261015 */
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -32,6 +32,8 @@
 #include <glob.h>
 #include <fcntl.h>
 #include <stddef.h>
+#include <poll.h>
+#include <sys/ioctl.h>
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -62,16 +64,30 @@
 #define CAM_ERROR_PRINT(a, b, c, d, e)
 #endif
 
+/* pass(4) gained the CAMIOQUEUE/CAMIOGET queued interface in FreeBSD 11 */
+#if __FreeBSD_version >= 1100000
+#include <cam/scsi/scsi_pass.h>
+#if defined(CAMIOQUEUE) && defined(CAMIOGET)
+#define SG_FBSD_CAM_QUEUE 1
+#endif
+#endif
+
+/* pass(4) hands back the user's periph_priv area unchanged with CAMIOGET */
+#define sg_ccb_ptp ppriv_ptr0
+
 
 struct freebsd_dev_channel {    /* one instance per open file descriptor */
     bool is_nvme_dev;   /* true if NVMe device attached, else SCSI */
     bool is_cam_nvme;   /* NVMe via /dev/nda<n> or /dev/pass<n> devices */
     bool is_pass;       /* CAM passthrough device (i.e. 'pass<n>') */
+    bool no_cam_queue;  /* CAMIOQUEUE refused, submit synchronously */
     int unitnum;        /* the SCSI unit number, NVMe controller id? */
     uint32_t nsid;
     // uint32_t nv_ctrlid;      /* unitnum seems to have this role */
     int nvme_fd_ns;     // for non-CAM NVMe, use -1 to indicate not provided
     int nvme_fd_ctrl;   // open("/dev/nvme<n>") if needed */
+    int num_queued;     /* CAMIOQUEUE-d, not yet fetched with CAMIOGET */
+    int num_ready;      /* fetched, not yet given to do_scsi_pt_receive() */
     char* devname;      // from cam_get_device() or ioctl(NVME_GET_NSID)
     struct cam_device* cam_dev;
     uint8_t * nvme_id_ctlp;
@@ -116,6 +132,8 @@ struct sg_pt_freebsd_scsi { /* context of one SCSI/NVME command (pt object) */
     bool mdxfer_out;
     bool is_nvme_dev;   /* copied from owning mchanp */
     bool nvme_our_sntl; /* true: our SNTL; false: received NVMe command */
+    bool async_queued;  /* CCB queued on the pass device with CAMIOQUEUE */
+    bool async_done;    /* queued CCB fetched, counted in mchanp->num_ready */
     struct freebsd_dev_channel * mchanp;    /* associated device info */
 };
 
@@ -581,6 +599,8 @@ destruct_scsi_pt_obj(struct sg_pt_base * vp)
         return;
     }
     if ((ptp = &vp->impl)) {
+        if (ptp->async_queued)  /* kernel still uses our data buffers */
+            do_scsi_pt_receive(vp, -1, 0);
         if (ptp->ccb)
             cam_freeccb(ptp->ccb);
         free(vp);
@@ -598,8 +618,11 @@ clear_scsi_pt_obj(struct sg_pt_base * vp)
     }
     if ((ptp = &vp->impl)) {
         int dev_han = ptp->dev_han;
-        struct freebsd_dev_channel *fdc_p = ptp->mchanp;
+        struct freebsd_dev_channel *fdc_p;
 
+        if (ptp->async_queued)
+            do_scsi_pt_receive(vp, -1, 0);
+        fdc_p = ptp->mchanp;
         if (ptp->ccb)
             cam_freeccb(ptp->ccb);
         memset(ptp, 0, sizeof(struct sg_pt_freebsd_scsi));
@@ -813,19 +836,15 @@ set_scsi_pt_flags(struct sg_pt_base * objp, int flags)
     if (flags) { ; }     /* unused, suppress warning */
 }
 
-/* Executes SCSI command (or at least forwards it to lower layers).
- * Clears os_err field prior to active call (whose result may set it
- * again). */
-int
-do_scsi_pt(struct sg_pt_base * vp, int dev_han, int time_secs, int vb)
+/* Checks the pt object and dev_han then sets *fdcpp to the associated
+ * device channel. Returns 0 if okay, else the value that do_scsi_pt() and
+ * do_scsi_pt_submit() should return. */
+static int
+fbsd_pt_get_chan(struct sg_pt_freebsd_scsi * ptp, int dev_han,
+                 struct freebsd_dev_channel ** fdcpp, int vb)
 {
-    struct sg_pt_freebsd_scsi * ptp = &vp->impl;
     struct freebsd_dev_channel *fdc_p;
-    FILE * ferrp = sg_warnings_strm ? sg_warnings_strm : stderr;
-    union ccb *ccb;
 
-    if (vb > 6)
-        pr2ws("%s: dev_han=%d, time_secs=%d\n", __func__, dev_han, time_secs);
     ptp->os_err = 0;
     if (ptp->in_err) {
         if (vb)
@@ -868,12 +887,18 @@ do_scsi_pt(struct sg_pt_base * vp, int dev_han, int time_secs, int vb)
         }
         ptp->mchanp = fdc_p;
     }
-#if (HAVE_NVME && (! IGNORE_NVME))
-    if (fdc_p->is_nvme_dev)
-        return sg_do_nvme_pt(ptp, -1, true /* assume Admin */, time_secs, vb);
-#endif
+    *fdcpp = fdc_p;
+    return 0;
+}
+
+/* Gets (or re-uses) the pt object's CCB and fills it in as a SCSI I/O
+ * request. Returns 0 if okay. */
+static int
+fbsd_cam_fill_ccb(struct sg_pt_freebsd_scsi * ptp,
+                  struct freebsd_dev_channel *fdc_p, int time_secs, int vb)
+{
+    union ccb *ccb;
 
-    /* SCSI CAM pass-through follows */
     ptp->is_nvme_dev = fdc_p->is_nvme_dev;
     if (NULL == fdc_p->cam_dev) {
         if (vb)
@@ -908,19 +933,13 @@ do_scsi_pt(struct sg_pt_base * vp, int dev_han, int time_secs, int vb)
                   /* cdblen */ ptp->cdb_len,
                   /* timeout (millisecs) */ ptp->timeout_ms);
     memcpy(ccb->csio.cdb_io.cdb_bytes, ptp->cdb, ptp->cdb_len);
+    return 0;
+}
 
-    if (cam_send_ccb(fdc_p->cam_dev, ccb) < 0) {
-        if (vb) {
-            pr2serr("%s: cam_send_ccb() error\n", __func__);
-            CAM_ERROR_PRINT(fdc_p->cam_dev, ccb, CAM_ESF_ALL,
-                            CAM_EPF_ALL, ferrp);
-        }
-        cam_freeccb(ptp->ccb);
-        ptp->ccb = NULL;
-        ptp->os_err = EIO;
-        return -ptp->os_err;
-    }
-
+/* Picks up SCSI status, residual and sense data from a completed CCB */
+static void
+fbsd_cam_ccb_done(struct sg_pt_freebsd_scsi * ptp, const union ccb *ccb)
+{
     if (((ccb->ccb_h.status & CAM_STATUS_MASK) == CAM_REQ_CMP) ||
         ((ccb->ccb_h.status & CAM_STATUS_MASK) == CAM_SCSI_STATUS_ERROR)) {
         ptp->scsi_status = ccb->csio.scsi_status;
@@ -940,7 +959,48 @@ do_scsi_pt(struct sg_pt_base * vp, int dev_han, int time_secs, int vb)
         }
     } else
         ptp->transport_err = 1;
+}
 
+/* Executes SCSI command (or at least forwards it to lower layers).
+ * Clears os_err field prior to active call (whose result may set it
+ * again). */
+int
+do_scsi_pt(struct sg_pt_base * vp, int dev_han, int time_secs, int vb)
+{
+    int res;
+    struct sg_pt_freebsd_scsi * ptp = &vp->impl;
+    struct freebsd_dev_channel *fdc_p = NULL;
+    FILE * ferrp = sg_warnings_strm ? sg_warnings_strm : stderr;
+    union ccb *ccb;
+
+    if (vb > 6)
+        pr2ws("%s: dev_han=%d, time_secs=%d\n", __func__, dev_han, time_secs);
+    res = fbsd_pt_get_chan(ptp, dev_han, &fdc_p, vb);
+    if (res)
+        return res;
+#if (HAVE_NVME && (! IGNORE_NVME))
+    if (fdc_p->is_nvme_dev)
+        return sg_do_nvme_pt(ptp, -1, true /* assume Admin */, time_secs, vb);
+#endif
+
+    /* SCSI CAM pass-through follows */
+    res = fbsd_cam_fill_ccb(ptp, fdc_p, time_secs, vb);
+    if (res)
+        return res;
+    ccb = ptp->ccb;
+
+    if (cam_send_ccb(fdc_p->cam_dev, ccb) < 0) {
+        if (vb) {
+            pr2serr("%s: cam_send_ccb() error\n", __func__);
+            CAM_ERROR_PRINT(fdc_p->cam_dev, ccb, CAM_ESF_ALL,
+                            CAM_EPF_ALL, ferrp);
+        }
+        cam_freeccb(ptp->ccb);
+        ptp->ccb = NULL;
+        ptp->os_err = EIO;
+        return -ptp->os_err;
+    }
+    fbsd_cam_ccb_done(ptp, ccb);
     return 0;
 }
 
@@ -3179,3 +3239,258 @@ do_nvm_pt(struct sg_pt_base * vp, int submq, int timeout_secs, int vb)
 }
 
 #endif          /* (HAVE_NVME && (! IGNORE_NVME)) */
+
+#ifdef SG_FBSD_CAM_QUEUE
+
+/* Waits up to wait_ms milliseconds (-1 for no limit) for the pass device
+ * to have a completed CCB, fetches it with CAMIOGET and completes the pt
+ * object that queued it. Returns 1 if a CCB was fetched, 0 on timeout,
+ * else a negated errno. */
+static int
+fbsd_cam_get_one(struct freebsd_dev_channel * fdc_p, int wait_ms, int vb)
+{
+    int res, fd;
+    struct pollfd a_poll;
+    union ccb r_ccb;
+    struct sg_pt_freebsd_scsi * ptp;
+
+    fd = fdc_p->cam_dev->fd;
+    a_poll.fd = fd;
+    a_poll.events = POLLIN;
+    a_poll.revents = 0;
+    res = poll(&a_poll, 1, wait_ms);
+    if (res < 0) {
+        res = errno;
+        if (EINTR == res)
+            return 0;
+        if (vb)
+            pr2ws("%s: poll() failed: %s\n", __func__, safe_strerror(res));
+        return -res;
+    } else if (0 == res)
+        return 0;
+    memset(&r_ccb, 0, sizeof(r_ccb));
+    if (ioctl(fd, CAMIOGET, &r_ccb) < 0) {
+        res = errno;
+        if ((ENOENT == res) || (EAGAIN == res))
+            return 0;
+        if (vb)
+            pr2ws("%s: ioctl(CAMIOGET) failed: %s\n", __func__,
+                  safe_strerror(res));
+        return -res;
+    }
+    if (fdc_p->num_queued > 0)
+        --fdc_p->num_queued;
+    ptp = (struct sg_pt_freebsd_scsi *)r_ccb.ccb_h.sg_ccb_ptp;
+    if ((NULL == ptp) || (! ptp->async_queued)) {
+        if (vb)
+            pr2ws("%s: CCB with no owner, ignored\n", __func__);
+        return 1;
+    }
+    ptp->async_queued = false;
+    ptp->async_done = true;
+    ++fdc_p->num_ready;
+    if (vb > 5)
+        pr2ws("%s: CCB status=0x%x\n", __func__, r_ccb.ccb_h.status);
+    fbsd_cam_ccb_done(ptp, &r_ccb);
+    return 1;
+}
+
+#endif          /* SG_FBSD_CAM_QUEUE */
+
+/* SCSI commands are queued on the pass(4) device with CAMIOQUEUE so that
+ * several can be outstanding; do_scsi_pt_receive() and
+ * scsi_pt_wait_for_response() collect them with CAMIOGET. NVMe commands,
+ * and kernels without that interface, complete synchronously here. */
+int
+do_scsi_pt_submit(struct sg_pt_base * vp, int fd, int time_secs, int verbose)
+{
+#ifdef SG_FBSD_CAM_QUEUE
+    int res;
+    struct sg_pt_freebsd_scsi * ptp = &vp->impl;
+    struct freebsd_dev_channel *fdc_p = NULL;
+
+    if (ptp->async_queued) {
+        if (verbose)
+            pr2ws("%s: pt object already has a command queued\n",
+                  __func__);
+        return SCSI_PT_DO_BAD_PARAMS;
+    }
+    res = fbsd_pt_get_chan(ptp, fd, &fdc_p, verbose);
+    if (res)
+        return res;
+    if (fdc_p->is_nvme_dev || fdc_p->no_cam_queue ||
+        (NULL == fdc_p->cam_dev))
+        return do_scsi_pt(vp, fd, time_secs, verbose);
+    res = fbsd_cam_fill_ccb(ptp, fdc_p, time_secs, verbose);
+    if (res)
+        return res;
+    ptp->ccb->ccb_h.sg_ccb_ptp = ptp;
+    if (ioctl(fdc_p->cam_dev->fd, CAMIOQUEUE, ptp->ccb) < 0) {
+        res = errno;
+        if ((ENOTTY == res) || (EINVAL == res)) {
+            if (verbose > 1)
+                pr2ws("%s: CAMIOQUEUE not supported, going synchronous\n",
+                      __func__);
+            fdc_p->no_cam_queue = true;
+            return do_scsi_pt(vp, fd, time_secs, verbose);
+        }
+        if (verbose)
+            pr2ws("%s: ioctl(CAMIOQUEUE) failed: %s\n", __func__,
+                  safe_strerror(res));
+        ptp->os_err = res;
+        return -res;
+    }
+    ptp->async_queued = true;
+    ++fdc_p->num_queued;
+    return 0;
+#else
+    return do_scsi_pt(vp, fd, time_secs, verbose);
+#endif
+}
+
+int
+do_nvm_pt_submit(struct sg_pt_base * vp, int submq, int timeout_secs,
+                 int verbose)
+{
+    return do_nvm_pt(vp, submq, timeout_secs, verbose);
+}
+
+/* Waits, if necessary, for the command queued by do_scsi_pt_submit() on
+ * this object. Other completions fetched meanwhile are placed in their
+ * own pt objects. Returns 0 when the result is available. */
+int
+do_scsi_pt_receive(struct sg_pt_base * vp, int fd, int verbose)
+{
+#ifdef SG_FBSD_CAM_QUEUE
+    int res;
+    struct sg_pt_freebsd_scsi * ptp = &vp->impl;
+    struct freebsd_dev_channel *fdc_p = ptp->mchanp;
+
+    if (fd) { }
+    while (ptp->async_queued && fdc_p && fdc_p->cam_dev) {
+        res = fbsd_cam_get_one(fdc_p, -1, verbose);
+        if (res < 0)
+            return res;
+    }
+    if (ptp->async_done) {
+        ptp->async_done = false;
+        if (fdc_p && (fdc_p->num_ready > 0))
+            --fdc_p->num_ready;
+    }
+#else
+    if (vp) { }
+    if (fd) { }
+    if (verbose) { }
+#endif
+    return 0;
+}
+
+/* Returns 1 if a completion is ready (or nothing is queued on fd), 0 if
+ * timeout_ms (-1 for no limit) expired first, else a negated errno. */
+int
+scsi_pt_wait_for_response(int fd, int timeout_ms, int verbose)
+{
+#ifdef SG_FBSD_CAM_QUEUE
+    int han = fd - FREEBSD_FDOFFSET;
+    struct freebsd_dev_channel *fdc_p;
+
+    if ((han < 0) || (han >= FREEBSD_MAXDEV))
+        return -ENODEV;
+    fdc_p = devicetable[han];
+    if (NULL == fdc_p)
+        return -ENODEV;
+    if ((NULL == fdc_p->cam_dev) || (fdc_p->num_ready > 0) ||
+        (fdc_p->num_queued < 1))
+        return 1;
+    return fbsd_cam_get_one(fdc_p, timeout_ms, verbose);
+#else
+    if (fd) { }
+    if (timeout_ms) { }
+    if (verbose) { }
+    return 1;
+#endif
+}
+
+/* Commands in the batch are issued one after the other */
+int
+do_scsi_pt_mrq(struct sg_pt_base * vp_arr[], int num, int fd, int time_secs,
+               int * num_donep, int verbose)
+{
+    return sg_pt_mrq_sequential(vp_arr, num, fd, time_secs, num_donep,
+                                verbose);
+}
+
+/* Registered buffers are not supported by this OS interface */
+int
+sg_pt_reg_bufs(struct sg_pt_base * vp, int num, uint32_t buf_len,
+               uint8_t * bufs[], int verbose)
+{
+    if (vp) { }
+    if (num) { }
+    if (buf_len) { }
+    if (bufs) { }
+    if (verbose) { }
+    return ENOTTY;
+}
+
+void
+sg_pt_unreg_bufs(struct sg_pt_base * vp)
+{
+    if (vp) { }
+}
+
+bool
+sg_pt_reg_bufs_zero_copy(const struct sg_pt_base * vp)
+{
+    if (vp) { }
+    return false;
+}
+
+/* Trace callbacks are not supported by this OS interface */
+bool
+set_pt_trace(struct sg_pt_base * vp, sg_pt_trace_fn fn, void * priv)
+{
+    if (vp) { }
+    if (fn) { }
+    if (priv) { }
+    return false;
+}
+
+void
+set_scsi_pt_data_in_reg(struct sg_pt_base * vp, int buf_idx, int dxfer_ilen)
+{
+    if (vp) { }
+    if (buf_idx) { }
+    if (dxfer_ilen) { }
+}
+
+void
+set_scsi_pt_data_out_reg(struct sg_pt_base * vp, int buf_idx,
+                         int dxfer_olen)
+{
+    if (vp) { }
+    if (buf_idx) { }
+    if (dxfer_olen) { }
+}
+
+void
+set_scsi_pt_data_in_iov(struct sg_pt_base * vp,
+                        const struct sg_pt_iovec * iovp, int iov_cnt)
+{
+    if ((1 == iov_cnt) && iovp)
+        set_scsi_pt_data_in(vp, (uint8_t *)iovp->iov_base,
+                            (int)iovp->iov_len);
+    else if (iov_cnt > 1)
+        ++vp->impl.in_err;        /* only the Linux sg driver takes an iovec */
+}
+
+void
+set_scsi_pt_data_out_iov(struct sg_pt_base * vp,
+                         const struct sg_pt_iovec * iovp, int iov_cnt)
+{
+    if ((1 == iov_cnt) && iovp)
+        set_scsi_pt_data_out(vp, (const uint8_t *)iovp->iov_base,
+                             (int)iovp->iov_len);
+    else if (iov_cnt > 1)
+        ++vp->impl.in_err;
+}
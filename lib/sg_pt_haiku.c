@@ -570,3 +570,120 @@ set_pt_metadata_xfer(struct sg_pt_base * vp, uint8_t * mdxferp,
     if (mdxfer_len) { }
     if (out_true) { }
 }
+
+/* No asynchronous pass-through in this port so these complete the command
+ * synchronously. */
+int
+do_scsi_pt_submit(struct sg_pt_base * vp, int fd, int time_secs, int verbose)
+{
+    return do_scsi_pt(vp, fd, time_secs, verbose);
+}
+
+int
+do_nvm_pt_submit(struct sg_pt_base * vp, int submq, int timeout_secs,
+                 int verbose)
+{
+    return do_nvm_pt(vp, submq, timeout_secs, verbose);
+}
+
+int
+do_scsi_pt_receive(struct sg_pt_base * vp, int fd, int verbose)
+{
+    if (vp) { }
+    if (fd) { }
+    if (verbose) { }
+    return 0;
+}
+
+int
+scsi_pt_wait_for_response(int fd, int timeout_ms, int verbose)
+{
+    if (fd) { }
+    if (timeout_ms) { }
+    if (verbose) { }
+    return 1;
+}
+
+/* Commands in the batch are issued one after the other */
+int
+do_scsi_pt_mrq(struct sg_pt_base * vp_arr[], int num, int fd, int time_secs,
+               int * num_donep, int verbose)
+{
+    return sg_pt_mrq_sequential(vp_arr, num, fd, time_secs, num_donep,
+                                verbose);
+}
+
+/* Registered buffers are not supported by this OS interface */
+int
+sg_pt_reg_bufs(struct sg_pt_base * vp, int num, uint32_t buf_len,
+               uint8_t * bufs[], int verbose)
+{
+    if (vp) { }
+    if (num) { }
+    if (buf_len) { }
+    if (bufs) { }
+    if (verbose) { }
+    return ENOTTY;
+}
+
+void
+sg_pt_unreg_bufs(struct sg_pt_base * vp)
+{
+    if (vp) { }
+}
+
+bool
+sg_pt_reg_bufs_zero_copy(const struct sg_pt_base * vp)
+{
+    if (vp) { }
+    return false;
+}
+
+/* Trace callbacks are not supported by this OS interface */
+bool
+set_pt_trace(struct sg_pt_base * vp, sg_pt_trace_fn fn, void * priv)
+{
+    if (vp) { }
+    if (fn) { }
+    if (priv) { }
+    return false;
+}
+
+void
+set_scsi_pt_data_in_reg(struct sg_pt_base * vp, int buf_idx, int dxfer_ilen)
+{
+    if (vp) { }
+    if (buf_idx) { }
+    if (dxfer_ilen) { }
+}
+
+void
+set_scsi_pt_data_out_reg(struct sg_pt_base * vp, int buf_idx,
+                         int dxfer_olen)
+{
+    if (vp) { }
+    if (buf_idx) { }
+    if (dxfer_olen) { }
+}
+
+void
+set_scsi_pt_data_in_iov(struct sg_pt_base * vp,
+                        const struct sg_pt_iovec * iovp, int iov_cnt)
+{
+    if ((1 == iov_cnt) && iovp)
+        set_scsi_pt_data_in(vp, (uint8_t *)iovp->iov_base,
+                            (int)iovp->iov_len);
+    else if (iov_cnt > 1)
+        ++vp->impl.in_err;        /* only the Linux sg driver takes an iovec */
+}
+
+void
+set_scsi_pt_data_out_iov(struct sg_pt_base * vp,
+                         const struct sg_pt_iovec * iovp, int iov_cnt)
+{
+    if ((1 == iov_cnt) && iovp)
+        set_scsi_pt_data_out(vp, (const uint8_t *)iovp->iov_base,
+                             (int)iovp->iov_len);
+    else if (iov_cnt > 1)
+        ++vp->impl.in_err;
+}
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2005-2023 Douglas Gilbert.
+ * Copyright (c) 2005-2026 Douglas Gilbert.
  * All rights reserved.
  * Use of this source code is governed by a BSD-style
  * license that can be found in the BSD_LICENSE file.
@@ -7,7 +7,7 @@
  * SPDX-License-Identifier: BSD-2-Clause
  */
 
-/* sg_pt_linux version 1.56 20230412 */
+/* sg_pt_linux version 1.63 20261015 */
 
 
 #include <stdio.h>
@@ -19,7 +19,10 @@
 #include <unistd.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <time.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/sysmacros.h>      /* to define 'major' */
 #ifndef major
@@ -37,7 +40,10 @@
 #include "sg_lib.h"
 #include "sg_linux_inc.h"
 #include "sg_pt_linux.h"
+#include "sg_io_linux.h"
+#include "sg_broker.h"
 #include "sg_pr2serr.h"
+#include "sg_sdt.h"
 
 
 #ifdef major
@@ -55,11 +61,19 @@
 
 #define DEF_TIMEOUT 60000       /* 60,000 millisecs (60 seconds) */
 
+#ifndef SG_FLAG_MMAP_IO
+#define SG_FLAG_MMAP_IO 4       /* same value for SGV4_FLAG_MMAP_IO */
+#endif
+
 /* sg driver displayed format: [x]xyyzz --> [x]x.[y]y.zz */
 #define SG_LINUX_SG_VER_V4_BASE 40000   /* lowest sg driver version with
                                          * v4 interface */
 #define SG_LINUX_SG_VER_V4_FULL 40030   /* lowest version with full v4
                                          * interface */
+#define SG_LINUX_SG_VER_V4_MRQ 40045    /* lowest version with usable
+                                         * multiple requests (mrq) */
+#define SG_LINUX_SG_VER_V4_POLLED 40045 /* lowest version with usable
+                                         * SGV4_FLAG_POLLED */
 
 static const char * linux_host_bytes[] = {
     "DID_OK", "DID_NO_CONNECT", "DID_BUS_BUSY", "DID_TIME_OUT",
@@ -123,75 +137,31 @@ bool sg_duration_set_nano = false;
 long sg_lin_page_size = 4096;   /* default, overridden with correct value */
 
 
-/* This function only needs to be called once (unless a NVMe controller
- * can be hot-plugged into system in which case it should be called
- * (again) after that event). */
+/* Kept for applications that use the sg_*_major variables, the library
+ * itself uses sg_linux_get_caps(). This function only needs to be called
+ * once (unless a NVMe controller can be hot-plugged into system in which
+ * case it should be called (again) after that event). */
 void
 sg_find_bsg_nvme_char_major(int verbose)
 {
-    int num_got = 0;
-    int n;
-    char * cp;
-    FILE *fp;
-    char a[128];
-    char b[128];
-    static const int blen = sizeof(b);
-    static const char * proc_devices = "/proc/devices";
-
-    sg_lin_page_size = sysconf(_SC_PAGESIZE);
-    if (NULL == (fp = fopen(proc_devices, "r"))) {
-        if (verbose)
-            pr2ws("fopen %s failed: %s\n", proc_devices, strerror(errno));
-        return;
-    }
-    while ((cp = fgets(b, blen, fp))) {
-        if ((1 == sscanf(b, "%126s", a)) &&
-            (0 == memcmp(a, "Character", 9)))
-            break;
-    }
-    while (cp && (cp = fgets(b, blen, fp))) {
-        if (2 == sscanf(b, "%d %126s", &n, a)) {
-            if (0 == strcmp("bsg", a)) {
-                sg_bsg_major = n;
-                if (++num_got >= 3)
-                    break;
-            } else if (0 == memcmp("nvme", a, 4)) {
-                if (0 == strcmp("nvme-generic", a)) {
-                    sg_nvme_gen_char_major = n;
-                    if (++num_got >= 3)
-                        break;
-                } else if (0 == strcmp("nvme", a)) {
-                    sg_nvme_char_major = n;
-                    if (++num_got >= 3)
-                        break;
-                }
-            }
-        } else
-            break;
-    }
-    if (verbose > 3) {
-        if (cp) {
-            if (sg_bsg_major > 0)
-                pr2ws("found sg_bsg_major=%d\n", sg_bsg_major);
-            if (sg_nvme_char_major > 0)
-                pr2ws("found sg_nvme_char_major=%d\n", sg_nvme_char_major);
-            if (sg_nvme_gen_char_major > 0)
-                pr2ws("found sg_nvme_gen_char_major=%d\n",
-                      sg_nvme_gen_char_major);
-        } else
-            pr2ws("found no bsg nor nvme char device in %s\n", proc_devices);
-    }
-    fclose(fp);
+    const struct sg_linux_caps * capsp;
+
+    sg_linux_caps_reset();      /* so /proc/devices is read again */
+    capsp = sg_linux_get_caps(verbose);
+    sg_lin_page_size = capsp->page_size;
+    sg_bsg_major = capsp->bsg_major;
+    sg_nvme_char_major = capsp->nvme_major;
+    sg_nvme_gen_char_major = capsp->nvme_gen_major;
+    sg_bsg_nvme_char_major_checked = true;
 }
 
-/* Assumes that sg_find_bsg_nvme_char_major() has already been called. Returns
- * true if dev_fd is a scsi generic pass-through device. If yields
+/* Returns true if dev_fd is a scsi generic pass-through device. If yields
  * *is_nvme_p = true with *nsid_p = 0 then dev_fd is a NVMe char device.
  * If yields *nsid_p > 0 then dev_fd is a NVMe block device. */
 static bool
 check_file_type(int dev_fd, struct stat * dev_statp, bool * is_bsg_p,
-                bool * is_nvme_p, uint32_t * nsid_p, int * os_err_p,
-                int verbose)
+                bool * is_nvme_p, bool * is_nvme_gen_p, uint32_t * nsid_p,
+                int * os_err_p, int verbose)
 {
     bool is_nvme = false;
     bool is_nvme_gen = false;
@@ -202,8 +172,20 @@ check_file_type(int dev_fd, struct stat * dev_statp, bool * is_bsg_p,
     int os_err = 0;
     int major_num;
     uint32_t nsid = 0;          /* invalid NSID */
-
-    if (dev_fd >= 0) {
+    const struct sg_broker_info * bip;
+
+    if ((bip = sg_broker_info(dev_fd))) {
+        /* leased from the broker which has already probed it */
+        dev_statp->st_mode = bip->st_mode;
+        dev_statp->st_rdev = bip->st_rdev;
+        is_char = S_ISCHR(dev_statp->st_mode);
+        is_block = S_ISBLK(dev_statp->st_mode);
+        is_sg = !! bip->is_sg;
+        is_bsg = !! bip->is_bsg;
+        is_nvme = bip->is_nvme && (! bip->is_nvme_gen);
+        is_nvme_gen = !! bip->is_nvme_gen;
+        nsid = bip->nvme_nsid;
+    } else if (dev_fd >= 0) {
         if (fstat(dev_fd, dev_statp) < 0) {
             os_err = errno;
             if (verbose)
@@ -217,15 +199,14 @@ check_file_type(int dev_fd, struct stat * dev_statp, bool * is_bsg_p,
             if (SCSI_GENERIC_MAJOR == major_num)
                 is_sg = true;
             else {
-                if (! sg_bsg_nvme_char_major_checked) {
-                    sg_bsg_nvme_char_major_checked = true;
-                    sg_find_bsg_nvme_char_major(verbose);
-                }
-                if (sg_bsg_major == major_num)
+                const struct sg_linux_caps * capsp =
+                                        sg_linux_get_caps(verbose);
+
+                if (capsp->bsg_major == major_num)
                     is_bsg = true;
-                else if (sg_nvme_char_major == major_num)
+                else if (capsp->nvme_major == major_num)
                     is_nvme = true;
-                else if (sg_nvme_gen_char_major == major_num) {
+                else if (capsp->nvme_gen_major == major_num) {
                     is_nvme_gen = true;
                     nsid = ioctl(dev_fd, NVME_IOCTL_ID, NULL);
                     if (SG_NVME_BROADCAST_NSID == nsid) {
@@ -284,6 +265,8 @@ skip_out:
         *is_bsg_p = is_bsg;
     if (is_nvme_p)
         *is_nvme_p = is_nvme | is_nvme_gen;
+    if (is_nvme_gen_p)
+        *is_nvme_gen_p = is_nvme_gen;
     if (nsid_p)
         *nsid_p = nsid;
     if (os_err_p)
@@ -312,8 +295,8 @@ check_pt_file_handle(int dev_fd, const char * device_name, int verbose)
         uint32_t nsid;
         struct stat a_stat;
 
-        is_sg = check_file_type(dev_fd, &a_stat, &is_bsg, &is_nvme, &nsid,
-                                &err, verbose);
+        is_sg = check_file_type(dev_fd, &a_stat, &is_bsg, &is_nvme, NULL,
+                                &nsid, &err, verbose);
         if (err)
             return -err;
         else if (is_sg)
@@ -373,6 +356,9 @@ scsi_pt_open_flags(const char * device_name, int flags, int verbose)
     if (verbose > 1) {
         pr2ws("open %s with flags=0x%x\n", device_name, flags);
     }
+    fd = sg_broker_open(device_name, flags, verbose);
+    if (fd >= 0)
+        return fd;
     fd = open(device_name, flags);
     if (fd < 0) {
         fd = -errno;
@@ -402,6 +388,7 @@ scsi_pt_close_device(int device_fd)
     res = close(device_fd);
     if (res < 0)
         res = -errno;
+    sg_broker_release(device_fd);
     return res;
 }
 
@@ -430,6 +417,7 @@ construct_scsi_pt_obj_with_fd(int dev_fd, int verbose)
         }
         ptp->dev_stat.scsi_dsense = ev_dsense;
 #endif
+        sg_pt_trace_check_env();
         err = set_pt_file_handle((struct sg_pt_base *)ptp, dev_fd, verbose);
         if ((0 == err) && (! ptp->is_nvme)) {
             ptp->io_hdr.guard = 'Q';
@@ -466,6 +454,10 @@ destruct_scsi_pt_obj(struct sg_pt_base * vp)
             ptp->free_nvme_id_ctlp = NULL;
             ptp->nvme_id_ctlp = NULL;
         }
+        if (ptp->rbp)
+            sg_pt_unreg_bufs(vp);
+        if (ptp->free_iov_bouncep)
+            free(ptp->free_iov_bouncep);
         if (vp)
             free(vp);
     }
@@ -478,17 +470,39 @@ clear_scsi_pt_obj(struct sg_pt_base * vp)
     struct sg_pt_linux_scsi * ptp = &vp->impl;
 
     if (ptp) {
-        bool is_sg, is_bsg, is_nvme;
-        int fd;
-        uint32_t nvme_nsid;
+        bool is_sg, is_bsg, is_nvme, is_nvme_gen, is_nonblock;
+        bool force_pack_id, nvm_rw_tmpl_ok;
+        int fd, sg_version;
+        uint32_t nvme_nsid, iov_bounce_sz;
+        uint64_t dev_id;
         struct sg_sntl_dev_state_t dev_stat;
+        struct sg_pt_reg_bufs_t * rbp;
+        struct sg_nvme_passthru_cmd nvm_rw_tmpl;
+        sg_pt_trace_fn trace_fn;
+        void * trace_priv;
+        uint8_t * iov_bouncep;
+        uint8_t * free_iov_bouncep;
 
         fd = ptp->dev_fd;
+        sg_version = ptp->sg_version;
+        dev_id = ptp->dev_id;
         is_sg = ptp->is_sg;
         is_bsg = ptp->is_bsg;
         is_nvme = ptp->is_nvme;
+        is_nvme_gen = ptp->is_nvme_gen;
+        is_nonblock = ptp->is_nonblock;
+        force_pack_id = ptp->force_pack_id;
         nvme_nsid = ptp->nvme_nsid;
         dev_stat = ptp->dev_stat;
+        rbp = ptp->rbp;
+        iov_bounce_sz = ptp->iov_bounce_sz;
+        iov_bouncep = ptp->iov_bouncep;
+        free_iov_bouncep = ptp->free_iov_bouncep;
+        trace_fn = ptp->trace_fn;
+        trace_priv = ptp->trace_priv;
+        nvm_rw_tmpl_ok = ptp->nvm_rw_tmpl_ok;
+        if (nvm_rw_tmpl_ok)
+            nvm_rw_tmpl = ptp->nvm_rw_tmpl;
         if (ptp->free_nvme_id_ctlp)
             free(ptp->free_nvme_id_ctlp);
         memset(ptp, 0, sizeof(struct sg_pt_linux_scsi));
@@ -500,15 +514,41 @@ clear_scsi_pt_obj(struct sg_pt_base * vp)
         ptp->io_hdr.subprotocol = BSG_SUB_PROTOCOL_SCSI_CMD;
 #endif
         ptp->dev_fd = fd;
+        ptp->sg_version = sg_version;
+        ptp->dev_id = dev_id;
         ptp->is_sg = is_sg;
         ptp->is_bsg = is_bsg;
         ptp->is_nvme = is_nvme;
+        ptp->is_nvme_gen = is_nvme_gen;
+        ptp->is_nonblock = is_nonblock;
         ptp->nvme_our_sntl = false;
+        ptp->force_pack_id = force_pack_id;
         ptp->nvme_nsid = nvme_nsid;
         ptp->dev_stat = dev_stat;
+        ptp->rbp = rbp;
+        ptp->iov_bounce_sz = iov_bounce_sz;
+        ptp->iov_bouncep = iov_bouncep;
+        ptp->free_iov_bouncep = free_iov_bouncep;
+        ptp->trace_fn = trace_fn;
+        ptp->trace_priv = trace_priv;
+        ptp->nvm_rw_tmpl_ok = nvm_rw_tmpl_ok;
+        if (nvm_rw_tmpl_ok)
+            ptp->nvm_rw_tmpl = nvm_rw_tmpl;
     }
 }
 
+bool
+set_pt_trace(struct sg_pt_base * vp, sg_pt_trace_fn fn, void * priv)
+{
+    struct sg_pt_linux_scsi * ptp = &vp->impl;
+
+    ptp->trace_fn = fn;
+    ptp->trace_priv = priv;
+    if (fn)     /* sticky, do_scsi_pt() then checks each object */
+        __atomic_or_fetch(&sg_pt_instr, SG_PT_INSTR_OBJ, __ATOMIC_RELEASE);
+    return true;
+}
+
 void
 partial_clear_scsi_pt_obj(struct sg_pt_base * vp)
 {
@@ -524,6 +564,9 @@ partial_clear_scsi_pt_obj(struct sg_pt_base * vp)
         ptp->io_hdr.din_xfer_len = 0;
         ptp->io_hdr.dout_xferp = 0;
         ptp->io_hdr.dout_xfer_len = 0;
+        ptp->io_hdr.din_iovec_count = 0;
+        ptp->io_hdr.dout_iovec_count = 0;
+        ptp->io_hdr.flags &= ~SG_FLAG_MMAP_IO;
         ptp->nvme_result = 0;
     }
 }
@@ -566,14 +609,32 @@ int
 set_pt_file_handle(struct sg_pt_base * vp, int dev_fd, int verbose)
 {
     struct sg_pt_linux_scsi * ptp = &vp->impl;
+    const struct sg_broker_info * bip;
     struct stat a_stat;
 
+    if (ptp->rbp && (dev_fd != ptp->dev_fd))
+        sg_pt_unreg_bufs(vp);   /* registered for the previous device */
     ptp->dev_fd = dev_fd;
+    ptp->force_pack_id = false;
+    ptp->nvm_rw_tmpl_ok = false;
+    ptp->dev_id = 0;
     if (dev_fd >= 0) {
+        memset(&a_stat, 0, sizeof(a_stat));
         ptp->is_sg = check_file_type(dev_fd, &a_stat, &ptp->is_bsg,
-                                     &ptp->is_nvme, &ptp->nvme_nsid,
-                                     &ptp->os_err, verbose);
-        if (ptp->is_sg && (! sg_checked_version_num)) {
+                                     &ptp->is_nvme, &ptp->is_nvme_gen,
+                                     &ptp->nvme_nsid, &ptp->os_err, verbose);
+        ptp->dev_id = (uint64_t)a_stat.st_rdev;
+        if (ptp->is_nvme_gen) {
+            int fl = fcntl(dev_fd, F_GETFL);
+
+            ptp->is_nonblock = (fl >= 0) && (O_NONBLOCK & fl);
+        }
+        if (ptp->is_sg && (! sg_checked_version_num) &&
+            (bip = sg_broker_info(dev_fd)) && (bip->sg_version > 0)) {
+            sg_driver_version_num = bip->sg_version;
+            sg_checked_version_num = true;
+            ptp->sg_version = sg_driver_version_num;
+        } else if (ptp->is_sg && (! sg_checked_version_num)) {
             if (ioctl(dev_fd, SG_GET_VERSION_NUM, &ptp->sg_version) < 0) {
                 ptp->os_err = errno;
                 ptp->sg_version = 0;
@@ -637,6 +698,8 @@ set_pt_file_handle(struct sg_pt_base * vp, int dev_fd, int verbose)
         ptp->is_sg = false;
         ptp->is_bsg = false;
         ptp->is_nvme = false;
+        ptp->is_nvme_gen = false;
+        ptp->is_nonblock = false;
         ptp->nvme_our_sntl = false;
         ptp->nvme_nsid = 0;
         ptp->os_err = 0;
@@ -732,6 +795,297 @@ set_scsi_pt_data_out(struct sg_pt_base * vp, const uint8_t * dxferp,
     }
 }
 
+/* Allocates num buffers of buf_len bytes for the device held in vp. For a
+ * sg device and num of 1 its reserve buffer is sized and mmap-ed instead
+ * (as sgm_dd does). For NVMe generic char devices using the io_uring
+ * engine the buffers are registered with this thread's ring. If that
+ * fails plain page aligned buffers are used. Returns 0 or positive errno. */
+int
+sg_pt_reg_bufs(struct sg_pt_base * vp, int num, uint32_t buf_len,
+               uint8_t * bufs[], int verbose)
+{
+    int k, res;
+    struct sg_pt_linux_scsi * ptp = &vp->impl;
+    struct sg_pt_reg_bufs_t * rbp;
+
+    if ((num < 1) || (num > SCSI_PT_REG_BUFS_MAX) || (0 == buf_len) ||
+        (buf_len > INT32_MAX) || (NULL == bufs))
+        return EINVAL;
+    if (ptp->dev_fd < 0) {
+        if (verbose)
+            pr2ws("%s: no device file descriptor given\n", __func__);
+        return EBADF;
+    }
+    sg_pt_unreg_bufs(vp);
+    rbp = (struct sg_pt_reg_bufs_t *)calloc(1, sizeof(*rbp));
+    if (NULL == rbp)
+        return ENOMEM;
+    rbp->num = num;
+    rbp->buf_len = buf_len;
+    if (ptp->is_sg && (1 == num)) {
+        int res_sz = (int)buf_len;
+        void * p;
+
+        if ((ioctl(ptp->dev_fd, SG_SET_RESERVED_SIZE, &res_sz) < 0) ||
+            (ioctl(ptp->dev_fd, SG_GET_RESERVED_SIZE, &res_sz) < 0)) {
+            if (verbose > 2)
+                pr2ws("%s: SG_SET_RESERVED_SIZE failed: %s\n", __func__,
+                      safe_strerror(errno));
+        } else if ((uint32_t)res_sz < buf_len) {
+            if (verbose > 2)
+                pr2ws("%s: reserve buffer only %d bytes, wanted %u\n",
+                      __func__, res_sz, buf_len);
+        } else {
+            p = mmap(NULL, buf_len, PROT_READ | PROT_WRITE, MAP_SHARED,
+                     ptp->dev_fd, 0);
+            if (MAP_FAILED != p) {
+                rbp->kind = SG_PT_RB_SG_MMAP;
+                rbp->bufs[0] = (uint8_t *)p;
+                goto fini;
+            }
+            if (verbose > 2)
+                pr2ws("%s: mmap() of reserve buffer failed: %s\n",
+                      __func__, safe_strerror(errno));
+        }
+    }
+    rbp->kind = SG_PT_RB_PLAIN;
+    for (k = 0; k < num; ++k) {
+        rbp->bufs[k] = sg_memalign(buf_len, 0, &rbp->free_bufs[k],
+                                   verbose > 3);
+        if (NULL == rbp->bufs[k]) {
+            while (--k >= 0)
+                free(rbp->free_bufs[k]);
+            free(rbp);
+            return ENOMEM;
+        }
+    }
+    if (sg_uring_usable(ptp)) {
+        res = sg_uring_reg_bufs(rbp, verbose);
+        if (0 == res)
+            rbp->kind = SG_PT_RB_URING;
+        else if (verbose > 2)
+            pr2ws("%s: io_uring fixed buffers unavailable (%s), using "
+                  "plain buffers\n", __func__, safe_strerror(-res));
+    }
+fini:
+    ptp->rbp = rbp;
+    for (k = 0; k < num; ++k)
+        bufs[k] = rbp->bufs[k];
+    if (verbose > 3)
+        pr2ws("%s: %d buffer%s of %u bytes, kind=%d\n", __func__, num,
+              (num > 1 ? "s" : ""), buf_len, rbp->kind);
+    return 0;
+}
+
+void
+sg_pt_unreg_bufs(struct sg_pt_base * vp)
+{
+    int k;
+    struct sg_pt_linux_scsi * ptp = &vp->impl;
+    struct sg_pt_reg_bufs_t * rbp = ptp->rbp;
+
+    if (NULL == rbp)
+        return;
+    if (SG_PT_RB_SG_MMAP == rbp->kind)
+        munmap(rbp->bufs[0], rbp->buf_len);
+    else {
+        if (SG_PT_RB_URING == rbp->kind)
+            sg_uring_unreg_bufs(rbp);
+        for (k = 0; k < rbp->num; ++k) {
+            if (rbp->free_bufs[k])
+                free(rbp->free_bufs[k]);
+        }
+    }
+    free(rbp);
+    ptp->rbp = NULL;
+}
+
+bool
+sg_pt_reg_bufs_zero_copy(const struct sg_pt_base * vp)
+{
+    const struct sg_pt_reg_bufs_t * rbp = vp->impl.rbp;
+
+    return rbp && (SG_PT_RB_PLAIN != rbp->kind);
+}
+
+/* Checks buf_idx and dxfer_len against the registered buffers of ptp,
+ * returns the buffer or NULL (after bumping in_err). */
+static uint8_t *
+reg_buf_check(struct sg_pt_linux_scsi * ptp, int buf_idx, int dxfer_len)
+{
+    const struct sg_pt_reg_bufs_t * rbp = ptp->rbp;
+
+    if ((NULL == rbp) || (buf_idx < 0) || (buf_idx >= rbp->num) ||
+        (dxfer_len > (int)rbp->buf_len)) {
+        ++ptp->in_err;
+        return NULL;
+    }
+    if (SG_PT_RB_SG_MMAP == rbp->kind)
+        ptp->io_hdr.flags |= SG_FLAG_MMAP_IO;
+    return rbp->bufs[buf_idx];
+}
+
+void
+set_scsi_pt_data_in_reg(struct sg_pt_base * vp, int buf_idx, int dxfer_ilen)
+{
+    uint8_t * bp = reg_buf_check(&vp->impl, buf_idx, dxfer_ilen);
+
+    if (bp)
+        set_scsi_pt_data_in(vp, bp, dxfer_ilen);
+}
+
+void
+set_scsi_pt_data_out_reg(struct sg_pt_base * vp, int buf_idx,
+                         int dxfer_olen)
+{
+    uint8_t * bp = reg_buf_check(&vp->impl, buf_idx, dxfer_olen);
+
+    if (bp)
+        set_scsi_pt_data_out(vp, bp, dxfer_olen);
+}
+
+/* Returns the sum of the lengths in the iov_cnt elements of iovp, or -1
+ * if iov_cnt is out of range or the sum is too large for one command. */
+static int
+iov_total_len(const struct sg_pt_iovec * iovp, int iov_cnt)
+{
+    int k;
+    uint64_t tot = 0;
+
+    if ((NULL == iovp) || (iov_cnt < 1) || (iov_cnt > SCSI_PT_IOV_MAX))
+        return -1;
+    for (k = 0; k < iov_cnt; ++k)
+        tot += iovp[k].iov_len;
+    return (tot > INT32_MAX) ? -1 : (int)tot;
+}
+
+void
+set_scsi_pt_data_in_iov(struct sg_pt_base * vp,
+                        const struct sg_pt_iovec * iovp, int iov_cnt)
+{
+    int len;
+    struct sg_pt_linux_scsi * ptp = &vp->impl;
+
+    if ((1 == iov_cnt) && iovp) {
+        set_scsi_pt_data_in(vp, (uint8_t *)iovp->iov_base,
+                            (int)iovp->iov_len);
+        return;
+    }
+    len = iov_total_len(iovp, iov_cnt);
+    if ((len < 0) || ptp->io_hdr.din_xferp) {
+        ++ptp->in_err;
+        return;
+    }
+    if (len > 0) {
+        ptp->io_hdr.din_xferp = (__u64)(sg_uintptr_t)iovp;
+        ptp->io_hdr.din_xfer_len = len;
+        ptp->io_hdr.din_iovec_count = iov_cnt;
+    }
+}
+
+void
+set_scsi_pt_data_out_iov(struct sg_pt_base * vp,
+                         const struct sg_pt_iovec * iovp, int iov_cnt)
+{
+    int len;
+    struct sg_pt_linux_scsi * ptp = &vp->impl;
+
+    if ((1 == iov_cnt) && iovp) {
+        set_scsi_pt_data_out(vp, (const uint8_t *)iovp->iov_base,
+                             (int)iovp->iov_len);
+        return;
+    }
+    len = iov_total_len(iovp, iov_cnt);
+    if ((len < 0) || ptp->io_hdr.dout_xferp) {
+        ++ptp->in_err;
+        return;
+    }
+    if (len > 0) {
+        ptp->io_hdr.dout_xferp = (__u64)(sg_uintptr_t)iovp;
+        ptp->io_hdr.dout_xfer_len = len;
+        ptp->io_hdr.dout_iovec_count = iov_cnt;
+    }
+}
+
+int
+sg_pt_iov_bounce_start(struct sg_pt_linux_scsi * ptp, int vb)
+{
+    bool din = (ptp->io_hdr.din_iovec_count > 0);
+    uint32_t k, len;
+    const struct sg_pt_iovec * iovp;
+    uint8_t * bp;
+
+    if (din && (ptp->io_hdr.dout_iovec_count > 0)) {
+        if (vb)
+            pr2ws("%s: bidi iovec transfers need the sg driver\n",
+                  __func__);
+        return SCSI_PT_DO_BAD_PARAMS;
+    }
+    len = din ? ptp->io_hdr.din_xfer_len : ptp->io_hdr.dout_xfer_len;
+    if (len > ptp->iov_bounce_sz) {
+        if (ptp->free_iov_bouncep)
+            free(ptp->free_iov_bouncep);
+        ptp->free_iov_bouncep = NULL;
+        ptp->iov_bounce_sz = 0;
+        ptp->iov_bouncep = sg_memalign(len, 0, &ptp->free_iov_bouncep,
+                                       false);
+        if (NULL == ptp->iov_bouncep) {
+            ptp->os_err = ENOMEM;
+            return -ENOMEM;
+        }
+        ptp->iov_bounce_sz = len;
+    }
+    bp = ptp->iov_bouncep;
+    if (din) {
+        ptp->iov_xferp = ptp->io_hdr.din_xferp;
+        ptp->iov_cnt = ptp->io_hdr.din_iovec_count;
+        ptp->io_hdr.din_xferp = (__u64)(sg_uintptr_t)bp;
+        ptp->io_hdr.din_iovec_count = 0;
+    } else {
+        ptp->iov_xferp = ptp->io_hdr.dout_xferp;
+        ptp->iov_cnt = ptp->io_hdr.dout_iovec_count;
+        iovp = (const struct sg_pt_iovec *)(sg_uintptr_t)ptp->iov_xferp;
+        for (k = 0; k < ptp->iov_cnt; bp += iovp[k].iov_len, ++k)
+            memcpy(bp, iovp[k].iov_base, iovp[k].iov_len);
+        ptp->io_hdr.dout_xferp = (__u64)(sg_uintptr_t)ptp->iov_bouncep;
+        ptp->io_hdr.dout_iovec_count = 0;
+    }
+    ptp->iov_din = din;
+    ptp->iov_bounced = true;
+    return 0;
+}
+
+void
+sg_pt_iov_bounce_end(struct sg_pt_linux_scsi * ptp)
+{
+    int n;
+    uint32_t k, len;
+    const struct sg_pt_iovec * iovp;
+    const uint8_t * bp = ptp->iov_bouncep;
+
+    if (! ptp->iov_bounced)
+        return;
+    ptp->iov_bounced = false;
+    iovp = (const struct sg_pt_iovec *)(sg_uintptr_t)ptp->iov_xferp;
+    if (! ptp->iov_din) {
+        ptp->io_hdr.dout_xferp = ptp->iov_xferp;
+        ptp->io_hdr.dout_iovec_count = ptp->iov_cnt;
+        return;
+    }
+    n = (int)ptp->io_hdr.din_xfer_len - ptp->io_hdr.din_resid;
+    if (n > (int)ptp->io_hdr.din_xfer_len)
+        n = ptp->io_hdr.din_xfer_len;
+    for (k = 0; (k < ptp->iov_cnt) && (n > 0); ++k) {
+        len = ((int)iovp[k].iov_len < n) ? (uint32_t)iovp[k].iov_len :
+                                           (uint32_t)n;
+        memcpy(iovp[k].iov_base, bp, len);
+        bp += len;
+        n -= len;
+    }
+    ptp->io_hdr.din_xferp = ptp->iov_xferp;
+    ptp->io_hdr.din_iovec_count = ptp->iov_cnt;
+}
+
 void
 set_pt_metadata_xfer(struct sg_pt_base * vp, uint8_t * dxferp,
                      uint32_t dxfer_len, bool out_true)
@@ -811,6 +1165,7 @@ set_scsi_pt_flags(struct sg_pt_base * vp, int flags)
         ptp->io_hdr.flags |= BSG_FLAG_Q_AT_TAIL;
         ptp->io_hdr.flags &= ~BSG_FLAG_Q_AT_HEAD;
     }
+    ptp->polled = !! (SCSI_PT_FLAGS_POLLED & flags);
 }
 
 /* If supported it is the number of bytes requested to transfer less the
@@ -1056,50 +1411,81 @@ get_pt_nvme_nsid(const struct sg_pt_base * vp)
     return ptp->nvme_nsid;
 }
 
-/* Executes SCSI command using sg v3 interface */
+/* Builds a sg v3 header from the v4 header held in ptp. Returns 0 if okay,
+ * else SCSI_PT_DO_BAD_PARAMS. */
 static int
-do_scsi_pt_v3(struct sg_pt_linux_scsi * ptp, int fd, int time_secs,
-              int verbose)
+build_v3_hdr(const struct sg_pt_linux_scsi * ptp, int time_secs,
+             struct sg_io_hdr * v3_hdrp, int verbose)
 {
-    struct sg_io_hdr v3_hdr;
-
-    memset(&v3_hdr, 0, sizeof(v3_hdr));
+    memset(v3_hdrp, 0, sizeof(*v3_hdrp));
     /* convert v4 to v3 header */
-    v3_hdr.interface_id = 'S';
-    v3_hdr.dxfer_direction = SG_DXFER_NONE;
-    v3_hdr.cmdp = (uint8_t *)(sg_uintptr_t)ptp->io_hdr.request;
-    v3_hdr.cmd_len = (uint8_t)ptp->io_hdr.request_len;
+    v3_hdrp->interface_id = 'S';
+    v3_hdrp->dxfer_direction = SG_DXFER_NONE;
+    v3_hdrp->cmdp = (uint8_t *)(sg_uintptr_t)ptp->io_hdr.request;
+    v3_hdrp->cmd_len = (uint8_t)ptp->io_hdr.request_len;
     if (ptp->io_hdr.din_xfer_len > 0) {
         if (ptp->io_hdr.dout_xfer_len > 0) {
             if (verbose)
                 pr2ws("sgv3 doesn't support bidi\n");
             return SCSI_PT_DO_BAD_PARAMS;
         }
-        v3_hdr.dxferp = (void *)(long)ptp->io_hdr.din_xferp;
-        v3_hdr.dxfer_len = (unsigned int)ptp->io_hdr.din_xfer_len;
-        v3_hdr.dxfer_direction =  SG_DXFER_FROM_DEV;
+        v3_hdrp->dxferp = (void *)(long)ptp->io_hdr.din_xferp;
+        v3_hdrp->dxfer_len = (unsigned int)ptp->io_hdr.din_xfer_len;
+        v3_hdrp->iovec_count = (unsigned short)ptp->io_hdr.din_iovec_count;
+        v3_hdrp->dxfer_direction =  SG_DXFER_FROM_DEV;
     } else if (ptp->io_hdr.dout_xfer_len > 0) {
-        v3_hdr.dxferp = (void *)(long)ptp->io_hdr.dout_xferp;
-        v3_hdr.dxfer_len = (unsigned int)ptp->io_hdr.dout_xfer_len;
-        v3_hdr.dxfer_direction =  SG_DXFER_TO_DEV;
+        v3_hdrp->dxferp = (void *)(long)ptp->io_hdr.dout_xferp;
+        v3_hdrp->dxfer_len = (unsigned int)ptp->io_hdr.dout_xfer_len;
+        v3_hdrp->iovec_count = (unsigned short)ptp->io_hdr.dout_iovec_count;
+        v3_hdrp->dxfer_direction =  SG_DXFER_TO_DEV;
     }
     if (ptp->io_hdr.response && (ptp->io_hdr.max_response_len > 0)) {
-        v3_hdr.sbp = (uint8_t *)(sg_uintptr_t)ptp->io_hdr.response;
-        v3_hdr.mx_sb_len = (uint8_t)ptp->io_hdr.max_response_len;
+        v3_hdrp->sbp = (uint8_t *)(sg_uintptr_t)ptp->io_hdr.response;
+        v3_hdrp->mx_sb_len = (uint8_t)ptp->io_hdr.max_response_len;
     }
-    v3_hdr.pack_id = (int)ptp->io_hdr.request_extra;
+    v3_hdrp->pack_id = (int)ptp->io_hdr.request_extra;
     if (BSG_FLAG_Q_AT_HEAD & ptp->io_hdr.flags)
-        v3_hdr.flags |= SG_FLAG_Q_AT_HEAD;      /* favour AT_HEAD */
+        v3_hdrp->flags |= SG_FLAG_Q_AT_HEAD;      /* favour AT_HEAD */
     else if (BSG_FLAG_Q_AT_TAIL & ptp->io_hdr.flags)
-        v3_hdr.flags |= SG_FLAG_Q_AT_TAIL;
+        v3_hdrp->flags |= SG_FLAG_Q_AT_TAIL;
+    if (SG_FLAG_MMAP_IO & ptp->io_hdr.flags)
+        v3_hdrp->flags |= SG_FLAG_MMAP_IO;      /* reserve buffer mmap-ed */
 
-    if (NULL == v3_hdr.cmdp) {
+    if (NULL == v3_hdrp->cmdp) {
         if (verbose)
             pr2ws("No SCSI command (cdb) given [v3]\n");
         return SCSI_PT_DO_BAD_PARAMS;
     }
     /* io_hdr.timeout is in milliseconds, if greater than zero */
-    v3_hdr.timeout = ((time_secs > 0) ? (time_secs * 1000) : DEF_TIMEOUT);
+    v3_hdrp->timeout = ((time_secs > 0) ? (time_secs * 1000) : DEF_TIMEOUT);
+    return 0;
+}
+
+/* Transfers the output fields of a completed sg v3 command back into the
+ * v4 header held in ptp. */
+static void
+v3_hdr_to_v4(struct sg_pt_linux_scsi * ptp, const struct sg_io_hdr * v3_hdrp)
+{
+    ptp->io_hdr.device_status = (__u32)v3_hdrp->status;
+    ptp->io_hdr.driver_status = (__u32)v3_hdrp->driver_status;
+    ptp->io_hdr.transport_status = (__u32)v3_hdrp->host_status;
+    ptp->io_hdr.response_len = (__u32)v3_hdrp->sb_len_wr;
+    ptp->io_hdr.duration = (__u32)v3_hdrp->duration;
+    ptp->io_hdr.din_resid = (__s32)v3_hdrp->resid;
+    /* v3_hdr.info not passed back since no mapping defined (yet) */
+}
+
+/* Executes SCSI command using sg v3 interface */
+static int
+do_scsi_pt_v3(struct sg_pt_linux_scsi * ptp, int fd, int time_secs,
+              int verbose)
+{
+    int res;
+    struct sg_io_hdr v3_hdr;
+
+    res = build_v3_hdr(ptp, time_secs, &v3_hdr, verbose);
+    if (res)
+        return res;
     /* Finally do the v3 SG_IO ioctl */
     if (ioctl(fd, SG_IO, &v3_hdr) < 0) {
         ptp->os_err = errno;
@@ -1108,13 +1494,7 @@ do_scsi_pt_v3(struct sg_pt_linux_scsi * ptp, int fd, int time_secs,
                   safe_strerror(ptp->os_err), ptp->os_err);
         return -ptp->os_err;
     }
-    ptp->io_hdr.device_status = (__u32)v3_hdr.status;
-    ptp->io_hdr.driver_status = (__u32)v3_hdr.driver_status;
-    ptp->io_hdr.transport_status = (__u32)v3_hdr.host_status;
-    ptp->io_hdr.response_len = (__u32)v3_hdr.sb_len_wr;
-    ptp->io_hdr.duration = (__u32)v3_hdr.duration;
-    ptp->io_hdr.din_resid = (__s32)v3_hdr.resid;
-    /* v3_hdr.info not passed back since no mapping defined (yet) */
+    v3_hdr_to_v4(ptp, &v3_hdr);
     return 0;
 }
 
@@ -1140,11 +1520,26 @@ do_scsi_pt_v4(struct sg_pt_linux_scsi * ptp, int fd, int time_secs,
     return 0;
 }
 
-/* Executes SCSI command (or at least forwards it to lower layers).
- * Returns 0 for success, negative numbers are negated 'errno' values from
- * OS system calls. Positive return values are errors from this package. */
-int
-do_scsi_pt(struct sg_pt_base * vp, int fd, int time_secs, int verbose)
+/* A time_secs of 0 (or less) asks for the default timeout. Use the one the
+ * device reported in RSOC for this command, if recorded; may_fetch allows
+ * it to be fetched now when SG3_UTILS_RSOC_TMO is set. */
+static int
+def_time_secs(const struct sg_pt_linux_scsi * ptp, bool may_fetch)
+{
+    if (ptp->is_nvme)
+        return 0;
+    return sg_pt_tmo_for_cmd(ptp->dev_id, may_fetch ? ptp->dev_fd : -1,
+                             (const uint8_t *)(sg_uintptr_t)
+                                        ptp->io_hdr.request,
+                             ptp->io_hdr.request_len);
+}
+
+/* Checks the state of *vp and reconciles the given 'fd' with the one (if
+ * any) already held in *vp. Returns 0 when *vp is ready to issue a command,
+ * otherwise the value that do_scsi_pt() should return. */
+static int
+pt_check_obj_and_fd(struct sg_pt_base * vp, int fd, const char * caller,
+                    int verbose)
 {
     struct sg_pt_linux_scsi * ptp = &vp->impl;
     bool have_checked_for_type = (ptp->dev_fd >= 0);
@@ -1158,16 +1553,15 @@ do_scsi_pt(struct sg_pt_base * vp, int fd, int time_secs, int verbose)
         if ((ptp->dev_fd >= 0) && (fd != ptp->dev_fd)) {
             if (verbose)
                 pr2ws("%s: file descriptor given to create() and here "
-                      "differ\n", __func__);
+                      "differ\n", caller);
             return SCSI_PT_DO_BAD_PARAMS;
         }
         ptp->dev_fd = fd;
     } else if (ptp->dev_fd < 0) {
         if (verbose)
-            pr2ws("%s: invalid file descriptors\n", __func__);
+            pr2ws("%s: invalid file descriptors\n", caller);
         return SCSI_PT_DO_BAD_PARAMS;
-    } else
-        fd = ptp->dev_fd;
+    }
     if (! have_checked_for_type) {
         int err = set_pt_file_handle(vp, ptp->dev_fd, verbose);
 
@@ -1176,16 +1570,194 @@ do_scsi_pt(struct sg_pt_base * vp, int fd, int time_secs, int verbose)
     }
     if (ptp->os_err)
         return -ptp->os_err;
+    return 0;
+}
+
+#ifndef SG_IOCTL_MAGIC_NUM
+#define SG_IOCTL_MAGIC_NUM 0x22
+#endif
+#ifndef SG_IOSUBMIT
+#define SG_IOSUBMIT _IOWR(SG_IOCTL_MAGIC_NUM, 0x41, struct sg_io_v4)
+#endif
+#ifndef SG_IORECEIVE
+#define SG_IORECEIVE _IOWR(SG_IOCTL_MAGIC_NUM, 0x42, struct sg_io_v4)
+#endif
+#ifndef SGV4_FLAG_MULTIPLE_REQS
+#define SGV4_FLAG_MULTIPLE_REQS 0x40000 /* 1 or more sg_io_v4-s in data-in */
+#endif
+
+#define SG_PT_MRQ_STACK_NUM 16  /* mrq batches up to this size on stack */
+#ifndef SGV4_FLAG_IMMED
+#define SGV4_FLAG_IMMED 0x400
+#endif
+#ifndef SGV4_FLAG_POLLED
+#define SGV4_FLAG_POLLED 0x800  /* use blk_poll() rather than interrupt */
+#endif
+#ifndef SG_SEIM_BLK_POLL
+#define SG_SEIM_BLK_POLL 0x100  /* call blk_poll, uses 'num' field */
+#endif
+
+#define SG_PT_POLL_SPINS 256    /* blk_poll attempts before sleeping */
+
+/* Same size and layout as the sg v4 driver's struct sg_extended_info,
+ * which may not be in the system's headers, only 'num' is added here */
+struct sg_pt_sei_blk_poll {
+    uint32_t sei_wr_mask;
+    uint32_t sei_rd_mask;
+    uint32_t others[9];
+    int32_t num;        /* blk_poll: in: loop count, out: number found */
+    uint8_t pad_to_96[48];
+};
+
+#define SG_SET_GET_EXTENDED_BLK_POLL _IOWR(SG_IOCTL_MAGIC_NUM, 0x51, \
+                                           struct sg_pt_sei_blk_poll)
+
+/* So read(2) or ioctl(SG_IORECEIVE) fetches the response matching the
+ * pack_id of the given object rather than the oldest waiting response on
+ * that file descriptor. Only needs to be done once per file descriptor. */
+static int
+set_force_pack_id(struct sg_pt_linux_scsi * ptp, int verbose)
+{
+    int one = 1;
+
+    if (ptp->force_pack_id)
+        return 0;
+    if (ioctl(ptp->dev_fd, SG_SET_FORCE_PACK_ID, &one) < 0) {
+        ptp->os_err = errno;
+        if (verbose > 1)
+            pr2ws("ioctl(SG_SET_FORCE_PACK_ID) failed: %s (errno=%d)\n",
+                  safe_strerror(ptp->os_err), ptp->os_err);
+        return -ptp->os_err;
+    }
+    ptp->force_pack_id = true;
+    return 0;
+}
+
+/* Asks the sg driver to poll for completions on dev_fd, up to 'num' of
+ * them (0 for as many as are found). Returns the number found (may be 0)
+ * or a negated errno. */
+static int
+sg_blk_poll(int dev_fd, int num)
+{
+    struct sg_pt_sei_blk_poll sei;
+
+    memset(&sei, 0, sizeof(sei));
+    sei.sei_rd_mask = SG_SEIM_BLK_POLL;
+    sei.sei_wr_mask = SG_SEIM_BLK_POLL;
+    sei.num = num;
+    if (ioctl(dev_fd, SG_SET_GET_EXTENDED_BLK_POLL, &sei) < 0)
+        return -errno;
+    return (sei.num < 0) ? 0 : sei.num;
+}
+
+/* Executes SCSI command with sg v4 interface using polled completion.
+ * Spins on blk_poll() for a while, after that sleeps in poll(2) for up to
+ * a millisecond at a time (still calling blk_poll() in case there is no
+ * completion interrupt). If the driver rejects the SGV4_FLAG_POLLED flag
+ * then falls back to do_scsi_pt_v4(). */
+static int
+do_scsi_pt_v4_polled(struct sg_pt_linux_scsi * ptp, int fd, int time_secs,
+                     int verbose)
+{
+    int k, n, err, res;
+    uint32_t flags;
+    struct pollfd a_poll;
+
+    if (0 == ptp->io_hdr.request) {
+        if (verbose)
+            pr2ws("No SCSI command (cdb) given [v4]\n");
+        return SCSI_PT_DO_BAD_PARAMS;
+    }
+    res = set_force_pack_id(ptp, verbose);
+    if (res)
+        return res;
+    ptp->io_hdr.timeout = ((time_secs > 0) ? (time_secs * 1000) : DEF_TIMEOUT);
+    flags = ptp->io_hdr.flags;
+    ptp->io_hdr.flags = flags | SGV4_FLAG_POLLED;
+    if (ioctl(fd, SG_IOSUBMIT, &ptp->io_hdr) < 0) {
+        err = errno;
+        ptp->io_hdr.flags = flags;
+        if ((EINVAL == err) || (EOPNOTSUPP == err)) {
+            if (verbose > 2)
+                pr2ws("%s: polled submit rejected, use interrupt "
+                      "completion\n", __func__);
+            ptp->polled = false;
+            return do_scsi_pt_v4(ptp, fd, time_secs, verbose);
+        }
+        ptp->os_err = err;
+        if (verbose > 1)
+            pr2ws("ioctl(SG_IOSUBMIT, polled) failed: %s (errno=%d)\n",
+                  safe_strerror(err), err);
+        return -err;
+    }
+    a_poll.fd = fd;
+    a_poll.events = POLLIN;
+    for (k = 0; ; ++k) {
+        n = sg_blk_poll(fd, 1);
+        if ((0 == n) && (k >= SG_PT_POLL_SPINS)) {
+            a_poll.revents = 0;
+            n = poll(&a_poll, 1, 1 /* millisecond */);
+        }
+        if (n < 0) {
+            err = -n;
+            if (EINTR != err) {
+                if (verbose > 2)
+                    pr2ws("%s: blk_poll: %s\n", __func__, safe_strerror(err));
+                /* blk_poll() unavailable, stop spinning */
+                k = SG_PT_POLL_SPINS;
+            }
+            continue;
+        }
+        if ((0 == n) && (k < SG_PT_POLL_SPINS))
+            continue;
+        /* SGV4_FLAG_IMMED makes SG_IORECEIVE non-blocking */
+        ptp->io_hdr.flags = flags | SGV4_FLAG_IMMED;
+        res = ioctl(fd, SG_IORECEIVE, &ptp->io_hdr);
+        err = errno;
+        ptp->io_hdr.flags = flags;
+        if (res >= 0)
+            break;
+        if ((EAGAIN != err) && (EINTR != err)) {
+            ptp->os_err = err;
+            if (verbose > 1)
+                pr2ws("ioctl(SG_IORECEIVE, polled) failed: %s (errno=%d)\n",
+                      safe_strerror(err), err);
+            return -err;
+        }
+    }
+    return 0;
+}
+
+/* Chooses the pass-through mechanism for the device type of *vp */
+static int
+do_scsi_pt_low(struct sg_pt_base * vp, int time_secs, int verbose)
+{
+    struct sg_pt_linux_scsi * ptp = &vp->impl;
+    int fd = ptp->dev_fd;
+
     if (verbose > 5)
         pr2ws("%s:  is_nvme=%d, is_sg=%d, is_bsg=%d\n", __func__,
               (int)ptp->is_nvme, (int)ptp->is_sg, (int)ptp->is_bsg);
+    if ((ptp->io_hdr.din_iovec_count || ptp->io_hdr.dout_iovec_count) &&
+        (ptp->is_nvme ||
+         ((! ptp->is_sg) && (sg_bsg_major > 0) && ptp->is_bsg))) {
+        int res = sg_pt_iov_bounce_start(ptp, verbose);
+
+        if (res)
+            return res;
+        res = do_scsi_pt_low(vp, time_secs, verbose);
+        sg_pt_iov_bounce_end(ptp);
+        return res;
+    }
     if (ptp->is_nvme)
         return sg_do_nvme_pt(vp, -1, time_secs, verbose);
     else if (ptp->is_sg) {
 #ifdef IGNORE_LINUX_SGV4
         return do_scsi_pt_v3(ptp, fd, time_secs, verbose);
 #else
-        if (ptp->sg_version >= SG_LINUX_SG_VER_V4_BASE)
+        if (ptp->polled && (ptp->sg_version >= SG_LINUX_SG_VER_V4_POLLED))
+            return do_scsi_pt_v4_polled(ptp, fd, time_secs, verbose);
+        else if (ptp->sg_version >= SG_LINUX_SG_VER_V4_BASE)
             return do_scsi_pt_v4(ptp, fd, time_secs, verbose);
         else
             return do_scsi_pt_v3(ptp, fd, time_secs, verbose);
@@ -1200,3 +1772,366 @@ do_scsi_pt(struct sg_pt_base * vp, int fd, int time_secs, int verbose)
     pr2ws("%s: Should never reach this point\n", __func__);
     return 0;
 }
+
+uint64_t
+sg_pt_linux_now_ns(void)
+{
+    return sg_get_mono_ns();
+}
+
+/* Completes the trace record started before the command was sent, then
+ * hands it to the trace callback. */
+void
+sg_pt_linux_trace_done(const struct sg_pt_linux_scsi * ptp,
+                       sg_pt_trace_fn fn, void * priv,
+                       struct sg_pt_trace_rec * trp, int res,
+                       uint64_t now_ns)
+{
+    struct sg_scsi_sense_hdr ssh;
+
+    trp->event = SG_PT_TRACE_COMPLETE;
+    trp->duration_ns = now_ns - trp->ts_ns;
+    trp->ts_ns = now_ns;
+    trp->result = res;
+    if (SG_PT_LAT_SCSI == trp->cmd_set) {
+        trp->status = ptp->io_hdr.device_status;
+        trp->resid = ((ptp->io_hdr.dout_xfer_len > 0) &&
+                      (0 == ptp->io_hdr.din_xfer_len)) ?
+                     ptp->io_hdr.dout_resid : ptp->io_hdr.din_resid;
+        if ((ptp->io_hdr.response_len > 0) &&
+            sg_scsi_normalize_sense((const uint8_t *)(sg_uintptr_t)
+                                    ptp->io_hdr.response,
+                                    ptp->io_hdr.response_len, &ssh)) {
+            trp->sense_key = ssh.sense_key;
+            trp->asc = ssh.asc;
+            trp->ascq = ssh.ascq;
+        }
+    } else
+        trp->status = ptp->nvme_status;
+    fn(trp, priv);
+}
+
+/* Slow path of do_scsi_pt() when latency histograms and/or a trace
+ * callback are active. */
+static int
+do_scsi_pt_instr(struct sg_pt_base * vp, int instr, int time_secs,
+                 int verbose)
+{
+    struct sg_pt_linux_scsi * ptp = &vp->impl;
+    int res, cmd_set, cdb_len;
+    uint64_t t_start;
+    const uint8_t * cdbp;
+    void * priv = ptp->trace_priv;
+    sg_pt_trace_fn fn = ptp->trace_fn;
+    struct sg_pt_trace_rec rec;
+
+    if ((NULL == fn) && (SG_PT_INSTR_TRACE & instr))
+        fn = sg_pt_trace_get(&priv);
+    if ((NULL == fn) && (! (SG_PT_INSTR_LAT & instr)))
+        return do_scsi_pt_low(vp, time_secs, verbose);
+    cdbp = (const uint8_t *)(sg_uintptr_t)ptp->io_hdr.request;
+    cdb_len = cdbp ? (int)ptp->io_hdr.request_len : 0;
+    cmd_set = (ptp->is_nvme && (cdb_len > 0) &&
+               (! sg_is_scsi_cdb(cdbp, cdb_len))) ?
+              SG_PT_LAT_NVME_ADMIN : SG_PT_LAT_SCSI;
+    t_start = sg_pt_linux_now_ns();
+    if (fn) {
+        memset(&rec, 0, sizeof(rec));
+        sg_pt_trace_start(&rec, t_start);
+        rec.dev_id = ptp->dev_id;
+        rec.cmd_set = (uint8_t)cmd_set;
+        rec.cmd_len = (cdb_len > SG_PT_TRACE_CMD_MAX) ? SG_PT_TRACE_CMD_MAX :
+                                                        cdb_len;
+        if (rec.cmd_len > 0)
+            memcpy(rec.cmd, cdbp, rec.cmd_len);
+        rec.din_len = ptp->io_hdr.din_xfer_len;
+        rec.dout_len = ptp->io_hdr.dout_xfer_len;
+        fn(&rec, priv);
+    }
+    res = do_scsi_pt_low(vp, time_secs, verbose);
+    if (fn)
+        sg_pt_linux_trace_done(ptp, fn, priv, &rec, res,
+                               sg_pt_linux_now_ns());
+    if ((SG_PT_INSTR_LAT & instr) && (cdb_len > 0))
+        sg_pt_lat_record(ptp->dev_id, cdbp[0], cmd_set,
+                         (fn ? rec.ts_ns : sg_pt_linux_now_ns()) - t_start);
+    return res;
+}
+
+/* Executes SCSI command (or at least forwards it to lower layers).
+ * Returns 0 for success, negative numbers are negated 'errno' values from
+ * OS system calls. Positive return values are errors from this package. */
+int
+do_scsi_pt(struct sg_pt_base * vp, int fd, int time_secs, int verbose)
+{
+    int res, instr;
+
+    res = pt_check_obj_and_fd(vp, fd, __func__, verbose);
+    if (res)
+        return res;
+    if (time_secs <= 0)
+        time_secs = def_time_secs(&vp->impl, true);
+    SG_USDT5(pt_submit, vp, vp->impl.dev_id, vp->impl.io_hdr.request,
+             vp->impl.io_hdr.request_len, SG_PT_LAT_SCSI);
+    instr = __atomic_load_n(&sg_pt_instr, __ATOMIC_RELAXED);
+    if (0 == instr)
+        res = do_scsi_pt_low(vp, time_secs, verbose);
+    else
+        res = do_scsi_pt_instr(vp, instr, time_secs, verbose);
+    SG_USDT5(pt_complete, vp, vp->impl.dev_id, res,
+             get_scsi_pt_status_response(vp), SG_PT_LAT_SCSI);
+    return res;
+}
+
+
+/* Starts SCSI command without waiting for its completion. Only the sg
+ * driver supports this, other device types (e.g. bsg and NVMe) complete
+ * the command synchronously, its response is then held in vp until
+ * do_scsi_pt_receive() is called. */
+int
+do_scsi_pt_submit(struct sg_pt_base * vp, int fd, int time_secs, int verbose)
+{
+    struct sg_pt_linux_scsi * ptp = &vp->impl;
+    int res;
+    struct sg_io_hdr v3_hdr;
+
+    res = pt_check_obj_and_fd(vp, fd, __func__, verbose);
+    if (res)
+        return res;
+    if (time_secs <= 0)
+        time_secs = def_time_secs(ptp, false);
+    ptp->async_done = false;
+    ptp->async_v4 = false;
+    if (ptp->is_nvme && sg_uring_usable(ptp) &&
+        (0 == (ptp->io_hdr.din_iovec_count | ptp->io_hdr.dout_iovec_count)) &&
+        (! sg_is_scsi_cdb((const uint8_t *)(sg_uintptr_t)ptp->io_hdr.request,
+                          ptp->io_hdr.request_len)))
+        return sg_nvme_pt_submit(vp, true /* admin */, time_secs, verbose);
+    if (ptp->is_nvme || (! ptp->is_sg)) {
+        res = do_scsi_pt(vp, -1, time_secs, verbose);
+        ptp->async_done = true;
+        return res;
+    }
+    res = set_force_pack_id(ptp, verbose);
+    if (res)
+        return res;
+#ifndef IGNORE_LINUX_SGV4
+    if (ptp->sg_version >= SG_LINUX_SG_VER_V4_BASE) {
+        if (0 == ptp->io_hdr.request) {
+            if (verbose)
+                pr2ws("No SCSI command (cdb) given [v4]\n");
+            return SCSI_PT_DO_BAD_PARAMS;
+        }
+        ptp->io_hdr.timeout = ((time_secs > 0) ? (time_secs * 1000) :
+                                                 DEF_TIMEOUT);
+        if (ioctl(ptp->dev_fd, SG_IOSUBMIT, &ptp->io_hdr) < 0) {
+            ptp->os_err = errno;
+            if (verbose > 1)
+                pr2ws("ioctl(SG_IOSUBMIT) failed: %s (errno=%d)\n",
+                      safe_strerror(ptp->os_err), ptp->os_err);
+            return -ptp->os_err;
+        }
+        ptp->async_v4 = true;
+        return 0;
+    }
+#endif
+    res = build_v3_hdr(ptp, time_secs, &v3_hdr, verbose);
+    if (res)
+        return res;
+    if (write(ptp->dev_fd, &v3_hdr, sizeof(v3_hdr)) < 0) {
+        ptp->os_err = errno;
+        if (verbose > 1)
+            pr2ws("write(sg v3) failed: %s (errno=%d)\n",
+                  safe_strerror(ptp->os_err), ptp->os_err);
+        return -ptp->os_err;
+    }
+    return 0;
+}
+
+/* Fetches the response of a command started by do_scsi_pt_submit(). If
+ * the response is not ready and the file descriptor is O_NONBLOCK then
+ * -EAGAIN is returned. */
+int
+do_scsi_pt_receive(struct sg_pt_base * vp, int fd, int verbose)
+{
+    struct sg_pt_linux_scsi * ptp = &vp->impl;
+    int err;
+    struct sg_io_hdr v3_hdr;
+
+    if (ptp->async_done) {
+        ptp->async_done = false;
+        return 0;
+    }
+    if ((fd >= 0) && (ptp->dev_fd >= 0) && (fd != ptp->dev_fd)) {
+        if (verbose)
+            pr2ws("%s: file descriptor given to create() and here "
+                  "differ\n", __func__);
+        return SCSI_PT_DO_BAD_PARAMS;
+    }
+    if (ptp->dev_fd < 0) {
+        if (verbose)
+            pr2ws("%s: invalid file descriptors\n", __func__);
+        return SCSI_PT_DO_BAD_PARAMS;
+    }
+    if (ptp->async_uring)
+        return sg_nvme_pt_receive(vp, ! ptp->is_nonblock, verbose);
+    if (ptp->async_v4) {
+        if (ioctl(ptp->dev_fd, SG_IORECEIVE, &ptp->io_hdr) < 0) {
+            err = errno;
+            if (EAGAIN == err)
+                return -EAGAIN;
+            ptp->os_err = err;
+            if (verbose > 1)
+                pr2ws("ioctl(SG_IORECEIVE) failed: %s (errno=%d)\n",
+                      safe_strerror(err), err);
+            return -err;
+        }
+        ptp->async_v4 = false;
+        return 0;
+    }
+    memset(&v3_hdr, 0, sizeof(v3_hdr));
+    v3_hdr.interface_id = 'S';
+    v3_hdr.pack_id = (int)ptp->io_hdr.request_extra;
+    if (read(ptp->dev_fd, &v3_hdr, sizeof(v3_hdr)) < 0) {
+        err = errno;
+        if (EAGAIN == err)
+            return -EAGAIN;
+        ptp->os_err = err;
+        if (verbose > 1)
+            pr2ws("read(sg v3) failed: %s (errno=%d)\n", safe_strerror(err),
+                  err);
+        return -err;
+    }
+    v3_hdr_to_v4(ptp, &v3_hdr);
+    return 0;
+}
+
+int
+scsi_pt_wait_for_response(int fd, int timeout_ms, int verbose)
+{
+    int res, ring_fd;
+    struct pollfd a_poll;
+
+    /* commands queued on this thread's io_uring complete via its ring */
+    ring_fd = sg_uring_busy_fd(verbose);
+    if ((ring_fd < 0) && sg_uring_polled_busy())
+        return 1;       /* do_scsi_pt_receive() will poll for completion */
+    a_poll.fd = (ring_fd >= 0) ? ring_fd : fd;
+    a_poll.events = POLLIN;
+    a_poll.revents = 0;
+    res = poll(&a_poll, 1, timeout_ms);
+    if (res < 0) {
+        res = -errno;
+        if (verbose > 1)
+            pr2ws("%s: poll() failed: %s\n", __func__, safe_strerror(-res));
+        return res;
+    }
+    return (res > 0) ? 1 : 0;
+}
+
+/* Sends the batch as one multiple requests (mrq) invocation of the sg v4
+ * SG_IO ioctl. The sg_io_v4 objects are copied into a contiguous array
+ * for the driver and the responses are copied back into their owners. */
+static int
+do_scsi_pt_mrq_v4(struct sg_pt_base * vp_arr[], int num, int fd,
+                  int time_secs, int * num_donep, int verbose)
+{
+    int k, n, res;
+    uint32_t tmo = (time_secs > 0) ? (time_secs * 1000) : DEF_TIMEOUT;
+    struct sg_pt_linux_scsi * ptp;
+    struct sg_io_v4 * a_v4p;
+    struct sg_io_v4 * free_a_v4p = NULL;
+    struct sg_io_v4 ctl_v4;
+    struct sg_io_v4 a_v4[SG_PT_MRQ_STACK_NUM];
+
+    if (num > SG_PT_MRQ_STACK_NUM) {
+        free_a_v4p = (struct sg_io_v4 *)calloc(num, sizeof(struct sg_io_v4));
+        if (NULL == free_a_v4p) {
+            pr2ws("%s: out of memory\n", __func__);
+            return -ENOMEM;
+        }
+        a_v4p = free_a_v4p;
+    } else
+        a_v4p = a_v4;
+    for (k = 0; k < num; ++k) {
+        ptp = &vp_arr[k]->impl;
+        ptp->io_hdr.timeout = tmo;
+        a_v4p[k] = ptp->io_hdr;
+    }
+    memset(&ctl_v4, 0, sizeof(ctl_v4));
+    ctl_v4.guard = 'Q';
+    ctl_v4.flags = SGV4_FLAG_MULTIPLE_REQS;
+    ctl_v4.timeout = tmo;
+    ctl_v4.dout_xferp = (uint64_t)(sg_uintptr_t)a_v4p;
+    ctl_v4.dout_xfer_len = num * sizeof(struct sg_io_v4);
+    ctl_v4.din_xferp = ctl_v4.dout_xferp;
+    ctl_v4.din_xfer_len = ctl_v4.dout_xfer_len;
+    res = 0;
+    if (ioctl(fd, SG_IO, &ctl_v4) < 0) {
+        ptp = &vp_arr[0]->impl;
+        ptp->os_err = errno;
+        if (verbose > 1)
+            pr2ws("ioctl(SG_IO v4, mrq) failed: %s (errno=%d)\n",
+                  safe_strerror(ptp->os_err), ptp->os_err);
+        res = -ptp->os_err;
+        n = 0;
+    } else {
+        n = ((int)ctl_v4.info < num) ? (int)ctl_v4.info : num;
+        if ((n < num) && (verbose > 1))
+            pr2ws("%s: only %d of %d requests done\n", __func__, n, num);
+    }
+    for (k = 0; k < n; ++k)
+        vp_arr[k]->impl.io_hdr = a_v4p[k];
+    if (free_a_v4p)
+        free(free_a_v4p);
+    if (num_donep)
+        *num_donep = n;
+    return res;
+}
+
+int
+do_scsi_pt_mrq(struct sg_pt_base * vp_arr[], int num, int fd, int time_secs,
+               int * num_donep, int verbose)
+{
+    bool use_mrq = false;
+    int k, res;
+    struct sg_pt_linux_scsi * ptp;
+
+    if (num_donep)
+        *num_donep = 0;
+    if ((NULL == vp_arr) || (num < 1)) {
+        if (verbose)
+            pr2ws("%s: no objects given\n", __func__);
+        return SCSI_PT_DO_BAD_PARAMS;
+    }
+    for (k = 0; k < num; ++k) {
+        res = pt_check_obj_and_fd(vp_arr[k], fd, __func__, verbose);
+        if (res)
+            return res;
+        ptp = &vp_arr[k]->impl;
+        if (fd < 0)
+            fd = ptp->dev_fd;
+        else if (fd != ptp->dev_fd) {
+            if (verbose)
+                pr2ws("%s: all objects in batch must use same file "
+                      "descriptor\n", __func__);
+            return SCSI_PT_DO_BAD_PARAMS;
+        }
+        if (0 == ptp->io_hdr.request) {
+            if (verbose)
+                pr2ws("%s: No SCSI command (cdb) given [element %d]\n",
+                      __func__, k);
+            return SCSI_PT_DO_BAD_PARAMS;
+        }
+    }
+#ifndef IGNORE_LINUX_SGV4
+    ptp = &vp_arr[0]->impl;
+    use_mrq = (num > 1) && ptp->is_sg &&
+              (ptp->sg_version >= SG_LINUX_SG_VER_V4_MRQ);
+#endif
+    if (use_mrq)
+        return do_scsi_pt_mrq_v4(vp_arr, num, fd, time_secs, num_donep,
+                                 verbose);
+    return sg_pt_mrq_sequential(vp_arr, num, fd, time_secs, num_donep,
+                                verbose);
+}
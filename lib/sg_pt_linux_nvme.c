@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2017-2023 Douglas Gilbert.
+ * Copyright (c) 2017-2026 Douglas Gilbert.
  * All rights reserved.
  * Use of this source code is governed by a BSD-style
  * license that can be found in the BSD_LICENSE file.
@@ -41,7 +41,7 @@
  *                   MA 02110-1301, USA.
  */
 
-/* sg_pt_linux_nvme version 1.19 20230514 */
+/* sg_pt_linux_nvme version 1.26 20261015 */
 
 /* This file contains a small "SPC-only" SNTL to support the SES pass-through
  * of SEND DIAGNOSTIC and RECEIVE DIAGNOSTIC RESULTS through NVME-MI
@@ -79,6 +79,7 @@
 #include "sg_pt_linux.h"
 #include "sg_unaligned.h"
 #include "sg_pr2serr.h"
+#include "sg_sdt.h"
 
 #define SCSI_INQUIRY_OPC     0x12
 #define SCSI_REPORT_LUNS_OPC 0xa0
@@ -97,6 +98,7 @@
 #define SCSI_START_STOP_OPC 0x1b
 #define SCSI_SYNC_CACHE10_OPC  0x35
 #define SCSI_SYNC_CACHE16_OPC  0x91
+#define SCSI_UNMAP_OPC 0x42
 #define SCSI_VERIFY10_OPC 0x2f
 #define SCSI_VERIFY16_OPC 0x8f
 #define SCSI_WRITE10_OPC 0x2a
@@ -105,6 +107,12 @@
 #define SCSI_WRITE_SAME16_OPC 0x93
 #define SCSI_SERVICE_ACT_IN_OPC  0x9e
 #define SCSI_READ_CAPACITY16_SA  0x10
+#define SCSI_GET_LBA_STATUS16_SA  0x12
+#define SCSI_VARIABLE_LEN_OPC  0x7f
+#define SCSI_GET_LBA_STATUS32_SA  0x12
+#define SCSI_ZBC_OUT_OPC  0x94
+#define SCSI_ZBC_IN_OPC  0x95
+#define SCSI_REPORT_ZONES_SA  0x0
 #define SCSI_SA_MSK  0x1f
 
 /* Additional Sense Code (ASC) */
@@ -145,16 +153,30 @@
 #define SG_NVME_AD_DEV_SELT_TEST 0x14
 #define SG_NVME_AD_MI_RECEIVE 0x1e      /* MI: Management Interface */
 #define SG_NVME_AD_MI_SEND 0x1d         /* hmmm, same opcode as SEND DIAG */
+#define SG_NVME_AD_GET_LBA_STATUS 0x86  /* SCSI GET LBA STATUS, in part */
 
 /* NVMe NVM (Non-Volatile Memory) commands */
 #define SG_NVME_NVM_FLUSH 0x0           /* SCSI SYNCHRONIZE CACHE */
 #define SG_NVME_NVM_COMPARE 0x5         /* SCSI VERIFY(BYTCHK=1) */
+#define SG_NVME_NVM_DSM 0x9             /* SCSI UNMAP (Dataset Management) */
 #define SG_NVME_NVM_READ 0x2
 #define SG_NVME_NVM_VERIFY 0xc          /* SCSI VERIFY(BYTCHK=0) */
 #define SG_NVME_NVM_WRITE 0x1
 #define SG_NVME_NVM_WRITE_ZEROES 0x8    /* SCSI WRITE SAME */
+#define SG_NVME_NVM_ZONE_MGMT_SEND 0x79 /* SCSI ZBC OUT, ZNS command set */
+#define SG_NVME_NVM_ZONE_MGMT_RECV 0x7a /* SCSI REPORT ZONES */
 
 #define SG_NVME_RW_CONTROL_FUA (1 << 14) /* Force Unit Access bit */
+#define SG_NVME_DSM_ATTR_AD 0x4         /* DSM cdw11: deallocate */
+#define SG_NVME_DSM_MAX_RANGES 256      /* per DSM command */
+#define SG_NVME_ONCS_DSM 0x4            /* Identify controller ONCS bit */
+#define SG_NVME_OACS_GLS 0x200          /* OACS: Get LBA Status supported */
+#define SG_NVME_GLS_ATYPE_TRACKED 0x10  /* return tracked LBAs, no scan */
+#define SG_NVME_NSFEAT_THINP 0x1        /* Identify namespace NSFEAT bit */
+#define SG_NVME_CSI_ZNS 0x2             /* Zoned Namespace command set */
+#define SG_NVME_ZA_RZR 0x4              /* zone attribute: reset recommended */
+#define SG_NVME_ZMS_SELECT_ALL 0x100    /* Zone Management Send cdw13 */
+#define SG_NVME_ZMR_MAX_LEN (1024 * 1024)       /* per Zone Mgmt Receive */
 
 
 #if (HAVE_NVME && (! IGNORE_NVME))
@@ -292,6 +314,80 @@ mk_sense_invalid_fld(struct sg_pt_linux_scsi * ptp, bool in_cdb, int in_byte,
               ((in_bit > 0) ? (0x7 & in_bit) : 0));
 }
 
+/* Common processing after a NVMe pass-through (Admin or NVM) command has
+ * been sent via an ioctl or io_uring. 'res' is what the ioctl returned:
+ * negated errno or the NVMe completion status. 'result' is DW0 from the
+ * completion queue. Returns 0 for success, SG_LIB_NVME_STATUS if there is
+ * non-zero NVMe status, or a negated errno. */
+static int
+nvme_pt_complete(struct sg_pt_linux_scsi * ptp, int res, uint32_t result,
+                 uint8_t opcode, const char * nam, const char * caller,
+                 int vb)
+{
+    uint32_t n;
+    uint16_t sct_sc;
+
+    if (res < 0) {  /* OS error (errno negated) */
+        ptp->os_err = -res;
+        if (vb > 1) {
+            pr2ws("%s: ioctl for %s [0x%x] failed: %s "
+                  "(errno=%d)\n", caller, nam, opcode, strerror(-res), -res);
+        }
+        return res;
+    }
+
+    /* Now res contains NVMe completion queue CDW3 31:17 (15 bits) */
+    ptp->nvme_result = result;
+    if ((! ptp->nvme_our_sntl) && ptp->io_hdr.response &&
+        (ptp->io_hdr.max_response_len > 3)) {
+        /* build 32 byte "sense" buffer */
+        uint8_t * sbp = (uint8_t *)(sg_uintptr_t)ptp->io_hdr.response;
+        uint16_t st = (uint16_t)res;
+
+        n = ptp->io_hdr.max_response_len;
+        n = (n < 32) ? n : 32;
+        memset(sbp, 0 , n);
+        ptp->io_hdr.response_len = n;
+        sg_put_unaligned_le32(result, sbp + SG_NVME_PT_CQ_RESULT);
+        if (n > 15) /* LSBit will be 0 (Phase bit) after (st << 1) */
+            sg_put_unaligned_le16(st << 1, sbp + SG_NVME_PT_CQ_STATUS_P);
+    }
+    /* clear upper bits (DNR and More) leaving ((SCT << 8) | SC) */
+    sct_sc = 0x7ff & res;       /* 11 bits */
+    ptp->nvme_status = sct_sc;
+    ptp->nvme_stat_dnr = !!(0x4000 & res);
+    ptp->nvme_stat_more = !!(0x2000 & res);
+    if (sct_sc) {  /* when non-zero, treat as command error */
+        if (vb > 1) {
+            char b[80];
+
+            pr2ws("%s: ioctl for %s [0x%x] failed, status: %s [0x%x]\n",
+                   caller, nam, opcode,
+                  sg_get_nvme_cmd_status_str(sct_sc, sizeof(b), b), sct_sc);
+        }
+        return SG_LIB_NVME_STATUS;      /* == SCSI_PT_DO_NVME_STATUS */
+    }
+    return 0;
+}
+
+/* Returns true for NVMe Admin commands that may change Identify responses
+ * or the volatile write cache setting held in the SNTL cache. */
+static bool
+nvme_admin_changes_cache(uint8_t opcode)
+{
+    switch (opcode) {
+    case SG_NVME_AD_SET_FEATURE:
+    case 0xd:           /* Namespace Management */
+    case 0x10:          /* Firmware Commit */
+    case 0x15:          /* Namespace Attachment */
+    case 0x80:          /* Format NVM */
+    case 0x84:          /* Sanitize */
+        return true;
+    default:
+        return false;
+    }
+}
+
 /* Returns 0 for success. Returns SG_LIB_NVME_STATUS if there is non-zero
  * NVMe status (from the completion queue) with the value placed in
  * ptp->nvme_status. If Unix error from ioctl then return negated value
@@ -307,7 +403,6 @@ sg_nvme_admin_cmd_f(struct sg_pt_linux_scsi * ptp,
     const uint32_t cmd_len = sizeof(struct sg_nvme_passthru_cmd);
     int res;
     uint32_t n;
-    uint16_t sct_sc;
     const uint8_t * up = ((const uint8_t *)cmdp) + SG_NVME_PT_OPCODE;
     char nam[64];
 
@@ -335,48 +430,18 @@ sg_nvme_admin_cmd_f(struct sg_pt_linux_scsi * ptp,
             }
         }
     }
-    res = ioctl(ptp->dev_fd, NVME_IOCTL_ADMIN_CMD, cmdp);
-    if (res < 0) {  /* OS error (errno negated) */
-        ptp->os_err = -res;
-        if (vb > 1) {
-            pr2ws("%s: ioctl for %s [0x%x] failed: %s "
-                  "(errno=%d)\n", __func__, nam, *up, strerror(-res), -res);
-        }
-        return res;
-    }
-
-    /* Now res contains NVMe completion queue CDW3 31:17 (15 bits) */
-    ptp->nvme_result = cmdp->result;
-    if ((! ptp->nvme_our_sntl) && ptp->io_hdr.response &&
-        (ptp->io_hdr.max_response_len > 3)) {
-        /* build 32 byte "sense" buffer */
-        uint8_t * sbp = (uint8_t *)(sg_uintptr_t)ptp->io_hdr.response;
-        uint16_t st = (uint16_t)res;
-
-        n = ptp->io_hdr.max_response_len;
-        n = (n < 32) ? n : 32;
-        memset(sbp, 0 , n);
-        ptp->io_hdr.response_len = n;
-        sg_put_unaligned_le32(cmdp->result,
-                              sbp + SG_NVME_PT_CQ_RESULT);
-        if (n > 15) /* LSBit will be 0 (Phase bit) after (st << 1) */
-            sg_put_unaligned_le16(st << 1, sbp + SG_NVME_PT_CQ_STATUS_P);
-    }
-    /* clear upper bits (DNR and More) leaving ((SCT << 8) | SC) */
-    sct_sc = 0x7ff & res;       /* 11 bits */
-    ptp->nvme_status = sct_sc;
-    ptp->nvme_stat_dnr = !!(0x4000 & res);
-    ptp->nvme_stat_more = !!(0x2000 & res);
-    if (sct_sc) {  /* when non-zero, treat as command error */
-        if (vb > 1) {
-            char b[80];
-
-            pr2ws("%s: ioctl for %s [0x%x] failed, status: %s [0x%x]\n",
-                   __func__, nam, *up,
-                  sg_get_nvme_cmd_status_str(sct_sc, sizeof(b), b), sct_sc);
-        }
-        return SG_LIB_NVME_STATUS;      /* == SCSI_PT_DO_NVME_STATUS */
+    if (sg_uring_usable(ptp))
+        res = sg_uring_nvme_cmd(ptp, cmdp, true /* admin */, vb);
+    else {
+        res = ioctl(ptp->dev_fd, NVME_IOCTL_ADMIN_CMD, cmdp);
+        if (res < 0)
+            res = -errno;
     }
+    if (nvme_admin_changes_cache(*up))
+        sg_pt_nvme_cache_invalidate();
+    res = nvme_pt_complete(ptp, res, cmdp->result, *up, nam, __func__, vb);
+    if (res)
+        return res;
     if ((vb > 4) && is_read && dp) {
         uint32_t len = sg_get_unaligned_le32(up + SG_NVME_PT_DATA_LEN);
 
@@ -464,7 +529,9 @@ sntl_do_identify(struct sg_pt_linux_scsi * ptp, int cns, int nsid,
 }
 
 /* Currently only caches associated identify controller response (4096 bytes).
- * Returns 0 on success; otherwise a positive value is returned */
+ * It is taken from the process wide SNTL cache if another pt object on this
+ * device has already fetched it. Returns 0 on success; otherwise a positive
+ * value is returned */
 static int
 sntl_cache_identify(struct sg_pt_linux_scsi * ptp, int time_secs, int vb)
 {
@@ -478,13 +545,47 @@ sntl_cache_identify(struct sg_pt_linux_scsi * ptp, int time_secs, int vb)
         pr2ws("%s: sg_memalign() failed to get memory\n", __func__);
         return sg_convert_errno(ENOMEM);
     }
+    if ((pg_sz >= SG_NVME_CACHE_ID_LEN) &&
+        sg_nvme_cache_get(ptp->dev_id, 0, SG_NVME_CACHE_ID_CTL, up, NULL)) {
+        if (vb > 5)
+            pr2ws("%s: Identify controller from cache\n", __func__);
+        sntl_check_enclosure_override(ptp, vb);
+        return 0;
+    }
     ret = sntl_do_identify(ptp, 0x1 /* CNS */, 0 /* nsid */, time_secs,
                            pg_sz, up, vb);
-    if (0 == ret)
+    if (0 == ret) {
+        if (pg_sz >= SG_NVME_CACHE_ID_LEN)
+            sg_nvme_cache_put(ptp->dev_id, 0, SG_NVME_CACHE_ID_CTL, up, 0);
         sntl_check_enclosure_override(ptp, vb);
+    }
     return (ret < 0) ? sg_convert_errno(-ret) : ret;
 }
 
+/* Identify namespace (CNS 0) for ptp->nvme_nsid placed in up which is
+ * u_len bytes long, via the SNTL cache when possible. Returns as for
+ * sntl_do_identify(). */
+static int
+sntl_identify_ns(struct sg_pt_linux_scsi * ptp, int time_secs, int u_len,
+                 uint8_t * up, int vb)
+{
+    int res;
+    bool cachable = (u_len >= SG_NVME_CACHE_ID_LEN);
+
+    if (cachable && sg_nvme_cache_get(ptp->dev_id, ptp->nvme_nsid,
+                                      SG_NVME_CACHE_ID_NS, up, NULL)) {
+        if (vb > 5)
+            pr2ws("%s: Identify namespace from cache\n", __func__);
+        return 0;
+    }
+    res = sntl_do_identify(ptp, 0x0 /* CNS */, ptp->nvme_nsid, time_secs,
+                           u_len, up, vb);
+    if ((0 == res) && cachable)
+        sg_nvme_cache_put(ptp->dev_id, ptp->nvme_nsid, SG_NVME_CACHE_ID_NS,
+                          up, 0);
+    return res;
+}
+
 /* If nsid==0 then set cmdp->nsid to SG_NVME_BROADCAST_NSID. */
 static int
 sntl_get_features(struct sg_pt_linux_scsi * ptp, int feature_id, int select,
@@ -555,7 +656,7 @@ sntl_inq(struct sg_pt_linux_scsi * ptp, const uint8_t * cdbp, int time_secs,
         case 0:
             /* inq_dout[0] = (PQ=0)<<5 | (PDT=0); prefer pdt=0xd --> SES */
             inq_dout[1] = pg_cd;
-            n = 12;
+            n = 13;
             sg_put_unaligned_be16(n - 4, inq_dout + 2);
             inq_dout[4] = 0x0;
             inq_dout[5] = 0x80;
@@ -563,7 +664,8 @@ sntl_inq(struct sg_pt_linux_scsi * ptp, const uint8_t * cdbp, int time_secs,
             inq_dout[7] = 0x86;
             inq_dout[8] = 0x87;
             inq_dout[9] = 0x92;
-            inq_dout[10] = 0xb1;
+            inq_dout[10] = 0xb0;
+            inq_dout[11] = 0xb1;
             inq_dout[n - 1] = SG_NVME_VPD_NICR;     /* last VPD number */
             break;
         case 0x80:
@@ -580,8 +682,8 @@ sntl_inq(struct sg_pt_linux_scsi * ptp, const uint8_t * cdbp, int time_secs,
                                          false);
                 if (nvme_id_ns) {
                     /* CNS=0x0 Identify namespace */
-                    res = sntl_do_identify(ptp, 0x0, ptp->nvme_nsid,
-                                           time_secs, pg_sz, nvme_id_ns, vb);
+                    res = sntl_identify_ns(ptp, time_secs, pg_sz,
+                                           nvme_id_ns, vb);
                     if (res) {
                         free(free_nvme_id_ns);
                         free_nvme_id_ns = NULL;
@@ -622,6 +724,18 @@ sntl_inq(struct sg_pt_linux_scsi * ptp, const uint8_t * cdbp, int time_secs,
             sg_put_unaligned_be16(n - 4, inq_dout + 2);
             inq_dout[9] = 0x1;  /* SFS SPC Discovery 2016 */
             break;
+        case 0xb0:      /* Block Limits */
+            inq_dout[1] = pg_cd;
+            n = 64;
+            sg_put_unaligned_be16(n - 4, inq_dout + 2);
+            if (SG_NVME_ONCS_DSM &
+                sg_get_unaligned_le16(ptp->nvme_id_ctlp + 520)) {
+                /* UNMAP is translated, see sntl_unmap(). No limit on the
+                 * number of LBs, one DSM command's worth of descriptors */
+                sg_put_unaligned_be32(0xffffffff, inq_dout + 20);
+                sg_put_unaligned_be32(SG_NVME_DSM_MAX_RANGES, inq_dout + 24);
+            }
+            break;
         case 0xb1:      /* Block Device Characteristics */
             inq_dout[1] = pg_cd;
             n = 64;
@@ -859,17 +973,28 @@ sntl_mode_ss(struct sg_pt_linux_scsi * ptp, const uint8_t * cdbp,
         int mp_t10 = (cdbp[2] & 0x3f);
 
         if ((0x3f == mp_t10) || (0x8 /* caching mpage */ == mp_t10)) {
-            /* 0x6 is "Volatile write cache" feature id */
-            res = sntl_get_features(ptp, 0x6, pc_t10_2_select[pc_t10], 0,
-                                    0, time_secs, vb);
-            if (0 != res) {
-                if (SG_LIB_NVME_STATUS == res) {
-                    mk_sense_from_nvme_status(ptp, vb);
-                    return 0;
-                } else
-                    return res;
+            bool cur = (0 == pc_t10_2_select[pc_t10]);
+            uint32_t wce;
+
+            if (cur && sg_nvme_cache_get(ptp->dev_id, 0, SG_NVME_CACHE_WCE,
+                                         NULL, &wce))
+                ptp->dev_stat.wce = !!wce;
+            else {
+                /* 0x6 is "Volatile write cache" feature id */
+                res = sntl_get_features(ptp, 0x6, pc_t10_2_select[pc_t10], 0,
+                                        0, time_secs, vb);
+                if (0 != res) {
+                    if (SG_LIB_NVME_STATUS == res) {
+                        mk_sense_from_nvme_status(ptp, vb);
+                        return 0;
+                    } else
+                        return res;
+                }
+                ptp->dev_stat.wce = !!(0x1 & ptp->nvme_result);
+                if (cur)
+                    sg_nvme_cache_put(ptp->dev_id, 0, SG_NVME_CACHE_WCE,
+                                      NULL, (uint32_t)ptp->dev_stat.wce);
             }
-            ptp->dev_stat.wce = !!(0x1 & ptp->nvme_result);
         }
         len = ptp->io_hdr.din_xfer_len;
         bp = (uint8_t *)(sg_uintptr_t)ptp->io_hdr.din_xferp;
@@ -1294,8 +1419,7 @@ sntl_readcap(struct sg_pt_linux_scsi * ptp, const uint8_t * cdbp,
         pr2ws("%s: sg_memalign() failed to get memory\n", __func__);
         return sg_convert_errno(ENOMEM);
     }
-    res = sntl_do_identify(ptp, 0x0 /* CNS */, ptp->nvme_nsid, time_secs,
-                           pg_sz, up, vb);
+    res = sntl_identify_ns(ptp, time_secs, pg_sz, up, vb);
     if (res < 0) {
         res = sg_convert_errno(-res);
         goto fini;
@@ -1352,7 +1476,6 @@ do_nvm_pt_low(struct sg_pt_linux_scsi * ptp,
     const uint32_t cmd_len = sizeof(struct sg_nvme_passthru_cmd);
     int res;
     uint32_t n;
-    uint16_t sct_sc;
     const uint8_t * up = ((const uint8_t *)cmdp) + SG_NVME_PT_OPCODE;
     char nam[64];
 
@@ -1378,48 +1501,16 @@ do_nvm_pt_low(struct sg_pt_linux_scsi * ptp,
             }
         }
     }
-    res = ioctl(ptp->dev_fd, NVME_IOCTL_IO_CMD, cmdp);
-    if (res < 0) {  /* OS error (errno negated) */
-        ptp->os_err = -res;
-        if (vb > 1) {
-            pr2ws("%s: ioctl for %s [0x%x] failed: %s "
-                  "(errno=%d)\n", __func__, nam, *up, strerror(-res), -res);
-        }
-        return res;
-    }
-
-    /* Now res contains NVMe completion queue CDW3 31:17 (15 bits) */
-    ptp->nvme_result = cmdp->result;
-    if ((! ptp->nvme_our_sntl) && ptp->io_hdr.response &&
-        (ptp->io_hdr.max_response_len > 3)) {
-        /* build 32 byte "sense" buffer */
-        uint8_t * sbp = (uint8_t *)(sg_uintptr_t)ptp->io_hdr.response;
-        uint16_t st = (uint16_t)res;
-
-        n = ptp->io_hdr.max_response_len;
-        n = (n < 32) ? n : 32;
-        memset(sbp, 0 , n);
-        ptp->io_hdr.response_len = n;
-        sg_put_unaligned_le32(cmdp->result,
-                              sbp + SG_NVME_PT_CQ_RESULT);
-        if (n > 15) /* LSBit will be 0 (Phase bit) after (st << 1) */
-            sg_put_unaligned_le16(st << 1, sbp + SG_NVME_PT_CQ_STATUS_P);
-    }
-    /* clear upper bits (DNR and More) leaving ((SCT << 8) | SC) */
-    sct_sc = 0x7ff & res;       /* 11 bits */
-    ptp->nvme_status = sct_sc;
-    ptp->nvme_stat_dnr = !!(0x4000 & res);
-    ptp->nvme_stat_more = !!(0x2000 & res);
-    if (sct_sc) {  /* when non-zero, treat as command error */
-        if (vb > 1) {
-            char b[80];
-
-            pr2ws("%s: ioctl for %s [0x%x] failed, status: %s [0x%x]\n",
-                   __func__, nam, *up,
-                  sg_get_nvme_cmd_status_str(sct_sc, sizeof(b), b), sct_sc);
-        }
-        return SG_LIB_NVME_STATUS;      /* == SCSI_PT_DO_NVME_STATUS */
+    if (sg_uring_usable(ptp))
+        res = sg_uring_nvme_cmd(ptp, cmdp, false /* NVM */, vb);
+    else {
+        res = ioctl(ptp->dev_fd, NVME_IOCTL_IO_CMD, cmdp);
+        if (res < 0)
+            res = -errno;
     }
+    res = nvme_pt_complete(ptp, res, cmdp->result, *up, nam, __func__, vb);
+    if (res)
+        return res;
     if ((vb > 4) && is_read && dp) {
         if (dlen > 0) {
             n = dlen;
@@ -1461,91 +1552,184 @@ sntl_do_nvm_cmd(struct sg_pt_linux_scsi * ptp, struct sg_nvme_user_io * iop,
     return do_nvm_pt_low(ptp, cmdp, dp, dlen, is_read, time_secs, vb);
 }
 
+/* Sends the num NVM commands in cmd_arr which together carry out one SCSI
+ * command. With the io_uring engine they are all in flight at once (up to
+ * the size of the ring), otherwise they are sent one after another.
+ * Returns as do_nvm_pt_low() does, for the first command that failed. */
 static int
-sntl_rread(struct sg_pt_linux_scsi * ptp, const uint8_t * cdbp,
-           int time_secs, int vb)
+do_nvm_pt_multi(struct sg_pt_linux_scsi * ptp,
+                struct sg_nvme_passthru_cmd * cmd_arr, int num, bool is_read,
+                int time_secs, int vb)
 {
-    bool is_read10 = (SCSI_READ10_OPC == cdbp[0]);
-    bool have_fua = !!(cdbp[1] & 0x8);
-    int res;
-    uint32_t nblks_t10 = 0;
-    struct sg_nvme_user_io io;
-    struct sg_nvme_user_io * iop = &io;
+    int k, res, fail;
+    uint32_t tmo = (time_secs < 0) ? (-time_secs) : (1000 * time_secs);
+    char nam[64];
 
-    if (vb > 5)
-        pr2ws("%s: fua=%d, time_secs=%d\n", __func__, (int)have_fua,
-              time_secs);
-    memset(iop, 0, sizeof(*iop));
-    iop->opcode = SG_NVME_NVM_READ;
-    if (is_read10) {
-        iop->slba = sg_get_unaligned_be32(cdbp + 2);
-        nblks_t10 = sg_get_unaligned_be16(cdbp + 7);
-    } else {
-        iop->slba = sg_get_unaligned_be64(cdbp + 2);
-        nblks_t10 = sg_get_unaligned_be32(cdbp + 10);
-        if (nblks_t10 > (UINT16_MAX + 1)) {
-            mk_sense_invalid_fld(ptp, true, 11, -1, vb);
-            return 0;
+    if (! sg_uring_usable(ptp)) {
+        for (k = 0; k < num; ++k) {
+            res = do_nvm_pt_low(ptp, cmd_arr + k,
+                                (void *)(sg_uintptr_t)cmd_arr[k].addr,
+                                cmd_arr[k].data_len, is_read, time_secs, vb);
+            if (res)
+                return res;
         }
-    }
-    if (0 == nblks_t10) {         /* NOP in SCSI */
-        if (vb > 4)
-            pr2ws("%s: nblks_t10 is 0, a NOP in SCSI, can't map to NVMe\n",
-                  __func__);
-        return 0;
-    }
-    iop->nblocks = nblks_t10 - 1;       /* crazy "0's based" */
-    if (have_fua)
-        iop->control |= SG_NVME_RW_CONTROL_FUA;
-    iop->addr = (uint64_t)ptp->io_hdr.din_xferp;
-    res = sntl_do_nvm_cmd(ptp, iop, ptp->io_hdr.din_xfer_len,
-                          true /* is_read */, time_secs, vb);
-    if (SG_LIB_NVME_STATUS == res) {
-        mk_sense_from_nvme_status(ptp, vb);
         return 0;
     }
+    for (k = 0; k < num; ++k)
+        cmd_arr[k].timeout_ms = tmo;
+    if (vb > 2)
+        pr2ws("%s: %d NVMe commands sent together\n", __func__, num);
+    ptp->os_err = 0;
+    res = sg_uring_nvme_cmds(ptp, cmd_arr, num, &fail, vb);
+    k = (fail < 0) ? 0 : fail;
+    if (vb)
+        sg_get_nvme_opcode_name(cmd_arr[k].opcode, false /* NVM */,
+                                sizeof(nam), nam);
+    else
+        nam[0] = '\0';
+    return nvme_pt_complete(ptp, res, cmd_arr[k].result, cmd_arr[k].opcode,
+                            nam, __func__, vb);
+}
+
+/* Largest number of blocks that one NVMe Read or Write may carry: the NLB
+ * field is 16 bits ("0's based") and, if the controller's MDTS field is
+ * set, that transfer size is another limit. MDTS is in units of the
+ * controller's minimum memory page size, which is taken to be 4096 bytes
+ * (the smallest allowed) as CAP.MPSMIN is not visible from here. The
+ * Identify controller response is only fetched when needed (i.e. when nblks
+ * exceeds the NLB limit) otherwise it is used if already cached. */
+static uint32_t
+sntl_rw_max_blks(struct sg_pt_linux_scsi * ptp, uint32_t nblks,
+                 uint32_t blk_sz, int time_secs, int vb)
+{
+    uint32_t max_blks = UINT16_MAX + 1;
+    uint64_t mdts_bytes;
+
+    if ((NULL == ptp->nvme_id_ctlp) && (nblks > max_blks))
+        sntl_cache_identify(ptp, time_secs, vb);
+    if (ptp->nvme_id_ctlp && (ptp->nvme_id_ctlp[77] > 0) &&
+        (ptp->nvme_id_ctlp[77] < 32) && (blk_sz > 0)) {
+        mdts_bytes = (uint64_t)4096 << ptp->nvme_id_ctlp[77];
+        if ((mdts_bytes / blk_sz) < max_blks)
+            max_blks = (uint32_t)(mdts_bytes / blk_sz);
+        if (0 == max_blks)
+            max_blks = 1;
+    }
+    return max_blks;
+}
+
+/* Splits the SCSI READ or WRITE of nblks blocks at lba, whose data is at dp,
+ * into NVMe commands of at most max_blks blocks each. The fields that are
+ * the same for all of them are taken from *tmplp. */
+static int
+sntl_rw_split(struct sg_pt_linux_scsi * ptp,
+              const struct sg_nvme_passthru_cmd * tmplp, uint64_t lba,
+              uint32_t nblks, uint32_t max_blks, uint32_t blk_sz,
+              uint8_t * dp, bool is_read, int time_secs, int vb)
+{
+    int k, num, res;
+    uint32_t n;
+    struct sg_nvme_passthru_cmd * cmd_arr;
+
+    num = (int)(((uint64_t)nblks + max_blks - 1) / max_blks);
+    cmd_arr = (struct sg_nvme_passthru_cmd *)calloc(num, sizeof(*cmd_arr));
+    if (NULL == cmd_arr)
+        return sg_convert_errno(ENOMEM);
+    if (vb > 4)
+        pr2ws("%s: %u blocks as %d NVMe commands of up to %u blocks\n",
+              __func__, nblks, num, max_blks);
+    for (k = 0; k < num; ++k) {
+        n = (nblks > max_blks) ? max_blks : nblks;
+        cmd_arr[k] = *tmplp;
+        cmd_arr[k].addr = (uint64_t)(sg_uintptr_t)dp;
+        cmd_arr[k].data_len = n * blk_sz;
+        cmd_arr[k].cdw10 = lba & 0xffffffff;
+        cmd_arr[k].cdw11 = (lba >> 32) & 0xffffffff;
+        cmd_arr[k].cdw12 = (tmplp->cdw12 & 0xffff0000) | (n - 1);
+        lba += n;
+        nblks -= n;
+        dp += (uint64_t)n * blk_sz;
+    }
+    res = do_nvm_pt_multi(ptp, cmd_arr, num, is_read, time_secs, vb);
+    free(cmd_arr);
     return res;
 }
 
+/* Fast path for SCSI READ(10/16) and WRITE(10/16), the bulk of streaming
+ * transfers (e.g. from sg_dd). The NVMe Read or Write command is built
+ * directly from a template held in ptp (so the fields that do not change
+ * between commands are set once per device) rather than via a struct
+ * sg_nvme_user_io and a second conversion. Transfers too large for one
+ * NVMe command are split, see sntl_rw_split(). */
 static int
-sntl_write(struct sg_pt_linux_scsi * ptp, const uint8_t * cdbp,
-           int time_secs, int vb)
+sntl_rw(struct sg_pt_linux_scsi * ptp, const uint8_t * cdbp, bool is_read,
+        int time_secs, int vb)
 {
-    bool is_write10 = (SCSI_WRITE10_OPC == cdbp[0]);
-    bool have_fua = !!(cdbp[1] & 0x8);
+    bool is_10 = ((SCSI_READ10_OPC == cdbp[0]) ||
+                  (SCSI_WRITE10_OPC == cdbp[0]));
     int res;
-    uint32_t nblks_t10 = 0;
-    struct sg_nvme_user_io io;
-    struct sg_nvme_user_io * iop = &io;
+    uint32_t nblks_t10, dlen, blk_sz, max_blks;
+    uint64_t lba;
+    void * dp;
+    struct sg_nvme_passthru_cmd cmd;
 
-    if (vb > 5)
-        pr2ws("%s: fua=%d, time_secs=%d\n", __func__, (int)have_fua,
-              time_secs);
-    memset(iop, 0, sizeof(*iop));
-    iop->opcode = SG_NVME_NVM_WRITE;
-    if (is_write10) {
-        iop->slba = sg_get_unaligned_be32(cdbp + 2);
+    if (is_10) {
+        lba = sg_get_unaligned_be32(cdbp + 2);
         nblks_t10 = sg_get_unaligned_be16(cdbp + 7);
     } else {
-        iop->slba = sg_get_unaligned_be64(cdbp + 2);
+        lba = sg_get_unaligned_be64(cdbp + 2);
         nblks_t10 = sg_get_unaligned_be32(cdbp + 10);
-        if (nblks_t10 > (UINT16_MAX + 1)) {
-            mk_sense_invalid_fld(ptp, true, 11, -1, vb);
-            return 0;
-        }
     }
-    if (0 == nblks_t10) { /* NOP in SCSI */
+    if (vb > 5)
+        pr2ws("%s: %s, lba=0x%" PRIx64 ", nblks=%u, fua=%d, time_secs=%d\n",
+              __func__, (is_read ? "read" : "write"), lba, nblks_t10,
+              !!(cdbp[1] & 0x8), time_secs);
+    if (0 == nblks_t10) {         /* NOP in SCSI */
         if (vb > 4)
             pr2ws("%s: nblks_t10 is 0, a NOP in SCSI, can't map to NVMe\n",
                   __func__);
         return 0;
     }
-    iop->nblocks = nblks_t10 - 1;
-    if (have_fua)
-        iop->control |= SG_NVME_RW_CONTROL_FUA;
-    iop->addr = (uint64_t)ptp->io_hdr.dout_xferp;
-    res = sntl_do_nvm_cmd(ptp, iop, ptp->io_hdr.dout_xfer_len, false,
-                          time_secs, vb);
+    if (! ptp->nvm_rw_tmpl_ok) {
+        memset(&ptp->nvm_rw_tmpl, 0, sizeof(ptp->nvm_rw_tmpl));
+        ptp->nvm_rw_tmpl.nsid = ptp->nvme_nsid;
+        ptp->nvm_rw_tmpl_ok = true;
+    }
+    cmd = ptp->nvm_rw_tmpl;
+    if (is_read) {
+        cmd.opcode = SG_NVME_NVM_READ;
+        dp = (void *)(sg_uintptr_t)ptp->io_hdr.din_xferp;
+        dlen = ptp->io_hdr.din_xfer_len;
+    } else {
+        cmd.opcode = SG_NVME_NVM_WRITE;
+        dp = (void *)(sg_uintptr_t)ptp->io_hdr.dout_xferp;
+        dlen = ptp->io_hdr.dout_xfer_len;
+    }
+    /* the data-in or data-out buffer tells the logical block size */
+    blk_sz = ((dlen >= nblks_t10) && (0 == (dlen % nblks_t10))) ?
+             (dlen / nblks_t10) : 0;
+    max_blks = sntl_rw_max_blks(ptp, nblks_t10, blk_sz, time_secs, vb);
+    if ((nblks_t10 > max_blks) && (0 == blk_sz)) {
+        if (nblks_t10 > (UINT16_MAX + 1)) {
+            mk_sense_invalid_fld(ptp, true, (is_10 ? 7 : 11), -1, vb);
+            return 0;
+        }
+        max_blks = nblks_t10;   /* can't split, let the device decide */
+    }
+    cmd.addr = (uint64_t)(sg_uintptr_t)dp;
+    cmd.data_len = dlen;
+    cmd.cdw10 = lba & 0xffffffff;
+    cmd.cdw11 = (lba >> 32) & 0xffffffff;
+    cmd.cdw12 = 0;
+    if (cdbp[1] & 0x8)          /* FUA is in the control field, 31:16 */
+        cmd.cdw12 |= ((uint32_t)SG_NVME_RW_CONTROL_FUA << 16);
+    if (nblks_t10 > max_blks)
+        res = sntl_rw_split(ptp, &cmd, lba, nblks_t10, max_blks, blk_sz,
+                            (uint8_t *)dp, is_read, time_secs, vb);
+    else {
+        cmd.cdw12 |= nblks_t10 - 1;     /* crazy "0's based" */
+        res = do_nvm_pt_low(ptp, &cmd, dp, dlen, is_read, time_secs, vb);
+    }
     if (SG_LIB_NVME_STATUS == res) {
         mk_sense_from_nvme_status(ptp, vb);
         return 0;
@@ -1699,39 +1883,720 @@ sntl_sync_cache(struct sg_pt_linux_scsi * ptp, const uint8_t * cdbp,
     return res;
 }
 
+/* Sends NVMe Dataset Management with the deallocate attribute for the
+ * num_rng ranges (each 16 bytes) in rng_arr. */
 static int
-sntl_start_stop(struct sg_pt_linux_scsi * ptp, const uint8_t * cdbp,
-                int time_secs, int vb)
+sntl_dsm_dealloc(struct sg_pt_linux_scsi * ptp, uint8_t * rng_arr,
+                 int num_rng, int time_secs, int vb)
 {
-    bool immed = !!(0x1 & cdbp[1]);
+    uint32_t dlen = num_rng * 16;
+    struct sg_nvme_passthru_cmd cmd;
 
-    if (vb > 5)
-        pr2ws("%s: immed=%d, time_secs=%d, ignore\n", __func__, (int)immed,
-              time_secs);
-    if (ptp) { }        /* suppress warning */
-    return 0;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.opcode = SG_NVME_NVM_DSM;
+    cmd.nsid = ptp->nvme_nsid;
+    cmd.addr = (uint64_t)(sg_uintptr_t)rng_arr;
+    cmd.data_len = dlen;
+    cmd.cdw10 = num_rng - 1;            /* "0's based" number of ranges */
+    cmd.cdw11 = SG_NVME_DSM_ATTR_AD;
+    return do_nvm_pt_low(ptp, &cmd, rng_arr, dlen, false, time_secs, vb);
 }
 
-/* Executes NVMe Admin command (or at least forwards it to lower layers).
- * Returns 0 for success, negative numbers are negated 'errno' values from
- * OS system calls. Positive return values are errors from this package.
- * When time_secs is 0 the Linux NVMe Admin command default of 60 seconds
- * is used. */
-int
-sg_do_nvme_pt(struct sg_pt_base * vp, int fd, int time_secs, int vb)
+/* SCSI UNMAP becomes one NVMe Dataset Management (deallocate) command for
+ * each SG_NVME_DSM_MAX_RANGES block descriptors in the parameter list. The
+ * SCSI NUMBER OF LOGICAL BLOCKS and NVMe range length fields are both 32
+ * bits so descriptors map one to one; those of zero blocks are dropped. */
+static int
+sntl_unmap(struct sg_pt_linux_scsi * ptp, const uint8_t * cdbp,
+           int time_secs, int vb)
 {
-    bool scsi_cdb;
-    bool is_read = false;
-    int n, len, hold_dev_fd;
-    uint16_t sa;
-    struct sg_pt_linux_scsi * ptp = &vp->impl;
-    struct sg_nvme_passthru_cmd cmd;
-    const uint8_t * cdbp;
-    void * dp = NULL;
-
-    if (! ptp->io_hdr.request) {
-        if (vb)
-            pr2ws("No NVMe command given (set_scsi_pt_cdb())\n");
+    int k, n, res, num_d, bd_len, pl_len;
+    uint32_t nblks;
+    const uint8_t * bp;
+    uint8_t * rp;
+    uint8_t * rng_arr;
+    uint8_t * free_rng_arr = NULL;
+
+    pl_len = sg_get_unaligned_be16(cdbp + 7);
+    if (vb > 5)
+        pr2ws("%s: anchor=%d, param_list_len=%d, time_secs=%d\n",
+              __func__, !!(0x1 & cdbp[1]), pl_len, time_secs);
+    if (0 == pl_len)            /* NOP in SCSI */
+        return 0;
+    if (0x1 & cdbp[1]) {        /* ANCHOR */
+        mk_sense_invalid_fld(ptp, true, 1, 0, vb);
+        return 0;
+    }
+    if (NULL == ptp->nvme_id_ctlp) {
+        res = sntl_cache_identify(ptp, time_secs, vb);
+        if (SG_LIB_NVME_STATUS == res) {
+            mk_sense_from_nvme_status(ptp, vb);
+            return 0;
+        } else if (res)
+            return res;
+    }
+    if (0 == (SG_NVME_ONCS_DSM &
+              sg_get_unaligned_le16(ptp->nvme_id_ctlp + 520))) {
+        if (vb > 2)
+            pr2ws("%s: Dataset Management command not supported\n",
+                  __func__);
+        mk_sense_asc_ascq(ptp, SPC_SK_ILLEGAL_REQUEST, INVALID_OPCODE, 0,
+                          vb);
+        return 0;
+    }
+    bp = (const uint8_t *)(sg_uintptr_t)ptp->io_hdr.dout_xferp;
+    if ((int)ptp->io_hdr.dout_xfer_len < pl_len)
+        pl_len = ptp->io_hdr.dout_xfer_len;
+    if ((NULL == bp) || (pl_len < 8)) {
+        mk_sense_asc_ascq(ptp, SPC_SK_ILLEGAL_REQUEST,
+                          PARAMETER_LIST_LENGTH_ERR, 0, vb);
+        return 0;
+    }
+    bd_len = sg_get_unaligned_be16(bp + 2);
+    if (bd_len > (pl_len - 8))
+        bd_len = pl_len - 8;
+    num_d = bd_len / 16;
+    rng_arr = sg_memalign(SG_NVME_DSM_MAX_RANGES * 16, 0, &free_rng_arr,
+                          false);
+    if (NULL == rng_arr)
+        return sg_convert_errno(ENOMEM);
+    for (k = 0, n = 0, res = 0, bp += 8; k < num_d; ++k, bp += 16) {
+        nblks = sg_get_unaligned_be32(bp + 8);
+        if (0 == nblks)
+            continue;
+        rp = rng_arr + (n * 16);
+        sg_put_unaligned_le32(0, rp + 0);       /* context attributes */
+        sg_put_unaligned_le32(nblks, rp + 4);
+        sg_put_unaligned_le64(sg_get_unaligned_be64(bp + 0), rp + 8);
+        if (++n < SG_NVME_DSM_MAX_RANGES)
+            continue;
+        res = sntl_dsm_dealloc(ptp, rng_arr, n, time_secs, vb);
+        n = 0;
+        if (res)
+            break;
+    }
+    if ((0 == res) && (n > 0))
+        res = sntl_dsm_dealloc(ptp, rng_arr, n, time_secs, vb);
+    free(free_rng_arr);
+    if (SG_LIB_NVME_STATUS == res) {
+        mk_sense_from_nvme_status(ptp, vb);
+        return 0;
+    }
+    return res;
+}
+
+/* Appends LBA status descriptors covering num blocks from lba to arr which
+ * holds *offp bytes and has room for mx_len. A SCSI descriptor covers at
+ * most 0xffffffff blocks so longer extents take several. Returns false
+ * (with the descriptors that fit appended) when arr is full. */
+static bool
+sntl_glbas_add(uint8_t * arr, int * offp, int mx_len, uint64_t lba,
+               uint64_t num, int prov_stat, int add_stat)
+{
+    uint32_t n;
+    uint8_t * bp;
+
+    while (num > 0) {
+        if (*offp + 16 > mx_len)
+            return false;
+        n = (num > 0xffffffff) ? 0xffffffff : (uint32_t)num;
+        bp = arr + *offp;
+        memset(bp, 0, 16);
+        sg_put_unaligned_be64(lba, bp + 0);
+        sg_put_unaligned_be32(n, bp + 8);
+        bp[12] = prov_stat & 0xf;
+        bp[13] = add_stat;
+        *offp += 16;
+        lba += n;
+        num -= n;
+    }
+    return true;
+}
+
+/* SCSI GET LBA STATUS(16) and (32). NVMe has no command reporting which
+ * LBAs are allocated, so the provisioning status of every LBA is "mapped
+ * or unknown" unless the namespace is thin provisioned and has nothing
+ * allocated (NUSE is 0), when all are deallocated. What NVMe does have is
+ * Get LBA Status, which returns the tracked potentially unrecoverable
+ * LBAs; those become descriptors with the additional status "may contain
+ * unrecovered errors" (report types 0 and 10h). Descriptors run from the
+ * starting LBA to the end of the namespace or of the scan length. */
+static int
+sntl_get_lba_status(struct sg_pt_linux_scsi * ptp, const uint8_t * cdbp,
+                    int time_secs, int vb)
+{
+    bool is_32 = (SCSI_VARIABLE_LEN_OPC == cdbp[0]);
+    bool want_pul, full;
+    int res, k, off, len, alloc_len, rt, rt_byte, prov_stat, compl_cond;
+    uint32_t scan_len, nld, dlen;
+    uint32_t pg_sz = sg_get_page_size();
+    uint64_t lba, end_lba, nsze, cur, d_lba, d_end;
+    const uint8_t * dp;
+    uint8_t * up = NULL;
+    uint8_t * arr = NULL;
+    uint8_t * free_up = NULL;
+    uint8_t * free_arr = NULL;
+    struct sg_nvme_passthru_cmd cmd;
+
+    if (is_32) {
+        rt = cdbp[10];
+        rt_byte = 10;
+        lba = sg_get_unaligned_be64(cdbp + 12);
+        scan_len = sg_get_unaligned_be32(cdbp + 20);
+        alloc_len = (int)sg_get_unaligned_be32(cdbp + 28);
+        if (sg_get_unaligned_be32(cdbp + 24)) {     /* ELEMENT IDENTIFIER */
+            mk_sense_invalid_fld(ptp, true, 24, -1, vb);
+            return 0;
+        }
+    } else {
+        rt = cdbp[14];
+        rt_byte = 14;
+        lba = sg_get_unaligned_be64(cdbp + 2);
+        scan_len = 0;
+        alloc_len = (int)sg_get_unaligned_be32(cdbp + 10);
+    }
+    if (vb > 5)
+        pr2ws("%s: GLBAS%d, lba=0x%" PRIx64 ", rt=0x%x, scan_len=%u, "
+              "alloc_len=%d\n", __func__, (is_32 ? 32 : 16), lba, rt,
+              scan_len, alloc_len);
+    switch (rt) {
+    case 0x0:   /* all LBAs */
+    case 0x1:   /* non-zero provisioning status */
+    case 0x2:   /* mapped */
+    case 0x3:   /* deallocated */
+    case 0x4:   /* anchored */
+    case 0x10:  /* may return unrecovered errors */
+        break;
+    default:
+        mk_sense_invalid_fld(ptp, true, rt_byte, -1, vb);
+        return 0;
+    }
+    if (alloc_len <= 0)
+        return 0;
+    up = sg_memalign(pg_sz, pg_sz, &free_up, false);
+    arr = sg_memalign(pg_sz, pg_sz, &free_arr, false);
+    if ((NULL == up) || (NULL == arr)) {
+        pr2ws("%s: sg_memalign() failed to get memory\n", __func__);
+        res = sg_convert_errno(ENOMEM);
+        goto fini;
+    }
+    res = sntl_identify_ns(ptp, time_secs, pg_sz, up, vb);
+    if (res)
+        goto nvme_res;
+    nsze = sg_get_unaligned_le64(up + 0);
+    if (lba >= nsze) {
+        mk_sense_asc_ascq(ptp, SPC_SK_ILLEGAL_REQUEST, LBA_OUT_OF_RANGE, 0,
+                          vb);
+        goto fini;
+    }
+    if (scan_len && (scan_len < (nsze - lba))) {
+        end_lba = lba + scan_len;
+        compl_cond = 2;         /* met scan length */
+    } else {
+        end_lba = nsze;
+        compl_cond = 3;         /* met capacity of medium */
+    }
+    prov_stat = ((SG_NVME_NSFEAT_THINP & up[24]) &&
+                 (0 == sg_get_unaligned_le64(up + 16))) ? 1 : 0;
+
+    /* tracked potentially unrecoverable LBAs, if the controller has them */
+    nld = 0;
+    want_pul = ((0x0 == rt) || (0x10 == rt));
+    if (want_pul && (NULL == ptp->nvme_id_ctlp)) {
+        res = sntl_cache_identify(ptp, time_secs, vb);
+        if (res)
+            goto nvme_res;
+    }
+    if (want_pul && (SG_NVME_OACS_GLS &
+                     sg_get_unaligned_le16(ptp->nvme_id_ctlp + 256))) {
+        dlen = pg_sz;
+        memset(&cmd, 0, sizeof(cmd));
+        cmd.opcode = SG_NVME_AD_GET_LBA_STATUS;
+        cmd.nsid = ptp->nvme_nsid;
+        cmd.addr = (uint64_t)(sg_uintptr_t)up;
+        cmd.data_len = dlen;
+        cmd.cdw10 = (uint32_t)lba;
+        cmd.cdw11 = (uint32_t)(lba >> 32);
+        cmd.cdw12 = (dlen / 4) - 1;     /* MNDW, "0's based" */
+        /* RL (range length) 0: to the end of the namespace */
+        cmd.cdw13 = (SG_NVME_GLS_ATYPE_TRACKED << 24);
+        res = sg_nvme_admin_cmd_f(ptp, &cmd, up, true, time_secs, vb);
+        if (0 == res) {
+            nld = sg_get_unaligned_le32(up + 0);
+            if (nld > ((dlen - 8) / 16))
+                nld = (dlen - 8) / 16;
+        } else if (SG_LIB_NVME_STATUS == res) {
+            /* the SCSI command still succeeds, just without them */
+            if (vb > 2)
+                pr2ws("%s: Get LBA Status failed, unrecovered LBAs not "
+                      "reported\n", __func__);
+            ptp->nvme_status = 0;
+            ptp->nvme_stat_dnr = false;
+            ptp->nvme_stat_more = false;
+            res = 0;
+        } else
+            goto nvme_res;
+    }
+
+    /* build the SCSI parameter data, descriptors start at offset 8 */
+    memset(arr, 0, 8);
+    off = 8;
+    full = false;
+    cur = lba;
+    for (k = 0, dp = up + 8; (k < (int)nld) && (! full); ++k, dp += 16) {
+        d_lba = sg_get_unaligned_le64(dp + 0);
+        d_end = d_lba + sg_get_unaligned_le32(dp + 8);
+        if (d_lba < cur)
+            d_lba = cur;
+        if (d_end > end_lba)
+            d_end = end_lba;
+        if (d_lba >= d_end)
+            continue;
+        if ((0x0 == rt) && (cur < d_lba))
+            full = ! sntl_glbas_add(arr, &off, pg_sz, cur, d_lba - cur,
+                                    prov_stat, 0);
+        if (! full)
+            full = ! sntl_glbas_add(arr, &off, pg_sz, d_lba, d_end - d_lba,
+                                    prov_stat, 1);
+        cur = d_end;
+    }
+    if ((! full) && (cur < end_lba)) {
+        switch (rt) {
+        case 0x0:
+            full = ! sntl_glbas_add(arr, &off, pg_sz, cur, end_lba - cur,
+                                    prov_stat, 0);
+            break;
+        case 0x1:
+        case 0x3:
+            if (prov_stat)
+                full = ! sntl_glbas_add(arr, &off, pg_sz, cur,
+                                        end_lba - cur, prov_stat, 0);
+            break;
+        case 0x2:
+            if (0 == prov_stat)
+                full = ! sntl_glbas_add(arr, &off, pg_sz, cur,
+                                        end_lba - cur, prov_stat, 0);
+            break;
+        default:        /* anchored: none; 10h: done above */
+            break;
+        }
+    }
+    if (full || (off > alloc_len))
+        compl_cond = 1;         /* met allocation length */
+    sg_put_unaligned_be32(off - 4, arr + 0);
+    arr[7] = (compl_cond << 1) | 0x1;   /* RTP: report type processed */
+    len = ptp->io_hdr.din_xfer_len;
+    len = (len < alloc_len) ? len : alloc_len;
+    len = (len < off) ? len : off;
+    ptp->io_hdr.din_resid = ptp->io_hdr.din_xfer_len - len;
+    if (len > 0)
+        memcpy((uint8_t *)(sg_uintptr_t)ptp->io_hdr.din_xferp, arr, len);
+    goto fini;
+nvme_res:
+    if (SG_LIB_NVME_STATUS == res) {
+        mk_sense_from_nvme_status(ptp, vb);
+        res = 0;
+    } else if (res < 0)
+        res = sg_convert_errno(-res);
+fini:
+    free(free_up);
+    free(free_arr);
+    return res;
+}
+
+/* Fetches the namespace size (NSZE) and, from the Zoned Namespace Command
+ * Set specific Identify namespace data, the zone size (ZSZE) of the LBA
+ * format in use. *zszep is 0 if the namespace is not zoned. Returns 0,
+ * SG_LIB_NVME_STATUS or a negated errno. */
+static int
+sntl_zns_geom(struct sg_pt_linux_scsi * ptp, int time_secs, uint64_t * nszep,
+              uint64_t * zszep, int vb)
+{
+    int res, fmt;
+    uint32_t pg_sz = sg_get_page_size();
+    uint8_t * up;
+    uint8_t * free_up = NULL;
+    struct sg_nvme_passthru_cmd cmd;
+
+    *zszep = 0;
+    up = sg_memalign(pg_sz, pg_sz, &free_up, false);
+    if (NULL == up)
+        return -ENOMEM;
+    res = sntl_identify_ns(ptp, time_secs, pg_sz, up, vb);
+    if (res)
+        goto fini;
+    *nszep = sg_get_unaligned_le64(up + 0);
+    fmt = up[26] & 0xf;                 /* FLBAS: LBA format in use */
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.opcode = SG_NVME_AD_IDENTIFY;
+    cmd.nsid = ptp->nvme_nsid;
+    cmd.cdw10 = 0x5;                    /* CNS: I/O command set specific */
+    cmd.cdw11 = (SG_NVME_CSI_ZNS << 24);
+    cmd.addr = (uint64_t)(sg_uintptr_t)up;
+    cmd.data_len = pg_sz;
+    res = sg_nvme_admin_cmd_f(ptp, &cmd, up, true, time_secs, vb);
+    if (0 == res)       /* LBAFE[fmt] follows at byte 2816, 16 bytes each */
+        *zszep = sg_get_unaligned_le64(up + 2816 + (16 * fmt));
+fini:
+    free(free_up);
+    return res;
+}
+
+/* Appends a 64 byte SCSI zone descriptor at arr + *offp if there is room
+ * (arr holds mx_len bytes) and counts it in *nump. */
+static void
+sntl_zone_desc(uint8_t * arr, int * offp, int mx_len, uint32_t * nump,
+               int zt, int zc, bool reset, uint64_t len, uint64_t start,
+               uint64_t wp)
+{
+    uint8_t * bp;
+
+    ++*nump;
+    if (*offp + 64 > mx_len)
+        return;
+    bp = arr + *offp;
+    memset(bp, 0, 64);
+    bp[0] = zt & 0xf;
+    bp[1] = ((zc & 0xf) << 4) | (reset ? 0x1 : 0x0);
+    sg_put_unaligned_be64(len, bp + 8);
+    sg_put_unaligned_be64(start, bp + 16);
+    sg_put_unaligned_be64(wp, bp + 24);
+    *offp += 64;
+}
+
+/* SCSI REPORT ZONES becomes NVMe Zone Management Receive (basic report)
+ * with as large a buffer as the controller's MDTS allows, up to 1 MiB. The
+ * ZNS zone states and the ZBC zone conditions have the same values. ZBC
+ * has no zone capacity: a zone whose capacity (ZCAP) is less than its
+ * size is reported as a sequential write required zone of ZCAP blocks
+ * followed by a gap zone for the rest. The zone start LBA is rounded down
+ * to a zone boundary. */
+static int
+sntl_report_zones(struct sg_pt_linux_scsi * ptp, const uint8_t * cdbp,
+                  int time_secs, int vb)
+{
+    bool partial = !!(0x80 & cdbp[14]);
+    bool want_swr, want_gap, rzr_only, gap_seen, full, by_state;
+    int res, k, off, len, alloc_len, ro, zrasf, mx_len, arr_len, rlen;
+    uint32_t num, nz, nz_all, fit, skipped;
+    uint64_t lba, slba, nsze, zsze, zcap, zslba, wp, nvme_total;
+    uint64_t mdts_bytes;
+    const uint8_t * dp;
+    uint8_t * arr = NULL;
+    uint8_t * rbuf = NULL;
+    uint8_t * free_arr = NULL;
+    uint8_t * free_rbuf = NULL;
+    struct sg_nvme_passthru_cmd cmd;
+
+    lba = sg_get_unaligned_be64(cdbp + 2);
+    alloc_len = (int)sg_get_unaligned_be32(cdbp + 10);
+    ro = cdbp[14] & 0x3f;
+    if (vb > 5)
+        pr2ws("%s: lba=0x%" PRIx64 ", alloc_len=%d, partial=%d, ro=0x%x\n",
+              __func__, lba, alloc_len, (int)partial, ro);
+    zrasf = 0;
+    want_swr = true;
+    want_gap = false;
+    rzr_only = false;
+    switch (ro) {
+    case 0x0:           /* all zones */
+        want_gap = true;
+        break;
+    case 0x1: case 0x2: case 0x3: case 0x4:
+    case 0x5: case 0x6: case 0x7:
+        zrasf = ro;     /* empty ... offline, same values as ZNS ZRASF */
+        break;
+    case 0x8:           /* inactive: ZNS has none */
+    case 0x11:          /* non-sequential write resources active: none */
+        want_swr = false;
+        break;
+    case 0x10:          /* RWP recommended: ZNS "Reset Zone Recommended" */
+        rzr_only = true;
+        break;
+    case 0x3e:          /* all but gap zones */
+        break;
+    case 0x3f:          /* not write pointer: the gap zones */
+        want_swr = false;
+        want_gap = true;
+        break;
+    default:
+        mk_sense_invalid_fld(ptp, true, 14, -1, vb);
+        return 0;
+    }
+    res = sntl_zns_geom(ptp, time_secs, &nsze, &zsze, vb);
+    if ((SG_LIB_NVME_STATUS == res) || ((0 == res) && (0 == zsze))) {
+        if (vb > 2)
+            pr2ws("%s: not a zoned namespace\n", __func__);
+        mk_sense_asc_ascq(ptp, SPC_SK_ILLEGAL_REQUEST, INVALID_OPCODE, 0,
+                          vb);
+        return 0;
+    } else if (res)
+        return (res < 0) ? sg_convert_errno(-res) : res;
+    if (lba >= nsze) {
+        mk_sense_asc_ascq(ptp, SPC_SK_ILLEGAL_REQUEST, LBA_OUT_OF_RANGE, 0,
+                          vb);
+        return 0;
+    }
+    len = ptp->io_hdr.din_xfer_len;
+    mx_len = (len < alloc_len) ? len : alloc_len;
+    if (mx_len <= 0)
+        return 0;
+    arr_len = (mx_len < 64) ? 64 : mx_len;
+    arr = sg_memalign(arr_len, 0, &free_arr, false);
+    if (NULL == arr) {
+        res = sg_convert_errno(ENOMEM);
+        goto fini;
+    }
+    /* receive buffer: no more than one command (MDTS) can move */
+    rlen = SG_NVME_ZMR_MAX_LEN;
+    if (NULL == ptp->nvme_id_ctlp)
+        sntl_cache_identify(ptp, time_secs, vb);
+    if (ptp->nvme_id_ctlp && (ptp->nvme_id_ctlp[77] > 0) &&
+        (ptp->nvme_id_ctlp[77] < 32)) {
+        mdts_bytes = (uint64_t)4096 << ptp->nvme_id_ctlp[77];
+        if (mdts_bytes < (uint64_t)rlen)
+            rlen = (int)mdts_bytes;
+    }
+    if (partial && (rlen > (arr_len + 64)))
+        rlen = arr_len + 64;    /* room for a first zone split in two */
+    rbuf = sg_memalign(rlen, 0, &free_rbuf, false);
+    if (NULL == rbuf) {
+        res = sg_convert_errno(ENOMEM);
+        goto fini;
+    }
+    fit = (rlen - 64) / 64;
+
+    memset(arr, 0, 64);
+    off = 64;
+    num = 0;
+    gap_seen = false;
+    nvme_total = 0;
+    skipped = 0;
+    /* a zone state filter is done by the device, so it gives the count */
+    by_state = (zrasf > 0);
+    slba = lba - (lba % zsze);
+    full = false;
+    while (want_swr || want_gap) {
+        memset(&cmd, 0, sizeof(cmd));
+        cmd.opcode = SG_NVME_NVM_ZONE_MGMT_RECV;
+        cmd.nsid = ptp->nvme_nsid;
+        cmd.addr = (uint64_t)(sg_uintptr_t)rbuf;
+        cmd.data_len = rlen;
+        cmd.cdw10 = (uint32_t)slba;
+        cmd.cdw11 = (uint32_t)(slba >> 32);
+        cmd.cdw12 = (rlen / 4) - 1;     /* NUMD, "0's based" */
+        /* ZRA 0: report zones; partial report 0: count all that match */
+        cmd.cdw13 = (zrasf << 8);
+        res = do_nvm_pt_low(ptp, &cmd, rbuf, rlen, true, time_secs, vb);
+        if (res)
+            break;
+        nz_all = (uint32_t)sg_get_unaligned_le64(rbuf + 0);
+        if (0 == nvme_total)
+            nvme_total = nz_all;
+        nz = (nz_all > fit) ? fit : nz_all;
+        if (0 == nz)
+            break;
+        for (k = 0, dp = rbuf + 64; k < (int)nz; ++k, dp += 64) {
+            zcap = sg_get_unaligned_le64(dp + 8);
+            zslba = sg_get_unaligned_le64(dp + 16);
+            wp = sg_get_unaligned_le64(dp + 24);
+            if ((0 == zcap) || (zcap > zsze))
+                zcap = zsze;
+            switch (dp[1] >> 4) {
+            case 0xd:           /* read only */
+            case 0xe:           /* full */
+            case 0xf:           /* offline */
+                wp = UINT64_MAX;        /* not valid */
+                break;
+            default:
+                break;
+            }
+            /* skip the first zone if the start LBA is in its gap */
+            if (lba >= (zslba + zcap))
+                ++skipped;
+            else if (want_swr && ((! rzr_only) || (SG_NVME_ZA_RZR & dp[2])))
+                sntl_zone_desc(arr, &off, arr_len, &num, dp[0] & 0xf,
+                               dp[1] >> 4, !!(SG_NVME_ZA_RZR & dp[2]), zcap,
+                               zslba, wp);
+            if (want_gap && (zcap < zsze)) {
+                gap_seen = true;
+                sntl_zone_desc(arr, &off, arr_len, &num, 0x5 /* gap */,
+                               0x0, false, zsze - zcap, zslba + zcap,
+                               UINT64_MAX);
+            }
+            slba = zslba + zsze;
+        }
+        full = (off + 64 > arr_len);
+        if ((nz_all <= fit) || (slba >= nsze))
+            break;              /* that was the last */
+        if (full && (partial || by_state))
+            break;              /* no need to count the rest */
+    }
+    if (SG_LIB_NVME_STATUS == res) {
+        mk_sense_from_nvme_status(ptp, vb);
+        res = 0;
+        goto fini;
+    } else if (res) {
+        if (res < 0)
+            res = sg_convert_errno(-res);
+        goto fini;
+    }
+    if (by_state && (! partial))
+        num = (uint32_t)nvme_total - skipped;
+    else if (partial)
+        num = (off - 64) / 64;
+    sg_put_unaligned_be32((num > (0xffffffff / 64)) ? 0xffffffc0 : num * 64,
+                          arr + 0);
+    arr[4] = gap_seen ? 0x0 : 0x1;      /* SAME */
+    sg_put_unaligned_be64(nsze - 1, arr + 8);   /* Maximum LBA */
+    sg_put_unaligned_be64(zsze, arr + 16);      /* RZSLBAG */
+    len = (off < mx_len) ? off : mx_len;
+    ptp->io_hdr.din_resid = ptp->io_hdr.din_xfer_len - len;
+    memcpy((uint8_t *)(sg_uintptr_t)ptp->io_hdr.din_xferp, arr, len);
+fini:
+    free(free_arr);
+    free(free_rbuf);
+    return res;
+}
+
+/* SCSI CLOSE, FINISH and OPEN ZONE and RESET WRITE POINTER become NVMe
+ * Zone Management Send with the same action value. ALL becomes Select
+ * All. A ZONE COUNT greater than one acts on that many consecutive zones,
+ * one command each; a gap zone (see sntl_report_zones()) cannot be given
+ * as the ZONE ID and is not counted. */
+static int
+sntl_zbc_out(struct sg_pt_linux_scsi * ptp, const uint8_t * cdbp,
+             int time_secs, int vb)
+{
+    bool all = !!(0x1 & cdbp[14]);
+    int sa = cdbp[1] & SCSI_SA_MSK;
+    int res;
+    uint32_t k, count;
+    uint64_t lba, nsze, zsze;
+    struct sg_nvme_passthru_cmd cmd;
+
+    lba = sg_get_unaligned_be64(cdbp + 2);
+    count = sg_get_unaligned_be16(cdbp + 12);
+    if (vb > 5)
+        pr2ws("%s: sa=0x%x, zone_id=0x%" PRIx64 ", count=%u, all=%d\n",
+              __func__, sa, lba, count, (int)all);
+    res = sntl_zns_geom(ptp, time_secs, &nsze, &zsze, vb);
+    if ((SG_LIB_NVME_STATUS == res) || ((0 == res) && (0 == zsze))) {
+        if (vb > 2)
+            pr2ws("%s: not a zoned namespace\n", __func__);
+        mk_sense_asc_ascq(ptp, SPC_SK_ILLEGAL_REQUEST, INVALID_OPCODE, 0,
+                          vb);
+        return 0;
+    } else if (res)
+        return (res < 0) ? sg_convert_errno(-res) : res;
+    if (all)
+        count = 1;
+    else {
+        if (lba >= nsze) {
+            mk_sense_asc_ascq(ptp, SPC_SK_ILLEGAL_REQUEST, LBA_OUT_OF_RANGE,
+                              0, vb);
+            return 0;
+        }
+        if (lba % zsze) {       /* not the start of a zone */
+            mk_sense_invalid_fld(ptp, true, 2, -1, vb);
+            return 0;
+        }
+        if (0 == count)
+            count = 1;
+        if (count > ((nsze - lba + zsze - 1) / zsze)) {
+            mk_sense_invalid_fld(ptp, true, 12, -1, vb);
+            return 0;
+        }
+    }
+    for (k = 0; k < count; ++k, lba += zsze) {
+        memset(&cmd, 0, sizeof(cmd));
+        cmd.opcode = SG_NVME_NVM_ZONE_MGMT_SEND;
+        cmd.nsid = ptp->nvme_nsid;
+        if (! all) {
+            cmd.cdw10 = (uint32_t)lba;
+            cmd.cdw11 = (uint32_t)(lba >> 32);
+        }
+        cmd.cdw13 = sa | (all ? SG_NVME_ZMS_SELECT_ALL : 0);
+        res = do_nvm_pt_low(ptp, &cmd, NULL, 0, false, time_secs, vb);
+        if (res)
+            break;
+    }
+    if (SG_LIB_NVME_STATUS == res) {
+        mk_sense_from_nvme_status(ptp, vb);
+        return 0;
+    }
+    return (res < 0) ? sg_convert_errno(-res) : res;
+}
+
+static int
+sntl_start_stop(struct sg_pt_linux_scsi * ptp, const uint8_t * cdbp,
+                int time_secs, int vb)
+{
+    bool immed = !!(0x1 & cdbp[1]);
+
+    if (vb > 5)
+        pr2ws("%s: immed=%d, time_secs=%d, ignore\n", __func__, (int)immed,
+              time_secs);
+    if (ptp) { }        /* suppress warning */
+    return 0;
+}
+
+/* Builds a NVMe pass-through command from the 64 byte NVMe command and the
+ * data-in or data-out buffer held in ptp. Returns 0 if okay, else
+ * SCSI_PT_DO_BAD_PARAMS. */
+static int
+nvme_admin_cmd_from_obj(const struct sg_pt_linux_scsi * ptp,
+                        struct sg_nvme_passthru_cmd * cmdp, void ** dpp,
+                        bool * is_readp, int vb)
+{
+    int n = ptp->io_hdr.request_len;
+    int len = (int)sizeof(*cmdp);
+
+    n = (n < len) ? n : len;
+    if (n < 64) {
+        if (vb)
+            pr2ws("%s: command length of %d bytes is too short\n", __func__,
+                  n);
+        return SCSI_PT_DO_BAD_PARAMS;
+    }
+    memcpy(cmdp, (const uint8_t *)(sg_uintptr_t)ptp->io_hdr.request, n);
+    if (n < len)        /* zero out rest of 'cmd' */
+        memset((uint8_t *)cmdp + n, 0, len - n);
+    *dpp = NULL;
+    *is_readp = false;
+    if (ptp->io_hdr.din_xfer_len > 0) {
+        cmdp->data_len = ptp->io_hdr.din_xfer_len;
+        *dpp = (void *)(sg_uintptr_t)ptp->io_hdr.din_xferp;
+        cmdp->addr = (uint64_t)(sg_uintptr_t)ptp->io_hdr.din_xferp;
+        *is_readp = true;
+    } else if (ptp->io_hdr.dout_xfer_len > 0) {
+        cmdp->data_len = ptp->io_hdr.dout_xfer_len;
+        *dpp = (void *)(sg_uintptr_t)ptp->io_hdr.dout_xferp;
+        cmdp->addr = (uint64_t)(sg_uintptr_t)ptp->io_hdr.dout_xferp;
+    }
+    return 0;
+}
+
+/* Executes NVMe Admin command (or at least forwards it to lower layers).
+ * Returns 0 for success, negative numbers are negated 'errno' values from
+ * OS system calls. Positive return values are errors from this package.
+ * When time_secs is 0 the Linux NVMe Admin command default of 60 seconds
+ * is used. */
+int
+sg_do_nvme_pt(struct sg_pt_base * vp, int fd, int time_secs, int vb)
+{
+    bool scsi_cdb;
+    bool is_read = false;
+    int n, hold_dev_fd;
+    uint16_t sa;
+    struct sg_pt_linux_scsi * ptp = &vp->impl;
+    struct sg_nvme_passthru_cmd cmd;
+    const uint8_t * cdbp;
+    void * dp = NULL;
+
+    if (! ptp->io_hdr.request) {
+        if (vb)
+            pr2ws("No NVMe command given (set_scsi_pt_cdb())\n");
         return SCSI_PT_DO_BAD_PARAMS;
     }
     hold_dev_fd = ptp->dev_fd;
@@ -1753,6 +2618,20 @@ sg_do_nvme_pt(struct sg_pt_base * vp, int fd, int time_secs, int vb)
     if (vb > 4)
         pr2ws("%s: opcode=0x%x, fd=%d (dev_fd=%d), time_secs=%d\n", __func__,
               cdbp[0], fd, hold_dev_fd, time_secs);
+    if ((10 == n) || (16 == n)) {       /* fast path for data transfers */
+        switch (cdbp[0]) {
+        case SCSI_READ10_OPC:
+        case SCSI_READ16_OPC:
+            ptp->nvme_our_sntl = true;
+            return sntl_rw(ptp, cdbp, true, time_secs, vb);
+        case SCSI_WRITE10_OPC:
+        case SCSI_WRITE16_OPC:
+            ptp->nvme_our_sntl = true;
+            return sntl_rw(ptp, cdbp, false, time_secs, vb);
+        default:
+            break;
+        }
+    }
     scsi_cdb = sg_is_scsi_cdb(cdbp, n);
     /* direct NVMe command (i.e. 64 bytes long) or SNTL */
     ptp->nvme_our_sntl = scsi_cdb;
@@ -1768,10 +2647,10 @@ sg_do_nvme_pt(struct sg_pt_base * vp, int fd, int time_secs, int vb)
             return sntl_req_sense(ptp, cdbp, time_secs, vb);
         case SCSI_READ10_OPC:
         case SCSI_READ16_OPC:
-            return sntl_rread(ptp, cdbp, time_secs, vb);
+            return sntl_rw(ptp, cdbp, true, time_secs, vb);
         case SCSI_WRITE10_OPC:
         case SCSI_WRITE16_OPC:
-            return sntl_write(ptp, cdbp, time_secs, vb);
+            return sntl_rw(ptp, cdbp, false, time_secs, vb);
         case SCSI_START_STOP_OPC:
             return sntl_start_stop(ptp, cdbp, time_secs, vb);
         case SCSI_SEND_DIAGNOSTIC_OPC:
@@ -1792,9 +2671,27 @@ sg_do_nvme_pt(struct sg_pt_base * vp, int fd, int time_secs, int vb)
         case SCSI_SYNC_CACHE10_OPC:
         case SCSI_SYNC_CACHE16_OPC:
             return sntl_sync_cache(ptp, cdbp, time_secs, vb);
+        case SCSI_UNMAP_OPC:
+            return sntl_unmap(ptp, cdbp, time_secs, vb);
         case SCSI_SERVICE_ACT_IN_OPC:
             if (SCSI_READ_CAPACITY16_SA == (cdbp[1] & SCSI_SA_MSK))
                 return sntl_readcap(ptp, cdbp, time_secs, vb);
+            if (SCSI_GET_LBA_STATUS16_SA == (cdbp[1] & SCSI_SA_MSK))
+                return sntl_get_lba_status(ptp, cdbp, time_secs, vb);
+            goto fini;
+        case SCSI_ZBC_IN_OPC:
+            if (SCSI_REPORT_ZONES_SA == (cdbp[1] & SCSI_SA_MSK))
+                return sntl_report_zones(ptp, cdbp, time_secs, vb);
+            goto fini;
+        case SCSI_ZBC_OUT_OPC:
+            sa = SCSI_SA_MSK & cdbp[1];
+            if ((sa >= 0x1) && (sa <= 0x4))     /* close ... reset WP */
+                return sntl_zbc_out(ptp, cdbp, time_secs, vb);
+            goto fini;
+        case SCSI_VARIABLE_LEN_OPC:
+            if ((n >= 32) && (SCSI_GET_LBA_STATUS32_SA ==
+                              sg_get_unaligned_be16(cdbp + 8)))
+                return sntl_get_lba_status(ptp, cdbp, time_secs, vb);
             goto fini;
         case SCSI_MAINT_IN_OPC:
             sa = SCSI_SA_MSK & cdbp[1];        /* service action */
@@ -1817,29 +2714,76 @@ fini:
             return 0;
         }
     }
-    len = (int)sizeof(cmd);
-    n = (n < len) ? n : len;
-    if (n < 64) {
+    n = nvme_admin_cmd_from_obj(ptp, &cmd, &dp, &is_read, vb);
+    if (n)
+        return n;
+    return sg_nvme_admin_cmd_f(ptp, &cmd, dp, is_read, time_secs, vb);
+}
+
+/* Queues the NVMe command held in vp on the io_uring engine, it is
+ * actually submitted to the kernel by the next sg_nvme_pt_receive() (or
+ * when the submission queue fills). If 'admin' is false the command is
+ * sent to the NVM command set (as in do_nvm_pt()). Only direct NVMe
+ * commands (i.e. not SCSI commands which need the SNTL) are accepted.
+ * Returns 0 if okay, otherwise values as for do_scsi_pt(). */
+int
+sg_nvme_pt_submit(struct sg_pt_base * vp, bool admin, int time_secs, int vb)
+{
+    bool is_read = false;
+    int res;
+    struct sg_pt_linux_scsi * ptp = &vp->impl;
+    struct sg_nvme_passthru_cmd cmd;
+    void * dp = NULL;
+
+    if (! ptp->io_hdr.request) {
         if (vb)
-            pr2ws("%s: command length of %d bytes is too short\n", __func__,
-                  n);
+            pr2ws("No NVMe command given (set_scsi_pt_cdb())\n");
         return SCSI_PT_DO_BAD_PARAMS;
     }
-    memcpy(&cmd, (const uint8_t *)(sg_uintptr_t)ptp->io_hdr.request, n);
-    if (n < len)        /* zero out rest of 'cmd' */
-        memset((uint8_t *)&cmd + n, 0, len - n);
-    if (ptp->io_hdr.din_xfer_len > 0) {
-        cmd.data_len = ptp->io_hdr.din_xfer_len;
-        dp = (void *)(sg_uintptr_t)ptp->io_hdr.din_xferp;
-        cmd.addr = (uint64_t)(sg_uintptr_t)ptp->io_hdr.din_xferp;
-        is_read = true;
-    } else if (ptp->io_hdr.dout_xfer_len > 0) {
-        cmd.data_len = ptp->io_hdr.dout_xfer_len;
-        dp = (void *)(sg_uintptr_t)ptp->io_hdr.dout_xferp;
-        cmd.addr = (uint64_t)(sg_uintptr_t)ptp->io_hdr.dout_xferp;
-        is_read = false;
+    res = nvme_admin_cmd_from_obj(ptp, &cmd, &dp, &is_read, vb);
+    if (res)
+        return res;
+    if (! admin)
+        cmd.nsid = cmd.nsid ? cmd.nsid : ptp->nvme_nsid;
+    cmd.timeout_ms = (time_secs < 0) ? (-time_secs) : (1000 * time_secs);
+    ptp->nvme_our_sntl = false;
+    ptp->os_err = 0;
+    res = sg_uring_queue(ptp, &cmd, admin, vb);
+    if (res) {
+        ptp->os_err = -res;
+        return res;
     }
-    return sg_nvme_admin_cmd_f(ptp, &cmd, dp, is_read, time_secs, vb);
+    ptp->async_uring = true;
+    ptp->async_admin = admin;
+    return 0;
+}
+
+/* Fetches the completion of a command queued by sg_nvme_pt_submit(). If
+ * 'wait' is false and it has not completed then -EAGAIN is returned. */
+int
+sg_nvme_pt_receive(struct sg_pt_base * vp, bool wait, int vb)
+{
+    int res;
+    struct sg_pt_linux_scsi * ptp = &vp->impl;
+    const uint8_t * cdbp = (const uint8_t *)(sg_uintptr_t)ptp->io_hdr.request;
+    char nam[64];
+
+    res = sg_uring_reap(ptp, wait, vb);
+    if (-EAGAIN == res)
+        return res;
+    ptp->async_uring = false;
+    if (ptp->async_admin && nvme_admin_changes_cache(cdbp[0]))
+        sg_pt_nvme_cache_invalidate();
+    if (res) {
+        ptp->os_err = -res;
+        return res;
+    }
+    if (vb)
+        sg_get_nvme_opcode_name(cdbp[0], ptp->async_admin, sizeof(nam), nam);
+    else
+        nam[0] = '\0';
+    return nvme_pt_complete(ptp, ptp->uring_res, ptp->uring_result, cdbp[0],
+                            nam, __func__, vb);
 }
 
 #else           /* (HAVE_NVME && (! IGNORE_NVME)) [around line 140] */
@@ -1874,6 +2818,25 @@ sg_do_nvme_pt(struct sg_pt_base * vp, int fd, int time_secs, int vb)
     return -inapprop_errno;
 }
 
+int
+sg_nvme_pt_submit(struct sg_pt_base * vp, bool admin, int time_secs, int vb)
+{
+    if (vp) { }
+    if (admin) { }
+    if (time_secs) { }
+    if (vb) { }
+    return SCSI_PT_DO_NOT_SUPPORTED;
+}
+
+int
+sg_nvme_pt_receive(struct sg_pt_base * vp, bool wait, int vb)
+{
+    if (vp) { }
+    if (wait) { }
+    if (vb) { }
+    return SCSI_PT_DO_NOT_SUPPORTED;
+}
+
 #endif          /* (HAVE_NVME && (! IGNORE_NVME)) */
 
 #if (HAVE_NVME && (! IGNORE_NVME))
@@ -1882,7 +2845,7 @@ int
 do_nvm_pt(struct sg_pt_base * vp, int submq, int timeout_secs, int vb)
 {
     bool is_read = false;
-    int dlen;
+    int res, dlen, instr;
     struct sg_pt_linux_scsi * ptp = &vp->impl;
     struct sg_nvme_passthru_cmd cmd;
     uint8_t * cmdp = (uint8_t *)&cmd;
@@ -1909,6 +2872,11 @@ do_nvm_pt(struct sg_pt_base * vp, int submq, int timeout_secs, int vb)
         memset(cmdp + 64, 0, sizeof(cmd) - 64);
     memcpy(cmdp, (uint8_t *)(sg_uintptr_t)ptp->io_hdr.request, 64);
     ptp->nvme_our_sntl = false;
+    if (ptp->io_hdr.din_iovec_count || ptp->io_hdr.dout_iovec_count) {
+        res = sg_pt_iov_bounce_start(ptp, vb);
+        if (res)
+            return res;
+    }
 
     dlen = ptp->io_hdr.din_xfer_len;
     if (dlen > 0) {
@@ -1919,7 +2887,66 @@ do_nvm_pt(struct sg_pt_base * vp, int submq, int timeout_secs, int vb)
         if (dlen > 0)
             dp = (void *)(sg_uintptr_t)ptp->io_hdr.dout_xferp;
     }
-    return do_nvm_pt_low(ptp, &cmd, dp, dlen, is_read, timeout_secs, vb);
+    SG_USDT5(pt_submit, vp, ptp->dev_id, cmdp, 64, SG_PT_LAT_NVME_NVM);
+    instr = __atomic_load_n(&sg_pt_instr, __ATOMIC_RELAXED);
+    if (instr) {
+        uint64_t t_start;
+        void * priv = ptp->trace_priv;
+        sg_pt_trace_fn fn = ptp->trace_fn;
+        struct sg_pt_trace_rec rec;
+
+        if ((NULL == fn) && (SG_PT_INSTR_TRACE & instr))
+            fn = sg_pt_trace_get(&priv);
+        t_start = sg_pt_linux_now_ns();
+        if (fn) {
+            memset(&rec, 0, sizeof(rec));
+            sg_pt_trace_start(&rec, t_start);
+            rec.dev_id = ptp->dev_id;
+            rec.cmd_set = SG_PT_LAT_NVME_NVM;
+            rec.cmd_len = 64;
+            memcpy(rec.cmd, cmdp, 64);
+            if (is_read)
+                rec.din_len = dlen;
+            else
+                rec.dout_len = dlen;
+            fn(&rec, priv);
+        }
+        res = do_nvm_pt_low(ptp, &cmd, dp, dlen, is_read, timeout_secs, vb);
+        if (fn)
+            sg_pt_linux_trace_done(ptp, fn, priv, &rec, res,
+                                   sg_pt_linux_now_ns());
+        if (SG_PT_INSTR_LAT & instr)
+            sg_pt_lat_record(ptp->dev_id, cmd.opcode, SG_PT_LAT_NVME_NVM,
+                             (fn ? rec.ts_ns : sg_pt_linux_now_ns()) -
+                             t_start);
+    } else
+        res = do_nvm_pt_low(ptp, &cmd, dp, dlen, is_read, timeout_secs, vb);
+    sg_pt_iov_bounce_end(ptp);
+    SG_USDT5(pt_complete, vp, ptp->dev_id, res, ptp->nvme_status,
+             SG_PT_LAT_NVME_NVM);
+    return res;
+}
+
+/* Asynchronous version of do_nvm_pt(). Only asynchronous when the
+ * io_uring engine is in use (see sg_pt_linux_uring.c), otherwise the
+ * command is completed synchronously. */
+int
+do_nvm_pt_submit(struct sg_pt_base * vp, int submq, int timeout_secs, int vb)
+{
+    int res;
+    struct sg_pt_linux_scsi * ptp = &vp->impl;
+
+    ptp->async_done = false;
+    if (ptp->is_nvme && sg_uring_usable(ptp) && (ptp->dev_fd >= 0) &&
+        (0 == (ptp->io_hdr.din_iovec_count | ptp->io_hdr.dout_iovec_count)) &&
+        ptp->io_hdr.request && (64 == ptp->io_hdr.request_len)) {
+        if (vb && (submq != 0))
+            pr2ws("%s: warning, uses submit queue 0\n", __func__);
+        return sg_nvme_pt_submit(vp, false /* NVM */, timeout_secs, vb);
+    }
+    res = do_nvm_pt(vp, submq, timeout_secs, vb);
+    ptp->async_done = true;
+    return res;
 }
 
 #else           /* (HAVE_NVME && (! IGNORE_NVME)) */
@@ -1947,4 +2974,10 @@ do_nvm_pt(struct sg_pt_base * vp, int submq, int timeout_secs, int vb)
     return SCSI_PT_DO_NOT_SUPPORTED;
 }
 
+int
+do_nvm_pt_submit(struct sg_pt_base * vp, int submq, int timeout_secs, int vb)
+{
+    return do_nvm_pt(vp, submq, timeout_secs, vb);
+}
+
 #endif          /* (HAVE_NVME && (! IGNORE_NVME)) */
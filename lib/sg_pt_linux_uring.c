@@ -0,0 +1,791 @@
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/* sg_pt_linux_uring version 1.03 20261015 */
+
+/* This file contains an optional io_uring engine for the Linux NVMe
+ * pass-through. It uses IORING_OP_URING_CMD which the Linux kernel (from
+ * lk 5.19) supports on NVMe generic char devices (e.g. /dev/ng0n1). It is
+ * selected at runtime by defining the SG3_UTILS_LINUX_URING environment
+ * variable. Each thread that uses it gets its own ring which is set up on
+ * first use. Commands queued by do_scsi_pt_submit() or do_nvm_pt_submit()
+ * are not given to the kernel until the next io_uring_enter(2) so several
+ * commands can be submitted with one system call; completions are reaped
+ * in batches in the same way.
+ *
+ * There is no liburing dependency, the raw system calls are used. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "sg_pt.h"
+#include "sg_lib.h"
+#include "sg_linux_inc.h"
+#include "sg_pt_linux.h"
+#include "sg_pr2serr.h"
+
+#ifdef HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>
+#endif
+
+#if (HAVE_NVME && (! IGNORE_NVME)) && defined(HAVE_LINUX_IO_URING_H) && \
+    defined(IORING_SETUP_SQE128) && defined(IORING_SETUP_CQE32) && \
+    defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+#define SG_URING_DEF_ENTRIES 64
+
+/* copied from <linux/nvme_ioctl.h>, same layout as struct
+ * sg_nvme_passthru_cmd without the trailing result field */
+struct sg_nvme_uring_cmd {
+    uint8_t opcode;
+    uint8_t flags;
+    uint16_t rsvd1;
+    uint32_t nsid;
+    uint32_t cdw2;
+    uint32_t cdw3;
+    uint64_t metadata;
+    uint64_t addr;
+    uint32_t metadata_len;
+    uint32_t data_len;
+    uint32_t cdw10;
+    uint32_t cdw11;
+    uint32_t cdw12;
+    uint32_t cdw13;
+    uint32_t cdw14;
+    uint32_t cdw15;
+    uint32_t timeout_ms;
+    uint32_t rsvd2;
+};
+
+#ifndef NVME_URING_CMD_IO
+#define NVME_URING_CMD_IO       _IOWR('N', 0x80, struct sg_nvme_uring_cmd)
+#endif
+#ifndef NVME_URING_CMD_ADMIN
+#define NVME_URING_CMD_ADMIN    _IOWR('N', 0x82, struct sg_nvme_uring_cmd)
+#endif
+
+/* With IORING_SETUP_SQE128 and IORING_SETUP_CQE32 each submission queue
+ * entry is 128 bytes and each completion queue entry is 32 bytes. */
+#define SG_URING_SQE_SZ 128
+#define SG_URING_CQE_SZ 32
+
+struct sg_uring_t {
+    int ring_fd;
+    uint32_t sq_entries;
+    uint32_t to_submit;         /* placed in SQ but not yet given to kernel */
+    uint32_t in_flight;         /* given to kernel, no completion reaped */
+    uint32_t * sq_head;
+    uint32_t * sq_tail;
+    uint32_t * sq_mask;
+    uint32_t * sq_array;
+    uint32_t * cq_head;
+    uint32_t * cq_tail;
+    uint32_t * cq_mask;
+    uint8_t * sqes;
+    uint8_t * cqes;
+    void * sq_ptr;
+    void * cq_ptr;
+    size_t sq_sz;
+    size_t cq_sz;
+    size_t sqes_sz;
+};
+
+/* Completion of one of the commands sent by sg_uring_nvme_cmds(). The
+ * user_data of that command's SQE is this object's address with its low
+ * bit set, otherwise user_data is a struct sg_pt_linux_scsi pointer. */
+struct sg_uring_sub_t {
+    bool done;
+    int res;
+    uint32_t result;
+    int * num_donep;
+};
+
+/* sg_uring_env and sg_uring_key are set once by sg_uring_init(). The two
+ * broken flags may be set by any thread so they are accessed atomically. */
+static pthread_once_t sg_uring_once = PTHREAD_ONCE_INIT;
+static bool sg_uring_env = false;       /* SG3_UTILS_LINUX_URING is set */
+static bool sg_uring_key_ok = false;
+static pthread_key_t sg_uring_key;      /* its destructor frees the rings */
+static bool sg_uring_broken = false;    /* setup failed, don't try again */
+static bool sg_uring_pol_broken = false; /* IOPOLL ring or command failed */
+
+#define SG_UR_LD(x) __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define SG_UR_ST(x, v) __atomic_store_n(&(x), (v), __ATOMIC_RELAXED)
+
+/* One ring per thread so no locking is needed. A second ring, created
+ * with IORING_SETUP_IOPOLL, is used for NVM commands whose pt object has
+ * SCSI_PT_FLAGS_POLLED set. Both are torn down when the thread exits. */
+static __thread struct sg_uring_t * sg_urp;
+static __thread struct sg_uring_t * sg_urp_pol;
+
+
+static int
+sys_io_uring_setup(uint32_t entries, struct io_uring_params * p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int
+sys_io_uring_enter(int fd, uint32_t to_submit, uint32_t min_complete,
+                   uint32_t flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                        flags, NULL, 0);
+}
+
+static struct sg_uring_t *
+sg_uring_setup(bool iopoll, int vb)
+{
+    bool single_mmap;
+    int fd;
+    uint8_t * sqp;
+    uint8_t * cqp;
+    struct sg_uring_t * urp;
+    struct io_uring_params p;
+
+    urp = (struct sg_uring_t *)calloc(1, sizeof(*urp));
+    if (NULL == urp) {
+        if (vb)
+            pr2ws("%s: calloc() failed, out of memory?\n", __func__);
+        return NULL;
+    }
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_SQE128 | IORING_SETUP_CQE32;
+    if (iopoll)
+        p.flags |= IORING_SETUP_IOPOLL;
+    fd = sys_io_uring_setup(SG_URING_DEF_ENTRIES, &p);
+    if (fd < 0) {
+        if (vb)
+            pr2ws("%s: io_uring_setup() failed: %s\n", __func__,
+                  safe_strerror(errno));
+        goto err_out;
+    }
+    urp->ring_fd = fd;
+    urp->sq_entries = p.sq_entries;
+    urp->sq_sz = p.sq_off.array + (p.sq_entries * sizeof(uint32_t));
+    urp->cq_sz = p.cq_off.cqes + (p.cq_entries * SG_URING_CQE_SZ);
+    single_mmap = !! (p.features & IORING_FEAT_SINGLE_MMAP);
+    if (single_mmap) {
+        if (urp->cq_sz > urp->sq_sz)
+            urp->sq_sz = urp->cq_sz;
+        urp->cq_sz = urp->sq_sz;
+    }
+    urp->sq_ptr = mmap(NULL, urp->sq_sz, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (MAP_FAILED == urp->sq_ptr)
+        goto mmap_err;
+    if (single_mmap)
+        urp->cq_ptr = urp->sq_ptr;
+    else {
+        urp->cq_ptr = mmap(NULL, urp->cq_sz, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_POPULATE, fd,
+                           IORING_OFF_CQ_RING);
+        if (MAP_FAILED == urp->cq_ptr) {
+            urp->cq_ptr = NULL;
+            goto mmap_err;
+        }
+    }
+    urp->sqes_sz = p.sq_entries * SG_URING_SQE_SZ;
+    urp->sqes = (uint8_t *)mmap(NULL, urp->sqes_sz, PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_POPULATE, fd,
+                                IORING_OFF_SQES);
+    if (MAP_FAILED == (void *)urp->sqes) {
+        urp->sqes = NULL;
+        goto mmap_err;
+    }
+    sqp = (uint8_t *)urp->sq_ptr;
+    cqp = (uint8_t *)urp->cq_ptr;
+    urp->sq_head = (uint32_t *)(sqp + p.sq_off.head);
+    urp->sq_tail = (uint32_t *)(sqp + p.sq_off.tail);
+    urp->sq_mask = (uint32_t *)(sqp + p.sq_off.ring_mask);
+    urp->sq_array = (uint32_t *)(sqp + p.sq_off.array);
+    urp->cq_head = (uint32_t *)(cqp + p.cq_off.head);
+    urp->cq_tail = (uint32_t *)(cqp + p.cq_off.tail);
+    urp->cq_mask = (uint32_t *)(cqp + p.cq_off.ring_mask);
+    urp->cqes = cqp + p.cq_off.cqes;
+    if (vb > 3)
+        pr2ws("%s: ring_fd=%d, sq_entries=%u, cq_entries=%u%s\n", __func__,
+              fd, p.sq_entries, p.cq_entries, (iopoll ? ", iopoll" : ""));
+    return urp;
+
+mmap_err:
+    if (vb)
+        pr2ws("%s: mmap() of ring failed: %s\n", __func__,
+              safe_strerror(errno));
+    if (urp->sq_ptr && (MAP_FAILED != urp->sq_ptr))
+        munmap(urp->sq_ptr, urp->sq_sz);
+    if (urp->cq_ptr && (urp->cq_ptr != urp->sq_ptr))
+        munmap(urp->cq_ptr, urp->cq_sz);
+    close(fd);
+err_out:
+    free(urp);
+    return NULL;
+}
+
+/* Unmaps the rings and closes the ring file descriptor. Commands still in
+ * flight are cancelled by the kernel. */
+static void
+sg_uring_teardown(struct sg_uring_t * urp)
+{
+    if (NULL == urp)
+        return;
+    if (urp->sqes)
+        munmap(urp->sqes, urp->sqes_sz);
+    if (urp->cq_ptr && (urp->cq_ptr != urp->sq_ptr))
+        munmap(urp->cq_ptr, urp->cq_sz);
+    if (urp->sq_ptr)
+        munmap(urp->sq_ptr, urp->sq_sz);
+    close(urp->ring_fd);
+    free(urp);
+}
+
+/* Destructor of sg_uring_key, called at exit of each thread that set up a
+ * ring. Thread local storage is still valid at this point. */
+static void
+sg_uring_thread_dtor(void * arg)
+{
+    if (arg) { }
+    sg_uring_teardown(sg_urp);
+    sg_urp = NULL;
+    sg_uring_teardown(sg_urp_pol);
+    sg_urp_pol = NULL;
+}
+
+static void
+sg_uring_init(void)
+{
+    sg_uring_env = !! getenv("SG3_UTILS_LINUX_URING");
+    sg_uring_key_ok = (0 == pthread_key_create(&sg_uring_key,
+                                               sg_uring_thread_dtor));
+}
+
+static struct sg_uring_t *
+sg_uring_get(bool polled, int vb)
+{
+    struct sg_uring_t * urp;
+
+    if (polled) {
+        if (sg_urp_pol)
+            return sg_urp_pol;
+        if (SG_UR_LD(sg_uring_pol_broken))
+            return NULL;
+    } else {
+        if (sg_urp)
+            return sg_urp;
+        if (SG_UR_LD(sg_uring_broken))
+            return NULL;
+    }
+    pthread_once(&sg_uring_once, sg_uring_init);
+    urp = sg_uring_setup(polled, vb);
+    if (NULL == urp) {
+        if (polled)
+            SG_UR_ST(sg_uring_pol_broken, true);
+        else
+            SG_UR_ST(sg_uring_broken, true);
+        return NULL;
+    }
+    /* any non-NULL value makes the destructor run at thread exit */
+    if (sg_uring_key_ok)
+        pthread_setspecific(sg_uring_key, &sg_urp);
+    if (polled)
+        sg_urp_pol = urp;
+    else
+        sg_urp = urp;
+    return urp;
+}
+
+/* Returns true if the io_uring engine should be used for commands on ptp.
+ * Requires the SG3_UTILS_LINUX_URING environment variable and a NVMe
+ * generic char device. */
+bool
+sg_uring_usable(const struct sg_pt_linux_scsi * ptp)
+{
+    pthread_once(&sg_uring_once, sg_uring_init);
+    return sg_uring_env && ptp->is_nvme_gen &&
+           (! SG_UR_LD(sg_uring_broken));
+}
+
+/* Gives all queued SQEs to the kernel and waits for at least min_complete
+ * completions. Returns 0 or negated errno. */
+static int
+sg_uring_enter(struct sg_uring_t * urp, uint32_t min_complete, int vb)
+{
+    int res;
+    uint32_t flags = min_complete ? IORING_ENTER_GETEVENTS : 0;
+
+    if ((0 == urp->to_submit) && (0 == min_complete))
+        return 0;
+    while (true) {
+        res = sys_io_uring_enter(urp->ring_fd, urp->to_submit, min_complete,
+                                 flags);
+        if (res >= 0)
+            break;
+        if (EINTR == errno)
+            continue;
+        res = -errno;
+        if (vb > 1)
+            pr2ws("%s: io_uring_enter() failed: %s\n", __func__,
+                  safe_strerror(-res));
+        return res;
+    }
+    if ((uint32_t)res > urp->to_submit)
+        res = urp->to_submit;
+    urp->to_submit -= res;
+    urp->in_flight += res;
+    return 0;
+}
+
+/* Drains the completion queue, each completion is placed in the object
+ * whose address is its user_data. Returns number of completions reaped. */
+static int
+sg_uring_reap_cqes(struct sg_uring_t * urp)
+{
+    int num = 0;
+    uint32_t head, tail;
+    uint64_t ud;
+    const struct io_uring_cqe * cqep;
+    struct sg_pt_linux_scsi * ptp;
+    struct sg_uring_sub_t * subp;
+
+    head = *urp->cq_head;
+    tail = __atomic_load_n(urp->cq_tail, __ATOMIC_ACQUIRE);
+    for ( ; head != tail; ++head, ++num) {
+        cqep = (const struct io_uring_cqe *)
+               (urp->cqes + ((head & *urp->cq_mask) * SG_URING_CQE_SZ));
+        ud = cqep->user_data;
+        if (0x1 & ud) {
+            subp = (struct sg_uring_sub_t *)(sg_uintptr_t)(ud - 1);
+            subp->res = cqep->res;
+            subp->result = (uint32_t)cqep->big_cqe[0];
+            subp->done = true;
+            ++*subp->num_donep;
+            ptp = NULL;
+        } else
+            ptp = (struct sg_pt_linux_scsi *)(sg_uintptr_t)ud;
+        if (ptp) {
+            ptp->uring_res = cqep->res;
+            /* with CQE32 the NVMe result (CDW0) is in big_cqe[0] */
+            ptp->uring_result = (uint32_t)cqep->big_cqe[0];
+            ptp->uring_done = true;
+        }
+        if (urp->in_flight > 0)
+            --urp->in_flight;
+    }
+    __atomic_store_n(urp->cq_head, head, __ATOMIC_RELEASE);
+    return num;
+}
+
+/* Places the NVMe command in cmdp, for the device open on ptp, in the
+ * submission queue of urp with user_data ud. Returns 0 or negated errno. */
+static int
+sg_uring_prep(struct sg_uring_t * urp, const struct sg_pt_linux_scsi * ptp,
+              const struct sg_nvme_passthru_cmd * cmdp, bool admin,
+              uint64_t ud, int vb)
+{
+    int res;
+    uint32_t tail, idx;
+    struct io_uring_sqe * sqep;
+    struct sg_nvme_uring_cmd * ucp;
+
+    tail = *urp->sq_tail;
+    if ((tail - __atomic_load_n(urp->sq_head, __ATOMIC_ACQUIRE)) >=
+        urp->sq_entries) {
+        /* submission queue full, hand what is there to the kernel */
+        res = sg_uring_enter(urp, 0, vb);
+        if (res)
+            return res;
+        if ((tail - __atomic_load_n(urp->sq_head, __ATOMIC_ACQUIRE)) >=
+            urp->sq_entries)
+            return -EAGAIN;
+    }
+    idx = tail & *urp->sq_mask;
+    sqep = (struct io_uring_sqe *)(urp->sqes + (idx * SG_URING_SQE_SZ));
+    memset(sqep, 0, SG_URING_SQE_SZ);
+    sqep->opcode = IORING_OP_URING_CMD;
+    sqep->fd = ptp->dev_fd;
+    sqep->cmd_op = admin ? NVME_URING_CMD_ADMIN : NVME_URING_CMD_IO;
+    sqep->user_data = ud;
+    ucp = (struct sg_nvme_uring_cmd *)sqep->cmd;
+    ucp->opcode = cmdp->opcode;
+    ucp->flags = cmdp->flags;
+    ucp->nsid = cmdp->nsid;
+    ucp->cdw2 = cmdp->cdw2;
+    ucp->cdw3 = cmdp->cdw3;
+    ucp->metadata = cmdp->metadata;
+    ucp->addr = cmdp->addr;
+    ucp->metadata_len = cmdp->metadata_len;
+    ucp->data_len = cmdp->data_len;
+    ucp->cdw10 = cmdp->cdw10;
+    ucp->cdw11 = cmdp->cdw11;
+    ucp->cdw12 = cmdp->cdw12;
+    ucp->cdw13 = cmdp->cdw13;
+    ucp->cdw14 = cmdp->cdw14;
+    ucp->cdw15 = cmdp->cdw15;
+    ucp->timeout_ms = cmdp->timeout_ms;
+#if defined(IORING_URING_CMD_FIXED) && defined(__NR_io_uring_register)
+    if (ptp->rbp && (ptp->rbp->ring == urp) && cmdp->addr) {
+        int k;
+        const struct sg_pt_reg_bufs_t * rbp = ptp->rbp;
+
+        /* data within one of this ring's fixed buffers? */
+        for (k = 0; k < rbp->num; ++k) {
+            uint64_t b = (uint64_t)(sg_uintptr_t)rbp->bufs[k];
+
+            if ((cmdp->addr >= b) &&
+                ((cmdp->addr + cmdp->data_len) <= (b + rbp->buf_len))) {
+                sqep->uring_cmd_flags = IORING_URING_CMD_FIXED;
+                sqep->buf_index = (uint16_t)k;
+                break;
+            }
+        }
+    }
+#endif
+    urp->sq_array[idx] = idx;
+    __atomic_store_n(urp->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ++urp->to_submit;
+    return 0;
+}
+
+/* Places the NVMe command in cmdp in the submission queue of this thread's
+ * ring, it is not given to the kernel until the next io_uring_enter().
+ * Polled NVM commands go to the IOPOLL ring unless it is unavailable.
+ * Returns 0 or negated errno. */
+int
+sg_uring_queue(struct sg_pt_linux_scsi * ptp,
+               const struct sg_nvme_passthru_cmd * cmdp, bool admin, int vb)
+{
+    bool polled = ptp->polled && (! admin) &&
+                  (! SG_UR_LD(sg_uring_pol_broken));
+    int res;
+    struct sg_uring_t * urp = sg_uring_get(polled, vb);
+
+    if ((NULL == urp) && polled) {
+        polled = false;         /* fall back to interrupt completion */
+        urp = sg_uring_get(false, vb);
+    }
+    if (NULL == urp)
+        return -ENOTTY;
+    res = sg_uring_prep(urp, ptp, cmdp, admin, (uint64_t)(sg_uintptr_t)ptp,
+                        vb);
+    if (res)
+        return res;
+    ptp->uring_done = false;
+    ptp->uring_polled = polled;
+    return 0;
+}
+
+/* Waits for the command queued for ptp to complete. If 'wait' is false and
+ * it has not yet completed then returns -EAGAIN. Completions for other
+ * objects on this thread's ring are harvested along the way. Returns
+ * 0 or negated errno. */
+int
+sg_uring_reap(struct sg_pt_linux_scsi * ptp, bool wait, int vb)
+{
+    int res;
+    struct sg_uring_t * urp = ptp->uring_polled ? sg_urp_pol : sg_urp;
+
+    if (ptp->uring_done)
+        return 0;
+    if (NULL == urp)
+        return -EINVAL;
+    res = sg_uring_enter(urp, 0, vb);
+    if (res)
+        return res;
+    sg_uring_reap_cqes(urp);
+    while (! ptp->uring_done) {
+        if (! wait)
+            return -EAGAIN;
+        if ((0 == urp->in_flight) && (0 == urp->to_submit)) {
+            if (vb)
+                pr2ws("%s: command not found on ring\n", __func__);
+            return -EINVAL;
+        }
+        res = sg_uring_enter(urp, 1, vb);
+        if (res)
+            return res;
+        sg_uring_reap_cqes(urp);
+    }
+    return 0;
+}
+
+/* Synchronous use of the ring: queue, submit and wait. Returns the same
+ * as ioctl(NVME_IOCTL_ADMIN_CMD) or ioctl(NVME_IOCTL_IO_CMD) would: the
+ * NVMe status (>= 0) or a negated errno. The command's result (CDW0) is
+ * placed in cmdp->result . The timeout is taken from cmdp->timeout_ms . */
+int
+sg_uring_nvme_cmd(struct sg_pt_linux_scsi * ptp,
+                  struct sg_nvme_passthru_cmd * cmdp, bool admin, int vb)
+{
+    int res;
+
+again:
+    res = sg_uring_queue(ptp, cmdp, admin, vb);
+    if (res)
+        return res;
+    res = sg_uring_reap(ptp, true, vb);
+    if (res)
+        return res;
+    if (ptp->uring_polled && (-EOPNOTSUPP == ptp->uring_res)) {
+        /* e.g. no NVMe poll queues, use interrupt completion from now */
+        if (vb > 2)
+            pr2ws("%s: polled command rejected, use interrupt "
+                  "completion\n", __func__);
+        SG_UR_ST(sg_uring_pol_broken, true);
+        goto again;
+    }
+    cmdp->result = ptp->uring_result;
+    return ptp->uring_res;
+}
+
+/* Sends the num NVM commands in cmd_arr on this thread's (interrupt
+ * completion) ring, keeping as many in flight at once as the ring allows,
+ * and waits for all of them. Each command's result (CDW0) is placed in its
+ * result field. Returns 0 if all succeeded, else what sg_uring_nvme_cmd()
+ * would for the first of cmd_arr that did not, whose index is placed in
+ * *failp (-1 when all succeeded or the ring itself failed). */
+int
+sg_uring_nvme_cmds(struct sg_pt_linux_scsi * ptp,
+                   struct sg_nvme_passthru_cmd * cmd_arr, int num,
+                   int * failp, int vb)
+{
+    int k, res;
+    int queued = 0;
+    int num_done = 0;
+    struct sg_uring_t * urp = sg_uring_get(false, vb);
+    struct sg_uring_sub_t * sub_arr;
+
+    *failp = -1;
+    if (NULL == urp)
+        return -ENOTTY;
+    sub_arr = (struct sg_uring_sub_t *)calloc(num, sizeof(*sub_arr));
+    if (NULL == sub_arr)
+        return -ENOMEM;
+    res = 0;
+    while (num_done < num) {
+        /* keep the ring full, but never the completion queue */
+        while ((0 == res) && (queued < num) &&
+               ((urp->in_flight + urp->to_submit) < urp->sq_entries)) {
+            sub_arr[queued].num_donep = &num_done;
+            res = sg_uring_prep(urp, ptp, cmd_arr + queued, false,
+                                (uint64_t)(sg_uintptr_t)(sub_arr + queued) |
+                                0x1, vb);
+            if (0 == res)
+                ++queued;
+        }
+        if (res && (num_done >= queued))
+            break;      /* nothing of ours still on the ring */
+        k = sg_uring_enter(urp, 1, vb);
+        if (k) {
+            /* completions may still arrive for sub_arr, so leak it */
+            return k;
+        }
+        sg_uring_reap_cqes(urp);
+    }
+    if (0 == res) {
+        for (k = 0; k < num; ++k) {
+            cmd_arr[k].result = sub_arr[k].result;
+            if (sub_arr[k].res && (*failp < 0)) {
+                *failp = k;
+                res = sub_arr[k].res;
+            }
+        }
+    }
+    free(sub_arr);
+    return res;
+}
+
+/* Returns the ring's file descriptor if this thread has commands queued or
+ * in flight on it, after giving any queued commands to the kernel.
+ * Otherwise returns -1 . */
+int
+sg_uring_busy_fd(int vb)
+{
+    struct sg_uring_t * urp = sg_urp;
+
+    if ((NULL == urp) || ((0 == urp->in_flight) && (0 == urp->to_submit)))
+        return -1;
+    sg_uring_enter(urp, 0, vb);
+    return urp->ring_fd;
+}
+
+#if defined(IORING_URING_CMD_FIXED) && defined(__NR_io_uring_register)
+
+/* Registers the buffers in rbp as fixed buffers of this thread's (non
+ * polled) ring. A ring has only one table of fixed buffers so this fails
+ * with -EBUSY if another registration holds it. Returns 0 or negated
+ * errno. */
+int
+sg_uring_reg_bufs(struct sg_pt_reg_bufs_t * rbp, int vb)
+{
+    int k, res;
+    struct sg_uring_t * urp = sg_uring_get(false, vb);
+    struct iovec iov[16];       /* 16 is SCSI_PT_REG_BUFS_MAX */
+
+    if (NULL == urp)
+        return -ENOTTY;
+    if ((rbp->num < 1) || (rbp->num > 16))
+        return -EINVAL;
+    for (k = 0; k < rbp->num; ++k) {
+        iov[k].iov_base = rbp->bufs[k];
+        iov[k].iov_len = rbp->buf_len;
+    }
+    res = (int)syscall(__NR_io_uring_register, urp->ring_fd,
+                       IORING_REGISTER_BUFFERS, iov, rbp->num);
+    if (res < 0) {
+        res = -errno;
+        if (vb > 1)
+            pr2ws("%s: IORING_REGISTER_BUFFERS failed: %s\n", __func__,
+                  safe_strerror(-res));
+        return res;
+    }
+    rbp->ring = urp;
+    return 0;
+}
+
+/* Drops the fixed buffers registered by sg_uring_reg_bufs(). This can only
+ * be done by the thread owning the ring, otherwise they stay until that
+ * ring is closed. */
+void
+sg_uring_unreg_bufs(struct sg_pt_reg_bufs_t * rbp)
+{
+    const struct sg_uring_t * urp = sg_urp;
+
+    if (urp && (rbp->ring == urp))
+        syscall(__NR_io_uring_register, urp->ring_fd,
+                IORING_UNREGISTER_BUFFERS, NULL, 0);
+    rbp->ring = NULL;
+}
+
+#else
+
+int
+sg_uring_reg_bufs(struct sg_pt_reg_bufs_t * rbp, int vb)
+{
+    if (rbp) { }
+    if (vb) { }
+    return -ENOTTY;
+}
+
+void
+sg_uring_unreg_bufs(struct sg_pt_reg_bufs_t * rbp)
+{
+    rbp->ring = NULL;
+}
+
+#endif
+
+/* Returns true if this thread has commands queued or in flight on its
+ * IOPOLL ring. Those completions are not signalled to poll(2), they are
+ * found by sg_uring_reap() (i.e. do_scsi_pt_receive()) actively polling. */
+bool
+sg_uring_polled_busy(void)
+{
+    const struct sg_uring_t * urp = sg_urp_pol;
+
+    return urp && (urp->in_flight || urp->to_submit);
+}
+
+#else   /* no io_uring support at build time */
+
+bool
+sg_uring_usable(const struct sg_pt_linux_scsi * ptp)
+{
+    if (ptp) { }
+    return false;
+}
+
+int
+sg_uring_queue(struct sg_pt_linux_scsi * ptp,
+               const struct sg_nvme_passthru_cmd * cmdp, bool admin, int vb)
+{
+    if (ptp) { }
+    if (cmdp) { }
+    if (admin) { }
+    if (vb) { }
+    return -ENOTTY;
+}
+
+int
+sg_uring_reap(struct sg_pt_linux_scsi * ptp, bool wait, int vb)
+{
+    if (ptp) { }
+    if (wait) { }
+    if (vb) { }
+    return -ENOTTY;
+}
+
+int
+sg_uring_nvme_cmd(struct sg_pt_linux_scsi * ptp,
+                  struct sg_nvme_passthru_cmd * cmdp, bool admin, int vb)
+{
+    if (ptp) { }
+    if (cmdp) { }
+    if (admin) { }
+    if (vb) { }
+    return -ENOTTY;
+}
+
+int
+sg_uring_nvme_cmds(struct sg_pt_linux_scsi * ptp,
+                   struct sg_nvme_passthru_cmd * cmd_arr, int num,
+                   int * failp, int vb)
+{
+    if (ptp) { }
+    if (cmd_arr) { }
+    if (num) { }
+    if (vb) { }
+    *failp = -1;
+    return -ENOTTY;
+}
+
+int
+sg_uring_busy_fd(int vb)
+{
+    if (vb) { }
+    return -1;
+}
+
+bool
+sg_uring_polled_busy(void)
+{
+    return false;
+}
+
+int
+sg_uring_reg_bufs(struct sg_pt_reg_bufs_t * rbp, int vb)
+{
+    if (rbp) { }
+    if (vb) { }
+    return -ENOTTY;
+}
+
+void
+sg_uring_unreg_bufs(struct sg_pt_reg_bufs_t * rbp)
+{
+    rbp->ring = NULL;
+}
+
+#endif
@@ -7,7 +7,7 @@
  * SPDX-License-Identifier: BSD-2-Clause
  */
 
-/* sg_pt_win32 version 1.34 20210503 */
+/* sg_pt_win32 version 1.36 20261015 */
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -99,11 +99,14 @@
  * be used for larger amounts of data but the buffer needs to be
  * "cache aligned". Is that 16 byte alignment or greater?
  *
- * This code will default to indirect (i.e. double buffered) access
- * unless the WIN32_SPT_DIRECT preprocessor constant is defined in
- * config.h . In version 1.12 runtime selection of direct and indirect
- * access was added; the default is still determined by the
- * WIN32_SPT_DIRECT preprocessor constant.
+ * This code will choose, for each command, direct access when the data
+ * buffer meets the adapter's AlignmentMask (fetched once per handle) and
+ * indirect (i.e. double buffered) access otherwise. Buffers from
+ * sg_memalign() are page aligned so they always take the direct path. If
+ * the WIN32_SPT_DIRECT preprocessor constant is defined in config.h then
+ * direct access is used for every command. In version 1.12 runtime
+ * selection of direct and indirect access was added, see
+ * scsi_pt_win32_direct().
  */
 
 #define DEF_TIMEOUT 60       /* 60 seconds */
@@ -128,7 +131,16 @@ struct sg_pt_handle {
     bool bus_type_failed;
     bool is_nvme;
     bool got_physical_drive;
+    bool ovl_failed;    /* overlapped setup failed, submit synchronously */
+    bool skip_on_success; /* FILE_SKIP_COMPLETION_PORT_ON_SUCCESS active */
+    bool checked_adapter; /* align_mask and max_xfer_len are valid */
     HANDLE fh;
+    HANDLE fh_ovl;      /* opened with FILE_FLAG_OVERLAPPED, NULL till used */
+    HANDLE iocp;        /* completion port that fh_ovl is associated with */
+    int num_pending;    /* submitted, completion not yet dequeued */
+    int num_ready;      /* completion dequeued, not yet received */
+    uint32_t align_mask;        /* adapter's AlignmentMask */
+    uint32_t max_xfer_len;      /* bytes, 0 if not known */
     char adapter[32];   /* for example: '\\.\scsi3' */
     int bus;            /* a.k.a. PathId in MS docs */
     int target;
@@ -149,6 +161,10 @@ struct sg_pt_win32_scsi {
     bool mdxfer_out;    /* direction of metadata xfer, true->data-out */
     bool have_nvme_cmd;
     bool is_read;
+    bool async_pending; /* overlapped DeviceIoControl() in flight */
+    bool async_done;    /* do_scsi_pt_submit() result is available */
+    bool async_ready;   /* counted in async_shp->num_ready */
+    bool async_direct;  /* submitted with IOCTL_SCSI_PASS_THROUGH_DIRECT */
     int sense_len;
     int scsi_status;
     int resid;
@@ -174,7 +190,9 @@ struct sg_pt_win32_scsi {
     uint8_t * nvme_id_ctlp;
     uint8_t * free_nvme_id_ctlp;
     struct sg_sntl_dev_state_t * dev_statp; /* points to handle's dev_stat */
+    struct sg_pt_handle * async_shp;    /* handle used by async submit */
     uint8_t nvme_cmd[64];
+    OVERLAPPED ovl;             /* for do_scsi_pt_submit() */
     union {
         SCSI_PASS_THROUGH_DIRECT_WITH_BUFFER swb_d;
         /* Last entry in structure so data buffer can be extended */
@@ -491,6 +509,19 @@ scsi_pt_close_device(int device_fd)
 
     if (NULL == shp)
         return -ENODEV;
+    if (shp->fh_ovl) {
+        CancelIoEx(shp->fh_ovl, NULL);
+        CloseHandle(shp->fh_ovl);
+        shp->fh_ovl = NULL;
+    }
+    if (shp->iocp) {
+        CloseHandle(shp->iocp);
+        shp->iocp = NULL;
+    }
+    shp->ovl_failed = false;
+    shp->skip_on_success = false;
+    shp->num_pending = 0;
+    shp->num_ready = 0;
     if ((! CloseHandle(shp->fh)) && shp->verbose)
         pr2ws("Windows CloseHandle error=%u\n", (unsigned int)GetLastError());
     shp->bus = 0;
@@ -619,6 +650,72 @@ get_bus_type(struct sg_pt_handle *shp, const char *dname,
     return 0;
 }
 
+/* Asks the adapter (once per handle) for its data buffer AlignmentMask and
+ * its maximum transfer length, the lesser of MaximumTransferLength and what
+ * MaximumPhysicalPages allows for a buffer that does not start on a page
+ * boundary. If the adapter does not answer, data buffers are expected to be
+ * page aligned and there is no known maximum. */
+static void
+get_adapter_limits(struct sg_pt_handle * shp, int vb)
+{
+    DWORD num_out, err;
+    uint32_t mx;
+    const uint32_t pg_sz = sg_get_page_size();
+    STORAGE_ADAPTER_DESCRIPTOR sad;
+    STORAGE_PROPERTY_QUERY query = {StorageAdapterProperty,
+                                    PropertyStandardQuery, {0} };
+    char b[128];
+
+    if (shp->checked_adapter)
+        return;
+    shp->checked_adapter = true;
+    shp->align_mask = pg_sz - 1;
+    shp->max_xfer_len = 0;
+    memset(&sad, 0, sizeof(sad));
+    if (! DeviceIoControl(shp->fh, IOCTL_STORAGE_QUERY_PROPERTY,
+                          &query, sizeof(query), &sad, sizeof(sad),
+                          &num_out, NULL)) {
+        if (vb > 2) {
+            err = GetLastError();
+            pr2ws("%s  IOCTL_STORAGE_QUERY_PROPERTY(Adapter) failed, "
+                  "Error: %s [%u]\n", shp->dname,
+                  get_err_str(err, sizeof(b), b), (uint32_t)err);
+        }
+        return;
+    }
+    if (num_out < offsetof(STORAGE_ADAPTER_DESCRIPTOR, AdapterUsesPio))
+        return;
+    shp->align_mask = sad.AlignmentMask;
+    mx = sad.MaximumTransferLength;
+    if ((sad.MaximumPhysicalPages > 1) &&
+        (((uint64_t)(sad.MaximumPhysicalPages - 1) * pg_sz) < mx))
+        mx = (sad.MaximumPhysicalPages - 1) * pg_sz;
+    shp->max_xfer_len = mx;
+    if (vb > 2)
+        pr2ws("%s: %s AlignmentMask=0x%x MaximumTransferLength=%u "
+              "MaximumPhysicalPages=%u\n", __func__, shp->dname,
+              (uint32_t)sad.AlignmentMask,
+              (uint32_t)sad.MaximumTransferLength,
+              (uint32_t)sad.MaximumPhysicalPages);
+}
+
+int
+scsi_pt_win32_adapter_limits(int device_fd, uint32_t * max_lenp,
+                             uint32_t * align_maskp, int vb)
+{
+    struct sg_pt_handle * shp = get_open_pt_handle(NULL, device_fd,
+                                                   vb > 1);
+
+    if (NULL == shp)
+        return -ENODEV;
+    get_adapter_limits(shp, vb);
+    if (max_lenp)
+        *max_lenp = shp->max_xfer_len;
+    if (align_maskp)
+        *align_maskp = shp->align_mask;
+    return 0;
+}
+
 /* Assumes dev_fd is an "open" file handle associated with device_name. If
  * the implementation (possibly for one OS) cannot determine from dev_fd if
  * a SCSI or NVMe pass-through is referenced, then it might guess based on
@@ -750,6 +847,13 @@ destruct_scsi_pt_obj(struct sg_pt_base * vp)
         struct sg_pt_win32_scsi * psp = vp->implp;
 
         if (psp) {
+            struct sg_pt_handle * shp = psp->async_shp;
+
+            /* the completion port must not be left holding &psp->ovl */
+            if (psp->async_pending && shp && shp->fh_ovl) {
+                CancelIoEx(shp->fh_ovl, &psp->ovl);
+                do_scsi_pt_receive(vp, -1, 0);
+            }
             free(psp);
         }
         free(vp);
@@ -1048,16 +1152,33 @@ set_scsi_pt_flags(struct sg_pt_base * objp, int flags)
     flags = flags;
 }
 
-/* Executes SCSI command (or at least forwards it to lower layers)
- * using direct interface. Clears os_err field prior to active call (whose
- * result may set it again). */
-static int
-scsi_pt_direct(struct sg_pt_win32_scsi * psp, struct sg_pt_handle * shp,
-               int time_secs, int vb)
+/* Returns true if the command in psp should use
+ * IOCTL_SCSI_PASS_THROUGH_DIRECT. The swb_d and swb_i members of psp have
+ * the same layout up to and including the sense buffer so the choice can
+ * be made here, after the cdb and data buffer have been set. */
+static bool
+spt_use_direct(const struct sg_pt_win32_scsi * psp, struct sg_pt_handle * shp,
+               int vb)
 {
-    BOOL status;
-    DWORD returned;
+    if (spt_direct || (0 == psp->dxfer_len))
+        return true;
+    get_adapter_limits(shp, vb);
+    if ((uintptr_t)psp->dxferp & shp->align_mask) {
+        if (vb > 4)
+            pr2ws("%s: data buffer %p not aligned for adapter (mask=0x%x), "
+                  "double buffer\n", __func__, (void *)psp->dxferp,
+                  shp->align_mask);
+        return false;
+    }
+    return true;
+}
 
+/* Prepares psp->swb_d for IOCTL_SCSI_PASS_THROUGH_DIRECT. Returns 0 if
+ * okay, else SCSI_PT_DO_BAD_PARAMS. */
+static int
+spt_direct_prep(struct sg_pt_win32_scsi * psp, struct sg_pt_handle * shp,
+                int time_secs, int vb)
+{
     psp->os_err = 0;
     if (0 == psp->swb_d.spt.CdbLength) {
         if (vb)
@@ -1065,10 +1186,12 @@ scsi_pt_direct(struct sg_pt_win32_scsi * psp, struct sg_pt_handle * shp,
         return SCSI_PT_DO_BAD_PARAMS;
     }
     psp->swb_d.spt.Length = sizeof (SCSI_PASS_THROUGH_DIRECT);
+    psp->swb_d.spt.SenseInfoOffset =
+                offsetof(SCSI_PASS_THROUGH_DIRECT_WITH_BUFFER, ucSenseBuf);
     psp->swb_d.spt.PathId = shp->bus;
     psp->swb_d.spt.TargetId = shp->target;
     psp->swb_d.spt.Lun = shp->lun;
-    psp->swb_d.spt.TimeOutValue = time_secs;
+    psp->swb_d.spt.TimeOutValue = (time_secs > 0) ? time_secs : DEF_TIMEOUT;
     psp->swb_d.spt.DataTransferLength = psp->dxfer_len;
     if (vb > 4) {
         pr2ws(" spt_direct, adapter: %s  Length=%d ScsiStatus=%d PathId=%d "
@@ -1087,6 +1210,40 @@ scsi_pt_direct(struct sg_pt_win32_scsi * psp, struct sg_pt_handle * shp,
               (unsigned int)psp->swb_d.spt.SenseInfoOffset);
     }
     psp->swb_d.spt.DataBuffer = psp->dxferp;
+    return 0;
+}
+
+/* Picks up the results of a completed IOCTL_SCSI_PASS_THROUGH_DIRECT */
+static void
+spt_direct_fini(struct sg_pt_win32_scsi * psp)
+{
+    psp->scsi_status = psp->swb_d.spt.ScsiStatus;
+    if ((SAM_STAT_CHECK_CONDITION == psp->scsi_status) ||
+        (SAM_STAT_COMMAND_TERMINATED == psp->scsi_status))
+        memcpy(psp->sensep, psp->swb_d.ucSenseBuf, psp->sense_len);
+    else
+        psp->sense_len = 0;
+    psp->sense_resid = 0;
+    if ((psp->dxfer_len > 0) && (psp->swb_d.spt.DataTransferLength > 0))
+        psp->resid = psp->dxfer_len - psp->swb_d.spt.DataTransferLength;
+    else
+        psp->resid = 0;
+}
+
+/* Executes SCSI command (or at least forwards it to lower layers)
+ * using direct interface. Clears os_err field prior to active call (whose
+ * result may set it again). */
+static int
+scsi_pt_direct(struct sg_pt_win32_scsi * psp, struct sg_pt_handle * shp,
+               int time_secs, int vb)
+{
+    int res;
+    BOOL status;
+    DWORD returned;
+
+    res = spt_direct_prep(psp, shp, time_secs, vb);
+    if (res)
+        return res;
     status = DeviceIoControl(shp->fh, IOCTL_SCSI_PASS_THROUGH_DIRECT,
                             &psp->swb_d,
                             sizeof(psp->swb_d),
@@ -1108,31 +1265,17 @@ scsi_pt_direct(struct sg_pt_win32_scsi * psp, struct sg_pt_handle * shp,
         psp->os_err = EIO;
         return 0;       /* let app find transport error */
     }
-
-    psp->scsi_status = psp->swb_d.spt.ScsiStatus;
-    if ((SAM_STAT_CHECK_CONDITION == psp->scsi_status) ||
-        (SAM_STAT_COMMAND_TERMINATED == psp->scsi_status))
-        memcpy(psp->sensep, psp->swb_d.ucSenseBuf, psp->sense_len);
-    else
-        psp->sense_len = 0;
-    psp->sense_resid = 0;
-    if ((psp->dxfer_len > 0) && (psp->swb_d.spt.DataTransferLength > 0))
-        psp->resid = psp->dxfer_len - psp->swb_d.spt.DataTransferLength;
-    else
-        psp->resid = 0;
-
+    spt_direct_fini(psp);
     return 0;
 }
 
-/* Executes SCSI command (or at least forwards it to lower layers) using
- * indirect interface. Clears os_err field prior to active call (whose
- * result may set it again). */
+/* Prepares swb_i for IOCTL_SCSI_PASS_THROUGH, enlarging vp->implp if the
+ * data won't fit (so callers must re-read vp->implp). Returns 0 if okay,
+ * else as for do_scsi_pt(). */
 static int
-scsi_pt_indirect(struct sg_pt_base * vp, struct sg_pt_handle * shp,
-                 int time_secs, int vb)
+spt_indirect_prep(struct sg_pt_base * vp, struct sg_pt_handle * shp,
+                  int time_secs, int vb)
 {
-    BOOL status;
-    DWORD returned;
     struct sg_pt_win32_scsi * psp = vp->implp;
 
     psp->os_err = 0;
@@ -1163,12 +1306,14 @@ scsi_pt_indirect(struct sg_pt_base * vp, struct sg_pt_handle * shp,
         psp = epsp;
     }
     psp->swb_i.spt.Length = sizeof (SCSI_PASS_THROUGH);
+    psp->swb_i.spt.SenseInfoOffset =
+                offsetof(SCSI_PASS_THROUGH_WITH_BUFFERS, ucSenseBuf);
     psp->swb_i.spt.DataBufferOffset =
                 offsetof(SCSI_PASS_THROUGH_WITH_BUFFERS, ucDataBuf);
     psp->swb_i.spt.PathId = shp->bus;
     psp->swb_i.spt.TargetId = shp->target;
     psp->swb_i.spt.Lun = shp->lun;
-    psp->swb_i.spt.TimeOutValue = time_secs;
+    psp->swb_i.spt.TimeOutValue = (time_secs > 0) ? time_secs : DEF_TIMEOUT;
     psp->swb_i.spt.DataTransferLength = psp->dxfer_len;
     if (vb > 4) {
         pr2ws(" spt_indirect, adapter: %s  Length=%d ScsiStatus=%d PathId=%d "
@@ -1191,6 +1336,45 @@ scsi_pt_indirect(struct sg_pt_base * vp, struct sg_pt_handle * shp,
     if ((psp->dxfer_len > 0) &&
         (SCSI_IOCTL_DATA_OUT == psp->swb_i.spt.DataIn))
         memcpy(psp->swb_i.ucDataBuf, psp->dxferp, psp->dxfer_len);
+    return 0;
+}
+
+/* Picks up the results (and data-in) of a completed IOCTL_SCSI_PASS_THROUGH */
+static void
+spt_indirect_fini(struct sg_pt_win32_scsi * psp)
+{
+    if ((psp->dxfer_len > 0) && (SCSI_IOCTL_DATA_IN == psp->swb_i.spt.DataIn))
+        memcpy(psp->dxferp, psp->swb_i.ucDataBuf, psp->dxfer_len);
+
+    psp->scsi_status = psp->swb_i.spt.ScsiStatus;
+    if ((SAM_STAT_CHECK_CONDITION == psp->scsi_status) ||
+        (SAM_STAT_COMMAND_TERMINATED == psp->scsi_status))
+        memcpy(psp->sensep, psp->swb_i.ucSenseBuf, psp->sense_len);
+    else
+        psp->sense_len = 0;
+    psp->sense_resid = 0;
+    if ((psp->dxfer_len > 0) && (psp->swb_i.spt.DataTransferLength > 0))
+        psp->resid = psp->dxfer_len - psp->swb_i.spt.DataTransferLength;
+    else
+        psp->resid = 0;
+}
+
+/* Executes SCSI command (or at least forwards it to lower layers) using
+ * indirect interface. Clears os_err field prior to active call (whose
+ * result may set it again). */
+static int
+scsi_pt_indirect(struct sg_pt_base * vp, struct sg_pt_handle * shp,
+                 int time_secs, int vb)
+{
+    int res;
+    BOOL status;
+    DWORD returned;
+    struct sg_pt_win32_scsi * psp;
+
+    res = spt_indirect_prep(vp, shp, time_secs, vb);
+    if (res)
+        return res;
+    psp = vp->implp;
     status = DeviceIoControl(shp->fh, IOCTL_SCSI_PASS_THROUGH,
                             &psp->swb_i,
                             sizeof(psp->swb_i),
@@ -1211,21 +1395,7 @@ scsi_pt_indirect(struct sg_pt_base * vp, struct sg_pt_handle * shp,
         psp->os_err = EIO;
         return 0;       /* let app find transport error */
     }
-    if ((psp->dxfer_len > 0) && (SCSI_IOCTL_DATA_IN == psp->swb_i.spt.DataIn))
-        memcpy(psp->dxferp, psp->swb_i.ucDataBuf, psp->dxfer_len);
-
-    psp->scsi_status = psp->swb_i.spt.ScsiStatus;
-    if ((SAM_STAT_CHECK_CONDITION == psp->scsi_status) ||
-        (SAM_STAT_COMMAND_TERMINATED == psp->scsi_status))
-        memcpy(psp->sensep, psp->swb_i.ucSenseBuf, psp->sense_len);
-    else
-        psp->sense_len = 0;
-    psp->sense_resid = 0;
-    if ((psp->dxfer_len > 0) && (psp->swb_i.spt.DataTransferLength > 0))
-        psp->resid = psp->dxfer_len - psp->swb_i.spt.DataTransferLength;
-    else
-        psp->resid = 0;
-
+    spt_indirect_fini(psp);
     return 0;
 }
 
@@ -1234,11 +1404,15 @@ scsi_pt_indirect(struct sg_pt_base * vp, struct sg_pt_handle * shp,
  * again). Returns 0 on success, positive SCSI_PT_DO_* errors for syntax
  * like errors and negated errnos for OS errors. For Windows its errors
  * are placed in psp->transport_err and a errno is simulated. */
-int
-do_scsi_pt(struct sg_pt_base * vp, int dev_fd, int time_secs, int vb)
+/* Checks vp and dev_fd then finds the handle and (once) its bus type.
+ * Returns 0 and places the handle in *shpp when do_scsi_pt() and
+ * do_scsi_pt_submit() can proceed, otherwise what they should return. */
+static int
+win32_pt_get_handle(struct sg_pt_base * vp, int dev_fd,
+                    struct sg_pt_handle ** shpp, int vb)
 {
     int res;
-    struct sg_pt_win32_scsi * psp = vp->implp;
+    struct sg_pt_win32_scsi * psp;
     struct sg_pt_handle * shp;
 
     if (! (vp && ((psp = vp->implp)))) {
@@ -1281,10 +1455,24 @@ do_scsi_pt(struct sg_pt_base * vp, int dev_fd, int time_secs, int vb)
         return -psp->os_err;
     psp->is_nvme = shp->is_nvme;
     psp->dev_statp = &shp->dev_stat;
+    *shpp = shp;
+    return 0;
+}
 
+int
+do_scsi_pt(struct sg_pt_base * vp, int dev_fd, int time_secs, int vb)
+{
+    int res;
+    struct sg_pt_win32_scsi * psp;
+    struct sg_pt_handle * shp = NULL;
+
+    res = win32_pt_get_handle(vp, dev_fd, &shp, vb);
+    if (res)
+        return res;
+    psp = vp->implp;
     if (psp->is_nvme)
         return nvme_pt(psp, shp, time_secs, vb);
-    else if (spt_direct)
+    else if (spt_use_direct(psp, shp, vb))
         return scsi_pt_direct(psp, shp, time_secs, vb);
     else
         return scsi_pt_indirect(vp, shp, time_secs, vb);
@@ -3162,3 +3350,321 @@ do_nvm_pt(struct sg_pt_base * vp, int submq, int timeout_secs, int verbose)
     if (verbose) { }
     return SCSI_PT_DO_NOT_SUPPORTED;
 }
+
+/* Lazily opens a second handle to the adapter with FILE_FLAG_OVERLAPPED
+ * and associates it with a completion port. The synchronous path keeps
+ * using shp->fh. Returns true if overlapped submission is available. */
+static bool
+win32_ovl_setup(struct sg_pt_handle * shp, int vb)
+{
+    HANDLE fh, port;
+
+    if (shp->fh_ovl)
+        return true;
+    if (shp->ovl_failed)
+        return false;
+    fh = CreateFile(shp->adapter, GENERIC_READ | GENERIC_WRITE,
+                    FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING,
+                    FILE_FLAG_OVERLAPPED, NULL);
+    if (INVALID_HANDLE_VALUE == fh) {
+        if (vb > 1) {
+            uint32_t err = (uint32_t)GetLastError();
+            char b[128];
+
+            pr2ws("%s: CreateFile(OVERLAPPED) error: %s [%u]\n", __func__,
+                  get_err_str(err, sizeof(b), b), err);
+        }
+        goto fail;
+    }
+    port = CreateIoCompletionPort(fh, NULL, (ULONG_PTR)shp, 0);
+    if (NULL == port) {
+        if (vb > 1)
+            pr2ws("%s: CreateIoCompletionPort error=%u\n", __func__,
+                  (unsigned int)GetLastError());
+        CloseHandle(fh);
+        goto fail;
+    }
+    /* when the ioctl completes inline, pick up the result immediately */
+    shp->skip_on_success = !! SetFileCompletionNotificationModes(fh,
+                                FILE_SKIP_COMPLETION_PORT_ON_SUCCESS);
+    shp->fh_ovl = fh;
+    shp->iocp = port;
+    shp->num_pending = 0;
+    shp->num_ready = 0;
+    if (vb > 4)
+        pr2ws("%s: overlapped handle ready, skip_on_success=%d\n", __func__,
+              (int)shp->skip_on_success);
+    return true;
+fail:
+    if (vb > 1)
+        pr2ws("%s: falling back to synchronous submission\n", __func__);
+    shp->ovl_failed = true;
+    return false;
+}
+
+/* Completes the object that owns ovlp. If ok is false then err holds the
+ * value from GetLastError() (or the completion packet). */
+static void
+win32_ovl_complete(struct sg_pt_win32_scsi * psp, bool ok, DWORD err)
+{
+    struct sg_pt_handle * shp = psp->async_shp;
+
+    if (ok) {
+        if (psp->async_direct)
+            spt_direct_fini(psp);
+        else
+            spt_indirect_fini(psp);
+    } else {
+        psp->transport_err = (int)err;
+        psp->os_err = EIO;
+    }
+    if (psp->async_pending) {
+        psp->async_pending = false;
+        if (shp && (shp->num_pending > 0))
+            --shp->num_pending;
+    }
+    psp->async_done = true;
+    if (shp && (! psp->async_ready)) {
+        psp->async_ready = true;
+        ++shp->num_ready;
+    }
+}
+
+/* Dequeues one completion from shp's port waiting up to wait_ms (INFINITE
+ * to block). Returns 1 if a completion was dequeued, 0 on timeout, else a
+ * negated errno. */
+static int
+win32_ovl_reap_one(struct sg_pt_handle * shp, DWORD wait_ms, int vb)
+{
+    BOOL ok;
+    DWORD n = 0;
+    DWORD err;
+    ULONG_PTR key = 0;
+    OVERLAPPED * ovlp = NULL;
+    struct sg_pt_win32_scsi * psp;
+
+    ok = GetQueuedCompletionStatus(shp->iocp, &n, &key, &ovlp, wait_ms);
+    if (NULL == ovlp) {
+        err = GetLastError();
+        if (WAIT_TIMEOUT == err)
+            return 0;
+        if (vb)
+            pr2ws("%s: GetQueuedCompletionStatus error=%u\n", __func__,
+                  (unsigned int)err);
+        return -EIO;
+    }
+    err = ok ? 0 : GetLastError();
+    psp = (struct sg_pt_win32_scsi *)
+                ((uint8_t *)ovlp - offsetof(struct sg_pt_win32_scsi, ovl));
+    if (vb > 5)
+        pr2ws("%s: completion, bytes=%u, err=%u\n", __func__,
+              (unsigned int)n, (unsigned int)err);
+    win32_ovl_complete(psp, !! ok, err);
+    return 1;
+}
+
+/* SCSI commands are submitted as overlapped DeviceIoControl() calls on a
+ * second handle associated with an I/O completion port; completions are
+ * picked up by do_scsi_pt_receive() and scsi_pt_wait_for_response(). NVMe
+ * (IOCTL_STORAGE_PROTOCOL_COMMAND) and SNTL commands, or when overlapped
+ * setup fails, complete synchronously in do_scsi_pt_submit(). */
+int
+do_scsi_pt_submit(struct sg_pt_base * vp, int fd, int time_secs, int verbose)
+{
+    int res;
+    BOOL ok;
+    DWORD err, returned;
+    struct sg_pt_win32_scsi * psp;
+    struct sg_pt_handle * shp = NULL;
+
+    res = win32_pt_get_handle(vp, fd, &shp, verbose);
+    if (res)
+        return res;
+    psp = vp->implp;
+    if (psp->async_pending) {
+        if (verbose)
+            pr2ws("%s: object already has a command in flight\n", __func__);
+        return SCSI_PT_DO_BAD_PARAMS;
+    }
+    psp->async_done = false;
+    psp->async_ready = false;
+    psp->async_shp = NULL;
+    if (psp->is_nvme || (! win32_ovl_setup(shp, verbose))) {
+        res = do_scsi_pt(vp, fd, time_secs, verbose);
+        vp->implp->async_done = true;
+        return res;
+    }
+    psp->async_direct = spt_use_direct(psp, shp, verbose);
+    if (psp->async_direct)
+        res = spt_direct_prep(psp, shp, time_secs, verbose);
+    else
+        res = spt_indirect_prep(vp, shp, time_secs, verbose);
+    if (res)
+        return res;
+    psp = vp->implp;            /* may have been enlarged by indirect prep */
+    memset(&psp->ovl, 0, sizeof(psp->ovl));
+    psp->async_shp = shp;
+    if (psp->async_direct)
+        ok = DeviceIoControl(shp->fh_ovl, IOCTL_SCSI_PASS_THROUGH_DIRECT,
+                             &psp->swb_d, sizeof(psp->swb_d), &psp->swb_d,
+                             sizeof(psp->swb_d), &returned, &psp->ovl);
+    else
+        ok = DeviceIoControl(shp->fh_ovl, IOCTL_SCSI_PASS_THROUGH,
+                             &psp->swb_i, sizeof(psp->swb_i), &psp->swb_i,
+                             sizeof(psp->swb_i), &returned, &psp->ovl);
+    if (ok) {
+        if (shp->skip_on_success)
+            win32_ovl_complete(psp, true, 0);
+        else {  /* a completion packet is still queued for this command */
+            psp->async_pending = true;
+            ++shp->num_pending;
+        }
+        return 0;
+    }
+    err = GetLastError();
+    if (ERROR_IO_PENDING == err) {
+        psp->async_pending = true;
+        ++shp->num_pending;
+        return 0;
+    }
+    if (verbose > 1)
+        pr2ws("%s: overlapped DeviceIoControl error=%u\n", __func__,
+              (unsigned int)err);
+    win32_ovl_complete(psp, false, err);
+    return 0;   /* let app find transport error */
+}
+
+int
+do_nvm_pt_submit(struct sg_pt_base * vp, int submq, int timeout_secs,
+                 int verbose)
+{
+    return do_nvm_pt(vp, submq, timeout_secs, verbose);
+}
+
+/* There is no non-blocking mode on Windows handles so this waits for the
+ * command submitted on vp (dequeuing other completions on the same port
+ * as they arrive). Returns 0 when the result is in vp. */
+int
+do_scsi_pt_receive(struct sg_pt_base * vp, int fd, int verbose)
+{
+    int res;
+    struct sg_pt_win32_scsi * psp;
+    struct sg_pt_handle * shp;
+
+    if (fd) { }
+    if (! (vp && ((psp = vp->implp))))
+        return SCSI_PT_DO_BAD_PARAMS;
+    shp = psp->async_shp;
+    while (psp->async_pending && shp && shp->iocp) {
+        res = win32_ovl_reap_one(shp, INFINITE, verbose);
+        if (res < 0)
+            return res;
+    }
+    if (psp->async_ready) {
+        psp->async_ready = false;
+        if (shp && (shp->num_ready > 0))
+            --shp->num_ready;
+    }
+    return 0;
+}
+
+/* Returns 1 if a completion is ready to be received (or nothing is in
+ * flight on fd), 0 if timeout_ms elapsed first, else a negated errno. A
+ * negative timeout_ms waits indefinitely. */
+int
+scsi_pt_wait_for_response(int fd, int timeout_ms, int verbose)
+{
+    struct sg_pt_handle * shp = get_open_pt_handle(NULL, fd, false);
+
+    if (NULL == shp)
+        return -ENODEV;
+    if ((NULL == shp->iocp) || (shp->num_ready > 0) ||
+        (shp->num_pending < 1))
+        return 1;
+    return win32_ovl_reap_one(shp, (timeout_ms < 0) ? INFINITE :
+                              (DWORD)timeout_ms, verbose);
+}
+
+/* Commands in the batch are issued one after the other */
+int
+do_scsi_pt_mrq(struct sg_pt_base * vp_arr[], int num, int fd, int time_secs,
+               int * num_donep, int verbose)
+{
+    return sg_pt_mrq_sequential(vp_arr, num, fd, time_secs, num_donep,
+                                verbose);
+}
+
+/* Registered buffers are not supported by this OS interface */
+int
+sg_pt_reg_bufs(struct sg_pt_base * vp, int num, uint32_t buf_len,
+               uint8_t * bufs[], int verbose)
+{
+    if (vp) { }
+    if (num) { }
+    if (buf_len) { }
+    if (bufs) { }
+    if (verbose) { }
+    return ENOTTY;
+}
+
+void
+sg_pt_unreg_bufs(struct sg_pt_base * vp)
+{
+    if (vp) { }
+}
+
+bool
+sg_pt_reg_bufs_zero_copy(const struct sg_pt_base * vp)
+{
+    if (vp) { }
+    return false;
+}
+
+/* Trace callbacks are not supported by this OS interface */
+bool
+set_pt_trace(struct sg_pt_base * vp, sg_pt_trace_fn fn, void * priv)
+{
+    if (vp) { }
+    if (fn) { }
+    if (priv) { }
+    return false;
+}
+
+void
+set_scsi_pt_data_in_reg(struct sg_pt_base * vp, int buf_idx, int dxfer_ilen)
+{
+    if (vp) { }
+    if (buf_idx) { }
+    if (dxfer_ilen) { }
+}
+
+void
+set_scsi_pt_data_out_reg(struct sg_pt_base * vp, int buf_idx,
+                         int dxfer_olen)
+{
+    if (vp) { }
+    if (buf_idx) { }
+    if (dxfer_olen) { }
+}
+
+void
+set_scsi_pt_data_in_iov(struct sg_pt_base * vp,
+                        const struct sg_pt_iovec * iovp, int iov_cnt)
+{
+    if ((1 == iov_cnt) && iovp)
+        set_scsi_pt_data_in(vp, (uint8_t *)iovp->iov_base,
+                            (int)iovp->iov_len);
+    else if (iov_cnt > 1)
+        ++vp->implp->in_err;     /* only the Linux sg driver takes an iovec */
+}
+
+void
+set_scsi_pt_data_out_iov(struct sg_pt_base * vp,
+                         const struct sg_pt_iovec * iovp, int iov_cnt)
+{
+    if ((1 == iov_cnt) && iovp)
+        set_scsi_pt_data_out(vp, (const uint8_t *)iovp->iov_base,
+                             (int)iovp->iov_len);
+    else if (iov_cnt > 1)
+        ++vp->implp->in_err;
+}
@@ -0,0 +1,308 @@
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/* sg_rcache version 1.01 20261015 */
+
+/* On-disk cache of responses that seldom change. The layout below the
+ * user's directory is:
+ *     node_<rdev in hex>     "<key> <ctime of node>" of the last device
+ *                            seen with that major:minor
+ *     <key>/<name>           cached responses, <key> is the NAA
+ *                            designator of the logical unit in hex
+ * Each response file starts with the 4 byte magic "SGR1" followed by the
+ * allocation length (big endian, 4 bytes) used to fetch it. Files are
+ * written to a temporary name then renamed so concurrent invocations
+ * never see a partial response. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "sg_rcache.h"
+#include "sg_broker.h"
+#include "sg_lib.h"
+#include "sg_cmds_basic.h"
+#include "sg_unaligned.h"
+#include "sg_pr2serr.h"
+
+#define SG_RCACHE_MAGIC "SGR1"
+#define SG_RCACHE_HDR_LEN 8     /* magic then allocation length */
+#define SG_RCACHE_KEY_MAX 36    /* 16 byte NAA designator in hex + NUL */
+#define SG_RCACHE_PATH_MAX 1024
+#define SG_RCACHE_DI_LEN 252    /* fetched to find the key */
+
+struct sg_rcache_t {
+    bool active;
+    int fd;
+    int verbose;
+    char key_dir[SG_RCACHE_PATH_MAX];
+};
+
+static struct sg_rcache_t sg_rc = {false, -1, 0, ""};
+
+
+#ifndef SG_LIB_WIN32
+
+/* Places the NAA designator of the logical unit found in the designation
+ * descriptors at bp, as hex, in key. Returns false if there is none. */
+static bool
+rcache_naa_key(const uint8_t * bp, int len, char * key, int key_len)
+{
+    int k, dlen;
+    int off = -1;
+
+    if (sg_vpd_dev_id_iter(bp, len, &off, 0 /* lu */, 3 /* NAA */,
+                           1 /* binary */))
+        return false;
+    dlen = bp[off + 3];
+    if ((dlen < 8) || ((2 * dlen) >= key_len))
+        return false;
+    for (k = 0; k < dlen; ++k)
+        snprintf(key + (2 * k), key_len - (2 * k), "%02x", bp[off + 4 + k]);
+    return true;
+}
+
+/* Removes the responses cached in directory kdir */
+static void
+rcache_purge(const char * kdir, int verbose)
+{
+    DIR * dirp;
+    struct dirent * dep;
+    char b[SG_RCACHE_PATH_MAX + 256];
+
+    dirp = opendir(kdir);
+    if (NULL == dirp)
+        return;
+    while ((dep = readdir(dirp))) {
+        if ('.' == dep->d_name[0])
+            continue;
+        snprintf(b, sizeof(b), "%s/%s", kdir, dep->d_name);
+        unlink(b);
+    }
+    closedir(dirp);
+    if (verbose)
+        pr2ws("response cache: discarded entries in %s\n", kdir);
+}
+
+/* Writes the contents of b (hdr_len bytes of hdr first, if given) to fn via
+ * a temporary file. Returns true on success. */
+static bool
+rcache_write(const char * fn, const uint8_t * hdr, int hdr_len,
+             const uint8_t * b, int len)
+{
+    bool ok;
+    FILE * fp;
+    char tmp[SG_RCACHE_PATH_MAX + 16];
+
+    snprintf(tmp, sizeof(tmp), "%s.%d", fn, (int)getpid());
+    fp = fopen(tmp, "wb");
+    if (NULL == fp)
+        return false;
+    ok = ((0 == hdr_len) || (1 == fwrite(hdr, hdr_len, 1, fp))) &&
+         (1 == fwrite(b, len, 1, fp));
+    if (fclose(fp))
+        ok = false;
+    if (ok && rename(tmp, fn))
+        ok = false;
+    if (! ok)
+        unlink(tmp);
+    return ok;
+}
+
+bool
+sg_rcache_open(const char * dir, const char * dev_name, int sg_fd,
+               int verbose)
+{
+    bool ua;
+    bool node_ok = false;
+    int res, resid, len, n;
+    long long o_ctime;
+    FILE * fp;
+    struct stat st;
+    char key[SG_RCACHE_KEY_MAX];
+    char o_key[SG_RCACHE_KEY_MAX];
+    char node_fn[SG_RCACHE_PATH_MAX];
+    char b[SG_RCACHE_PATH_MAX];
+    uint8_t di[SG_RCACHE_DI_LEN];
+
+    sg_rcache_close();
+    if ((stat(dir, &st) < 0) || (! S_ISDIR(st.st_mode))) {
+        pr2ws("response cache: %s is not a directory\n", dir);
+        return false;
+    }
+    if ((stat(dev_name, &st) < 0) ||
+        (! (S_ISCHR(st.st_mode) || S_ISBLK(st.st_mode)))) {
+        if (verbose)
+            pr2ws("response cache: %s is not a device node, not used\n",
+                  dev_name);
+        return false;
+    }
+    res = sg_ll_test_unit_ready(sg_fd, 0, false, verbose);
+    ua = (SG_LIB_CAT_UNIT_ATTENTION == res);
+    snprintf(node_fn, sizeof(node_fn), "%s/node_%llx", dir,
+             (unsigned long long)st.st_rdev);
+    fp = fopen(node_fn, "r");
+    if (fp) {
+        if ((2 == fscanf(fp, "%35s %lld", o_key, &o_ctime)) &&
+            (o_ctime == (long long)st.st_ctime))
+            node_ok = true;
+        fclose(fp);
+    }
+    if (node_ok && (! ua)) {
+        snprintf(sg_rc.key_dir, sizeof(sg_rc.key_dir), "%s/%s", dir, o_key);
+        goto activate;
+    }
+
+    /* the device may have changed so find out which LU it is now */
+    res = sg_ll_inquiry_v2(sg_fd, true, 0x83, di, sizeof(di), 0, &resid,
+                           false, verbose);
+    len = (int)sizeof(di) - resid;
+    if (res || (len < 4) || (0x83 != di[1])) {
+        if (verbose)
+            pr2ws("response cache: unable to fetch Device Identification "
+                  "VPD page\n");
+        return false;
+    }
+    n = sg_get_unaligned_be16(di + 2) + 4;
+    if (n < len)
+        len = n;
+    if (! rcache_naa_key(di + 4, len - 4, key, sizeof(key))) {
+        if (verbose)
+            pr2ws("response cache: %s has no NAA designator, not used\n",
+                  dev_name);
+        return false;
+    }
+    snprintf(sg_rc.key_dir, sizeof(sg_rc.key_dir), "%s/%s", dir, key);
+    if ((mkdir(sg_rc.key_dir, 0755) < 0) && (EEXIST != errno)) {
+        pr2ws("response cache: unable to create %s: %s\n", sg_rc.key_dir,
+              safe_strerror(errno));
+        return false;
+    }
+    if (verbose > 1)
+        pr2ws("response cache: %s%s\n", ua ? "unit attention, " : "",
+              node_ok ? "node unchanged" : "new or changed node");
+    rcache_purge(sg_rc.key_dir, verbose);
+    n = snprintf(b, sizeof(b), "%s %lld\n", key, (long long)st.st_ctime);
+    rcache_write(node_fn, NULL, 0, (const uint8_t *)b, n);
+    sg_rc.active = true;
+    sg_rc.fd = sg_fd;
+    sg_rc.verbose = verbose;
+    sg_rcache_put(sg_fd, "vpd_83", di, sizeof(di), len);
+    return true;
+
+activate:
+    if ((mkdir(sg_rc.key_dir, 0755) < 0) && (EEXIST != errno))
+        return false;
+    sg_rc.active = true;
+    sg_rc.fd = sg_fd;
+    sg_rc.verbose = verbose;
+    return true;
+}
+
+int
+sg_rcache_get(int sg_fd, const char * name, uint8_t * rp, int mx_len)
+{
+    int n, alloc_len;
+    FILE * fp;
+    uint8_t hdr[SG_RCACHE_HDR_LEN];
+    char fn[SG_RCACHE_PATH_MAX + 32];
+
+    /* a device leased from the broker may have the response in hand */
+    n = sg_broker_get(sg_fd, name, rp, mx_len);
+    if (n >= 0)
+        return n;
+    if ((! sg_rc.active) || (sg_fd != sg_rc.fd) || (mx_len <= 0))
+        return -1;
+    snprintf(fn, sizeof(fn), "%s/%s", sg_rc.key_dir, name);
+    fp = fopen(fn, "rb");
+    if (NULL == fp)
+        return -1;
+    n = -1;
+    if ((1 == fread(hdr, sizeof(hdr), 1, fp)) &&
+        (0 == memcmp(hdr, SG_RCACHE_MAGIC, 4))) {
+        alloc_len = (int)sg_get_unaligned_be32(hdr + 4);
+        n = (int)fread(rp, 1, mx_len, fp);
+        /* if the device filled the allocation length there may be more */
+        if ((n < mx_len) && (n >= alloc_len))
+            n = -1;
+    }
+    fclose(fp);
+    if ((n >= 0) && (sg_rc.verbose > 1))
+        pr2ws("response cache: %s, %d bytes\n", name, n);
+    return n;
+}
+
+void
+sg_rcache_put(int sg_fd, const char * name, const uint8_t * rp, int mx_len,
+              int len)
+{
+    uint8_t hdr[SG_RCACHE_HDR_LEN];
+    char fn[SG_RCACHE_PATH_MAX + 32];
+
+    if ((! sg_rc.active) || (sg_fd != sg_rc.fd) || (len <= 0))
+        return;
+    memcpy(hdr, SG_RCACHE_MAGIC, 4);
+    sg_put_unaligned_be32((uint32_t)mx_len, hdr + 4);
+    snprintf(fn, sizeof(fn), "%s/%s", sg_rc.key_dir, name);
+    if ((! rcache_write(fn, hdr, sizeof(hdr), rp, len)) && sg_rc.verbose)
+        pr2ws("response cache: unable to write %s\n", fn);
+}
+
+#else   /* SG_LIB_WIN32 */
+
+bool
+sg_rcache_open(const char * dir, const char * dev_name, int sg_fd,
+               int verbose)
+{
+    if (dir || dev_name || sg_fd) { }
+    if (verbose)
+        pr2ws("response cache: not supported in Windows\n");
+    return false;
+}
+
+int
+sg_rcache_get(int sg_fd, const char * name, uint8_t * rp, int mx_len)
+{
+    if (sg_fd || name || rp || mx_len) { }
+    return -1;
+}
+
+void
+sg_rcache_put(int sg_fd, const char * name, const uint8_t * rp, int mx_len,
+              int len)
+{
+    if (sg_fd || name || rp || mx_len || len) { }
+}
+
+#endif  /* SG_LIB_WIN32 */
+
+bool
+sg_rcache_active(int sg_fd)
+{
+    return sg_rc.active && (sg_fd == sg_rc.fd) && (sg_fd >= 0);
+}
+
+void
+sg_rcache_close(void)
+{
+    sg_rc.active = false;
+    sg_rc.fd = -1;
+    sg_rc.key_dir[0] = '\0';
+}
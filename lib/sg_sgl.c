@@ -0,0 +1,606 @@
+/*
+ * Copyright (c) 2014-2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/* sg_sgl version 1.02 20261014 */
+
+/* Scatter gather lists of LBA ranges, parsed from the skip= and seek=
+ * operands of the dd family of utilities. Derived from the C++
+ * scat_gath_list class in testing/sg_scat_gath.cpp which sg_mrq_dd uses.
+ * Lists can also be saved to, and memory mapped from, a binary file. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "sg_lib.h"
+
+#ifndef SG_LIB_WIN32
+#include <sys/mman.h>
+#endif
+
+#include "sg_sgl.h"
+#include "sg_cmds_extra.h"
+#include "sg_unaligned.h"
+#include "sg_pr2serr.h"
+
+#define SG_SGL_LBAS_DESCS 256   /* per GET LBA STATUS response */
+#define SG_SGL_BIN_BOM 0x01020304U      /* detects other byte order */
+#define SG_SGL_PATH_MAX 1024
+
+
+bool
+sg_sgl_is_list(const char * arg)
+{
+    int len = (int)strlen(arg);
+
+    if ((('-' == arg[0]) && (1 == len)) || ((len > 1) && ('@' == arg[0])) ||
+        ((len > 2) && ('H' == toupper((uint8_t)arg[0])) && ('@' == arg[1])))
+        return true;
+    return (NULL != strchr(arg, ',')) || (NULL != strchr(arg, ' '));
+}
+
+bool
+sg_sgl_append(struct sg_sgl * sglp, uint64_t lba, int64_t num)
+{
+    int n;
+    struct sg_sgl_elem * ep;
+
+    do {
+        if (sglp->num_elems >= sglp->alloc_elems) {
+            n = sglp->alloc_elems ? (2 * sglp->alloc_elems) : 16;
+            ep = (struct sg_sgl_elem *)realloc(sglp->elems,
+                                               n * sizeof(*ep));
+            if (NULL == ep)
+                return false;
+            sglp->elems = ep;
+            sglp->alloc_elems = n;
+        }
+        ep = sglp->elems + sglp->num_elems++;
+        ep->lba = lba;
+        ep->num = (num > SG_SGL_MAX_NUM) ? SG_SGL_MAX_NUM : (uint32_t)num;
+        lba += ep->num;
+        num -= ep->num;
+    } while (num > 0);
+    return true;
+}
+
+/* Parses LBA,NUM pairs from one line (or the command line) separated by
+ * commas, spaces or tabs; '#' starts a comment. *halfp carries a LBA
+ * whose NUM is on the next line. Returns 0 or SG_LIB_SYNTAX_ERROR. */
+static int
+parse_pairs(struct sg_sgl * sglp, const char * lcp, bool def_hex,
+            int64_t * halfp, const char * where, bool vb)
+{
+    const char * const line = lcp;
+    int n;
+    int64_t ll;
+    uint64_t ull;
+    char tok[32];
+
+    while (1) {
+        lcp += strspn(lcp, " ,\t\r\n");
+        if (('\0' == *lcp) || ('#' == *lcp))
+            return 0;
+        n = (int)strcspn(lcp, " ,\t\r\n#");
+        if (n >= (int)sizeof(tok))
+            n = sizeof(tok) - 1;        /* too long, fails below */
+        memcpy(tok, lcp, n);
+        tok[n] = '\0';
+        if (def_hex) {  /* don't accept negatives or multipliers */
+            if ((strspn(tok, "0123456789abcdefABCDEF") == (size_t)n) &&
+                (1 == sscanf(tok, "%" SCNx64, &ull)))
+                ll = (int64_t)ull;
+            else
+                ll = -1;
+        } else
+            ll = sg_get_llnum(tok);
+        if (ll < 0) {
+            if (vb)
+                pr2serr("%s: bad number at pos %d\n", where,
+                        (int)(lcp - line) + 1);
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        if (*halfp < 0)
+            *halfp = ll;        /* a LBA */
+        else {                  /* a NUM */
+            if (sglp->num_elems >= SG_SGL_MAX_ELEMENTS) {
+                if (vb)
+                    pr2serr("%s: more than %d elements\n", where,
+                            SG_SGL_MAX_ELEMENTS);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            if (! sg_sgl_append(sglp, (uint64_t)*halfp, ll))
+                return sg_convert_errno(ENOMEM);
+            *halfp = -1;
+        }
+        lcp += strcspn(lcp, " ,\t\r\n#");
+    }
+}
+
+/* Reads LBA,NUM pairs from fnp, line by line. Lines starting with '#' are
+ * ignored as is a 'HEX' line before the first pair, which switches to hex
+ * (as sg_mrq_dd's flexible mode does). */
+static int
+file_to_sgl(struct sg_sgl * sglp, const char * fnp, bool def_hex, bool vb)
+{
+    bool have_stdin = (0 == strcmp(fnp, "-"));
+    int k, res, len;
+    int64_t half = -1;
+    FILE * fp;
+    const char * lcp;
+    char where[96];
+    char line[1024];
+
+    fp = have_stdin ? stdin : fopen(fnp, "r");
+    if (NULL == fp) {
+        if (vb)
+            pr2serr("unable to open %s: %s\n", fnp, safe_strerror(errno));
+        return SG_LIB_FILE_ERROR;
+    }
+    res = 0;
+    for (k = 1; fgets(line, sizeof(line), fp); ++k) {
+        len = (int)strlen(line);
+        snprintf(where, sizeof(where), "%s: line %d", have_stdin ?
+                 "<stdin>" : fnp, k);
+        if ((len > 0) && ('\n' != line[len - 1]) && (! feof(fp))) {
+            if (vb)
+                pr2serr("%s: too long, max %d bytes\n", where,
+                        (int)sizeof(line) - 2);
+            res = SG_LIB_SYNTAX_ERROR;
+            break;
+        }
+        lcp = line + strspn(line, " \t");
+        if ((0 == sglp->num_elems) && (half < 0) &&
+            (0 == strncasecmp(lcp, "hex", 3))) {
+            def_hex = true;
+            continue;
+        }
+        res = parse_pairs(sglp, lcp, def_hex, &half, where, vb);
+        if (res)
+            break;
+    }
+    if ((0 == res) && (half >= 0)) {
+        if (vb)
+            pr2serr("%s: expected even number of items: LBA0,NUM0,LBA1,"
+                    "NUM1...\n", fnp);
+        res = SG_LIB_SYNTAX_ERROR;
+    }
+    if (! have_stdin)
+        fclose(fp);
+    return res;
+}
+
+int
+sg_sgl_parse(struct sg_sgl * sglp, const char * id, const char * arg,
+             bool vb)
+{
+    int res;
+    int64_t half = -1;
+
+    if ('-' == arg[0] && ('\0' == arg[1]))
+        res = file_to_sgl(sglp, arg, false, vb);
+    else if (('@' == arg[0]) && sg_sgl_is_bin_file(arg + 1))
+        return sg_sgl_bin_load(sglp, arg + 1, vb);
+    else if ('@' == arg[0])
+        res = file_to_sgl(sglp, arg + 1, false, vb);
+    else if (('H' == toupper((uint8_t)arg[0])) && ('@' == arg[1]))
+        res = file_to_sgl(sglp, arg + 2, true, vb);
+    else {
+        res = parse_pairs(sglp, arg, false, &half, id, vb);
+        if ((0 == res) && (half >= 0)) {
+            if (vb)
+                pr2serr("%s: expected even number of items: LBA0,NUM0,"
+                        "LBA1,NUM1...\n", id);
+            res = SG_LIB_SYNTAX_ERROR;
+        }
+    }
+    if ((0 == res) && (! sg_sgl_sum_scan(sglp)))
+        res = sg_convert_errno(ENOMEM);
+    return res;
+}
+
+bool
+sg_sgl_sum_scan(struct sg_sgl * sglp)
+{
+    int k;
+    int weak;
+    uint64_t lba, end;
+    uint64_t low = 0;
+    uint64_t high = 0;
+    uint64_t prev_lba = 0;
+    uint64_t prev_end = 0;
+    const struct sg_sgl_elem * ep;
+
+    free(sglp->starts);
+    sglp->starts = (int64_t *)malloc((sglp->num_elems + 1) *
+                                     sizeof(int64_t));
+    if (NULL == sglp->starts)
+        return false;
+    sglp->sum = 0;
+    sglp->linearity = SG_SGL_LINEAR;
+    for (k = 0; k < sglp->num_elems; ++k) {
+        ep = sglp->elems + k;
+        sglp->starts[k] = sglp->sum;
+        if (0 == ep->num)
+            continue;   /* degenerate elements are ignored */
+        lba = ep->lba;
+        end = lba + ep->num;
+        if (0 == sglp->sum) {
+            low = lba;
+            high = end;
+        } else {
+            if (lba < prev_lba)
+                weak = SG_SGL_NON_MONOTONIC;
+            else if (lba < prev_end)
+                weak = SG_SGL_MONO_OVERLAP;
+            else if (lba > prev_end)
+                weak = SG_SGL_MONOTONIC;
+            else
+                weak = SG_SGL_LINEAR;
+            if (weak > sglp->linearity)
+                sglp->linearity = weak;
+            if (lba < low)
+                low = lba;
+            if (end > high)
+                high = end;     /* high is one plus highest LBA */
+        }
+        prev_lba = lba;
+        prev_end = end;
+        sglp->sum += ep->num;
+    }
+    sglp->starts[k] = sglp->sum;
+    sglp->lowest_lba = (int64_t)low;
+    sglp->high_lba_p1 = (int64_t)high;
+    return true;
+}
+
+int64_t
+sg_sgl_idx_to_lba(const struct sg_sgl * sglp, int64_t idx, int * remp)
+{
+    int lo, hi, mid;
+    const struct sg_sgl_elem * ep;
+
+    if ((idx < 0) || (idx >= sglp->sum)) {
+        if (remp)
+            *remp = 0;
+        return -1;
+    }
+    /* find last element whose start is <= idx, skips degenerate ones */
+    for (lo = 0, hi = sglp->num_elems - 1; lo < hi; ) {
+        mid = (lo + hi + 1) / 2;
+        if (sglp->starts[mid] <= idx)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    ep = sglp->elems + lo;
+    if (remp)
+        *remp = (int)(ep->num - (idx - sglp->starts[lo]));
+    return (int64_t)ep->lba + (idx - sglp->starts[lo]);
+}
+
+int
+sg_sgl_from_lba_status(struct sg_sgl * sglp, int sg_fd, uint64_t lba,
+                       int64_t num, int verbose)
+{
+    int k, n, res, rlen, ps;
+    const int alloc_len = 8 + (16 * SG_SGL_LBAS_DESCS);
+    uint32_t d_num;
+    uint64_t d_lba, s, e, nxt;
+    uint64_t end = lba + num;
+    struct sg_sgl_elem * ep;
+    const uint8_t * bp;
+    uint8_t * rp;
+
+    rp = (uint8_t *)malloc(alloc_len);
+    if (NULL == rp)
+        return sg_convert_errno(ENOMEM);
+    res = 0;
+    while (lba < end) {
+        res = sg_ll_get_lba_status16(sg_fd, lba, 0 /* rt */, rp, alloc_len,
+                                     true, verbose);
+        if (res)
+            break;
+        rlen = (int)sg_get_unaligned_be32(rp + 0) + 4;
+        if (rlen > alloc_len)
+            rlen = alloc_len;
+        n = (rlen - 8) / 16;
+        if (n < 1) {
+            res = SG_LIB_CAT_MALFORMED;
+            break;
+        }
+        for (k = 0, bp = rp + 8, nxt = lba; (k < n) && (nxt < end);
+             ++k, bp += 16) {
+            d_lba = sg_get_unaligned_be64(bp + 0);
+            d_num = sg_get_unaligned_be32(bp + 8);
+            ps = bp[12] & 0xf;  /* provisioning status */
+            if ((d_lba > nxt) || ((d_lba + d_num) <= nxt))
+                break;  /* expect each to start where the last ended */
+            s = nxt;
+            e = d_lba + d_num;
+            nxt = e;
+            if (e > end)
+                e = end;
+            if ((1 == ps) || (2 == ps))
+                continue;       /* deallocated or anchored, reads zeros */
+            ep = (sglp->num_elems > 0) ? (sglp->elems + sglp->num_elems - 1)
+                                       : NULL;
+            if (ep && ((ep->lba + ep->num) == s) &&
+                ((ep->num + (e - s)) <= SG_SGL_MAX_NUM))
+                ep->num += (uint32_t)(e - s);
+            else if (! sg_sgl_append(sglp, s, (int64_t)(e - s))) {
+                res = sg_convert_errno(ENOMEM);
+                break;
+            }
+        }
+        if (res)
+            break;
+        if (nxt == lba) {       /* no progress */
+            if (verbose)
+                pr2serr("%s: GET LBA STATUS response doesn't cover LBA "
+                        "0x%" PRIx64 "\n", __func__, lba);
+            res = SG_LIB_CAT_MALFORMED;
+            break;
+        }
+        lba = nxt;
+    }
+    free(rp);
+    if ((0 == res) && (! sg_sgl_sum_scan(sglp)))
+        res = sg_convert_errno(ENOMEM);
+    return res;
+}
+
+const char *
+sg_sgl_linearity_str(int linearity)
+{
+    switch (linearity) {
+    case SG_SGL_LINEAR:
+        return "linear";
+    case SG_SGL_MONOTONIC:
+        return "monotonic";
+    case SG_SGL_MONO_OVERLAP:
+        return "monotonic, overlapping";
+    case SG_SGL_NON_MONOTONIC:
+        return "non-monotonic";
+    default:
+        return "unknown";
+    }
+}
+
+void
+sg_sgl_print(const struct sg_sgl * sglp, const char * id, bool show,
+             FILE * fp)
+{
+    int k;
+    const struct sg_sgl_elem * ep;
+
+    fprintf(fp, "%s: elems=%d, linearity=%s, sum=%" PRId64 ", lowest=0x%"
+            PRIx64 ", high_lba_p1=0x%" PRIx64 "\n", id ? id : "unknown",
+            sglp->num_elems, sg_sgl_linearity_str(sglp->linearity),
+            sglp->sum, (uint64_t)sglp->lowest_lba,
+            (uint64_t)sglp->high_lba_p1);
+    for (k = 0; show && (k < sglp->num_elems); ++k) {
+        ep = sglp->elems + k;
+        fprintf(fp, "    lba: 0x%" PRIx64 ", number: 0x%" PRIx32 "\n",
+                ep->lba, ep->num);
+    }
+}
+
+void
+sg_sgl_free(struct sg_sgl * sglp)
+{
+    free(sglp->elems);
+    free(sglp->starts);
+    memset(sglp, 0, sizeof(*sglp));
+}
+
+/* In the binary file, this 64 byte header is followed by the elements as
+ * struct sg_sgl_elem in native byte order */
+struct sgl_bin_hdr_t {
+    char magic[8];      /* SG_SGL_BIN_MAGIC */
+    uint32_t bom;       /* SG_SGL_BIN_BOM */
+    uint16_t version;   /* SG_SGL_BIN_VERSION */
+    uint16_t elem_sz;   /* sizeof(struct sg_sgl_elem) */
+    int64_t num_elems;
+    int64_t sum;
+    int64_t lowest_lba;
+    int64_t high_lba_p1;
+    int32_t linearity;
+    uint8_t reserved[12];
+};
+
+bool
+sg_sgl_is_bin_file(const char * fn)
+{
+    int fd;
+    bool res = false;
+    char b[sizeof(SG_SGL_BIN_MAGIC)];
+
+    fd = open(fn, O_RDONLY);
+    if (fd < 0)
+        return false;
+    if ((sizeof(b) == read(fd, b, sizeof(b))) &&
+        (0 == memcmp(b, SG_SGL_BIN_MAGIC, sizeof(b))))
+        res = true;
+    close(fd);
+    return res;
+}
+
+int
+sg_sgl_bin_save(const struct sg_sgl * sglp, const char * fn)
+{
+    bool ok;
+    int fd, e;
+    ssize_t n;
+    size_t len;
+    struct sgl_bin_hdr_t hdr;
+    char tmp[SG_SGL_PATH_MAX + 16];
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, SG_SGL_BIN_MAGIC, sizeof(hdr.magic));
+    hdr.bom = SG_SGL_BIN_BOM;
+    hdr.version = SG_SGL_BIN_VERSION;
+    hdr.elem_sz = sizeof(struct sg_sgl_elem);
+    hdr.num_elems = sglp->num_elems;
+    hdr.sum = sglp->sum;
+    hdr.lowest_lba = sglp->lowest_lba;
+    hdr.high_lba_p1 = sglp->high_lba_p1;
+    hdr.linearity = sglp->linearity;
+    snprintf(tmp, sizeof(tmp), "%s.%d", fn, (int)getpid());
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return sg_convert_errno(errno);
+    len = (size_t)sglp->num_elems * sizeof(struct sg_sgl_elem);
+    n = write(fd, &hdr, sizeof(hdr));
+    ok = (n == (ssize_t)sizeof(hdr));
+    if (ok && (len > 0)) {
+        n = write(fd, sglp->elems, len);
+        ok = (n == (ssize_t)len);
+    }
+    e = ok ? 0 : ((n < 0) ? errno : ENOSPC);
+    if (close(fd) && ok) {
+        ok = false;
+        e = errno;
+    }
+    if (ok && rename(tmp, fn)) {
+        ok = false;
+        e = errno;
+    }
+    if (! ok) {
+        unlink(tmp);
+        return sg_convert_errno(e);
+    }
+    return 0;
+}
+
+int
+sg_sgl_bin_map(const char * fn, struct sg_sgl_bin * sbp, bool vb)
+{
+    int fd, res;
+    struct stat st;
+    const struct sgl_bin_hdr_t * hp;
+
+    memset(sbp, 0, sizeof(*sbp));
+    fd = open(fn, O_RDONLY);
+    if (fd < 0)
+        return sg_convert_errno(errno);
+    res = SG_LIB_FILE_ERROR;
+    if ((fstat(fd, &st) < 0) ||
+        (st.st_size < (off_t)sizeof(struct sgl_bin_hdr_t)))
+        goto bad;
+    sbp->total_len = (size_t)st.st_size;
+#ifndef SG_LIB_WIN32
+    sbp->basep = mmap(NULL, sbp->total_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (MAP_FAILED == sbp->basep) {
+        res = sg_convert_errno(errno);
+        sbp->basep = NULL;
+        goto bad;
+    }
+    sbp->mapped = true;
+#else
+    sbp->basep = malloc(sbp->total_len);
+    if ((NULL == sbp->basep) ||
+        ((ssize_t)sbp->total_len != read(fd, sbp->basep, sbp->total_len))) {
+        free(sbp->basep);
+        sbp->basep = NULL;
+        goto bad;
+    }
+#endif
+    close(fd);
+    hp = (const struct sgl_bin_hdr_t *)sbp->basep;
+    if (memcmp(hp->magic, SG_SGL_BIN_MAGIC, sizeof(hp->magic)) ||
+        (SG_SGL_BIN_BOM != hp->bom) || (SG_SGL_BIN_VERSION != hp->version) ||
+        (sizeof(struct sg_sgl_elem) != hp->elem_sz) ||
+        (hp->num_elems < 0) ||
+        (sbp->total_len != sizeof(struct sgl_bin_hdr_t) +
+                           ((size_t)hp->num_elems *
+                            sizeof(struct sg_sgl_elem)))) {
+        if (vb)
+            pr2serr("%s is not a binary sgl file (for this machine)\n", fn);
+        sg_sgl_bin_unmap(sbp);
+        return SG_LIB_FILE_ERROR;
+    }
+    sbp->elems = (const struct sg_sgl_elem *)((const uint8_t *)sbp->basep +
+                                              sizeof(struct sgl_bin_hdr_t));
+    sbp->num_elems = hp->num_elems;
+    sbp->sum = hp->sum;
+    sbp->lowest_lba = hp->lowest_lba;
+    sbp->high_lba_p1 = hp->high_lba_p1;
+    sbp->linearity = hp->linearity;
+    return 0;
+bad:
+    close(fd);
+    return res;
+}
+
+void
+sg_sgl_bin_unmap(struct sg_sgl_bin * sbp)
+{
+    if (sbp->basep) {
+#ifndef SG_LIB_WIN32
+        if (sbp->mapped)
+            munmap(sbp->basep, sbp->total_len);
+        else
+#endif
+            free(sbp->basep);
+    }
+    memset(sbp, 0, sizeof(*sbp));
+}
+
+int
+sg_sgl_bin_load(struct sg_sgl * sglp, const char * fn, bool vb)
+{
+    int res;
+    size_t len;
+    struct sg_sgl_bin sb;
+
+    res = sg_sgl_bin_map(fn, &sb, vb);
+    if (res)
+        return res;
+    if (sb.num_elems > (INT32_MAX - 1)) {
+        if (vb)
+            pr2serr("%s: too many elements: %" PRId64 "\n", fn,
+                    sb.num_elems);
+        res = SG_LIB_FILE_ERROR;
+        goto fini;
+    }
+    len = (size_t)sb.num_elems * sizeof(struct sg_sgl_elem);
+    free(sglp->elems);
+    sglp->elems = (struct sg_sgl_elem *)malloc(len ? len : 1);
+    if (NULL == sglp->elems) {
+        sglp->alloc_elems = 0;
+        sglp->num_elems = 0;
+        res = sg_convert_errno(ENOMEM);
+        goto fini;
+    }
+    memcpy(sglp->elems, sb.elems, len);
+    sglp->num_elems = (int)sb.num_elems;
+    sglp->alloc_elems = sglp->num_elems;
+    if (! sg_sgl_sum_scan(sglp))
+        res = sg_convert_errno(ENOMEM);
+    else if ((sglp->sum != sb.sum) && vb)
+        pr2serr("%s: warning: header sum (%" PRId64 ") differs from sum of "
+                "elements (%" PRId64 ")\n", fn, sb.sum, sglp->sum);
+fini:
+    sg_sgl_bin_unmap(&sb);
+    return res;
+}
@@ -0,0 +1,516 @@
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/* sg_zmap version 1.00 20261014 */
+
+/* Zone state map built from REPORT ZONES responses. In memory and in the
+ * file the layout is a 64 byte header (struct zmap_hdr_t) followed by one
+ * struct sg_zmap_ent per zone, in ascending start LBA order. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "sg_lib.h"
+
+#ifndef SG_LIB_WIN32
+#include <sys/mman.h>
+#endif
+
+#include "sg_zmap.h"
+#include "sg_cmds_extra.h"
+#include "sg_unaligned.h"
+#include "sg_pr2serr.h"
+
+#define SG_ZMAP_MAGIC "SGZMAP1"         /* with trailing NUL: 8 bytes */
+#define SG_ZMAP_BOM 0x01020304U         /* detects other byte order */
+#define SG_ZMAP_DEF_RESP_LEN (64 * 1024)
+#define SG_ZMAP_PATH_MAX 1024
+#define ZN_DESC_LEN 64                  /* also the response header length */
+
+struct zmap_hdr_t {
+    char magic[8];
+    uint32_t bom;
+    uint32_t ent_sz;
+    uint64_t num_zones;
+    uint64_t max_lba;
+    uint8_t rsvd[32];
+};
+
+struct sg_zmap {
+    bool mapped;        /* else basep is from calloc() */
+    size_t total_len;
+    uint8_t * basep;
+    struct zmap_hdr_t * hp;
+    struct sg_zmap_ent * ents;
+};
+
+/* zone condition selected by each condition filtering reporting option */
+static int
+zmap_ro2cond(int report_opts)
+{
+    switch (report_opts) {
+    case 1:             /* empty */
+    case 2:             /* implicitly opened */
+    case 3:             /* explicitly opened */
+    case 4:             /* closed */
+        return report_opts;
+    case 5:             /* full */
+        return 0xe;
+    case 6:             /* read only */
+        return 0xd;
+    case 7:             /* offline */
+        return 0xf;
+    case 8:             /* inactive */
+        return 5;
+    case 0x3f:          /* not write pointer */
+        return 0;
+    default:
+        return -1;
+    }
+}
+
+static struct sg_zmap *
+zmap_alloc(uint64_t num_zones, uint64_t max_lba)
+{
+    struct sg_zmap * zmp;
+
+    zmp = (struct sg_zmap *)calloc(1, sizeof(*zmp));
+    if (NULL == zmp)
+        return NULL;
+    zmp->total_len = sizeof(struct zmap_hdr_t) +
+                     (num_zones * sizeof(struct sg_zmap_ent));
+    zmp->basep = (uint8_t *)calloc(1, zmp->total_len);
+    if (NULL == zmp->basep) {
+        free(zmp);
+        return NULL;
+    }
+    zmp->hp = (struct zmap_hdr_t *)zmp->basep;
+    zmp->ents = (struct sg_zmap_ent *)(zmp->basep +
+                                       sizeof(struct zmap_hdr_t));
+    memcpy(zmp->hp->magic, SG_ZMAP_MAGIC, sizeof(zmp->hp->magic));
+    zmp->hp->bom = SG_ZMAP_BOM;
+    zmp->hp->ent_sz = sizeof(struct sg_zmap_ent);
+    zmp->hp->num_zones = num_zones;
+    zmp->hp->max_lba = max_lba;
+    return zmp;
+}
+
+/* Fills *ep from zone descriptor bp. Returns false if the write pointer
+ * offset does not fit */
+static bool
+zmap_set_ent(struct sg_zmap_ent * ep, const uint8_t * bp)
+{
+    uint64_t wp;
+
+    ep->start_lba = sg_get_unaligned_be64(bp + 16);
+    ep->type = bp[0] & 0xf;
+    ep->cond = (bp[1] >> 4) & 0xf;
+    ep->flags = bp[1] & 0x7;
+    ep->rsvd = 0;
+    wp = sg_get_unaligned_be64(bp + 24);
+    if ((UINT64_MAX == wp) || (wp < ep->start_lba))
+        ep->wp_off = SG_ZMAP_NO_WP;
+    else if ((wp - ep->start_lba) >= SG_ZMAP_NO_WP)
+        return false;
+    else
+        ep->wp_off = (uint32_t)(wp - ep->start_lba);
+    return true;
+}
+
+/* Index of the entry whose start LBA is lba, else -1 */
+static int64_t
+zmap_exact(const struct sg_zmap * zmp, uint64_t lba)
+{
+    int64_t k = sg_zmap_find(zmp, lba);
+
+    if ((k >= 0) && (zmp->ents[k].start_lba == lba))
+        return k;
+    return -1;
+}
+
+/* Fetches zones with REPORT ZONES from zone start LBA st_lba and updates
+ * their entries, stopping at the entry with index end_idx (exclusive).
+ * Returns 0 on success */
+static int
+zmap_pass(int sg_fd, struct sg_zmap * zmp, uint64_t st_lba, uint64_t end_idx,
+          int report_opts, uint8_t * buf, int mx_len, uint32_t * num_updp,
+          int verbose)
+{
+    int k, n, res, resid, per_page;
+    int64_t idx;
+    uint64_t lba = st_lba;
+    const uint8_t * bp;
+
+    per_page = (mx_len - ZN_DESC_LEN) / ZN_DESC_LEN;
+    while (true) {
+        res = sg_ll_report_zones(sg_fd, lba, true, report_opts, buf, mx_len,
+                                 &resid, true, verbose);
+        if (res)
+            return res;
+        n = (mx_len - resid - ZN_DESC_LEN) / ZN_DESC_LEN;
+        if (n < 1)
+            return 0;
+        if (sg_get_unaligned_be64(buf + 8) != zmp->hp->max_lba) {
+            pr2ws("zone map: Maximum LBA differs from the device's\n");
+            return SG_LIB_CAT_MALFORMED;
+        }
+        for (k = 0, bp = buf + ZN_DESC_LEN; k < n; ++k, bp += ZN_DESC_LEN) {
+            idx = zmap_exact(zmp, sg_get_unaligned_be64(bp + 16));
+            if (idx < 0) {
+                pr2ws("zone map: no zone starts at LBA 0x%" PRIx64 "\n",
+                      sg_get_unaligned_be64(bp + 16));
+                return SG_LIB_CAT_MALFORMED;
+            }
+            if ((uint64_t)idx >= end_idx)
+                return 0;
+            if (! zmap_set_ent(zmp->ents + idx, bp))
+                return SG_LIB_CAT_MALFORMED;
+            if (num_updp)
+                ++*num_updp;
+        }
+        bp -= ZN_DESC_LEN;
+        lba = sg_get_unaligned_be64(bp + 16) + sg_get_unaligned_be64(bp + 8);
+        if ((n < per_page) || (lba > zmp->hp->max_lba) ||
+            ((uint64_t)(idx + 1) >= end_idx))
+            return 0;
+    }
+}
+
+int
+sg_zmap_build(int sg_fd, int mx_resp_len, struct sg_zmap ** zmpp,
+              int verbose)
+{
+    int k, n, res, resid, per_page;
+    uint32_t num = 0;
+    uint64_t num_zones, lba, max_lba;
+    uint8_t * buf;
+    uint8_t * free_buf;
+    const uint8_t * bp;
+    struct sg_zmap * zmp;
+
+    *zmpp = NULL;
+    if (mx_resp_len <= 0)
+        mx_resp_len = SG_ZMAP_DEF_RESP_LEN;
+    per_page = (mx_resp_len - ZN_DESC_LEN) / ZN_DESC_LEN;
+    if (per_page < 1)
+        return SG_LIB_SYNTAX_ERROR;
+    buf = sg_memalign(mx_resp_len, 0, &free_buf, false);
+    if (NULL == buf)
+        return sg_convert_errno(ENOMEM);
+    /* without the PARTIAL bit the zone list length covers every zone */
+    res = sg_ll_report_zones(sg_fd, 0, false, 0, buf, mx_resp_len, &resid,
+                             true, verbose);
+    if (res)
+        goto fini;
+    if ((mx_resp_len - resid) < ZN_DESC_LEN) {
+        res = SG_LIB_CAT_MALFORMED;
+        goto fini;
+    }
+    num_zones = sg_get_unaligned_be32(buf + 0) / ZN_DESC_LEN;
+    max_lba = sg_get_unaligned_be64(buf + 8);
+    if (verbose > 1)
+        pr2ws("zone map: %" PRIu64 " zones, Maximum LBA 0x%" PRIx64 "\n",
+              num_zones, max_lba);
+    zmp = zmap_alloc(num_zones, max_lba);
+    if (NULL == zmp) {
+        res = sg_convert_errno(ENOMEM);
+        goto fini;
+    }
+    while (true) {
+        n = (mx_resp_len - resid - ZN_DESC_LEN) / ZN_DESC_LEN;
+        if (n > (int)(num_zones - num))
+            n = (int)(num_zones - num);
+        if (n < 1)
+            break;
+        for (k = 0, bp = buf + ZN_DESC_LEN; k < n;
+             ++k, ++num, bp += ZN_DESC_LEN) {
+            if (! zmap_set_ent(zmp->ents + num, bp) ||
+                ((num > 0) &&
+                 (zmp->ents[num].start_lba <= zmp->ents[num - 1].start_lba))) {
+                res = SG_LIB_CAT_MALFORMED;
+                break;
+            }
+        }
+        if (res)
+            break;
+        bp -= ZN_DESC_LEN;
+        lba = sg_get_unaligned_be64(bp + 16) + sg_get_unaligned_be64(bp + 8);
+        if ((lba > max_lba) || (num >= num_zones))
+            break;
+        res = sg_ll_report_zones(sg_fd, lba, true, 0, buf, mx_resp_len,
+                                 &resid, true, verbose);
+        if (res)
+            break;
+    }
+    if ((0 == res) && (num != num_zones)) {
+        pr2ws("zone map: expected %" PRIu64 " zones, found %u\n", num_zones,
+              num);
+        res = SG_LIB_CAT_MALFORMED;
+    }
+    if (res)
+        sg_zmap_free(zmp);
+    else
+        *zmpp = zmp;
+fini:
+    free(free_buf);
+    return res;
+}
+
+int
+sg_zmap_refresh(int sg_fd, struct sg_zmap * zmp, int report_opts,
+                int mx_resp_len, uint32_t * num_updp, int verbose)
+{
+    int cond, res, len;
+    uint64_t k, j, n;
+    uint8_t * buf;
+    uint8_t * free_buf;
+    struct sg_zmap_ent * ents = zmp->ents;
+
+    if (num_updp)
+        *num_updp = 0;
+    if (SG_ZMAP_RO_ACTIVE == report_opts) {
+        for (k = 2; k <= 4; ++k) {      /* implicitly, explicitly, closed */
+            uint32_t nu = 0;
+
+            res = sg_zmap_refresh(sg_fd, zmp, (int)k, mx_resp_len, &nu,
+                                  verbose);
+            if (num_updp)
+                *num_updp += nu;
+            if (res)
+                return res;
+        }
+        return 0;
+    }
+    if (mx_resp_len <= 0)
+        mx_resp_len = SG_ZMAP_DEF_RESP_LEN;
+    if (mx_resp_len < (2 * ZN_DESC_LEN))
+        return SG_LIB_SYNTAX_ERROR;
+    buf = sg_memalign(mx_resp_len, 0, &free_buf, false);
+    if (NULL == buf)
+        return sg_convert_errno(ENOMEM);
+    n = zmp->hp->num_zones;
+    cond = zmap_ro2cond(report_opts);
+    if (cond >= 0) {
+        for (k = 0; k < n; ++k)
+            ents[k].rsvd = (ents[k].cond == cond);
+    }
+    res = zmap_pass(sg_fd, zmp, 0, n, report_opts, buf, mx_resp_len,
+                    num_updp, verbose);
+    if (res || (cond < 0))
+        goto fini;
+    /* entries still marked left that condition; re-read each run of them */
+    for (k = 0; k < n; k = j) {
+        if (0 == ents[k].rsvd) {
+            j = k + 1;
+            continue;
+        }
+        for (j = k + 1; (j < n) && ents[j].rsvd; ++j)
+            ;
+        len = mx_resp_len;
+        if ((j - k) < (uint64_t)((mx_resp_len / ZN_DESC_LEN) - 1))
+            len = ZN_DESC_LEN + (int)((j - k) * ZN_DESC_LEN);
+        if (verbose > 1)
+            pr2ws("zone map: re-read %" PRIu64 " zone(s) from LBA 0x%"
+                  PRIx64 "\n", j - k, ents[k].start_lba);
+        res = zmap_pass(sg_fd, zmp, ents[k].start_lba, j, 0, buf, len,
+                        num_updp, verbose);
+        if (res)
+            break;
+        if (ents[j - 1].rsvd) {   /* the run should have been re-read */
+            res = SG_LIB_CAT_MALFORMED;
+            break;
+        }
+    }
+fini:
+    for (k = 0; k < n; ++k)
+        ents[k].rsvd = 0;
+    free(free_buf);
+    return res;
+}
+
+int
+sg_zmap_save(const struct sg_zmap * zmp, const char * fn)
+{
+    bool ok;
+    int fd, e;
+    ssize_t n;
+    char tmp[SG_ZMAP_PATH_MAX + 16];
+
+    snprintf(tmp, sizeof(tmp), "%s.%d", fn, (int)getpid());
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return sg_convert_errno(errno);
+    n = write(fd, zmp->basep, zmp->total_len);
+    ok = (n == (ssize_t)zmp->total_len);
+    e = ok ? 0 : ((n < 0) ? errno : ENOSPC);
+    if (close(fd) && ok) {
+        ok = false;
+        e = errno;
+    }
+    if (ok && rename(tmp, fn)) {
+        ok = false;
+        e = errno;
+    }
+    if (! ok) {
+        unlink(tmp);
+        return sg_convert_errno(e);
+    }
+    return 0;
+}
+
+int
+sg_zmap_load(const char * fn, struct sg_zmap ** zmpp, int verbose)
+{
+    int fd, res;
+    struct stat st;
+    struct sg_zmap * zmp;
+    const struct zmap_hdr_t * hp;
+
+    *zmpp = NULL;
+    fd = open(fn, O_RDONLY);
+    if (fd < 0)
+        return sg_convert_errno(errno);
+    res = SG_LIB_FILE_ERROR;
+    if ((fstat(fd, &st) < 0) ||
+        (st.st_size < (off_t)sizeof(struct zmap_hdr_t)))
+        goto bad;
+    zmp = (struct sg_zmap *)calloc(1, sizeof(*zmp));
+    if (NULL == zmp) {
+        res = sg_convert_errno(ENOMEM);
+        goto bad;
+    }
+    zmp->total_len = (size_t)st.st_size;
+#ifndef SG_LIB_WIN32
+    zmp->basep = (uint8_t *)mmap(NULL, zmp->total_len,
+                                 PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (MAP_FAILED == (void *)zmp->basep) {
+        res = sg_convert_errno(errno);
+        free(zmp);
+        goto bad;
+    }
+    zmp->mapped = true;
+#else
+    zmp->basep = (uint8_t *)malloc(zmp->total_len);
+    if ((NULL == zmp->basep) ||
+        ((ssize_t)zmp->total_len != read(fd, zmp->basep, zmp->total_len))) {
+        free(zmp->basep);
+        free(zmp);
+        goto bad;
+    }
+#endif
+    close(fd);
+    hp = (const struct zmap_hdr_t *)zmp->basep;
+    if (memcmp(hp->magic, SG_ZMAP_MAGIC, sizeof(hp->magic)) ||
+        (SG_ZMAP_BOM != hp->bom) ||
+        (sizeof(struct sg_zmap_ent) != hp->ent_sz) ||
+        (zmp->total_len != sizeof(struct zmap_hdr_t) +
+                           (hp->num_zones * sizeof(struct sg_zmap_ent)))) {
+        if (verbose)
+            pr2ws("zone map: %s is not a zone map file (for this "
+                  "machine)\n", fn);
+        sg_zmap_free(zmp);
+        return SG_LIB_FILE_ERROR;
+    }
+    zmp->hp = (struct zmap_hdr_t *)zmp->basep;
+    zmp->ents = (struct sg_zmap_ent *)(zmp->basep +
+                                       sizeof(struct zmap_hdr_t));
+    *zmpp = zmp;
+    return 0;
+bad:
+    close(fd);
+    return res;
+}
+
+void
+sg_zmap_free(struct sg_zmap * zmp)
+{
+    if (NULL == zmp)
+        return;
+#ifndef SG_LIB_WIN32
+    if (zmp->mapped)
+        munmap(zmp->basep, zmp->total_len);
+    else
+#endif
+        free(zmp->basep);
+    free(zmp);
+}
+
+uint32_t
+sg_zmap_num_zones(const struct sg_zmap * zmp)
+{
+    return zmp ? (uint32_t)zmp->hp->num_zones : 0;
+}
+
+uint64_t
+sg_zmap_max_lba(const struct sg_zmap * zmp)
+{
+    return zmp ? zmp->hp->max_lba : 0;
+}
+
+const struct sg_zmap_ent *
+sg_zmap_entry(const struct sg_zmap * zmp, uint32_t idx)
+{
+    if ((NULL == zmp) || (idx >= zmp->hp->num_zones))
+        return NULL;
+    return zmp->ents + idx;
+}
+
+uint64_t
+sg_zmap_zone_len(const struct sg_zmap * zmp, uint32_t idx)
+{
+    if ((NULL == zmp) || (idx >= zmp->hp->num_zones))
+        return 0;
+    if ((idx + 1) < zmp->hp->num_zones)
+        return zmp->ents[idx + 1].start_lba - zmp->ents[idx].start_lba;
+    return zmp->hp->max_lba + 1 - zmp->ents[idx].start_lba;
+}
+
+int64_t
+sg_zmap_find(const struct sg_zmap * zmp, uint64_t lba)
+{
+    uint64_t lo, hi, mid;
+
+    if ((NULL == zmp) || (0 == zmp->hp->num_zones) ||
+        (lba > zmp->hp->max_lba) || (lba < zmp->ents[0].start_lba))
+        return -1;
+    /* last entry with start_lba <= lba */
+    lo = 0;
+    hi = zmp->hp->num_zones;
+    while ((hi - lo) > 1) {
+        mid = lo + ((hi - lo) / 2);
+        if (zmp->ents[mid].start_lba <= lba)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return (int64_t)lo;
+}
+
+uint64_t
+sg_zmap_wp(const struct sg_zmap * zmp, uint64_t lba)
+{
+    int64_t k = sg_zmap_find(zmp, lba);
+
+    if ((k < 0) || (SG_ZMAP_NO_WP == zmp->ents[k].wp_off))
+        return UINT64_MAX;
+    return zmp->ents[k].start_lba + zmp->ents[k].wp_off;
+}
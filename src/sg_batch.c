@@ -0,0 +1,444 @@
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <sys/types.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#ifndef SG_LIB_WIN32
+#define SG_BATCH_FORK 1         /* a child process per blob */
+#include <poll.h>
+#include <sys/wait.h>
+#endif
+
+#include "sg_lib.h"
+#include "sg_pr2serr.h"
+
+#include "sg_batch.h"
+
+/* This file holds the --batch=MF manifest reader and the pool of child
+ * processes shared by several decoding utilities. */
+
+#define SG_BATCH_LINE_LEN 4096
+#define SG_BATCH_OUT_CHUNK 8192
+
+#ifdef SG_BATCH_FORK
+
+struct sg_batch_slot {
+    int item;           /* index into the manifest, -1 if slot not in use */
+    int fd;             /* read end of the pipe from the child's stdout */
+    pid_t pid;
+    char * b;           /* what the child has written so far */
+    size_t len;
+    size_t sz;
+};
+
+/* Parses the manifest into a newly allocated array, returned in *arrp.
+ * Returns the number of items or -1 on error. */
+static int
+batch_read_manifest(const char * mf, struct sg_batch_item ** arrp)
+{
+    bool got_stdin;
+    int k, num, ln;
+    int sz = 0;
+    char * cp;
+    char * tp;
+    char * fp;
+    char * bp;
+    FILE * m_fp;
+    struct sg_batch_item * arr = NULL;
+    struct sg_batch_item * nap;
+    char line[SG_BATCH_LINE_LEN];
+
+    got_stdin = (0 == strcmp(mf, "-"));
+    if (got_stdin)
+        m_fp = stdin;
+    else if (NULL == (m_fp = fopen(mf, "r"))) {
+        pr2serr("unable to open manifest %s: %s\n", mf,
+                safe_strerror(errno));
+        return -1;
+    }
+    for (num = 0, ln = 1; fgets(line, sizeof(line), m_fp); ++ln) {
+        if ((cp = strchr(line, '#')))
+            *cp = '\0';
+        tp = strtok(line, " \t\r\n");
+        if (NULL == tp)
+            continue;           /* blank or comment line */
+        fp = strtok(NULL, " \t\r\n");
+        bp = fp ? strtok(NULL, " \t\r\n") : NULL;
+        if (NULL == fp)
+            fp = tp;            /* just FN, use it as the tag */
+        if (num >= sz) {
+            sz = sz ? (2 * sz) : 256;
+            nap = (struct sg_batch_item *)realloc(arr, sz * sizeof(*arr));
+            if (NULL == nap)
+                goto nomem;
+            arr = nap;
+        }
+        arr[num].as_binary = -1;
+        if (bp) {
+            if (0 == strcmp(bp, "bin"))
+                arr[num].as_binary = 1;
+            else if (0 == strcmp(bp, "hex"))
+                arr[num].as_binary = 0;
+            else {
+                pr2serr("manifest %s, line %d: expected 'bin' or 'hex', "
+                        "got '%s'\n", mf, ln, bp);
+                goto err_out;
+            }
+        }
+        arr[num].tag = strdup(tp);
+        arr[num].fn = (fp == tp) ? arr[num].tag : strdup(fp);
+        if ((NULL == arr[num].tag) || (NULL == arr[num].fn))
+            goto nomem;
+        ++num;
+    }
+    if (ferror(m_fp)) {
+        pr2serr("error reading manifest %s\n", mf);
+        goto err_out;
+    }
+    if (! got_stdin)
+        fclose(m_fp);
+    if (0 == num) {
+        pr2serr("manifest %s names no blobs\n", mf);
+        free(arr);
+        return -1;
+    }
+    *arrp = arr;
+    return num;
+nomem:
+    pr2serr("%s: out of memory\n", __func__);
+err_out:
+    for (k = 0; k < num; ++k) {
+        if (arr[k].fn != arr[k].tag)
+            free((char *)arr[k].fn);
+        free((char *)arr[k].tag);
+    }
+    free(arr);
+    if (! got_stdin)
+        fclose(m_fp);
+    return -1;
+}
+
+/* Outputs len bytes at cp as a JSON string (with surrounding quotes) */
+static void
+batch_js_str(const char * cp, size_t len)
+{
+    size_t k;
+    unsigned char c;
+
+    putchar('"');
+    for (k = 0; k < len; ++k) {
+        c = (unsigned char)cp[k];
+        if (('"' == c) || ('\\' == c))
+            printf("\\%c", c);
+        else if ('\n' == c)
+            fputs("\\n", stdout);
+        else if ('\t' == c)
+            fputs("\\t", stdout);
+        else if (c < 0x20)
+            printf("\\u%04x", c);
+        else
+            putchar(c);
+    }
+    putchar('"');
+}
+
+/* Removes whitespace that is not within a JSON string, in place. Returns
+ * the new length. */
+static size_t
+batch_js_compact(char * b, size_t len)
+{
+    bool in_str = false;
+    bool esc = false;
+    size_t k, j;
+    char c;
+
+    for (k = 0, j = 0; k < len; ++k) {
+        c = b[k];
+        if (in_str) {
+            if (esc)
+                esc = false;
+            else if ('\\' == c)
+                esc = true;
+            else if ('"' == c)
+                in_str = false;
+        } else if ('"' == c)
+            in_str = true;
+        else if (isspace((unsigned char)c))
+            continue;
+        b[j++] = c;
+    }
+    return j;
+}
+
+/* Writes one JSON line for the finished child in sp */
+static void
+batch_output(const struct sg_batch_item * ip, struct sg_batch_slot * sp,
+             int exit_status)
+{
+    size_t n;
+    char b[128];
+
+    fputs("{\"tag\":", stdout);
+    batch_js_str(ip->tag, strlen(ip->tag));
+    fputs(",\"file\":", stdout);
+    batch_js_str(ip->fn, strlen(ip->fn));
+    printf(",\"exit_status\":%d", exit_status);
+    if (exit_status && sg_exit2str(exit_status, false, sizeof(b), b)) {
+        fputs(",\"exit_status_meaning\":", stdout);
+        batch_js_str(b, strlen(b));
+    }
+    n = batch_js_compact(sp->b, sp->len);
+    if ((n > 0) && (('{' == sp->b[0]) || ('[' == sp->b[0]))) {
+        fputs(",\"decode\":", stdout);
+        fwrite(sp->b, 1, n, stdout);
+    } else if (sp->len > 0) {   /* not JSON, so give it as a string */
+        fputs(",\"output\":", stdout);
+        batch_js_str(sp->b, sp->len);
+    }
+    fputs("}\n", stdout);
+    fflush(stdout);
+}
+
+/* Forks a child for item k using slot sp. Returns 1 in the child, 0 in the
+ * parent and -1 on error. */
+static int
+batch_start(struct sg_batch_slot * slot_arr, int num_q,
+            struct sg_batch_slot * sp, int k)
+{
+    int j, err;
+    int pfd[2];
+
+    if (pipe(pfd) < 0) {
+        err = errno;
+        pr2serr("pipe() failed: %s\n", safe_strerror(err));
+        return -1;
+    }
+    fflush(stdout);     /* else child would output it again */
+    fflush(stderr);
+    sp->pid = fork();
+    if (sp->pid < 0) {
+        err = errno;
+        pr2serr("fork() failed: %s\n", safe_strerror(err));
+        close(pfd[0]);
+        close(pfd[1]);
+        return -1;
+    }
+    if (0 == sp->pid) {         /* child */
+        close(pfd[0]);
+        for (j = 0; j < num_q; ++j) {
+            if ((slot_arr[j].item >= 0) && (slot_arr[j].fd >= 0))
+                close(slot_arr[j].fd);
+        }
+        if (dup2(pfd[1], STDOUT_FILENO) < 0) {
+            pr2serr("dup2() failed: %s\n", safe_strerror(errno));
+            _exit(SG_LIB_FILE_ERROR);
+        }
+        close(pfd[1]);
+        return 1;
+    }
+    close(pfd[1]);
+    sp->item = k;
+    sp->fd = pfd[0];
+    sp->len = 0;
+    return 0;
+}
+
+/* Reads what is available from the child in sp. Returns true at end of
+ * file (or on a read error). */
+static bool
+batch_collect(struct sg_batch_slot * sp)
+{
+    ssize_t n;
+    char * nbp;
+
+    if ((sp->sz - sp->len) < SG_BATCH_OUT_CHUNK) {
+        nbp = (char *)realloc(sp->b, sp->sz + 4 * SG_BATCH_OUT_CHUNK);
+        if (NULL == nbp) {
+            pr2serr("%s: out of memory\n", __func__);
+            return true;
+        }
+        sp->b = nbp;
+        sp->sz += 4 * SG_BATCH_OUT_CHUNK;
+    }
+    n = read(sp->fd, sp->b + sp->len, sp->sz - sp->len);
+    if (n < 0) {
+        if ((EINTR == errno) || (EAGAIN == errno))
+            return false;
+        pr2serr("read from child: %s\n", safe_strerror(errno));
+        return true;
+    }
+    if (0 == n)
+        return true;
+    sp->len += n;
+    return false;
+}
+
+bool
+sg_batch_run(const char * mf, int num_q, struct sg_batch_item * ip,
+             int * retp, int verbose)
+{
+    int k, j, n, res, status;
+    int num_items, next, num_active, num_failed;
+    int * exit_arr = NULL;
+    long lnum;
+    struct sg_batch_item * item_arr = NULL;
+    struct sg_batch_slot * sp;
+    struct sg_batch_slot * slot_arr = NULL;
+    struct pollfd * pfd_arr = NULL;
+    int * pfd2slot = NULL;
+
+    *retp = 0;
+    num_items = batch_read_manifest(mf, &item_arr);
+    if (num_items < 0) {
+        *retp = SG_LIB_FILE_ERROR;
+        return false;
+    }
+    if (num_q <= 0) {
+        lnum = sysconf(_SC_NPROCESSORS_ONLN);
+        num_q = (lnum > 0) ? (int)lnum : 1;
+    }
+    if (num_q > SG_BATCH_MAX_PARALLEL)
+        num_q = SG_BATCH_MAX_PARALLEL;
+    if (num_q > num_items)
+        num_q = num_items;
+    if (verbose)
+        pr2serr("%d blobs in manifest %s, decode up to %d at once\n",
+                num_items, mf, num_q);
+    exit_arr = (int *)calloc(num_items, sizeof(int));
+    slot_arr = (struct sg_batch_slot *)calloc(num_q, sizeof(*slot_arr));
+    pfd_arr = (struct pollfd *)calloc(num_q, sizeof(*pfd_arr));
+    pfd2slot = (int *)calloc(num_q, sizeof(int));
+    if ((NULL == exit_arr) || (NULL == slot_arr) || (NULL == pfd_arr) ||
+        (NULL == pfd2slot)) {
+        pr2serr("%s: out of memory\n", __func__);
+        *retp = sg_convert_errno(ENOMEM);
+        goto fini;
+    }
+    for (k = 0; k < num_q; ++k) {
+        slot_arr[k].item = -1;
+        slot_arr[k].fd = -1;
+    }
+    for (next = 0, num_active = 0; (next < num_items) || (num_active > 0); ) {
+        /* keep every slot busy while there are blobs left */
+        for (k = 0; (k < num_q) && (next < num_items); ++k) {
+            sp = slot_arr + k;
+            if (sp->item >= 0)
+                continue;
+            res = batch_start(slot_arr, num_q, sp, next);
+            if (res > 0) {      /* in the child */
+                *ip = item_arr[next];
+                return true;    /* the rest is the child's copy, not freed */
+            } else if (res < 0) {
+                exit_arr[next] = SG_LIB_OS_BASE_ERR + EAGAIN;
+                if (0 == num_active) {
+                    /* nothing will finish to free a slot, so give up */
+                    for (j = next + 1; j < num_items; ++j)
+                        exit_arr[j] = exit_arr[next];
+                    next = num_items;
+                    break;
+                }
+                ++next;
+                break;
+            }
+            ++next;
+            ++num_active;
+        }
+        if (0 == num_active)
+            break;
+        for (k = 0, n = 0; k < num_q; ++k) {
+            if (slot_arr[k].item >= 0) {
+                pfd_arr[n].fd = slot_arr[k].fd;
+                pfd_arr[n].events = POLLIN;
+                pfd_arr[n].revents = 0;
+                pfd2slot[n++] = k;
+            }
+        }
+        res = poll(pfd_arr, n, -1);
+        if (res < 0) {
+            if (EINTR == errno)
+                continue;
+            pr2serr("poll() failed: %s\n", safe_strerror(errno));
+            *retp = sg_convert_errno(errno);
+            break;
+        }
+        for (j = 0; j < n; ++j) {
+            if (0 == pfd_arr[j].revents)
+                continue;
+            sp = slot_arr + pfd2slot[j];
+            if (! batch_collect(sp))
+                continue;
+            close(sp->fd);
+            sp->fd = -1;
+            while ((waitpid(sp->pid, &status, 0) < 0) && (EINTR == errno))
+                ;
+            if (WIFEXITED(status))
+                exit_arr[sp->item] = WEXITSTATUS(status);
+            else {
+                if (WIFSIGNALED(status))
+                    pr2serr("%s: decoder killed by signal %d\n",
+                            item_arr[sp->item].tag, WTERMSIG(status));
+                exit_arr[sp->item] = SG_LIB_CAT_OTHER;
+            }
+            batch_output(item_arr + sp->item, sp, exit_arr[sp->item]);
+            sp->item = -1;
+            --num_active;
+        }
+    }
+    for (k = 0, num_failed = 0; k < num_items; ++k) {
+        if (exit_arr[k]) {
+            if (0 == *retp)
+                *retp = exit_arr[k];
+            ++num_failed;
+        }
+    }
+    if (verbose || num_failed)
+        pr2serr("%d of %d blobs decoded without error\n",
+                num_items - num_failed, num_items);
+fini:
+    if (slot_arr) {
+        for (k = 0; k < num_q; ++k)
+            free(slot_arr[k].b);
+    }
+    free(slot_arr);
+    free(pfd_arr);
+    free(pfd2slot);
+    free(exit_arr);
+    for (k = 0; k < num_items; ++k) {
+        if (item_arr[k].fn != item_arr[k].tag)
+            free((char *)item_arr[k].fn);
+        free((char *)item_arr[k].tag);
+    }
+    free(item_arr);
+    return false;
+}
+
+#else   /* no fork() */
+
+bool
+sg_batch_run(const char * mf, int num_q, struct sg_batch_item * ip,
+             int * retp, int verbose)
+{
+    if (mf || num_q || ip || verbose) { }       /* suppress warning */
+    pr2serr("--batch=MF needs fork() which this OS does not have\n");
+    *retp = SG_LIB_SYNTAX_ERROR;
+    return false;
+}
+
+#endif  /* SG_BATCH_FORK */
@@ -0,0 +1,59 @@
+#ifndef SG_BATCH_H
+#define SG_BATCH_H
+
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/* This is a common header file for the --batch=MF option of the sg_vpd,
+ * sg_logs, sg_rep_zones and sg_decode_sense utilities. MF is a manifest
+ * naming many captured responses (blobs), each with a tag. Each blob is
+ * decoded, as if given to --inhex=, in its own child process, with up to a
+ * given number of them at once. Since each child has its own copy of the
+ * utility's state, the existing decoders are used unchanged. The JSON each
+ * child outputs is collected by the parent and written to stdout as one
+ * line (i.e. JSON Lines) together with the blob's tag and exit status. */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SG_BATCH_MAX_PARALLEL 256
+
+/* One line of the manifest */
+struct sg_batch_item {
+    const char * tag;
+    const char * fn;
+    int as_binary;      /* -1: as the command line says, 0: hex, 1: binary */
+};
+
+/* Reads the manifest named mf ('-' for stdin). Each line (anything from and
+ * including a '#' is ignored, as are blank lines) is 'TAG FN [bin|hex]' or
+ * just 'FN' in which case the tag is FN. Then forks a child for each line,
+ * with up to num_q (0 -> number of online processors) running at once.
+ * Returns true in each child, with *ip set to the blob to decode and stdout
+ * going to the parent; the child should decode ip->fn as if given to
+ * --inhex= (with JSON output) then exit via its normal path. Returns false
+ * in the parent once every child has finished (or on error), with *retp
+ * set to 0 if all children succeeded, else to the exit status of the first
+ * one (in manifest order) that failed. */
+bool sg_batch_run(const char * mf, int num_q, struct sg_batch_item * ip,
+                  int * retp, int verbose);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* SG_BATCH_H */
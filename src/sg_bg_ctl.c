@@ -13,6 +13,8 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <errno.h>
+#include <signal.h>
 #include <ctype.h>
 #include <getopt.h>
 #define __STDC_FORMAT_MACROS 1
@@ -27,6 +29,7 @@
 #include "sg_cmds_basic.h"
 #include "sg_unaligned.h"
 #include "sg_pr2serr.h"
+#include "sg_mpoll.h"
 
 /* A utility program originally written for the Linux OS SCSI subsystem.
  *
@@ -35,19 +38,28 @@
  * device. Based on sbc4r10.pdf .
  */
 
-static const char * version_str = "1.14 20230519";
+static const char * version_str = "1.15 20261015";
 
 #define BACKGROUND_CONTROL_SA 0x15
 
 #define SENSE_BUFF_LEN 64       /* Arbitrary, could be larger */
 #define DEF_PT_TIMEOUT  60      /* 60 seconds */
 
+#define BGS_LOG_PAGE 0x15       /* Background scan results */
+#define BGS_BO_SUBPG 0x2        /* Background operation */
+#define BGS_DEF_POLL_SECS 60
+#define BGS_DEF_MAX_STOPS 3
+#define BGS_MAX_DOMS 256
+
 static const char * cmd_name = "Background control";
 
 
 static struct option long_options[] = {
         {"ctl", required_argument, 0, 'c'},
         {"help", no_argument, 0, 'h'},
+        {"lat-max", required_argument, 0, 'l'},
+        {"poll", required_argument, 0, 'p'},
+        {"schedule", required_argument, 0, 's'},
         {"time", required_argument, 0, 't'},
         {"verbose", no_argument, 0, 'v'},
         {"version", no_argument, 0, 'V'},
@@ -59,9 +71,10 @@ static void
 usage()
 {
     pr2serr("Usage: "
-            "sg_bg_ctl  [--ctl=CTL] [--help] [--time=TN] [--verbose] "
+            "sg_bg_ctl  [--ctl=CTL] [--help] [--lat-max=MS] [--poll=SECS]\n"
+            "                  [--schedule=K[,N]] [--time=TN] [--verbose] "
             "[--version]\n"
-            "                  DEVICE\n");
+            "                  DEVICE[@DOM] [DEVICE[@DOM]...]\n");
     pr2serr("  where:\n"
             "    --ctl=CTL|-c CTL    CTL is background operation control "
             "value\n"
@@ -69,6 +82,19 @@ usage()
             "operations\n"
             "                        1 -> start; 2 -> stop\n"
             "    --help|-h          print out usage message\n"
+            "    --lat-max=MS|-l MS    with --schedule, stop a DEVICE's "
+            "operation when\n"
+            "                          TEST UNIT READY takes more than MS "
+            "ms (def: 0\n"
+            "                          -> never)\n"
+            "    --poll=SECS|-p SECS    with --schedule, seconds between "
+            "polls (def: 60)\n"
+            "    --schedule=K[,N]|-s K[,N]    start operations on at most K "
+            "DEVICEs\n"
+            "                                 per domain DOM at once; give "
+            "up on a DEVICE\n"
+            "                                 stopped more than N times "
+            "(def: 3)\n"
             "    --time=TN|-t TN    TN (units 100 ms) is max time to perform "
             "background\n"
             "                       operations (def: 0 -> no limit)\n"
@@ -80,7 +106,8 @@ usage()
             "and allow a resource or\nthin provisioned device (disk) to "
             "perform garbage collection type operations.\nThese may "
             "degrade performance while they occur. Hence it is best to\n"
-            "perform this action while the computer is not too busy.\n");
+            "perform this action while the computer is not too busy.\n"
+            "Only --schedule= accepts more than one DEVICE.\n");
 }
 
 /* Invokes a SCSI BACKGROUND CONTROL command (SBC-4).  Return of 0 -> success,
@@ -139,6 +166,368 @@ sg_ll_background_control(int sg_fd, unsigned int bo_ctl, unsigned int bo_time,
     return ret;
 }
 
+/* Scheduler mode (--schedule=K): background operations are started on at
+ * most K DEVICEs of each domain (e.g. an enclosure or power domain, given
+ * as DEVICE@DOM) at a time. Each round the active DEVICEs are probed with
+ * a timed TEST UNIT READY and their progress read from the Background
+ * scan results and Background operation log pages. A DEVICE whose probe
+ * takes longer than --lat-max=MS has its operation stopped and goes to
+ * the back of the queue, so another DEVICE of that domain gets its turn. */
+
+enum bgs_state {
+    BGS_PENDING = 0,
+    BGS_ACTIVE,
+    BGS_DONE,
+    BGS_FAILED,
+    BGS_GAVE_UP,
+};
+
+struct bgs_dev_t {
+    bool seen_active;   /* log pages have shown it active since start */
+    int sg_fd;
+    int res;            /* 0 or an exit status (e.g. SG_LIB_CAT_*) */
+    int state;          /* enum bgs_state */
+    int dom;            /* index into domain names */
+    int seq;            /* queue position, lowest starts next */
+    int stops;          /* stopped due to TUR latency */
+    int polls;          /* since last start */
+    int progress;       /* 0 to 65535, or -1 */
+    int bms_status;     /* Background scan status, or -1 */
+    int bo_status;      /* BO_STATUS, or -1 */
+    int tur_ms;         /* latest TUR latency */
+    int max_tur_ms;
+    int64_t start_ms;   /* of latest start */
+    int64_t active_ms;  /* total time active */
+    const char * dev_name;
+};
+
+struct bgs_opts_t {
+    int per_dom;        /* K */
+    int max_stops;      /* N */
+    int poll_secs;
+    int lat_max_ms;     /* 0 -> no latency checks */
+    unsigned int time_tnth;
+    int verbose;
+};
+
+static volatile sig_atomic_t bgs_interrupted;
+
+static const char * bgs_state_str[] = {
+    "pending", "active", "done", "failed", "gave up",
+};
+
+static void
+bgs_sig_handler(int sig)
+{
+    if (SIGINT == sig)
+        bgs_interrupted = 1;
+}
+
+/* Reads the Background scan status and progress ([0x15,0x0], parameter 0)
+ * and BO_STATUS ([0x15,0x2], parameter 1) of dp. Either page may be absent,
+ * the corresponding field is then -1. */
+static void
+bgs_read_status(struct bgs_dev_t * dp, int verbose)
+{
+    int res, resid, len, k, pc, pl;
+    uint8_t rsp[256];
+
+    dp->bms_status = -1;
+    dp->bo_status = -1;
+    dp->progress = -1;
+    res = sg_ll_log_sense_v2(dp->sg_fd, false, false, 1, BGS_LOG_PAGE, 0, 0,
+                             rsp, sizeof(rsp), DEF_PT_TIMEOUT, &resid, false,
+                             verbose > 1);
+    len = (0 == res) ? (int)sizeof(rsp) - resid : 0;
+    if (len >= 4)
+        len = ((sg_get_unaligned_be16(rsp + 2) + 4) < len) ?
+                        (sg_get_unaligned_be16(rsp + 2) + 4) : len;
+    for (k = 4; k + 4 <= len; k += pl) {
+        pc = sg_get_unaligned_be16(rsp + k);
+        pl = rsp[k + 3] + 4;
+        if ((0 == pc) && (pl >= 16) && (k + 16 <= len)) {
+            dp->bms_status = rsp[k + 9];
+            if ((1 == dp->bms_status) || (2 == dp->bms_status))
+                dp->progress = sg_get_unaligned_be16(rsp + k + 12);
+            break;
+        }
+    }
+    res = sg_ll_log_sense_v2(dp->sg_fd, false, false, 1, BGS_LOG_PAGE,
+                             BGS_BO_SUBPG, 0, rsp, sizeof(rsp),
+                             DEF_PT_TIMEOUT, &resid, false, verbose > 1);
+    len = (0 == res) ? (int)sizeof(rsp) - resid : 0;
+    for (k = 4; k + 5 <= len; k += rsp[k + 3] + 4) {
+        if (1 == sg_get_unaligned_be16(rsp + k)) {
+            dp->bo_status = rsp[k + 4];
+            break;
+        }
+    }
+}
+
+/* Active if the device reports a medium scan or pre-scan in progress, or
+ * host initiated advanced background operations. */
+static bool
+bgs_is_active(const struct bgs_dev_t * dp)
+{
+    return (1 == dp->bms_status) || (2 == dp->bms_status) ||
+           (1 == dp->bo_status);
+}
+
+static void
+bgs_start(struct bgs_dev_t * dp, const struct bgs_opts_t * bop,
+          const char ** dom_arr)
+{
+    int res;
+
+    res = sg_ll_background_control(dp->sg_fd, 1, bop->time_tnth, true,
+                                   bop->verbose);
+    if (res) {
+        char b[80];
+
+        sg_get_category_sense_str(res, sizeof(b), b, bop->verbose);
+        pr2serr("%s: start failed: %s\n", dp->dev_name, b);
+        dp->res = res;
+        dp->state = BGS_FAILED;
+        return;
+    }
+    dp->state = BGS_ACTIVE;
+    dp->seen_active = false;
+    dp->polls = 0;
+    dp->start_ms = sg_mpoll_now_ms();
+    printf("%s [%s]: started\n", dp->dev_name, dom_arr[dp->dom]);
+}
+
+/* Stops dp, which must be active, and notes its active time. */
+static int
+bgs_stop(struct bgs_dev_t * dp, const struct bgs_opts_t * bop)
+{
+    int res;
+
+    res = sg_ll_background_control(dp->sg_fd, 2, 0, true, bop->verbose);
+    dp->active_ms += sg_mpoll_now_ms() - dp->start_ms;
+    if (res) {
+        char b[80];
+
+        sg_get_category_sense_str(res, sizeof(b), b, bop->verbose);
+        pr2serr("%s: stop failed: %s\n", dp->dev_name, b);
+    }
+    return res;
+}
+
+/* Starts pending DEVICEs, lowest seq first, while their domain has fewer
+ * than per_dom active. */
+static void
+bgs_fill(struct bgs_dev_t * dev_arr, int num, int * act_arr,
+         const struct bgs_opts_t * bop, const char ** dom_arr)
+{
+    int k, best;
+
+    while (! bgs_interrupted) {
+        for (best = -1, k = 0; k < num; ++k) {
+            if ((BGS_PENDING != dev_arr[k].state) ||
+                (act_arr[dev_arr[k].dom] >= bop->per_dom))
+                continue;
+            if ((best < 0) || (dev_arr[k].seq < dev_arr[best].seq))
+                best = k;
+        }
+        if (best < 0)
+            break;
+        bgs_start(dev_arr + best, bop, dom_arr);
+        if (BGS_ACTIVE == dev_arr[best].state)
+            ++act_arr[dev_arr[best].dom];
+    }
+}
+
+/* One poll of the active DEVICE dp. Returns true if it is no longer
+ * active (finished, failed or stopped). */
+static bool
+bgs_poll(struct bgs_dev_t * dp, int * next_seqp,
+         const struct bgs_opts_t * bop, const char ** dom_arr)
+{
+    int res;
+    int64_t t;
+    char b[80];
+
+    ++dp->polls;
+    t = sg_mpoll_now_ms();
+    res = sg_ll_test_unit_ready(dp->sg_fd, 0, false, bop->verbose > 1);
+    dp->tur_ms = (int)(sg_mpoll_now_ms() - t);
+    if (dp->tur_ms > dp->max_tur_ms)
+        dp->max_tur_ms = dp->tur_ms;
+    if (res && (SG_LIB_CAT_UNIT_ATTENTION != res) &&
+        (SG_LIB_CAT_NOT_READY != res)) {
+        sg_get_category_sense_str(res, sizeof(b), b, bop->verbose);
+        pr2serr("%s: TEST UNIT READY: %s\n", dp->dev_name, b);
+        bgs_stop(dp, bop);
+        dp->res = res;
+        dp->state = BGS_FAILED;
+        return true;
+    }
+    if ((bop->lat_max_ms > 0) && (dp->tur_ms > bop->lat_max_ms)) {
+        bgs_stop(dp, bop);
+        ++dp->stops;
+        if (dp->stops > bop->max_stops) {
+            dp->state = BGS_GAVE_UP;
+            printf("%s [%s]: stopped, TUR took %d ms, gave up after %d "
+                   "stops\n", dp->dev_name, dom_arr[dp->dom], dp->tur_ms,
+                   dp->stops);
+        } else {
+            dp->state = BGS_PENDING;
+            dp->seq = (*next_seqp)++;
+            printf("%s [%s]: stopped, TUR took %d ms, requeued\n",
+                   dp->dev_name, dom_arr[dp->dom], dp->tur_ms);
+        }
+        return true;
+    }
+    bgs_read_status(dp, bop->verbose);
+    if (bgs_is_active(dp)) {
+        dp->seen_active = true;
+        if (dp->progress >= 0)
+            printf("%s [%s]: %.2f %%, TUR %d ms\n", dp->dev_name,
+                   dom_arr[dp->dom], 100.0 * dp->progress / 65536.0,
+                   dp->tur_ms);
+        else if (bop->verbose)
+            printf("%s [%s]: active, TUR %d ms\n", dp->dev_name,
+                   dom_arr[dp->dom], dp->tur_ms);
+        return false;
+    }
+    /* not seen active by the second poll: it finished very quickly or
+     * the device does not report it */
+    if ((! dp->seen_active) && (dp->polls < 2))
+        return false;
+    dp->active_ms += sg_mpoll_now_ms() - dp->start_ms;
+    dp->state = BGS_DONE;
+    printf("%s [%s]: done after %.1f minutes%s\n", dp->dev_name,
+           dom_arr[dp->dom], dp->active_ms / 60000.0,
+           dp->seen_active ? "" : " (never reported active)");
+    return true;
+}
+
+static int
+bgs_run(struct bgs_dev_t * dev_arr, int num, const char ** dom_arr,
+        int num_doms, const struct bgs_opts_t * bop)
+{
+    int k, res;
+    int ret = 0;
+    int num_bad = 0;
+    int num_gave_up = 0;
+    int next_seq = num;
+    int * act_arr;
+    struct bgs_dev_t * dp;
+
+    act_arr = (int *)calloc(num_doms, sizeof(int));
+    if (NULL == act_arr)
+        return sg_convert_errno(ENOMEM);
+    for (k = 0, dp = dev_arr; k < num; ++k, ++dp) {
+        dp->seq = k;
+        dp->progress = -1;
+        dp->sg_fd = sg_cmds_open_device(dp->dev_name, false, bop->verbose);
+        if (dp->sg_fd < 0) {
+            pr2serr("open error: %s: %s\n", dp->dev_name,
+                    safe_strerror(-dp->sg_fd));
+            dp->res = sg_convert_errno(-dp->sg_fd);
+            dp->state = BGS_FAILED;
+        }
+    }
+    signal(SIGINT, bgs_sig_handler);
+    while (! bgs_interrupted) {
+        bgs_fill(dev_arr, num, act_arr, bop, dom_arr);
+        for (res = 0, k = 0; k < num; ++k)
+            res += (BGS_ACTIVE == dev_arr[k].state);
+        if (0 == res)
+            break;
+        sg_mpoll_sleep_ms(bop->poll_secs * 1000);
+        for (k = 0, dp = dev_arr; (k < num) && (! bgs_interrupted);
+             ++k, ++dp) {
+            if ((BGS_ACTIVE == dp->state) &&
+                bgs_poll(dp, &next_seq, bop, dom_arr))
+                --act_arr[dp->dom];
+        }
+    }
+    if (bgs_interrupted)
+        pr2serr("interrupted, stopping active background operations\n");
+    for (k = 0, dp = dev_arr; k < num; ++k, ++dp) {
+        if (BGS_ACTIVE == dp->state) {
+            bgs_stop(dp, bop);
+            dp->state = BGS_PENDING;
+        }
+        if (dp->sg_fd >= 0)
+            sg_cmds_close_device(dp->sg_fd);
+    }
+    free(act_arr);
+
+    printf("\n%-24s %-12s %-8s %6s %6s %10s\n", "DEVICE", "domain", "state",
+           "stops", "minutes", "max TUR ms");
+    for (k = 0, dp = dev_arr; k < num; ++k, ++dp) {
+        printf("%-24s %-12s %-8s %6d %6.1f %10d\n", dp->dev_name,
+               dom_arr[dp->dom], bgs_state_str[dp->state], dp->stops,
+               dp->active_ms / 60000.0, dp->max_tur_ms);
+        if (BGS_FAILED == dp->state) {
+            ++num_bad;
+            if (0 == ret)
+                ret = dp->res;
+        } else if (BGS_DONE != dp->state)
+            ++num_gave_up;
+    }
+    fflush(stdout);
+    if (num_bad)
+        pr2serr("%d of %d DEVICEs failed\n", num_bad, num);
+    if (num_gave_up)
+        pr2serr("%d of %d DEVICEs did not finish\n", num_gave_up, num);
+    if (bgs_interrupted && (0 == ret))
+        ret = SG_LIB_CAT_OTHER;
+    return ret;
+}
+
+/* Splits each DEVICE[@DOM] of dev_argv into a bgs_dev_t and a domain
+ * index, then runs the scheduler. */
+static int
+bgs_main(char * dev_argv[], int num, const struct bgs_opts_t * bop)
+{
+    int k, j;
+    int num_doms = 0;
+    int ret;
+    char * cp;
+    const char * dom_arr[BGS_MAX_DOMS];
+    struct bgs_dev_t * dev_arr;
+
+    dev_arr = (struct bgs_dev_t *)calloc(num, sizeof(struct bgs_dev_t));
+    if (NULL == dev_arr) {
+        pr2serr("unable to allocate DEVICE list\n");
+        return sg_convert_errno(ENOMEM);
+    }
+    for (k = 0; k < num; ++k) {
+        const char * dom = "-";
+
+        cp = strrchr(dev_argv[k], '@');
+        if (cp && (cp > dev_argv[k]) && cp[1]) {
+            *cp = '\0';
+            dom = cp + 1;
+        }
+        dev_arr[k].dev_name = dev_argv[k];
+        for (j = 0; j < num_doms; ++j) {
+            if (0 == strcmp(dom, dom_arr[j]))
+                break;
+        }
+        if (j >= num_doms) {
+            if (num_doms >= BGS_MAX_DOMS) {
+                pr2serr("too many domains, %d is the maximum\n",
+                        BGS_MAX_DOMS);
+                free(dev_arr);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            dom_arr[num_doms++] = dom;
+        }
+        dev_arr[k].dom = j;
+    }
+    if (bop->verbose)
+        pr2serr("%d DEVICEs in %d domains, at most %d active per domain\n",
+                num, num_doms, bop->per_dom);
+    ret = bgs_run(dev_arr, num, dom_arr, num_doms, bop);
+    free(dev_arr);
+    return ret;
+}
+
 
 int
 main(int argc, char * argv[])
@@ -150,13 +539,19 @@ main(int argc, char * argv[])
     unsigned int ctl = 0;
     unsigned int time_tnth = 0;
     int verbose = 0;
+    int dev_idx = 0;
     const char * device_name = NULL;
     int ret = 0;
+    struct bgs_opts_t bgs_opts;
+    struct bgs_opts_t * bop = &bgs_opts;
 
+    memset(bop, 0, sizeof(bgs_opts));
+    bop->poll_secs = BGS_DEF_POLL_SECS;
+    bop->max_stops = BGS_DEF_MAX_STOPS;
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "c:ht:vV", long_options, &option_index);
+        c = getopt_long(argc, argv, "c:hl:p:s:t:vV", long_options, &option_index);
         if (c == -1)
             break;
 
@@ -171,6 +566,35 @@ main(int argc, char * argv[])
         case '?':
             usage();
             return 0;
+        case 'l':
+            bop->lat_max_ms = sg_get_num(optarg);
+            if ((bop->lat_max_ms < 0) || (bop->lat_max_ms > 3600000)) {
+                pr2serr("--lat-max= expects a number from 0 to 3600000\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case 'p':
+            bop->poll_secs = sg_get_num(optarg);
+            if ((bop->poll_secs < 1) || (bop->poll_secs > 86400)) {
+                pr2serr("--poll= expects a number from 1 to 86400\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case 's':
+            {
+                const char * cp = strchr(optarg, ',');
+
+                bop->per_dom = sg_get_num(optarg);
+                if (cp)
+                    bop->max_stops = sg_get_num(cp + 1);
+                if ((bop->per_dom < 1) || (bop->per_dom > 1024) ||
+                    (bop->max_stops < 0) || (bop->max_stops > 1000)) {
+                    pr2serr("--schedule= expects K from 1 to 1024 and N "
+                            "from 0 to 1000\n");
+                    return SG_LIB_SYNTAX_ERROR;
+                }
+            }
+            break;
         case 't':
             if ((1 != sscanf(optarg, "%4u", &time_tnth)) ||
                 (time_tnth > 255)) {
@@ -192,11 +616,12 @@ main(int argc, char * argv[])
         }
     }
     if (optind < argc) {
+        dev_idx = optind;
         if (NULL == device_name) {
             device_name = argv[optind];
             ++optind;
         }
-        if (optind < argc) {
+        if ((optind < argc) && (0 == bop->per_dom)) {
             for (; optind < argc; ++optind)
                 pr2serr("Unexpected extra argument: %s\n",
                         argv[optind]);
@@ -230,6 +655,19 @@ main(int argc, char * argv[])
         usage();
         return SG_LIB_SYNTAX_ERROR;
     }
+    if (bop->per_dom > 0) {
+        if (ctl > 1) {
+            pr2serr("--schedule= starts operations, so --ctl=%u makes no "
+                    "sense\n", ctl);
+            return SG_LIB_CONTRADICT;
+        }
+        bop->time_tnth = time_tnth;
+        bop->verbose = verbose;
+        ret = bgs_main(argv + dev_idx, argc - dev_idx, bop);
+        return (ret >= 0) ? ret : SG_LIB_CAT_OTHER;
+    } else if (bop->lat_max_ms || (BGS_DEF_POLL_SECS != bop->poll_secs))
+        pr2serr("--lat-max= and --poll= are ignored without "
+                "--schedule=\n");
 
     sg_fd = sg_cmds_open_device(device_name, false, verbose);
     if (sg_fd < 0) {
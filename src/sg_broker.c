@@ -0,0 +1,735 @@
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1           /* for accept4() and struct ucred */
+#endif
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/sysmacros.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "sg_lib.h"
+#include "sg_pt.h"
+#include "sg_cmds_basic.h"
+#include "sg_broker.h"
+#include "sg_linux_inc.h"
+#include "sg_io_linux.h"
+#include "sg_unaligned.h"
+#include "sg_pr2serr.h"
+
+/* A utility program originally written for the Linux OS SCSI subsystem.
+ *
+ * This program is a long-lived device broker. It listens on a Unix socket
+ * and, when asked for a device by the library in another sg3_utils
+ * process (see sg_broker.h), passes that process an open file descriptor
+ * of the device together with a snapshot of what kind of pass-through it
+ * is and of its identification. Opens of each device are kept and reused
+ * by later clients so short invocations of the utilities skip the open,
+ * the driver type probe and, often, the identification commands.
+ */
+
+static const char * version_str = "1.00 20261015";
+
+#define MAX_DEVICES 256
+#define MAX_OPENS 8             /* per device, one per concurrent client */
+#define MAX_CLIENTS 512
+#define DEF_IDLE 60             /* seconds an unleased open is kept */
+#define DEF_REFRESH 10          /* seconds identification is trusted */
+#define REQ_TIMEOUT_MS 1000     /* for the client to send its request */
+#define MAX_DRAIN 256           /* orphaned sg responses discarded */
+
+struct bopen_t {
+    int fd;                     /* -1 when not open */
+    bool leased;
+    double last_tm;             /* when last leased or returned */
+};
+
+struct bdev_t {
+    bool in_use;
+    bool stale;                 /* device node changed, free when idle */
+    bool rdwr;                  /* opens are O_RDWR, else O_RDONLY */
+    int num_leased;
+    dev_t rdev;
+    long long ctime_s;
+    double ident_tm;            /* when identification last fetched */
+    char name[SG_BROKER_NAME_MAX];
+    struct bopen_t open_arr[MAX_OPENS];
+    struct sg_broker_info info;
+};
+
+struct client_t {
+    int sock_fd;                /* -1 when slot free */
+    int dev_idx;
+    int open_idx;
+};
+
+struct opts_t {
+    int idle;
+    int refresh;
+    int verbose;
+    const char * sock_path;
+};
+
+static volatile sig_atomic_t stop_flag;
+
+static int num_clients;
+static struct bdev_t devs[MAX_DEVICES];
+static struct client_t clients[MAX_CLIENTS];
+
+
+static struct option long_options[] = {
+        {"help", no_argument, 0, 'h'},
+        {"idle", required_argument, 0, 'i'},
+        {"refresh", required_argument, 0, 'r'},
+        {"socket", required_argument, 0, 's'},
+        {"verbose", no_argument, 0, 'v'},
+        {"version", no_argument, 0, 'V'},
+        {0, 0, 0, 0},
+};
+
+
+static void
+usage()
+{
+    pr2serr("Usage: "
+            "sg_broker  [--help] [--idle=SECS] [--refresh=SECS] "
+            "[--socket=PATH]\n"
+            "                  [--verbose] [--version]\n");
+    pr2serr("  where:\n"
+            "    --help|-h          print out usage message\n"
+            "    --idle=SECS|-i SECS    close an open no client has used "
+            "for SECS\n"
+            "                           seconds (def: %d)\n"
+            "    --refresh=SECS|-r SECS    fetch identification again when "
+            "it is older\n"
+            "                              than SECS seconds (def: %d)\n"
+            "    --socket=PATH|-s PATH    Unix socket to listen on (def: "
+            "%s)\n"
+            "    --verbose|-v       increase verbosity\n"
+            "    --version|-V       print version string and exit\n\n"
+            "Device broker. Utilities started with the %s environment\n"
+            "variable set to PATH (or to \"\" for the default) are passed "
+            "open devices\nby this process, together with their driver type "
+            "and identification.\n", DEF_IDLE, DEF_REFRESH,
+            SG_BROKER_DEF_SOCKET, SG_BROKER_ENV);
+}
+
+static void
+sig_handler(int sig)
+{
+    if ((SIGINT == sig) || (SIGTERM == sig))
+        stop_flag = 1;
+}
+
+static double
+get_mono_secs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + ((double)ts.tv_nsec / 1000000000.0);
+}
+
+static void
+close_dev(struct bdev_t * dp, int vb)
+{
+    int k;
+
+    for (k = 0; k < MAX_OPENS; ++k) {
+        if (dp->open_arr[k].fd >= 0)
+            close(dp->open_arr[k].fd);
+        dp->open_arr[k].fd = -1;
+    }
+    if (vb)
+        pr2serr("closed %s\n", dp->name);
+    dp->in_use = false;
+}
+
+/* Discards responses to commands that a client left behind on a sg open
+ * so the next client does not read them. */
+static void
+drain_sg(int fd)
+{
+    int k;
+    struct sg_io_hdr io_hdr;
+
+    for (k = 0; k < MAX_DRAIN; ++k) {
+        memset(&io_hdr, 0, sizeof(io_hdr));
+        io_hdr.interface_id = 'S';
+        io_hdr.pack_id = -1;
+        if (read(fd, &io_hdr, sizeof(io_hdr)) < 0)
+            break;          /* EAGAIN when nothing is waiting */
+    }
+}
+
+/* Fills the driver type part of the snapshot, as check_file_type() in
+ * lib/sg_pt_linux.c would find it. */
+static void
+probe_dev(struct bdev_t * dp, int fd, const struct stat * stp, int vb)
+{
+    int type;
+    const struct sg_linux_caps * capsp;
+    struct sg_broker_info * bip = &dp->info;
+    struct sg_pt_base * ptvp;
+
+    sg_linux_caps_reset();      /* a driver may have been loaded */
+    capsp = sg_linux_get_caps(vb);
+    bip->st_mode = (uint32_t)stp->st_mode;
+    bip->st_rdev = (uint64_t)stp->st_rdev;
+    type = check_pt_file_handle(fd, dp->name, vb);
+    bip->is_sg = (1 == type);
+    bip->is_bsg = (2 == type);
+    bip->is_nvme = ((3 == type) || (4 == type));
+    bip->is_nvme_gen = bip->is_nvme && S_ISCHR(stp->st_mode) &&
+                       (capsp->nvme_gen_major > 0) &&
+                       (capsp->nvme_gen_major == (int)major(stp->st_rdev));
+    bip->sg_version = bip->is_sg ? capsp->sg_version : 0;
+    bip->nvme_nsid = 0;
+    if (bip->is_nvme) {
+        ptvp = construct_scsi_pt_obj_with_fd(fd, vb);
+        if (ptvp) {
+            bip->nvme_nsid = get_pt_nvme_nsid(ptvp);
+            destruct_scsi_pt_obj(ptvp);
+        }
+    }
+}
+
+/* Fetches one response into the snapshot. Returns true if it was. */
+static bool
+fetch_id(int fd, struct sg_broker_id * idp, const char * name, int vb)
+{
+    bool evpd = ('v' == name[0]);
+    int res, resid, k;
+    int pg = 0;
+
+    memset(idp, 0, sizeof(*idp));
+    snprintf(idp->name, sizeof(idp->name), "%s", name);
+    for (k = 0; k < 2; ++k) {   /* again after a unit attention */
+        resid = 0;
+        if (0 == strcmp(name, "rcap16")) {
+            idp->alloc_len = 32;
+            res = sg_ll_readcap_16(fd, false, 0, idp->resp, idp->alloc_len,
+                                   false, vb);
+        } else if (0 == strcmp(name, "rcap10")) {
+            idp->alloc_len = 8;
+            res = sg_ll_readcap_10(fd, false, 0, idp->resp, idp->alloc_len,
+                                   false, vb);
+        } else {
+            pg = (int)strtol(name + 4, NULL, 16);
+            idp->alloc_len = SG_BROKER_ID_MAX_LEN;
+            res = sg_ll_inquiry_v2(fd, evpd, pg, idp->resp, idp->alloc_len,
+                                   0, &resid, false, vb);
+        }
+        if (SG_LIB_CAT_UNIT_ATTENTION != res)
+            break;
+    }
+    if (res || (resid < 0) || (resid >= idp->alloc_len))
+        return false;
+    idp->len = idp->alloc_len - resid;
+    if (evpd && ((idp->len < 4) || (pg != idp->resp[1])))
+        idp->len = 0;
+    return (idp->len > 0);
+}
+
+static bool
+vpd_listed(const struct sg_broker_id * v0p, int pg)
+{
+    int k;
+    int n = v0p->len;
+
+    if (n > 4 + (int)sg_get_unaligned_be16(v0p->resp + 2))
+        n = 4 + sg_get_unaligned_be16(v0p->resp + 2);
+    for (k = 4; k < n; ++k) {
+        if (pg == v0p->resp[k])
+            return true;
+    }
+    return false;
+}
+
+/* Fetches the identification part of the snapshot with fd */
+static void
+fetch_ident(struct bdev_t * dp, int fd, int vb)
+{
+    int pdt, n;
+    struct sg_broker_id * idp = dp->info.id_arr;
+
+    memset(idp, 0, sizeof(dp->info.id_arr));
+    if (! fetch_id(fd, idp, "inq_00", vb)) {
+        if (vb)
+            pr2serr("%s: no standard INQUIRY response\n", dp->name);
+        return;
+    }
+    pdt = idp->resp[0] & PDT_MASK;
+    n = 1;
+    if (fetch_id(fd, idp + n, "vpd_00", vb)) {
+        const struct sg_broker_id * v0p = idp + n;
+
+        ++n;
+        if (vpd_listed(v0p, 0x80) && fetch_id(fd, idp + n, "vpd_80", vb))
+            ++n;
+        if (vpd_listed(v0p, 0x83) && fetch_id(fd, idp + n, "vpd_83", vb))
+            ++n;
+    }
+    if ((PDT_DISK == pdt) || (PDT_OPTICAL == pdt) || (PDT_RBC == pdt) ||
+        (PDT_ZBC == pdt)) {
+        if (fetch_id(fd, idp + n, "rcap16", vb))
+            ++n;
+        if (fetch_id(fd, idp + n, "rcap10", vb))
+            ++n;
+    }
+    memset(idp + n, 0, (SG_BROKER_NUM_IDS - n) * sizeof(*idp));
+    if (vb > 1)
+        pr2serr("%s: %d responses in identification snapshot\n", dp->name,
+                n);
+}
+
+/* Returns index in devs[] of the entry for name, making one if needed,
+ * or -1 with *errp set. */
+static int
+find_dev(const char * name, int * errp, int vb)
+{
+    int k;
+    int free_k = -1;
+    struct bdev_t * dp;
+    struct stat st;
+
+    if (stat(name, &st) < 0) {
+        *errp = errno;
+        return -1;
+    }
+    if (! (S_ISCHR(st.st_mode) || S_ISBLK(st.st_mode))) {
+        *errp = ENODEV;
+        return -1;
+    }
+    for (k = 0, dp = devs; k < MAX_DEVICES; ++k, ++dp) {
+        if (! dp->in_use) {
+            if (free_k < 0)
+                free_k = k;
+            continue;
+        }
+        if (dp->stale || strcmp(name, dp->name))
+            continue;
+        if ((dp->rdev == st.st_rdev) &&
+            (dp->ctime_s == (long long)st.st_ctime))
+            return k;
+        /* node re-created (e.g. hotplug), this entry refers to the old */
+        if (vb)
+            pr2serr("%s: device node changed\n", name);
+        dp->stale = true;
+        if (0 == dp->num_leased)
+            close_dev(dp, vb);
+        if (free_k < 0)
+            free_k = k;
+    }
+    if (free_k < 0) {
+        *errp = ENFILE;
+        return -1;
+    }
+    dp = devs + free_k;
+    memset(dp, 0, sizeof(*dp));
+    for (k = 0; k < MAX_OPENS; ++k)
+        dp->open_arr[k].fd = -1;
+    dp->in_use = true;
+    dp->rdwr = true;
+    dp->rdev = st.st_rdev;
+    dp->ctime_s = (long long)st.st_ctime;
+    dp->ident_tm = -1.0;
+    snprintf(dp->name, sizeof(dp->name), "%s", name);
+    return free_k;
+}
+
+/* Returns index of an unleased open of dp, opening another if needed, or
+ * -1 with *errp set. */
+static int
+get_open(struct bdev_t * dp, int * errp, int vb)
+{
+    int k, fd;
+    int free_k = -1;
+    struct stat st;
+
+    for (k = 0; k < MAX_OPENS; ++k) {
+        if (dp->open_arr[k].fd < 0) {
+            if (free_k < 0)
+                free_k = k;
+        } else if (! dp->open_arr[k].leased)
+            return k;
+    }
+    if (free_k < 0) {
+        *errp = EBUSY;
+        return -1;
+    }
+    fd = -1;
+    if (dp->rdwr) {
+        fd = open(dp->name, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        if ((fd < 0) && ((EACCES == errno) || (EROFS == errno)))
+            dp->rdwr = false;
+    }
+    if (! dp->rdwr)
+        fd = open(dp->name, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        *errp = errno;
+        return -1;
+    }
+    if (dp->ident_tm < 0.0) {   /* first open of this device */
+        if (fstat(fd, &st) < 0) {
+            *errp = errno;
+            close(fd);
+            return -1;
+        }
+        probe_dev(dp, fd, &st, vb);
+    }
+    if (vb)
+        pr2serr("opened %s %s\n", dp->name, dp->rdwr ? "read-write" :
+                "read-only");
+    dp->open_arr[free_k].fd = fd;
+    dp->open_arr[free_k].leased = false;
+    return free_k;
+}
+
+/* Sends the reply, with fd unless it is negative */
+static void
+send_rep(int sock_fd, const struct sg_broker_rep * repp, int fd)
+{
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr * cmp;
+    union {
+        char b[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } cbuf;
+
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = (void *)repp;
+    iov.iov_len = sizeof(*repp);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (fd >= 0) {
+        memset(&cbuf, 0, sizeof(cbuf));
+        msg.msg_control = cbuf.b;
+        msg.msg_controllen = sizeof(cbuf.b);
+        cmp = CMSG_FIRSTHDR(&msg);
+        cmp->cmsg_level = SOL_SOCKET;
+        cmp->cmsg_type = SCM_RIGHTS;
+        cmp->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmp), &fd, sizeof(int));
+    }
+    sendmsg(sock_fd, &msg, MSG_NOSIGNAL);
+}
+
+/* Handles a new connection on the listening socket */
+static void
+new_client(int lfd, const struct opts_t * op)
+{
+    int sfd, k, dev_idx, open_idx, err;
+    int vb = op->verbose;
+    double now;
+    socklen_t len;
+    struct ucred cred;
+    struct pollfd pfd;
+    struct bdev_t * dp;
+    struct bopen_t * bop;
+    struct sg_broker_req req;
+    static struct sg_broker_rep rep;
+
+    sfd = accept4(lfd, NULL, NULL, SOCK_CLOEXEC);
+    if (sfd < 0)
+        return;
+    memset(&rep, 0, sizeof(rep));
+    rep.magic = SG_BROKER_MAGIC;
+    len = sizeof(cred);
+    /* only pass devices to processes of this user (or root) */
+    if ((getsockopt(sfd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0) ||
+        ((0 != cred.uid) && (geteuid() != cred.uid))) {
+        if (vb)
+            pr2serr("refused client of another user\n");
+        rep.err = EPERM;
+        goto reply;
+    }
+    pfd.fd = sfd;
+    pfd.events = POLLIN;
+    if ((poll(&pfd, 1, REQ_TIMEOUT_MS) < 1) ||
+        (recv(sfd, &req, sizeof(req), MSG_WAITALL) != (ssize_t)sizeof(req))
+        || (SG_BROKER_MAGIC != req.magic)) {
+        rep.err = EPROTO;
+        goto reply;
+    }
+    req.dev_name[SG_BROKER_NAME_MAX - 1] = '\0';
+    for (k = 0; k < MAX_CLIENTS; ++k) {
+        if (clients[k].sock_fd < 0)
+            break;
+    }
+    if (k >= MAX_CLIENTS) {
+        rep.err = EMFILE;
+        goto reply;
+    }
+    dev_idx = find_dev(req.dev_name, &err, vb);
+    if (dev_idx < 0) {
+        rep.err = err;
+        goto reply;
+    }
+    dp = devs + dev_idx;
+    open_idx = get_open(dp, &err, vb);
+    if (open_idx < 0) {
+        rep.err = err;
+        goto reply;
+    }
+    if ((SG_BROKER_FL_RDWR & req.flags) && (! dp->rdwr)) {
+        rep.err = EACCES;
+        goto reply;
+    }
+    bop = dp->open_arr + open_idx;
+    now = get_mono_secs();
+    if ((dp->ident_tm < 0.0) || ((now - dp->ident_tm) > op->refresh)) {
+        fetch_ident(dp, bop->fd, vb);
+        dp->ident_tm = get_mono_secs();
+    }
+    bop->leased = true;
+    bop->last_tm = now;
+    ++dp->num_leased;
+    clients[k].sock_fd = sfd;
+    clients[k].dev_idx = dev_idx;
+    clients[k].open_idx = open_idx;
+    if (k >= num_clients)
+        num_clients = k + 1;
+    rep.info = dp->info;
+    if (vb > 1)
+        pr2serr("leased %s [%d] to pid %d\n", dp->name, open_idx,
+                (int)cred.pid);
+    send_rep(sfd, &rep, bop->fd);
+    return;
+
+reply:
+    send_rep(sfd, &rep, -1);
+    close(sfd);
+}
+
+/* The client has closed its socket (or exited), take its open back */
+static void
+end_client(struct client_t * cp, int vb)
+{
+    struct bdev_t * dp = devs + cp->dev_idx;
+    struct bopen_t * bop = dp->open_arr + cp->open_idx;
+
+    close(cp->sock_fd);
+    cp->sock_fd = -1;
+    if (dp->info.is_sg)
+        drain_sg(bop->fd);
+    bop->leased = false;
+    bop->last_tm = get_mono_secs();
+    --dp->num_leased;
+    if (vb > 1)
+        pr2serr("%s [%d] returned\n", dp->name, cp->open_idx);
+    if (dp->stale && (0 == dp->num_leased))
+        close_dev(dp, vb);
+}
+
+/* Closes opens that have not been leased for op->idle seconds */
+static void
+close_idle(const struct opts_t * op)
+{
+    int j, k, n;
+    double now = get_mono_secs();
+    struct bdev_t * dp;
+    struct bopen_t * bop;
+
+    for (k = 0, dp = devs; k < MAX_DEVICES; ++k, ++dp) {
+        if (! dp->in_use)
+            continue;
+        for (j = 0, n = 0, bop = dp->open_arr; j < MAX_OPENS; ++j, ++bop) {
+            if (bop->fd < 0)
+                continue;
+            if ((! bop->leased) && ((now - bop->last_tm) > op->idle)) {
+                close(bop->fd);
+                bop->fd = -1;
+            } else
+                ++n;
+        }
+        if (0 == n)
+            close_dev(dp, op->verbose);
+    }
+}
+
+static int
+open_listener(const char * path)
+{
+    int fd;
+    mode_t old_mask;
+    struct sockaddr_un sun;
+    struct stat st;
+
+    if (strlen(path) >= sizeof(sun.sun_path)) {
+        pr2serr("socket path too long: %s\n", path);
+        return -1;
+    }
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    memset(&sun, 0, sizeof(sun));
+    sun.sun_family = AF_UNIX;
+    strcpy(sun.sun_path, path);
+    /* a socket left by an earlier broker would make bind() fail */
+    if ((0 == stat(path, &st)) && S_ISSOCK(st.st_mode))
+        unlink(path);
+    old_mask = umask(077);
+    if (bind(fd, (const struct sockaddr *)&sun, sizeof(sun)) < 0) {
+        pr2serr("bind to %s failed: %s\n", path, safe_strerror(errno));
+        umask(old_mask);
+        close(fd);
+        return -1;
+    }
+    umask(old_mask);
+    if (listen(fd, 64) < 0) {
+        perror("listen");
+        close(fd);
+        unlink(path);
+        return -1;
+    }
+    return fd;
+}
+
+
+int
+main(int argc, char * argv[])
+{
+    int c, k, n, lfd;
+    struct opts_t opts;
+    struct opts_t * op = &opts;
+    struct sigaction sa;
+    static struct pollfd pfds[1 + MAX_CLIENTS];
+    int pmap[1 + MAX_CLIENTS];
+
+    memset(op, 0, sizeof(opts));
+    op->idle = DEF_IDLE;
+    op->refresh = DEF_REFRESH;
+    op->sock_path = getenv(SG_BROKER_ENV);
+    if ((NULL == op->sock_path) || ('\0' == op->sock_path[0]))
+        op->sock_path = SG_BROKER_DEF_SOCKET;
+    while (1) {
+        int option_index = 0;
+
+        c = getopt_long(argc, argv, "hi:r:s:vV", long_options,
+                        &option_index);
+        if (c == -1)
+            break;
+
+        switch (c) {
+        case 'h':
+        case '?':
+            usage();
+            return 0;
+        case 'i':
+            op->idle = sg_get_num(optarg);
+            if (op->idle < 0) {
+                pr2serr("--idle= expects a number of seconds\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case 'r':
+            op->refresh = sg_get_num(optarg);
+            if (op->refresh < 0) {
+                pr2serr("--refresh= expects a number of seconds\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case 's':
+            op->sock_path = optarg;
+            break;
+        case 'v':
+            ++op->verbose;
+            break;
+        case 'V':
+            pr2serr("version: %s\n", version_str);
+            return 0;
+        default:
+            pr2serr("unrecognised option code 0x%x ??\n", c);
+            usage();
+            return SG_LIB_SYNTAX_ERROR;
+        }
+    }
+    if (optind < argc) {
+        for (; optind < argc; ++optind)
+            pr2serr("Unexpected extra argument: %s\n", argv[optind]);
+        usage();
+        return SG_LIB_SYNTAX_ERROR;
+    }
+
+#ifdef DEBUG
+    pr2serr("In DEBUG mode, ");
+    if (op->verbose) {
+        pr2serr("verbose=%d\n", op->verbose);
+        op->verbose = 1;
+    } else
+        pr2serr("\n");
+#endif
+
+    for (k = 0; k < MAX_CLIENTS; ++k)
+        clients[k].sock_fd = -1;
+    lfd = open_listener(op->sock_path);
+    if (lfd < 0)
+        return SG_LIB_FILE_ERROR;
+    if (op->verbose)
+        pr2serr("listening on %s\n", op->sock_path);
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sig_handler;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    while (! stop_flag) {
+        pfds[0].fd = lfd;
+        pfds[0].events = POLLIN;
+        pfds[0].revents = 0;
+        for (k = 0, n = 1; k < num_clients; ++k) {
+            if (clients[k].sock_fd < 0)
+                continue;
+            pfds[n].fd = clients[k].sock_fd;
+            pfds[n].events = POLLIN;
+            pfds[n].revents = 0;
+            pmap[n++] = k;
+        }
+        if (poll(pfds, n, 1000) > 0) {
+            for (k = 1; k < n; ++k) {
+                /* clients send nothing after their request, so any
+                 * event means the lease has ended */
+                if (pfds[k].revents)
+                    end_client(clients + pmap[k], op->verbose);
+            }
+            if (pfds[0].revents & POLLIN)
+                new_client(lfd, op);
+        }
+        close_idle(op);
+    }
+    close(lfd);
+    unlink(op->sock_path);
+    for (k = 0; k < MAX_DEVICES; ++k) {
+        if (devs[k].in_use)
+            close_dev(devs + k, op->verbose);
+    }
+    return 0;
+}
@@ -50,18 +50,34 @@
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
+
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+#include <time.h>
+#elif defined(HAVE_GETTIMEOFDAY)
+#include <time.h>
+#include <sys/time.h>
+#endif
+
+#ifndef SG_LIB_WIN32
+#define SG_CAW_THREADS 1        /* --bench runs one thread per worker */
+#include <pthread.h>
+#endif
 #include "sg_lib.h"
 #include "sg_cmds_basic.h"
 #include "sg_pt.h"
 #include "sg_unaligned.h"
 #include "sg_pr2serr.h"
 
-static const char * version_str = "1.32 20220127";
+static const char * version_str = "1.33 20261014";
 
 #define DEF_BLOCK_SIZE 512
 #define DEF_NUM_BLOCKS (1)
 #define DEF_BLOCKS_PER_TRANSFER 8
 #define DEF_TIMEOUT_SECS 60
+#define DEF_BENCH_COUNT 1000
+#define DEF_BENCH_THREADS 4
+#define MAX_BENCH_THREADS 64
+#define MAX_BENCH_RANGE 65536
 
 #define COMPARE_AND_WRITE_OPCODE (0x89)
 #define COMPARE_AND_WRITE_CDB_SIZE (16)
@@ -71,6 +87,8 @@ static const char * version_str = "1.32 20220127";
 #define ME "sg_compare_and_write: "
 
 static struct option long_options[] = {
+        {"bench", no_argument, 0, 'b'},
+        {"count", required_argument, 0, 'c'},
         {"dpo", no_argument, 0, 'd'},
         {"fua", no_argument, 0, 'f'},
         {"fua_nv", no_argument, 0, 'F'},
@@ -84,6 +102,8 @@ static struct option long_options[] = {
         {"lba", required_argument, 0, 'l'},
         {"num", required_argument, 0, 'n'},
         {"quiet", no_argument, 0, 'q'},
+        {"range", required_argument, 0, 'R'},
+        {"threads", required_argument, 0, 'T'},
         {"timeout", required_argument, 0, 't'},
         {"verbose", no_argument, 0, 'v'},
         {"version", no_argument, 0, 'V'},
@@ -101,14 +121,18 @@ struct caw_flags {
 };
 
 struct opts_t {
+        bool bench;             /* --bench: contention benchmark */
         bool quiet;
         bool verbose_given;
         bool version_given;
         bool wfn_given;
         int numblocks;
+        int num_thr;            /* --threads=N */
+        int range;              /* --range=R, LBAs (of NUM blocks) used */
         int verbose;
         int timeout;
         int xfer_len;
+        int64_t bench_cnt;      /* --count=CNT, commands per thread */
         uint64_t lba;
         const char * ifn;
         const char * wfn;
@@ -120,16 +144,28 @@ struct opts_t {
 static void
 usage()
 {
-        pr2serr("Usage: sg_compare_and_write [--dpo] [--fua] [--fua_nv] "
-                "[--grpnum=GN] [--help]\n"
+        pr2serr("Usage: sg_compare_and_write [--bench] [--count=CNT] [--dpo] "
+                "[--fua]\n"
+                "                            [--fua_nv] [--grpnum=GN] "
+                "[--help]\n"
                 "                            --in=IF|--inc=IF [--inw=WF] "
                 "--lba=LBA "
                 "[--num=NUM]\n"
-                "                            [--quiet] [--timeout=TO] "
-                "[--verbose] [--version]\n"
+                "                            [--quiet] [--range=R] "
+                "[--threads=N]\n"
+                "                            [--timeout=TO] [--verbose] "
+                "[--version]\n"
                 "                            [--wrprotect=WP] [--xferlen=LEN] "
                 "DEVICE\n"
                 "  where:\n"
+                "    --bench|-b          contention benchmark: N threads "
+                "repeatedly\n"
+                "                        COMPARE AND WRITE a lock block at "
+                "LBA\n"
+                "                        (or one of R from LBA); no IF "
+                "needed\n"
+                "    --count=CNT|-c CNT    commands per thread with --bench "
+                "(def: 1000)\n"
                 "    --dpo|-d            set the dpo bit in cdb (def: "
                 "clear)\n"
                 "    --fua|-f            set the fua bit in cdb (def: "
@@ -154,6 +190,11 @@ usage()
                 "    --quiet|-q          suppress MISCOMPARE report to "
                 "stderr,\n"
                 "                        still sets exit status of 14\n"
+                "    --range=R|-R R      with --bench each command picks one "
+                "of R\n"
+                "                        lock blocks at LBA, LBA+NUM, ... "
+                "(def: 1)\n"
+                "    --threads=N|-T N    threads with --bench (def: 4)\n"
                 "    --timeout=TO|-t TO    timeout for the command "
                 "(def: 60 secs)\n"
                 "    --verbose|-v        increase verbosity (use '-vv' for "
@@ -189,12 +230,23 @@ parse_args(int argc, char* argv[], struct opts_t * op)
         while (1) {
                 int option_index = 0;
 
-                c = getopt_long(argc, argv, "C:dD:fFg:hi:l:n:qt:vVw:x:",
+                c = getopt_long(argc, argv, "bc:C:dD:fFg:hi:l:n:qR:t:T:vVw:x:",
                                 long_options, &option_index);
                 if (c == -1)
                         break;
 
                 switch (c) {
+                case 'b':
+                        op->bench = true;
+                        break;
+                case 'c':
+                        op->bench_cnt = sg_get_llnum(optarg);
+                        if (op->bench_cnt < 1) {
+                                pr2serr("bad argument to '--count', expect "
+                                        "1 or more\n");
+                                goto out_err_no_usage;
+                        }
+                        break;
                 case 'C':
                 case 'i':
                         op->ifn = optarg;
@@ -246,6 +298,15 @@ parse_args(int argc, char* argv[], struct opts_t * op)
                 case 'q':
                         op->quiet = true;
                         break;
+                case 'R':
+                        op->range = sg_get_num(optarg);
+                        if ((op->range < 1) ||
+                            (op->range > MAX_BENCH_RANGE)) {
+                                pr2serr("bad argument to '--range', expect "
+                                        "1 to %d\n", MAX_BENCH_RANGE);
+                                goto out_err_no_usage;
+                        }
+                        break;
                 case 't':
                         op->timeout = sg_get_num(optarg);
                         if (op->timeout < 0)  {
@@ -253,6 +314,15 @@ parse_args(int argc, char* argv[], struct opts_t * op)
                                 goto out_err_no_usage;
                         }
                         break;
+                case 'T':
+                        op->num_thr = sg_get_num(optarg);
+                        if ((op->num_thr < 1) ||
+                            (op->num_thr > MAX_BENCH_THREADS)) {
+                                pr2serr("bad argument to '--threads', expect "
+                                        "1 to %d\n", MAX_BENCH_THREADS);
+                                goto out_err_no_usage;
+                        }
+                        break;
                 case 'v':
                         op->verbose_given = true;
                         ++op->verbose;
@@ -298,7 +368,27 @@ parse_args(int argc, char* argv[], struct opts_t * op)
                 pr2serr("missing device name!\n");
                 goto out_err;
         }
-        if (! if_given) {
+        if (op->bench) {
+                if (if_given || op->wfn_given) {
+                        pr2serr("--bench builds its own buffers so "
+                                "--in= and --inw= are not used\n");
+                        goto out_err_no_usage;
+                }
+                if (0 == op->numblocks) {
+                        pr2serr("--bench needs --num= of 1 or more\n");
+                        goto out_err_no_usage;
+                }
+                if (0 == op->bench_cnt)
+                        op->bench_cnt = DEF_BENCH_COUNT;
+                if (0 == op->num_thr)
+                        op->num_thr = DEF_BENCH_THREADS;
+                if (0 == op->range)
+                        op->range = 1;
+        } else if (op->bench_cnt || op->num_thr || op->range) {
+                pr2serr("--count=, --range= and --threads= only apply with "
+                        "--bench\n");
+                goto out_err_no_usage;
+        } else if (! if_given) {
                 pr2serr("missing input file\n");
                 goto out_err;
         }
@@ -470,10 +560,313 @@ open_dev(const char * outf, int verbose)
 }
 
 
+/* --bench: each worker treats the first block at each of its LBAs as a
+ * lock block. It reads the block (after a miscompare or on first use),
+ * then sends a COMPARE AND WRITE whose compare half is what it read and
+ * whose write half has the generation number (first 8 bytes) incremented
+ * and its own worker number (next 4 bytes) as the owner. Other workers
+ * racing for the same block then get a MISCOMPARE, as they would when
+ * contending for an ATS style lock. */
+struct caw_worker_t {
+        int id;
+        int res;                /* first error other than a miscompare */
+        uint64_t done;          /* COMPARE AND WRITE commands sent */
+        uint64_t good;
+        uint64_t miscompares;
+        uint64_t reads;
+        struct sg_pt_lat_hist good_h;
+        struct sg_pt_lat_hist mis_h;
+        const struct opts_t * op;
+};
+
+static void
+lat_add(struct sg_pt_lat_hist * hp, uint64_t lat_ns)
+{
+        if ((0 == hp->count) || (lat_ns < hp->min_ns))
+                hp->min_ns = lat_ns;
+        if (lat_ns > hp->max_ns)
+                hp->max_ns = lat_ns;
+        ++hp->count;
+        hp->sum_ns += lat_ns;
+        ++hp->bucket[sg_pt_lat_bucket_idx(lat_ns)];
+}
+
+static void
+lat_merge(struct sg_pt_lat_hist * dp, const struct sg_pt_lat_hist * sp)
+{
+        int k;
+
+        if (0 == sp->count)
+                return;
+        if ((0 == dp->count) || (sp->min_ns < dp->min_ns))
+                dp->min_ns = sp->min_ns;
+        if (sp->max_ns > dp->max_ns)
+                dp->max_ns = sp->max_ns;
+        dp->count += sp->count;
+        dp->sum_ns += sp->sum_ns;
+        for (k = 0; k < SG_PT_LAT_NUM_BUCKETS; ++k)
+                dp->bucket[k] += sp->bucket[k];
+}
+
+static void
+lat_report(const struct sg_pt_lat_hist * hp, const char * leadin)
+{
+        if (0 == hp->count)
+                return;
+        printf("%s latency min/avg/max: %.1f/%.1f/%.1f us, p50/p90/p99/"
+               "p99.9: %.1f/%.1f/%.1f/%.1f us\n", leadin,
+               hp->min_ns / 1000.0,
+               ((double)hp->sum_ns / hp->count) / 1000.0,
+               hp->max_ns / 1000.0, sg_pt_lat_percentile(hp, 50.0) / 1000.0,
+               sg_pt_lat_percentile(hp, 90.0) / 1000.0,
+               sg_pt_lat_percentile(hp, 99.0) / 1000.0,
+               sg_pt_lat_percentile(hp, 99.9) / 1000.0);
+}
+
+/* Reads 'blocks' blocks of 'blk_sz' bytes from 'lba' with READ(16).
+ * Returns 0 for success, various SG_LIB_CAT_* values, otherwise -1 . */
+static int
+caw_read16(int sg_fd, uint8_t * buff, int blocks, uint64_t lba, int blk_sz,
+           int verbose)
+{
+        int sense_cat, res, ret;
+        struct sg_pt_base * ptvp;
+        uint8_t rCmd[16];
+        uint8_t sense_b[SENSE_BUFF_LEN] SG_C_CPP_ZERO_INIT;
+
+        memset(rCmd, 0, sizeof(rCmd));
+        rCmd[0] = 0x88;         /* READ(16) */
+        sg_put_unaligned_be64(lba, rCmd + 2);
+        sg_put_unaligned_be32((uint32_t)blocks, rCmd + 10);
+        ptvp = construct_scsi_pt_obj();
+        if (NULL == ptvp) {
+                pr2serr("Could not construct scsit_pt_obj, out of memory\n");
+                return -1;
+        }
+        set_scsi_pt_cdb(ptvp, rCmd, sizeof(rCmd));
+        set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
+        set_scsi_pt_data_in(ptvp, buff, blocks * blk_sz);
+        res = do_scsi_pt(ptvp, sg_fd, DEF_TIMEOUT_SECS, verbose);
+        ret = sg_cmds_process_resp(ptvp, "READ(16)", res, true, verbose,
+                                   &sense_cat);
+        if (-1 == ret) {
+                if (get_scsi_pt_transport_err(ptvp))
+                        ret = SG_LIB_TRANSPORT_ERROR;
+                else
+                        ret = sg_convert_errno(get_scsi_pt_os_err(ptvp));
+        } else if (-2 == ret) {
+                switch (sense_cat) {
+                case SG_LIB_CAT_RECOVERED:
+                case SG_LIB_CAT_NO_SENSE:
+                        ret = 0;
+                        break;
+                default:
+                        ret = sense_cat;
+                        break;
+                }
+        } else
+                ret = 0;
+        destruct_scsi_pt_obj(ptvp);
+        return ret;
+}
+
+static void *
+caw_bench_worker(void * v_wp)
+{
+        int res;
+        int devfd = -1;
+        uint32_t idx = 0;
+        uint32_t rnd;
+        uint64_t k, lba, t_ns;
+        struct caw_worker_t * wp = (struct caw_worker_t *)v_wp;
+        const struct opts_t * op = wp->op;
+        int half = op->xfer_len / 2;
+        int blk_sz = half / op->numblocks;
+        int vb = (op->verbose > 1) ? op->verbose - 1 : 0;
+        uint8_t * bp = NULL;
+        uint8_t * free_bp = NULL;
+        uint8_t * cachep = NULL;
+        bool * validp = NULL;
+
+        rnd = 0x9e3779b9U * (uint32_t)(wp->id + 1);
+        /* each worker has its own file descriptor, like a separate host */
+        devfd = open_dev(op->device_name, vb);
+        if (devfd < 0) {
+                wp->res = sg_convert_errno(-devfd);
+                return NULL;
+        }
+        bp = (uint8_t *)sg_memalign(op->xfer_len, 0, &free_bp, false);
+        cachep = (uint8_t *)malloc((size_t)op->range * half);
+        validp = (bool *)calloc(op->range, sizeof(bool));
+        if ((NULL == bp) || (NULL == cachep) || (NULL == validp)) {
+                pr2serr("Not enough user memory\n");
+                wp->res = sg_convert_errno(ENOMEM);
+                goto fini;
+        }
+        for (k = 0; k < (uint64_t)op->bench_cnt; ++k) {
+                if (op->range > 1) {
+                        rnd ^= rnd << 13;       /* xorshift32 */
+                        rnd ^= rnd >> 17;
+                        rnd ^= rnd << 5;
+                        idx = rnd % (uint32_t)op->range;
+                }
+                lba = op->lba + ((uint64_t)idx * op->numblocks);
+                if (! validp[idx]) {
+                        res = caw_read16(devfd, cachep + (idx * half),
+                                         op->numblocks, lba, blk_sz, vb);
+                        if (res) {
+                                wp->res = res;
+                                break;
+                        }
+                        ++wp->reads;
+                        validp[idx] = true;
+                }
+                memcpy(bp, cachep + (idx * half), half);
+                memcpy(bp + half, bp, half);
+                sg_put_unaligned_be64(sg_get_unaligned_be64(bp) + 1,
+                                      bp + half);
+                sg_put_unaligned_be32((uint32_t)(wp->id + 1), bp + half + 8);
+                t_ns = sg_get_mono_ns();
+                res = sg_ll_compare_and_write(devfd, bp, op->numblocks, lba,
+                                              op->xfer_len, op->flags, false,
+                                              vb);
+                t_ns = sg_get_mono_ns() - t_ns;
+                ++wp->done;
+                if (0 == res) {
+                        ++wp->good;
+                        lat_add(&wp->good_h, t_ns);
+                        memcpy(cachep + (idx * half), bp + half, half);
+                } else if (SG_LIB_CAT_MISCOMPARE == res) {
+                        ++wp->miscompares;
+                        lat_add(&wp->mis_h, t_ns);
+                        validp[idx] = false;    /* re-read before next */
+                } else {
+                        wp->res = res;
+                        break;
+                }
+        }
+fini:
+        free(validp);
+        free(cachep);
+        if (free_bp)
+                free(free_bp);
+        close(devfd);
+        return NULL;
+}
+
+/* Runs the --bench contention benchmark then reports throughput, the
+ * miscompare ratio and latency percentiles to stdout. A worker stops
+ * after its first error other than a miscompare. Returns 0 if no worker
+ * had such an error. */
+static int
+caw_bench(const struct opts_t * op)
+{
+        int k, n, res;
+        uint64_t ns, done, good, mis, reads;
+        double secs;
+        struct caw_worker_t * wa;
+        struct sg_pt_lat_hist all_h, good_h, mis_h;
+        char b[80];
+#ifdef SG_CAW_THREADS
+        int err;
+        pthread_t thr_arr[MAX_BENCH_THREADS];
+#endif
+
+        n = op->num_thr;
+        if (0 != (op->xfer_len % (2 * op->numblocks))) {
+                pr2serr("--xferlen=%d is not twice a multiple of NUM (%d) "
+                        "blocks\n", op->xfer_len, op->numblocks);
+                return SG_LIB_SYNTAX_ERROR;
+        }
+        if ((op->xfer_len / 2 / op->numblocks) < 12) {
+                pr2serr("block size too small for a lock block\n");
+                return SG_LIB_SYNTAX_ERROR;
+        }
+        wa = (struct caw_worker_t *)calloc(n, sizeof(*wa));
+        if (NULL == wa) {
+                pr2serr("Not enough user memory\n");
+                return sg_convert_errno(ENOMEM);
+        }
+        for (k = 0; k < n; ++k) {
+                wa[k].id = k;
+                wa[k].op = op;
+        }
+        if (op->verbose)
+                pr2serr("COMPARE AND WRITE benchmark: %d workers, %" PRId64
+                        " commands each on %d lock block%s from LBA 0x%"
+                        PRIx64 "\n", n, op->bench_cnt, op->range,
+                        (op->range > 1) ? "s" : "", op->lba);
+        ns = sg_get_mono_ns();
+#ifdef SG_CAW_THREADS
+        for (k = 1; k < n; ++k) {
+                err = pthread_create(thr_arr + k, NULL, caw_bench_worker,
+                                     wa + k);
+                if (err) {
+                        pr2serr("pthread_create: %s\n", safe_strerror(err));
+                        n = k;
+                        break;
+                }
+        }
+        caw_bench_worker(wa + 0);
+        for (k = 1; k < n; ++k)
+                pthread_join(thr_arr[k], NULL);
+#else
+        if (n > 1)
+                pr2serr("%s: no threads so the workers run one after "
+                        "another\n", __func__);
+        for (k = 0; k < n; ++k)
+                caw_bench_worker(wa + k);
+#endif
+        ns = sg_get_mono_ns() - ns;
+        secs = (double)ns / 1000000000.0;
+        memset(&good_h, 0, sizeof(good_h));
+        memset(&mis_h, 0, sizeof(mis_h));
+        done = good = mis = reads = 0;
+        res = 0;
+        for (k = 0; k < n; ++k) {
+                const struct caw_worker_t * wp = wa + k;
+
+                done += wp->done;
+                good += wp->good;
+                mis += wp->miscompares;
+                reads += wp->reads;
+                lat_merge(&good_h, &wp->good_h);
+                lat_merge(&mis_h, &wp->mis_h);
+                if (op->verbose)
+                        pr2serr("  worker %d: %" PRIu64 " commands, %" PRIu64
+                                " good, %" PRIu64 " miscompares, %" PRIu64
+                                " reads\n", k, wp->done, wp->good,
+                                wp->miscompares, wp->reads);
+                if (wp->res) {
+                        sg_get_category_sense_str(wp->res, sizeof(b), b,
+                                                  op->verbose);
+                        pr2serr("worker %d stopped: %s\n", k, b);
+                        if (0 == res)
+                                res = wp->res;
+                }
+        }
+        all_h = good_h;
+        lat_merge(&all_h, &mis_h);
+        printf("%" PRIu64 " COMPARE AND WRITE commands from %d workers in "
+               "%.3f secs", done, n, secs);
+        if (secs > 0.0)
+                printf(", %.1f commands/sec, %.1f good/sec",
+                       (double)done / secs, (double)good / secs);
+        printf("\n  good: %" PRIu64 ", miscompares: %" PRIu64 " (%.2f%%), "
+               "reads: %" PRIu64 "\n", good, mis,
+               done ? (100.0 * mis) / done : 0.0, reads);
+        lat_report(&all_h, "  all");
+        lat_report(&good_h, "  good");
+        lat_report(&mis_h, "  miscompare");
+        free(wa);
+        return res;
+}
+
+
 int
 main(int argc, char * argv[])
 {
-        bool ifn_stdin;
+        bool ifn_stdin = false;
         int res, half_xlen, vb;
         int infd = -1;
         int wfd = -1;
@@ -514,6 +907,10 @@ main(int argc, char * argv[])
                 return 0;
         }
         vb = op->verbose;
+        if (op->bench) {
+                res = caw_bench(op);
+                goto out;
+        }
 
         if (vb) {
                 pr2serr("Running COMPARE AND WRITE command with the "
@@ -1,7 +1,7 @@
 /* A utility program for copying files. Specialised for "files" that
  * represent devices that understand the SCSI command set.
  *
- * Copyright (C) 1999 - 2023 D. Gilbert and P. Allworth
+ * Copyright (C) 1999 - 2026 D. Gilbert and P. Allworth
  * This program is free software; you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
  * the Free Software Foundation; either version 2, or (at your option)
@@ -44,6 +44,7 @@
 #include <errno.h>
 #include <time.h>               /* for clock_gettime() */
 #include <limits.h>
+#include <poll.h>
 #define __STDC_FORMAT_MACROS 1
 #include <inttypes.h>
 #include <sys/ioctl.h>
@@ -60,28 +61,40 @@
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
+#ifndef SG_LIB_WIN32
+#define SG_DD_THREADS 1         /* iflag=tape and oflag=tape use a thread */
+#include <pthread.h>
+#endif
 #ifdef HAVE_GETRANDOM
 #include <sys/random.h>         /* for getrandom() system call */
 #endif
 #include "sg_lib.h"
+#include "sg_lib_data.h"
 #include "sg_cmds_basic.h"
 #include "sg_cmds_extra.h"
 #include "sg_io_linux.h"
 #include "sg_unaligned.h"
 #include "sg_pr2serr.h"
+#include "sg_dd_eng.h"
+#include "sg_geom.h"
 #include "sg_pt.h"              /* used to get to SNTL for NVMe devices */
-
-static const char * version_str = "6.44 20230518";
+#include "sg_json_sg_lib.h"
+#include "sg_hash.h"
+#include "sg_pi.h"
+#include "sg_sgl.h"
+#include "sg_sdt.h"
+#include "sg_err_stats.h"
+#include "sg_cpu_stats.h"
+#include "sg_pat.h"
+#include "sg_cimg.h"
+
+static const char * version_str = "6.65 20261015";
 
 static const char * my_name = "sg_dd: ";
 
 /* Uncomment next line to turn on compiled debug */
 /* #define DEBUG 1 */
 
-#ifndef BLOCK_EXT_MAJOR
-#define BLOCK_EXT_MAJOR 259     /* used by NVMe block devices */
-#endif
-
 #define STR_SZ 1024
 #define INOUTF_SZ 512
 #define EBUFF_SZ 768
@@ -102,7 +115,6 @@ static const char * my_name = "sg_dd: ";
 
 #define SENSE_BUFF_LEN 64       /* Arbitrary, could be larger */
 #define READ_CAP_REPLY_LEN 8
-#define RCAP16_REPLY_LEN 32
 #define READ_LONG_OPCODE 0x3E
 #define READ_LONG_CMD_LEN 10
 #define READ_LONG_DEF_BLK_INC 8
@@ -112,28 +124,22 @@ static const char * my_name = "sg_dd: ";
 
 #define DEF_TIMEOUT 60000       /* 60,000 millisecs == 60 seconds */
 
-#ifndef RAW_MAJOR
-#define RAW_MAJOR 255   /*unlikely value */
-#endif
-
 #define SG_LIB_FLOCK_ERR 90
 
 /* found in flags_t::file_type, several may be OR-ed together */
 #define FT_INIT 0               /* filetype not examined yet */
-#define FT_OTHER 1              /* filetype is probably normal */
-#define FT_SG 2                 /* filetype is sg char device or supports
-                                   SG_IO ioctl */
-#define FT_RAW 4                /* filetype is raw char device */
-#define FT_DEV_NULL 8           /* either "/dev/null" or "." as filename */
-#define FT_ST 16                /* filetype is st char device (tape) */
-#define FT_BLOCK 32             /* filetype is block device */
-#define FT_FIFO 64              /* filetype is a fifo (name pipe) */
-#define FT_NVME 128             /* NVMe char(-generic)/block device */
+#define FT_OTHER SG_DDE_FT_OTHER  /* filetype is probably normal */
+#define FT_SG SG_DDE_FT_SG        /* filetype is sg char device or supports
+                                     SG_IO ioctl */
+#define FT_RAW SG_DDE_FT_RAW      /* filetype is raw char device */
+#define FT_DEV_NULL SG_DDE_FT_DEV_NULL  /* "/dev/null" or "." as filename */
+#define FT_ST SG_DDE_FT_ST        /* filetype is st char device (tape) */
+#define FT_BLOCK SG_DDE_FT_BLOCK  /* filetype is block device */
+#define FT_FIFO SG_DDE_FT_FIFO    /* filetype is a fifo (name pipe) */
+#define FT_NVME SG_DDE_FT_NVME    /* NVMe char(-generic)/block device */
 #define FT_RANDOM_0_FF 256      /* iflag=00, iflag=ff and iflag=random
                                    overriding if=IFILE */
-#define FT_ERROR 512           /* couldn't "stat" file */
-
-#define DEV_NULL_MINOR_NUM 3
+#define FT_ERROR SG_DDE_FT_ERROR  /* couldn't "stat" file */
 
 #define SG_DD_BYPASS 999        /* failed but coe set */
 
@@ -151,6 +157,89 @@ static const char * my_name = "sg_dd: ";
 #define PROGRESS2_TRIGGER_MS 60000      /* milliseconds: 1 minute */
 #define PROGRESS3_TRIGGER_MS 30000      /* milliseconds: 30 seconds */
 
+/* interval=SECS times each read and write with sg_pt_lat_record() using
+ * these keys rather than device numbers, that keeps them apart from any
+ * per-command times recorded by the pass-through layer itself. */
+#define LAT_IN_ID 1
+#define LAT_OUT_ID 2
+#define LAT_ARR_SZ 16
+
+/* bpt=auto probes transfer sizes from AUTO_BPT_MIN_BYTES up to what the
+ * devices and kernel will take (at most AUTO_BPT_MAX_BYTES), copying about
+ * AUTO_BPT_PROBE_BYTES with each, then settles on the fastest. */
+#define AUTO_BPT_MIN_BYTES (64 * 1024)
+#define AUTO_BPT_MAX_BYTES (8 * 1024 * 1024)
+#define AUTO_BPT_PROBE_BYTES (16 * 1024 * 1024)
+#define AUTO_BPT_MAX_CANDS 16
+
+struct auto_bpt_t {
+    int num;            /* number of candidates, 0 -> not probing */
+    int cur;            /* index of candidate being probed */
+    int max_blks;       /* limit from devices, 0 if none known */
+    int opt_blks;       /* optimal transfer length, 0 if not known */
+    int cands[AUTO_BPT_MAX_CANDS];      /* in blocks, ascending */
+    int64_t blks[AUTO_BPT_MAX_CANDS];   /* blocks copied with each */
+    uint64_t ns[AUTO_BPT_MAX_CANDS];    /* time taken for those blocks */
+};
+
+/* oflag=unmap: transfers read as all zeros are not written to a thin
+ * provisioned OFILE. Consecutive ones are coalesced into runs which are
+ * sent as UNMAP block descriptors when the device reads unmapped blocks as
+ * zeros (LBPRZ), otherwise as WRITE SAME(16) with the UNMAP bit set. */
+#define UNMAP_OFF 0
+#define UNMAP_CMD 1             /* UNMAP, batched block descriptors */
+#define UNMAP_WS16 2            /* WRITE SAME(16) with UNMAP bit, per run */
+#define UNMAP_MAX_DESCS 256     /* per UNMAP parameter list */
+#define UNMAP_DEF_MAX_LBAS 0x400000     /* when device reports no limit */
+
+struct unmap_stage {
+    int mode;           /* UNMAP_OFF, UNMAP_CMD or UNMAP_WS16 */
+    int num_descs;      /* block descriptors in param, UNMAP_CMD only */
+    int max_descs;
+    int64_t max_lbas;   /* per command, from Block Limits VPD page */
+    int64_t run_lba;    /* OFILE run being coalesced */
+    int64_t run_num;    /* 0 -> no run */
+    int64_t list_lbas;  /* in param plus run */
+    int64_t first_lba;  /* lowest still pending, -1 -> none */
+    uint8_t * param;    /* UNMAP parameter list */
+    uint8_t * zbuf;     /* all zeros, a block for WRITE SAME, more when
+                         * falling back to writing */
+};
+
+/* iflag=simage and oflag=simage: a sparse image is a sg_cimg file (see
+ * sg_cimg.h) with alg SG_CIMG_RAW. Its index lists the extents that hold
+ * data, each with the CRC32C of that data; the blocks between them are
+ * holes. Image blocks are numbered as those of the device it was made
+ * from, so oflag=simage puts each transfer at SEEK and iflag=simage reads
+ * from SKIP. */
+#define SIMG_MAX_EXT_BYTES (1024 * 1024 * 1024)     /* per index entry */
+
+struct simg_stage {
+    bool seq;           /* oflag=simage: OFILE is a pipe, use write() */
+    struct sg_cimg_hdr hdr;     /* alg is 0 until opened or loaded */
+    struct sg_cimg_ent * ents;  /* in block order */
+    int64_t num_ents;
+    int64_t max_ents;   /* oflag=simage: room in ents */
+    int64_t tot_blks;   /* iflag=simage: blocks in image */
+    int64_t crc_idx;    /* entry whose CRC is being built, -1 -> none */
+    int64_t crc_next;   /* iflag=simage: block the CRC has reached */
+    int64_t num_checked;        /* iflag=simage: extents with good CRC */
+    uint64_t pos;       /* oflag=simage: file offset of next data */
+    struct sg_hash_ctx hc;      /* CRC32C of entry crc_idx so far */
+};
+
+/* ckpt=CFILE[,SECS] keeps a one line journal of where the copy is up to.
+ * skip, seek and count are those of the original invocation while done is
+ * the number of blocks, from the start of that range, that have been
+ * copied. It is rewritten every SECS seconds and when the copy stops. */
+#define DEF_CKPT_SECS 10
+
+#define DEF_ZAPP_QD 32          /* zappend=MFILE[,QD] */
+#define CKPT_PR_FMT "sg3_utils checkpoint: bs=%d skip=%" PRId64 " seek=%" \
+                    PRId64 " count=%" PRId64 " done=%" PRId64 "\n"
+#define CKPT_SC_FMT "sg3_utils checkpoint: bs=%d skip=%" SCNd64 " seek=%" \
+                    SCNd64 " count=%" SCNd64 " done=%" SCNd64
+
 // static int sum_of_resids = 0;
 
 // static int64_t dd_count = -1;   /* number of block given to count=COUNT */
@@ -159,17 +248,21 @@ static int in_partial = 0;      /* count so far of partial blocks read */
 static int64_t out_full = 0;    /* count so far of full blocks written */
 static int out_partial = 0;     /* count so far of partial blocks written */
 static int64_t out_sparse_num = 0;
+static int64_t out_unmap_num = 0;
 static int recovered_errs = 0;
 static int unrecovered_errs = 0;
 static int miscompare_errs = 0;
 static int read_longs = 0;
-static int num_retries = 0;
+static struct sg_err_stats err_stats;   /* by sense category and errno */
 
 static bool start_tm_valid = false;
+static volatile sig_atomic_t rate_reload = 0;   /* SIGHUP and rate=@FN */
+static volatile sig_atomic_t err_stats_js = 0;  /* SIGUSR1 and --json */
 static int max_uas = MAX_UNIT_ATTENTIONS;
 static int max_aborted = MAX_ABORTED_CMDS;
 static uint32_t glob_pack_id = 0;       /* pre-increment */
 static struct timeval start_tm;
+static struct sg_cpu_snap start_cpu;   /* valid when time=1 */
 
 static uint8_t * zeros_buff = NULL;
 static uint8_t * free_zeros_buff = NULL;
@@ -189,13 +282,19 @@ struct flags_t {
     bool dpo;
     bool dsync;
     bool excl;
+    bool extents;
     bool flock;
     bool ff;
     bool fua;
+    bool hugepage;
     bool nocreat;
+    bool pi;            /* transfer T10 PI, checked or made by sg_dd */
     bool random;
     bool sgio;
+    bool simage;        /* IFILE is, or OFILE will be, a sparse image */
     bool sparse;
+    bool tape;          /* sg device is a tape drive, SSC READ/WRITE(6) */
+    bool unmap;
     bool zero;
     int cdbsz;
     int cdl;
@@ -204,16 +303,20 @@ struct flags_t {
     int pdt;
     int retries;
     int file_type;  /* not user input; from file/device examination: FT_* */
+    struct sg_dde_cdb_tmpl tmpl;        /* READ, WRITE or VERIFY cdb */
 };
 
 struct opts_t
 {
     bool bpt_given;
+    bool bpt_auto;              /* bpt=auto */
     bool cdbsz_given;
     bool cdl_given;
     bool do_sync;
     bool do_time;
     bool do_verify;          /* when false: do copy (which is default) */
+    bool do_json;
+    bool resume;                /* --resume: continue from ckpt=CFILE */
     bool verbose_given;
     bool version_given;
     int infd;
@@ -233,11 +336,45 @@ struct opts_t
     int dio_incomplete_count;
     int sum_of_resids;
     int progress;       /* --progress or -p, checked in sig_listen_thread */
+    int interval;       /* interval=SECS, 0 for no periodic statistics */
+    int ckpt_secs;      /* ckpt=CFILE,SECS, 0 -> only when copy stops */
+    int64_t ckpt_skip;  /* skip, seek and count of the original copy */
+    int64_t ckpt_seek;
+    int64_t ckpt_count;
+    int hash_alg;       /* hash=ALG[,MANIFEST], SG_HASH_NONE -> no hash */
+    int nbuf;           /* nbuf=NBUF, block groups in flight, 1 -> no overlap */
+    int pf_num;         /* prefetch=DIST,NUM blocks per PRE-FETCH, 0 -> BPT */
+    int64_t pf_dist;    /* prefetch=DIST, 0 -> no read-ahead */
+    int64_t pf_next;    /* next LBA to PRE-FETCH, -1 before the first */
+    int tbuf_mb;        /* tbuf=MB[,PCT] ring size for iflag/oflag=tape */
+    int tbuf_pct;       /* ring percent full before drive writes (re)start */
+    int zapp_qd;        /* zappend=MFILE[,QD] appends in flight, 0 -> off */
+    int pi_type;        /* pi_type=TYPE[,AT], 0 -> 1 */
+    int pi_at;          /* application tag from pi_type=TYPE,AT or -1 */
     int verbose;
     int dry_run;
+    const char * json_arg;      /* carries [JO] from --json[=JO] */
+    const char * rate_arg;      /* rate=BPS[,IOPS] or rate=@FN */
+    struct sg_rate_lim rate_lim;
+    FILE * hash_mfp;            /* per transfer digests written here */
+    struct sg_hash_ctx hash_ctx;        /* digest of whole input stream */
+    struct unmap_stage um;      /* oflag=unmap */
+    struct simg_stage simg;     /* iflag=simage or oflag=simage */
+    struct sg_sgl i_sgl;        /* skip=SGL, num_elems 0 when not given */
+    struct sg_sgl o_sgl;        /* seek=SGL */
+    struct sg_pi_ctx pi_ctx;    /* iflag=pi and oflag=pi */
+    struct sg_pat pat;          /* if=pat:PAT, kind SG_PAT_NONE otherwise */
+    uint8_t * pi_buf;           /* bpt * (blk_sz + 8) bytes, data + PI */
+    uint8_t * free_pi_buf;
+    int64_t sgl_idx;            /* blocks copied, index into both lists */
+    int64_t ext_end;    /* iflag=extents: seek + count before, else 0 */
+    sgj_state json_st;
     struct sg_pt_base *in_ptp;    /* these two pointers only used if NVMe */
     struct sg_pt_base *out_ptp;   /* ... devices are detected */
+    char ckpt_fname[INOUTF_SZ];
+    char hash_mf_fname[INOUTF_SZ];
     char in_fname[INOUTF_SZ];
+    char zapp_fname[INOUTF_SZ];         /* zappend=MFILE, LBA map */
     char out_fname[INOUTF_SZ];
     char out2_fname[INOUTF_SZ];
 };
@@ -271,12 +408,13 @@ print_stats(const char * str)
             in_partial);
     pr2serr("%s%" PRId64 "+%d records %s\n", str, out_full - out_partial,
             out_partial, (fscope_op->do_verify ? "verified" : "out"));
-    if (fscope_op->oflag.sparse)
+    if (fscope_op->oflag.sparse || fscope_op->oflag.simage)
         pr2serr("%s%" PRId64 " bypassed records out\n", str, out_sparse_num);
+    if (fscope_op->oflag.unmap)
+        pr2serr("%s%" PRId64 " unmapped records out\n", str, out_unmap_num);
     if (recovered_errs > 0)
         pr2serr("%s%d recovered errors\n", str, recovered_errs);
-    if (num_retries > 0)
-        pr2serr("%s%d retries attempted\n", str, num_retries);
+    sg_err_stats_pr(&err_stats, str);
     if (unrecovered_errs > 0) {
         pr2serr("%s%d unrecovered error(s)\n", str, unrecovered_errs);
         if (fscope_op->iflag.coe || fscope_op->oflag.coe)
@@ -313,112 +451,23 @@ siginfo_handler(int sig)
     if (fscope_op->do_time)
         calc_duration_throughput(true);
     print_stats("  ");
+    if (fscope_op->do_json)
+        err_stats_js = 1;       /* output between transfers in copy loop */
 }
 
-static const char * proc_devices_s = "/proc/devices";
-static const char * pdevs_ch_s = "Character";
-
-static bool bsg_nvme_majors_checked = false;
-
-static int bsg_major = 0;
-static int nvme_major = 0;
-static int nvme_gen_major = 0;
-
 static void
-find_bsg_nvme_majors(const struct opts_t * op)
+sighup_handler(int sig)
 {
-    int n;
-    int num_found = 0;
-    char *cp;
-    FILE *fp;
-    char a[128];
-    char b[128];
-    static const int blen = sizeof(b);
-
-    if (NULL == (fp = fopen(proc_devices_s, "r"))) {
-        if (op->verbose)
-            pr2serr("fopen %s failed: %s\n", proc_devices_s, strerror(errno));
-        return;
-    }
-    while ((cp = fgets(b, blen, fp))) {
-        if ((1 == sscanf(b, "%126s", a)) &&
-            (0 == memcmp(a, pdevs_ch_s, 9)))
-            break;
-    }
-    while (cp && (cp = fgets(b, blen, fp))) {
-        if (2 == sscanf(b, "%d %126s", &n, a)) {
-            if (0 == strcmp("bsg", a)) {
-                bsg_major = n;
-                if (++num_found > 2)
-                    break;
-            } else if (0 == memcmp("nvme", a, 4)) {
-                if (0 == strcmp("nvme-generic", a)) {
-                    nvme_gen_major = n;
-                    if (++num_found > 2)
-                        break;
-                } else {
-                    nvme_major = n;
-                    if (++num_found > 2)
-                        break;
-                }
-            }
-        } else
-            break;
-    }
-    if (op->verbose > 5) {
-        if (cp) {
-            if (bsg_major > 0)
-                pr2serr("found bsg_major=%d\n", bsg_major);
-            if (nvme_major > 0)
-                pr2serr("found nvme_major=%d\n", nvme_major);
-            if (nvme_gen_major > 0)
-                pr2serr("found nvme_gen_major=%d\n", nvme_gen_major);
-        } else
-            pr2serr("found no nvme char device in %s\n", proc_devices_s);
-    }
-    fclose(fp);
+    if (sig) { ; }      /* unused, dummy to suppress warning */
+    rate_reload = 1;    /* acted on between transfers in the copy loop */
 }
 
-
+/* bsg and NVMe char devices are treated like sg devices */
 static int
 dd_filetype(const char * filename, const struct opts_t * op)
 {
-    size_t len = strlen(filename);
-    struct stat st;
-
-    if ((1 == len) && ('.' == filename[0]))
-        return FT_DEV_NULL;
-    if (stat(filename, &st) < 0)
-        return FT_ERROR;
-    if (S_ISCHR(st.st_mode)) {
-        /* major() and minor() defined in sys/sysmacros.h */
-        if ((MEM_MAJOR == major(st.st_rdev)) &&
-            (DEV_NULL_MINOR_NUM == minor(st.st_rdev)))
-            return FT_DEV_NULL;
-        if (RAW_MAJOR == major(st.st_rdev))
-            return FT_RAW;
-        if (SCSI_GENERIC_MAJOR == major(st.st_rdev))
-            return FT_SG;
-        if (SCSI_TAPE_MAJOR == major(st.st_rdev))
-            return FT_ST;
-        if (! bsg_nvme_majors_checked) {
-            bsg_nvme_majors_checked = true;
-            find_bsg_nvme_majors(op);
-        }
-        if (bsg_major == (int)major(st.st_rdev))
-            return FT_SG;
-        if (nvme_major == (int)major(st.st_rdev))       /* e.g. /dev/nvme0 */
-            return FT_SG | FT_NVME;     /* treat as sg device */
-        if (nvme_gen_major == (int)major(st.st_rdev))   /* e.g. /dev/ng0n1 */
-            return FT_SG | FT_NVME;     /* treat as sg device */
-    } else if (S_ISBLK(st.st_mode)) {
-        if (BLOCK_EXT_MAJOR)
-            return FT_BLOCK | FT_NVME;
-        else
-            return FT_BLOCK;
-    } else if (S_ISFIFO(st.st_mode))
-        return FT_FIFO;
-    return FT_OTHER;
+    return sg_dde_filetype(filename, SG_DDE_FTF_FIFO | SG_DDE_FTF_BSG_NVME,
+                           op->verbose);
 }
 
 
@@ -469,24 +518,34 @@ usage()
             "[seek=SEEK]\n"
             "              [skip=SKIP] [--dry-run] [--help] [--verbose] "
             "[--version]\n\n"
-            "              [blk_sgio=0|1] [bpt=BPT] [cdbsz=6|10|12|16] "
+            "              [blk_sgio=0|1] [bpt=BPT|auto] [cdbsz=6|10|12|16] "
             "[cdl=CDL]\n"
-            "              [coe=0|1|2|3] [coe_limit=CL] [dio=0|1] "
-            "[odir=0|1]\n"
-            "              [of2=OFILE2] [retries=RETR] [sync=0|1] "
-            "[time=0|1[,TO]]\n"
-            "              [verbose=VERB] [--compare] [--progress] "
-            "[--verify]\n"
+            "              [ckpt=CFILE[,SECS]] [coe=0|1|2|3] [coe_limit=CL] "
+            "[dio=0|1]\n"
+            "              [hash=ALG[,MANIFEST]] [interval=SECS] [nbuf=1|2|3]\n"
+            "              [odir=0|1] [of2=OFILE2] [pi_type=1|3[,AT]] "
+            "[prefetch=DIST[,NUM]]\n"
+            "              [rate=BPS[,IOPS]] [retries=RETR] [sync=0|1] "
+            "[tbuf=MB[,PCT]]\n"
+            "              [time=0|1[,TO]] [verbose=VERB] "
+            "[zappend=MFILE[,QD]]\n"
+            "              [--compare] [--json[=JO]] [--progress] "
+            "[--resume] [--verify]\n"
             "  where:\n"
             "    blk_sgio    0->block device use normal I/O(def), 1->use "
             "SG_IO\n"
             "    bpt         is blocks_per_transfer (default is 128 or 32 "
-            "when BS>=2048)\n"
+            "when BS>=2048);\n"
+            "                'auto' probes sizes up to device limits then "
+            "settles\n"
             "    bs          logical block size (default is 512)\n");
     pr2serr("    cdbsz       size of SCSI READ or WRITE cdb (default is "
             "10)\n"
             "    cdl         command duration limits value 0 to 7 (def: "
             "0 (no cdl))\n"
+            "    ckpt        checkpoint journal CFILE, rewritten every SECS "
+            "seconds\n"
+            "                (def: 10) and when copy stops; see --resume\n"
             "    coe         0->exit on error (def), 1->continue on sg "
             "error (zero\n"
             "                fill), 2->also try read_long on unrecovered "
@@ -501,12 +560,27 @@ usage()
             "    count       number of blocks to copy (def: device size)\n"
             "    dio         for direct IO, 1->attempt, 0->indirect IO "
             "(def)\n"
+            "    hash        ALG is crc32c, xxh64 or sha256; digest of data "
+            "read is\n"
+            "                printed at end; MANIFEST gets a digest per "
+            "transfer\n"
             "    ibs         input logical block size (if given must be same "
             "as 'bs=')\n"
-            "    if          file or device to read from (def: stdin)\n"
+            "    if          file or device to read from (def: stdin); "
+            "or pat:PAT\n"
+            "                for generated data: zero, ff, HEX, lba or "
+            "prng[,SEED]\n"
             "    iflag       comma separated list from: [00,coe,dio,direct,"
             "dpo,dsync,\n"
-            "                excl,ff,flock,fua,nocache,null,pt,random,sgio]\n"
+            "                excl,extents,ff,flock,fua,hugepage,nocache,null,pi,"
+            "pt,\n"
+            "                random,sgio,simage,tape]\n"
+            "    interval    every SECS seconds report throughput, IOPS and "
+            "latency\n"
+            "                percentiles of that interval (def: 0 -> don't)\n"
+            "    nbuf        blocks per transfer groups in flight; 2 or 3 "
+            "overlap\n"
+            "                READs and WRITEs between sg devices (def: 1)\n"
             "    obs         output logical block size (if given must be "
             "same as 'bs=')\n"
             "    odir        1->use O_DIRECT when opening block dev, "
@@ -519,23 +593,56 @@ usage()
             "                normal file or pipe\n"
             "    oflag       comma separated list from: [append,coe,dio,"
             "direct,dpo,\n"
-            "                dsync,excl,flock,fua,nocache,nocreat,null,pt,"
-            "sgio,sparse]\n"
+            "                dsync,excl,flock,fua,hugepage,nocache,nocreat,"
+            "null,pi,\n"
+            "                pt,sgio,simage,sparse,tape,unmap]\n"
+            "    pi_type     protection type of PI sg_dd checks (iflag=pi) "
+            "or makes\n"
+            "                (oflag=pi): 1 (def) or 3; AT is application "
+            "tag (def: 0,\n"
+            "                not checked)\n"
+            "    prefetch    send PRE-FETCH (IMMED) on IFILE up to DIST "
+            "blocks ahead of\n"
+            "                the READs, NUM blocks each (def: BPT)\n"
+            "    rate        limit copy to BPS bytes per second and IOPS "
+            "commands\n"
+            "                per second (0 -> no limit); '@FN' reads "
+            "BPS[,IOPS] from\n"
+            "                file FN, re-read on SIGHUP\n"
             "    retries     retry sgio errors RETR times (def: 0)\n"
-            "    seek        block position to start writing to OFILE\n"
-            "    skip        block position to start reading from IFILE\n"
+            "    seek        block position to start writing to OFILE, or "
+            "a scatter\n"
+            "                gather list: LBA0,NUM0[,LBA1,NUM1...] or "
+            "@FN\n"
+            "    skip        block position to start reading from IFILE, "
+            "or a list\n"
             "    sync        0->no sync(def), 1->SYNCHRONIZE CACHE on "
             "OFILE after copy\n"
+            "    tbuf        with iflag=tape or oflag=tape: ring buffer of "
+            "MB MiB\n"
+            "                (def: 64); drive writes start at PCT percent "
+            "full (def: 50)\n"
             "    time        0->no timing(def), 1->time plus calculate "
             "throughput;\n"
             "                TO is command timeout in seconds (def: 60)\n"
             "    verbose     0->quiet(def), 1->some noise, 2->more noise, "
             "etc\n"
+            "    zappend     append to the zones of OFILE (ZNS or ZBC) from "
+            "the one\n"
+            "                holding SEEK, QD (def: 32) at once; where each "
+            "BPT blocks\n"
+            "                of IFILE landed goes to MFILE ('-' for stdout)\n"
             "    --compare|-c    same as --verify, compare IFILE with "
             "OFILE\n"
             "    --dry-run|-d    do preparation but bypass copy (or read)\n"
             "    --help|-h    print out this usage message then exit\n"
+            "    --json[=JO]    interval=SECS reports and error statistics "
+            "are output\n"
+            "                   as JSON lines (to stdout unless OFILE is "
+            "stdout),\n"
+            "                   JO is JSON options\n"
             "    --progress|-p    print progress report every 2 minutes\n"
+            "    --resume|-r    continue the copy recorded in ckpt=CFILE\n"
             "    --verbose|-v   same as 'verbose=1', can be used multiple "
             "times\n"
             "    --verify|-x    do verify/compare rather than copy "
@@ -554,37 +661,8 @@ static int
 scsi_read_capacity(int sg_fd, int64_t * num_sect, int * sect_sz,
                    struct opts_t * op)
 {
-    int res, verb;
-    unsigned int ui;
-    uint8_t rcBuff[RCAP16_REPLY_LEN];
-
-    verb = (op->verbose ? op->verbose - 1: 0);
-    res = sg_ll_readcap_10(sg_fd, false, 0, rcBuff, READ_CAP_REPLY_LEN, true,
-                           verb);
-    if (0 != res)
-        return res;
-
-    if ((0xff == rcBuff[0]) && (0xff == rcBuff[1]) && (0xff == rcBuff[2]) &&
-        (0xff == rcBuff[3])) {
-        int64_t ls;
-
-        res = sg_ll_readcap_16(sg_fd, false, 0, rcBuff, RCAP16_REPLY_LEN,
-                               true, verb);
-        if (0 != res)
-            return res;
-        ls = (int64_t)sg_get_unaligned_be64(rcBuff);
-        *num_sect = ls + 1;
-        *sect_sz = (int)sg_get_unaligned_be32(rcBuff + 8);
-    } else {
-        ui = sg_get_unaligned_be32(rcBuff);
-        /* take care not to sign extend values > 0x7fffffff */
-        *num_sect = (int64_t)ui + 1;
-        *sect_sz = (int)sg_get_unaligned_be32(rcBuff + 4);
-    }
-    if (verb)
-        pr2serr("      number of blocks=%" PRId64 " [0x%" PRIx64 "], "
-                "logical block size=%d\n", *num_sect, *num_sect, *sect_sz);
-    return 0;
+    return sg_dde_read_capacity(sg_fd, num_sect, sect_sz, true,
+                                (op->verbose ? op->verbose - 1 : 0));
 }
 
 
@@ -594,141 +672,64 @@ static int
 read_blkdev_capacity(int sg_fd, int64_t * num_sect, int * sect_sz,
                      struct opts_t * op)
 {
-#ifdef BLKSSZGET
-    if ((ioctl(sg_fd, BLKSSZGET, sect_sz) < 0) && (*sect_sz > 0)) {
-        perror("BLKSSZGET ioctl error");
-        return -1;
-    } else {
- #ifdef BLKGETSIZE64
-        uint64_t ull;
-
-        if (ioctl(sg_fd, BLKGETSIZE64, &ull) < 0) {
-
-            perror("BLKGETSIZE64 ioctl error");
-            return -1;
-        }
-        *num_sect = ((int64_t)ull / (int64_t)*sect_sz);
-        if (op->verbose)
-            pr2serr("      [bgs64] number of blocks=%" PRId64 " [0x%" PRIx64
-                    "], logical block size=%d\n", *num_sect, *num_sect,
-                    *sect_sz);
- #else
-        unsigned long ul;
-
-        if (ioctl(sg_fd, BLKGETSIZE, &ul) < 0) {
-            perror("BLKGETSIZE ioctl error");
-            return -1;
-        }
-        *num_sect = (int64_t)ul;
-        if (op->verbose)
-            pr2serr("      [bgs] number of blocks=%" PRId64 " [0x%" PRIx64
-                    "],  logical block size=%d\n", *num_sect, *num_sect,
-                    *sect_sz);
- #endif
-    }
-    return 0;
-#else
-    if (op->verbose)
-        pr2serr("      BLKSSZGET+BLKGETSIZE ioctl not available\n");
-    *num_sect = 0;
-    *sect_sz = 0;
-    return -1;
-#endif
+    return sg_dde_blkdev_capacity(sg_fd, num_sect, sect_sz, op->verbose);
 }
 
 
+/* Sets up *tp with all the fields of the cdb that are the same for every
+ * command on one side of the copy, leaving the LBA and TRANSFER LENGTH to
+ * sg_dde_cdb_tmpl_fill(). Returns 0 on success, else 1. */
 static int
-sg_build_scsi_cdb(uint8_t * cdbp, unsigned int blocks, int64_t start_block,
-                  bool is_verify, bool write_true, struct opts_t * op)
+sg_dd_cdb_tmpl_init(struct sg_dde_cdb_tmpl * tp, bool is_verify,
+                    bool write_true, const struct opts_t * op)
 {
-    int sz_ind;
     const struct flags_t * flagp = write_true ? &op->oflag : &op->iflag;
-    static const int rd_opcode[] = {0x8, 0x28, 0xa8, 0x88};
-    static const int ve_opcode[] = {0xff /* no VERIFY(6) */, VERIFY10,
-                                    VERIFY12, VERIFY16};
-    static const int wr_opcode[] = {0xa, 0x2a, 0xaa, 0x8a};
-
-    memset(cdbp, 0, flagp->cdbsz);
-    if (is_verify)
-        cdbp[1] = 0x2;  /* (BYTCHK=1) << 1 */
-    else {
-        if (flagp->dpo)
-            cdbp[1] |= 0x10;
-        if (flagp->fua)
-            cdbp[1] |= 0x8;
-    }
-    switch (flagp->cdbsz) {
-    case 6:
-        sz_ind = 0;
+    int cdbsz = flagp->cdbsz;
+
+    if (6 == cdbsz) {
         if (is_verify && write_true) {
             pr2serr("%sthere is no VERIFY(6), choose a larger cdbsz\n",
                      my_name);
             return 1;
         }
-        cdbp[0] = (uint8_t)(write_true ? wr_opcode[sz_ind] :
-                                         rd_opcode[sz_ind]);
-        sg_put_unaligned_be24(0x1fffff & start_block, cdbp + 1);
-        cdbp[4] = (256 == blocks) ? 0 : (uint8_t)blocks;
-        if (blocks > 256) {
-            pr2serr("%sfor 6 byte commands, maximum number of blocks is "
-                    "256\n", my_name);
-            return 1;
-        }
-        if ((start_block + blocks - 1) & (~0x1fffff)) {
-            pr2serr("%sfor 6 byte commands, can't address blocks beyond %d\n",
-                    my_name, 0x1fffff);
-            return 1;
-        }
-        if (flagp->dpo || flagp->fua) {
-            pr2serr("%sfor 6 byte commands, neither dpo nor fua bits "
-                    "supported\n", my_name);
-            return 1;
-        }
-        break;
-    case 10:
-        sz_ind = 1;
-        if (is_verify && write_true)
-            cdbp[0] = ve_opcode[sz_ind];
-        else
-            cdbp[0] = (uint8_t)(write_true ? wr_opcode[sz_ind] :
-                                             rd_opcode[sz_ind]);
-        sg_put_unaligned_be32(start_block, cdbp + 2);
-        sg_put_unaligned_be16(blocks, cdbp + 7);
-        if (blocks & (~0xffff)) {
-            pr2serr("%sfor 10 byte commands, maximum number of blocks "
-                    "is %d\n", my_name, 0xffff);
+        if ((! is_verify) && flagp->pi) {
+            pr2serr("%sfor 6 byte commands, PI can't be transferred\n",
+                    my_name);
             return 1;
         }
-        break;
-    case 12:
-        sz_ind = 2;
-        if (is_verify && write_true)
-            cdbp[0] = ve_opcode[sz_ind];
-        else
-            cdbp[0] = (uint8_t)(write_true ? wr_opcode[sz_ind] :
-                                             rd_opcode[sz_ind]);
-        sg_put_unaligned_be32(start_block, cdbp + 2);
-        sg_put_unaligned_be32(blocks, cdbp + 6);
-        break;
-    case 16:
-        sz_ind = 3;
-        if (is_verify && write_true)
-            cdbp[0] = ve_opcode[sz_ind];
-        else
-            cdbp[0] = (uint8_t)(write_true ? wr_opcode[sz_ind] :
-                                             rd_opcode[sz_ind]);
-        if ((! is_verify) && (flagp->cdl > 0)) {
-            if (flagp->cdl & 0x4)
-                cdbp[1] |= 0x1;
-            if (flagp->cdl & 0x3)
-                cdbp[14] |= ((flagp->cdl & 0x3) << 6);
-        }
-        sg_put_unaligned_be64(start_block, cdbp + 2);
-        sg_put_unaligned_be32(blocks, cdbp + 10);
-        break;
-    default:
-        pr2serr("%sexpected cdb size of 6, 10, 12, or 16 but got %d\n",
-                my_name, flagp->cdbsz);
+    }
+    if (sg_dde_cdb_tmpl_init(tp, cdbsz, write_true, flagp->fua, flagp->dpo,
+                             my_name))
+        return 1;
+    if (is_verify) {
+        tp->cdb[1] = 0x2;       /* (BYTCHK=1) << 1 */
+        if (write_true)
+            tp->cdb[0] = (10 == cdbsz) ? VERIFY10 :
+                         ((12 == cdbsz) ? VERIFY12 : VERIFY16);
+        return 0;
+    }
+    if (flagp->pi)
+        tp->cdb[1] |= 0x20;     /* RDPROTECT or WRPROTECT = 1 */
+    if ((16 == cdbsz) && (flagp->cdl > 0)) {
+        if (flagp->cdl & 0x4)
+            tp->cdb[1] |= 0x1;
+        if (flagp->cdl & 0x3)
+            tp->cdb[14] |= ((flagp->cdl & 0x3) << 6);
+    }
+    return 0;
+}
+
+static int
+sg_build_scsi_cdb(uint8_t * cdbp, unsigned int blocks, int64_t start_block,
+                  bool is_verify, bool write_true, struct opts_t * op)
+{
+    struct sg_dde_cdb_tmpl tmpl;
+
+    if (sg_dd_cdb_tmpl_init(&tmpl, is_verify, write_true, op))
+        return 1;
+    if (sg_dde_cdb_tmpl_fill(&tmpl, cdbp, blocks, start_block)) {
+        pr2serr("%s%u blocks at lba %" PRId64 " do not fit a %d byte cdb\n",
+                my_name, blocks, start_block, tmpl.cdb_sz);
         return 1;
     }
     return 0;
@@ -769,7 +770,7 @@ use_sntl(const uint8_t * scsiCdb, uint8_t * buff, int blocks,
     vb = ((op->verbose > 1) ? (op->verbose - 1) : op->verbose);
     while (((res = do_scsi_pt(ptvp, -1, to, vb)) < 0) &&
            ((-EINTR == res) || (-EAGAIN == res) || (-EBUSY == res))) {
-        ;
+        sg_err_stats_errno(&err_stats, res);
     }
     ret = sg_cmds_process_resp(ptvp, cmd_s, res, false /* noisy */, vb,
                                &sense_cat);
@@ -778,9 +779,12 @@ use_sntl(const uint8_t * scsiCdb, uint8_t * buff, int blocks,
             ret = SG_LIB_TRANSPORT_ERROR;
         else
             ret = sg_convert_errno(get_scsi_pt_os_err(ptvp));
+        sg_err_stats_cat(&err_stats, ret);
+        sg_err_stats_errno(&err_stats, get_scsi_pt_os_err(ptvp));
     } else if (-2 == ret) {
         slen = get_scsi_pt_sense_len(ptvp);
         ret = sense_cat;
+        sg_err_stats_cat(&err_stats, sense_cat);
 
         switch (sense_cat) {
         case SG_LIB_CAT_NOT_READY:
@@ -833,8 +837,10 @@ use_sntl(const uint8_t * scsiCdb, uint8_t * buff, int blocks,
         default:
             break;
         }
-    } else
+    } else {
         ret = 0;
+        sg_err_stats_cat(&err_stats, 0);
+    }
 
     /* We are going to re-read those good blocks */
     if ((SG_LIB_CAT_MEDIUM_HARD_WITH_INFO != ret) &&
@@ -850,6 +856,29 @@ use_sntl(const uint8_t * scsiCdb, uint8_t * buff, int blocks,
  * SG_LIB_CAT_MEDIUM_HARD -> no info field,
  * SG_LIB_CAT_NOT_READY, SG_LIB_CAT_ABORTED_COMMAND,
  * -2 -> ENOMEM, -1 other errors */
+/* With iflag=pi, checks the PI read into op->pi_buf along with the data
+ * of blocks starting at from_block, then places the data (without PI) in
+ * buff. Returns 0 or SG_LIB_CAT_PROTECTION. */
+static int
+pi_check_strip(uint8_t * buff, int blocks, int64_t from_block,
+               struct opts_t * op)
+{
+    int res, k;
+
+    op->pi_ctx.ref_tag = (uint32_t)from_block;
+    res = sg_pi_verify(&op->pi_ctx, from_block, blocks, op->pi_buf, NULL,
+                       &k);
+    if (res) {
+        ++unrecovered_errs;
+        sg_err_stats_cat(&err_stats, SG_LIB_CAT_PROTECTION);
+        pr2serr("PI %s at LBA 0x%" PRIx64 " (reading)\n",
+                sg_pi_err_str(res), (uint64_t)(from_block + k));
+        return SG_LIB_CAT_PROTECTION;
+    }
+    sg_pi_deinterleave(op->blk_sz, blocks, op->pi_buf, buff, NULL);
+    return 0;
+}
+
 static int
 sg_read_low(uint8_t * buff, int blocks, int64_t from_block,
             bool * diop, uint64_t * io_addrp, struct opts_t * op)
@@ -863,8 +892,7 @@ sg_read_low(uint8_t * buff, int blocks, int64_t from_block,
     uint8_t senseBuff[SENSE_BUFF_LEN] SG_C_CPP_ZERO_INIT;
     struct sg_io_hdr io_hdr;
 
-    if (sg_build_scsi_cdb(rdCmd, blocks, from_block, op->do_verify,
-                          false, op)) {
+    if (sg_dde_cdb_tmpl_fill(&ifp->tmpl, rdCmd, blocks, from_block)) {
         pr2serr("%sbad rd cdb build, from_block=%" PRId64 ", blocks=%d\n",
                 my_name, from_block, blocks);
         return SG_LIB_SYNTAX_ERROR;
@@ -877,8 +905,13 @@ sg_read_low(uint8_t * buff, int blocks, int64_t from_block,
     io_hdr.cmd_len = ifp->cdbsz;
     io_hdr.cmdp = rdCmd;
     io_hdr.dxfer_direction = SG_DXFER_FROM_DEV;
-    io_hdr.dxfer_len = op->blk_sz * blocks;
-    io_hdr.dxferp = buff;
+    if (ifp->pi) {      /* read data with PI interleaved, then strip */
+        io_hdr.dxfer_len = (op->blk_sz + SG_PI_TUPLE_LEN) * blocks;
+        io_hdr.dxferp = op->pi_buf;
+    } else {
+        io_hdr.dxfer_len = op->blk_sz * blocks;
+        io_hdr.dxferp = buff;
+    }
     io_hdr.mx_sb_len = SENSE_BUFF_LEN;
     io_hdr.sbp = senseBuff;
     io_hdr.timeout = op->cmd_timeout;
@@ -891,16 +924,19 @@ sg_read_low(uint8_t * buff, int blocks, int64_t from_block,
 
     while (((res = ioctl(op->infd, SG_IO, &io_hdr)) < 0) &&
            ((EINTR == errno) || (EAGAIN == errno) || (EBUSY == errno)))
-        ;
+        sg_err_stats_errno(&err_stats, errno);
     if (res < 0) {
+        sg_err_stats_errno(&err_stats, errno);
         if (ENOMEM == errno)
             return -2;
+        sg_err_stats_cat(&err_stats, sg_convert_errno(errno));
         perror("reading (SG_IO) on sg device, error");
         return -1;
     }
     if (op->verbose > 2)
         pr2serr("      duration=%u ms\n", io_hdr.duration);
     res = sg_err_category3(&io_hdr);
+    sg_err_stats_cat(&err_stats, res);
     sbp = io_hdr.sbp;
     slen = io_hdr.sb_len_wr;
     switch (res) {
@@ -987,9 +1023,165 @@ sg_read_low(uint8_t * buff, int blocks, int64_t from_block,
         ((io_hdr.info & SG_INFO_DIRECT_IO_MASK) != SG_INFO_DIRECT_IO))
         *diop = false;      /* flag that dio not done (completely) */
     op->sum_of_resids += io_hdr.resid;
+    if (ifp->pi)
+        return pi_check_strip(buff, blocks, from_block, op);
+    return 0;
+}
+
+
+/* Supplies the contents of the block at lba which could not be read, for
+ * 'coe': zeros or, with coe=2 or more, what READ LONG returns. Returns 0,
+ * or -1 if out of memory. */
+static int
+coe_fill_bad(uint8_t * bp, int64_t lba, struct opts_t * op)
+{
+    int res;
+    int bs = op->blk_sz;
+    struct flags_t * ifp = &op->iflag;
+
+    if ((0 != ifp->pdt) || (ifp->coe < 2)) {
+        pr2serr(">> unrecovered read error at blk=%" PRId64 ", pdt=%d, "
+                "use zeros\n", lba, ifp->pdt);
+        memset(bp, 0, bs);
+    } else if (lba < UINT_MAX) {
+        bool corrct, ok;
+        int offset, nl, r;
+        uint8_t * buffp;
+        uint8_t * free_buffp;
+
+        buffp = sg_memalign(bs * 2, 0, &free_buffp, false);
+        if (NULL == buffp) {
+            pr2serr(">> heap problems\n");
+            return -1;
+        }
+        corrct = (ifp->coe > 2);
+        res = sg_ll_read_long10(op->infd, /* pblock */false, corrct, lba,
+                                buffp, bs + read_long_blk_inc, &offset,
+                                true, op->verbose);
+        ok = false;
+        switch (res) {
+        case 0:
+            ok = true;
+            ++read_longs;
+            break;
+        case SG_LIB_CAT_ILLEGAL_REQ_WITH_INFO:
+            nl = bs + read_long_blk_inc - offset;
+            if ((nl < 32) || (nl > (bs * 2))) {
+                pr2serr(">> read_long(10) len=%d unexpected\n", nl);
+                break;
+            }
+            /* remember for next read_long attempt, if required */
+            read_long_blk_inc = nl - bs;
+
+            if (op->verbose)
+                pr2serr("read_long(10): adjusted len=%d\n", nl);
+            r = sg_ll_read_long10(op->infd, false, corrct, lba, buffp, nl,
+                                  &offset, true, op->verbose);
+            if (0 == r) {
+                ok = true;
+                ++read_longs;
+                break;
+            } else
+                pr2serr(">> unexpected result=%d on second "
+                        "read_long(10)\n", r);
+            break;
+        case SG_LIB_CAT_INVALID_OP:
+            pr2serr(">> read_long(10); not supported\n");
+            break;
+        case SG_LIB_CAT_ILLEGAL_REQ:
+            pr2serr(">> read_long(10): bad cdb field\n");
+            break;
+        case SG_LIB_CAT_NOT_READY:
+            pr2serr(">> read_long(10): device not ready\n");
+            break;
+        case SG_LIB_CAT_UNIT_ATTENTION:
+            pr2serr(">> read_long(10): unit attention\n");
+            break;
+        case SG_LIB_CAT_ABORTED_COMMAND:
+            pr2serr(">> read_long(10): aborted command\n");
+            break;
+        default:
+            pr2serr(">> read_long(10): problem (%d)\n", res);
+            break;
+        }
+        if (ok)
+            memcpy(bp, buffp, bs);
+        else
+            memset(bp, 0, bs);
+        free(free_buffp);
+    } else {
+        pr2serr(">> read_long(10) cannot handle blk=%" PRId64 ", use "
+                "zeros\n", lba);
+        memset(bp, 0, bs);
+    }
     return 0;
 }
 
+/* For 'coe' after a READ of blks blocks at lba failed with a medium error
+ * whose sense data did not locate the bad block. Rather than zero all of
+ * them, or read them one at a time, reads each half of the range and
+ * recurses into a half that fails, so k bad blocks among n cost about
+ * 2k.log2(n) commands. A failure whose INFORMATION field does locate the
+ * bad block has the blocks before it read and carries on just after it.
+ * Bad blocks are filled by coe_fill_bad() and counted in *badp. Returns 0,
+ * or the result of a read that failed for another reason. */
+static int
+coe_bisect(uint8_t * bp, int blks, int64_t lba, bool * diop, int * badp,
+           struct opts_t * op)
+{
+    int res, n;
+    int bs = op->blk_sz;
+    uint64_t io_addr;
+
+    while (blks > 0) {
+        io_addr = 0;
+        res = sg_read_low(bp, blks, lba, diop, &io_addr, op);
+        if (0 == res)
+            return 0;
+        if ((SG_LIB_CAT_MEDIUM_HARD_WITH_INFO == res) &&
+            (io_addr >= (uint64_t)lba) &&
+            (io_addr < (uint64_t)(lba + blks))) {
+            n = (int)(io_addr - (uint64_t)lba);
+            if (n > 0) {
+                if ((res = coe_bisect(bp, n, lba, diop, badp, op)))
+                    return res;
+            }
+            bp += n * bs;
+            lba += n;
+            if (coe_fill_bad(bp, lba, op))
+                return -1;
+            ++*badp;
+            bp += bs;
+            ++lba;
+            blks -= n + 1;
+            continue;
+        }
+        if ((SG_LIB_CAT_MEDIUM_HARD != res) &&
+            (SG_LIB_CAT_MEDIUM_HARD_WITH_INFO != res))
+            return res;
+        if (1 == blks) {
+            if (coe_fill_bad(bp, lba, op))
+                return -1;
+            ++*badp;
+            return 0;
+        }
+        /* counted again in each half, the one that holds the bad block */
+        if (unrecovered_errs > 0)
+            --unrecovered_errs;
+        n = blks / 2;
+        if (op->verbose > 1)
+            pr2serr("  bisect: blocks [0x%" PRIx64 ",0x%" PRIx64 "] then "
+                    "[0x%" PRIx64 ",0x%" PRIx64 "]\n", (uint64_t)lba,
+                    (uint64_t)(lba + n - 1), (uint64_t)(lba + n),
+                    (uint64_t)(lba + blks - 1));
+        if ((res = coe_bisect(bp, n, lba, diop, badp, op)))
+            return res;
+        bp += n * bs;   /* then the second half, in this loop */
+        lba += n;
+        blks -= n;
+    }
+    return 0;
+}
 
 /* Does repeats associated with a SCSI READ on IFILE. Returns 0 -> successful,
  * SG_LIB_SYNTAX_ERROR  -> unable to build cdb, SG_LIB_CAT_UNIT_ATTENTION ->
@@ -1052,7 +1244,7 @@ sg_read(uint8_t * buff, int blocks, int64_t from_block, bool * diop,
                 pr2serr(">>> retrying a sgio read, lba=0x%" PRIx64 "\n",
                         (uint64_t)lba);
                 --retries_tmp;
-                ++num_retries;
+                sg_err_stats_retry(&err_stats);
                 if (unrecovered_errs > 0)
                     --unrecovered_errs;
                 repeat = true;
@@ -1079,7 +1271,7 @@ sg_read(uint8_t * buff, int blocks, int64_t from_block, bool * diop,
                 pr2serr(">>> retrying a sgio read, lba=0x%" PRIx64 "\n",
                         (uint64_t)lba);
                 --retries_tmp;
-                ++num_retries;
+                sg_err_stats_retry(&err_stats);
                 if (unrecovered_errs > 0)
                     --unrecovered_errs;
                 repeat = true;
@@ -1149,81 +1341,8 @@ sg_read(uint8_t * buff, int blocks, int64_t from_block, bool * diop,
         }
         bp += (blks * bs);
         lba += blks;
-        if ((0 != ifp->pdt) || (ifp->coe < 2)) {
-            pr2serr(">> unrecovered read error at blk=%" PRId64 ", pdt=%d, "
-                    "use zeros\n", lba, ifp->pdt);
-            memset(bp, 0, bs);
-        } else if (io_addr < UINT_MAX) {
-            bool corrct, ok;
-            int offset, nl, r;
-            uint8_t * buffp;
-            uint8_t * free_buffp;
-
-            buffp = sg_memalign(bs * 2, 0, &free_buffp, false);
-            if (NULL == buffp) {
-                pr2serr(">> heap problems\n");
-                return -1;
-            }
-            corrct = (ifp->coe > 2);
-            res = sg_ll_read_long10(op->infd, /* pblock */false, corrct, lba,
-                                    buffp, bs + read_long_blk_inc, &offset,
-                                    true, op->verbose);
-            ok = false;
-            switch (res) {
-            case 0:
-                ok = true;
-                ++read_longs;
-                break;
-            case SG_LIB_CAT_ILLEGAL_REQ_WITH_INFO:
-                nl = bs + read_long_blk_inc - offset;
-                if ((nl < 32) || (nl > (bs * 2))) {
-                    pr2serr(">> read_long(10) len=%d unexpected\n", nl);
-                    break;
-                }
-                /* remember for next read_long attempt, if required */
-                read_long_blk_inc = nl - bs;
-
-                if (op->verbose)
-                    pr2serr("read_long(10): adjusted len=%d\n", nl);
-                r = sg_ll_read_long10(op->infd, false, corrct, lba, buffp, nl,
-                                      &offset, true, op->verbose);
-                if (0 == r) {
-                    ok = true;
-                    ++read_longs;
-                    break;
-                } else
-                    pr2serr(">> unexpected result=%d on second "
-                            "read_long(10)\n", r);
-                break;
-            case SG_LIB_CAT_INVALID_OP:
-                pr2serr(">> read_long(10); not supported\n");
-                break;
-            case SG_LIB_CAT_ILLEGAL_REQ:
-                pr2serr(">> read_long(10): bad cdb field\n");
-                break;
-            case SG_LIB_CAT_NOT_READY:
-                pr2serr(">> read_long(10): device not ready\n");
-                break;
-            case SG_LIB_CAT_UNIT_ATTENTION:
-                pr2serr(">> read_long(10): unit attention\n");
-                break;
-            case SG_LIB_CAT_ABORTED_COMMAND:
-                pr2serr(">> read_long(10): aborted command\n");
-                break;
-            default:
-                pr2serr(">> read_long(10): problem (%d)\n", res);
-                break;
-            }
-            if (ok)
-                memcpy(bp, buffp, bs);
-            else
-                memset(bp, 0, bs);
-            free(free_buffp);
-        } else {
-            pr2serr(">> read_long(10) cannot handle blk=%" PRId64 ", use "
-                    "zeros\n", lba);
-            memset(bp, 0, bs);
-        }
+        if (coe_fill_bad(bp, lba, op))
+            return -1;
         ++xferred;
         bp += bs;
         ++lba;
@@ -1239,6 +1358,26 @@ sg_read(uint8_t * buff, int blocks, int64_t from_block, bool * diop,
     return 0;
 
 err_out:
+    if (ifp->coe && may_coe && (blks > 1)) {
+        int bad = 0;
+
+        /* which of the blks are bad is not known, find them */
+        res = coe_bisect(bp, blks, lba, diop, &bad, op);
+        if (0 == res) {
+            if (op->verbose)
+                pr2serr(">> %d bad block(s) found by bisection in %d blocks "
+                        "at blk=%" PRId64 "\n", bad, blks, lba);
+            if (blks_readp)
+                *blks_readp = xferred + blks;
+            if ((op->coe_limit > 0) &&
+                ((op->coe_count += bad) > op->coe_limit)) {
+                pr2serr(">> coe_limit on consecutive reads exceeded\n");
+                return SG_LIB_CAT_MEDIUM_HARD;
+            }
+            return 0;
+        }
+        ret = res;
+    }
     if (ifp->coe) {
         memset(bp, 0, bs * blks);
         pr2serr(">> unable to read at blk=%" PRId64 " for %d bytes, use "
@@ -1258,6 +1397,44 @@ err_out:
         return ret;
 }
 
+/* Keeps PRE-FETCH commands, with IMMED set, up to pf_dist blocks ahead of
+ * the READ about to be sent for blocks at op->skip so the device's cache
+ * holds the data when later READs arrive. Each PRE-FETCH asks for pf_num
+ * blocks and none go past the end of the copy. PRE-FETCH is only a hint
+ * so errors are ignored, other than the command not being supported which
+ * stops the read-ahead. */
+static void
+prefetch_ahead(struct opts_t * op, int blocks)
+{
+    int n, res;
+    int vb = (op->verbose > 1) ? op->verbose - 1 : 0;
+    int64_t end = op->skip + op->dd_count;
+    int64_t want = op->skip + blocks + op->pf_dist;
+
+    if (op->pf_next < op->skip + blocks)
+        op->pf_next = op->skip + blocks;   /* current READ not worth it */
+    if (want > end)
+        want = end;
+    while (op->pf_next < want) {
+        n = (op->pf_num > 0) ? op->pf_num : op->bpt;
+        if (n > (end - op->pf_next))
+            n = (int)(end - op->pf_next);
+        res = sg_ll_pre_fetch_x(op->infd, false, (16 == op->iflag.cdbsz),
+                                true, op->pf_next, n, 0,
+                                op->cmd_timeout / 1000, false, vb);
+        if ((SG_LIB_CAT_INVALID_OP == res) ||
+            (SG_LIB_CAT_ILLEGAL_REQ == res)) {
+            pr2serr("PRE-FETCH not supported by IFILE, read-ahead "
+                    "stopped\n");
+            op->pf_dist = 0;
+            return;
+        } else if (res && (SG_LIB_CAT_CONDITION_MET != res) &&
+                   (op->verbose > 1))
+            pr2serr("PRE-FETCH at lba=%" PRId64 " for %d blocks failed, "
+                    "res=%d, ignored\n", op->pf_next, n, res);
+        op->pf_next += n;
+    }
+}
 
 /* Does a SCSI WRITE or VERIFY (if do_verify set) on OFILE. Returns:
  * 0 -> successful, SG_LIB_SYNTAX_ERROR -> unable to build cdb,
@@ -1278,7 +1455,7 @@ sg_write(int sg_fd, uint8_t * buff, int blocks, int64_t to_block,
     struct sg_io_hdr io_hdr;
     const char * op_str = op->do_verify ? "verifying" : "writing";
 
-    if (sg_build_scsi_cdb(wrCmd, blocks, to_block, op->do_verify, true, op)) {
+    if (sg_dde_cdb_tmpl_fill(&ofp->tmpl, wrCmd, blocks, to_block)) {
         pr2serr("%sbad wr cdb build, to_block=%" PRId64 ", blocks=%d\n",
                 my_name, to_block, blocks);
         return SG_LIB_SYNTAX_ERROR;
@@ -1291,8 +1468,17 @@ sg_write(int sg_fd, uint8_t * buff, int blocks, int64_t to_block,
     io_hdr.cmd_len = ofp->cdbsz;
     io_hdr.cmdp = wrCmd;
     io_hdr.dxfer_direction = SG_DXFER_TO_DEV;
-    io_hdr.dxfer_len = bs * blocks;
-    io_hdr.dxferp = buff;
+    if (ofp->pi && (! op->do_verify)) {
+        /* interleave data with PI made here, device checks it */
+        op->pi_ctx.ref_tag = (uint32_t)to_block;
+        sg_pi_interleave(bs, blocks, buff, NULL, op->pi_buf);
+        sg_pi_generate(&op->pi_ctx, to_block, blocks, op->pi_buf, NULL);
+        io_hdr.dxfer_len = (bs + SG_PI_TUPLE_LEN) * blocks;
+        io_hdr.dxferp = op->pi_buf;
+    } else {
+        io_hdr.dxfer_len = bs * blocks;
+        io_hdr.dxferp = buff;
+    }
     io_hdr.mx_sb_len = SENSE_BUFF_LEN;
     io_hdr.sbp = senseBuff;
     io_hdr.timeout = op->cmd_timeout;
@@ -1305,10 +1491,12 @@ sg_write(int sg_fd, uint8_t * buff, int blocks, int64_t to_block,
 
     while (((res = ioctl(sg_fd, SG_IO, &io_hdr)) < 0) &&
            ((EINTR == errno) || (EAGAIN == errno) || (EBUSY == errno)))
-        ;
+        sg_err_stats_errno(&err_stats, errno);
     if (res < 0) {
+        sg_err_stats_errno(&err_stats, errno);
         if (ENOMEM == errno)
             return -2;
+        sg_err_stats_cat(&err_stats, sg_convert_errno(errno));
 #if 0
         if (op->do_verify)
             perror("verifying (SG_IO) on sg device, error");
@@ -1321,6 +1509,7 @@ sg_write(int sg_fd, uint8_t * buff, int blocks, int64_t to_block,
     if (op->verbose > 2)
         pr2serr("      duration=%u ms\n", io_hdr.duration);
     res = sg_err_category3(&io_hdr);
+    sg_err_stats_cat(&err_stats, res);
     switch (res) {
     case SG_LIB_CAT_CLEAN:
     case SG_LIB_CAT_CONDITION_MET:
@@ -1512,26 +1701,38 @@ process_flags(const char * arg, struct flags_t * fp)
             fp->dsync = true;
         else if (0 == strcmp(cp, "excl"))
             fp->excl = true;
+        else if (0 == strcmp(cp, "extents"))
+            fp->extents = true;
         else if (0 == strcmp(cp, "flock"))
             fp->flock = true;
         else if (0 == strcmp(cp, "ff"))
             fp->ff = true;
         else if (0 == strcmp(cp, "fua"))
             fp->fua = true;
+        else if (0 == strcmp(cp, "hugepage"))
+            fp->hugepage = true;
         else if (0 == strcmp(cp, "nocache"))
             ++fp->nocache;
         else if (0 == strcmp(cp, "nocreat"))
             fp->nocreat = true;
         else if (0 == strcmp(cp, "null"))
             ;
+        else if (0 == strcmp(cp, "pi"))
+            fp->pi = true;
         else if (0 == strcmp(cp, "pt"))
             fp->sgio = true;
         else if (0 == strcmp(cp, "random"))
             fp->random = true;
         else if (0 == strcmp(cp, "sgio"))
             fp->sgio = true;
+        else if (0 == strcmp(cp, "simage"))
+            fp->simage = true;
         else if (0 == strcmp(cp, "sparse"))
             fp->sparse = true;
+        else if (0 == strcmp(cp, "tape"))
+            fp->tape = true;
+        else if (0 == strcmp(cp, "unmap"))
+            fp->unmap = true;
         else {
             pr2serr("unrecognised flag: %s\n", cp);
             return 1;
@@ -1596,6 +1797,7 @@ open_if(struct opts_t * op)
     struct flags_t * ifp = &op->iflag;
     char ebuff[EBUFF_SZ];
     struct sg_simple_inquiry_resp sir;
+    struct sg_dde_resbuf rb;
 
     ft = dd_filetype(inf, op);
     if (op->verbose)
@@ -1640,13 +1842,10 @@ open_if(struct opts_t * op)
             pr2serr("    %s: %.8s  %.16s  %.4s  [pdt=%d]\n", inf, sir.vendor,
                     sir.product, sir.revision, ifp->pdt);
         if (! ((FT_BLOCK & ft) || (FT_NVME & ft))) {
-            t = op->blk_sz * op->bpt;
-            res = ioctl(infd, SG_SET_RESERVED_SIZE, &t);
-            if (res < 0) {
-                snprintf(ebuff, sizeof(ebuff), "%sSG_SET_RESERVED_SIZE error",
-                         my_name);
-                perror(ebuff);
-            }
+            /* with dio, bpt is lowered if need be so direct IO is used */
+            sg_dde_resbuf_size(infd, op->blk_sz, &op->bpt,
+                               ifp->dio ? (SG_DDE_RB_DIO | SG_DDE_RB_FIT) : 0,
+                               &rb, my_name, vb);
             res = ioctl(infd, SG_GET_VERSION_NUM, &t);
             if ((res < 0) || (t < 30000)) {
                 if (FT_BLOCK & ifp->file_type)
@@ -1674,7 +1873,7 @@ open_if(struct opts_t * op)
         } else {
             if (vb)
                 pr2serr("        open input, flags=0x%x\n", flags);
-            if (op->skip > 0) {
+            if ((op->skip > 0) && (! ifp->simage)) {
                 off64_t offset = op->skip;
 
                 offset *= op->blk_sz;   /* could exceed 32 bits here! */
@@ -1737,6 +1936,7 @@ open_of(struct opts_t * op)
     struct flags_t * ofp = &op->oflag;
     char ebuff[EBUFF_SZ];
     struct sg_simple_inquiry_resp sir;
+    struct sg_dde_resbuf rb;
 
     ft = dd_filetype(outf, op);
     if (vb)
@@ -1776,13 +1976,10 @@ open_of(struct opts_t * op)
             pr2serr("    %s: %.8s  %.16s  %.4s  [pdt=%d]\n", outf, sir.vendor,
                     sir.product, sir.revision, ofp->pdt);
         if (! ((FT_BLOCK & ft) || (FT_NVME & ft))) {
-            t = op->blk_sz * op->bpt;
-            res = ioctl(outfd, SG_SET_RESERVED_SIZE, &t);
-            if (res < 0) {
-                snprintf(ebuff, sizeof(ebuff), "%sSG_SET_RESERVED_SIZE error",
-                         my_name);
-                perror(ebuff);
-            }
+            /* with dio, bpt is lowered if need be so direct IO is used */
+            sg_dde_resbuf_size(outfd, op->blk_sz, &op->bpt,
+                               ofp->dio ? (SG_DDE_RB_DIO | SG_DDE_RB_FIT) : 0,
+                               &rb, my_name, vb);
             res = ioctl(outfd, SG_GET_VERSION_NUM, &t);
             if ((res < 0) || (t < 30000)) {
                 pr2serr("%ssg driver prior to 3.x.y\n", my_name);
@@ -1817,6 +2014,8 @@ open_of(struct opts_t * op)
             flags |= O_SYNC;
         if (ofp->append)
             flags |= O_APPEND;
+        if (ofp->simage)
+            flags |= O_TRUNC;
         if ((outfd = open(outf, flags, 0666)) < 0) {
             snprintf(ebuff, EBUFF_SZ,
                     "%scould not open %s for writing", my_name, outf);
@@ -1826,7 +2025,7 @@ open_of(struct opts_t * op)
         if (vb)
             pr2serr("        %s output, flags=0x%x\n",
                     (not_found ? "create" : "open"), flags);
-        if (op->seek > 0) {
+        if ((op->seek > 0) && (! ofp->simage)) {
             off64_t offset = op->seek;
 
             offset *= op->blk_sz;       /* could exceed 32 bits here! */
@@ -2003,42 +2202,2346 @@ check_progress(struct opts_t * op)
 #endif
 }
 
-static int
-parse_cmd_line(int argc, char * argv[], struct opts_t * op)
+/* Adds the time since t0_ns (from sg_get_mono_ns()) of the read (when 'id'
+ * is LAT_IN_ID) or write just completed to the interval statistics. */
+static void
+lat_add(int id, uint64_t t0_ns)
 {
-    int k, n, t, res, keylen;
-    int ibs = 0;
-    int obs = 0;
-    char * key;
-    char * buf;
-    struct flags_t * ifp = &op->iflag;
-    struct flags_t * ofp = &op->oflag;
-    char str[STR_SZ];
+    /* opcodes of READ(16) and WRITE(16) whatever the transfer method */
+    sg_pt_lat_record(id, (LAT_IN_ID == id) ? 0x88 : 0x8a, SG_PT_LAT_SCSI,
+                     sg_get_mono_ns() - t0_ns);
+}
 
-    for (k = 1; k < argc; k++) {
-        if (argv[k]) {
-            strncpy(str, argv[k], STR_SZ);
-            str[STR_SZ - 1] = '\0';
-        } else
-            continue;
-        for (key = str, buf = key; *buf && *buf != '=';)
-            buf++;
-        if (*buf)
-            *buf++ = '\0';
-        keylen = strlen(key);
-        if (0 == strncmp(key, "app", 3)) {
-            ifp->append = !! sg_get_num(buf);
-            ofp->append = ifp->append;
-        } else if (0 == strcmp(key, "blk_sgio")) {
+/* Called after each transfer in the copy loop when interval=SECS is given.
+ * The first call sets the reference. Thereafter, when SECS have elapsed
+ * since the previous report (or 'final' is true), outputs the throughput,
+ * IOPS and latency percentiles of reads and writes of that interval. The
+ * report is a line to stderr, or when --json is given a JSON object on one
+ * line to stdout (or stderr if OFILE is stdout). */
+static void
+interval_report(struct opts_t * op, bool final)
+{
+    int j, k, num;
+    int n = 0;
+    int64_t blks;
+    uint64_t now, cnt;
+    double secs, r;
+    sgj_state * jsp = &op->json_st;
+    sgj_opaque_p jop = NULL;
+    sgj_opaque_p jo2p;
+    const struct sg_pt_lat_hist * hp;
+    struct sg_pt_lat_hist lat_arr[LAT_ARR_SZ];
+    char b[256];
+    static const int blen = sizeof(b);
+    static const char * side_s[2] = {"in", "out"};
+    uint64_t cmds;
+    struct sg_cpu_snap cpu_now;
+    struct sg_cpu_cost cc;
+    static int count;
+    static int64_t prev_blks;
+    static uint64_t start_ns, prev_ns, prev_cmds;
+    static struct sg_cpu_snap prev_cpu;
+
+    now = sg_get_mono_ns();
+    if (0 == start_ns) {
+        start_ns = now;
+        prev_ns = now;
+        sg_pt_lat_snapshot(lat_arr, 0, true);
+        sg_cpu_snap(&prev_cpu);
+        prev_cmds = SG_ERR_STATS_LD(err_stats.cmds);
+        return;
+    }
+    if ((! final) && ((now - prev_ns) < (uint64_t)op->interval * 1000000000))
+        return;
+    blks = (in_full > out_full) ? in_full : out_full;
+    if (final && (blks == prev_blks))
+        return;         /* nothing new since last report */
+    secs = (double)(now - prev_ns) / 1000000000.0;
+    if (secs < 0.000001)
+        secs = 0.000001;
+    r = ((double)op->blk_sz * (blks - prev_blks)) / secs;
+    num = sg_pt_lat_snapshot(lat_arr, LAT_ARR_SZ, true);
+    sg_cpu_snap(&cpu_now);
+    cmds = SG_ERR_STATS_LD(err_stats.cmds);
+    sg_cpu_cost(&prev_cpu, &cpu_now, (uint64_t)op->blk_sz *
+                (blks - prev_blks), cmds - prev_cmds, &cc);
+    ++count;
+    if (op->do_json) {
+        jop = sgj_start_r(NULL, NULL, 0, NULL, jsp);
+        sgj_js_nv_i(jsp, jop, "interval", count);
+        sgj_js_nv_i(jsp, jop, "elapsed_ms", (now - start_ns) / 1000000);
+        sgj_js_nv_i(jsp, jop, "interval_ms", (now - prev_ns) / 1000000);
+        sgj_js_nv_i(jsp, jop, "blocks", blks - prev_blks);
+        sgj_js_nv_i(jsp, jop, "bytes_per_second", (int64_t)r);
+    } else
+        n = sg_scnpr(b, blen, "interval %d at %.1f secs: %.2f MB/sec",
+                     count, (double)(now - start_ns) / 1000000000.0,
+                     r / 1000000.0);
+    for (k = 0; k < 2; ++k) {
+        for (hp = NULL, j = 0; j < num; ++j) {
+            if (lat_arr[j].dev_id == (uint64_t)(LAT_IN_ID + k)) {
+                hp = lat_arr + j;
+                break;
+            }
+        }
+        cnt = hp ? hp->count : 0;
+        if (op->do_json) {
+            jo2p = sgj_named_subobject_r(jsp, jop, side_s[k]);
+            sgj_js_nv_i(jsp, jo2p, "count", cnt);
+            sgj_js_nv_i(jsp, jo2p, "iops", (int64_t)(cnt / secs));
+            sgj_js_nv_i(jsp, jo2p, "p50_ns", sg_pt_lat_percentile(hp, 50.0));
+            sgj_js_nv_i(jsp, jo2p, "p99_ns", sg_pt_lat_percentile(hp, 99.0));
+            sgj_js_nv_i(jsp, jo2p, "p99_9_ns",
+                        sg_pt_lat_percentile(hp, 99.9));
+            sgj_js_nv_i(jsp, jo2p, "max_ns", cnt ? hp->max_ns : 0);
+        } else if (cnt > 0)
+            n += sg_scn3pr(b, blen, n, "; %s %.0f IOPS, lat p50/p99/p99.9 "
+                           "%.1f/%.1f/%.1f us", side_s[k], cnt / secs,
+                           sg_pt_lat_percentile(hp, 50.0) / 1000.0,
+                           sg_pt_lat_percentile(hp, 99.0) / 1000.0,
+                           sg_pt_lat_percentile(hp, 99.9) / 1000.0);
+    }
+    if (op->do_json) {
+        FILE * fp = (STDOUT_FILENO == op->outfd) ? stderr : stdout;
+
+        if (cpu_now.valid)
+            sg_cpu_cost_js(jsp, jop, "cpu_cost", &cc);
+        sgj_js2file(jsp, NULL, 0, fp);
+        sgj_finish(jsp);
+        fflush(fp);
+    } else {
+        if (cpu_now.valid) {
+            char c[80];
+
+            sg_scn3pr(b, blen, n, "; %s",
+                      sg_cpu_cost_str(&cc, c, sizeof(c)));
+        }
+        pr2serr("%s\n", b);
+    }
+    prev_ns = now;
+    prev_blks = blks;
+    prev_cpu = cpu_now;
+    prev_cmds = cmds;
+}
+
+/* CPU cost of the copy so far, from the snapshot taken at its start.
+ * Returns false if time=1 was not given or no snapshot is available. */
+static bool
+cpu_cost_so_far(const struct opts_t * op, struct sg_cpu_cost * cp)
+{
+    int64_t blks = (in_full > out_full) ? in_full : out_full;
+    struct sg_cpu_snap now;
+
+    if (! start_cpu.valid)
+        return false;
+    sg_cpu_snap(&now);
+    return sg_cpu_cost(&start_cpu, &now, (uint64_t)op->blk_sz * blks,
+                       SG_ERR_STATS_LD(err_stats.cmds), cp);
+}
+
+/* With --json, outputs the error statistics as an "error_statistics"
+ * object on one line to stdout (or stderr if OFILE is stdout). When time=1
+ * is given, a "cpu_cost" object is added. */
+static void
+err_stats_json(struct opts_t * op)
+{
+    sgj_state * jsp = &op->json_st;
+    sgj_opaque_p jop;
+    struct sg_cpu_cost cc;
+    FILE * fp = (STDOUT_FILENO == op->outfd) ? stderr : stdout;
+
+    jop = sgj_start_r(NULL, NULL, 0, NULL, jsp);
+    sg_err_stats_js(jsp, jop, "error_statistics", &err_stats);
+    if (cpu_cost_so_far(op, &cc))
+        sg_cpu_cost_js(jsp, jop, "cpu_cost", &cc);
+    sgj_js2file(jsp, NULL, 0, fp);
+    sgj_finish(jsp);
+    fflush(fp);
+}
+
+/* Adds n to the ascending candidate list of abp if it is not there yet */
+static void
+auto_bpt_add(struct auto_bpt_t * abp, int n)
+{
+    int k, j;
+
+    for (k = 0; k < abp->num; ++k) {
+        if (n == abp->cands[k])
+            return;
+        if (n < abp->cands[k])
+            break;
+    }
+    if (abp->num >= AUTO_BPT_MAX_CANDS)
+        return;
+    for (j = abp->num; j > k; --j)
+        abp->cands[j] = abp->cands[j - 1];
+    abp->cands[k] = n;
+    ++abp->num;
+}
+
+/* bpt=auto: works out the candidate transfer sizes from the limits of
+ * IFILE and OFILE then sets op->bpt to the largest so buffers are big
+ * enough. If the copy is too short to probe then op->bpt is set to the
+ * optimal transfer length, if known, and abp->num is zeroed. */
+static void
+auto_bpt_setup(struct opts_t * op, struct auto_bpt_t * abp)
+{
+    int k, t, cap, mx, opt, i_opt, o_opt;
+    int bs = op->blk_sz;
+    struct sg_dde_resbuf rb;
+
+    memset(abp, 0, sizeof(*abp));
+    mx = sg_dde_xfer_limits(op->infd, op->iflag.file_type, bs, &i_opt,
+                            op->verbose);
+    t = sg_dde_xfer_limits(op->outfd, op->oflag.file_type, bs, &o_opt,
+                           op->verbose);
+    if ((t > 0) && ((0 == mx) || (t < mx)))
+        mx = t;
+    opt = o_opt ? o_opt : i_opt;        /* the write side matters more */
+    cap = AUTO_BPT_MAX_BYTES / bs;
+    if ((mx > 0) && (mx < cap))
+        cap = mx;
+    if (cap < 1)
+        cap = 1;
+    abp->max_blks = mx;
+    abp->opt_blks = opt;
+    k = AUTO_BPT_MIN_BYTES / bs;
+    for (k = (k > 0) ? k : 1; k < cap; k *= 2)
+        auto_bpt_add(abp, k);
+    auto_bpt_add(abp, cap);
+    if ((opt > 0) && (opt <= cap))
+        auto_bpt_add(abp, opt);
+    if (op->dd_count < (2 * (int64_t)abp->num * AUTO_BPT_PROBE_BYTES / bs)) {
+        /* not worth probing, the copy would be over before settling */
+        if (opt > 0)
+            op->bpt = (opt < cap) ? opt : cap;
+        else
+            op->bpt = (op->bpt < cap) ? op->bpt : cap;
+        abp->num = 0;
+        pr2serr("bpt=auto: copy too short to probe, using bpt=%d\n",
+                op->bpt);
+    } else
+        op->bpt = abp->cands[abp->num - 1];
+    if (FT_SG & op->iflag.file_type)
+        sg_dde_resbuf_size(op->infd, bs, &op->bpt,
+                           op->iflag.dio ? SG_DDE_RB_DIO : 0, &rb,
+                           "bpt=auto: ", op->verbose);
+    if (FT_SG & op->oflag.file_type)
+        sg_dde_resbuf_size(op->outfd, bs, &op->bpt,
+                           op->oflag.dio ? SG_DDE_RB_DIO : 0, &rb,
+                           "bpt=auto: ", op->verbose);
+}
+
+/* Called after each transfer while probing; blocks were copied in ns
+ * nanoseconds with a transfer size of blocks_per. Returns the transfer
+ * size to use next. When all candidates have been probed, picks the one
+ * with the best throughput, or a smaller one within 5% of it. */
+static int
+auto_bpt_next(struct opts_t * op, struct auto_bpt_t * abp, int blocks_per,
+              int blocks, uint64_t ns)
+{
+    int k, best;
+    double mbs, best_mbs, r[AUTO_BPT_MAX_CANDS];
+
+    if (blocks_per != abp->cands[abp->cur]) {
+        abp->num = 0;   /* reduced by ENOMEM handling, stop probing */
+        return blocks_per;
+    }
+    abp->blks[abp->cur] += blocks;
+    abp->ns[abp->cur] += ns;
+    if (((abp->blks[abp->cur] * op->blk_sz) < AUTO_BPT_PROBE_BYTES) ||
+        (abp->blks[abp->cur] < (4 * (int64_t)blocks_per)))
+        return blocks_per;
+    if (++abp->cur < abp->num)
+        return abp->cands[abp->cur];
+    for (k = 0, best = 0, best_mbs = 0.0; k < abp->num; ++k) {
+        r[k] = abp->ns[k] ? ((double)abp->blks[k] * op->blk_sz * 1000.0 /
+                             (double)abp->ns[k]) : 0.0;
+        if (r[k] > best_mbs) {
+            best_mbs = r[k];
+            best = k;
+        }
+        if (op->verbose)
+            pr2serr("bpt=auto: bpt=%d: %.2f MB/sec\n", abp->cands[k], r[k]);
+    }
+    for (k = 0; k < best; ++k) {
+        if (r[k] >= (0.95 * best_mbs))
+            break;
+    }
+    best = k;
+    mbs = r[best];
+    abp->num = 0;
+    pr2serr("bpt=auto: chose bpt=%d (%d KiB), %.2f MB/sec; device limits: "
+            "max=%d opt=%d blocks\n", abp->cands[best],
+            (int)(((int64_t)abp->cands[best] * op->blk_sz) / 1024), mbs,
+            abp->max_blks, abp->opt_blks);
+    return abp->cands[best];
+}
+
+/* oflag=unmap: decides between UNMAP and WRITE SAME(16) from what OFILE
+ * reports in READ CAPACITY(16) and its Logical Block Provisioning and Block
+ * Limits VPD pages. Leaves op->um.mode as UNMAP_OFF (so transfers are
+ * written as usual) if OFILE is not a thin provisioned SCSI device. */
+static void
+unmap_setup(struct opts_t * op)
+{
+    bool lbprz, lbpu, lbpws;
+    int fd = op->outfd;
+    int vb = (op->verbose > 1) ? op->verbose - 1 : 0;
+    uint32_t max_ul = 0;
+    uint32_t max_ud = 0;
+    uint64_t max_ws = 0;
+    struct unmap_stage * ump = &op->um;
+    const char * cp = NULL;
+    struct sg_geom g;
+
+    ump->first_lba = -1;
+    if ((! (FT_SG & op->oflag.file_type)) || (FT_NVME & op->oflag.file_type))
+        cp = "OFILE is not a SCSI device";
+    else if (sg_geom_get(fd, SG_GEOM_BL | SG_GEOM_LBP, &g, true, vb))
+        cp = "READ CAPACITY failed";
+    else if (! g.lbpme)
+        cp = "OFILE is not thin provisioned (LBPME=0)";
+    if (cp) {
+        pr2serr("oflag=unmap ignored, %s\n", cp);
+        return;
+    }
+    lbprz = g.lbprz;
+    if (g.have_lbp) {
+        lbpu = g.lbpu;
+        lbpws = g.lbpws;
+    } else {    /* LBPME set, so guess */
+        lbpu = lbprz;
+        lbpws = true;
+    }
+    if (g.have_bl) {
+        max_ul = g.max_unmap_lba_cnt;
+        max_ud = g.max_unmap_desc_cnt;
+        max_ws = g.max_ws_len;
+        if ((0 == max_ul) || (0 == max_ud))
+            lbpu = false;
+    } else
+        max_ul = max_ud = 0xffffffff;
+    if (lbpu && lbprz) {
+        ump->mode = UNMAP_CMD;
+        ump->max_lbas = max_ul;
+        ump->max_descs = (max_ud < UNMAP_MAX_DESCS) ? (int)max_ud :
+                                                      UNMAP_MAX_DESCS;
+    } else if (lbpws) {
+        /* data-out block of zeros is written if device can't unmap */
+        ump->mode = UNMAP_WS16;
+        ump->max_lbas = (max_ws > 0) ? (int64_t)max_ws : UNMAP_DEF_MAX_LBAS;
+    } else {
+        pr2serr("oflag=unmap ignored, OFILE supports neither UNMAP (with "
+                "LBPRZ) nor\nWRITE SAME(16) with UNMAP\n");
+        return;
+    }
+    if ((ump->max_lbas <= 0) || (ump->max_lbas > UNMAP_DEF_MAX_LBAS))
+        ump->max_lbas = UNMAP_DEF_MAX_LBAS;
+    ump->param = (uint8_t *)calloc(8 + (16 * UNMAP_MAX_DESCS), 1);
+    ump->zbuf = (uint8_t *)calloc(op->bpt, op->blk_sz);
+    if ((NULL == ump->param) || (NULL == ump->zbuf)) {
+        pr2serr("oflag=unmap ignored, out of memory\n");
+        ump->mode = UNMAP_OFF;
+        return;
+    }
+    if (op->verbose)
+        pr2serr("oflag=unmap: using %s, up to %" PRId64 " blocks per "
+                "command\n", (UNMAP_CMD == ump->mode) ? "UNMAP" :
+                "WRITE SAME(16) with UNMAP bit", ump->max_lbas);
+}
+
+/* Writes zeros to num blocks of OFILE starting at lba, in op->bpt sized
+ * pieces. Used when UNMAP or WRITE SAME fails. Returns 0 on success. */
+static int
+unmap_zero_fill(struct opts_t * op, int64_t lba, int64_t num)
+{
+    int n, res;
+
+    for ( ; num > 0; lba += n, num -= n) {
+        n = (num < op->bpt) ? (int)num : op->bpt;
+        res = sg_write(op->outfd, op->um.zbuf, n, lba, NULL, op);
+        if ((0 != res) && (SG_DD_BYPASS != res))
+            return res;
+    }
+    return 0;
+}
+
+/* Issues WRITE SAME(16) with the UNMAP bit set (and NDOB clear, so the
+ * data-out is a block of zeros) over num blocks starting at lba. The cdb
+ * is built as sg_write_same does. Returns 0 on success. */
+static int
+unmap_ws16(struct opts_t * op, int64_t lba, int64_t num)
+{
+    int res;
+    uint8_t ws_cdb[16];
+    uint8_t sense_b[SENSE_BUFF_LEN] SG_C_CPP_ZERO_INIT;
+    struct sg_io_hdr io_hdr;
+
+    memset(ws_cdb, 0, sizeof(ws_cdb));
+    ws_cdb[0] = 0x93;   /* WRITE SAME(16) */
+    ws_cdb[1] = 0x8;    /* UNMAP bit */
+    sg_put_unaligned_be64((uint64_t)lba, ws_cdb + 2);
+    sg_put_unaligned_be32((uint32_t)num, ws_cdb + 10);
+    memset(&io_hdr, 0, sizeof(struct sg_io_hdr));
+    io_hdr.interface_id = 'S';
+    io_hdr.cmd_len = sizeof(ws_cdb);
+    io_hdr.cmdp = ws_cdb;
+    io_hdr.dxfer_direction = SG_DXFER_TO_DEV;
+    io_hdr.dxfer_len = op->blk_sz;
+    io_hdr.dxferp = op->um.zbuf;
+    io_hdr.mx_sb_len = SENSE_BUFF_LEN;
+    io_hdr.sbp = sense_b;
+    io_hdr.timeout = op->cmd_timeout;
+    io_hdr.pack_id = (int)++glob_pack_id;
+    if (op->verbose > 2)
+        sg_print_command_len(ws_cdb, sizeof(ws_cdb));
+    while (((res = ioctl(op->outfd, SG_IO, &io_hdr)) < 0) &&
+           ((EINTR == errno) || (EAGAIN == errno) || (EBUSY == errno)))
+        sg_err_stats_errno(&err_stats, errno);
+    if (res < 0) {
+        sg_err_stats_errno(&err_stats, errno);
+        sg_err_stats_cat(&err_stats, sg_convert_errno(errno));
+        perror("write same(16) (SG_IO) on sg device, error");
+        return -1;
+    }
+    res = sg_err_category3(&io_hdr);
+    sg_err_stats_cat(&err_stats, res);
+    if ((SG_LIB_CAT_CLEAN == res) || (SG_LIB_CAT_RECOVERED == res))
+        return 0;
+    sg_chk_n_print3("write same(16)", &io_hdr, op->verbose > 1);
+    return res;
+}
+
+/* Sends what is pending: the run being coalesced and, for UNMAP_CMD, the
+ * block descriptors already in the parameter list. If the device rejects
+ * that, those blocks are written with zeros and oflag=unmap is turned off
+ * for the rest of the copy. Returns 0 on success. */
+static int
+unmap_flush(struct opts_t * op, bool run_only)
+{
+    int k, n, res;
+    int to_secs = op->cmd_timeout / 1000;
+    struct unmap_stage * ump = &op->um;
+    uint8_t * bp;
+
+    res = 0;
+    if (ump->run_num > 0) {
+        if (UNMAP_WS16 == ump->mode) {
+            res = unmap_ws16(op, ump->run_lba, ump->run_num);
+            if (res) {
+                pr2serr("WRITE SAME(16) failed, writing zeros instead for "
+                        "the rest of the copy\n");
+                ump->mode = UNMAP_OFF;
+                res = unmap_zero_fill(op, ump->run_lba, ump->run_num);
+            }
+            ump->list_lbas = 0;
+        } else {
+            bp = ump->param + 8 + (16 * ump->num_descs++);
+            sg_put_unaligned_be64((uint64_t)ump->run_lba, bp + 0);
+            sg_put_unaligned_be32((uint32_t)ump->run_num, bp + 8);
+        }
+        ump->run_num = 0;
+    }
+    if ((UNMAP_CMD == ump->mode) && (ump->num_descs > 0) &&
+        ((! run_only) || (ump->num_descs >= ump->max_descs))) {
+        n = 16 * ump->num_descs;
+        sg_put_unaligned_be16(n + 6, ump->param + 0);
+        sg_put_unaligned_be16(n, ump->param + 2);
+        res = sg_ll_unmap_v2(op->outfd, false, 0, (to_secs > 0) ? to_secs :
+                             DEF_TIMEOUT / 1000, ump->param, n + 8, true,
+                             (op->verbose > 1) ? op->verbose - 1 : 0);
+        if (res) {
+            pr2serr("UNMAP failed, writing zeros instead for the rest of "
+                    "the copy\n");
+            ump->mode = UNMAP_OFF;
+            for (k = 0, bp = ump->param + 8; k < ump->num_descs;
+                 ++k, bp += 16) {
+                res = unmap_zero_fill(op, sg_get_unaligned_be64(bp),
+                                      sg_get_unaligned_be32(bp + 8));
+                if (res)
+                    break;
+            }
+        }
+        ump->num_descs = 0;
+        ump->list_lbas = 0;
+    }
+    if ((0 == res) && (0 == ump->list_lbas))
+        ump->first_lba = -1;
+    return res;
+}
+
+/* Called with a transfer of num blocks, all zeros, that would be written
+ * at OFILE lba. Sets *takenp if it was added to the pending unmap runs, if
+ * not the caller should write it. Returns 0 on success. */
+static int
+unmap_add(struct opts_t * op, int64_t lba, int num, bool * takenp)
+{
+    int res;
+    struct unmap_stage * ump = &op->um;
+
+    *takenp = false;
+    if (num > ump->max_lbas)
+        return 0;
+    if ((ump->run_num > 0) && (lba == (ump->run_lba + ump->run_num)) &&
+        ((ump->list_lbas + num) <= ump->max_lbas)) {
+        ump->run_num += num;    /* coalesce */
+        ump->list_lbas += num;
+        *takenp = true;
+        return 0;
+    }
+    res = unmap_flush(op, (ump->list_lbas + num) <= ump->max_lbas);
+    if (res || (UNMAP_OFF == ump->mode))
+        return res;
+    if (ump->first_lba < 0)
+        ump->first_lba = lba;
+    ump->run_lba = lba;
+    ump->run_num = num;
+    ump->list_lbas += num;
+    *takenp = true;
+    return 0;
+}
+
+/* Opens the hash=ALG,MANIFEST file (if given) and starts the digest of the
+ * whole input stream. Returns false if MANIFEST could not be created. */
+static bool
+hash_open(struct opts_t * op)
+{
+    sg_hash_init(&op->hash_ctx, op->hash_alg);
+    if (op->verbose)
+        pr2serr("hash=%s%s\n", sg_hash_alg_name(op->hash_alg),
+                ((SG_HASH_CRC32C == op->hash_alg) && sg_hash_crc32c_hw()) ?
+                " using CPU crc32 instruction" : "");
+    if ('\0' == op->hash_mf_fname[0])
+        return true;
+    op->hash_mfp = fopen(op->hash_mf_fname, "w");
+    if (NULL == op->hash_mfp) {
+        pr2serr("%sunable to create hash manifest %s: %s\n", my_name,
+                op->hash_mf_fname, safe_strerror(errno));
+        return false;
+    }
+    fprintf(op->hash_mfp, "# sg3_utils hash manifest: alg=%s bs=%d if=%s\n"
+            "# lba blocks digest\n", sg_hash_alg_name(op->hash_alg),
+            op->blk_sz, op->in_fname);
+    return true;
+}
+
+/* Called for each transfer of 'blocks' starting at input 'lba' with the
+ * 'len' bytes that were read, while they are still in the buffer. */
+static void
+hash_range(struct opts_t * op, int64_t lba, int blocks, const uint8_t * bp,
+           int len)
+{
+    int n;
+    struct sg_hash_ctx hc;
+    uint8_t d[SG_HASH_MAX_DIGEST_LEN];
+    char b[(2 * SG_HASH_MAX_DIGEST_LEN) + 1];
+
+    sg_hash_update(&op->hash_ctx, bp, len);
+    if (NULL == op->hash_mfp)
+        return;
+    sg_hash_init(&hc, op->hash_alg);
+    sg_hash_update(&hc, bp, len);
+    n = sg_hash_final(&hc, d);
+    sg_hash_hex(d, n, b, sizeof(b));
+    fprintf(op->hash_mfp, "%" PRId64 " %d %s\n", lba, blocks, b);
+}
+
+/* Finishes the digest of the whole input stream and prints it, also as the
+ * last line of MANIFEST. */
+static void
+hash_close(struct opts_t * op)
+{
+    int n;
+    uint8_t d[SG_HASH_MAX_DIGEST_LEN];
+    char b[(2 * SG_HASH_MAX_DIGEST_LEN) + 1];
+
+    n = sg_hash_final(&op->hash_ctx, d);
+    sg_hash_hex(d, n, b, sizeof(b));
+    pr2serr("%s (%s) = %s\n", sg_hash_alg_name(op->hash_alg), op->in_fname,
+            b);
+    if (op->hash_mfp) {
+        fprintf(op->hash_mfp, "# total bytes=%" PRIu64 " %s\n",
+                op->hash_ctx.total, b);
+        if (fclose(op->hash_mfp))
+            pr2serr("%sproblem closing hash manifest %s: %s\n", my_name,
+                    op->hash_mf_fname, safe_strerror(errno));
+        op->hash_mfp = NULL;
+    }
+}
+
+/* Writes the checkpoint journal to CFILE.tmp, syncs it, then renames it to
+ * CFILE so a crash leaves either the old or the new record. Unless 'final'
+ * is true does nothing if less than SECS have passed since the last call.
+ * Returns false if the journal could not be written. */
+static bool
+ckpt_write(struct opts_t * op, bool final)
+{
+    static uint64_t prev_ns;
+    bool ok;
+    int fd, n;
+    int64_t done = op->skip - op->ckpt_skip;
+    uint64_t now = sg_get_mono_ns();
+    char b[256];
+    char tmp_fn[INOUTF_SZ + 8];
+
+    if ((! final) && (prev_ns > 0) &&
+        ((0 == op->ckpt_secs) ||
+         ((now - prev_ns) < (uint64_t)op->ckpt_secs * 1000000000)))
+        return true;
+    prev_ns = now;
+    /* blocks from a pending oflag=unmap run onwards are not done yet */
+    if ((op->um.first_lba >= 0) && ((op->um.first_lba - op->ckpt_seek) < done))
+        done = op->um.first_lba - op->ckpt_seek;
+    n = sg_scnpr(b, sizeof(b), CKPT_PR_FMT, op->blk_sz, op->ckpt_skip,
+                 op->ckpt_seek, op->ckpt_count, done);
+    snprintf(tmp_fn, sizeof(tmp_fn), "%s.tmp", op->ckpt_fname);
+    fd = open(tmp_fn, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror("ckpt_write: open");
+        return false;
+    }
+    ok = (write(fd, b, n) == n) && (0 == fsync(fd));
+    close(fd);
+    if (ok)
+        ok = (0 == rename(tmp_fn, op->ckpt_fname));
+    if (! ok)
+        pr2serr("%sunable to write checkpoint to %s\n", my_name,
+                op->ckpt_fname);
+    if ((op->verbose > 2) && ok)
+        pr2serr("checkpoint: %s", b);
+    return ok;
+}
+
+/* For --resume, reads the journal named by ckpt=CFILE and moves skip, seek
+ * and count on past the blocks that it says have already been copied. Any
+ * of those values given on the command line must agree with the journal.
+ * Returns 0 on success, else an exit status. */
+static int
+ckpt_resume(struct opts_t * op)
+{
+    int n, bs;
+    int64_t skip, seek, count, done;
+    FILE * fp;
+
+    fp = fopen(op->ckpt_fname, "r");
+    if (NULL == fp) {
+        pr2serr("%sunable to open checkpoint %s: %s\n", my_name,
+                op->ckpt_fname, safe_strerror(errno));
+        return SG_LIB_FILE_ERROR;
+    }
+    n = fscanf(fp, CKPT_SC_FMT, &bs, &skip, &seek, &count, &done);
+    fclose(fp);
+    if ((5 != n) || (skip < 0) || (seek < 0) || (count < 0) ||
+        (done < 0) || (done > count)) {
+        pr2serr("%s%s is not a valid checkpoint\n", my_name,
+                op->ckpt_fname);
+        return SG_LIB_FILE_ERROR;
+    }
+    if ((bs != op->blk_sz) || (op->skip && (op->skip != skip)) ||
+        (op->seek && (op->seek != seek)) ||
+        ((op->dd_count >= 0) && (op->dd_count != count))) {
+        pr2serr("%scheckpoint was for bs=%d skip=%" PRId64 " seek=%" PRId64
+                " count=%" PRId64 ", conflicts with command line\n",
+                my_name, bs, skip, seek, count);
+        return SG_LIB_CONTRADICT;
+    }
+    op->ckpt_skip = skip;
+    op->ckpt_seek = seek;
+    op->ckpt_count = count;
+    op->skip = skip + done;
+    op->seek = seek + done;
+    op->dd_count = count - done;
+    pr2serr("Resuming from checkpoint: %" PRId64 " of %" PRId64 " blocks "
+            "already copied\n", done, count);
+    return 0;
+}
+
+/* iflag=extents: builds skip= and seek= lists holding only the extents of
+ * IFILE that GET LBA STATUS reports as mapped, so deallocated ranges are
+ * not read. When IFILE doesn't support that command the whole range is
+ * copied. Returns 0 or an error that should stop the copy. */
+static int
+extents_setup(struct opts_t * op)
+{
+    int k, res;
+    int64_t orig_count = op->dd_count;
+    const struct sg_sgl_elem * ep;
+
+    if (! (FT_SG & op->iflag.file_type)) {
+        pr2serr("iflag=extents needs IFILE to be a SCSI device, ignored\n");
+        return 0;
+    }
+    res = sg_sgl_from_lba_status(&op->i_sgl, op->infd, op->skip,
+                                 op->dd_count, op->verbose);
+    if (res) {
+        char b[80];
+
+        sg_get_category_sense_str(res, sizeof(b), b, op->verbose);
+        pr2serr("iflag=extents: GET LBA STATUS: %s, copying whole range\n",
+                b);
+        sg_sgl_free(&op->i_sgl);
+        return 0;
+    }
+    for (k = 0; k < op->i_sgl.num_elems; ++k) {
+        ep = op->i_sgl.elems + k;
+        if (! sg_sgl_append(&op->o_sgl, ep->lba - op->skip + op->seek,
+                            ep->num))
+            return sg_convert_errno(ENOMEM);
+    }
+    if (! sg_sgl_sum_scan(&op->o_sgl))
+        return sg_convert_errno(ENOMEM);
+    op->ext_end = op->seek + orig_count;
+    op->dd_count = op->i_sgl.sum;
+    pr2serr("iflag=extents: %d mapped extent%s, copying %" PRId64 " of %"
+            PRId64 " blocks\n", op->i_sgl.num_elems,
+            (1 == op->i_sgl.num_elems) ? "" : "s", op->dd_count, orig_count);
+    if (op->verbose > 1)
+        sg_sgl_print(&op->i_sgl, "extents", (op->verbose > 2), stderr);
+    return 0;
+}
+
+/* The blocks of OFILE from lba up to end correspond to unmapped blocks of
+ * IFILE. With oflag=unmap they are unmapped, otherwise left as they are
+ * (as oflag=sparse does); a regular file is extended at the end. */
+static int
+extents_hole(struct opts_t * op, int64_t lba, int64_t end)
+{
+    int n, res;
+    bool taken;
+
+    if (op->verbose > 2)
+        pr2serr("iflag=extents: bypassing seek blk=%" PRId64 ", blks=%"
+                PRId64 "\n", lba, end - lba);
+    while (op->um.mode && (lba < end)) {
+        n = ((end - lba) > op->um.max_lbas) ? op->um.max_lbas :
+                                              (int)(end - lba);
+        res = unmap_add(op, lba, n, &taken);
+        if (res)
+            return res;
+        if (! taken)
+            break;      /* unmap turned itself off */
+        lba += n;
+    }
+    return 0;
+}
+
+/* Maps the next segment of a skip= and/or seek= scatter gather list onto
+ * op->skip and op->seek, trimming *blocksp so it does not cross the end of
+ * an element. When the new LBA is not where the last transfer finished and
+ * the file is accessed with read() or write(), lseek64() to it. Returns 0
+ * or SG_LIB_FILE_ERROR (or an oflag=unmap error). */
+static int
+sgl_next(struct opts_t * op, int * blocksp)
+{
+    int k, rem, fd, ft, res;
+    int64_t lba, * posp;
+    off64_t offset;
+    const struct sg_sgl * sglp;
+
+    for (k = 0; k < 2; ++k) {
+        sglp = k ? &op->o_sgl : &op->i_sgl;
+        if (0 == sglp->num_elems)
+            continue;
+        lba = sg_sgl_idx_to_lba(sglp, op->sgl_idx, &rem);
+        if (lba < 0)
+            return SG_LIB_FILE_ERROR;   /* count checked, so can't happen */
+        if (*blocksp > rem)
+            *blocksp = rem;
+        posp = k ? &op->seek : &op->skip;
+        fd = k ? op->outfd : op->infd;
+        ft = k ? op->oflag.file_type : op->iflag.file_type;
+        if (k && (op->ext_end > 0) && (lba > *posp)) {
+            res = extents_hole(op, *posp, lba);
+            if (res)
+                return res;
+        }
+        if ((lba == *posp) || (k ? &op->oflag : &op->iflag)->simage ||
+            ((FT_SG | FT_DEV_NULL | FT_RANDOM_0_FF) & ft)) {
+            *posp = lba;
+            continue;
+        }
+        offset = (off64_t)lba * op->blk_sz;
+        if (lseek64(fd, offset, SEEK_SET) < 0) {
+            pr2serr("%s list: lseek64 to byte offset=0x%" PRIx64 " failed: "
+                    "%s\n", (k ? "seek" : "skip"), (uint64_t)offset,
+                    safe_strerror(errno));
+            return SG_LIB_FILE_ERROR;
+        }
+        if (op->verbose > 2)
+            pr2serr("  >> %s list: lseek64 SEEK_SET, byte offset=0x%" PRIx64
+                    "\n", (k ? "seek" : "skip"), (uint64_t)offset);
+        *posp = lba;
+    }
+    return 0;
+}
+
+/* oflag=simage: writes len bytes at bp to OFILE at the image's next data
+ * offset. Returns 0 or a SG_LIB_* error. */
+static int
+simg_xwrite(struct opts_t * op, const uint8_t * bp, int len)
+{
+    int res;
+    struct simg_stage * sip = &op->simg;
+
+    while (len > 0) {
+        if (sip->seq)
+            res = write(op->outfd, bp, len);
+        else
+            res = pwrite(op->outfd, bp, len, (off_t)sip->pos);
+        if (res < 0) {
+            if ((EINTR == errno) || (EAGAIN == errno) || (EBUSY == errno))
+                continue;
+            sg_err_stats_errno(&err_stats, errno);
+            pr2serr("%swriting sparse image, seek=%" PRId64 ": %s\n",
+                    my_name, op->seek, safe_strerror(errno));
+            return sg_convert_errno(errno);
+        } else if (0 == res) {
+            pr2serr("%ssparse image not taking data, seek=%" PRId64 "\n",
+                    my_name, op->seek);
+            return SG_LIB_FILE_ERROR;
+        }
+        bp += res;
+        len -= res;
+        sip->pos += res;
+    }
+    return 0;
+}
+
+/* Places the CRC32C of the extent being built, if any, in its entry */
+static void
+simg_crc_done(struct simg_stage * sip)
+{
+    uint8_t d[SG_HASH_MAX_DIGEST_LEN];
+
+    if (sip->crc_idx < 0)
+        return;
+    sg_hash_final(&sip->hc, d);
+    sip->ents[sip->crc_idx].crc = sg_get_unaligned_be32(d);
+    sip->crc_idx = -1;
+}
+
+/* oflag=simage: called once OFILE is open and bpt is settled. Writes the
+ * header of the image. Returns 0 or a SG_LIB_* error. */
+static int
+simg_open(struct opts_t * op)
+{
+    struct stat st;
+    struct simg_stage * sip = &op->simg;
+    uint8_t b[SG_CIMG_HDR_LEN];
+
+    sip->seq = ! ((0 == fstat(op->outfd, &st)) && S_ISREG(st.st_mode));
+    sip->hdr.alg = SG_CIMG_RAW;
+    sip->hdr.bs = op->blk_sz;
+    sip->hdr.chunk_blks = SIMG_MAX_EXT_BYTES / op->blk_sz;
+    if (sip->hdr.chunk_blks < op->bpt)
+        sip->hdr.chunk_blks = op->bpt;
+    sip->crc_idx = -1;
+    sg_cimg_hdr_enc(&sip->hdr, b);
+    return simg_xwrite(op, b, SG_CIMG_HDR_LEN);
+}
+
+/* oflag=simage: adds the 'blocks' at bp, bound for block SEEK of the
+ * image. If they are all zeros they become a hole, otherwise they are
+ * appended to the last extent when it ends at SEEK (and has room) or start
+ * a new one. Only 'valid' bytes were read when that is less than the
+ * blocks, the rest are zeroed. Returns 0 or a SG_LIB_* error. */
+static int
+simg_write(struct opts_t * op, uint8_t * bp, int blocks, int valid)
+{
+    int res;
+    int len = blocks * op->blk_sz;
+    int64_t n;
+    struct simg_stage * sip = &op->simg;
+    struct sg_cimg_ent * ep = NULL;
+    struct sg_cimg_ent * nep;
+
+    if ((valid > 0) && (valid < len))
+        memset(bp + valid, 0, len - valid);
+    if (sg_all_zeros(bp, len)) {
+        out_sparse_num += blocks;
+        if (op->verbose > 2)
+            pr2serr("oflag=simage: hole at seek blk=%" PRId64 ", blks=%d\n",
+                    op->seek, blocks);
+        return 0;
+    }
+    if (sip->num_ents > 0)
+        ep = sip->ents + sip->num_ents - 1;
+    if ((NULL == ep) || (ep->blk + ep->num_blks != (uint64_t)op->seek) ||
+        (ep->num_blks + blocks > (uint32_t)sip->hdr.chunk_blks)) {
+        simg_crc_done(sip);
+        if (sip->num_ents >= sip->max_ents) {
+            n = sip->max_ents ? (2 * sip->max_ents) : 256;
+            nep = (struct sg_cimg_ent *)realloc(sip->ents, n * sizeof(*nep));
+            if (NULL == nep)
+                return sg_convert_errno(ENOMEM);
+            sip->ents = nep;
+            sip->max_ents = n;
+        }
+        ep = sip->ents + sip->num_ents;
+        memset(ep, 0, sizeof(*ep));
+        ep->blk = op->seek;
+        ep->pos = sip->pos;
+        ep->flags = SG_CIMG_F_RAW;
+        sip->crc_idx = sip->num_ents++;
+        sg_hash_init(&sip->hc, SG_HASH_CRC32C);
+    }
+    res = simg_xwrite(op, bp, len);
+    if (res)
+        return res;
+    sg_hash_update(&sip->hc, bp, len);
+    ep->num_blks += blocks;
+    ep->clen += len;
+    out_full += blocks;
+    return 0;
+}
+
+/* oflag=simage: called when the copy stops, also after an error so what
+ * was copied can still be restored. Writes the index for an image of
+ * tot_blks blocks, trims OFILE after it and reports how much of the image
+ * holds data. Returns 0 or a SG_LIB_* error. */
+static int
+simg_close(struct opts_t * op, int64_t tot_blks)
+{
+    int res;
+    int64_t k, m, data;
+    uint64_t end;
+    struct simg_stage * sip = &op->simg;
+
+    simg_crc_done(sip);
+    for (k = 0, m = 0, data = 0; k < sip->num_ents; ++k) {
+        if (sip->ents[k].num_blks > 0) {
+            ++m;
+            data += sip->ents[k].num_blks;
+        }
+    }
+    res = sg_cimg_write_index(op->outfd, sip->seq, sip->pos, sip->ents,
+                              sip->num_ents, (uint64_t)tot_blks);
+    end = sip->pos + (m * SG_CIMG_ENT_LEN) + SG_CIMG_TRL_LEN;
+    if (res)
+        pr2serr("%sunable to write index of %s\n", my_name, op->out_fname);
+    else if ((! sip->seq) && (ftruncate(op->outfd, (off64_t)end) < 0))
+        pr2serr("%sunable to trim %s after its index: %s\n", my_name,
+                op->out_fname, safe_strerror(errno));
+    pr2serr("sparse image: %" PRId64 " extent%s, %" PRId64 " of %" PRId64
+            " blocks hold data, %" PRIu64 " bytes\n", m, (1 == m) ? "" : "s",
+            data, (tot_blks > data) ? tot_blks : data, end);
+    return res;
+}
+
+/* iflag=simage: reads the header and index of IFILE. The block size (if
+ * bs= is not given) comes from the image and COUNT defaults to the blocks
+ * from SKIP to its end. Returns 0 or a SG_LIB_* error. */
+static int
+simg_load(struct opts_t * op)
+{
+    int res;
+    int64_t rem;
+    struct stat st;
+    struct simg_stage * sip = &op->simg;
+    struct sg_cimg_hdr * hp = &sip->hdr;
+
+    if ((fstat(op->infd, &st) < 0) || (! S_ISREG(st.st_mode))) {
+        pr2serr("%siflag=simage needs IFILE to be a regular file\n",
+                my_name);
+        return SG_LIB_FILE_ERROR;
+    }
+    res = sg_cimg_load(op->infd, hp, &sip->ents, &sip->num_ents,
+                       &sip->tot_blks, op->verbose);
+    if (res) {
+        pr2serr("%s%s is not a usable sparse image%s\n", my_name,
+                op->in_fname, op->verbose ? "" : ", try with -v");
+        return res;
+    }
+    if (SG_CIMG_RAW != hp->alg) {
+        pr2serr("%s%s is compressed with %s, read it with sgp_dd "
+                "iflag=cimage\n", my_name, op->in_fname,
+                sg_cimg_alg_name(hp->alg));
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if (op->blk_sz <= 0)
+        op->blk_sz = hp->bs;
+    else if (op->blk_sz != hp->bs) {
+        pr2serr("%sbs=%d but %s was made with bs=%d\n", my_name, op->blk_sz,
+                op->in_fname, hp->bs);
+        return SG_LIB_CONTRADICT;
+    }
+    sip->crc_idx = -1;
+    if (op->skip > sip->tot_blks) {
+        pr2serr("%sskip=%" PRId64 " is past the end of %s (%" PRId64
+                " blocks)\n", my_name, op->skip, op->in_fname,
+                sip->tot_blks);
+        return SG_LIB_CONTRADICT;
+    }
+    rem = sip->tot_blks - op->skip;
+    if (op->dd_count < 0)
+        op->dd_count = rem;
+    else if (op->dd_count > rem) {
+        pr2serr("count reduced to %" PRId64 ", the blocks left in %s\n",
+                rem, op->in_fname);
+        op->dd_count = rem;
+    }
+    return 0;
+}
+
+/* iflag=simage: when OFILE can be positioned, builds skip= and seek= lists
+ * from the extents of the image between SKIP and SKIP + COUNT, as
+ * iflag=extents does from GET LBA STATUS, so only they are copied and the
+ * holes are left as they are or, with oflag=unmap, unmapped. Otherwise
+ * (e.g. OFILE is a pipe) every block is copied, holes as zeros. Returns 0
+ * or an error that should stop the copy. */
+static int
+simg_extents(struct opts_t * op)
+{
+    int ft = op->oflag.file_type;
+    int64_t k, lba, end;
+    int64_t orig_count = op->dd_count;
+    int64_t stop = op->skip + op->dd_count;
+    struct stat st;
+    const struct sg_cimg_ent * ep;
+    struct simg_stage * sip = &op->simg;
+
+    if (! (((FT_SG | FT_BLOCK | FT_DEV_NULL) & ft) ||
+           ((op->outfd >= 0) && (0 == fstat(op->outfd, &st)) &&
+            S_ISREG(st.st_mode))))
+        return 0;
+    ep = sg_cimg_find(sip->ents, sip->num_ents, (uint64_t)op->skip);
+    for (k = ep ? (ep - sip->ents) : sip->num_ents; k < sip->num_ents;
+         ++k) {
+        ep = sip->ents + k;
+        if ((int64_t)ep->blk >= stop)
+            break;
+        lba = ((int64_t)ep->blk > op->skip) ? (int64_t)ep->blk : op->skip;
+        end = ep->blk + ep->num_blks;
+        if (end > stop)
+            end = stop;
+        if ((! sg_sgl_append(&op->i_sgl, lba, end - lba)) ||
+            (! sg_sgl_append(&op->o_sgl, lba - op->skip + op->seek,
+                             end - lba)))
+            return sg_convert_errno(ENOMEM);
+    }
+    if ((! sg_sgl_sum_scan(&op->i_sgl)) || (! sg_sgl_sum_scan(&op->o_sgl)))
+        return sg_convert_errno(ENOMEM);
+    op->ext_end = op->seek + orig_count;
+    op->dd_count = op->i_sgl.sum;
+    if (op->verbose)
+        pr2serr("iflag=simage: %d extent%s, copying %" PRId64 " of %"
+                PRId64 " blocks\n", op->i_sgl.num_elems,
+                (1 == op->i_sgl.num_elems) ? "" : "s", op->dd_count,
+                orig_count);
+    if (op->verbose > 1)
+        sg_sgl_print(&op->i_sgl, "simage", (op->verbose > 2), stderr);
+    return 0;
+}
+
+/* iflag=simage: fills bp with 'blocks' of the image from block SKIP. Each
+ * extent is found with a binary search of the index and holes read as
+ * zeros. The CRC32C of an extent is checked when it has been read in order
+ * from its start to its end. Returns 0 or a SG_LIB_* error. */
+static int
+simg_read(struct opts_t * op, uint8_t * bp, int blocks)
+{
+    int bs = op->blk_sz;
+    int n, len, got;
+    ssize_t res;
+    int64_t k;
+    int64_t lba = op->skip;
+    int64_t end = lba + blocks;
+    off_t off;
+    struct simg_stage * sip = &op->simg;
+    const struct sg_cimg_ent * ep;
+    uint8_t d[SG_HASH_MAX_DIGEST_LEN];
+
+    while (lba < end) {
+        ep = sg_cimg_find(sip->ents, sip->num_ents, (uint64_t)lba);
+        if ((NULL == ep) || ((int64_t)ep->blk >= end)) {
+            memset(bp, 0, (end - lba) * bs);    /* hole to the end */
+            break;
+        }
+        if ((int64_t)ep->blk > lba) {           /* hole before extent */
+            n = (int)(ep->blk - lba);
+            memset(bp, 0, n * bs);
+            bp += n * bs;
+            lba += n;
+        }
+        n = (int)(ep->blk + ep->num_blks - lba);
+        if (n > end - lba)
+            n = (int)(end - lba);
+        len = n * bs;
+        off = (off_t)(ep->pos + ((lba - ep->blk) * bs));
+        for (got = 0; got < len; got += res) {
+            res = pread(op->infd, bp + got, len - got, off + got);
+            if ((res < 0) && ((EINTR == errno) || (EAGAIN == errno))) {
+                res = 0;
+                continue;
+            }
+            if (res <= 0) {
+                if (res < 0)
+                    sg_err_stats_errno(&err_stats, errno);
+                pr2serr("%sreading sparse image, skip=%" PRId64 ": %s\n",
+                        my_name, lba, (res < 0) ? safe_strerror(errno) :
+                                                  "image is truncated");
+                return SG_LIB_FILE_ERROR;
+            }
+        }
+        k = ep - sip->ents;
+        if ((int64_t)ep->blk == lba) {
+            sip->crc_idx = k;
+            sip->crc_next = lba;
+            sg_hash_init(&sip->hc, SG_HASH_CRC32C);
+        }
+        if ((sip->crc_idx == k) && (sip->crc_next == lba)) {
+            sg_hash_update(&sip->hc, bp, len);
+            sip->crc_next += n;
+            if (sip->crc_next == (int64_t)(ep->blk + ep->num_blks)) {
+                sg_hash_final(&sip->hc, d);
+                sip->crc_idx = -1;
+                if (sg_get_unaligned_be32(d) != ep->crc) {
+                    pr2serr("%ssparse image extent at blk=%" PRIu64 " (%u "
+                            "blocks) is corrupt, CRC32C mismatch\n",
+                            my_name, ep->blk, ep->num_blks);
+                    return SG_LIB_FILE_ERROR;
+                }
+                ++sip->num_checked;
+            }
+        }
+        bp += len;
+        lba += n;
+    }
+    return 0;
+}
+
+/* nbuf=2|3: keeps up to NBUF block groups in flight so the READ of one
+ * overlaps the WRITEs of those before it. Uses the asynchronous sg v3
+ * interface (write() then read() of a sg_io_hdr), as sgp_dd does, so both
+ * IFILE and OFILE must be sg char devices. Only one READ is outstanding,
+ * keeping IFILE sequential; each WRITE is submitted as its READ finishes
+ * and, with NBUF of 3, two WRITEs may be outstanding. */
+#define OVL_FREE 0
+#define OVL_READING 1
+#define OVL_WRITING 2
+
+struct ovl_buf {
+    int state;          /* OVL_* */
+    int blocks;
+    int64_t lba;        /* of IFILE then OFILE, depending on state */
+    int64_t out_lba;
+    uint64_t t0_ns;     /* for interval=SECS latencies */
+    uint8_t * bp;
+    uint8_t * free_bp;
+    struct sg_io_hdr io_hdr;
+    uint8_t cdb[MAX_SCSI_CDBSZ];
+    uint8_t sense[SENSE_BUFF_LEN];
+};
+
+static bool
+is_sg_chr_dev(int fd)
+{
+    struct stat st;
+
+    return (0 == fstat(fd, &st)) && S_ISCHR(st.st_mode) &&
+           (SCSI_GENERIC_MAJOR == major(st.st_rdev));
+}
+
+/* Returns 0 if submitted, -2 for ENOMEM, -1 for other errors */
+static int
+ovl_submit(struct ovl_buf * obp, bool wr, struct opts_t * op)
+{
+    int res;
+    int fd = wr ? op->outfd : op->infd;
+    const struct flags_t * fp = wr ? &op->oflag : &op->iflag;
+    struct sg_io_hdr * hp = &obp->io_hdr;
+
+    /* the templates are of VERIFY, not WRITE, cdbs with --verify */
+    if (op->do_verify ?
+        sg_build_scsi_cdb(obp->cdb, obp->blocks, obp->lba, false, wr, op) :
+        sg_dde_cdb_tmpl_fill(&fp->tmpl, obp->cdb, obp->blocks, obp->lba)) {
+        pr2serr("%sbad %s cdb build, lba=%" PRId64 ", blocks=%d\n", my_name,
+                (wr ? "wr" : "rd"), obp->lba, obp->blocks);
+        return -1;
+    }
+    memset(hp, 0, sizeof(*hp));
+    hp->interface_id = 'S';
+    hp->cmd_len = fp->cdbsz;
+    hp->cmdp = obp->cdb;
+    hp->dxfer_direction = wr ? SG_DXFER_TO_DEV : SG_DXFER_FROM_DEV;
+    hp->dxfer_len = op->blk_sz * obp->blocks;
+    hp->dxferp = obp->bp;
+    hp->mx_sb_len = SENSE_BUFF_LEN;
+    hp->sbp = obp->sense;
+    hp->timeout = op->cmd_timeout;
+    hp->usr_ptr = obp;
+    hp->pack_id = (int)++glob_pack_id;
+    if (fp->dio)
+        hp->flags |= SG_FLAG_DIRECT_IO;
+    if (op->verbose > 2)
+        sg_print_command_len(obp->cdb, fp->cdbsz);
+    if (op->interval > 0)
+        obp->t0_ns = sg_get_mono_ns();
+    while (((res = write(fd, hp, sizeof(*hp))) < 0) &&
+           ((EINTR == errno) || (EAGAIN == errno) || (EBUSY == errno)))
+        sg_err_stats_errno(&err_stats, errno);
+    if (res < 0) {
+        sg_err_stats_errno(&err_stats, errno);
+        if (ENOMEM == errno)
+            return -2;
+        perror(wr ? "nbuf: starting write on sg device, error" :
+                    "nbuf: starting read on sg device, error");
+        return -1;
+    }
+    obp->state = wr ? OVL_WRITING : OVL_READING;
+    return 0;
+}
+
+/* Collects the response of a command submitted on fd, placing the buffer
+ * it used in *obpp. Unit attentions and aborted commands are re-submitted
+ * (returning 1), as sg_read() and sg_write() do, up to their limits.
+ * Returns 0 when the command has finished, else an error. */
+static int
+ovl_finish(int fd, bool wr, struct opts_t * op, struct ovl_buf ** obpp)
+{
+    int res;
+    struct ovl_buf * obp;
+    struct sg_io_hdr io_hdr;
+    const char * leadin = wr ? "writing" : "reading";
+
+    *obpp = NULL;
+    memset(&io_hdr, 0, sizeof(io_hdr));
+    io_hdr.interface_id = 'S';
+    while (((res = read(fd, &io_hdr, sizeof(io_hdr))) < 0) &&
+           ((EINTR == errno) || (EAGAIN == errno) || (EBUSY == errno)))
+        ;
+    if (res < 0) {
+        sg_err_stats_errno(&err_stats, errno);
+        perror(wr ? "nbuf: finishing write on sg device, error" :
+                    "nbuf: finishing read on sg device, error");
+        return -1;
+    }
+    obp = (struct ovl_buf *)io_hdr.usr_ptr;
+    *obpp = obp;
+    obp->io_hdr = io_hdr;
+    if (op->verbose > 2)
+        pr2serr("      duration=%u ms\n", io_hdr.duration);
+    res = sg_err_category3(&io_hdr);
+    sg_err_stats_cat(&err_stats, res);
+    switch (res) {
+    case SG_LIB_CAT_CLEAN:
+    case SG_LIB_CAT_CONDITION_MET:
+        break;
+    case SG_LIB_CAT_RECOVERED:
+        ++recovered_errs;
+        sg_chk_n_print3(leadin, &io_hdr, op->verbose > 1);
+        break;
+    case SG_LIB_CAT_UNIT_ATTENTION:
+    case SG_LIB_CAT_ABORTED_COMMAND:
+        if (((SG_LIB_CAT_UNIT_ATTENTION == res) ? --max_uas :
+                                                  --max_aborted) > 0) {
+            if (op->verbose)
+                sg_chk_n_print3(leadin, &io_hdr, op->verbose > 1);
+            sg_err_stats_retry(&err_stats);
+            res = ovl_submit(obp, wr, op);
+            return res ? res : 1;
+        }
+        pr2serr("%s, too many (%c)\n", (SG_LIB_CAT_UNIT_ATTENTION == res) ?
+                "Unit attention" : "Aborted command", (wr ? 'w' : 'r'));
+        return res;
+    default:
+        ++unrecovered_errs;
+        sg_chk_n_print3(leadin, &io_hdr, op->verbose > 0);
+        return res;
+    }
+    if ((io_hdr.flags & SG_FLAG_DIRECT_IO) &&
+        ((io_hdr.info & SG_INFO_DIRECT_IO_MASK) != SG_INFO_DIRECT_IO))
+        op->dio_incomplete_count++;
+    op->sum_of_resids += io_hdr.resid;
+    return 0;
+}
+
+/* The copy loop for nbuf=2|3, instead of the one in main(). wrkPos is the
+ * first buffer. Returns 0 or an error, op->dd_count is 0 on success. */
+static int
+ovl_copy(struct opts_t * op, uint8_t * wrkPos, int blocks_per)
+{
+    bool in_done = false;
+    int k, n, res;
+    int ret = 0;
+    int reading = 0;
+    int writing = 0;
+    int bs = op->blk_sz;
+    int64_t rd_rem = op->dd_count;
+    int64_t rd_lba = op->skip;
+    int64_t wr_lba = op->seek;
+    struct ovl_buf * obp;
+    struct ovl_buf obufs[3];
+    struct pollfd pfd[2];
+
+    memset(obufs, 0, sizeof(obufs));
+    for (k = 0; k < op->nbuf; ++k) {
+        if (0 == k)
+            obufs[k].bp = wrkPos;
+        else {
+            obufs[k].bp = sg_memalign(bs * op->bpt, 0, &obufs[k].free_bp,
+                                      false);
+            if (NULL == obufs[k].bp) {
+                pr2serr("nbuf: not enough user memory\n");
+                ret = sg_convert_errno(ENOMEM);
+                goto fini;
+            }
+        }
+    }
+    while (true) {
+        if ((! in_done) && (0 == reading)) {
+            for (k = 0, obp = NULL; k < op->nbuf; ++k) {
+                if (OVL_FREE == obufs[k].state) {
+                    obp = obufs + k;
+                    break;
+                }
+            }
+            if (obp && (rd_rem <= 0))
+                in_done = true;
+            else if (obp) {
+                n = (rd_rem > blocks_per) ? blocks_per : (int)rd_rem;
+                if (op->rate_arg)
+                    sg_rate_lim_wait(&op->rate_lim, (uint64_t)n * bs, 1);
+                obp->blocks = n;
+                obp->lba = rd_lba;
+                obp->out_lba = wr_lba;
+                res = ovl_submit(obp, false, op);
+                if (res) {
+                    ret = res;
+                    in_done = true;
+                } else {
+                    rd_lba += n;
+                    wr_lba += n;
+                    rd_rem -= n;
+                    ++reading;
+                }
+            }
+        }
+        if ((0 == reading) && (0 == writing))
+            break;
+        pfd[0].fd = reading ? op->infd : -1;
+        pfd[0].events = POLLIN;
+        pfd[0].revents = 0;
+        pfd[1].fd = writing ? op->outfd : -1;
+        pfd[1].events = POLLIN;
+        pfd[1].revents = 0;
+        res = poll(pfd, 2, -1);
+        if (res < 0) {
+            if (EINTR == errno)
+                continue;
+            perror("nbuf: poll() failed");
+            ret = -1;
+            break;              /* outstanding commands are abandoned */
+        }
+        if (pfd[0].revents) {
+            res = ovl_finish(op->infd, false, op, &obp);
+            if (1 == res)
+                ;               /* re-submitted */
+            else if (res) {
+                pr2serr("sg_read failed, at or after lba=%" PRId64 " [0x%"
+                        PRIx64 "]\n", obp ? obp->lba : rd_lba,
+                        obp ? obp->lba : rd_lba);
+                --reading;
+                if (0 == ret)
+                    ret = res;
+                in_done = true;
+                if (obp)
+                    obp->state = OVL_FREE;
+            } else {
+                --reading;
+                n = obp->blocks;
+                if (obp->io_hdr.resid > 0) {    /* short read, stop after */
+                    n = (obp->io_hdr.dxfer_len - obp->io_hdr.resid) / bs;
+                    in_done = true;
+                }
+                in_full += n;
+                if (op->interval > 0)
+                    lat_add(LAT_IN_ID, obp->t0_ns);
+                if (op->hash_alg && (n > 0))
+                    hash_range(op, obp->lba, n, obp->bp, n * bs);
+                if (0 == n)
+                    obp->state = OVL_FREE;
+                else {
+                    obp->blocks = n;
+                    obp->lba = obp->out_lba;
+                    if (op->rate_arg)
+                        sg_rate_lim_wait(&op->rate_lim, 0, 1);
+                    res = ovl_submit(obp, true, op);
+                    if (res) {
+                        if (0 == ret)
+                            ret = res;
+                        in_done = true;
+                        obp->state = OVL_FREE;
+                    } else
+                        ++writing;
+                }
+            }
+        }
+        if (pfd[1].revents) {
+            res = ovl_finish(op->outfd, true, op, &obp);
+            if (1 == res)
+                ;
+            else if (res) {
+                pr2serr("sg_write failed, seek=%" PRId64 "\n",
+                        obp ? obp->lba : op->seek);
+                --writing;
+                if (0 == ret)
+                    ret = res;
+                in_done = true;
+                if (obp)
+                    obp->state = OVL_FREE;
+            } else {
+                --writing;
+                out_full += obp->blocks;
+                if (op->interval > 0)
+                    lat_add(LAT_OUT_ID, obp->t0_ns);
+                op->dd_count -= obp->blocks;
+                op->skip += obp->blocks;
+                op->seek += obp->blocks;
+                obp->state = OVL_FREE;
+            }
+        }
+        if (op->progress > 0) {
+            if (check_progress(op)) {
+                calc_duration_throughput(true);
+                print_stats("");
+            }
+        }
+        if (op->interval > 0)
+            interval_report(op, false);
+    }
+    if (0 == ret)
+        op->dd_count = 0;       /* may have been ended by a short read */
+fini:
+    for (k = 1; k < op->nbuf; ++k) {
+        if (obufs[k].free_bp)
+            free(obufs[k].free_bp);
+    }
+    return ret;
+}
+
+/* iflag=tape or oflag=tape: that side is a tape drive reached through a sg
+ * device, accessed with SSC READ(6) and WRITE(6) commands. A ring of
+ * tbuf=MB (def: 64 MiB) is filled by a producer thread reading IFILE and
+ * drained by the main thread writing OFILE, so that the drive keeps
+ * streaming while the host side stalls (and vice versa). When writing to
+ * tape the drain only starts (and restarts after the ring runs dry) once
+ * the ring is PCT percent full, so the drive gets long runs rather than
+ * dribbles that cause it to stop and reposition ("shoe-shine"). */
+#define TAPE_DEF_RING_MB 64
+#define TAPE_DEF_HIGH_PCT 50
+#define TAPE_MX_FIXED_BLOCKS 0xffffff   /* 24 bit transfer length */
+#define TAPE_RBL_LEN 6
+#define TAPE_RPOS_LONG_SA 6
+#define TAPE_RPOS_SHORT_SA 0
+#define TAPE_RPOS_LEN 32
+#define TAPE_MS_LEN 252
+#define TAPE_SK_BLANK_CHECK 0x8
+#define TAPE_SK_VOLUME_OVERFLOW 0xd
+
+struct tape_slot {
+    int len;            /* bytes held in bp */
+    bool last;          /* nothing follows this slot */
+    uint8_t * bp;
+};
+
+struct tape_ring {
+    bool in_tape;       /* IFILE is the tape, else OFILE is */
+    bool fixed;         /* tape in fixed block mode */
+    bool in_done;       /* producer has stopped; protected by mtx */
+    bool out_stop;      /* consumer has stopped; protected by mtx */
+    int tblk_len;       /* tape block length in fixed mode, else 0 */
+    int xfer;           /* bytes per slot (bs * bpt) */
+    int num_slots;
+    int head;           /* next slot for producer */
+    int tail;           /* next slot for consumer */
+    int filled;         /* protected by mtx */
+    int high;           /* slots filled before the drain (re)starts */
+    int min_fill;       /* since last telemetry */
+    int max_fill;
+    int in_res;         /* producer error, 0 if none */
+    int filemarks;      /* filemarks read (that end input) */
+    int drive_waits;    /* times drive side waited on the ring */
+    int64_t in_bytes;   /* protected by mtx */
+    int64_t records;    /* tape READs or WRITEs that moved data */
+    int64_t rem_bytes;  /* count= (in bytes) still to be read */
+    uint64_t drive_wait_ns;
+    struct tape_slot * slots;
+    uint8_t * free_ring;
+    struct opts_t * op;
+#ifdef SG_DD_THREADS
+    pthread_mutex_t mtx;
+    pthread_cond_t cv;
+#endif
+};
+
+/* Sends cdb to the tape (a sg device) with SG_IO, dxfer_len bytes in the
+ * direction given by wr. Decodes any sense data into *sdp and writes the
+ * residual count to *residp. Returns a SG_LIB_CAT_* value or -1 for an
+ * OS error. Unlike sg_read_low() a CHECK CONDITION is not reported here
+ * since filemarks and early warning are normal on a tape. */
+static int
+tape_cmd(int fd, const uint8_t * cdb, int cdb_len, uint8_t * buff,
+         int dxfer_len, bool wr, int * residp, struct sg_sense_decode_t * sdp,
+         const struct opts_t * op)
+{
+    int res;
+    uint8_t senseBuff[SENSE_BUFF_LEN] SG_C_CPP_ZERO_INIT;
+    struct sg_io_hdr io_hdr;
+
+    memset(&io_hdr, 0, sizeof(struct sg_io_hdr));
+    io_hdr.interface_id = 'S';
+    io_hdr.cmd_len = cdb_len;
+    io_hdr.cmdp = (uint8_t *)cdb;
+    io_hdr.dxfer_direction = (0 == dxfer_len) ? SG_DXFER_NONE :
+                             (wr ? SG_DXFER_TO_DEV : SG_DXFER_FROM_DEV);
+    io_hdr.dxfer_len = dxfer_len;
+    io_hdr.dxferp = buff;
+    io_hdr.mx_sb_len = SENSE_BUFF_LEN;
+    io_hdr.sbp = senseBuff;
+    io_hdr.timeout = op->cmd_timeout;
+    io_hdr.pack_id = (int)++glob_pack_id;
+    if (op->verbose > 2)
+        sg_print_command_len(cdb, cdb_len);
+    while (((res = ioctl(fd, SG_IO, &io_hdr)) < 0) &&
+           ((EINTR == errno) || (EAGAIN == errno) || (EBUSY == errno)))
+        sg_err_stats_errno(&err_stats, errno);
+    if (res < 0) {
+        sg_err_stats_errno(&err_stats, errno);
+        perror("tape: SG_IO ioctl error");
+        return -1;
+    }
+    if (op->verbose > 2)
+        pr2serr("      duration=%u ms\n", io_hdr.duration);
+    *residp = io_hdr.resid;
+    res = sg_err_category3(&io_hdr);
+    sg_err_stats_cat(&err_stats, res);
+    if (io_hdr.sb_len_wr > 0)
+        sg_decode_sense(senseBuff, io_hdr.sb_len_wr, sdp);
+    else
+        memset(sdp, 0, sizeof(*sdp));
+    if (res && (op->verbose > 1))
+        sg_chk_n_print3("tape", &io_hdr, true);
+    return res;
+}
+
+/* Outputs the position of the tape using READ POSITION, long form if the
+ * drive supports it, else short form. */
+static void
+tape_position(int fd, const char * leadin, const struct opts_t * op)
+{
+    int k, res, resid;
+    int sa_arr[2] = {TAPE_RPOS_LONG_SA, TAPE_RPOS_SHORT_SA};
+    uint8_t cdb[10];
+    uint8_t rsp[TAPE_RPOS_LEN];
+    struct sg_sense_decode_t sd;
+    char b[80];
+
+    for (k = 0; k < 2; ++k) {
+        memset(cdb, 0, sizeof(cdb));
+        memset(rsp, 0, sizeof(rsp));
+        cdb[0] = SG_READ_POSITION;
+        cdb[1] = sa_arr[k];
+        if (TAPE_RPOS_LONG_SA == sa_arr[k])
+            sg_put_unaligned_be16(TAPE_RPOS_LEN, cdb + 7);
+        if (op->verbose > 1) {
+            sg_get_opcode_sa_name(SG_READ_POSITION, sa_arr[k], PDT_TAPE,
+                                  sizeof(b), b);
+            pr2serr("    %s\n", b);
+        }
+        res = tape_cmd(fd, cdb, sizeof(cdb), rsp,
+                       (TAPE_RPOS_LONG_SA == sa_arr[k]) ? TAPE_RPOS_LEN : 20,
+                       false, &resid, &sd, op);
+        if (0 == res)
+            break;
+    }
+    if (k >= 2) {
+        if (op->verbose)
+            pr2serr("%s: READ POSITION failed\n", leadin);
+        return;
+    }
+    if (TAPE_RPOS_LONG_SA == sa_arr[k])
+        pr2serr("%s: partition %u, block %" PRIu64 ", file %" PRIu64 "%s%s\n",
+                leadin, sg_get_unaligned_be32(rsp + 4),
+                sg_get_unaligned_be64(rsp + 8),
+                sg_get_unaligned_be64(rsp + 16),
+                (rsp[0] & 0x80) ? " [BOP]" : "",
+                (rsp[0] & 0x40) ? " [EOP]" : "");
+    else if (rsp[0] & 0x4)
+        pr2serr("%s: position unknown\n", leadin);
+    else
+        pr2serr("%s: partition %u, block %u%s%s\n", leadin, rsp[1],
+                sg_get_unaligned_be32(rsp + 4), (rsp[0] & 0x80) ? " [BOP]" :
+                "", (rsp[0] & 0x40) ? " [EOP]" : "");
+}
+
+/* Fetches READ BLOCK LIMITS and the mode parameter block descriptor of
+ * the tape, decides between fixed and variable block mode and checks that
+ * BS and BPT suit it. Returns 0 if ok. */
+static int
+tape_probe(int fd, bool wr, struct tape_ring * trp, struct opts_t * op)
+{
+    int res, bd_len, buff_mode;
+    uint32_t max_len, min_len;
+    uint8_t rbl[TAPE_RBL_LEN];
+    uint8_t ms[TAPE_MS_LEN];
+    char b[80];
+
+    memset(rbl, 0, sizeof(rbl));
+    res = sg_ll_read_block_limits(fd, rbl, sizeof(rbl), true, op->verbose);
+    if (res) {
+        sg_get_category_sense_str(res, sizeof(b), b, op->verbose);
+        pr2serr("tape: READ BLOCK LIMITS failed: %s\n", b);
+        return res;
+    }
+    max_len = sg_get_unaligned_be24(rbl + 1);   /* 0 -> not given */
+    min_len = sg_get_unaligned_be16(rbl + 4);
+    memset(ms, 0, sizeof(ms));
+    /* MODE SENSE(6) of all pages is the most widely supported on tapes */
+    res = sg_ll_mode_sense6(fd, false /* dbd */, 0 /* current */, 0x3f, 0,
+                            ms, sizeof(ms), true, op->verbose);
+    if (res) {
+        sg_get_category_sense_str(res, sizeof(b), b, op->verbose);
+        pr2serr("tape: MODE SENSE failed: %s\n", b);
+        return res;
+    }
+    bd_len = ms[3];
+    trp->tblk_len = (bd_len >= 8) ? (int)sg_get_unaligned_be24(ms + 4 + 5) :
+                                    0;
+    trp->fixed = (trp->tblk_len > 0);
+    buff_mode = (ms[2] >> 4) & 0x7;
+    if (op->verbose)
+        pr2serr("tape: block limits min=%u max=%u, block length=%d (%s "
+                "mode), buffered mode=%d\n", min_len, max_len,
+                trp->tblk_len, trp->fixed ? "fixed" : "variable", buff_mode);
+    if (wr && (ms[2] & 0x80)) {
+        pr2serr("tape: write protected\n");
+        return SG_LIB_CAT_DATA_PROTECT;
+    }
+    if (wr && (0 == buff_mode))
+        pr2serr(">> tape: buffered mode is off so each WRITE waits for the "
+                "medium,\n   the drive is unlikely to stream\n");
+    if (trp->fixed) {
+        if (op->blk_sz != trp->tblk_len) {
+            pr2serr("tape: in fixed block mode of %d bytes, so need bs=%d\n",
+                    trp->tblk_len, trp->tblk_len);
+            return SG_LIB_CONTRADICT;
+        }
+        if (op->bpt > TAPE_MX_FIXED_BLOCKS) {
+            pr2serr("tape: bpt=%d exceeds %d\n", op->bpt,
+                    TAPE_MX_FIXED_BLOCKS);
+            return SG_LIB_CONTRADICT;
+        }
+    } else {
+        if ((max_len > 0) && ((uint32_t)trp->xfer > max_len)) {
+            pr2serr("tape: bs*bpt=%d exceeds maximum block length %u, "
+                    "reduce bpt\n", trp->xfer, max_len);
+            return SG_LIB_CONTRADICT;
+        }
+        if ((uint32_t)trp->xfer < min_len) {
+            pr2serr("tape: bs*bpt=%d is less than minimum block length "
+                    "%u\n", trp->xfer, min_len);
+            return SG_LIB_CONTRADICT;
+        }
+    }
+    return 0;
+}
+
+/* One READ(6) into slp->bp. Sets slp->len and slp->last; a filemark or
+ * end of data ends the input. Returns 0 if ok. */
+static int
+tape_read_one(struct tape_ring * trp, struct tape_slot * slp, int want)
+{
+    int res, resid, n;
+    int64_t info;
+    struct opts_t * op = trp->op;
+    uint8_t cdb[6];
+    struct sg_sense_decode_t sd;
+    char b[120];
+
+    memset(cdb, 0, sizeof(cdb));
+    cdb[0] = 0x8;               /* READ(6) */
+    if (trp->fixed) {
+        cdb[1] = 0x1;           /* FIXED */
+        sg_put_unaligned_be24(want / trp->tblk_len, cdb + 2);
+    } else {
+        cdb[1] = 0x2;           /* SILI: shorter blocks are not an error */
+        sg_put_unaligned_be24(want, cdb + 2);
+    }
+    slp->len = 0;
+    slp->last = false;
+    res = tape_cmd(op->infd, cdb, sizeof(cdb), slp->bp, want, false, &resid,
+                   &sd, op);
+    if (res < 0)
+        return res;
+    info = (int64_t)(int32_t)sd.info;   /* residue may be negative */
+    if ((SG_LIB_CAT_CLEAN == res) || (SG_LIB_CAT_RECOVERED == res)) {
+        if (SG_LIB_CAT_RECOVERED == res)
+            ++recovered_errs;
+        slp->len = want - resid;
+        return 0;
+    }
+    if (sd.valid && (SPC_SK_NO_SENSE == sd.sense_key) && sd.filemark) {
+        n = sd.info_valid ? (int)info : 0;
+        slp->len = trp->fixed ? (want / trp->tblk_len - n) * trp->tblk_len :
+                                0;
+        slp->last = true;
+        ++trp->filemarks;
+        return 0;
+    }
+    if (sd.valid && (TAPE_SK_BLANK_CHECK == sd.sense_key)) {
+        n = sd.info_valid ? (int)info : 0;
+        slp->len = trp->fixed ? (want / trp->tblk_len - n) * trp->tblk_len :
+                                0;
+        slp->last = true;       /* end of data */
+        if (op->verbose)
+            pr2serr("tape: end of data\n");
+        return 0;
+    }
+    if (sd.valid && sd.ili && (info < 0)) {
+        pr2serr("tape: block of %" PRId64 " bytes longer than bs*bpt=%d, "
+                "increase bpt\n", want - info, want);
+        return SG_LIB_CAT_ILLEGAL_REQ;
+    }
+    if (sd.valid && sd.eom)
+        pr2serr("tape: end of partition reached while reading\n");
+    sg_sense_decode_str(&sd, sizeof(b), b);
+    pr2serr("tape: READ failed: %s\n", b);
+    ++unrecovered_errs;
+    return res ? res : SG_LIB_CAT_OTHER;
+}
+
+/* One WRITE(6) of len bytes from bp. A fixed block tail is padded with
+ * zeros. *eomp is set at early warning (the data was written). Returns 0
+ * if ok. */
+static int
+tape_write_one(struct tape_ring * trp, uint8_t * bp, int len, bool * eomp)
+{
+    int res, resid, n;
+    struct opts_t * op = trp->op;
+    uint8_t cdb[6];
+    struct sg_sense_decode_t sd;
+    char b[120];
+
+    memset(cdb, 0, sizeof(cdb));
+    cdb[0] = 0xa;               /* WRITE(6) */
+    if (trp->fixed) {
+        n = len % trp->tblk_len;
+        if (n) {
+            memset(bp + len, 0, trp->tblk_len - n);
+            len += trp->tblk_len - n;
+            ++out_partial;
+        }
+        cdb[1] = 0x1;           /* FIXED */
+        sg_put_unaligned_be24(len / trp->tblk_len, cdb + 2);
+    } else
+        sg_put_unaligned_be24(len, cdb + 2);
+    res = tape_cmd(op->outfd, cdb, sizeof(cdb), bp, len, true, &resid, &sd,
+                   op);
+    if (res < 0)
+        return res;
+    if (SG_LIB_CAT_RECOVERED == res)
+        ++recovered_errs;
+    if ((SG_LIB_CAT_CLEAN == res) || (SG_LIB_CAT_RECOVERED == res))
+        return 0;
+    if (sd.valid && sd.eom && (SPC_SK_NO_SENSE == sd.sense_key)) {
+        *eomp = true;           /* early warning, data written */
+        return 0;
+    }
+    sg_sense_decode_str(&sd, sizeof(b), b);
+    if (sd.valid && (TAPE_SK_VOLUME_OVERFLOW == sd.sense_key))
+        pr2serr("tape: end of partition, WRITE incomplete: %s\n", b);
+    else
+        pr2serr("tape: WRITE failed: %s\n", b);
+    ++unrecovered_errs;
+    return res ? res : SG_LIB_CAT_OTHER;
+}
+
+/* Fills slp from a host file (not the tape), looping over short reads of
+ * pipes. Returns 0 if ok. */
+static int
+tape_host_read(struct tape_ring * trp, struct tape_slot * slp, int want)
+{
+    int res;
+    struct opts_t * op = trp->op;
+
+    slp->len = 0;
+    slp->last = false;
+    while (slp->len < want) {
+        res = read(op->infd, slp->bp + slp->len, want - slp->len);
+        if (res < 0) {
+            if ((EINTR == errno) || (EAGAIN == errno) || (EBUSY == errno))
+                continue;
+            sg_err_stats_errno(&err_stats, errno);
+            perror("tape: reading IFILE");
+            return sg_convert_errno(errno);
+        }
+        if (0 == res) {
+            slp->last = true;
+            break;
+        }
+        slp->len += res;
+    }
+    return 0;
+}
+
+/* Ring fill in slots, kept as a low and high water mark for telemetry.
+ * Call with mtx held. */
+static void
+tape_fill_note(struct tape_ring * trp)
+{
+    if (trp->filled < trp->min_fill)
+        trp->min_fill = trp->filled;
+    if (trp->filled > trp->max_fill)
+        trp->max_fill = trp->filled;
+}
+
+/* Producer: reads IFILE into the ring until count= is met, a filemark,
+ * end of data or of input, an error or the consumer stops. */
+static void *
+tape_producer(void * v_trp)
+{
+    bool stop = false;
+    int res, want;
+    uint64_t t0 = 0;
+    struct tape_ring * trp = (struct tape_ring *)v_trp;
+    struct tape_slot * slp;
+
+    while (! stop) {
+#ifdef SG_DD_THREADS
+        pthread_mutex_lock(&trp->mtx);
+        if ((trp->filled >= trp->num_slots) && (! trp->out_stop)) {
+            if (trp->in_tape) {         /* drive has to stop */
+                ++trp->drive_waits;
+                t0 = sg_get_mono_ns();
+            }
+            while ((trp->filled >= trp->num_slots) && (! trp->out_stop))
+                pthread_cond_wait(&trp->cv, &trp->mtx);
+            if (trp->in_tape)
+                trp->drive_wait_ns += sg_get_mono_ns() - t0;
+        }
+        stop = trp->out_stop;
+        pthread_mutex_unlock(&trp->mtx);
+#else
+        if (t0) { ; }   /* suppress warning; only one slot, never full */
+#endif
+        if (stop)
+            break;
+        slp = trp->slots + trp->head;
+        want = ((trp->rem_bytes >= 0) && (trp->rem_bytes < trp->xfer)) ?
+               (int)trp->rem_bytes : trp->xfer;
+        if (trp->in_tape && trp->fixed)
+            want -= want % trp->tblk_len;
+        if (want <= 0) {
+            slp->len = 0;
+            slp->last = true;
+            res = 0;
+        } else if (trp->in_tape)
+            res = tape_read_one(trp, slp, want);
+        else
+            res = tape_host_read(trp, slp, want);
+        if (0 == res) {
+            if (trp->in_tape && (slp->len > 0))
+                ++trp->records;
+            if (trp->rem_bytes >= 0) {  /* -1 -> until end of input */
+                trp->rem_bytes -= slp->len;
+                if (trp->rem_bytes <= 0)
+                    slp->last = true;
+            }
+        } else {
+            slp->len = 0;
+            slp->last = true;
+        }
+        stop = slp->last;
+#ifdef SG_DD_THREADS
+        pthread_mutex_lock(&trp->mtx);
+#endif
+        trp->in_res = res;
+        trp->in_bytes += slp->len;
+        in_full += slp->len / trp->op->blk_sz;
+        if (slp->len % trp->op->blk_sz)
+            ++in_partial;
+        trp->head = (trp->head + 1) % trp->num_slots;
+        ++trp->filled;
+        tape_fill_note(trp);
+        if (stop)
+            trp->in_done = true;
+#ifdef SG_DD_THREADS
+        pthread_cond_broadcast(&trp->cv);
+        pthread_mutex_unlock(&trp->mtx);
+#else
+        break;          /* one slot per call without threads */
+#endif
+    }
+    return NULL;
+}
+
+/* Outputs the buffer-fill telemetry line: ring fill now and its low and
+ * high water marks since the previous line, throughput of each side and
+ * how often (and how long) the drive side has waited on the ring. */
+static void
+tape_telemetry(struct tape_ring * trp, int64_t out_bytes, bool final)
+{
+    int now_pct, lo_pct, hi_pct;
+    uint64_t now;
+    double secs;
+    static uint64_t prev_ns;
+    static int64_t prev_in, prev_out;
+
+    now = sg_get_mono_ns();
+    if (0 == prev_ns) {
+        prev_ns = now;
+        return;
+    }
+    if ((! final) && ((now - prev_ns) < (uint64_t)trp->op->interval *
+                                        1000000000))
+        return;
+    secs = (double)(now - prev_ns) / 1000000000.0;
+    if (secs < 0.000001)
+        secs = 0.000001;
+#ifdef SG_DD_THREADS
+    pthread_mutex_lock(&trp->mtx);
+#endif
+    now_pct = (100 * trp->filled) / trp->num_slots;
+    lo_pct = (100 * trp->min_fill) / trp->num_slots;
+    hi_pct = (100 * trp->max_fill) / trp->num_slots;
+    pr2serr("tape: ring %d%% full (low %d%%, high %d%%), in %.2f MB/sec, "
+            "out %.2f MB/sec, %" PRId64 " records, drive waited %d times "
+            "(%.1f secs)\n", now_pct, lo_pct, hi_pct,
+            (double)(trp->in_bytes - prev_in) / (secs * 1000000.0),
+            (double)(out_bytes - prev_out) / (secs * 1000000.0),
+            trp->records, trp->drive_waits,
+            (double)trp->drive_wait_ns / 1000000000.0);
+    trp->min_fill = trp->filled;
+    trp->max_fill = trp->filled;
+    prev_in = trp->in_bytes;
+#ifdef SG_DD_THREADS
+    pthread_mutex_unlock(&trp->mtx);
+#endif
+    prev_out = out_bytes;
+    prev_ns = now;
+}
+
+/* Writes one slot to OFILE (the tape or a host file). Returns 0 if ok. */
+static int
+tape_drain_one(struct tape_ring * trp, struct tape_slot * slp, bool * eomp)
+{
+    int res, off;
+    struct opts_t * op = trp->op;
+
+    if (0 == slp->len)
+        return 0;
+    if (! trp->in_tape) {
+        res = tape_write_one(trp, slp->bp, slp->len, eomp);
+        if (0 == res)
+            ++trp->records;
+        return res;
+    }
+    for (off = 0; off < slp->len; off += res) {
+        res = write(op->outfd, slp->bp + off, slp->len - off);
+        if (res < 0) {
+            if ((EINTR == errno) || (EAGAIN == errno) || (EBUSY == errno)) {
+                res = 0;
+                continue;
+            }
+            sg_err_stats_errno(&err_stats, errno);
+            perror("tape: writing OFILE");
+            return sg_convert_errno(errno);
+        }
+    }
+    return 0;
+}
+
+/* The copy loop for iflag=tape or oflag=tape, instead of the one in
+ * main(). Returns 0 or an error, op->dd_count is 0 on success. */
+static int
+tape_copy(struct opts_t * op)
+{
+    bool eom = false;
+    bool last = false;
+    bool wait_high;
+    int k, res, resid;
+    int ret = 0;
+    int fd;
+    int64_t out_bytes = 0;
+    uint64_t t0 = 0;
+    struct tape_ring ring;
+    struct tape_ring * trp = &ring;
+    struct tape_slot * slp;
+    struct sg_sense_decode_t sd;
+    uint8_t cdb[6];
+    uint8_t * bp;
+#ifdef SG_DD_THREADS
+    pthread_t thr;
+#endif
+
+    memset(trp, 0, sizeof(*trp));
+    trp->op = op;
+    trp->in_tape = op->iflag.tape;
+    trp->xfer = op->blk_sz * op->bpt;
+    trp->rem_bytes = (op->dd_count >= MAX_COUNT_SKIP_SEEK) ? -1 :
+                     op->dd_count * op->blk_sz;
+    fd = trp->in_tape ? op->infd : op->outfd;
+    ret = tape_probe(fd, ! trp->in_tape, trp, op);
+    if (ret)
+        return ret;
+    tape_position(fd, "tape: start position", op);
+    trp->num_slots = (int)(((int64_t)op->tbuf_mb << 20) / trp->xfer);
+    if (trp->num_slots < 2)
+        trp->num_slots = 2;
+    trp->high = (trp->num_slots * op->tbuf_pct) / 100;
+    if (trp->high < 1)
+        trp->high = 1;
+    trp->slots = (struct tape_slot *)calloc(trp->num_slots,
+                                             sizeof(struct tape_slot));
+    bp = sg_memalign((uint32_t)trp->num_slots * trp->xfer, 0,
+                     &trp->free_ring, false);
+    if ((NULL == trp->slots) || (NULL == bp)) {
+        pr2serr("tape: not enough user memory for a %d MiB ring, try a "
+                "smaller tbuf=\n", op->tbuf_mb);
+        ret = sg_convert_errno(ENOMEM);
+        goto fini;
+    }
+    for (k = 0; k < trp->num_slots; ++k)
+        trp->slots[k].bp = bp + ((size_t)k * trp->xfer);
+    if (op->verbose)
+        pr2serr("tape: ring of %d slots of %d bytes, %s drains at %d "
+                "slots\n", trp->num_slots, trp->xfer,
+                trp->in_tape ? "host" : "drive", trp->high);
+    tape_telemetry(trp, 0, false);     /* sets the reference */
+#ifdef SG_DD_THREADS
+    pthread_mutex_init(&trp->mtx, NULL);
+    pthread_cond_init(&trp->cv, NULL);
+    if (pthread_create(&thr, NULL, tape_producer, trp)) {
+        pr2serr("tape: unable to start reader thread\n");
+        ret = sg_convert_errno(errno);
+        goto fini;
+    }
+#endif
+    /* when the drive is being written, wait for the ring to fill first */
+    wait_high = ! trp->in_tape;
+    while (! last) {
+#ifdef SG_DD_THREADS
+        pthread_mutex_lock(&trp->mtx);
+        if ((0 == trp->filled) && (! trp->in_done) && (! wait_high) &&
+            (! trp->in_tape)) {
+            ++trp->drive_waits;         /* ring ran dry, drive stops */
+            wait_high = true;
+        }
+        if (wait_high || (0 == trp->filled))
+            t0 = sg_get_mono_ns();
+        while ((! trp->in_done) &&
+               ((0 == trp->filled) ||
+                (wait_high && (trp->filled < trp->high))))
+            pthread_cond_wait(&trp->cv, &trp->mtx);
+        if (t0 && (! trp->in_tape) && (trp->records > 0))
+            trp->drive_wait_ns += sg_get_mono_ns() - t0;
+        t0 = 0;
+        wait_high = false;
+        pthread_mutex_unlock(&trp->mtx);
+#else
+        if (wait_high) { ; }    /* suppress warning */
+        if (t0) { ; }
+        tape_producer(trp);     /* one slot, then drain it */
+#endif
+        slp = trp->slots + trp->tail;
+        last = slp->last;
+        res = tape_drain_one(trp, slp, &eom);
+        if (0 == res) {
+            out_bytes += slp->len;
+            out_full += slp->len / op->blk_sz;
+            if (slp->len % op->blk_sz)
+                ++out_partial;
+        }
+#ifdef SG_DD_THREADS
+        pthread_mutex_lock(&trp->mtx);
+#endif
+        trp->tail = (trp->tail + 1) % trp->num_slots;
+        --trp->filled;
+        tape_fill_note(trp);
+        if (res || eom)
+            trp->out_stop = true;
+#ifdef SG_DD_THREADS
+        pthread_cond_broadcast(&trp->cv);
+        pthread_mutex_unlock(&trp->mtx);
+#endif
+        if (res) {
+            ret = res;
+            break;
+        }
+        if (eom) {
+            pr2serr("tape: early warning, end of partition is near; "
+                    "stopping\n");
+            ret = SG_LIB_CAT_MEDIUM_HARD;
+            break;
+        }
+        if (op->progress > 0) {
+            if (check_progress(op)) {
+                calc_duration_throughput(true);
+                print_stats("");
+            }
+        }
+        if (op->interval > 0)
+            tape_telemetry(trp, out_bytes, false);
+    }
+#ifdef SG_DD_THREADS
+    pthread_join(thr, NULL);
+    pthread_cond_destroy(&trp->cv);
+    pthread_mutex_destroy(&trp->mtx);
+#endif
+    if (trp->in_res && (0 == ret))
+        ret = trp->in_res;
+    if ((! trp->in_tape) && (trp->records > 0) && (! eom)) {
+        /* WRITE FILEMARKS(6), count 1, not IMMED: flushes drive buffer */
+        memset(cdb, 0, sizeof(cdb));
+        cdb[0] = 0x10;
+        cdb[4] = 1;
+        res = tape_cmd(op->outfd, cdb, sizeof(cdb), NULL, 0, true, &resid,
+                       &sd, op);
+        if (res) {
+            pr2serr("tape: WRITE FILEMARKS failed\n");
+            if (0 == ret)
+                ret = (res < 0) ? SG_LIB_CAT_OTHER : res;
+        }
+    }
+    tape_telemetry(trp, out_bytes, true);
+    if (trp->filemarks)
+        pr2serr("tape: input ended at a filemark\n");
+    tape_position(fd, "tape: end position", op);
+    if (0 == ret)
+        op->dd_count = 0;
+fini:
+    free(trp->slots);
+    free(trp->free_ring);
+    return ret;
+}
+
+/* Fills blocks of bp for iflag=00, iflag=ff (both: each block is filled
+ * with its IFILE block number), iflag=random and if=pat:PAT. A pattern
+ * that is the same for every block is only generated again when bp or
+ * blocks change. */
+static void
+gen_0_ff_random(struct opts_t * op, uint8_t * bp, int blocks)
+{
+    int k, j;
+    int bs = op->blk_sz;
+    const struct flags_t * ifp = &op->iflag;
+    static const uint8_t * pat_bp;
+    static int pat_blocks;
+
+    if (SG_PAT_NONE != op->pat.kind) {
+        if (! sg_pat_lba_indep(&op->pat))
+            sg_pat_fill(&op->pat, bp, bs, op->seek, blocks);
+        else if ((bp != pat_bp) || (blocks > pat_blocks)) {
+            sg_pat_fill(&op->pat, bp, bs, 0, blocks);
+            pat_bp = bp;
+            pat_blocks = blocks;
+        }
+    } else if (ifp->zero && ifp->ff && (bs >= 4)) {
+        uint32_t pos = (uint32_t)op->skip;
+        uint32_t off;
+
+        for (k = 0, off = 0; k < blocks; ++k, off += bs, ++pos) {
+            for (j = 0; j < (bs - 3); j += 4)
+                sg_put_unaligned_be32(pos, bp + off + j);
+        }
+    } else if (ifp->zero)
+        memset(bp, 0, blocks * bs);
+    else if (ifp->ff)
+        memset(bp, 0xff, blocks * bs);
+    else {
+        const int jbump = sizeof(uint32_t);
+        long rn;
+
+        for (k = 0; k < blocks; ++k, bp += bs) {
+            for (j = 0; j < bs; j += jbump) {
+               /* mrand48 takes uniformly from [-2^31, 2^31) */
+#ifdef HAVE_SRAND48_R
+                mrand48_r(&drand, &rn);
+#else
+                rn = mrand48();
+#endif
+                *((uint32_t *)(bp + j)) = (uint32_t)rn;
+            }
+        }
+    }
+}
+
+/* zappend=MFILE[,QD]: called as each append completes, ctx is MFILE */
+static void
+zapp_done(void * ctx, int64_t tag, uint64_t lba, int num_blks)
+{
+    out_full += num_blks;
+    fprintf((FILE *)ctx, "0x%" PRIx64 ",0x%" PRIx64 ",%d\n", (uint64_t)tag,
+            lba, num_blks);
+}
+
+/* The copy loop for zappend=MFILE[,QD], instead of the one in main().
+ * IFILE is read BPT blocks at a time and each lot is given to the zone
+ * append writer of the dd helpers (see sg_dd_eng.h) which has up to QD of
+ * them outstanding. Each line of MFILE is the IFILE block a lot started
+ * at, the OFILE LBA it landed at and its number of blocks. Returns 0 or
+ * an error, op->dd_count is 0 on success. */
+static int
+zapp_copy(struct opts_t * op)
+{
+    bool dio_tmp;
+    int res, blocks, blks_read, n;
+    int ret = 0;
+    int bs = op->blk_sz;
+    int max_blks = op->bpt;
+    FILE * fp = stdout;
+    uint8_t * bp;
+    struct flags_t * ifp = &op->iflag;
+    struct sg_dde_zapp * zap = NULL;
+    struct sg_dde_ep ep;
+    struct sg_dde_zapp_stats st;
+
+    if (strcmp("-", op->zapp_fname)) {
+        fp = fopen(op->zapp_fname, "w");
+        if (NULL == fp) {
+            perror("zappend: opening MFILE");
+            return SG_LIB_FILE_ERROR;
+        }
+    }
+    fprintf(fp, "# IFILE block,OFILE LBA,blocks\n");
+    memset(&ep, 0, sizeof(ep));
+    ep.cdb_sz = op->oflag.cdbsz;
+    ep.blk_sz = bs;
+    ep.timeout_secs = op->cmd_timeout / 1000;
+    ep.verbose = op->verbose;
+    ep.fd = op->outfd;
+    ep.fname = op->out_fname;
+    ep.tmpl = op->oflag.tmpl;
+    ret = sg_dde_zapp_new(&ep, op->seek, op->zapp_qd, &max_blks, zapp_done,
+                          fp, &zap);
+    if (ret)
+        goto fini;
+    while (op->dd_count > 0) {
+        blocks = (op->dd_count > max_blks) ? max_blks : (int)op->dd_count;
+        ret = sg_dde_zapp_get_buf(zap, &bp);
+        if (ret)
+            break;
+        if (FT_SG & ifp->file_type) {
+            dio_tmp = false;
+            res = sg_read(bp, blocks, op->skip, &dio_tmp, &blks_read, op);
+            if (res) {
+                pr2serr("sg_read failed at or after lba=%" PRId64 " [0x%"
+                        PRIx64 "]\n", op->skip, op->skip);
+                ret = (res < 0) ? SG_LIB_CAT_OTHER : res;
+                break;
+            }
+            if (blks_read < blocks) {
+                op->dd_count = blks_read;       /* last lot */
+                blocks = blks_read;
+            }
+            in_full += blocks;
+        } else if (FT_RANDOM_0_FF & ifp->file_type) {
+            gen_0_ff_random(op, bp, blocks);
+            in_full += blocks;
+        } else {
+            for (n = 0; n < blocks * bs; n += res) {
+                res = read(op->infd, bp + n, blocks * bs - n);
+                if (res < 0) {
+                    if ((EINTR == errno) || (EAGAIN == errno))
+                        res = 0;
+                    else
+                        break;
+                } else if (0 == res)
+                    break;      /* end of input */
+            }
+            if (res < 0) {
+                sg_err_stats_errno(&err_stats, errno);
+                perror("zappend: reading IFILE");
+                ret = sg_convert_errno(errno);
+                break;
+            }
+            if (n < blocks * bs) {
+                blocks = (n + bs - 1) / bs;
+                op->dd_count = blocks;          /* last lot */
+                if (n % bs) {
+                    memset(bp + n, 0, bs - (n % bs));
+                    ++in_partial;
+                    in_full += blocks - 1;
+                } else
+                    in_full += blocks;
+            } else
+                in_full += blocks;
+        }
+        if (0 == blocks)
+            break;
+        ret = sg_dde_zapp_submit(zap, op->skip, blocks);
+        if (ret)
+            break;
+        op->skip += blocks;
+        op->dd_count -= blocks;
+        if ((op->progress > 0) && check_progress(op)) {
+            calc_duration_throughput(true);
+            print_stats("");
+        }
+    }
+    res = sg_dde_zapp_drain(zap);
+    if (0 == ret)
+        ret = res;
+    sg_dde_zapp_get_stats(zap, &st);
+    if (op->verbose || ret)
+        pr2serr("zappend: %" PRId64 " appends to %d zones, at most %d "
+                "outstanding in one zone, %" PRId64 " sent again\n",
+                st.appends, st.zones, st.max_in_zone, st.resent);
+    sg_dde_zapp_free(zap);
+    if (0 == ret)
+        op->dd_count = 0;
+fini:
+    if (stdout == fp)
+        fflush(fp);
+    else if (fclose(fp) && (0 == ret)) {
+        perror("zappend: closing MFILE");
+        ret = SG_LIB_FILE_ERROR;
+    }
+    return ret;
+}
+
+static int
+parse_cmd_line(int argc, char * argv[], struct opts_t * op)
+{
+    int k, n, t, res, keylen;
+    int ibs = 0;
+    int obs = 0;
+    char * key;
+    char * buf;
+    struct flags_t * ifp = &op->iflag;
+    struct flags_t * ofp = &op->oflag;
+    char str[STR_SZ];
+
+    for (k = 1; k < argc; k++) {
+        if (argv[k]) {
+            strncpy(str, argv[k], STR_SZ);
+            str[STR_SZ - 1] = '\0';
+        } else
+            continue;
+        for (key = str, buf = key; *buf && *buf != '=';)
+            buf++;
+        if (*buf)
+            *buf++ = '\0';
+        keylen = strlen(key);
+        if (0 == strncmp(key, "app", 3)) {
+            ifp->append = !! sg_get_num(buf);
+            ofp->append = ifp->append;
+        } else if (0 == strcmp(key, "blk_sgio")) {
             ifp->sgio = !! sg_get_num(buf);
             ofp->sgio = ifp->sgio;
         } else if (0 == strcmp(key, "bpt")) {
-            op->bpt = sg_get_num(buf);
-            if (-1 == op->bpt) {
-                pr2serr("%sbad argument to 'bpt='\n", my_name);
-                return SG_LIB_SYNTAX_ERROR;
+            if (0 == strcmp(buf, "auto"))
+                op->bpt_auto = true;
+            else {
+                op->bpt = sg_get_num(buf);
+                if (-1 == op->bpt) {
+                    pr2serr("%sbad argument to 'bpt='\n", my_name);
+                    return SG_LIB_SYNTAX_ERROR;
+                }
+                op->bpt_given = true;
             }
-            op->bpt_given = true;
         } else if (0 == strcmp(key, "bs")) {
             op->blk_sz = sg_get_num(buf);
             if ((op->blk_sz < 0) || (op->blk_sz > MAX_BPT_VALUE)) {
@@ -2071,6 +4574,25 @@ parse_cmd_line(int argc, char * argv[], struct opts_t * op)
             } else
                 ofp->cdl = ifp->cdl;
             op->cdl_given = true;
+        } else if (0 == strcmp(key, "ckpt")) {
+            char * cp = strrchr(buf, ',');
+
+            if (cp) {
+                *cp = '\0';
+                op->ckpt_secs = sg_get_num(cp + 1);
+                if (op->ckpt_secs < 0) {
+                    pr2serr("%sbad SECS argument to 'ckpt=CFILE,SECS'\n",
+                            my_name);
+                    return SG_LIB_SYNTAX_ERROR;
+                }
+            } else
+                op->ckpt_secs = DEF_CKPT_SECS;
+            if ('\0' == buf[0]) {
+                pr2serr("%s'ckpt=' expects a file name\n", my_name);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            memcpy(op->ckpt_fname, buf, INOUTF_SZ - 1);
+            op->ckpt_fname[INOUTF_SZ - 1] = '\0';
         } else if (0 == strcmp(key, "coe")) {
             ifp->coe = sg_get_num(buf);
             ofp->coe = ifp->coe;
@@ -2115,11 +4637,41 @@ parse_cmd_line(int argc, char * argv[], struct opts_t * op)
                 memcpy(op->in_fname, buf, INOUTF_SZ - 1);
                 op->in_fname[INOUTF_SZ - 1] = '\0';
             }
+            if (sg_pat_is_pat(buf) && (! sg_pat_parse(buf, &op->pat))) {
+                pr2serr("%sbad pattern in 'if=%s'\n", my_name, buf);
+                return SG_LIB_SYNTAX_ERROR;
+            }
         } else if (0 == strcmp(key, "iflag")) {
             if (process_flags(buf, ifp)) {
                 pr2serr("%sbad argument to 'iflag='\n", my_name);
                 return SG_LIB_SYNTAX_ERROR;
             }
+        } else if (0 == strcmp(key, "hash")) {
+            char * cp = strchr(buf, ',');
+
+            if (cp) {
+                *cp = '\0';
+                memcpy(op->hash_mf_fname, cp + 1, INOUTF_SZ - 1);
+                op->hash_mf_fname[INOUTF_SZ - 1] = '\0';
+            }
+            op->hash_alg = sg_hash_alg_from_name(buf);
+            if (op->hash_alg < 0) {
+                pr2serr("%sbad argument to 'hash=', expect crc32c, xxh64 "
+                        "or sha256\n", my_name);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+        } else if (0 == strcmp(key, "interval")) {
+            op->interval = sg_get_num(buf);
+            if (op->interval < 0) {
+                pr2serr("%sbad argument to 'interval='\n", my_name);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+        } else if (0 == strcmp(key, "nbuf")) {
+            op->nbuf = sg_get_num(buf);
+            if ((op->nbuf < 1) || (op->nbuf > 3)) {
+                pr2serr("%snbuf=NBUF expects 1, 2 or 3\n", my_name);
+                return SG_LIB_SYNTAX_ERROR;
+            }
         } else if (0 == strcmp(key, "obs")) {
             obs = sg_get_num(buf);
             if ((obs < 0) || (obs > MAX_BPT_VALUE)) {
@@ -2150,6 +4702,47 @@ parse_cmd_line(int argc, char * argv[], struct opts_t * op)
                 pr2serr("%sbad argument to 'oflag='\n", my_name);
                 return SG_LIB_SYNTAX_ERROR;
             }
+        } else if (0 == strcmp(key, "pi_type")) {
+            char * cp = strchr(buf, ',');
+
+            if (cp) {
+                *cp++ = '\0';
+                op->pi_at = sg_get_num(cp);
+                if ((op->pi_at < 0) || (op->pi_at > UINT16_MAX)) {
+                    pr2serr("%sbad AT in 'pi_type=', expect 0 to 0xffff\n",
+                            my_name);
+                    return SG_LIB_SYNTAX_ERROR;
+                }
+            }
+            op->pi_type = sg_get_num(buf);
+            if ((1 != op->pi_type) && (3 != op->pi_type)) {
+                pr2serr("%sbad argument to 'pi_type=', expect 1 or 3 (Type "
+                        "2 needs 32 byte cdbs)\n", my_name);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+        } else if (0 == strcmp(key, "prefetch")) {
+            char * cp = strchr(buf, ',');
+
+            if (cp) {
+                *cp++ = '\0';
+                op->pf_num = sg_get_num(cp);
+                if ((op->pf_num < 1) || (op->pf_num > MAX_BPT_VALUE)) {
+                    pr2serr("%sbad NUM argument to 'prefetch='\n", my_name);
+                    return SG_LIB_SYNTAX_ERROR;
+                }
+            }
+            op->pf_dist = sg_get_llnum(buf);
+            if ((op->pf_dist < 1) || (op->pf_dist > MAX_COUNT_SKIP_SEEK)) {
+                pr2serr("%sbad DIST argument to 'prefetch='\n", my_name);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+        } else if (0 == strcmp(key, "rate")) {
+            if (! sg_rate_lim_parse(&op->rate_lim, buf)) {
+                pr2serr("%sbad argument to 'rate=', expect BPS[,IOPS] or "
+                        "@FN\n", my_name);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            op->rate_arg = argv[k] + (buf - str);
         } else if (0 == strcmp(key, "retries")) {
             ifp->retries = sg_get_num(buf);
             ofp->retries = ifp->retries;
@@ -2158,20 +4751,60 @@ parse_cmd_line(int argc, char * argv[], struct opts_t * op)
                 return SG_LIB_SYNTAX_ERROR;
             }
         } else if (0 == strcmp(key, "seek")) {
-            op->seek = sg_get_llnum(buf);
-            if ((op->seek < 0) || (op->seek > MAX_COUNT_SKIP_SEEK)) {
-                pr2serr("%sbad argument to 'seek='\n", my_name);
-                return SG_LIB_SYNTAX_ERROR;
+            if (sg_sgl_is_list(buf)) {
+                res = sg_sgl_parse(&op->o_sgl, "seek", buf, true);
+                if (res) {
+                    pr2serr("%sbad scatter gather list to 'seek='\n",
+                            my_name);
+                    return res;
+                }
+                op->seek = (op->o_sgl.sum > 0) ?
+                           sg_sgl_idx_to_lba(&op->o_sgl, 0, NULL) : 0;
+            } else {
+                op->seek = sg_get_llnum(buf);
+                if ((op->seek < 0) || (op->seek > MAX_COUNT_SKIP_SEEK)) {
+                    pr2serr("%sbad argument to 'seek='\n", my_name);
+                    return SG_LIB_SYNTAX_ERROR;
+                }
             }
         } else if (0 == strcmp(key, "skip")) {
-            op->skip = sg_get_llnum(buf);
-            if ((op->skip < 0) || (op->skip > MAX_COUNT_SKIP_SEEK)) {
-                pr2serr("%sbad argument to 'skip='\n", my_name);
-                return SG_LIB_SYNTAX_ERROR;
+            if (sg_sgl_is_list(buf)) {
+                res = sg_sgl_parse(&op->i_sgl, "skip", buf, true);
+                if (res) {
+                    pr2serr("%sbad scatter gather list to 'skip='\n",
+                            my_name);
+                    return res;
+                }
+                op->skip = (op->i_sgl.sum > 0) ?
+                           sg_sgl_idx_to_lba(&op->i_sgl, 0, NULL) : 0;
+            } else {
+                op->skip = sg_get_llnum(buf);
+                if ((op->skip < 0) || (op->skip > MAX_COUNT_SKIP_SEEK)) {
+                    pr2serr("%sbad argument to 'skip='\n", my_name);
+                    return SG_LIB_SYNTAX_ERROR;
+                }
             }
         } else if (0 == strcmp(key, "sync"))
             op->do_sync = !! sg_get_num(buf);
-        else if (0 == strcmp(key, "time")) {
+        else if (0 == strcmp(key, "tbuf")) {
+            char * cp = strchr(buf, ',');
+
+            if (cp) {
+                *cp++ = '\0';
+                op->tbuf_pct = sg_get_num(cp);
+                if ((op->tbuf_pct < 0) || (op->tbuf_pct > 100)) {
+                    pr2serr("%sbad PCT argument to 'tbuf=', expect 0 to "
+                            "100\n", my_name);
+                    return SG_LIB_SYNTAX_ERROR;
+                }
+            }
+            op->tbuf_mb = sg_get_num(buf);
+            if ((op->tbuf_mb < 1) || (op->tbuf_mb > 4095)) {
+                pr2serr("%sbad MB argument to 'tbuf=', expect 1 to 4095\n",
+                        my_name);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+        } else if (0 == strcmp(key, "time")) {
             const char * cp = strchr(buf, ',');
 
             op->do_time = !! sg_get_num(buf);
@@ -2185,7 +4818,25 @@ parse_cmd_line(int argc, char * argv[], struct opts_t * op)
             }
         } else if (0 == strncmp(key, "verb", 4))
             op->verbose = sg_get_num(buf);
-        else if ((keylen > 1) && ('-' == key[0]) && ('-' != key[1])) {
+        else if (0 == strcmp(key, "zappend")) {
+            char * cp = strchr(buf, ',');
+
+            op->zapp_qd = DEF_ZAPP_QD;
+            if (cp) {
+                *cp++ = '\0';
+                op->zapp_qd = sg_get_num(cp);
+                if ((op->zapp_qd < 1) || (op->zapp_qd > 1024)) {
+                    pr2serr("%sbad QD argument to 'zappend=', expect 1 to "
+                            "1024\n", my_name);
+                    return SG_LIB_SYNTAX_ERROR;
+                }
+            }
+            if ('\0' == buf[0]) {
+                pr2serr("%szappend= needs MFILE\n", my_name);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            snprintf(op->zapp_fname, INOUTF_SZ, "%s", buf);
+        } else if ((keylen > 1) && ('-' == key[0]) && ('-' != key[1])) {
             res = 0;
             n = num_chs_in_str(key + 1, keylen - 1, 'c');
             if (n > 0)
@@ -2202,6 +4853,10 @@ parse_cmd_line(int argc, char * argv[], struct opts_t * op)
             n = num_chs_in_str(key + 1, keylen - 1, 'p');
             op->progress += n;
             res += n;
+            n = num_chs_in_str(key + 1, keylen - 1, 'r');
+            if (n > 0)
+                op->resume = true;
+            res += n;
             n = num_chs_in_str(key + 1, keylen - 1, 'v');
             if (n > 0)
                 op->verbose_given = true;
@@ -2229,8 +4884,14 @@ parse_cmd_line(int argc, char * argv[], struct opts_t * op)
                  (0 == strcmp(key, "-?"))) {
             usage();
             return 0;
+        } else if (0 == strncmp(key, "--json", 6)) {
+            op->do_json = true;
+            if (*buf)
+                op->json_arg = argv[k] + (buf - str);
         } else if (0 == strncmp(key, "--progress", 10))
             ++op->progress;
+        else if (0 == strncmp(key, "--resume", 8))
+            op->resume = true;
         else if (0 == strncmp(key, "--verb", 6)) {
             op->verbose_given = true;
             ++op->verbose;
@@ -2246,7 +4907,7 @@ parse_cmd_line(int argc, char * argv[], struct opts_t * op)
     }
     if (op->version_given)
         return 0;
-    if (op->blk_sz <= 0) {
+    if ((op->blk_sz <= 0) && (! op->iflag.simage)) {  /* else from image */
         op->blk_sz = DEF_BLOCK_SIZE;
         pr2serr("Assume default 'bs' ((logical) block size) of %d bytes\n",
                 op->blk_sz);
@@ -2263,11 +4924,13 @@ parse_cmd_line(int argc, char * argv[], struct opts_t * op)
 int
 main(int argc, char * argv[])
 {
-    bool dio_tmp, first;
+    bool dio_tmp, first, um_taken;
     bool do_sync = false;
     bool penult_sparse_skip = false;
     bool sparse_skip = false;
-    int k, res, buf_sz, blocks_per, bs;
+    int res, buf_sz, blocks_per, bs;
+    uint64_t ab_t0 = 0;
+    struct auto_bpt_t ab;
     int retries_tmp, blks_read, bytes_read, bytes_of2, bytes_of;
     int in_sect_sz, out_sect_sz;
     int blocks = 0;
@@ -2275,8 +4938,11 @@ main(int argc, char * argv[])
     int ret = 0;
     int64_t in_num_sect = -1;
     int64_t out_num_sect = -1;
+    uint64_t t0_ns = 0;
     const char * ccp = NULL;
     const char * cc2p;
+    int hp_kind = SG_HUGEPAGE_NONE;
+    uint32_t wrk_sz = 0;
     uint8_t * wrkBuff = NULL;
     uint8_t * wrkPos;
     struct opts_t * op;
@@ -2289,8 +4955,13 @@ main(int argc, char * argv[])
     fscope_op = op;
     op->bpt = DEF_BLOCKS_PER_TRANSFER;
     op->cmd_timeout = DEF_TIMEOUT;   /* in milliseconds */
+    op->um.first_lba = -1;
     op->dd_count = -1;
     op->out2fd = -1;
+    op->pi_at = -1;
+    op->nbuf = 1;
+    op->tbuf_mb = TAPE_DEF_RING_MB;
+    op->tbuf_pct = TAPE_DEF_HIGH_PCT;
     ifp = &op->iflag;
     ofp = &op->oflag;
     ifp->cdbsz = DEF_SCSI_CDBSZ;
@@ -2327,25 +4998,115 @@ main(int argc, char * argv[])
     }
     if (op->progress > 0 && !op->do_time)
         op->do_time = true;
+    if (op->do_json) {
+        sgj_state * jsp = &op->json_st;
+
+        if (! sgj_init_state(jsp, op->json_arg)) {
+            int bad_char = jsp->first_bad_char;
+            char e[1500];
+
+            if (bad_char)
+                pr2serr("bad argument to --json= option, unrecognized "
+                        "character '%c'\n\n", bad_char);
+            sg_json_usage(0, e, sizeof(e));
+            pr2serr("%s", e);
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        /* each interval report is a JSON object on its own line */
+        jsp->pr_exit_status = false;
+        jsp->pr_leadin = false;
+        jsp->pr_pretty = false;
+        jsp->pr_rec_lines = false;
+    }
+    if (op->interval > 0)
+        sg_pt_lat_enable(true);
     if (argc < 2) {
         pr2serr("Won't default both IFILE to stdin _and_ OFILE to stdout\n");
         pr2serr("For more information use '--help'\n");
         return SG_LIB_CONTRADICT;
     }
+    if (op->resume) {
+        if ('\0' == op->ckpt_fname[0]) {
+            pr2serr("--resume needs ckpt=CFILE\n");
+            return SG_LIB_CONTRADICT;
+        }
+        ret = ckpt_resume(op);
+        if (ret)
+            return ret;
+    }
     if ((op->skip < 0) || (op->seek < 0)) {
         pr2serr("skip and seek cannot be negative\n");
         return SG_LIB_CONTRADICT;
     }
-    if (ofp->append && (op->seek > 0)) {
+    if (ofp->append && ((op->seek > 0) || (op->o_sgl.num_elems > 0))) {
         pr2serr("Can't use both append and seek switches\n");
         return SG_LIB_CONTRADICT;
     }
+    if ((op->i_sgl.num_elems > 0) || (op->o_sgl.num_elems > 0)) {
+        if (op->ckpt_fname[0]) {
+            pr2serr("ckpt=CFILE does not support scatter gather lists in "
+                    "skip= or seek=\n");
+            return SG_LIB_CONTRADICT;
+        }
+        if (op->verbose > 1) {
+            if (op->i_sgl.num_elems > 0)
+                sg_sgl_print(&op->i_sgl, "skip", (op->verbose > 2), stderr);
+            if (op->o_sgl.num_elems > 0)
+                sg_sgl_print(&op->o_sgl, "seek", (op->verbose > 2), stderr);
+        }
+        /* count defaults to the (smaller) sum of the list(s) */
+        if (op->dd_count < 0) {
+            if (0 == op->i_sgl.num_elems)
+                op->dd_count = op->o_sgl.sum;
+            else if ((0 == op->o_sgl.num_elems) ||
+                     (op->i_sgl.sum < op->o_sgl.sum))
+                op->dd_count = op->i_sgl.sum;
+            else
+                op->dd_count = op->o_sgl.sum;
+        } else if (((op->i_sgl.num_elems > 0) &&
+                    (op->dd_count > op->i_sgl.sum)) ||
+                   ((op->o_sgl.num_elems > 0) &&
+                    (op->dd_count > op->o_sgl.sum))) {
+            pr2serr("count=%" PRId64 " exceeds the number of blocks in the "
+                    "skip= or seek= list\n", op->dd_count);
+            return SG_LIB_CONTRADICT;
+        }
+    }
     if ((op->bpt < 1) || (op->bpt > MAX_BPT_VALUE)) {
         pr2serr("bpt must be > 0 and <= %d\n", MAX_BPT_VALUE);
         return SG_LIB_SYNTAX_ERROR;
     }
     if (ifp->sparse)
         pr2serr("sparse flag ignored for iflag\n");
+    if (ofp->extents)
+        pr2serr("extents flag ignored for oflag\n");
+    if (ifp->extents && ((op->i_sgl.num_elems > 0) ||
+                         (op->o_sgl.num_elems > 0) || op->ckpt_fname[0])) {
+        pr2serr("iflag=extents can't be used with skip= or seek= lists, or "
+                "ckpt=\n");
+        return SG_LIB_CONTRADICT;
+    }
+    if (ifp->simage || ofp->simage) {
+        if ((op->i_sgl.num_elems > 0) || (op->o_sgl.num_elems > 0) ||
+            op->ckpt_fname[0] || op->do_verify || ifp->pi || ofp->pi ||
+            ifp->tape || ofp->tape || ofp->append || (op->nbuf > 1) ||
+            (op->zapp_qd > 0)) {
+            pr2serr("iflag=simage and oflag=simage can't be used with skip= "
+                    "or seek= lists,\nckpt=, --verify, pi, tape, append, "
+                    "nbuf= or zappend=\n");
+            return SG_LIB_CONTRADICT;
+        }
+        if (ifp->simage && ifp->extents) {
+            pr2serr("iflag=simage and iflag=extents can't be used "
+                    "together\n");
+            return SG_LIB_CONTRADICT;
+        }
+        if (ofp->simage && (ofp->sparse || ofp->unmap)) {
+            pr2serr("oflag=simage leaves holes itself so can't be used with "
+                    "oflag=sparse\nor oflag=unmap\n");
+            return SG_LIB_CONTRADICT;
+        }
+    }
 
     /* defaulting transfer size to 128*2048 for CD/DVDs is too large
        for the block layer in lk 2.6 and results in an EIO on the
@@ -2361,6 +5122,8 @@ main(int argc, char * argv[])
     install_handler(SIGQUIT, interrupt_handler);
     install_handler(SIGPIPE, interrupt_handler);
     install_handler(SIGUSR1, siginfo_handler);
+    if (op->rate_arg && ('@' == op->rate_arg[0]))
+        install_handler(SIGHUP, sighup_handler);
 
     op->infd = STDIN_FILENO;
     op->outfd = STDOUT_FILENO;
@@ -2406,11 +5169,22 @@ main(int argc, char * argv[])
         ifp->file_type = FT_RANDOM_0_FF;
         strcpy(op->in_fname, ccp);
         op->infd = -1;
+    } else if (SG_PAT_NONE != op->pat.kind) {
+        ifp->file_type = FT_RANDOM_0_FF;
+        sg_pat_str(&op->pat, op->in_fname, INOUTF_SZ);
+        if (op->verbose)
+            pr2serr("data from %s\n", op->in_fname);
+        op->infd = -1;
     } else if (op->in_fname[0] && ('-' != op->in_fname[0])) {
         op->infd = open_if(op);
         if (op->infd < 0)
             return -op->infd;
     }
+    if (ifp->simage) {
+        ret = simg_load(op);
+        if (ret)
+            return ret;
+    }
 
     if (op->out_fname[0] && ('-' != op->out_fname[0])) {
         op->outfd = open_of(op);
@@ -2424,11 +5198,40 @@ main(int argc, char * argv[])
             ret = SG_LIB_CONTRADICT;
             goto bypass_copy;
         }
-        if (ofp->sparse) {
-            pr2serr("--verify cannot be used with oflag=sparse\n");
+        if (ofp->sparse || ofp->unmap) {
+            pr2serr("--verify cannot be used with oflag=sparse or "
+                    "oflag=unmap\n");
+            ret = SG_LIB_CONTRADICT;
+            goto bypass_copy;
+        }
+    }
+    if (ifp->pi || ofp->pi) {
+        if (op->do_verify) {
+            pr2serr("--verify cannot be used with iflag=pi or oflag=pi\n");
+            ret = SG_LIB_CONTRADICT;
+            goto bypass_copy;
+        }
+        if ((ifp->pi && ((! (FT_SG & ifp->file_type)) ||
+                         (FT_NVME & ifp->file_type))) ||
+            (ofp->pi && ((! (FT_SG & ofp->file_type)) ||
+                         (FT_NVME & ofp->file_type)))) {
+            pr2serr("iflag=pi and oflag=pi need a SCSI sg device (or "
+                    "iflag=sgio, oflag=sgio)\n");
             ret = SG_LIB_CONTRADICT;
             goto bypass_copy;
         }
+        sg_pi_init();
+        op->pi_ctx.prot_type = op->pi_type ? op->pi_type : 1;
+        op->pi_ctx.blk_len = op->blk_sz;
+        if (op->pi_at >= 0) {
+            op->pi_ctx.app_tag = (uint16_t)op->pi_at;
+            op->pi_ctx.app_mask = 0xffff;
+        }
+        if (op->verbose)
+            pr2serr("PI Type %d on%s%s, guard CRC %s\n",
+                    op->pi_ctx.prot_type, (ifp->pi ? " IFILE" : ""),
+                    (ofp->pi ? " OFILE" : ""),
+                    (sg_pi_crc16_hw() ? "uses pclmul" : "from table"));
     }
     if (op->cdl_given && (! op->cdbsz_given)) {
         bool changed = false;
@@ -2444,6 +5247,92 @@ main(int argc, char * argv[])
         if (changed)
             pr2serr(">> increasing cdbsz to 16 due to cdl > 0\n");
     }
+    if (op->pf_dist > 0) {
+        if ((! (FT_SG & ifp->file_type)) || (op->nbuf > 1) ||
+            (op->i_sgl.num_elems > 0)) {
+            pr2serr("prefetch= needs IFILE accessed with SCSI commands (e.g. "
+                    "a sg device)\nand can't be used with nbuf= or a skip= "
+                    "list\n");
+            ret = SG_LIB_CONTRADICT;
+            goto bypass_copy;
+        }
+        op->pf_next = -1;
+    }
+    if (op->nbuf > 1) {
+        if ((! is_sg_chr_dev(op->infd)) || (! is_sg_chr_dev(op->outfd))) {
+            pr2serr("nbuf=%d needs both IFILE and OFILE to be sg devices "
+                    "(e.g. /dev/sg1)\n", op->nbuf);
+            ret = SG_LIB_CONTRADICT;
+            goto bypass_copy;
+        }
+        if (op->do_verify || ifp->pi || ofp->pi || ofp->sparse ||
+            ofp->unmap || ifp->extents || ifp->coe || ofp->coe ||
+            op->bpt_auto || op->out2_fname[0] || op->ckpt_fname[0] ||
+            (op->i_sgl.num_elems > 0) || (op->o_sgl.num_elems > 0)) {
+            pr2serr("nbuf=%d can't be used with --verify, pi, sparse, unmap, "
+                    "extents, coe,\n"
+                    "bpt=auto, of2=, ckpt= or scatter gather lists\n", op->nbuf);
+            ret = SG_LIB_CONTRADICT;
+            goto bypass_copy;
+        }
+    }
+    if (ifp->tape || ofp->tape) {
+        if ((ifp->tape && ofp->tape) ||
+            (! (FT_SG & (ifp->tape ? ifp : ofp)->file_type)) ||
+            ((FT_SG | FT_RANDOM_0_FF) & (ifp->tape ? ofp : ifp)->file_type)) {
+            pr2serr("iflag=tape or oflag=tape needs that side to be a sg "
+                    "device and\nthe other side a file, pipe or (non sg) "
+                    "device\n");
+            ret = SG_LIB_CONTRADICT;
+            goto bypass_copy;
+        }
+        if ((ifp->tape ? ifp : ofp)->pdt != PDT_TAPE)
+            pr2serr(">> warning: %s does not claim to be a tape drive\n",
+                    ifp->tape ? op->in_fname : op->out_fname);
+        if ((ifp->tape && (op->skip > 0)) || (ofp->tape && (op->seek > 0))) {
+            pr2serr("tape: skip= or seek= on the tape is not supported, "
+                    "position it first\n");
+            ret = SG_LIB_CONTRADICT;
+            goto bypass_copy;
+        }
+        if (op->do_verify || ifp->pi || ofp->pi || ofp->sparse ||
+            ofp->unmap || ifp->extents || ifp->coe || ofp->coe ||
+            (op->nbuf > 1) || (op->pf_dist > 0) || op->bpt_auto ||
+            op->hash_alg || op->rate_arg || op->out2_fname[0] ||
+            op->ckpt_fname[0] || (op->i_sgl.num_elems > 0) ||
+            (op->o_sgl.num_elems > 0)) {
+            pr2serr("iflag=tape and oflag=tape can't be used with --verify, "
+                    "pi, sparse,\nunmap, extents, coe, nbuf=, prefetch=, "
+                    "bpt=auto, hash=, rate=, of2=,\nckpt= or scatter gather "
+                    "lists\n");
+            ret = SG_LIB_CONTRADICT;
+            goto bypass_copy;
+        }
+        if (op->dd_count < 0)
+            op->dd_count = MAX_COUNT_SKIP_SEEK; /* to filemark or EOF */
+    }
+    if (op->zapp_qd > 0) {
+        if ((! (FT_SG & ofp->file_type)) || ifp->tape || ofp->tape) {
+            pr2serr("zappend= needs OFILE to be a zoned sg or NVMe "
+                    "generic device\n");
+            ret = SG_LIB_CONTRADICT;
+            goto bypass_copy;
+        }
+        if (op->do_verify || ifp->pi || ofp->pi || ofp->sparse ||
+            ofp->unmap || ifp->extents || ifp->coe || ofp->coe ||
+            (op->nbuf > 1) || (op->pf_dist > 0) || op->bpt_auto ||
+            op->hash_alg || op->rate_arg || op->out2_fname[0] ||
+            op->ckpt_fname[0] || (op->i_sgl.num_elems > 0) ||
+            (op->o_sgl.num_elems > 0)) {
+            pr2serr("zappend= can't be used with --verify, pi, sparse, "
+                    "unmap, extents,\ncoe, nbuf=, prefetch=, bpt=auto, "
+                    "hash=, rate=, of2=, ckpt= or\nscatter gather lists\n");
+            ret = SG_LIB_CONTRADICT;
+            goto bypass_copy;
+        }
+        if (op->dd_count < 0)
+            op->dd_count = MAX_COUNT_SKIP_SEEK; /* to EOF */
+    }
     if (op->out2_fname[0]) {
         op->out2_type = dd_filetype(op->out2_fname, op);
         if ((op->out2fd = open(op->out2_fname, O_WRONLY | O_CREAT,
@@ -2467,6 +5356,11 @@ main(int argc, char * argv[])
             return SG_LIB_CONTRADICT;
         }
     }
+    if (ofp->simage && ((FT_SG | FT_BLOCK | FT_RAW | FT_DEV_NULL | FT_ST) &
+                        ofp->file_type)) {
+        pr2serr("oflag=simage needs OFILE to be a regular file or a pipe\n");
+        return SG_LIB_CONTRADICT;
+    }
 
     bs = op->blk_sz;
     if ((op->dd_count < 0) || ((op->verbose > 0) && (0 == op->dd_count))) {
@@ -2573,25 +5467,59 @@ main(int argc, char * argv[])
         pr2serr("Couldn't calculate count, please give one\n");
         return SG_LIB_CAT_OTHER;
     }
+    if (ifp->extents) {
+        ret = extents_setup(op);
+        if (ret)
+            return ret;
+    }
+    if (ifp->simage) {
+        ret = simg_extents(op);
+        if (ret)
+            return ret;
+    }
+    ab.num = 0;
+    if (op->bpt_auto && (0 == op->dry_run))
+        auto_bpt_setup(op, &ab);
     if (! op->cdbsz_given) {
         if ((FT_SG & ifp->file_type) && (MAX_SCSI_CDBSZ != ifp->cdbsz) &&
-            (((op->dd_count + op->skip) > UINT_MAX) ||
+            ((((op->i_sgl.num_elems > 0) ? op->i_sgl.high_lba_p1 :
+               (op->dd_count + op->skip)) > UINT_MAX) ||
              (op->bpt > USHRT_MAX))) {
             pr2serr("Note: SCSI command size increased to 16 bytes (for "
                     "'if')\n");
             ifp->cdbsz = MAX_SCSI_CDBSZ;
         }
         if ((FT_SG & ofp->file_type) && (MAX_SCSI_CDBSZ != ofp->cdbsz) &&
-            (((op->dd_count + op->seek) > UINT_MAX) ||
+            ((((op->o_sgl.num_elems > 0) ? op->o_sgl.high_lba_p1 :
+               (op->dd_count + op->seek)) > UINT_MAX) ||
              (op->bpt > USHRT_MAX))) {
             pr2serr("Note: SCSI command size increased to 16 bytes (for "
                     "'of')\n");
             ofp->cdbsz = MAX_SCSI_CDBSZ;
         }
     }
+    /* per command only the LBA and TRANSFER LENGTH need to be filled in */
+    if ((FT_SG & ifp->file_type) &&
+        sg_dd_cdb_tmpl_init(&ifp->tmpl, op->do_verify, false, op)) {
+        ret = SG_LIB_SYNTAX_ERROR;
+        goto bypass_copy;
+    }
+    if ((FT_SG & ofp->file_type) &&
+        sg_dd_cdb_tmpl_init(&ofp->tmpl, op->do_verify, true, op)) {
+        ret = SG_LIB_SYNTAX_ERROR;
+        goto bypass_copy;
+    }
 
-    if (ifp->dio || ifp->direct || ofp->direct ||
-        (FT_RAW & ifp->file_type) || (FT_RAW & ofp->file_type)) {
+    if (ifp->hugepage || ofp->hugepage) {
+        wrk_sz = bs * op->bpt;
+        wrkPos = sg_memalign_hugepage(wrk_sz, &wrkBuff, &hp_kind,
+                                      op->verbose > 0);
+        if (NULL == wrkPos) {
+            pr2serr("sg_memalign_hugepage: error, out of memory?\n");
+            return sg_convert_errno(ENOMEM);
+        }
+    } else if (ifp->dio || ifp->direct || ofp->direct ||
+               (FT_RAW & ifp->file_type) || (FT_RAW & ofp->file_type)) {
         /* want heap buffer aligned to page_size */
         wrkPos = sg_memalign(bs * op->bpt, 0, &wrkBuff, false);
         if (NULL == wrkPos) {
@@ -2606,7 +5534,18 @@ main(int argc, char * argv[])
         }
     }
 
+    if (ifp->pi || ofp->pi) {
+        op->pi_buf = sg_memalign((bs + SG_PI_TUPLE_LEN) * op->bpt, 0,
+                                 &op->free_pi_buf, false);
+        if (NULL == op->pi_buf) {
+            pr2serr("Not enough user memory for PI\n");
+            ret = sg_convert_errno(ENOMEM);
+            goto bypass_copy;
+        }
+    }
     blocks_per = op->bpt;
+    if (ab.num > 0)
+        blocks_per = ab.cands[0];
 #ifdef DEBUG
     pr2serr("Start of loop, count=%" PRId64 ", blocks_per=%d\n",
             op->dd_count, blocks_per);
@@ -2616,15 +5555,64 @@ main(int argc, char * argv[])
         start_tm.tv_usec = 0;
         gettimeofday(&start_tm, NULL);
         start_tm_valid = true;
+        sg_cpu_snap(&start_cpu);
     }
 
     if (op->dry_run > 0) {
         pr2serr("Since --dry-run option given, bypassing copy\n");
         goto bypass_copy;
     }
+    if (ofp->unmap)
+        unmap_setup(op);
+    if (ofp->simage) {
+        ret = simg_open(op);
+        if (ret)
+            goto bypass_copy;
+    }
+
+    if (op->interval > 0)
+        interval_report(op, false);     /* sets the reference */
+    if (op->ckpt_fname[0]) {
+        if (! op->resume) {
+            op->ckpt_skip = op->skip;
+            op->ckpt_seek = op->seek;
+            op->ckpt_count = op->dd_count;
+        }
+        if (! ckpt_write(op, false)) {
+            ret = SG_LIB_FILE_ERROR;
+            goto bypass_copy;
+        }
+    }
+    if (op->hash_alg && (! hash_open(op))) {
+        ret = SG_LIB_FILE_ERROR;
+        op->hash_alg = SG_HASH_NONE;
+        goto bypass_copy;
+    }
+
+    if (op->nbuf > 1)
+        ret = ovl_copy(op, wrkPos, blocks_per);
+    else if (ifp->tape || ofp->tape)
+        ret = tape_copy(op);
+    else if (op->zapp_qd > 0)
+        ret = zapp_copy(op);
 
     /* <<< main loop that does the copy >>> */
-    while (op->dd_count > 0) {
+    while ((op->dd_count > 0) && (op->nbuf < 2) &&
+           (! (ifp->tape || ofp->tape)) && (0 == op->zapp_qd)) {
+        if (err_stats_js) {
+            err_stats_js = 0;
+            err_stats_json(op);
+        }
+        if (rate_reload) {
+            rate_reload = 0;
+            if (! sg_rate_lim_parse(&op->rate_lim, op->rate_arg))
+                pr2serr("SIGHUP: unable to re-read %s, rate unchanged\n",
+                        op->rate_arg + 1);
+            else if (op->verbose)
+                pr2serr("SIGHUP: rate now %" PRId64 " bytes/sec, %" PRId64
+                        " IOPS (0 -> no limit)\n", op->rate_lim.bytes_ps,
+                        op->rate_lim.iops);
+        }
         bytes_read = 0;
         bytes_of = 0;
         bytes_of2 = 0;
@@ -2632,7 +5620,22 @@ main(int argc, char * argv[])
         penult_blocks = penult_sparse_skip ? blocks : 0;
         sparse_skip = false;
         blocks = (op->dd_count > blocks_per) ? blocks_per : op->dd_count;
+        if ((op->i_sgl.num_elems > 0) || (op->o_sgl.num_elems > 0)) {
+            ret = sgl_next(op, &blocks);
+            if (ret)
+                break;
+        }
+        SG_USDT3(dd_seg_start, op->skip, op->seek, blocks);
+        if (ab.num > 0)
+            ab_t0 = sg_get_mono_ns();
+        if (op->rate_arg)
+            sg_rate_lim_wait(&op->rate_lim, (uint64_t)blocks * bs,
+                             (FT_RANDOM_0_FF & ifp->file_type) ? 0 : 1);
+        if (op->interval > 0)
+            t0_ns = sg_get_mono_ns();
         if (FT_SG & ifp->file_type) {
+            if (op->pf_dist > 0)
+                prefetch_ahead(op, blocks);
             dio_tmp = ifp->dio;
             res = sg_read(wrkPos, blocks, op->skip, &dio_tmp, &blks_read, op);
             if (-2 == res) {     /* ENOMEM, find what's available+try that */
@@ -2666,53 +5669,33 @@ main(int argc, char * argv[])
                 in_full += blocks;
                 if (ifp->dio && (! dio_tmp))
                     op->dio_incomplete_count++;
+                if (op->interval > 0)
+                    lat_add(LAT_IN_ID, t0_ns);
             }
         } else if (FT_RANDOM_0_FF & ifp->file_type) {
-            int j;
-
             res = blocks * bs;
-            if (ifp->zero && ifp->ff && (bs >= 4)) {
-                uint32_t pos = (uint32_t)op->skip;
-                uint32_t off;
-
-                for (k = 0, off = 0; k < blocks; ++k, off += bs, ++pos) {
-                    for (j = 0; j < (bs - 3); j += 4)
-                        sg_put_unaligned_be32(pos, wrkPos + off + j);
-                }
-            } else if (ifp->zero)
-                memset(wrkPos, 0, res);
-            else if (ifp->ff)
-                memset(wrkPos, 0xff, res);
-            else {
-                int kk, jj;
-                const int jbump = sizeof(uint32_t);
-                long rn;
-                uint8_t * bp;
-
-                bp = wrkPos;
-                for (kk = 0; kk < blocks; ++kk, bp += bs) {
-                    for (jj = 0; jj < bs; jj += jbump) {
-                       /* mrand48 takes uniformly from [-2^31, 2^31) */
-#ifdef HAVE_SRAND48_R
-                        mrand48_r(&drand, &rn);
-#else
-                        rn = mrand48();
-#endif
-                        *((uint32_t *)(bp + jj)) = (uint32_t)rn;
-                    }
-                }
-            }
+            gen_0_ff_random(op, wrkPos, blocks);
             bytes_read = res;
             in_full += blocks;
+        } else if (ifp->simage) {
+            ret = simg_read(op, wrkPos, blocks);
+            if (ret)
+                break;
+            in_full += blocks;
+            if (op->interval > 0)
+                lat_add(LAT_IN_ID, t0_ns);
         } else {
             while (((res = read(op->infd, wrkPos, blocks * bs)) < 0) &&
                    ((EINTR == errno) || (EAGAIN == errno) ||
                     (EBUSY == errno)))
-                ;
+                sg_err_stats_errno(&err_stats, errno);
+            sg_err_stats_cat(&err_stats, (res < 0) ?
+                             sg_convert_errno(errno) : 0);
             if (op->verbose > 2)
                 pr2serr("read(unix): count=%d, res=%d\n", blocks * bs,
                         res);
             if (res < 0) {
+                sg_err_stats_errno(&err_stats, errno);
                 snprintf(ebuff, EBUFF_SZ, "%sreading, skip=%" PRId64 " ",
                          my_name, op->skip);
                 perror(ebuff);
@@ -2728,10 +5711,15 @@ main(int argc, char * argv[])
             }
             bytes_read = res;
             in_full += blocks;
+            if (op->interval > 0)
+                lat_add(LAT_IN_ID, t0_ns);
         }
 
         if (0 == blocks)
             break;      /* nothing read so leave loop */
+        if (op->hash_alg)
+            hash_range(op, op->skip, blocks, wrkPos,
+                       (bytes_read > 0) ? bytes_read : blocks * bs);
 
         if (op->out2fd >= 0) {
             while (((res = write(op->out2fd, wrkPos, blocks * bs)) < 0) &&
@@ -2762,10 +5750,23 @@ main(int argc, char * argv[])
                     break;
                 }
             }
-            if (0 == memcmp(wrkPos, zeros_buff, blocks * bs))
+            if (sg_all_zeros(wrkPos, blocks * bs))
                 sparse_skip = true;
         }
-        if (sparse_skip) {
+        um_taken = false;
+        if (op->um.mode && sg_all_zeros(wrkPos, blocks * bs)) {
+            ret = unmap_add(op, op->seek, blocks, &um_taken);
+            if (ret) {
+                pr2serr("oflag=unmap failed, seek=%" PRId64 "\n", op->seek);
+                break;
+            }
+        }
+        if (um_taken) {
+            out_unmap_num += blocks;
+            if (op->verbose > 2)
+                pr2serr("unmap instead of sg_write: seek blk=%" PRId64
+                        ", blks=%d\n", op->seek, blocks);
+        } else if (sparse_skip) {
             if (FT_SG & ofp->file_type) {
                 out_sparse_num += blocks;
                 if (op->verbose > 2)
@@ -2794,10 +5795,22 @@ main(int argc, char * argv[])
                             (int64_t)off_res);
                 out_sparse_num += blocks;
             }
+        } else if (ofp->simage) {
+            if (op->interval > 0)
+                t0_ns = sg_get_mono_ns();
+            ret = simg_write(op, wrkPos, blocks, bytes_read);
+            if (ret)
+                break;
+            if (op->interval > 0)
+                lat_add(LAT_OUT_ID, t0_ns);
         } else if (FT_SG & ofp->file_type) {
             dio_tmp = ofp->dio;
             retries_tmp = ofp->retries;
             first = true;
+            if (op->rate_arg)
+                sg_rate_lim_wait(&op->rate_lim, 0, 1);
+            if (op->interval > 0)
+                t0_ns = sg_get_mono_ns();
             while (1) {
                 ret = sg_write(op->outfd, wrkPos, blocks, op->seek,
                                &dio_tmp, op);
@@ -2842,7 +5855,7 @@ main(int argc, char * argv[])
                             (op->do_verify ? "verify" : "write"),
                             (uint64_t)op->seek);
                     --retries_tmp;
-                    ++num_retries;
+                    sg_err_stats_retry(&err_stats);
                     if (unrecovered_errs > 0)
                         --unrecovered_errs;
                 } else
@@ -2859,18 +5872,27 @@ main(int argc, char * argv[])
                 out_full += blocks;
                 if (ofp->dio && (! dio_tmp))
                     op->dio_incomplete_count++;
+                if (op->interval > 0)
+                    lat_add(LAT_OUT_ID, t0_ns);
             }
         } else if (FT_DEV_NULL & ofp->file_type)
             out_full += blocks; /* act as if written out without error */
         else {
+            if (op->rate_arg)
+                sg_rate_lim_wait(&op->rate_lim, 0, 1);
+            if (op->interval > 0)
+                t0_ns = sg_get_mono_ns();
             while (((res = write(op->outfd, wrkPos, blocks * bs)) < 0) &&
                    ((EINTR == errno) || (EAGAIN == errno) ||
                     (EBUSY == errno)))
-                ;
+                sg_err_stats_errno(&err_stats, errno);
+            sg_err_stats_cat(&err_stats, (res < 0) ?
+                             sg_convert_errno(errno) : 0);
             if (op->verbose > 2)
                 pr2serr("write(unix): count=%d, res=%d\n", blocks * bs,
                         res);
             if (res < 0) {
+                sg_err_stats_errno(&err_stats, errno);
                 snprintf(ebuff, EBUFF_SZ, "%swriting, seek=%" PRId64 " ",
                          my_name, op->seek);
                 perror(ebuff);
@@ -2888,6 +5910,8 @@ main(int argc, char * argv[])
             } else {
                 out_full += blocks;
                 bytes_of = res;
+                if (op->interval > 0)
+                    lat_add(LAT_OUT_ID, t0_ns);
             }
         }
 #ifdef HAVE_POSIX_FADVISE
@@ -2922,17 +5946,66 @@ main(int argc, char * argv[])
             }
         }
 #endif
+        SG_USDT3(dd_seg_done, op->skip, op->seek, blocks);
         if (op->dd_count > 0)
             op->dd_count -= blocks;
         op->skip += blocks;
         op->seek += blocks;
+        op->sgl_idx += blocks;
+        if (ab.num > 0)
+            blocks_per = auto_bpt_next(op, &ab, blocks_per, blocks,
+                                       sg_get_mono_ns() - ab_t0);
         if (op->progress > 0) {
             if (check_progress(op)) {
                 calc_duration_throughput(true);
                 print_stats("");
             }
         }
+        if (op->interval > 0)
+            interval_report(op, false);
+        if (op->ckpt_fname[0])
+            ckpt_write(op, false);
     } /* end of main loop that does the copy ... */
+    if ((0 == ret) && (op->ext_end > op->seek) && (0 == op->dd_count)) {
+        /* unmapped tail of IFILE */
+        ret = extents_hole(op, op->seek, op->ext_end);
+        if ((0 == ret) &&
+            ((FT_OTHER | FT_BLOCK | FT_ERROR) & ofp->file_type) &&
+            (! (FT_SG & ofp->file_type)) && (! ofp->simage)) {
+            struct stat st;
+
+            if ((0 == fstat(op->outfd, &st)) && S_ISREG(st.st_mode) &&
+                (st.st_size < ((off64_t)op->ext_end * bs)) &&
+                (ftruncate(op->outfd, (off64_t)op->ext_end * bs) < 0))
+                perror("iflag=extents: ftruncate on output");
+        }
+    }
+    if (op->um.first_lba >= 0) {
+        res = unmap_flush(op, false);
+        if (res && (0 == ret)) {
+            pr2serr("oflag=unmap failed at end of copy\n");
+            ret = res;
+        }
+    }
+    if (op->interval > 0)
+        interval_report(op, true);
+    if (op->ckpt_fname[0])
+        ckpt_write(op, true);
+    if (op->hash_alg)
+        hash_close(op);
+    if (ofp->simage && op->simg.hdr.alg) {
+        int64_t tot_blks = op->seek;
+
+        if ((0 == ret) && (op->ext_end > tot_blks))
+            tot_blks = op->ext_end;     /* unmapped tail of IFILE */
+        res = simg_close(op, tot_blks);
+        if (res && (0 == ret))
+            ret = res;
+    }
+    if (ifp->simage && (op->verbose || op->simg.num_checked))
+        pr2serr("iflag=simage: CRC32C of %" PRId64 " extent%s checked\n",
+                op->simg.num_checked,
+                (1 == op->simg.num_checked) ? "" : "s");
 
     if (ret && penult_sparse_skip && (penult_blocks > 0)) {
         /* if error and skipped last output due to sparse ... */
@@ -2956,7 +6029,7 @@ main(int argc, char * argv[])
     }
 
     if (do_sync) {
-        if (FT_SG & ofp->file_type) {
+        if ((FT_SG & ofp->file_type) && (! ofp->tape)) {
             pr2serr(">> Synchronizing cache on %s\n", op->out_fname);
             res = sg_ll_sync_cache_10(op->outfd, false, false, 0, 0, 0, true,
                                       0);
@@ -2971,15 +6044,26 @@ main(int argc, char * argv[])
     }
 
 bypass_copy:
-    if (op->do_time)
+    if (op->do_time) {
+        struct sg_cpu_cost cc;
+
         calc_duration_throughput(false);
+        if ((op->dry_run < 1) && cpu_cost_so_far(op, &cc))
+            sg_cpu_cost_pr(&cc, "");
+    }
     if (op->progress > 0)
         pr2serr("\nCompleted:\n");
 
     if (wrkBuff)
-        free(wrkBuff);
+        sg_free_hugepage(wrkBuff, wrk_sz, hp_kind);
     if (free_zeros_buff)
         free(free_zeros_buff);
+    free(op->um.param);
+    free(op->um.zbuf);
+    free(op->free_pi_buf);
+    sg_sgl_free(&op->i_sgl);
+    sg_sgl_free(&op->o_sgl);
+    free(op->simg.ents);
     if (op->in_ptp)
         destruct_scsi_pt_obj(op->in_ptp);
     if (op->out_ptp)
@@ -3016,6 +6100,8 @@ bypass_copy:
     }
     if (op->sum_of_resids)
         pr2serr(">> Non-zero sum of residual counts=%d\n", op->sum_of_resids);
+    if (op->do_json)
+        err_stats_json(op);
 
 bypass2:
     return (ret >= 0) ? ret : SG_LIB_CAT_OTHER;
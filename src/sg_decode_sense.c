@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2010-2023 Douglas Gilbert.
+ * Copyright (c) 2010-2026 Douglas Gilbert.
  * All rights reserved.
  * Use of this source code is governed by a BSD-style
  * license that can be found in the BSD_LICENSE file.
@@ -25,19 +25,29 @@
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
+#ifndef SG_LIB_WIN32
+#define SG_DECODE_SENSE_THREADS 1       /* --stream decodes in a pool */
+#include <pthread.h>
+#endif
 #include "sg_lib.h"
+#include "sg_par.h"
 #include "sg_pr2serr.h"
 #include "sg_json_sg_lib.h"
 #include "sg_unaligned.h"
+#include "sg_batch.h"
 
 
-static const char * version_str = "1.43 20230517";
+static const char * version_str = "1.45 20261015";
 
 #define MY_NAME "sg_decode_sense"
 
 #define MAX_SENSE_LEN 8192 /* max descriptor format actually: 255+8 */
 
+#define STRM_MAX_SB_LEN 264     /* longest sense buffer in a --stream line */
+#define STRM_CHUNK_SZ (256 * 1024)      /* whole lines handed to a worker */
+
 static struct option long_options[] = {
+    {"batch", required_argument, 0, 'B'},
     {"binary", required_argument, 0, 'b'},
     {"cdb", no_argument, 0, 'c'},
     {"err", required_argument, 0, 'e'},
@@ -57,7 +67,9 @@ static struct option long_options[] = {
     {"list_err", no_argument, 0, 'l'},
     {"nodecode", no_argument, 0, 'N'},
     {"nospace", no_argument, 0, 'n'},
+    {"parallel", required_argument, 0, 'P'},
     {"status", required_argument, 0, 's'},
+    {"stream", no_argument, 0, 'S'},
     {"verbose", no_argument, 0, 'v'},
     {"version", no_argument, 0, 'V'},
     {"write", required_argument, 0, 'w'},
@@ -71,6 +83,7 @@ struct opts_t {
     bool do_json;
     bool do_list_err;
     bool do_status;
+    bool do_stream;
     bool no_decode;
     bool no_space;
     bool verbose_given;
@@ -78,10 +91,12 @@ struct opts_t {
     bool err_given;
     bool file_given;
     bool ignore_first;
+    const char * batch_fn;
     const char * fname;
     int es_val;
     int es_up_val;
     int hex_count;
+    int num_parallel;   /* --batch=MF or --stream, 0 -> number of cpus */
     int sense_len;
     int sstatus;
     int verbose;
@@ -99,16 +114,24 @@ static char concat_buff[1024];
 static void
 usage()
 {
-  pr2serr("Usage: sg_decode_sense [--binary=BFN] [--cdb] [--err=ES[,LES]] "
-          "[--file=HFN]\n"
-          "                       [--help] [--hex] [--inhex=HFN] "
-          "[--ignore-first]\n"
-          "                       [--json[=JO]] [--js_file=JFN] "
-          "[--list-err]\n"
-          "                       [--nodecode] [--nospace] [--status=SS] "
-          "[--verbose]\n"
-          "                       [--version] [--write=WFN] H1 H2 H3 ...\n"
+  pr2serr("Usage: sg_decode_sense [--batch=MF] [--binary=BFN] [--cdb] "
+          "[--err=ES[,LES]]\n"
+          "                       [--file=HFN] [--help] [--hex] "
+          "[--inhex=HFN]\n"
+          "                       [--ignore-first] [--json[=JO]] "
+          "[--js_file=JFN]\n"
+          "                       [--list-err] [--nodecode] [--nospace] "
+          "[--parallel=Q]\n"
+          "                       [--status=SS] [--stream] [--verbose] "
+          "[--version]\n"
+          "                       [--write=WFN]\n"
+          "                       H1 H2 H3 ...\n"
           "  where:\n"
+          "    --batch=MF|-B MF      decode each blob named in manifest MF "
+          "(lines of\n"
+          "                          'TAG FN [bin|hex]') as with "
+          "--file=FN, output\n"
+          "                          a JSON line for each\n"
           "    --binary=BFN|-b BFN    BFN is a file name to read sense "
           "data in\n"
           "                          binary from. If BFN is '-' then read "
@@ -152,7 +175,17 @@ usage()
           "    --nospace|-n          no spaces or other separators between "
           "pairs of\n"
           "                          hex digits (e.g. '3132330A')\n"
+          "    --parallel=Q|-P Q     with --batch=MF decode up to Q blobs "
+          "at once,\n"
+          "                          with --stream use Q threads (def: 0 "
+          "-> number\n"
+          "                          of processors)\n"
           "    --status=SS |-s SS    SCSI status value in hex\n"
+          "    --stream|-S           decode a sense buffer in hex on each "
+          "line of stdin\n"
+          "                          (or HFN), optionally preceded by "
+          "TIMESTAMP and\n"
+          "                          op=OPC; output a JSON line for each\n"
           "    --verbose|-v          increase verbosity\n"
           "    --version|-V          print version string then exit\n"
           "    --write=WFN |-w WFN    write sense data in binary to WFN, "
@@ -201,6 +234,9 @@ chk_short_opts(const char sopt_ch, struct opts_t * op)
     case 'N':
         op->no_decode = true;
         break;
+    case 'S':
+        op->do_stream = true;
+        break;
     case 'v':
         op->verbose_given = true;
         ++op->verbose;
@@ -226,7 +262,7 @@ parse_cmd_line(struct opts_t *op, int argc, char *argv[])
     char * endptr;
 
     while (1) {
-        c = getopt_long(argc, argv, "^b:ce:f:hHi:Ij::J:lnNs:vVw:",
+        c = getopt_long(argc, argv, "^b:B:ce:f:hHi:Ij::J:lnNP:s:SvVw:",
                         long_options, NULL);
         if (c == -1)
             break;
@@ -241,6 +277,9 @@ parse_cmd_line(struct opts_t *op, int argc, char *argv[])
             op->do_binary = true;
             op->fname = optarg;
             break;
+        case 'B':
+            op->batch_fn = optarg;
+            break;
         case 'c':
             op->do_cdb = true;
             break;
@@ -327,6 +366,12 @@ parse_cmd_line(struct opts_t *op, int argc, char *argv[])
         case 'N':
             op->no_decode = true;
             break;
+        case 'P':
+            op->num_parallel = sg_par_get_num(optarg, 0,
+                                              SG_BATCH_MAX_PARALLEL);
+            if (op->num_parallel < 0)
+                return SG_LIB_SYNTAX_ERROR;
+            break;
         case 's':
             if (1 != sscanf(optarg, "%x", &ui)) {
                 pr2serr("'--status=SS' expects a byte value\n");
@@ -339,6 +384,9 @@ parse_cmd_line(struct opts_t *op, int argc, char *argv[])
             op->do_status = true;
             op->sstatus = ui;
             break;
+        case 'S':
+            op->do_stream = true;
+            break;
         case 'v':
             op->verbose_given = true;
             ++op->verbose;
@@ -459,6 +507,533 @@ write2wfn(FILE * fp, struct opts_t * op)
 }
 
 
+/* --stream: each line of input is a record of the form
+ *     [TIMESTAMP] [op=OPC] HH HH HH ...
+ * where TIMESTAMP (also accepted as ts=TIMESTAMP) is a single token that is
+ * not hexadecimal and OPC is the opcode (in hex) of the command that
+ * yielded the sense buffer. The sense buffer follows as hex bytes, either
+ * separated by whitespace or commas, or run together. Blank lines and
+ * those starting with '#' are skipped. Input is taken in chunks of whole
+ * lines; each chunk is decoded, into JSON lines, by a pool of threads.
+ * Chunks are output in the order they were read. */
+
+enum strm_state_e {
+    STRM_FREE = 0,
+    STRM_FILLED,        /* lines in 'in', waiting for a worker */
+    STRM_BUSY,
+    STRM_DONE,          /* JSON lines in 'out', waiting to be written */
+};
+
+struct strm_chunk {
+    int state;          /* STRM_* */
+    int in_len;
+    int out_len;
+    int out_sz;
+    int num_bad;        /* records that could not be decoded */
+    int64_t first_lnum; /* line number of first line in 'in' */
+    char * in;          /* STRM_CHUNK_SZ bytes */
+    char * out;
+};
+
+struct strm_ctl {
+    bool stop;          /* reader has seen end of input */
+    int num_slots;
+    int verbose;
+    int64_t next_decode;        /* sequence number of next chunk to decode */
+    struct strm_chunk * slots;  /* ring, sequence number modulo num_slots */
+#ifdef SG_DECODE_SENSE_THREADS
+    pthread_mutex_t mtx;
+    pthread_cond_t filled_cv;   /* a chunk is FILLED or stop is set */
+    pthread_cond_t done_cv;     /* a chunk is DONE */
+#endif
+};
+
+static int
+strm_hexval(char c)
+{
+    if ((c >= '0') && (c <= '9'))
+        return c - '0';
+    c |= 0x20;
+    if ((c >= 'a') && (c <= 'f'))
+        return c - 'a' + 10;
+    return -1;
+}
+
+static bool
+strm_is_sep(char c)
+{
+    return ((' ' == c) || ('\t' == c) || (',' == c) || ('\r' == c));
+}
+
+/* Appends s[0..slen) to b (of blen bytes, starting at off) as a JSON
+ * string, with quotes. Returns the new offset. */
+static int
+strm_js_str(char * b, int blen, int off, const char * s, int slen)
+{
+    int k;
+    uint8_t c;
+
+    off += sg_scn3pr(b, blen, off, "\"");
+    for (k = 0; (k < slen) && (off < (blen - 8)); ++k) {
+        c = (uint8_t)s[k];
+        if (('"' == c) || ('\\' == c))
+            off += sg_scn3pr(b, blen, off, "\\%c", c);
+        else if (c < 0x20)
+            off += sg_scn3pr(b, blen, off, "\\u%04x", c);
+        else
+            b[off++] = c;
+    }
+    if (off < blen)
+        b[off] = '\0';
+    off += sg_scn3pr(b, blen, off, "\"");
+    return off;
+}
+
+/* Parses one hex token (optionally with a "0x" prefix) of one or two hex
+ * digits, or an even number of them run together, appending to sb. Returns
+ * false if it is not hex or sb would overflow. */
+static bool
+strm_hex_tok(const char * tp, int tlen, uint8_t * sb, int * sb_lenp)
+{
+    int k, hi, lo;
+    int n = *sb_lenp;
+
+    if ((tlen > 2) && ('0' == tp[0]) && ('x' == (tp[1] | 0x20))) {
+        tp += 2;
+        tlen -= 2;
+    }
+    if ((tlen < 1) || ((tlen > 2) && (tlen & 1)))
+        return false;
+    if ((*sb_lenp + ((tlen + 1) / 2)) > STRM_MAX_SB_LEN)
+        return false;
+    for (k = 0; k < tlen; k += 2) {
+        if (1 == tlen) {
+            hi = 0;
+            lo = strm_hexval(tp[0]);
+        } else {
+            hi = strm_hexval(tp[k]);
+            lo = strm_hexval(tp[k + 1]);
+        }
+        if ((hi < 0) || (lo < 0))
+            return false;
+        sb[n++] = (uint8_t)((hi << 4) | lo);
+    }
+    *sb_lenp = n;
+    return true;
+}
+
+/* Decodes the line lp[0..llen) numbered lnum, appending a JSON line to b
+ * (of blen bytes). Returns bytes written, 0 for a line that is skipped.
+ * Sets *badp if the record could not be decoded. Uses nothing but the
+ * stack so any number of these may run at once. */
+static int
+strm_decode_line(const char * lp, int llen, int64_t lnum, char * b, int blen,
+                 bool * badp)
+{
+    bool hex_seen = false;
+    int k, n, tlen, sb_len, ts_len, opcode;
+    const char * tp;
+    const char * ts = NULL;
+    const char * err = NULL;
+    const char * ep = lp + llen;
+    struct sg_sense_decode_t sd;
+    uint8_t sb[STRM_MAX_SB_LEN];
+    char e[160];
+
+    *badp = false;
+    while ((lp < ep) && strm_is_sep(*lp))
+        ++lp;
+    if ((lp >= ep) || ('#' == *lp))
+        return 0;
+    ts_len = 0;
+    opcode = -1;
+    sb_len = 0;
+    for (tp = lp; tp < ep; tp += tlen) {
+        while ((tp < ep) && strm_is_sep(*tp))
+            ++tp;
+        if (tp >= ep)
+            break;
+        for (tlen = 0; ((tp + tlen) < ep) && (! strm_is_sep(tp[tlen]));
+             ++tlen)
+            ;
+        if ((! hex_seen) && (tlen > 3) && (0 == memcmp(tp, "ts=", 3))) {
+            ts = tp + 3;
+            ts_len = tlen - 3;
+            continue;
+        }
+        if ((! hex_seen) && (tlen > 3) && (0 == memcmp(tp, "op=", 3))) {
+            if ((tlen > 5) || (strm_hexval(tp[3]) < 0) ||
+                ((5 == tlen) && (strm_hexval(tp[4]) < 0))) {
+                err = "bad op=OPC";
+                break;
+            }
+            opcode = strm_hexval(tp[3]);
+            if (5 == tlen)
+                opcode = (opcode << 4) | strm_hexval(tp[4]);
+            continue;
+        }
+        if (strm_hex_tok(tp, tlen, sb, &sb_len)) {
+            hex_seen = true;
+            continue;
+        }
+        if ((! hex_seen) && (NULL == ts)) {
+            ts = tp;
+            ts_len = tlen;
+            continue;
+        }
+        if (sb_len >= STRM_MAX_SB_LEN)
+            err = "sense data too long";
+        else
+            err = "bad hex";
+        break;
+    }
+    n = sg_scnpr(b, blen, "{\"line\":%" PRId64, lnum);
+    if (ts) {
+        n += sg_scn3pr(b, blen, n, ",\"timestamp\":");
+        n = strm_js_str(b, blen, n, ts, ts_len);
+    }
+    if (opcode >= 0) {
+        sg_get_opcode_name((uint8_t)opcode, 0 /* disk */, sizeof(e), e);
+        n += sg_scn3pr(b, blen, n, ",\"opcode\":%d,\"command_name\":",
+                       opcode);
+        n = strm_js_str(b, blen, n, e, strlen(e));
+    }
+    if ((NULL == err) && (0 == sb_len))
+        err = "no sense data";
+    if ((NULL == err) && (! sg_decode_sense(sb, sb_len, &sd))) {
+        snprintf(e, sizeof(e), "response code 0x%x not decoded",
+                 sb[0] & 0x7f);
+        err = e;
+    }
+    if (err) {
+        *badp = true;
+        n += sg_scn3pr(b, blen, n, ",\"error\":");
+        n = strm_js_str(b, blen, n, err, strlen(err));
+        n += sg_scn3pr(b, blen, n, "}\n");
+        return n;
+    }
+    n += sg_scn3pr(b, blen, n, ",\"response_code\":%d,\"sense_key\":%d,"
+                   "\"sense_key_str\":", sd.resp_code, sd.sense_key);
+    sg_get_sense_key_str(sd.sense_key, sizeof(e), e);
+    n = strm_js_str(b, blen, n, e, strlen(e));
+    n += sg_scn3pr(b, blen, n, ",\"additional_sense_code\":%d,"
+                   "\"additional_sense_code_qualifier\":%d,"
+                   "\"additional_sense_str\":", sd.asc, sd.ascq);
+    sg_get_additional_sense_str(sd.asc, sd.ascq, false, sizeof(e), e);
+    n = strm_js_str(b, blen, n, e, strlen(e));
+    n += sg_scn3pr(b, blen, n, ",\"category\":%d", sd.category);
+    if (sg_exit2str(sd.category, false, sizeof(e), e) && e[0]) {
+        n += sg_scn3pr(b, blen, n, ",\"category_str\":");
+        n = strm_js_str(b, blen, n, e, strlen(e));
+    }
+    if (sd.deferred)
+        n += sg_scn3pr(b, blen, n, ",\"deferred\":true");
+    if (sd.info_valid)
+        n += sg_scn3pr(b, blen, n, ",\"information\":%" PRIu64, sd.info);
+    if (sd.cmd_spec_valid)
+        n += sg_scn3pr(b, blen, n, ",\"command_specific_information\":%"
+                       PRIu64, sd.cmd_spec);
+    if (sd.progress_valid) {
+        k = (sd.progress * 100) / 65536;
+        n += sg_scn3pr(b, blen, n, ",\"progress_indication\":%d,"
+                       "\"progress_percent\":%d", sd.progress, k);
+    }
+    if (sd.sksv)
+        n += sg_scn3pr(b, blen, n, ",\"sense_key_specific\":%d",
+                       sg_get_unaligned_be24(sd.sks) & 0x7fffff);
+    n += sg_scn3pr(b, blen, n, "}\n");
+    return n;
+}
+
+/* Decodes the lines in cp->in into JSON lines in cp->out. Returns false if
+ * out of memory. */
+static bool
+strm_decode_chunk(struct strm_chunk * cp)
+{
+    bool bad;
+    int k, llen;
+    int64_t lnum = cp->first_lnum;
+    const char * lp;
+    const char * nlp;
+    const char * ep = cp->in + cp->in_len;
+    char * bp;
+
+    cp->out_len = 0;
+    cp->num_bad = 0;
+    for (lp = cp->in; lp < ep; lp = nlp + 1, ++lnum) {
+        nlp = (const char *)memchr(lp, '\n', ep - lp);
+        if (NULL == nlp)
+            nlp = ep;
+        llen = nlp - lp;
+        if ((cp->out_sz - cp->out_len) < 2048) {
+            k = cp->out_sz ? (2 * cp->out_sz) : (2 * STRM_CHUNK_SZ);
+            bp = (char *)realloc(cp->out, k);
+            if (NULL == bp)
+                return false;
+            cp->out = bp;
+            cp->out_sz = k;
+        }
+        cp->out_len += strm_decode_line(lp, llen, lnum, cp->out + cp->out_len,
+                                        cp->out_sz - cp->out_len, &bad);
+        if (bad)
+            ++cp->num_bad;
+    }
+    return true;
+}
+
+#ifdef SG_DECODE_SENSE_THREADS
+
+static void *
+strm_worker(void * v_ctlp)
+{
+    struct strm_ctl * ctlp = (struct strm_ctl *)v_ctlp;
+    struct strm_chunk * cp;
+
+    pthread_mutex_lock(&ctlp->mtx);
+    while (true) {
+        cp = ctlp->slots + (ctlp->next_decode % ctlp->num_slots);
+        if (STRM_FILLED == cp->state) {
+            cp->state = STRM_BUSY;
+            ++ctlp->next_decode;
+            pthread_mutex_unlock(&ctlp->mtx);
+            if (! strm_decode_chunk(cp))
+                cp->out_len = -1;
+            pthread_mutex_lock(&ctlp->mtx);
+            cp->state = STRM_DONE;
+            pthread_cond_signal(&ctlp->done_cv);
+            continue;
+        }
+        if (ctlp->stop)
+            break;
+        pthread_cond_wait(&ctlp->filled_cv, &ctlp->mtx);
+    }
+    pthread_mutex_unlock(&ctlp->mtx);
+    return NULL;
+}
+
+#endif  /* SG_DECODE_SENSE_THREADS */
+
+/* Reads whole lines from fp into cp->in, the start of a line that does
+ * not fit is kept in carry (of *carry_lenp bytes) for the next chunk. A
+ * line longer than a chunk is cut; its remainder is dropped. Returns the
+ * number of lines placed in cp->in, 0 at end of input or -1 on error. */
+static int
+strm_fill(FILE * fp, struct strm_chunk * cp, char * carry, int * carry_lenp,
+          bool * skip_nlp)
+{
+    int k, n, num;
+    size_t s;
+    char * lnlp;
+    char * nlp;
+
+    n = *carry_lenp;
+    if (n > 0)
+        memcpy(cp->in, carry, n);
+    *carry_lenp = 0;
+    while (true) {
+        s = fread(cp->in + n, 1, STRM_CHUNK_SZ - n, fp);
+        if (ferror(fp))
+            return -1;
+        n += s;
+        if ((! *skip_nlp) || (0 == n))
+            break;
+        nlp = (char *)memchr(cp->in, '\n', n);
+        if (nlp) {
+            *skip_nlp = false;
+            k = (nlp + 1) - cp->in;
+            memmove(cp->in, nlp + 1, n - k);
+            n -= k;
+            if ((n > 0) || feof(fp))
+                break;
+        } else if (feof(fp))
+            return 0;
+        else
+            n = 0;      /* still in the line being dropped */
+    }
+    cp->in_len = n;
+    if (0 == n)
+        return 0;
+    for (num = 0, lnlp = NULL, nlp = cp->in;
+         (nlp = (char *)memchr(nlp, '\n', (cp->in + n) - nlp)); ++nlp) {
+        lnlp = nlp;
+        ++num;
+    }
+    if (lnlp) {
+        k = (lnlp + 1) - cp->in;
+        if ((k < n) && (! feof(fp))) {
+            *carry_lenp = n - k;
+            memcpy(carry, lnlp + 1, n - k);
+            cp->in_len = k;
+        } else if (k < n)
+            ++num;      /* last line lacks a '\n' */
+    } else {            /* one line, possibly too long for a chunk */
+        num = 1;
+        if ((STRM_CHUNK_SZ == n) && (! feof(fp)))
+            *skip_nlp = true;
+    }
+    return num;
+}
+
+/* Handles --stream, reading lines from fp until end of input. Returns 0
+ * or an exit status. */
+static int
+strm_run(FILE * fp, const struct opts_t * op)
+{
+    bool skip_nl = false;
+    int k, n, num_thr, carry_len;
+    int ret = 0;
+    int64_t seq_fill, seq_write, lnum, num_bad;
+    long lval;
+    size_t s;
+    struct strm_chunk * cp;
+    char * carry = NULL;
+    struct strm_ctl ctl;
+#ifdef SG_DECODE_SENSE_THREADS
+    pthread_t thr_arr[SG_BATCH_MAX_PARALLEL];
+#endif
+
+    memset(&ctl, 0, sizeof(ctl));
+    num_thr = op->num_parallel;
+    if (num_thr <= 0) {
+        lval = sysconf(_SC_NPROCESSORS_ONLN);
+        num_thr = (lval > 0) ? (int)lval : 1;
+        if (num_thr > SG_BATCH_MAX_PARALLEL)
+            num_thr = SG_BATCH_MAX_PARALLEL;
+    }
+#ifndef SG_DECODE_SENSE_THREADS
+    num_thr = 1;
+#endif
+    ctl.num_slots = (num_thr > 1) ? (2 * num_thr) : 1;
+    ctl.verbose = op->verbose;
+    ctl.slots = (struct strm_chunk *)calloc(ctl.num_slots, sizeof(*cp));
+    carry = (char *)malloc(STRM_CHUNK_SZ);
+    if ((NULL == ctl.slots) || (NULL == carry))
+        goto nomem;
+    for (k = 0; k < ctl.num_slots; ++k) {
+        ctl.slots[k].in = (char *)malloc(STRM_CHUNK_SZ);
+        if (NULL == ctl.slots[k].in)
+            goto nomem;
+    }
+#ifdef SG_DECODE_SENSE_THREADS
+    pthread_mutex_init(&ctl.mtx, NULL);
+    pthread_cond_init(&ctl.filled_cv, NULL);
+    pthread_cond_init(&ctl.done_cv, NULL);
+    for (k = 0; k < ((num_thr > 1) ? num_thr : 0); ++k) {
+        if (pthread_create(thr_arr + k, NULL, strm_worker, &ctl))
+            break;
+    }
+    num_thr = k;
+#else
+    num_thr = 0;
+#endif
+    if (op->verbose)
+        pr2serr("%s: %d decode threads, %d chunks of %d bytes\n", __func__,
+                num_thr, ctl.num_slots, STRM_CHUNK_SZ);
+    seq_fill = 0;
+    seq_write = 0;
+    lnum = 1;
+    num_bad = 0;
+    carry_len = 0;
+    while (true) {
+        /* fill free chunks, a worker starts on each as soon as it is full */
+        while ((! ctl.stop) && ((seq_fill - seq_write) < ctl.num_slots)) {
+            cp = ctl.slots + (seq_fill % ctl.num_slots);
+            n = strm_fill(fp, cp, carry, &carry_len, &skip_nl);
+            if (n <= 0) {
+                if (n < 0) {
+                    pr2serr("%s: read error: %s\n", __func__,
+                            safe_strerror(errno));
+                    ret = SG_LIB_FILE_ERROR;
+                }
+#ifdef SG_DECODE_SENSE_THREADS
+                pthread_mutex_lock(&ctl.mtx);
+                ctl.stop = true;
+                pthread_cond_broadcast(&ctl.filled_cv);
+                pthread_mutex_unlock(&ctl.mtx);
+#else
+                ctl.stop = true;
+#endif
+                break;
+            }
+            cp->first_lnum = lnum;
+            lnum += n;
+            ++seq_fill;
+            if (0 == num_thr) {
+                if (! strm_decode_chunk(cp))
+                    cp->out_len = -1;
+                cp->state = STRM_DONE;
+                break;
+            }
+#ifdef SG_DECODE_SENSE_THREADS
+            pthread_mutex_lock(&ctl.mtx);
+            cp->state = STRM_FILLED;
+            pthread_cond_signal(&ctl.filled_cv);
+            pthread_mutex_unlock(&ctl.mtx);
+#endif
+        }
+        if (seq_write >= seq_fill)
+            break;
+        /* write out the oldest chunk once it is decoded */
+        cp = ctl.slots + (seq_write % ctl.num_slots);
+#ifdef SG_DECODE_SENSE_THREADS
+        pthread_mutex_lock(&ctl.mtx);
+        while (STRM_DONE != cp->state)
+            pthread_cond_wait(&ctl.done_cv, &ctl.mtx);
+        pthread_mutex_unlock(&ctl.mtx);
+#endif
+        if (cp->out_len < 0) {
+            pr2serr("%s: out of memory\n", __func__);
+            ret = sg_convert_errno(ENOMEM);
+            break;
+        }
+        s = fwrite(cp->out, 1, cp->out_len, stdout);
+        if ((int)s != cp->out_len) {
+            pr2serr("%s: write error: %s\n", __func__, safe_strerror(errno));
+            ret = SG_LIB_FILE_ERROR;
+            break;
+        }
+        num_bad += cp->num_bad;
+#ifdef SG_DECODE_SENSE_THREADS
+        pthread_mutex_lock(&ctl.mtx);
+        cp->state = STRM_FREE;
+        pthread_mutex_unlock(&ctl.mtx);
+#else
+        cp->state = STRM_FREE;
+#endif
+        ++seq_write;
+    }
+#ifdef SG_DECODE_SENSE_THREADS
+    pthread_mutex_lock(&ctl.mtx);
+    ctl.stop = true;
+    pthread_cond_broadcast(&ctl.filled_cv);
+    pthread_mutex_unlock(&ctl.mtx);
+    for (k = 0; k < num_thr; ++k)
+        pthread_join(thr_arr[k], NULL);
+    pthread_cond_destroy(&ctl.done_cv);
+    pthread_cond_destroy(&ctl.filled_cv);
+    pthread_mutex_destroy(&ctl.mtx);
+#endif
+    fflush(stdout);
+    if (op->verbose)
+        pr2serr("%s: %" PRId64 " lines, %" PRId64 " records not decoded\n",
+                __func__, lnum - 1, num_bad);
+    goto fini;
+nomem:
+    pr2serr("%s: out of memory\n", __func__);
+    ret = sg_convert_errno(ENOMEM);
+fini:
+    if (ctl.slots) {
+        for (k = 0; k < ctl.num_slots; ++k) {
+            free(ctl.slots[k].in);
+            free(ctl.slots[k].out);
+        }
+        free(ctl.slots);
+    }
+    free(carry);
+    return ret;
+}
+
+
 int
 main(int argc, char *argv[])
 {
@@ -519,6 +1094,43 @@ main(int argc, char *argv[])
         enumerate_err_codes(op);
         goto clean_op;
     }
+    if (op->batch_fn) {
+        if (op->fname || op->sense_len || op->no_space_str || op->js_file ||
+            op->wfname) {
+            pr2serr("--batch=MF cannot be used with hex on the command line, "
+                    "--binary=,\n--file=, --inhex=, --js-file= or "
+                    "--write=\n");
+            ret = SG_LIB_CONTRADICT;
+            goto clean_op;
+        }
+        op->do_json = true;     /* each blob is output as a JSON line */
+    }
+    if (op->do_stream) {
+        if (op->batch_fn || op->do_binary || op->sense_len ||
+            op->no_space_str || op->js_file || op->wfname || op->hex_count ||
+            op->do_cdb || op->no_decode || op->do_status) {
+            pr2serr("--stream cannot be used with hex on the command line, "
+                    "--batch=,\n--binary=, --cdb, --hex, --js-file=, "
+                    "--nodecode, --status= or --write=\n");
+            ret = SG_LIB_CONTRADICT;
+            goto clean_op;
+        }
+        fp = stdin;
+        if (op->fname && strcmp(op->fname, "-")) {
+            fp = fopen(op->fname, "r");
+            if (NULL == fp) {
+                err = errno;
+                pr2serr("unable to open file: %s: %s\n", op->fname,
+                        safe_strerror(err));
+                ret = sg_convert_errno(err);
+                goto clean_op;
+            }
+        }
+        ret = strm_run(fp, op);         /* output is always JSON lines */
+        if (stdin != fp)
+            fclose(fp);
+        goto clean_op;
+    }
     jsp = &op->json_st;
     if (op->do_json) {
        if (! sgj_init_state(jsp, op->json_arg)) {
@@ -537,7 +1149,20 @@ main(int argc, char *argv[])
         jop = sgj_start_r(MY_NAME, version_str, argc, argv, jsp);
     }
     as_json = jsp->pr_as_json;
+    if (op->batch_fn) {
+        struct sg_batch_item bi;
 
+        if (! sg_batch_run(op->batch_fn, op->num_parallel, &bi, &ret,
+                           op->verbose)) {
+            sgj_finish(jsp);
+            goto clean_op;
+        }
+        op->fname = bi.fn;      /* now in a child, decoding one blob */
+        if (1 == bi.as_binary)
+            op->do_binary = true;
+        else
+            op->file_given = true;
+    }
 
     if (op->do_status) {
         sg_get_scsi_status_str(op->sstatus, blen, b);
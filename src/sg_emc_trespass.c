@@ -22,6 +22,8 @@
 #include <stdarg.h>
 #include <stdbool.h>
 #include <string.h>
+#include <errno.h>
+#include <inttypes.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -31,17 +33,30 @@
 #endif
 #include "sg_lib.h"
 #include "sg_cmds_basic.h"
+#include "sg_alua.h"
+#include "sg_par.h"
+#include "sg_mpoll.h"
 #include "sg_pr2serr.h"
 
 
-static const char * version_str = "0.23 20180219";
+static const char * version_str = "0.24 20261015";
 
 static int debug = 0;
 
 #define TRESPASS_PAGE           0x22
+#define DEF_PER_CTL             4
 
+struct tres_batch_t {
+        bool hr;
+        bool short_cmd;
+        const struct sg_alua_path * pa_arr;
+        int * res_arr;
+        int64_t * ms_arr;
+};
+
+/* When noisy is false nothing is output; the caller reports the result */
 static int
-do_trespass(int fd, bool hr, bool short_cmd)
+do_trespass(int fd, bool hr, bool short_cmd, bool noisy)
 {
         uint8_t long_trespass_pg[] =
                 { 0, 0, 0, 0, 0, 0, 0, 0x00,
@@ -76,6 +91,8 @@ do_trespass(int fd, bool hr, bool short_cmd)
                                  long_trespass_pg, sizeof(long_trespass_pg),
                                  true, (debug ? 2 : 0));
 
+        if (! noisy)
+                return res;
         switch (res) {
         case 0:
                 if (debug)
@@ -103,19 +120,123 @@ do_trespass(int fd, bool hr, bool short_cmd)
         return res;
 }
 
-void usage ()
+static int
+trespass_one(int64_t k, void * ctx)
+{
+        struct tres_batch_t * bp = (struct tres_batch_t *)ctx;
+        const struct sg_alua_path * pap = bp->pa_arr + k;
+        int64_t start_ms;
+
+        if (pap->sg_fd < 0) {
+                bp->res_arr[k] = pap->res ? pap->res : SG_LIB_FILE_ERROR;
+                return 0;
+        }
+        start_ms = sg_mpoll_now_ms();
+        bp->res_arr[k] = do_trespass(pap->sg_fd, bp->hr, bp->short_cmd,
+                                     false);
+        bp->ms_arr[k] = sg_mpoll_now_ms() - start_ms;
+        return 0;
+}
+
+/* Sends the trespass page to each of num_devs DEVICEs, at most num_par
+ * at once and at most per_ctl at once through the same target port (i.e.
+ * to the same SP). Outputs one line per DEVICE. Returns 0 if all
+ * succeeded, else the first failure in command line order. */
+static int
+trespass_multi(const char ** dev_names, int num_devs, int num_par,
+               int per_ctl, bool hr, bool short_cmd)
+{
+        int k, n;
+        int ret = 0;
+        int * grp_arr = NULL;
+        struct sg_alua_path * pa_arr;
+        struct sg_alua_path * pap;
+        struct tres_batch_t batch;
+        char b[80];
+
+        memset(&batch, 0, sizeof(batch));
+        pa_arr = (struct sg_alua_path *)calloc(num_devs, sizeof(*pa_arr));
+        grp_arr = (int *)calloc(num_devs, sizeof(int));
+        batch.res_arr = (int *)calloc(num_devs, sizeof(int));
+        batch.ms_arr = (int64_t *)calloc(num_devs, sizeof(int64_t));
+        if ((NULL == pa_arr) || (NULL == grp_arr) ||
+            (NULL == batch.res_arr) || (NULL == batch.ms_arr)) {
+                pr2serr("%s: out of memory\n", __func__);
+                ret = sg_convert_errno(ENOMEM);
+                goto fini;
+        }
+        for (k = 0; k < num_devs; ++k) {
+                pa_arr[k].dev_name = dev_names[k];
+                pa_arr[k].keep_open = true;
+                pa_arr[k].vpd_only = true;
+        }
+        /* only to learn which SP each DEVICE goes through */
+        sg_alua_discover(pa_arr, num_devs, num_par, false /* rw */,
+                         debug ? 1 : 0);
+        n = sg_alua_tport_groups(pa_arr, num_devs, grp_arr);
+        if (debug)
+                pr2serr("%d DEVICEs through %d target port(s)\n", num_devs,
+                        n);
+        batch.hr = hr;
+        batch.short_cmd = short_cmd;
+        batch.pa_arr = pa_arr;
+        sg_par_each_grouped(num_devs, num_par, per_ctl, grp_arr,
+                            trespass_one, &batch);
+        for (k = 0, n = 0, pap = pa_arr; k < num_devs; ++k, ++pap) {
+                if (0 == batch.res_arr[k]) {
+                        printf("%s: trespass ok, %" PRId64 " ms\n",
+                               pap->dev_name, batch.ms_arr[k]);
+                        continue;
+                }
+                ++n;
+                if (0 == ret)
+                        ret = batch.res_arr[k];
+                if (pap->sg_fd < 0)
+                        printf("%s: not opened\n", pap->dev_name);
+                else {
+                        sg_get_category_sense_str(batch.res_arr[k],
+                                                  sizeof(b), b, debug);
+                        printf("%s: %s trespass failed, %" PRId64 " ms: "
+                               "%s\n", pap->dev_name,
+                               (short_cmd ? "short" : "long"),
+                               batch.ms_arr[k], b);
+                }
+        }
+        if (n)
+                pr2serr("%d of %d DEVICEs failed\n", n, num_devs);
+fini:
+        if (pa_arr) {
+                sg_alua_close(pa_arr, num_devs);
+                free(pa_arr);
+        }
+        free(grp_arr);
+        free(batch.res_arr);
+        free(batch.ms_arr);
+        return ret;
+}
+
+static void
+usage()
 {
-        pr2serr("Usage:  sg_emc_trespass [-d] [-hr] [-s] [-V] DEVICE\n"
+        pr2serr("Usage:  sg_emc_trespass [-c=C] [-d] [-hr] [-p=Q] [-s] [-V] "
+                "DEVICE...\n"
                 "  Change ownership of a LUN from another SP to this one.\n"
                 "  EMC CLARiiON CX-/AX-family + FC5300/FC4500/FC4700.\n"
+                "    -c=C: with several DEVICEs, at most C trespasses at "
+                "once through\n"
+                "          the same target port (def: %d)\n"
                 "    -d : output debug\n"
                 "    -hr: Set Honor Reservation bit\n"
+                "    -p=Q: with several DEVICEs, at most Q trespasses at "
+                "once (def: %d)\n"
                 "    -s : Send Short Trespass Command page (default: long)\n"
                 "         (for FC series)\n"
                 "    -V: print version string then exit\n"
                 "     DEVICE   sg or block device (latter in lk 2.6 or lk 3 "
                 "series)\n"
-                "        Example: sg_emc_trespass /dev/sda\n");
+                "        Example: sg_emc_trespass /dev/sda\n"
+                "  With several DEVICEs one line of status and timing is "
+                "output per DEVICE.\n", DEF_PER_CTL, SG_ALUA_DEF_PARALLEL);
         exit (1);
 }
 
@@ -123,7 +244,11 @@ int main(int argc, char * argv[])
 {
         char **argptr;
         char * file_name = 0;
+        const char ** dev_names = NULL;
         int k, fd;
+        int num_devs = 0;
+        int num_par = SG_ALUA_DEF_PARALLEL;
+        int per_ctl = DEF_PER_CTL;
         bool hr = false;
         bool short_cmd = false;
         int ret = 0;
@@ -139,6 +264,23 @@ int main(int argc, char * argv[])
                         short_cmd = true;
                 else if (!strcmp (*argptr, "-hr"))
                         hr = true;
+                else if (!strncmp (*argptr, "-c=", 3)) {
+                        per_ctl = sg_get_num(*argptr + 3);
+                        if (per_ctl < 1) {
+                                pr2serr("bad argument to '-c=', expect 1 or "
+                                        "more\n");
+                                return SG_LIB_SYNTAX_ERROR;
+                        }
+                }
+                else if (!strncmp (*argptr, "-p=", 3)) {
+                        num_par = sg_get_num(*argptr + 3);
+                        if ((num_par < 1) ||
+                            (num_par > SG_ALUA_MAX_PARALLEL)) {
+                                pr2serr("bad argument to '-p=', expect 1 to "
+                                        "%d\n", SG_ALUA_MAX_PARALLEL);
+                                return SG_LIB_SYNTAX_ERROR;
+                        }
+                }
                 else if (!strcmp (*argptr, "-V")) {
                         printf("Version string: %s\n", version_str);
                         exit(0);
@@ -148,18 +290,31 @@ int main(int argc, char * argv[])
                         file_name = NULL;
                         break;
                 }
-                else if (NULL == file_name)
-                        file_name = argv[k];
                 else {
-                        pr2serr("too many arguments\n");
-                        file_name = NULL;
-                        break;
+                        if (NULL == dev_names) {
+                                dev_names = (const char **)
+                                        calloc(argc, sizeof(char *));
+                                if (NULL == dev_names) {
+                                        pr2serr("out of memory\n");
+                                        return sg_convert_errno(ENOMEM);
+                                }
+                                file_name = argv[k];
+                        }
+                        dev_names[num_devs++] = argv[k];
                 }
         }
         if (NULL == file_name) {
+                free(dev_names);
                 usage();
                 return SG_LIB_SYNTAX_ERROR;
         }
+        if (num_devs > 1) {
+                ret = trespass_multi(dev_names, num_devs, num_par, per_ctl,
+                                     hr, short_cmd);
+                free(dev_names);
+                return (ret >= 0) ? ret : SG_LIB_CAT_OTHER;
+        }
+        free(dev_names);
 
         fd = open(file_name, O_RDWR | O_NONBLOCK);
         if (fd < 0) {
@@ -169,7 +324,7 @@ int main(int argc, char * argv[])
                 return SG_LIB_FILE_ERROR;
         }
 
-        ret = do_trespass(fd, hr, short_cmd);
+        ret = do_trespass(fd, hr, short_cmd, true);
 
         close (fd);
         return (ret >= 0) ? ret : SG_LIB_CAT_OTHER;
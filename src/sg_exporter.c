@@ -0,0 +1,1585 @@
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <poll.h>
+#include <time.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "sg_lib.h"
+#include "sg_pt.h"
+#include "sg_cmds_basic.h"
+#include "sg_cmds_extra.h"
+#include "sg_unaligned.h"
+#include "sg_pr2serr.h"
+
+/* A utility program originally written for the Linux OS SCSI subsystem.
+ *
+ * This program keeps one or more SCSI devices open and periodically
+ * collects health telemetry from them: log pages (temperature, error
+ * counters, solid state media and background scan results), the SES
+ * Enclosure status diagnostic page and, for ATA disks behind a SCSI to
+ * ATA Translation (SAT) layer, the SMART attributes. The results are
+ * served in the Prometheus text or OpenMetrics exposition format, either
+ * over HTTP or written to a file for the node_exporter textfile collector.
+ */
+
+static const char * version_str = "1.01 20261015";
+
+#define MAX_DEVICES 64
+#define MAX_CONCURRENCY 8
+#define MAX_JOBS 12
+#define MAX_SAMPLES 512
+#define RESP_BUFF_LEN (16 * 1024)
+#define SMART_RESP_LEN 512
+#define SENSE_BUFF_LEN 64       /* Arbitrary, could be larger */
+#define DEF_PT_TIMEOUT 60       /* 60 seconds */
+#define DEF_INTERVAL 60         /* seconds between collections */
+#define HTTP_REQ_LEN 4096
+#define HTTP_TIMEOUT_MS 2000    /* for a whole request and its response */
+
+#define LOG_SENSE_CMD 0x4d
+#define LOG_SENSE_CMDLEN 10
+#define RECEIVE_DIAGNOSTICS_CMD 0x1c
+#define RECEIVE_DIAGNOSTICS_CMDLEN 6
+#define SAT_ATA_PASS_THROUGH16 0x85
+#define SAT_ATA_PASS_THROUGH16_LEN 16
+#define ATA_SMART 0xb0
+#define ATA_SMART_READ_DATA 0xd0
+
+#define WRITE_ERR_LPAGE 0x2
+#define READ_ERR_LPAGE 0x3
+#define VERIFY_ERR_LPAGE 0x5
+#define NON_MEDIUM_LPAGE 0x6
+#define TEMPERATURE_LPAGE 0xd
+#define SSD_LPAGE 0x11
+#define BACKGROUND_SCAN_LPAGE 0x15
+
+#define SES_CONFIGURATION_DPAGE 0x1
+#define SES_ENC_STATUS_DPAGE 0x2
+
+/* --select= bit masks */
+#define SEL_TEMP 0x1
+#define SEL_ERRORS 0x2
+#define SEL_SSD 0x4
+#define SEL_BGSCAN 0x8
+#define SEL_SES 0x10
+#define SEL_SMART 0x20
+#define SEL_ALL 0x3f
+
+enum job_kind_e {
+    JOB_LOG = 0,
+    JOB_SES_STATUS,
+    JOB_SMART,
+};
+
+struct job_t {
+    enum job_kind_e kind;
+    int pn;                     /* log page number */
+};
+
+/* One command in flight; there are up to --concurrency= of these for each
+ * DEVICE, all sharing its file descriptor. */
+struct slot_t {
+    struct sg_pt_base * ptvp;
+    bool in_flight;
+    int job_idx;
+    uint8_t cdb[SAT_ATA_PASS_THROUGH16_LEN];
+    uint8_t sense_b[SENSE_BUFF_LEN];
+    uint8_t * resp;
+};
+
+struct sample_t {
+    int fam;                    /* index into families[] */
+    char labels[112];           /* extra labels, after device="..." */
+                                /* (for sg_device_info: dev_t::info) */
+    bool is_dbl;
+    uint64_t u;
+    double d;
+};
+
+struct dev_t {
+    const char * name;
+    char label[80];             /* escaped DEVICE name */
+    char info[256];             /* escaped labels of sg_device_info */
+    int fd;
+    bool sync_only;             /* no async commands: read-only or NVMe */
+    bool ses_cfg_ok;
+    bool got_one;               /* at least one command succeeded */
+    bool up;                    /* result of the last collection */
+    int pack_id;
+    int num_jobs;
+    int next_job;
+    int num_done;
+    int num_slots;
+    int ses_num_types;
+    uint32_t ses_gen;
+    uint8_t ses_types[64];
+    uint8_t ses_num_elems[64];
+    struct job_t jobs[MAX_JOBS];
+    struct slot_t slots[MAX_CONCURRENCY];
+    uint64_t num_collections;
+    uint64_t cmd_errs;
+    struct timespec start_tm;
+    int num_samples;            /* in samples[], those being served */
+    int num_new;                /* in new_samples[], being collected */
+    struct sample_t * samples;
+    struct sample_t * new_samples;
+};
+
+struct opts_t {
+    bool do_once;
+    bool openmetrics;
+    int concurrency;
+    int interval;
+    int select;
+    int verbose;
+    const char * listen_arg;
+    const char * textfile;
+};
+
+struct buff_t {
+    char * p;
+    size_t len;
+    size_t cap;
+};
+
+enum fam_type_e {
+    FT_GAUGE = 0,
+    FT_COUNTER,
+    FT_INFO,
+};
+
+struct family_t {
+    const char * name;
+    enum fam_type_e type;
+    const char * help;
+};
+
+enum fam_e {
+    F_UP = 0,
+    F_INFO,
+    F_DURATION,
+    F_COLLECTIONS,
+    F_CMD_ERRS,
+    F_TEMP,
+    F_TEMP_REF,
+    F_ERRORS,
+    F_PROCESSED,
+    F_NON_MEDIUM,
+    F_ENDURANCE,
+    F_POWER_ON,
+    F_BGS_STATUS,
+    F_BGS_SCANS,
+    F_BGS_MEDIUM_SCANS,
+    F_BGS_PROGRESS,
+    F_BGS_DEFECTS,
+    F_SES_FLAG,
+    F_SES_ELEMS,
+    F_SMART_VALUE,
+    F_SMART_WORST,
+    F_SMART_RAW,
+    F_NUM_FAMILIES,
+};
+
+/* Counters are named without their "_total" suffix, info families without
+ * "_info"; both are appended to the sample names. */
+static const struct family_t families[F_NUM_FAMILIES] = {
+    {"sg_up", FT_GAUGE,
+     "1 if the last collection from the device had a good response"},
+    {"sg_device", FT_INFO, "Identification of the device from INQUIRY"},
+    {"sg_collect_duration_seconds", FT_GAUGE,
+     "Time taken by the last collection from the device"},
+    {"sg_collections", FT_COUNTER, "Collections from the device"},
+    {"sg_command_errors", FT_COUNTER,
+     "Commands sent to the device that failed"},
+    {"sg_temperature_celsius", FT_GAUGE,
+     "Temperature from the Temperature log page"},
+    {"sg_temperature_reference_celsius", FT_GAUGE,
+     "Maximum reported operating temperature"},
+    {"sg_log_errors", FT_COUNTER,
+     "Error counters from the write, read and verify error log pages"},
+    {"sg_log_processed_bytes", FT_COUNTER,
+     "Total bytes processed from the error counter log pages"},
+    {"sg_non_medium_errors", FT_COUNTER,
+     "Non-medium error count log page"},
+    {"sg_endurance_used_percent", FT_GAUGE,
+     "Percentage used endurance indicator of solid state media"},
+    {"sg_power_on_minutes", FT_COUNTER,
+     "Accumulated power on minutes from the Background scan log page"},
+    {"sg_background_scan_status", FT_GAUGE,
+     "Background scan status code"},
+    {"sg_background_scans", FT_COUNTER, "Background scans performed"},
+    {"sg_background_medium_scans", FT_COUNTER,
+     "Background medium scans performed"},
+    {"sg_background_scan_progress_ratio", FT_GAUGE,
+     "Progress of the current background scan"},
+    {"sg_background_scan_defects", FT_GAUGE,
+     "Medium scan parameters in the Background scan log page"},
+    {"sg_ses_status_flag", FT_GAUGE,
+     "Flags in the header of the SES Enclosure status page"},
+    {"sg_ses_elements", FT_GAUGE,
+     "SES elements by element type and status"},
+    {"sg_ata_smart_value", FT_GAUGE, "ATA SMART attribute normalized value"},
+    {"sg_ata_smart_worst", FT_GAUGE, "ATA SMART attribute worst value"},
+    {"sg_ata_smart_raw", FT_GAUGE, "ATA SMART attribute raw value"},
+};
+
+static const char * ses_etype_names[] = {
+    "unspecified", "device_slot", "power_supply", "cooling",
+    "temperature_sensor", "door", "audible_alarm",
+    "enclosure_services_controller_electronics",
+    "scc_controller_electronics", "nonvolatile_cache",
+    "invalid_operation_reason", "uninterruptible_power_supply", "display",
+    "key_pad_entry", "enclosure", "scsi_port_transceiver", "language",
+    "communication_port", "voltage_sensor", "current_sensor",
+    "scsi_target_port", "scsi_initiator_port", "simple_subenclosure",
+    "array_device_slot", "sas_expander", "sas_connector",
+};
+
+static const char * ses_status_names[] = {
+    "unsupported", "ok", "critical", "noncritical", "unrecoverable",
+    "not_installed", "unknown", "not_available", "no_access",
+};
+
+static const char * err_counter_names[] = {
+    "corrected_without_delay", "corrected_with_delay", "total_rewrites",
+    "total_corrected", "correction_algorithm_invocations", "",
+    "total_uncorrected",
+};
+
+static struct dev_t devs[MAX_DEVICES];
+static int num_devs;
+static volatile sig_atomic_t stop_flag;
+
+static const char * prom_ctype = "text/plain; version=0.0.4; charset=utf-8";
+static const char * om_ctype =
+        "application/openmetrics-text; version=1.0.0; charset=utf-8";
+
+
+static struct option long_options[] = {
+        {"concurrency", required_argument, 0, 'c'},
+        {"help", no_argument, 0, 'h'},
+        {"interval", required_argument, 0, 'i'},
+        {"listen", required_argument, 0, 'l'},
+        {"once", no_argument, 0, '1'},
+        {"openmetrics", no_argument, 0, 'o'},
+        {"select", required_argument, 0, 's'},
+        {"textfile", required_argument, 0, 't'},
+        {"verbose", no_argument, 0, 'v'},
+        {"version", no_argument, 0, 'V'},
+        {0, 0, 0, 0},
+};
+
+
+static void
+usage()
+{
+    pr2serr("Usage: "
+            "sg_exporter  [--concurrency=CO] [--help] [--interval=SECS]\n"
+            "                    [--listen=[ADDR:]PORT] [--once] "
+            "[--openmetrics]\n"
+            "                    [--select=LIST] [--textfile=PATH] "
+            "[--verbose] [--version]\n"
+            "                    DEVICE [DEVICE...]\n");
+    pr2serr("  where:\n"
+            "    --concurrency=CO|-c CO    maximum commands in flight to "
+            "each DEVICE\n"
+            "                              (def: 1, max: %d)\n"
+            "    --help|-h          print out usage message\n"
+            "    --interval=SECS|-i SECS    seconds between collections "
+            "(def: %d)\n"
+            "    --listen=[ADDR:]PORT|-l [ADDR:]PORT    serve metrics over "
+            "HTTP at\n"
+            "                       /metrics on PORT (of ADDR, def: all "
+            "addresses)\n"
+            "    --once|-1          collect once, output then exit\n"
+            "    --openmetrics|-o    output OpenMetrics format rather than "
+            "Prometheus\n"
+            "                        text format, when not serving HTTP\n"
+            "    --select=LIST|-s LIST    comma separated list from: temp, "
+            "errors,\n"
+            "                             ssd, bgscan, ses and smart (def: "
+            "all)\n"
+            "    --textfile=PATH|-t PATH    after each collection write "
+            "metrics to\n"
+            "                               PATH (via PATH.tmp)\n"
+            "    --verbose|-v       increase verbosity\n"
+            "    --version|-V       print version string and exit\n\n"
+            "Collects health telemetry from each DEVICE, which is kept "
+            "open, and exports\nit in the Prometheus text or OpenMetrics "
+            "format. With neither --listen=\nnor --textfile= the metrics "
+            "are collected once and sent to stdout.\n",
+            MAX_CONCURRENCY, DEF_INTERVAL);
+}
+
+static void
+sig_handler(int sig)
+{
+    if (sig)
+        stop_flag = 1;
+}
+
+static double
+get_mono_secs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + ((double)ts.tv_nsec / 1000000000.0);
+}
+
+/* Appends to the buffer that bp points to, growing it as needed. On
+ * memory allocation failure the output is silently truncated. */
+static void
+bprintf(struct buff_t * bp, const char * fmt, ...)
+{
+    int n;
+    size_t room;
+    char * cp;
+    va_list args;
+
+    while (true) {
+        room = bp->cap - bp->len;
+        va_start(args, fmt);
+        n = vsnprintf(bp->p ? (bp->p + bp->len) : NULL, room, fmt, args);
+        va_end(args);
+        if (n < 0)
+            return;
+        if ((size_t)n < room) {
+            bp->len += n;
+            return;
+        }
+        cp = (char *)realloc(bp->p, bp->cap + n + 4096);
+        if (NULL == cp)
+            return;
+        bp->p = cp;
+        bp->cap += n + 4096;
+    }
+}
+
+/* Copies src to dst as an exposition format label value: backslash,
+ * double quote and line feed are escaped; other control characters and
+ * trailing spaces are dropped. */
+static void
+escape_label(char * dst, int dst_len, const char * src, int src_len)
+{
+    int k, j;
+
+    src_len = strnlen(src, src_len);
+    while ((src_len > 0) && (' ' == src[src_len - 1]))
+        --src_len;
+    for (k = 0, j = 0; (k < src_len) && src[k] && (j < (dst_len - 3)); ++k) {
+        if (('\\' == src[k]) || ('"' == src[k])) {
+            dst[j++] = '\\';
+            dst[j++] = src[k];
+        } else if ('\n' == src[k]) {
+            dst[j++] = '\\';
+            dst[j++] = 'n';
+        } else if (! iscntrl((uint8_t)src[k]))
+            dst[j++] = src[k];
+    }
+    dst[j] = '\0';
+}
+
+static void
+add_sample(struct dev_t * dp, int fam, const char * labels, uint64_t u)
+{
+    struct sample_t * sp;
+
+    if (dp->num_new >= MAX_SAMPLES)
+        return;
+    sp = dp->new_samples + dp->num_new++;
+    sp->fam = fam;
+    snprintf(sp->labels, sizeof(sp->labels), "%s", labels ? labels : "");
+    sp->is_dbl = false;
+    sp->u = u;
+}
+
+static void
+add_sample_dbl(struct dev_t * dp, int fam, const char * labels, double d)
+{
+    struct sample_t * sp;
+
+    if (dp->num_new >= MAX_SAMPLES)
+        return;
+    sp = dp->new_samples + dp->num_new++;
+    sp->fam = fam;
+    snprintf(sp->labels, sizeof(sp->labels), "%s", labels ? labels : "");
+    sp->is_dbl = true;
+    sp->d = d;
+}
+
+/* Outputs all the samples being served in the OpenMetrics format if
+ * openmetrics is true, otherwise in the Prometheus text format (0.0.4).
+ * Samples are grouped by metric family as both formats require. */
+static void
+render(struct buff_t * bp, bool openmetrics)
+{
+    int f, k, j;
+    bool seen;
+    const char * sfx;
+    const char * lp;
+    const struct family_t * fp;
+    const struct dev_t * dp;
+    const struct sample_t * sp;
+
+    bp->len = 0;
+    for (f = 0; f < F_NUM_FAMILIES; ++f) {
+        fp = families + f;
+        if (FT_COUNTER == fp->type)
+            sfx = "_total";
+        else if (FT_INFO == fp->type)
+            sfx = "_info";
+        else
+            sfx = "";
+        seen = false;
+        for (k = 0; k < num_devs; ++k) {
+            dp = devs + k;
+            for (j = 0; j < dp->num_samples; ++j) {
+                sp = dp->samples + j;
+                if (f != sp->fam)
+                    continue;
+                if (! seen) {
+                    seen = true;
+                    if (openmetrics)
+                        bprintf(bp, "# TYPE %s %s\n# HELP %s %s.\n",
+                                fp->name, (FT_COUNTER == fp->type) ?
+                                "counter" : ((FT_INFO == fp->type) ?
+                                "info" : "gauge"), fp->name, fp->help);
+                    else
+                        bprintf(bp, "# HELP %s%s %s.\n# TYPE %s%s %s\n",
+                                fp->name, sfx, fp->help, fp->name, sfx,
+                                (FT_COUNTER == fp->type) ? "counter" :
+                                "gauge");
+                }
+                lp = (F_INFO == f) ? dp->info : sp->labels;
+                bprintf(bp, "%s%s{device=\"%s\"%s%s} ", fp->name, sfx,
+                        dp->label, lp[0] ? "," : "", lp);
+                if (sp->is_dbl)
+                    bprintf(bp, "%.6g\n", sp->d);
+                else
+                    bprintf(bp, "%" PRIu64 "\n", sp->u);
+            }
+        }
+    }
+    if (openmetrics)
+        bprintf(bp, "# EOF\n");
+}
+
+/* Builds the list of commands sent on each collection from the log pages
+ * the DEVICE claims to support and from its peripheral device type. */
+static void
+build_jobs(struct dev_t * dp, const uint8_t * supp, int num_supp,
+           bool is_ses, bool is_ata, const struct opts_t * op)
+{
+    int k, pn;
+
+    dp->num_jobs = 0;
+    for (k = 0; k < num_supp; ++k) {
+        pn = supp[k] & 0x3f;
+        switch (pn) {
+        case TEMPERATURE_LPAGE:
+            if (! (op->select & SEL_TEMP))
+                continue;
+            break;
+        case WRITE_ERR_LPAGE:
+        case READ_ERR_LPAGE:
+        case VERIFY_ERR_LPAGE:
+        case NON_MEDIUM_LPAGE:
+            if (! (op->select & SEL_ERRORS))
+                continue;
+            break;
+        case SSD_LPAGE:
+            if (! (op->select & SEL_SSD))
+                continue;
+            break;
+        case BACKGROUND_SCAN_LPAGE:
+            if (! (op->select & SEL_BGSCAN))
+                continue;
+            break;
+        default:
+            continue;
+        }
+        if (dp->num_jobs >= MAX_JOBS)
+            break;
+        dp->jobs[dp->num_jobs].kind = JOB_LOG;
+        dp->jobs[dp->num_jobs++].pn = pn;
+    }
+    if (is_ses && (op->select & SEL_SES) && (dp->num_jobs < MAX_JOBS)) {
+        dp->jobs[dp->num_jobs].kind = JOB_SES_STATUS;
+        dp->jobs[dp->num_jobs++].pn = SES_ENC_STATUS_DPAGE;
+    }
+    if (is_ata && (op->select & SEL_SMART) && (dp->num_jobs < MAX_JOBS)) {
+        dp->jobs[dp->num_jobs].kind = JOB_SMART;
+        dp->jobs[dp->num_jobs++].pn = 0;
+    }
+}
+
+/* Fetches the SES Configuration diagnostic page to learn the element types
+ * (and how many of each) that the Enclosure status page will report. */
+static void
+fetch_ses_config(struct dev_t * dp, const struct opts_t * op)
+{
+    int k, j, res, rlen, num_encs, num_types, off;
+    uint8_t * bp = dp->slots[0].resp;
+
+    dp->ses_cfg_ok = false;
+    res = sg_ll_receive_diag(dp->fd, true, SES_CONFIGURATION_DPAGE, bp,
+                             RESP_BUFF_LEN, false, op->verbose);
+    if (res) {
+        ++dp->cmd_errs;
+        if (op->verbose)
+            pr2serr("%s: fetching SES Configuration page failed\n",
+                    dp->name);
+        return;
+    }
+    rlen = sg_get_unaligned_be16(bp + 2) + 4;
+    if ((SES_CONFIGURATION_DPAGE != bp[0]) || (rlen > RESP_BUFF_LEN) ||
+        (rlen < 8))
+        return;
+    dp->ses_gen = sg_get_unaligned_be32(bp + 4);
+    num_encs = bp[1] + 1;
+    for (k = 0, off = 8, num_types = 0; k < num_encs; ++k) {
+        if ((off + 4) > rlen)
+            return;
+        num_types += bp[off + 2];
+        off += bp[off + 3] + 4;
+    }
+    if ((num_types > (int)sizeof(dp->ses_types)) ||
+        ((off + (num_types * 4)) > rlen))
+        return;
+    for (j = 0; j < num_types; ++j, off += 4) {
+        dp->ses_types[j] = bp[off];
+        dp->ses_num_elems[j] = bp[off + 1];
+    }
+    dp->ses_num_types = num_types;
+    dp->ses_cfg_ok = true;
+}
+
+/* Opens DEVICE dp (if not already open) then, with synchronous commands,
+ * gets its identification and the log pages it supports. Returns 0 when
+ * the DEVICE is ready to be collected from. */
+static int
+open_dev(struct dev_t * dp, const struct opts_t * op)
+{
+    int k, fd, res, num_supp;
+    int vb = op->verbose;
+    bool is_ses, is_ata;
+    uint8_t * bp;
+    struct sg_simple_inquiry_resp inq;
+    char pdt_s[48];
+    char v[20], p[36], r[12], t[64];
+
+    if (dp->fd >= 0)
+        return 0;
+    dp->sync_only = false;
+    fd = sg_cmds_open_flags(dp->name, O_RDWR | O_NONBLOCK, vb);
+    if ((-EACCES == fd) || (-EROFS == fd) || (-EPERM == fd)) {
+        fd = sg_cmds_open_device(dp->name, true /* ro */, vb);
+        dp->sync_only = true;
+    }
+    if (fd < 0) {
+        if (vb || (0 == dp->num_collections))
+            pr2serr("error opening file: %s: %s\n", dp->name,
+                    safe_strerror(-fd));
+        return sg_convert_errno(-fd);
+    }
+    dp->fd = fd;
+    for (k = 0; k < dp->num_slots; ++k) {
+        dp->slots[k].ptvp = construct_scsi_pt_obj_with_fd(fd, vb);
+        if (NULL == dp->slots[k].ptvp)
+            goto mem_err;
+        if (NULL == dp->slots[k].resp) {
+            dp->slots[k].resp = (uint8_t *)calloc(1, RESP_BUFF_LEN);
+            if (NULL == dp->slots[k].resp)
+                goto mem_err;
+        }
+    }
+    if (pt_device_is_nvme(dp->slots[0].ptvp))
+        dp->sync_only = true;   /* SCSI translation is synchronous */
+
+    res = sg_simple_inquiry(fd, &inq, false, vb);
+    if (res) {
+        pr2serr("%s: INQUIRY failed\n", dp->name);
+        goto err_out;
+    }
+    is_ses = (PDT_SES == inq.peripheral_type) || (0x40 & inq.byte_6);
+    is_ata = (0 == strncmp(inq.vendor, "ATA ", 4));
+    escape_label(v, sizeof(v), inq.vendor, sizeof(inq.vendor));
+    escape_label(p, sizeof(p), inq.product, sizeof(inq.product));
+    escape_label(r, sizeof(r), inq.revision, sizeof(inq.revision));
+    sg_get_pdt_str(inq.peripheral_type, sizeof(pdt_s), pdt_s);
+    escape_label(t, sizeof(t), pdt_s, sizeof(pdt_s));
+    snprintf(dp->info, sizeof(dp->info), "vendor=\"%s\",product=\"%s\","
+             "revision=\"%s\",peripheral_type=\"%s\"", v, p, r, t);
+
+    bp = dp->slots[0].resp;
+    num_supp = 0;
+    res = sg_ll_log_sense(fd, false, false, 1, 0, 0, 0, bp, RESP_BUFF_LEN,
+                          false, vb);
+    if (0 == res) {
+        num_supp = sg_get_unaligned_be16(bp + 2);
+        if ((num_supp + 4) > RESP_BUFF_LEN)
+            num_supp = RESP_BUFF_LEN - 4;
+    } else if (vb)
+        pr2serr("%s: no Supported log pages page\n", dp->name);
+    build_jobs(dp, bp + 4, num_supp, is_ses, is_ata, op);
+    if (vb)
+        pr2serr("%s: %s %s %s, %d commands per collection%s\n", dp->name,
+                v, p, r, dp->num_jobs, dp->sync_only ? " (sync)" : "");
+    dp->ses_cfg_ok = false;
+    return 0;
+
+mem_err:
+    pr2serr("%s: out of memory for %s\n", __func__, dp->name);
+    res = sg_convert_errno(ENOMEM);
+err_out:
+    for (k = 0; k < dp->num_slots; ++k) {
+        if (dp->slots[k].ptvp) {
+            destruct_scsi_pt_obj(dp->slots[k].ptvp);
+            dp->slots[k].ptvp = NULL;
+        }
+    }
+    sg_cmds_close_device(fd);
+    dp->fd = -1;
+    return res ? res : SG_LIB_CAT_OTHER;
+}
+
+static void
+close_dev(struct dev_t * dp)
+{
+    int k;
+
+    for (k = 0; k < dp->num_slots; ++k) {
+        if (dp->slots[k].ptvp) {
+            destruct_scsi_pt_obj(dp->slots[k].ptvp);
+            dp->slots[k].ptvp = NULL;
+        }
+        dp->slots[k].in_flight = false;
+    }
+    if (dp->fd >= 0) {
+        sg_cmds_close_device(dp->fd);
+        dp->fd = -1;
+    }
+}
+
+static void
+decode_temperature(struct dev_t * dp, const uint8_t * bp, int len)
+{
+    int pc, pl;
+    const uint8_t * pp;
+
+    for (pp = bp + 4; (pp + 4) <= (bp + len); pp += pl) {
+        pc = sg_get_unaligned_be16(pp);
+        pl = pp[3] + 4;
+        if ((pl < 6) || ((pp + pl) > (bp + len)) || (0xff == pp[5]))
+            continue;
+        if (0 == pc)
+            add_sample(dp, F_TEMP, NULL, pp[5]);
+        else if (1 == pc)
+            add_sample(dp, F_TEMP_REF, NULL, pp[5]);
+    }
+}
+
+static void
+decode_err_counters(struct dev_t * dp, int pn, const uint8_t * bp, int len)
+{
+    int pc, pl, vl;
+    uint64_t u;
+    const char * dir;
+    const uint8_t * pp;
+    char b[112];
+
+    if (WRITE_ERR_LPAGE == pn)
+        dir = "write";
+    else if (READ_ERR_LPAGE == pn)
+        dir = "read";
+    else
+        dir = "verify";
+    for (pp = bp + 4; (pp + 4) <= (bp + len); pp += pl) {
+        pc = sg_get_unaligned_be16(pp);
+        pl = pp[3] + 4;
+        vl = pp[3];
+        if ((pp + pl) > (bp + len))
+            break;
+        if ((vl < 1) || (vl > 8) || (pc > 6))
+            continue;
+        u = sg_get_unaligned_be(vl, pp + 4);
+        if (5 == pc) {
+            snprintf(b, sizeof(b), "direction=\"%s\"", dir);
+            add_sample(dp, F_PROCESSED, b, u);
+        } else {
+            snprintf(b, sizeof(b), "direction=\"%s\",counter=\"%s\"", dir,
+                     err_counter_names[pc]);
+            add_sample(dp, F_ERRORS, b, u);
+        }
+    }
+}
+
+static void
+decode_non_medium(struct dev_t * dp, const uint8_t * bp, int len)
+{
+    int vl;
+    const uint8_t * pp = bp + 4;
+
+    if ((pp + 5) > (bp + len) || (0 != sg_get_unaligned_be16(pp)))
+        return;
+    vl = pp[3];
+    if ((vl < 1) || (vl > 8) || ((pp + 4 + vl) > (bp + len)))
+        return;
+    add_sample(dp, F_NON_MEDIUM, NULL, sg_get_unaligned_be(vl, pp + 4));
+}
+
+static void
+decode_ssd(struct dev_t * dp, const uint8_t * bp, int len)
+{
+    int pl;
+    const uint8_t * pp;
+
+    for (pp = bp + 4; (pp + 4) <= (bp + len); pp += pl) {
+        pl = pp[3] + 4;
+        if ((pp + pl) > (bp + len))
+            break;
+        if ((1 == sg_get_unaligned_be16(pp)) && (pl >= 8))
+            add_sample(dp, F_ENDURANCE, NULL, pp[7]);
+    }
+}
+
+static void
+decode_bgscan(struct dev_t * dp, const uint8_t * bp, int len)
+{
+    int pc, pl;
+    uint64_t num_defects = 0;
+    const uint8_t * pp;
+
+    for (pp = bp + 4; (pp + 4) <= (bp + len); pp += pl) {
+        pc = sg_get_unaligned_be16(pp);
+        pl = pp[3] + 4;
+        if ((pp + pl) > (bp + len))
+            break;
+        if ((0 == pc) && (pl >= 16)) {
+            add_sample(dp, F_POWER_ON, NULL, sg_get_unaligned_be32(pp + 4));
+            add_sample(dp, F_BGS_STATUS, NULL, pp[9]);
+            add_sample(dp, F_BGS_SCANS, NULL,
+                       sg_get_unaligned_be16(pp + 10));
+            add_sample_dbl(dp, F_BGS_PROGRESS, NULL,
+                           (double)sg_get_unaligned_be16(pp + 12) / 65536.0);
+            add_sample(dp, F_BGS_MEDIUM_SCANS, NULL,
+                       sg_get_unaligned_be16(pp + 14));
+        } else if ((pc >= 0x1) && (pc <= 0x800))
+            ++num_defects;
+    }
+    add_sample(dp, F_BGS_DEFECTS, NULL, num_defects);
+}
+
+/* Returns false if the generation code of the Enclosure status page does
+ * not match that of the Configuration page last fetched. */
+static bool
+decode_ses_status(struct dev_t * dp, const uint8_t * bp, int len)
+{
+    int k, j, e, st, off, et;
+    uint32_t counts[sizeof(ses_status_names) / sizeof(ses_status_names[0])];
+    char b[112];
+    char tn[16];
+    const char * tnp;
+    static const char * flag_names[] = {
+        "unrecov", "crit", "non_crit", "info", "invop",
+    };
+
+    if ((len < 8) || (! dp->ses_cfg_ok) ||
+        (sg_get_unaligned_be32(bp + 4) != dp->ses_gen))
+        return false;
+    for (k = 0; k < 5; ++k) {
+        snprintf(b, sizeof(b), "flag=\"%s\"", flag_names[k]);
+        add_sample(dp, F_SES_FLAG, b, !!(bp[1] & (1 << k)));
+    }
+    for (k = 0, off = 8; k < dp->ses_num_types; ++k) {
+        off += 4;               /* skip overall element */
+        memset(counts, 0, sizeof(counts));
+        for (e = 0; e < dp->ses_num_elems[k]; ++e, off += 4) {
+            if ((off + 4) > len)
+                break;
+            st = bp[off] & 0xf;
+            if (st < (int)(sizeof(counts) / sizeof(counts[0])))
+                ++counts[st];
+        }
+        et = dp->ses_types[k];
+        if (et < (int)(sizeof(ses_etype_names) / sizeof(ses_etype_names[0])))
+            tnp = ses_etype_names[et];
+        else {
+            snprintf(tn, sizeof(tn), "0x%x", et);
+            tnp = tn;
+        }
+        for (j = 0; j < (int)(sizeof(counts) / sizeof(counts[0])); ++j) {
+            if (0 == counts[j])
+                continue;
+            /* element types may repeat (e.g. in subenclosures) */
+            snprintf(b, sizeof(b), "element_type=\"%s\",status=\"%s\","
+                     "index=\"%d\"", tnp, ses_status_names[j], k);
+            add_sample(dp, F_SES_ELEMS, b, counts[j]);
+        }
+    }
+    return true;
+}
+
+/* SMART READ DATA response: 30 attribute entries of 12 bytes starting at
+ * byte offset 2; an attribute id of zero marks an unused entry. */
+static void
+decode_smart(struct dev_t * dp, const uint8_t * bp, int len)
+{
+    int k;
+    const uint8_t * ap;
+    char b[112];
+
+    for (k = 0; k < 30; ++k) {
+        ap = bp + 2 + (k * 12);
+        if ((ap + 12) > (bp + len))
+            break;
+        if (0 == ap[0])
+            continue;
+        snprintf(b, sizeof(b), "id=\"%d\"", ap[0]);
+        add_sample(dp, F_SMART_VALUE, b, ap[3]);
+        add_sample(dp, F_SMART_WORST, b, ap[4]);
+        add_sample(dp, F_SMART_RAW, b, sg_get_unaligned_le48(ap + 5));
+    }
+}
+
+/* Called when the command in slot sp has completed (or failed to be sent),
+ * 'res' being from do_scsi_pt() or do_scsi_pt_receive(). */
+static void
+job_done(struct dev_t * dp, struct slot_t * sp, int res,
+         const struct opts_t * op)
+{
+    int n, sense_cat, rlen;
+    bool good = false;
+    struct job_t * jp = dp->jobs + sp->job_idx;
+    const uint8_t * bp = sp->resp;
+
+    sp->in_flight = false;
+    ++dp->num_done;
+    n = sg_cmds_process_resp(sp->ptvp, (JOB_SMART == jp->kind) ?
+                             "ata pass-through(16)" :
+                             ((JOB_LOG == jp->kind) ? "log sense" :
+                              "receive diagnostic results"), res,
+                             op->verbose > 1, op->verbose, &sense_cat);
+    if (n >= 0)
+        good = true;
+    else if ((-2 == n) && ((SG_LIB_CAT_RECOVERED == sense_cat) ||
+                           (SG_LIB_CAT_NO_SENSE == sense_cat)))
+        good = true;
+    else if ((-2 == n) && ((SG_LIB_CAT_INVALID_OP == sense_cat) ||
+                           (SG_LIB_CAT_ILLEGAL_REQ == sense_cat))) {
+        /* not supported: drop it for subsequent collections */
+        if (op->verbose)
+            pr2serr("%s: command for job %d not supported, dropped\n",
+                    dp->name, sp->job_idx);
+        jp->kind = JOB_LOG;
+        jp->pn = -1;
+    }
+    rlen = RESP_BUFF_LEN - get_scsi_pt_resid(sp->ptvp);
+    if ((-1 == n) && (op->verbose > 1))
+        pr2serr("%s: pass-through failure on job %d\n", dp->name,
+                sp->job_idx);
+    partial_clear_scsi_pt_obj(sp->ptvp);
+    if (! good) {
+        ++dp->cmd_errs;
+        return;
+    }
+    if (JOB_SMART == jp->kind) {
+        dp->got_one = true;
+        decode_smart(dp, bp, SMART_RESP_LEN);
+        return;
+    }
+    if (rlen < 4)
+        return;
+    n = sg_get_unaligned_be16(bp + 2) + 4;
+    if (n < rlen)
+        rlen = n;
+    if (JOB_SES_STATUS == jp->kind) {
+        if (SES_ENC_STATUS_DPAGE != bp[0])
+            return;
+        dp->got_one = true;
+        if (! decode_ses_status(dp, bp, rlen))
+            dp->ses_cfg_ok = false;     /* fetch again next time */
+        return;
+    }
+    if ((bp[0] & 0x3f) != jp->pn)
+        return;
+    dp->got_one = true;
+    switch (jp->pn) {
+    case TEMPERATURE_LPAGE:
+        decode_temperature(dp, bp, rlen);
+        break;
+    case WRITE_ERR_LPAGE:
+    case READ_ERR_LPAGE:
+    case VERIFY_ERR_LPAGE:
+        decode_err_counters(dp, jp->pn, bp, rlen);
+        break;
+    case NON_MEDIUM_LPAGE:
+        decode_non_medium(dp, bp, rlen);
+        break;
+    case SSD_LPAGE:
+        decode_ssd(dp, bp, rlen);
+        break;
+    case BACKGROUND_SCAN_LPAGE:
+        decode_bgscan(dp, bp, rlen);
+        break;
+    default:
+        break;
+    }
+}
+
+/* Sends the next command of DEVICE dp from slot sp without waiting for it,
+ * unless dp is sync_only in which case it completes here. */
+static void
+job_submit(struct dev_t * dp, struct slot_t * sp, const struct opts_t * op)
+{
+    int res, cdb_len, mx_len;
+    struct job_t * jp;
+
+    while ((dp->next_job < dp->num_jobs) &&
+           (JOB_LOG == dp->jobs[dp->next_job].kind) &&
+           (dp->jobs[dp->next_job].pn < 0)) {   /* skip dropped jobs */
+        ++dp->next_job;
+        ++dp->num_done;
+    }
+    if (dp->next_job >= dp->num_jobs)
+        return;
+    sp->job_idx = dp->next_job++;
+    jp = dp->jobs + sp->job_idx;
+    memset(sp->cdb, 0, sizeof(sp->cdb));
+    mx_len = RESP_BUFF_LEN;
+    switch (jp->kind) {
+    case JOB_LOG:
+        sp->cdb[0] = LOG_SENSE_CMD;
+        sp->cdb[2] = (uint8_t)(0x40 | jp->pn);  /* cumulative values */
+        sg_put_unaligned_be16((uint16_t)mx_len, sp->cdb + 7);
+        cdb_len = LOG_SENSE_CMDLEN;
+        break;
+    case JOB_SES_STATUS:
+        sp->cdb[0] = RECEIVE_DIAGNOSTICS_CMD;
+        sp->cdb[1] = 0x1;       /* PCV */
+        sp->cdb[2] = (uint8_t)jp->pn;
+        sg_put_unaligned_be16((uint16_t)mx_len, sp->cdb + 3);
+        cdb_len = RECEIVE_DIAGNOSTICS_CMDLEN;
+        break;
+    case JOB_SMART:
+    default:
+        mx_len = SMART_RESP_LEN;
+        sp->cdb[0] = SAT_ATA_PASS_THROUGH16;
+        sp->cdb[1] = (4 << 1);  /* PIO data-in */
+        sp->cdb[2] = 0xe;       /* T_DIR=1, BYTE_BLOCK=1, T_LENGTH=2 */
+        sp->cdb[4] = ATA_SMART_READ_DATA;       /* features */
+        sp->cdb[6] = 1;                         /* count */
+        sp->cdb[10] = 0x4f;                     /* lba_mid */
+        sp->cdb[12] = 0xc2;                     /* lba_high */
+        sp->cdb[14] = ATA_SMART;
+        cdb_len = SAT_ATA_PASS_THROUGH16_LEN;
+        break;
+    }
+    set_scsi_pt_cdb(sp->ptvp, sp->cdb, cdb_len);
+    set_scsi_pt_sense(sp->ptvp, sp->sense_b, sizeof(sp->sense_b));
+    set_scsi_pt_data_in(sp->ptvp, sp->resp, mx_len);
+    set_scsi_pt_packet_id(sp->ptvp, ++dp->pack_id);
+    if (dp->sync_only) {
+        res = do_scsi_pt(sp->ptvp, -1, DEF_PT_TIMEOUT, op->verbose);
+        job_done(dp, sp, res, op);
+        return;
+    }
+    res = do_scsi_pt_submit(sp->ptvp, dp->fd, DEF_PT_TIMEOUT, op->verbose);
+    if (res) {
+        job_done(dp, sp, res, op);
+        return;
+    }
+    sp->in_flight = true;
+}
+
+/* Prepares DEVICE dp for a new collection. Returns false if it is not
+ * available, in which case only its meta samples are output. */
+static bool
+start_collection(struct dev_t * dp, const struct opts_t * op)
+{
+    int k;
+
+    clock_gettime(CLOCK_MONOTONIC, &dp->start_tm);
+    dp->num_new = 0;
+    dp->next_job = 0;
+    dp->num_done = 0;
+    dp->got_one = false;
+    if (open_dev(dp, op))
+        return false;
+    for (k = 0; k < dp->num_jobs; ++k) {
+        if ((JOB_SES_STATUS == dp->jobs[k].kind) && (! dp->ses_cfg_ok))
+            fetch_ses_config(dp, op);
+    }
+    add_sample(dp, F_INFO, NULL, 1);
+    return true;
+}
+
+/* Adds the samples that describe the collection itself, then makes the
+ * new samples of DEVICE dp visible. */
+static void
+end_collection(struct dev_t * dp)
+{
+    struct timespec now;
+    struct sample_t * sp;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    dp->up = (dp->fd >= 0) && (dp->got_one || (0 == dp->num_jobs));
+    ++dp->num_collections;
+    add_sample(dp, F_UP, NULL, dp->up);
+    add_sample_dbl(dp, F_DURATION, NULL,
+                   (double)(now.tv_sec - dp->start_tm.tv_sec) +
+                   ((double)(now.tv_nsec - dp->start_tm.tv_nsec) /
+                    1000000000.0));
+    add_sample(dp, F_COLLECTIONS, NULL, dp->num_collections);
+    add_sample(dp, F_CMD_ERRS, NULL, dp->cmd_errs);
+    /* the new samples are served from now on */
+    sp = dp->samples;
+    dp->samples = dp->new_samples;
+    dp->new_samples = sp;
+    dp->num_samples = dp->num_new;
+    dp->num_new = 0;
+    if ((dp->fd >= 0) && (! dp->up) && (dp->num_jobs > 0))
+        close_dev(dp);          /* reopen on the next collection */
+}
+
+static void serve_http(int lfd, const struct opts_t * op);
+
+/* Collects from all DEVICEs, keeping up to --concurrency= commands in
+ * flight on each. While waiting for responses, HTTP requests arriving on
+ * lfd (when >= 0) are served the metrics of the previous collection. */
+static void
+collect_all(int lfd, const struct opts_t * op)
+{
+    int k, j, n, res, remaining;
+    struct dev_t * dp;
+    struct slot_t * sp;
+    struct pollfd pfds[MAX_DEVICES + 1];
+    bool active[MAX_DEVICES];
+
+    for (k = 0, remaining = 0; k < num_devs; ++k) {
+        dp = devs + k;
+        active[k] = start_collection(dp, op);
+        if (active[k])
+            ++remaining;
+        else
+            end_collection(dp);
+    }
+    while ((remaining > 0) && (! stop_flag)) {
+        for (k = 0; k < num_devs; ++k) {
+            dp = devs + k;
+            if (! active[k])
+                continue;
+            for (j = 0; j < dp->num_slots; ++j) {
+                sp = dp->slots + j;
+                if (! sp->in_flight)
+                    job_submit(dp, sp, op);
+            }
+        }
+        for (k = 0, n = 0; k < num_devs; ++k) {
+            dp = devs + k;
+            if (! active[k])
+                continue;
+            for (j = 0; j < dp->num_slots; ++j) {
+                if (dp->slots[j].in_flight)
+                    break;
+            }
+            if (j < dp->num_slots) {
+                pfds[n].fd = dp->fd;
+                pfds[n].events = POLLIN;
+                pfds[n].revents = 0;
+                ++n;
+            }
+        }
+        if (n > 0) {
+            if (lfd >= 0) {
+                pfds[n].fd = lfd;
+                pfds[n].events = POLLIN;
+                pfds[n].revents = 0;
+            }
+            res = poll(pfds, n + (lfd >= 0), -1);
+            if (res < 0) {
+                if (EINTR != errno)
+                    pr2serr("%s: poll() failed: %s\n", __func__,
+                            safe_strerror(errno));
+                continue;
+            }
+            if ((lfd >= 0) && pfds[n].revents)
+                serve_http(lfd, op);
+            for (k = 0, n = 0; k < num_devs; ++k) {
+                dp = devs + k;
+                if (! active[k])
+                    continue;
+                for (j = 0; j < dp->num_slots; ++j) {
+                    if (dp->slots[j].in_flight)
+                        break;
+                }
+                if (j >= dp->num_slots)
+                    continue;
+                if (0 == pfds[n++].revents)
+                    continue;
+                for (j = 0; j < dp->num_slots; ++j) {
+                    sp = dp->slots + j;
+                    if (! sp->in_flight)
+                        continue;
+                    res = do_scsi_pt_receive(sp->ptvp, dp->fd, op->verbose);
+                    if (-EAGAIN != res)
+                        job_done(dp, sp, res, op);
+                }
+            }
+        }
+        for (k = 0, remaining = 0; k < num_devs; ++k) {
+            dp = devs + k;
+            if (! active[k])
+                continue;
+            if (dp->num_done >= dp->num_jobs) {
+                active[k] = false;
+                end_collection(dp);
+            } else
+                ++remaining;
+        }
+    }
+}
+
+/* Listens on --listen=[ADDR:]PORT . Returns the socket or -1. */
+static int
+open_listener(const char * arg)
+{
+    int res, fd, on;
+    char host[128];
+    const char * cp;
+    const char * port;
+    struct addrinfo hints;
+    struct addrinfo * ai;
+    struct addrinfo * aip;
+
+    cp = strrchr(arg, ':');
+    if (cp) {
+        snprintf(host, sizeof(host), "%.*s", (int)(cp - arg), arg);
+        port = cp + 1;
+        if (('[' == host[0]) && (']' == host[strlen(host) - 1])) {
+            memmove(host, host + 1, strlen(host));      /* [IPv6] */
+            host[strlen(host) - 1] = '\0';
+        }
+    } else {
+        host[0] = '\0';
+        port = arg;
+    }
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    res = getaddrinfo(host[0] ? host : NULL, port, &hints, &ai);
+    if (res) {
+        pr2serr("--listen=%s: %s\n", arg, gai_strerror(res));
+        return -1;
+    }
+    for (fd = -1, aip = ai; aip; aip = aip->ai_next) {
+        fd = socket(aip->ai_family, aip->ai_socktype, aip->ai_protocol);
+        if (fd < 0)
+            continue;
+        on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if ((0 == bind(fd, aip->ai_addr, aip->ai_addrlen)) &&
+            (0 == listen(fd, 16)))
+            break;
+        close(fd);
+        fd = -1;
+    }
+    if (fd < 0)
+        pr2serr("--listen=%s: unable to listen: %s\n", arg,
+                safe_strerror(errno));
+    freeaddrinfo(ai);
+    return fd;
+}
+
+/* Milliseconds left until deadline (from get_mono_secs()), 0 if past. */
+static int
+http_left_ms(double deadline)
+{
+    double left = deadline - get_mono_secs();
+
+    return (left > 0.0) ? (int)(left * 1000.0) : 0;
+}
+
+static bool
+send_all(int fd, const char * bp, size_t len, double deadline)
+{
+    int tmo;
+    ssize_t n;
+    struct pollfd pfd;
+
+    while (len > 0) {
+        n = send(fd, bp, len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (EINTR == errno)
+                continue;
+            if (EAGAIN != errno)
+                return false;
+            pfd.fd = fd;
+            pfd.events = POLLOUT;
+            tmo = http_left_ms(deadline);
+            if ((tmo < 1) || (poll(&pfd, 1, tmo) < 1))
+                return false;
+            continue;
+        }
+        bp += n;
+        len -= n;
+    }
+    return true;
+}
+
+/* Accepts one connection and answers a single HTTP/1.x request on it:
+ * GET /metrics yields the metrics, in the OpenMetrics format when the
+ * Accept header asks for it. Other requests get an error status. The
+ * whole exchange must finish within HTTP_TIMEOUT_MS so that a slow client
+ * can't hold up device polling. */
+static void
+serve_http(int lfd, const struct opts_t * op)
+{
+    int cfd, fl, tmo;
+    double deadline;
+    char ch;
+    ssize_t n;
+    size_t len = 0;
+    bool om;
+    char * cp;
+    const char * status = NULL;
+    char req[HTTP_REQ_LEN];
+    char hdr[256];
+    struct pollfd pfd;
+    static struct buff_t out;
+
+    cfd = accept(lfd, NULL, NULL);
+    if (cfd < 0)
+        return;
+    fl = fcntl(cfd, F_GETFL);
+    if (fl >= 0)
+        fcntl(cfd, F_SETFL, fl | O_NONBLOCK);
+    deadline = get_mono_secs() + (HTTP_TIMEOUT_MS / 1000.0);
+    pfd.fd = cfd;
+    pfd.events = POLLIN;
+    while (len < (sizeof(req) - 1)) {
+        tmo = http_left_ms(deadline);
+        if ((tmo < 1) || (poll(&pfd, 1, tmo) < 1))
+            goto fini;
+        n = recv(cfd, req + len, sizeof(req) - 1 - len, 0);
+        if (n < 0) {
+            if ((EINTR == errno) || (EAGAIN == errno))
+                continue;
+            goto fini;
+        }
+        if (0 == n)
+            goto fini;
+        len += n;
+        req[len] = '\0';
+        if (strstr(req, "\r\n\r\n") || strstr(req, "\n\n"))
+            break;
+    }
+    req[len] = '\0';
+    if (op->verbose > 1)
+        pr2serr("HTTP request: %.*s\n", (int)strcspn(req, "\r\n"), req);
+    if (0 != strncmp(req, "GET ", 4))
+        status = "405 Method Not Allowed";
+    else if ((0 != strncmp(req + 4, "/metrics", 8)) ||
+             ((' ' != req[12]) && ('?' != req[12])))
+        status = "404 Not Found";
+    if (status) {
+        snprintf(hdr, sizeof(hdr), "HTTP/1.1 %s\r\nContent-Type: "
+                 "text/plain\r\nContent-Length: %d\r\nConnection: close"
+                 "\r\n\r\n%s\n", status, (int)strlen(status) + 1, status);
+        send_all(cfd, hdr, strlen(hdr), deadline);
+        goto fini;
+    }
+    om = false;
+    for (cp = strchr(req, '\n'); cp; cp = strchr(cp + 1, '\n')) {
+        if (0 == strncasecmp(cp + 1, "Accept:", 7)) {
+            fl = strcspn(cp + 1, "\r\n");
+            ch = cp[1 + fl];
+            cp[1 + fl] = '\0';
+            if (strstr(cp + 1, "application/openmetrics-text"))
+                om = true;
+            cp[1 + fl] = ch;
+        }
+    }
+    render(&out, om);
+    snprintf(hdr, sizeof(hdr), "HTTP/1.1 200 OK\r\nContent-Type: %s\r\n"
+             "Content-Length: %zu\r\nConnection: close\r\n\r\n",
+             om ? om_ctype : prom_ctype, out.len);
+    if (send_all(cfd, hdr, strlen(hdr), deadline) && (out.len > 0))
+        send_all(cfd, out.p, out.len, deadline);
+fini:
+    close(cfd);
+}
+
+/* Writes rendered metrics to PATH.tmp then renames it to PATH so that a
+ * reader never sees a partially written file. */
+static int
+write_textfile(const char * path, const struct buff_t * bp)
+{
+    int err;
+    FILE * fp;
+    char b[1024];
+
+    snprintf(b, sizeof(b), "%s.tmp", path);
+    fp = fopen(b, "w");
+    if (NULL == fp) {
+        err = errno;
+        pr2serr("unable to open %s: %s\n", b, safe_strerror(err));
+        return sg_convert_errno(err);
+    }
+    if ((bp->len > 0) && (1 != fwrite(bp->p, bp->len, 1, fp))) {
+        err = errno;
+        fclose(fp);
+        pr2serr("unable to write %s: %s\n", b, safe_strerror(err));
+        return sg_convert_errno(err);
+    }
+    if (fclose(fp) || rename(b, path)) {
+        err = errno;
+        pr2serr("unable to rename %s: %s\n", b, safe_strerror(err));
+        return sg_convert_errno(err);
+    }
+    return 0;
+}
+
+static int
+parse_select(const char * arg)
+{
+    int k, mask = 0;
+    const char * cp;
+    size_t len;
+    static const struct {
+        const char * name;
+        int mask;
+    } sel_arr[] = {
+        {"all", SEL_ALL},
+        {"bgscan", SEL_BGSCAN},
+        {"errors", SEL_ERRORS},
+        {"ses", SEL_SES},
+        {"smart", SEL_SMART},
+        {"ssd", SEL_SSD},
+        {"temp", SEL_TEMP},
+    };
+
+    for (cp = arg; *cp; cp += len + (',' == cp[len])) {
+        len = strcspn(cp, ",");
+        for (k = 0; k < (int)(sizeof(sel_arr) / sizeof(sel_arr[0])); ++k) {
+            if ((len == strlen(sel_arr[k].name)) &&
+                (0 == strncmp(cp, sel_arr[k].name, len)))
+                break;
+        }
+        if (k >= (int)(sizeof(sel_arr) / sizeof(sel_arr[0]))) {
+            pr2serr("--select=: unknown item '%.*s'\n", (int)len, cp);
+            return -1;
+        }
+        mask |= sel_arr[k].mask;
+    }
+    return mask;
+}
+
+
+int
+main(int argc, char * argv[])
+{
+    int c, k, res, lfd, n;
+    int ret = 0;
+    double next_tm, now;
+    struct dev_t * dp;
+    struct opts_t opts;
+    struct opts_t * op = &opts;
+    struct buff_t out;
+    struct sigaction sa;
+
+    memset(op, 0, sizeof(opts));
+    memset(&out, 0, sizeof(out));
+    op->concurrency = 1;
+    op->interval = DEF_INTERVAL;
+    op->select = SEL_ALL;
+    while (1) {
+        int option_index = 0;
+
+        c = getopt_long(argc, argv, "1c:hi:l:os:t:vV", long_options,
+                        &option_index);
+        if (c == -1)
+            break;
+
+        switch (c) {
+        case '1':
+            op->do_once = true;
+            break;
+        case 'c':
+            op->concurrency = sg_get_num(optarg);
+            if ((op->concurrency < 1) ||
+                (op->concurrency > MAX_CONCURRENCY)) {
+                pr2serr("--concurrency= expects a value from 1 to %d\n",
+                        MAX_CONCURRENCY);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case 'h':
+        case '?':
+            usage();
+            return 0;
+        case 'i':
+            op->interval = sg_get_num(optarg);
+            if (op->interval < 1) {
+                pr2serr("--interval= expects a positive number of "
+                        "seconds\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case 'l':
+            op->listen_arg = optarg;
+            break;
+        case 'o':
+            op->openmetrics = true;
+            break;
+        case 's':
+            op->select = parse_select(optarg);
+            if (op->select < 0)
+                return SG_LIB_SYNTAX_ERROR;
+            break;
+        case 't':
+            op->textfile = optarg;
+            break;
+        case 'v':
+            ++op->verbose;
+            break;
+        case 'V':
+            pr2serr("version: %s\n", version_str);
+            return 0;
+        default:
+            pr2serr("unrecognised option code 0x%x ??\n", c);
+            usage();
+            return SG_LIB_SYNTAX_ERROR;
+        }
+    }
+    for ( ; optind < argc; ++optind) {
+        if (num_devs >= MAX_DEVICES) {
+            pr2serr("too many DEVICEs, limit is %d\n", MAX_DEVICES);
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        dp = devs + num_devs++;
+        dp->name = argv[optind];
+        dp->fd = -1;
+        dp->num_slots = op->concurrency;
+        escape_label(dp->label, sizeof(dp->label), dp->name,
+                     strlen(dp->name));
+        dp->samples = (struct sample_t *)calloc(MAX_SAMPLES,
+                                                sizeof(struct sample_t));
+        dp->new_samples = (struct sample_t *)calloc(MAX_SAMPLES,
+                                                    sizeof(struct sample_t));
+        if ((NULL == dp->samples) || (NULL == dp->new_samples)) {
+            pr2serr("out of memory\n");
+            return sg_convert_errno(ENOMEM);
+        }
+    }
+    if (0 == num_devs) {
+        pr2serr("missing device name!\n\n");
+        usage();
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if ((NULL == op->listen_arg) && (NULL == op->textfile))
+        op->do_once = true;
+
+#ifdef DEBUG
+    pr2serr("In DEBUG mode, ");
+    if (op->verbose) {
+        pr2serr("verbose=%d\n", op->verbose);
+        op->verbose = 1;
+    } else
+        pr2serr("\n");
+#endif
+
+    lfd = -1;
+    if (op->listen_arg && (! op->do_once)) {
+        lfd = open_listener(op->listen_arg);
+        if (lfd < 0)
+            return SG_LIB_FILE_ERROR;
+    }
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sig_handler;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    next_tm = get_mono_secs();
+    while (! stop_flag) {
+        now = get_mono_secs();
+        if (now >= next_tm) {
+            collect_all(lfd, op);
+            next_tm += op->interval;
+            if (next_tm < now)      /* collection took too long */
+                next_tm = now + op->interval;
+            if (op->do_once) {
+                render(&out, op->openmetrics);
+                if (op->textfile)
+                    ret = write_textfile(op->textfile, &out);
+                else if (out.len > 0)
+                    fwrite(out.p, out.len, 1, stdout);
+                for (k = 0, n = 0; k < num_devs; ++k)
+                    n += devs[k].up;
+                if ((0 == ret) && (0 == n))
+                    ret = SG_LIB_CAT_OTHER;
+                break;
+            }
+            if (op->textfile) {
+                render(&out, op->openmetrics);
+                res = write_textfile(op->textfile, &out);
+                if (res && (0 == ret))
+                    ret = res;
+            }
+            continue;
+        }
+        n = (int)((next_tm - now) * 1000.0) + 1;
+        if (lfd >= 0) {
+            struct pollfd pfd;
+
+            pfd.fd = lfd;
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+            if (poll(&pfd, 1, n) > 0)
+                serve_http(lfd, op);
+        } else
+            poll(NULL, 0, n);
+    }
+    if (lfd >= 0)
+        close(lfd);
+    for (k = 0; k < num_devs; ++k) {
+        close_dev(devs + k);
+        free(devs[k].samples);
+        free(devs[k].new_samples);
+        for (c = 0; c < devs[k].num_slots; ++c)
+            free(devs[k].slots[c].resp);
+    }
+    free(out.p);
+    if (op->verbose && ret)
+        pr2serr("Exit status: %d\n", ret);
+    return ret >= 0 ? ret : SG_LIB_CAT_OTHER;
+}
@@ -6,7 +6,7 @@
  *
  * Copyright (C) 2003  Grant Grundler    grundler at parisc-linux dot org
  * Copyright (C) 2003  James Bottomley       jejb at parisc-linux dot org
- * Copyright (C) 2005-2023  Douglas Gilbert   dgilbert at interlog dot com
+ * Copyright (C) 2005-2026  Douglas Gilbert   dgilbert at interlog dot com
  *
  *   This program is free software; you can redistribute it and/or modify
  *   it under the terms of the GNU General Public License as published by
@@ -39,8 +39,9 @@
 #include "sg_unaligned.h"
 #include "sg_pr2serr.h"
 #include "sg_pt.h"
+#include "sg_mpoll.h"
 
-static const char * version_str = "1.72 20230502";
+static const char * version_str = "1.74 20261015";
 
 
 #define MY_NAME "sg_format"
@@ -75,6 +76,7 @@ struct opts_t {
         bool cappid_twice;      /* -aa */
         bool cmplst;            /* -C value */
         bool cmplst_given;
+        bool do_json;           /* -j */
         bool dry_run;           /* -d */
         bool early;             /* -e */
         bool fmtmaxlba;         /* -b (only with F_WITH_PRESET) */
@@ -82,6 +84,7 @@ struct opts_t {
         bool ip_def;            /* -I */
         bool long_lba;          /* -l */
         bool mode6;             /* -6 */
+        bool multi;             /* several DEVICEs or --json */
         bool pinfo;             /* -p, deprecated, prefer fmtpinfo */
         bool poll_type;         /* -x 0|1 */
         bool poll_type_given;
@@ -100,6 +103,7 @@ struct opts_t {
         int format;             /* -F */
         uint32_t p_id;          /* set by argument of --preset=id  */
         int mode_page;          /* -M value */
+        int num_devs;           /* number of DEVICE arguments */
         int pfu;                /* -P value */
         int pie;                /* -q value */
         int sec_init;           /* -S */
@@ -109,6 +113,10 @@ struct opts_t {
         int64_t blk_count;      /* -c value */
         int64_t total_byte_count;      /* from READ CAPACITY command */
         const char * device_name;
+        const char * json_arg;  /* -j[=JO] or --json[=JO] */
+        const char * js_file;   /* -J JFN or --js-file=JFN */
+        char ** dev_names;      /* num_devs DEVICE arguments */
+        sgj_state json_st;
 };
 
 
@@ -128,6 +136,9 @@ static struct option long_options[] = {
         {"help", no_argument, 0, 'h'},
         {"ip-def", no_argument, 0, 'I'},
         {"ip_def", no_argument, 0, 'I'},
+        {"json", optional_argument, 0, '^'},    /* short option is '-j' */
+        {"js-file", required_argument, 0, 'J'},
+        {"js_file", required_argument, 0, 'J'},
         {"long", no_argument, 0, 'l'},
         {"mode", required_argument, 0, 'M'},
         {"pinfo", no_argument, 0, 'p'},
@@ -168,15 +179,16 @@ usage()
                "[--dcrt] [--dry-run]\n"
                "            [--early] [--ffmt=FFMT] [--fmtmaxlba] "
                "[--fmtpinfo=FPI]\n"
-               "            [--format] [--help] [--ip-def] [--long] "
-               "[--mode=MP] [--pfu=PFU]\n"
-               "            [--pie=PIE] [--pinfo] [--poll=PT] [--preset=ID] "
-               "[--quick]\n"
-               "            [--resize] [--rto_req] [--security] [--six] "
-               "[--size=LB_SZ]\n"
-               "            [--tape=FM] [--timeout=SECS] [--verbose] "
-               "[--verify] [--version]\n"
-               "            [--wait] DEVICE\n"
+               "            [--format] [--help] [--ip-def] [--json[=JO]] "
+               "[--js-file=JFN]\n"
+               "            [--long] [--mode=MP] [--pfu=PFU] [--pie=PIE] "
+               "[--pinfo] [--poll=PT]\n"
+               "            [--preset=ID] [--quick] [--resize] [--rto_req] "
+               "[--security]\n"
+               "            [--six] [--size=LB_SZ] [--tape=FM] "
+               "[--timeout=SECS] [--verbose]\n"
+               "            [--verify] [--version] [--wait] DEVICE "
+               "[DEVICE...]\n"
                "  where:\n"
                "    --cappid|-a     set CAPPID bit in Mode Select if count "
                "change\n"
@@ -211,6 +223,14 @@ usage()
                "only\n"
                "    --help|-h       prints out this usage message\n"
                "    --ip-def|-I     use default initialization pattern\n"
+               "    --json[=JO]|-j[=JO]    output per DEVICE results in JSON "
+               "instead of\n"
+               "                           plain text; use --json=? for "
+               "JSON help\n"
+               "    --js-file=JFN|-J JFN    JFN is a filename to which JSON "
+               "output is\n"
+               "                            written (def: stdout); truncates "
+               "then writes\n"
                "    --long|-l       allow for 64 bit lbas (default: assume "
                "32 bit lbas)\n"
                "    --mode=MP|-M MP     mode page (def: 1 -> RW error "
@@ -259,6 +279,9 @@ usage()
                "                    (default: set IMMED=1 and poll with "
                "Test Unit Ready)\n\n"
                "\tExample: sg_format --format /dev/sdc\n\n"
+               "With several DEVICEs the format is started (with IMMED set) "
+               "on all of them,\nthen they are polled together and a table "
+               "of their progress is output.\n\n"
                "This utility formats a SCSI disk [FORMAT UNIT] or resizes "
                "it. Alternatively\nif '--tape=FM' is given formats a tape "
                "[FORMAT MEDIUM]. Another alternative\nis doing the FORMAT "
@@ -396,9 +419,48 @@ sg_ll_format_with_preset(int sg_fd, bool immed, bool fmtmaxlba,
         return ret;
 }
 
+/* Returns the command timeout for a FORMAT command with 'opcode'. Without
+ * IMMED, if the device reports a recommended timeout for it in REPORT
+ * SUPPORTED OPERATION CODES that is used, else a figure based on the
+ * capacity. --timeout may raise either. */
+static int
+format_tmout(int fd, uint8_t opcode, bool immed, const struct opts_t * op)
+{
+        int tmout, dev_tmout;
+        uint8_t cdb[SG_FORMAT_WITH_PRESET_CMDLEN] SG_C_CPP_ZERO_INIT;
+
+        if (immed)
+                tmout = SHORT_TIMEOUT;
+        else {
+                if (op->total_byte_count > EIGHT_TBYTE)
+                        tmout = VLONG_FORMAT_TIMEOUT;
+                else if (op->total_byte_count > FOUR_TBYTE)
+                        tmout = LONG_FORMAT_TIMEOUT;
+                else
+                        tmout = FORMAT_TIMEOUT;
+                if (! op->dry_run) {
+                        cdb[0] = opcode;
+                        sg_pt_tmo_load(fd, (op->verbose > 1) ?
+                                                op->verbose : 0);
+                        dev_tmout = sg_pt_tmo_get(fd, cdb, sizeof(cdb),
+                                                  NULL);
+                        if (dev_tmout > 0) {
+                                tmout = dev_tmout;
+                                if (op->verbose)
+                                        pr2serr("    device's recommended "
+                                                "timeout: %d seconds\n",
+                                                tmout);
+                        }
+                }
+        }
+        if (op->timeout > tmout)
+                tmout = op->timeout;
+        return tmout;
+}
+
 /* Return 0 on success, else see sg_ll_format_unit_v2() */
 static int
-scsi_format_unit(int fd, const struct opts_t * op)
+scsi_format_unit(int fd, struct opts_t * op)
 {
         bool need_param_lst, longlist, ip_desc, first;
         bool immed = ! op->fwait;
@@ -412,6 +474,7 @@ scsi_format_unit(int fd, const struct opts_t * op)
         uint8_t * param;
         uint8_t * free_param = NULL;
         char b[80];
+        sgj_state * jsp = &op->json_st;
 
         param = sg_memalign(max_param_sz, 0, &free_param, false);
         if (NULL == param) {
@@ -419,18 +482,7 @@ scsi_format_unit(int fd, const struct opts_t * op)
                         __func__);
                 return sg_convert_errno(ENOMEM);
         }
-        if (immed)
-                tmout = SHORT_TIMEOUT;
-        else {
-                if (op->total_byte_count > EIGHT_TBYTE)
-                        tmout = VLONG_FORMAT_TIMEOUT;
-                else if (op->total_byte_count > FOUR_TBYTE)
-                        tmout = LONG_FORMAT_TIMEOUT;
-                else
-                        tmout = FORMAT_TIMEOUT;
-        }
-        if (op->timeout > tmout)
-                tmout = op->timeout;
+        tmout = format_tmout(fd, SG_FORMAT_MEDIUM_CMD, immed, op);
         longlist = (op->pie > 0);  /* only set LONGLIST if PI_EXPONENT>0 */
         ip_desc = (op->ip_def || op->sec_init);
         off = longlist ? LONG_FORMAT_HEADER_SZ : SH_FORMAT_HEADER_SZ;
@@ -500,18 +552,21 @@ scsi_format_unit(int fd, const struct opts_t * op)
                 return 0;
 
         if (! op->dry_run)
-                printf("\n%s has started\n", fu_s);
+                sgj_pr_hr(jsp, "\n%s has started\n", fu_s);
+        if (op->multi)
+                return 0;       /* polled by format_fleet() */
 
         if (op->early) {
                 if (immed)
-                        printf("%s continuing,\n    request sense or "
-                               "test unit ready can be used to monitor "
-                               "progress\n", fu_s);
+                        sgj_pr_hr(jsp, "%s continuing,\n    request sense or "
+                                  
+                                  "test unit ready can be used to monitor "
+                                  "progress\n", fu_s);
                 return 0;
         }
 
         if (op->dry_run) {
-                printf("No point in polling for progress, so exit\n");
+                sgj_pr_hr(jsp, "No point in polling for progress, so exit\n");
                 return 0;
         }
         poll_wait_secs = op->ffmt ? POLL_DURATION_FFMT_SECS :
@@ -525,8 +580,8 @@ scsi_format_unit(int fd, const struct opts_t * op)
                         if (progress >= 0) {
                                 pr = (progress * 100) / 65536;
                                 rem = ((progress * 100) % 65536) / 656;
-                                printf("%s in progress, %d.%02d%% done\n",
-                                       fu_s, pr, rem);
+                                sgj_pr_hr(jsp, "%s in progress, %d.%02d%% "
+                                          "done\n", fu_s, pr, rem);
                         } else {
                                 if (first && op->verbose)
                                         pr2serr("%s seems to be successful "
@@ -568,8 +623,8 @@ scsi_format_unit(int fd, const struct opts_t * op)
                         if (progress >= 0) {
                                 pr = (progress * 100) / 65536;
                                 rem = ((progress * 100) % 65536) / 656;
-                                printf("%s in progress, %d.%02d%% done\n",
-                                       fu_s, pr, rem);
+                                sgj_pr_hr(jsp, "%s in progress, %d.%02d%% "
+                                          "done\n", fu_s, pr, rem);
                         } else {
                                 if (first && op->verbose)
                                         pr2serr("%s seems to be successful "
@@ -581,32 +636,22 @@ scsi_format_unit(int fd, const struct opts_t * op)
                 if (free_reqSense)
                         free(free_reqSense);
         }
-        printf("FORMAT UNIT Complete\n");
+        sgj_pr_hr(jsp, "FORMAT UNIT Complete\n");
         return 0;
 }
 
 /* Return 0 on success, else see sg_ll_format_medium() above */
 static int
-scsi_format_medium(int fd, const struct opts_t * op)
+scsi_format_medium(int fd, struct opts_t * op)
 {
         bool first;
         bool immed = ! op->fwait;
         int res, progress, pr, rem, resp_len, tmout;
         int vb = op->verbose;
         char b[80];
+        sgj_state * jsp = &op->json_st;
 
-        if (immed)
-                tmout = SHORT_TIMEOUT;
-        else {
-                if (op->total_byte_count > EIGHT_TBYTE)
-                        tmout = VLONG_FORMAT_TIMEOUT;
-                else if (op->total_byte_count > FOUR_TBYTE)
-                        tmout = LONG_FORMAT_TIMEOUT;
-                else
-                        tmout = FORMAT_TIMEOUT;
-        }
-        if (op->timeout > tmout)
-                tmout = op->timeout;
+        tmout = format_tmout(fd, SG_FORMAT_MEDIUM_CMD, immed, op);
         if (op->dry_run) {
                 res = 0;
                 pr2serr("Due to --dry-run option bypassing %s command\n",
@@ -624,17 +669,20 @@ scsi_format_medium(int fd, const struct opts_t * op)
                 return 0;
 
         if (! op->dry_run)
-                printf("\n%s has started\n", fm_s);
+                sgj_pr_hr(jsp, "\n%s has started\n", fm_s);
+        if (op->multi)
+                return 0;       /* polled by format_fleet() */
         if (op->early) {
                 if (immed)
-                        printf("%s continuing,\n    request sense or "
-                               "test unit ready can be used to monitor "
-                               "progress\n", fm_s);
+                        sgj_pr_hr(jsp, "%s continuing,\n    request sense or "
+                                  
+                                  "test unit ready can be used to monitor "
+                                  "progress\n", fm_s);
                 return 0;
         }
 
         if (op->dry_run) {
-                printf("No point in polling for progress, so exit\n");
+                sgj_pr_hr(jsp, "No point in polling for progress, so exit\n");
                 return 0;
         }
         if (! op->poll_type) {
@@ -646,8 +694,8 @@ scsi_format_medium(int fd, const struct opts_t * op)
                         if (progress >= 0) {
                                 pr = (progress * 100) / 65536;
                                 rem = ((progress * 100) % 65536) / 656;
-                                printf("%s in progress, %d.%02d%% done\n",
-                                       fm_s, pr, rem);
+                                sgj_pr_hr(jsp, "%s in progress, %d.%02d%% "
+                                          "done\n", fm_s, pr, rem);
                         } else {
                                 if (first && op->verbose)
                                         pr2serr("%s seems to be successful "
@@ -689,8 +737,8 @@ scsi_format_medium(int fd, const struct opts_t * op)
                         if (progress >= 0) {
                                 pr = (progress * 100) / 65536;
                                 rem = ((progress * 100) % 65536) / 656;
-                                printf("%s in progress, %d.%02d%% done\n",
-                                       fm_s, pr, rem);
+                                sgj_pr_hr(jsp, "%s in progress, %d.%02d%% "
+                                          "done\n", fm_s, pr, rem);
                         } else {
                                 if (first && op->verbose)
                                         pr2serr("%s seems to be successful "
@@ -702,32 +750,22 @@ scsi_format_medium(int fd, const struct opts_t * op)
                 if (free_reqSense)
                         free(free_reqSense);
         }
-        printf("FORMAT MEDIUM Complete\n");
+        sgj_pr_hr(jsp, "FORMAT MEDIUM Complete\n");
         return 0;
 }
 
 /* Return 0 on success, else see sg_ll_format_medium() above */
 static int
-scsi_format_with_preset(int fd, const struct opts_t * op)
+scsi_format_with_preset(int fd, struct opts_t * op)
 {
         bool first;
         bool immed = ! op->fwait;
         int res, progress, pr, rem, resp_len, tmout;
         int vb = op->verbose;
         char b[80];
+        sgj_state * jsp = &op->json_st;
 
-        if (immed)
-                tmout = SHORT_TIMEOUT;
-        else {
-                if (op->total_byte_count > EIGHT_TBYTE)
-                        tmout = VLONG_FORMAT_TIMEOUT;
-                else if (op->total_byte_count > FOUR_TBYTE)
-                        tmout = LONG_FORMAT_TIMEOUT;
-                else
-                        tmout = FORMAT_TIMEOUT;
-        }
-        if (op->timeout > tmout)
-                tmout = op->timeout;
+        tmout = format_tmout(fd, SG_FORMAT_WITH_PRESET_CMD, immed, op);
         if (op->dry_run) {
                 res = 0;
                 pr2serr("Due to --dry-run option bypassing FORMAT WITH "
@@ -744,16 +782,18 @@ scsi_format_with_preset(int fd, const struct opts_t * op)
                 return 0;
 
         if (! op->dry_run)
-                printf("\n%s has started\n", fwp_s);
+                sgj_pr_hr(jsp, "\n%s has started\n", fwp_s);
+        if (op->multi)
+                return 0;       /* polled by format_fleet() */
         if (op->early) {
                 if (immed)
-                        printf("%s continuing,\n    Request sense can "
-                               "be used to monitor progress\n", fwp_s);
+                        sgj_pr_hr(jsp, "%s continuing,\n    Request sense can "
+                                  "be used to monitor progress\n", fwp_s);
                 return 0;
         }
 
         if (op->dry_run) {
-                printf("No point in polling for progress, so exit\n");
+                sgj_pr_hr(jsp, "No point in polling for progress, so exit\n");
                 return 0;
         }
         if (! op->poll_type) {
@@ -765,8 +805,8 @@ scsi_format_with_preset(int fd, const struct opts_t * op)
                         if (progress >= 0) {
                                 pr = (progress * 100) / 65536;
                                 rem = ((progress * 100) % 65536) / 656;
-                                printf("%s in progress, %d.%02d%% done\n",
-                                       fwp_s, pr, rem);
+                                sgj_pr_hr(jsp, "%s in progress, %d.%02d%% "
+                                          "done\n", fwp_s, pr, rem);
                         } else {
                                 if (first && op->verbose)
                                         pr2serr("%s seems to be successful "
@@ -808,8 +848,8 @@ scsi_format_with_preset(int fd, const struct opts_t * op)
                         if (progress >= 0) {
                                 pr = (progress * 100) / 65536;
                                 rem = ((progress * 100) % 65536) / 656;
-                                printf("%s in progress, %d.%02d%% done\n",
-                                       fwp_s, pr, rem);
+                                sgj_pr_hr(jsp, "%s in progress, %d.%02d%% "
+                                          "done\n", fwp_s, pr, rem);
                         } else {
                                 if (first && op->verbose)
                                         pr2serr("%s seems to be successful "
@@ -821,7 +861,7 @@ scsi_format_with_preset(int fd, const struct opts_t * op)
                 if (free_reqSense)
                         free(free_reqSense);
         }
-        printf("FORMAT WITH PRESET Complete\n");
+        sgj_pr_hr(jsp, "FORMAT WITH PRESET Complete\n");
         return 0;
 }
 
@@ -895,7 +935,7 @@ get_lu_name(const uint8_t * bp, int u_len, char * b, int b_len)
 
 static int
 print_dev_id(int fd, uint8_t * sinq_resp, int max_rlen,
-             const struct opts_t * op)
+             struct opts_t * op)
 {
         bool has_sn = false;
         bool has_di = false;
@@ -905,6 +945,7 @@ print_dev_id(int fd, uint8_t * sinq_resp, int max_rlen,
         uint8_t  * free_b = NULL;
         char a[MAX_VPD_RESP_LEN];
         char pdt_name[64];
+        sgj_state * jsp = &op->json_st;
 
         verb = (op->verbose > 1) ? op->verbose - 1 : 0;
         memset(sinq_resp, 0, max_rlen);
@@ -924,15 +965,16 @@ print_dev_id(int fd, uint8_t * sinq_resp, int max_rlen,
         memcpy(sinq_resp, b, (n < max_rlen) ? n : max_rlen);
         if (n == SAFE_STD_INQ_RESP_LEN) {
                 pdt = b[0] & PDT_MASK;
-                printf("    %.8s  %.16s  %.4s   peripheral_type: %s [0x%x]\n",
-                       (const char *)(b + 8), (const char *)(b + 16),
-                       (const char *)(b + 32),
-                       sg_get_pdt_str(pdt, sizeof(pdt_name), pdt_name), pdt);
+                sgj_pr_hr(jsp, "    %.8s  %.16s  %.4s   peripheral_type: %s "
+                          "[0x%x]\n", (const char *)(b + 8),
+                          (const char *)(b + 16), (const char *)(b + 32),
+                          sg_get_pdt_str(pdt, sizeof(pdt_name), pdt_name),
+                          pdt);
                 if (op->verbose)
-                        printf("      PROTECT=%d\n", !!(b[5] & 1));
+                        sgj_pr_hr(jsp, "      PROTECT=%d\n", !!(b[5] & 1));
                 if (b[5] & 1)
-                        printf("      << supports protection information>>"
-                               "\n");
+                        sgj_pr_hr(jsp, "      << supports protection "
+                                  "information>>\n");
         } else {
                 pr2serr("Short INQUIRY response: %d bytes, expect at least "
                         "36\n", n);
@@ -986,8 +1028,8 @@ print_dev_id(int fd, uint8_t * sinq_resp, int max_rlen,
                 n = sg_get_unaligned_be16(b + 2);
                 if (n > (int)(MAX_VPD_RESP_LEN - 4))
                         n = (MAX_VPD_RESP_LEN - 4);
-                printf("      Unit serial number: %.*s\n", n,
-                       (const char *)(b + 4));
+                sgj_pr_hr(jsp, "      Unit serial number: %.*s\n", n,
+                          (const char *)(b + 4));
         }
         if (has_di) {
                 res = sg_ll_inquiry(fd, false, true /* evpd */, VPD_DEVICE_ID,
@@ -1008,7 +1050,7 @@ print_dev_id(int fd, uint8_t * sinq_resp, int max_rlen,
                         n = (MAX_VPD_RESP_LEN - 4);
                 n = strlen(get_lu_name(b, n + 4, a, sizeof(a)));
                 if (n > 0)
-                        printf("      LU name: %.*s\n", n, a);
+                        sgj_pr_hr(jsp, "      LU name: %.*s\n", n, a);
         }
 out:
         if (has_cappid_vpd)
@@ -1034,6 +1076,7 @@ print_read_cap(int fd, struct opts_t * op)
         uint64_t llast_blk_addr;
         int64_t ll;
         char b[80];
+        sgj_state * jsp = &op->json_st;
 
         resp_buff = sg_memalign(RCAP_REPLY_LEN, 0, &free_resp_buff, false);
         if (NULL == resp_buff) {
@@ -1048,24 +1091,25 @@ print_read_cap(int fd, struct opts_t * op)
                 if (0 == res) {
                         llast_blk_addr = sg_get_unaligned_be64(resp_buff + 0);
                         block_size = sg_get_unaligned_be32(resp_buff + 8);
-                        printf("Read Capacity (16) results:\n");
-                        printf("   Protection: prot_en=%d, p_type=%d, "
-                               "p_i_exponent=%d\n",
-                               !!(resp_buff[12] & 0x1),
-                               ((resp_buff[12] >> 1) & 0x7),
-                               ((resp_buff[13] >> 4) & 0xf));
-                        printf("   Logical block provisioning: lbpme=%d, "
-                               "lbprz=%d\n", !!(resp_buff[14] & 0x80),
-                               !!(resp_buff[14] & 0x40));
-                        printf("   Logical blocks per physical block "
-                               "exponent=%d\n", resp_buff[13] & 0xf);
-                        printf("   Lowest aligned logical block address=%d\n",
-                               0x3fff & sg_get_unaligned_be16(resp_buff +
-                                                              14));
-                        printf("   Number of logical blocks=%" PRIu64 "\n",
-                               llast_blk_addr + 1);
-                        printf("   Logical block size=%u bytes\n",
-                               block_size);
+                        sgj_pr_hr(jsp, "Read Capacity (16) results:\n");
+                        sgj_pr_hr(jsp, "   Protection: prot_en=%d, p_type=%d, "
+                                  "p_i_exponent=%d\n", !!(resp_buff[12] & 0x1),
+                                  ((resp_buff[12] >> 1) & 0x7),
+                                  ((resp_buff[13] >> 4) & 0xf));
+                        sgj_pr_hr(jsp, "   Logical block provisioning: "
+                                  "lbpme=%d, lbprz=%d\n",
+                                  !!(resp_buff[14] & 0x80),
+                                  !!(resp_buff[14] & 0x40));
+                        sgj_pr_hr(jsp, "   Logical blocks per physical block "
+                                  "exponent=%d\n", resp_buff[13] & 0xf);
+                        sgj_pr_hr(jsp, "   Lowest aligned logical block "
+                                  "address=%d\n",
+                                  0x3fff & sg_get_unaligned_be16(resp_buff +
+                                                                 14));
+                        sgj_pr_hr(jsp, "   Number of logical blocks=%" PRIu64
+                                  "\n", llast_blk_addr + 1);
+                        sgj_pr_hr(jsp, "   Logical block size=%u bytes\n",
+                                  block_size);
                         ll = (int64_t)(llast_blk_addr + 1) * block_size;
                         if (ll > op->total_byte_count)
                                 op->total_byte_count = ll;
@@ -1080,17 +1124,20 @@ print_read_cap(int fd, struct opts_t * op)
                         block_size = sg_get_unaligned_be32(resp_buff + 4);
                         if (0xffffffff == last_blk_addr) {
                                 if (op->verbose)
-                                        printf("Read Capacity (10) response "
-                                               "indicates that Read Capacity "
-                                               "(16) is required\n");
+                                        sgj_pr_hr(jsp, "Read Capacity (10) "
+                                                  
+                                                  "response indicates that "
+                                                  
+                                                  "Read Capacity (16) is "
+                                                  "required\n");
                                 res = -2;
                                 goto out;
                         }
-                        printf("Read Capacity (10) results:\n");
-                        printf("   Number of logical blocks=%u\n",
-                               last_blk_addr + 1);
-                        printf("   Logical block size=%u bytes\n",
-                               block_size);
+                        sgj_pr_hr(jsp, "Read Capacity (10) results:\n");
+                        sgj_pr_hr(jsp, "   Number of logical blocks=%u\n",
+                                  last_blk_addr + 1);
+                        sgj_pr_hr(jsp, "   Logical block size=%u bytes\n",
+                                  block_size);
                         ll = (int64_t)(last_blk_addr + 1) * block_size;
                         if (ll > op->total_byte_count)
                                 op->total_byte_count = ll;
@@ -1123,6 +1170,7 @@ fetch_block_desc(int fd, uint8_t * dbuff, int * calc_lenp, int * bd_lb_szp,
         uint64_t ull;
         int64_t ll;
         char b[80];
+        sgj_state * jsp = &op->json_st;
 
 again_with_long_lba:
         memset(dbuff, 0, MAX_BUFF_SZ);
@@ -1203,11 +1251,11 @@ again_with_long_lba:
         rq_lb_sz = op->lblk_sz;
         if (first) {
                 first = false;
-                printf("Mode Sense (block descriptor) data, prior to "
-                       "changes:\n");
+                sgj_pr_hr(jsp, "Mode Sense (block descriptor) data, prior to "
+                          "changes:\n");
         }
         if (dev_specific_param & 0x40)
-                printf("  <<< Write Protect (WP) bit set >>>\n");
+                sgj_pr_hr(jsp, "  <<< Write Protect (WP) bit set >>>\n");
         if (bd_len > 0) {
                 ull = op->long_lba ? sg_get_unaligned_be64(dbuff + offset) :
                                  sg_get_unaligned_be32(dbuff + offset);
@@ -1237,19 +1285,20 @@ again_with_long_lba:
                         }
                 }
                 if (op->long_lba) {
-                        printf("  <<< longlba flag set (64 bit lba) >>>\n");
+                        sgj_pr_hr(jsp, "  <<< longlba flag set (64 bit lba) "
+                                  ">>>\n");
                         if (bd_len != 16)
                                 prob = true;
                 } else if (bd_len != 8)
                         prob = true;
-                printf("  Number of blocks=%" PRIu64 " [0x%" PRIx64 "]\n",
-                       ull, ull);
-                printf("  Block size=%d [0x%x]\n", bd_lbsz, bd_lbsz);
+                sgj_pr_hr(jsp, "  Number of blocks=%" PRIu64 " [0x%" PRIx64
+                          "]\n", ull, ull);
+                sgj_pr_hr(jsp, "  Block size=%d [0x%x]\n", bd_lbsz, bd_lbsz);
                 ll = (int64_t)ull * bd_lbsz;
                 if (ll > op->total_byte_count)
                         op->total_byte_count = ll;
         } else {
-                printf("  No block descriptors present\n");
+                sgj_pr_hr(jsp, "  No block descriptors present\n");
                 prob = true;
         }
         if (op->resize || (op->format && ((op->blk_count != 0) ||
@@ -1301,7 +1350,7 @@ parse_cmd_line(struct opts_t * op, int argc, char **argv)
                 int c;
 
                 c = getopt_long(argc, argv,
-                                "abc:C:dDeE:f:FhIlm:M:pP:q:QrRs:St:T:vVwx:y6",
+                                "abc:C:dDeE:f:FhIj::J:lm:M:pP:q:QrRs:St:T:vVwx:y6",
                                 long_options, &option_index);
                 if (c == -1)
                         break;
@@ -1373,6 +1422,20 @@ parse_cmd_line(struct opts_t * op, int argc, char **argv)
                 case 'I':
                         op->ip_def = true;
                         break;
+                case 'j':       /* for: -j[=JO] */
+                case '^':       /* for: --json[=JO] */
+                        op->do_json = true;
+                        if (optarg)
+                                op->json_arg = (('j' == c) &&
+                                                ('=' == *optarg)) ?
+                                               optarg + 1 : optarg;
+                        else
+                                op->json_arg = NULL;
+                        break;
+                case 'J':
+                        op->do_json = true;
+                        op->js_file = optarg;
+                        break;
                 case 'l':
                         op->long_lba = true;
                         op->do_rcap16 = true;
@@ -1479,17 +1542,9 @@ parse_cmd_line(struct opts_t * op, int argc, char **argv)
                 }
         }
         if (optind < argc) {
-                if (NULL == op->device_name) {
-                        op->device_name = argv[optind];
-                        ++optind;
-                }
-        }
-        if (optind < argc) {
-                for (; optind < argc; ++optind)
-                        pr2serr("Unexpected extra argument: %s\n",
-                                argv[optind]);
-                usage();
-                return SG_LIB_SYNTAX_ERROR;
+                op->device_name = argv[optind];
+                op->dev_names = argv + optind;
+                op->num_devs = argc - optind;
         }
 #ifdef DEBUG
         pr2serr("In DEBUG mode, ");
@@ -1560,50 +1615,39 @@ parse_cmd_line(struct opts_t * op, int argc, char **argv)
         }
         if ((op->ffmt > 0) && (! op->cmplst_given))
                 op->cmplst = false; /* SBC-4 silent; FFMT&&CMPLST unlikely */
+        op->multi = ((op->num_devs > 1) || op->do_json);
+        if (op->multi) {
+                if (! (op->format || (op->tape >= 0) || op->preset)) {
+                        pr2serr("with several DEVICEs or '--json' need one "
+                                "of: '--format', '--tape=' or\n"
+                                "'--preset='\n");
+                        return SG_LIB_CONTRADICT;
+                }
+                if (op->fwait) {
+                        pr2serr("'--wait' not permitted with several DEVICEs "
+                                "or '--json'\n");
+                        return SG_LIB_CONTRADICT;
+                }
+        }
         return 0;
 }
 
 
-int
-main(int argc, char **argv)
+
+/* Does what is asked of one DEVICE, already open on fd. With op->multi
+ * the format command is only started. Returns 0 on success. */
+static int
+format_one(int fd, struct opts_t * op, uint8_t * dbuff, uint8_t * inq_resp)
 {
-        int bd_lb_sz, calc_len, pdt, res, rq_lb_sz, vb;
-        int fd = -1;
+        int bd_lb_sz, calc_len, pdt, res, rq_lb_sz;
         int ret = 0;
-        const int dbuff_sz = MAX_BUFF_SZ;
+        int vb = op->verbose;
         const int inq_resp_sz = SAFE_STD_INQ_RESP_LEN;
-        struct opts_t * op;
-        uint8_t * dbuff;
-        uint8_t * free_dbuff = NULL;
-        uint8_t * inq_resp;
-        uint8_t * free_inq_resp = NULL;
-        struct opts_t opts;
         char b[80];
+        sgj_state * jsp = &op->json_st;
 
-        op = &opts;
-        memset(op, 0, sizeof(opts));
-        if (getenv("SG3_UTILS_INVOCATION"))
-                sg_rep_invocation(MY_NAME, version_str, argc, argv, NULL);
-        ret = parse_cmd_line(op, argc, argv);
-        if (ret)
-                return (SG_LIB_OK_FALSE == ret) ? 0 : ret;
-        vb = op->verbose;
-
-        dbuff = sg_memalign(dbuff_sz, 0, &free_dbuff, false);
-        inq_resp = sg_memalign(inq_resp_sz, 0, &free_inq_resp, false);
-        if ((NULL == dbuff) || (NULL == inq_resp)) {
-                pr2serr("Unable to allocate heap\n");
-                ret = sg_convert_errno(ENOMEM);
-                goto out;
-        }
-
-        if ((fd = sg_cmds_open_device(op->device_name, false, vb)) < 0) {
-                pr2serr("error opening device file: %s: %s\n",
-                        op->device_name, safe_strerror(-fd));
-                ret = sg_convert_errno(-fd);
-                goto out;
-        }
-
+        has_cappid_vpd = false;
+        has_fpresets_vpd = false;
         if (op->format > 2)
                 goto format_only;
 
@@ -1707,7 +1751,8 @@ again_sp_false:
                 }
         }
         if (op->resize) {
-                printf("Resize operation seems to have been successful\n");
+                sgj_pr_hr(jsp, "Resize operation seems to have been "
+                          "successful\n");
                 goto out;
         } else if (! op->format) {
                 res = print_read_cap(fd, op);
@@ -1719,23 +1764,25 @@ again_sp_false:
                         ret = -1;
                 if ((res > 0) && (bd_lb_sz > 0) &&
                     (res != (int)bd_lb_sz)) {
-                        printf("  Warning: mode sense and read capacity "
-                               "report different block sizes [%d,%d]\n",
-                               bd_lb_sz, res);
-                        printf("           Probably needs format\n");
+                        sgj_pr_hr(jsp, "  Warning: mode sense and read "
+                                  
+                                  "capacity report different block sizes "
+                                  "[%d,%d]\n", bd_lb_sz, res);
+                        sgj_pr_hr(jsp, "           Probably needs format\n");
                 }
                 if ((PDT_TAPE == pdt) || (PDT_MCHANGER == pdt) ||
                     (PDT_ADC == pdt))
-                        printf("No changes made. To format use '--tape='.\n");
+                        sgj_pr_hr(jsp, "No changes made. To format use "
+                                  "'--tape='.\n");
                 else
-                        printf("No changes made. To format use '--format'. "
-                               "To resize use '--resize'\n");
+                        sgj_pr_hr(jsp, "No changes made. To format use "
+                                  "'--format'. To resize use '--resize'\n");
                 goto out;
         }
 
         if (op->format) {
 format_only:
-                if (! op->quick)
+                if (! (op->quick || op->multi))
                     sg_warn_and_wait("FORMAT UNIT", op->device_name, true);
                 res = scsi_format_unit(fd, op);
                 ret = res;
@@ -1751,7 +1798,7 @@ format_only:
 format_med:
         if (! op->poll_type_given) /* SSC-5 specifies REQUEST SENSE polling */
                 op->poll_type = true;
-        if (! op->quick)
+        if (! (op->quick || op->multi))
             sg_warn_and_wait("FORMAT MEDIUM", op->device_name, true);
         res = scsi_format_medium(fd, op);
         ret = res;
@@ -1763,7 +1810,7 @@ format_med:
         goto out;
 
 format_with_pre:
-        if (! op->quick)
+        if (! (op->quick || op->multi))
             sg_warn_and_wait("FORMAT WITH PRESET", op->device_name, true);
         res = scsi_format_with_preset(fd, op);
         ret = res;
@@ -1773,6 +1820,170 @@ format_with_pre:
                         pr2serr("    try '-v' for more information\n");
         }
 
+out:
+        return ret;
+}
+
+/* Starts the format (with IMMED set) on each DEVICE in turn, then polls
+ * all of them from one loop rather than one DEVICE after another. Returns
+ * the exit status of the first DEVICE that failed, else 0. */
+static int
+format_fleet(struct opts_t * op, uint8_t * dbuff, uint8_t * inq_resp,
+             sgj_opaque_p jop)
+{
+        int k, fd, res, len;
+        int ret = 0;
+        int vb = op->verbose;
+        const char * cmd_name;
+        char * names;
+        struct sg_mpoll_dev * mdp_arr;
+        struct sg_mpoll_dev * mdp;
+        struct sg_mpoll_opts mpo;
+        sgj_state * jsp = &op->json_st;
+
+        mdp_arr = (struct sg_mpoll_dev *)calloc(op->num_devs,
+                                                sizeof(*mdp_arr));
+        if (NULL == mdp_arr) {
+                pr2serr("%s: unable to obtain heap\n", __func__);
+                return sg_convert_errno(ENOMEM);
+        }
+        for (k = 0, len = 0, mdp = mdp_arr; k < op->num_devs; ++k, ++mdp) {
+                mdp->dev_name = op->dev_names[k];
+                mdp->sg_fd = -1;
+                mdp->progress = -1;
+                len += strlen(mdp->dev_name) + 2;
+        }
+        if (op->format)
+                cmd_name = "FORMAT UNIT";
+        else if (op->tape >= 0)
+                cmd_name = "FORMAT MEDIUM";
+        else
+                cmd_name = "FORMAT WITH PRESET";
+        if (! op->quick) {
+                names = (char *)calloc(len + 1, 1);
+                for (k = 0; names && (k < op->num_devs); ++k) {
+                        if (k > 0)
+                                strcat(names, ", ");
+                        strcat(names, op->dev_names[k]);
+                }
+                sg_warn_and_wait(cmd_name, (names ? names : "all DEVICEs"),
+                                 true);
+                free(names);
+        }
+        for (k = 0, mdp = mdp_arr; k < op->num_devs; ++k, ++mdp) {
+                sgj_pr_hr(jsp, "%s%s:\n", ((k > 0) ? "\n" : ""),
+                          mdp->dev_name);
+                fd = sg_cmds_open_device(mdp->dev_name, false, vb);
+                if (fd < 0) {
+                        pr2serr("error opening device file: %s: %s\n",
+                                mdp->dev_name, safe_strerror(-fd));
+                        mdp->res = sg_convert_errno(-fd);
+                        continue;
+                }
+                mdp->sg_fd = fd;
+                res = format_one(fd, op, dbuff, inq_resp);
+                if (res) {
+                        pr2serr("%s failed on %s\n", cmd_name,
+                                mdp->dev_name);
+                        mdp->res = (res > 0) ? res : SG_LIB_CAT_OTHER;
+                } else if (! op->dry_run)
+                        sg_mpoll_started(mdp, fd, true, 0);
+        }
+        /* like FORMAT MEDIUM, format_one() may have changed poll_type */
+        for (k = 0, mdp = mdp_arr; k < op->num_devs; ++k, ++mdp)
+                mdp->use_rs = op->poll_type;
+        if (op->dry_run)
+                sgj_pr_hr(jsp, "No point in polling for progress, so "
+                          "exit\n");
+        else if (op->early)
+                sgj_pr_hr(jsp, "\n%s continuing,\n    request sense or "
+                          "test unit ready can be used to monitor "
+                          "progress\n", cmd_name);
+        else {
+                memset(&mpo, 0, sizeof(mpo));
+                mpo.max_secs = op->ffmt ? POLL_DURATION_FFMT_SECS :
+                                          POLL_DURATION_SECS;
+                mpo.verbose = vb;
+                sg_mpoll_run(mdp_arr, op->num_devs, cmd_name, &mpo, jsp);
+        }
+        sg_mpoll_js(jsp, jop, mdp_arr, op->num_devs);
+        for (k = 0, mdp = mdp_arr; k < op->num_devs; ++k, ++mdp) {
+                if (mdp->res && (0 == ret))
+                        ret = mdp->res;
+                if (mdp->sg_fd >= 0) {
+                        res = sg_cmds_close_device(mdp->sg_fd);
+                        if (res < 0)
+                                pr2serr("close error: %s: %s\n",
+                                        mdp->dev_name, safe_strerror(-res));
+                }
+        }
+        free(mdp_arr);
+        return ret;
+}
+
+int
+main(int argc, char **argv)
+{
+        int res, vb;
+        int fd = -1;
+        int ret = 0;
+        const int dbuff_sz = MAX_BUFF_SZ;
+        const int inq_resp_sz = SAFE_STD_INQ_RESP_LEN;
+        struct opts_t * op;
+        uint8_t * dbuff;
+        uint8_t * free_dbuff = NULL;
+        uint8_t * inq_resp;
+        uint8_t * free_inq_resp = NULL;
+        sgj_state * jsp;
+        sgj_opaque_p jop = NULL;
+        struct opts_t opts;
+        char b[80];
+
+        op = &opts;
+        memset(op, 0, sizeof(opts));
+        if (getenv("SG3_UTILS_INVOCATION"))
+                sg_rep_invocation(MY_NAME, version_str, argc, argv, NULL);
+        ret = parse_cmd_line(op, argc, argv);
+        if (ret)
+                return (SG_LIB_OK_FALSE == ret) ? 0 : ret;
+        vb = op->verbose;
+        jsp = &op->json_st;
+        if (op->do_json) {
+                if (! sgj_init_state(jsp, op->json_arg)) {
+                        int bad_char = jsp->first_bad_char;
+                        char e[1500];
+
+                        if (bad_char)
+                                pr2serr("bad argument to --json= option, "
+                                        "unrecognized character '%c'\n\n",
+                                        bad_char);
+                        sg_json_usage(0, e, sizeof(e));
+                        pr2serr("%s", e);
+                        return SG_LIB_SYNTAX_ERROR;
+                }
+                jop = sgj_start_r(MY_NAME, version_str, argc, argv, jsp);
+        }
+
+        dbuff = sg_memalign(dbuff_sz, 0, &free_dbuff, false);
+        inq_resp = sg_memalign(inq_resp_sz, 0, &free_inq_resp, false);
+        if ((NULL == dbuff) || (NULL == inq_resp)) {
+                pr2serr("Unable to allocate heap\n");
+                ret = sg_convert_errno(ENOMEM);
+                goto out;
+        }
+        if (op->multi) {
+                ret = format_fleet(op, dbuff, inq_resp, jop);
+                goto out;
+        }
+
+        if ((fd = sg_cmds_open_device(op->device_name, false, vb)) < 0) {
+                pr2serr("error opening device file: %s: %s\n",
+                        op->device_name, safe_strerror(-fd));
+                ret = sg_convert_errno(-fd);
+                goto out;
+        }
+        ret = format_one(fd, op, dbuff, inq_resp);
+
 out:
         if (free_dbuff)
                 free(free_dbuff);
@@ -1790,5 +2001,37 @@ out:
                 if (! sg_if_can2stderr("sg_format failed: ", ret))
                         pr2serr("Some error occurred, %s\n", tawvv_s);
         }
-        return (ret >= 0) ? ret : SG_LIB_CAT_OTHER;
+        ret = (ret >= 0) ? ret : SG_LIB_CAT_OTHER;
+        if (jsp->pr_as_json) {
+                FILE * fp = stdout;
+
+                if (op->js_file) {
+                        if ((1 != strlen(op->js_file)) ||
+                            ('-' != op->js_file[0])) {
+                                fp = fopen(op->js_file, "w");
+                                if (NULL == fp) {
+                                        int e = errno;
+
+                                        pr2serr("unable to open file: %s "
+                                                "[%s]\n", op->js_file,
+                                                safe_strerror(e));
+                                        ret = sg_convert_errno(e);
+                                }
+                        }
+                        /* '--js-file=-' will send JSON output to stdout */
+                }
+                if (fp) {
+                        const char * estr = NULL;
+
+                        if (sg_exit2str(ret, jsp->verbose, sizeof(b), b)) {
+                                if (strlen(b) > 0)
+                                        estr = b;
+                        }
+                        sgj_js2file_estr(jsp, NULL, ret, estr, fp);
+                }
+                if (op->js_file && fp && (stdout != fp))
+                        fclose(fp);
+                sgj_finish(jsp);
+        }
+        return ret;
 }
@@ -0,0 +1,312 @@
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#ifndef SG_LIB_WIN32
+#include <sys/mman.h>
+#endif
+
+#include "sg_lib.h"
+#include "sg_cmds_basic.h"
+#include "sg_par.h"
+#include "sg_pr2serr.h"
+
+#include "sg_fw_common.h"
+
+/* This file holds the multiple device firmware download shared by the
+ * sg_write_buffer and sg_ses_microcode utilities. */
+
+#define FW_DEF_READ_LEN (8 * 1024 * 1024)
+
+
+int
+fw_image_from_file(const char * fn, int skip, int len,
+                   struct fw_image_t * imp, int verbose)
+{
+    bool got_stdin;
+    int fd, res, err;
+    int ret = 0;
+    int64_t fsize = -1;
+    uint8_t * bp;
+    struct stat a_stat;
+
+    memset(imp, 0, sizeof(*imp));
+    got_stdin = (0 == strcmp(fn, "-"));
+    if (got_stdin)
+        fd = STDIN_FILENO;
+    else if ((fd = open(fn, O_RDONLY)) < 0) {
+        err = errno;
+        pr2serr("could not open %s for reading: %s\n", fn,
+                safe_strerror(err));
+        return sg_convert_errno(err);
+    } else if (sg_set_binary_mode(fd) < 0)
+        perror("sg_set_binary_mode");
+    if ((0 == fstat(fd, &a_stat)) && S_ISREG(a_stat.st_mode))
+        fsize = a_stat.st_size;
+    if (fsize >= 0) {
+        if (skip >= fsize) {
+            pr2serr("skip exceeds file size of %" PRId64 " bytes\n", fsize);
+            ret = SG_LIB_FILE_ERROR;
+            goto fini;
+        }
+        if (0 == len) {
+            if ((fsize - skip) > INT32_MAX) {
+                pr2serr("%s is too large, need '--length=LEN'\n", fn);
+                ret = SG_LIB_FILE_ERROR;
+                goto fini;
+            }
+            len = (int)(fsize - skip);
+        }
+    } else if (skip > 0) {
+        pr2serr("%s is not a 'regular' file so can't apply skip\n", fn);
+        ret = SG_LIB_FILE_ERROR;
+        goto fini;
+    }
+#ifndef SG_LIB_WIN32
+    if ((fsize >= 0) && ((skip + (int64_t)len) <= fsize)) {
+        long pg_sz = sysconf(_SC_PAGESIZE);
+        off_t pg_off;
+
+        /* mmap() wants an offset that is a multiple of the page size */
+        pg_off = (pg_sz > 0) ? (skip - (skip % pg_sz)) : 0;
+        imp->map_len = (size_t)(skip - pg_off) + len;
+        imp->map_p = mmap(NULL, imp->map_len, PROT_READ, MAP_PRIVATE, fd,
+                          pg_off);
+        if (MAP_FAILED != imp->map_p) {
+            imp->mapped = true;
+            imp->bp = (const uint8_t *)imp->map_p + (skip - pg_off);
+            imp->len = len;
+            if (verbose)
+                pr2serr("mapped %d bytes of %s, shared by all DEVICEs\n",
+                        len, fn);
+            goto fini;
+        }
+        if (verbose)
+            pr2serr("mmap() of %s failed: %s, so read it\n", fn,
+                    safe_strerror(errno));
+        imp->map_p = NULL;
+        imp->map_len = 0;
+    }
+#endif
+    if ((skip > 0) && (lseek(fd, skip, SEEK_SET) < 0)) {
+        err = errno;
+        pr2serr("couldn't skip to required position on %s: %s\n", fn,
+                safe_strerror(err));
+        ret = sg_convert_errno(err);
+        goto fini;
+    }
+    imp->map_len = (len > 0) ? len : FW_DEF_READ_LEN;
+    bp = (uint8_t *)malloc(imp->map_len);
+    if (NULL == bp) {
+        pr2serr("%s: out of memory\n", __func__);
+        ret = sg_convert_errno(ENOMEM);
+        goto fini;
+    }
+    memset(bp, 0xff, imp->map_len);
+    imp->map_p = bp;
+    res = read(fd, bp, imp->map_len);
+    if (res < 0) {
+        err = errno;
+        pr2serr("couldn't read from %s: %s\n", fn, safe_strerror(err));
+        ret = sg_convert_errno(err);
+        goto fini;
+    }
+    if (res < (int)imp->map_len) {
+        if (len > 0) {
+            pr2serr("tried to read %d bytes from %s, got %d bytes\n", len,
+                    fn, res);
+            pr2serr("pad with 0xff bytes and continue\n");
+        } else
+            len = res;
+    }
+    imp->bp = bp;
+    imp->len = len;
+fini:
+    if (! got_stdin)
+        close(fd);
+    if (ret)
+        fw_image_free(imp);
+    return ret;
+}
+
+void
+fw_image_free(struct fw_image_t * imp)
+{
+    if (imp->map_p) {
+#ifndef SG_LIB_WIN32
+        if (imp->mapped)
+            munmap(imp->map_p, imp->map_len);
+        else
+#endif
+            free(imp->map_p);
+    }
+    memset(imp, 0, sizeof(*imp));
+}
+
+struct fw_work_t {
+    bool activate;      /* false: download phase, true: activate phase */
+    int num_devs;
+    int chunk_sz;
+    int verbose;
+    struct fw_dev_t * dev_arr;
+    const struct fw_image_t * imp;
+    const struct fw_ops_t * fop;
+    void * ctx;
+    const char * cmd_name;
+};
+
+/* Download the whole image to one device */
+static int
+fw_download(struct fw_work_t * wp, struct fw_dev_t * dp)
+{
+    int k, n, res;
+    int len = wp->imp->len;
+    int chunk_sz = (wp->chunk_sz > 0) ? wp->chunk_sz : len;
+    const uint8_t * bp = wp->imp->bp;
+
+    dp->sg_fd = sg_cmds_open_device(dp->dev_name, false /* rw */,
+                                    wp->verbose);
+    if (dp->sg_fd < 0) {
+        res = -dp->sg_fd;
+        dp->sg_fd = -1;
+        pr2serr("%s: open error: %s\n", dp->dev_name, safe_strerror(res));
+        return sg_convert_errno(res);
+    }
+    if (wp->fop->prep_fn) {
+        res = wp->fop->prep_fn(dp, wp->ctx);
+        if (res)
+            return res;
+    }
+    k = 0;
+    do {        /* an empty image is sent as one command with no data */
+        n = len - k;
+        if (n > chunk_sz)
+            n = chunk_sz;
+        if (wp->verbose > 1)
+            pr2serr("%s: offset=%d, len=%d\n", dp->dev_name, k, n);
+        res = wp->fop->chunk_fn(dp, k, (bp ? bp + k : NULL), n,
+                                (k + n >= len), wp->ctx);
+        if (res)
+            return res;
+        k += n;
+        dp->bytes_done = k;
+    } while (k < len);
+    dp->downloaded = true;
+    return 0;
+}
+
+/* Called by sg_par_each() for the k-th device in each phase */
+static int
+fw_dev_one(int64_t k, void * ctx)
+{
+    int res;
+    struct fw_work_t * wp = (struct fw_work_t *)ctx;
+    struct fw_dev_t * dp = wp->dev_arr + k;
+    char b[80];
+
+    if (wp->activate) {
+        if (! dp->downloaded)
+            return 0;
+        res = wp->fop->act_fn(dp, wp->ctx);
+        if (0 == res)
+            dp->activated = true;
+    } else
+        res = fw_download(wp, dp);
+    if (res) {
+        dp->res = (res > 0) ? res : SG_LIB_CAT_OTHER;
+        if (dp->sg_fd < 0)
+            return 0;           /* open error already reported */
+        sg_get_category_sense_str(dp->res, sizeof(b), b, wp->verbose);
+        pr2serr("%s: %s%s failed after %d bytes: %s\n", dp->dev_name,
+                wp->cmd_name, (wp->activate ? " (activate)" : ""),
+                dp->bytes_done, b);
+    } else if (wp->verbose)
+        pr2serr("%s: %s\n", dp->dev_name,
+                (wp->activate ? "activated" : "download complete"));
+    return 0;
+}
+
+int
+fw_run_all(struct fw_dev_t * dev_arr, int num_devs,
+           const struct fw_image_t * imp, int chunk_sz, int num_q,
+           const struct fw_ops_t * fop, void * ctx, const char * cmd_name,
+           int verbose)
+{
+    int k, res;
+    int num_ok = 0;
+    int ret = 0;
+    struct fw_dev_t * dp;
+    struct fw_work_t work;
+
+    if (num_q < 1)
+        num_q = 1;
+    else if (num_q > FW_MAX_PARALLEL)
+        num_q = FW_MAX_PARALLEL;
+    for (k = 0, dp = dev_arr; k < num_devs; ++k, ++dp) {
+        dp->sg_fd = -1;
+        dp->res = 0;
+        dp->bytes_done = 0;
+        dp->downloaded = false;
+        dp->activated = false;
+    }
+    memset(&work, 0, sizeof(work));
+    work.num_devs = num_devs;
+    work.chunk_sz = chunk_sz;
+    work.verbose = verbose;
+    work.dev_arr = dev_arr;
+    work.imp = imp;
+    work.fop = fop;
+    work.ctx = ctx;
+    work.cmd_name = cmd_name;
+    sg_par_each(num_devs, num_q, fw_dev_one, &work);
+    if (fop->act_fn) {
+        /* only now, with all downloads finished, activate them together */
+        work.activate = true;
+        sg_par_each(num_devs, num_q, fw_dev_one, &work);
+    }
+    for (k = 0, dp = dev_arr; k < num_devs; ++k, ++dp) {
+        if (dp->sg_fd >= 0) {
+            res = sg_cmds_close_device(dp->sg_fd);
+            if (res < 0) {
+                pr2serr("%s: close error: %s\n", dp->dev_name,
+                        safe_strerror(-res));
+                if (0 == dp->res)
+                    dp->res = sg_convert_errno(-res);
+            }
+            dp->sg_fd = -1;
+        }
+        if (dp->res) {
+            if (0 == ret)
+                ret = dp->res;
+            printf("  %s: failed after %d of %d bytes%s\n", dp->dev_name,
+                   dp->bytes_done, imp->len,
+                   (dp->downloaded ? ", activate failed" : ""));
+        } else {
+            ++num_ok;
+            printf("  %s: %d bytes sent%s\n", dp->dev_name, dp->bytes_done,
+                   (dp->activated ? ", activated" : ""));
+        }
+    }
+    printf("%s: %d of %d DEVICEs succeeded\n", cmd_name, num_ok, num_devs);
+    return ret;
+}
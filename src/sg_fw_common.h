@@ -0,0 +1,94 @@
+#ifndef SG_FW_COMMON_H
+#define SG_FW_COMMON_H
+
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/* This is a common header file for the sg_write_buffer and sg_ses_microcode
+ * utilities. It downloads one firmware image to many devices. The image is
+ * read (or mapped) once and shared, read-only, by all devices. Each device
+ * is sent the image in chunks, with up to a given number of devices being
+ * downloaded to at the same time. When every download has finished, any
+ * deferred microcode is activated on the devices whose download succeeded,
+ * so the new firmware starts at about the same time on all of them. */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FW_MAX_PARALLEL 64
+#define FW_DEF_PARALLEL 8
+
+/* The firmware image, shared read-only by all devices */
+struct fw_image_t {
+    const uint8_t * bp;
+    int len;
+    bool mapped;        /* true -> map_p is a memory map of the file */
+    void * map_p;       /* to free or unmap */
+    size_t map_len;
+};
+
+/* One per DEVICE; the caller sets dev_name (and priv if needed) */
+struct fw_dev_t {
+    const char * dev_name;
+    int sg_fd;          /* open (by fw_run_all()) device or -1 */
+    int res;            /* 0 or result of the step that failed */
+    int bytes_done;     /* of the image */
+    bool downloaded;
+    bool activated;
+    void * priv;        /* per DEVICE state of the caller */
+};
+
+/* prep_fn is called after the device is opened, before the first chunk;
+ * chunk_fn sends len bytes at bp which are at offset off in the image
+ * (last is true for the final chunk); act_fn activates the deferred
+ * microcode. Each returns 0 on success else a SG_LIB_CAT_* value or -1.
+ * They may be called from several threads at once but never twice at the
+ * same time for one device. prep_fn and act_fn may be NULL. */
+struct fw_ops_t {
+    int (*prep_fn)(struct fw_dev_t * dp, void * ctx);
+    int (*chunk_fn)(struct fw_dev_t * dp, int off, const uint8_t * bp,
+                    int len, bool last, void * ctx);
+    int (*act_fn)(struct fw_dev_t * dp, void * ctx);
+};
+
+/* Sets up imp to hold len bytes of the file named fn, starting skip bytes
+ * into it. If len is 0 the rest of the file is used. A regular file is
+ * mapped read-only if the whole of len is in it, otherwise the bytes are
+ * read into a buffer that is padded with 0xff bytes up to len. Returns 0
+ * on success */
+int fw_image_from_file(const char * fn, int skip, int len,
+                       struct fw_image_t * imp, int verbose);
+
+void fw_image_free(struct fw_image_t * imp);
+
+/* Opens each of the num_devs devices in dev_arr and downloads the image in
+ * imp to it, in chunks of chunk_sz bytes (0 -> one chunk), with up to num_q
+ * devices in progress at once. After all have finished, if act_fn is given
+ * it is called for each device whose download succeeded, again with up to
+ * num_q at once. Devices are then closed and a line per device is output.
+ * A failing device does not stop the others. Returns 0 if all succeeded
+ * else the result of the first device (in dev_arr order) that failed */
+int fw_run_all(struct fw_dev_t * dev_arr, int num_devs,
+               const struct fw_image_t * imp, int chunk_sz, int num_q,
+               const struct fw_ops_t * fop, void * ctx, const char * cmd_name,
+               int verbose);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* SG_FW_COMMON_H */
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2004-2023 Douglas Gilbert.
+ * Copyright (c) 2004-2026 Douglas Gilbert.
  * All rights reserved.
  * Use of this source code is governed by a BSD-style
  * license that can be found in the BSD_LICENSE file.
@@ -33,7 +33,7 @@
 
 */
 
-static const char * version_str = "0.50 20230519";    /* mmc6r02 */
+static const char * version_str = "0.51 20261014";    /* mmc6r02 */
 
 #define MX_ALLOC_LEN 8192
 #define NAME_BUFF_SZ 64
@@ -50,6 +50,8 @@ static struct option long_options[] = {
         {"hex", no_argument, 0, 'H'},
         {"inner-hex", no_argument, 0, 'i'},
         {"list", no_argument, 0, 'l'},
+        {"no-inquiry", no_argument, 0, 'n'},
+        {"no_inquiry", no_argument, 0, 'n'},
         {"raw", no_argument, 0, 'R'},
         {"readonly", no_argument, 0, 'q'},
         {"rt", required_argument, 0, 'r'},
@@ -65,7 +67,8 @@ usage()
 {
     pr2serr("Usage:  sg_get_config [--brief] [--current] [--help] [--hex] "
             "[--inner-hex]\n"
-            "                      [--list] [--raw] [--readonly] [--rt=RT]\n"
+            "                      [--list] [--no-inquiry] [--raw] "
+            "[--readonly] [--rt=RT]\n"
             "                      [--starting=FC] [--verbose] [--version] "
             "DEVICE\n"
             "  where:\n"
@@ -79,6 +82,9 @@ usage()
             "features in hex\n"
             "    --list|-l        list all known features + profiles "
             "(ignore DEVICE)\n"
+            "    --no-inquiry|-n    do not send a standard INQUIRY first "
+            "(so no\n"
+            "                       vendor, product and device type line)\n"
             "    --raw|-R         output in binary (to stdout)\n"
             "    --readonly|-q    open DEVICE read-only (def: open it "
             "read-write)\n"
@@ -953,6 +959,7 @@ main(int argc, char * argv[])
     bool inner_hex = false;
     bool list = false;
     bool do_raw = false;
+    bool no_inquiry = false;
     bool readonly = false;
     bool verbose_given = false;
     bool version_given = false;
@@ -971,7 +978,7 @@ main(int argc, char * argv[])
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "bchHilqr:Rs:vV", long_options,
+        c = getopt_long(argc, argv, "bchHilnqr:Rs:vV", long_options,
                         &option_index);
         if (c == -1)
             break;
@@ -996,6 +1003,9 @@ main(int argc, char * argv[])
         case 'l':
             list = true;
             break;
+        case 'n':
+            no_inquiry = true;
+            break;
         case 'q':
             readonly = true;
             break;
@@ -1071,29 +1081,32 @@ main(int argc, char * argv[])
         usage();
         return SG_LIB_SYNTAX_ERROR;
     }
-    if ((sg_fd = sg_cmds_open_device(device_name, true /* ro */, verbose))
-        < 0) {
-        pr2serr(ME "error opening file: %s (ro): %s\n", device_name,
-                safe_strerror(-sg_fd));
-        return sg_convert_errno(-sg_fd);
-    }
-    if (0 == sg_simple_inquiry(sg_fd, &inq_resp, true, verbose)) {
-        if (! do_raw)
-            printf("  %.8s  %.16s  %.4s\n", inq_resp.vendor, inq_resp.product,
-                   inq_resp.revision);
-        peri_type = inq_resp.peripheral_type;
-        cp = sg_get_pdt_str(peri_type, sizeof(buff), buff);
-        if (! do_raw) {
-            if (strlen(cp) > 0)
-                printf("  Peripheral device type: %s\n", cp);
-            else
-                printf("  Peripheral device type: 0x%x\n", peri_type);
+    if (! no_inquiry) {
+        sg_fd = sg_cmds_open_device(device_name, true /* ro */, verbose);
+        if (sg_fd < 0) {
+            pr2serr(ME "error opening file: %s (ro): %s\n", device_name,
+                    safe_strerror(-sg_fd));
+            return sg_convert_errno(-sg_fd);
         }
-    } else {
-        pr2serr(ME "%s doesn't respond to a SCSI INQUIRY\n", device_name);
-        return SG_LIB_CAT_OTHER;
+        if (0 == sg_simple_inquiry(sg_fd, &inq_resp, true, verbose)) {
+            if (! do_raw)
+                printf("  %.8s  %.16s  %.4s\n", inq_resp.vendor,
+                       inq_resp.product, inq_resp.revision);
+            peri_type = inq_resp.peripheral_type;
+            cp = sg_get_pdt_str(peri_type, sizeof(buff), buff);
+            if (! do_raw) {
+                if (strlen(cp) > 0)
+                    printf("  Peripheral device type: %s\n", cp);
+                else
+                    printf("  Peripheral device type: 0x%x\n", peri_type);
+            }
+        } else {
+            pr2serr(ME "%s doesn't respond to a SCSI INQUIRY\n",
+                    device_name);
+            return SG_LIB_CAT_OTHER;
+        }
+        sg_cmds_close_device(sg_fd);
     }
-    sg_cmds_close_device(sg_fd);
 
     sg_fd = sg_cmds_open_device(device_name, readonly, verbose);
     if (sg_fd < 0) {
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2019-2023 Douglas Gilbert.
+ * Copyright (c) 2019-2026 Douglas Gilbert.
  * All rights reserved.
  * Use of this source code is governed by a BSD-style
  * license that can be found in the BSD_LICENSE file.
@@ -35,10 +35,12 @@
  *
  *
  * This program issues the SCSI GET PHYSICAL ELEMENT STATUS command to the
- * given SCSI device.
+ * given SCSI device. With --monitor it polls that command, reporting only
+ * changes in element health, and with --depop it issues a REMOVE ELEMENT
+ * AND TRUNCATE command then polls the progress of that depopulation.
  */
 
-static const char * version_str = "1.22 20230519";      /* sbc5r04 */
+static const char * version_str = "1.24 20261014";      /* sbc5r04 */
 
 #define MY_NAME "sg_get_elem_status"
 
@@ -47,6 +49,7 @@ static const char * version_str = "1.22 20230519";      /* sbc5r04 */
 #endif
 
 #define GET_PHY_ELEM_STATUS_SA 0x17
+#define REMOVE_ELEM_SA 0x18
 #define DEF_GPES_BUFF_LEN (1024 + 32)
 #define MAX_GPES_BUFF_LEN ((1024 * 1024) + DEF_GPES_BUFF_LEN)
 #define GPES_DESC_OFFSET 32     /* descriptors starts at this byte offset */
@@ -55,11 +58,13 @@ static const char * version_str = "1.22 20230519";      /* sbc5r04 */
 
 #define SENSE_BUFF_LEN 64       /* Arbitrary, could be larger */
 #define DEF_PT_TIMEOUT  60      /* 60 seconds */
+#define DEF_DEPOP_POLL_SECS 5   /* --depop=EID without --monitor=SECS */
 
 struct opts_t {
     bool do_json;
     bool do_raw;
     bool o_readonly;
+    bool quick;
     bool verbose_given;
     bool version_given;
     uint8_t filter;
@@ -67,8 +72,12 @@ struct opts_t {
     int do_brief;
     int do_hex;
     int maxlen;
+    int mon_secs;       /* --monitor=SECS[,CNT], 0 -> not monitoring */
+    int mon_count;      /* number of polls, 0 -> until interrupted */
     int verbose;
     uint32_t starting_elem;
+    uint32_t depop_id;  /* --depop=EID[,RC], 0 -> no depopulation */
+    uint64_t depop_cap;
     const char * in_fn;
     const char * json_arg;
     const char * js_file;
@@ -83,11 +92,19 @@ struct gpes_desc_t {    /* info in returned physical status descriptor */
     uint64_t assoc_cap;   /* number of LBs removed if depopulated */
 };
 
+struct gpes_cache_t {   /* element list kept between --monitor polls */
+    int num;
+    int max;
+    uint32_t id_elem_depop;
+    struct gpes_desc_t * arr;
+};
+
 static uint8_t gpesBuff[DEF_GPES_BUFF_LEN];
 
 
 static struct option long_options[] = {
     {"brief", no_argument, 0, 'b'},
+    {"depop", required_argument, 0, 'D'},
     {"filter", required_argument, 0, 'f'},
     {"help", no_argument, 0, 'h'},
     {"hex", no_argument, 0, 'H'},
@@ -97,6 +114,8 @@ static struct option long_options[] = {
     {"js-file", required_argument, 0, 'J'},
     {"js_file", required_argument, 0, 'J'},
     {"maxlen", required_argument, 0, 'm'},
+    {"monitor", required_argument, 0, 'M'},
+    {"quick", no_argument, 0, 'q'},
     {"raw", no_argument, 0, 'r'},
     {"readonly", no_argument, 0, 'R'},
     {"report-type", required_argument, 0, 't'},
@@ -110,17 +129,24 @@ static struct option long_options[] = {
 static void
 usage()
 {
-    pr2serr("Usage: sg_get_elem_status  [--brief] [--filter=FLT] [--help] "
-            "[--hex]\n"
-            "                           [--inhex=FN] [--json[=JO]] "
-            "[--js-file=JFN]\n"
-            "                           [--maxlen=LEN] [--raw] "
-            "[--readonly]\n"
+    pr2serr("Usage: sg_get_elem_status  [--brief] [--depop=EID[,RC]] "
+            "[--filter=FLT]\n"
+            "                           [--help] [--hex] [--inhex=FN] "
+            "[--json[=JO]]\n"
+            "                           [--js-file=JFN] [--maxlen=LEN] "
+            "[--monitor=SECS[,CNT]]\n"
+            "                           [--quick] [--raw] [--readonly]\n"
             "                           [--report-type=RT] [--starting=ELEM] "
             "[--verbose]\n"
             "                           [--version] DEVICE\n"
             "  where:\n"
             "    --brief|-b        one descriptor per line\n"
+            "    --depop=EID[,RC]|-D EID[,RC]    send REMOVE ELEMENT AND "
+            "TRUNCATE for\n"
+            "                                    element EID (requested "
+            "capacity RC,\n"
+            "                                    def: 0) then poll its "
+            "progress\n"
             "    --filter=FLT|-f FLT    FLT is 0 (def) for all physical "
             "elements;\n"
             "                           1 for out of spec and depopulated "
@@ -140,7 +166,16 @@ usage()
             "then writes\n"
             "    --maxlen=LEN|-m LEN    max response length (allocation "
             "length in cdb)\n"
-            "                           (def: 0 -> %d bytes)\n",
+            "                           (def: 0 -> %d bytes)\n"
+            "    --monitor=SECS[,CNT]|-M SECS[,CNT]    poll every SECS "
+            "seconds, CNT\n"
+            "                                          times (def: 0 -> "
+            "until\n"
+            "                                          interrupted) "
+            "reporting only\n"
+            "                                          health changes\n"
+            "    --quick|-q        bypass 15 second warn and wait before "
+            "--depop\n",
             DEF_GPES_BUFF_LEN );
     pr2serr("    --raw|-r          output in binary, unless --inhex=FN is "
             "given in\n"
@@ -292,6 +327,406 @@ fetch_health_str(uint8_t health, char * bp, int max_blen)
     return add_val;
 }
 
+/* Invokes a SCSI REMOVE ELEMENT AND TRUNCATE command (SBC-4). Return of
+ * 0 -> success, various SG_LIB_CAT_* positive values or -1 -> other
+ * errors */
+static int
+sg_ll_remove_elem(int sg_fd, const struct opts_t * op)
+{
+    int ret, res, sense_cat;
+    uint8_t reCmd[16] = {SG_SERVICE_ACTION_IN_16, REMOVE_ELEM_SA, 0, 0,
+                         0, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0};
+    uint8_t sense_b[SENSE_BUFF_LEN] SG_C_CPP_ZERO_INIT;
+    struct sg_pt_base * ptvp;
+    static const char * const cmd_name = "Remove element and truncate";
+
+    sg_put_unaligned_be64(op->depop_cap, reCmd + 2);
+    sg_put_unaligned_be32(op->depop_id, reCmd + 10);
+    if (op->verbose) {
+        char b[128];
+
+        pr2serr("    %s cdb: %s\n", cmd_name,
+                sg_get_command_str(reCmd, (int)sizeof(reCmd), false,
+                                   sizeof(b), b));
+    }
+    ptvp = construct_scsi_pt_obj_with_fd(sg_fd, op->verbose);
+    if (NULL == ptvp) {
+        pr2serr("%s: out of memory\n", cmd_name);
+        return -1;
+    }
+    set_scsi_pt_cdb(ptvp, reCmd, sizeof(reCmd));
+    set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
+    res = do_scsi_pt(ptvp, -1, DEF_PT_TIMEOUT, op->verbose);
+    ret = sg_cmds_process_resp(ptvp, cmd_name, res, true, op->verbose,
+                               &sense_cat);
+    if (-1 == ret) {
+        if (get_scsi_pt_transport_err(ptvp))
+            ret = SG_LIB_TRANSPORT_ERROR;
+        else
+            ret = sg_convert_errno(get_scsi_pt_os_err(ptvp));
+    } else if (-2 == ret) {
+        switch (sense_cat) {
+        case SG_LIB_CAT_RECOVERED:
+        case SG_LIB_CAT_NO_SENSE:
+            ret = 0;
+            break;
+        default:
+            ret = sense_cat;
+            break;
+        }
+    } else
+        ret = 0;
+    destruct_scsi_pt_obj(ptvp);
+    return ret;
+}
+
+/* Replaces the response buffer with one of new_len bytes. Returns false
+ * (leaving the old buffer) if that cannot be allocated. */
+static bool
+gpes_buff_resize(int new_len, uint8_t ** buffpp, uint8_t ** free_buffpp,
+                 int * buff_lenp, int verbose)
+{
+    uint8_t * free_bp = NULL;
+    uint8_t * bp;
+
+    bp = sg_memalign(new_len, 0, &free_bp, verbose > 3);
+    if (NULL == bp)
+        return false;
+    if (*free_buffpp)
+        free(*free_buffpp);
+    *buffpp = bp;
+    *free_buffpp = free_bp;
+    *buff_lenp = new_len;
+    return true;
+}
+
+/* Fetches every element descriptor (subject to --filter, --report-type and
+ * --starting) into cp. If the header shows that more descriptors are
+ * available than the buffer holds, the buffer is enlarged once to fit
+ * them all (up to MAX_GPES_BUFF_LEN) so later polls need a single command.
+ * Beyond that descriptors are paged through using STARTING ELEMENT. */
+static int
+gpes_fetch_all(int sg_fd, struct opts_t * op, uint8_t ** buffpp,
+               uint8_t ** free_buffpp, int * buff_lenp,
+               struct gpes_cache_t * cp)
+{
+    bool resized = false;
+    int k, res, rlen, resid, fit;
+    int ret = 0;
+    uint32_t num_desc, num_ret;
+    uint32_t start = op->starting_elem;
+    int64_t ll;
+    const uint8_t * bp;
+
+    cp->num = 0;
+    cp->id_elem_depop = 0;
+    while (true) {
+        op->maxlen = *buff_lenp;
+        op->starting_elem = start;
+        resid = 0;
+        res = sg_ll_get_phy_elem_status(sg_fd, *buffpp, &resid, op);
+        if (res) {
+            ret = res;
+            break;
+        }
+        rlen = *buff_lenp - resid;
+        if (rlen < MIN_MAXLEN) {
+            pr2serr("Response too short (%d bytes) due to resid (%d)\n",
+                    rlen, resid);
+            ret = SG_LIB_CAT_MALFORMED;
+            break;
+        }
+        num_desc = sg_get_unaligned_be32(*buffpp + 0);
+        num_ret = sg_get_unaligned_be32(*buffpp + 4);
+        if (cp->num == 0)
+            cp->id_elem_depop = sg_get_unaligned_be32(*buffpp + 8);
+        fit = (rlen - GPES_DESC_OFFSET) / GPES_DESC_LEN;
+        if (fit < 0)
+            fit = 0;
+        if ((int64_t)num_ret > fit)
+            num_ret = fit;
+        if ((! resized) && (num_desc > num_ret) &&
+            (*buff_lenp < MAX_GPES_BUFF_LEN)) {
+            resized = true;
+            ll = ((int64_t)num_desc * GPES_DESC_LEN) + GPES_DESC_OFFSET;
+            if (ll > MAX_GPES_BUFF_LEN)
+                ll = MAX_GPES_BUFF_LEN;
+            if (op->verbose)
+                pr2serr("header shows %u descriptors, response buffer "
+                        "grown to %d bytes\n", num_desc, (int)ll);
+            if (gpes_buff_resize((int)ll, buffpp, free_buffpp, buff_lenp,
+                                 op->verbose))
+                continue;       /* re-issue with the larger buffer */
+        }
+        if (cp->num + (int)num_ret > cp->max) {
+            int n = cp->num + (int)num_ret;
+            struct gpes_desc_t * ap;
+
+            ap = (struct gpes_desc_t *)realloc(cp->arr, n * sizeof(*ap));
+            if (NULL == ap) {
+                pr2serr("%s: out of memory\n", __func__);
+                ret = sg_convert_errno(ENOMEM);
+                break;
+            }
+            cp->arr = ap;
+            cp->max = n;
+        }
+        for (bp = *buffpp + GPES_DESC_OFFSET, k = 0; k < (int)num_ret;
+             bp += GPES_DESC_LEN, ++k)
+            decode_elem_status_desc(bp, cp->arr + cp->num++);
+        /* a response that was not full, or that holds all there are, is
+         * the last page */
+        if ((0 == num_ret) || (num_ret >= num_desc) ||
+            ((int)num_ret < ((*buff_lenp - GPES_DESC_OFFSET) /
+                             GPES_DESC_LEN)))
+            break;
+        start = cp->arr[cp->num - 1].elem_id;
+        if (UINT32_MAX == start)
+            break;
+        ++start;
+        if (op->verbose > 1)
+            pr2serr("paging, next starting element: %u\n", start);
+    }
+    return ret;
+}
+
+static void
+pr_gpes_err(int res, int verbose)
+{
+    char b[80];
+
+    if (res < 0)
+        return;         /* already reported */
+    if (SG_LIB_CAT_INVALID_OP == res)
+        pr2serr("Get physical element status command not supported\n");
+    else if (SG_LIB_CAT_MALFORMED != res) {
+        sg_get_category_sense_str(res, sizeof(b), b, verbose);
+        pr2serr("Get physical element status command: %s\n", b);
+    }
+}
+
+static void
+pr_health_change(const struct opts_t * op, int poll,
+                 const struct gpes_desc_t * prevp,
+                 const struct gpes_desc_t * curp)
+{
+    char b[80];
+    char b2[80];
+
+    if (op->do_brief) {
+        if (NULL == prevp)
+            printf("%u: +%u\n", curp->elem_id, curp->phys_elem_health);
+        else if (NULL == curp)
+            printf("%u: %u-\n", prevp->elem_id, prevp->phys_elem_health);
+        else
+            printf("%u: %u->%u\n", curp->elem_id, prevp->phys_elem_health,
+                   curp->phys_elem_health);
+        return;
+    }
+    if (prevp)
+        fetch_health_str(prevp->phys_elem_health, b, sizeof(b));
+    if (curp)
+        fetch_health_str(curp->phys_elem_health, b2, sizeof(b2));
+    if (NULL == prevp)
+        printf("[%d] identifier: 0x%06x  now reported, health: %s <%d>\n",
+               poll, curp->elem_id, b2, curp->phys_elem_health);
+    else if (NULL == curp)
+        printf("[%d] identifier: 0x%06x  no longer reported, last "
+               "health: %s <%d>\n", poll, prevp->elem_id, b,
+               prevp->phys_elem_health);
+    else
+        printf("[%d] identifier: 0x%06x  health: %s <%d> --> %s <%d>\n",
+               poll, curp->elem_id, b, prevp->phys_elem_health, b2,
+               curp->phys_elem_health);
+}
+
+/* Both lists are in ascending element identifier order (as the device
+ * should return them) so they are merged. Returns number of changes. */
+static int
+report_changes(const struct opts_t * op, int poll,
+               const struct gpes_cache_t * prevp,
+               const struct gpes_cache_t * curp)
+{
+    int j = 0;
+    int k = 0;
+    int changes = 0;
+    const struct gpes_desc_t * pp;
+    const struct gpes_desc_t * cp;
+
+    while ((j < prevp->num) || (k < curp->num)) {
+        pp = (j < prevp->num) ? prevp->arr + j : NULL;
+        cp = (k < curp->num) ? curp->arr + k : NULL;
+        if (pp && cp && (pp->elem_id == cp->elem_id)) {
+            if (pp->phys_elem_health != cp->phys_elem_health) {
+                pr_health_change(op, poll, pp, cp);
+                ++changes;
+            }
+            ++j;
+            ++k;
+        } else if (pp && ((NULL == cp) || (pp->elem_id < cp->elem_id))) {
+            pr_health_change(op, poll, pp, NULL);
+            ++changes;
+            ++j;
+        } else {
+            pr_health_change(op, poll, NULL, cp);
+            ++changes;
+            ++k;
+        }
+    }
+    if (prevp->id_elem_depop != curp->id_elem_depop) {
+        if (op->do_brief < 2)
+            printf("[%d] identifier of element being depopulated: %u --> "
+                   "%u\n", poll, prevp->id_elem_depop, curp->id_elem_depop);
+        ++changes;
+    }
+    return changes;
+}
+
+/* Sends REMOVE ELEMENT AND TRUNCATE then polls only the header and that
+ * element's descriptor (STARTING ELEMENT set to EID), plus REQUEST SENSE
+ * for a progress indication, until depopulation is no longer in
+ * progress. */
+static int
+do_depop(int sg_fd, const char * device_name, struct opts_t * op,
+         uint8_t * buffp)
+{
+    bool got_prog;
+    int res, prog, resid;
+    int secs = op->mon_secs ? op->mon_secs : DEF_DEPOP_POLL_SECS;
+    uint32_t save_start = op->starting_elem;
+    int save_maxlen = op->maxlen;
+    uint8_t rsBuff[SENSE_BUFF_LEN];
+    struct gpes_desc_t a_ped;
+    char b[80];
+
+    if (! op->quick)
+        sg_warn_and_wait("REMOVE ELEMENT AND TRUNCATE", device_name,
+                         false);
+    res = sg_ll_remove_elem(sg_fd, op);
+    if (res) {
+        if (SG_LIB_CAT_INVALID_OP == res)
+            pr2serr("Remove element and truncate command not supported\n");
+        else {
+            sg_get_category_sense_str(res, sizeof(b), b, op->verbose);
+            pr2serr("Remove element and truncate command: %s\n", b);
+        }
+        return res;
+    }
+    op->starting_elem = op->depop_id;
+    op->maxlen = GPES_DESC_OFFSET + GPES_DESC_LEN;
+    while (true) {
+        sg_sleep_secs(secs);
+        memset(rsBuff, 0, sizeof(rsBuff));
+        got_prog = false;
+        if (0 == sg_ll_request_sense(sg_fd, false, rsBuff, sizeof(rsBuff),
+                                     false, op->verbose))
+            got_prog = sg_get_sense_progress_fld(rsBuff, sizeof(rsBuff),
+                                                 &prog);
+        resid = 0;
+        res = sg_ll_get_phy_elem_status(sg_fd, buffp, &resid, op);
+        if (res) {
+            pr_gpes_err(res, op->verbose);
+            break;
+        }
+        if (((op->maxlen - resid) < op->maxlen) ||
+            (0 == sg_get_unaligned_be32(buffp + 4))) {
+            pr2serr("element %u not reported during depopulation\n",
+                    op->depop_id);
+            res = SG_LIB_CAT_MALFORMED;
+            break;
+        }
+        decode_elem_status_desc(buffp + GPES_DESC_OFFSET, &a_ped);
+        if (a_ped.elem_id != op->depop_id) {
+            pr2serr("element %u not reported during depopulation, got %u\n",
+                    op->depop_id, a_ped.elem_id);
+            res = SG_LIB_CAT_MALFORMED;
+            break;
+        }
+        fetch_health_str(a_ped.phys_elem_health, b, sizeof(b));
+        if (got_prog)
+            printf("depopulation of element %u: %s, %d%% complete\n",
+                   a_ped.elem_id, b, prog * 100 / 65536);
+        else if (op->do_brief < 2)
+            printf("depopulation of element %u: %s\n", a_ped.elem_id, b);
+        fflush(stdout);
+        if (0xfe != a_ped.phys_elem_health)
+            break;
+    }
+    op->starting_elem = save_start;
+    op->maxlen = save_maxlen;
+    return res;
+}
+
+/* Handles --monitor=SECS[,CNT] and --depop=EID[,RC] */
+static int
+do_monitor(int sg_fd, const char * device_name, struct opts_t * op,
+           uint8_t ** buffpp, uint8_t ** free_buffpp)
+{
+    int k, res, n;
+    int ret = 0;
+    int buff_len = op->maxlen;
+    struct gpes_cache_t cache[2];
+    struct gpes_cache_t * prevp = cache + 0;
+    struct gpes_cache_t * curp = cache + 1;
+    struct gpes_cache_t * tp;
+    char b[80];
+
+    memset(cache, 0, sizeof(cache));
+    if (op->depop_id) {
+        ret = do_depop(sg_fd, device_name, op, *buffpp);
+        if (ret || (0 == op->mon_secs))
+            goto fini;
+    }
+    ret = gpes_fetch_all(sg_fd, op, buffpp, free_buffpp, &buff_len, prevp);
+    if (ret) {
+        pr_gpes_err(ret, op->verbose);
+        goto fini;
+    }
+    if (op->do_brief < 2) {
+        printf("Monitoring %d element%s every %d second%s", prevp->num,
+               (1 == prevp->num) ? "" : "s", op->mon_secs,
+               (1 == op->mon_secs) ? "" : "s");
+        if (op->mon_count)
+            printf(", %d time%s\n", op->mon_count,
+                   (1 == op->mon_count) ? "" : "s");
+        else
+            printf("\n");
+    }
+    if (0 == op->do_brief) {
+        for (k = 0; k < prevp->num; ++k) {
+            n = prevp->arr[k].phys_elem_health;
+            if (fetch_health_str(n, b, sizeof(b)))
+                printf("  identifier: 0x%06x  health: %s <%d>\n",
+                       prevp->arr[k].elem_id, b, n);
+            else
+                printf("  identifier: 0x%06x  health: %s\n",
+                       prevp->arr[k].elem_id, b);
+        }
+    }
+    fflush(stdout);
+    for (k = 1; (0 == op->mon_count) || (k <= op->mon_count); ++k) {
+        sg_sleep_secs(op->mon_secs);
+        res = gpes_fetch_all(sg_fd, op, buffpp, free_buffpp, &buff_len,
+                             curp);
+        if (res) {
+            pr_gpes_err(res, op->verbose);
+            ret = res;
+            break;
+        }
+        n = report_changes(op, k, prevp, curp);
+        if ((0 == n) && (op->verbose > 1))
+            pr2serr("poll %d: no change in %d elements\n", k, curp->num);
+        fflush(stdout);
+        tp = prevp;
+        prevp = curp;
+        curp = tp;
+    }
+fini:
+    free(cache[0].arr);
+    free(cache[1].arr);
+    return ret;
+}
+
 /* Handles short options after '-j' including a sequence of short options
  * that include one 'j' (for JSON). Want optional argument to '-j' to be
  * prefixed by '='. Return 0 for good, SG_LIB_SYNTAX_ERROR for syntax error
@@ -370,7 +805,7 @@ main(int argc, char * argv[])
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "^bf:hHi:j::J:m:rRs:St:TvV", long_options,
+        c = getopt_long(argc, argv, "^bD:f:hHi:j::J:m:M:qrRs:St:TvV", long_options,
                         &option_index);
         if (c == -1)
             break;
@@ -379,6 +814,24 @@ main(int argc, char * argv[])
         case 'b':
             ++op->do_brief;
             break;
+        case 'D':
+            ll = sg_get_llnum(optarg);
+            if ((ll <= 0) || (ll > UINT32_MAX)) {
+                pr2serr("bad EID in '--depop=EID[,RC]', expect 1 to "
+                        "0xffffffff\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            op->depop_id = (uint32_t)ll;
+            cp = strchr(optarg, ',');
+            if (cp) {
+                ll = sg_get_llnum(cp + 1);
+                if (-1 == ll) {
+                    pr2serr("bad RC in '--depop=EID,RC'\n");
+                    return SG_LIB_SYNTAX_ERROR;
+                }
+                op->depop_cap = (uint64_t)ll;
+            }
+            break;
         case 'f':
             n = sg_get_num_nomult(optarg);
             if ((n < 0) || (n > 15)) {
@@ -440,6 +893,27 @@ main(int argc, char * argv[])
                 op->maxlen = DEF_GPES_BUFF_LEN;
             }
             break;
+        case 'M':
+            n = sg_get_num_nomult(optarg);
+            if (n < 1) {
+                pr2serr("'--monitor=SECS[,CNT]' expects SECS to be 1 or "
+                        "more\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            op->mon_secs = n;
+            cp = strchr(optarg, ',');
+            if (cp) {
+                n = sg_get_num_nomult(cp + 1);
+                if (n < 0) {
+                    pr2serr("bad CNT in '--monitor=SECS,CNT'\n");
+                    return SG_LIB_SYNTAX_ERROR;
+                }
+                op->mon_count = n;
+            }
+            break;
+        case 'q':
+            op->quick = true;
+            break;
         case 'r':
             op->do_raw = true;
             break;
@@ -527,6 +1001,22 @@ main(int argc, char * argv[])
         jop = sgj_start_r(MY_NAME, version_str, argc, argv, jsp);
     }
 
+    if (op->mon_secs || op->depop_id) {
+        if (op->in_fn || op->do_raw || op->do_hex || op->do_json) {
+            pr2serr("--monitor= and --depop= contradict --inhex=, --raw, "
+                    "--hex and --json\n");
+            ret = SG_LIB_CONTRADICT;
+            no_final_msg = true;
+            goto fini;
+        }
+        if (op->depop_id && op->o_readonly) {
+            pr2serr("--depop= needs DEVICE opened read-write so it "
+                    "contradicts --readonly\n");
+            ret = SG_LIB_CONTRADICT;
+            no_final_msg = true;
+            goto fini;
+        }
+    }
     if (op->maxlen > DEF_GPES_BUFF_LEN) {
         gpesBuffp = (uint8_t *)sg_memalign(op->maxlen, 0, &free_gpesBuffp,
                                            op->verbose > 3);
@@ -590,6 +1080,11 @@ main(int argc, char * argv[])
         ret = sg_convert_errno(-sg_fd);
         goto fini;
     }
+    if (op->mon_secs || op->depop_id) {
+        ret = do_monitor(sg_fd, device_name, op, &gpesBuffp, &free_gpesBuffp);
+        no_final_msg = true;
+        goto fini;
+    }
 
     res = sg_ll_get_phy_elem_status(sg_fd, gpesBuffp, &resid, op);
     ret = res;
@@ -674,9 +1169,15 @@ start_response:
         sgj_pr_hr(jsp, "\n");
     }
 
-    if (jsp->pr_as_json)
-        jap = sgj_named_subarray_r(jsp, jop,
-                                   "physical_element_status_descriptor_list");
+    if (jsp->pr_as_json) {
+        static const char * pesdl_sn =
+                        "physical_element_status_descriptor_list";
+
+        if ((NULL == op->js_file) || (0 == strcmp(op->js_file, "-")))
+            jap = sgj_stream_subarray_r(jsp, pesdl_sn, stdout);
+        else
+            jap = sgj_named_subarray_r(jsp, jop, pesdl_sn);
+    }
     for (bp = gpesBuffp + GPES_DESC_OFFSET, k = 0; k < (int)num_desc_ret;
          bp += GPES_DESC_LEN, ++k) {
         if ((0 == k) && (op->do_brief < 2))
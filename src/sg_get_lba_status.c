@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2009-2023 Douglas Gilbert.
+ * Copyright (c) 2009-2026 Douglas Gilbert.
  * All rights reserved.
  * Use of this source code is governed by a BSD-style
  * license that can be found in the BSD_LICENSE file.
@@ -26,17 +26,20 @@
 #include "sg_cmds_basic.h"
 #include "sg_cmds_extra.h"
 #include "sg_unaligned.h"
+#include "sg_par.h"
 #include "sg_pr2serr.h"
 #include "sg_json_sg_lib.h"
+#include "sg_geom.h"
 
 /* A utility program originally written for the Linux OS SCSI subsystem.
  *
  *
  * This program issues the SCSI GET LBA STATUS command to the given SCSI
- * device.
+ * device. With --map=MF it scans from the given LBA to the end of the
+ * medium and writes the runs of LBAs found to a file.
  */
 
-static const char * version_str = "1.42 20230519";      /* sbc5r04 */
+static const char * version_str = "1.45 20261015";      /* sbc5r04 */
 
 #define MY_NAME "sg_get_lba_status"
 
@@ -47,6 +50,9 @@ static const char * version_str = "1.42 20230519";      /* sbc5r04 */
 #define MAX_GLBAS_BUFF_LEN (1024 * 1024)
 #define DEF_GLBAS_BUFF_LEN 1024
 #define MIN_MAXLEN 16
+#define DEF_MAP_BUFF_LEN (64 * 1024)    /* room for 4095 descriptors */
+#define DEF_MAP_PARALLEL 4
+#define MAX_MAP_PARALLEL 64
 
 static uint8_t glbasFixedBuff[DEF_GLBAS_BUFF_LEN];
 
@@ -58,10 +64,12 @@ struct opts_t {
     bool o_readonly;
     bool verbose_given;
     bool version_given;
+    bool maxlen_given;
     int blockhex;
     int do_brief;
     int do_hex;
     int maxlen;
+    int num_par;        /* --parallel=Q, regions scanned at once */
     int rt;
     int verbose;
     uint32_t element_id;
@@ -70,9 +78,36 @@ struct opts_t {
     const char * in_fn;
     const char * json_arg;
     const char * js_file;
+    const char * map_fn;
     sgj_state json_st;
 };
 
+/* --map=MF: the LBAs from --lba=LBA to the end of the medium are split
+ * into --parallel=Q regions, each scanned with its own sequence of GET LBA
+ * STATUS commands (so up to Q are outstanding), each command starting where
+ * the last descriptor of the previous response ended. Adjacent descriptors
+ * with the same status are merged into runs which are then written to MF,
+ * one "LBA,NUM" pair per line. That is the scatter gather list format that
+ * the skip= and seek= operands of sgp_dd accept. */
+struct glbas_run {
+    uint64_t lba;
+    uint64_t num;
+    uint8_t p_status;
+    uint8_t add_status;
+};
+
+struct glbas_seg {
+    int sg_fd;
+    int num_runs;
+    int max_runs;
+    int num_cmds;
+    int res;
+    uint64_t lba;
+    uint64_t end;       /* exclusive */
+    struct glbas_run * runs;
+    const struct opts_t * op;
+};
+
 
 static struct option long_options[] = {
     {"16", no_argument, 0, 'S'},
@@ -89,7 +124,9 @@ static struct option long_options[] = {
     {"js-file", required_argument, 0, 'J'},
     {"js_file", required_argument, 0, 'J'},
     {"lba", required_argument, 0, 'l'},
+    {"map", required_argument, 0, 'M'},
     {"maxlen", required_argument, 0, 'm'},
+    {"parallel", required_argument, 0, 'p'},
     {"raw", no_argument, 0, 'r'},
     {"readonly", no_argument, 0, 'R'},
     {"report-type", required_argument, 0, 't'},
@@ -110,7 +147,9 @@ usage()
             "[--inhex=FN]\n"
             "                          [--json[=JO]] [--js_file=JFN] "
             "[--lba=LBA]\n"
-            "                          [--maxlen=LEN] [--raw] [--readonly]\n"
+            "                          [--map=MF] [--maxlen=LEN] "
+            "[--parallel=Q] [--raw]\n"
+            "                          [--readonly]\n"
             "                          [--report-type=RT] [--scan-len=SL] "
             "[--verbose]\n"
             "                          [--version] DEVICE\n"
@@ -141,10 +180,17 @@ usage()
             "then writes\n"
             "    --lba=LBA|-l LBA    starting LBA (logical block address) "
             "(def: 0)\n"
+            "    --map=MF|-M MF    scan from LBA to end of medium, write "
+            "runs of LBAs\n"
+            "                      selected by RT to file MF ('-' for "
+            "stdout)\n"
             "    --maxlen=LEN|-m LEN    max response length (allocation "
             "length in cdb)\n"
-            "                           (def: 0 -> %d bytes)\n",
-            DEF_GLBAS_BUFF_LEN );
+            "                           (def: 0 -> %d bytes, with --map: "
+            "%d)\n"
+            "    --parallel=Q|-p Q    with --map, regions scanned at once "
+            "(def: %d)\n",
+            DEF_GLBAS_BUFF_LEN, DEF_MAP_BUFF_LEN, DEF_MAP_PARALLEL);
     pr2serr("    --raw|-r          output in binary, unless if --inhex=FN "
             "is given,\n"
             "                      in which case input file is binary\n"
@@ -271,6 +317,300 @@ get_lba_access_str(int la, char * b, int blen, bool short_form)
     return b;
 }
 
+/* Does a descriptor with provisioning status ps and additional status as
+ * belong in the --map=MF output for report type rt? Devices are asked to
+ * do this selection but those that predate the REPORT TYPE field ignore
+ * it. */
+static bool
+map_rt_match(int rt, int ps, int as)
+{
+    switch (rt) {
+    case 0:
+        return true;
+    case 1:
+        return (0 != ps);
+    case 2:
+        return ((0 == ps) || (3 == ps));
+    case 3:
+        return (1 == ps);
+    case 4:
+        return (2 == ps);
+    case 0x10:
+        return (0 != as);
+    default:
+        return true;
+    }
+}
+
+/* Appends a run to segp, merging it with the previous run when they are
+ * adjacent and have the same status. Returns false if out of memory. */
+static bool
+map_add_run(struct glbas_seg * segp, uint64_t lba, uint64_t num, int ps,
+            int as)
+{
+    struct glbas_run * rp;
+
+    if (segp->num_runs > 0) {
+        rp = segp->runs + segp->num_runs - 1;
+        if (((rp->lba + rp->num) == lba) && (rp->p_status == ps) &&
+            (rp->add_status == as)) {
+            rp->num += num;
+            return true;
+        }
+    }
+    if (segp->num_runs >= segp->max_runs) {
+        int n = segp->max_runs ? (2 * segp->max_runs) : 1024;
+
+        rp = (struct glbas_run *)realloc(segp->runs, n * sizeof(*rp));
+        if (NULL == rp)
+            return false;
+        segp->runs = rp;
+        segp->max_runs = n;
+    }
+    rp = segp->runs + segp->num_runs++;
+    rp->lba = lba;
+    rp->num = num;
+    rp->p_status = (uint8_t)ps;
+    rp->add_status = (uint8_t)as;
+    return true;
+}
+
+/* Scans the LBAs of the k-th region, ctx being the array of regions.
+ * Called by sg_par_each(). */
+static int
+map_scan_seg(int64_t k_seg, void * ctx)
+{
+    int k, n, rlen, ps, as, cc;
+    uint32_t d_num;
+    uint32_t sl = 0;
+    uint64_t d_lba, s, e, nxt;
+    struct glbas_seg * segp = (struct glbas_seg *)ctx + k_seg;
+    const struct opts_t * op = segp->op;
+    uint64_t lba = segp->lba;
+    uint8_t * bp;
+    uint8_t * free_bp;
+    const uint8_t * dp;
+
+    bp = (uint8_t *)sg_memalign(op->maxlen, 0, &free_bp, false);
+    if (NULL == bp) {
+        segp->res = sg_convert_errno(ENOMEM);
+        return 0;
+    }
+    while (lba < segp->end) {
+        if (op->do_32) {
+            /* don't have the device scan past the end of this region */
+            sl = ((segp->end - lba) > UINT32_MAX) ? UINT32_MAX :
+                                                    (uint32_t)(segp->end - lba);
+            if ((op->scan_len > 0) && (op->scan_len < sl))
+                sl = op->scan_len;
+            segp->res = sg_ll_get_lba_status32(segp->sg_fd, lba, sl,
+                                               op->element_id, op->rt, bp,
+                                               op->maxlen, true, op->verbose);
+        } else
+            segp->res = sg_ll_get_lba_status16(segp->sg_fd, lba, op->rt, bp,
+                                               op->maxlen, true, op->verbose);
+        ++segp->num_cmds;
+        if (segp->res)
+            break;
+        rlen = (int)sg_get_unaligned_be32(bp + 0) + 4;
+        if (rlen > op->maxlen)
+            rlen = op->maxlen;
+        n = (rlen >= 8) ? ((rlen - 8) / 16) : 0;
+        cc = (bp[7] >> 1) & 7;
+        for (k = 0, dp = bp + 8, nxt = lba; k < n; ++k, dp += 16) {
+            d_lba = sg_get_unaligned_be64(dp + 0);
+            d_num = sg_get_unaligned_be32(dp + 8);
+            ps = dp[12] & 0xf;
+            as = dp[13];
+            e = d_lba + d_num;
+            if (e <= nxt)
+                continue;
+            s = (d_lba > nxt) ? d_lba : nxt;
+            if (s >= segp->end) {
+                nxt = segp->end;        /* nothing more in this region */
+                break;
+            }
+            if (e > segp->end)
+                e = segp->end;
+            if (map_rt_match(op->rt, ps, as) &&
+                (! map_add_run(segp, s, e - s, ps, as))) {
+                segp->res = sg_convert_errno(ENOMEM);
+                goto fini;
+            }
+            nxt = e;
+        }
+        if (nxt == lba) {
+            if (op->do_32 && (2 == cc))
+                nxt = lba + sl;         /* nothing selected in scan length */
+            else if ((0 == n) || (3 == cc))
+                break;                  /* nothing selected up to capacity */
+            else {
+                if (op->verbose)
+                    pr2serr("GET LBA STATUS response doesn't cover LBA 0x%"
+                            PRIx64 "\n", lba);
+                segp->res = SG_LIB_CAT_MALFORMED;
+                break;
+            }
+        }
+        lba = nxt;
+    }
+fini:
+    free(free_bp);
+    return 0;
+}
+
+/* Implements --map=MF. Returns 0 on success */
+static int
+map_scan(int sg_fd, const char * device_name, struct opts_t * op,
+         sgj_opaque_p jop)
+{
+    bool to_stdout = (0 == strcmp(op->map_fn, "-"));
+    int k, j, res, num_seg, num_cmds, num_runs;
+    uint64_t total, seg_len, sum, bad_blks;
+    uint64_t ps_blks[16];
+    FILE * fp = NULL;
+    struct glbas_seg * segs;
+    struct glbas_seg * sp;
+    const struct glbas_run * rp;
+    sgj_state * jsp = &op->json_st;
+    sgj_opaque_p jo2p, jo3p, jap;
+    struct sg_geom g;
+    char b[80];
+    char d[80];
+
+    res = sg_geom_get(sg_fd, 0, &g, true, op->verbose);
+    if (res)
+        return res;
+    total = g.num_blks;
+    if (op->lba >= total) {
+        pr2serr("--lba=0x%" PRIx64 " is beyond the end of the medium "
+                "(0x%" PRIx64 " blocks)\n", op->lba, total);
+        return SG_LIB_LBA_OUT_OF_RANGE;
+    }
+    total -= op->lba;
+    num_seg = op->num_par;
+    if ((uint64_t)num_seg > total)
+        num_seg = (int)total;
+    segs = (struct glbas_seg *)calloc(num_seg, sizeof(*segs));
+    if (NULL == segs)
+        return sg_convert_errno(ENOMEM);
+    seg_len = (total + num_seg - 1) / num_seg;
+    for (k = 0; k < num_seg; ++k) {
+        sp = segs + k;
+        sp->sg_fd = sg_fd;
+        sp->op = op;
+        sp->lba = op->lba + (k * seg_len);
+        sp->end = (k == (num_seg - 1)) ? (op->lba + total) :
+                                         (sp->lba + seg_len);
+    }
+    sg_par_each(num_seg, num_seg, map_scan_seg, segs);
+    res = 0;
+    num_cmds = 0;
+    for (k = 0; k < num_seg; ++k) {
+        num_cmds += segs[k].num_cmds;
+        if (segs[k].res && (0 == res)) {
+            res = segs[k].res;
+            sg_get_category_sense_str(res, sizeof(b), b, op->verbose);
+            pr2serr("Get LBA Status command, region starting at LBA 0x%"
+                    PRIx64 ": %s\n", segs[k].lba, b);
+        }
+    }
+    if (res)
+        goto fini;
+    /* join the regions, merging runs that continue across a boundary */
+    for (k = 1; k < num_seg; ++k) {
+        for (j = 0, rp = segs[k].runs; j < segs[k].num_runs; ++j, ++rp) {
+            if (! map_add_run(segs + 0, rp->lba, rp->num, rp->p_status,
+                              rp->add_status)) {
+                res = sg_convert_errno(ENOMEM);
+                goto fini;
+            }
+        }
+    }
+    if (to_stdout)
+        fp = stdout;
+    else if (NULL == (fp = fopen(op->map_fn, "w"))) {
+        res = errno;
+        pr2serr("unable to open %s: %s\n", op->map_fn, safe_strerror(res));
+        res = sg_convert_errno(res);
+        goto fini;
+    }
+    fprintf(fp, "# %s map of %s, LBA 0x%" PRIx64 " for 0x%" PRIx64
+            " blocks, report type %d\n", MY_NAME, device_name, op->lba,
+            total, op->rt);
+    memset(ps_blks, 0, sizeof(ps_blks));
+    sum = 0;
+    bad_blks = 0;
+    num_runs = segs[0].num_runs;
+    for (j = 0, rp = segs[0].runs; j < num_runs; ++j, ++rp) {
+        get_prov_status_str(rp->p_status, b, sizeof(b));
+        get_pr_status_str(rp->add_status, d, sizeof(d));
+        fprintf(fp, "0x%" PRIx64 ",0x%" PRIx64 "\t# %s%s%s\n", rp->lba,
+                rp->num, b, (strlen(d) > 0) ? ", " : "", d);
+        ps_blks[rp->p_status] += rp->num;
+        sum += rp->num;
+        if (rp->add_status)
+            bad_blks += rp->num;
+    }
+    if (! to_stdout) {
+        if (fclose(fp)) {
+            res = errno;
+            pr2serr("error writing %s: %s\n", op->map_fn, safe_strerror(res));
+            res = sg_convert_errno(res);
+            goto fini;
+        }
+    } else
+        fflush(fp);
+    if (to_stdout && (! jsp->pr_as_json)) {
+        /* the map is the output */
+        if (op->verbose)
+            pr2serr("%d runs found with %d commands\n", num_runs, num_cmds);
+        goto fini;
+    }
+
+    jo2p = sgj_named_subobject_r(jsp, jop, "lba_status_map");
+    sgj_haj_vi(jsp, jo2p, 0, "Starting LBA", SGJ_SEP_COLON_1_SPACE,
+               op->lba, true);
+    sgj_haj_vi(jsp, jo2p, 0, "Number of blocks", SGJ_SEP_COLON_1_SPACE,
+               total, true);
+    sgj_haj_vi(jsp, jo2p, 0, "Report type", SGJ_SEP_COLON_1_SPACE,
+               op->rt, false);
+    sgj_haj_vi(jsp, jo2p, 0, "Number of commands",
+               SGJ_SEP_COLON_1_SPACE, num_cmds, false);
+    sgj_haj_vi(jsp, jo2p, 0, "Number of runs", SGJ_SEP_COLON_1_SPACE,
+               num_runs, false);
+    jap = sgj_named_subarray_r(jsp, jo2p, "provisioning_status_list");
+    for (k = 0; k < 16; ++k) {
+        if (0 == ps_blks[k])
+            continue;
+        get_prov_status_str(k, b, sizeof(b));
+        sgj_pr_hr(jsp, "  %s: %" PRIu64 " blocks\n", b, ps_blks[k]);
+        if (jsp->pr_as_json) {
+            jo3p = sgj_new_unattached_object_r(jsp);
+            sgj_js_nv_istr(jsp, jo3p, "provisioning_status", k, NULL, b);
+            sgj_js_nv_i(jsp, jo3p, "blocks", (int64_t)ps_blks[k]);
+            sgj_js_nv_o(jsp, jap, NULL /* name */, jo3p);
+        }
+    }
+    if (bad_blks > 0) {
+        sgj_pr_hr(jsp, "  may contain unrecovered errors: %" PRIu64
+                  " blocks\n", bad_blks);
+        sgj_js_nv_i(jsp, jo2p, "unrecovered_error_blocks",
+                    (int64_t)bad_blks);
+    }
+    if (sum < total) {
+        sgj_pr_hr(jsp, "  not reported: %" PRIu64 " blocks\n", total - sum);
+        sgj_js_nv_i(jsp, jo2p, "not_reported_blocks", (int64_t)(total - sum));
+    }
+    if (! to_stdout)
+        sgj_pr_hr(jsp, "Map written to %s\n", op->map_fn);
+fini:
+    for (k = 0; k < num_seg; ++k)
+        free(segs[k].runs);
+    free(segs);
+    return res;
+}
+
 /* Handles short options after '-j' including a sequence of short options
  * that include one 'j' (for JSON). Want optional argument to '-j' to be
  * prefixed by '='. Return 0 for good, SG_LIB_SYNTAX_ERROR for syntax error
@@ -355,12 +695,13 @@ main(int argc, char * argv[])
 
     op = &opts;
     op->maxlen = DEF_GLBAS_BUFF_LEN;
+    op->num_par = DEF_MAP_PARALLEL;
     if (getenv("SG3_UTILS_INVOCATION"))
         sg_rep_invocation(MY_NAME, version_str, argc, argv, stderr);
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "^bBe:hi:j::J:Hl:m:rRs:St:TvV",
+        c = getopt_long(argc, argv, "^bBe:hi:j::J:Hl:m:M:p:rRs:St:TvV",
                         long_options, &option_index);
         if (c == -1)
             break;
@@ -439,7 +780,16 @@ main(int argc, char * argv[])
                 pr2serr("Warning: --maxlen=LEN less than %d ignored\n",
                         MIN_MAXLEN);
                 op->maxlen = DEF_GLBAS_BUFF_LEN;
-            }
+            } else
+                op->maxlen_given = true;
+            break;
+        case 'M':
+            op->map_fn = optarg;
+            break;
+        case 'p':
+            op->num_par = sg_par_get_num(optarg, 1, MAX_MAP_PARALLEL);
+            if (op->num_par < 0)
+                return SG_LIB_SYNTAX_ERROR;
             break;
         case 'r':
             op->do_raw = true;
@@ -532,6 +882,23 @@ main(int argc, char * argv[])
         }
         jop = sgj_start_r(MY_NAME, version_str, argc, argv, jsp);
     }
+    if (op->map_fn) {
+        if (op->in_fn || op->do_raw || op->do_hex || (NULL == device_name)) {
+            pr2serr("--map=MF needs a DEVICE and can't be used with "
+                    "--inhex=FN, --raw or --hex\n");
+            ret = SG_LIB_CONTRADICT;
+            goto fini;
+        }
+        if ((0 == strcmp(op->map_fn, "-")) && op->do_json &&
+            ((NULL == op->js_file) || (0 == strcmp(op->js_file, "-")))) {
+            pr2serr("with --map=- and --json, JSON output needs "
+                    "--js-file=JFN\n");
+            ret = SG_LIB_CONTRADICT;
+            goto fini;
+        }
+        if (! op->maxlen_given)
+            op->maxlen = DEF_MAP_BUFF_LEN;
+    }
 
     if (op->maxlen > DEF_GLBAS_BUFF_LEN) {
         glbasBuffp = (uint8_t *)sg_memalign(op->maxlen, 0, &free_glbasBuffp,
@@ -605,6 +972,10 @@ main(int argc, char * argv[])
         goto fini;
     }
 
+    if (op->map_fn) {
+        ret = map_scan(sg_fd, device_name, op, jop);
+        goto fini;
+    }
     res = 0;
     if (op->do_16)
         res = sg_ll_get_lba_status16(sg_fd, op->lba, op->rt, glbasBuffp,
@@ -723,8 +1094,13 @@ start_response:
                *(glbasBuffp + 7) & 0x1, true);    /* added sbc4r12 */
     if (op->verbose)
         pr2serr("%d complete LBA status descriptors found\n", num_descs);
-    if (jsp->pr_as_json)
-        jap = sgj_named_subarray_r(jsp, jop, "lba_status_descriptor");
+    if (jsp->pr_as_json) {
+        if ((NULL == op->js_file) || (0 == strcmp(op->js_file, "-")))
+            jap = sgj_stream_subarray_r(jsp, "lba_status_descriptor",
+                                        stdout);
+        else
+            jap = sgj_named_subarray_r(jsp, jop, "lba_status_descriptor");
+    }
 
     for (bp = glbasBuffp + 8, k = 0; k < num_descs; bp += 16, ++k) {
         res = decode_lba_status_desc(bp, &d_lba, &d_blocks, &lba_access,
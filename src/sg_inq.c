@@ -1,5 +1,5 @@
 /* A utility program originally written for the Linux OS SCSI subsystem.
- * Copyright (C) 2000-2023 D. Gilbert
+ * Copyright (C) 2000-2026 D. Gilbert
  * This program is free software; you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
  * the Free Software Foundation; either version 2, or (at your option)
@@ -47,13 +47,14 @@
 #include "sg_pt.h"
 #include "sg_unaligned.h"
 #include "sg_pr2serr.h"
+#include "sg_rcache.h"
 #if (HAVE_NVME && (! IGNORE_NVME))
 #include "sg_pt_nvme.h"
 #endif
 
 #include "sg_vpd_common.h"  /* for shared VPD page processing with sg_vpd */
 
-static const char * version_str = "2.48 20230606";  /* spc6r08, sbc5r04 */
+static const char * version_str = "2.53 20261015";  /* spc6r08, sbc5r04 */
 
 #define MY_NAME "sg_inq"
 
@@ -113,9 +114,7 @@ static const char * version_str = "2.48 20230606";  /* spc6r08, sbc5r04 */
 #define DEF_PT_TIMEOUT  60       /* 60 seconds */
 
 
-uint8_t * rsp_buff;
 
-static uint8_t * free_rsp_buff;
 static const int rsp_buff_sz = MX_ALLOC_LEN + 1;
 
 static char xtra_buff[MX_ALLOC_LEN + 1];
@@ -224,6 +223,7 @@ static struct option long_options[] = {
         {"ata", no_argument, 0, 'a'},
 #endif
         {"block", required_argument, 0, 'B'},
+        {"cache", required_argument, 0, 'C'},
         {"cmddt", no_argument, 0, 'c'},
         {"descriptors", no_argument, 0, 'd'},
         {"debug", no_argument, 0, 'D'},
@@ -244,6 +244,8 @@ static struct option long_options[] = {
         {"new", no_argument, 0, 'N'},
         {"old", no_argument, 0, 'O'},
 #endif
+        {"no-inquiry", no_argument, 0, 'n'},
+        {"no_inquiry", no_argument, 0, 'n'},
         {"only", no_argument, 0, 'o'},
         {"page", required_argument, 0, 'p'},
         {"quiet", no_argument, 0, 'q'},
@@ -264,36 +266,41 @@ usage()
 #if defined(SG_LIB_LINUX) && defined(SG_SCSI_STRINGS) && \
     defined(HDIO_GET_IDENTITY)
 
-    pr2serr("Usage: sg_inq [--ata] [--block=0|1] [--cmddt] [--descriptors] "
-            "[--export]\n"
-            "              [--extended] [--help] [--hex] [--id] "
+    pr2serr("Usage: sg_inq [--ata] [--block=0|1] [--cache=DIR] [--cmddt] "
+            "[--descriptors]\n"
+            "              [--export] [--extended] [--help] [--hex] [--id] "
             "[--inhex=FN]\n"
             "              [--json[=JO]] [--js-file=JFN] [--len=LEN] "
             "[--long]\n"
-            "              [--maxlen=LEN] [--only] [--page=PG] [--raw]\n"
-            "              [--sinq_inraw=RFN] [--vendor] [--verbose] "
-            "[--version]\n"
-            "              [--vpd] DEVICE\n"
+            "              [--maxlen=LEN] [--no-inquiry] [--only] "
+            "[--page=PG]\n"
+            "              [--raw] [--sinq_inraw=RFN] [--vendor] "
+            "[--verbose]\n"
+            "              [--version] [--vpd] DEVICE\n"
             "  where:\n"
             "    --ata|-a        treat DEVICE as (directly attached) ATA "
             "device\n");
 #else
-    pr2serr("Usage: sg_inq [--block=0|1] [--cmddt] [--descriptors] "
-            "[--export]\n"
-            "              [--extended] [--help] [--hex] [--id] "
+    pr2serr("Usage: sg_inq [--block=0|1] [--cache=DIR] [--cmddt] "
+            "[--descriptors]\n"
+            "              [--export] [--extended] [--help] [--hex] [--id] "
             "[--inhex=FN]\n"
             "              [--json[=JO]] [--js-file=JFN] [--len=LEN] "
             "[--long]\n"
-            "              [--maxlen=LEN] [--only] [--page=PG] [--quiet] "
-            "[--raw]\n"
-            "              [--sinq_inraw=RFN] [--verbose] [--version] "
-            "[--vpd]\n"
-            "              DEVICE\n"
+            "              [--maxlen=LEN] [--no-inquiry] [--only] "
+            "[--page=PG]\n"
+            "              [--quiet] [--raw] [--sinq_inraw=RFN] "
+            "[--verbose]\n"
+            "              [--version] [--vpd] DEVICE\n"
             "  where:\n");
 #endif
     pr2serr("    --block=0|1     0-> open(non-blocking); 1-> "
             "open(blocking)\n"
             "      -B 0|1        (def: depends on OS; Linux pt: 0)\n"
+            "    --cache=DIR|-C DIR    reuse INQUIRY responses cached in "
+            "directory\n"
+            "                          DIR while the DEVICE reports no unit "
+            "attention\n"
             "    --cmddt|-c      command support data mode (set opcode "
             "with '--page=PG')\n"
             "                    use twice for list of supported "
@@ -329,6 +336,9 @@ usage()
             "indicated)\n"
             "    --long|-L       supply extra information on NVMe devices\n"
             "    --maxlen=LEN|-m LEN    same as '--len='\n"
+            "    --no-inquiry|-n    same as '--force --only': send the "
+            "fewest\n"
+            "                       commands, for scripts\n"
             "    --old|-O        use old interface (use as first option)\n"
             "    --only|-o       for std inquiry do not fetch serial number "
             "vpd page;\n"
@@ -482,6 +492,10 @@ chk_short_opts(const char sopt_ch, struct opts_t * op)
         break;
     case 'j':
         break;  /* simply ignore second 'j' (e.g. '-jxj') */
+    case 'n':
+        op->do_force = true;
+        op->do_only = true;
+        break;
     case 'o':
         op->do_only = true;
         break;
@@ -553,19 +567,19 @@ new_parse_cmd_line(struct opts_t * op, int argc, char * argv[])
 #ifdef SG_LIB_LINUX
 #ifdef SG_SCSI_STRINGS
         c = getopt_long(argc, argv,
-                        "^aB:cdDeEfhHiI:j::J:l:Lm:M:NoOp:qQ:rsuvVx",
+                        "^aB:cC:dDeEfhHiI:j::J:l:Lm:M:nNoOp:qQ:rsuvVx",
                         long_options, &option_index);
 #else
-        c = getopt_long(argc, argv, "^B:cdDeEfhHiI:j::J:l:Lm:M:op:qQ:rsuvVx",
+        c = getopt_long(argc, argv, "^B:cdDeEfhHiI:j::J:l:Lm:M:nop:qQ:rsuvVx",
                         long_options, &option_index);
 #endif /* SG_SCSI_STRINGS */
 #else  /* SG_LIB_LINUX */
 #ifdef SG_SCSI_STRINGS
         c = getopt_long(argc, argv,
-                        "^B:cdDeEfhHiI:j::J:l:Lm:M:NoOp:qQ:rsuvVx",
+                        "^B:cC:dDeEfhHiI:j::J:l:Lm:M:nNoOp:qQ:rsuvVx",
                         long_options, &option_index);
 #else
-        c = getopt_long(argc, argv, "^B:cdDeEfhHiI:j::J:l:Lm:M:op:qQ:rsuvVx",
+        c = getopt_long(argc, argv, "^B:cdDeEfhHiI:j::J:l:Lm:M:nop:qQ:rsuvVx",
                         long_options, &option_index);
 #endif /* SG_SCSI_STRINGS */
 #endif /* SG_LIB_LINUX */
@@ -595,6 +609,9 @@ new_parse_cmd_line(struct opts_t * op, int argc, char * argv[])
         case 'c':
             ++op->do_cmddt;
             break;
+        case 'C':
+            op->cache_dir = optarg;
+            break;
         case 'd':
             op->do_descriptors = true;
             break;
@@ -644,6 +661,10 @@ new_parse_cmd_line(struct opts_t * op, int argc, char * argv[])
             op->do_json = true;
             op->js_file = optarg;
             break;
+        case 'n':
+            op->do_force = true;
+            op->do_only = true;
+            break;
         case 'o':
             op->do_only = true;
             break;
@@ -1214,7 +1235,7 @@ svpd_inhex_decode_all(struct opts_t * op, sgj_opaque_p jop)
         return vpd_decode(NULL, op, jop, 0);
 
     for (off = 0; off < in_len; off += bump) {
-        uint8_t * rp = rsp_buff + off;
+        uint8_t * rp = op->rsp_buff + off;
 
         pn = rp[1];
         bump = sg_get_unaligned_be16(rp + 2) + 4;
@@ -1471,9 +1492,12 @@ decode_dev_ids(const char * leadin, uint8_t * buff, int len,
     char d[64];
     static const int blen = sizeof(b);
     static const int dlen = sizeof(d);
+    struct sg_vpd_dev_id_idx di_idx;
 
+    /* walked once here, for both JSON and plain text output */
+    sg_vpd_dev_id_index(buff, len, &di_idx);
     if (jsp->pr_as_json) {
-        int ret = filter_json_dev_ids(buff, len, -1, op, jap);
+        int ret = filter_json_dev_ids(buff, len, &di_idx, -1, op, jap);
 
         if (ret || (! jsp->pr_out_hr))
             return;
@@ -1504,7 +1528,7 @@ decode_dev_ids(const char * leadin, uint8_t * buff, int len,
     }
 
     for (j = 1, off = -1;
-         (u = sg_vpd_dev_id_iter(buff, len, &off, -1, -1, -1)) == 0;
+         (u = sg_vpd_dev_id_next(&di_idx, &off, -1, -1, -1)) == 0;
          ++j) {
         bp = buff + off;
         i_len = bp[3];
@@ -2536,30 +2560,30 @@ std_inq_process(struct sg_pt_base * ptvp, struct opts_t * op,
     rlen = (op->maxlen > 0) ? op->maxlen : SAFE_STD_INQ_RESP_LEN;
     vb = op->verbose;
     if (NULL == ptvp) {    /* assume --inhex=FD usage */
-        std_inq_decode(rsp_buff + off, rlen, op, jop);
+        std_inq_decode(op->rsp_buff + off, rlen, op, jop);
         return 0;
     }
-    res = sg_ll_inquiry_pt(ptvp, false, 0, rsp_buff, rlen, DEF_PT_TIMEOUT,
+    res = sg_ll_inquiry_pt(ptvp, false, 0, op->rsp_buff, rlen, DEF_PT_TIMEOUT,
                            &resid, false, vb);
     if (0 == res) {
         if ((vb > 4) && ((rlen - resid) > 0)) {
             pr2serr("Safe (36 byte) Inquiry response:\n");
-            hex2stderr(rsp_buff, rlen - resid, 0);
+            hex2stderr(op->rsp_buff, rlen - resid, 0);
         }
-        len = rsp_buff[4] + 5;
+        len = op->rsp_buff[4] + 5;
         if ((len > SAFE_STD_INQ_RESP_LEN) && (len < 256) &&
             (0 == op->maxlen)) {
             rlen = len;
-            memset(rsp_buff, 0, rlen);
-            if (sg_ll_inquiry_pt(ptvp, false, 0, rsp_buff, rlen,
+            memset(op->rsp_buff, 0, rlen);
+            if (sg_ll_inquiry_pt(ptvp, false, 0, op->rsp_buff, rlen,
                                  DEF_PT_TIMEOUT, &resid, true, vb)) {
                 pr2serr("second INQUIRY (%d byte) failed\n", len);
                 return SG_LIB_CAT_OTHER;
             }
-            if (len != (rsp_buff[4] + 5)) {
+            if (len != (op->rsp_buff[4] + 5)) {
                 pr2serr("strange, consecutive INQUIRYs yield different "
                         "'additional lengths'\n");
-                len = rsp_buff[4] + 5;
+                len = op->rsp_buff[4] + 5;
             }
         }
         if (op->maxlen > 0)
@@ -2570,12 +2594,12 @@ std_inq_process(struct sg_pt_base * ptvp, struct opts_t * op,
         if (act_len > (rlen - resid))
             act_len = rlen - resid;
         if (act_len < SAFE_STD_INQ_RESP_LEN)
-            rsp_buff[act_len] = '\0';
+            op->rsp_buff[act_len] = '\0';
         if ((! op->do_only) && (! op->do_export) && (0 == op->maxlen)) {
             if (fetch_unit_serial_num(ptvp, usn_buff, sizeof(usn_buff), vb))
                 usn_buff[0] = '\0';
         }
-        std_inq_decode(rsp_buff, act_len, op, jop);
+        std_inq_decode(op->rsp_buff, act_len, op, jop);
         return 0;
     } else if (res < 0) { /* could be an ATA device */
 #if defined(SG_LIB_LINUX) && defined(SG_SCSI_STRINGS) && \
@@ -2617,20 +2641,21 @@ cmddt_process(int sg_fd, const struct opts_t * op)
     int k, j, num, len, pdt, reserved_cmddt, support_num, res;
     char op_name[128];
 
-    memset(rsp_buff, 0, rsp_buff_sz);
+    memset(op->rsp_buff, 0, rsp_buff_sz);
     if (op->do_cmddt > 1) {
         printf("Supported command list:\n");
         for (k = 0; k < 256; ++k) {
-            res = sg_ll_inquiry(sg_fd, true /* cmddt */, false, k, rsp_buff,
-                                DEF_ALLOC_LEN, true, op->verbose);
+            res = sg_ll_inquiry(sg_fd, true /* cmddt */, false, k,
+                                op->rsp_buff, DEF_ALLOC_LEN, true,
+                                op->verbose);
             if (0 == res) {
-                pdt = rsp_buff[0] & PDT_MASK;
-                support_num = rsp_buff[1] & 7;
-                reserved_cmddt = rsp_buff[4];
+                pdt = op->rsp_buff[0] & PDT_MASK;
+                support_num = op->rsp_buff[1] & 7;
+                reserved_cmddt = op->rsp_buff[4];
                 if ((3 == support_num) || (5 == support_num)) {
-                    num = rsp_buff[5];
+                    num = op->rsp_buff[5];
                     for (j = 0; j < num; ++j)
-                        printf(" %.2x", (int)rsp_buff[6 + j]);
+                        printf(" %.2x", (int)op->rsp_buff[6 + j]);
                     if (5 == support_num)
                         printf("  [vendor specific manner (5)]");
                     sg_get_opcode_name((uint8_t)k, pdt,
@@ -2655,9 +2680,9 @@ cmddt_process(int sg_fd, const struct opts_t * op)
     }
     else {
         res = sg_ll_inquiry(sg_fd, true /* cmddt */, false, op->vpd_pn,
-                            rsp_buff, DEF_ALLOC_LEN, true, op->verbose);
+                            op->rsp_buff, DEF_ALLOC_LEN, true, op->verbose);
         if (0 == res) {
-            pdt = rsp_buff[0] & PDT_MASK;
+            pdt = op->rsp_buff[0] & PDT_MASK;
             if (! op->do_raw) {
                 printf("CmdDt INQUIRY, opcode=0x%.2x:  [", op->vpd_pn);
                 sg_get_opcode_name((uint8_t)op->vpd_pn, pdt,
@@ -2665,18 +2690,18 @@ cmddt_process(int sg_fd, const struct opts_t * op)
                 op_name[sizeof(op_name) - 1] = '\0';
                 printf("%s]\n", op_name);
             }
-            len = rsp_buff[5] + 6;
-            reserved_cmddt = rsp_buff[4];
+            len = op->rsp_buff[5] + 6;
+            reserved_cmddt = op->rsp_buff[4];
             if (op->do_raw)
-                dStrRaw((const char *)rsp_buff, len);
+                dStrRaw((const char *)op->rsp_buff, len);
             else if (op->do_hex > 0)
-                hex2stdout(rsp_buff, len, no_ascii_4hex(op));
+                hex2stdout(op->rsp_buff, len, no_ascii_4hex(op));
             else {
                 bool prnt_cmd = false;
                 const char * desc_p;
 
-                support_num = rsp_buff[1] & 7;
-                num = rsp_buff[5];
+                support_num = op->rsp_buff[1] & 7;
+                num = op->rsp_buff[5];
                 switch (support_num) {
                 case 0:
                     if (0 == reserved_cmddt)
@@ -2700,7 +2725,7 @@ cmddt_process(int sg_fd, const struct opts_t * op)
                 if (prnt_cmd) {
                     printf("  Support field: %s [", desc_p);
                     for (j = 0; j < num; ++j)
-                        printf(" %.2x", (int)rsp_buff[6 + j]);
+                        printf(" %.2x", (int)op->rsp_buff[6 + j]);
                     printf(" ]\n");
                 } else
                     printf("  Support field: %s\n", desc_p);
@@ -2751,7 +2776,7 @@ vpd_mainly_hex(struct sg_pt_base * ptvp, struct opts_t * op, sgj_opaque_p jop,
     if (dhex < 0)
         dhex = -dhex;
     as_json = jsp->pr_as_json;
-    rp = rsp_buff + off;
+    rp = op->rsp_buff + off;
     if ((! op->do_raw) && (dhex < 3)) {
         if (dhex > 0)
             printf("VPD INQUIRY, page code=0x%.2x:\n", op->vpd_pn);
@@ -2847,7 +2872,7 @@ vpd_decode(struct sg_pt_base * ptvp, struct opts_t * op, sgj_opaque_p jop,
 
     if (dhex < 0)
         dhex = -dhex;
-    rp = rsp_buff + off;
+    rp = op->rsp_buff + off;
     vb = op->verbose;
     if ((off > 0) && (VPD_NOPE_WANT_STD_INQ != op->vpd_pn))
         pn = rp[1];
@@ -4314,6 +4339,7 @@ main(int argc, char * argv[])
     sgj_opaque_p jop = NULL;
     struct opts_t opts SG_C_CPP_ZERO_INIT;
     struct opts_t * op;
+    uint8_t * free_rsp_buff = NULL;
 
     op = &opts;
     op->vpd_pn = -1;
@@ -4364,6 +4390,7 @@ main(int argc, char * argv[])
             op->do_hex = -op->do_hex;
     }
 
+    sgj_hr_buffered();
     jsp = &op->json_st;
     if (op->do_json) {
         if (! sgj_init_state(jsp, op->json_arg)) {
@@ -4520,9 +4547,9 @@ main(int argc, char * argv[])
     if (as_json)
         jop = sgj_start_r(MY_NAME, version_str, argc, argv, jsp);
 
-    rsp_buff = sg_memalign(rsp_buff_sz, 0 /* page align */, &free_rsp_buff,
-                           false);
-    if (NULL == rsp_buff) {
+    op->rsp_buff = sg_memalign(rsp_buff_sz, 0 /* page align */,
+                               &free_rsp_buff, false);
+    if (NULL == op->rsp_buff) {
         pr2serr("Unable to allocate %d bytes on heap\n", rsp_buff_sz);
         return sg_convert_errno(ENOMEM);
     }
@@ -4533,7 +4560,7 @@ main(int argc, char * argv[])
             goto err_out;
         }
         /* Note: want to support both --sinq_inraw= and --inhex= options */
-        if ((ret = sg_f2hex_arr(op->sinq_inraw_fn, true, false, rsp_buff,
+        if ((ret = sg_f2hex_arr(op->sinq_inraw_fn, true, false, op->rsp_buff,
                                 &inraw_len, rsp_buff_sz))) {
             goto err_out;
         }
@@ -4543,7 +4570,7 @@ main(int argc, char * argv[])
             ret = SG_LIB_FILE_ERROR;
             goto err_out;
         }
-        memcpy(op->std_inq_a,  rsp_buff, 36);
+        memcpy(op->std_inq_a,  op->rsp_buff, 36);
         op->std_inq_a_valid = true;
     }
     if (op->inhex_fn) {
@@ -4557,7 +4584,7 @@ main(int argc, char * argv[])
             ret = SG_LIB_CONTRADICT;
             goto err_out;
         }
-        err = sg_f2hex_arr(op->inhex_fn, !!op->do_raw, false, rsp_buff,
+        err = sg_f2hex_arr(op->inhex_fn, !!op->do_raw, false, op->rsp_buff,
                            &inhex_len, rsp_buff_sz);
         if (err) {
             if (err < 0)
@@ -4568,12 +4595,12 @@ main(int argc, char * argv[])
         op->do_raw = 0;         /* don't want raw on output with --inhex= */
         if (-1 == op->vpd_pn) {       /* may be able to deduce VPD page */
             if (op->page_pdt < 0)
-                op->page_pdt = PDT_MASK & rsp_buff[0];
-            if ((0x2 == (0xf & rsp_buff[3])) && (rsp_buff[2] > 2)) {
+                op->page_pdt = PDT_MASK & op->rsp_buff[0];
+            if ((0x2 == (0xf & op->rsp_buff[3])) && (op->rsp_buff[2] > 2)) {
                 if (vb)
                     pr2serr("Guessing from --inhex= this is a standard "
                             "INQUIRY\n");
-            } else if (rsp_buff[2] <= 2) {
+            } else if (op->rsp_buff[2] <= 2) {
                 /*
                  * Removable devices have the RMB bit set, which would
                  * present itself as vpd page 0x80 output if we're not
@@ -4582,18 +4609,18 @@ main(int argc, char * argv[])
                  * Serial number must be right-aligned ASCII data in
                  * bytes 5-7; standard INQUIRY will have flags here.
                  */
-                if (rsp_buff[1] == 0x80 &&
-                    (rsp_buff[5] < 0x20 || rsp_buff[5] > 0x80 ||
-                     rsp_buff[6] < 0x20 || rsp_buff[6] > 0x80 ||
-                     rsp_buff[7] < 0x20 || rsp_buff[7] > 0x80)) {
+                if (op->rsp_buff[1] == 0x80 &&
+                    (op->rsp_buff[5] < 0x20 || op->rsp_buff[5] > 0x80 ||
+                     op->rsp_buff[6] < 0x20 || op->rsp_buff[6] > 0x80 ||
+                     op->rsp_buff[7] < 0x20 || op->rsp_buff[7] > 0x80)) {
                     if (vb)
                         pr2serr("Guessing from --inhex= this is a "
                                 "standard INQUIRY\n");
                 } else {
                     if (vb)
                         pr2serr("Guessing from --inhex= this is VPD "
-                                "page 0x%x\n", rsp_buff[1]);
-                    op->vpd_pn = rsp_buff[1];
+                                "page 0x%x\n", op->rsp_buff[1]);
+                    op->vpd_pn = op->rsp_buff[1];
                     op->do_vpd = true;
                     if ((1 != op->do_hex) && (0 == op->do_raw))
                         op->do_decode = true;
@@ -4713,15 +4740,15 @@ main(int argc, char * argv[])
             goto err_out;
         }
     } else if (op->std_inq_a_valid && (NULL == op->device_name)) {
-        /* --sinq_inraw=RFN contents still in rsp_buff */
+        /* --sinq_inraw=RFN contents still in op->rsp_buff */
         if (op->do_raw)
-            dStrRaw((const char *)rsp_buff, inraw_len);
+            dStrRaw((const char *)op->rsp_buff, inraw_len);
         else if (op->do_hex) {
             if (! op->do_quiet && (op->do_hex < 3))
                 sgj_pr_hr(jsp, "Standard Inquiry data format:\n");
-            hex2stdout(rsp_buff, inraw_len, (1 == op->do_hex) ? 0 : -1);
+            hex2stdout(op->rsp_buff, inraw_len, (1 == op->do_hex) ? 0 : -1);
         } else
-            std_inq_decode(rsp_buff, inraw_len, op, jop);
+            std_inq_decode(op->rsp_buff, inraw_len, op, jop);
         ret = 0;
         goto fini2;
     }
@@ -4760,13 +4787,15 @@ main(int argc, char * argv[])
         goto err_out;
     }
 #endif
-    memset(rsp_buff, 0, rsp_buff_sz);
+    memset(op->rsp_buff, 0, rsp_buff_sz);
     ptvp = construct_scsi_pt_obj_with_fd(sg_fd, vb);
     if (NULL == ptvp) {
         pr2serr("memory problem from construct_scsi_pt_obj_with_fd()\n");
         ret = sg_convert_errno(ENOMEM);
         goto err_out;
     }
+    if (op->cache_dir)
+        sg_rcache_open(op->cache_dir, op->device_name, sg_fd, vb);
 
 #if (HAVE_NVME && (! IGNORE_NVME))
 #if 0
@@ -5033,7 +5062,7 @@ prepare_ata_identify(const struct opts_t * op, int inhex_len)
     else if (n > 512)
         n = 512;
     memset(&ata_ident, 0, sizeof(ata_ident));
-    memcpy(&ata_ident, rsp_buff, n);
+    memcpy(&ata_ident, op->rsp_buff, n);
     show_ata_identify(&ata_ident, false, op->verbose);
 }
 
@@ -0,0 +1,1574 @@
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+#include <sys/types.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/utsname.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "sg_lib.h"
+#include "sg_pt.h"
+#include "sg_cmds_basic.h"
+#include "sg_mux.h"
+#include "sg_io_linux.h"
+#include "sg_dd_eng.h"
+#include "sg_json_sg_lib.h"
+#include "sg_unaligned.h"
+#include "sg_pr2serr.h"
+
+/* A utility program originally written for the Linux OS SCSI subsystem.
+ *
+ * This program measures the command rate (IOPS) and latency that one or
+ * more devices achieve with a given number of commands in flight. Each
+ * thread has its own file descriptor and keeps up to QD commands (a mix
+ * of TEST UNIT READY, READ, WRITE, VERIFY, WRITE ATOMIC and WRITE followed
+ * by SYNCHRONIZE CACHE) outstanding for a given duration. It grew out of
+ * testing/sg_tst_async which exercises the sg driver's asynchronous
+ * interface; here each thread has a completion multiplexer (sg_mux) so sg
+ * devices (v3 or v4 interface, whichever the driver offers) overlap
+ * commands while bsg and NVMe devices (via the SCSI to NVMe translation)
+ * complete each command as it is submitted.
+ */
+
+static const char * version_str = "1.03 20261015";
+
+#define MY_NAME "sg_iobench"
+
+#define MAX_DEVICES 64
+#define MAX_THREADS 256
+#define MAX_QD 1024             /* per thread (and file descriptor) */
+#define MAX_PCTS 16
+#define MAX_SWEEP 32
+#define DEF_DURATION 10         /* seconds */
+#define DEF_QD 8
+#define DEF_BLOCKS 8            /* per READ, WRITE or VERIFY */
+#define DEF_PT_TIMEOUT 60       /* seconds */
+#define SENSE_BUFF_LEN 64
+#define WAIT_MAX_MS 200         /* how long a thread sleeps between checks */
+
+#define VERIFY10 0x2f
+#define VERIFY16 0x8f
+#define SYNC_CACHE10 0x35
+#define SYNC_CACHE16 0x91
+#define WRITE_ATOMIC16 0x9c
+#define VPD_BLOCK_LIMITS 0xb0
+#define VPD_BLOCK_LIMITS_LEN 64
+
+#define BK_TUR 0                /* indexes of the commands in the mix */
+#define BK_READ 1
+#define BK_WRITE 2
+#define BK_VERIFY 3
+#define BK_ATOMIC 4             /* WRITE ATOMIC(16) */
+#define BK_WSYNC 5              /* WRITE then SYNCHRONIZE CACHE */
+#define BK_NUM 6
+
+static const char * bk_name[BK_NUM] = {"tur", "read", "write", "verify",
+                                       "atomic", "wsync"};
+static const char * bk_cmd_name[BK_NUM] = {"Test unit ready", "Read",
+                                           "Write", "Verify",
+                                           "Write atomic(16)",
+                                           "Synchronize cache"};
+
+static const double def_pcts[] = {50.0, 90.0, 99.0, 99.9, 99.99};
+
+static volatile int got_signal;
+
+static struct option long_options[] = {
+        {"adaptive", no_argument, 0, 'A'},
+        {"align", required_argument, 0, 'a'},
+        {"blocks", required_argument, 0, 'b'},
+        {"cdbsz", required_argument, 0, 'c'},
+        {"duration", required_argument, 0, 'd'},
+        {"force", no_argument, 0, 'f'},
+        {"help", no_argument, 0, 'h'},
+        {"json", optional_argument, 0, '^'},    /* short option is '-j' */
+        {"js-file", required_argument, 0, 'J'},
+        {"js_file", required_argument, 0, 'J'},
+        {"mix", required_argument, 0, 'm'},
+        {"percentiles", required_argument, 0, 'p'},
+        {"qd", required_argument, 0, 'q'},
+        {"qd-sweep", required_argument, 0, 'W'},
+        {"qd_sweep", required_argument, 0, 'W'},
+        {"queue", required_argument, 0, 'Q'},
+        {"range", required_argument, 0, 'r'},
+        {"seed", required_argument, 0, 's'},
+        {"share", no_argument, 0, 'S'},
+        {"sweep", required_argument, 0, 'w'},
+        {"threads", required_argument, 0, 't'},
+        {"timeout", required_argument, 0, 'T'},
+        {"verbose", no_argument, 0, 'v'},
+        {"version", no_argument, 0, 'V'},
+        {0, 0, 0, 0},
+};
+
+struct opts_t {
+    bool adaptive;      /* QD is the most, mux adjusts the window */
+    bool do_json;
+    bool force;
+    bool seed_given;
+    bool share;         /* threads on the same DEVICE share its fd */
+    bool sweep_qd;      /* --qd-sweep= rather than --sweep= */
+    bool verbose_given;
+    bool version_given;
+    int align;          /* LBAs are multiples of this */
+    int cdbsz;          /* 10 or 16, 0 -> from capacity */
+    int do_help;
+    int duration;       /* seconds */
+    int num_blks;       /* per READ, WRITE or VERIFY */
+    int num_devs;
+    int num_pcts;
+    int num_sweep;
+    int num_threads;
+    int qd;             /* commands in flight per thread */
+    int pt_flags;       /* SCSI_PT_FLAGS_QUEUE_AT_* or 0 */
+    int timeout;
+    int verbose;
+    int weight[BK_NUM];
+    int weight_sum;
+    int64_t lba_start;  /* --range=LBA[,NUM] */
+    int64_t lba_num;    /* 0 -> to the end of the device */
+    uint64_t seed;
+    const char * json_arg;      /* carries [JO] from --json[=JO] */
+    const char * js_file;
+    const char * dev_names[MAX_DEVICES];
+    int sweep[MAX_SWEEP];       /* thread counts or QDs of a sweep */
+    double pct[MAX_PCTS];
+    sgj_state json_st;
+};
+
+struct dev_t {
+    bool is_async;      /* sg device: commands overlap */
+    int fd;             /* with --share: the fd its threads use, else -1 */
+    int blk_sz;
+    int64_t num_blks;   /* capacity */
+    int64_t lba_num;    /* addresses used: lba_start to +lba_num */
+    uint32_t atomic_max;        /* from the Block Limits VPD page */
+    uint32_t atomic_align;
+    uint32_t atomic_gran;
+    int64_t first_lba[BK_NUM];  /* lowest aligned LBA in range */
+    int64_t num_pos[BK_NUM];    /* aligned positions of num_blks blocks */
+    int align[BK_NUM];
+    const char * name;
+    const char * iface;
+    /* the cdb of BK_WSYNC is its SYNCHRONIZE CACHE, its WRITE is BK_WRITE */
+    struct sg_dde_cdb_tmpl tmpl[BK_NUM];
+};
+
+struct thr_t;
+
+struct slot_t {
+    struct sg_mux_cmd mc;       /* mc.ptp is this slot's pt object */
+    bool busy;
+    bool synced;        /* BK_WSYNC: the WRITE is done, now the sync */
+    int kind;           /* BK_* */
+    int64_t lba;
+    uint64_t t0_ns;
+    struct thr_t * tp;
+    uint8_t * buf;
+    uint8_t * free_buf;
+    uint8_t cdb[16];
+    uint8_t sense[SENSE_BUFF_LEN];
+};
+
+/* One per thread. The thread alone updates its counters, the main thread
+ * reads them after joining. */
+struct thr_t {
+    int idx;
+    int fd;
+    int ret;            /* first error, stops this thread */
+    uint64_t rnd;       /* xorshift64 state */
+    uint64_t end_ns;
+    uint64_t errs[BK_NUM];
+    uint64_t submit_eagain;
+    uint64_t submit_ebusy;
+    struct sg_mux_aimd_stats aimd;      /* with --adaptive, at the end */
+    struct dev_t * dp;
+    const struct opts_t * op;
+    struct sg_mux * mxp;
+    struct slot_t * slots;
+    struct sg_pt_lat_hist lat[BK_NUM];
+    pthread_t tid;
+};
+
+/* Summary of one run of a --sweep= */
+struct sweep_res {
+    int num_threads;
+    int qd;
+    int num_fds;
+    double secs;
+    uint64_t errs;
+    struct sg_pt_lat_hist tot;  /* all commands */
+};
+
+
+static void
+usage(void)
+{
+    pr2serr("Usage: sg_iobench [--adaptive] [--align=ALN] [--blocks=NUM] "
+            "[--cdbsz=10|16]\n"
+            "                  [--duration=SECS] [--force] [--help] "
+            "[--json[=JO]]\n"
+            "                  [--js-file=JFN] [--mix=MIX] "
+            "[--percentiles=PL] [--qd=QD]\n"
+            "                  [--qd-sweep=QL] [--queue=head|tail] "
+            "[--range=LBA[,NUM]]\n"
+            "                  [--seed=SEED] [--share] [--sweep=TL] "
+            "[--threads=NT]\n"
+            "                  [--timeout=TO] [--verbose] [--version] "
+            "DEVICE [DEVICE...]\n"
+            "  where:\n"
+            "    --adaptive|-A      QD is the most commands in flight, the "
+            "number\n"
+            "                       is adjusted to latency and BUSY "
+            "responses\n"
+            "    --align=ALN|-a ALN    LBAs are multiples of ALN (def: 1; "
+            "atomic\n"
+            "                          also to the device's atomic "
+            "alignment)\n"
+            "    --blocks=NUM|-b NUM    blocks per command other than TUR "
+            "(def: %d)\n"
+            "    --cdbsz=10|16|-c 10|16    cdb size of READ, WRITE and "
+            "VERIFY (def:\n"
+            "                              10, or 16 for large devices)\n"
+            "    --duration=SECS|-d SECS    seconds to run for (def: %d)\n"
+            "    --force|-f         needed when MIX contains write, atomic "
+            "or wsync\n"
+            "                       since they overwrite data on DEVICE\n"
+            "    --help|-h          print out usage message then exit\n"
+            "    --json[=JO]|-j[=JO]    output in JSON instead of plain "
+            "text\n"
+            "                           use --json=? for JSON help\n"
+            "    --js-file=JFN|-J JFN    JFN is a filename to which JSON "
+            "output is\n"
+            "                            written (def: stdout); truncates "
+            "then writes\n"
+            "    --mix=MIX|-m MIX    commands to send, MIX is a comma "
+            "separated list\n"
+            "                        of CMD[:WEIGHT] where CMD is tur, "
+            "read, write,\n"
+            "                        verify, atomic or wsync (def: read)\n"
+            "    --percentiles=PL|-p PL    comma separated latency "
+            "percentiles to\n"
+            "                              output (def: "
+            "50,90,99,99.9,99.99)\n",
+            DEF_BLOCKS, DEF_DURATION);
+    pr2serr("    --qd=QD|-q QD      commands in flight per thread (def: "
+            "%d)\n"
+            "    --qd-sweep=QL|-W QL    run once for each queue depth in "
+            "the comma\n"
+            "                           separated list QL, then "
+            "summarize\n"
+            "    --queue=head|tail|-Q head|tail    queue commands at the "
+            "head or\n"
+            "                                      tail (def: as the "
+            "driver does)\n"
+            "    --range=LBA[,NUM]|-r LBA[,NUM]    random addresses taken "
+            "from LBA\n"
+            "                                      to LBA+NUM-1 (def: whole "
+            "device)\n"
+            "    --seed=SEED|-s SEED    seed for the random addresses and "
+            "mix\n"
+            "    --share|-S         threads on the same DEVICE share one "
+            "file\n"
+            "                       descriptor (def: one per thread)\n"
+            "    --sweep=TL|-w TL    run once for each thread count in the "
+            "comma\n"
+            "                        separated list TL, then summarize\n"
+            "    --threads=NT|-t NT    number of threads, shared round "
+            "robin\n"
+            "                          between DEVICEs (def: 1)\n"
+            "    --timeout=TO|-T TO    command timeout in seconds (def: "
+            "%d)\n"
+            "    --verbose|-v       increase verbosity, once: latency "
+            "histograms\n"
+            "    --version|-V       print version string then exit\n\n"
+            "Sends a mix of SCSI commands to DEVICE for a period, keeping QD "
+            "of them in\nflight from each thread, then reports IOPS, "
+            "throughput and latency\npercentiles for each command. atomic "
+            "is WRITE ATOMIC(16), wsync is WRITE\nthen SYNCHRONIZE CACHE of "
+            "the same blocks timed as one.\n",
+            DEF_QD, DEF_PT_TIMEOUT);
+}
+
+static void
+sig_handler(int sig)
+{
+    got_signal = sig;
+}
+
+static uint64_t
+bench_rand(uint64_t * statep)
+{
+    uint64_t x = *statep;
+
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *statep = x;
+    return x;
+}
+
+static void
+lat_add(struct sg_pt_lat_hist * hp, uint64_t lat_ns)
+{
+    if ((0 == hp->count) || (lat_ns < hp->min_ns))
+        hp->min_ns = lat_ns;
+    if (lat_ns > hp->max_ns)
+        hp->max_ns = lat_ns;
+    ++hp->count;
+    hp->sum_ns += lat_ns;
+    ++hp->bucket[sg_pt_lat_bucket_idx(lat_ns)];
+}
+
+static void
+lat_merge(struct sg_pt_lat_hist * hp, const struct sg_pt_lat_hist * h2p)
+{
+    int k;
+
+    if (0 == h2p->count)
+        return;
+    if ((0 == hp->count) || (h2p->min_ns < hp->min_ns))
+        hp->min_ns = h2p->min_ns;
+    if (h2p->max_ns > hp->max_ns)
+        hp->max_ns = h2p->max_ns;
+    hp->count += h2p->count;
+    hp->sum_ns += h2p->sum_ns;
+    for (k = 0; k < SG_PT_LAT_NUM_BUCKETS; ++k)
+        hp->bucket[k] += h2p->bucket[k];
+}
+
+/* Parses MIX (e.g. "read:70,write:30") into op->weight[]. Returns 0 or
+ * SG_LIB_SYNTAX_ERROR. */
+static int
+parse_mix(const char * arg, struct opts_t * op)
+{
+    int k, n, w, len;
+    const char * cp;
+    const char * ccp;
+
+    memset(op->weight, 0, sizeof(op->weight));
+    for (cp = arg; cp && *cp; cp = ccp ? (ccp + 1) : NULL) {
+        ccp = strchr(cp, ',');
+        len = ccp ? (int)(ccp - cp) : (int)strlen(cp);
+        for (n = 0; (n < len) && (':' != cp[n]); ++n)
+            ;
+        for (k = 0; k < BK_NUM; ++k) {
+            if ((n == (int)strlen(bk_name[k])) &&
+                (0 == strncmp(cp, bk_name[k], n)))
+                break;
+        }
+        if (k >= BK_NUM) {
+            pr2serr("--mix= expects tur, read, write, verify, atomic or "
+                    "wsync, not '%.*s'\n", n, cp);
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        w = 1;
+        if (n < len) {
+            w = sg_get_num_nomult(cp + n + 1);
+            if ((w < 0) || (w > 1000000)) {
+                pr2serr("--mix= weight of %s should be 0 to 1000000\n",
+                        bk_name[k]);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+        }
+        op->weight[k] += w;
+    }
+    for (k = 0, op->weight_sum = 0; k < BK_NUM; ++k)
+        op->weight_sum += op->weight[k];
+    if (op->weight_sum < 1) {
+        pr2serr("--mix= needs at least one command with a weight\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    return 0;
+}
+
+static int
+parse_pcts(const char * arg, struct opts_t * op)
+{
+    int n;
+    double d;
+    const char * cp;
+    char * endp;
+
+    for (n = 0, cp = arg; *cp; ++n) {
+        if (n >= MAX_PCTS) {
+            pr2serr("--percentiles= takes up to %d values\n", MAX_PCTS);
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        d = strtod(cp, &endp);
+        if ((endp == cp) || (d <= 0.0) || (d > 100.0) ||
+            ((',' != *endp) && ('\0' != *endp))) {
+            pr2serr("--percentiles= expects values from 0 (exclusive) to "
+                    "100\n");
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        op->pct[n] = d;
+        cp = (',' == *endp) ? (endp + 1) : endp;
+    }
+    op->num_pcts = n;
+    return 0;
+}
+
+/* Parses the comma separated list of a --sweep= or --qd-sweep= (named
+ * oname) whose values are from 1 to max. */
+static int
+parse_sweep(const char * arg, const char * oname, int max,
+            struct opts_t * op)
+{
+    int n, v;
+    const char * cp;
+
+    for (n = 0, cp = arg; cp; ++n) {
+        if (n >= MAX_SWEEP) {
+            pr2serr("%s takes up to %d values\n", oname, MAX_SWEEP);
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        v = sg_get_num_nomult(cp);
+        if ((v < 1) || (v > max)) {
+            pr2serr("%s expects values from 1 to %d\n", oname, max);
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        op->sweep[n] = v;
+        cp = strchr(cp, ',');
+        if (cp)
+            ++cp;
+    }
+    op->num_sweep = n;
+    return 0;
+}
+
+static int
+parse_cmd_line(struct opts_t * op, int argc, char * argv[])
+{
+    int c, n;
+    int64_t ll;
+    const char * cp;
+
+    while (1) {
+        int option_index = 0;
+
+        c = getopt_long(argc, argv, "^Aa:b:c:d:fhj::J:m:p:q:Q:r:s:St:T:vVw:W:",
+                        long_options, &option_index);
+        if (c == -1)
+            break;
+
+        switch (c) {
+        case 'A':
+            op->adaptive = true;
+            break;
+        case 'a':
+            n = sg_get_num(optarg);
+            if (n < 1) {
+                pr2serr("--align= expects a positive number of blocks\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            op->align = n;
+            break;
+        case 'b':
+            n = sg_get_num(optarg);
+            if ((n < 1) || (n > 0xffff)) {
+                pr2serr("--blocks= expects 1 to 65535\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            op->num_blks = n;
+            break;
+        case 'c':
+            n = sg_get_num(optarg);
+            if ((10 != n) && (16 != n)) {
+                pr2serr("--cdbsz= expects 10 or 16\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            op->cdbsz = n;
+            break;
+        case 'd':
+            n = sg_get_num(optarg);
+            if (n < 1) {
+                pr2serr("--duration= expects a positive number of "
+                        "seconds\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            op->duration = n;
+            break;
+        case 'f':
+            op->force = true;
+            break;
+        case 'h':
+        case '?':
+            ++op->do_help;
+            break;
+        case 'j':       /* for: -j[=JO] */
+        case '^':       /* for: --json[=JO] */
+            op->do_json = true;
+            /* Now want '=' to precede all JSON optional arguments */
+            if (optarg) {
+                if ('^' == c) {
+                    op->json_arg = optarg;
+                    break;
+                } else if ('=' == *optarg) {
+                    op->json_arg = optarg + 1;
+                    break;
+                }
+                pr2serr("-j expects its optional argument to start with "
+                        "'='\n");
+                return SG_LIB_SYNTAX_ERROR;
+            } else
+                op->json_arg = NULL;
+            break;
+        case 'J':
+            op->do_json = true;
+            op->js_file = optarg;
+            break;
+        case 'm':
+            if (parse_mix(optarg, op))
+                return SG_LIB_SYNTAX_ERROR;
+            break;
+        case 'p':
+            if (parse_pcts(optarg, op))
+                return SG_LIB_SYNTAX_ERROR;
+            break;
+        case 'q':
+            n = sg_get_num(optarg);
+            if ((n < 1) || (n > MAX_QD)) {
+                pr2serr("--qd= expects 1 to %d\n", MAX_QD);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            op->qd = n;
+            break;
+        case 'Q':
+            if (0 == strcmp(optarg, "head"))
+                op->pt_flags = SCSI_PT_FLAGS_QUEUE_AT_HEAD;
+            else if (0 == strcmp(optarg, "tail"))
+                op->pt_flags = SCSI_PT_FLAGS_QUEUE_AT_TAIL;
+            else {
+                pr2serr("--queue= expects head or tail\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case 'r':
+            ll = sg_get_llnum(optarg);
+            if (ll < 0) {
+                pr2serr("bad LBA given to --range=\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            op->lba_start = ll;
+            cp = strchr(optarg, ',');
+            if (cp) {
+                ll = sg_get_llnum(cp + 1);
+                if (ll < 1) {
+                    pr2serr("bad NUM given to --range=\n");
+                    return SG_LIB_SYNTAX_ERROR;
+                }
+                op->lba_num = ll;
+            }
+            break;
+        case 's':
+            ll = sg_get_llnum(optarg);
+            if (ll < 0) {
+                pr2serr("bad argument to --seed=\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            op->seed = (uint64_t)ll;
+            op->seed_given = true;
+            break;
+        case 'S':
+            op->share = true;
+            break;
+        case 't':
+            n = sg_get_num(optarg);
+            if ((n < 1) || (n > MAX_THREADS)) {
+                pr2serr("--threads= expects 1 to %d\n", MAX_THREADS);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            op->num_threads = n;
+            break;
+        case 'T':
+            n = sg_get_num(optarg);
+            if (n < 1) {
+                pr2serr("--timeout= expects a positive number of seconds\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            op->timeout = n;
+            break;
+        case 'v':
+            op->verbose_given = true;
+            ++op->verbose;
+            break;
+        case 'V':
+            op->version_given = true;
+            break;
+        case 'w':
+        case 'W':
+            if (op->num_sweep > 0) {
+                pr2serr("only one of --sweep= and --qd-sweep= please\n");
+                return SG_LIB_CONTRADICT;
+            }
+            op->sweep_qd = ('W' == c);
+            cp = op->sweep_qd ? "--qd-sweep=" : "--sweep=";
+            if (parse_sweep(optarg, cp, op->sweep_qd ? MAX_QD :
+                                                       MAX_THREADS, op))
+                return SG_LIB_SYNTAX_ERROR;
+            break;
+        default:
+            pr2serr("unrecognised option code 0x%x ??\n", c);
+            return SG_LIB_SYNTAX_ERROR;
+        }
+    }
+    while (optind < argc) {
+        if (op->num_devs >= MAX_DEVICES) {
+            pr2serr("too many DEVICEs, the maximum is %d\n", MAX_DEVICES);
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        op->dev_names[op->num_devs++] = argv[optind++];
+    }
+    return 0;
+}
+
+static int
+lcm_blks(int a, uint32_t b)
+{
+    uint32_t x = (uint32_t)a;
+    uint32_t y = b;
+    uint32_t t;
+
+    while (y) {
+        t = x % y;
+        x = y;
+        y = t;
+    }
+    return (int)(((uint64_t)a / x) * b);
+}
+
+/* Fetches the atomic write limits from the Block Limits VPD page of fd
+ * into dp and checks --blocks= against them. Returns 0 or an exit status.
+ */
+static int
+get_atomic_limits(int fd, struct dev_t * dp, const struct opts_t * op)
+{
+    int res, resid;
+    uint8_t b[VPD_BLOCK_LIMITS_LEN];
+
+    memset(b, 0, sizeof(b));
+    res = sg_ll_inquiry_v2(fd, true, VPD_BLOCK_LIMITS, b, sizeof(b), 0,
+                           &resid, op->verbose > 0, op->verbose);
+    if (0 == res) {
+        if ((VPD_BLOCK_LIMITS != b[1]) ||
+            (sg_get_unaligned_be16(b + 2) < 0x3c) ||
+            ((int)sizeof(b) - resid < 56))
+            res = SG_LIB_CAT_MALFORMED;
+    }
+    if (res) {
+        pr2serr("%s: unable to fetch Block Limits VPD page, needed for "
+                "atomic\n", dp->name);
+        return res;
+    }
+    dp->atomic_max = sg_get_unaligned_be32(b + 44);
+    dp->atomic_align = sg_get_unaligned_be32(b + 48);
+    dp->atomic_gran = sg_get_unaligned_be32(b + 52);
+    if (0 == dp->atomic_max) {
+        pr2serr("%s: does not report atomic writes (maximum atomic "
+                "transfer length is 0)\n", dp->name);
+        return SG_LIB_CAT_INVALID_OP;
+    }
+    if ((uint32_t)op->num_blks > dp->atomic_max) {
+        pr2serr("%s: --blocks= exceeds the maximum atomic transfer length "
+                "of %u blocks\n", dp->name, dp->atomic_max);
+        return SG_LIB_CONTRADICT;
+    }
+    if ((dp->atomic_gran > 1) && (op->num_blks % dp->atomic_gran)) {
+        pr2serr("%s: --blocks= is not a multiple of the atomic transfer "
+                "length granularity of %u blocks\n", dp->name,
+                dp->atomic_gran);
+        return SG_LIB_CONTRADICT;
+    }
+    return 0;
+}
+
+/* Opens DEVICE for thread tp: each thread has its own file descriptor
+ * unless --share is given, then the first thread on a DEVICE opens it and
+ * the others use that file descriptor. When dp is being used for the first
+ * time its interface, capacity and cdb templates are found. Returns 0 or
+ * an exit status. */
+static int
+open_dev(struct thr_t * tp, struct dev_t * dp, const struct opts_t * op)
+{
+    bool first = (NULL == dp->iface);
+    int fd, res, k, ver, cdbsz;
+    int vb = op->verbose;
+
+    if (dp->fd >= 0) {
+        tp->fd = dp->fd;
+        return 0;
+    }
+    fd = sg_cmds_open_flags(dp->name, O_RDWR | O_NONBLOCK, vb);
+    if (fd < 0) {
+        pr2serr("error opening file: %s: %s\n", dp->name,
+                safe_strerror(-fd));
+        return sg_convert_errno(-fd);
+    }
+    tp->fd = fd;
+    if (op->share)
+        dp->fd = fd;
+    if (! first)
+        return 0;
+    switch (check_pt_file_handle(fd, dp->name, vb)) {
+    case 1:
+        dp->is_async = true;
+        if ((ioctl(fd, SG_GET_VERSION_NUM, &ver) >= 0) && (ver >= 40000))
+            dp->iface = "sg v4";
+        else
+            dp->iface = "sg v3";
+        break;
+    case 2:
+        dp->iface = "bsg";
+        break;
+    case 3:
+        dp->iface = "nvme generic";
+        break;
+    case 4:
+        dp->iface = "nvme block";
+        break;
+    default:
+        dp->iface = "other";
+        break;
+    }
+    if (op->weight[BK_TUR] == op->weight_sum)
+        return 0;       /* TUR only: neither capacity nor cdbs needed */
+    res = sg_dde_read_capacity(fd, &dp->num_blks, &dp->blk_sz, true, vb);
+    if (res) {
+        pr2serr("%s: unable to find capacity\n", dp->name);
+        return res;
+    }
+    if (op->lba_start >= dp->num_blks) {
+        pr2serr("%s: --range= LBA beyond capacity of %" PRId64 " blocks\n",
+                dp->name, dp->num_blks);
+        return SG_LIB_LBA_OUT_OF_RANGE;
+    }
+    dp->lba_num = op->lba_num ? op->lba_num :
+                                (dp->num_blks - op->lba_start);
+    if ((op->lba_start + dp->lba_num) > dp->num_blks) {
+        pr2serr("%s: --range= exceeds capacity of %" PRId64 " blocks\n",
+                dp->name, dp->num_blks);
+        return SG_LIB_LBA_OUT_OF_RANGE;
+    }
+    if (op->weight[BK_ATOMIC]) {
+        res = get_atomic_limits(fd, dp, op);
+        if (res)
+            return res;
+    }
+    for (k = BK_READ; k < BK_NUM; ++k) {
+        int64_t end = op->lba_start + dp->lba_num - op->num_blks;
+
+        dp->align[k] = op->align;
+        if ((BK_ATOMIC == k) && (dp->atomic_align > 1))
+            dp->align[k] = lcm_blks(op->align, dp->atomic_align);
+        dp->first_lba[k] = ((op->lba_start + dp->align[k] - 1) /
+                            dp->align[k]) * dp->align[k];
+        dp->num_pos[k] = (end >= dp->first_lba[k]) ?
+                         (((end - dp->first_lba[k]) / dp->align[k]) + 1) : 0;
+        if (op->weight[k] && (dp->num_pos[k] < 1)) {
+            pr2serr("%s: no %s of --blocks= fits in --range= at an "
+                    "alignment of %d\n", dp->name, bk_name[k],
+                    dp->align[k]);
+            return SG_LIB_CONTRADICT;
+        }
+    }
+    cdbsz = op->cdbsz;
+    if (0 == cdbsz)
+        cdbsz = ((op->lba_start + dp->lba_num) > UINT32_MAX) ? 16 : 10;
+    for (k = BK_READ; k < BK_NUM; ++k) {
+        if (sg_dde_cdb_tmpl_init(dp->tmpl + k,
+                                 (BK_ATOMIC == k) ? 16 : cdbsz,
+                                 (BK_READ != k), false, false,
+                                 MY_NAME ": "))
+            return SG_LIB_SYNTAX_ERROR;
+    }
+    /* VERIFY and SYNCHRONIZE CACHE have the same LBA and length fields as
+     * WRITE, BYTCHK=0 and IMMED=0 respectively. So does WRITE ATOMIC(16)
+     * with an ATOMIC BOUNDARY of 0 since its TRANSFER LENGTH is the lower
+     * two bytes of that of WRITE(16) and --blocks= is below 65536. */
+    dp->tmpl[BK_VERIFY].cdb[0] = (10 == cdbsz) ? VERIFY10 : VERIFY16;
+    dp->tmpl[BK_WSYNC].cdb[0] = (10 == cdbsz) ? SYNC_CACHE10 : SYNC_CACHE16;
+    dp->tmpl[BK_ATOMIC].cdb[0] = WRITE_ATOMIC16;
+    return 0;
+}
+
+/* Picks a command from the mix then starts it in *sp. Returns 0, -EAGAIN
+ * or -EBUSY if the device queue is full, else an exit status. */
+static int
+start_cmd(struct thr_t * tp, struct slot_t * sp)
+{
+    int k, w, res, len;
+    int64_t lba;
+    const struct opts_t * op = tp->op;
+    struct dev_t * dp = tp->dp;
+    const struct sg_dde_cdb_tmpl * tmplp;
+
+    w = (int)(bench_rand(&tp->rnd) % (uint64_t)op->weight_sum);
+    for (k = 0; k < (BK_NUM - 1); ++k) {
+        if (w < op->weight[k])
+            break;
+        w -= op->weight[k];
+    }
+    sp->kind = k;
+    sp->synced = false;
+    clear_scsi_pt_obj(sp->mc.ptp);
+    if (op->pt_flags)
+        set_scsi_pt_flags(sp->mc.ptp, op->pt_flags);
+    if (BK_TUR == k) {
+        memset(sp->cdb, 0, 6);
+        set_scsi_pt_cdb(sp->mc.ptp, sp->cdb, 6);
+    } else {
+        lba = dp->first_lba[k] + dp->align[k] *
+              (int64_t)(bench_rand(&tp->rnd) % (uint64_t)dp->num_pos[k]);
+        sp->lba = lba;
+        tmplp = dp->tmpl + ((BK_WSYNC == k) ? BK_WRITE : k);
+        if (sg_dde_cdb_tmpl_fill(tmplp, sp->cdb, op->num_blks, lba))
+            return SG_LIB_LBA_OUT_OF_RANGE;
+        set_scsi_pt_cdb(sp->mc.ptp, sp->cdb, tmplp->cdb_sz);
+        len = op->num_blks * dp->blk_sz;
+        if (BK_READ == k)
+            set_scsi_pt_data_in(sp->mc.ptp, sp->buf, len);
+        else if (BK_VERIFY != k)
+            set_scsi_pt_data_out(sp->mc.ptp, sp->buf, len);
+    }
+    set_scsi_pt_sense(sp->mc.ptp, sp->sense, sizeof(sp->sense));
+    sp->busy = true;
+    sp->t0_ns = sg_get_mono_ns();
+    res = sg_mux_submit(tp->mxp, &sp->mc);
+    if (0 == res)
+        return 0;
+    sp->busy = false;
+    if ((-EAGAIN == res) || (-EBUSY == res))
+        return res;
+    pr2serr("%s: submit of %s failed: %s\n", dp->name, bk_cmd_name[k],
+            (res < 0) ? safe_strerror(-res) : "pass-through error");
+    return (res < 0) ? sg_convert_errno(-res) : SG_LIB_CAT_OTHER;
+}
+
+/* Starts the SYNCHRONIZE CACHE of a BK_WSYNC whose WRITE is done, covering
+ * the same blocks. Returns the sg_mux_submit() value. */
+static int
+start_sync(struct thr_t * tp, struct slot_t * sp)
+{
+    const struct dev_t * dp = tp->dp;
+
+    clear_scsi_pt_obj(sp->mc.ptp);
+    if (tp->op->pt_flags)
+        set_scsi_pt_flags(sp->mc.ptp, tp->op->pt_flags);
+    sg_dde_cdb_tmpl_fill(dp->tmpl + BK_WSYNC, sp->cdb, tp->op->num_blks,
+                         sp->lba);
+    set_scsi_pt_cdb(sp->mc.ptp, sp->cdb, dp->tmpl[BK_WSYNC].cdb_sz);
+    set_scsi_pt_sense(sp->mc.ptp, sp->sense, sizeof(sp->sense));
+    sp->synced = true;
+    return sg_mux_submit(tp->mxp, &sp->mc);
+}
+
+/* sg_mux done() callback: the response of the slot's command is in. A
+ * failed command is counted, it does not stop the run. The latency of a
+ * BK_WSYNC runs from the submission of its WRITE to the response of its
+ * SYNCHRONIZE CACHE. */
+static void
+cmd_done(struct sg_mux_cmd * mcp, void * ctx)
+{
+    bool bad;
+    int res, sense_cat;
+    struct slot_t * sp = (struct slot_t *)ctx;
+    struct thr_t * tp = sp->tp;
+    const struct opts_t * op = tp->op;
+    const char * cp;
+
+    cp = ((BK_WSYNC == sp->kind) && (! sp->synced)) ? bk_cmd_name[BK_WRITE]
+                                                     : bk_cmd_name[sp->kind];
+    res = sg_cmds_process_resp(mcp->ptp, cp, mcp->res, op->verbose > 0,
+                               op->verbose, &sense_cat);
+    bad = (-1 == res) || ((-2 == res) &&
+                          (SG_LIB_CAT_RECOVERED != sense_cat) &&
+                          (SG_LIB_CAT_NO_SENSE != sense_cat));
+    if ((BK_WSYNC == sp->kind) && (! sp->synced) && (! bad)) {
+        res = start_sync(tp, sp);
+        if (0 == res)
+            return;             /* done() is called again for the sync */
+        pr2serr("%s: submit of %s failed: %s\n", tp->dp->name,
+                bk_cmd_name[BK_WSYNC], (res < 0) ? safe_strerror(-res) :
+                                                   "pass-through error");
+        bad = true;
+    }
+    lat_add(tp->lat + sp->kind, sg_get_mono_ns() - sp->t0_ns);
+    sp->busy = false;
+    if (bad)
+        ++tp->errs[sp->kind];
+}
+
+/* Keeps every idle slot busy until the end of the run, then waits for
+ * the commands still in flight. */
+static void *
+bench_thread(void * v_tp)
+{
+    bool full, stop;
+    int k, res, ms;
+    uint64_t now;
+    struct thr_t * tp = (struct thr_t *)v_tp;
+    const struct opts_t * op = tp->op;
+    struct slot_t * sp;
+
+    while (true) {
+        now = sg_get_mono_ns();
+        stop = (now >= tp->end_ns) || got_signal || tp->ret;
+        full = false;
+        for (k = 0; (k < op->qd) && (! stop) && (! full); ++k) {
+            sp = tp->slots + k;
+            if (sp->busy)
+                continue;
+            res = start_cmd(tp, sp);
+            if (-EAGAIN == res) {
+                ++tp->submit_eagain;
+                full = true;
+            } else if (-EBUSY == res) {
+                ++tp->submit_ebusy;
+                full = true;
+            } else if (res) {
+                tp->ret = res;
+                stop = true;
+            }
+        }
+        if (0 == sg_mux_in_flight(tp->mxp)) {
+            if (stop)
+                break;
+            if (full)
+                usleep(100);    /* queue full yet nothing of ours in it */
+            continue;
+        }
+        ms = (int)((tp->end_ns > now) ? ((tp->end_ns - now) / 1000000) : 0);
+        ms = (ms > WAIT_MAX_MS) ? WAIT_MAX_MS : ((ms < 1) ? 1 : ms);
+        res = sg_mux_run(tp->mxp, stop ? WAIT_MAX_MS : ms);
+        if (res < 0) {
+            pr2serr("%s: waiting for responses: %s\n", tp->dp->name,
+                    safe_strerror(-res));
+            if (0 == tp->ret)
+                tp->ret = sg_convert_errno(-res);
+            break;      /* abandons commands in flight */
+        }
+    }
+    if (op->adaptive)
+        sg_mux_get_aimd_stats(tp->mxp, tp->fd, &tp->aimd);
+    return NULL;
+}
+
+/* Outputs the results of kind k (or all kinds when k is BK_NUM) taken
+ * over secs seconds from *hp, errs failed commands among them. */
+static void
+report_kind(int k, const struct sg_pt_lat_hist * hp, uint64_t errs,
+            double secs, int blk_sz, const struct opts_t * op,
+            sgj_opaque_p jap)
+{
+    int j;
+    uint64_t cnt = hp->count;
+    double iops, mbps;
+    const char * cp = (k < BK_NUM) ? bk_name[k] : "total";
+    sgj_state * jsp = (sgj_state *)&op->json_st;
+    sgj_opaque_p jop, ja2p, jo2p;
+    char b[400];
+    static const int blen = sizeof(b);
+
+    iops = (secs > 0.0) ? (cnt / secs) : 0.0;
+    mbps = ((BK_TUR != k) && (BK_VERIFY != k) && (BK_NUM != k)) ?
+           ((iops * op->num_blks * blk_sz) / 1000000.0) : 0.0;
+    sgj_pr_hr(jsp, "  %-6s: %" PRIu64 " commands, %.1f IOPS", cp, cnt,
+              iops);
+    if (mbps > 0.0)
+        sgj_pr_hr(jsp, ", %.2f MB/s", mbps);
+    sgj_pr_hr(jsp, ", %" PRIu64 " errors\n", errs);
+    jop = sgj_new_unattached_object_r(jsp);
+    sgj_js_nv_s(jsp, jop, "command", cp);
+    sgj_js_nv_i(jsp, jop, "count", cnt);
+    sgj_js_nv_i(jsp, jop, "errors", errs);
+    sgj_js_nv_i(jsp, jop, "iops", (int64_t)(iops + 0.5));
+    if (mbps > 0.0)
+        sgj_js_nv_i(jsp, jop, "kb_per_second",
+                    (int64_t)((mbps * 1000.0) + 0.5));
+    if (cnt > 0) {
+        sgj_pr_hr(jsp, "          latency (us) min/avg/max: "
+                  "%.1f/%.1f/%.1f\n", hp->min_ns / 1000.0,
+                  (hp->sum_ns / (double)cnt) / 1000.0, hp->max_ns / 1000.0);
+        sgj_js_nv_i(jsp, jop, "latency_min_ns", hp->min_ns);
+        sgj_js_nv_i(jsp, jop, "latency_mean_ns", hp->sum_ns / cnt);
+        sgj_js_nv_i(jsp, jop, "latency_max_ns", hp->max_ns);
+        ja2p = sgj_named_subarray_r(jsp, jop, "latency_percentile_list");
+        b[0] = '\0';
+        for (j = 0; j < op->num_pcts; ++j) {
+            uint64_t ns = sg_pt_lat_percentile(hp, op->pct[j]);
+
+            sg_scn3pr(b, blen, strlen(b), " p%g=%.1f", op->pct[j],
+                      ns / 1000.0);
+            if (jsp->pr_as_json) {
+                jo2p = sgj_new_unattached_object_r(jsp);
+                snprintf(b + blen - 32, 32, "%g", op->pct[j]);
+                sgj_js_nv_s(jsp, jo2p, "percentile", b + blen - 32);
+                sgj_js_nv_i(jsp, jo2p, "latency_ns", ns);
+                sgj_js_nv_o(jsp, ja2p, NULL /* name */, jo2p);
+            }
+        }
+        sgj_pr_hr(jsp, "          latency (us)%s\n", b);
+        if (op->verbose && (k < BK_NUM)) {
+            for (j = 0; j < SG_PT_LAT_NUM_BUCKETS; ++j) {
+                if (0 == hp->bucket[j])
+                    continue;
+                if (j < (SG_PT_LAT_NUM_BUCKETS - 1))
+                    sgj_pr_hr(jsp, "          %10.1f to %10.1f us: %10"
+                              PRIu64 " (%5.2f%%)\n",
+                              sg_pt_lat_bucket_ns(j) / 1000.0,
+                              sg_pt_lat_bucket_ns(j + 1) / 1000.0,
+                              hp->bucket[j], (100.0 * hp->bucket[j]) / cnt);
+                else
+                    sgj_pr_hr(jsp, "          %10.1f us or more   : %10"
+                              PRIu64 " (%5.2f%%)\n",
+                              sg_pt_lat_bucket_ns(j) / 1000.0,
+                              hp->bucket[j], (100.0 * hp->bucket[j]) / cnt);
+            }
+        }
+        if (k < BK_NUM)
+            sgj_js_pt_lat(jsp, jop, hp, 1);
+    }
+    sgj_js_nv_o(jsp, jap, NULL /* name */, jop);
+}
+
+/* Outputs the results of a run that took secs seconds; *ru0p is the
+ * resource usage before it. Places a summary in *srp. */
+static void
+report(struct thr_t * thr_arr, struct dev_t * dev_arr, double secs,
+       const struct rusage * ru0p, const struct opts_t * op,
+       sgj_opaque_p jop, struct sweep_res * srp)
+{
+    int k, j, blk_sz;
+    uint64_t errs, tot_errs;
+    sgj_state * jsp = (sgj_state *)&op->json_st;
+    sgj_opaque_p jap, jo2p;
+    struct sg_pt_lat_hist * totp = &srp->tot;
+    struct sg_pt_lat_hist h;
+    struct rusage ru;
+
+    sgj_pr_hr(jsp, "%s: %d thread%s on %d device%s, queue depth %s%d per "
+              "thread, %s, %.2f seconds\n", MY_NAME, op->num_threads,
+              (1 == op->num_threads) ? "" : "s", op->num_devs,
+              (1 == op->num_devs) ? "" : "s",
+              op->adaptive ? "adaptive up to " : "", op->qd,
+              op->share ? "shared fd" : "fd per thread", secs);
+    if (op->pt_flags)
+        sgj_pr_hr(jsp, "  commands queued at the %s\n",
+                  (SCSI_PT_FLAGS_QUEUE_AT_HEAD == op->pt_flags) ? "head" :
+                                                                  "tail");
+    sgj_js_nv_i(jsp, jop, "threads", op->num_threads);
+    sgj_js_nv_b(jsp, jop, "shared_fd", op->share);
+    sgj_js_nv_s(jsp, jop, "queue_at",
+                (SCSI_PT_FLAGS_QUEUE_AT_HEAD == op->pt_flags) ? "head" :
+                ((SCSI_PT_FLAGS_QUEUE_AT_TAIL == op->pt_flags) ? "tail" :
+                                                                 "default"));
+    sgj_js_nv_i(jsp, jop, "file_descriptors", srp->num_fds);
+    sgj_js_nv_i(jsp, jop, "queue_depth", op->qd);
+    sgj_js_nv_b(jsp, jop, "adaptive", op->adaptive);
+    sgj_js_nv_i(jsp, jop, "blocks_per_command", op->num_blks);
+    sgj_js_nv_i(jsp, jop, "lba_alignment", op->align);
+    sgj_js_nv_i(jsp, jop, "elapsed_ms", (int64_t)(secs * 1000.0));
+    sgj_js_nv_i(jsp, jop, "seed", (int64_t)op->seed);
+    jap = sgj_named_subarray_r(jsp, jop, "device_list");
+    for (k = 0, blk_sz = 0; k < op->num_devs; ++k) {
+        struct dev_t * dp = dev_arr + k;
+
+        if (dp->blk_sz > 0) {
+            sgj_pr_hr(jsp, "  %s: %s, %d byte blocks, %" PRId64 " blocks\n",
+                      dp->name, dp->iface, dp->blk_sz, dp->num_blks);
+            if (0 == blk_sz)
+                blk_sz = dp->blk_sz;
+        } else
+            sgj_pr_hr(jsp, "  %s: %s\n", dp->name, dp->iface);
+        jo2p = sgj_new_unattached_object_r(jsp);
+        sgj_js_nv_s(jsp, jo2p, "device_name", dp->name);
+        sgj_js_nv_s(jsp, jo2p, "interface", dp->iface);
+        sgj_js_nv_b(jsp, jo2p, "asynchronous", dp->is_async);
+        sgj_js_nv_i(jsp, jo2p, "block_size", dp->blk_sz);
+        sgj_js_nv_i(jsp, jo2p, "number_of_blocks", dp->num_blks);
+        if (op->weight[BK_ATOMIC]) {
+            sgj_pr_hr(jsp, "    atomic writes: maximum %u blocks, "
+                      "alignment %u, granularity %u; LBAs aligned to "
+                      "%d\n", dp->atomic_max, dp->atomic_align,
+                      dp->atomic_gran, dp->align[BK_ATOMIC]);
+            sgj_js_nv_i(jsp, jo2p, "maximum_atomic_transfer_length",
+                        dp->atomic_max);
+            sgj_js_nv_i(jsp, jo2p, "atomic_alignment", dp->atomic_align);
+            sgj_js_nv_i(jsp, jo2p, "atomic_transfer_length_granularity",
+                        dp->atomic_gran);
+            sgj_js_nv_i(jsp, jo2p, "atomic_lba_alignment",
+                        dp->align[BK_ATOMIC]);
+        }
+        sgj_js_nv_o(jsp, jap, NULL /* name */, jo2p);
+    }
+    memset(totp, 0, sizeof(*totp));
+    jap = sgj_named_subarray_r(jsp, jop, "command_list");
+    for (k = 0, tot_errs = 0; k < BK_NUM; ++k) {
+        if (0 == op->weight[k])
+            continue;
+        memset(&h, 0, sizeof(h));
+        for (j = 0, errs = 0; j < op->num_threads; ++j) {
+            lat_merge(&h, thr_arr[j].lat + k);
+            errs += thr_arr[j].errs[k];
+        }
+        h.opcode = (BK_TUR == k) ? 0 :
+                   dev_arr[0].tmpl[(BK_WSYNC == k) ? BK_WRITE : k].cdb[0];
+        report_kind(k, &h, errs, secs, blk_sz, op, jap);
+        lat_merge(totp, &h);
+        tot_errs += errs;
+    }
+    if (op->weight[BK_TUR] < op->weight_sum)
+        report_kind(BK_NUM, totp, tot_errs, secs, blk_sz, op, jap);
+    srp->errs = tot_errs;
+    srp->secs = secs;
+    for (j = 0, errs = 0, tot_errs = 0; j < op->num_threads; ++j) {
+        errs += thr_arr[j].submit_eagain;
+        tot_errs += thr_arr[j].submit_ebusy;
+    }
+    sgj_pr_hr(jsp, "  queue full at submit: EAGAIN %" PRIu64 ", EBUSY %"
+              PRIu64 "\n", errs, tot_errs);
+    sgj_js_nv_i(jsp, jop, "submit_eagain_count", errs);
+    sgj_js_nv_i(jsp, jop, "submit_ebusy_count", tot_errs);
+    if (op->adaptive) {
+        jap = sgj_named_subarray_r(jsp, jop, "adaptive_window_list");
+        for (j = 0; j < op->num_threads; ++j) {
+            const struct sg_mux_aimd_stats * ap = &thr_arr[j].aimd;
+
+            sgj_pr_hr(jsp, "  thread %d window: %d of %d, lowest latency "
+                      "%" PRId64 " us, smoothed %" PRId64 " us\n", j,
+                      ap->win, op->qd, ap->min_lat_us, ap->srtt_us);
+            sgj_pr_hr(jsp, "    grew %" PRIu64 " times, shrank %" PRIu64
+                      " times; BUSY or TASK SET FULL: %" PRIu64 "\n",
+                      ap->num_inc, ap->num_dec, ap->num_busy);
+            jo2p = sgj_new_unattached_object_r(jsp);
+            sgj_js_nv_i(jsp, jo2p, "thread", j);
+            sgj_js_nv_i(jsp, jo2p, "window", ap->win);
+            sgj_js_nv_i(jsp, jo2p, "host", ap->host);
+            sgj_js_nv_i(jsp, jo2p, "latency_min_us", ap->min_lat_us);
+            sgj_js_nv_i(jsp, jo2p, "latency_smoothed_us", ap->srtt_us);
+            sgj_js_nv_i(jsp, jo2p, "increase_count", ap->num_inc);
+            sgj_js_nv_i(jsp, jo2p, "decrease_count", ap->num_dec);
+            sgj_js_nv_i(jsp, jo2p, "busy_count", ap->num_busy);
+            sgj_js_nv_o(jsp, jap, NULL /* name */, jo2p);
+        }
+    }
+    if (0 == getrusage(RUSAGE_SELF, &ru)) {
+        double u = (ru.ru_utime.tv_sec - ru0p->ru_utime.tv_sec) +
+                   ((ru.ru_utime.tv_usec - ru0p->ru_utime.tv_usec) /
+                    1000000.0);
+        double s = (ru.ru_stime.tv_sec - ru0p->ru_stime.tv_sec) +
+                   ((ru.ru_stime.tv_usec - ru0p->ru_stime.tv_usec) /
+                    1000000.0);
+
+        ru.ru_nvcsw -= ru0p->ru_nvcsw;
+        ru.ru_nivcsw -= ru0p->ru_nivcsw;
+        sgj_pr_hr(jsp, "  CPU: user %.3f s, system %.3f s; context "
+                  "switches: %ld voluntary, %ld involuntary\n", u, s,
+                  ru.ru_nvcsw, ru.ru_nivcsw);
+        jo2p = sgj_named_subobject_r(jsp, jop, "rusage");
+        sgj_js_nv_i(jsp, jo2p, "user_us", (int64_t)(u * 1000000.0));
+        sgj_js_nv_i(jsp, jo2p, "system_us", (int64_t)(s * 1000000.0));
+        sgj_js_nv_i(jsp, jo2p, "voluntary_context_switches", ru.ru_nvcsw);
+        sgj_js_nv_i(jsp, jo2p, "involuntary_context_switches",
+                    ru.ru_nivcsw);
+    }
+}
+
+
+/* Sets up op->num_threads threads on the DEVICEs in dev_arr, runs them
+ * for the duration, reports into jop and then tears them down. Returns 0
+ * or an exit status. */
+static int
+bench_run(struct opts_t * op, struct dev_t * dev_arr, sgj_opaque_p jop,
+          struct sweep_res * srp)
+{
+    int k, j, res, len;
+    int ret = 0;
+    int num_started = 0;
+    uint64_t start_ns, end_ns;
+    struct thr_t * tp;
+    struct thr_t * thr_arr;
+    struct rusage ru0;
+
+    thr_arr = (struct thr_t *)calloc(op->num_threads, sizeof(*thr_arr));
+    if (NULL == thr_arr) {
+        pr2serr("out of memory\n");
+        return sg_convert_errno(ENOMEM);
+    }
+    for (k = 0; k < op->num_threads; ++k)
+        thr_arr[k].fd = -1;
+    srp->num_threads = op->num_threads;
+    srp->qd = op->qd;
+    srp->num_fds = 0;
+    /* open and set up everything before the clock starts */
+    for (k = 0; k < op->num_threads; ++k) {
+        tp = thr_arr + k;
+        tp->idx = k;
+        tp->op = op;
+        tp->dp = dev_arr + (k % op->num_devs);
+        tp->rnd = op->seed + (0x9e3779b97f4a7c15ULL * (k + 1));
+        if (0 == tp->rnd)
+            tp->rnd = 1;
+        res = tp->dp->fd;
+        ret = open_dev(tp, tp->dp, op);
+        if (ret)
+            goto fini;
+        if (res < 0)
+            ++srp->num_fds;
+        tp->mxp = sg_mux_new(op->verbose);
+        if (NULL == tp->mxp) {
+            res = errno;
+            pr2serr("unable to set up completion multiplexer: %s\n",
+                    safe_strerror(res));
+            ret = sg_convert_errno(res);
+            goto fini;
+        }
+        res = sg_mux_add_fd(tp->mxp, tp->fd);
+        if (res) {
+            pr2serr("%s: sg_mux_add_fd: %s\n", tp->dp->name,
+                    safe_strerror(-res));
+            ret = sg_convert_errno(-res);
+            goto fini;
+        }
+        if (op->adaptive) {
+            struct sg_mux_aimd a;
+
+            memset(&a, 0, sizeof(a));
+            a.max_dev = op->qd;
+            res = sg_mux_set_aimd(tp->mxp, &a);
+            if (res) {
+                pr2serr("sg_mux_set_aimd: %s\n", safe_strerror(-res));
+                ret = sg_convert_errno(-res);
+                goto fini;
+            }
+        }
+        tp->slots = (struct slot_t *)calloc(op->qd, sizeof(struct slot_t));
+        if (NULL == tp->slots)
+            goto nomem;
+        len = op->num_blks * tp->dp->blk_sz;
+        for (j = 0; j < op->qd; ++j) {
+            struct slot_t * sp = tp->slots + j;
+
+            sp->tp = tp;
+            sp->mc.fd = tp->fd;
+            sp->mc.timeout_secs = op->timeout;
+            sp->mc.ctx = sp;
+            sp->mc.done = cmd_done;
+            sp->mc.ptp = construct_scsi_pt_obj_with_fd(tp->fd, op->verbose);
+            if (NULL == sp->mc.ptp)
+                goto nomem;
+            if (len > 0) {
+                sp->buf = sg_memalign(len, 0, &sp->free_buf, false);
+                if (NULL == sp->buf)
+                    goto nomem;
+                memset(sp->buf, 0xa5 ^ j, len);
+            }
+        }
+    }
+    getrusage(RUSAGE_SELF, &ru0);
+    start_ns = sg_get_mono_ns();
+    end_ns = start_ns + ((uint64_t)op->duration * 1000000000);
+    for (k = 0; k < op->num_threads; ++k) {
+        tp = thr_arr + k;
+        tp->end_ns = end_ns;
+        res = pthread_create(&tp->tid, NULL, bench_thread, tp);
+        if (res) {
+            pr2serr("pthread_create: %s\n", safe_strerror(res));
+            ret = sg_convert_errno(res);
+            got_signal = SIGTERM;       /* stop those already started */
+            break;
+        }
+        ++num_started;
+    }
+    for (k = 0; k < num_started; ++k) {
+        pthread_join(thr_arr[k].tid, NULL);
+        if ((0 == ret) && thr_arr[k].ret)
+            ret = thr_arr[k].ret;
+    }
+    if (got_signal && (SIGTERM != got_signal) && op->verbose)
+        pr2serr("interrupted by signal %d, partial results\n", got_signal);
+    if (num_started == op->num_threads)
+        report(thr_arr, dev_arr, (sg_get_mono_ns() - start_ns) / 1000000000.0,
+               &ru0, op, jop, srp);
+    for (k = 0; (0 == ret) && (k < op->num_threads); ++k) {
+        for (j = 0; j < BK_NUM; ++j) {
+            if (thr_arr[k].errs[j]) {
+                ret = SG_LIB_CAT_OTHER;         /* some commands failed */
+                break;
+            }
+        }
+    }
+    goto fini;
+nomem:
+    pr2serr("out of memory\n");
+    ret = sg_convert_errno(ENOMEM);
+fini:
+    /* close before freeing buffers of any abandoned commands */
+    for (k = 0; k < op->num_threads; ++k) {
+        tp = thr_arr + k;
+        sg_mux_free(tp->mxp);
+        if ((tp->fd >= 0) && (! op->share))
+            sg_cmds_close_device(tp->fd);
+    }
+    for (k = 0; k < op->num_devs; ++k) {
+        if (dev_arr[k].fd >= 0) {
+            sg_cmds_close_device(dev_arr[k].fd);
+            dev_arr[k].fd = -1;
+        }
+    }
+    for (k = 0; k < op->num_threads; ++k) {
+        tp = thr_arr + k;
+        if (tp->slots) {
+            for (j = 0; j < op->qd; ++j) {
+                if (tp->slots[j].mc.ptp)
+                    destruct_scsi_pt_obj(tp->slots[j].mc.ptp);
+                free(tp->slots[j].free_buf);
+            }
+            free(tp->slots);
+        }
+    }
+    free(thr_arr);
+    return ret;
+}
+
+/* Outputs a line for each run of a --sweep= */
+static void
+report_sweep(const struct sweep_res * sr_arr, int num,
+             const struct opts_t * op, sgj_opaque_p jop)
+{
+    int k;
+    double iops;
+    sgj_state * jsp = (sgj_state *)&op->json_st;
+    sgj_opaque_p jap = sgj_named_subarray_r(jsp, jop, "sweep_summary_list");
+    sgj_opaque_p jo2p;
+    const struct sweep_res * srp;
+
+    sgj_pr_hr(jsp, "\nSweep summary (%s):\n", op->share ? "shared fd" :
+              "fd per thread");
+    sgj_pr_hr(jsp, "  threads  fds   qd        IOPS    mean us     p50 us"
+              "     p99 us     max us   errors\n");
+    for (k = 0; k < num; ++k) {
+        srp = sr_arr + k;
+        iops = (srp->secs > 0.0) ? (srp->tot.count / srp->secs) : 0.0;
+        sgj_pr_hr(jsp, "  %7d %4d %4d %11.1f %10.1f %10.1f %10.1f %10.1f "
+                  "%8" PRIu64 "\n", srp->num_threads, srp->num_fds, srp->qd,
+                  iops,
+                  srp->tot.count ? ((srp->tot.sum_ns /
+                                     (double)srp->tot.count) / 1000.0) : 0.0,
+                  sg_pt_lat_percentile(&srp->tot, 50.0) / 1000.0,
+                  sg_pt_lat_percentile(&srp->tot, 99.0) / 1000.0,
+                  srp->tot.max_ns / 1000.0, srp->errs);
+        jo2p = sgj_new_unattached_object_r(jsp);
+        sgj_js_nv_i(jsp, jo2p, "threads", srp->num_threads);
+        sgj_js_nv_i(jsp, jo2p, "file_descriptors", srp->num_fds);
+        sgj_js_nv_i(jsp, jo2p, "queue_depth", srp->qd);
+        sgj_js_nv_i(jsp, jo2p, "iops", (int64_t)(iops + 0.5));
+        sgj_js_nv_i(jsp, jo2p, "latency_mean_ns", srp->tot.count ?
+                    (srp->tot.sum_ns / srp->tot.count) : 0);
+        sgj_js_nv_i(jsp, jo2p, "latency_p50_ns",
+                    sg_pt_lat_percentile(&srp->tot, 50.0));
+        sgj_js_nv_i(jsp, jo2p, "latency_p99_ns",
+                    sg_pt_lat_percentile(&srp->tot, 99.0));
+        sgj_js_nv_i(jsp, jo2p, "latency_max_ns", srp->tot.max_ns);
+        sgj_js_nv_i(jsp, jo2p, "errors", srp->errs);
+        sgj_js_nv_o(jsp, jap, NULL /* name */, jo2p);
+    }
+}
+
+int
+main(int argc, char * argv[])
+{
+    int k, res;
+    int ret = 0;
+    int num_sweep = 0;
+    struct opts_t * op;
+    struct dev_t * dev_arr = NULL;
+    sgj_state * jsp;
+    sgj_opaque_p jop = NULL;
+    sgj_opaque_p jap, jo2p;
+    struct sigaction sa;
+    struct utsname uts;
+    struct opts_t opts;
+    struct sweep_res sr_arr[MAX_SWEEP];
+
+    if (getenv("SG3_UTILS_INVOCATION"))
+        sg_rep_invocation(MY_NAME, version_str, argc, argv, stderr);
+    op = &opts;
+    memset(op, 0, sizeof(opts));
+    op->align = 1;
+    op->duration = DEF_DURATION;
+    op->num_blks = DEF_BLOCKS;
+    op->num_threads = 1;
+    op->qd = DEF_QD;
+    op->timeout = DEF_PT_TIMEOUT;
+    op->weight[BK_READ] = 1;
+    op->weight_sum = 1;
+    op->num_pcts = sizeof(def_pcts) / sizeof(def_pcts[0]);
+    memcpy(op->pct, def_pcts, sizeof(def_pcts));
+    jsp = &op->json_st;
+    res = parse_cmd_line(op, argc, argv);
+    if (res)
+        return res;
+    if (op->do_help) {
+        usage();
+        return 0;
+    }
+#ifdef DEBUG
+    pr2serr("In DEBUG mode, ");
+    if (op->verbose_given && op->version_given) {
+        pr2serr("but override: '-vV' given, zero verbose and continue\n");
+        op->verbose_given = false;
+        op->version_given = false;
+        op->verbose = 0;
+    } else if (! op->verbose_given) {
+        pr2serr("set '-vv'\n");
+        op->verbose = 2;
+    } else
+        pr2serr("keep verbose=%d\n", op->verbose);
+#else
+    if (op->verbose_given && op->version_given)
+        pr2serr("Not in DEBUG mode, so '-vV' has no special action\n");
+#endif
+    if (op->version_given) {
+        pr2serr("version: %s\n", version_str);
+        return 0;
+    }
+    if (0 == op->num_devs) {
+        pr2serr("missing DEVICE name\n\n");
+        usage();
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if ((op->weight[BK_WRITE] || op->weight[BK_ATOMIC] ||
+         op->weight[BK_WSYNC]) && (! op->force)) {
+        pr2serr("--mix= contains write, atomic or wsync which overwrite "
+                "data on DEVICE, add --force\n");
+        return SG_LIB_CONTRADICT;
+    }
+    if (op->num_threads < op->num_devs) {
+        op->num_threads = op->num_devs;
+        if (op->verbose)
+            pr2serr("using one thread per DEVICE\n");
+    }
+    if (! op->seed_given)
+        op->seed = sg_get_mono_ns() ^ ((uint64_t)getpid() << 32);
+    if (op->do_json) {
+        if (! sgj_init_state(jsp, op->json_arg)) {
+            int bad_char = jsp->first_bad_char;
+            char e[1500];
+
+            if (bad_char)
+                pr2serr("bad argument to --json= option, unrecognized "
+                        "character '%c'\n\n", bad_char);
+            sg_json_usage(0, e, sizeof(e));
+            pr2serr("%s", e);
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        jop = sgj_start_r(MY_NAME, version_str, argc, argv, jsp);
+    }
+
+    dev_arr = (struct dev_t *)calloc(op->num_devs, sizeof(*dev_arr));
+    if (NULL == dev_arr) {
+        pr2serr("out of memory\n");
+        ret = sg_convert_errno(ENOMEM);
+        goto fini;
+    }
+    for (k = 0; k < op->num_devs; ++k) {
+        dev_arr[k].name = op->dev_names[k];
+        dev_arr[k].fd = -1;
+    }
+    if (0 == uname(&uts)) {
+        sgj_pr_hr(jsp, "Linux kernel %s\n", uts.release);
+        sgj_js_nv_s(jsp, jop, "kernel_release", uts.release);
+    }
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sig_handler;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    if (0 == op->num_sweep) {
+        ret = bench_run(op, dev_arr, jop, sr_arr);
+        goto fini;
+    }
+    jap = sgj_named_subarray_r(jsp, jop, "sweep_list");
+    for (k = 0; (k < op->num_sweep) && (! got_signal); ++k) {
+        if (op->sweep_qd)
+            op->qd = op->sweep[k];
+        else {
+            op->num_threads = op->sweep[k];
+            if (op->num_threads < op->num_devs)
+                op->num_threads = op->num_devs;
+        }
+        if (k > 0)
+            sgj_pr_hr(jsp, "\n");
+        jo2p = sgj_new_unattached_object_r(jsp);
+        res = bench_run(op, dev_arr, jo2p, sr_arr + num_sweep);
+        sgj_js_nv_o(jsp, jap, NULL /* name */, jo2p);
+        if (res) {
+            if (0 == ret)
+                ret = res;
+            if (SG_LIB_CAT_OTHER != res)
+                break;          /* failed to set up or submit */
+        }
+        ++num_sweep;
+    }
+    if (num_sweep > 0)
+        report_sweep(sr_arr, num_sweep, op, jop);
+fini:
+    free(dev_arr);
+    ret = (ret >= 0) ? ret : SG_LIB_CAT_OTHER;
+    if (jsp->pr_as_json) {
+        FILE * fp = stdout;
+
+        if (op->js_file) {
+            if ((1 != strlen(op->js_file)) || ('-' != op->js_file[0])) {
+                fp = fopen(op->js_file, "w");   /* truncate if exists */
+                if (NULL == fp) {
+                    int e = errno;
+
+                    pr2serr("unable to open file: %s [%s]\n", op->js_file,
+                            safe_strerror(e));
+                    ret = sg_convert_errno(e);
+                }
+            }
+            /* '--js-file=-' will send JSON output to stdout */
+        }
+        if (fp) {
+            const char * estr = NULL;
+            char b[80];
+
+            if (sg_exit2str(ret, jsp->verbose, sizeof(b), b)) {
+                if (strlen(b) > 0)
+                    estr = b;
+            }
+            sgj_js2file_estr(jsp, NULL, ret, estr, fp);
+        }
+        if (op->js_file && fp && (stdout != fp))
+            fclose(fp);
+        sgj_finish(jsp);
+    }
+    return ret;
+}
@@ -1,5 +1,5 @@
 /* A utility program originally written for the Linux OS SCSI subsystem.
- *  Copyright (C) 2000-2023 D. Gilbert
+ *  Copyright (C) 2000-2026 D. Gilbert
  *  This program is free software; you can redistribute it and/or modify
  *  it under the terms of the GNU General Public License as published by
  *  the Free Software Foundation; either version 2, or (at your option)
@@ -24,11 +24,16 @@
 #define __STDC_FORMAT_MACROS 1
 #include <inttypes.h>
 #include <errno.h>
+#include <time.h>
+#include <signal.h>
 #include <sys/stat.h>
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
+#ifdef HAVE_GETTIMEOFDAY
+#include <sys/time.h>
+#endif
 #include "sg_lib.h"
 #include "sg_lib_names.h"
 #include "sg_cmds_basic.h"
@@ -36,11 +41,13 @@
 #include "sg_pt.h"      /* needed for scsi_pt_win32_direct() */
 #endif
 #include "sg_unaligned.h"
+#include "sg_par.h"
 #include "sg_pr2serr.h"
 
 #include "sg_logs.h"
+#include "sg_batch.h"
 
-static const char * version_str = "2.34 20230603";    /* spc6r08 + sbc5r04 */
+static const char * version_str = "2.41 20261015";    /* spc6r08 + sbc5r04 */
 
 #define MY_NAME "sg_logs"
 
@@ -51,11 +58,10 @@ const char * const rsv_s = "reserved";
 const char * const unkn_s = "unknown";
 const char * const vend_spec = "vendor specific";
 
-static uint8_t * rsp_buff;
-static uint8_t * free_rsp_buff;
-static int rsp_buff_sz = MX_ALLOC_LEN + 4;
 static const int parr_sz = 4096;
 
+#define MAX_NUM_PARALLEL 64
+
 static const char * const as_s_s = "as_string";
 static const char * const lba_sn = "logical_block_address";
 static const char * const not_avail = "not available";
@@ -80,8 +86,10 @@ static struct option long_options[] = {
     {"All", no_argument, 0, 'A'},   /* equivalent to '-aa' */
     {"ALL", no_argument, 0, 'A'},   /* equivalent to '-aa' */
     {"all", no_argument, 0, 'a'},
+    {"batch", required_argument, 0, 'B'},
     {"brief", no_argument, 0, 'b'},
     {"control", required_argument, 0, 'c'},
+    {"delta", required_argument, 0, 'd'},
     {"enumerate", no_argument, 0, 'e'},
     {"exclude", no_argument, 0, 'E'},
     {"filter", required_argument, 0, 'f'},
@@ -102,6 +110,7 @@ static struct option long_options[] = {
     {"old", no_argument, 0, 'O'},
     {"page", required_argument, 0, 'p'},
     {"paramp", required_argument, 0, 'P'},
+    {"parallel", required_argument, 0, 'o'},
     {"pcb", no_argument, 0, 'q'},
     {"ppc", no_argument, 0, 'Q'},
     {"pdt", required_argument, 0, 'D'},
@@ -116,6 +125,7 @@ static struct option long_options[] = {
     {"vendor", required_argument, 0, 'M'},
     {"verbose", no_argument, 0, 'v'},
     {"version", no_argument, 0, 'V'},
+    {"watch", required_argument, 0, 'W'},
     {0, 0, 0, 0},
 };
 
@@ -392,8 +402,6 @@ static struct vp_name_t vp_arr[] = {
     {0, NULL, NULL, NULL, NULL},
 };
 
-static char t10_vendor_str[10];
-static char t10_product_str[18];
 
 #ifdef SG_LIB_WIN32
 static bool win32_spt_init_state = false;
@@ -406,21 +414,22 @@ usage(int hval)
 {
     if (1 == hval) {
         pr2serr(
-           "Usage: sg_logs [-ALL] [--all] [--brief] [--control=PC] "
-           "[--enumerate]\n"
-           "               [--exclude] [--filter=FL] [--full] [--help] "
-           "[--hex]\n"
+           "Usage: sg_logs [-ALL] [--all] [--batch=MF] [--brief] "
+           "[--control=PC]\n"
+           "               [--delta=SFN] [--enumerate] [--exclude] "
+           "[--filter=FL]\n"
+           "               [--full] [--help] [--hex]\n"
            "               [--inhex=FN] [--json[=JO]] [--js_file=JFN] "
            "[--list]\n"
            "               [--maxlen=LEN] [--name] [--no_inq] "
            "[--page=PG]\n"
-           "               [--paramp=PP] [--pcb] [--ppc] [--pdt=DT] "
-           "[--raw]\n"
-           "               [--readonly] [--reset] [--select] [--sp] "
-           "[--temperature]\n"
-           "               [--transport] [--undefined] [--vendor=VP] "
-           "[--verbose]\n"
-           "               [--version] DEVICE\n"
+           "               [--paramp=PP] [--parallel=Q] [--pcb] [--ppc] "
+           "[--pdt=DT]\n"
+           "               [--raw] [--readonly] [--reset] [--select] [--sp] "
+           "\n"
+           "               [--temperature] [--transport] [--undefined] "
+           "[--vendor=VP]\n"
+           "               [--verbose] [--version] [--watch=SECS] DEVICE\n"
            "  where the main options are:\n"
            "    --ALL|-A        fetch and decode all log pages and "
            "subpages\n"
@@ -428,7 +437,16 @@ usage(int hval)
            "subpages; use\n"
            "                    twice to fetch and decode all log pages "
            "and subpages\n"
+           "    --batch=MF|-B MF    decode each blob named in manifest MF "
+           "(lines of\n"
+           "                        'TAG FN [bin|hex]') as with --inhex=FN, "
+           "output\n"
+           "                        a JSON line for each\n"
            "    --brief|-b      shorten the output of some log pages\n"
+           "    --delta=SFN|-d SFN    only output counters that changed "
+           "since the\n"
+           "                          last invocation, with rates; state "
+           "kept in SFN\n"
            "    --enumerate|-e    enumerate known pages, ignore DEVICE. "
            "Sort order,\n"
            "                      '-e': all by acronym; '-ee': non-vendor "
@@ -500,6 +518,13 @@ usage(int hval)
            "    --old|-O        use old interface (use as first option)\n"
            "    --paramp=PP|-P PP    place PP in parameter pointer field in "
            "cdb (def: 0)\n"
+           "    --parallel=Q|-o Q    with --all, have up to Q LOG SENSE "
+           "commands\n"
+           "                         outstanding at once (def: 1, max: "
+           "64); with\n"
+           "                         --batch=MF decode up to Q blobs at "
+           "once (def:\n"
+           "                         number of processors)\n"
            "    --pcb|-q        show parameter control bytes in decoded "
            "output\n"
            "    --ppc|-Q        set the Parameter Pointer Control (PPC) bit "
@@ -525,7 +550,11 @@ usage(int hval)
            "fields,\n"
            "                      use one or more times; format as per "
            "--hex\n"
-           "    --version|-V    output version string then exit\n\n"
+           "    --version|-V    output version string then exit\n"
+           "    --watch=SECS|-W SECS    keep DEVICE open and fetch the "
+           "requested log\n"
+           "                            page(s) every SECS seconds until "
+           "interrupted\n\n"
            "If DEVICE and --select are given, a LOG SELECT command will be "
            "issued.\nIf DEVICE is not given and '--in=FN' is given then FN "
            "will decoded as if\nit were a log page. The contents of FN is "
@@ -768,11 +797,11 @@ find_vpn_by_acron(const char * vp_ap)
 /* Find vendor product number using T10 VENDOR and PRODUCT ID fields in a
    INQUIRY response. */
 static int
-find_vpn_by_inquiry(void)
+find_vpn_by_inquiry(const struct opts_t * op)
 {
     size_t len;
-    size_t t10_v_len = strlen(t10_vendor_str);
-    size_t t10_p_len = strlen(t10_product_str);
+    size_t t10_v_len = strlen(op->t10_vendor_str);
+    size_t t10_p_len = strlen(op->t10_product_str);
     const struct vp_name_t * vpp;
 
     if ((0 == t10_v_len) && (0 == t10_p_len))
@@ -783,14 +812,14 @@ find_vpn_by_inquiry(void)
         if (vpp->t10_vendorp && (t10_v_len > 0)) {
             len = strlen(vpp->t10_vendorp);
             len = (len > t10_v_len) ? t10_v_len : len;
-            if (strncmp(vpp->t10_vendorp, t10_vendor_str, len))
+            if (strncmp(vpp->t10_vendorp, op->t10_vendor_str, len))
                 continue;
             matched = true;
         }
         if (vpp->t10_productp && (t10_p_len > 0)) {
             len = strlen(vpp->t10_productp);
             len = (len > t10_p_len) ? t10_p_len : len;
-            if (strncmp(vpp->t10_productp, t10_product_str, len))
+            if (strncmp(vpp->t10_productp, op->t10_product_str, len))
                 continue;
             matched = true;
         }
@@ -819,15 +848,52 @@ enumerate_vp(struct opts_t * op)
     }
 }
 
+/* Elements of log_arr chained by page code, in log_arr order, so a search
+ * only visits the entries for that page (of up to 63 others). Built by
+ * log_arr_idx_build() before any decoding thread starts. */
+static int16_t log_arr_pg_head[64];
+static int16_t log_arr_pg_next[SG_ARRAY_SIZE(log_arr)];
+static bool log_arr_idx_ready;
+
+static void
+log_arr_idx_build(void)
+{
+    int k, pg;
+    int16_t * tail_arr[64];
+
+    if (log_arr_idx_ready)
+        return;
+    for (k = 0; k < 64; ++k) {
+        log_arr_pg_head[k] = -1;
+        tail_arr[k] = log_arr_pg_head + k;
+    }
+    for (k = 0; log_arr[k].pg_code >= 0; ++k) {
+        log_arr_pg_next[k] = -1;
+        pg = log_arr[k].pg_code;
+        if (pg > 0x3f)
+            continue;
+        *tail_arr[pg] = (int16_t)k;
+        tail_arr[pg] = log_arr_pg_next + k;
+    }
+    log_arr_idx_ready = true;
+}
+
 static const struct log_elem *
 pg_subpg_pdt_search(int pg_code, int subpg_code, int pdt, int vpn)
 {
+    bool use_idx;
+    int k;
     const struct log_elem * lep;
     int d_pdt;
     int vp_mask = get_vp_mask(vpn);
 
     d_pdt = sg_lib_pdt_decay(pdt);
-    for (lep = log_arr; lep->pg_code >=0; ++lep) {
+    use_idx = log_arr_idx_ready && (pg_code >= 0) && (pg_code <= 0x3f);
+    k = use_idx ? log_arr_pg_head[pg_code] : 0;
+    for ( ; k >= 0; k = use_idx ? log_arr_pg_next[k] : k + 1) {
+        lep = log_arr + k;
+        if (lep->pg_code < 0)
+            break;
         if (pg_code == lep->pg_code) {
             if (subpg_code == lep->subpg_code) {
                 if ((MVP_STD & lep->flags) || (0 == vp_mask) ||
@@ -987,8 +1053,8 @@ new_parse_cmd_line(struct opts_t * op, int argc, char * argv[])
         int c, n;
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "^aAbc:D:eEf:FhHi:j::J:lLm:M:nNOp:P:qQrR"
-                        "sStTuvVxX", long_options, &option_index);
+        c = getopt_long(argc, argv, "^aAbB:c:d:D:eEf:FhHi:j::J:lLm:M:nNo:Op:P:qQrR"
+                        "sStTuvVW:xX", long_options, &option_index);
         if (c == -1)
             break;
 
@@ -1002,6 +1068,9 @@ new_parse_cmd_line(struct opts_t * op, int argc, char * argv[])
         case 'b':
             ++op->do_brief;
             break;
+        case 'B':
+            op->batch_fn = optarg;
+            break;
         case 'c':
             n = sg_get_num(optarg);
             if ((n < 0) || (n > 3)) {
@@ -1011,6 +1080,9 @@ new_parse_cmd_line(struct opts_t * op, int argc, char * argv[])
             }
             op->page_control = n;
             break;
+        case 'd':
+            op->delta_fn = optarg;
+            break;
         case 'D':
             if (0 == memcmp("-1", optarg, 3))
                 n = -1;       /* SPC */
@@ -1138,6 +1210,14 @@ new_parse_cmd_line(struct opts_t * op, int argc, char * argv[])
         case 'p':
             op->pg_arg = optarg;
             break;
+        case 'o':
+            n = sg_par_get_num(optarg, 1, MAX_NUM_PARALLEL);
+            if (n < 0) {
+                usage(2);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            op->num_parallel = n;
+            break;
         case 'P':
             n = sg_get_num(optarg);
             if (n < 0) {
@@ -1182,6 +1262,16 @@ new_parse_cmd_line(struct opts_t * op, int argc, char * argv[])
         case 'V':
             op->version_given = true;
             break;
+        case 'W':
+            n = sg_get_num(optarg);
+            if (n < 1) {
+                pr2serr("bad argument to '--watch=', expect 1 or more "
+                        "seconds\n");
+                usage(2);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            op->watch_secs = n;
+            break;
         case 'x':
             ++op->no_inq;
             break;
@@ -1595,6 +1685,134 @@ resid_err:
     return res;
 }
 
+/* Pages (and subpages) fetched with --all that are not worth decoding */
+static bool
+skip_in_all(int pg_code, int subpg_code, const struct opts_t * op)
+{
+    /* Some devices include [pg_code, 0xff] for all pg_code > 0 */
+    if ((pg_code > 0) && (SUPP_SPGS_SUBPG == subpg_code))
+        return true;      /* skip since no new information */
+    if ((pg_code >= 0x30) && op->exclude_vendor)
+        return true;
+    return false;
+}
+
+/* One log page (and subpage) of --all fetched ahead of its decode */
+struct lpg_fetch_t {
+    bool wanted;
+    int res;
+    int len;            /* bytes held in resp when res is 0 */
+    uint8_t * resp;
+};
+
+struct lpg_work_t {
+    int sg_fd;
+    int resp_len;
+    const uint8_t * parr;       /* from supported pages (+ subpages) */
+    bool spf;
+    int * idx_arr;              /* elements of arr to fetch */
+    struct lpg_fetch_t * arr;   /* indexed like parr */
+    const struct opts_t * op;
+};
+
+/* Fetches the page of element idx_arr[j] */
+static int
+lpg_fetch_one(int64_t j, void * ctx)
+{
+    int k, n;
+    struct lpg_work_t * wp = (struct lpg_work_t *)ctx;
+    struct lpg_fetch_t * fp;
+    uint8_t * bp;
+    uint8_t * free_bp;
+    struct opts_t my_op;
+
+    k = wp->idx_arr[j];
+    fp = wp->arr + k;
+    bp = sg_memalign(wp->resp_len, 0, &free_bp, false);
+    if (NULL == bp)
+        return 0;       /* left for the caller to fetch */
+    my_op = *wp->op;            /* do_logs() takes page numbers from op */
+    my_op.pg_code = wp->parr[k] & 0x3f;
+    my_op.subpg_code = wp->spf ? wp->parr[k + 1] : NOT_SPG_SUBPG;
+    fp->res = do_logs(wp->sg_fd, bp, wp->resp_len, &my_op);
+    if (0 == fp->res) {
+        n = sg_get_unaligned_be16(bp + 2) + 4;
+        if (n > wp->resp_len)
+            n = wp->resp_len;    /* truncation reported when decoded */
+        fp->resp = (uint8_t *)malloc(n);
+        if (fp->resp) {
+            memcpy(fp->resp, bp, n);
+            fp->len = n;
+        } else
+            fp->res = sg_convert_errno(ENOMEM);
+    }
+    free(free_bp);
+    return 0;
+}
+
+/* Fetches the pages that --all would fetch, listed in parr (plen bytes),
+ * with up to op->num_parallel LOG SENSE commands outstanding. Returns an
+ * array indexed like parr for the caller to decode in order, or NULL if
+ * resources are short (then the caller falls back to fetching serially).
+ * Commands sent concurrently to the same file descriptor are each handled
+ * by the pass-through independently, so threads sharing sg_fd suffice. */
+static struct lpg_fetch_t *
+fetch_all_parallel(int sg_fd, const uint8_t * parr, int plen, bool spf,
+                   int resp_len, const struct opts_t * op)
+{
+    int k, n, num_pgs;
+    struct lpg_fetch_t * arr;
+    struct lpg_work_t work;
+
+    arr = (struct lpg_fetch_t *)calloc(plen + 1, sizeof(*arr));
+    memset(&work, 0, sizeof(work));
+    work.idx_arr = (int *)calloc(plen + 1, sizeof(int));
+    if ((NULL == arr) || (NULL == work.idx_arr)) {
+        free(arr);
+        free(work.idx_arr);
+        return NULL;
+    }
+    for (k = 0, num_pgs = 0; k < plen; ++k) {
+        n = k;
+        if (spf)
+            ++k;
+        if (skip_in_all(parr[n] & 0x3f, spf ? parr[k] : NOT_SPG_SUBPG, op))
+            continue;
+        arr[n].wanted = true;
+        work.idx_arr[num_pgs++] = n;
+    }
+    work.sg_fd = sg_fd;
+    work.resp_len = resp_len;
+    work.parr = parr;
+    work.spf = spf;
+    work.arr = arr;
+    work.op = op;
+    if (op->verbose > 1)
+        pr2serr("%s: %d pages, up to %d at once\n", __func__, num_pgs,
+                op->num_parallel);
+    sg_par_each(num_pgs, op->num_parallel, lpg_fetch_one, &work);
+    free(work.idx_arr);
+    /* a job short of memory leaves its page undone: fetch those serially */
+    for (k = 0; k < plen; ++k) {
+        if (arr[k].wanted && (0 == arr[k].res) && (NULL == arr[k].resp))
+            arr[k].wanted = false;
+    }
+    return arr;
+}
+
+static void
+free_fetch_all(struct lpg_fetch_t * arr, int plen)
+{
+    int k;
+
+    if (NULL == arr)
+        return;
+    for (k = 0; k < plen; ++k)
+        free(arr[k].resp);
+    free(arr);
+}
+
+
 /* Apart from short names, names that do not end is "age" have " log page"
  * appended to them, unless they end in '?' in which case the '?' is
  * removed. */
@@ -1969,13 +2187,13 @@ show_buffer_over_under_run_page(const uint8_t * resp, int len,
         sgj_js_nv_ihex(jsp, jo3p, param_c_sn, pc);
         if (cp) {
             sgj_pr_hr(jsp, "    %s = %" PRIu64 "\n", cp, count);
-            js_snakenv_ihexstr_nex(jsp, jo3p, param_c, pc, true,
+            sgj_js_nv_ihexstr_nex(jsp, jo3p, param_c_sn, pc, true,
                                    NULL, cp, NULL);
             sgj_js_nv_ihex(jsp, jo3p, orurc, count);
         } else
             sgj_pr_hr(jsp, "    counter = %" PRIu64 "\n", count);
 
-        if (op->do_pcb)
+        if (op->do_pcb && op->hr_out)
             sgj_pr_hr(jsp, "        <%s>\n", get_pcb_str(bp[2],
                       str, sizeof(str)));
         if (jsp->pr_as_json)
@@ -2009,6 +2227,7 @@ show_error_counter_page(const uint8_t * resp, int len,
     char b[168] SG_C_CPP_ZERO_INIT;
     char d[128];
     char e[64];
+    char pg_sn[64];
     static const int blen = sizeof(b);
     static const char * wec = "Write error counter";
     static const char * rec = "Read error counter";
@@ -2054,6 +2273,8 @@ show_error_counter_page(const uint8_t * resp, int len,
         memcpy(b + n, " parameters", 11 + 1);
         sgj_convert2snake(b, d, sizeof(d) - 1);
         jap = sgj_named_subarray_r(jsp, jo2p, d);
+        /* snake name of each counter, once rather than per parameter */
+        sgj_convert2snake(pg_cp, pg_sn, sizeof(pg_sn) - 1);
     }
     num = len - 4;
     bp = &resp[0] + 4;
@@ -2136,13 +2357,12 @@ show_error_counter_page(const uint8_t * resp, int len,
                 snprintf(d, sizeof(d), "%" PRIu64, val);
             sgj_pr_hr(jsp, "  %s = %s\n", par_cp, d);
             if (jsp->pr_as_json) {
-                js_snakenv_ihexstr_nex(jsp, jo3p, param_c, pc, true,
+                sgj_js_nv_ihexstr_nex(jsp, jo3p, param_c_sn, pc, true,
                                        NULL, par_cp, NULL);
-                sgj_convert2snake(pg_cp, e, sizeof(e) - 1);
-                sgj_js_nv_ihexstr(jsp, jo3p, e, val, as_s_s, d);
+                sgj_js_nv_ihexstr(jsp, jo3p, pg_sn, val, as_s_s, d);
             }
         }
-        if (op->do_pcb)
+        if (op->do_pcb && op->hr_out)
             sgj_pr_hr(jsp, "        <%s>\n", get_pcb_str(bp[2], b, blen));
         if (jsp->pr_as_json)
             sgj_js_nv_o(jsp, jap, NULL /* name */, jo3p);
@@ -2240,12 +2460,12 @@ show_non_medium_error_page(const uint8_t * resp, int len,
         else {
             count = sg_get_unaligned_be(pl - 4, bp + 4);
             sgj_pr_hr(jsp, "  %s = %" PRIu64 "\n", b, count);
-            js_snakenv_ihexstr_nex(jsp, jo3p, param_c, pc, true,
+            sgj_js_nv_ihexstr_nex(jsp, jo3p, param_c_sn, pc, true,
                                    NULL, b, NULL);
             js_snakenv_ihexstr_nex(jsp, jo3p, nmec, count, true, NULL, NULL,
                                    NULL);
         }
-        if (op->do_pcb)
+        if (op->do_pcb && op->hr_out)
             sgj_pr_hr(jsp, "        <%s>\n", get_pcb_str(bp[2],
                       str, sizeof(str)));
         if (jsp->pr_as_json)
@@ -2353,7 +2573,7 @@ show_power_condition_transitions_page(const uint8_t * resp, int len,
         }
         count = sg_get_unaligned_be(pl - 4, bp + 4);
         sgj_pr_hr(jsp, "  %s = %" PRIu64 "\n", cp, count);
-        if (op->do_pcb)
+        if (op->do_pcb && op->hr_out)
             sgj_pr_hr(jsp, "        <%s>\n", get_pcb_str(bp[2],
                       str, sizeof(str)));
         if (jsp->pr_as_json) {
@@ -2555,7 +2775,7 @@ show_environmental_reporting_page(const uint8_t * resp, int len,
             }
         } else
             sgj_pr_hr(jsp, "  <<unexpected %s 0x%x\n", param_c, pc);
-        if (op->do_pcb)
+        if (op->do_pcb && op->hr_out)
             sgj_pr_hr(jsp, "        <%s>\n", get_pcb_str(bp[2], b, blen));
 inner:
         if (jsp->pr_as_json)
@@ -2731,7 +2951,7 @@ show_environmental_limits_page(const uint8_t * resp, int len,
                                    NULL, b, NULL);
         } else
              sgj_pr_hr(jsp, "  <<unexpected %s 0x%x\n", param_c, pc);
-        if (op->do_pcb)
+        if (op->do_pcb && op->hr_out)
             sgj_pr_hr(jsp, "        <%s>\n", get_pcb_str(bp[2], b, blen));
 inner:
         if (jsp->pr_as_json)
@@ -2920,7 +3140,7 @@ show_cmd_dur_limits_page(const uint8_t * resp, int len,
              sgj_pr_hr(jsp, "  <<unexpected %s 0x%x\n", param_c, pc);
             break;
         }
-        if (op->do_pcb)
+        if (op->do_pcb && op->hr_out)
             sgj_pr_hr(jsp, "        <%s>\n", get_pcb_str(bp[2], b, blen));
         if (jsp->pr_as_json)
             sgj_js_nv_o(jsp, jap, NULL /* name */, jo3p);
@@ -3021,7 +3241,7 @@ show_last_n_error_page(const uint8_t * resp, int len,
                     sgj_js_nv_hex_bytes(jsp, jo3p, eed, bp + 4, pl - 4);
             }
         }
-        if (op->do_pcb)
+        if (op->do_pcb && op->hr_out)
             sgj_pr_hr(jsp, "        <%s>\n", get_pcb_str(bp[2], b, blen));
         if (jsp->pr_as_json)
             sgj_js_nv_o(jsp, jap, NULL /* name */, jo3p);
@@ -3116,7 +3336,7 @@ show_last_n_deferred_error_page(const uint8_t * resp, int len,
                 sgj_js_sense(jsp, jo4p, bp + 4, pl - 4);
             }
         }
-        if (op->do_pcb)
+        if (op->do_pcb && op->hr_out)
             sgj_pr_hr(jsp, "        <%s>\n", get_pcb_str(bp[2], b, blen));
         if (jsp->pr_as_json)
             sgj_js_nv_o(jsp, jap, NULL /* name */, jo3p);
@@ -3215,20 +3435,12 @@ show_last_n_inq_data_ch_page(const uint8_t * resp, int len,
                 }
             }
         } else {        /* pc > 0x0 */
-            int m;
-            const int nn = sg_lib_names_mode_len;
-            struct sg_lib_simple_value_name_t * nvp = sg_lib_names_vpd_arr;
-
             snprintf(b, blen, "  %s 0x%x, ", param_c, pc);
             vpd = !! (1 & *(bp + 4));
             vpd_pg = *(bp + 5);
-            if (vpd) {
-                for (m = 0; m < nn; ++m, ++nvp) {
-                    if (nvp->value == vpd_pg)
-                        break;
-                }
-                vpd_pg_name = (m < nn) ? nvp->name : NULL;
-            } else
+            if (vpd)
+                vpd_pg_name = sg_lib_names_vpd_find(vpd_pg);
+            else
                 vpd_pg_name = "Standard INQUIRY";
 
             if (jsp->pr_as_json) {
@@ -3246,7 +3458,7 @@ show_last_n_inq_data_ch_page(const uint8_t * resp, int len,
             } else
                 sgj_pr_hr(jsp, "%sStandard INQUIRY data changed\n", b);
         }
-        if (op->do_pcb)
+        if (op->do_pcb && op->hr_out)
             sgj_pr_hr(jsp, "        <%s>\n", get_pcb_str(bp[2], b, blen));
 skip:
         if (jsp->pr_as_json)
@@ -3346,8 +3558,6 @@ show_last_n_mode_pg_data_ch_page(const uint8_t * resp, int len,
             }
         } else {        /* pc > 0x0 */
             int val;
-            const int nn = sg_lib_names_mode_len;
-            struct sg_lib_simple_value_name_t * nmp = sg_lib_names_mode_arr;
 
             snprintf(b, blen, "  %s 0x%x, ", param_c, pc);
             spf = !! (0x40 & *(bp + 4));
@@ -3360,13 +3570,9 @@ show_last_n_mode_pg_data_ch_page(const uint8_t * resp, int len,
                 sgj_pr_hr(jsp, "%smode page 0x%x changed\n", b, pg_code);
 
             val = (pg_code << 8) | spg_code;
-            for (k = 0; k < nn; ++k, ++nmp) {
-                if (nmp->value == val)
-                    break;
-            }
-            mode_pg_name = (k < nn) ? nmp->name : NULL;
+            mode_pg_name = sg_lib_names_mode_find(val);
             if ((0 == op->do_brief) && mode_pg_name)
-                sgj_pr_hr(jsp, "    name: %s\n", nmp->name);
+                sgj_pr_hr(jsp, "    name: %s\n", mode_pg_name);
             if (jsp->pr_as_json) {
                 sgj_js_nv_i(jsp, jo3p, "spf", (int)spf);
                 sgj_js_nv_ihex(jsp, jo3p, "mode_page_code", pg_code);
@@ -3375,7 +3581,7 @@ show_last_n_mode_pg_data_ch_page(const uint8_t * resp, int len,
                     sgj_js_nv_s(jsp, jo3p, "mode_page_name", mode_pg_name);
             }
         }
-        if (op->do_pcb)
+        if (op->do_pcb && op->hr_out)
             sgj_pr_hr(jsp, "        <%s>\n", get_pcb_str(bp[2], b, blen));
 skip:
         if (jsp->pr_as_json)
@@ -3513,7 +3719,7 @@ show_self_test_page(const uint8_t * resp, int len, struct opts_t * op,
                           blen, b));
             }
         }
-        if (op->do_pcb)
+        if (op->do_pcb && op->hr_out)
             sgj_pr_hr(jsp, "        <%s>\n", get_pcb_str(bp[2], b, blen));
         if (jsp->pr_as_json) {
             js_snakenv_ihexstr_nex(jsp, jo3p, stc_s, st_c, true, NULL,
@@ -3668,7 +3874,7 @@ show_temperature_page(const uint8_t * resp, int len, struct opts_t * op,
         }
         if (jsp->pr_as_json)
             sgj_js_nv_o(jsp, jap, NULL /* name */, jo3p);
-        if (op->do_pcb)
+        if (op->do_pcb && op->hr_out)
             sgj_pr_hr(jsp, "        <%s>\n", get_pcb_str(bp[2], b, blen));
 skip:
         if (op->filter_given)
@@ -3848,7 +4054,7 @@ show_start_stop_page(const uint8_t * resp, int len, struct opts_t * op,
         }
         if (jsp->pr_as_json)
             sgj_js_nv_o(jsp, jap, NULL /* name */, jo3p);
-        if (op->do_pcb)
+        if (op->do_pcb && op->hr_out)
             sgj_pr_hr(jsp, "        <%s>\n", get_pcb_str(bp[2], str,
                       sizeof(str)));
 skip:
@@ -3961,7 +4167,7 @@ show_app_client_page(const uint8_t * resp, int len, struct opts_t * op,
             sgj_js_nv_hex_bytes(jsp, jo3p, in_hex, bp, extra);
             sgj_js_nv_o(jsp, jap, NULL /* name */, jo3p);
         }
-        if (op->do_pcb)
+        if (op->do_pcb && op->hr_out)
             sgj_pr_hr(jsp, "        <%s>\n", get_pcb_str(bp[2], str,
                       sizeof(str)));
         if (op->filter_given)
@@ -4184,7 +4390,7 @@ show_ie_page(const uint8_t * resp, int len, struct opts_t * op,
 
         if (jsp->pr_as_json)
             sgj_js_nv_o(jsp, jap, NULL /* name */, jo3p);
-        if (op->do_pcb)
+        if (op->do_pcb && op->hr_out)
             sgj_pr_hr(jsp, "        <%s>\n", get_pcb_str(bp[2], str,
                       sizeof(str)));
 skip:
@@ -4451,7 +4657,7 @@ show_sas_port_param(const uint8_t * bp, int param_len, struct opts_t * op,
     else
         sgj_pr_hr(jsp, "  number of phys = %d\n", nphys);
     if (jsp->pr_as_json) {
-        js_snakenv_ihexstr_nex(jsp, jop, param_c , t, true,
+        sgj_js_nv_ihexstr_nex(jsp, jop, param_c_sn, t, true,
                                NULL, psplpfstp, rtpi);
         pi = 0xf & bp[4];
         sgj_js_nv_ihexstr(jsp, jop, "protocol_identifier", pi, NULL,
@@ -4769,7 +4975,7 @@ show_protocol_specific_port_page(const uint8_t * resp, int len,
         show_sas_port_param(bp, pl, op, jo3p);
         if (jsp->pr_as_json)
             sgj_js_nv_o(jsp, jap, NULL /* name */, jo3p);
-        if ((op->do_pcb) && (! op->do_name))
+        if ((op->do_pcb) && op->hr_out && (! op->do_name))
             sgj_pr_hr(jsp, "        <%s>\n", get_pcb_str(bp[2], b,
                       sizeof(b)));
         if (op->filter_given)
@@ -4991,7 +5197,7 @@ show_stats_perform_pages(const uint8_t * resp, int len,
             }
             if (jsp->pr_as_json)
                 sgj_js_nv_o(jsp, jap, NULL /* name */, jo3p);
-            if ((op->do_pcb) && (! nm))
+            if ((op->do_pcb) && op->hr_out && (! nm))
                 sgj_pr_hr(jsp, "    <%s>\n", get_pcb_str(bp[2], b, blen));
 skip:
             if (op->filter_given)
@@ -5115,7 +5321,7 @@ skip:
             }
             if (jsp->pr_as_json)
                 sgj_js_nv_o(jsp, jap, NULL /* name */, jo3p);
-            if ((op->do_pcb) && (! nm))
+            if ((op->do_pcb) && op->hr_out && (! nm))
                 sgj_pr_hr(jsp, "    <%s>\n", get_pcb_str(bp[2], b, blen));
 skip2:
             if (op->filter_given)
@@ -5278,7 +5484,7 @@ show_cache_stats_page(const uint8_t * resp, int len, struct opts_t * op,
         }
         if (jsp->pr_as_json)
             sgj_js_nv_o(jsp, jap, NULL /* name */, jo3p);
-        if ((op->do_pcb) && (! nm))
+        if ((op->do_pcb) && op->hr_out && (! nm))
             sgj_pr_hr(jsp, "    <%s>\n", get_pcb_str(bp[2], b, blen));
 skip:
         if (op->filter_given)
@@ -5424,7 +5630,7 @@ show_format_status_page(const uint8_t * resp, int len,
         }
         if (jsp->pr_as_json)
             sgj_js_nv_o(jsp, jap, NULL /* name */, jo3p);
-        if ((op->do_pcb) && (! op->do_name))
+        if ((op->do_pcb) && op->hr_out && (! op->do_name))
             sgj_pr_hr(jsp, "        <%s>\n", get_pcb_str(bp[2], b, blen));
 filter_chk:
         if (op->filter_given)
@@ -5566,7 +5772,7 @@ show_non_volatile_cache_page(const uint8_t * resp, int len,
 
             sgj_js_nv_o(jsp, jap, NULL /* name */, jo3p);
         }
-        if ((op->do_pcb) && (! op->do_name))
+        if ((op->do_pcb) && op->hr_out && (! op->do_name))
             sgj_pr_hr(jsp, "        <%s>\n", get_pcb_str(bp[2], b, blen));
 filter_chk:
         if (op->filter_given)
@@ -5718,7 +5924,7 @@ show_lb_provisioning_page(const uint8_t * resp, int len,
         }
         if (jsp->pr_as_json)
             sgj_js_nv_o(jsp, jap, NULL /* name */, jo3p);
-        if ((op->do_pcb) && (! op->do_name))
+        if ((op->do_pcb) && op->hr_out && (! op->do_name))
             sgj_pr_hr(jsp, "        <%s>\n", get_pcb_str(bp[2], b, blen));
 filter_chk:
         if (op->filter_given)
@@ -5838,7 +6044,7 @@ show_utilization_page(const uint8_t * resp, int len, struct opts_t * op,
         }
         if (jsp->pr_as_json)
             sgj_js_nv_o(jsp, jap, NULL /* name */, jo3p);
-        if ((op->do_pcb) && (! op->do_name))
+        if ((op->do_pcb) && op->hr_out && (! op->do_name))
             sgj_pr_hr(jsp, "        <%s>\n", get_pcb_str(bp[2], b, blen));
 filter_chk:
         if (op->filter_given)
@@ -5919,7 +6125,7 @@ show_solid_state_media_page(const uint8_t * resp, int len,
             }
             sgj_pr_hr(jsp, "  %s: %u %%\n", puei, bp[7]);
             if (jsp->pr_as_json) {
-                js_snakenv_ihexstr_nex(jsp, jo3p, param_c, pc, true,
+                sgj_js_nv_ihexstr_nex(jsp, jo3p, param_c_sn, pc, true,
                                        NULL, puei, NULL);
                 js_snakenv_ihexstr_nex(jsp, jo3p, puei, bp[7], false,
                                        NULL, NULL, NULL);
@@ -5933,7 +6139,7 @@ show_solid_state_media_page(const uint8_t * resp, int len,
         }
         if (jsp->pr_as_json)
             sgj_js_nv_o(jsp, jap, NULL /* name */, jo3p);
-        if (op->do_pcb)
+        if (op->do_pcb && op->hr_out)
             sgj_pr_hr(jsp, "        <%s>\n", get_pcb_str(bp[2], b, blen));
 filter_chk:
         if (op->filter_given)
@@ -6264,7 +6470,7 @@ show_dt_device_status_page(const uint8_t * resp, int len,
         }
         if (jsp->pr_as_json)
             sgj_js_nv_o(jsp, jap, NULL /* name */, jo3p);
-        if (op->do_pcb)
+        if (op->do_pcb && op->hr_out)
             sgj_pr_hr(jsp, "        <%s>\n", get_pcb_str(bp[2], b, blen));
 filter_chk:
         if (op->filter_given)
@@ -6392,7 +6598,7 @@ show_tapealert_response_page(const uint8_t * resp, int len,
         }
         if (jsp->pr_as_json)
             sgj_js_nv_o(jsp, jap, NULL /* name */, jo3p);
-        if ((op->do_pcb) && (! op->do_name))
+        if ((op->do_pcb) && op->hr_out && (! op->do_name))
             sgj_pr_hr(jsp, "        <%s>\n", get_pcb_str(bp[2], b, blen));
 filter_chk:
         if (op->filter_given)
@@ -6551,7 +6757,7 @@ show_requested_recovery_page(const uint8_t * resp, int len,
         }
         if (jsp->pr_as_json)
             sgj_js_nv_o(jsp, jap, NULL /* name */, jo3p);
-        if ((op->do_pcb) && (! op->do_name))
+        if ((op->do_pcb) && op->hr_out && (! op->do_name))
             sgj_pr_hr(jsp, "        <%s>\n", get_pcb_str(bp[2], b, blen));
 filter_chk:
         if (op->filter_given)
@@ -6668,7 +6874,7 @@ show_ata_pt_results_page(const uint8_t * resp, int len,
         }
         if (jsp->pr_as_json)
             sgj_js_nv_o(jsp, jap, NULL /* name */, jo3p);
-        if ((op->do_pcb) && (! op->do_name))
+        if ((op->do_pcb) && op->hr_out && (! op->do_name))
             sgj_pr_hr(jsp, "        <%s>\n", get_pcb_str(bp[2], b, blen));
 filter_chk:
         if (op->filter_given)
@@ -6932,7 +7138,7 @@ show_background_scan_results_page(const uint8_t * resp, int len,
         }               /* end of switch statement block */
         if (jsp->pr_as_json)
             sgj_js_nv_o(jsp, jap, NULL /* name */, jo3p);
-        if (op->do_pcb)
+        if (op->do_pcb && op->hr_out)
             sgj_pr_hr(jsp, "        <%s>\n", get_pcb_str(bp[2], b, blen));
 filter_chk:
         if (op->filter_given)
@@ -7190,7 +7396,7 @@ show_zoned_block_dev_stats(const uint8_t * resp, int len,
                     __func__, pl);
         if (jsp->pr_as_json)
             sgj_js_nv_o(jsp, jap, NULL /* name */, jo3p);
-        if (op->do_pcb)
+        if (op->do_pcb && op->hr_out)
             sgj_pr_hr(jsp, "        <%s>\n", get_pcb_str(bp[2], b, blen));
 filter_chk:
         if (op->filter_given)
@@ -7320,7 +7526,7 @@ show_pending_defects_page(const uint8_t * resp, int len, struct opts_t * op,
         }
         if (jsp->pr_as_json)
             sgj_js_nv_o(jsp, jap, NULL /* name */, jo3p);
-        if (op->do_pcb)
+        if (op->do_pcb && op->hr_out)
             sgj_pr_hr(jsp, "        <%s>\n", get_pcb_str(bp[2], b, blen));
 filter_chk:
         if (op->filter_given)
@@ -7415,7 +7621,7 @@ show_background_op_page(const uint8_t * resp, int len,
         }
         if (jsp->pr_as_json)
             sgj_js_nv_o(jsp, jap, NULL /* name */, jo3p);
-        if (op->do_pcb)
+        if (op->do_pcb && op->hr_out)
             sgj_pr_hr(jsp, "        <%s>\n", get_pcb_str(bp[2], b, blen));
 filter_chk:
         if (op->filter_given)
@@ -7533,7 +7739,7 @@ show_lps_misalignment_page(const uint8_t * resp, int len,
         }
         if (jsp->pr_as_json)
             sgj_js_nv_o(jsp, jap, NULL /* name */, jo3p);
-        if (op->do_pcb)
+        if (op->do_pcb && op->hr_out)
             sgj_pr_hr(jsp, "        <%s>\n", get_pcb_str(bp[2], b, blen));
 filter_chk:
         if (op->filter_given)
@@ -7660,7 +7866,7 @@ show_service_buffers_info_page(const uint8_t * resp, int len,
         }
         if (jsp->pr_as_json)
             sgj_js_nv_o(jsp, jap, NULL /* name */, jo3p);
-        if (op->do_pcb)
+        if (op->do_pcb && op->hr_out)
             sgj_pr_hr(jsp, "        <%s>\n", get_pcb_str(bp[2], b, blen));
 filter_chk:
         if (op->filter_given)
@@ -7873,7 +8079,7 @@ show_sequential_access_page(const uint8_t * resp, int len,
         }
         if (jsp->pr_as_json)
             sgj_js_nv_o(jsp, jap, NULL /* name */, jo3p);
-        if (op->do_pcb)
+        if (op->do_pcb && op->hr_out)
             sgj_pr_hr(jsp, "        <%s>\n", get_pcb_str(bp[2], b, blen));
 filter_chk:
         if (op->filter_given)
@@ -8150,7 +8356,7 @@ show_device_stats_page(const uint8_t * resp, int len,
         }
         if (jsp->pr_as_json)
             sgj_js_nv_o(jsp, jap, NULL /* name */, jo3p);
-        if (op->do_pcb)
+        if (op->do_pcb && op->hr_out)
             sgj_pr_hr(jsp, "        <%s>\n", get_pcb_str(bp[2], b, blen));
 filter_chk:
         if (op->filter_given)
@@ -8419,7 +8625,7 @@ show_element_stats_page(const uint8_t * resp, int len,
                    SGJ_SEP_COLON_1_SPACE, v, false);
         if (jsp->pr_as_json)
             sgj_js_nv_o(jsp, jap, NULL /* name */, jo3p);
-        if (op->do_pcb)
+        if (op->do_pcb && op->hr_out)
             sgj_pr_hr(jsp, "        <%s>\n", get_pcb_str(bp[2], b, blen));
 filter_chk:
         if (op->filter_given)
@@ -8578,7 +8784,7 @@ show_tape_diag_data_page(const uint8_t * resp, int len,
         }
         if (jsp->pr_as_json)
             sgj_js_nv_o(jsp, jap, NULL /* name */, jo3p);
-        if (op->do_pcb)
+        if (op->do_pcb && op->hr_out)
             sgj_pr_hr(jsp, "        <%s>\n", get_pcb_str(bp[2], b, blen));
 filter_chk:
         if (op->filter_given)
@@ -8748,7 +8954,7 @@ show_mchanger_diag_data_page(const uint8_t * resp, int len,
         }
         if (jsp->pr_as_json)
             sgj_js_nv_o(jsp, jap, NULL /* name */, jo3p);
-        if (op->do_pcb)
+        if (op->do_pcb && op->hr_out)
             sgj_pr_hr(jsp, "        <%s>\n", get_pcb_str(bp[2], b, blen));
 filter_chk:
         if (op->filter_given)
@@ -9259,7 +9465,7 @@ show_volume_stats_pages(const uint8_t * resp, int len,
         }
         if (jsp->pr_as_json)
             sgj_js_nv_o(jsp, jap, NULL /* name */, jo3p);
-        if (op->do_pcb)
+        if (op->do_pcb && op->hr_out)
             sgj_pr_hr(jsp, "        <%s>\n", get_pcb_str(bp[2], b, blen));
 filter_chk:
         if (op->filter_given)
@@ -9353,7 +9559,7 @@ show_tape_alert_ssc_page(const uint8_t * resp, int len,
             sgj_js_nv_i(jsp, jo3p, "flag", flag);
             sgj_js_nv_o(jsp, jap, NULL /* name */, jo3p);
         }
-        if (op->do_pcb)
+        if (op->do_pcb && op->hr_out)
             sgj_pr_hr(jsp, "        <%s>\n", get_pcb_str(bp[2], b, blen));
 filter_chk:
         if (op->filter_given)
@@ -9454,6 +9660,335 @@ show_unknown_page(const char * lp_name, const uint8_t * resp, int len,
     }
 }
 
+/* --delta=SFN keeps log parameter values from one invocation to the next in
+ * the state file SFN, a 16 byte header: "SGLD", 2 byte version, 2 reserved
+ * bytes, 8 byte timestamp (microseconds since the epoch); then a 4 byte
+ * count of entries each of 12 bytes: page code, subpage code, 2 byte
+ * parameter code and 8 byte value. All integers are big endian. Only
+ * parameters that are counters (not ASCII, at most 8 bytes long) are kept. */
+#define DELTA_MAGIC "SGLD"
+#define DELTA_VERSION 1
+#define DELTA_HDR_LEN 20
+#define DELTA_ENT_LEN 12
+
+struct delta_ent_t {
+    uint32_t key;       /* page code << 24 | subpage << 16 | parameter code */
+    uint64_t value;
+};
+
+struct delta_state_t {
+    bool have_old;
+    int old_num;
+    int new_num;
+    int new_max;
+    int num_changed;
+    uint64_t old_usecs;
+    uint64_t now_usecs;
+    struct delta_ent_t * old_arr;       /* sorted by key */
+    struct delta_ent_t * new_arr;
+    sgj_opaque_p jap;
+    uint8_t pg_seen[(64 * 256) / 8];    /* bit per page, subpage fetched */
+};
+
+static uint64_t
+delta_now_usecs(void)
+{
+#ifdef HAVE_GETTIMEOFDAY
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return ((uint64_t)tv.tv_sec * 1000000) + tv.tv_usec;
+#else
+    return (uint64_t)time(NULL) * 1000000;
+#endif
+}
+
+static int
+delta_ent_cmp(const void * a, const void * b)
+{
+    uint32_t x = ((const struct delta_ent_t *)a)->key;
+    uint32_t y = ((const struct delta_ent_t *)b)->key;
+
+    return (x < y) ? -1 : ((x > y) ? 1 : 0);
+}
+
+/* Reads the previous state from op->delta_fn. A missing file is not an
+ * error, every counter is then reported as new. */
+static void
+delta_load(struct opts_t * op)
+{
+    int k, n;
+    FILE * fp;
+    struct delta_state_t * dsp = op->delta_sp;
+    uint8_t b[DELTA_HDR_LEN];
+    uint8_t e[DELTA_ENT_LEN];
+
+    dsp->now_usecs = delta_now_usecs();
+    fp = fopen(op->delta_fn, "rb");
+    if (NULL == fp) {
+        if (op->verbose)
+            pr2serr("--delta: no previous state in %s\n", op->delta_fn);
+        return;
+    }
+    if ((1 != fread(b, sizeof(b), 1, fp)) || memcmp(b, DELTA_MAGIC, 4) ||
+        (DELTA_VERSION != sg_get_unaligned_be16(b + 4))) {
+        pr2serr("--delta: %s is not a sg_logs state file, ignored\n",
+                op->delta_fn);
+        goto fini;
+    }
+    dsp->old_usecs = sg_get_unaligned_be64(b + 8);
+    n = (int)sg_get_unaligned_be32(b + 16);
+    if ((n < 0) || (n > (64 * 256 * 65536))) {
+        pr2serr("--delta: %s has bad count, ignored\n", op->delta_fn);
+        goto fini;
+    }
+    dsp->old_arr = (struct delta_ent_t *)calloc(n + 1,
+                                                sizeof(struct delta_ent_t));
+    if (NULL == dsp->old_arr)
+        goto fini;
+    for (k = 0; k < n; ++k) {
+        if (1 != fread(e, sizeof(e), 1, fp))
+            break;
+        dsp->old_arr[k].key = ((uint32_t)e[0] << 24) | ((uint32_t)e[1] << 16) |
+                              sg_get_unaligned_be16(e + 2);
+        dsp->old_arr[k].value = sg_get_unaligned_be64(e + 4);
+    }
+    dsp->old_num = k;
+    qsort(dsp->old_arr, dsp->old_num, sizeof(struct delta_ent_t),
+          delta_ent_cmp);
+    dsp->have_old = true;
+    if (op->verbose)
+        pr2serr("--delta: %d values from %s\n", dsp->old_num, op->delta_fn);
+fini:
+    fclose(fp);
+}
+
+static bool
+delta_add_new(struct delta_state_t * dsp, uint32_t key, uint64_t value)
+{
+    if (dsp->new_num >= dsp->new_max) {
+        int n = (dsp->new_max > 0) ? (2 * dsp->new_max) : 256;
+        struct delta_ent_t * p;
+
+        p = (struct delta_ent_t *)realloc(dsp->new_arr,
+                                          n * sizeof(struct delta_ent_t));
+        if (NULL == p)
+            return false;
+        dsp->new_arr = p;
+        dsp->new_max = n;
+    }
+    dsp->new_arr[dsp->new_num].key = key;
+    dsp->new_arr[dsp->new_num].value = value;
+    ++dsp->new_num;
+    return true;
+}
+
+/* Decodes the log page in resp into (parameter code, value) pairs and
+ * reports those that have changed since the previous invocation, with a
+ * rate per second. Used instead of decode_page_contents() for --delta */
+static void
+delta_page(const uint8_t * resp, int len, struct opts_t * op,
+           sgj_opaque_p jop)
+{
+    bool spf;
+    int k, pg_code, subpg_code, pc, pl, vpn;
+    uint32_t key;
+    uint64_t value, secs_x1000;
+    const uint8_t * bp;
+    const struct log_elem * lep;
+    struct delta_state_t * dsp = op->delta_sp;
+    struct delta_ent_t ent;
+    const struct delta_ent_t * oep;
+    sgj_state * jsp = &op->json_st;
+    sgj_opaque_p jo2p;
+    char d[64];
+    char r[64];
+    char pg_s[32];
+
+    if (len < 4)
+        return;
+    spf = !!(resp[0] & 0x40);
+    pg_code = resp[0] & 0x3f;
+    subpg_code = spf ? resp[1] : NOT_SPG_SUBPG;
+    /* nothing to count in the supported pages and subpages pages */
+    if ((SUPP_PAGES_LPAGE == pg_code) || (SUPP_SPGS_SUBPG == subpg_code))
+        return;
+    dsp->pg_seen[((pg_code << 8) | subpg_code) >> 3] |=
+                                        (1 << (subpg_code & 7));
+    k = sg_get_unaligned_be16(resp + 2) + 4;
+    if (k < len)
+        len = k;
+    vpn = (op->vend_prod_num >= 0) ? op->vend_prod_num : op->deduced_vpn;
+    lep = pg_subpg_pdt_search(pg_code, subpg_code, op->dev_pdt, vpn);
+    if (subpg_code > 0)
+        snprintf(pg_s, sizeof(pg_s), "0x%x,0x%x", pg_code, subpg_code);
+    else
+        snprintf(pg_s, sizeof(pg_s), "0x%x", pg_code);
+    secs_x1000 = (dsp->now_usecs > dsp->old_usecs) ?
+                 ((dsp->now_usecs - dsp->old_usecs) / 1000) : 0;
+    for (bp = resp + 4; (bp + 4) <= (resp + len); bp += pl) {
+        pc = sg_get_unaligned_be16(bp + 0);
+        pl = bp[3] + 4;
+        if ((bp + pl) > (resp + len))
+            break;
+        /* skip ASCII format lists and values too long to be counters */
+        if ((1 == (bp[2] & 0x3)) || (pl < 5) || (pl > 12))
+            continue;
+        value = sg_get_big_endian(bp + 4, 7, (pl - 4) * 8);
+        key = ((uint32_t)pg_code << 24) | ((uint32_t)subpg_code << 16) | pc;
+        if (! delta_add_new(dsp, key, value)) {
+            pr2serr("--delta: out of memory\n");
+            return;
+        }
+        ent.key = key;
+        oep = dsp->have_old ?
+              (const struct delta_ent_t *)bsearch(&ent, dsp->old_arr,
+                        dsp->old_num, sizeof(ent), delta_ent_cmp) : NULL;
+        if (oep && (oep->value == value))
+            continue;
+        ++dsp->num_changed;
+        d[0] = '\0';
+        r[0] = '\0';
+        if (oep) {
+            int64_t diff = (int64_t)(value - oep->value);
+
+            snprintf(d, sizeof(d), "%+" PRId64, diff);
+            if (secs_x1000 > 0)
+                snprintf(r, sizeof(r), "%.3f", (double)diff * 1000.0 /
+                         (double)secs_x1000);
+        }
+        if (jsp->pr_as_json) {
+            if (NULL == dsp->jap)
+                dsp->jap = sgj_named_subarray_r(jsp, jop,
+                                                "delta_parameter_list");
+            jo2p = sgj_new_unattached_object_r(jsp);
+            sgj_js_nv_ihex(jsp, jo2p, pg_c_sn, pg_code);
+            sgj_js_nv_ihex(jsp, jo2p, spg_c_sn, subpg_code);
+            if (lep)
+                sgj_js_nv_s(jsp, jo2p, "log_page_name", lep->name);
+            sgj_js_nv_ihex(jsp, jo2p, param_c_sn, pc);
+            sgj_js_nv_i(jsp, jo2p, "value", (int64_t)value);
+            if (oep)
+                sgj_js_nv_i(jsp, jo2p, "delta", (int64_t)(value - oep->value));
+            if (r[0])
+                sgj_js_nv_s(jsp, jo2p, "rate_per_second", r);
+            sgj_js_nv_o(jsp, dsp->jap, NULL /* name */, jo2p);
+        }
+        if (r[0])
+            sgj_pr_hr(jsp, "%s [%s] %s 0x%04x: %" PRIu64 " (%s, %s/sec)\n",
+                      lep ? lep->acron : "?", pg_s, param_c, pc, value, d,
+                      r);
+        else if (oep)
+            sgj_pr_hr(jsp, "%s [%s] %s 0x%04x: %" PRIu64 " (%s)\n",
+                      lep ? lep->acron : "?", pg_s, param_c, pc, value, d);
+        else
+            sgj_pr_hr(jsp, "%s [%s] %s 0x%04x: %" PRIu64 " (new)\n",
+                      lep ? lep->acron : "?", pg_s, param_c, pc, value);
+    }
+}
+
+/* Writes the values just fetched, and those from the previous state for
+ * pages not fetched this time, to op->delta_fn. Returns 0 on success. */
+static int
+delta_save(struct opts_t * op)
+{
+    bool ok = true;
+    int k, n, pg, spg;
+    FILE * fp;
+    struct delta_state_t * dsp = op->delta_sp;
+    uint8_t b[DELTA_HDR_LEN];
+    uint8_t e[DELTA_ENT_LEN];
+    char tmp[1024];
+
+    for (k = 0; k < dsp->old_num; ++k) {
+        pg = dsp->old_arr[k].key >> 24;
+        spg = (dsp->old_arr[k].key >> 16) & 0xff;
+        if (! (dsp->pg_seen[((pg << 8) | spg) >> 3] & (1 << (spg & 7))))
+            delta_add_new(dsp, dsp->old_arr[k].key, dsp->old_arr[k].value);
+    }
+    snprintf(tmp, sizeof(tmp), "%s.%d", op->delta_fn, (int)getpid());
+    fp = fopen(tmp, "wb");
+    if (NULL == fp) {
+        pr2serr("--delta: unable to create %s: %s\n", tmp,
+                safe_strerror(errno));
+        return SG_LIB_FILE_ERROR;
+    }
+    memset(b, 0, sizeof(b));
+    memcpy(b, DELTA_MAGIC, 4);
+    sg_put_unaligned_be16(DELTA_VERSION, b + 4);
+    sg_put_unaligned_be64(dsp->now_usecs, b + 8);
+    sg_put_unaligned_be32(dsp->new_num, b + 16);
+    if (1 != fwrite(b, sizeof(b), 1, fp))
+        ok = false;
+    for (k = 0, n = dsp->new_num; ok && (k < n); ++k) {
+        e[0] = dsp->new_arr[k].key >> 24;
+        e[1] = (dsp->new_arr[k].key >> 16) & 0xff;
+        sg_put_unaligned_be16(dsp->new_arr[k].key & 0xffff, e + 2);
+        sg_put_unaligned_be64(dsp->new_arr[k].value, e + 4);
+        if (1 != fwrite(e, sizeof(e), 1, fp))
+            ok = false;
+    }
+    if (fclose(fp))
+        ok = false;
+    if (ok && rename(tmp, op->delta_fn))
+        ok = false;
+    if (! ok) {
+        pr2serr("--delta: unable to write %s\n", op->delta_fn);
+        unlink(tmp);
+        return SG_LIB_FILE_ERROR;
+    }
+    if (op->verbose)
+        pr2serr("--delta: %d values saved, %d changed\n", dsp->new_num,
+                dsp->num_changed);
+    return 0;
+}
+
+static void
+delta_free(struct opts_t * op)
+{
+    struct delta_state_t * dsp = op->delta_sp;
+
+    if (NULL == dsp)
+        return;
+    free(dsp->old_arr);
+    free(dsp->new_arr);
+    memset(dsp, 0, sizeof(*dsp));
+}
+
+/* --watch=SECS keeps DEVICE open and repeats the fetch and decode of the
+ * requested log page(s) until SIGINT or SIGTERM arrives. Each poll starts
+ * with a short header line; with --json each poll is a separate JSON
+ * object (one line each when '--json=r' is given). */
+static volatile sig_atomic_t watch_stop;
+
+static void
+watch_sig_handler(int sig)
+{
+    if (sig) { }        /* suppress warning */
+    watch_stop = 1;
+}
+
+static void
+watch_poll_hdr(int poll_num, time_t t, struct opts_t * op, sgj_opaque_p jop)
+{
+    sgj_state * jsp = &op->json_st;
+    sgj_opaque_p jo2p;
+    struct tm * tmp = localtime(&t);
+    char b[64];
+
+    if ((NULL == tmp) || (0 == strftime(b, sizeof(b), "%F %T", tmp)))
+        snprintf(b, sizeof(b), "%" PRId64 "", (int64_t)t);
+    if (0 == op->do_raw)
+        sgj_pr_hr(jsp, "Poll %d at %s:\n", poll_num, b);
+    if (jsp->pr_as_json) {
+        jo2p = sgj_named_subobject_r(jsp, jop, "watch");
+        sgj_js_nv_i(jsp, jo2p, "interval_seconds", op->watch_secs);
+        sgj_js_nv_i(jsp, jo2p, "poll_number", poll_num);
+        sgj_js_nv_i(jsp, jo2p, "seconds_since_epoch", (int64_t)t);
+        sgj_js_nv_s(jsp, jo2p, "local_time", b);
+    }
+}
+
 static void
 decode_page_contents(const uint8_t * resp, int len, struct opts_t * op,
                      sgj_opaque_p jop)
@@ -9467,6 +10002,10 @@ decode_page_contents(const uint8_t * resp, int len, struct opts_t * op,
         pr2serr("%s: response has bad length: %d\n", __func__, len);
         return;
     }
+    if (op->delta_fn) {
+        delta_page(resp, len, op, jop);
+        return;
+    }
     spf = !!(resp[0] & 0x40);
     pg_code = resp[0] & 0x3f;
     if ((VP_HITA == op->vend_prod_num) && (pg_code >= 0x30))
@@ -9604,7 +10143,8 @@ decode_pg_arg(struct opts_t * op)
  * (excluding its 4 byte header) is returned.
  * Assumes both pages are in ascending order (as required by SPC-4). */
 static int
-merge_both_supported(const uint8_t * supp_pgs_p, int su_p_pg_len, int pg_len)
+merge_both_supported(uint8_t * rsp_buff, int rsp_buff_sz,
+                     const uint8_t * supp_pgs_p, int su_p_pg_len, int pg_len)
 {
     uint8_t pg;
     int k, kp, ks;
@@ -9652,18 +10192,29 @@ main(int argc, char * argv[])
 {
     bool as_json;
     int k, nn, pg_len, res, vb;
+    int poll_num = 0;
+    int watch_pg_code = 0;
+    int watch_subpg_code = 0;
     int resp_len = 0;
     int su_p_pg_len = 0;
     int in_len = -1;
     int sg_fd = -1;
     int ret = 0;
-    uint8_t * parr;
+    int rsp_buff_sz = MX_ALLOC_LEN + 4;
+    uint8_t * rsp_buff = NULL;
+    uint8_t * free_rsp_buff = NULL;
+    uint8_t * parr = NULL;
     uint8_t * free_parr = NULL;
+    time_t poll_t = 0;
+    FILE * watch_fp = NULL;
+    int fetch_num = 0;
+    struct lpg_fetch_t * fetch_arr = NULL;
     struct opts_t * op;
     sgj_state * jsp;
     sgj_opaque_p jop = NULL;
     struct sg_simple_inquiry_resp inq_out;
     struct opts_t opts SG_C_CPP_ZERO_INIT;
+    struct delta_state_t delta_st SG_C_CPP_ZERO_INIT;
     uint8_t supp_pgs_rsp[256];
     char b[128];
     static const int blen = sizeof(b);
@@ -9687,6 +10238,17 @@ main(int argc, char * argv[])
         usage_for(op->do_help, op);
         return 0;
     }
+    if (op->delta_fn)
+        op->delta_sp = &delta_st;
+    if (op->batch_fn) {
+        if (op->device_name || op->inhex_fn || op->js_file) {
+            pr2serr("--batch=MF cannot be used with a DEVICE, --inhex= or "
+                    "--js-file=\n");
+            return SG_LIB_CONTRADICT;
+        }
+        op->do_json = true;     /* each blob is output as a JSON line */
+    }
+    sgj_hr_buffered();
     jsp = &op->json_st;
     if (op->do_json) {
         if (! sgj_init_state(jsp, op->json_arg)) {
@@ -9710,6 +10272,8 @@ main(int argc, char * argv[])
         jop = sgj_start_r(MY_NAME, version_str, argc, argv, jsp);
     }
     as_json = jsp->pr_as_json;
+    op->hr_out = (! as_json) || jsp->pr_out_hr;
+    log_arr_idx_build();
 
 #ifdef DEBUG
     pr2serr("In DEBUG mode, ");
@@ -9731,6 +10295,18 @@ main(int argc, char * argv[])
         pr2serr("Version string: %s\n", version_str);
         return 0;
     }
+    if (op->batch_fn) {
+        struct sg_batch_item bi;
+
+        if (! sg_batch_run(op->batch_fn, op->num_parallel, &bi, &ret,
+                           op->verbose)) {
+            sgj_finish(jsp);
+            return ret;
+        }
+        op->inhex_fn = bi.fn;   /* now in a child, decoding one blob */
+        if (bi.as_binary >= 0)
+            op->do_raw = bi.as_binary;
+    }
     if (op->do_hex > 0) {
         if (op->do_hex > 2) {
             op->dstrhex_no_ascii = -1;
@@ -9984,6 +10560,25 @@ main(int argc, char * argv[])
             goto err_out;
         }
     }
+    if (op->delta_fn) {
+        if (op->do_select || op->do_raw || op->do_hex ||
+            op->do_temperature) {
+            pr2serr("--delta=SFN conflicts with --hex, --raw, --select and "
+                    "--temperature\n");
+            ret = SG_LIB_CONTRADICT;
+            goto err_out;
+        }
+        delta_load(op);
+    }
+    if (op->watch_secs > 0) {
+        if (op->do_select || op->do_raw || op->inhex_fn ||
+            (NULL == op->device_name)) {
+            pr2serr("--watch=SECS needs DEVICE and conflicts with --in=FN, "
+                    "--raw and --select\n");
+            ret = SG_LIB_CONTRADICT;
+            goto err_out;
+        }
+    }
     if (op->inhex_fn) {
         if (! op->do_select) {
             pr2serr("--in=FN can only be used with --select when DEVICE "
@@ -10056,10 +10651,10 @@ main(int argc, char * argv[])
             (0 == op->no_inq) && (0 == op->do_brief))
             sgj_pr_hr(jsp, "    %.8s  %.16s  %.4s\n", inq_out.vendor,
                       inq_out.product, inq_out.revision);
-        memcpy(t10_vendor_str, inq_out.vendor, 8);
-        memcpy(t10_product_str, inq_out.product, 16);
+        memcpy(op->t10_vendor_str, inq_out.vendor, 8);
+        memcpy(op->t10_product_str, inq_out.product, 16);
         if (VP_NONE == op->vend_prod_num)
-            op->deduced_vpn = find_vpn_by_inquiry();
+            op->deduced_vpn = find_vpn_by_inquiry(op);
     }
 
     if (op->do_temperature) {
@@ -10091,6 +10686,29 @@ main(int argc, char * argv[])
         ret = (k >= 0) ?  k : SG_LIB_CAT_OTHER;
         goto err_out;
     }
+    if (op->watch_secs > 0) {
+        watch_fp = stdout;
+        if (as_json && op->js_file &&
+            ((1 != strlen(op->js_file)) || ('-' != op->js_file[0]))) {
+            watch_fp = fopen(op->js_file, "w");   /* truncate if exists */
+            if (NULL == watch_fp) {
+                pr2serr("unable to open file: %s\n", op->js_file);
+                ret = SG_LIB_FILE_ERROR;
+                goto err_out;
+            }
+        }
+        signal(SIGINT, watch_sig_handler);
+        signal(SIGTERM, watch_sig_handler);
+        watch_pg_code = op->pg_code;
+        watch_subpg_code = op->subpg_code;
+    }
+watch_poll:
+    if (op->watch_secs > 0) {
+        op->pg_code = watch_pg_code;
+        op->subpg_code = watch_subpg_code;
+        poll_t = time(NULL);
+        watch_poll_hdr(++poll_num, poll_t, op, jop);
+    }
     if (op->do_list > 2) {
         const int supp_pgs_blen = sizeof(supp_pgs_rsp);
 
@@ -10158,11 +10776,12 @@ bad:
     else
         pr2serr("%sother error [%d]\n", ls_s, res);
     ret = res;
-    goto err_out;
+    goto poll_done;
 
 good:
     if (op->do_list > 2)
-        pg_len = merge_both_supported(supp_pgs_rsp + 4, su_p_pg_len, pg_len);
+        pg_len = merge_both_supported(rsp_buff, rsp_buff_sz, supp_pgs_rsp + 4,
+                                      su_p_pg_len, pg_len);
 
     if (0 == op->do_all) {
 #if 0
@@ -10197,7 +10816,8 @@ good:
         int my_len = pg_len;
         bool spf;
 
-        parr = sg_memalign(parr_sz, 0, &free_parr, false);
+        if (NULL == parr)       /* kept for the next poll of --watch */
+            parr = sg_memalign(parr_sz, 0, &free_parr, false);
         if (NULL == parr) {
             pr2serr("Unable to allocate heap for parr\n");
             ret = sg_convert_errno(ENOMEM);
@@ -10210,21 +10830,31 @@ good:
             my_len = parr_sz;
         }
         memcpy(parr, rsp_buff + 4, my_len);
+        if (op->num_parallel > 1) {
+            fetch_arr = fetch_all_parallel(sg_fd, parr, my_len, spf,
+                                           resp_len, op);
+            fetch_num = my_len;
+        }
         for (k = 0; k < my_len; ++k) {
+            int pg_k = k;
+
             op->pg_code = parr[k] & 0x3f;
             if (spf)
                 op->subpg_code = parr[++k];
             else
                 op->subpg_code = NOT_SPG_SUBPG;
 
-            /* Some devices include [pg_code, 0xff] for all pg_code > 0 */
-            if ((op->pg_code > 0) && (SUPP_SPGS_SUBPG == op->subpg_code))
-                continue;       /* skip since no new information */
-            if ((op->pg_code >= 0x30) && op->exclude_vendor)
+            if (skip_in_all(op->pg_code, op->subpg_code, op))
                 continue;
-            if (0 == op->do_raw)
+            if ((0 == op->do_raw) && (NULL == op->delta_fn))
                 sgj_pr_hr(jsp, "\n");
-            res = do_logs(sg_fd, rsp_buff, resp_len, op);
+            if (fetch_arr && fetch_arr[pg_k].wanted) {
+                res = fetch_arr[pg_k].res;
+                if (0 == res)
+                    memcpy(rsp_buff, fetch_arr[pg_k].resp,
+                           fetch_arr[pg_k].len);
+            } else
+                res = do_logs(sg_fd, rsp_buff, resp_len, op);
             if (0 == res) {
                 pg_len = sg_get_unaligned_be16(rsp_buff + 2);
                 if ((pg_len + 4) > resp_len) {
@@ -10274,7 +10904,36 @@ good:
                 pr2serr("%sfailed, try '-v' for more information\n", ls_s);
         }
     }
+    if (op->delta_fn && (0 == ret))
+        ret = delta_save(op);
+poll_done:
+    if ((op->watch_secs > 0) && (! watch_stop)) {
+        free_fetch_all(fetch_arr, fetch_num);
+        fetch_arr = NULL;
+        fetch_num = 0;
+        if (as_json) {
+            sgj_js2file(jsp, NULL, ret, watch_fp);
+            sgj_finish(jsp);
+        } else
+            sgj_pr_hr(jsp, "\n");
+        fflush(watch_fp);
+        if (op->delta_fn) {     /* this poll's values are the next baseline */
+            delta_free(op);
+            delta_load(op);
+        }
+        while ((! watch_stop) && ((time(NULL) - poll_t) < op->watch_secs))
+            sg_sleep_secs(1);
+        if (! watch_stop) {
+            if (as_json)
+                jop = sgj_start_r(MY_NAME, version_str, argc, argv, jsp);
+            ret = 0;
+            goto watch_poll;
+        }
+        as_json = false;        /* last poll already output */
+    }
 err_out:
+    free_fetch_all(fetch_arr, fetch_num);
+    delta_free(op);
     if (free_rsp_buff)
         free(free_rsp_buff);
     if (free_parr)
@@ -10287,9 +10946,9 @@ err_out:
                     "more information\n");
     }
     if (as_json) {
-        FILE * fp = stdout;
+        FILE * fp = watch_fp ? watch_fp : stdout;
 
-        if (op->js_file) {
+        if (op->js_file && (NULL == watch_fp)) {
             if ((1 != strlen(op->js_file)) || ('-' != op->js_file[0])) {
                 fp = fopen(op->js_file, "w");   /* truncate if exists */
                 if (NULL == fp) {
@@ -2,7 +2,7 @@
 #define SG_LOGS_H
 
 /*
- * Copyright (c) 2023 Douglas Gilbert.
+ * Copyright (c) 2023-2026 Douglas Gilbert.
  * All rights reserved.
  * Use of this source code is governed by a BSD-style
  * license that can be found in the BSD_LICENSE file.
@@ -119,6 +119,11 @@ struct log_elem {
                         /* Returns true if done */
 };
 
+struct delta_state_t;   /* private to sg_logs.c */
+
+/* All the state of one invocation: the decoders only use what they are
+ * given via this structure (and their resp arguments) so several opts_t
+ * instances may decode at the same time in different threads. */
 struct opts_t {
     bool do_full;
     bool do_json;
@@ -132,6 +137,7 @@ struct opts_t {
     bool do_transport;
     bool exclude_vendor;
     bool filter_given;
+    bool hr_out;        /* false when only JSON is output */
     bool maxlen_given;
     bool o_readonly;
     bool opt_new;
@@ -155,10 +161,14 @@ struct opts_t {
     int pg_code;
     int subpg_code;
     int paramp;
+    int num_parallel;   /* --all: LOG SENSE commands outstanding at once */
+    int watch_secs;     /* --watch=SECS poll interval, 0 for a single pass */
     int no_inq;
     int dev_pdt;        /* from device or --pdt=DT */
     int decod_subpg_code;
     int undefined_hex;  /* hex format of undefined/unrecognized fields */
+    const char * batch_fn;      /* --batch=MF manifest */
+    const char * delta_fn;      /* --delta=SFN state file */
     const char * device_name;
     const char * inhex_fn;
     const char * json_arg;
@@ -166,6 +176,9 @@ struct opts_t {
     const char * pg_arg;
     const char * vend_prod;
     const struct log_elem * lep;
+    struct delta_state_t * delta_sp;    /* non-NULL when --delta=SFN */
+    char t10_vendor_str[10];    /* from INQUIRY, for find_vpn_by_inquiry() */
+    char t10_product_str[18];
     sgj_state json_st;
 };
 
@@ -172,7 +172,7 @@ show_tape_usage_page(const uint8_t * resp, int len, struct opts_t * op,
         if (ccp)
             sgj_haj_vi(jsp, jo3p, 2, ccp, SGJ_SEP_COLON_1_SPACE, ull,
                        false);
-        if (op->do_pcb)
+        if (op->do_pcb && op->hr_out)
             sgj_pr_hr(jsp, "        <%s>\n", get_pcb_str(bp[2], b, blen));
         if (jsp->pr_as_json)
             sgj_js_nv_o(jsp, jap, NULL /* name */, jo3p);
@@ -295,7 +295,7 @@ show_hgst_perf_page(const uint8_t * resp, int len, struct opts_t * op,
             sgj_haj_vi(jsp, jo3p, 2, b, SGJ_SEP_SPACE_EQUAL_SPACE, pc, true);
             break;
         }
-        if (op->do_pcb)
+        if (op->do_pcb && op->hr_out)
             sgj_pr_hr(jsp, "        <%s>\n", get_pcb_str(bp[2], b, blen));
         if (jsp->pr_as_json)
             sgj_js_nv_o(jsp, jap, NULL /* name */, jo3p);
@@ -405,7 +405,7 @@ show_tape_capacity_page(const uint8_t * resp, int len,
                 sgj_js_nv_ihex_nex(jsp, jo3p, sgj_convert2snake(ccp, b, blen),
                                    u, false, "[unit: MibiByte]");
         }
-        if (op->do_pcb)
+        if (op->do_pcb && op->hr_out)
             sgj_pr_hr(jsp, "        <%s>\n", get_pcb_str(bp[2], b, blen));
         if (jsp->pr_as_json)
             sgj_js_nv_o(jsp, jap, NULL /* name */, jo3p);
@@ -559,7 +559,7 @@ show_data_compression_page(const uint8_t * resp, int len,
             sgj_js_nv_i(jsp, jo3p, "data_compression_counter", ull);
             sgj_js_nv_o(jsp, jap, NULL /* name */, jo3p);
         }
-        if (op->do_pcb)
+        if (op->do_pcb && op->hr_out)
             sgj_pr_hr(jsp, "        <%s>\n", get_pcb_str(bp[2], b, blen));
 skip_para:
         if (op->filter_given)
@@ -678,7 +678,7 @@ show_seagate_cache_page(const uint8_t * resp, int len,
                 jcp = b;
             }
             sgj_js_nv_ihex(jsp, jo3p, jcp, ull);
-            if (op->do_pcb)
+            if (op->do_pcb && op->hr_out)
                 sgj_pr_hr(jsp, "        <%s>\n", get_pcb_str(bp[2], b, blen));
         }
         if (jsp->pr_as_json)
@@ -789,7 +789,7 @@ show_seagate_farm_page(const uint8_t * resp, int len,
         default:
             break;
         }
-        if (op->do_pcb)
+        if (op->do_pcb && op->hr_out)
             sgj_pr_hr(jsp, "        <%s>\n", get_pcb_str(bp[2], b, blen));
         if (jsp->pr_as_json)
             sgj_js_nv_o(jsp, jap, NULL /* name */, jo3p);
@@ -896,7 +896,7 @@ show_hgst_misc_page(const uint8_t * resp, int len, struct opts_t * op,
             sgj_haj_vi(jsp, jo2p, 2, b, SGJ_SEP_SPACE_EQUAL_SPACE, pc, false);
             break;
         }
-        if (op->do_pcb)
+        if (op->do_pcb && op->hr_out)
             sgj_pr_hr(jsp, "        <%s>\n", get_pcb_str(bp[2], b, blen));
 filter_chk:
         if (op->filter_given)
@@ -990,7 +990,7 @@ show_seagate_factory_page(const uint8_t * resp, int len,
 
         if (jsp->pr_as_json)
             sgj_js_nv_o(jsp, jap, NULL /* name */, jo3p);
-        if (op->do_pcb)
+        if (op->do_pcb && op->hr_out)
             sgj_pr_hr(jsp, "        <%s>\n", get_pcb_str(bp[2], b, blen));
 filter_chk:
         if (op->filter_given)
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2004-2023 Douglas Gilbert.
+ * Copyright (c) 2004-2026 Douglas Gilbert.
  * All rights reserved.
  * Use of this source code is governed by a BSD-style
  * license that can be found in the BSD_LICENSE file.
@@ -22,9 +22,15 @@
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
+#ifdef SG_LIB_LINUX
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#endif
 #include "sg_lib.h"
 #include "sg_cmds_basic.h"
 #include "sg_unaligned.h"
+#include "sg_par.h"
 #include "sg_pr2serr.h"
 #include "sg_json_sg_lib.h"
 
@@ -32,20 +38,29 @@
  *
  *
  * This program issues the SCSI REPORT LUNS command to the given SCSI device
- * and decodes the response.
+ * and decodes the response. In Linux it can then probe each reported LU
+ * with INQUIRY commands (see --probe=VP).
  */
 
-static const char * version_str = "1.58 20230519";      /* spc6r08 */
+static const char * version_str = "1.60 20261015";      /* spc6r08 */
 
 #define MY_NAME "sg_luns"
 
 #define MAX_RLUNS_BUFF_LEN (1024 * 1024)
 #define DEF_RLUNS_BUFF_LEN (1024 * 8)
 
+#define STD_INQ_RESP_LEN 96
+#define LUN_VPD_RESP_LEN 2048
+#define VPD_SN 0x80
+#define VPD_DI 0x83
+#define LUNS_MAX_PARALLEL 128
+#define LUNS_DEF_PARALLEL 16
+
 struct opts_t {
     bool do_json;
 #ifdef SG_LIB_LINUX
     bool do_linux;
+    bool do_probe;
 #endif
     bool do_quiet;
     bool do_raw;
@@ -61,6 +76,8 @@ struct opts_t {
     int do_hex;
     int lu_cong_arg;
     int maxlen;
+    int num_parallel;   /* --parallel=Q */
+    int probe_pg;       /* VPD page for --probe=VP, -1 for none */
     int decode_arg;
     int select_rep;
     int verbose;
@@ -90,6 +107,10 @@ static struct option long_options[] = {
     {"lu_cong", no_argument, 0, 'L'},
     {"lu-cong", no_argument, 0, 'L'},
     {"maxlen", required_argument, 0, 'm'},
+#ifdef SG_LIB_LINUX
+    {"parallel", required_argument, 0, 'p'},
+    {"probe", required_argument, 0, 'P'},
+#endif
     {"quiet", no_argument, 0, 'q'},
     {"raw", no_argument, 0, 'r'},
     {"readonly", no_argument, 0, 'R'},
@@ -113,11 +134,11 @@ usage()
             "[--inner-hex]\n"
             "                  [--json[=JO]] [--js-file=JFN] [--linux] "
             "[--lu_cong]\n"
-            "                  [--maxlen=LEN] [--quiet] [--raw] "
-            "[--readonly]\n"
-            "                  [--select=SR] [--sinq_inraw=RFN] [--verbose] "
-            "[--version]\n"
-            "                  DEVICE\n");
+            "                  [--maxlen=LEN] [--parallel=Q] [--probe=VP] "
+            "[--quiet]\n"
+            "                  [--raw] [--readonly] "
+            "[--select=SR] [--sinq_inraw=RFN]\n"
+            "                  [--verbose] [--version] DEVICE\n");
 #else
     pr2serr("Usage: sg_luns    [--decode] [--help] [--hex] [--inhex-FN] "
             "[--inner-hex]\n"
@@ -159,8 +180,22 @@ usage()
             "                       decode as if LU_CONG is clear\n"
             "    --maxlen=LEN|-m LEN    max response length (allocation "
             "length in cdb)\n"
-            "                           (def: 0 -> %d bytes)\n"
-            "    --quiet|-q         output only ASCII hex lun values\n"
+            "                           (def: 0 -> %d bytes)\n",
+            DEF_RLUNS_BUFF_LEN);
+#ifdef SG_LIB_LINUX
+    pr2serr("    --parallel=Q|-p Q    with --probe=VP, send to up to Q LUs "
+            "at once\n"
+            "                         (def: %d)\n"
+            "    --probe=VP|-P VP    after REPORT LUNS send a standard "
+            "INQUIRY and\n"
+            "                        INQUIRY for VPD page VP to each "
+            "reported LU,\n"
+            "                        found via its Linux h:c:t:l; VP may "
+            "be 'sn',\n"
+            "                        'di' or 'std' (no VPD page)\n",
+            LUNS_DEF_PARALLEL);
+#endif
+    pr2serr("    --quiet|-q         output only ASCII hex lun values\n"
             "    --raw|-r           output response in binary\n"
             "    --readonly|-R      open DEVICE read-only (def: read-write)\n"
             "    --select=SR|-s SR    select report SR (def: 0)\n"
@@ -187,7 +222,7 @@ usage()
             "well known logical unit;\nwhen SR is 0x12 DEVICE must be an "
             "administrative logical unit. When the\n--test=ALUN option is "
             "given, decodes ALUN rather than sending a REPORT\nLUNS "
-            "command.\n", DEF_RLUNS_BUFF_LEN );
+            "command.\n");
 }
 
 /* Decoded according to SAM-5 rev 10. Note that one draft: BCC rev 0,
@@ -460,6 +495,305 @@ dStrRaw(const char * str, int len)
         printf("%c", str[k]);
 }
 
+#ifdef SG_LIB_LINUX
+
+struct lun_probe_t {
+    uint8_t lun[8];
+    uint64_t lin_lun;
+    int res;            /* 0, SG_LIB_CAT_* or SG_LIB_FILE_ERROR if no node */
+    int inq_len;
+    int vpd_len;        /* 0 if the VPD page was not fetched */
+    char dev_name[80];
+    uint8_t inq[STD_INQ_RESP_LEN];
+    uint8_t vpd[LUN_VPD_RESP_LEN];
+};
+
+struct lun_work_t {
+    int hctl[3];        /* host, channel and target of DEVICE */
+    int vpd_pg;
+    int num_luns;
+    int verbose;
+    struct lun_probe_t * pr_arr;
+};
+
+/* Finds the Linux <host>:<channel>:<target> of the open sg_fd via sysfs.
+ * Returns true if found. */
+static bool
+lun_dev_hctl(int sg_fd, int hctl[3], int vb)
+{
+    int res;
+    uint64_t ull;
+    const char * cp;
+    struct stat st;
+    char fn[128];
+    char b[256];
+
+    if (fstat(sg_fd, &st) < 0)
+        return false;
+    snprintf(fn, sizeof(fn), "/sys/dev/%s/%u:%u/device",
+             (S_ISBLK(st.st_mode) ? "block" : "char"), major(st.st_rdev),
+             minor(st.st_rdev));
+    res = readlink(fn, b, sizeof(b) - 1);
+    if (res < 0) {
+        if (vb)
+            pr2serr("readlink(%s): %s\n", fn, safe_strerror(errno));
+        return false;
+    }
+    b[res] = '\0';
+    cp = strrchr(b, '/');
+    cp = cp ? cp + 1 : b;
+    if (4 != sscanf(cp, "%d:%d:%d:%" SCNu64, hctl + 0, hctl + 1, hctl + 2,
+                    &ull)) {
+        if (vb)
+            pr2serr("%s: unexpected link: %s\n", __func__, b);
+        return false;
+    }
+    if (vb > 1)
+        pr2serr("DEVICE is Linux %d:%d:%d:%" PRIu64 "\n", hctl[0], hctl[1],
+                hctl[2], ull);
+    return true;
+}
+
+/* Places the name of a device node (sg preferred, else block) of the LU
+ * at <h:c:t:lin_lun> in b. Returns true if the LU has such a node. */
+static bool
+lun_node(const int hctl[3], uint64_t lin_lun, char * b, int blen)
+{
+    int k, n;
+    bool found = false;
+    DIR * dp;
+    struct dirent * dep;
+    char fn[192];
+    static const char * subdir_arr[] = {"scsi_generic", "block"};
+
+    for (k = 0; (! found) && (k < (int)SG_ARRAY_SIZE(subdir_arr)); ++k) {
+        n = snprintf(fn, sizeof(fn), "/sys/bus/scsi/devices/%d:%d:%d:%"
+                     PRIu64 "/%s", hctl[0], hctl[1], hctl[2], lin_lun,
+                     subdir_arr[k]);
+        if ((n >= (int)sizeof(fn)) || (NULL == (dp = opendir(fn))))
+            continue;
+        while ((dep = readdir(dp))) {
+            if ('.' == dep->d_name[0])
+                continue;
+            snprintf(b, blen, "/dev/%.64s", dep->d_name);
+            found = true;
+            break;
+        }
+        closedir(dp);
+    }
+    return found;
+}
+
+/* Sends a standard INQUIRY then, if asked, an INQUIRY for a VPD page to
+ * one LU */
+static int
+lun_probe(struct lun_work_t * wp, struct lun_probe_t * pp)
+{
+    int sg_fd, res, len;
+    int ret = 0;
+    int vb = wp->verbose;
+
+    if (0xc1 == pp->lun[0])     /* W-LUNs are probably not scanned */
+        return 0;
+    if (! lun_node(wp->hctl, pp->lin_lun, pp->dev_name,
+                   sizeof(pp->dev_name)))
+        return SG_LIB_FILE_ERROR;
+    sg_fd = sg_cmds_open_device(pp->dev_name, true /* ro */, vb);
+    if (sg_fd < 0) {
+        if (vb)
+            pr2serr("%s: open error: %s\n", pp->dev_name,
+                    safe_strerror(-sg_fd));
+        return sg_convert_errno(-sg_fd);
+    }
+    ret = sg_ll_inquiry(sg_fd, false, false, 0, pp->inq, sizeof(pp->inq),
+                        false, vb);
+    if (ret)
+        goto fini;
+    len = pp->inq[4] + 5;
+    pp->inq_len = (len < (int)sizeof(pp->inq)) ? len : (int)sizeof(pp->inq);
+    if (wp->vpd_pg >= 0) {
+        ret = sg_ll_inquiry(sg_fd, false, true /* evpd */, wp->vpd_pg,
+                            pp->vpd, sizeof(pp->vpd), false, vb);
+        if (ret)
+            goto fini;
+        len = sg_get_unaligned_be16(pp->vpd + 2) + 4;
+        if (pp->vpd[1] != wp->vpd_pg) {
+            if (vb)
+                pr2serr("%s: asked for VPD page 0x%x, got 0x%x\n",
+                        pp->dev_name, wp->vpd_pg, pp->vpd[1]);
+            ret = SG_LIB_CAT_MALFORMED;
+            goto fini;
+        }
+        pp->vpd_len = (len < (int)sizeof(pp->vpd)) ? len :
+                                                     (int)sizeof(pp->vpd);
+    }
+fini:
+    res = sg_cmds_close_device(sg_fd);
+    if ((res < 0) && (0 == ret))
+        ret = sg_convert_errno(-res);
+    return ret;
+}
+
+/* Probes the k-th LU, called once for each k by sg_par_each() */
+static int
+lun_probe_one(int64_t k, void * ctx)
+{
+    int res;
+    struct lun_work_t * wp = (struct lun_work_t *)ctx;
+
+    res = lun_probe(wp, wp->pr_arr + k);
+    wp->pr_arr[k].res = (res >= 0) ? res : SG_LIB_CAT_OTHER;
+    return 0;
+}
+
+/* Outputs a short summary of a VPD page for the inventory line */
+static void
+lun_vpd_str(const struct lun_probe_t * pp, int vpd_pg, char * b, int blen)
+{
+    int k, off, len;
+    const uint8_t * dp;
+    static const int lu_desig_types[] = {3, 2, 8, 1};
+
+    b[0] = '\0';
+    len = pp->vpd_len - 4;
+    if (len < 0)
+        return;
+    if (VPD_SN == vpd_pg) {
+        snprintf(b, blen, "serial=%.*s", len, (const char *)(pp->vpd + 4));
+        return;
+    }
+    if (VPD_DI == vpd_pg) {
+        /* association 0 is the logical unit */
+        for (k = 0; k < (int)SG_ARRAY_SIZE(lu_desig_types); ++k) {
+            off = -1;
+            if (0 == sg_vpd_dev_id_iter(pp->vpd + 4, len, &off, 0,
+                                        lu_desig_types[k], -1))
+                break;
+        }
+        if (k >= (int)SG_ARRAY_SIZE(lu_desig_types))
+            return;
+        dp = pp->vpd + 4 + off;
+        len = dp[3];
+        if ((3 == (dp[0] & 0xf)) || (2 == (dp[0] & 0xf))) {
+            snprintf(b, blen, "lu_id=%.*s", len, (const char *)(dp + 4));
+            return;
+        }
+        off = snprintf(b, blen, "lu_id=0x");
+        for (k = 0; (k < len) && (off < (blen - 2)); ++k)
+            off += snprintf(b + off, blen - off, "%02x", dp[4 + k]);
+        return;
+    }
+    snprintf(b, blen, "vpd_0x%x: %d bytes", vpd_pg, pp->vpd_len);
+}
+
+/* Probes each of the luns reported (in rl_buff) with up to num_q at once,
+ * then outputs an inventory line (or JSON object) per LU. Returns 0 if all
+ * LUs were probed, else the result of the first one that failed. */
+static int
+lun_inventory(int sg_fd, const uint8_t * rl_buff, int luns,
+              struct opts_t * op, sgj_opaque_p jop)
+{
+    int k, m, n;
+    int ret = 0;
+    struct lun_probe_t * pp;
+    struct lun_probe_t * pr_arr;
+    sgj_state * jsp = &op->json_st;
+    sgj_opaque_p jo2p;
+    sgj_opaque_p jo3p;
+    sgj_opaque_p jap;
+    struct lun_work_t work;
+    char b[160];
+    char d[80];
+    static const int blen = sizeof(b);
+
+    memset(&work, 0, sizeof(work));
+    if (! lun_dev_hctl(sg_fd, work.hctl, op->verbose)) {
+        pr2serr("--probe: unable to find Linux h:c:t:l of %s\n",
+                op->device_name);
+        return SG_LIB_FILE_ERROR;
+    }
+    if (luns < 1)
+        return 0;
+    pr_arr = (struct lun_probe_t *)calloc(luns, sizeof(*pr_arr));
+    if (NULL == pr_arr) {
+        pr2serr("%s: out of memory\n", __func__);
+        return sg_convert_errno(ENOMEM);
+    }
+    for (k = 0, pp = pr_arr; k < luns; ++k, ++pp) {
+        memcpy(pp->lun, rl_buff + 8 + (8 * k), 8);
+        pp->lin_lun = t10_2linux_lun(pp->lun);
+    }
+    work.vpd_pg = op->probe_pg;
+    work.num_luns = luns;
+    work.verbose = op->verbose;
+    work.pr_arr = pr_arr;
+    if (op->verbose > 1)
+        pr2serr("%s: %d LUs, %d threads\n", __func__, luns,
+                (op->num_parallel < luns) ? op->num_parallel : luns);
+    sg_par_each(luns, op->num_parallel, lun_probe_one, &work);
+
+    jo2p = sgj_named_subobject_r(jsp, jop, "lun_inventory");
+    sgj_js_nv_ihex(jsp, jo2p, "vpd_page_code", op->probe_pg);
+    jap = sgj_named_subarray_r(jsp, jo2p, "inventory_list");
+    if (op->probe_pg >= 0)
+        sgj_pr_hr(jsp, "Inventory [VPD page 0x%x]:\n", op->probe_pg);
+    else
+        sgj_pr_hr(jsp, "Inventory:\n");
+    for (k = 0, pp = pr_arr; k < luns; ++k, ++pp) {
+        jo3p = sgj_new_unattached_object_r(jsp);
+        sgj_js_nv_hex_bytes(jsp, jo3p, "lun", pp->lun, 8);
+        sgj_js_nv_ihex(jsp, jo3p, "linux_lun", pp->lin_lun);
+        n = sg_scnpr(b, blen, "    ");
+        for (m = 0; m < 8; ++m)
+            n += sg_scn3pr(b, blen, n, "%02x", pp->lun[m]);
+        n += sg_scn3pr(b, blen, n, "  [%" PRIu64 "]", pp->lin_lun);
+        if (pp->dev_name[0])
+            sgj_js_nv_s(jsp, jo3p, "device_name", pp->dev_name);
+        if (0xc1 == pp->lun[0]) {
+            sgj_pr_hr(jsp, "%s  well known LU, not probed\n", b);
+        } else if (SG_LIB_FILE_ERROR == pp->res) {
+            sgj_pr_hr(jsp, "%s  no Linux device node\n", b);
+        } else if (pp->res) {
+            sg_get_category_sense_str(pp->res, sizeof(d), d, op->verbose);
+            sgj_pr_hr(jsp, "%s  %s: failed: %s\n", b, pp->dev_name, d);
+        } else {
+            sgj_js_nv_ihex(jsp, jo3p, "peripheral_qualifier",
+                           (pp->inq[0] >> 5) & 0x7);
+            sgj_js_nv_ihex(jsp, jo3p, "peripheral_device_type",
+                           pp->inq[0] & 0x1f);
+            if (pp->inq_len >= 36) {
+                sgj_js_nv_s_len_chk(jsp, jo3p, "t10_vendor_identification",
+                                    pp->inq + 8, 8);
+                sgj_js_nv_s_len_chk(jsp, jo3p, "product_identification",
+                                    pp->inq + 16, 16);
+                sgj_js_nv_s_len_chk(jsp, jo3p, "product_revision_level",
+                                    pp->inq + 32, 4);
+                n += sg_scn3pr(b, blen, n, "  %s  %.8s  %.16s  %.4s",
+                               pp->dev_name, (const char *)(pp->inq + 8),
+                               (const char *)(pp->inq + 16),
+                               (const char *)(pp->inq + 32));
+            } else
+                n += sg_scn3pr(b, blen, n, "  %s  pdt=0x%x", pp->dev_name,
+                               pp->inq[0] & 0x1f);
+            if (pp->vpd_len > 0) {
+                sgj_js_nv_hex_bytes(jsp, jo3p, "vpd_page", pp->vpd,
+                                    pp->vpd_len);
+                lun_vpd_str(pp, op->probe_pg, d, sizeof(d));
+                if (d[0])
+                    sg_scn3pr(b, blen, n, "  %s", d);
+            }
+            sgj_pr_hr(jsp, "%s\n", b);
+        }
+        sgj_js_nv_i(jsp, jo3p, "exit_status", pp->res);
+        sgj_js_nv_o(jsp, jap, NULL /* name */, jo3p);
+        if (pp->res && (0 == ret))
+            ret = pp->res;
+    }
+    free(pr_arr);
+    return ret;
+}
+#endif  /* SG_LIB_LINUX */
+
 /* Handles short options after '-j' including a sequence of short options
  * that include one 'j' (for JSON). Want optional argument to '-j' to be
  * prefixed by '='. Return 0 for good, SG_LIB_SYNTAX_ERROR for syntax error
@@ -486,7 +820,7 @@ chk_short_opts(const char sopt_ch, struct opts_t * op)
         break;  /* simply ignore second 'j' (e.g. '-jxj') */
 #ifdef SG_LIB_LINUX
     case 'l':
-        op->do_linux = false;
+        op->do_linux = true;
         break;
 #endif
     case 'L':
@@ -544,13 +878,15 @@ main(int argc, char * argv[])
     static const int blen = sizeof(b);
 
     op = &opts;
+    op->probe_pg = -1;
+    op->num_parallel = LUNS_DEF_PARALLEL;
     if (getenv("SG3_UTILS_INVOCATION"))
         sg_rep_invocation(MY_NAME, version_str, argc, argv, stderr);
     while (1) {
         int option_index = 0;
 
 #ifdef SG_LIB_LINUX
-        c = getopt_long(argc, argv, "^dhHi:Ij::J:lLm:qQ:rRs:t:vV",
+        c = getopt_long(argc, argv, "^dhHi:Ij::J:lLm:p:P:qQ:rRs:t:vV",
                         long_options, &option_index);
 #else
         c = getopt_long(argc, argv, "^dhHi:Ij::J:Lm:qQ:rRs:t:vV",
@@ -606,7 +942,30 @@ main(int argc, char * argv[])
             break;
 #ifdef SG_LIB_LINUX
         case 'l':
-            op->do_linux = false;
+            op->do_linux = true;
+            break;
+        case 'p':
+            op->num_parallel = sg_par_get_num(optarg, 1,
+                                              LUNS_MAX_PARALLEL);
+            if (op->num_parallel < 0)
+                return SG_LIB_SYNTAX_ERROR;
+            break;
+        case 'P':
+            op->do_probe = true;
+            if (0 == strcmp(optarg, "sn"))
+                op->probe_pg = VPD_SN;
+            else if (0 == strcmp(optarg, "di"))
+                op->probe_pg = VPD_DI;
+            else if (0 == strcmp(optarg, "std"))
+                op->probe_pg = -1;
+            else {
+                op->probe_pg = sg_get_num(optarg);
+                if ((op->probe_pg < 0) || (op->probe_pg > 255)) {
+                    pr2serr("bad argument to '--probe=', expect 0 to 255, "
+                            "'sn', 'di' or 'std'\n");
+                    return SG_LIB_SYNTAX_ERROR;
+                }
+            }
             break;
 #endif
         case 'L':
@@ -816,6 +1175,14 @@ main(int argc, char * argv[])
         return SG_LIB_SYNTAX_ERROR;
     }
 
+#ifdef SG_LIB_LINUX
+    if (op->do_probe && (op->inhex_fn || op->do_raw || op->do_hex ||
+                         op->do_quiet)) {
+        pr2serr("--probe=VP needs a DEVICE and cannot be used with --hex, "
+                "--inhex=,\n--quiet or --raw\n");
+        return SG_LIB_CONTRADICT;
+    }
+#endif
     if (op->do_raw) {
         if (sg_set_binary_mode(STDOUT_FILENO) < 0) {
             perror("sg_set_binary_mode");
@@ -977,6 +1344,10 @@ main(int argc, char * argv[])
                 decode_lun("      ", reportLunsBuff + off, op, jo3p);
             sgj_js_nv_o(jsp, jap, NULL /* name */, jo3p);
         }
+#ifdef SG_LIB_LINUX
+        if (op->do_probe)
+            ret = lun_inventory(sg_fd, reportLunsBuff, luns, op, jop);
+#endif
     } else if (SG_LIB_CAT_INVALID_OP == ret)
         pr2serr("Report Luns command not supported (support mandatory in "
                 "SPC-3)\n");
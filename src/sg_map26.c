@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2005-2023 Douglas Gilbert.
+ * Copyright (c) 2005-2026 Douglas Gilbert.
  * All rights reserved.
  * Use of this source code is governed by a BSD-style
  * license that can be found in the BSD_LICENSE file.
@@ -13,6 +13,8 @@
  * This program maps a primary SCSI device node name to the corresponding
  * SCSI generic device node name (or vice versa). Targets Linux
  * kernel 2.6, 3 and 4 series. Sysfs device names can also be mapped.
+ * Many DEVICEs can be mapped by one invocation, answered from a map built
+ * in one pass (and optionally cached in a file).
  */
 
 /* #define _XOPEN_SOURCE 500 */
@@ -47,7 +49,7 @@
 #endif
 #include "sg_lib.h"
 
-static const char * version_str = "1.21 20230414";
+static const char * version_str = "1.22 20261014";
 
 #define ME "sg_map26: "
 
@@ -112,6 +114,8 @@ static const char * def_dev_dir = "/dev";
 
 
 static struct option long_options[] = {
+        {"all", no_argument, 0, 'a'},
+        {"cache", required_argument, 0, 'c'},
         {"dev_dir", required_argument, 0, 'd'},
         {"given_is", required_argument, 0, 'g'},
         {"help", no_argument, 0, 'h'},
@@ -158,15 +162,26 @@ pr2serr(const char * fmt, ...)
 static void
 usage()
 {
-        pr2serr("Usage: sg_map26 [--dev_dir=DIR] [--given_is=0..1] [--help] "
-                "[--result=0..3]\n"
-                "                [--symlink] [--verbose] [--version] "
-                "DEVICE\n"
+        pr2serr("Usage: sg_map26 [--all] [--cache=FN] [--dev_dir=DIR] "
+                "[--given_is=0..1]\n"
+                "                [--help] [--result=0..3] [--symlink] "
+                "[--verbose]\n"
+                "                [--version] [DEVICE...]\n"
                 "  where:\n"
+                "    --all | -a        list every sg and NVMe generic "
+                "device with the\n"
+                "                      device, bsg device and H:C:T:L it "
+                "maps to\n"
+                "    --cache=FN | -c FN    keep the map in file FN, it is "
+                "rebuilt when\n"
+                "                          hotplug events or DIR changes "
+                "make it stale\n"
                 "    --dev_dir=DIR | -d DIR    search in DIR for "
                 "resulting special\n"
                 "                            (def: directory of DEVICE "
-                "or '/dev')\n"
+                "or '/dev'; '/dev'\n"
+                "                            when --all, --cache= or "
+                "several DEVICEs)\n"
                 "    --given_is=0..1 | -g 0..1    variety of given "
                 "DEVICE\n"
                 "                                 0->block or char special "
@@ -189,7 +204,10 @@ usage()
                 "    --version | -V    print version string and exit\n\n"
                 "Maps SCSI device node to corresponding generic node (and "
                 "vv). Users may\nfind the lsscsi utility more convenient "
-                "as it doesn't need root\npermissions.\n"
+                "as it doesn't need root\npermissions. When several "
+                "DEVICEs are given each output line starts\nwith the "
+                "DEVICE and all are answered from a map built in one "
+                "pass.\n"
                 );
 }
 
@@ -1186,6 +1204,682 @@ skip:
         return 0;
 }
 
+/* Topology map used by --all, --cache=FN and when several DEVICEs are
+ * given. It is built with one pass over the sg (and NVMe generic) sysfs
+ * classes plus one scan of the device directory (and its bsg
+ * sub-directory). Then each query is answered from hash tables rather than
+ * by rescanning directories. */
+
+#define MAP_HASH_SZ 1024        /* must be a power of 2 */
+#define MAP_CACHE_HDR "# sg_map26 cache v1"
+
+struct map_row_t {
+        int sg_ma;      /* sg (or NVMe generic) char device */
+        int sg_mi;
+        int o_ft;       /* FT_BLOCK or FT_CHAR, FT_OTHER if no mapping */
+        int o_ma;       /* sd, sr, st, osst, ch or nvme device */
+        int o_mi;
+        int bsg_ma;     /* -1 if no bsg device */
+        int bsg_mi;
+        char hctl[NAME_LEN_MAX];        /* empty for NVMe */
+        char sg_sys[D_NAME_LEN_MAX];    /* resolved sysfs paths */
+        char o_sys[D_NAME_LEN_MAX];
+};
+
+struct map_ent_t {      /* element of a hash chain */
+        struct map_ent_t * next;
+        bool symlnk;    /* node found via a symlink */
+        int ft;
+        int ma;
+        int mi;
+        int row;        /* index into map_rows, -1 for a device node */
+        char * name;    /* device node name, NULL for row keys */
+};
+
+static struct map_row_t * map_rows;
+static int map_num_rows;
+static int map_max_rows;
+static struct map_ent_t * node_hash[MAP_HASH_SZ];
+static struct map_ent_t * row_hash[MAP_HASH_SZ];
+
+static const char * sys_bsg_dir = "/sys/class/bsg/";
+static const char * sys_ng_dir = "/sys/class/nvme-generic/";
+static const char * uevent_seqnum_fn = "/sys/kernel/uevent_seqnum";
+
+static int
+map_hash_idx(int ft, int ma, int mi)
+{
+        unsigned int h = ((unsigned int)ma * 2654435761U) ^ (unsigned int)mi;
+
+        return (int)(((h * 2) + (FT_BLOCK == ft)) & (MAP_HASH_SZ - 1));
+}
+
+/* Tape devices have several minors (e.g. st0 and nst0) for each drive */
+static int
+map_norm_minor(int ma, int mi)
+{
+        int nt = nt_typ_from_major(ma);
+
+        return ((NT_ST == nt) || (NT_OSST == nt)) ? (int)TAPE_NR(mi) : mi;
+}
+
+/* Appends to the chain so device nodes keep their directory order.
+ * Returns false if out of memory. */
+static bool
+map_add(struct map_ent_t ** hash, int ft, int ma, int mi, int row,
+        bool symlnk, const char * name)
+{
+        struct map_ent_t * ep;
+        struct map_ent_t ** epp;
+
+        ep = (struct map_ent_t *)calloc(1, sizeof(*ep));
+        if (NULL == ep)
+                return false;
+        if (name && (NULL == (ep->name = strdup(name)))) {
+                free(ep);
+                return false;
+        }
+        ep->ft = ft;
+        ep->ma = ma;
+        ep->mi = mi;
+        ep->row = row;
+        ep->symlnk = symlnk;
+        for (epp = hash + map_hash_idx(ft, ma, mi); *epp;
+             epp = &(*epp)->next)
+                ;
+        *epp = ep;
+        return true;
+}
+
+/* Returns the first element after ep (or the first when ep is NULL)
+ * matching ft, ma and mi, else NULL. */
+static struct map_ent_t *
+map_next(struct map_ent_t ** hash, struct map_ent_t * ep, int ft, int ma,
+         int mi)
+{
+        ep = ep ? ep->next : hash[map_hash_idx(ft, ma, mi)];
+        for ( ; ep; ep = ep->next) {
+                if ((ep->ft == ft) && (ep->ma == ma) && (ep->mi == mi))
+                        return ep;
+        }
+        return NULL;
+}
+
+static void
+map_free(void)
+{
+        int k, j;
+        struct map_ent_t * ep;
+        struct map_ent_t * nxt;
+        struct map_ent_t ** hash;
+
+        for (j = 0; j < 2; ++j) {
+                hash = j ? row_hash : node_hash;
+                for (k = 0; k < MAP_HASH_SZ; ++k) {
+                        for (ep = hash[k]; ep; ep = nxt) {
+                                nxt = ep->next;
+                                free(ep->name);
+                                free(ep);
+                        }
+                        hash[k] = NULL;
+                }
+        }
+        free(map_rows);
+        map_rows = NULL;
+        map_num_rows = 0;
+        map_max_rows = 0;
+}
+
+static struct map_row_t *
+map_new_row(void)
+{
+        struct map_row_t * rp;
+
+        if (map_num_rows >= map_max_rows) {
+                int n = map_max_rows ? (2 * map_max_rows) : 64;
+
+                rp = (struct map_row_t *)realloc(map_rows, n * sizeof(*rp));
+                if (NULL == rp)
+                        return NULL;
+                map_rows = rp;
+                map_max_rows = n;
+        }
+        rp = map_rows + map_num_rows++;
+        memset(rp, 0, sizeof(*rp));
+        rp->o_ft = FT_OTHER;
+        rp->bsg_ma = -1;
+        rp->bsg_mi = -1;
+        return rp;
+}
+
+/* Return 1 if the 'dev' attribute in dir_name was decoded, else 0 */
+static int
+map_get_dev(const char * dir_name, int * map, int * mip)
+{
+        char value[NAME_LEN_MAX];
+
+        if (! get_value(dir_name, "dev", value, sizeof(value)))
+                return 0;
+        return (2 == sscanf(value, "%d:%d", map, mip)) ? 1 : 0;
+}
+
+static void
+map_realpath(const char * path, char * b, int blen)
+{
+        char * cp = realpath(path, NULL);
+
+        snprintf(b, blen, "%s", cp ? cp : path);
+        free(cp);
+}
+
+/* Adds the block or char device nodes in dir_name to node_hash. Returns
+ * 0 on success, 1 if out of memory, else a negated errno. */
+static int
+map_scan_nodes(const char * dir_name, int verbose)
+{
+        bool symlnk;
+        int ft;
+        DIR * dirp;
+        struct dirent * dp;
+        struct stat st;
+        char name[D_NAME_LEN_MAX];
+
+        if (NULL == (dirp = opendir(dir_name))) {
+                if (verbose)
+                        pr2serr("opendir: %s %s\n", dir_name,
+                                ssafe_strerror(errno));
+                return -errno;
+        }
+        while ((dp = readdir(dirp))) {
+                symlnk = false;
+                switch (dp->d_type) {
+                case DT_BLK:
+                case DT_CHR:
+                        break;
+                case DT_LNK:
+                        symlnk = true;
+                        break;
+                default:
+                        continue;
+                }
+                snprintf(name, sizeof(name), "%.*s/%.*s", NAME_LEN_MAX,
+                         dir_name, NAME_LEN_MAX, dp->d_name);
+                if (stat(name, &st) < 0)
+                        continue;
+                if (S_ISBLK(st.st_mode))
+                        ft = FT_BLOCK;
+                else if (S_ISCHR(st.st_mode))
+                        ft = FT_CHAR;
+                else
+                        continue;
+                if (! map_add(node_hash, ft, major(st.st_rdev),
+                              minor(st.st_rdev), -1, symlnk, name)) {
+                        closedir(dirp);
+                        return 1;
+                }
+        }
+        closedir(dirp);
+        return 0;
+}
+
+/* Adds a row for each sg device in sysfs */
+static bool
+map_scan_sg(int verbose)
+{
+        DIR * dirp;
+        struct dirent * dp;
+        struct map_row_t * rp;
+        char * cp;
+        char b[D_NAME_LEN_MAX];
+        char d[D_NAME_LEN_MAX];
+        char o[2 * D_NAME_LEN_MAX];
+
+        if (NULL == (dirp = opendir(sys_sg_dir))) {
+                if (verbose)
+                        pr2serr("opendir: %s %s\n", sys_sg_dir,
+                                ssafe_strerror(errno));
+                return true;    /* perhaps sg module is not loaded */
+        }
+        while ((dp = readdir(dirp))) {
+                if ('.' == dp->d_name[0])
+                        continue;
+                snprintf(b, sizeof(b), "%s%.*s", sys_sg_dir, NAME_LEN_MAX,
+                         dp->d_name);
+                if (NULL == (rp = map_new_row())) {
+                        closedir(dirp);
+                        return false;
+                }
+                if (! map_get_dev(b, &rp->sg_ma, &rp->sg_mi)) {
+                        --map_num_rows;
+                        continue;
+                }
+                map_realpath(b, rp->sg_sys, sizeof(rp->sg_sys));
+                snprintf(d, sizeof(d), "%.*s/device", NAME_LEN_MAX, b);
+                map_realpath(d, o, sizeof(o));
+                cp = strrchr(o, '/');
+                snprintf(rp->hctl, sizeof(rp->hctl), "%.*s", NAME_LEN_MAX - 1,
+                         cp ? cp + 1 : o);
+                if (1 == from_sg_scan(d, verbose > 1)) {
+                        snprintf(o, sizeof(o), "%s/%s", d, from_sg.name);
+                        if (DT_DIR == from_sg.d_type) {
+                                if (1 != scan_for_first(o, verbose))
+                                        o[0] = '\0';
+                                else
+                                        snprintf(o + strlen(o),
+                                                 sizeof(o) - strlen(o),
+                                                 "/%s", for_first.name);
+                        }
+                        if (o[0] && map_get_dev(o, &rp->o_ma, &rp->o_mi)) {
+                                rp->o_ft = from_sg.ft;
+                                map_realpath(o, rp->o_sys,
+                                             sizeof(rp->o_sys));
+                        }
+                }
+                snprintf(o, sizeof(o), "%s%s", sys_bsg_dir, rp->hctl);
+                if (! map_get_dev(o, &rp->bsg_ma, &rp->bsg_mi)) {
+                        rp->bsg_ma = -1;
+                        rp->bsg_mi = -1;
+                }
+        }
+        closedir(dirp);
+        return true;
+}
+
+/* Adds a row for each NVMe generic (e.g. ng0n1) device in sysfs, mapped to
+ * the namespace block device with the same numbers (e.g. nvme0n1). */
+static bool
+map_scan_ng(int verbose)
+{
+        DIR * dirp;
+        struct dirent * dp;
+        struct map_row_t * rp;
+        char b[D_NAME_LEN_MAX];
+
+        if (NULL == (dirp = opendir(sys_ng_dir))) {
+                if (verbose > 1)
+                        pr2serr("opendir: %s %s\n", sys_ng_dir,
+                                ssafe_strerror(errno));
+                return true;
+        }
+        while ((dp = readdir(dirp))) {
+                if (0 != strncmp("ng", dp->d_name, 2))
+                        continue;
+                snprintf(b, sizeof(b), "%s%.*s", sys_ng_dir, NAME_LEN_MAX,
+                         dp->d_name);
+                if (NULL == (rp = map_new_row())) {
+                        closedir(dirp);
+                        return false;
+                }
+                if (! map_get_dev(b, &rp->sg_ma, &rp->sg_mi)) {
+                        --map_num_rows;
+                        continue;
+                }
+                map_realpath(b, rp->sg_sys, sizeof(rp->sg_sys));
+                snprintf(b, sizeof(b), "%snvme%.*s", sys_sd_dir,
+                         NAME_LEN_MAX, dp->d_name + 2);
+                if (map_get_dev(b, &rp->o_ma, &rp->o_mi)) {
+                        rp->o_ft = FT_BLOCK;
+                        map_realpath(b, rp->o_sys, sizeof(rp->o_sys));
+                }
+        }
+        closedir(dirp);
+        return true;
+}
+
+/* Each row can be found by any of its devices */
+static bool
+map_hash_rows(void)
+{
+        int k;
+        const struct map_row_t * rp;
+
+        for (k = 0; k < map_num_rows; ++k) {
+                rp = map_rows + k;
+                if (! map_add(row_hash, FT_CHAR, rp->sg_ma, rp->sg_mi, k,
+                              false, NULL))
+                        return false;
+                if ((FT_OTHER != rp->o_ft) &&
+                    (! map_add(row_hash, rp->o_ft, rp->o_ma,
+                               map_norm_minor(rp->o_ma, rp->o_mi), k, false,
+                               NULL)))
+                        return false;
+                if ((rp->bsg_ma >= 0) &&
+                    (! map_add(row_hash, FT_CHAR, rp->bsg_ma, rp->bsg_mi, k,
+                               false, NULL)))
+                        return false;
+        }
+        return true;
+}
+
+/* The cache is reused while this string is unchanged: the kernel's uevent
+ * sequence number (bumped on every hotplug event) plus the modification
+ * times of the device directory and its bsg sub-directory. */
+static void
+map_cache_key(const char * device_dir, char * b, int blen)
+{
+        int k;
+        char value[NAME_LEN_MAX];
+        char d[D_NAME_LEN_MAX];
+        struct stat st[2];
+
+        if (! get_value(NULL, uevent_seqnum_fn, value, sizeof(value)))
+                snprintf(value, sizeof(value), "-");
+        memset(st, 0, sizeof(st));
+        stat(device_dir, st + 0);
+        snprintf(d, sizeof(d), "%.*s/bsg", NAME_LEN_MAX, device_dir);
+        stat(d, st + 1);
+        k = snprintf(b, blen, "seqnum=%s", value);
+        snprintf(b + k, blen - k, " mtime=%lld.%09ld,%lld.%09ld dir=%s",
+                 (long long)st[0].st_mtim.tv_sec, st[0].st_mtim.tv_nsec,
+                 (long long)st[1].st_mtim.tv_sec, st[1].st_mtim.tv_nsec,
+                 device_dir);
+}
+
+/* Returns true if cache_fn was read and its key matches */
+static bool
+map_cache_load(const char * cache_fn, const char * key, int verbose)
+{
+        bool ok = false;
+        int n, ft, ma, mi, symlnk;
+        int line = 0;
+        FILE * fp;
+        struct map_row_t * rp;
+        char * cp;
+        char b[3 * D_NAME_LEN_MAX];
+        char hctl[NAME_LEN_MAX];
+
+        if (NULL == (fp = fopen(cache_fn, "r"))) {
+                if (verbose)
+                        pr2serr("cache %s: %s\n", cache_fn,
+                                ssafe_strerror(errno));
+                return false;
+        }
+        while (fgets(b, sizeof(b), fp)) {
+                ++line;
+                n = strlen(b);
+                if ((n > 0) && ('\n' == b[n - 1]))
+                        b[--n] = '\0';
+                if (1 == line) {
+                        if (strcmp(b, MAP_CACHE_HDR))
+                                break;
+                        continue;
+                } else if (2 == line) {
+                        if (strcmp(b, key)) {
+                                if (verbose)
+                                        pr2serr("cache %s is stale\n",
+                                                cache_fn);
+                                break;
+                        }
+                        ok = true;
+                        continue;
+                }
+                if ('r' == b[0]) {
+                        if (NULL == (rp = map_new_row()))
+                                goto bad;
+                        if ((10 != sscanf(b + 1, " %d:%d %d %d:%d %d:%d "
+                                          "%255s %519s %519s", &rp->sg_ma,
+                                          &rp->sg_mi, &rp->o_ft, &rp->o_ma,
+                                          &rp->o_mi, &rp->bsg_ma,
+                                          &rp->bsg_mi, hctl, rp->sg_sys,
+                                          rp->o_sys)))
+                                goto bad;
+                        snprintf(rp->hctl, sizeof(rp->hctl), "%s",
+                                 strcmp(hctl, "-") ? hctl : "");
+                        if (0 == strcmp(rp->o_sys, "-"))
+                                rp->o_sys[0] = '\0';
+                } else if ('n' == b[0]) {
+                        n = 0;
+                        if ((4 != sscanf(b + 1, " %d %d:%d %d %n", &ft, &ma,
+                                         &mi, &symlnk, &n)) || (0 == n))
+                                goto bad;
+                        cp = b + 1 + n;
+                        if (! map_add(node_hash, ft, ma, mi, -1,
+                                      !! symlnk, cp))
+                                goto bad;
+                } else
+                        goto bad;
+        }
+        fclose(fp);
+        if (ok && map_hash_rows())
+                return true;
+        map_free();
+        return false;
+bad:
+        if (verbose)
+                pr2serr("cache %s: unable to decode line %d\n", cache_fn,
+                        line);
+        fclose(fp);
+        map_free();
+        return false;
+}
+
+/* Writes to a temporary file then renames it, so concurrent readers see
+ * either the old or the new cache. */
+static void
+map_cache_save(const char * cache_fn, const char * key, int verbose)
+{
+        int k;
+        FILE * fp;
+        const struct map_row_t * rp;
+        const struct map_ent_t * ep;
+        char tmp_fn[D_NAME_LEN_MAX];
+
+        snprintf(tmp_fn, sizeof(tmp_fn), "%.*s.%d", NAME_LEN_MAX, cache_fn,
+                 (int)getpid());
+        if (NULL == (fp = fopen(tmp_fn, "w"))) {
+                pr2serr("unable to write cache %s: %s\n", tmp_fn,
+                        ssafe_strerror(errno));
+                return;
+        }
+        fprintf(fp, "%s\n%s\n", MAP_CACHE_HDR, key);
+        for (k = 0; k < map_num_rows; ++k) {
+                rp = map_rows + k;
+                fprintf(fp, "r %d:%d %d %d:%d %d:%d %s %s %s\n", rp->sg_ma,
+                        rp->sg_mi, rp->o_ft, rp->o_ma, rp->o_mi, rp->bsg_ma,
+                        rp->bsg_mi, rp->hctl[0] ? rp->hctl : "-",
+                        rp->sg_sys, rp->o_sys[0] ? rp->o_sys : "-");
+        }
+        for (k = 0; k < MAP_HASH_SZ; ++k) {
+                for (ep = node_hash[k]; ep; ep = ep->next)
+                        fprintf(fp, "n %d %d:%d %d %s\n", ep->ft, ep->ma,
+                                ep->mi, (int)ep->symlnk, ep->name);
+        }
+        if (fclose(fp) || rename(tmp_fn, cache_fn)) {
+                pr2serr("unable to write cache %s: %s\n", cache_fn,
+                        ssafe_strerror(errno));
+                unlink(tmp_fn);
+        } else if (verbose)
+                pr2serr("wrote %d rows to cache %s\n", map_num_rows,
+                        cache_fn);
+}
+
+/* Builds the map, from cache_fn if it is given and still valid. Returns
+ * 0 on success. */
+static int
+map_build(const char * cache_fn, const char * device_dir, int verbose)
+{
+        int res;
+        char d[D_NAME_LEN_MAX];
+        char key[2 * D_NAME_LEN_MAX];
+
+        if (cache_fn) {
+                map_cache_key(device_dir, key, sizeof(key));
+                if (map_cache_load(cache_fn, key, verbose)) {
+                        if (verbose)
+                                pr2serr("using cache %s, %d rows\n", cache_fn,
+                                        map_num_rows);
+                        return 0;
+                }
+        }
+        res = map_scan_nodes(device_dir, verbose);
+        if (res < 0) {
+                pr2serr("dev_dir: %s: %s\n", device_dir,
+                        ssafe_strerror(-res));
+                return SG_LIB_FILE_ERROR;
+        }
+        snprintf(d, sizeof(d), "%.*s/bsg", NAME_LEN_MAX, device_dir);
+        if ((res > 0) || (map_scan_nodes(d, verbose > 1) > 0) ||
+            (! map_scan_sg(verbose)) || (! map_scan_ng(verbose)) ||
+            (! map_hash_rows())) {
+                pr2serr("out of memory building map\n");
+                return SG_LIB_CAT_OTHER;
+        }
+        if (verbose)
+                pr2serr("mapped %d sg and NVMe generic devices\n",
+                        map_num_rows);
+        if (cache_fn)
+                map_cache_save(cache_fn, key, verbose);
+        return 0;
+}
+
+/* Outputs device nodes of the given device; returns the number output */
+static int
+map_pr_nodes(int ft, int ma, int mi, bool follow_symlink, const char * pre)
+{
+        int num = 0;
+        struct map_ent_t * ep = NULL;
+
+        while ((ep = map_next(node_hash, ep, ft, ma, mi))) {
+                if (ep->symlnk && (! follow_symlink))
+                        continue;
+                printf("%s%s\n", pre, ep->name);
+                ++num;
+        }
+        return num;
+}
+
+static const char *
+map_first_node(int ft, int ma, int mi, bool follow_symlink)
+{
+        struct map_ent_t * ep = NULL;
+
+        while ((ep = map_next(node_hash, ep, ft, ma, mi))) {
+                if ((! ep->symlnk) || follow_symlink)
+                        return ep->name;
+        }
+        return "-";
+}
+
+/* --all : one line for each sg (or NVMe generic) device */
+static void
+map_pr_all(bool follow_symlink)
+{
+        int k;
+        const struct map_row_t * rp;
+
+        for (k = 0; k < map_num_rows; ++k) {
+                rp = map_rows + k;
+                printf("%s  %s  %s  %s\n",
+                       map_first_node(FT_CHAR, rp->sg_ma, rp->sg_mi,
+                                      follow_symlink),
+                       (FT_OTHER == rp->o_ft) ? "-" :
+                       map_first_node(rp->o_ft, rp->o_ma, rp->o_mi,
+                                      follow_symlink),
+                       (rp->bsg_ma < 0) ? "-" :
+                       map_first_node(FT_CHAR, rp->bsg_ma, rp->bsg_mi,
+                                      follow_symlink),
+                       rp->hctl[0] ? rp->hctl : "-");
+        }
+}
+
+/* Answers one query from the map, output lines are prefixed by 'pre'.
+ * Returns 0 if found, 1 if not, else SG_LIB_FILE_ERROR . */
+static int
+map_query(const char * device_name, int given_is, int op_result,
+          bool follow_symlink, const char * pre, int verbose)
+{
+        bool use_sg;
+        int j, ft, nt, ma, mi, which;
+        const struct map_row_t * rp = NULL;
+        struct map_ent_t * ep;
+        struct stat st;
+        char value[D_NAME_LEN_MAX];
+
+        if (stat(device_name, &st) < 0) {
+                pr2serr("stat failed on %s: %s\n", device_name,
+                        ssafe_strerror(errno));
+                return SG_LIB_FILE_ERROR;
+        }
+        if (S_ISBLK(st.st_mode) || S_ISCHR(st.st_mode)) {
+                if (given_is > 0) {
+                        pr2serr("%s is special but '--given_is=' suggested "
+                                "sysfs device\n", device_name);
+                        return SG_LIB_FILE_ERROR;
+                }
+                ft = S_ISBLK(st.st_mode) ? FT_BLOCK : FT_CHAR;
+                ma = major(st.st_rdev);
+                mi = minor(st.st_rdev);
+        } else if (S_ISREG(st.st_mode) || S_ISDIR(st.st_mode)) {
+                if (0 == given_is) {
+                        pr2serr("%s is sysfs but '--given_is=' suggested "
+                                "block or char special\n", device_name);
+                        return SG_LIB_FILE_ERROR;
+                }
+                if ((! get_value(S_ISDIR(st.st_mode) ? device_name : NULL,
+                                 S_ISDIR(st.st_mode) ? "dev" : device_name,
+                                 value, sizeof(value))) ||
+                    (2 != sscanf(value, "%d:%d", &ma, &mi))) {
+                        pr2serr("Couldn't fetch dev value from: %s\n",
+                                device_name);
+                        return SG_LIB_FILE_ERROR;
+                }
+                nt = nt_typ_from_major(ma);
+                ft = ((NT_SD == nt) || (NT_SR == nt) || (NT_HD == nt)) ?
+                     FT_BLOCK : FT_CHAR;
+                /* majors not known here (e.g. nvme) may be either */
+                if ((NT_NO_MATCH == nt) &&
+                    (NULL == map_next(row_hash, NULL, ft, ma, mi)))
+                        ft = FT_BLOCK;
+        } else {
+                pr2serr("%s: not a device nor a sysfs file\n", device_name);
+                return 1;
+        }
+        if (verbose)
+                pr2serr(" %s: %s device [maj=%d, min=%d]\n", device_name,
+                        (FT_BLOCK == ft) ? "block" : "char", ma, mi);
+        if (2 == op_result)
+                return map_pr_nodes(ft, ma, mi, follow_symlink, pre) ? 0 : 1;
+        ep = map_next(row_hash, NULL, ft, ma, map_norm_minor(ma, mi));
+        if (ep)
+                rp = map_rows + ep->row;
+        if (NULL == rp) {
+                pr2serr("%s does not match any mapped device\n",
+                        device_name);
+                return 1;
+        }
+        if ((FT_CHAR == ft) && (ma == rp->sg_ma) && (mi == rp->sg_mi))
+                which = 0;
+        else if ((FT_CHAR == ft) && (ma == rp->bsg_ma) && (mi == rp->bsg_mi))
+                which = 2;
+        else
+                which = 1;
+        if (3 == op_result) {
+                if (2 == which)
+                        printf("%s%s%s\n", pre, sys_bsg_dir, rp->hctl);
+                else
+                        printf("%s%s\n", pre, which ? rp->o_sys : rp->sg_sys);
+                return 0;
+        }
+        /* like map_bsg(), a bsg device maps to sd, sr or st else to sg */
+        use_sg = (1 == which) || ((2 == which) && (FT_OTHER == rp->o_ft));
+        if ((! use_sg) && (FT_OTHER == rp->o_ft)) {
+                pr2serr("%s does not match any other SCSI device\n",
+                        device_name);
+                return 1;
+        }
+        if (1 == op_result) {
+                printf("%s%s\n", pre, use_sg ? rp->sg_sys : rp->o_sys);
+                return 0;
+        }
+        if (use_sg)
+                j = map_pr_nodes(FT_CHAR, rp->sg_ma, rp->sg_mi,
+                                 follow_symlink, pre);
+        else
+                j = map_pr_nodes(rp->o_ft, rp->o_ma, rp->o_mi,
+                                 follow_symlink, pre);
+        return (j > 0) ? 0 : 1;
+}
+
 int
 main(int argc, char * argv[])
 {
@@ -1195,9 +1889,13 @@ main(int argc, char * argv[])
         int opt_result = 0;
         int verbose = 0;
         int ret = 1;
-        int ma, mi;
+        int ma, mi, k;
+        int num_devs = 0;
+        bool do_all = false;
         bool do_dev_dir = false;
         bool follow_symlink = false;
+        const char * cache_fn = NULL;
+        char ** dev_arr = NULL;
         char device_name[D_NAME_LEN_MAX];
         char device_dir[D_NAME_LEN_MAX];
         char value[D_NAME_LEN_MAX];
@@ -1207,12 +1905,18 @@ main(int argc, char * argv[])
         while (1) {
                 int option_index = 0;
 
-                c = getopt_long(argc, argv, "d:hg:r:svV", long_options,
+                c = getopt_long(argc, argv, "ac:d:hg:r:svV", long_options,
                                 &option_index);
                 if (c == -1)
                         break;
 
                 switch (c) {
+                case 'a':
+                        do_all = true;
+                        break;
+                case 'c':
+                        cache_fn = optarg;
+                        break;
                 case 'd':
                         strncpy(device_dir, optarg, sizeof(device_dir) - 1);
                         do_dev_dir = true;
@@ -1257,19 +1961,43 @@ main(int argc, char * argv[])
                 }
         }
         if (optind < argc) {
-                if ('\0' == device_name[0]) {
-                        strncpy(device_name, argv[optind],
-                                sizeof(device_name) - 1);
-                        device_name[sizeof(device_name) - 1] = '\0';
-                        ++optind;
+                strncpy(device_name, argv[optind], sizeof(device_name) - 1);
+                device_name[sizeof(device_name) - 1] = '\0';
+                dev_arr = argv + optind;
+                num_devs = argc - optind;
+        }
+        if (do_all || cache_fn || (num_devs > 1)) {
+                char * cp;
+
+                if (! do_dev_dir)
+                        strcpy(device_dir, def_dev_dir);
+                cp = realpath(device_dir, NULL);
+                if (NULL == cp) {
+                        pr2serr("dev_dir: %s invalid\n", device_dir);
+                        return SG_LIB_FILE_ERROR;
                 }
-                if (optind < argc) {
-                        for (; optind < argc; ++optind)
-                                pr2serr("Unexpected extra argument: %s\n",
-                                        argv[optind]);
-                        usage();
-                        return SG_LIB_SYNTAX_ERROR;
+                snprintf(device_dir, sizeof(device_dir), "%s", cp);
+                free(cp);
+                ret = map_build(cache_fn, device_dir, verbose);
+                if (ret)
+                        return ret;
+                if (do_all)
+                        map_pr_all(follow_symlink);
+                for (k = 0; k < num_devs; ++k) {
+                        char pre[D_NAME_LEN_MAX + 2];
+
+                        if (num_devs > 1)
+                                snprintf(pre, sizeof(pre), "%.*s ",
+                                         NAME_LEN_MAX, dev_arr[k]);
+                        else
+                                pre[0] = '\0';
+                        res = map_query(dev_arr[k], given_is, opt_result,
+                                        follow_symlink, pre, verbose);
+                        if (res && (0 == ret))
+                                ret = res;
                 }
+                map_free();
+                return ret;
         }
 
         if (0 == device_name[0]) {
@@ -1,5 +1,5 @@
 /*
- *  Copyright (C) 2000-2023 D. Gilbert
+ *  Copyright (C) 2000-2026 D. Gilbert
  *  This program is free software; you can redistribute it and/or modify
  *  it under the terms of the GNU General Public License as published by
  *  the Free Software Foundation; either version 2, or (at your option)
@@ -32,7 +32,7 @@
 #include "sg_unaligned.h"
 #include "sg_pr2serr.h"
 
-static const char * version_str = "1.78 20230326";
+static const char * version_str = "1.79 20261014";
 
 #define MY_NAME "sg_modes"
 
@@ -57,6 +57,7 @@ struct opts_t {
     bool do_list;
     bool do_llbaa;
     bool do_multiple;
+    bool no_inquiry;
     bool do_six;
     bool o_readwrite;
     bool subpg_code_given;
@@ -106,6 +107,8 @@ static struct option long_options[] = {
         {"maxlen", required_argument, 0, 'm'},
         {"multiple", no_argument, 0, 'M'},
         {"new", no_argument, 0, 'N'},
+        {"no-inquiry", no_argument, 0, 'n'},
+        {"no_inquiry", no_argument, 0, 'n'},
         {"old", no_argument, 0, 'O'},
         {"page", required_argument, 0, 'p'},
         {"raw", no_argument, 0, 'r'},
@@ -302,10 +305,11 @@ usage()
            "[--examine]\n"
            "                [--flexible] [--help] [--hex] [--list] "
            "[--llbaa]\n"
-           "                [--maxlen=LEN] [--multiple] [--page=PG[,SPG]] "
-           "[--raw] [-R]\n"
-           "                [--readwrite] [--six] [--verbose] [--version] "
-           "[DEVICE]\n"
+           "                [--maxlen=LEN] [--multiple] [--no-inquiry] "
+           "[--page=PG[,SPG]]\n"
+           "                [--raw] [-R] [--readwrite] [--six] [--verbose] "
+           "[--version]\n"
+           "                [DEVICE]\n"
            "  where:\n"
            "    --all|-a        get all mode pages supported by device\n"
            "                    use twice to get all mode pages and subpages\n"
@@ -333,6 +337,9 @@ usage()
            "SENSE 6) bytes)\n"
            "    --multiple|-M    output multiple page controls rather`"
            "than one\n"
+           "    --no-inquiry|-n    do not send a standard INQUIRY first; "
+           "the\n"
+           "                       peripheral device type is then unknown\n"
            "    --page=PG|-p PG    page code to fetch (def: 63). May be "
            "acronym\n"
            "    --page=PG,SPG|-p PG,SPG\n"
@@ -471,7 +478,7 @@ new_parse_cmd_line(struct opts_t * op, int argc, char * argv[])
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "6aAc:dDefhHlLm:MNOp:rRsvV",
+        c = getopt_long(argc, argv, "6aAc:dDefhHlLm:MnNOp:rRsvV",
                         long_options, &option_index);
         if (c == -1)
             break;
@@ -538,6 +545,9 @@ new_parse_cmd_line(struct opts_t * op, int argc, char * argv[])
             break;
         case 'N':
             break;      /* ignore */
+        case 'n':
+            op->no_inquiry = true;
+            break;
         case 'O':
             op->opt_new = false;
             return 0;
@@ -1448,15 +1458,18 @@ main(int argc, char * argv[])
         goto fini;
     }
 
-    if ((res = sg_simple_inquiry(sg_fd, &inq_out, true, vb))) {
+    if (op->no_inquiry)
+        op->inq_pdt = -1;       /* unknown, use pages common to all */
+    else if ((res = sg_simple_inquiry(sg_fd, &inq_out, true, vb))) {
         pr2serr("%s doesn't respond to a SCSI INQUIRY\n", op->device_name);
         ret = (res > 0) ? res : sg_convert_errno(-res);
         goto fini;
+    } else {
+        op->inq_pdt = inq_out.peripheral_type;
+        op->encserv = !! (0x40 & inq_out.byte_6);
+        op->mchngr = !! (0x8 & inq_out.byte_6);
     }
-    op->inq_pdt = inq_out.peripheral_type;
-    op->encserv = !! (0x40 & inq_out.byte_6);
-    op->mchngr = !! (0x8 & inq_out.byte_6);
-    if ((0 == op->do_raw) && (dhex < 3))
+    if ((! op->no_inquiry) && (0 == op->do_raw) && (dhex < 3))
         printf("    %.8s  %.16s  %.4s   peripheral_type: %s [0x%x]\n",
                inq_out.vendor, inq_out.product, inq_out.revision,
                sg_get_pdt_str(op->inq_pdt, sizeof(pdt_name), pdt_name),
@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/*
+ * This is the front end of the multi-call binary that './configure
+ * --enable-multicall' builds instead of one executable per utility. Each
+ * utility's main() is compiled as <utility>_main() (see src/Makefile.am)
+ * and all are linked, once, with libsgutils2 into a single executable
+ * called sg3_utils. Like busybox, the utility to run is chosen by the last
+ * component of argv[0] so each utility name is installed as a symbolic
+ * link to sg3_utils. Alternatively: 'sg3_utils <utility> [<args>]' .
+ *
+ * One (usually static) executable means one exec, no dynamic loader work
+ * and one copy of the library's read-only tables in the page cache shared
+ * by every utility, which suits scripts that invoke many utilities, and
+ * initramfs and container images.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "sg_lib.h"
+#include "sg_pr2serr.h"
+
+static const char * version_str = "1.00 20261015";
+
+static const char * my_name = "sg3_utils";
+
+/* Keep in alphabetical order, it is searched with bsearch(). This should
+ * list the same utilities as MC_SRCS in src/Makefile.am . */
+#define SG_MC_UTILS \
+        X(sg_bg_ctl) X(sg_broker) X(sg_compare_and_write) \
+        X(sg_copy_results) X(sg_dd) X(sg_decode_sense) X(sg_emc_trespass) \
+        X(sg_exporter) X(sg_format) \
+        X(sg_get_config) X(sg_get_elem_status) X(sg_get_lba_status) \
+        X(sg_ident) X(sg_inq) X(sg_iobench) X(sg_logs) X(sg_luns) \
+        X(sg_map) X(sg_map26) X(sg_modes) X(sg_opcodes) X(sg_persist) \
+        X(sg_prevent) X(sg_raw) X(sg_rbuf) X(sg_rdac) X(sg_read) \
+        X(sg_read_attr) X(sg_read_block_limits) X(sg_read_buffer) \
+        X(sg_read_long) X(sg_readcap) X(sg_reassign) X(sg_referrals) \
+        X(sg_rem_rest_elem) X(sg_rep_density) X(sg_rep_pip) \
+        X(sg_rep_zones) X(sg_requests) X(sg_reset) X(sg_reset_wp) \
+        X(sg_rmsn) X(sg_rtpg) X(sg_safte) X(sg_sanitize) \
+        X(sg_sat_datetime) X(sg_sat_identify) X(sg_sat_phy_event) \
+        X(sg_sat_read_gplog) X(sg_sat_set_features) X(sg_scan) \
+        X(sg_seek) X(sg_senddiag) X(sg_ses) X(sg_ses_microcode) \
+        X(sg_start) X(sg_stpg) X(sg_stream_ctl) X(sg_sync) \
+        X(sg_test_rwbuf) X(sg_timestamp) X(sg_turs) X(sg_unmap) \
+        X(sg_verify) X(sg_vpd) X(sg_wr_mode) X(sg_write_attr) \
+        X(sg_write_buffer) X(sg_write_long) X(sg_write_same) \
+        X(sg_write_verify) X(sg_write_x) X(sg_xcopy) X(sg_z_act_query) \
+        X(sg_zone) X(sginfo) X(sgm_dd) X(sgp_dd)
+
+#define X(u) int u##_main(int argc, char * argv[]);
+SG_MC_UTILS
+#undef X
+
+struct mc_util_t {
+    const char * name;
+    int (*main_fn)(int argc, char * argv[]);
+};
+
+static const struct mc_util_t mc_util_arr[] = {
+#define X(u) {#u, u##_main},
+SG_MC_UTILS
+#undef X
+};
+
+#define MC_NUM_UTILS (int)(sizeof(mc_util_arr) / sizeof(mc_util_arr[0]))
+
+
+static int
+mc_cmp(const void * keyp, const void * elemp)
+{
+    return strcmp((const char *)keyp,
+                  ((const struct mc_util_t *)elemp)->name);
+}
+
+static const struct mc_util_t *
+mc_find(const char * name)
+{
+    return (const struct mc_util_t *)bsearch(name, mc_util_arr,
+                                             MC_NUM_UTILS,
+                                             sizeof(mc_util_arr[0]),
+                                             mc_cmp);
+}
+
+/* Returns pointer to the last component of path (i.e. after last '/') */
+static const char *
+mc_basename(const char * path)
+{
+    const char * cp = strrchr(path, '/');
+
+    return cp ? (cp + 1) : path;
+}
+
+static void
+list_utils(void)
+{
+    int k;
+
+    for (k = 0; k < MC_NUM_UTILS; ++k)
+        printf("%s\n", mc_util_arr[k].name);
+}
+
+static void
+usage(void)
+{
+    pr2serr("Usage: %s [--help] [--list] [--version]\n"
+            "       %s UTILITY [ARGS...]\n"
+            "       UTILITY [ARGS...]\n"
+            "  where:\n"
+            "    --help|-h       print out usage message then exit\n"
+            "    --list|-l       list the utilities in this binary, one "
+            "per line\n"
+            "    --version|-V    print version string then exit\n\n"
+            "Multi-call binary holding %d sg3_utils utilities. Each "
+            "UTILITY is usually\ninstalled as a symbolic link to this "
+            "binary and is selected by the name it\nis invoked with. "
+            "Otherwise give UTILITY as the first argument.\n",
+            my_name, my_name, MC_NUM_UTILS);
+}
+
+
+int
+main(int argc, char * argv[])
+{
+    const char * cp = (argc > 0) ? mc_basename(argv[0]) : my_name;
+    const struct mc_util_t * up;
+
+    up = mc_find(cp);
+    if (up)
+        return up->main_fn(argc, argv);
+    /* invoked as sg3_utils (or by an unknown name), look at argv[1] */
+    if (argc < 2) {
+        usage();
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    cp = argv[1];
+    if ((0 == strcmp(cp, "--help")) || (0 == strcmp(cp, "-h")) ||
+        (0 == strcmp(cp, "-?"))) {
+        usage();
+        return 0;
+    }
+    if ((0 == strcmp(cp, "--list")) || (0 == strcmp(cp, "-l"))) {
+        list_utils();
+        return 0;
+    }
+    if ((0 == strcmp(cp, "--version")) || (0 == strcmp(cp, "-V"))) {
+        pr2serr("version: %s\n", version_str);
+        return 0;
+    }
+    up = mc_find(mc_basename(cp));
+    if (NULL == up) {
+        pr2serr("%s: unknown utility: %s\n", my_name, cp);
+        pr2serr("Use '%s --list' to see those available\n", my_name);
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    /* utility sees its own name as argv[0] */
+    return up->main_fn(argc - 1, argv + 1);
+}
@@ -1,5 +1,5 @@
 /* A utility program originally written for the Linux OS SCSI subsystem.
- *  Copyright (C) 2004-2023 D. Gilbert
+ *  Copyright (C) 2004-2026 D. Gilbert
  *  This program is free software; you can redistribute it and/or modify
  *  it under the terms of the GNU General Public License as published by
  *  the Free Software Foundation; either version 2, or (at your option)
@@ -31,10 +31,11 @@
 #include "sg_unaligned.h"
 #include "sg_pr2serr.h"
 #include "sg_json_sg_lib.h"
+#include "sg_rcache.h"
 
 #include "sg_pt.h"
 
-static const char * version_str = "1.01 20230519";    /* spc6r08 */
+static const char * version_str = "1.02 20261014";    /* spc6r08 */
 
 #define MY_NAME "sg_opcodes"
 
@@ -60,6 +61,7 @@ static bool no_final_msg = false;
 
 static struct option long_options[] = {
     {"alpha", no_argument, 0, 'a'},
+    {"cache", required_argument, 0, 'C'},
     {"compact", no_argument, 0, 'c'},
     {"enumerate", no_argument, 0, 'e'},
     {"help", no_argument, 0, 'h'},
@@ -109,6 +111,7 @@ struct opts_t {
     int opcode;
     int servact;
     int verbose;
+    const char * cache_dir;
     const char * device_name;
     const char * inhex_fn;
     const char * json_arg;
@@ -120,10 +123,10 @@ struct opts_t {
 static void
 usage()
 {
-    pr2serr("Usage:  sg_opcodes [--alpha] [--compact] [--enumerate] "
-            "[--help] [--hex]\n"
-            "                   [--inhex=FN] [--json[=JO]] [--js-file=JFN] "
-            "[--mask]\n"
+    pr2serr("Usage:  sg_opcodes [--alpha] [--cache=DIR] [--compact] "
+            "[--enumerate] [--help]\n"
+            "                   [--hex] [--inhex=FN] [--json[=JO]] "
+            "[--js-file=JFN] [--mask]\n"
             "                   [--mlu] [--no-inquiry] [--opcode=OP[,SA]] "
             "[--pdt=DT]\n"
             "                   [--raw] [--rctd] [--repd] [--sa=SA] [--tmf] "
@@ -132,6 +135,9 @@ usage()
             "  where:\n"
             "    --alpha|-a      output list of operation codes sorted "
             "alphabetically\n"
+            "    --cache=DIR|-C DIR    reuse responses cached in directory "
+            "DIR while\n"
+            "                          the DEVICE reports no unit attention\n"
             "    --compact|-c    more compact output\n"
             "    --enumerate|-e    use '--opcode=' and '--pdt=' to look up "
             "name,\n"
@@ -227,10 +233,11 @@ do_rsoc(struct sg_pt_base * ptvp, bool rctd, int rep_opts, int rq_opcode,
         int rq_servact, void * resp, int mx_resp_len, int * act_resp_lenp,
         bool noisy, int verbose)
 {
-    int ret, res, sense_cat;
+    int ret, res, sense_cat, fd;
     uint8_t rsoc_cdb[RSOC_CMD_LEN] = {SG_MAINTENANCE_IN, RSOC_SA, 0,
                                               0, 0, 0, 0, 0, 0, 0, 0, 0};
     uint8_t sense_b[SENSE_BUFF_LEN] SG_C_CPP_ZERO_INIT;
+    char rc_name[32];
 
     if (rctd)
         rsoc_cdb[2] |= 0x80;
@@ -251,6 +258,18 @@ do_rsoc(struct sg_pt_base * ptvp, bool rctd, int rep_opts, int rq_opcode,
                 sg_get_command_str(rsoc_cdb, RSOC_CMD_LEN, false,
                                    sizeof(b), b));
     }
+    fd = get_pt_file_handle(ptvp);
+    /* the response depends on the REPORTING OPTIONS, OP and SA fields */
+    snprintf(rc_name, sizeof(rc_name), "rsoc_%02x_%02x_%04x", rsoc_cdb[2],
+             rsoc_cdb[3], sg_get_unaligned_be16(rsoc_cdb + 4));
+    ret = sg_rcache_get(fd, rc_name, (uint8_t *)resp, mx_resp_len);
+    if (ret >= 4) {
+        if (verbose)
+            pr2serr("    %s response from cache\n", rsoc_s);
+        if (act_resp_lenp)
+            *act_resp_lenp = ret;
+        return 0;
+    }
     clear_scsi_pt_obj(ptvp);
     set_scsi_pt_cdb(ptvp, rsoc_cdb, sizeof(rsoc_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -279,6 +298,7 @@ do_rsoc(struct sg_pt_base * ptvp, bool rctd, int rep_opts, int rq_opcode,
             pr2serr("%s response:\n", rsoc_s);
             hex2stderr((const uint8_t *)resp, ret, 1);
         }
+        sg_rcache_put(fd, rc_name, (const uint8_t *)resp, mx_resp_len, ret);
         ret = 0;
     }
     return ret;
@@ -423,7 +443,7 @@ new_parse_cmd_line(struct opts_t * op, int argc, char * argv[])
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "^acehHi:j::J:mMnNo:Op:qrRs:tuvV",
+        c = getopt_long(argc, argv, "^acC:ehHi:j::J:mMnNo:Op:qrRs:tuvV",
                         long_options, &option_index);
         if (c == -1)
             break;
@@ -435,6 +455,9 @@ new_parse_cmd_line(struct opts_t * op, int argc, char * argv[])
         case 'c':
             op->do_compact = true;
             break;
+        case 'C':
+            op->cache_dir = optarg;
+            break;
         case 'e':
             op->do_enumerate = true;
             break;
@@ -1412,6 +1435,8 @@ main(int argc, char * argv[])
             no_final_msg = true;
             goto err_out;
         }
+        if (op->cache_dir)
+            sg_rcache_open(op->cache_dir, op->device_name, sg_fd, vb);
         if (op->no_inquiry && (peri_dtype < 0))
             pr2serr("--no-inquiry ignored because --pdt= not given\n");
         if (op->no_inquiry && (peri_dtype >= 0))
@@ -1454,6 +1479,8 @@ open_rw:                /* if not already open */
             no_final_msg = true;
             goto err_out;
         }
+        if (op->cache_dir)
+            sg_rcache_open(op->cache_dir, op->device_name, sg_fd, vb);
     }
     if (op->opcode >= 0)
         rep_opts = ((op->servact >= 0) ? 2 : 1);
@@ -1,5 +1,5 @@
 /* A utility program originally written for the Linux OS SCSI subsystem.
- *  Copyright (C) 2004-2023 D. Gilbert
+ *  Copyright (C) 2004-2026 D. Gilbert
  *  This program is free software; you can redistribute it and/or modify
  *  it under the terms of the GNU General Public License as published by
  *  the Free Software Foundation; either version 2, or (at your option)
@@ -28,14 +28,15 @@
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
-
 #include "sg_lib.h"
 #include "sg_cmds_basic.h"
 #include "sg_cmds_extra.h"
 #include "sg_unaligned.h"
+#include "sg_par.h"
 #include "sg_pr2serr.h"
+#include "sg_json_sg_lib.h"
 
-static const char * version_str = "0.72 20230407";
+static const char * version_str = "0.74 20261015";
 static const char * my_name = "sg_persist: ";
 
 
@@ -55,6 +56,13 @@ static const char * my_name = "sg_persist: ";
 #define MX_ALLOC_LEN 8192
 #define MX_TIDS 32
 #define MX_TID_LEN 256
+#define PR_VPD_DI_LEN 2048
+#define PR_TPORT_ID_LEN 520    /* hex of longest designator, plus "0x" */
+#define PR_MAX_PARALLEL 256
+#define PR_DEF_PARALLEL 32
+#define PR_DEF_PER_PORT 4
+#define PR_AUDIT_GEN 4         /* prin_val[] index, others are PRIN SAs */
+#define PR_AUDIT_NUM 5
 
 
 #define SG_PERSIST_IN_RDONLY "SG_PERSIST_IN_RDONLY"
@@ -71,7 +79,10 @@ struct opts_t {
     bool verbose_given;
     bool version_given;
     int hex;
+    int num_parallel;   /* --batch=BF: DEVICEs worked on at once */
     int num_transportids;
+    int per_port;       /* --batch=BF: limit on each target port */
+    int prin_mask;      /* --batch=BF with PR In: (1 << sa) for each */
     int prin_sa;
     int prout_sa;
     int verbose;
@@ -80,6 +91,8 @@ struct opts_t {
     uint32_t prout_type;
     uint64_t param_rk;
     uint64_t param_sark;
+    const char * batch_fn;
+    const char * dev_name;      /* prefix for PR Out errors, else NULL */
     uint8_t transportid_arr[MX_TIDS * MX_TID_LEN];
 };
 
@@ -87,6 +100,7 @@ struct opts_t {
 static struct option long_options[] = {
     {"alloc-length", required_argument, 0, 'l'},
     {"alloc_length", required_argument, 0, 'l'},
+    {"batch", required_argument, 0, 'B'},
     {"clear", no_argument, 0, 'C'},
     {"device", required_argument, 0, 'd'},
     {"help", no_argument, 0, 'h'},
@@ -96,6 +110,7 @@ static struct option long_options[] = {
     {"no-inquiry", no_argument, 0, 'n'},
     {"no_inquiry", no_argument, 0, 'n'},
     {"out", no_argument, 0, 'o'},
+    {"parallel", required_argument, 0, 'p'},
     {"param-alltgpt", no_argument, 0, 'Y'},
     {"param_alltgpt", no_argument, 0, 'Y'},
     {"param-aptpl", no_argument, 0, 'Z'},
@@ -106,6 +121,8 @@ static struct option long_options[] = {
     {"param_sark", required_argument, 0, 'S'},
     {"param-unreg", no_argument, 0, 'U'},
     {"param_unreg", no_argument, 0, 'U'},
+    {"per-port", required_argument, 0, 't'},
+    {"per_port", required_argument, 0, 't'},
     {"preempt", no_argument, 0, 'P'},
     {"preempt-abort", no_argument, 0, 'A'},
     {"preempt_abort", no_argument, 0, 'A'},
@@ -181,6 +198,15 @@ static const char * pr_type_strs[] = {
     "obsolete [0xd]", "obsolete [0xe]", "obsolete [0xf]",
 };
 
+/* Names of the items compared by --in --batch=BF, by prin_val[] index */
+static const char * pr_audit_names[PR_AUDIT_NUM] = {
+    "registered_keys",
+    "reservation",
+    NULL,
+    "full_status",
+    "prgeneration",
+};
+
 static const char * const prout_s = "PR out";
 static const char * const prin_s = "PR in";
 
@@ -234,6 +260,16 @@ usage(int help)
                 "value (used with\n"
                 "                                 PR In only) (default: 8192 "
                 "(2000 in hex))\n"
+                "    --batch=BF|-B BF           PR Out actions, one a line "
+                "in file BF, each\n"
+                "                               line: 'DEVICE [ACTION] "
+                "[rk=RK] [sark=SARK]\n"
+                "                               [type=TYPE] [aptpl] "
+                "[alltgpt]'; output JSON.\n"
+                "                               With PR In, each line is a "
+                "DEVICE; output\n"
+                "                               is inconsistencies between "
+                "paths to an LU\n"
                 "    --device=DEVICE|-d DEVICE    supply DEVICE as an option "
                 "rather than\n"
                 "                                 an argument\n"
@@ -245,9 +281,16 @@ usage(int help)
                 "(def: 8192, 8k, 2000h)\n"
                 "    --no-inquiry|-n            skip INQUIRY (default: do "
                 "INQUIRY)\n"
+                "    --parallel=Q|-p Q          with --batch=BF, up to Q "
+                "DEVICEs at once\n"
+                "                               (def: 32)\n"
                 "    --param-alltgpt|-Y         PR Out parameter "
                 "'ALL_TG_PT'\n"
                 "    --param-aptpl|-Z           PR Out parameter 'APTPL'\n"
+                "    --per-port=PP|-t PP        with --batch=BF, up to PP "
+                "DEVICEs at once\n"
+                "                               on any target port (def: "
+                "4)\n"
                 "    --readonly|-y              open DEVICE read-only (def: "
                 "read-write)\n"
                 "    --relative-target-port=RTPI|-Q RTPI    relative target "
@@ -485,6 +528,8 @@ prout_work(int sg_fd, struct opts_t * op)
     int res = 0;
     uint8_t * pr_buff = NULL;
     uint8_t * free_pr_buff = NULL;
+    const char * dnp = op->dev_name ? op->dev_name : "";
+    const char * sep = op->dev_name ? ": " : "";
     char b[64];
     char bb[80];
 
@@ -519,19 +564,22 @@ prout_work(int sg_fd, struct opts_t * op)
             snprintf(b, sizeof(b), "service action=0x%x", op->prout_sa);
         if (res) {
             if (SG_LIB_CAT_INVALID_OP == res)
-                pr2serr("%s (%s): command not supported\n", prout_s, b);
+                pr2serr("%s%s%s (%s): command not supported\n", dnp, sep,
+                        prout_s, b);
             else if (SG_LIB_CAT_ILLEGAL_REQ == res)
-                pr2serr("%s (%s): bad field in cdb (perhaps unsupported "
-                        "service action)\n", prout_s, b);
+                pr2serr("%s%s%s (%s): bad field in cdb (perhaps unsupported "
+                        "service action)\n", dnp, sep, prout_s, b);
             else if (SG_LIB_CAT_INVALID_PARAM == res)
-                pr2serr("%s (%s): bad field parameter list\n", prout_s, b);
+                pr2serr("%s%s%s (%s): bad field parameter list\n", dnp, sep,
+                        prout_s, b);
             else {
                 sg_get_category_sense_str(res, sizeof(bb), bb, op->verbose);
-                pr2serr("%s (%s): %s\n", prout_s, b, bb);
+                pr2serr("%s%s%s (%s): %s\n", dnp, sep, prout_s, b, bb);
             }
             goto fini;
         } else if (op->verbose)
-            pr2serr("%s: command (%s) successful\n", prout_s, b);
+            pr2serr("%s%s%s: command (%s) successful\n", dnp, sep, prout_s,
+                    b);
     }
 fini:
     if (free_pr_buff)
@@ -943,6 +991,819 @@ my_cont_b:
     return 0;
 }
 
+/* Names of the PR Out service actions accepted in a --batch=BF file */
+static struct pr_act_name_t {
+    const char * name;
+    int prout_sa;
+} pr_act_names[] = {
+    {"register", PROUT_REG_SA},
+    {"reserve", PROUT_RES_SA},
+    {"release", PROUT_REL_SA},
+    {"clear", PROUT_CLEAR_SA},
+    {"preempt", PROUT_PREE_SA},
+    {"preempt-abort", PROUT_PREE_AB_SA},
+    {"register-ignore", PROUT_REG_IGN_SA},
+    {"replace-lost", PROUT_REPL_LOST_SA},
+    {NULL, -1},
+};
+
+/* One PR Out command from a --batch=BF file */
+struct pr_act_t {
+    bool param_alltgpt;
+    bool param_aptpl;
+    int line;           /* in BF, for error messages */
+    int next;           /* next action (index) on same DEVICE, -1 for end */
+    int prout_sa;
+    int res;            /* -1: not attempted, else 0 or SG_LIB_CAT_* */
+    uint32_t prout_type;
+    uint64_t param_rk;
+    uint64_t param_sark;
+};
+
+/* One DEVICE from a --batch=BF file; its actions are done in file order */
+struct pr_dev_t {
+    int sg_fd;
+    int res;            /* 0 or result of the step that failed */
+    int first_act;      /* index into act_arr */
+    int last_act;
+    int port;           /* index into port_arr, -1 if not known */
+    const char * dev_name;
+    char tport_id[PR_TPORT_ID_LEN];     /* "" if not known */
+    char lu_id[PR_TPORT_ID_LEN];        /* "" if not known */
+    char * prin_val[PR_AUDIT_NUM];      /* PR In summaries, from malloc() */
+};
+
+struct pr_port_t {
+    const char * id;    /* points to tport_id of first DEVICE on port */
+};
+
+struct pr_batch_t {
+    int num_devs;
+    int max_devs;
+    int num_acts;
+    int max_acts;
+    int num_ports;
+    int per_port;
+    struct pr_dev_t * dev_arr;
+    struct pr_act_t * act_arr;
+    struct pr_port_t * port_arr;        /* num_devs elements */
+    const struct opts_t * op;
+};
+
+static int
+pr_batch_add_dev(struct pr_batch_t * bp, const char * name)
+{
+    int k;
+    struct pr_dev_t * dp;
+
+    for (k = 0; k < bp->num_devs; ++k) {
+        if (0 == strcmp(name, bp->dev_arr[k].dev_name))
+            return k;
+    }
+    if (bp->num_devs >= bp->max_devs) {
+        int n = bp->max_devs ? (2 * bp->max_devs) : 64;
+
+        dp = (struct pr_dev_t *)realloc(bp->dev_arr, n * sizeof(*dp));
+        if (NULL == dp)
+            return -1;
+        bp->dev_arr = dp;
+        bp->max_devs = n;
+    }
+    dp = bp->dev_arr + bp->num_devs;
+    memset(dp, 0, sizeof(*dp));
+    dp->dev_name = strdup(name);
+    if (NULL == dp->dev_name)
+        return -1;
+    dp->sg_fd = -1;
+    dp->first_act = -1;
+    dp->last_act = -1;
+    dp->port = -1;
+    return bp->num_devs++;
+}
+
+/* Returns the next white space separated word in the line at *cpp (which
+ * is NUL terminated in place) and steps *cpp past it. Returns NULL when
+ * there are no more words. */
+static char *
+pr_next_word(char ** cpp)
+{
+    char * cp = *cpp;
+    char * wp;
+
+    while (isspace((uint8_t)*cp))
+        ++cp;
+    if ('\0' == *cp)
+        return NULL;
+    for (wp = cp; *cp && (! isspace((uint8_t)*cp)); ++cp)
+        ;
+    if (*cp)
+        *cp++ = '\0';
+    *cpp = cp;
+    return wp;
+}
+
+/* Parses one 'NAME=VALUE' or flag word that follows the ACTION on a line
+ * of a --batch=BF file. Returns true if ok. */
+static bool
+pr_batch_param(const char * wp, struct pr_act_t * ap)
+{
+    if (0 == strcmp(wp, "aptpl"))
+        ap->param_aptpl = true;
+    else if (0 == strcmp(wp, "alltgpt"))
+        ap->param_alltgpt = true;
+    else if (0 == strncmp(wp, "rk=", 3))
+        return (1 == sscanf(wp + 3, "%" SCNx64 "", &ap->param_rk));
+    else if (0 == strncmp(wp, "sark=", 5))
+        return (1 == sscanf(wp + 5, "%" SCNx64 "", &ap->param_sark));
+    else if (0 == strncmp(wp, "type=", 5))
+        return (1 == sscanf(wp + 5, "%x", &ap->prout_type));
+    else
+        return false;
+    return true;
+}
+
+/* Reads the --batch=BF file ('-' for stdin). For PR Out each line is
+ * 'DEVICE [ACTION [rk=RK] [sark=SARK] [type=TYPE] [aptpl] [alltgpt]]'
+ * where anything not given is taken from the command line. For PR In
+ * each line is just 'DEVICE'. Empty lines and those starting with '#' are
+ * ignored. Returns 0 on success. */
+static int
+pr_batch_read(const char * fn, struct pr_batch_t * bp)
+{
+    int k, n, d;
+    int line = 0;
+    int ret = 0;
+    char * cp;
+    char * wp;
+    FILE * fp;
+    const struct opts_t * op = bp->op;
+    const struct pr_act_name_t * anp;
+    struct pr_act_t * ap;
+    struct pr_dev_t * dp;
+    char b[1024];
+
+    if ((1 == strlen(fn)) && ('-' == fn[0]))
+        fp = stdin;
+    else {
+        fp = fopen(fn, "r");
+        if (NULL == fp) {
+            n = errno;
+            pr2serr("unable to open file: %s [%s]\n", fn, safe_strerror(n));
+            return sg_convert_errno(n);
+        }
+    }
+    while (fgets(b, sizeof(b), fp)) {
+        ++line;
+        for (cp = b; isspace((uint8_t)*cp); ++cp)
+            ;
+        if (('\0' == *cp) || ('#' == *cp))
+            continue;
+        wp = pr_next_word(&cp);
+        d = pr_batch_add_dev(bp, wp);
+        if (op->pr_in && (d >= 0)) {
+            wp = pr_next_word(&cp);
+            if (wp) {
+                pr2serr("%s: line %d: unexpected '%s', with PR In each line "
+                        "is a DEVICE\n", fn, line, wp);
+                ret = SG_LIB_SYNTAX_ERROR;
+                break;
+            }
+            continue;
+        }
+        if ((d >= 0) && (bp->num_acts >= bp->max_acts)) {
+            n = bp->max_acts ? (2 * bp->max_acts) : 64;
+            ap = (struct pr_act_t *)realloc(bp->act_arr, n * sizeof(*ap));
+            if (ap) {
+                bp->act_arr = ap;
+                bp->max_acts = n;
+            } else
+                d = -1;
+        }
+        if (d < 0) {
+            pr2serr("%s: out of memory\n", __func__);
+            ret = sg_convert_errno(ENOMEM);
+            break;
+        }
+        ap = bp->act_arr + bp->num_acts;
+        memset(ap, 0, sizeof(*ap));
+        ap->line = line;
+        ap->next = -1;
+        ap->res = -1;
+        ap->prout_sa = op->prout_sa;
+        ap->prout_type = op->prout_type;
+        ap->param_rk = op->param_rk;
+        ap->param_sark = op->param_sark;
+        ap->param_alltgpt = op->param_alltgpt;
+        ap->param_aptpl = op->param_aptpl;
+        wp = pr_next_word(&cp);
+        if (wp && (NULL == strchr(wp, '='))) {
+            for (anp = pr_act_names; anp->name; ++anp) {
+                if (0 == strcmp(wp, anp->name))
+                    break;
+            }
+            if (anp->name) {
+                ap->prout_sa = anp->prout_sa;
+                wp = pr_next_word(&cp);
+            }
+        }
+        for ( ; wp; wp = pr_next_word(&cp)) {
+            if (! pr_batch_param(wp, ap))
+                break;
+        }
+        if (wp) {
+            pr2serr("%s: line %d: unexpected '%s'\n", fn, line, wp);
+            ret = SG_LIB_SYNTAX_ERROR;
+            break;
+        }
+        if (ap->prout_sa < 0) {
+            pr2serr("%s: line %d: no action given (e.g. 'register') and "
+                    "none on the\ncommand line\n", fn, line);
+            ret = SG_LIB_SYNTAX_ERROR;
+            break;
+        }
+        dp = bp->dev_arr + d;
+        k = bp->num_acts++;
+        if (dp->last_act >= 0)
+            bp->act_arr[dp->last_act].next = k;
+        else
+            dp->first_act = k;
+        dp->last_act = k;
+    }
+    if (stdin != fp)
+        fclose(fp);
+    if ((0 == ret) && (0 == bp->num_devs)) {
+        pr2serr("%s: no DEVICEs found\n", fn);
+        ret = SG_LIB_SYNTAX_ERROR;
+    }
+    return ret;
+}
+
+/* Places a printable form of the designator at dp into b */
+static void
+pr_desig_str(const uint8_t * dp, char * b, int blen)
+{
+    int k, n;
+    int c_set = dp[0] & 0xf;
+    int d_len = dp[3];
+
+    if ((3 == c_set) || (2 == c_set)) {         /* UTF-8 or ASCII */
+        snprintf(b, blen, "%.*s", d_len, (const char *)(dp + 4));
+        return;
+    }
+    n = snprintf(b, blen, "0x");
+    for (k = 0; (k < d_len) && (n < (blen - 2)); ++k)
+        n += snprintf(b + n, blen - n, "%02x", dp[4 + k]);
+}
+
+/* Places a printable form of the first target port designator (other than
+ * the relative target port) in the Device Identification VPD page into
+ * tport_b. Places the logical unit's designator (NAA preferred, then
+ * EUI-64, SCSI name string and T10 vendor id based) into lu_b. Each is
+ * left as an empty string if there is none or it cannot be fetched. */
+static void
+pr_get_ids(int sg_fd, char * tport_b, char * lu_b, int blen, int vb)
+{
+    int k, off, len, d_type;
+    const uint8_t * dp;
+    static const int lu_desig_types[] = {3, 2, 8, 1};
+    uint8_t rsp[PR_VPD_DI_LEN];
+
+    tport_b[0] = '\0';
+    lu_b[0] = '\0';
+    if (sg_ll_inquiry(sg_fd, false, true /* evpd */, 0x83 /* VPD_DI */, rsp,
+                      sizeof(rsp), false, vb))
+        return;
+    len = sg_get_unaligned_be16(rsp + 2);
+    if ((0x83 != rsp[1]) || (len < 4))
+        return;
+    if (len > ((int)sizeof(rsp) - 4))
+        len = (int)sizeof(rsp) - 4;
+    /* association 1 is the target port that the command was received on */
+    for (off = -1; 0 == sg_vpd_dev_id_iter(rsp + 4, len, &off, 1, -1, -1); ) {
+        dp = rsp + 4 + off;
+        d_type = dp[1] & 0xf;
+        if ((4 == d_type) || (5 == d_type))     /* relative port, TPG */
+            continue;
+        pr_desig_str(dp, tport_b, blen);
+        break;
+    }
+    /* association 0 is the logical unit */
+    for (k = 0; k < (int)SG_ARRAY_SIZE(lu_desig_types); ++k) {
+        off = -1;
+        if (0 == sg_vpd_dev_id_iter(rsp + 4, len, &off, 0,
+                                    lu_desig_types[k], -1)) {
+            pr_desig_str(rsp + 4 + off, lu_b, blen);
+            break;
+        }
+    }
+}
+
+/* Opens DEVICE k and finds the target port it is connected through and
+ * the logical unit it reaches. The result is kept in its pr_dev_t. */
+static int
+pr_batch_ident(int64_t k, void * ctx)
+{
+    struct pr_batch_t * bp = (struct pr_batch_t *)ctx;
+    struct pr_dev_t * dp = bp->dev_arr + k;
+    const struct opts_t * op = bp->op;
+
+    dp->sg_fd = sg_cmds_open_device(dp->dev_name, op->readonly,
+                                    op->verbose);
+    if (dp->sg_fd < 0) {
+        pr2serr("%serror opening file %s (r%s): %s\n", my_name, dp->dev_name,
+                (op->readonly ? "o" : "w"), safe_strerror(-dp->sg_fd));
+        dp->res = sg_convert_errno(-dp->sg_fd);
+        dp->sg_fd = -1;
+        return 0;
+    }
+    pr_get_ids(dp->sg_fd, dp->tport_id, dp->lu_id, sizeof(dp->tport_id),
+               op->verbose);
+    return 0;
+}
+
+/* Places DEVICE into the port_arr[] slot for its target port */
+static void
+pr_batch_set_port(struct pr_batch_t * bp, struct pr_dev_t * dp)
+{
+    int k;
+
+    if ('\0' == dp->tport_id[0])
+        return;         /* unknown target port, so no per port limit */
+    for (k = 0; k < bp->num_ports; ++k) {
+        if (0 == strcmp(dp->tport_id, bp->port_arr[k].id))
+            break;
+    }
+    if (k >= bp->num_ports) {
+        bp->port_arr[k].id = dp->tport_id;
+        ++bp->num_ports;
+    }
+    dp->port = k;
+}
+
+/* Sends the PR Out commands for one DEVICE, in BF order, stopping at the
+ * first that fails. */
+static void
+pr_batch_prout(struct pr_batch_t * bp, struct pr_dev_t * dp)
+{
+    int k;
+    struct pr_act_t * ap;
+    struct opts_t * o2p;
+
+    /* use a copy of the command line options for the fields in BF */
+    o2p = (struct opts_t *)malloc(sizeof(*o2p));
+    if (NULL == o2p) {
+        dp->res = sg_convert_errno(ENOMEM);
+        return;
+    }
+    memcpy(o2p, bp->op, sizeof(*o2p));
+    o2p->dev_name = dp->dev_name;
+    for (k = dp->first_act; k >= 0; k = ap->next) {
+        ap = bp->act_arr + k;
+        o2p->prout_sa = ap->prout_sa;
+        o2p->prout_type = ap->prout_type;
+        o2p->param_rk = ap->param_rk;
+        o2p->param_sark = ap->param_sark;
+        o2p->param_alltgpt = ap->param_alltgpt;
+        o2p->param_aptpl = ap->param_aptpl;
+        ap->res = prout_work(dp->sg_fd, o2p);
+        if (ap->res < 0)
+            ap->res = SG_LIB_CAT_OTHER;
+        if (ap->res) {
+            dp->res = ap->res;
+            break;
+        }
+    }
+    free(o2p);
+}
+
+static int
+pr_cmp_u64(const void * ap, const void * bp)
+{
+    uint64_t a = *(const uint64_t *)ap;
+    uint64_t b = *(const uint64_t *)bp;
+
+    return (a < b) ? -1 : (a > b);
+}
+
+static int
+pr_cmp_str(const void * ap, const void * bp)
+{
+    return strcmp(*(char * const *)ap, *(char * const *)bp);
+}
+
+/* Returns a summary, in a string from malloc(), of the PR In response in
+ * buff (of len bytes) to the service action sa. Registered keys and full
+ * status descriptors are sorted so that the summary does not depend on
+ * the order a DEVICE reports them in. Returns NULL if out of memory. */
+static char *
+pr_audit_summary(int sa, const uint8_t * buff, int len)
+{
+    int k, j, m, n, num, add_len;
+    int d_len = 0;
+    int sz = 0;
+    const uint8_t * bp;
+    uint64_t * kp;
+    char ** sp;
+    char * cp;
+
+    add_len = sg_get_unaligned_be32(buff + 4);
+    if (add_len > (len - 8))
+        add_len = len - 8;
+    bp = buff + 8;
+    if (PRIN_RRES_SA == sa) {
+        cp = (char *)malloc(64);
+        if (NULL == cp)
+            return NULL;
+        if (add_len >= 16)
+            snprintf(cp, 64, "key=0x%" PRIx64 ",scope=%d,type=%d",
+                     sg_get_unaligned_be64(bp), (bp[13] >> 4) & 0xf,
+                     bp[13] & 0xf);
+        else
+            snprintf(cp, 64, "none");
+        return cp;
+    }
+    if (PRIN_RKEY_SA == sa) {
+        num = add_len / 8;
+        kp = (uint64_t *)calloc(num + 1, sizeof(uint64_t));
+        cp = (char *)malloc((num * 20) + 8);
+        if ((NULL == kp) || (NULL == cp)) {
+            free(kp);
+            free(cp);
+            return NULL;
+        }
+        for (k = 0; k < num; ++k)
+            kp[k] = sg_get_unaligned_be64(bp + (8 * k));
+        qsort(kp, num, sizeof(uint64_t), pr_cmp_u64);
+        n = 0;
+        cp[0] = '\0';
+        for (k = 0; k < num; ++k)
+            n += sprintf(cp + n, "%s0x%" PRIx64, (k ? "," : ""), kp[k]);
+        if (0 == num)
+            sprintf(cp, "none");
+        free(kp);
+        return cp;
+    }
+    /* PRIN_RFSTAT_SA: one string per descriptor, then sort and join them */
+    for (k = 0, num = 0; (k + 24) <= add_len; k += 24 + d_len, ++num)
+        d_len = sg_get_unaligned_be32(bp + k + 20);
+    sp = (char **)calloc(num + 1, sizeof(char *));
+    if (NULL == sp)
+        return NULL;
+    for (k = 0, j = 0; j < num; k += 24 + d_len, ++j) {
+        const uint8_t * dp = bp + k;
+
+        d_len = sg_get_unaligned_be32(dp + 20);
+        if ((k + 24 + d_len) > add_len)
+            d_len = add_len - (k + 24);
+        sp[j] = (char *)malloc(96 + (2 * d_len));
+        if (NULL == sp[j])
+            break;
+        n = sprintf(sp[j], "key=0x%" PRIx64, sg_get_unaligned_be64(dp));
+        if (dp[12] & 0x2)
+            n += sprintf(sp[j] + n, ",all_tg_pt");
+        else
+            n += sprintf(sp[j] + n, ",rtpi=%u",
+                         sg_get_unaligned_be16(dp + 18));
+        if (dp[12] & 0x1)
+            n += sprintf(sp[j] + n, ",holder,scope=%d,type=%d",
+                         (dp[13] >> 4) & 0xf, dp[13] & 0xf);
+        if (d_len > 0)
+            n += sprintf(sp[j] + n, ",tid=");
+        for (m = 0; m < d_len; ++m)
+            n += sprintf(sp[j] + n, "%02x", dp[24 + m]);
+        sz += n + 1;
+    }
+    cp = NULL;
+    if (j >= num) {
+        qsort(sp, num, sizeof(char *), pr_cmp_str);
+        cp = (char *)malloc(sz + 8);
+    }
+    if (cp) {
+        n = 0;
+        cp[0] = '\0';
+        for (k = 0; k < num; ++k)
+            n += sprintf(cp + n, "%s%s", (k ? ";" : ""), sp[k]);
+        if (0 == num)
+            sprintf(cp, "none");
+    }
+    for (k = 0; k < num; ++k)
+        free(sp[k]);
+    free(sp);
+    return cp;
+}
+
+/* Sends the chosen PR In commands to one DEVICE and keeps a summary of
+ * each response. A service action the DEVICE does not support is noted
+ * as such rather than failing the DEVICE. */
+static void
+pr_batch_prin(struct pr_batch_t * bp, struct pr_dev_t * dp)
+{
+    int k, res;
+    const struct opts_t * op = bp->op;
+    uint8_t * buff;
+    uint8_t * free_buff = NULL;
+    char b[80];
+
+    buff = sg_memalign(op->alloc_len, 0 /* page aligned */, &free_buff,
+                       false);
+    if (NULL == buff) {
+        dp->res = sg_convert_errno(ENOMEM);
+        return;
+    }
+    for (k = PRIN_RKEY_SA; k <= PRIN_RFSTAT_SA; ++k) {
+        if ((PRIN_RCAP_SA == k) || (! (op->prin_mask & (1 << k))))
+            continue;
+        res = sg_ll_persistent_reserve_in(dp->sg_fd, k, buff, op->alloc_len,
+                                          false, op->verbose);
+        if ((SG_LIB_CAT_INVALID_OP == res) ||
+            (SG_LIB_CAT_ILLEGAL_REQ == res)) {
+            dp->prin_val[k] = strdup("not supported");
+            continue;
+        } else if (res) {
+            sg_get_category_sense_str(res, sizeof(b), b, op->verbose);
+            pr2serr("%s: %s (%s): %s\n", dp->dev_name, prin_s,
+                    prin_sa_strs[k], b);
+            dp->res = (res > 0) ? res : SG_LIB_CAT_OTHER;
+            break;
+        }
+        if (NULL == dp->prin_val[PR_AUDIT_GEN]) {
+            snprintf(b, sizeof(b), "0x%x", sg_get_unaligned_be32(buff));
+            dp->prin_val[PR_AUDIT_GEN] = strdup(b);
+        }
+        dp->prin_val[k] = pr_audit_summary(k, buff, op->alloc_len);
+        if (NULL == dp->prin_val[k]) {
+            dp->res = sg_convert_errno(ENOMEM);
+            break;
+        }
+    }
+    free(free_buff);
+}
+
+/* Returns the logical unit identifier of dp, or its DEVICE name if it has
+ * none (so then that DEVICE is a group of its own). */
+static const char *
+pr_lu_of(const struct pr_dev_t * dp)
+{
+    return dp->lu_id[0] ? dp->lu_id : dp->dev_name;
+}
+
+/* Groups the DEVICEs that succeeded by logical unit and, for each item
+ * summarised by pr_batch_prin(), outputs an inconsistency when the
+ * DEVICEs in a group do not all agree. Also outputs those DEVICEs that
+ * failed. Only the problems are output, as one JSON document on stdout.
+ * Returns the number of inconsistencies found. */
+static int
+pr_audit_output(struct pr_batch_t * bp, int num_failed, int ret, int argc,
+                char * argv[])
+{
+    int k, j, m, item;
+    int num_lus = 0;
+    int num_incons = 0;
+    sgj_state js SG_C_CPP_ZERO_INIT;
+    sgj_state * jsp = &js;
+    sgj_opaque_p jop;
+    sgj_opaque_p jo2p;
+    sgj_opaque_p jo3p;
+    sgj_opaque_p jo4p;
+    sgj_opaque_p jap;
+    sgj_opaque_p jap2;
+    sgj_opaque_p jap3;
+    struct pr_dev_t * dp;
+    struct pr_dev_t * d2p;
+    char b[128];
+
+    if (! sgj_init_state(jsp, NULL))
+        return 0;
+    jop = sgj_start_r("sg_persist", version_str, argc, argv, jsp);
+    jo2p = sgj_named_subobject_r(jsp, jop, "persistent_reserve_in_audit");
+    jap = sgj_named_subarray_r(jsp, jo2p, "inconsistency_list");
+    for (k = 0, dp = bp->dev_arr; k < bp->num_devs; ++k, ++dp) {
+        if (dp->res)
+            continue;
+        /* only the first DEVICE of each logical unit starts a group */
+        for (j = 0, d2p = bp->dev_arr; j < k; ++j, ++d2p) {
+            if ((0 == d2p->res) && (0 == strcmp(pr_lu_of(dp), pr_lu_of(d2p))))
+                break;
+        }
+        if (j < k)
+            continue;
+        ++num_lus;
+        for (item = 0; item < PR_AUDIT_NUM; ++item) {
+            if (PRIN_RCAP_SA == item)
+                continue;
+            for (j = k + 1, d2p = dp + 1; j < bp->num_devs; ++j, ++d2p) {
+                if (d2p->res || strcmp(pr_lu_of(dp), pr_lu_of(d2p)))
+                    continue;
+                if ((NULL == dp->prin_val[item]) !=
+                    (NULL == d2p->prin_val[item]))
+                    break;
+                if (dp->prin_val[item] &&
+                    strcmp(dp->prin_val[item], d2p->prin_val[item]))
+                    break;
+            }
+            if (j >= bp->num_devs)
+                continue;       /* all paths to this LU agree */
+            ++num_incons;
+            jo3p = sgj_new_unattached_object_r(jsp);
+            sgj_js_nv_s(jsp, jo3p, "logical_unit_identifier", pr_lu_of(dp));
+            sgj_js_nv_s(jsp, jo3p, "item", pr_audit_names[item]);
+            jap2 = sgj_named_subarray_r(jsp, jo3p, "device_list");
+            for (m = k, d2p = dp; m < bp->num_devs; ++m, ++d2p) {
+                if (d2p->res || strcmp(pr_lu_of(dp), pr_lu_of(d2p)))
+                    continue;
+                jo4p = sgj_new_unattached_object_r(jsp);
+                sgj_js_nv_s(jsp, jo4p, "device_name", d2p->dev_name);
+                if (d2p->tport_id[0])
+                    sgj_js_nv_s(jsp, jo4p, "target_port_identifier",
+                                d2p->tport_id);
+                sgj_js_nv_s(jsp, jo4p, "value", d2p->prin_val[item] ?
+                            d2p->prin_val[item] : "not read");
+                sgj_js_nv_o(jsp, jap2, NULL, jo4p);
+            }
+            sgj_js_nv_o(jsp, jap, NULL, jo3p);
+        }
+    }
+    jap3 = sgj_named_subarray_r(jsp, jo2p, "failed_device_list");
+    for (k = 0, dp = bp->dev_arr; k < bp->num_devs; ++k, ++dp) {
+        if (0 == dp->res)
+            continue;
+        jo3p = sgj_new_unattached_object_r(jsp);
+        sgj_js_nv_s(jsp, jo3p, "device_name", dp->dev_name);
+        sgj_js_nv_i(jsp, jo3p, "exit_status", dp->res);
+        if (sg_exit2str(dp->res, false, sizeof(b), b))
+            sgj_js_nv_s(jsp, jo3p, "exit_status_meaning", b);
+        sgj_js_nv_o(jsp, jap3, NULL, jo3p);
+    }
+    sgj_js_nv_i(jsp, jo2p, "number_of_devices", bp->num_devs);
+    sgj_js_nv_i(jsp, jo2p, "number_of_devices_failed", num_failed);
+    sgj_js_nv_i(jsp, jo2p, "number_of_logical_units", num_lus);
+    sgj_js_nv_i(jsp, jo2p, "number_of_inconsistencies", num_incons);
+    if ((0 == ret) && num_incons)
+        ret = SG_LIB_CAT_MISCOMPARE;
+    sgj_js2file(jsp, NULL, ret, stdout);
+    sgj_finish(jsp);
+    return num_incons;
+}
+
+/* Works on DEVICE k, if it was opened and identified */
+static int
+pr_batch_one(int64_t k, void * ctx)
+{
+    struct pr_batch_t * bp = (struct pr_batch_t *)ctx;
+    struct pr_dev_t * dp = bp->dev_arr + k;
+
+    if (dp->res)
+        return 0;
+    if (bp->op->pr_in)
+        pr_batch_prin(bp, dp);
+    else
+        pr_batch_prout(bp, dp);
+    return 0;
+}
+
+/* Outputs the result of each DEVICE, and of each of its actions, as one
+ * JSON document on stdout */
+static void
+pr_batch_output(struct pr_batch_t * bp, int num_failed, int ret, int argc,
+                char * argv[])
+{
+    int k, j;
+    sgj_state js SG_C_CPP_ZERO_INIT;
+    sgj_state * jsp = &js;
+    sgj_opaque_p jop;
+    sgj_opaque_p jo2p;
+    sgj_opaque_p jo3p;
+    sgj_opaque_p jo4p;
+    sgj_opaque_p jap;
+    sgj_opaque_p jap2;
+    struct pr_dev_t * dp;
+    struct pr_act_t * ap;
+    char b[128];
+
+    if (! sgj_init_state(jsp, NULL))
+        return;
+    jop = sgj_start_r("sg_persist", version_str, argc, argv, jsp);
+    jo2p = sgj_named_subobject_r(jsp, jop, "persistent_reserve_out_batch");
+    sgj_js_nv_i(jsp, jo2p, "number_of_devices", bp->num_devs);
+    sgj_js_nv_i(jsp, jo2p, "number_of_target_ports", bp->num_ports);
+    sgj_js_nv_i(jsp, jo2p, "number_of_devices_failed", num_failed);
+    jap = sgj_named_subarray_r(jsp, jo2p, "device_list");
+    for (k = 0, dp = bp->dev_arr; k < bp->num_devs; ++k, ++dp) {
+        jo3p = sgj_new_unattached_object_r(jsp);
+        sgj_js_nv_s(jsp, jo3p, "device_name", dp->dev_name);
+        if (dp->tport_id[0])
+            sgj_js_nv_s(jsp, jo3p, "target_port_identifier", dp->tport_id);
+        sgj_js_nv_i(jsp, jo3p, "exit_status", dp->res);
+        if (dp->res && sg_exit2str(dp->res, false, sizeof(b), b))
+            sgj_js_nv_s(jsp, jo3p, "exit_status_meaning", b);
+        jap2 = sgj_named_subarray_r(jsp, jo3p, "action_list");
+        for (j = dp->first_act; j >= 0; j = ap->next) {
+            ap = bp->act_arr + j;
+            jo4p = sgj_new_unattached_object_r(jsp);
+            sgj_js_nv_s(jsp, jo4p, "service_action",
+                        prout_sa_strs[ap->prout_sa]);
+            sgj_js_nv_i(jsp, jo4p, "service_action_code", ap->prout_sa);
+            sgj_js_nv_i(jsp, jo4p, "prout_type", ap->prout_type);
+            sgj_js_nv_i(jsp, jo4p, "line", ap->line);
+            if (ap->res < 0)
+                sgj_js_nv_b(jsp, jo4p, "attempted", false);
+            else {
+                sgj_js_nv_i(jsp, jo4p, "exit_status", ap->res);
+                if (ap->res && sg_exit2str(ap->res, false, sizeof(b), b))
+                    sgj_js_nv_s(jsp, jo4p, "exit_status_meaning", b);
+            }
+            sgj_js_nv_o(jsp, jap2, NULL, jo4p);
+        }
+        sgj_js_nv_o(jsp, jap, NULL, jo3p);
+    }
+    sgj_js2file(jsp, NULL, ret, stdout);
+    sgj_finish(jsp);
+}
+
+/* Implements --batch=BF: sends PR Out (or PR In) commands to many DEVICEs
+ * at once, with up to op->num_parallel DEVICEs being worked on in total
+ * and up to op->per_port on any one target port. Returns 0 if all
+ * succeeded else the result of the first DEVICE (in BF order) that failed.
+ * For PR In, if all succeeded but their responses are inconsistent then
+ * SG_LIB_CAT_MISCOMPARE is returned. */
+static int
+pr_batch_run(struct opts_t * op, int argc, char * argv[])
+{
+    int k, j, res;
+    int num_failed = 0;
+    int ret = 0;
+    int * grp_arr = NULL;
+    struct pr_dev_t * dp;
+    struct pr_batch_t batch;
+
+    memset(&batch, 0, sizeof(batch));
+    batch.op = op;
+    batch.per_port = op->per_port;
+    ret = pr_batch_read(op->batch_fn, &batch);
+    if (ret)
+        goto fini;
+    batch.port_arr = (struct pr_port_t *)calloc(batch.num_devs,
+                                                sizeof(struct pr_port_t));
+    if (NULL == batch.port_arr) {
+        pr2serr("%s: out of memory\n", __func__);
+        ret = sg_convert_errno(ENOMEM);
+        goto fini;
+    }
+    grp_arr = (int *)calloc(batch.num_devs, sizeof(int));
+    if (NULL == grp_arr) {
+        pr2serr("%s: out of memory\n", __func__);
+        ret = sg_convert_errno(ENOMEM);
+        goto fini;
+    }
+    /* first open and identify every DEVICE, then group them by target
+     * port so that at most per_port of each group are worked on at once */
+    sg_par_each(batch.num_devs, op->num_parallel, pr_batch_ident, &batch);
+    for (k = 0, dp = batch.dev_arr; k < batch.num_devs; ++k, ++dp) {
+        if (0 == dp->res)
+            pr_batch_set_port(&batch, dp);
+    }
+    for (k = 0, dp = batch.dev_arr; k < batch.num_devs; ++k, ++dp)
+        grp_arr[k] = (dp->port >= 0) ? dp->port : (batch.num_ports + k);
+    if (op->verbose > 1)
+        pr2serr("%s: %d DEVICEs through %d target ports\n", __func__,
+                batch.num_devs, batch.num_ports);
+    sg_par_each_grouped(batch.num_devs, op->num_parallel, batch.per_port,
+                        grp_arr, pr_batch_one, &batch);
+    for (k = 0, dp = batch.dev_arr; k < batch.num_devs; ++k, ++dp) {
+        if (dp->sg_fd >= 0) {
+            res = sg_cmds_close_device(dp->sg_fd);
+            if ((res < 0) && (0 == dp->res))
+                dp->res = sg_convert_errno(-res);
+            dp->sg_fd = -1;
+        }
+        if (dp->res) {
+            ++num_failed;
+            if (0 == ret)
+                ret = dp->res;
+        }
+    }
+    if (op->pr_in) {
+        if (pr_audit_output(&batch, num_failed, ret, argc, argv) &&
+            (0 == ret))
+            ret = SG_LIB_CAT_MISCOMPARE;
+    } else
+        pr_batch_output(&batch, num_failed, ret, argc, argv);
+    if (num_failed || op->verbose)
+        pr2serr("%d of %d DEVICEs succeeded\n", batch.num_devs - num_failed,
+                batch.num_devs);
+fini:
+    for (k = 0; k < batch.num_devs; ++k) {
+        free((char *)batch.dev_arr[k].dev_name);
+        for (j = 0; j < PR_AUDIT_NUM; ++j)
+            free(batch.dev_arr[k].prin_val[j]);
+    }
+    free(batch.dev_arr);
+    free(batch.act_arr);
+    free(batch.port_arr);
+    free(grp_arr);
+    return ret;
+}
+
 
 int
 main(int argc, char * argv[])
@@ -973,6 +1834,8 @@ main(int argc, char * argv[])
     op->prout_sa = -1;
     op->inquiry = true;
     op->alloc_len = MX_ALLOC_LEN;
+    op->num_parallel = PR_DEF_PARALLEL;
+    op->per_port = PR_DEF_PER_PORT;
    if (getenv("SG3_UTILS_INVOCATION"))
         sg_rep_invocation(my_name, version_str, argc, argv, stderr);
 
@@ -980,7 +1843,7 @@ main(int argc, char * argv[])
         int option_index = 0;
 
         c = getopt_long(argc, argv,
-                        "AcCd:GHhiIkK:l:Lm:MnoPQ:rRsS:T:UvVX:yYzZ",
+                        "AB:cCd:GHhiIkK:l:Lm:Mnop:PQ:rRsS:t:T:UvVX:yYzZ",
                         long_options, &option_index);
         if (c == -1)
             break;
@@ -990,8 +1853,12 @@ main(int argc, char * argv[])
             op->prout_sa = PROUT_PREE_AB_SA;
             ++num_prout_sa;
             break;
+        case 'B':
+            op->batch_fn = optarg;
+            break;
         case 'c':
             op->prin_sa = PRIN_RCAP_SA;
+            op->prin_mask |= (1 << PRIN_RCAP_SA);
             ++num_prin_sa;
             break;
         case 'C':
@@ -1020,6 +1887,7 @@ main(int argc, char * argv[])
             break;
         case 'k':
             op->prin_sa = PRIN_RKEY_SA;
+            op->prin_mask |= (1 << PRIN_RKEY_SA);
             ++num_prin_sa;
             break;
         case 'K':
@@ -1062,6 +1930,11 @@ main(int argc, char * argv[])
         case 'o':
             want_prout = true;
             break;
+        case 'p':
+            op->num_parallel = sg_par_get_num(optarg, 1, PR_MAX_PARALLEL);
+            if (op->num_parallel < 0)
+                return SG_LIB_SYNTAX_ERROR;
+            break;
         case 'P':
             op->prout_sa = PROUT_PREE_SA;
             ++num_prout_sa;
@@ -1080,6 +1953,7 @@ main(int argc, char * argv[])
             break;
         case 'r':
             op->prin_sa = PRIN_RRES_SA;
+            op->prin_mask |= (1 << PRIN_RRES_SA);
             ++num_prin_sa;
             break;
         case 'R':
@@ -1088,6 +1962,7 @@ main(int argc, char * argv[])
             break;
         case 's':
             op->prin_sa = PRIN_RFSTAT_SA;
+            op->prin_mask |= (1 << PRIN_RFSTAT_SA);
             ++num_prin_sa;
             break;
         case 'S':
@@ -1097,6 +1972,14 @@ main(int argc, char * argv[])
             }
             ++num_prout_param;
             break;
+        case 't':
+            op->per_port = sg_get_num(optarg);
+            if ((op->per_port < 1) || (op->per_port > PR_MAX_PARALLEL)) {
+                pr2serr("bad argument to '--per-port', expect 1 to %d\n",
+                        PR_MAX_PARALLEL);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
         case 'T':
             if (1 != sscanf(optarg, "%x", &op->prout_type)) {
                 pr2serr("bad argument to '--prout-type'\n");
@@ -1189,6 +2072,56 @@ main(int argc, char * argv[])
         return 0;
     }
 
+    if (op->batch_fn) {
+        if (device_name) {
+            pr2serr("--batch=BF names the DEVICEs, so don't give one as "
+                    "well\n");
+            usage(1);
+            return SG_LIB_CONTRADICT;
+        }
+        if (want_prout && want_prin) {
+            pr2serr("choose '--in' _or_ '--out' (not both)\n");
+            usage(1);
+            return SG_LIB_CONTRADICT;
+        }
+        if (! want_prout) {
+            if (num_prout_sa > 0) {
+                pr2serr(">> When a service action for Persistent Reserve "
+                        "Out is chosen the\n>> '--out' option must be "
+                        "given (as a safeguard)\n");
+                return SG_LIB_CONTRADICT;
+            }
+            if (op->prin_mask & (1 << PRIN_RCAP_SA)) {
+                pr2serr("--report-capabilities not supported with "
+                        "--batch=BF\n");
+                return SG_LIB_CONTRADICT;
+            }
+            if (0 == op->prin_mask)     /* default: all three */
+                op->prin_mask = (1 << PRIN_RKEY_SA) | (1 << PRIN_RRES_SA) |
+                                (1 << PRIN_RFSTAT_SA);
+            if ((! op->readwrite_force) && getenv(SG_PERSIST_IN_RDONLY))
+                op->readonly = true;
+            ret = pr_batch_run(op, argc, argv);
+            flagged = true;
+            goto fini;
+        }
+        if ((num_prin_sa > 0) || (num_prout_sa > 1)) {
+            pr2serr(">> For Persistent Reserve Out one and only one "
+                    "appropriate\n>> service action must be chosen (e.g. "
+                    "'--register')\n");
+            return SG_LIB_CONTRADICT;
+        }
+        if ((PROUT_REG_MOVE_SA == op->prout_sa) || op->num_transportids ||
+            op->param_unreg || op->param_rtp) {
+            pr2serr("--register-move and --transport-id are not supported "
+                    "with --batch=BF\n");
+            return SG_LIB_CONTRADICT;
+        }
+        op->pr_in = false;
+        ret = pr_batch_run(op, argc, argv);
+        flagged = true;
+        goto fini;
+    }
     if (NULL == device_name) {
         pr2serr("No device name given\n");
         usage(1);
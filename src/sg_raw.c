@@ -1,7 +1,7 @@
 /*
  * A utility program originally written for the Linux OS SCSI subsystem.
  *
- * Copyright (C) 2000-2023 Ingo van Lil <inguin@gmx.de>
+ * Copyright (C) 2000-2026 Ingo van Lil <inguin@gmx.de>
  *
  * This program is free software; you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -27,6 +27,7 @@
 #include <getopt.h>
 #include <inttypes.h>
 #include <errno.h>
+#include <time.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 
@@ -39,7 +40,7 @@
 #include "sg_pr2serr.h"
 #include "sg_unaligned.h"
 
-#define SG_RAW_VERSION "0.4.41 (2023-05-04)"
+#define SG_RAW_VERSION "0.4.44 (2026-10-15)"
 
 static const char * my_name = "sg_raw: ";
 
@@ -53,6 +54,9 @@ static const char * my_name = "sg_raw: ";
 #define NVME_DATA_LEN_DATA_IN  0xfffffffe
 #define NVME_DATA_LEN_DATA_OUT 0xfffffffd
 
+#define SCRIPT_MAX_QD 64
+#define SCRIPT_ANY_STATUS -1
+
 static struct option long_options[] = {
     { "binary",  no_argument,       NULL, 'b' },
     { "cmdfile", required_argument, NULL, 'c' },
@@ -64,10 +68,13 @@ static struct option long_options[] = {
     { "nosense", no_argument,       NULL, 'n' },
     { "nvm",     no_argument,       NULL, 'N' },
     { "outfile", required_argument, NULL, 'o' },
+    { "pace",    required_argument, NULL, 'p' },
+    { "qd",      required_argument, NULL, 'q' },
     { "raw",     no_argument,       NULL, 'w' },
     { "request", required_argument, NULL, 'r' },
     { "readonly", no_argument,      NULL, 'R' },
     { "scan",    required_argument, NULL, 'Q' },
+    { "script",  required_argument, NULL, 'S' },
     { "send",    required_argument, NULL, 's' },
     { "timeout", required_argument, NULL, 't' },
     { "tmo",     required_argument, NULL, 't' },
@@ -91,6 +98,10 @@ struct opts_t {
     int cmdset;
     int datain_len;
     int dataout_len;
+    int qd;             /* --qd=QD, commands outstanding with --script= */
+    int qd_mult;        /* --qd=Mx: M times the trace's peak concurrency */
+    bool pace_orig;     /* --pace=orig[,F]: keep the trace's timing */
+    double pace_factor; /* F: > 1 replays faster than traced */
     int timeout;
     int raw;
     int readonly;
@@ -102,6 +113,7 @@ struct opts_t {
     const char *cmd_file;
     const char *datain_file;
     const char *dataout_file;
+    const char *script_file;    /* --script=SF */
     char *device_name;
 };
 
@@ -110,7 +122,7 @@ static void
 pr_version()
 {
     pr2serr("sg_raw " SG_RAW_VERSION "\n"
-            "Copyright (C) 2007-2021 Ingo van Lil <inguin@gmx.de>\n"
+            "Copyright (C) 2007-2026 Ingo van Lil <inguin@gmx.de>\n"
             "This is free software.  You may redistribute copies of it "
             "under the terms of\n"
             "the GNU General Public License "
@@ -122,6 +134,9 @@ static void
 usage()
 {
     pr2serr("Usage: sg_raw [OPTION]* DEVICE [CDB0 CDB1 ...]\n"
+            "       sg_raw --script=SF [--pace=afap|orig[,F]] [--qd=QD|Mx] "
+            "[OPTION]*\n"
+            "              DEVICE\n"
             "\n"
             "Options:\n"
             "  --binary|-b            Dump data in binary form, even when "
@@ -148,6 +163,17 @@ usage()
             "(i.e. data-in)\n"
             "                              to OFILE (def: hexdump to "
             "stdout)\n"
+            "  --pace=afap|orig[,F]|-p ...    with a trace as SF: afap "
+            "(def) sends as\n"
+            "                         fast as possible; orig keeps traced "
+            "start times\n"
+            "                         (sped up F times if F given)\n"
+            "  --qd=QD|-q QD          with --script=SF keep up to QD "
+            "commands\n"
+            "                         outstanding (def: 1, max: %d); with "
+            "a trace\n"
+            "                         QD of 'Mx' is M times its peak "
+            "concurrency\n"
             "  --raw|-w               interpret CF (command file) as "
             "binary (def:\n"
             "                         interpret as ASCII hex)\n"
@@ -160,6 +186,11 @@ usage()
             "                           to LO (last opcode) inclusive. Uses "
             "given\n"
             "                           command bytes, varying the opcode\n"
+            "  --script=SF|-S SF      send each command in SF (text "
+            "records or a\n"
+            "                         binary pass-through trace) and "
+            "report each\n"
+            "                         one's status and time\n"
             "  --send=SLEN|-s SLEN    Send SLEN bytes of data (data-out)\n"
             "  --skip=KLEN|-k KLEN    Skip the first KLEN bytes when "
             "reading\n"
@@ -172,7 +203,7 @@ usage()
             "can be\nspecified and will be sent to DEVICE. Lengths RLEN, "
             "SLEN and KLEN are\ndecimal by default. Bidirectional commands "
             "accepted.\n\nSimple example: Perform INQUIRY on /dev/sg0:\n"
-            "  sg_raw -r 1k /dev/sg0 12 00 00 00 60 00\n");
+            "  sg_raw -r 1k /dev/sg0 12 00 00 00 60 00\n", SCRIPT_MAX_QD);
 }
 
 static int
@@ -182,7 +213,7 @@ parse_cmd_line(struct opts_t * op, int argc, char *argv[])
         int c, n;
         const char * cp;
 
-        c = getopt_long(argc, argv, "bc:C:ehi:k:nNo:Q:r:Rs:t:vVw",
+        c = getopt_long(argc, argv, "bc:C:ehi:k:nNo:p:q:Q:r:Rs:S:t:vVw",
                         long_options, NULL);
         if (c == -1)
             break;
@@ -238,6 +269,51 @@ parse_cmd_line(struct opts_t * op, int argc, char *argv[])
             }
             op->datain_file = optarg;
             break;
+        case 'p':
+            if (0 == strcmp(optarg, "afap"))
+                op->pace_orig = false;
+            else if (0 == strncmp(optarg, "orig", 4)) {
+                op->pace_orig = true;
+                op->pace_factor = 1.0;
+                if (',' == optarg[4]) {
+                    op->pace_factor = atof(optarg + 5);
+                    if (op->pace_factor <= 0.0) {
+                        pr2serr("Invalid factor to '--pace=orig,F', "
+                                "expect F > 0\n");
+                        return SG_LIB_SYNTAX_ERROR;
+                    }
+                } else if ('\0' != optarg[4])
+                    goto bad_pace;
+            } else {
+bad_pace:
+                pr2serr("Invalid argument to '--pace', expect afap or "
+                        "orig[,F]\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case 'q':
+            n = (int)strlen(optarg);
+            if ((n > 1) && ('x' == tolower((uint8_t)optarg[n - 1]))) {
+                char b[16];
+
+                snprintf(b, sizeof(b), "%.*s", n - 1, optarg);
+                n = sg_get_num(b);
+                if ((n < 1) || (n > SCRIPT_MAX_QD)) {
+                    pr2serr("Invalid argument to '--qd=Mx', expect M from "
+                            "1 to %d\n", SCRIPT_MAX_QD);
+                    return SG_LIB_SYNTAX_ERROR;
+                }
+                op->qd_mult = n;
+                break;
+            }
+            n = sg_get_num(optarg);
+            if ((n < 1) || (n > SCRIPT_MAX_QD)) {
+                pr2serr("Invalid argument to '--qd', expect 1 to %d\n",
+                        SCRIPT_MAX_QD);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            op->qd = n;
+            break;
         case 'Q':       /* --scan=FO,LO */
             cp = strchr(optarg, ',');
             if (NULL == cp) {
@@ -280,6 +356,9 @@ parse_cmd_line(struct opts_t * op, int argc, char *argv[])
             }
             op->dataout_len = n;
             break;
+        case 'S':
+            op->script_file = optarg;
+            break;
         case 't':
             n = sg_get_num(optarg);
             if (n < 0) {
@@ -335,6 +414,19 @@ parse_cmd_line(struct opts_t * op, int argc, char *argv[])
         ++op->cdb_length;
     }
 
+    if (op->script_file) {
+        if ((op->cdb_length > 0) || op->cmdfile_given ||
+            (op->scan_first < op->scan_last) || op->do_datain ||
+            op->do_dataout || op->do_enumerate) {
+            pr2serr("--script= takes its commands, and their data "
+                    "lengths, from SF so\nCDB bytes, --cmdfile=, "
+                    "--enumerate, --request=, --scan= and --send=\n"
+                    "contradict it\n");
+            return SG_LIB_CONTRADICT;
+        }
+        return 0;
+    } else if ((op->qd > 0) || op->qd_mult || op->pace_orig)
+        pr2serr("--pace= and --qd= ignored without --script=\n");
     if (op->cmdfile_given) {
         int err;
 
@@ -533,6 +625,816 @@ bail:
     return ret;
 }
 
+/* One command of a --script=SF file, with its outcome once sent */
+struct script_rec {
+    int rec_num;        /* line number in SF, or trace sequence number */
+    int cdb_len;
+    int din_len;
+    int dout_len;
+    int exp_status;     /* SCRIPT_ANY_STATUS: not checked */
+    int dout_fidx;      /* index into script_work::dout_fns, -1: IFILE */
+    off_t dout_off;     /* byte offset in data-out file */
+    off_t din_off;      /* byte offset in OFILE */
+    /* outcome */
+    bool sent;
+    bool ok;
+    bool din_err;       /* writing data-in to OFILE failed */
+    int res;            /* do_scsi_pt() or do_nvm_pt() result */
+    int cat;            /* SG_LIB_CAT_* of sense data, if any */
+    int status;
+    int resid;
+    uint8_t sense_key;
+    uint8_t asc;
+    uint8_t ascq;
+    uint64_t ns;        /* time from submission to completion */
+    uint64_t orig_ns;   /* trace: as above when traced */
+    uint64_t sub_ns;    /* trace: submitted at, since the first */
+    uint8_t cdb[MAX_SCSI_CDBSZ];
+};
+
+struct script_slot;
+
+struct script_work {
+    const struct opts_t * op;
+    struct script_rec * arr;
+    int num_recs;
+    int alloc_recs;
+    int max_din;
+    int max_dout;
+    int num_fns;
+    char ** dout_fns;   /* data-out files named in SF */
+    int ifile_fd;       /* --infile=IFILE, -1 if none */
+    int ofile_fd;       /* --outfile=OFILE, -1 if none */
+    bool is_trace;      /* SF is a binary trace */
+    int trace_peak;     /* most commands outstanding at once in trace */
+    uint64_t t0;        /* when replay started, for --pace=orig */
+    int dout_fd;        /* data-out file named in SF that is open */
+    int dout_fidx;      /* its index into dout_fns, -1 if none open */
+    struct script_slot * slots;  /* one per command that may be in flight */
+    int num_slots;
+    int num_busy;       /* slots with a command in flight */
+};
+
+static uint64_t
+script_now_ns(void)
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+
+    if (0 == clock_gettime(CLOCK_MONOTONIC, &ts))
+        return ((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+#endif
+    return 0;
+}
+
+/* Sleeps until the CLOCK_MONOTONIC time t_ns */
+static void
+script_wait_until(uint64_t t_ns)
+{
+    uint64_t now;
+    struct timespec ts;
+
+    while ((now = script_now_ns()) && (now < t_ns)) {
+        ts.tv_sec = (t_ns - now) / 1000000000;
+        ts.tv_nsec = (t_ns - now) % 1000000000;
+        nanosleep(&ts, NULL);
+    }
+}
+
+static struct script_rec *
+script_new_rec(struct script_work * wp)
+{
+    struct script_rec * rp;
+
+    if (wp->num_recs >= wp->alloc_recs) {
+        int n = (wp->alloc_recs > 0) ? (2 * wp->alloc_recs) : 256;
+
+        rp = (struct script_rec *)realloc(wp->arr, n * sizeof(*rp));
+        if (NULL == rp)
+            return NULL;
+        wp->arr = rp;
+        wp->alloc_recs = n;
+    }
+    rp = wp->arr + wp->num_recs++;
+    memset(rp, 0, sizeof(*rp));
+    rp->dout_fidx = -1;
+    return rp;
+}
+
+/* Data-in of each command goes to OFILE, and data-out without its own
+ * file comes from IFILE, in the order of the records. */
+static void
+script_place(struct script_work * wp, struct script_rec * rp,
+             off_t * din_offp, off_t * dout_offp)
+{
+    rp->din_off = *din_offp;
+    *din_offp += rp->din_len;
+    if ((rp->dout_fidx < 0) && (rp->dout_len > 0)) {
+        rp->dout_off = *dout_offp;
+        *dout_offp += rp->dout_len;
+    }
+    if (rp->din_len > wp->max_din)
+        wp->max_din = rp->din_len;
+    if (rp->dout_len > wp->max_dout)
+        wp->max_dout = rp->dout_len;
+}
+
+static int
+script_fn_idx(struct script_work * wp, const char * fn)
+{
+    int k;
+    char ** pp;
+
+    for (k = 0; k < wp->num_fns; ++k) {
+        if (0 == strcmp(fn, wp->dout_fns[k]))
+            return k;
+    }
+    pp = (char **)realloc(wp->dout_fns, (k + 1) * sizeof(char *));
+    if (NULL == pp)
+        return -1;
+    wp->dout_fns = pp;
+    if (NULL == (pp[k] = strdup(fn)))
+        return -1;
+    wp->num_fns = k + 1;
+    return k;
+}
+
+/* Parses one text record: the command in hex (either one or two digits
+ * per byte, space separated, or a single string of digit pairs) followed
+ * by optional in=LEN, out=LEN[,FN[,OFF]] and status=ST|any fields.
+ * Returns 0 or SG_LIB_SYNTAX_ERROR. */
+static int
+script_parse_line(struct script_work * wp, struct script_rec * rp, char * lp,
+                  const char * sfn)
+{
+    int k, n, len;
+    int64_t ll;
+    char * cp;
+    char * c2p;
+
+    rp->exp_status = SAM_STAT_GOOD;
+    for (cp = strtok(lp, " \t\r\n"); cp; cp = strtok(NULL, " \t\r\n")) {
+        if (0 == strncmp(cp, "in=", 3)) {
+            rp->din_len = sg_get_num(cp + 3);
+            if ((rp->din_len < 0) || (rp->din_len > MAX_SCSI_DXLEN))
+                goto bad;
+        } else if (0 == strncmp(cp, "out=", 4)) {
+            rp->dout_len = sg_get_num(cp + 4);
+            if ((rp->dout_len < 0) || (rp->dout_len > MAX_SCSI_DXLEN))
+                goto bad;
+            if ((c2p = strchr(cp + 4, ','))) {
+                *c2p++ = '\0';
+                if ((cp = strchr(c2p, ','))) {
+                    *cp++ = '\0';
+                    ll = sg_get_llnum(cp);
+                    if (ll < 0)
+                        goto bad;
+                    rp->dout_off = (off_t)ll;
+                }
+                rp->dout_fidx = script_fn_idx(wp, c2p);
+                if (rp->dout_fidx < 0) {
+                    pr2serr("%s: out of memory\n", __func__);
+                    return sg_convert_errno(ENOMEM);
+                }
+            }
+        } else if (0 == strncmp(cp, "status=", 7)) {
+            if (0 == strcmp(cp + 7, "any"))
+                rp->exp_status = SCRIPT_ANY_STATUS;
+            else {
+                rp->exp_status = sg_get_num(cp + 7);
+                if ((rp->exp_status < 0) || (rp->exp_status > 0xff))
+                    goto bad;
+            }
+        } else {
+            len = (int)strlen(cp);
+            if ((int)strspn(cp, "0123456789abcdefABCDEF") != len)
+                goto bad;
+            if (len > 2) {
+                if (len & 1)
+                    goto bad;
+            }
+            for (k = 0; k < len; k += n) {
+                unsigned int u;
+
+                n = (len > 2) ? 2 : len;
+                if (rp->cdb_len >= MAX_SCSI_CDBSZ)
+                    goto bad;
+                if (1 != sscanf(cp + k, (2 == n) ? "%2x" : "%1x", &u))
+                    goto bad;
+                rp->cdb[rp->cdb_len++] = (uint8_t)u;
+            }
+        }
+    }
+    if (rp->cdb_len < MIN_SCSI_CDBSZ) {
+        pr2serr("%s: line %d: command of %d bytes too short\n", sfn,
+                rp->rec_num, rp->cdb_len);
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    return 0;
+bad:
+    pr2serr("%s: line %d: unable to decode '%s'\n", sfn, rp->rec_num, cp);
+    return SG_LIB_SYNTAX_ERROR;
+}
+
+static int
+script_cmp_sub(const void * ap, const void * bp)
+{
+    const struct script_rec * a = (const struct script_rec *)ap;
+    const struct script_rec * b = (const struct script_rec *)bp;
+
+    if (a->sub_ns != b->sub_ns)
+        return (a->sub_ns < b->sub_ns) ? -1 : 1;
+    return (a->rec_num < b->rec_num) ? -1 : (a->rec_num > b->rec_num);
+}
+
+static int
+script_cmp_u64(const void * ap, const void * bp)
+{
+    uint64_t a = *(const uint64_t *)ap;
+    uint64_t b = *(const uint64_t *)bp;
+
+    return (a < b) ? -1 : (a > b);
+}
+
+/* Orders the commands of a trace by when they were submitted (a trace
+ * holds completions, in the order they completed), makes submit times
+ * relative to the first and finds the most that were outstanding at
+ * once. */
+static int
+script_trace_order(struct script_work * wp)
+{
+    int k, j, n;
+    uint64_t first;
+    uint64_t * ends;
+    struct script_rec * rp;
+
+    n = wp->num_recs;
+    qsort(wp->arr, n, sizeof(*wp->arr), script_cmp_sub);
+    ends = (uint64_t *)malloc(n * sizeof(uint64_t));
+    if (NULL == ends)
+        return sg_convert_errno(ENOMEM);
+    first = wp->arr[0].sub_ns;
+    for (k = 0, rp = wp->arr; k < n; ++k, ++rp) {
+        rp->sub_ns -= first;
+        ends[k] = rp->sub_ns + rp->orig_ns;
+    }
+    qsort(ends, n, sizeof(uint64_t), script_cmp_u64);
+    wp->trace_peak = 1;
+    for (k = 0, j = 0, rp = wp->arr; k < n; ++k, ++rp) {
+        while ((j < k) && (ends[j] <= rp->sub_ns))
+            ++j;
+        if ((k + 1 - j) > wp->trace_peak)
+            wp->trace_peak = k + 1 - j;
+    }
+    free(ends);
+    return 0;
+}
+
+/* Loads the completion events of SCSI commands from a binary trace (see
+ * sg_pt_trace_ring_dump() and sg_pt_trace_stream_init() ), expecting each
+ * to get the status it got then. */
+static int
+script_load_trace(struct script_work * wp, FILE * fp, const char * sfn,
+                  off_t * din_offp, off_t * dout_offp)
+{
+    bool to_eof;
+    int k, res;
+    int num_skip = 0;
+    struct script_rec * rp;
+    struct sg_pt_trace_ring_hdr hdr;
+    struct sg_pt_trace_rec rec;
+
+    if ((1 != fread(&hdr, sizeof(hdr), 1, fp)) ||
+        (hdr.rec_sz != sizeof(rec))) {
+        pr2serr("%s: trace header bad, or written by a different "
+                "version\n", sfn);
+        return SG_LIB_FILE_ERROR;
+    }
+    /* a stream that was not ended has 0 in num_recs */
+    to_eof = (0 == hdr.num_recs);
+    for (k = 0; to_eof || (k < (int)hdr.num_recs); ++k) {
+        if (1 != fread(&rec, sizeof(rec), 1, fp)) {
+            if (to_eof && feof(fp))
+                break;
+            pr2serr("%s: truncated after %d records\n", sfn, k);
+            return SG_LIB_FILE_ERROR;
+        }
+        if (SG_PT_TRACE_COMPLETE != rec.event)
+            continue;
+        if ((SG_PT_LAT_SCSI != rec.cmd_set) ||
+            (rec.cmd_len < MIN_SCSI_CDBSZ) || (0 != rec.result) ||
+            (rec.din_len > MAX_SCSI_DXLEN) ||
+            (rec.dout_len > MAX_SCSI_DXLEN)) {
+            ++num_skip;
+            continue;
+        }
+        if (NULL == (rp = script_new_rec(wp))) {
+            pr2serr("%s: out of memory\n", __func__);
+            return sg_convert_errno(ENOMEM);
+        }
+        rp->rec_num = (int)rec.seq;
+        rp->cdb_len = rec.cmd_len;
+        memcpy(rp->cdb, rec.cmd, rec.cmd_len);
+        rp->din_len = (int)rec.din_len;
+        rp->dout_len = (int)rec.dout_len;
+        rp->exp_status = (int)rec.status;
+        rp->orig_ns = rec.duration_ns;
+        rp->sub_ns = rec.ts_ns - rec.duration_ns;
+    }
+    if (num_skip && (wp->op->verbose > 0))
+        pr2serr("%s: skipped %d NVMe, truncated or failed commands\n", sfn,
+                num_skip);
+    wp->is_trace = true;
+    if (0 == wp->num_recs)
+        return 0;
+    res = script_trace_order(wp);
+    if (res)
+        return res;
+    for (k = 0; k < wp->num_recs; ++k)
+        script_place(wp, wp->arr + k, din_offp, dout_offp);
+    if (wp->op->verbose > 0)
+        pr2serr("%s: %d commands over %" PRIu64 " us, up to %d "
+                "outstanding\n", sfn, wp->num_recs,
+                wp->arr[wp->num_recs - 1].sub_ns / 1000, wp->trace_peak);
+    return 0;
+}
+
+static int
+script_load(struct script_work * wp, const char * sfn)
+{
+    int n;
+    int res = 0;
+    int line_num = 0;
+    const int mlen = sizeof(SG_PT_TRACE_RING_MAGIC) - 1;
+    off_t din_off = 0;
+    off_t dout_off = wp->op->dataout_offset;
+    char * cp;
+    FILE * fp;
+    struct script_rec * rp;
+    char b[2048];
+
+    fp = fopen(sfn, "r");
+    if (NULL == fp) {
+        res = sg_convert_errno(errno);
+        perror(sfn);
+        return res;
+    }
+    n = (int)fread(b, 1, mlen, fp);
+    if (fseek(fp, 0, SEEK_SET)) {
+        pr2serr("%s: must be a regular file\n", sfn);
+        res = SG_LIB_FILE_ERROR;
+        goto fini;
+    }
+    if ((mlen == n) && (0 == memcmp(b, SG_PT_TRACE_RING_MAGIC, mlen))) {
+        res = script_load_trace(wp, fp, sfn, &din_off, &dout_off);
+        goto fini;
+    }
+    while (fgets(b, sizeof(b), fp)) {
+        ++line_num;
+        if ((cp = strchr(b, '#')))
+            *cp = '\0';
+        cp = b + strspn(b, " \t\r\n");
+        if ('\0' == *cp)
+            continue;
+        if (NULL == (rp = script_new_rec(wp))) {
+            pr2serr("%s: out of memory\n", __func__);
+            res = sg_convert_errno(ENOMEM);
+            break;
+        }
+        rp->rec_num = line_num;
+        res = script_parse_line(wp, rp, cp, sfn);
+        if (res)
+            break;
+        script_place(wp, rp, &din_off, &dout_off);
+    }
+fini:
+    fclose(fp);
+    if ((0 == res) && (0 == wp->num_recs)) {
+        pr2serr("%s: no commands found\n", sfn);
+        res = SG_LIB_SYNTAX_ERROR;
+    }
+    return res;
+}
+
+/* One command slot of --script=SF: a pt object and buffers that are
+ * reused by the records sent through it */
+struct script_slot {
+    bool busy;
+    int rec_idx;        /* into script_work::arr */
+    uint64_t t0;        /* when submitted */
+    struct sg_pt_base * ptvp;
+    uint8_t * dinp;
+    uint8_t * doutp;
+    uint8_t * din_free;
+    uint8_t * dout_free;
+    uint8_t sense_b[32];
+};
+
+/* Starts the command of rp on sp. Returns true if it is in flight,
+ * otherwise rp->res holds why not. */
+static bool
+script_start(struct script_work * wp, struct script_slot * sp,
+             struct script_rec * rp)
+{
+    const struct opts_t * op = wp->op;
+    int fd, res;
+    struct sg_pt_base * ptvp = sp->ptvp;
+
+    clear_scsi_pt_obj(ptvp);
+    rp->sent = true;
+    if (rp->dout_len > 0) {
+        fd = wp->ifile_fd;
+        if (rp->dout_fidx >= 0) {
+            if (wp->dout_fidx != rp->dout_fidx) {
+                if (wp->dout_fd >= 0)
+                    close(wp->dout_fd);
+                wp->dout_fidx = rp->dout_fidx;
+                wp->dout_fd = open(wp->dout_fns[rp->dout_fidx], O_RDONLY);
+                if (wp->dout_fd < 0) {
+                    rp->res = -errno;
+                    wp->dout_fidx = -1;
+                    return false;
+                }
+            }
+            fd = wp->dout_fd;
+        }
+        if (fd < 0)
+            memset(sp->doutp, 0, rp->dout_len);
+        else if ((res = pread(fd, sp->doutp, rp->dout_len, rp->dout_off)) <
+                 rp->dout_len) {
+            rp->res = (res < 0) ? -errno : -EIO;
+            return false;
+        }
+        set_scsi_pt_data_out(ptvp, sp->doutp, rp->dout_len);
+    }
+    if (rp->din_len > 0)
+        set_scsi_pt_data_in(ptvp, sp->dinp, rp->din_len);
+    set_scsi_pt_cdb(ptvp, rp->cdb, rp->cdb_len);
+    set_scsi_pt_sense(ptvp, sp->sense_b, sizeof(sp->sense_b));
+    /* responses are matched to slots by packet id */
+    set_scsi_pt_packet_id(ptvp, (int)(sp - wp->slots) + 1);
+    sp->t0 = script_now_ns();
+    if (op->do_nvm)
+        rp->res = do_nvm_pt_submit(ptvp, 0, op->timeout, op->verbose);
+    else
+        rp->res = do_scsi_pt_submit(ptvp, -1, op->timeout, op->verbose);
+    if (rp->res)
+        return false;
+    sp->rec_idx = (int)(rp - wp->arr);
+    sp->busy = true;
+    return true;
+}
+
+/* Fetches the response of the command in flight on sp, if it has come,
+ * and records how it went. Returns false if it has not come yet. */
+static bool
+script_finish(struct script_work * wp, struct script_slot * sp)
+{
+    int res, slen;
+    struct script_rec * rp = wp->arr + sp->rec_idx;
+    struct sg_pt_base * ptvp = sp->ptvp;
+    struct sg_scsi_sense_hdr ssh;
+
+    res = do_scsi_pt_receive(ptvp, -1, wp->op->verbose);
+    if (-EAGAIN == res)
+        return false;
+    rp->ns = script_now_ns() - sp->t0;
+    sp->busy = false;
+    --wp->num_busy;
+    rp->res = res;
+    if (res)
+        return true;
+    rp->status = get_scsi_pt_status_response(ptvp);
+    rp->resid = get_scsi_pt_resid(ptvp);
+    slen = get_scsi_pt_sense_len(ptvp);
+    if (sg_scsi_normalize_sense(sp->sense_b, slen, &ssh)) {
+        rp->cat = sg_err_category_sense(sp->sense_b, slen);
+        rp->sense_key = ssh.sense_key;
+        rp->asc = ssh.asc;
+        rp->ascq = ssh.ascq;
+    }
+    rp->ok = (SCRIPT_ANY_STATUS == rp->exp_status) ||
+             (rp->status == rp->exp_status);
+    if ((rp->din_len > 0) && (wp->ofile_fd >= 0)) {
+        int len = rp->din_len - rp->resid;
+
+        if ((len > 0) &&
+            (pwrite(wp->ofile_fd, sp->dinp, len, rp->din_off) < 0)) {
+            rp->din_err = true;
+            rp->ok = false;
+        }
+    }
+    return true;
+}
+
+/* Sends the records in order from one thread over the file descriptor of
+ * ptvp, keeping up to qd of them in flight with do_scsi_pt_submit() (or
+ * do_nvm_pt_submit()) and fetching responses, in whatever order they
+ * come, with do_scsi_pt_receive(). Returns 0 or an SG_LIB_CAT_* value. */
+static int
+script_run(struct script_work * wp, struct sg_pt_base * ptvp, int qd)
+{
+    const struct opts_t * op = wp->op;
+    int k, n, wait_ms;
+    int sg_fd = get_pt_file_handle(ptvp);
+    int next = 0;
+    int ret = 0;
+    uint64_t now;
+    uint64_t due = 0;
+    struct script_slot * sp;
+
+    wp->slots = (struct script_slot *)calloc(qd, sizeof(*sp));
+    if (NULL == wp->slots)
+        return sg_convert_errno(ENOMEM);
+    for (k = 0; k < qd; ++k) {
+        sp = wp->slots + k;
+        sp->ptvp = (0 == k) ? ptvp :
+                   construct_scsi_pt_obj_with_fd(sg_fd, op->verbose);
+        sp->dinp = sg_memalign(wp->max_din, 0, &sp->din_free, false);
+        sp->doutp = sg_memalign(wp->max_dout, 0, &sp->dout_free, false);
+        if ((NULL == sp->ptvp) || (NULL == sp->dinp) ||
+            (NULL == sp->doutp)) {
+            ret = sg_convert_errno(ENOMEM);
+            wp->num_slots = k + 1;
+            goto fini;
+        }
+    }
+    wp->num_slots = qd;
+    while ((next < wp->num_recs) || (wp->num_busy > 0)) {
+        wait_ms = -1;
+        for (k = 0; (k < qd) && (next < wp->num_recs); ++k) {
+            sp = wp->slots + k;
+            if (sp->busy)
+                continue;
+            if (op->pace_orig) {
+                due = wp->t0 + (uint64_t)((double)wp->arr[next].sub_ns /
+                                          op->pace_factor);
+                now = script_now_ns();
+                if (now && (now < due)) {
+                    wait_ms = (int)((due - now + 999999) / 1000000);
+                    break;
+                }
+            }
+            if (script_start(wp, sp, wp->arr + next++))
+                ++wp->num_busy;
+        }
+        if (0 == wp->num_busy) {
+            if (wait_ms > 0)
+                script_wait_until(due);
+            continue;
+        }
+        for (k = 0, n = 0; k < qd; ++k) {
+            if (wp->slots[k].busy && script_finish(wp, wp->slots + k))
+                ++n;
+        }
+        if (n > 0)
+            continue;
+        n = scsi_pt_wait_for_response(sg_fd, wait_ms, op->verbose);
+        if (n < 0) {
+            pr2serr("%s: waiting for responses: %s\n", op->device_name,
+                    safe_strerror(-n));
+            ret = sg_convert_errno(-n);
+            break;
+        }
+    }
+fini:
+    for (k = 0; k < wp->num_slots; ++k) {
+        sp = wp->slots + k;
+        if (sp->ptvp && (sp->ptvp != ptvp))
+            destruct_scsi_pt_obj(sp->ptvp);
+        free(sp->din_free);
+        free(sp->dout_free);
+    }
+    free(wp->slots);
+    wp->slots = NULL;
+    return ret;
+}
+
+static void
+script_lat_line(const char * name, uint64_t * arr, int n)
+{
+    int k;
+    double sum = 0.0;
+
+    for (k = 0; k < n; ++k)
+        sum += (double)arr[k];
+    qsort(arr, n, sizeof(uint64_t), script_cmp_u64);
+    printf("  %-8s %10.1f %10.1f %10.1f %10.1f\n", name,
+           sum / n / 1000.0, (double)arr[(n - 1) / 2] / 1000.0,
+           (double)arr[((n - 1) * 99) / 100] / 1000.0,
+           (double)arr[n - 1] / 1000.0);
+}
+
+/* For each opcode replayed from a trace, compares the latencies seen when
+ * traced with those seen now */
+static void
+script_lat_report(const struct script_work * wp)
+{
+    bool hdr_done = false;
+    int k, op_code, n;
+    double t_sum, r_sum;
+    uint64_t * t_arr;
+    uint64_t * r_arr;
+    const struct script_rec * rp;
+    char b[80];
+
+    t_arr = (uint64_t *)malloc(wp->num_recs * sizeof(uint64_t));
+    r_arr = (uint64_t *)malloc(wp->num_recs * sizeof(uint64_t));
+    if ((NULL == t_arr) || (NULL == r_arr))
+        goto fini;
+    for (op_code = 0; op_code < 256; ++op_code) {
+        const struct script_rec * first = NULL;
+
+        t_sum = 0.0;
+        r_sum = 0.0;
+        for (k = 0, n = 0, rp = wp->arr; k < wp->num_recs; ++k, ++rp) {
+            if ((rp->cdb[0] != op_code) || (! rp->sent) || rp->res)
+                continue;
+            if (NULL == first)
+                first = rp;
+            t_arr[n] = rp->orig_ns;
+            r_arr[n++] = rp->ns;
+            t_sum += (double)rp->orig_ns;
+            r_sum += (double)rp->ns;
+        }
+        if (0 == n)
+            continue;
+        if (! hdr_done) {
+            printf("\nLatency comparison, in microseconds:\n");
+            hdr_done = true;
+        }
+        sg_get_opcode_sa_name(op_code, (first->cdb_len > 16) ?
+                              sg_get_unaligned_be16(first->cdb + 8) :
+                              (first->cdb[1] & 0x1f), 0, sizeof(b), b);
+        printf("%s: %d commands, replay/traced mean: %.2f\n", b, n,
+               (t_sum > 0.0) ? (r_sum / t_sum) : 0.0);
+        printf("             %10s %10s %10s %10s\n", "mean", "median",
+               "99th", "max");
+        script_lat_line("traced", t_arr, n);
+        script_lat_line("replay", r_arr, n);
+    }
+fini:
+    free(t_arr);
+    free(r_arr);
+}
+
+/* Outputs one line per record, in record order, then a summary. Returns
+ * 0 if every command was sent and got its expected status. */
+static int
+script_report(const struct script_work * wp, uint64_t elapsed_ns)
+{
+    bool is_scsi;
+    int k, sa;
+    int num_bad = 0;
+    int ret = 0;
+    const struct opts_t * op = wp->op;
+    const struct script_rec * rp;
+    char b[80];
+    char e[80];
+
+    for (k = 0, rp = wp->arr; k < wp->num_recs; ++k, ++rp) {
+        is_scsi = sg_is_scsi_cdb(rp->cdb, rp->cdb_len);
+        if ((1 == op->cmdset) || (2 == op->cmdset))
+            is_scsi = (1 == op->cmdset);
+        if (! is_scsi)
+            snprintf(b, sizeof(b), "%s", sg_get_nvme_opcode_name(rp->cdb[0],
+                     ! op->do_nvm, sizeof(e), e));
+        else {
+            sa = (rp->cdb_len > 16) ? sg_get_unaligned_be16(rp->cdb + 8) :
+                                      (rp->cdb[1] & 0x1f);
+            sg_get_opcode_sa_name(rp->cdb[0], sa, 0, sizeof(b), b);
+        }
+        printf("%d [%d] %s: ", k + 1, rp->rec_num, b);
+        if (! rp->sent) {
+            printf("not sent\n");
+            ++num_bad;
+            continue;
+        }
+        if (rp->res) {
+            if (rp->res < 0)
+                printf("error: %s\n", safe_strerror(-rp->res));
+            else
+                printf("pass-through error %d\n", rp->res);
+            if (0 == ret)
+                ret = (rp->res < 0) ? sg_convert_errno(-rp->res) :
+                                      SG_LIB_CAT_OTHER;
+            ++num_bad;
+            continue;
+        }
+        sg_get_scsi_status_str(rp->status, sizeof(e), e);
+        printf("%s", e);
+        if (rp->sense_key || rp->asc || rp->ascq)
+            printf(" sense=%x/%02x/%02x", rp->sense_key, rp->asc, rp->ascq);
+        if (rp->resid)
+            printf(" resid=%d", rp->resid);
+        printf(" %" PRIu64 ".%03u us", rp->ns / 1000,
+               (unsigned int)(rp->ns % 1000));
+        if (wp->is_trace)
+            printf(" (traced %" PRIu64 ".%03u us)", rp->orig_ns / 1000,
+                   (unsigned int)(rp->orig_ns % 1000));
+        if (! rp->ok) {
+            ++num_bad;
+            if (rp->din_err)
+                printf(", data-in not written");
+            else {
+                sg_get_scsi_status_str(rp->exp_status, sizeof(e), e);
+                printf(", expected %s", e);
+            }
+            if (0 == ret)
+                ret = rp->din_err ? SG_LIB_FILE_ERROR :
+                      (rp->cat ? rp->cat : SG_LIB_CAT_OTHER);
+        }
+        printf("\n");
+    }
+    printf("%d commands, %d not as expected, in %" PRIu64 ".%06u secs",
+           wp->num_recs, num_bad, elapsed_ns / 1000000000,
+           (unsigned int)((elapsed_ns % 1000000000) / 1000));
+    if (elapsed_ns > 0)
+        printf(", %.1f IOPS", (double)wp->num_recs * 1e9 /
+                              (double)elapsed_ns);
+    printf("\n");
+    if (wp->is_trace)
+        script_lat_report(wp);
+    if (num_bad && (0 == ret))
+        ret = SG_LIB_CAT_OTHER;
+    return ret;
+}
+
+/* --script=SF: sends each command in SF, up to --qd=QD of them at a
+ * time, from this thread over the file descriptor of ptvp */
+static int
+do_script(const struct opts_t * op, struct sg_pt_base * ptvp)
+{
+    int k, res, qd;
+    int ret = 0;
+    uint64_t t0;
+    struct script_work work;
+    struct script_work * wp = &work;
+
+    memset(wp, 0, sizeof(*wp));
+    wp->op = op;
+    wp->ifile_fd = -1;
+    wp->ofile_fd = -1;
+    wp->dout_fd = -1;
+    wp->dout_fidx = -1;
+    ret = script_load(wp, op->script_file);
+    if (ret)
+        goto fini;
+    if (op->dataout_file) {
+        wp->ifile_fd = open(op->dataout_file, O_RDONLY);
+        if (wp->ifile_fd < 0) {
+            ret = sg_convert_errno(errno);
+            perror(op->dataout_file);
+            goto fini;
+        }
+    }
+    if (op->datain_file) {
+        wp->ofile_fd = open(op->datain_file, O_WRONLY | O_CREAT | O_TRUNC,
+                            0666);
+        if (wp->ofile_fd < 0) {
+            ret = sg_convert_errno(errno);
+            perror(op->datain_file);
+            goto fini;
+        }
+    }
+    if ((op->pace_orig || op->qd_mult) && (! wp->is_trace)) {
+        pr2serr("--pace=orig and --qd=Mx need a trace as SF\n");
+        ret = SG_LIB_CONTRADICT;
+        goto fini;
+    }
+    if (op->qd_mult)
+        qd = op->qd_mult * wp->trace_peak;
+    else if (op->qd > 0)
+        qd = op->qd;
+    else        /* to keep the traced timing, allow traced concurrency */
+        qd = op->pace_orig ? wp->trace_peak : 1;
+    if (qd > SCRIPT_MAX_QD)
+        qd = SCRIPT_MAX_QD;
+    if (qd > wp->num_recs)
+        qd = wp->num_recs;
+    if (op->verbose)
+        pr2serr("%s: %d commands, sending up to %d at a time\n",
+                op->script_file, wp->num_recs, qd);
+    t0 = script_now_ns();
+    wp->t0 = t0;
+    res = script_run(wp, ptvp, qd);
+    ret = script_report(wp, script_now_ns() - t0);
+    if (res && (0 == ret))
+        ret = res;
+fini:
+    if (wp->dout_fd >= 0)
+        close(wp->dout_fd);
+    if (wp->ifile_fd >= 0)
+        close(wp->ifile_fd);
+    if (wp->ofile_fd >= 0)
+        close(wp->ofile_fd);
+    for (k = 0; k < wp->num_fns; ++k)
+        free(wp->dout_fns[k]);
+    free(wp->dout_fns);
+    free(wp->arr);
+    return ret;
+}
+
 
 int
 main(int argc, char *argv[])
@@ -610,6 +1512,10 @@ main(int argc, char *argv[])
         goto done;
     }
 
+    if (op->script_file) {
+        ret = do_script(op, ptvp);
+        goto done;
+    }
     if (op->scan_first < op->scan_last)
         do_scan = true;
 
@@ -840,7 +1746,7 @@ done:
         }
     }
 
-    if (op->verbose && is_scsi_cdb) {
+    if (op->verbose && is_scsi_cdb && (! op->script_file)) {
         sg_get_category_sense_str(ret, b_len, b, op->verbose - 1);
         pr2serr("%s\n", b);
     }
@@ -1,5 +1,5 @@
 /* A utility program originally written for the Linux OS SCSI subsystem.
- *  Copyright (C) 1999-2022 D. Gilbert
+ *  Copyright (C) 1999-2026 D. Gilbert
  *  This program is free software; you can redistribute it and/or modify
  *  it under the terms of the GNU General Public License as published by
  *  the Free Software Foundation; either version 2, or (at your option)
@@ -9,7 +9,9 @@
  *
  * This program uses the SCSI command READ BUFFER on the given
  * device, first to find out how big it is and then to read that
- * buffer (data mode, buffer id 0).
+ * buffer (data mode, buffer id 0). Optionally several threads, each with
+ * its own file descriptor, can each have several commands in flight using
+ * the sg driver's asynchronous (write()/read()) interface.
  */
 
 
@@ -29,6 +31,8 @@
 #include <getopt.h>
 #define __STDC_FORMAT_MACROS 1
 #include <inttypes.h>
+#include <poll.h>
+#include <pthread.h>
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -51,13 +55,15 @@
 #define RB_DEF_SIZE (200*1024*1024)
 #define RB_OPCODE 0x3C
 #define RB_CMD_LEN 10
+#define RB_MAX_QUEUE 16         /* sg driver default limit per fd */
+#define RB_MAX_THREADS 64
 
 #ifndef SG_FLAG_MMAP_IO
 #define SG_FLAG_MMAP_IO 4
 #endif
 
 
-static const char * version_str = "5.09 20220425";
+static const char * version_str = "5.10 20261014";
 
 static struct option long_options[] = {
         {"buffer", required_argument, 0, 'b'},
@@ -67,8 +73,11 @@ static struct option long_options[] = {
         {"mmap", no_argument, 0, 'm'},
         {"new", no_argument, 0, 'N'},
         {"old", no_argument, 0, 'O'},
+        {"progress", no_argument, 0, 'p'},
+        {"queue", required_argument, 0, 'Q'},
         {"quick", no_argument, 0, 'q'},
         {"size", required_argument, 0, 's'},
+        {"threads", required_argument, 0, 'T'},
         {"time", no_argument, 0, 't'},
         {"verbose", no_argument, 0, 'v'},
         {"version", no_argument, 0, 'V'},
@@ -79,6 +88,7 @@ struct opts_t {
     bool do_dio;
     bool do_echo;
     bool do_mmap;
+    bool do_progress;
     bool do_quick;
     bool do_time;
     bool verbose_given;
@@ -86,6 +96,8 @@ struct opts_t {
     bool opt_new;
     int do_buffer;
     int do_help;
+    int num_queue;      /* commands in flight per thread, 0 -> 1 */
+    int num_threads;    /* 0 -> 1 */
     int verbose;
     int64_t do_size;
     const char * device_name;
@@ -97,7 +109,9 @@ usage()
 {
     pr2serr("Usage: sg_rbuf [--buffer=EACH] [--dio] [--echo] "
             "[--help] [--mmap]\n"
-            "               [--quick] [--size=OVERALL] [--time] [--verbose] "
+            "               [--progress] [--queue=QD] [--quick] "
+            "[--size=OVERALL]\n"
+            "               [--threads=THR] [--time] [--verbose] "
             "[--version]\n"
             "               SG_DEVICE\n");
     pr2serr("  where:\n"
@@ -106,16 +120,23 @@ usage()
             "    --echo|-e       use echo buffer (def: use data mode)\n"
             "    --help|-h       print usage message then exit\n"
             "    --mmap|-m       requests mmap-ed IO (overrides -q, -d)\n"
-            "    --quick|-q      quick, don't xfer to user space\n");
+            "    --progress|-p    print bandwidth each second (to stderr)\n"
+            "    --queue=QD|-Q QD    commands in flight per thread (def: "
+            "1, max: %d)\n"
+            "    --quick|-q      quick, don't xfer to user space\n",
+            RB_MAX_QUEUE);
     pr2serr("    --size=OVERALL|-s OVERALL    total size to read (in bytes)\n"
             "                    default: 200 MiB\n"
+            "    --threads=THR|-T THR    number of threads, each with its "
+            "own file\n"
+            "                            descriptor (def: 1, max: %d)\n"
             "    --time|-t       time the data transfer\n"
             "    --verbose|-v    increase verbosity (more debug)\n"
             "    --old|-O        use old interface (use as first option)\n"
             "    --version|-V    print version string then exit\n\n"
             "Use SCSI READ BUFFER command (data or echo buffer mode, buffer "
             "id 0)\nrepeatedly. This utility only works with Linux sg "
-            "devices.\n");
+            "devices.\n", RB_MAX_THREADS);
 }
 
 static void
@@ -159,7 +180,7 @@ new_parse_cmd_line(struct opts_t * op, int argc, char * argv[])
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "b:dehmNOqs:tvV", long_options,
+        c = getopt_long(argc, argv, "b:dehmNOpqQ:s:tT:vV", long_options,
                         &option_index);
         if (c == -1)
             break;
@@ -192,9 +213,21 @@ new_parse_cmd_line(struct opts_t * op, int argc, char * argv[])
         case 'O':
             op->opt_new = false;
             return 0;
+        case 'p':
+            op->do_progress = true;
+            break;
         case 'q':
             op->do_quick = true;
             break;
+        case 'Q':
+            n = sg_get_num(optarg);
+            if ((n < 1) || (n > RB_MAX_QUEUE)) {
+                pr2serr("bad argument to '--queue', expect 1 to %d\n",
+                        RB_MAX_QUEUE);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            op->num_queue = n;
+            break;
         case 's':
            nn = sg_get_llnum(optarg);
            if (nn < 0) {
@@ -207,6 +240,15 @@ new_parse_cmd_line(struct opts_t * op, int argc, char * argv[])
         case 't':
             op->do_time = true;
             break;
+        case 'T':
+            n = sg_get_num(optarg);
+            if ((n < 1) || (n > RB_MAX_THREADS)) {
+                pr2serr("bad argument to '--threads', expect 1 to %d\n",
+                        RB_MAX_THREADS);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            op->num_threads = n;
+            break;
         case 'v':
             op->verbose_given = true;
             ++op->verbose;
@@ -351,6 +393,401 @@ parse_cmd_line(struct opts_t * op, int argc, char * argv[])
     return res;
 }
 
+static void
+enomem_hint(const struct opts_t * op, const char * leadin, int buf_size)
+{
+    pr2serr("%s: out of memory, try a smaller buffer size than %d bytes\n",
+            leadin, buf_size);
+    if (op->opt_new)
+        pr2serr("    [with '--buffer=EACH' where EACH is in bytes]\n");
+    else
+        pr2serr("    [with '-b=EACH' where EACH is in KiB]\n");
+}
+
+/* Prints the time since *start_tmp and the MB/sec and IOPS of 'num'
+ * commands that transferred 'bytes' in total */
+static void
+print_elapsed(const struct timeval * start_tmp, double bytes,
+              unsigned int num)
+{
+    double a;
+    struct timeval end_tm, res_tm;
+
+    gettimeofday(&end_tm, NULL);
+    res_tm.tv_sec = end_tm.tv_sec - start_tmp->tv_sec;
+    res_tm.tv_usec = end_tm.tv_usec - start_tmp->tv_usec;
+    if (res_tm.tv_usec < 0) {
+        --res_tm.tv_sec;
+        res_tm.tv_usec += 1000000;
+    }
+    a = res_tm.tv_sec;
+    a += (0.000001 * res_tm.tv_usec);
+    printf("time to read data from buffer was %d.%06d secs",
+           (int)res_tm.tv_sec, (int)res_tm.tv_usec);
+    if (a > 0.00001) {
+        if (bytes > 511)
+            printf(", %.2f MB/sec", bytes / (a * 1000000.0));
+        printf(", %.2f IOPS", num / a);
+    }
+    printf("\n");
+}
+
+/* State shared by the threads of the --threads= and --queue= engine */
+struct rb_share_t {
+    const struct opts_t * op;
+    int buf_size;
+    int num_active;             /* threads still running */
+    int res;                    /* first error, stops further commands */
+    bool dio_incomplete;
+    size_t psz;
+    unsigned int num;           /* commands to send in total */
+    unsigned int next_k;        /* next command to be claimed */
+    unsigned int num_done;
+    pthread_mutex_t mtx;
+    pthread_cond_t cv;          /* signalled as each thread exits */
+};
+
+/* One command slot; a thread has --queue= of them */
+struct rb_slot_t {
+    bool busy;
+    uint8_t * buffp;
+    uint8_t * free_buffp;
+    struct sg_io_hdr io_hdr;
+    uint8_t cdb[RB_CMD_LEN];
+    uint8_t sense_b[32];
+};
+
+static bool
+rb_claim(struct rb_share_t * sp)
+{
+    bool ok;
+
+    pthread_mutex_lock(&sp->mtx);
+    ok = ((0 == sp->res) && (sp->next_k < sp->num));
+    if (ok)
+        ++sp->next_k;
+    pthread_mutex_unlock(&sp->mtx);
+    return ok;
+}
+
+static void
+rb_set_err(struct rb_share_t * sp, int res)
+{
+    pthread_mutex_lock(&sp->mtx);
+    if (0 == sp->res)
+        sp->res = res;
+    pthread_mutex_unlock(&sp->mtx);
+}
+
+static void
+rb_prep(const struct rb_share_t * sp, struct rb_slot_t * slp, int pack_id)
+{
+    const struct opts_t * op = sp->op;
+    struct sg_io_hdr * hp = &slp->io_hdr;
+
+    memset(slp->cdb, 0, RB_CMD_LEN);
+    slp->cdb[0] = RB_OPCODE;
+    slp->cdb[1] = op->do_echo ? RB_MODE_ECHO_DATA : RB_MODE_DATA;
+    sg_put_unaligned_be24((uint32_t)sp->buf_size, slp->cdb + 6);
+    memset(hp, 0, sizeof(*hp));
+    hp->interface_id = 'S';
+    hp->cmd_len = RB_CMD_LEN;
+    hp->mx_sb_len = sizeof(slp->sense_b);
+    hp->dxfer_direction = SG_DXFER_FROM_DEV;
+    hp->dxfer_len = sp->buf_size;
+    if (! op->do_mmap)
+        hp->dxferp = slp->buffp;
+    hp->cmdp = slp->cdb;
+    hp->sbp = slp->sense_b;
+    hp->timeout = 20000;        /* 20000 millisecs == 20 seconds */
+    hp->pack_id = pack_id;
+    if (op->do_mmap)
+        hp->flags |= SG_FLAG_MMAP_IO;
+    else if (op->do_dio)
+        hp->flags |= SG_FLAG_DIRECT_IO;
+    else if (op->do_quick)
+        hp->flags |= SG_FLAG_NO_DXFER;
+}
+
+/* Accounts for a completed command whose header is *hp */
+static void
+rb_complete(struct rb_share_t * sp, struct sg_io_hdr * hp)
+{
+    int res = sg_err_category3(hp);
+    const struct opts_t * op = sp->op;
+
+    if (op->verbose > 2)
+        pr2serr("      duration=%u ms\n", hp->duration);
+    pthread_mutex_lock(&sp->mtx);
+    switch (res) {
+    case SG_LIB_CAT_RECOVERED:
+        sg_chk_n_print3("READ BUFFER data, continuing", hp,
+                        op->verbose > 1);
+#if defined(__GNUC__)
+#if (__GNUC__ >= 7)
+        __attribute__((fallthrough));
+        /* FALL THROUGH */
+#endif
+#endif
+    case SG_LIB_CAT_CLEAN:
+        ++sp->num_done;
+        if (op->do_dio &&
+            ((hp->info & SG_INFO_DIRECT_IO_MASK) != SG_INFO_DIRECT_IO))
+            sp->dio_incomplete = true;
+        break;
+    default:
+        if (0 == sp->res) {
+            sg_chk_n_print3("READ BUFFER data error", hp, op->verbose > 1);
+            sp->res = (res > 0) ? res : SG_LIB_CAT_OTHER;
+        }
+        break;
+    }
+    pthread_mutex_unlock(&sp->mtx);
+}
+
+/* With a queue depth of 1 uses ioctl(SG_IO), otherwise keeps up to
+ * --queue= commands in flight with write() and collects them with read().
+ * Each thread opens its own file descriptor since the sg driver's reserved
+ * buffer (used by --mmap) and its queue of commands are per descriptor. */
+static void *
+rb_worker(void * v_sp)
+{
+    struct rb_share_t * sp = (struct rb_share_t *)v_sp;
+    const struct opts_t * op = sp->op;
+    int k, n, err;
+    int fd = -1;
+    int qd = (op->num_queue > 1) ? op->num_queue : 1;
+    int in_flight = 0;
+    unsigned int rs;
+    uint8_t * mmap_p = NULL;
+    struct rb_slot_t * slp;
+    struct rb_slot_t * slot_arr;
+    struct sg_io_hdr r_hdr;
+    struct pollfd a_poll;
+
+    slot_arr = (struct rb_slot_t *)calloc(qd, sizeof(struct rb_slot_t));
+    if (NULL == slot_arr) {
+        pr2serr("%s: out of memory\n", __func__);
+        rb_set_err(sp, sg_convert_errno(ENOMEM));
+        goto fini;
+    }
+    /* async interface needs write(), only then open read-write */
+    fd = open(op->device_name, ((qd > 1) ? O_RDWR : O_RDONLY) | O_NONBLOCK);
+    if (fd < 0) {
+        err = errno;
+        pr2serr("%s: open %s: %s\n", __func__, op->device_name,
+                safe_strerror(err));
+        rb_set_err(sp, sg_convert_errno(err));
+        goto fini;
+    }
+    if (! op->do_dio) {
+        rs = sp->buf_size;
+        if (op->do_mmap && (0 != (rs % sp->psz)))
+            rs = ((rs / sp->psz) + 1) * sp->psz;  /* round up to page */
+        if (ioctl(fd, SG_SET_RESERVED_SIZE, &rs) < 0)
+            perror("SG_SET_RESERVED_SIZE error");
+    }
+    if (op->do_mmap) {
+        mmap_p = (uint8_t *)mmap(NULL, sp->buf_size, PROT_READ, MAP_SHARED,
+                                 fd, 0);
+        if (MAP_FAILED == mmap_p) {
+            mmap_p = NULL;
+            if (ENOMEM == errno)
+                enomem_hint(op, "mmap()", sp->buf_size);
+            else
+                perror("error using mmap()");
+            rb_set_err(sp, SG_LIB_CAT_OTHER);
+            goto fini;
+        }
+    } else {
+        for (k = 0; k < qd; ++k) {
+            slp = slot_arr + k;
+            /* page aligned, as dio needs */
+            slp->buffp = sg_memalign(sp->buf_size, 0, &slp->free_buffp,
+                                     false);
+            if (NULL == slp->buffp) {
+                pr2serr("%s: out of memory (data)\n", __func__);
+                rb_set_err(sp, sg_convert_errno(ENOMEM));
+                goto fini;
+            }
+        }
+    }
+
+    if (1 == qd) {
+        slp = slot_arr;
+        for (k = 0; rb_claim(sp); ++k) {
+            rb_prep(sp, slp, k);
+            if (ioctl(fd, SG_IO, &slp->io_hdr) < 0) {
+                if (ENOMEM == errno)
+                    enomem_hint(op, "SG_IO data", sp->buf_size);
+                else
+                    perror("SG_IO READ BUFFER data error");
+                rb_set_err(sp, SG_LIB_CAT_OTHER);
+                break;
+            }
+            rb_complete(sp, &slp->io_hdr);
+        }
+        goto fini;
+    }
+    while (true) {
+        for (k = 0; (in_flight < qd) && (k < qd); ++k) {
+            slp = slot_arr + k;
+            if (slp->busy)
+                continue;
+            if (! rb_claim(sp))
+                break;
+            rb_prep(sp, slp, k);
+            if (write(fd, &slp->io_hdr, sizeof(slp->io_hdr)) < 0) {
+                if (ENOMEM == errno)
+                    enomem_hint(op, "write() data", sp->buf_size);
+                else
+                    perror("sg write() READ BUFFER data error");
+                rb_set_err(sp, SG_LIB_CAT_OTHER);
+                break;
+            }
+            slp->busy = true;
+            ++in_flight;
+        }
+        if (0 == in_flight)
+            break;
+        a_poll.fd = fd;
+        a_poll.events = POLLIN;
+        a_poll.revents = 0;
+        n = poll(&a_poll, 1, -1);
+        if ((n < 0) && (EINTR != errno)) {
+            perror("poll() error");
+            rb_set_err(sp, SG_LIB_CAT_OTHER);
+            break;
+        }
+        if (n <= 0)
+            continue;
+        memset(&r_hdr, 0, sizeof(r_hdr));
+        r_hdr.interface_id = 'S';
+        r_hdr.pack_id = -1;     /* any completed command */
+        if (read(fd, &r_hdr, sizeof(r_hdr)) < 0) {
+            if ((EAGAIN == errno) || (EINTR == errno))
+                continue;
+            perror("sg read() READ BUFFER data error");
+            rb_set_err(sp, SG_LIB_CAT_OTHER);
+            break;      /* close() below discards those still in flight */
+        }
+        if ((r_hdr.pack_id < 0) || (r_hdr.pack_id >= qd) ||
+            (! slot_arr[r_hdr.pack_id].busy)) {
+            pr2serr("%s: unexpected pack_id=%d\n", __func__,
+                    r_hdr.pack_id);
+            rb_set_err(sp, SG_LIB_CAT_OTHER);
+            break;
+        }
+        slot_arr[r_hdr.pack_id].busy = false;
+        --in_flight;
+        rb_complete(sp, &r_hdr);
+    }
+fini:
+    if (mmap_p)
+        munmap(mmap_p, sp->buf_size);
+    if (slot_arr) {
+        for (k = 0; k < qd; ++k) {
+            if (slot_arr[k].free_buffp)
+                free(slot_arr[k].free_buffp);
+        }
+        free(slot_arr);
+    }
+    if (fd >= 0)
+        close(fd);
+    pthread_mutex_lock(&sp->mtx);
+    --sp->num_active;
+    pthread_cond_signal(&sp->cv);
+    pthread_mutex_unlock(&sp->mtx);
+    return NULL;
+}
+
+/* Sends 'num' READ BUFFER commands, each of 'buf_size' bytes, using
+ * --threads= threads each with up to --queue= commands in flight. With
+ * --progress the bandwidth over each second is printed. Returns 0 on
+ * success. */
+static int
+rb_parallel(const struct opts_t * op, int buf_size, size_t psz,
+            unsigned int num)
+{
+    int k, n, err;
+    int elapsed_secs = 0;
+    int num_thr = (op->num_threads > 1) ? op->num_threads : 1;
+    unsigned int prev_done = 0;
+    unsigned int done;
+    struct rb_share_t share;
+    struct rb_share_t * sp = &share;
+    struct timeval start_tm, now_tm;
+    struct timespec wait_ts;
+    pthread_t tid_arr[RB_MAX_THREADS];
+
+    memset(sp, 0, sizeof(*sp));
+    sp->op = op;
+    sp->buf_size = buf_size;
+    sp->psz = psz;
+    sp->num = num;
+    pthread_mutex_init(&sp->mtx, NULL);
+    pthread_cond_init(&sp->cv, NULL);
+    if (op->verbose)
+        pr2serr("%d thread%s, each with up to %d command%s in flight\n",
+                num_thr, ((num_thr > 1) ? "s" : ""), op->num_queue ?
+                op->num_queue : 1, (op->num_queue > 1) ? "s" : "");
+    fflush(stdout);
+    gettimeofday(&start_tm, NULL);
+    for (k = 0; k < num_thr; ++k) {
+        pthread_mutex_lock(&sp->mtx);
+        ++sp->num_active;
+        pthread_mutex_unlock(&sp->mtx);
+        err = pthread_create(tid_arr + k, NULL, rb_worker, sp);
+        if (err) {
+            pr2serr("pthread_create: %s\n", safe_strerror(err));
+            pthread_mutex_lock(&sp->mtx);
+            --sp->num_active;
+            if (0 == sp->res)
+                sp->res = sg_convert_errno(err);
+            pthread_mutex_unlock(&sp->mtx);
+            break;
+        }
+    }
+    n = k;
+    pthread_mutex_lock(&sp->mtx);
+    wait_ts.tv_sec = start_tm.tv_sec + 1;
+    wait_ts.tv_nsec = start_tm.tv_usec * 1000;
+    while (sp->num_active > 0) {
+        if (ETIMEDOUT != pthread_cond_timedwait(&sp->cv, &sp->mtx,
+                                                &wait_ts))
+            continue;
+        ++elapsed_secs;
+        ++wait_ts.tv_sec;
+        if (op->do_progress) {
+            done = sp->num_done;
+            pr2serr("  %4d s: %.2f MB/sec, %u IOPS\n", elapsed_secs,
+                    (double)(done - prev_done) * buf_size / 1000000.0,
+                    done - prev_done);
+            prev_done = done;
+        }
+    }
+    pthread_mutex_unlock(&sp->mtx);
+    for (k = 0; k < n; ++k)
+        pthread_join(tid_arr[k], NULL);
+    if (op->do_time)
+        print_elapsed(&start_tm, (double)buf_size * sp->num_done,
+                      sp->num_done);
+    else if (op->do_progress) {
+        gettimeofday(&now_tm, NULL);
+        pr2serr("  %4.1f s: done\n", (now_tm.tv_sec - start_tm.tv_sec) +
+                (0.000001 * (now_tm.tv_usec - start_tm.tv_usec)));
+    }
+    if (sp->dio_incomplete)
+        printf(">> direct IO requested but not done\n");
+    printf("Read %" PRId64 " MiB (actual: %" PRId64 " bytes), buffer "
+           "size=%d KiB (%d bytes)\n",
+           ((int64_t)num * buf_size) / (1024 * 1024),
+           (int64_t)sp->num_done * buf_size, buf_size / 1024, buf_size);
+    pthread_mutex_destroy(&sp->mtx);
+    pthread_cond_destroy(&sp->cv);
+    return sp->res;
+}
+
 
 int
 main(int argc, char * argv[])
@@ -371,7 +808,7 @@ main(int argc, char * argv[])
     uint8_t sense_buffer[32] SG_C_CPP_ZERO_INIT;
     uint8_t rb_cdb [RB_CMD_LEN] SG_C_CPP_ZERO_INIT;
     struct sg_io_hdr io_hdr;
-    struct timeval start_tm, end_tm;
+    struct timeval start_tm;
     struct opts_t opts;
 
 #if defined(HAVE_SYSCONF) && defined(_SC_PAGESIZE)
@@ -414,6 +851,11 @@ main(int argc, char * argv[])
         usage_for(op);
         return SG_LIB_SYNTAX_ERROR;
     }
+    if (op->do_mmap && (op->num_queue > 1)) {
+        pr2serr("--mmap needs --queue=1 since each file descriptor has one "
+                "reserved buffer\n");
+        return SG_LIB_CONTRADICT;
+    }
 
     if (op->do_buffer > 0)
         buf_size = op->do_buffer;
@@ -510,6 +952,11 @@ main(int argc, char * argv[])
         free(rawp);
         rawp = NULL;
     }
+    if ((op->num_threads > 1) || (op->num_queue > 1) || op->do_progress) {
+        close(sg_fd);
+        res = rb_parallel(op, buf_size, psz, total_size / buf_size);
+        return (res >= 0) ? res : SG_LIB_CAT_OTHER;
+    }
 
     if (! op->do_dio) {
         k = buf_size;
@@ -524,15 +971,9 @@ main(int argc, char * argv[])
         rbBuff = (uint8_t *)mmap(NULL, buf_size, PROT_READ, MAP_SHARED,
                                        sg_fd, 0);
         if (MAP_FAILED == rbBuff) {
-            if (ENOMEM == errno) {
-                pr2serr("mmap() out of memory, try a smaller buffer size "
-                        "than %d bytes\n", buf_size);
-                if (op->opt_new)
-                    pr2serr("    [with '--buffer=EACH' where EACH is in "
-                            "bytes]\n");
-                else
-                    pr2serr("    [with '-b=EACH' where EACH is in KiB]\n");
-            } else
+            if (ENOMEM == errno)
+                enomem_hint(op, "mmap()", buf_size);
+            else
                 perror("error using mmap()");
             return SG_LIB_CAT_OTHER;
         }
@@ -594,15 +1035,9 @@ main(int argc, char * argv[])
                                        sizeof(b), b));
         }
         if (ioctl(sg_fd, SG_IO, &io_hdr) < 0) {
-            if (ENOMEM == errno) {
-                pr2serr("SG_IO data: out of memory, try a smaller buffer "
-                        "size than %d bytes\n", buf_size);
-                if (op->opt_new)
-                    pr2serr("    [with '--buffer=EACH' where EACH is in "
-                            "bytes]\n");
-                else
-                    pr2serr("    [with '-b=EACH' where EACH is in KiB]\n");
-            } else
+            if (ENOMEM == errno)
+                enomem_hint(op, "SG_IO data", buf_size);
+            else
                 perror("SG_IO READ BUFFER data error");
             if (rawp) free(rawp);
             return SG_LIB_CAT_OTHER;
@@ -642,29 +1077,8 @@ main(int argc, char * argv[])
         }
 #endif
     }
-    if (op->do_time && (start_tm.tv_sec || start_tm.tv_usec)) {
-        struct timeval res_tm;
-        double a, b;
-
-        gettimeofday(&end_tm, NULL);
-        res_tm.tv_sec = end_tm.tv_sec - start_tm.tv_sec;
-        res_tm.tv_usec = end_tm.tv_usec - start_tm.tv_usec;
-        if (res_tm.tv_usec < 0) {
-            --res_tm.tv_sec;
-            res_tm.tv_usec += 1000000;
-        }
-        a = res_tm.tv_sec;
-        a += (0.000001 * res_tm.tv_usec);
-        b = (double)buf_size * num;
-        printf("time to read data from buffer was %d.%06d secs",
-               (int)res_tm.tv_sec, (int)res_tm.tv_usec);
-        if (a > 0.00001) {
-            if (b > 511)
-                printf(", %.2f MB/sec", b / (a * 1000000.0));
-            printf(", %.2f IOPS", num / a);
-        }
-        printf("\n");
-    }
+    if (op->do_time && (start_tm.tv_sec || start_tm.tv_usec))
+        print_elapsed(&start_tm, (double)buf_size * num, num);
     if (dio_incomplete)
         printf(">> direct IO requested but not done\n");
     printf("Read %" PRId64 " MiB (actual: %" PRId64 " bytes), buffer "
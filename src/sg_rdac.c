@@ -21,6 +21,8 @@
 #include <stdbool.h>
 #include <unistd.h>
 #include <string.h>
+#include <errno.h>
+#include <inttypes.h>
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -29,10 +31,13 @@
 #include "sg_lib.h"
 #include "sg_cmds_basic.h"
 #include "sg_unaligned.h"
+#include "sg_alua.h"
+#include "sg_par.h"
+#include "sg_mpoll.h"
 #include "sg_pr2serr.h"
 
 
-static const char * version_str = "1.17 20180512";
+static const char * version_str = "1.18 20261015";
 
 uint8_t mode6_hdr[] = {
     0x75, /* Length */
@@ -116,8 +121,21 @@ static void dump_mode_page( uint8_t *page, int len )
 #define RDAC_FAIL_SELECTED_PATHS 0x2
 #define RDAC_FORCE_QUIESCENCE 0x2
 #define RDAC_QUIESCENCE_TIME 10
+#define RDAC_MAX_LUNS 256
+#define DEF_PER_CTL 4
+
+struct rdac_batch_t {
+        bool fail_all;
+        bool use_6_byte;
+        int num_luns;
+        const int * lun_arr;
+        const struct sg_alua_path * pa_arr;
+        int * res_arr;
+        int64_t * ms_arr;
+};
 
-static int fail_all_paths(int fd, bool use_6_byte)
+/* When noisy is false nothing is output; the caller reports the result */
+static int fail_all_paths(int fd, bool use_6_byte, bool noisy)
 {
         struct rdac_legacy_page *rdac_page;
         struct rdac_expanded_page *rdac_page_exp;
@@ -160,6 +178,8 @@ static int fail_all_paths(int fd, bool use_6_byte)
                                         true, (do_verbose ? 2: 0));
         }
 
+        if (! noisy)
+                return res;
         switch (res) {
         case 0:
                 if (do_verbose)
@@ -174,27 +194,18 @@ static int fail_all_paths(int fd, bool use_6_byte)
         return res;
 }
 
-static int fail_this_path(int fd, int lun, bool use_6_byte)
+/* Marks all num_luns LUNs in lun_arr in the one MODE SELECT. The LUNs are
+ * checked by main() so that this function may run in any thread. */
+static int fail_these_paths(int fd, const int * lun_arr, int num_luns,
+                            bool use_6_byte, bool noisy)
 {
-        int res;
+        int k, res;
         struct rdac_legacy_page *rdac_page;
         struct rdac_expanded_page *rdac_page_exp;
         struct rdac_page_common *rdac_common = NULL;
         uint8_t fail_paths_pg[308];
         char b[80];
 
-        if (use_6_byte) {
-                if (lun > 31) {
-                        pr2serr("must use 10 byte cdb to fail luns over 31\n");
-                        return -1;
-                }
-        } else {        /* 10 byte cdb case */
-                if (lun > 255) {
-                        pr2serr("lun cannot exceed 255\n");
-                        return -1;
-                }
-        }
-
         memset(fail_paths_pg, 0, 308);
         if (use_6_byte) {
                 memcpy(fail_paths_pg, mode6_hdr, 4);
@@ -204,7 +215,8 @@ static int fail_this_path(int fd, int lun, bool use_6_byte)
                 rdac_page->page_length = RDAC_CONTROLLER_PAGE_LEN;
                 rdac_common = &rdac_page->attr;
                 memset(rdac_page->lun_table, 0x0, 32);
-                rdac_page->lun_table[lun] = 0x81;
+                for (k = 0; k < num_luns; ++k)
+                        rdac_page->lun_table[lun_arr[k]] = 0x81;
         } else {
                 memcpy(fail_paths_pg, mode10_hdr, 8);
                 rdac_page_exp = (struct rdac_expanded_page *)
@@ -215,7 +227,8 @@ static int fail_this_path(int fd, int lun, bool use_6_byte)
                                       rdac_page_exp->page_length + 0);
                 rdac_common = &rdac_page_exp->attr;
                 memset(rdac_page_exp->lun_table, 0x0, 256);
-                rdac_page_exp->lun_table[lun] = 0x81;
+                for (k = 0; k < num_luns; ++k)
+                        rdac_page_exp->lun_table[lun_arr[k]] = 0x81;
         }
 
         rdac_common->current_mode_lsb =  RDAC_FAIL_SELECTED_PATHS;
@@ -232,6 +245,8 @@ static int fail_this_path(int fd, int lun, bool use_6_byte)
                                         true, (do_verbose ? 2: 0));
         }
 
+        if (! noisy)
+                return res;
         switch (res) {
         case 0:
                 if (do_verbose)
@@ -239,13 +254,111 @@ static int fail_this_path(int fd, int lun, bool use_6_byte)
                 break;
         default:
                 sg_get_category_sense_str(res, sizeof(b), b, do_verbose);
-                pr2serr("fail paths page (lun=%d) failed: %s\n", lun, b);
+                if (1 == num_luns)
+                        pr2serr("fail paths page (lun=%d) failed: %s\n",
+                                lun_arr[0], b);
+                else
+                        pr2serr("fail paths page (%d luns) failed: %s\n",
+                                num_luns, b);
                 break;
         }
 
         return res;
 }
 
+static int rdac_one(int64_t k, void * ctx)
+{
+        struct rdac_batch_t * bp = (struct rdac_batch_t *)ctx;
+        const struct sg_alua_path * pap = bp->pa_arr + k;
+        int64_t start_ms;
+
+        if (pap->sg_fd < 0) {
+                bp->res_arr[k] = pap->res ? pap->res : SG_LIB_FILE_ERROR;
+                return 0;
+        }
+        start_ms = sg_mpoll_now_ms();
+        if (bp->fail_all)
+                bp->res_arr[k] = fail_all_paths(pap->sg_fd, bp->use_6_byte,
+                                                false);
+        else
+                bp->res_arr[k] = fail_these_paths(pap->sg_fd, bp->lun_arr,
+                                                  bp->num_luns,
+                                                  bp->use_6_byte, false);
+        bp->ms_arr[k] = sg_mpoll_now_ms() - start_ms;
+        return 0;
+}
+
+/* Sends the same redundant controller page to each of num_devs DEVICEs,
+ * at most num_par at once and at most per_ctl at once through the same
+ * target port (i.e. to the same controller). Outputs one line per DEVICE.
+ * Returns 0 if all succeeded, else the first failure in command line
+ * order. */
+static int rdac_multi(const char ** dev_names, int num_devs, int num_par,
+                      int per_ctl, struct rdac_batch_t * bp)
+{
+        int k, n;
+        int ret = 0;
+        int * grp_arr = NULL;
+        struct sg_alua_path * pa_arr;
+        struct sg_alua_path * pap;
+        char b[80];
+
+        pa_arr = (struct sg_alua_path *)calloc(num_devs, sizeof(*pa_arr));
+        grp_arr = (int *)calloc(num_devs, sizeof(int));
+        bp->res_arr = (int *)calloc(num_devs, sizeof(int));
+        bp->ms_arr = (int64_t *)calloc(num_devs, sizeof(int64_t));
+        if ((NULL == pa_arr) || (NULL == grp_arr) ||
+            (NULL == bp->res_arr) || (NULL == bp->ms_arr)) {
+                pr2serr("%s: out of memory\n", __func__);
+                ret = sg_convert_errno(ENOMEM);
+                goto fini;
+        }
+        for (k = 0; k < num_devs; ++k) {
+                pa_arr[k].dev_name = dev_names[k];
+                pa_arr[k].keep_open = true;
+                pa_arr[k].vpd_only = true;
+        }
+        /* only to learn which controller each DEVICE goes through */
+        sg_alua_discover(pa_arr, num_devs, num_par, false /* rw */,
+                         do_verbose);
+        n = sg_alua_tport_groups(pa_arr, num_devs, grp_arr);
+        if (do_verbose)
+                pr2serr("%d DEVICEs through %d target port(s)\n", num_devs,
+                        n);
+        bp->pa_arr = pa_arr;
+        sg_par_each_grouped(num_devs, num_par, per_ctl, grp_arr, rdac_one,
+                            bp);
+        for (k = 0, n = 0, pap = pa_arr; k < num_devs; ++k, ++pap) {
+                if (0 == bp->res_arr[k]) {
+                        printf("%s: fail paths ok, %" PRId64 " ms\n",
+                               pap->dev_name, bp->ms_arr[k]);
+                        continue;
+                }
+                ++n;
+                if (0 == ret)
+                        ret = bp->res_arr[k];
+                if (pap->sg_fd < 0)
+                        printf("%s: not opened\n", pap->dev_name);
+                else {
+                        sg_get_category_sense_str(bp->res_arr[k], sizeof(b),
+                                                  b, do_verbose);
+                        printf("%s: fail paths failed, %" PRId64 " ms: %s\n",
+                               pap->dev_name, bp->ms_arr[k], b);
+                }
+        }
+        if (n)
+                pr2serr("%d of %d DEVICEs failed\n", n, num_devs);
+fini:
+        if (pa_arr) {
+                sg_alua_close(pa_arr, num_devs);
+                free(pa_arr);
+        }
+        free(grp_arr);
+        free(bp->res_arr);
+        free(bp->ms_arr);
+        return ret;
+}
+
 static void print_rdac_mode(uint8_t *ptr, bool exp_subpg)
 {
         int i, k, bd_len, lun_table_len;
@@ -372,18 +485,29 @@ static void print_rdac_mode(uint8_t *ptr, bool exp_subpg)
 
 static void usage()
 {
-    printf("Usage:  sg_rdac [-6] [-a] [-f=LUN] [-v] [-V] DEVICE\n"
+    printf("Usage:  sg_rdac [-6] [-a] [-c=C] [-f=LUN[,LUN...]] [-p=Q] [-v] "
+           "[-V] DEVICE...\n"
            "  where:\n"
            "    -6        use 6 byte cdbs for mode sense/select\n"
            "    -a        transfer all devices to the controller\n"
            "              serving DEVICE.\n"
-           "    -f=LUN    transfer the device at LUN to the\n"
-           "              controller serving DEVICE\n"
+           "    -c=C      with several DEVICEs, at most C mode selects at "
+           "once\n"
+           "              through the same target port (def: %d)\n"
+           "    -f=LUN[,LUN...]    transfer the device(s) at LUN(s) to "
+           "the\n"
+           "              controller serving DEVICE, in one mode select\n"
+           "    -p=Q      with several DEVICEs, at most Q mode selects at "
+           "once\n"
+           "              (def: %d)\n"
            "    -v        verbose\n"
            "    -V        print version then exit\n\n"
            " Display/Modify RDAC Redundant Controller Page 0x2c.\n"
            " If [-a] or [-f] is not specified the current settings"
-           " are displayed.\n");
+           " are displayed.\n"
+           " Several DEVICEs need [-a] or [-f]; one line of status and "
+           "timing is\n"
+           " output per DEVICE.\n", DEF_PER_CTL, SG_ALUA_DEF_PARALLEL);
 }
 
 int main(int argc, char * argv[])
@@ -391,11 +515,19 @@ int main(int argc, char * argv[])
         bool fail_all = false;
         bool fail_path = false;
         bool use_6_byte = false;
-        int res, fd, k, resid, len, lun = -1;
+        int res, fd, k, j, resid, len;
+        int num_luns = 0;
+        int num_devs = 0;
+        int num_par = SG_ALUA_DEF_PARALLEL;
+        int per_ctl = DEF_PER_CTL;
         int ret = 0;
         char **argptr;
         char * file_name = 0;
+        const char * cp;
+        const char ** dev_names = NULL;
+        int lun_arr[RDAC_MAX_LUNS];
         uint8_t rsp_buff[MX_ALLOC_LEN];
+        struct rdac_batch_t batch;
 
         if (argc < 2) {
                 usage ();
@@ -408,7 +540,33 @@ int main(int argc, char * argv[])
                         ++do_verbose;
                 else if (!strncmp(*argptr, "-f=",3)) {
                         fail_path = true;
-                        lun = strtoul(*argptr + 3, NULL, 0);
+                        for (cp = *argptr + 3; cp; ) {
+                                if (num_luns >= RDAC_MAX_LUNS) {
+                                        pr2serr("too many LUNs to '-f='\n");
+                                        return SG_LIB_SYNTAX_ERROR;
+                                }
+                                lun_arr[num_luns++] = strtoul(cp, NULL, 0);
+                                cp = strchr(cp, ',');
+                                if (cp)
+                                        ++cp;
+                        }
+                }
+                else if (!strncmp(*argptr, "-c=", 3)) {
+                        per_ctl = sg_get_num(*argptr + 3);
+                        if (per_ctl < 1) {
+                                pr2serr("bad argument to '-c=', expect 1 or "
+                                        "more\n");
+                                return SG_LIB_SYNTAX_ERROR;
+                        }
+                }
+                else if (!strncmp(*argptr, "-p=", 3)) {
+                        num_par = sg_get_num(*argptr + 3);
+                        if ((num_par < 1) ||
+                            (num_par > SG_ALUA_MAX_PARALLEL)) {
+                                pr2serr("bad argument to '-p=', expect 1 to "
+                                        "%d\n", SG_ALUA_MAX_PARALLEL);
+                                return SG_LIB_SYNTAX_ERROR;
+                        }
                 }
                 else if (!strcmp(*argptr, "-a")) {
                         fail_all = true;
@@ -425,18 +583,53 @@ int main(int argc, char * argv[])
                         file_name = 0;
                         break;
                 }
-                else if (0 == file_name)
-                        file_name = argv[k];
                 else {
-                        pr2serr("too many arguments\n");
-                        file_name = 0;
-                        break;
+                        if (NULL == dev_names) {
+                                dev_names = (const char **)
+                                        calloc(argc, sizeof(char *));
+                                if (NULL == dev_names) {
+                                        pr2serr("out of memory\n");
+                                        return sg_convert_errno(ENOMEM);
+                                }
+                                file_name = argv[k];
+                        }
+                        dev_names[num_devs++] = argv[k];
                 }
         }
         if (0 == file_name) {
+                free(dev_names);
                 usage();
                 return SG_LIB_SYNTAX_ERROR;
         }
+        for (j = 0; fail_path && (j < num_luns); ++j) {
+                if (use_6_byte && (lun_arr[j] > 31)) {
+                        pr2serr("must use 10 byte cdb to fail luns over 31\n");
+                        free(dev_names);
+                        return SG_LIB_SYNTAX_ERROR;
+                } else if (lun_arr[j] > 255) {
+                        pr2serr("lun cannot exceed 255\n");
+                        free(dev_names);
+                        return SG_LIB_SYNTAX_ERROR;
+                }
+        }
+        if (num_devs > 1) {
+                if (! (fail_all || fail_path)) {
+                        pr2serr("several DEVICEs need '-a' or '-f='\n");
+                        free(dev_names);
+                        usage();
+                        return SG_LIB_SYNTAX_ERROR;
+                }
+                memset(&batch, 0, sizeof(batch));
+                batch.fail_all = fail_all;
+                batch.use_6_byte = use_6_byte;
+                batch.lun_arr = lun_arr;
+                batch.num_luns = num_luns;
+                ret = rdac_multi(dev_names, num_devs, num_par, per_ctl,
+                                 &batch);
+                free(dev_names);
+                goto fini;
+        }
+        free(dev_names);
 
         fd = sg_cmds_open_device(file_name, false /* rw */, do_verbose);
         if (fd < 0) {
@@ -447,9 +640,10 @@ int main(int argc, char * argv[])
         }
 
         if (fail_all) {
-                res = fail_all_paths(fd, use_6_byte);
+                res = fail_all_paths(fd, use_6_byte, true);
         } else if (fail_path) {
-                res = fail_this_path(fd, lun, use_6_byte);
+                res = fail_these_paths(fd, lun_arr, num_luns, use_6_byte,
+                                       true);
         } else {
                 resid = 0;
                 if (use_6_byte)
@@ -36,6 +36,7 @@
 #include <signal.h>
 #include <ctype.h>
 #include <errno.h>
+#include <time.h>
 #define __STDC_FORMAT_MACROS 1
 #include <inttypes.h>
 #include <sys/ioctl.h>
@@ -52,13 +53,20 @@
 #include "config.h"
 #endif
 
+#ifdef HAVE_GETRANDOM
+#include <sys/random.h>         /* for getrandom() system call */
+#endif
+
 #include "sg_lib.h"
+#include "sg_cmds_basic.h"
+#include "sg_pt.h"
 #include "sg_io_linux.h"
 #include "sg_unaligned.h"
 #include "sg_pr2serr.h"
+#include "sg_cpu_stats.h"
 
 
-static const char * version_str = "1.39 20230519";
+static const char * version_str = "1.41 20261015";
 
 #define DEF_BLOCK_SIZE 512
 #define DEF_BLOCKS_PER_TRANSFER 128
@@ -88,6 +96,10 @@ static const char * version_str = "1.39 20230519";
 
 #define MIN_RESERVED_SIZE 8192
 
+#define MAX_QUEUE_DEPTH 64      /* random=1 commands in flight */
+#define RND_RD_ID 1             /* sg_pt_lat_*() device ids for reads */
+#define RND_WR_ID 2             /* and writes done by random=1 */
+
 static int sum_of_resids = 0;
 
 static int64_t dd_count = -1;
@@ -100,6 +112,40 @@ static int verbose = 0;
 
 static const char * sg_allow_dio = "/sys/module/sg/parameters/allow_dio";
 
+#ifdef HAVE_SRAND48_R   /* gcc extension. N.B. non-reentrant version slower */
+static struct drand48_data drand;/* opaque, used by srand48_r and mrand48_r */
+#endif
+
+/* Settings of the random=1 benchmark mode */
+struct rnd_opts_t {
+    bool is_sg;         /* SCSI commands via the pass-through, else pread() */
+    bool fua;
+    bool dpo;
+    int fd;
+    int bs;
+    int bpt_min;        /* each transfer is between bpt_min and bpt_max */
+    int bpt_max;
+    int wr_pct;         /* percentage of transfers that are writes */
+    int qd;
+    int cdbsz;
+    int64_t skip;       /* working set is ws blocks starting at skip */
+    int64_t ws;
+    long seed;
+};
+
+/* One command slot of random=1 */
+struct rnd_slot_t {
+    bool busy;
+    bool wr;
+    int blocks;
+    uint64_t t0_ns;
+    struct sg_pt_base * ptvp;
+    uint8_t * buf;
+    uint8_t * free_buf;
+    uint8_t cdb[MAX_SCSI_CDBSZ];
+    uint8_t sense[SENSE_BUFF_LEN];
+};
+
 
 static void
 install_handler (int sig_num, void (*sig_handler) (int sig))
@@ -173,22 +219,25 @@ dd_filetype(const char * filename)
 static void
 usage()
 {
-    pr2serr("Usage: sg_read  [blk_sgio=0|1] [bpt=BPT] [bs=BS] "
+    pr2serr("Usage: sg_read  [blk_sgio=0|1] [bpt=BPT[,BPT_MAX]] [bs=BS] "
             "[cdbsz=6|10|12|16]\n"
             "                count=COUNT [dio=0|1] [dpo=0|1] [fua=0|1] "
             "if=IFILE\n"
-            "                [mmap=0|1] [no_dfxer=0|1] [odir=0|1] "
-            "[skip=SKIP]\n"
-            "                [time=TI] [verbose=VERB] [--help] "
+            "                [mmap=0|1] [no_dfxer=0|1] [odir=0|1] [qd=QD]\n"
+            "                [random=0|1] [seed=SEED] [skip=SKIP] "
+            "[time=TI]\n"
+            "                [verbose=VERB] [wr=PCT] [ws=WS] [--help] "
             "[--verbose]\n"
-            "                [--version] "
+            "                [--version]\n"
             "  where:\n"
             "    blk_sgio 0->normal IO for block devices, 1->SCSI commands "
             "via SG_IO\n"
             "    bpt      is blocks_per_transfer (default is 128, or 64 KiB "
             "for default BS)\n"
             "             setting 'bpt=0' will do COUNT zero block SCSI "
-            "READs\n"
+            "READs; with\n"
+            "             random=1 each transfer is from BPT to BPT_MAX "
+            "blocks\n"
             "    bs       must match sector size if IFILE accessed via SCSI "
             "commands\n"
             "             (def=512)\n"
@@ -207,16 +256,29 @@ usage()
             "    no_dxfer 1->DMA to kernel buffers only, not user space, "
             "0->normal(def)\n"
             "    odir     1->open block device O_DIRECT, 0->don't (def)\n"
+            "    qd       random=1: commands kept in flight on a sg device "
+            "(def: 1)\n"
+            "    random   1->each transfer at a random address in the "
+            "working set,\n"
+            "             then report IOPS and a latency histogram\n"
+            "    seed     random=1: seed for the address sequence (def: "
+            "random)\n"
             "    skip     each transfer starts at this logical address "
             "(def=0)\n"
+            "             (random=1: start of the working set)\n"
             "    time     0->do nothing(def), 1->time from 1st cmd, 2->time "
-            "from 2nd, ...\n"
-            "    verbose  increase level of verbosity (def: 0)\n"
+            "from 2nd, ...\n");
+    pr2serr("    verbose  increase level of verbosity (def: 0)\n"
+            "    wr       random=1: percentage of transfers that are WRITEs "
+            "(def: 0)\n"
+            "             WARNING: that overwrites data on IFILE\n"
+            "    ws       random=1: working set size in blocks (def: from "
+            "SKIP to end)\n"
             "    --help|-h    print this usage message then exit\n"
             "    --verbose|-v   increase level of verbosity (def: 0)\n"
             "    --version|-V   print version number then exit\n\n"
             "Issue SCSI READ commands, each starting from the same logical "
-            "block address\n");
+            "block address;\nor, with random=1, at random addresses.\n");
 }
 
 static int
@@ -381,6 +443,346 @@ sg_bread(int sg_fd, uint8_t * buff, int blocks, int64_t from_block, int bs,
     return 0;
 }
 
+static uint32_t
+rnd_u32(void)
+{
+    long rn;
+
+#ifdef HAVE_SRAND48_R
+    mrand48_r(&drand, &rn);
+#else
+    rn = mrand48();
+#endif
+    return (uint32_t)rn;       /* mrand48 takes uniformly from [-2^31, 2^31) */
+}
+
+/* Picks the next transfer of random=1: its lba, size and direction */
+static void
+rnd_pick(const struct rnd_opts_t * rop, int64_t * lbap, int * blocksp,
+         bool * wrp)
+{
+    int blocks = rop->bpt_min;
+    uint64_t r;
+
+    if (rop->bpt_max > rop->bpt_min)
+        blocks += rnd_u32() % (uint32_t)(rop->bpt_max - rop->bpt_min + 1);
+    if (blocks > rop->ws)
+        blocks = (int)rop->ws;
+    r = ((uint64_t)rnd_u32() << 32) | rnd_u32();
+    *lbap = rop->skip + (int64_t)(r % (uint64_t)(rop->ws - blocks + 1));
+    *blocksp = blocks;
+    *wrp = (rop->wr_pct > 0) && ((int)(rnd_u32() % 100) < rop->wr_pct);
+}
+
+/* Starts the transfer held in *slp (or, when not a sg device, does it with
+ * pread() or pwrite()). Returns 0 on success. */
+static int
+rnd_start(const struct rnd_opts_t * rop, struct rnd_slot_t * slp,
+          int64_t lba)
+{
+    int res;
+    int num = slp->blocks * rop->bs;
+
+    slp->t0_ns = sg_get_mono_ns();
+    if (! rop->is_sg) {
+        off64_t pos = (off64_t)lba * rop->bs;
+
+        if (slp->wr)
+            res = pwrite(rop->fd, slp->buf, num, pos);
+        else
+            res = pread(rop->fd, slp->buf, num, pos);
+        if (res < 0) {
+            res = errno;
+            pr2serr(ME "%s at block %" PRId64 ": %s\n",
+                    (slp->wr ? "pwrite" : "pread"), lba, safe_strerror(res));
+            return sg_convert_errno(res);
+        }
+        if (res < num) {
+            pr2serr(ME "short %s at block %" PRId64 "\n",
+                    (slp->wr ? "write" : "read"), lba);
+            return SG_LIB_CAT_OTHER;
+        }
+        return 0;
+    }
+    if (sg_build_scsi_cdb(slp->cdb, rop->cdbsz, slp->blocks, lba, slp->wr,
+                          rop->fua, rop->dpo))
+        return SG_LIB_SYNTAX_ERROR;
+    clear_scsi_pt_obj(slp->ptvp);
+    set_scsi_pt_cdb(slp->ptvp, slp->cdb, rop->cdbsz);
+    set_scsi_pt_sense(slp->ptvp, slp->sense, sizeof(slp->sense));
+    if (slp->wr)
+        set_scsi_pt_data_out(slp->ptvp, slp->buf, num);
+    else
+        set_scsi_pt_data_in(slp->ptvp, slp->buf, num);
+    set_scsi_pt_packet_id(slp->ptvp, pack_id_count++);
+    if (verbose > 1) {
+        char b[128];
+
+        pr2serr("    %s cdb: %s\n", (slp->wr ? "WRITE" : "READ"),
+                sg_get_command_str(slp->cdb, rop->cdbsz, false, sizeof(b),
+                                   b));
+    }
+    res = do_scsi_pt_submit(slp->ptvp, -1, DEF_TIMEOUT / 1000, verbose);
+    if (res) {
+        pr2serr(ME "submit of SCSI %s failed, res=%d\n",
+                (slp->wr ? "WRITE" : "READ"), res);
+        return (res < 0) ? sg_convert_errno(-res) : SG_LIB_CAT_OTHER;
+    }
+    return 0;
+}
+
+/* Fetches the response of *slp. Returns 0 if done, -EAGAIN if not yet
+ * available, otherwise an error. */
+static int
+rnd_finish(const struct rnd_opts_t * rop, struct rnd_slot_t * slp)
+{
+    int res, sense_cat;
+
+    if (rop->is_sg) {
+        res = do_scsi_pt_receive(slp->ptvp, -1, verbose);
+        if (-EAGAIN == res)
+            return res;
+        res = sg_cmds_process_resp(slp->ptvp, (slp->wr ? "WRITE" : "READ"),
+                                   res, true, verbose, &sense_cat);
+        if (-1 == res)
+            return sg_convert_errno(get_scsi_pt_os_err(slp->ptvp));
+        else if (-2 == res) {
+            if ((SG_LIB_CAT_RECOVERED != sense_cat) &&
+                (SG_LIB_CAT_NO_SENSE != sense_cat))
+                return sense_cat;
+        }
+        sum_of_resids += get_scsi_pt_resid(slp->ptvp);
+    }
+    sg_pt_lat_record(slp->wr ? RND_WR_ID : RND_RD_ID,
+                     slp->cdb[0], SG_PT_LAT_SCSI,
+                     sg_get_mono_ns() - slp->t0_ns);
+    return 0;
+}
+
+/* Outputs IOPS, throughput, latency percentiles and the non-empty buckets
+ * of the latency histogram of reads and of writes. */
+static void
+rnd_report(const struct rnd_opts_t * rop, double secs)
+{
+    int j, k, num;
+    uint64_t cnt, lo, hi;
+    const struct sg_pt_lat_hist * hp;
+    struct sg_pt_lat_hist lat_arr[8];
+    static const char * side_s[2] = {"read", "write"};
+
+    num = sg_pt_lat_snapshot(lat_arr, 8, false);
+    for (k = 0; k < 2; ++k) {
+        for (hp = NULL, j = 0; j < num; ++j) {
+            if (lat_arr[j].dev_id == (uint64_t)(RND_RD_ID + k)) {
+                hp = lat_arr + j;
+                break;
+            }
+        }
+        if ((NULL == hp) || (0 == hp->count))
+            continue;
+        cnt = hp->count;
+        pr2serr("%s: %" PRIu64 " commands, %.0f IOPS; latency (us) "
+                "min/avg/max %.1f/%.1f/%.1f\n", side_s[k], cnt, cnt / secs,
+                hp->min_ns / 1000.0, (hp->sum_ns / (double)cnt) / 1000.0,
+                hp->max_ns / 1000.0);
+        pr2serr("  p50/p90/p99/p99.9/p99.99: %.1f/%.1f/%.1f/%.1f/%.1f us\n",
+                sg_pt_lat_percentile(hp, 50.0) / 1000.0,
+                sg_pt_lat_percentile(hp, 90.0) / 1000.0,
+                sg_pt_lat_percentile(hp, 99.0) / 1000.0,
+                sg_pt_lat_percentile(hp, 99.9) / 1000.0,
+                sg_pt_lat_percentile(hp, 99.99) / 1000.0);
+        for (j = 0; j < SG_PT_LAT_NUM_BUCKETS; ++j) {
+            if (0 == hp->bucket[j])
+                continue;
+            lo = sg_pt_lat_bucket_ns(j);
+            if (j < (SG_PT_LAT_NUM_BUCKETS - 1)) {
+                hi = sg_pt_lat_bucket_ns(j + 1);
+                pr2serr("    %10.1f to %10.1f us: %10" PRIu64 " (%5.2f%%)\n",
+                        lo / 1000.0, hi / 1000.0, hp->bucket[j],
+                        (100.0 * hp->bucket[j]) / cnt);
+            } else
+                pr2serr("    %10.1f us or more   : %10" PRIu64 " (%5.2f%%)\n",
+                        lo / 1000.0, hp->bucket[j],
+                        (100.0 * hp->bucket[j]) / cnt);
+        }
+    }
+    if ((secs > 0.00001) && (in_full > 0))
+        pr2serr("%.2f MB/sec over %.3f secs, ",
+                ((double)rop->bs * in_full) / (secs * 1000000.0), secs);
+    pr2serr("seed=%ld\n", rop->seed);
+}
+
+/* Completes *rop for random=1: working set size (ws of 0 -> from skip to
+ * the end of IFILE), seed (NULL seedp -> from getrandom() or the time),
+ * SCSI command size and, with qd > 1 on a sg device, O_NONBLOCK. Returns
+ * 0 on success. */
+static int
+rnd_setup(struct rnd_opts_t * rop, int64_t ws, const long * seedp)
+{
+    int res, fl;
+    int64_t cap = -1;
+
+    if (rop->is_sg) {
+        uint8_t rb[32];
+
+        res = sg_ll_readcap_16(rop->fd, false, 0, rb, sizeof(rb), true,
+                               verbose);
+        if (0 == res)
+            cap = (int64_t)sg_get_unaligned_be64(rb + 0) + 1;
+        else if (0 == sg_ll_readcap_10(rop->fd, false, 0, rb, 8, true,
+                                       verbose))
+            cap = (int64_t)sg_get_unaligned_be32(rb + 0) + 1;
+    } else {
+        off64_t off = lseek64(rop->fd, 0, SEEK_END);
+
+        if (off > 0)
+            cap = off / rop->bs;
+    }
+    if (0 == ws) {
+        if (cap <= rop->skip) {
+            pr2serr(ME "unable to find size of IFILE, give 'ws'\n");
+            return SG_LIB_CAT_OTHER;
+        }
+        ws = cap - rop->skip;
+    } else if ((cap > 0) && ((rop->skip + ws) > cap)) {
+        pr2serr(ME "SKIP+WS (%" PRId64 ") exceeds IFILE size (%" PRId64
+                " blocks)\n", rop->skip + ws, cap);
+        return SG_LIB_CONTRADICT;
+    }
+    rop->ws = ws;
+    if (rop->is_sg && (rop->cdbsz < MAX_SCSI_CDBSZ) &&
+        (((rop->skip + ws) > UINT32_MAX) ||
+         ((rop->cdbsz < 12) && (rop->bpt_max > 0xffff)) ||
+         ((6 == rop->cdbsz) && (((rop->skip + ws) > 0x1fffff) ||
+                                (rop->bpt_max > 256) || rop->fua ||
+                                rop->dpo)))) {
+        pr2serr("Note: SCSI command size increased to 16 bytes\n");
+        rop->cdbsz = MAX_SCSI_CDBSZ;
+    }
+    if (seedp)
+        rop->seed = *seedp;
+    else {
+#ifdef HAVE_GETRANDOM
+        ssize_t ssz = getrandom(&rop->seed, sizeof(rop->seed),
+                                GRND_NONBLOCK);
+
+        if (ssz < (ssize_t)sizeof(rop->seed))
+            rop->seed = (long)time(NULL);
+#else
+        rop->seed = (long)time(NULL);
+#endif
+    }
+#ifdef HAVE_SRAND48_R
+    srand48_r(rop->seed, &drand);
+#else
+    srand48(rop->seed);
+#endif
+    if (rop->qd > 1) {
+        if (! rop->is_sg) {
+            pr2serr("Note: qd=%d ignored as IFILE is not accessed with SCSI "
+                    "commands\n", rop->qd);
+            rop->qd = 1;
+        } else {
+            fl = fcntl(rop->fd, F_GETFL);
+            if ((fl < 0) || (fcntl(rop->fd, F_SETFL, fl | O_NONBLOCK) < 0))
+                perror(ME "fcntl(O_NONBLOCK)");
+        }
+    }
+    if (verbose)
+        pr2serr("random: working set %" PRId64 " blocks from %" PRId64
+                ", %d to %d blocks per transfer, %d%% writes, qd=%d, "
+                "seed=%ld\n", rop->ws, rop->skip, rop->bpt_min,
+                rop->bpt_max, rop->wr_pct, rop->qd, rop->seed);
+    return 0;
+}
+
+/* random=1: transfers (reads, and writes if wr= is given) of random size
+ * and address within the working set until dd_count blocks have been
+ * moved, with up to qd commands in flight on a sg device. Returns 0 or
+ * the first error; dd_count holds the number of blocks not started. */
+static int
+rnd_run(const struct rnd_opts_t * rop, int * itersp)
+{
+    bool wr;
+    int k, res, blocks, num_busy;
+    int ret = 0;
+    int64_t lba;
+    uint64_t start_ns;
+    struct rnd_slot_t * slp;
+    struct sg_cpu_snap cpu0, cpu1;
+    struct sg_cpu_cost cc;
+    struct rnd_slot_t slots[MAX_QUEUE_DEPTH];
+
+    memset(slots, 0, sizeof(slots));
+    for (k = 0; k < rop->qd; ++k) {
+        slp = slots + k;
+        slp->buf = sg_memalign(rop->bs * rop->bpt_max, 0, &slp->free_buf,
+                               false);
+        if (NULL == slp->buf) {
+            ret = sg_convert_errno(ENOMEM);
+            goto fini;
+        }
+        if (rop->is_sg) {
+            slp->ptvp = construct_scsi_pt_obj_with_fd(rop->fd, verbose);
+            if (NULL == slp->ptvp) {
+                ret = sg_convert_errno(ENOMEM);
+                goto fini;
+            }
+        }
+    }
+    sg_pt_lat_enable(true);
+    start_ns = sg_get_mono_ns();
+    sg_cpu_snap(&cpu0);
+    for (num_busy = 0; (dd_count > 0) || (num_busy > 0); ) {
+        for (k = 0; (0 == ret) && (dd_count > 0) && (k < rop->qd); ++k) {
+            slp = slots + k;
+            if (slp->busy)
+                continue;
+            rnd_pick(rop, &lba, &blocks, &wr);
+            slp->blocks = (blocks > dd_count) ? (int)dd_count : blocks;
+            slp->wr = wr;
+            ret = rnd_start(rop, slp, lba);
+            if (ret)
+                break;
+            slp->busy = true;
+            ++num_busy;
+            dd_count -= slp->blocks;
+            ++*itersp;
+        }
+        if (0 == num_busy)
+            break;
+        if (rop->qd > 1)
+            scsi_pt_wait_for_response(rop->fd, -1, verbose);
+        for (k = 0; k < rop->qd; ++k) {
+            slp = slots + k;
+            if (! slp->busy)
+                continue;
+            res = rnd_finish(rop, slp);
+            if (-EAGAIN == res)
+                continue;
+            slp->busy = false;
+            --num_busy;
+            if (res) {
+                if (0 == ret)
+                    ret = res;
+                dd_count += slp->blocks;        /* count it as not done */
+            } else
+                in_full += slp->blocks;
+        }
+    }
+    rnd_report(rop, (sg_get_mono_ns() - start_ns) / 1000000000.0);
+    sg_cpu_snap(&cpu1);
+    if (sg_cpu_cost(&cpu0, &cpu1, (uint64_t)rop->bs * in_full, *itersp, &cc))
+        sg_cpu_cost_pr(&cc, "");
+fini:
+    for (k = 0; k < rop->qd; ++k) {
+        if (slots[k].ptvp)
+            destruct_scsi_pt_obj(slots[k].ptvp);
+        free(slots[k].free_buf);
+    }
+    return ret;
+}
+
 /* Returns the number of times 'ch' is found in string 's' given the
  * string's length. */
 static int
@@ -409,6 +811,8 @@ main(int argc, char * argv[])
     bool do_dio = false;
     bool do_mmap = false;
     bool do_odir = false;
+    bool do_random = false;
+    bool seed_given = false;
     bool dpo = false;
     bool fua = false;
     bool no_dxfer = false;
@@ -416,6 +820,9 @@ main(int argc, char * argv[])
     bool version_given = false;
     int bs = 0;
     int bpt = DEF_BLOCKS_PER_TRANSFER;
+    int bpt_max = 0;
+    int qd = 1;
+    int wr_pct = 0;
     int dio_incomplete = 0;
     int do_time = 0;
     int in_type = FT_OTHER;
@@ -425,6 +832,8 @@ main(int argc, char * argv[])
     int n, keylen;
     size_t psz;
     int64_t skip = 0;
+    int64_t ws = 0;
+    long seed = 0;
     char * key;
     char * buf;
     uint8_t * wrkBuff = NULL;
@@ -435,6 +844,8 @@ main(int argc, char * argv[])
     char ebuff[EBUFF_SZ];
     const char * read_str;
     struct timeval start_tm, end_tm;
+    struct sg_cpu_snap start_cpu, end_cpu;
+    struct sg_cpu_cost cc;
 
 #if defined(HAVE_SYSCONF) && defined(_SC_PAGESIZE)
     psz = sysconf(_SC_PAGESIZE); /* POSIX.1 (was getpagesize()) */
@@ -457,6 +868,16 @@ main(int argc, char * argv[])
         if (0 == strcmp(key,"blk_sgio"))
             do_blk_sgio = !! sg_get_num(buf);
         else if (0 == strcmp(key,"bpt")) {
+            char * cp = strchr(buf, ',');
+
+            if (cp) {
+                *cp++ = '\0';
+                bpt_max = sg_get_num(cp);
+                if ((bpt_max < 1) || (bpt_max > MAX_BPT_VALUE)) {
+                    pr2serr( ME "bad BPT_MAX argument to 'bpt'\n");
+                    return SG_LIB_SYNTAX_ERROR;
+                }
+            }
             bpt = sg_get_num(buf);
             if ((bpt < 0) || (bpt > MAX_BPT_VALUE)) {
                 pr2serr( ME "bad argument to 'bpt'\n");
@@ -509,6 +930,21 @@ main(int argc, char * argv[])
         else if (strcmp(key,"of") == 0) {
             memcpy(outf, buf, INF_SZ - 1);
             outf[INF_SZ - 1] = '\0';
+        } else if (0 == strcmp(key,"qd")) {
+            qd = sg_get_num(buf);
+            if ((qd < 1) || (qd > MAX_QUEUE_DEPTH)) {
+                pr2serr( ME "'qd' expects 1 to %d\n", MAX_QUEUE_DEPTH);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+        } else if (0 == strcmp(key,"random"))
+            do_random = !! sg_get_num(buf);
+        else if (0 == strcmp(key,"seed")) {
+            seed = (long)sg_get_llnum(buf);
+            if (-1 == seed) {
+                pr2serr( ME "bad argument to 'seed'\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            seed_given = true;
         } else if (0 == strcmp(key,"skip")) {
             skip = sg_get_llnum(buf);
             if ((skip < 0) || (skip > MAX_COUNT_SKIP_SEEK)) {
@@ -520,6 +956,18 @@ main(int argc, char * argv[])
         else if (0 == strncmp(key, "verb", 4)) {
             verbose_given = true;
             verbose = sg_get_num(buf);
+        } else if (0 == strcmp(key,"wr")) {
+            wr_pct = sg_get_num(buf);
+            if ((wr_pct < 0) || (wr_pct > 100)) {
+                pr2serr( ME "'wr' expects a percentage (0 to 100)\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+        } else if (0 == strcmp(key,"ws")) {
+            ws = sg_get_llnum(buf);
+            if ((ws < 1) || (ws > MAX_COUNT_SKIP_SEEK)) {
+                pr2serr( ME "bad argument to 'ws'\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
         } else if (0 == strncmp(key, "--help", 6)) {
             usage();
             return 0;
@@ -608,6 +1056,21 @@ main(int argc, char * argv[])
         pr2serr("cannot select no_dxfer with dio or mmap\n");
         return SG_LIB_CONTRADICT;
     }
+    if (do_random) {
+        if ((dd_count <= 0) || (bpt < 1)) {
+            pr2serr("random=1 needs a positive 'count' and 'bpt'\n");
+            return SG_LIB_CONTRADICT;
+        }
+        if (do_dio || do_mmap || no_dxfer) {
+            pr2serr("random=1 can't be used with dio, mmap or no_dxfer\n");
+            return SG_LIB_CONTRADICT;
+        }
+        if (bpt_max < bpt)
+            bpt_max = bpt;
+    } else if (bpt_max || (qd > 1) || wr_pct || ws || seed_given) {
+        pr2serr("bpt=BPT,BPT_MAX qd= seed= wr= and ws= need random=1\n");
+        return SG_LIB_CONTRADICT;
+    }
 
     install_handler (SIGINT, interrupt_handler);
     install_handler (SIGQUIT, interrupt_handler);
@@ -683,7 +1146,7 @@ main(int argc, char * argv[])
             pr2serr(ME "negative 'count' only supported with SCSI READs\n");
             return SG_LIB_CAT_OTHER;
         }
-        flags = O_RDONLY;
+        flags = (wr_pct > 0) ? O_RDWR : O_RDONLY;
         if (do_odir)
             flags |= O_DIRECT;
         if ((infd = open(inf, flags)) < 0) {
@@ -713,6 +1176,34 @@ main(int argc, char * argv[])
         return 0;
     orig_count = dd_count;
 
+    if (do_random) {
+        struct rnd_opts_t ro;
+
+        memset(&ro, 0, sizeof(ro));
+        ro.is_sg = !! (FT_SG & in_type);
+        ro.fd = infd;
+        ro.bs = bs;
+        ro.bpt_min = bpt;
+        ro.bpt_max = bpt_max;
+        ro.wr_pct = wr_pct;
+        ro.qd = qd;
+        ro.cdbsz = scsi_cdbsz;
+        ro.fua = fua;
+        ro.dpo = dpo;
+        ro.skip = skip;
+        iters = 0;
+        ret = rnd_setup(&ro, ws, seed_given ? &seed : NULL);
+        if (0 == ret)
+            ret = rnd_run(&ro, &iters);
+        close(infd);
+        print_stats(iters, ro.is_sg ? "SCSI READ and WRITE" : "read and "
+                    "write");
+        if (sum_of_resids)
+            pr2serr(">> Non-zero sum of residual counts=%d\n",
+                    sum_of_resids);
+        return (ret >= 0) ? ret : SG_LIB_CAT_OTHER;
+    }
+
     if (dd_count > 0) {
         if (do_dio || do_odir || (FT_RAW & in_type)) {
             wrkBuff = (uint8_t *)malloc(bs * bpt + psz);
@@ -743,6 +1234,7 @@ main(int argc, char * argv[])
     blocks_per = bpt;
     start_tm.tv_sec = 0;   /* just in case start set condition not met */
     start_tm.tv_usec = 0;
+    memset(&start_cpu, 0, sizeof(start_cpu));
 
     if (verbose && (dd_count < 0))
         pr2serr("About to issue %" PRId64 " zero block SCSI READs\n",
@@ -750,8 +1242,10 @@ main(int argc, char * argv[])
 
     /* main loop */
     for (iters = 0; dd_count != 0; ++iters) {
-        if ((do_time > 0) && (iters == (do_time - 1)))
+        if ((do_time > 0) && (iters == (do_time - 1))) {
             gettimeofday(&start_tm, NULL);
+            sg_cpu_snap(&start_cpu);
+        }
         if (dd_count < 0)
             blocks = 0;
         else
@@ -846,6 +1340,7 @@ main(int argc, char * argv[])
     read_str = (FT_SG & in_type) ? "SCSI READ" : "read";
     if (do_time > 0) {
         gettimeofday(&end_tm, NULL);
+        sg_cpu_snap(&end_cpu);
         if (start_tm.tv_sec || start_tm.tv_usec) {
             struct timeval res_tm;
             double a, b, c;
@@ -896,6 +1391,11 @@ main(int argc, char * argv[])
             if ((iters > 0) && (a > 0.00001))
                 pr2serr("Average number of %s commands per second was %.2f\n",
                         read_str, (double)iters / a);
+            if (do_time > 1)
+                b = (c > 0.0) ? c : 0.0;
+            if (sg_cpu_cost(&start_cpu, &end_cpu, (uint64_t)b,
+                            iters - (do_time - 1), &cc))
+                sg_cpu_cost_pr(&cc, "");
         }
     }
 
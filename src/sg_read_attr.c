@@ -31,6 +31,7 @@
 #include "sg_cmds_basic.h"
 #include "sg_unaligned.h"
 #include "sg_pr2serr.h"
+#include "sg_json_sg_lib.h"
 
 /* A utility program originally written for the Linux OS SCSI subsystem.
  *
@@ -39,7 +40,7 @@
  * and decodes the response. Based on spc5r08.pdf
  */
 
-static const char * version_str = "1.18 20230407";
+static const char * version_str = "1.19 20261015";
 
 static const char * my_name = "sg_read_attr: ";
 
@@ -66,11 +67,30 @@ static const char * my_name = "sg_read_attr: ";
 #define SENSE_BUFF_LEN 64       /* Arbitrary, could be larger */
 #define DEF_PT_TIMEOUT  60      /* 60 seconds */
 
+#define RA_HARV_MAX_RANGES 32   /* items in --attrs=AL */
+#define RA_HARV_MAX_SIZES 64    /* entries in size cache */
+#define RA_HARV_MEDIA_LEN 32
+
+struct ra_range_t {
+    int lo;
+    int hi;
+};
+
+/* Allocation length needed by a media type for the attribute span lo to
+ * hi, learnt from the ATTRIBUTE LIST service action or a response */
+struct ra_size_t {
+    char media[RA_HARV_MEDIA_LEN];
+    int lo;
+    int hi;
+    int need;
+};
+
 struct opts_t {
     bool cache;
     bool enumerate;
     bool do_raw;
     bool o_readonly;
+    bool sizes_changed;
     bool verbose_given;
     bool version_given;
     int elem_addr;
@@ -83,6 +103,15 @@ struct opts_t {
     int quiet;
     int sa;
     int verbose;
+    int attr_lo;                /* lowest identifier in --attrs= */
+    int attr_hi;                /* highest identifier in --attrs= */
+    int num_ranges;             /* 0 unless --attrs= given */
+    int num_sizes;
+    const char * media;         /* --media=MT, "-" if not given */
+    const char * size_cache;    /* --size-cache=SCF */
+    sgj_state json_st;
+    struct ra_range_t ranges[RA_HARV_MAX_RANGES];
+    struct ra_size_t sizes[RA_HARV_MAX_SIZES];
 };
 
 struct acron_nv_t {
@@ -101,6 +130,7 @@ struct attr_name_info_t {
 };
 
 static struct option long_options[] = {
+    {"attrs", required_argument, 0, 'a'},
     {"cache", no_argument, 0, 'c'},
     {"enumerate", no_argument, 0, 'e'},
     {"element", required_argument, 0, 'E'},   /* SMC-3 element address */
@@ -111,11 +141,13 @@ static struct option long_options[] = {
     {"in", required_argument, 0, 'i'},
     {"lvn", required_argument, 0, 'l'},
     {"maxlen", required_argument, 0, 'm'},
+    {"media", required_argument, 0, 'M'},
     {"partition", required_argument, 0, 'p'},
     {"quiet", required_argument, 0, 'q'},
     {"raw", no_argument, 0, 'r'},
     {"readonly", no_argument, 0, 'R'},
     {"sa", required_argument, 0, 's'},
+    {"size-cache", required_argument, 0, 'S'},
     {"verbose", no_argument, 0, 'v'},
     {"version", no_argument, 0, 'V'},
     {0, 0, 0, 0},   /* sentinel */
@@ -195,16 +227,23 @@ static struct attr_name_info_t attr_name_arr[] = {
 static void
 usage()
 {
-    pr2serr("Usage: sg_read_attr [--cache] [--element=EA] [--enumerate] "
-            "[--filter=FL]\n"
-            "                    [--first=FAI] [--help] [--hex] [--in=FN] "
-            "[--lvn=LVN]\n"
-            "                    [--maxlen=LEN] [--partition=PN] [--quiet] "
-            "[--raw]\n"
-            "                    [--readonly] [--sa=SA] [--verbose] "
-            "[--version]\n"
-            "                    DEVICE\n");
+    pr2serr("Usage: sg_read_attr [--attrs=AL] [--cache] [--element=EA] "
+            "[--enumerate]\n"
+            "                    [--filter=FL] [--first=FAI] [--help] "
+            "[--hex] [--in=FN]\n"
+            "                    [--lvn=LVN] [--maxlen=LEN] [--media=MT] "
+            "[--partition=PN]\n"
+            "                    [--quiet] [--raw] [--readonly] [--sa=SA] "
+            "[--size-cache=SCF]\n"
+            "                    [--verbose] [--version] DEVICE "
+            "[DEVICE...]\n");
     pr2serr("  where:\n"
+            "    --attrs=AL|-a AL    harvest attributes in AL (comma "
+            "separated\n"
+            "                        identifiers or LO-HI ranges) with one "
+            "sized\n"
+            "                        READ ATTRIBUTE, output a JSON line per "
+            "DEVICE\n"
             "    --cache|-c         set CACHE bit in cdn (def: clear)\n"
             "    --enumerate|-e     enumerate known attributes and service "
             "actions\n"
@@ -228,17 +267,23 @@ usage()
             "    --maxlen=LEN|-m LEN    max response length (allocation "
             "length in cdb)\n"
             "                           (def: 0 -> 8192 bytes)\n"
+            "    --media=MT|-M MT    media type of the cartridges, keys the "
+            "sizing\n"
+            "                        used by --attrs= (def: '-')\n"
             "    --partition=PN|-p PN    partition number (PN) (def:0)\n"
             "    --quiet|-q         reduce the amount of output, can use "
             "more than once\n"
             "    --raw|-r           output response in binary\n"
             "    --readonly|-R      open DEVICE read-only (def: read-write)\n"
             "    --sa=SA|-s SA      SA is service action (def: 0)\n"
+            "    --size-cache=SCF|-S SCF    keep --attrs= sizing per media "
+            "type in\n"
+            "                               file SCF\n"
             "    --verbose|-v       increase verbosity\n"
             "    --version|-V       print version string and exit\n\n"
             "Performs a SCSI READ ATTRIBUTE command. Even though it is "
             "defined in\nSPC-3 and later it is typically used on tape "
-            "systems.\n");
+            "systems.\nOnly --attrs= accepts more than one DEVICE.\n");
 }
 
 /* Invokes a SCSI READ ATTRIBUTE command (SPC+SMC).  Return of 0 -> success,
@@ -337,7 +382,7 @@ find_sa_acron(const char * cp)
     return -1;  /* not found */
 }
 
-const char * a_format[] = {
+static const char * a_format[] = {
     "binary",
     "ascii",
     "text",
@@ -735,15 +780,482 @@ decode_all_sa_s(const uint8_t * rabp, int len, const struct opts_t * op)
     }
 }
 
+/* Harvest mode (--attrs=AL): the selected attributes of each DEVICE are
+ * fetched with one READ ATTRIBUTE (attribute values) whose FIRST ATTRIBUTE
+ * IDENTIFIER is the lowest selected identifier and whose allocation length
+ * just covers the highest one. Attributes are returned in ascending order
+ * so that length depends on which attributes the medium holds, and that
+ * is found once per media type (see --media=MT) from the ATTRIBUTE LIST
+ * service action. The needed lengths can be kept in a file between
+ * invocations (see --size-cache=SCF). Each DEVICE yields a JSON line. */
+
+static bool
+harv_selected(const struct opts_t * op, int id)
+{
+    int k;
+
+    for (k = 0; k < op->num_ranges; ++k) {
+        if ((id >= op->ranges[k].lo) && (id <= op->ranges[k].hi))
+            return true;
+    }
+    return false;
+}
+
+/* Decodes AL, a comma separated list of attribute identifiers or LO-HI
+ * identifier ranges, into op->ranges. Returns 0 or SG_LIB_SYNTAX_ERROR. */
+static int
+harv_parse_attrs(const char * arg, struct opts_t * op)
+{
+    int lo, hi, k;
+    const char * cp;
+    char b[32];
+
+    op->attr_lo = 65535;
+    op->attr_hi = 0;
+    for (cp = arg; cp && *cp; ) {
+        k = strcspn(cp, ",");
+        if ((k < 1) || (k >= (int)sizeof(b)))
+            goto bad;
+        memcpy(b, cp, k);
+        b[k] = '\0';
+        cp = (',' == cp[k]) ? (cp + k + 1) : NULL;
+        if (op->num_ranges >= RA_HARV_MAX_RANGES) {
+            pr2serr("--attrs= takes at most %d items\n", RA_HARV_MAX_RANGES);
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        if (strchr(b + 1, '-')) {
+            char * c2p = strchr(b + 1, '-');
+
+            *c2p = '\0';
+            lo = sg_get_num(b);
+            hi = sg_get_num(c2p + 1);
+        } else {
+            lo = sg_get_num(b);
+            hi = lo;
+        }
+        if ((lo < 0) || (lo > 65535) || (hi < lo) || (hi > 65535))
+            goto bad;
+        op->ranges[op->num_ranges].lo = lo;
+        op->ranges[op->num_ranges].hi = hi;
+        ++op->num_ranges;
+        if (lo < op->attr_lo)
+            op->attr_lo = lo;
+        if (hi > op->attr_hi)
+            op->attr_hi = hi;
+    }
+    if (op->num_ranges > 0)
+        return 0;
+bad:
+    pr2serr("bad argument to '--attrs=AL', expect a comma separated list "
+            "of attribute\nidentifiers (0 to 65535) or LO-HI ranges\n");
+    return SG_LIB_SYNTAX_ERROR;
+}
+
+static struct ra_size_t *
+harv_find_size(struct opts_t * op)
+{
+    int k;
+    struct ra_size_t * szp;
+
+    for (k = 0, szp = op->sizes; k < op->num_sizes; ++k, ++szp) {
+        if ((szp->lo == op->attr_lo) && (szp->hi == op->attr_hi) &&
+            (0 == strcmp(szp->media, op->media)))
+            return szp;
+    }
+    return NULL;
+}
+
+/* Records that media type op->media needs 'need' bytes. Entries only ever
+ * grow since cartridges of one media type may differ in host attributes. */
+static void
+harv_note_size(struct opts_t * op, int need)
+{
+    struct ra_size_t * szp = harv_find_size(op);
+
+    if (NULL == szp) {
+        if (op->num_sizes >= RA_HARV_MAX_SIZES)
+            return;
+        szp = op->sizes + op->num_sizes++;
+        snprintf(szp->media, sizeof(szp->media), "%s", op->media);
+        szp->lo = op->attr_lo;
+        szp->hi = op->attr_hi;
+        szp->need = 0;
+    }
+    if (need > szp->need) {
+        szp->need = need;
+        op->sizes_changed = true;
+    }
+}
+
+/* Each line of the size cache file is: MEDIA FIRST LAST NEED ; where FIRST
+ * and LAST are the lowest and highest selected attribute identifiers and
+ * NEED is the allocation length they required. '#' starts a comment. A
+ * missing file is not an error. */
+static int
+harv_load_sizes(struct opts_t * op)
+{
+    int lo, hi, need;
+    FILE * fp;
+    char line[256];
+    char media[RA_HARV_MEDIA_LEN];
+    char fmt[32];
+
+    fp = fopen(op->size_cache, "r");
+    if (NULL == fp)
+        return (ENOENT == errno) ? 0 : sg_convert_errno(errno);
+    snprintf(fmt, sizeof(fmt), "%%%ds %%i %%i %%i", RA_HARV_MEDIA_LEN - 1);
+    while (fgets(line, sizeof(line), fp)) {
+        if (('#' == line[0]) || (4 != sscanf(line, fmt, media, &lo, &hi,
+                                              &need)))
+            continue;
+        if ((op->num_sizes >= RA_HARV_MAX_SIZES) || (lo < 0) || (hi < lo) ||
+            (need < 4) || (need > MAX_RATTR_BUFF_LEN))
+            continue;
+        snprintf(op->sizes[op->num_sizes].media, RA_HARV_MEDIA_LEN, "%s",
+                 media);
+        op->sizes[op->num_sizes].lo = lo;
+        op->sizes[op->num_sizes].hi = hi;
+        op->sizes[op->num_sizes].need = need;
+        ++op->num_sizes;
+    }
+    fclose(fp);
+    if (op->verbose)
+        pr2serr("loaded %d entries from size cache %s\n", op->num_sizes,
+                op->size_cache);
+    return 0;
+}
+
+static int
+harv_save_sizes(const struct opts_t * op)
+{
+    int k;
+    FILE * fp;
+    const struct ra_size_t * szp;
+
+    fp = fopen(op->size_cache, "w");
+    if (NULL == fp) {
+        pr2serr("unable to write size cache %s: %s\n", op->size_cache,
+                safe_strerror(errno));
+        return sg_convert_errno(errno);
+    }
+    fprintf(fp, "# sg_read_attr size cache: MEDIA FIRST LAST NEED\n");
+    for (k = 0, szp = op->sizes; k < op->num_sizes; ++k, ++szp)
+        fprintf(fp, "%s 0x%x 0x%x %d\n", szp->media, szp->lo, szp->hi,
+                szp->need);
+    if (fclose(fp))
+        return sg_convert_errno(errno);
+    return 0;
+}
+
+/* Walks an attribute values response of rlen bytes. Places in *endp the
+ * offset just past the last attribute whose identifier is op->attr_hi or
+ * less. Returns true if the response is known to hold all of those, that
+ * is: an attribute beyond op->attr_hi has been seen, or the whole of the
+ * available data was returned. */
+static bool
+harv_scan(const uint8_t * bp, int rlen, const struct opts_t * op, int * endp)
+{
+    int k, id, alen, avail;
+
+    *endp = 4;
+    if (rlen < 4)
+        return false;
+    avail = (int)sg_get_unaligned_be32(bp + 0) + 4;
+    for (k = 4; k + 2 <= rlen; k += alen + 5) {
+        id = sg_get_unaligned_be16(bp + k);
+        if (id > op->attr_hi)
+            return true;
+        if (k + 5 > rlen)
+            break;
+        alen = sg_get_unaligned_be16(bp + k + 3);
+        if (k + 5 + alen > rlen)
+            break;
+        *endp = k + 5 + alen;
+    }
+    return (rlen >= avail) && (*endp >= avail);
+}
+
+/* Uses the ATTRIBUTE LIST service action and the T10 attribute lengths to
+ * work out how many bytes the selected attribute span needs. Places that
+ * in *needp, or 0 if an attribute in the span has no fixed length. */
+static int
+harv_list_need(int sg_fd, uint8_t * bp, int * needp, int * cmdsp,
+               struct opts_t * op)
+{
+    int k, id, res, resid, rlen, avail, need;
+    const struct attr_name_info_t * anip;
+    char b[160];
+
+    *needp = 0;
+    op->sa = RA_ATTR_LIST_SA;
+    op->fai = 0;
+    op->maxlen = 512;
+    while (true) {
+        res = sg_ll_read_attr(sg_fd, bp, &resid, op->verbose > 0, op);
+        ++*cmdsp;
+        if (res)
+            return res;
+        rlen = op->maxlen - resid;
+        if (rlen < 4)
+            return SG_LIB_CAT_MALFORMED;
+        avail = (int)sg_get_unaligned_be32(bp + 0) + 4;
+        if ((avail <= rlen) || (op->maxlen >= MAX_RATTR_BUFF_LEN))
+            break;
+        op->maxlen = (avail < MAX_RATTR_BUFF_LEN) ? avail :
+                                                    MAX_RATTR_BUFF_LEN;
+    }
+    if (avail < rlen)
+        rlen = avail;
+    need = 4;
+    for (k = 4; k + 2 <= rlen; k += 2) {
+        id = sg_get_unaligned_be16(bp + k);
+        if ((id < op->attr_lo) || (id > op->attr_hi))
+            continue;
+        anip = NULL;
+        attr_id_lookup(id, &anip, sizeof(b), b);
+        if ((NULL == anip) || (anip->len < 0)) {
+            if (op->verbose > 1)
+                pr2serr("attribute 0x%x has no fixed length\n", id);
+            return 0;
+        }
+        need += 5 + anip->len;
+    }
+    *needp = need;
+    return 0;
+}
+
+/* Usage history fields of attribute 0x340 (6 bytes each) and 0x341 (4
+ * bytes each), in order. */
+static const char * usage_hist_sn[] = {
+    "current_data_written_mib", "current_write_retry_count",
+    "current_data_read_mib", "current_read_retry_count",
+    "previous_data_written_mib", "previous_write_retry_count",
+    "previous_data_read_mib", "previous_read_retry_count",
+    "total_data_written_mib", "total_write_retry_count",
+    "total_data_read_mib", "total_read_retry_count",
+    "load_count", "total_change_partition_count",
+    "total_partition_initialization_count",
+};
+
+/* Adds the selected attributes found in the response to jop, keyed by
+ * their T10 names in snake case. */
+static void
+harv_attrs_js(sgj_state * jsp, sgj_opaque_p jop, const uint8_t * bp,
+              int len, bool * found_arr, const struct opts_t * op)
+{
+    int k, j, id, alen, fsz;
+    const uint8_t * vp;
+    const struct attr_name_info_t * anip;
+    const struct attr_name_info_t * a2p;
+    sgj_opaque_p jo2p;
+    char b[160];
+    char sn[160];
+
+    for (k = 4; k + 5 <= len; k += alen + 5) {
+        id = sg_get_unaligned_be16(bp + k);
+        alen = sg_get_unaligned_be16(bp + k + 3);
+        vp = bp + k + 5;
+        if ((id > op->attr_hi) || (k + 5 + alen > len))
+            break;
+        if (! harv_selected(op, id))
+            continue;
+        for (j = 0; j < op->num_ranges; ++j) {
+            if (id == op->ranges[j].lo)
+                found_arr[j] = true;
+        }
+        anip = NULL;
+        attr_id_lookup(id, &anip, sizeof(b), b);
+        if (anip) {
+            sgj_convert2snake(anip->name, sn, sizeof(sn));
+            for (a2p = attr_name_arr; a2p->name; ++a2p) {
+                if ((a2p != anip) && (0 == strcmp(a2p->name, anip->name)))
+                    break;
+            }
+            if (a2p->name)      /* same name used twice, add identifier */
+                sg_scn3pr(sn, sizeof(sn), strlen(sn), "_%x", id);
+        } else
+            snprintf(sn, sizeof(sn), "attribute_0x%x", id);
+        if (NULL == anip) {
+            sgj_js_nv_hex_bytes(jsp, jop, sn, vp, alen);
+            continue;
+        }
+        if ((RA_FMT_ASCII == anip->format) || (RA_FMT_TEXT == anip->format)) {
+            while ((alen > 0) && ((' ' == vp[alen - 1]) ||
+                                  ('\0' == vp[alen - 1])))
+                --alen;
+            sgj_js_nv_s_len_chk(jsp, jop, sn, vp, alen);
+        } else if ((0x224 == id) || (0x225 == id)) {
+            if (all_ffs_or_last_fe(vp, alen) || (alen > 8))
+                sgj_js_nv_s(jsp, jop, sn, "unknown");
+            else
+                sgj_js_nv_i(jsp, jop, sn, sg_get_unaligned_be(alen, vp));
+        } else if ((0x340 == id) || (0x341 == id)) {
+            fsz = (0x340 == id) ? 6 : 4;
+            jo2p = sgj_named_subobject_r(jsp, jop, sn);
+            for (j = 0; j < (int)SG_ARRAY_SIZE(usage_hist_sn); ++j) {
+                if ((j + 1) * fsz > alen)
+                    break;
+                sgj_js_nv_i(jsp, jo2p, usage_hist_sn[j],
+                            sg_get_unaligned_be(fsz, vp + (j * fsz)));
+            }
+        } else if ((alen > 0) && (alen <= 8)) {
+            if (1 == anip->process)
+                sgj_js_nv_ihex(jsp, jop, sn, sg_get_unaligned_be(alen, vp));
+            else
+                sgj_js_nv_i(jsp, jop, sn, sg_get_unaligned_be(alen, vp));
+        } else
+            sgj_js_nv_hex_bytes(jsp, jop, sn, vp, alen);
+    }
+}
+
+/* Fetches the selected attributes from one DEVICE and outputs them as one
+ * JSON line on stdout. Returns 0 or an exit status. */
+static int
+harvest_one(const char * dev_name, uint8_t * bp, struct opts_t * op)
+{
+    bool complete = false;
+    int k, sg_fd, res, resid, need, alloc;
+    int end = 4;
+    int rlen = 0;
+    int ret = 0;
+    int cmds = 0;
+    int resizes = 0;
+    sgj_state * jsp = &op->json_st;
+    sgj_opaque_p jop;
+    sgj_opaque_p jap;
+    struct ra_size_t * szp;
+    bool found_arr[RA_HARV_MAX_RANGES];
+    char b[80];
+
+    memset(found_arr, 0, sizeof(found_arr));
+    jop = sgj_start_r(NULL, NULL, 0, NULL, jsp);
+    sgj_js_nv_s(jsp, jop, "device", dev_name);
+    sgj_js_nv_s(jsp, jop, "media", op->media);
+    sg_fd = sg_cmds_open_device(dev_name, op->o_readonly, op->verbose);
+    if (sg_fd < 0) {
+        pr2serr("open error: %s: %s\n", dev_name, safe_strerror(-sg_fd));
+        ret = sg_convert_errno(-sg_fd);
+        goto fini;
+    }
+    szp = harv_find_size(op);
+    if (NULL == szp) {
+        ret = harv_list_need(sg_fd, bp, &need, &cmds, op);
+        if (ret)
+            goto close_fini;
+        if (need > 0)
+            harv_note_size(op, need);
+        else
+            need = DEF_RATTR_BUFF_LEN - 5;
+    } else
+        need = szp->need;
+    op->sa = RA_ATTR_VAL_SA;
+    op->fai = op->attr_lo;
+    /* 5 bytes more shows the identifier of the attribute after the span */
+    alloc = need + 5;
+    for (k = 0; k < 2; ++k) {
+        op->maxlen = (alloc < MAX_RATTR_BUFF_LEN) ? alloc :
+                                                   MAX_RATTR_BUFF_LEN;
+        ret = sg_ll_read_attr(sg_fd, bp, &resid, op->verbose > 0, op);
+        ++cmds;
+        if (ret)
+            goto close_fini;
+        rlen = op->maxlen - resid;
+        if (rlen < 4) {
+            ret = SG_LIB_CAT_MALFORMED;
+            goto close_fini;
+        }
+        complete = harv_scan(bp, rlen, op, &end);
+        if (complete || (op->maxlen >= MAX_RATTR_BUFF_LEN))
+            break;
+        /* this cartridge holds more than its media type suggested */
+        ++resizes;
+        alloc = (int)sg_get_unaligned_be32(bp + 0) + 4;
+        if (op->verbose)
+            pr2serr("%s: %d byte allocation too short, available is %d\n",
+                    dev_name, op->maxlen, alloc);
+    }
+    if (! complete)
+        pr2serr("%s: attribute response incomplete\n", dev_name);
+    harv_note_size(op, end);
+    sgj_js_nv_i(jsp, jop, "read_attribute_commands", cmds);
+    if (resizes)
+        sgj_js_nv_i(jsp, jop, "resizes", resizes);
+    harv_attrs_js(jsp, sgj_named_subobject_r(jsp, jop, "attributes"), bp,
+                  rlen, found_arr, op);
+    jap = NULL;
+    for (k = 0; k < op->num_ranges; ++k) {
+        if ((op->ranges[k].lo != op->ranges[k].hi) || found_arr[k])
+            continue;
+        if (NULL == jap)
+            jap = sgj_named_subarray_r(jsp, jop, "missing");
+        sgj_js_nv_i(jsp, jap, NULL, op->ranges[k].lo);
+    }
+close_fini:
+    res = sg_cmds_close_device(sg_fd);
+    if ((res < 0) && (0 == ret))
+        ret = sg_convert_errno(-res);
+fini:
+    if (ret) {
+        sg_get_category_sense_str(ret, sizeof(b), b, op->verbose);
+        sgj_js_nv_s(jsp, jop, "error", b);
+        if (op->verbose)
+            pr2serr("%s: %s\n", dev_name, b);
+    }
+    sgj_js2file(jsp, NULL, ret, stdout);
+    sgj_finish(jsp);
+    fflush(stdout);
+    return ret;
+}
+
+/* Harvest mode over num DEVICEs, one after another, so that those holding
+ * the same media type share one sizing. */
+static int
+harvest_multi(const char ** dev_arr, int num, struct opts_t * op)
+{
+    int k, res;
+    int ret = 0;
+    int num_bad = 0;
+    uint8_t * bp;
+    uint8_t * free_bp = NULL;
+
+    if (op->size_cache && (ret = harv_load_sizes(op)))
+        return ret;
+    bp = (uint8_t *)sg_memalign(MAX_RATTR_BUFF_LEN, 0, &free_bp,
+                                op->verbose > 3);
+    if (NULL == bp) {
+        pr2serr("unable to sg_memalign %d bytes\n", MAX_RATTR_BUFF_LEN);
+        return sg_convert_errno(ENOMEM);
+    }
+    for (k = 0; k < num; ++k) {
+        res = harvest_one(dev_arr[k], bp, op);
+        if (res) {
+            ++num_bad;
+            if (0 == ret)
+                ret = res;
+        }
+    }
+    free(free_bp);
+    if (op->size_cache && op->sizes_changed) {
+        res = harv_save_sizes(op);
+        if (0 == ret)
+            ret = res;
+    }
+    if ((num > 1) && num_bad)
+        pr2serr("%d of %d DEVICEs failed\n", num_bad, num);
+    return ret;
+}
+
 int
 main(int argc, char * argv[])
 {
     int sg_fd, res, c, len, resid, rlen;
+    int num_devs = 0;
     unsigned int ra_len;
     int in_len = 0;
     int ret = 0;
     const char * device_name = NULL;
     const char * fname = NULL;
+    const char ** dev_arr = NULL;
     uint8_t * rabp = NULL;
     uint8_t * free_rabp = NULL;
     struct opts_t opts;
@@ -753,18 +1265,23 @@ main(int argc, char * argv[])
     op = &opts;
     memset(op, 0, sizeof(opts));
     op->filter = -1;
+    op->media = "-";
     if (getenv("SG3_UTILS_INVOCATION"))
         sg_rep_invocation(my_name, version_str, argc, argv, stderr);
 
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "ceE:f:F:hHi:l:m:p:qrRs:vV",
+        c = getopt_long(argc, argv, "a:ceE:f:F:hHi:l:m:M:p:qrRs:S:vV",
                         long_options, &option_index);
         if (c == -1)
             break;
 
         switch (c) {
+        case 'a':
+            if (harv_parse_attrs(optarg, op))
+                return SG_LIB_SYNTAX_ERROR;
+            break;
         case 'c':
             op->cache = true;
             break;
@@ -818,6 +1335,16 @@ main(int argc, char * argv[])
                 return SG_LIB_SYNTAX_ERROR;
             }
             break;
+        case 'M':
+            if ((strlen(optarg) < 1) ||
+                (strlen(optarg) >= RA_HARV_MEDIA_LEN) ||
+                strpbrk(optarg, " \t\n#")) {
+                pr2serr("bad argument to '--media=MT', expect 1 to %d "
+                        "characters, no spaces\n", RA_HARV_MEDIA_LEN - 1);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            op->media = optarg;
+            break;
         case 'p':
            op->pn = sg_get_num(optarg);
            if ((op->pn < 0) || (op->pn > 255)) {
@@ -850,6 +1377,9 @@ main(int argc, char * argv[])
                 op->sa = res;
             }
             break;
+        case 'S':
+            op->size_cache = optarg;
+            break;
         case 'v':
             op->verbose_given = true;
             ++op->verbose;
@@ -868,12 +1398,23 @@ main(int argc, char * argv[])
             device_name = argv[optind];
             ++optind;
         }
-        if (optind < argc) {
+        if ((optind < argc) && (0 == op->num_ranges)) {
             for (; optind < argc; ++optind)
                 pr2serr("Unexpected extra argument: %s\n", argv[optind]);
             usage();
             return SG_LIB_SYNTAX_ERROR;
         }
+        if (op->num_ranges > 0) {
+            dev_arr = (const char **)calloc(argc - optind + 1,
+                                            sizeof(const char *));
+            if (NULL == dev_arr) {
+                pr2serr("unable to allocate DEVICE list\n");
+                return sg_convert_errno(ENOMEM);
+            }
+            dev_arr[num_devs++] = device_name;
+            for (; optind < argc; ++optind)
+                dev_arr[num_devs++] = argv[optind];
+        }
     }
 #ifdef DEBUG
     pr2serr("In DEBUG mode, ");
@@ -903,6 +1444,30 @@ main(int argc, char * argv[])
         return 0;
     }
 
+    if (op->num_ranges > 0) {
+        if (fname || op->do_raw || op->do_hex || (op->sa != RA_ATTR_VAL_SA) ||
+            (op->filter >= 0) || op->fai) {
+            pr2serr("--attrs= does not work with --in=, --raw, --hex, "
+                    "--sa=, --filter=\nor --first=\n");
+            ret = SG_LIB_CONTRADICT;
+        } else if (0 == num_devs) {
+            pr2serr("missing device name!\n");
+            usage();
+            ret = SG_LIB_SYNTAX_ERROR;
+        } else {
+            sgj_state * jsp = &op->json_st;
+
+            sgj_init_state(jsp, NULL);
+            /* each DEVICE is a JSON object on its own line */
+            jsp->pr_leadin = false;
+            jsp->pr_pretty = false;
+            jsp->pr_string = false;
+            ret = harvest_multi(dev_arr, num_devs, op);
+        }
+        free(dev_arr);
+        return (ret >= 0) ? ret : SG_LIB_CAT_OTHER;
+    } else if (strcmp(op->media, "-") || op->size_cache)
+        pr2serr("--media= and --size-cache= are ignored without --attrs=\n");
     if (fname && device_name) {
         pr2serr("since '--in=FN' given, ignoring DEVICE\n");
         device_name = NULL;
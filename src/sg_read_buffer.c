@@ -25,6 +25,10 @@
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
+#ifndef SG_LIB_WIN32
+#define SG_RB_THREADS 1         /* --download keeps commands in flight */
+#include <pthread.h>
+#endif
 
 #include "sg_lib.h"
 #include "sg_lib_data.h"
@@ -32,14 +36,17 @@
 #include "sg_cmds_extra.h"
 #include "sg_pt.h"
 #include "sg_unaligned.h"
+#include "sg_par.h"
 #include "sg_pr2serr.h"
 
 /*
  * This utility issues the SCSI READ BUFFER(10 or 16) command to the given
- * device.
+ * device. With --download=OFN it reads a whole buffer (or error history
+ * buffer) in chunks, with several READ BUFFER commands in flight, into a
+ * file.
  */
 
-static const char * version_str = "1.35 20220217";      /* spc6r06 */
+static const char * version_str = "1.36 20261015";      /* spc6r06 */
 
 #ifndef SG_READ_BUFFER_10_CMD
 #define SG_READ_BUFFER_10_CMD 0x3c
@@ -64,10 +71,16 @@ static const char * version_str = "1.35 20220217";      /* spc6r06 */
 #define SENSE_BUFF_LEN  64      /* Arbitrary, could be larger */
 #define DEF_PT_TIMEOUT  60      /* 60 seconds */
 #define DEF_RESPONSE_LEN 4      /* increased to 64 for MODE_ERR_HISTORY */
+#define DEF_DL_CHUNK (1024 * 1024)      /* --download= bytes per command */
+#define DEF_DL_PARALLEL 4
+#define MAX_DL_PARALLEL 32
+#define EH_DIR_LEN (32 + (8 * 256))     /* error history directory */
 
 
 static struct option long_options[] = {
         {"16", no_argument, 0, 'L'},
+        {"chunk", required_argument, 0, 'c'},
+        {"download", required_argument, 0, 'D'},
         {"eh_code", required_argument, 0, 'e'},
         {"eh-code", required_argument, 0, 'e'},
         {"help", no_argument, 0, 'h'},
@@ -80,6 +93,7 @@ static struct option long_options[] = {
         {"no_output", no_argument, 0, 'N'},
         {"no-output", no_argument, 0, 'N'},
         {"offset", required_argument, 0, 'o'},
+        {"parallel", required_argument, 0, 'P'},
         {"raw", no_argument, 0, 'r'},
         {"readonly", no_argument, 0, 'R'},
         {"specific", required_argument, 0, 'S'},
@@ -100,9 +114,11 @@ struct opts_t {
     bool verbose_given;
     bool version_given;
     int sg_fd;
+    int chunk;          /* --download= bytes per command, 0: default */
     int do_help;
     int do_hex;
     int eh_code;
+    int parallel;       /* --download= commands in flight */
     int rb_id;
     int rb_len;
     int rb_mode;
@@ -111,22 +127,31 @@ struct opts_t {
     uint64_t rb_offset;
     const char * device_name;
     const char * inhex_name;
+    const char * dl_fname;      /* --download=OFN */
 };
 
 
 static void
 usage()
 {
-    pr2serr("Usage: sg_read_buffer [--16] [--eh_code=EHC] [--help] [--hex] "
-            "[--id=ID]\n"
-            "                      [--inhex=FN] [--length=LEN] [--long] "
-            "[--mode=MO]\n"
-            "                      [--no_output] [--offset=OFF] [--raw] "
-            "[--readonly]\n"
-            "                      [--specific=MS] [--verbose] [--version] "
-            "DEVICE\n"
+    pr2serr("Usage: sg_read_buffer [--16] [--chunk=CS] [--download=OFN] "
+            "[--eh_code=EHC]\n"
+            "                      [--help] [--hex] [--id=ID] [--inhex=FN] "
+            "[--length=LEN]\n"
+            "                      [--long] [--mode=MO] [--no_output] "
+            "[--offset=OFF]\n"
+            "                      [--parallel=Q] [--raw] [--readonly] "
+            "[--specific=MS]\n"
+            "                      [--verbose] [--version] DEVICE\n"
             "  where:\n"
             "    --16|-L             issue READ BUFFER(16) (def: 10)\n"
+            "    --chunk=CS|-c CS    bytes per READ BUFFER with --download= "
+            "(def:\n"
+            "                        1 MiB, rounded to the offset boundary)\n"
+            "    --download=OFN|-D OFN    read the whole buffer (from OFF, "
+            "up to LEN\n"
+            "                             bytes) into file OFN ('-' for "
+            "stdout)\n"
             "    --eh_code=EHC|-e EHC    same as '-m eh -i EHC' where "
             "EHC is the\n"
             "                            error history code\n"
@@ -144,6 +169,9 @@ usage()
             "acronym (def: 0)\n"
             "    --no_output|-N      perform the command then exit\n"
             "    --offset=OFF|-o OFF    buffer offset (unit: bytes, def: 0)\n"
+            "    --parallel=Q|-P Q    READ BUFFER commands in flight with "
+            "--download=\n"
+            "                         (def: %d)\n"
             "    --raw|-r            output response in binary to stdout\n"
             "    --readonly|-R       open DEVICE read-only (def: read-write)\n"
             "    --specific=MS|-S MS    mode specific value; 3 bit field (0 "
@@ -152,7 +180,7 @@ usage()
             "    --version|-V        print version string and exit\n\n"
             "Performs a SCSI READ BUFFER (10 or 16) command. Use '-m xxx' to "
             "list\navailable modes. Some responses are decoded, others are "
-            "output in hex.\n"
+            "output in hex.\n", DEF_DL_PARALLEL
            );
 }
 
@@ -485,6 +513,314 @@ decode_error_history(const uint8_t * resp, const struct opts_t * op)
 
 }
 
+/* One READ BUFFER of a --download= */
+struct dl_slot_t {
+    bool busy;
+    bool threaded;
+    int res;
+    int resid;
+    uint8_t * buf;
+    uint8_t * free_buf;
+    struct opts_t o;    /* copy of the options with this chunk's offset */
+#ifdef SG_RB_THREADS
+    pthread_t thr;
+#endif
+};
+
+static void *
+dl_fetch(void * v_sp)
+{
+    struct dl_slot_t * sp = (struct dl_slot_t *)v_sp;
+
+    sp->resid = 0;
+    if (sp->o.do_long)
+        sp->res = sg_ll_read_buffer_16(sp->buf, &sp->resid, true, &sp->o);
+    else
+        sp->res = sg_ll_read_buffer_10(sp->buf, &sp->resid, true, &sp->o);
+    return NULL;
+}
+
+static void
+dl_issue(struct dl_slot_t * sp, uint64_t off, int len)
+{
+    sp->o.rb_offset = off;
+    sp->o.rb_len = len;
+    sp->busy = true;
+    sp->threaded = false;
+#ifdef SG_RB_THREADS
+    if (0 == pthread_create(&sp->thr, NULL, dl_fetch, sp)) {
+        sp->threaded = true;
+        return;
+    }
+#endif
+    dl_fetch(sp);
+}
+
+static void
+dl_collect(struct dl_slot_t * sp)
+{
+    if (! sp->busy)
+        return;
+#ifdef SG_RB_THREADS
+    if (sp->threaded)
+        pthread_join(sp->thr, NULL);
+#endif
+    sp->busy = false;
+}
+
+/* Finds the size of the buffer to download and the alignment its offsets
+ * need. For error history (buffer ID 0x10 to 0xef) that is from the entry
+ * in the error history directory, otherwise from the descriptor mode.
+ * Returns 0 or an exit status. */
+static int
+dl_buffer_size(const struct opts_t * op, uint64_t * sizep, int * alignp)
+{
+    int k, n, res;
+    int resid = 0;
+    const uint8_t * up;
+    uint8_t * bp;
+    uint8_t * free_bp = NULL;
+    struct opts_t o = *op;
+
+    bp = (uint8_t *)sg_memalign(EH_DIR_LEN, 0, &free_bp, false);
+    if (NULL == bp)
+        return sg_convert_errno(ENOMEM);
+    o.rb_offset = 0;
+    o.rb_mode_sp = 0;
+    if (MODE_ERR_HISTORY == op->rb_mode) {
+        o.rb_id = 0;            /* directory, existing snapshot */
+        o.rb_len = EH_DIR_LEN;
+    } else {
+        o.rb_mode = MODE_DESCRIPTOR;
+        o.rb_len = 4;
+    }
+    res = o.do_long ? sg_ll_read_buffer_16(bp, &resid, true, &o) :
+                      sg_ll_read_buffer_10(bp, &resid, true, &o);
+    if (res) {
+        pr2serr("unable to fetch the %s to find the buffer size\n",
+                (MODE_ERR_HISTORY == op->rb_mode) ?
+                "error history directory" : "buffer descriptor");
+        goto fini;
+    }
+    n = o.rb_len - resid;
+    res = SG_LIB_CAT_MALFORMED;
+    if (MODE_DESCRIPTOR == o.rb_mode) {
+        if (n < 4)
+            goto fini;
+        *sizep = sg_get_unaligned_be24(bp + 1);
+        /* an OFFSET BOUNDARY of 0xff means the offset must be 0 */
+        *alignp = (0xff == bp[0]) ? -1 : (1 << (bp[0] & 0x1f));
+        res = 0;
+        goto fini;
+    }
+    if (n < 32)
+        goto fini;
+    n = (n < (32 + (int)sg_get_unaligned_be16(bp + 30))) ? n :
+        (32 + (int)sg_get_unaligned_be16(bp + 30));
+    for (k = 32, up = bp + 32; (k + 8) <= n; k += 8, up += 8) {
+        if (up[0] == op->rb_id) {
+            *sizep = sg_get_unaligned_be32(up + 4);
+            *alignp = 1;
+            res = 0;
+            goto fini;
+        }
+    }
+    pr2serr("Buffer ID 0x%x not in the error history directory, a "
+            "snapshot may\nbe needed first (e.g. '--eh_code=1 -N')\n",
+            op->rb_id);
+    res = SG_LIB_SYNTAX_ERROR;
+fini:
+    free(free_bp);
+    return res;
+}
+
+/* Writes len bytes at bp to fd. Returns 0 or an exit status. */
+static int
+dl_write(int fd, const uint8_t * bp, int len)
+{
+    int n, err;
+
+    while (len > 0) {
+        n = write(fd, bp, len);
+        if (n < 0) {
+            err = errno;
+            if (EINTR == err)
+                continue;
+            pr2serr("write to --download= file: %s\n", safe_strerror(err));
+            return sg_convert_errno(err);
+        }
+        bp += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* Reads the buffer into op->dl_fname with up to op->parallel READ BUFFER
+ * commands of op->chunk bytes in flight, sharing op->sg_fd. Chunks are
+ * written to the file in order as each one is collected. Returns 0 or an
+ * exit status. */
+static int
+download_buffer(const struct opts_t * op)
+{
+    bool to_stdout = (0 == strcmp(op->dl_fname, "-"));
+    int k, n, res, chunk, num_q, head, tail;
+    int align = 1;
+    int fd = -1;
+    int ret = 0;
+    uint64_t size = 0;
+    uint64_t total, issued, written;
+    uint64_t num_cmds = 0;
+    struct dl_slot_t * sp;
+    struct dl_slot_t * slots = NULL;
+
+    if ((MODE_ERR_HISTORY == op->rb_mode) &&
+        ((op->rb_id < 0x10) || (op->rb_id > 0xef))) {
+        pr2serr("--download= of error history needs a Buffer ID from 0x10 "
+                "to 0xef\n");
+        return SG_LIB_SYNTAX_ERROR;
+    } else if ((MODE_ERR_HISTORY != op->rb_mode) &&
+               (MODE_DATA != op->rb_mode) && (MODE_VENDOR != op->rb_mode)) {
+        pr2serr("--download= needs the data, vendor or err_hist mode\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    ret = dl_buffer_size(op, &size, &align);
+    if (ret)
+        return ret;
+    if (op->rb_offset >= size) {
+        pr2serr("--offset=%" PRIu64 " is not within the buffer of %" PRIu64
+                " bytes\n", op->rb_offset, size);
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    total = size - op->rb_offset;
+    if (op->rb_len_given && ((uint64_t)op->rb_len < total))
+        total = op->rb_len;
+    chunk = op->chunk ? op->chunk : DEF_DL_CHUNK;
+    if ((! op->do_long) && (chunk > 0xffffff))
+        chunk = 0xffffff;
+    if (align < 0) {            /* single READ BUFFER from offset 0 */
+        if ((op->rb_offset > 0) || (total > (uint64_t)chunk)) {
+            pr2serr("buffer does not allow offsets (OFFSET BOUNDARY 0xff), "
+                    "--chunk=%" PRIu64 " and no --offset= needed\n", total);
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        chunk = (int)total;
+    } else {
+        if (op->rb_offset % align) {
+            pr2serr("--offset= must be a multiple of the buffer offset "
+                    "alignment (%d)\n", align);
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        if (chunk >= align)
+            chunk -= chunk % align;
+        else
+            chunk = align;
+    }
+    if ((! op->do_long) && ((op->rb_offset + total - 1) > 0xffffff)) {
+        pr2serr("buffer offsets too large for READ BUFFER(10), try "
+                "--16\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    num_q = (int)((total + chunk - 1) / chunk);
+    if (num_q > op->parallel)
+        num_q = op->parallel;
+    if (op->verbose)
+        pr2serr("download %" PRIu64 " bytes from offset %" PRIu64 " of a "
+                "%" PRIu64 " byte buffer, %d byte chunks, %d in flight\n",
+                total, op->rb_offset, size, chunk, num_q);
+
+    if (to_stdout) {
+        fd = STDOUT_FILENO;
+        if (sg_set_binary_mode(fd) < 0)
+            perror("sg_set_binary_mode");
+    } else {
+        fd = open(op->dl_fname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            res = errno;
+            pr2serr("could not open %s for writing: %s\n", op->dl_fname,
+                    safe_strerror(res));
+            return sg_convert_errno(res);
+        }
+        if (sg_set_binary_mode(fd) < 0)
+            perror("sg_set_binary_mode");
+    }
+    slots = (struct dl_slot_t *)calloc(num_q, sizeof(*slots));
+    if (NULL == slots) {
+        ret = sg_convert_errno(ENOMEM);
+        goto fini;
+    }
+    for (k = 0; k < num_q; ++k) {
+        slots[k].o = *op;
+        slots[k].buf = (uint8_t *)sg_memalign(chunk, 0, &slots[k].free_buf,
+                                              false);
+        if (NULL == slots[k].buf) {
+            pr2serr("unable to allocate %d bytes on the heap\n", chunk);
+            ret = sg_convert_errno(ENOMEM);
+            goto fini;
+        }
+    }
+    /* ring of num_q slots: issue at tail, collect (in offset order) at
+     * head, issue the next chunk into the slot just collected */
+    issued = 0;
+    written = 0;
+    for (tail = 0; (tail < num_q) && (issued < total); ++tail) {
+        n = ((total - issued) < (uint64_t)chunk) ? (int)(total - issued) :
+                                                   chunk;
+        dl_issue(slots + tail, op->rb_offset + issued, n);
+        issued += n;
+        ++num_cmds;
+    }
+    for (head = 0; written < issued; head = (head + 1) % num_q) {
+        sp = slots + head;
+        dl_collect(sp);
+        if (sp->res) {
+            char b[80];
+
+            ret = sp->res;
+            if (ret > 0) {
+                sg_get_category_sense_str(ret, sizeof(b), b, op->verbose);
+                pr2serr("Read buffer(%d) at offset %" PRIu64 " failed: %s\n",
+                        (op->do_long ? 16 : 10), sp->o.rb_offset, b);
+            }
+            break;
+        }
+        n = sp->o.rb_len - ((sp->resid > 0) ? sp->resid : 0);
+        ret = dl_write(fd, sp->buf, n);
+        if (ret)
+            break;
+        written += n;
+        if (n < sp->o.rb_len) {         /* short: the buffer ended early */
+            if (op->verbose)
+                pr2serr("short read at offset %" PRIu64 ", stopping\n",
+                        sp->o.rb_offset);
+            break;
+        }
+        if (issued < total) {
+            n = ((total - issued) < (uint64_t)chunk) ?
+                (int)(total - issued) : chunk;
+            dl_issue(sp, op->rb_offset + issued, n);
+            issued += n;
+            ++num_cmds;
+        }
+        if (op->verbose > 1)
+            pr2serr("  %" PRIu64 " of %" PRIu64 " bytes\n", written, total);
+    }
+    if ((0 == ret) && (! to_stdout))
+        printf("Read %" PRIu64 " bytes into %s with %" PRIu64 " READ "
+               "BUFFER(%d) command%s\n", written, op->dl_fname, num_cmds,
+               (op->do_long ? 16 : 10), ((1 == num_cmds) ? "" : "s"));
+fini:
+    if (slots) {
+        for (k = 0; k < num_q; ++k) {
+            dl_collect(slots + k);      /* any still in flight */
+            free(slots[k].free_buf);
+        }
+        free(slots);
+    }
+    if ((fd >= 0) && (! to_stdout))
+        close(fd);
+    return ret;
+}
+
 static void
 dStrRaw(const uint8_t * str, int len)
 {
@@ -511,16 +847,27 @@ main(int argc, char * argv[])
 
     op->sg_fd = -1;
     op->rb_len = DEF_RESPONSE_LEN;
+    op->parallel = DEF_DL_PARALLEL;
 
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "e:hHi:I:l:Lm:No:rRS:vV", long_options,
-                        &option_index);
+        c = getopt_long(argc, argv, "c:D:e:hHi:I:l:Lm:No:P:rRS:vV",
+                        long_options, &option_index);
         if (c == -1)
             break;
 
         switch (c) {
+        case 'c':
+            op->chunk = sg_get_num(optarg);
+            if (op->chunk < 1) {
+                pr2serr("bad argument to '--chunk='\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case 'D':
+            op->dl_fname = optarg;
+            break;
         case 'e':
             if (op->rb_mode_given && (MODE_ERR_HISTORY != op->rb_mode)) {
                 pr2serr("mode incompatible with --eh_code= option\n");
@@ -565,10 +912,6 @@ main(int argc, char * argv[])
                 pr2serr("bad argument to '--length'\n");
                 return SG_LIB_SYNTAX_ERROR;
              }
-             if (op->rb_len > 0xffffff) {
-                pr2serr("argument to '--length' must be <= 0xffffff\n");
-                return SG_LIB_SYNTAX_ERROR;
-             }
              op->rb_len_given = true;
              break;
         case 'L':
@@ -630,6 +973,11 @@ main(int argc, char * argv[])
             }
             op->rb_offset = ll;
             break;
+        case 'P':
+            op->parallel = sg_par_get_num(optarg, 1, MAX_DL_PARALLEL);
+            if (op->parallel < 0)
+                return SG_LIB_SYNTAX_ERROR;
+            break;
         case 'r':
             op->do_raw = true;
             break;
@@ -698,6 +1046,14 @@ main(int argc, char * argv[])
         pr2serr("version: %s\n", version_str);
         return 0;
     }
+    if ((op->rb_len > 0xffffff) && (NULL == op->dl_fname)) {
+        pr2serr("argument to '--length' must be <= 0xffffff\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if (op->dl_fname && op->inhex_name) {
+        pr2serr("--download= and --inhex= options contradict\n");
+        return SG_LIB_CONTRADICT;
+    }
     if ((MODE_ERR_HISTORY == op->rb_mode) && (NULL == op->inhex_name)) {
         if (! op->rb_len_given)
             op->rb_len = 64;
@@ -733,7 +1089,7 @@ main(int argc, char * argv[])
         return SG_LIB_SYNTAX_ERROR;
     }
 
-    len = op->rb_len ? op->rb_len : 8;
+    len = op->dl_fname ? 8 : (op->rb_len ? op->rb_len : 8);
     resp = (uint8_t *)sg_memalign(len, 0, &free_resp, false);
     if (NULL == resp) {
         pr2serr("unable to allocate %d bytes on the heap\n", len);
@@ -766,6 +1122,10 @@ main(int argc, char * argv[])
         ret = sg_convert_errno(-op->sg_fd);
         goto fini;
     }
+    if (op->dl_fname) {
+        ret = download_buffer(op);
+        goto fini;
+    }
 
     if (op->do_long)
         res = sg_ll_read_buffer_16(resp, &resid, true, op);
@@ -1,7 +1,7 @@
 /* This code is does a SCSI READ CAPACITY command on the given device
  * and outputs the result.
  *
- * Copyright (C) 1999 - 2023 D. Gilbert
+ * Copyright (C) 1999 - 2026 D. Gilbert
  * This program is free software; you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
  * the Free Software Foundation; either version 2, or (at your option)
@@ -35,9 +35,10 @@
 #include "sg_unaligned.h"
 #include "sg_pr2serr.h"
 #include "sg_json_sg_lib.h"
+#include "sg_rcache.h"
 
 
-static const char * version_str = "4.13 20230519";
+static const char * version_str = "4.14 20261014";
 
 static const char * my_name = "sg_readcap: ";
 
@@ -46,6 +47,7 @@ static const char * my_name = "sg_readcap: ";
 
 static struct option long_options[] = {
     {"brief", no_argument, 0, 'b'},
+    {"cache", required_argument, 0, 'C'},
     {"help", no_argument, 0, 'h'},
     {"hex", no_argument, 0, 'H'},
     {"inhex", required_argument, 0, 'i'},
@@ -83,6 +85,7 @@ struct opts_t {
     int do_lba;
     int verbose;
     uint64_t llba;
+    const char * cache_dir;
     const char * device_name;
     const char * inhex_fn;
     const char * json_arg;
@@ -100,8 +103,9 @@ static const char * lbppbe_s = "Logical blocks per physical block exponent";
 static void
 usage()
 {
-    pr2serr("Usage: sg_readcap [--10] [--16] [--brief] [--help] [--hex] "
-            "[--inhex-FN]\n"
+    pr2serr("Usage: sg_readcap [--10] [--16] [--brief] [--cache=DIR] "
+            "[--help] [--hex]\n"
+            "                  [--inhex-FN]\n"
             "                  [--json[=JO]] [--js-file=JFN] [--lba=LBA] "
             "[--long] [--pmi]\n"
             "                  [--raw] [--readonly] [--verbose] [--version] "
@@ -114,6 +118,9 @@ usage()
             "--long)\n"
             "    --brief|-b      brief, two hex numbers: number of blocks "
             "and block size\n"
+            "    --cache=DIR|-C DIR    reuse responses cached in directory "
+            "DIR while\n"
+            "                          the DEVICE reports no unit attention\n"
             "    --help|-h       print this usage message and exit\n"
             "    --hex|-H        output response in hexadecimal to stdout\n"
             "    --inhex=FN|-i FN    contents of file FN treated as hex "
@@ -261,7 +268,7 @@ new_parse_cmd_line(struct opts_t * op, int argc, char * argv[])
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "^16bhHi:j::J:lL:NOprRTvVz", long_options,
+        c = getopt_long(argc, argv, "^16bC:hHi:j::J:lL:NOprRTvVz", long_options,
                         &option_index);
         if (c == -1)
             break;
@@ -277,6 +284,9 @@ new_parse_cmd_line(struct opts_t * op, int argc, char * argv[])
         case 'b':
             op->do_brief = true;
             break;
+        case 'C':
+            op->cache_dir = optarg;
+            break;
         case 'h':
         case '?':
             ++op->do_help;
@@ -675,6 +685,9 @@ main(int argc, char * argv[])
             ret = sg_convert_errno(-sg_fd);
             goto fini;
         }
+        if (op->cache_dir)
+            sg_rcache_open(op->cache_dir, op->device_name, sg_fd,
+                           op->verbose);
     }
 
     if (! op->do_long) {
@@ -766,6 +779,9 @@ main(int argc, char * argv[])
                 ret = sg_convert_errno(-sg_fd);
                 goto fini;
             }
+            if (op->cache_dir)
+                sg_rcache_open(op->cache_dir, op->device_name, sg_fd,
+                               op->verbose);
             if (op->verbose)
                 pr2serr("READ CAPACITY (10) not supported, trying READ "
                         "CAPACITY (16)\n");
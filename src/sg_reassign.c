@@ -9,6 +9,7 @@
 
 #include <unistd.h>
 #include <fcntl.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
@@ -25,9 +26,13 @@
 #endif
 
 #include "sg_lib.h"
+#include "sg_pt.h"
 #include "sg_cmds_basic.h"
 #include "sg_cmds_extra.h"
+#include "sg_dd_eng.h"
+#include "sg_json_sg_lib.h"
 #include "sg_unaligned.h"
+#include "sg_par.h"
 #include "sg_pr2serr.h"
 
 /* A utility program originally written for the Linux OS SCSI subsystem.
@@ -37,13 +42,23 @@
  * a disk) to a new physical location. The previous contents is
  * recoverable then it is written to the remapped lba otherwise
  * vendor specific data is written.
+ *
+ * With --remediate it takes a list of suspect lbas and one or more
+ * devices: the lbas that fail VERIFY are salvaged (READ LONG) if possible,
+ * reassigned in batches and their salvaged contents written back.
  */
 
-static const char * version_str = "1.28 20230519";
+static const char * version_str = "1.29 20261015";
 
 #define DEF_DEFECT_LIST_FORMAT 4        /* bytes from index */
 
 #define MAX_NUM_ADDR 1024
+#define MAX_REM_ADDR 65536      /* with --remediate */
+#define MAX_REM_DEVS 256
+#define MAX_ECC_LEN 1024        /* READ LONG bytes beyond the block */
+
+#define SENSE_BUFF_LEN 64
+#define DEF_TIMEOUT_SECS 60
 
 #ifndef UINT32_MAX
 #define UINT32_MAX ((uint32_t)-1)
@@ -52,13 +67,21 @@ static const char * version_str = "1.28 20230519";
 
 static struct option long_options[] = {
         {"address", required_argument, 0, 'a'},
+        {"batch", required_argument, 0, 'b'},
         {"dummy", no_argument, 0, 'd'},
         {"eight", required_argument, 0, 'e'},
+        {"force", no_argument, 0, 'f'},
         {"grown", no_argument, 0, 'g'},
         {"help", no_argument, 0, 'h'},
         {"hex", no_argument, 0, 'H'},
+        {"json", optional_argument, 0, '^'},    /* short option is '-j' */
+        {"js-file", required_argument, 0, 'J'},
+        {"js_file", required_argument, 0, 'J'},
         {"longlist", required_argument, 0, 'l'},
+        {"no-salvage", no_argument, 0, 'N'},
+        {"no_salvage", no_argument, 0, 'N'},
         {"primary", no_argument, 0, 'p'},
+        {"remediate", no_argument, 0, 'R'},
         {"verbose", no_argument, 0, 'v'},
         {"version", no_argument, 0, 'V'},
         {0, 0, 0, 0},
@@ -72,6 +95,11 @@ usage()
             "                   [--help] [--hex] [--longlist=0|1] "
             "[--primary] [--verbose]\n"
             "                   [--version] DEVICE\n"
+            "       sg_reassign --remediate --address=A,A... [--batch=BN] "
+            "[--dummy]\n"
+            "                   [--force] [--json[=JO]] [--js-file=JFN] "
+            "[--no-salvage]\n"
+            "                   [--verbose] DEVICE [DEVICE...]\n"
             "  where:\n"
             "    --address=A,A...|-a A,A...    comma separated logical block "
             "addresses\n"
@@ -79,6 +107,12 @@ usage()
             "decimal\n"
             "    --address=-|-a -    read stdin for logical block "
             "addresses\n"
+            "    --address=@FN|-a @FN    read file FN for logical block "
+            "addresses\n"
+            "    --batch=BN|-b BN    with --remediate: at most BN lbas per "
+            "REASSIGN\n"
+            "                        BLOCKS command (def: 0 -> all in "
+            "one)\n"
             "    --dummy|-d          prepare but do not execute REASSIGN "
             "BLOCKS command\n"
             "    --eight=0|1\n"
@@ -86,17 +120,33 @@ usage()
             "when 1,\n"
             "                        four byte (32 bit) lbas when 0 "
             "(def)\n"
+            "    --force|-f          with --remediate: reassign every lba, "
+            "no VERIFY\n"
             "    --grown|-g          fetch grown defect list length, "
             "don't reassign\n"
             "    --help|-h           print out usage message\n"
             "    --hex|-H            print response in hex (for '-g' or "
             "'-p')\n"
+            "    --json[=JO]|-j[=JO]    output --remediate report in JSON "
+            "instead of\n"
+            "                           plain text. Use --json=? for "
+            "JSON help\n"
+            "    --js-file=JFN|-J JFN    JFN is a filename to which JSON "
+            "output is\n"
+            "                            written (def: stdout); truncates "
+            "then writes\n"
             "    --longlist=0|1\n"
             "       -l 0|1           use 4 byte list length when 1, safe to "
             "ignore\n"
             "                        (def: 0 (2 byte list length))\n"
+            "    --no-salvage|-N     with --remediate: don't READ LONG bad "
+            "lbas\n"
             "    --primary|-p        fetch primary defect list length, "
             "don't reassign\n"
+            "    --remediate|-R      verify, salvage then reassign bad lbas "
+            "and restore\n"
+            "                        their contents, on each DEVICE "
+            "concurrently\n"
             "    --verbose|-v        increase verbosity\n"
             "    --version|-V        print version string and exit\n\n"
             "Perform a SCSI REASSIGN BLOCKS command (or READ DEFECT LIST)\n");
@@ -124,12 +174,21 @@ build_lba_arr(const char * inp, uint64_t * lba_arr,
     in_len = strlen(inp);
     if (0 == in_len)
         *lba_arr_len = 0;
-    if ('-' == inp[0]) {        /* read from stdin */
+    if (('-' == inp[0]) || ('@' == inp[0])) {   /* read stdin or file */
         char line[1024];
         int off = 0;
+        FILE * fp = stdin;
 
-        for (j = 0; j < 512; ++j) {
-            if (NULL == fgets(line, sizeof(line), stdin))
+        if ('@' == inp[0]) {
+            fp = fopen(inp + 1, "r");
+            if (NULL == fp) {
+                pr2serr("%s: unable to open %s: %s\n", __func__, inp + 1,
+                        safe_strerror(errno));
+                return SG_LIB_FILE_ERROR;
+            }
+        }
+        for (j = 0; ; ++j) {
+            if (NULL == fgets(line, sizeof(line), fp))
                 break;
             // could improve with carry_over logic if sizeof(line) too small
             in_len = strlen(line);
@@ -153,6 +212,8 @@ build_lba_arr(const char * inp, uint64_t * lba_arr,
             if ((k < in_len) && ('#' != lcp[k])) {
                 pr2serr("%s: syntax error at line %d, pos %d\n", __func__,
                         j + 1, m + k + 1);
+                if (stdin != fp)
+                    fclose(fp);
                 return SG_LIB_SYNTAX_ERROR;
             }
             for (k = 0; k < 1024; ++k) {
@@ -160,6 +221,8 @@ build_lba_arr(const char * inp, uint64_t * lba_arr,
                 if (-1 != ll) {
                     if ((off + k) >= max_arr_len) {
                         pr2serr("%s: array length exceeded\n", __func__);
+                        if (stdin != fp)
+                            fclose(fp);
                         return SG_LIB_SYNTAX_ERROR;
                     }
                     lba_arr[off + k] = (uint64_t)ll;
@@ -176,11 +239,15 @@ build_lba_arr(const char * inp, uint64_t * lba_arr,
                     }
                     pr2serr("%s: error in line %d, at pos %d\n", __func__,
                             j + 1, (int)(lcp - line + 1));
+                    if (stdin != fp)
+                        fclose(fp);
                     return SG_LIB_SYNTAX_ERROR;
                 }
             }
             off += (k + 1);
         }
+        if (stdin != fp)
+            fclose(fp);
         *lba_arr_len = off;
     } else {        /* list of numbers (default decimal) on command line */
         k = strspn(inp, "0123456789aAbBcCdDeEfFhHxX, ");
@@ -216,6 +283,477 @@ build_lba_arr(const char * inp, uint64_t * lba_arr,
     return 0;
 }
 
+/* Remediation (--remediate): each DEVICE is handled by its own thread (when
+ * available). Each listed LBA is first checked with VERIFY(16) and those
+ * that verify are left alone. The contents of the others is read, if
+ * possible, with READ LONG(16) with the CORRCT bit set. Then the bad LBAs
+ * are reassigned with as few REASSIGN BLOCKS commands as the device will
+ * take and lastly any contents that was salvaged is written back. */
+
+struct rem_opts {
+    bool dummy;
+    bool eight;
+    bool eight_given;
+    bool force;         /* reassign without VERIFY first */
+    bool longlist;
+    bool longlist_given;
+    bool no_salvage;
+    int batch;          /* LBAs per REASSIGN BLOCKS, 0 -> all */
+    int verbose;
+};
+
+struct rem_lba {
+    uint64_t lba;
+    int verify_cat;     /* -1: not verified, 0: good, else SG_LIB_CAT_* */
+    int reassign_cat;   /* -1: not attempted */
+    bool salvaged;      /* READ LONG returned its (corrected) contents */
+    bool restored;      /* salvaged contents written back */
+    uint8_t * salvp;    /* blk_sz bytes when salvaged */
+};
+
+struct rem_dev {
+    const char * dname;
+    const struct rem_opts * op;
+    int sg_fd;
+    int blk_sz;
+    int64_t num_blks;
+    int glist_before;   /* grown defect list elements, -1: unknown */
+    int glist_after;
+    int num_reassign_cmds;
+    int ret;
+    int num_lba;
+    struct rem_lba * la;
+};
+
+/* Returns the number of elements in the grown defect list or -1 */
+static int
+rem_glist_count(int sg_fd, int verbose)
+{
+    int res, div;
+    uint8_t b[4];
+
+    memset(b, 0, sizeof(b));
+    res = sg_ll_read_defect10(sg_fd, false /* primary */, true /* grown */,
+                              DEF_DEFECT_LIST_FORMAT, b, sizeof(b), false,
+                              verbose);
+    if (res || (0 == (b[1] & 0x8)))
+        return -1;
+    switch (b[1] & 0x7) {
+    case 0:
+        div = 4;
+        break;
+    case 1:
+    case 2:
+    case 3:
+    case 4:
+    case 5:
+        div = 8;
+        break;
+    default:
+        return -1;
+    }
+    return sg_get_unaligned_be16(b + 2) / div;
+}
+
+/* READ LONG(16) of lba with corrections applied. The transfer length is
+ * first the logical block size; if the device says that is wrong it is
+ * retried once with the length it wants. On success keeps the first blk_sz
+ * bytes. */
+static void
+rem_salvage(struct rem_dev * dp, struct rem_lba * lp)
+{
+    int res, offset, xfer_len;
+    int vb = dp->op->verbose;
+    uint8_t * bp;
+
+    xfer_len = dp->blk_sz;
+    bp = (uint8_t *)calloc(1, xfer_len);
+    if (NULL == bp)
+        return;
+    res = sg_ll_read_long16(dp->sg_fd, false, true /* correct */, lp->lba,
+                            bp, xfer_len, &offset, false, vb);
+    if ((SG_LIB_CAT_ILLEGAL_REQ_WITH_INFO == res) && (offset < 0) &&
+        ((xfer_len - offset) <= (dp->blk_sz + MAX_ECC_LEN))) {
+        uint8_t * b2p;
+
+        xfer_len -= offset;
+        if (vb > 1)
+            pr2serr("%s: lba=0x%" PRIx64 ": READ LONG wants %d bytes\n",
+                    dp->dname, lp->lba, xfer_len);
+        b2p = (uint8_t *)realloc(bp, xfer_len);
+        if (NULL == b2p) {
+            free(bp);
+            return;
+        }
+        bp = b2p;
+        res = sg_ll_read_long16(dp->sg_fd, false, true, lp->lba, bp,
+                                xfer_len, &offset, false, vb);
+    }
+    if (res) {
+        if (vb) {
+            char b[80];
+
+            sg_get_category_sense_str(res, sizeof(b), b, vb);
+            pr2serr("%s: lba=0x%" PRIx64 ": READ LONG: %s\n", dp->dname,
+                    lp->lba, b);
+        }
+        free(bp);
+        return;
+    }
+    lp->salvaged = true;
+    lp->salvp = bp;     /* logical block data precedes the ECC bytes */
+}
+
+/* Writes the salvaged contents of lp back with WRITE(16). Returns 0 or a
+ * SG_LIB_CAT_* value */
+static int
+rem_restore(struct rem_dev * dp, struct rem_lba * lp)
+{
+    int res, sense_cat, ret;
+    int vb = dp->op->verbose;
+    struct sg_pt_base * ptvp;
+    uint8_t cdb[16];
+    uint8_t sense_b[SENSE_BUFF_LEN] SG_C_CPP_ZERO_INIT;
+
+    if (sg_dde_build_rw_cdb(cdb, sizeof(cdb), 1, (int64_t)lp->lba, true,
+                            false, false, dp->dname))
+        return SG_LIB_SYNTAX_ERROR;
+    ptvp = construct_scsi_pt_obj();
+    if (NULL == ptvp)
+        return sg_convert_errno(ENOMEM);
+    set_scsi_pt_cdb(ptvp, cdb, sizeof(cdb));
+    set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
+    set_scsi_pt_data_out(ptvp, lp->salvp, dp->blk_sz);
+    res = do_scsi_pt(ptvp, dp->sg_fd, DEF_TIMEOUT_SECS, vb);
+    ret = sg_cmds_process_resp(ptvp, "Write(16)", res, false, vb,
+                               &sense_cat);
+    if (-1 == ret) {
+        if (get_scsi_pt_transport_err(ptvp))
+            ret = SG_LIB_TRANSPORT_ERROR;
+        else
+            ret = sg_convert_errno(get_scsi_pt_os_err(ptvp));
+    } else if (-2 == ret) {
+        switch (sense_cat) {
+        case SG_LIB_CAT_RECOVERED:
+        case SG_LIB_CAT_NO_SENSE:
+            ret = 0;
+            break;
+        default:
+            ret = sense_cat;
+            break;
+        }
+    } else
+        ret = 0;
+    destruct_scsi_pt_obj(ptvp);
+    return ret;
+}
+
+/* One REASSIGN BLOCKS command for the n LBAs at lpp[0..n-1]. Returns 0 or
+ * a SG_LIB_CAT_* value */
+static int
+rem_reassign(struct rem_dev * dp, struct rem_lba ** lpp, int n,
+             uint8_t * param_arr)
+{
+    const struct rem_opts * op = dp->op;
+    bool eight = op->eight;
+    bool longlist = op->longlist;
+    int k, j, res;
+
+    if (! op->eight_given) {
+        for (j = 0; j < n; ++j) {
+            if (lpp[j]->lba >= UINT32_MAX) {
+                eight = true;
+                break;
+            }
+        }
+    }
+    k = 4;
+    for (j = 0; j < n; ++j) {
+        if (eight) {
+            sg_put_unaligned_be64(lpp[j]->lba, param_arr + k);
+            k += 8;
+        } else {
+            sg_put_unaligned_be32((uint32_t)lpp[j]->lba, param_arr + k);
+            k += 4;
+        }
+    }
+    if ((! op->longlist_given) && ((k - 4) > 0xffff))
+        longlist = true;
+    memset(param_arr, 0, 4);
+    if (longlist)
+        sg_put_unaligned_be32((uint32_t)(k - 4), param_arr + 0);
+    else
+        sg_put_unaligned_be16((uint16_t)(k - 4), param_arr + 2);
+    if (op->dummy) {
+        if (op->verbose)
+            pr2serr("%s: dummy: would reassign %d LBAs with one command\n",
+                    dp->dname, n);
+        return 0;
+    }
+    ++dp->num_reassign_cmds;
+    res = sg_ll_reassign_blocks(dp->sg_fd, eight, longlist, param_arr, k,
+                                false, op->verbose);
+    if (res && op->verbose) {
+        char b[80];
+
+        sg_get_category_sense_str(res, sizeof(b), b, op->verbose);
+        pr2serr("%s: REASSIGN BLOCKS of %d LBAs: %s\n", dp->dname, n, b);
+    }
+    return res;
+}
+
+/* Remediates the k-th DEVICE, ctx being the array of them. Called by
+ * sg_par_each(). */
+static int
+rem_dev_run(int64_t k_dev, void * ctx)
+{
+    struct rem_dev * dp = (struct rem_dev *)ctx + k_dev;
+    const struct rem_opts * op = dp->op;
+    bool verify = ! op->force;
+    int k, j, n, bn, res, num_bad;
+    int vb = op->verbose;
+    struct rem_lba * lp;
+    struct rem_lba ** bad_arr = NULL;
+    uint8_t * param_arr = NULL;
+    char b[80];
+
+    dp->glist_before = -1;
+    dp->glist_after = -1;
+    dp->sg_fd = sg_cmds_open_device(dp->dname, false /* rw */, vb);
+    if (dp->sg_fd < 0) {
+        pr2serr("%s: open error: %s\n", dp->dname,
+                safe_strerror(-dp->sg_fd));
+        dp->ret = sg_convert_errno(-dp->sg_fd);
+        return 0;
+    }
+    res = sg_dde_read_capacity(dp->sg_fd, &dp->num_blks, &dp->blk_sz, false,
+                               vb);
+    if (res) {
+        sg_get_category_sense_str(res, sizeof(b), b, vb);
+        pr2serr("%s: READ CAPACITY: %s\n", dp->dname, b);
+        dp->ret = res;
+        goto fini;
+    }
+    dp->glist_before = rem_glist_count(dp->sg_fd, vb);
+    bad_arr = (struct rem_lba **)calloc(dp->num_lba, sizeof(*bad_arr));
+    param_arr = (uint8_t *)malloc(4 + ((size_t)dp->num_lba * 8));
+    if ((NULL == bad_arr) || (NULL == param_arr)) {
+        dp->ret = sg_convert_errno(ENOMEM);
+        goto fini;
+    }
+    for (num_bad = 0, k = 0; k < dp->num_lba; ++k) {
+        lp = dp->la + k;
+        if (lp->lba >= (uint64_t)dp->num_blks) {
+            lp->verify_cat = SG_LIB_LBA_OUT_OF_RANGE;
+            continue;
+        }
+        if (verify) {
+            res = sg_ll_verify16(dp->sg_fd, 0, false, 0 /* bytchk */,
+                                 lp->lba, 1, 0, NULL, 0, NULL, false, vb);
+            if (SG_LIB_CAT_INVALID_OP == res) {
+                pr2serr("%s: VERIFY(16) not supported, so reassign all "
+                        "listed LBAs\n", dp->dname);
+                verify = false;
+            } else {
+                lp->verify_cat = res;
+                if (0 == res)
+                    continue;
+            }
+        }
+        if (! op->no_salvage)
+            rem_salvage(dp, lp);
+        bad_arr[num_bad++] = lp;
+    }
+    bn = (op->batch > 0) ? op->batch : num_bad;
+    for (k = 0; k < num_bad; k += n) {
+        n = ((num_bad - k) < bn) ? (num_bad - k) : bn;
+        res = rem_reassign(dp, bad_arr + k, n, param_arr);
+        if ((SG_LIB_CAT_ILLEGAL_REQ == res) && (n > 1)) {
+            /* perhaps the list is too long for the device, one at a time */
+            if (vb)
+                pr2serr("%s: retry those %d LBAs one at a time\n",
+                        dp->dname, n);
+            for (j = 0; j < n; ++j)
+                bad_arr[k + j]->reassign_cat =
+                        rem_reassign(dp, bad_arr + k + j, 1, param_arr);
+        } else if (! op->dummy) {
+            for (j = 0; j < n; ++j)
+                bad_arr[k + j]->reassign_cat = res;
+        }
+    }
+    for (k = 0; k < num_bad; ++k) {
+        lp = bad_arr[k];
+        if (lp->reassign_cat > 0) {
+            if (0 == dp->ret)
+                dp->ret = lp->reassign_cat;
+        } else if ((0 == lp->reassign_cat) && lp->salvaged) {
+            res = rem_restore(dp, lp);
+            if (0 == res)
+                lp->restored = true;
+            else if (vb) {
+                sg_get_category_sense_str(res, sizeof(b), b, vb);
+                pr2serr("%s: lba=0x%" PRIx64 ": WRITE(16): %s\n", dp->dname,
+                        lp->lba, b);
+            }
+        }
+    }
+    if (num_bad > 0)
+        dp->glist_after = rem_glist_count(dp->sg_fd, vb);
+    else
+        dp->glist_after = dp->glist_before;
+fini:
+    free(param_arr);
+    free(bad_arr);
+    res = sg_cmds_close_device(dp->sg_fd);
+    if ((res < 0) && (0 == dp->ret))
+        dp->ret = sg_convert_errno(-res);
+    return 0;
+}
+
+static const char *
+rem_lba_state(const struct rem_lba * lp)
+{
+    if (SG_LIB_LBA_OUT_OF_RANGE == lp->verify_cat)
+        return "out of range";
+    if (0 == lp->verify_cat)
+        return "good";
+    if (lp->reassign_cat < 0)
+        return "not reassigned";
+    if (lp->reassign_cat > 0)
+        return "reassign failed";
+    if (lp->restored)
+        return "reassigned, contents restored";
+    if (lp->salvaged)
+        return "reassigned, restore failed";
+    return "reassigned";
+}
+
+static void
+rem_report(const struct rem_dev * dp, sgj_state * jsp, sgj_opaque_p jap)
+{
+    bool bad;
+    int k, n_good, n_oor, n_reas, n_fail, n_rest;
+    const struct rem_lba * lp;
+    sgj_opaque_p jop, jo2p, ja2p;
+    char b[80];
+
+    jop = sgj_new_unattached_object_r(jsp);
+    sgj_js_nv_s(jsp, jop, "device_name", dp->dname);
+    if (0 == dp->blk_sz) {      /* open or READ CAPACITY failed */
+        sgj_pr_hr(jsp, "%s: not remediated\n", dp->dname);
+        sgj_js_nv_i(jsp, jop, "exit_status", dp->ret);
+        sgj_js_nv_o(jsp, jap, NULL /* name */, jop);
+        return;
+    }
+    n_good = n_oor = n_reas = n_fail = n_rest = 0;
+    for (k = 0; k < dp->num_lba; ++k) {
+        lp = dp->la + k;
+        if (SG_LIB_LBA_OUT_OF_RANGE == lp->verify_cat)
+            ++n_oor;
+        else if (0 == lp->verify_cat)
+            ++n_good;
+        else if (0 == lp->reassign_cat) {
+            ++n_reas;
+            if (lp->restored)
+                ++n_rest;
+        } else if (lp->reassign_cat > 0)
+            ++n_fail;
+    }
+    sgj_pr_hr(jsp, "%s: %d LBAs: %d good, %d reassigned (%d restored), %d "
+              "failed, %d out of range\n", dp->dname, dp->num_lba, n_good,
+              n_reas, n_rest, n_fail, n_oor);
+    if ((dp->glist_before >= 0) && (dp->glist_after >= 0))
+        sgj_pr_hr(jsp, "  grown defect list: %d elements before, %d "
+                  "after; %d REASSIGN BLOCKS commands\n", dp->glist_before,
+                  dp->glist_after, dp->num_reassign_cmds);
+    sgj_js_nv_i(jsp, jop, "block_size", dp->blk_sz);
+    sgj_js_nv_i(jsp, jop, "lba_count", dp->num_lba);
+    sgj_js_nv_i(jsp, jop, "good_count", n_good);
+    sgj_js_nv_i(jsp, jop, "reassigned_count", n_reas);
+    sgj_js_nv_i(jsp, jop, "restored_count", n_rest);
+    sgj_js_nv_i(jsp, jop, "failed_count", n_fail);
+    sgj_js_nv_i(jsp, jop, "out_of_range_count", n_oor);
+    sgj_js_nv_i(jsp, jop, "reassign_blocks_commands",
+                dp->num_reassign_cmds);
+    sgj_js_nv_i(jsp, jop, "grown_defects_before", dp->glist_before);
+    sgj_js_nv_i(jsp, jop, "grown_defects_after", dp->glist_after);
+    sgj_js_nv_i(jsp, jop, "exit_status", dp->ret);
+    ja2p = sgj_named_subarray_r(jsp, jop, "lba_list");
+    for (k = 0; k < dp->num_lba; ++k) {
+        lp = dp->la + k;
+        bad = (0 != lp->verify_cat);
+        if (bad || (dp->op->verbose > 0)) {
+            if (lp->verify_cat > 0) {
+                sg_get_category_sense_str(lp->verify_cat, sizeof(b), b, 0);
+                sgj_pr_hr(jsp, "  lba=0x%" PRIx64 ": %s [verify: %s]\n",
+                          lp->lba, rem_lba_state(lp), b);
+            } else
+                sgj_pr_hr(jsp, "  lba=0x%" PRIx64 ": %s\n", lp->lba,
+                          rem_lba_state(lp));
+        }
+        jo2p = sgj_new_unattached_object_r(jsp);
+        sgj_js_nv_i(jsp, jo2p, "lba", lp->lba);
+        sgj_js_nv_s(jsp, jo2p, "state", rem_lba_state(lp));
+        sgj_js_nv_i(jsp, jo2p, "verify_category", lp->verify_cat);
+        sgj_js_nv_b(jsp, jo2p, "salvaged", lp->salvaged);
+        sgj_js_nv_b(jsp, jo2p, "restored", lp->restored);
+        sgj_js_nv_i(jsp, jo2p, "reassign_category", lp->reassign_cat);
+        sgj_js_nv_o(jsp, ja2p, NULL /* name */, jo2p);
+    }
+    sgj_js_nv_o(jsp, jap, NULL /* name */, jop);
+}
+
+/* Remediates the num_lba LBAs in lba_arr on each of the num_dev devices,
+ * concurrently when threads are available. Returns 0 or the exit status
+ * of the first device (in command line order) that had a problem. */
+static int
+rem_run(const char ** dev_arr, int num_dev, const uint64_t * lba_arr,
+        int num_lba, const struct rem_opts * op, sgj_state * jsp,
+        sgj_opaque_p jop)
+{
+    int k, j;
+    int ret = 0;
+    struct rem_dev * dev_a;
+    sgj_opaque_p jap;
+
+    dev_a = (struct rem_dev *)calloc(num_dev, sizeof(*dev_a));
+    if (NULL == dev_a)
+        return sg_convert_errno(ENOMEM);
+    for (k = 0; k < num_dev; ++k) {
+        dev_a[k].dname = dev_arr[k];
+        dev_a[k].op = op;
+        dev_a[k].num_lba = num_lba;
+        dev_a[k].la = (struct rem_lba *)calloc(num_lba, sizeof(*dev_a[k].la));
+        if (NULL == dev_a[k].la) {
+            ret = sg_convert_errno(ENOMEM);
+            goto fini;
+        }
+        for (j = 0; j < num_lba; ++j) {
+            dev_a[k].la[j].lba = lba_arr[j];
+            dev_a[k].la[j].verify_cat = -1;
+            dev_a[k].la[j].reassign_cat = -1;
+        }
+    }
+    /* one thread per DEVICE */
+    sg_par_each(num_dev, num_dev, rem_dev_run, dev_a);
+    jap = sgj_named_subarray_r(jsp, jop, "remediation_list");
+    for (k = 0; k < num_dev; ++k) {
+        rem_report(dev_a + k, jsp, jap);
+        if ((0 == ret) && dev_a[k].ret)
+            ret = dev_a[k].ret;
+    }
+fini:
+    for (k = 0; k < num_dev; ++k) {
+        if (dev_a[k].la) {
+            for (j = 0; j < num_lba; ++j)
+                free(dev_a[k].la[j].salvp);
+            free(dev_a[k].la);
+        }
+    }
+    free(dev_a);
+    return ret;
+}
+
 
 int
 main(int argc, char * argv[])
@@ -227,6 +765,8 @@ main(int argc, char * argv[])
     bool longlist = false;
     bool primary = false;
     bool grown = false;
+    bool remediate = false;
+    bool do_json = false;
     bool verbose_given = false;
     bool version_given = false;
     int res, c, num, k, j;
@@ -234,17 +774,28 @@ main(int argc, char * argv[])
     int addr_arr_len = 0;
     int do_hex = 0;
     int verbose = 0;
+    int num_dev = 0;
     const char * device_name = NULL;
-    uint64_t addr_arr[MAX_NUM_ADDR];
+    const char * json_arg = NULL;
+    const char * js_file = NULL;
+    static uint64_t addr_arr[MAX_REM_ADDR];
     uint8_t param_arr[4 + (MAX_NUM_ADDR * 8)];
+    const char * dev_arr[MAX_REM_DEVS];
     char b[80];
     int param_len = 4;
     int ret = 0;
+    struct rem_opts ro;
+    sgj_state * jsp;
+    sgj_opaque_p jop = NULL;
+    sgj_state json_st SG_C_CPP_ZERO_INIT;
+
+    jsp = &json_st;
+    memset(&ro, 0, sizeof(ro));
 
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "a:de:ghHl:pvV", long_options,
+        c = getopt_long(argc, argv, "a:b:de:fghHj::J:l:NpRvV", long_options,
                         &option_index);
         if (c == -1)
             break;
@@ -253,12 +804,19 @@ main(int argc, char * argv[])
         case 'a':
             memset(addr_arr, 0, sizeof(addr_arr));
             if ((res = build_lba_arr(optarg, addr_arr, &addr_arr_len,
-                                     MAX_NUM_ADDR))) {
+                                     MAX_REM_ADDR))) {
                 pr2serr("bad argument to '--address'\n");
                 return res;
             }
             got_addr = true;
             break;
+        case 'b':
+            ro.batch = sg_get_num(optarg);
+            if (ro.batch < 0) {
+                pr2serr("bad argument to '--batch='\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
         case 'd':
             dummy = true;
             break;
@@ -272,6 +830,9 @@ main(int argc, char * argv[])
             }
             eight_given = true;
             break;
+        case 'f':
+            ro.force = true;
+            break;
         case 'g':
             grown = true;
             break;
@@ -282,6 +843,28 @@ main(int argc, char * argv[])
         case 'H':
             ++do_hex;
             break;
+        case 'j':       /* for: -j[=JO] */
+        case '^':       /* for: --json[=JO] */
+            do_json = true;
+            /* Now want '=' to precede all JSON optional arguments */
+            if (optarg) {
+                if ('^' == c) {
+                    json_arg = optarg;
+                    break;
+                } else if ('=' == *optarg) {
+                    json_arg = optarg + 1;
+                    break;
+                }
+                pr2serr("-j expects its optional argument to start with "
+                        "'='\n");
+                return SG_LIB_SYNTAX_ERROR;
+            } else
+                json_arg = NULL;
+            break;
+        case 'J':
+            do_json = true;
+            js_file = optarg;
+            break;
         case 'l':
             num = sscanf(optarg, "%d", &res);
             if ((1 == num) && ((0 == res) || (1 == res)))
@@ -290,10 +873,17 @@ main(int argc, char * argv[])
                 pr2serr("value for '--longlist=' must be 0 or 1\n");
                 return SG_LIB_SYNTAX_ERROR;
             }
+            ro.longlist_given = true;
+            break;
+        case 'N':
+            ro.no_salvage = true;
             break;
         case 'p':
             primary = true;
             break;
+        case 'R':
+            remediate = true;
+            break;
         case 'v':
             verbose_given = true;
             ++verbose;
@@ -307,6 +897,18 @@ main(int argc, char * argv[])
             return SG_LIB_SYNTAX_ERROR;
         }
     }
+    if (remediate) {
+        for (; optind < argc; ++optind) {
+            if (num_dev >= MAX_REM_DEVS) {
+                pr2serr("at most %d DEVICEs with '--remediate'\n",
+                        MAX_REM_DEVS);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            dev_arr[num_dev++] = argv[optind];
+        }
+        if (num_dev > 0)
+            device_name = dev_arr[0];
+    }
     if (optind < argc) {
         if (NULL == device_name) {
             device_name = argv[optind];
@@ -356,6 +958,73 @@ main(int argc, char * argv[])
         usage();
         return SG_LIB_SYNTAX_ERROR;
     }
+    if (remediate) {
+        if (grown || primary) {
+            pr2serr("can't have '--remediate' with '--grown' or "
+                    "'--primary'\n");
+            return SG_LIB_CONTRADICT;
+        }
+        if (do_json) {
+            if (! sgj_init_state(jsp, json_arg)) {
+                int bad_char = jsp->first_bad_char;
+                char e[1500];
+
+                if (bad_char)
+                    pr2serr("bad argument to --json= option, unrecognized "
+                            "character '%c'\n\n", bad_char);
+                sg_json_usage(0, e, sizeof(e));
+                pr2serr("%s", e);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            jop = sgj_start_r("sg_reassign", version_str, argc, argv, jsp);
+        }
+        ro.dummy = dummy;
+        ro.eight = eight;
+        ro.eight_given = eight_given;
+        ro.longlist = longlist;
+        ro.verbose = verbose;
+        if (dummy)
+            pr2serr(">>> dummy: REASSIGN BLOCKS not executed, nothing "
+                    "written\n");
+        ret = rem_run(dev_arr, num_dev, addr_arr, addr_arr_len, &ro, jsp,
+                      jop);
+        ret = (ret >= 0) ? ret : SG_LIB_CAT_OTHER;
+        if (jsp->pr_as_json) {
+            FILE * fp = stdout;
+
+            if (js_file) {
+                if ((1 != strlen(js_file)) || ('-' != js_file[0])) {
+                    fp = fopen(js_file, "w");   /* truncate if exists */
+                    if (NULL == fp) {
+                        int e = errno;
+
+                        pr2serr("unable to open file: %s [%s]\n", js_file,
+                                safe_strerror(e));
+                        ret = sg_convert_errno(e);
+                    }
+                }
+                /* '--js-file=-' will send JSON output to stdout */
+            }
+            if (fp) {
+                const char * estr = NULL;
+
+                if (sg_exit2str(ret, jsp->verbose, sizeof(b), b)) {
+                    if (strlen(b) > 0)
+                        estr = b;
+                }
+                sgj_js2file_estr(jsp, NULL, ret, estr, fp);
+            }
+            if (js_file && fp && (stdout != fp))
+                fclose(fp);
+            sgj_finish(jsp);
+        }
+        return ret;
+    }
+    if (addr_arr_len > MAX_NUM_ADDR) {
+        pr2serr("at most %d addresses without '--remediate'\n",
+                MAX_NUM_ADDR);
+        return SG_LIB_SYNTAX_ERROR;
+    }
     if (got_addr) {
         for (k = 0; k < addr_arr_len; ++k) {
             if (addr_arr[k] >= UINT32_MAX) {
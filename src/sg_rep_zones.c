@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2014-2023 Douglas Gilbert.
+ * Copyright (c) 2014-2026 Douglas Gilbert.
  * All rights reserved.
  * Use of this source code is governed by a BSD-style
  * license that can be found in the BSD_LICENSE file.
@@ -24,14 +24,22 @@
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
+#ifndef SG_LIB_WIN32
+#define SG_RZ_PAGE_THREADS 1    /* --all keeps commands in flight */
+#include <pthread.h>
+#endif
 
 #include "sg_lib.h"
 #include "sg_lib_data.h"
 #include "sg_pt.h"
 #include "sg_cmds_basic.h"
+#include "sg_mpoll.h"
 #include "sg_unaligned.h"
+#include "sg_par.h"
 #include "sg_pr2serr.h"
 #include "sg_json_sg_lib.h"
+#include "sg_zmap.h"
+#include "sg_batch.h"
 
 /* A utility program originally written for the Linux OS SCSI subsystem.
  *
@@ -41,7 +49,7 @@
  * Based on zbc2r12.pdf
  */
 
-static const char * version_str = "1.50 20230518";
+static const char * version_str = "1.56 20261015";
 
 #define MY_NAME "sg_rep_zones"
 
@@ -54,6 +62,7 @@ static const char * version_str = "1.50 20230518";
 #define REPORT_ZONES_DESC_LEN 64
 #define SENSE_BUFF_LEN 64       /* Arbitrary, could be larger */
 #define DEF_PT_TIMEOUT  60      /* 60 seconds */
+#define RZ_PAGE_SLOTS 3         /* one being decoded plus two in flight */
 
 /* Three zone service actions supported by this utility */
 enum zone_report_sa_e {
@@ -63,6 +72,7 @@ enum zone_report_sa_e {
 };
 
 struct opts_t {
+    bool do_all;
     bool do_brief;
     bool do_force;
     bool do_json;
@@ -82,12 +92,16 @@ struct opts_t {
     int do_num;
     int find_zt;        /* negative values: find first not equal to */
     int maxlen;
+    int num_parallel;   /* for --batch=MF, 0 -> number of cpus */
     int reporting_opt;
     int vb;
     uint64_t st_lba;
+    const char * batch_fn;
     const char * in_fn;
     const char * json_arg;
     const char * js_file;
+    const char * zmap_fn;
+    FILE * js_fp;       /* --js-file=JFN opened early when streaming */
     sgj_state json_st;
 };
 
@@ -97,6 +111,8 @@ struct zt_num2abbrev_t {
 };
 
 static struct option long_options[] = {
+    {"all", no_argument, 0, 'a'},
+    {"batch", required_argument, 0, 'B'},
     {"brief", no_argument, 0, 'b'}, /* only header and last descriptor */
     {"domain", no_argument, 0, 'd'},
     {"domains", no_argument, 0, 'd'},
@@ -112,6 +128,7 @@ static struct option long_options[] = {
     {"locator", required_argument, 0, 'l'},
     {"maxlen", required_argument, 0, 'm'},
     {"num", required_argument, 0, 'n'},
+    {"parallel", required_argument, 0, 'P'},
     {"partial", no_argument, 0, 'p'},
     {"raw", no_argument, 0, 'r'},
     {"readonly", no_argument, 0, 'R'},
@@ -124,6 +141,7 @@ static struct option long_options[] = {
     {"verbose", no_argument, 0, 'v'},
     {"version", no_argument, 0, 'V'},
     {"wp", no_argument, 0, 'w'},
+    {"zmap", required_argument, 0, 'Z'},
     {0, 0, 0, 0},
 };
 
@@ -166,19 +184,29 @@ usage(int h)
 {
     if (h > 1) goto h_twoormore;
     pr2serr("Usage: "
-            "sg_rep_zones  [--domain] [--find=ZT] [--force] [--help] "
-            "[--hex]\n"
-            "                     [--inhex=FN] [--json[=JO]] "
-            "[--js_file=JFN]\n"
-            "                     [--locator=LBA] [--maxlen=LEN] "
-            "[--num=NUM]\n"
-            "                     [--partial] [--raw] [--readonly]"
-            "[--realm]\n"
+            "sg_rep_zones  [--all] [--batch=MF] [--domain] [--find=ZT] "
+            "[--force]\n"
+            "                     [--help] [--hex] [--inhex=FN] "
+            "[--json[=JO]]\n"
+            "                     [--js_file=JFN] [--locator=LBA] "
+            "[--maxlen=LEN]\n"
+            "                     [--num=NUM] [--parallel=Q] [--partial] "
+            "[--raw]\n"
+            "                     [--readonly] [--realm]\n"
             "                     [--report=OPT] [--start=LBA] "
             "[--statistics]\n"
             "                     [--verbose] [--version] [--wp] "
-            "DEVICE\n");
+            "[--zmap=ZMF]\n"
+            "                     DEVICE [DEVICE...]\n");
     pr2serr("  where:\n"
+            "    --all|-a           page through all zones from LBA to the "
+            "end using\n"
+            "                       multiple REPORT ZONES commands\n"
+            "    --batch=MF|-B MF    decode each blob named in manifest MF "
+            "(lines of\n"
+            "                        'TAG FN [bin|hex]') as with --inhex=FN, "
+            "output\n"
+            "                        a JSON line for each\n"
             "    --domain|-d        sends a REPORT ZONE DOMAINS command\n"
             "    --find=ZT|-F ZT    find first zone with ZT zone type, "
             "starting at LBA\n"
@@ -206,6 +234,11 @@ usage(int h)
             "                           (def: 0 -> 8192 bytes)\n"
             "    --num=NUM|-n NUM    number of zones to output (def: 0 -> "
             "all)\n"
+            "    --parallel=Q|-P Q    with --batch=MF decode up to Q blobs "
+            "at once;\n"
+            "                         with --statistics review up to Q "
+            "DEVICEs at once\n"
+            "                         (def: 0 -> number of processors)\n"
             "    --partial|-p       sets PARTIAL bit in cdb (def: 0 -> "
             "zone list\n"
             "                       length not altered by allocation length "
@@ -217,10 +250,16 @@ usage(int h)
             "zones)\n"
             "    --start=LBA|-s LBA    report zones from the LBA (def: 0)\n"
             "                          need not be a zone starting LBA\n"
-            "    --statistics|-S    gather statistics by reviewing zones\n"
+            "    --statistics|-S    gather statistics by reviewing zones; "
+            "with more\n"
+            "                       than one DEVICE, a JSON line for each\n"
             "    --verbose|-v       increase verbosity\n"
             "    --version|-V       print version string and exit\n"
-            "    --wp|-w            output write pointer only\n\n"
+            "    --wp|-w            output write pointer only\n"
+            "    --zmap=ZMF|-Z ZMF    build or refresh zone map file ZMF, "
+            "then output\n"
+            "                         zones from it (refresh uses "
+            "--report=OPT)\n\n"
             "Sends a SCSI REPORT ZONES, REPORT ZONE DOMAINS or REPORT REALMS "
             "command.\nBy default sends a REPORT ZONES command. Give help "
             "option twice\n(e.g. '-hh') to see reporting options "
@@ -324,6 +363,251 @@ sg_ll_report_zzz(int sg_fd, enum zone_report_sa_e serv_act, uint64_t zs_lba,
     return ret;
 }
 
+/* Pages through REPORT ZONES responses, each command having the PARTIAL bit
+ * set and a start LBA taken from the last descriptor of the previous
+ * response. While the caller decodes one page, the next page is fetched. If
+ * the Same field says zone lengths are equal and all zones are reported,
+ * the page after that is also fetched, from a predicted start LBA that is
+ * checked (and the page discarded if wrong) when the page before it
+ * arrives. So memory use is RZ_PAGE_SLOTS buffers whatever the zone count.
+ * Commands sent concurrently to the same file descriptor are each handled
+ * by the pass-through independently, so threads sharing sg_fd suffice. */
+struct rz_slot_t {
+    bool busy;          /* command issued, response not yet collected */
+    bool threaded;
+    int res;
+    int resid;
+    uint64_t st_lba;
+    uint8_t * buf;
+    uint8_t * free_buf;
+    struct rz_pager_t * pgp;
+#ifdef SG_RZ_PAGE_THREADS
+    pthread_t thr;
+#endif
+};
+
+struct rz_pager_t {
+    bool done;
+    int sg_fd;
+    int report_opts;
+    int mx_len;
+    int in_len;         /* when sg_fd < 0, the single page is from --inhex */
+    int per_page;       /* descriptors that fit in mx_len */
+    int num_rem;        /* zones still wanted (--num=NUM) */
+    int head;           /* next slot to be collected */
+    int last_num_zd;
+    int vb;
+    uint32_t zn_dnum;   /* zone descriptor number of first in last page */
+    uint32_t num_cmds;
+    uint32_t num_discarded;
+    uint64_t mx_lba;
+    struct rz_slot_t slot[RZ_PAGE_SLOTS];
+};
+
+static void *
+rz_fetch(void * v_sp)
+{
+    struct rz_slot_t * sp = (struct rz_slot_t *)v_sp;
+    struct rz_pager_t * pgp = sp->pgp;
+
+    sp->resid = 0;
+    sp->res = sg_ll_report_zzz(pgp->sg_fd, REPORT_ZONES_SA, sp->st_lba,
+                               true /* set partial */, pgp->report_opts,
+                               sp->buf, pgp->mx_len, &sp->resid, true,
+                               pgp->vb);
+    return NULL;
+}
+
+static void
+rz_issue(struct rz_pager_t * pgp, int s, uint64_t st_lba)
+{
+    struct rz_slot_t * sp = pgp->slot + s;
+
+    sp->st_lba = st_lba;
+    sp->busy = true;
+    sp->threaded = false;
+    ++pgp->num_cmds;
+    if (pgp->vb > 2)
+        pr2serr("%s: slot %d, start LBA 0x%" PRIx64 "\n", __func__, s,
+                st_lba);
+#ifdef SG_RZ_PAGE_THREADS
+    if (0 == pthread_create(&sp->thr, NULL, rz_fetch, sp)) {
+        sp->threaded = true;
+        return;
+    }
+#endif
+    rz_fetch(sp);
+}
+
+static void
+rz_collect(struct rz_pager_t * pgp, int s)
+{
+    struct rz_slot_t * sp = pgp->slot + s;
+
+    if (! sp->busy)
+        return;
+#ifdef SG_RZ_PAGE_THREADS
+    if (sp->threaded)
+        pthread_join(sp->thr, NULL);
+#endif
+    sp->busy = false;
+}
+
+/* A fetched (or in flight) page that turned out not to follow on */
+static void
+rz_discard(struct rz_pager_t * pgp, int s)
+{
+    if (! pgp->slot[s].busy)
+        return;
+    rz_collect(pgp, s);
+    ++pgp->num_discarded;
+    if (pgp->vb > 1)
+        pr2serr("%s: page from LBA 0x%" PRIx64 " not used\n", __func__,
+                pgp->slot[s].st_lba);
+}
+
+/* If sg_fd is negative then in_buf holding in_len bytes is the only page.
+ * Returns 0 on success */
+static int
+rz_pager_init(struct rz_pager_t * pgp, int sg_fd, uint8_t * in_buf,
+              int in_len, const struct opts_t * op)
+{
+    int k;
+
+    memset(pgp, 0, sizeof(*pgp));
+    pgp->sg_fd = sg_fd;
+    pgp->report_opts = op->reporting_opt;
+    pgp->mx_len = op->maxlen;
+    pgp->in_len = in_len;
+    pgp->per_page = (op->maxlen - 64) / REPORT_ZONES_DESC_LEN;
+    pgp->num_rem = op->do_num ? op->do_num : INT_MAX;
+    pgp->vb = op->vb;
+    pgp->head = -1;     /* nothing issued yet */
+    if (sg_fd < 0) {
+        pgp->slot[0].buf = in_buf;
+        return 0;
+    }
+    if (pgp->per_page < 1) {
+        pr2serr("--maxlen=%d too small to hold a zone descriptor\n",
+                op->maxlen);
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    for (k = 0; k < RZ_PAGE_SLOTS; ++k) {
+        pgp->slot[k].pgp = pgp;
+        pgp->slot[k].buf = (uint8_t *)sg_memalign(op->maxlen, 0,
+                                     &pgp->slot[k].free_buf, op->vb > 3);
+        if (NULL == pgp->slot[k].buf) {
+            pr2serr("unable to sg_memalign %d bytes\n", op->maxlen);
+            return sg_convert_errno(ENOMEM);
+        }
+    }
+    rz_issue(pgp, 0, op->st_lba);
+    pgp->head = 0;
+    return 0;
+}
+
+/* Places the next page in *rzpp (valid until the next call) and the number
+ * of zone descriptors it holds in *num_zdp; that number is 0 after the
+ * last page. Returns 0 on success */
+static int
+rz_pager_next(struct rz_pager_t * pgp, const uint8_t ** rzpp, int * num_zdp)
+{
+    int k, s, rlen, num_zd;
+    int h = pgp->head;
+    uint64_t next_lba, zn_len;
+    struct rz_slot_t * sp;
+    const uint8_t * bp;
+
+    *num_zdp = 0;
+    if (pgp->done)
+        return 0;
+    if (pgp->sg_fd < 0) {       /* --inhex=FN */
+        pgp->done = true;
+        rlen = pgp->in_len;
+        sp = pgp->slot;
+        goto got_page;
+    }
+    sp = pgp->slot + h;
+    rz_collect(pgp, h);
+    if (sp->res) {
+        pgp->done = true;
+        return sp->res;
+    }
+    rlen = pgp->mx_len - sp->resid;
+got_page:
+    if (rlen <= 64) {
+        pgp->done = true;
+        return 0;
+    }
+    pgp->mx_lba = sg_get_unaligned_be64(sp->buf + 8);
+    num_zd = (rlen - 64) / REPORT_ZONES_DESC_LEN;
+    if (num_zd > pgp->num_rem)
+        num_zd = pgp->num_rem;
+    if (num_zd < 1) {
+        pgp->done = true;
+        return 0;
+    }
+    pgp->zn_dnum += pgp->last_num_zd;
+    pgp->last_num_zd = num_zd;
+    bp = sp->buf + 64 + ((num_zd - 1) * REPORT_ZONES_DESC_LEN);
+    zn_len = sg_get_unaligned_be64(bp + 8);
+    next_lba = sg_get_unaligned_be64(bp + 16) + zn_len;
+    pgp->num_rem -= num_zd;
+    *rzpp = sp->buf;
+    *num_zdp = num_zd;
+    if (pgp->sg_fd < 0)
+        return 0;
+    /* fewer descriptors than fit means the device had no more to report */
+    if ((next_lba > pgp->mx_lba) || (0 == pgp->num_rem) || (0 == zn_len) ||
+        ((rlen - 64) / REPORT_ZONES_DESC_LEN < pgp->per_page))
+        pgp->done = true;
+    /* check the pages fetched ahead; drop them from the first wrong one */
+    for (k = 1; k < RZ_PAGE_SLOTS; ++k) {
+        s = (h + k) % RZ_PAGE_SLOTS;
+        if (! pgp->slot[s].busy)
+            break;
+        if (pgp->done || (pgp->slot[s].st_lba != next_lba))
+            break;
+        next_lba += (uint64_t)pgp->per_page * zn_len;
+    }
+    for (; k < RZ_PAGE_SLOTS; ++k)
+        rz_discard(pgp, (h + k) % RZ_PAGE_SLOTS);
+    if (pgp->done)
+        return 0;
+    s = (h + 1) % RZ_PAGE_SLOTS;
+    pgp->head = s;
+    if (! pgp->slot[s].busy)
+        rz_issue(pgp, s, sg_get_unaligned_be64(bp + 16) + zn_len);
+#ifdef SG_RZ_PAGE_THREADS
+    /* with equal length zones (Same not 0) each full page spans per_page
+     * of them, so the start LBA of the page after next is predictable */
+    s = (h + 2) % RZ_PAGE_SLOTS;
+    if ((! pgp->slot[s].busy) && (0 != (sp->buf[4] & 0xf)) &&
+        (0 == pgp->report_opts) && (pgp->num_rem > pgp->per_page)) {
+        next_lba = pgp->slot[(h + 1) % RZ_PAGE_SLOTS].st_lba +
+                   ((uint64_t)pgp->per_page * zn_len);
+        if (next_lba <= pgp->mx_lba)
+            rz_issue(pgp, s, next_lba);
+    }
+#endif
+    return 0;
+}
+
+static void
+rz_pager_fini(struct rz_pager_t * pgp)
+{
+    int k;
+
+    for (k = 0; k < RZ_PAGE_SLOTS; ++k) {
+        rz_collect(pgp, k);
+        if (pgp->slot[k].free_buf)
+            free(pgp->slot[k].free_buf);
+    }
+    if ((pgp->vb > 1) && (pgp->sg_fd >= 0))
+        pr2serr("%u REPORT ZONES commands, %u page(s) fetched ahead not "
+                "used\n", pgp->num_cmds, pgp->num_discarded);
+}
+
 static void
 dStrRaw(const uint8_t * str, int len)
 {
@@ -432,31 +716,16 @@ prt_a_zn_desc(const uint8_t *bp, struct opts_t * op, sgj_opaque_p jop)
     return lba + len;
 }
 
-static int
-decode_rep_zones(const uint8_t * rzBuff, int act_len, uint32_t decod_len,
-                 struct opts_t * op,  sgj_opaque_p jop)
+/* Outputs the 64 byte header of a REPORT ZONES response. Returns the
+ * Maximum LBA field. */
+static uint64_t
+prt_rep_zones_hdr(const uint8_t * rzBuff, struct opts_t * op,
+                  sgj_opaque_p jop)
 {
-    bool as_json;
-    int k, same, num_zd;
-    uint64_t wp, ul, mx_lba;
+    int same;
+    uint64_t mx_lba;
     sgj_state * jsp = &op->json_st;
-    sgj_opaque_p jap = NULL;
-    const uint8_t * bp;
 
-    as_json = jsp ? jsp->pr_as_json : false;
-    if ((uint32_t)act_len < decod_len) {
-        num_zd = (act_len >= 64) ? ((act_len - 64) / REPORT_ZONES_DESC_LEN)
-                                 : 0;
-        if (act_len == op->maxlen) {
-            if (op->maxlen_given)
-                pr2serr("decode length [%u bytes] may be constrained by "
-                        "given --maxlen value, try increasing\n", decod_len);
-            else
-                pr2serr("perhaps --maxlen=%u needs to be used\n", decod_len);
-        } else if (op->in_fn)
-            pr2serr("perhaps %s has been truncated\n", op->in_fn);
-    } else
-        num_zd = (decod_len - 64) / REPORT_ZONES_DESC_LEN;
     same = rzBuff[4] & 0xf;
     mx_lba = sg_get_unaligned_be64(rzBuff + 8);
     if (op->wp_only) {
@@ -479,6 +748,91 @@ decode_rep_zones(const uint8_t * rzBuff, int act_len, uint32_t decod_len,
         sgj_js_nv_ihex(jsp, jop, sgj_convert2snake(rzslbag_s, b, sizeof(b)),
                        rzslbag);
     }
+    return mx_lba;
+}
+
+/* Returns the JSON array that zone descriptors are added to. A large zoned
+ * disk has many zones so, unless hex is wanted, they are streamed out to
+ * stdout or to the opened --js-file=JFN */
+static sgj_opaque_p
+zn_descs_jarr(struct opts_t * op, const char * sn_name)
+{
+    sgj_state * jsp = &op->json_st;
+    FILE * fp = NULL;
+
+    if (! op->do_hex) {
+        if (op->js_fp)
+            fp = op->js_fp;
+        else if ((NULL == op->js_file) || (0 == strcmp(op->js_file, "-")))
+            fp = stdout;
+    }
+    if (fp)
+        return sgj_stream_subarray_r(jsp, sn_name, fp);
+    return sgj_named_subarray_r(jsp, NULL, sn_name);
+}
+
+/* Outputs num_zd zone descriptors starting at bp, the first of which is
+ * zone descriptor number zn_dnum. JSON objects are added to array jap. */
+static void
+prt_zn_descs(const uint8_t * bp, int num_zd, uint32_t zn_dnum,
+             struct opts_t * op, sgj_opaque_p jap)
+{
+    int k;
+    uint64_t wp;
+    sgj_state * jsp = &op->json_st;
+
+    for (k = 0; k < num_zd; ++k, bp += REPORT_ZONES_DESC_LEN) {
+        sgj_opaque_p jo2p;
+
+        if (! op->wp_only)
+             sgj_pr_hr(jsp, " %s%u\n", zn_dnum_s, zn_dnum + k);
+        if (op->do_hex) {
+            hex2stdout(bp, 64, -1);
+            continue;
+        }
+        if (op->wp_only) {
+            wp = sg_get_unaligned_be64(bp + 24);
+            if (sg_all_ffs((const uint8_t *)&wp, sizeof(wp)))
+                sgj_pr_hr(jsp, "-1\n");
+            else
+                sgj_pr_hr(jsp, "0x%" PRIx64 "\n", wp);
+            jo2p = sgj_new_unattached_object_r(jsp);
+            sgj_js_nv_ihex(jsp, jo2p, "write_pointer_lba", (int64_t)wp);
+            sgj_js_nv_o(jsp, jap, NULL /* name */, jo2p);
+            continue;
+        }
+        jo2p = sgj_new_unattached_object_r(jsp);
+        prt_a_zn_desc(bp, op, jo2p);
+        sgj_js_nv_o(jsp, jap, NULL /* name */, jo2p);
+    }
+}
+
+static int
+decode_rep_zones(const uint8_t * rzBuff, int act_len, uint32_t decod_len,
+                 struct opts_t * op,  sgj_opaque_p jop)
+{
+    bool as_json;
+    int num_zd;
+    uint64_t ul, mx_lba;
+    sgj_state * jsp = &op->json_st;
+    sgj_opaque_p jap = NULL;
+    const uint8_t * bp;
+
+    as_json = jsp ? jsp->pr_as_json : false;
+    if ((uint32_t)act_len < decod_len) {
+        num_zd = (act_len >= 64) ? ((act_len - 64) / REPORT_ZONES_DESC_LEN)
+                                 : 0;
+        if (act_len == op->maxlen) {
+            if (op->maxlen_given)
+                pr2serr("decode length [%u bytes] may be constrained by "
+                        "given --maxlen value, try increasing\n", decod_len);
+            else
+                pr2serr("perhaps --maxlen=%u needs to be used\n", decod_len);
+        } else if (op->in_fn)
+            pr2serr("perhaps %s has been truncated\n", op->in_fn);
+    } else
+        num_zd = (decod_len - 64) / REPORT_ZONES_DESC_LEN;
+    mx_lba = prt_rep_zones_hdr(rzBuff, op, jop);
     if (op->do_num > 0)
             num_zd = (num_zd > op->do_num) ? op->do_num : num_zd;
     if (((uint32_t)act_len < decod_len) &&
@@ -507,37 +861,14 @@ decode_rep_zones(const uint8_t * rzBuff, int act_len, uint32_t decod_len,
                       "\n", ul);
         return 0;
     }
-    if (as_json)
-        jap = sgj_named_subarray_r(jsp, NULL, "zone_descriptors_list");
-    for (k = 0, bp = rzBuff + 64; k < num_zd;
-         ++k, bp += REPORT_ZONES_DESC_LEN) {
-        sgj_opaque_p jo2p;
-
-        if (! op->wp_only)
-             sgj_pr_hr(jsp, " %s%d\n", zn_dnum_s, k);
-        if (op->do_hex) {
-            hex2stdout(bp, 64, -1);
-            continue;
-        }
-        if (op->wp_only) {
-            if (op->do_hex)
-                hex2stdout(bp + 24, 8, -1);
-            else {
-                wp = sg_get_unaligned_be64(bp + 24);
-                if (sg_all_ffs((const uint8_t *)&wp, sizeof(wp)))
-                    sgj_pr_hr(jsp, "-1\n");
-                else
-                    sgj_pr_hr(jsp, "0x%" PRIx64 "\n", wp);
-                jo2p = sgj_new_unattached_object_r(jsp);
-                sgj_js_nv_ihex(jsp, jo2p, "write_pointer_lba", (int64_t)wp);
-                sgj_js_nv_o(jsp, jap, NULL /* name */, jo2p);
-            }
-            continue;
-        }
-        jo2p = sgj_new_unattached_object_r(jsp);
-        prt_a_zn_desc(bp, op, jo2p);
-        sgj_js_nv_o(jsp, jap, NULL /* name */, jo2p);
+    if (as_json) {
+        /* only stream when not within one of many --inhex= responses */
+        if (jop == jsp->basep)
+            jap = zn_descs_jarr(op, "zone_descriptors_list");
+        else
+            jap = sgj_named_subarray_r(jsp, jop, "zone_descriptors_list");
     }
+    prt_zn_descs(rzBuff + 64, num_zd, 0, op, jap);
     if ((op->do_num == 0) && (! op->wp_only) && (! op->do_hex)) {
         if ((64 + (REPORT_ZONES_DESC_LEN * (uint32_t)num_zd)) < decod_len)
             sgj_pr_hr(jsp, "\n>>> Beware: Zone list truncated, may need "
@@ -546,6 +877,161 @@ decode_rep_zones(const uint8_t * rzBuff, int act_len, uint32_t decod_len,
     return 0;
 }
 
+/* Handles --all: pages through REPORT ZONES responses from --start=LBA
+ * until the last zone (or --num=NUM zones) and outputs them as one list */
+static int
+page_rep_zones(int sg_fd, const char * cmd_name, struct opts_t * op,
+               sgj_opaque_p jop)
+{
+    int res, num_zd;
+    uint32_t num_zones = 0;
+    sgj_state * jsp = &op->json_st;
+    sgj_opaque_p jap = NULL;
+    const uint8_t * rzp = NULL;
+    struct rz_pager_t pager;
+    char b[96];
+
+    res = rz_pager_init(&pager, sg_fd, NULL, 0, op);
+    while (0 == res) {
+        res = rz_pager_next(&pager, &rzp, &num_zd);
+        if (res) {
+            if (SG_LIB_CAT_INVALID_OP == res)
+                pr2serr("%s: %s%u, %s command not supported\n", __func__,
+                        zn_dnum_s, num_zones, cmd_name);
+            else {
+                sg_get_category_sense_str(res, sizeof(b), b, op->vb);
+                pr2serr("%s: %s%u, %s command: %s\n", __func__, zn_dnum_s,
+                        num_zones, cmd_name, b);
+            }
+            break;
+        }
+        if (num_zd < 1)
+            break;
+        if (0 == num_zones) {   /* header fields from the first response */
+            if (! op->wp_only && (! op->do_hex))
+                sgj_pr_hr(jsp, "%s response:\n", cmd_name);
+            prt_rep_zones_hdr(rzp, op, jop);
+            if (jsp->pr_as_json)
+                jap = zn_descs_jarr(op, "zone_descriptors_list");
+        }
+        prt_zn_descs(rzp + 64, num_zd, pager.zn_dnum, op, jap);
+        num_zones += num_zd;
+    }
+    if ((0 == res) && (0 == num_zones))
+        pr2serr("no zones reported from LBA 0x%" PRIx64 "\n", op->st_lba);
+    rz_pager_fini(&pager);
+    return res;
+}
+
+/* Handles --zmap=ZMF: loads the zone map in file ZMF and refreshes it from
+ * the zones selected by --report=OPT (0: the open and closed zones), or
+ * builds it if ZMF is not a zone map. After saving it, outputs the zones
+ * from the one containing --start=LBA, taken from the map. */
+static int
+zmap_rep_zones(int sg_fd, struct opts_t * op, sgj_opaque_p jop)
+{
+    bool built = false;
+    int res, ro;
+    uint32_t k, num, num_upd = 0;
+    int64_t idx;
+    uint64_t wp;
+    sgj_state * jsp = &op->json_st;
+    sgj_opaque_p jap = NULL;
+    sgj_opaque_p jo2p;
+    struct sg_zmap * zmp = NULL;
+    const struct sg_zmap_ent * ep;
+    char b[80];
+    char d[40];
+
+    ro = op->reporting_opt ? op->reporting_opt : SG_ZMAP_RO_ACTIVE;
+    res = sg_zmap_load(op->zmap_fn, &zmp, op->vb);
+    if (0 == res) {
+        res = sg_zmap_refresh(sg_fd, zmp, ro, op->maxlen, &num_upd, op->vb);
+        if (SG_LIB_CAT_MALFORMED == res) {
+            pr2serr("zone map in %s is stale, rebuilding it\n",
+                    op->zmap_fn);
+            sg_zmap_free(zmp);
+            zmp = NULL;
+        } else if (res) {
+            sg_get_category_sense_str(res, sizeof(b), b, op->vb);
+            pr2serr("refreshing zone map: %s\n", b);
+            goto fini;
+        }
+    }
+    if (NULL == zmp) {
+        res = sg_zmap_build(sg_fd, op->maxlen, &zmp, op->vb);
+        if (res) {
+            sg_get_category_sense_str(res, sizeof(b), b, op->vb);
+            pr2serr("building zone map: %s\n", b);
+            goto fini;
+        }
+        built = true;
+        num_upd = sg_zmap_num_zones(zmp);
+    }
+    res = sg_zmap_save(zmp, op->zmap_fn);
+    if (res) {
+        sg_get_category_sense_str(res, sizeof(b), b, op->vb);
+        pr2serr("unable to save zone map to %s: %s\n", op->zmap_fn, b);
+        goto fini;
+    }
+    num = sg_zmap_num_zones(zmp);
+    if (! op->wp_only) {
+        sgj_pr_hr(jsp, "Zone map %s: %u zones, %s %u of them\n",
+                  op->zmap_fn, num, built ? "built from" : "refreshed",
+                  num_upd);
+        sgj_pr_hr(jsp, "  Maximum LBA: 0x%" PRIx64 "\n\n",
+                  sg_zmap_max_lba(zmp));
+        jo2p = sgj_named_subobject_r(jsp, jop, "zone_map");
+        sgj_js_nv_s(jsp, jo2p, "file_name", op->zmap_fn);
+        sgj_js_nv_b(jsp, jo2p, "built", built);
+        sgj_js_nv_i(jsp, jo2p, "number_of_zones", num);
+        sgj_js_nv_i(jsp, jo2p, "zones_updated", num_upd);
+        sgj_js_nv_ihex(jsp, jo2p, "maximum_lba", sg_zmap_max_lba(zmp));
+    }
+    idx = sg_zmap_find(zmp, op->st_lba);
+    if (idx < 0) {
+        pr2serr("--start=0x%" PRIx64 " is beyond the Maximum LBA\n",
+                op->st_lba);
+        res = SG_LIB_LBA_OUT_OF_RANGE;
+        goto fini;
+    }
+    if (op->do_num && ((uint64_t)idx + op->do_num < num))
+        num = (uint32_t)idx + op->do_num;
+    if (jsp->pr_as_json)
+        jap = zn_descs_jarr(op, "zone_map_list");
+    for (k = (uint32_t)idx; k < num; ++k) {
+        ep = sg_zmap_entry(zmp, k);
+        wp = (SG_ZMAP_NO_WP == ep->wp_off) ? UINT64_MAX :
+                                             ep->start_lba + ep->wp_off;
+        if (op->wp_only) {
+            if (UINT64_MAX == wp)
+                sgj_pr_hr(jsp, "-1\n");
+            else
+                sgj_pr_hr(jsp, "0x%" PRIx64 "\n", wp);
+        } else {
+            sg_get_zone_type_str(ep->type, sizeof(d), d);
+            zone_condition_str(ep->cond, b, sizeof(b), op->vb);
+            if (UINT64_MAX == wp)
+                sgj_pr_hr(jsp, " %u: start LBA 0x%" PRIx64 ", %s, %s\n", k,
+                          ep->start_lba, d, b);
+            else
+                sgj_pr_hr(jsp, " %u: start LBA 0x%" PRIx64 ", %s, %s, "
+                          "wp: 0x%" PRIx64 "\n", k, ep->start_lba, d, b, wp);
+        }
+        jo2p = sgj_new_unattached_object_r(jsp);
+        sgj_js_nv_i(jsp, jo2p, "zone_index", k);
+        sgj_js_nv_ihex(jsp, jo2p, "zone_start_lba", ep->start_lba);
+        sgj_js_nv_ihex(jsp, jo2p, "zone_length", sg_zmap_zone_len(zmp, k));
+        sgj_js_nv_i(jsp, jo2p, "zone_type", ep->type);
+        sgj_js_nv_i(jsp, jo2p, "zone_condition", ep->cond);
+        sgj_js_nv_ihex(jsp, jo2p, "write_pointer_lba", (int64_t)wp);
+        sgj_js_nv_o(jsp, jap, NULL /* name */, jo2p);
+    }
+fini:
+    sg_zmap_free(zmp);
+    return res;
+}
+
 static int
 decode_rep_realms(const uint8_t * rzBuff, int act_len, struct opts_t * op,
                   sgj_opaque_p jop)
@@ -852,20 +1338,164 @@ struct statistics_t {
     uint64_t wp_max_lba1;       /* ... that isn't Zone start LBA */
     uint64_t wp_blk_num;        /* sum of (zwp - zs_lba) */
     uint64_t conv_blk_num;      /* sum of (z_blks) of zt=conv */
+    uint64_t num_zones;
+    uint32_t num_cmds;          /* REPORT ZONES commands sent */
 };
 
+/* Adds the num_zd zone descriptors of the REPORT ZONES response at rzp to
+ * the counts in stp */
+static void
+stats_tally(struct statistics_t * stp, const uint8_t * rzp, int num_zd)
+{
+    uint8_t zt, zc;
+    int k;
+    uint64_t zs_lba, zwp, z_blks;
+    const uint8_t * bp;
+
+    stp->num_zones += num_zd;
+    for (k = 0, bp = rzp + 64; k < num_zd; ++k, bp += REPORT_ZONES_DESC_LEN) {
+        z_blks = sg_get_unaligned_be64(bp + 8);
+        zs_lba = sg_get_unaligned_be64(bp + 16);
+        zwp = sg_get_unaligned_be64(bp + 24);
+        zt = 0xf & bp[0];
+        switch (zt) {
+        case 1:     /* conventional */
+            ++stp->zt_conv_num;
+            stp->conv_blk_num += z_blks;
+            break;
+        case 2:     /* sequential write required */
+            ++stp->zt_swr_num;
+            if (0 == stp->zt_swr_1st_lba1)
+                stp->zt_swr_1st_lba1 = zs_lba + 1;
+            break;
+        case 3:     /* sequential write preferred, obsolete zbc3r02 */
+            ++stp->zt_swp_num;
+            if (0 == stp->zt_swp_1st_lba1)
+                stp->zt_swp_1st_lba1 = zs_lba + 1;
+            break;
+        case 4:     /* sequential or before (write) */
+            ++stp->zt_sob_num;
+            if (0 == stp->zt_sob_1st_lba1)
+                stp->zt_sob_1st_lba1 = zs_lba + 1;
+            break;
+        case 5:     /* gap */
+            ++stp->zt_gap_num;
+            if (0 == stp->zt_gap_1st_lba1)
+                stp->zt_gap_1st_lba1 = zs_lba + 1;
+            break;
+        default:
+            ++stp->zt_unk_num;
+            break;
+        }
+        zc = (bp[1] >> 4) & 0xf;
+        switch (zc) {
+        case 0:     /* not write pointer (zone) */
+            ++stp->zc_nwp_num;
+            if (0 == stp->zc_nwp_1st_lba1)
+                stp->zc_nwp_1st_lba1 = zs_lba + 1;
+            break;
+        case 1:     /* empty */
+            ++stp->zc_mt_num;
+            if (0 == stp->zc_mt_1st_lba1)
+                stp->zc_mt_1st_lba1 = zs_lba + 1;
+            break;
+        case 2:     /* implicitly opened */
+            ++stp->zc_iop_num;
+            if (0 == stp->zc_iop_1st_lba1)
+                stp->zc_iop_1st_lba1 = zs_lba + 1;
+            if (zwp > zs_lba) {
+                stp->wp_max_lba1 = zwp + 1;
+                stp->wp_blk_num += zwp - zs_lba;
+            }
+            break;
+        case 3:     /* explicitly opened */
+            ++stp->zc_eop_num;
+            if (0 == stp->zc_eop_1st_lba1)
+                stp->zc_eop_1st_lba1 = zs_lba + 1;
+            if (zwp > zs_lba) {
+                stp->wp_max_lba1 = zwp + 1;
+                stp->wp_blk_num += zwp - zs_lba;
+            }
+            break;
+        case 4:     /* closed */
+            ++stp->zc_cl_num;
+            if (0 == stp->zc_cl_1st_lba1)
+                stp->zc_cl_1st_lba1 = zs_lba + 1;
+            if (zwp > zs_lba) {
+                stp->wp_max_lba1 = zwp + 1;
+                stp->wp_blk_num += zwp - zs_lba;
+            }
+            break;
+        case 5:     /* inactive */
+            ++stp->zc_ina_num;
+            if (0 == stp->zc_ina_1st_lba1)
+                stp->zc_ina_1st_lba1 = zs_lba + 1;
+            break;
+        case 0xd:   /* read-only */
+            ++stp->zc_ro_num;
+            if (0 == stp->zc_ro_1st_lba1)
+                stp->zc_ro_1st_lba1 = zs_lba + 1;
+            break;
+        case 0xe:   /* full */
+            ++stp->zc_full_num;
+            if (0 == stp->zc_full_1st_lba1)
+                stp->zc_full_1st_lba1 = zs_lba + 1;
+            stp->wp_blk_num += z_blks;
+            break;
+        case 0xf:   /* offline */
+            ++stp->zc_off_num;
+            if (0 == stp->zc_off_1st_lba1)
+                stp->zc_off_1st_lba1 = zs_lba + 1;
+            break;
+        default:
+            ++stp->zc_unk_num;
+            break;
+        }
+    }
+}
+
+/* Reviews the zones from op->st_lba with REPORT ZONES, fetching a page
+ * ahead while the last is tallied into stp. Returns 0 or a SG_LIB_CAT_*
+ * value. */
+static int
+stats_collect(int sg_fd, uint8_t * rzBuff, const char * cmd_name,
+              const struct opts_t * op, struct statistics_t * stp)
+{
+    int num_zd;
+    int res;
+    const uint8_t * rzp = NULL;
+    struct rz_pager_t pager;
+    char b[96];
+
+    res = rz_pager_init(&pager, sg_fd, rzBuff, op->maxlen, op);
+    while (0 == res) {
+        res = rz_pager_next(&pager, &rzp, &num_zd);
+        if (res) {
+            if (SG_LIB_CAT_INVALID_OP == res)
+                pr2serr("%s: %s%u, %s command not supported\n", __func__,
+                        zn_dnum_s, pager.zn_dnum + pager.last_num_zd,
+                        cmd_name);
+            else {
+                sg_get_category_sense_str(res, sizeof(b), b, op->vb);
+                pr2serr("%s: %s%u, %s command: %s\n", __func__, zn_dnum_s,
+                        pager.zn_dnum + pager.last_num_zd, cmd_name, b);
+            }
+            break;
+        }
+        if (num_zd < 1)
+            break;
+        stats_tally(stp, rzp, num_zd);
+    }
+    stp->num_cmds = pager.num_cmds;
+    rz_pager_fini(&pager);
+    return res;
+}
+
 static int
 gather_statistics(int sg_fd, uint8_t * rzBuff, const char * cmd_name,
                   struct opts_t * op)
 {
-    uint8_t zt, zc;
-    int k, resid, rlen, num_zd, num_rem;
     int res = 0;
-    uint32_t zn_dnum = 0;
-    uint64_t slba = op->st_lba;
-    uint64_t mx_lba = 0;
-    uint64_t zs_lba, zwp, z_blks;
-    const uint8_t * bp = rzBuff;
     struct statistics_t st SG_C_CPP_ZERO_INIT;
     char b[96];
 
@@ -875,138 +1505,8 @@ gather_statistics(int sg_fd, uint8_t * rzBuff, const char * cmd_name,
         return SG_LIB_SYNTAX_ERROR;
     }
 
-    num_rem = op->do_num ? op->do_num : INT_MAX;
-    for ( ; num_rem > 0; num_rem -= num_zd) {
-        resid = 0;
-        if (sg_fd >= 0) {
-            res = sg_ll_report_zzz(sg_fd, REPORT_ZONES_SA, slba,
-                                   true /* set partial */, op->reporting_opt,
-                                   rzBuff, op->maxlen, &resid, true, op->vb);
-            if (res) {
-                if (SG_LIB_CAT_INVALID_OP == res)
-                    pr2serr("%s: %s%u, %s command not supported\n", __func__,
-                            zn_dnum_s, zn_dnum, cmd_name);
-                else {
-                    sg_get_category_sense_str(res, sizeof(b), b, op->vb);
-                    pr2serr("%s: %s%u, %s command: %s\n", __func__,
-                            zn_dnum_s, zn_dnum, cmd_name, b);
-                }
-                break;
-            }
-        } else
-            res = 0;
-        rlen = op->maxlen - resid;
-        if (rlen <= 64) {
-            break;
-        }
-        mx_lba = sg_get_unaligned_be64(rzBuff + 8);
-        num_zd = (rlen - 64) / REPORT_ZONES_DESC_LEN;
-        if (num_zd > num_rem)
-            num_zd = num_rem;
-        for (k = 0, bp = rzBuff + 64; k < num_zd;
-             ++k, bp += REPORT_ZONES_DESC_LEN, ++zn_dnum) {
-            z_blks = sg_get_unaligned_be64(bp + 8);
-            zs_lba = sg_get_unaligned_be64(bp + 16);
-            zwp = sg_get_unaligned_be64(bp + 24);
-            zt = 0xf & bp[0];
-            switch (zt) {
-            case 1:     /* conventional */
-                ++st.zt_conv_num;
-                st.conv_blk_num += z_blks;
-                break;
-            case 2:     /* sequential write required */
-                ++st.zt_swr_num;
-                if (0 == st.zt_swr_1st_lba1)
-                    st.zt_swr_1st_lba1 = zs_lba + 1;
-                break;
-            case 3:     /* sequential write preferred, obsolete zbc3r02 */
-                ++st.zt_swp_num;
-                if (0 == st.zt_swp_1st_lba1)
-                    st.zt_swp_1st_lba1 = zs_lba + 1;
-                break;
-            case 4:     /* sequential or before (write) */
-                ++st.zt_sob_num;
-                if (0 == st.zt_sob_1st_lba1)
-                    st.zt_sob_1st_lba1 = zs_lba + 1;
-                break;
-            case 5:     /* gap */
-                ++st.zt_gap_num;
-                if (0 == st.zt_gap_1st_lba1)
-                    st.zt_gap_1st_lba1 = zs_lba + 1;
-                break;
-            default:
-                ++st.zt_unk_num;
-                break;
-            }
-            zc = (bp[1] >> 4) & 0xf;
-            switch (zc) {
-            case 0:     /* not write pointer (zone) */
-                ++st.zc_nwp_num;
-                if (0 == st.zc_nwp_1st_lba1)
-                    st.zc_nwp_1st_lba1 = zs_lba + 1;
-                break;
-            case 1:     /* empty */
-                ++st.zc_mt_num;
-                if (0 == st.zc_mt_1st_lba1)
-                    st.zc_mt_1st_lba1 = zs_lba + 1;
-                break;
-            case 2:     /* implicitly opened */
-                ++st.zc_iop_num;
-                if (0 == st.zc_iop_1st_lba1)
-                    st.zc_iop_1st_lba1 = zs_lba + 1;
-                if (zwp > zs_lba) {
-                    st.wp_max_lba1 = zwp + 1;
-                    st.wp_blk_num += zwp - zs_lba;
-                }
-                break;
-            case 3:     /* explicitly opened */
-                ++st.zc_eop_num;
-                if (0 == st.zc_eop_1st_lba1)
-                    st.zc_eop_1st_lba1 = zs_lba + 1;
-                if (zwp > zs_lba) {
-                    st.wp_max_lba1 = zwp + 1;
-                    st.wp_blk_num += zwp - zs_lba;
-                }
-                break;
-            case 4:     /* closed */
-                ++st.zc_cl_num;
-                if (0 == st.zc_cl_1st_lba1)
-                    st.zc_cl_1st_lba1 = zs_lba + 1;
-                if (zwp > zs_lba) {
-                    st.wp_max_lba1 = zwp + 1;
-                    st.wp_blk_num += zwp - zs_lba;
-                }
-                break;
-            case 5:     /* inactive */
-                ++st.zc_ina_num;
-                if (0 == st.zc_ina_1st_lba1)
-                    st.zc_ina_1st_lba1 = zs_lba + 1;
-                break;
-            case 0xd:   /* read-only */
-                ++st.zc_ro_num;
-                if (0 == st.zc_ro_1st_lba1)
-                    st.zc_ro_1st_lba1 = zs_lba + 1;
-                break;
-            case 0xe:   /* full */
-                ++st.zc_full_num;
-                if (0 == st.zc_full_1st_lba1)
-                    st.zc_full_1st_lba1 = zs_lba + 1;
-                st.wp_blk_num += z_blks;
-                break;
-            case 0xf:   /* offline */
-                ++st.zc_off_num;
-                if (0 == st.zc_off_1st_lba1)
-                    st.zc_off_1st_lba1 = zs_lba + 1;
-                break;
-            default:
-                ++st.zc_unk_num;
-                break;
-            }
-            slba = zs_lba + z_blks;
-        }       /* end of inner for loop */
-        if ((slba > mx_lba) || (sg_fd < 0))
-            break;
-    }           /* end of outer for loop */
+    /* with a DEVICE, pages are fetched (in flight) while the last is tallied */
+    res = stats_collect(sg_fd, rzBuff, cmd_name, op, &st);
     printf("Number of conventional type zones: %u\n", st.zt_conv_num);
     if (st.zt_swr_num > 0)
         printf("Number of sequential write required type zones: %u\n",
@@ -1153,6 +1653,161 @@ gather_statistics(int sg_fd, uint8_t * rzBuff, const char * cmd_name,
     return res;
 }
 
+/* With --statistics and more than one DEVICE, each device has its zones
+ * reviewed (by up to --parallel=Q threads at once) and its statistics
+ * output as one line of JSON, in the order the devices finish. Nothing is
+ * kept per zone so memory use does not grow with the number of zones. */
+struct fleet_t {
+    int num_devs;
+    const char ** dev_arr;
+    int * ret_arr;
+    const struct opts_t * op;
+};
+
+/* Copies s into b with '"' and '\' escaped, for a JSON string */
+static const char *
+fleet_js_str(const char * s, char * b, int blen)
+{
+    int n = 0;
+
+    for ( ; *s && (n < (blen - 2)); ++s) {
+        if (('"' == *s) || ('\\' == *s))
+            b[n++] = '\\';
+        b[n++] = *s;
+    }
+    b[n] = '\0';
+    return b;
+}
+
+/* Reviews the zones of one device and outputs its JSON line. Returns 0 or
+ * an exit status. */
+static int
+fleet_one(struct fleet_t * flp, const char * dname)
+{
+    int sg_fd, res, n;
+    int ret = 0;
+    uint32_t blk_sz = 0;
+    uint64_t wp_zones;
+    int64_t start_ms = sg_mpoll_now_ms();
+    const struct opts_t * op = flp->op;
+    struct statistics_t st SG_C_CPP_ZERO_INIT;
+    uint8_t rc_b[RCAP16_REPLY_LEN];
+    char dn[256];
+    char line[1024];
+
+    fleet_js_str(dname, dn, sizeof(dn));
+    sg_fd = sg_cmds_open_device(dname, op->o_readonly, op->vb);
+    if (sg_fd < 0) {
+        ret = sg_convert_errno(-sg_fd);
+        snprintf(line, sizeof(line), "{\"device\": \"%s\", \"exit_status\": "
+                 "%d, \"error\": \"open: %s\"}\n", dn, ret,
+                 safe_strerror(-sg_fd));
+        goto out;
+    }
+    ret = stats_collect(sg_fd, NULL, "Report zones", op, &st);
+    if (0 == ret) {
+        res = sg_ll_readcap_16(sg_fd, false, 0, rc_b, sizeof(rc_b), false,
+                               op->vb);
+        if (0 == res)
+            blk_sz = sg_get_unaligned_be32(rc_b + 8);
+    }
+    res = sg_cmds_close_device(sg_fd);
+    if ((res < 0) && (0 == ret))
+        ret = sg_convert_errno(-res);
+    if (ret) {
+        char b[80];
+
+        sg_get_category_sense_str(ret, sizeof(b), b, 0);
+        snprintf(line, sizeof(line), "{\"device\": \"%s\", \"exit_status\": "
+                 "%d, \"error\": \"%s\"}\n", dn, ret, b);
+        goto out;
+    }
+    wp_zones = st.num_zones - st.zc_nwp_num;
+    n = snprintf(line, sizeof(line), "{\"device\": \"%s\", \"exit_status\": "
+                 "0, \"zones\": %" PRIu64 ", \"block_size\": %u, ", dn,
+                 st.num_zones, blk_sz);
+    n += snprintf(line + n, sizeof(line) - n, "\"zone_types\": "
+                  "{\"conventional\": %u, \"seq_write_required\": %u, "
+                  "\"seq_write_preferred\": %u, \"seq_or_before\": %u, "
+                  "\"gap\": %u, \"unknown\": %u}, ", st.zt_conv_num,
+                  st.zt_swr_num, st.zt_swp_num, st.zt_sob_num,
+                  st.zt_gap_num, st.zt_unk_num);
+    n += snprintf(line + n, sizeof(line) - n, "\"zone_conditions\": "
+                  "{\"not_write_pointer\": %u, \"empty\": %u, "
+                  "\"implicitly_open\": %u, \"explicitly_open\": %u, "
+                  "\"closed\": %u, \"inactive\": %u, \"read_only\": %u, "
+                  "\"full\": %u, \"offline\": %u, \"unknown\": %u}, ",
+                  st.zc_nwp_num, st.zc_mt_num, st.zc_iop_num, st.zc_eop_num,
+                  st.zc_cl_num, st.zc_ina_num, st.zc_ro_num, st.zc_full_num,
+                  st.zc_off_num, st.zc_unk_num);
+    snprintf(line + n, sizeof(line) - n, "\"written_blocks\": %" PRIu64
+             ", \"written_bytes\": %" PRIu64 ", \"conventional_bytes\": %"
+             PRIu64 ", \"empty_ratio\": %.4f, \"full_ratio\": %.4f, "
+             "\"report_zones_commands\": %u, \"elapsed_ms\": %" PRId64
+             "}\n", st.wp_blk_num, st.wp_blk_num * blk_sz,
+             st.conv_blk_num * blk_sz,
+             wp_zones ? ((double)st.zc_mt_num / wp_zones) : 0.0,
+             wp_zones ? ((double)st.zc_full_num / wp_zones) : 0.0,
+             st.num_cmds, sg_mpoll_now_ms() - start_ms);
+out:
+    sg_par_lock();
+    fputs(line, stdout);
+    fflush(stdout);
+    sg_par_unlock();
+    return ret;
+}
+
+/* Called by sg_par_each() for the k-th device */
+static int
+fleet_dev_one(int64_t k, void * ctx)
+{
+    struct fleet_t * flp = (struct fleet_t *)ctx;
+
+    flp->ret_arr[k] = fleet_one(flp, flp->dev_arr[k]);
+    return 0;
+}
+
+/* Returns 0 if every device was reviewed, else the exit status of the
+ * first (in command line order) that was not */
+static int
+fleet_statistics(const char ** dev_arr, int num_devs,
+                 const struct opts_t * op)
+{
+    int k, num_thr;
+    int ret = 0;
+    long lval;
+    struct fleet_t fl;
+
+    memset(&fl, 0, sizeof(fl));
+    fl.num_devs = num_devs;
+    fl.dev_arr = dev_arr;
+    fl.op = op;
+    fl.ret_arr = (int *)calloc(num_devs, sizeof(int));
+    if (NULL == fl.ret_arr)
+        return sg_convert_errno(ENOMEM);
+    num_thr = op->num_parallel;
+    if (num_thr <= 0) {
+        lval = sysconf(_SC_NPROCESSORS_ONLN);
+        num_thr = (lval > 0) ? (int)lval : 1;
+        if (num_thr > SG_BATCH_MAX_PARALLEL)
+            num_thr = SG_BATCH_MAX_PARALLEL;
+    }
+    if (num_thr > num_devs)
+        num_thr = num_devs;
+    if (op->vb)
+        pr2serr("%s: %d devices, %d threads\n", __func__, num_devs,
+                num_thr);
+    sg_par_each(num_devs, num_thr, fleet_dev_one, &fl);
+    for (k = 0; k < num_devs; ++k) {
+        if (fl.ret_arr[k]) {
+            ret = fl.ret_arr[k];
+            break;
+        }
+    }
+    free(fl.ret_arr);
+    return ret;
+}
+
 /* Handles short options after '-j' including a sequence of short options
  * that include one 'j' (for JSON). Want optional argument to '-j' to be
  * prefixed by '='. Return 0 for good, SG_LIB_SYNTAX_ERROR for syntax error
@@ -1162,6 +1817,9 @@ chk_short_opts(const char sopt_ch, struct opts_t * op)
 {
     /* only need to process short, non-argument options */
     switch (sopt_ch) {
+    case 'a':
+        op->do_all = true;
+        break;
     case 'b':
         op->do_brief = true;
         break;
@@ -1220,21 +1878,30 @@ main(int argc, char * argv[])
 {
     bool no_final_msg = false;
     bool as_json = false;
-    int res, c, act_len, rlen, in_len, off;
+    bool multi = false;
+    int res, c, act_len, rlen, off;
+    int in_len = 0;
+    int resp_num = 0;
+    int in_off = 0;
     int sg_fd = -1;
     int resid = 0;
+    int num_devs = 0;
     int ret = 0;
     uint32_t decod_len;
     int64_t ll;
     const char * device_name = NULL;
+    const char ** dev_arr = NULL;
     uint8_t * rzBuff = NULL;
     uint8_t * free_rzbp = NULL;
     const char * cmd_name = "Report zones";
     sgj_state * jsp;
     sgj_opaque_p jop = NULL;
+    sgj_opaque_p jo2p = NULL;
+    sgj_opaque_p jap = NULL;
     char b[80];
     struct opts_t opts SG_C_CPP_ZERO_INIT;
     struct opts_t * op = &opts;
+    struct sg_f2hex_map in_map SG_C_CPP_ZERO_INIT;
 
     if (getenv("SG3_UTILS_INVOCATION"))
         sg_rep_invocation(MY_NAME, version_str, argc, argv, stderr);
@@ -1242,12 +1909,18 @@ main(int argc, char * argv[])
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "^bdefF:hHi:j::J:l:m:n:o:prRs:SvVw",
+        c = getopt_long(argc, argv, "^aB:bdefF:hHi:j::J:l:m:n:o:pP:rRs:SvVwZ:",
                         long_options, &option_index);
         if (c == -1)
             break;
 
         switch (c) {
+        case 'a':
+            op->do_all = true;
+            break;
+        case 'B':
+            op->batch_fn = optarg;
+            break;
         case 'b':
             op->do_brief = true;
             break;
@@ -1354,6 +2027,12 @@ main(int argc, char * argv[])
         case 'p':
             op->do_partial = true;
             break;
+        case 'P':
+            op->num_parallel = sg_par_get_num(optarg, 0,
+                                              SG_BATCH_MAX_PARALLEL);
+            if (op->num_parallel < 0)
+                return SG_LIB_SYNTAX_ERROR;
+            break;
         case 'r':
             op->do_raw = true;
             break;
@@ -1386,6 +2065,9 @@ main(int argc, char * argv[])
         case 'w':
             op->wp_only = true;
             break;
+        case 'Z':
+            op->zmap_fn = optarg;
+            break;
         default:
             pr2serr("unrecognised option code 0x%x ??\n", c);
             usage(1);
@@ -1397,6 +2079,11 @@ main(int argc, char * argv[])
             device_name = argv[optind];
             ++optind;
         }
+        if ((optind < argc) && op->statistics) {
+            dev_arr = (const char **)(argv + optind - 1);
+            num_devs = argc - optind + 1;
+            optind = argc;
+        }
         if (optind < argc) {
             for (; optind < argc; ++optind)
                 pr2serr("Unexpected extra argument: %s\n", argv[optind]);
@@ -1429,6 +2116,27 @@ main(int argc, char * argv[])
         usage(op->do_help);
         return 0;
     }
+    if (op->batch_fn) {
+        if (device_name || op->in_fn || op->js_file || op->zmap_fn) {
+            pr2serr("--batch=MF cannot be used with a DEVICE, --inhex=, "
+                    "--js-file= or\n--zmap=\n");
+            return SG_LIB_CONTRADICT;
+        }
+        op->do_json = true;     /* each blob is output as a JSON line */
+    }
+    if (num_devs > 1) {         /* --statistics for each DEVICE */
+        if (op->in_fn || op->js_file || op->zmap_fn || op->find_zt ||
+            op->do_all || op->do_zdomains || op->do_realms || op->do_raw ||
+            op->do_hex) {
+            pr2serr("--statistics with more than one DEVICE cannot be used "
+                    "with --all,\n--domain, --find=, --hex, --inhex=, "
+                    "--js-file=, --raw, --realm or --zmap=\n");
+            return SG_LIB_CONTRADICT;
+        }
+        if (0 == op->maxlen)
+            op->maxlen = DEF_RZONES_BUFF_LEN;
+        return fleet_statistics(dev_arr, num_devs, op);
+    }
     jsp = &op->json_st;
     if (op->do_json) {
        if (! sgj_init_state(jsp, op->json_arg)) {
@@ -1447,6 +2155,18 @@ main(int argc, char * argv[])
         jop = sgj_start_r(MY_NAME, version_str, argc, argv, jsp);
     }
     as_json = jsp->pr_as_json;
+    if (op->batch_fn) {
+        struct sg_batch_item bi;
+
+        if (! sg_batch_run(op->batch_fn, op->num_parallel, &bi, &ret,
+                           op->vb)) {
+            sgj_finish(jsp);
+            return ret;
+        }
+        op->in_fn = bi.fn;      /* now in a child, decoding one blob */
+        if (bi.as_binary >= 0)
+            op->do_raw = bi.as_binary;
+    }
 
     if (op->do_zdomains && op->do_realms) {
         pr2serr("Can't have both --domain and --realm\n");
@@ -1466,6 +2186,43 @@ main(int argc, char * argv[])
                 "not both\n");
         device_name = NULL;
     }
+    if (op->zmap_fn) {
+        if ((op->serv_act != REPORT_ZONES_SA) || op->do_all ||
+            op->do_brief || op->do_raw || op->find_zt || op->in_fn ||
+            op->statistics) {
+            pr2serr("--zmap= only applies to REPORT ZONES and conflicts "
+                    "with --all,\n--brief, --find=, --inhex=, --raw and "
+                    "--statistics\n");
+            return SG_LIB_CONTRADICT;
+        }
+        if (NULL == device_name) {
+            pr2serr("--zmap= needs a DEVICE\n");
+            return SG_LIB_SYNTAX_ERROR;
+        }
+    }
+    if (op->do_all) {
+        if (op->serv_act != REPORT_ZONES_SA) {
+            pr2serr("Can only use --all with REPORT ZONES\n");
+            return SG_LIB_CONTRADICT;
+        }
+        if (op->do_brief || op->do_raw || op->find_zt || op->in_fn) {
+            pr2serr("--all conflicts with --brief, --find=, --inhex= and "
+                    "--raw\n");
+            return SG_LIB_CONTRADICT;
+        }
+        /* stream the JSON zone list into JFN as it is decoded */
+        if (as_json && op->js_file && (0 != strcmp(op->js_file, "-")) &&
+            (! op->statistics)) {
+            op->js_fp = fopen(op->js_file, "w");   /* truncate if exists */
+            if (NULL == op->js_fp) {
+                int e = errno;
+
+                pr2serr("unable to open file: %s [%s]\n", op->js_file,
+                        safe_strerror(e));
+                return sg_convert_errno(e);
+            }
+        }
+    }
     if (0 == op->maxlen)
         op->maxlen = DEF_RZONES_BUFF_LEN;
     rzBuff = (uint8_t *)sg_memalign(op->maxlen, 0, &free_rzbp, op->vb > 3);
@@ -1476,15 +2233,12 @@ main(int argc, char * argv[])
 
     if (NULL == device_name) {
         if (op->in_fn) {
-            if ((ret = sg_f2hex_arr(op->in_fn, op->do_raw, false, rzBuff,
-                                    &in_len, op->maxlen))) {
-                if (SG_LIB_LBA_OUT_OF_RANGE == ret) {
-                    no_final_msg = true;
-                    pr2serr("... decode what we have, --maxlen=%d needs to "
-                            "be increased\n", op->maxlen);
-                } else
-                    goto the_end;
-            }
+            /* may hold many responses, one after another */
+            if ((ret = sg_f2hex_mmap(op->in_fn, op->do_raw, false,
+                                     &in_map, 0)))
+                goto the_end;
+            rzBuff = in_map.bp;         /* decode in place, no copy */
+            in_len = in_map.len;
             if (op->vb > 2)
                 pr2serr("Read %d [0x%x] bytes of user supplied data\n",
                         in_len, in_len);
@@ -1539,6 +2293,12 @@ main(int argc, char * argv[])
     } else if (op->statistics) {
         ret = gather_statistics(sg_fd, rzBuff, cmd_name, op);
         goto the_end;
+    } else if (op->do_all) {
+        ret = page_rep_zones(sg_fd, cmd_name, op, jop);
+        goto the_end;
+    } else if (op->zmap_fn) {
+        ret = zmap_rep_zones(sg_fd, op, jop);
+        goto the_end;
     }
     res = sg_ll_report_zzz(sg_fd, op->serv_act, op->st_lba, op->do_partial,
                            op->reporting_opt, rzBuff, op->maxlen, &resid,
@@ -1582,15 +2342,33 @@ start_response:
             }
         } else
             act_len = decod_len;
+        jo2p = jop;
+        if (op->in_fn && (0 == resp_num) && ((rlen - act_len) >= 64)) {
+            /* --inhex=FN holds more than one response */
+            multi = true;
+            if (jsp->pr_as_json)
+                jap = sgj_named_subarray_r(jsp, jop, "response_list");
+        }
+        if (multi) {
+            ++resp_num;
+            if (jap) {
+                jo2p = sgj_new_unattached_object_r(jsp);
+                sgj_js_nv_o(jsp, jap, NULL /* name */, jo2p);
+            }
+        }
         if (op->do_raw) {
             dStrRaw(rzBuff, act_len);
-            goto the_end;
+            goto next_response;
         }
         if (op->do_hex && (2 != op->do_hex)) {
             hex2stdout(rzBuff, act_len, ((1 == op->do_hex) ? 1 : -1));
-            goto the_end;
+            goto next_response;
         }
-        if (! op->wp_only && (! op->do_hex))
+        if (multi && (! op->wp_only))
+            sgj_pr_hr(jsp, "%s%s response %d, at offset %d:\n",
+                      ((resp_num > 1) ? "\n" : ""), cmd_name, resp_num,
+                      in_off);
+        else if (! op->wp_only && (! op->do_hex))
             sgj_pr_hr(jsp, "%s response:\n", cmd_name);
 
         if (act_len < 64) {
@@ -1600,11 +2378,18 @@ start_response:
             goto the_end;
         }
         if (REPORT_ZONES_SA == op->serv_act)
-            ret = decode_rep_zones(rzBuff, act_len, decod_len, op, jop);
+            ret = decode_rep_zones(rzBuff, act_len, decod_len, op, jo2p);
         else if (op->do_realms)
-            ret = decode_rep_realms(rzBuff, act_len, op, jop);
+            ret = decode_rep_realms(rzBuff, act_len, op, jo2p);
         else if (op->do_zdomains)
-            ret = decode_rep_zdomains(rzBuff, act_len, op, jop);
+            ret = decode_rep_zdomains(rzBuff, act_len, op, jo2p);
+next_response:
+        if (multi && (0 == ret) && ((in_len - act_len) >= 64)) {
+            rzBuff += act_len;
+            in_len -= act_len;
+            in_off += act_len;
+            goto start_response;
+        }
     } else if (SG_LIB_CAT_INVALID_OP == res)
         pr2serr("%s command not supported\n", cmd_name);
     else {
@@ -1615,6 +2400,7 @@ start_response:
 the_end:
     if (free_rzbp)
         free(free_rzbp);
+    sg_f2hex_unmap(&in_map);
     if (sg_fd >= 0) {
         res = sg_cmds_close_device(sg_fd);
         if (res < 0) {
@@ -1632,7 +2418,9 @@ the_end:
     if (as_json) {
         FILE * fp = stdout;
 
-        if (op->js_file) {
+        if (op->js_fp)
+            fp = op->js_fp;
+        else if (op->js_file) {
             if ((1 != strlen(op->js_file)) || ('-' != op->js_file[0])) {
                 fp = fopen(op->js_file, "w");   /* truncate if exists */
                 if (NULL == fp) {
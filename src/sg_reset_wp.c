@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2014-2023 Douglas Gilbert.
+ * Copyright (c) 2014-2026 Douglas Gilbert.
  * All rights reserved.
  * Use of this source code is governed by a BSD-style
  * license that can be found in the BSD_LICENSE file.
@@ -28,16 +28,21 @@
 #include "sg_pt.h"
 #include "sg_cmds_basic.h"
 #include "sg_unaligned.h"
+#include "sg_par.h"
 #include "sg_pr2serr.h"
 
+#include "sg_zone_common.h"
+
 /* A utility program originally written for the Linux OS SCSI subsystem.
  *
  *
  * This program issues the SCSI RESET WRITE POINTER command to the given SCSI
- * device. Based on zbc-r04c.pdf .
+ * device. Based on zbc-r04c.pdf . Given a list of zones, adjacent zones are
+ * coalesced and one command per run of zones is sent, with several of those
+ * commands in flight.
  */
 
-static const char * version_str = "1.17 20230519";
+static const char * version_str = "1.19 20261015";
 
 #define SG_ZONING_OUT_CMDLEN 16
 #define RESET_WRITE_POINTER_SA 0x4
@@ -49,7 +54,10 @@ static const char * version_str = "1.17 20230519";
 static struct option long_options[] = {
         {"all", no_argument, 0, 'a'},
         {"count", required_argument, 0, 'C'},
+        {"filter", required_argument, 0, 'F'},
         {"help", no_argument, 0, 'h'},
+        {"list", required_argument, 0, 'l'},
+        {"parallel", required_argument, 0, 'p'},
         {"reset-all", no_argument, 0, 'R'},
         {"reset_all", no_argument, 0, 'R'},
         {"verbose", no_argument, 0, 'v'},
@@ -63,12 +71,24 @@ static void
 usage()
 {
     pr2serr("Usage: "
-            "sg_reset_wp  [--all] [--count=ZC] [--help] [--verbose]\n"
-            "                    [--version] [--zone=ID] DEVICE\n");
+            "sg_reset_wp  [--all] [--count=ZC] [--filter=CN] [--help]\n"
+            "                    [--list=FN] [--parallel=Q] [--verbose] "
+            "[--version]\n"
+            "                    [--zone=ID] DEVICE\n");
     pr2serr("  where:\n"
             "    --all|-a           sets the ALL flag in the cdb\n"
             "    --count=ZC|-C ZC    set zone count field (def: 0)\n"
+            "    --filter=CN|-F CN    reset zones whose condition is CN "
+            "(e.g. 'full')\n"
+            "                         as found by REPORT ZONES; '-F xxx' "
+            "lists names\n"
             "    --help|-h          print out usage message\n"
+            "    --list=FN|-l FN    reset zones whose IDs are in file FN "
+            "('-' for\n"
+            "                       stdin); adjacent zones share a command\n"
+            "    --parallel=Q|-p Q    with --list or --filter, up to Q "
+            "commands in\n"
+            "                         flight (def: %d, max: %d)\n"
             "    --verbose|-v       increase verbosity\n"
             "    --version|-V       print version string and exit\n"
             "    --zone=ID|-z ID    ID is the starting LBA of the zone "
@@ -76,7 +96,8 @@ usage()
             "                       write pointer is to be reset\n\n"
             "Performs a SCSI RESET WRITE POINTER command. ID is decimal by "
             "default,\nfor hex use a leading '0x' or a trailing 'h'. "
-            "Either the --zone=ID\nor --all option needs to be given.\n");
+            "One of the --zone=ID,\n--all, --list=FN or --filter=CN "
+            "options needs to be given.\n", ZL_DEF_PARALLEL, ZL_MAX_PARALLEL);
 }
 
 /* Invokes a SCSI RESET WRITE POINTER command (ZBC).  Return of 0 -> success,
@@ -134,6 +155,14 @@ sg_ll_reset_write_pointer(int sg_fd, uint64_t zid, uint16_t zc, bool all,
     return ret;
 }
 
+/* zl_cmd_f callback, ctx points to the verbosity */
+static int
+rwp_zl_cmd(int sg_fd, uint64_t zid, uint16_t zc, void * ctx)
+{
+    return sg_ll_reset_write_pointer(sg_fd, zid, zc, false, true,
+                                     *(int *)ctx);
+}
+
 
 int
 main(int argc, char * argv[])
@@ -142,19 +171,26 @@ main(int argc, char * argv[])
     bool verbose_given = false;
     bool version_given = false;
     bool zid_given = false;
+    bool zc_given = false;
     int res, c, n;
     int sg_fd = -1;
     int ret = 0;
     int verbose = 0;
+    int filter_ro = 0;
+    int num_q = ZL_DEF_PARALLEL;
     uint16_t zc = 0;
     uint64_t zid = 0;
     int64_t ll;
     const char * device_name = NULL;
+    const char * list_fn = NULL;
+    struct zl_list_t zl_list;
+
+    memset(&zl_list, 0, sizeof(zl_list));
 
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "aC:hRvVz:", long_options,
+        c = getopt_long(argc, argv, "aC:F:hl:p:RvVz:", long_options,
                         &option_index);
         if (c == -1)
             break;
@@ -172,11 +208,28 @@ main(int argc, char * argv[])
                 return SG_LIB_SYNTAX_ERROR;
             }
             zc = (uint16_t)n;
+            zc_given = true;
+            break;
+        case 'F':
+            filter_ro = zl_cond2ro(optarg);
+            if (filter_ro < 0) {
+                pr2serr("bad argument to '--filter=CN'\n");
+                zl_cond_usage();
+                return SG_LIB_SYNTAX_ERROR;
+            }
             break;
         case 'h':
         case '?':
             usage();
             return 0;
+        case 'l':
+            list_fn = optarg;
+            break;
+        case 'p':
+            num_q = sg_par_get_num(optarg, 1, ZL_MAX_PARALLEL);
+            if (num_q < 0)
+                return SG_LIB_SYNTAX_ERROR;
+            break;
         case 'v':
             verbose_given = true;
             ++verbose;
@@ -234,7 +287,18 @@ main(int argc, char * argv[])
         return 0;
     }
 
-    if ((! zid_given) && (! all)) {
+    if (list_fn || filter_ro) {
+        if (list_fn && filter_ro) {
+            pr2serr("--list=FN and --filter=CN options are mutually "
+                    "exclusive\n");
+            return SG_LIB_CONTRADICT;
+        }
+        if (zid_given || all || zc_given) {
+            pr2serr("--list=FN and --filter=CN options contradict --zone=ID, "
+                    "--all and --count=ZC\n");
+            return SG_LIB_CONTRADICT;
+        }
+    } else if ((! zid_given) && (! all)) {
         pr2serr("either the --zone=ID or --all option is required\n\n");
         usage();
         return SG_LIB_CONTRADICT;
@@ -256,6 +320,24 @@ main(int argc, char * argv[])
         goto fini;
     }
 
+    if (list_fn || filter_ro) {
+        if (list_fn)
+            ret = zl_read_file(list_fn, &zl_list);
+        else
+            ret = zl_from_report(sg_fd, filter_ro, &zl_list, verbose);
+        if (0 == ret)
+            ret = zl_coalesce(sg_fd, &zl_list, verbose);
+        if (ret)
+            goto fini;
+        if (0 == zl_list.num_zones) {
+            if (verbose)
+                pr2serr("no zones to reset\n");
+            goto fini;
+        }
+        ret = zl_run_all(sg_fd, &zl_list, num_q, rwp_zl_cmd, &verbose,
+                         "Reset write pointer", verbose);
+        goto fini;
+    }
     res = sg_ll_reset_write_pointer(sg_fd, zid, zc, all, true, verbose);
     ret = res;
     if (res) {
@@ -270,6 +352,7 @@ main(int argc, char * argv[])
     }
 
 fini:
+    zl_free(&zl_list);
     if (sg_fd >= 0) {
         res = sg_cmds_close_device(sg_fd);
         if (res < 0) {
@@ -14,6 +14,7 @@
 #include <stdarg.h>
 #include <stdbool.h>
 #include <string.h>
+#include <errno.h>
 #include <getopt.h>
 
 #ifdef HAVE_CONFIG_H
@@ -24,16 +25,21 @@
 #include "sg_cmds_basic.h"
 #include "sg_cmds_extra.h"
 #include "sg_unaligned.h"
+#include "sg_alua.h"
+#include "sg_par.h"
 #include "sg_pr2serr.h"
 
 /* A utility program for the Linux OS SCSI subsystem.
  *
  *
  * This program issues the SCSI command REPORT TARGET PORT GROUPS
- * to the given SCSI device.
+ * to the given SCSI device. When given several DEVICEs (e.g. all paths
+ * to a set of logical units) they are queried concurrently and the
+ * output is grouped by logical unit and target port group. With --ids
+ * only the identifiers of each DEVICE (path) are output, one line each.
  */
 
-static const char * version_str = "1.28 20230519";
+static const char * version_str = "1.30 20261015";
 
 #define REPORT_TGT_GRP_BUFF_LEN 1024
 
@@ -54,6 +60,8 @@ static struct option long_options[] = {
         {"extended", no_argument, 0, 'e'},
         {"help", no_argument, 0, 'h'},
         {"hex", no_argument, 0, 'H'},
+        {"ids", no_argument, 0, 'i'},
+        {"parallel", required_argument, 0, 'p'},
         {"raw", no_argument, 0, 'r'},
         {"readonly", no_argument, 0, 'R'},
         {"verbose", no_argument, 0, 'v'},
@@ -66,19 +74,30 @@ static void
 usage()
 {
     pr2serr("Usage: sg_rtpg   [--decode] [--extended] [--help] [--hex] "
-            "[--raw] [--readonly]\n"
-            "                 [--verbose] [--version] DEVICE\n"
+            "[--ids]\n"
+            "                 [--parallel=Q] [--raw] [--readonly] "
+            "[--verbose]\n"
+            "                 [--version] DEVICE [DEVICE...]\n"
             "  where:\n"
             "    --decode|-d        decode status and asym. access state\n"
             "    --extended|-e      use extended header parameter data "
             "format\n"
             "    --help|-h          print out usage message\n"
             "    --hex|-H           print out response in hex\n"
+            "    --ids|-i           only output the LU and target port "
+            "identifiers and\n"
+            "                       relative target port of each DEVICE, "
+            "one per line\n"
+            "    --parallel=Q|-p Q    with several DEVICEs, query at most Q "
+            "at once\n"
+            "                         (def: 32, with --ids: 256)\n"
             "    --raw|-r           output response in binary to stdout\n"
             "    --readonly|-R      open DEVICE read-only (def: read-write)\n"
             "    --verbose|-v       increase verbosity\n"
             "    --version|-V       print version string and exit\n\n"
-            "Performs a SCSI REPORT TARGET PORT GROUPS command\n");
+            "Performs a SCSI REPORT TARGET PORT GROUPS command. Several "
+            "DEVICEs (paths)\nare queried concurrently and output is "
+            "grouped by logical unit.\n");
 
 }
 
@@ -143,6 +162,170 @@ decode_tpgs_state(const int st)
     }
 }
 
+/* Outputs the paths of pa_arr grouped by logical unit, then by target port
+ * group. The states are taken from the first path to each logical unit
+ * that answered; a path that reports a different state for one of its
+ * groups is flagged. */
+static void
+pr_multi(const struct sg_alua_path * pa_arr, int num)
+{
+    bool * done_arr;
+    int k, j, n, i, n_paths, n_bad;
+    const struct sg_alua_path * pap;
+    const struct sg_alua_path * rep_p;
+    const struct sg_alua_path * qp;
+    const struct sg_alua_tpg * tp;
+    const struct sg_alua_tpg * t2p;
+
+    done_arr = (bool *)calloc(num, sizeof(bool));
+    if (NULL == done_arr)
+        return;
+    for (k = 0, pap = pa_arr; k < num; ++k, ++pap) {
+        if (done_arr[k] || (0 == pap->lu_id[0]))
+            continue;
+        rep_p = NULL;
+        for (j = k, n_paths = 0, n_bad = 0; j < num; ++j) {
+            qp = pa_arr + j;
+            if (0 != strcmp(qp->lu_id, pap->lu_id))
+                continue;
+            done_arr[j] = true;
+            ++n_paths;
+            if (qp->res)
+                ++n_bad;
+            else if (NULL == rep_p)
+                rep_p = qp;
+        }
+        printf("Logical unit: %s, %d path%s", pap->lu_id, n_paths,
+               (1 == n_paths) ? "" : "s");
+        if (n_bad)
+            printf(", %d failed", n_bad);
+        printf("\n");
+        for (i = 0; rep_p && (i < rep_p->num_tpgs); ++i) {
+            tp = rep_p->tpg_arr + i;
+            printf("  target port group id : 0x%x , Pref=%d : 0x%02x (%s)\n",
+                   tp->id, (int)tp->pref, tp->state,
+                   sg_alua_state_str(tp->state));
+            for (j = k, n = 0; j < num; ++j) {
+                qp = pa_arr + j;
+                if ((0 != strcmp(qp->lu_id, pap->lu_id)) ||
+                    (qp->tpg != tp->id))
+                    continue;
+                printf("    %s", qp->dev_name);
+                if (qp->rel_tport >= 0)
+                    printf("  [relative target port: 0x%x]", qp->rel_tport);
+                if (qp->res)
+                    printf("  <failed>");
+                else {
+                    t2p = sg_alua_find_tpg(qp, tp->id);
+                    if (t2p && (t2p->state != tp->state))
+                        printf("  <reports %s>",
+                               sg_alua_state_str(t2p->state));
+                }
+                printf("\n");
+                ++n;
+            }
+            if (0 == n)
+                printf("    <no path given>\n");
+        }
+        for (j = k; j < num; ++j) {     /* paths with no known group */
+            qp = pa_arr + j;
+            if (0 != strcmp(qp->lu_id, pap->lu_id))
+                continue;
+            if (rep_p && sg_alua_find_tpg(rep_p, qp->tpg))
+                continue;
+            printf("  target port group unknown\n    %s%s\n", qp->dev_name,
+                   qp->res ? "  <failed>" : "");
+        }
+    }
+    for (k = 0, n = 0, pap = pa_arr; k < num; ++k, ++pap) {
+        if (pap->lu_id[0])
+            continue;
+        if (0 == n++)
+            printf("Logical unit unknown:\n");
+        printf("    %s%s\n", pap->dev_name, pap->res ? "  <failed>" : "");
+    }
+    free(done_arr);
+}
+
+/* Fetches the Device Identification VPD page of num_devs paths
+ * concurrently, then outputs a line for each (in command line order): the
+ * DEVICE, its logical unit designator, its target port designator and
+ * its relative target port, "-" standing for those not found. No REPORT
+ * TARGET PORT GROUPS is sent. Returns 0 if all succeeded, else the result
+ * of the first DEVICE that failed. */
+static int
+rtpg_ids(const char ** dev_names, int num_devs, int num_parallel,
+         int verbose)
+{
+    int k, n_bad;
+    int ret = 0;
+    struct sg_alua_path * pa_arr;
+    struct sg_alua_path * pap;
+    char b[16];
+
+    pa_arr = (struct sg_alua_path *)calloc(num_devs, sizeof(*pa_arr));
+    if (NULL == pa_arr) {
+        pr2serr("%s: out of memory\n", __func__);
+        return sg_convert_errno(ENOMEM);
+    }
+    for (k = 0; k < num_devs; ++k) {
+        pa_arr[k].dev_name = dev_names[k];
+        pa_arr[k].vpd_only = true;
+    }
+    /* INQUIRY is permitted on a read-only open */
+    n_bad = sg_alua_discover(pa_arr, num_devs, num_parallel, true, verbose);
+    for (k = 0, pap = pa_arr; k < num_devs; ++k, ++pap) {
+        if (pap->rel_tport >= 0)
+            snprintf(b, sizeof(b), "0x%x", pap->rel_tport);
+        else
+            snprintf(b, sizeof(b), "-");
+        printf("%s %s %s %s\n", pap->dev_name,
+               pap->lu_id[0] ? pap->lu_id : "-",
+               pap->tport_id[0] ? pap->tport_id : "-", b);
+        if (verbose)
+            pr2serr("%s: %d ms\n", pap->dev_name, (int)pap->elapsed_ms);
+        if (pap->res && (0 == ret))
+            ret = pap->res;
+    }
+    if (n_bad)
+        pr2serr("%d of %d DEVICEs failed\n", n_bad, num_devs);
+    free(pa_arr);
+    return ret;
+}
+
+/* Queries num_devs paths concurrently. Returns 0 if all succeeded, else
+ * the result of the first DEVICE (in command line order) that failed. */
+static int
+rtpg_multi(const char ** dev_names, int num_devs, int num_parallel,
+           bool o_readonly, int verbose)
+{
+    int k, n_bad;
+    int ret = 0;
+    struct sg_alua_path * pa_arr;
+
+    pa_arr = (struct sg_alua_path *)calloc(num_devs, sizeof(*pa_arr));
+    if (NULL == pa_arr) {
+        pr2serr("%s: out of memory\n", __func__);
+        return sg_convert_errno(ENOMEM);
+    }
+    for (k = 0; k < num_devs; ++k)
+        pa_arr[k].dev_name = dev_names[k];
+    n_bad = sg_alua_discover(pa_arr, num_devs, num_parallel, o_readonly,
+                             verbose);
+    pr_multi(pa_arr, num_devs);
+    for (k = 0; k < num_devs; ++k) {
+        if (verbose)
+            pr2serr("%s: %d ms\n", pa_arr[k].dev_name,
+                    (int)pa_arr[k].elapsed_ms);
+        if (pa_arr[k].res && (0 == ret))
+            ret = pa_arr[k].res;
+    }
+    if (n_bad)
+        pr2serr("%d of %d DEVICEs failed\n", n_bad, num_devs);
+    free(pa_arr);
+    return ret;
+}
+
 int
 main(int argc, char * argv[])
 {
@@ -151,20 +334,25 @@ main(int argc, char * argv[])
     bool raw = false;
     bool o_readonly = false;
     bool extended = false;
+    bool ids = false;
+    bool parallel_given = false;
     bool verbose_given = false;
     bool version_given = false;
     int k, j, off, res, c, report_len, buff_len, tgt_port_count;
     int sg_fd = -1;
+    int num_devs = 0;
+    int num_parallel = SG_ALUA_DEF_PARALLEL;
     int ret = 0;
     int verbose = 0;
     uint8_t * reportTgtGrpBuff = NULL;
     uint8_t * bp;
     const char * device_name = NULL;
+    const char ** dev_names = NULL;
 
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "dehHrRvV", long_options,
+        c = getopt_long(argc, argv, "dehHip:rRvV", long_options,
                         &option_index);
         if (c == -1)
             break;
@@ -183,6 +371,15 @@ main(int argc, char * argv[])
         case 'H':
             hex = true;
             break;
+        case 'i':
+            ids = true;
+            break;
+        case 'p':
+            parallel_given = true;
+            num_parallel = sg_par_get_num(optarg, 1, SG_ALUA_MAX_PARALLEL);
+            if (num_parallel < 0)
+                return SG_LIB_SYNTAX_ERROR;
+            break;
         case 'r':
             raw = true;
             break;
@@ -203,16 +400,9 @@ main(int argc, char * argv[])
         }
     }
     if (optind < argc) {
-        if (NULL == device_name) {
-            device_name = argv[optind];
-            ++optind;
-        }
-        if (optind < argc) {
-            for (; optind < argc; ++optind)
-                pr2serr("Unexpected extra argument: %s\n", argv[optind]);
-            usage();
-            return SG_LIB_SYNTAX_ERROR;
-        }
+        device_name = argv[optind];
+        dev_names = (const char **)(argv + optind);
+        num_devs = argc - optind;
     }
 #ifdef DEBUG
     pr2serr("In DEBUG mode, ");
@@ -239,6 +429,27 @@ main(int argc, char * argv[])
         usage();
         return SG_LIB_SYNTAX_ERROR;
     }
+    if (ids) {
+        if (raw || hex || extended) {
+            pr2serr("--raw, --hex and --extended are not permitted with "
+                    "--ids\n");
+            return SG_LIB_CONTRADICT;
+        }
+        /* a thread per path unless told otherwise, it is mostly waiting */
+        if (! parallel_given)
+            num_parallel = SG_ALUA_MAX_PARALLEL;
+        ret = rtpg_ids(dev_names, num_devs, num_parallel, verbose);
+        goto err_out;
+    }
+    if (num_devs > 1) {
+        if (raw || hex || extended) {
+            pr2serr("--raw, --hex and --extended need a single DEVICE\n");
+            return SG_LIB_CONTRADICT;
+        }
+        ret = rtpg_multi(dev_names, num_devs, num_parallel, o_readonly,
+                         verbose);
+        goto err_out;
+    }
     if (raw) {
         if (sg_set_binary_mode(STDOUT_FILENO) < 0) {
             perror("sg_set_binary_mode");
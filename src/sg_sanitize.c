@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2011-2023 Douglas Gilbert.
+ * Copyright (c) 2011-2026 Douglas Gilbert.
  * All rights reserved.
  * Use of this source code is governed by a BSD-style
  * license that can be found in the BSD_LICENSE file.
@@ -32,10 +32,13 @@
 #include "sg_cmds_extra.h"
 #include "sg_unaligned.h"
 #include "sg_pr2serr.h"
+#include "sg_json.h"
+#include "sg_mpoll.h"
 
-static const char * version_str = "1.21 20230503";
+static const char * version_str = "1.22 20261014";
 
-#define ME "sg_sanitize: "
+#define MY_NAME "sg_sanitize"
+#define ME MY_NAME ": "
 
 #define SANITIZE_OP 0x48
 #define SANITIZE_OP_LEN 10
@@ -67,6 +70,9 @@ static struct option long_options[] = {
     {"help", no_argument, 0, 'h'},
     {"invert", no_argument, 0, 'I'},
     {"ipl", required_argument, 0, 'i'},
+    {"js-file", required_argument, 0, 'J'},
+    {"js_file", required_argument, 0, 'J'},
+    {"json", optional_argument, 0, '^'},    /* short option is '-j' */
     {"overwrite", no_argument, 0, 'O'},
     {"pattern", required_argument, 0, 'p'},
     {"quick", no_argument, 0, 'Q'},
@@ -77,6 +83,7 @@ static struct option long_options[] = {
     {"version", no_argument, 0, 'V'},
     {"wait", no_argument, 0, 'w'},
     {"zero", no_argument, 0, 'z'},
+    {"znr", no_argument, 0, 'Z'},
     {0, 0, 0, 0},
 };
 
@@ -85,10 +92,12 @@ struct opts_t {
     bool block;
     bool crypto;
     bool desc;
+    bool do_json;
     bool dry_run;
     bool early;
     bool fail;
     bool invert;
+    bool multi;         /* several DEVICEs or --json given */
     bool overwrite;
     bool quick;
     bool verbose_given;
@@ -97,11 +106,16 @@ struct opts_t {
     bool znr;
     int count;
     int ipl;    /* initialization pattern length */
+    int num_devs;
     int test;
     int timeout;        /* in seconds */
     int verbose;
     int zero;
     const char * pattern_fn;
+    const char * json_arg;
+    const char * js_file;
+    char ** dev_names;
+    sgj_state json_st;
 };
 
 
@@ -112,11 +126,12 @@ usage()
           "[--dry-run]\n"
           "                   [--early] [--fail] [--help] [--invert] "
           "[--ipl=LEN]\n"
-          "                   [--overwrite] [--pattern=PF] [--quick] "
-          "[--test=TE]\n"
-          "                   [--timeout=SECS] [--verbose] [--version] "
-          "[--wait]\n"
-          "                   [--zero] [--znr] DEVICE\n"
+          "                   [--js-file=JFN] [--json[=JO]] [--overwrite] "
+          "[--pattern=PF]\n"
+          "                   [--quick] [--test=TE] [--timeout=SECS] "
+          "[--verbose]\n"
+          "                   [--version] [--wait] [--zero] [--znr] "
+          "DEVICE [DEVICE...]\n"
           "  where:\n"
           "    --ause|-A            set AUSE bit in cdb\n"
           "    --block|-B           do BLOCK ERASE sanitize\n"
@@ -138,6 +153,13 @@ usage()
           "list\n"
           "    --ipl=LEN|-i LEN     initialization pattern length (in "
           "bytes)\n"
+          "    --js-file=JFN|-J JFN    JFN is a filename to which JSON "
+          "output is\n"
+          "                            written (def: stdout); truncates "
+          "then writes\n"
+          "    --json[=JO]|-j[=JO]    output in JSON instead of plain "
+          "text\n"
+          "                           use --json=? for JSON help\n"
           "    --overwrite|-O       do OVERWRITE sanitize\n"
           "    --pattern=PF|-p PF    PF is file containing initialization "
           "pattern\n"
@@ -162,7 +184,9 @@ usage()
           "reconsider; then execute SANITIZE\ncommand with IMMED bit set; "
           "then use REQUEST SENSE command every 60\nseconds to poll for a "
           "progress indication; then exit when there is no\nmore progress "
-          "indication.\n"
+          "indication. With several DEVICEs the SANITIZE is started on "
+          "all of them,\nthen they are polled together and a table of "
+          "their progress is output.\n"
           );
 }
 
@@ -344,7 +368,8 @@ get_lu_name(const uint8_t * bp, int u_len, char * b, int b_len)
 #define VPD_DEVICE_ID 0x83
 
 static int
-print_dev_id(int fd, uint8_t * sinq_resp, int max_rlen, int verbose)
+print_dev_id(int fd, uint8_t * sinq_resp, int max_rlen, int verbose,
+             sgj_state * jsp)
 {
     int res, k, n, verb, pdt, has_sn, has_di;
     uint8_t b[256];
@@ -363,14 +388,14 @@ print_dev_id(int fd, uint8_t * sinq_resp, int max_rlen, int verbose)
     memcpy(sinq_resp, b, (n < max_rlen) ? n : max_rlen);
     if (n == SAFE_STD_INQ_RESP_LEN) {
         pdt = b[0] & PDT_MASK;
-        printf("    %.8s  %.16s  %.4s   peripheral_type: %s [0x%x]\n",
-               (const char *)(b + 8), (const char *)(b + 16),
-               (const char *)(b + 32),
-               sg_get_pdt_str(pdt, sizeof(pdt_name), pdt_name), pdt);
+        sgj_pr_hr(jsp, "    %.8s  %.16s  %.4s   peripheral_type: %s "
+                  "[0x%x]\n", (const char *)(b + 8), (const char *)(b + 16),
+                  (const char *)(b + 32),
+                  sg_get_pdt_str(pdt, sizeof(pdt_name), pdt_name), pdt);
         if (verbose)
-            printf("      PROTECT=%d\n", !!(b[5] & 1));
+            sgj_pr_hr(jsp, "      PROTECT=%d\n", !!(b[5] & 1));
         if (b[5] & 1)
-            printf("      << supports protection information>>\n");
+            sgj_pr_hr(jsp, "      << supports protection information>>\n");
     } else {
         pr2serr("Short INQUIRY response: %d bytes, expect at least 36\n", n);
         return SG_LIB_CAT_OTHER;
@@ -414,7 +439,8 @@ print_dev_id(int fd, uint8_t * sinq_resp, int max_rlen, int verbose)
         n = sg_get_unaligned_be16(b + 2);
         if (n > (int)(sizeof(b) - 4))
             n = (sizeof(b) - 4);
-        printf("      Unit serial number: %.*s\n", n, (const char *)(b + 4));
+        sgj_pr_hr(jsp, "      Unit serial number: %.*s\n", n,
+                  (const char *)(b + 4));
     }
     if (has_di) {
         res = sg_ll_inquiry(fd, false, true /* evpd */, VPD_DEVICE_ID, b,
@@ -434,11 +460,96 @@ print_dev_id(int fd, uint8_t * sinq_resp, int max_rlen, int verbose)
             n = (sizeof(b) - 4);
         n = strlen(get_lu_name(b, n + 4, a, sizeof(a)));
         if (n > 0)
-            printf("      LU name: %.*s\n", n, a);
+            sgj_pr_hr(jsp, "      LU name: %.*s\n", n, a);
     }
     return 0;
 }
 
+/* Starts the SANITIZE (with IMMED set) on each DEVICE in turn, then polls
+ * all of them from one loop. Returns the exit status of the first DEVICE
+ * that failed, else 0. */
+static int
+sanitize_fleet(struct opts_t * op, const uint8_t * wBuff, int param_lst_len,
+               sgj_opaque_p jop)
+{
+    int k, res, len;
+    int ret = 0;
+    int vb = op->verbose;
+    char * names;
+    struct sg_mpoll_dev * mdp_arr;
+    struct sg_mpoll_dev * mdp;
+    struct sg_mpoll_opts mpo;
+    sgj_state * jsp = &op->json_st;
+    uint8_t inq_resp[SAFE_STD_INQ_RESP_LEN];
+    char b[80];
+
+    mdp_arr = (struct sg_mpoll_dev *)calloc(op->num_devs, sizeof(*mdp_arr));
+    if (NULL == mdp_arr) {
+        pr2serr("%s: unable to obtain heap\n", __func__);
+        return sg_convert_errno(ENOMEM);
+    }
+    for (k = 0, len = 0, mdp = mdp_arr; k < op->num_devs; ++k, ++mdp) {
+        mdp->dev_name = op->dev_names[k];
+        mdp->progress = -1;
+        mdp->use_rs = true;
+        mdp->desc = op->desc;
+        len += strlen(mdp->dev_name) + 2;
+        sgj_pr_hr(jsp, "%s:\n", mdp->dev_name);
+        mdp->sg_fd = sg_cmds_open_device(mdp->dev_name, false /* rw */, vb);
+        if (mdp->sg_fd < 0) {
+            pr2serr(ME "open error: %s: %s\n", mdp->dev_name,
+                    safe_strerror(-mdp->sg_fd));
+            mdp->res = sg_convert_errno(-mdp->sg_fd);
+            mdp->sg_fd = -1;
+            continue;
+        }
+        mdp->res = print_dev_id(mdp->sg_fd, inq_resp, sizeof(inq_resp), vb,
+                                jsp);
+    }
+    if ((! op->quick) && (! op->fail)) {
+        names = (char *)calloc(len + 1, 1);
+        for (k = 0, mdp = mdp_arr; names && (k < op->num_devs); ++k, ++mdp) {
+            if (mdp->res)
+                continue;
+            if (names[0])
+                strcat(names, ", ");
+            strcat(names, mdp->dev_name);
+        }
+        sg_warn_and_wait("SANITIZE", (names ? names : "all DEVICEs"), true);
+        free(names);
+    }
+    for (k = 0, mdp = mdp_arr; k < op->num_devs; ++k, ++mdp) {
+        if (mdp->res)
+            continue;
+        res = do_sanitize(mdp->sg_fd, op, wBuff, param_lst_len);
+        if (res) {
+            sg_get_category_sense_str(res, sizeof(b), b, vb);
+            pr2serr("Sanitize failed on %s: %s\n", mdp->dev_name, b);
+            mdp->res = (res > 0) ? res : SG_LIB_CAT_OTHER;
+        } else if (! op->dry_run)
+            sg_mpoll_started(mdp, mdp->sg_fd, true, 0);
+    }
+    if ((! op->early) && (! op->dry_run)) {
+        memset(&mpo, 0, sizeof(mpo));
+        mpo.max_secs = POLL_DURATION_SECS;
+        mpo.verbose = vb;
+        sg_mpoll_run(mdp_arr, op->num_devs, "SANITIZE", &mpo, jsp);
+    }
+    sg_mpoll_js(jsp, jop, mdp_arr, op->num_devs);
+    for (k = 0, mdp = mdp_arr; k < op->num_devs; ++k, ++mdp) {
+        if (mdp->res && (0 == ret))
+            ret = mdp->res;
+        if (mdp->sg_fd >= 0) {
+            res = sg_cmds_close_device(mdp->sg_fd);
+            if (res < 0)
+                pr2serr("close error: %s: %s\n", mdp->dev_name,
+                        safe_strerror(-res));
+        }
+    }
+    free(mdp_arr);
+    return ret;
+}
+
 
 int
 main(int argc, char * argv[])
@@ -449,6 +560,8 @@ main(int argc, char * argv[])
     int param_lst_len = 0;
     int ret = -1;
     const char * device_name = NULL;
+    sgj_state * jsp;
+    sgj_opaque_p jop = NULL;
     char ebuff[EBUFF_SZ];
     char b[80];
     uint8_t rsBuff[DEF_REQS_RESP_LEN];
@@ -461,11 +574,12 @@ main(int argc, char * argv[])
 
     op = &opts;
     memset(op, 0, sizeof(opts));
+    jsp = &op->json_st;
     op->count = 1;
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "ABc:CdDeFhi:IOp:Qt:T:vVwzZ",
+        c = getopt_long(argc, argv, "ABc:CdDeFhi:Ij::J:Op:Qt:T:vVwzZ",
                         long_options, &option_index);
         if (c == -1)
             break;
@@ -513,6 +627,17 @@ main(int argc, char * argv[])
         case 'I':
             op->invert = true;
             break;
+        case 'j':       /* for: -j[=JO] */
+        case '^':       /* for: --json[=JO] */
+            op->do_json = true;
+            /* Now want '=' to be optional as well as JO */
+            op->json_arg = (('j' == c) && optarg && ('=' == *optarg)) ?
+                           optarg + 1 : optarg;
+            break;
+        case 'J':
+            op->do_json = true;
+            op->js_file = optarg;
+            break;
         case 'O':
             op->overwrite = true;
             break;
@@ -559,16 +684,9 @@ main(int argc, char * argv[])
         }
     }
     if (optind < argc) {
-        if (NULL == device_name) {
-            device_name = argv[optind];
-            ++optind;
-        }
-        if (optind < argc) {
-            for (; optind < argc; ++optind)
-                pr2serr("Unexpected extra argument: %s\n", argv[optind]);
-            usage();
-            return SG_LIB_SYNTAX_ERROR;
-        }
+        device_name = argv[optind];
+        op->dev_names = argv + optind;
+        op->num_devs = argc - optind;
     }
 #ifdef DEBUG
     pr2serr("In DEBUG mode, ");
@@ -597,6 +715,12 @@ main(int argc, char * argv[])
         return SG_LIB_SYNTAX_ERROR;
     }
     vb = op->verbose;
+    op->multi = ((op->num_devs > 1) || op->do_json);
+    if (op->multi && op->wait) {
+        pr2serr("with several DEVICEs or '--json' the '--wait' option is "
+                "not permitted\n");
+        return SG_LIB_CONTRADICT;
+    }
     n = (int)op->block + (int)op->crypto + (int)op->fail + (int)op->overwrite;
     if (1 != n) {
         pr2serr("one and only one of '--block', '--crypto', '--fail' or "
@@ -644,19 +768,6 @@ main(int argc, char * argv[])
         }
     }
 
-    sg_fd = sg_cmds_open_device(device_name, false /* rw */, vb);
-    if (sg_fd < 0) {
-        if (op->verbose)
-            pr2serr(ME "open error: %s: %s\n", device_name,
-                    safe_strerror(-sg_fd));
-        ret = sg_convert_errno(-sg_fd);
-        goto err_out;
-    }
-
-    ret = print_dev_id(sg_fd, inq_resp, sizeof(inq_resp), op->verbose);
-    if (ret)
-        goto err_out;
-
     if (op->overwrite) {
         param_lst_len = op->ipl + 4;
         wBuff = (uint8_t*)sg_memalign(op->ipl + 4, 0, &free_wBuff, false);
@@ -714,6 +825,39 @@ main(int argc, char * argv[])
         sg_put_unaligned_be16((uint16_t)op->ipl, wBuff + 2);
     }
 
+    if (op->do_json) {
+        if (! sgj_init_state(jsp, op->json_arg)) {
+            int bad_char = jsp->first_bad_char;
+            char e[1500];
+
+            if (bad_char)
+                pr2serr("bad argument to --json= option, unrecognized "
+                        "character '%c'\n\n", bad_char);
+            sg_json_usage(0, e, sizeof(e));
+            pr2serr("%s", e);
+            ret = SG_LIB_SYNTAX_ERROR;
+            goto err_out;
+        }
+        jop = sgj_start_r(MY_NAME, version_str, argc, argv, jsp);
+    }
+    if (op->multi) {
+        ret = sanitize_fleet(op, wBuff, param_lst_len, jop);
+        goto err_out;
+    }
+
+    sg_fd = sg_cmds_open_device(device_name, false /* rw */, vb);
+    if (sg_fd < 0) {
+        if (op->verbose)
+            pr2serr(ME "open error: %s: %s\n", device_name,
+                    safe_strerror(-sg_fd));
+        ret = sg_convert_errno(-sg_fd);
+        goto err_out;
+    }
+
+    ret = print_dev_id(sg_fd, inq_resp, sizeof(inq_resp), op->verbose, jsp);
+    if (ret)
+        goto err_out;
+
     if ((! op->quick) && (! op->fail))
         sg_warn_and_wait("SANITIZE", device_name, true);
 
@@ -773,8 +917,8 @@ main(int argc, char * argv[])
                 /* N.B. exits first time there isn't a progress indication */
                 break;
             } else
-                printf("Progress indication: %d%% done\n",
-                       (progress * 100) / 65536);
+                sgj_pr_hr(jsp, "Progress indication: %d%% done\n",
+                          (progress * 100) / 65536);
         }
     }
 
@@ -794,5 +938,34 @@ err_out:
             pr2serr("Some error occurred, try again with '-v' "
                     "or '-vv' for more information\n");
     }
-    return (ret >= 0) ? ret : SG_LIB_CAT_OTHER;
+    ret = (ret >= 0) ? ret : SG_LIB_CAT_OTHER;
+    if (jsp->pr_as_json) {
+        FILE * fp = stdout;
+
+        if (op->js_file) {
+            if ((1 != strlen(op->js_file)) || ('-' != op->js_file[0])) {
+                fp = fopen(op->js_file, "w");   /* truncate if exists */
+                if (NULL == fp) {
+                    err = errno;
+                    pr2serr("unable to open file: %s [%s]\n", op->js_file,
+                            safe_strerror(err));
+                    ret = sg_convert_errno(err);
+                }
+            }
+            /* '--js-file=-' will send JSON output to stdout */
+        }
+        if (fp) {
+            const char * estr = NULL;
+
+            if (sg_exit2str(ret, jsp->verbose, sizeof(b), b)) {
+                if (strlen(b) > 0)
+                    estr = b;
+            }
+            sgj_js2file_estr(jsp, NULL, ret, estr, fp);
+        }
+        if (op->js_file && fp && (stdout != fp))
+            fclose(fp);
+        sgj_finish(jsp);
+    }
+    return ret;
 }
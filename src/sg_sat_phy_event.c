@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2006-2023 Douglas Gilbert.
+ * Copyright (c) 2006-2026 Douglas Gilbert.
  * All rights reserved.
  * Use of this source code is governed by a BSD-style
  * license that can be found in the BSD_LICENSE file.
@@ -22,13 +22,14 @@
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
-
 #include "sg_lib.h"
 #include "sg_cmds_basic.h"
 #include "sg_cmds_extra.h"
+#include "sg_unaligned.h"
+#include "sg_par.h"
 #include "sg_pr2serr.h"
 
-static const char * version_str = "1.16 20230519";
+static const char * version_str = "1.18 20261015";
 
 /* This program uses a ATA PASS-THROUGH SCSI command. This usage is
  * defined in the SCSI to ATA Translation (SAT) drafts and standards.
@@ -41,7 +42,8 @@ static const char * version_str = "1.16 20230519";
 
 /* This program uses a ATA PASS-THROUGH (16 or 12) SCSI command defined
  * by SAT to package an ATA READ LOG EXT (2Fh) command to fetch
- * log page 11h. That page contains SATA phy event counters.
+ * log page 11h. That page contains SATA phy event counters. When polling
+ * or given several DEVICEs it also sends IDENTIFY DEVICE (ECh).
  * For ATA READ LOG EXT command see ATA-8/ACS at www.t13.org .
  * For SATA phy counter definitions see SATA 2.5 .
  *
@@ -56,6 +58,7 @@ static const char * version_str = "1.16 20230519";
 #define ASCQ_ATA_PT_INFO_AVAILABLE 0x1d
 
 #define ATA_READ_LOG_EXT 0x2f
+#define ATA_IDENTIFY_DEVICE 0xec
 #define SATA_PHY_EVENT_LPAGE 0x11
 #define READ_LOG_EXT_RESPONSE_LEN 512
 
@@ -63,13 +66,19 @@ static const char * version_str = "1.16 20230519";
 
 #define EBUFF_SZ 256
 
+#define PHY_MAX_PARALLEL 64
+#define PHY_DEF_PARALLEL 8
+
 static struct option long_options[] = {
         {"ck_cond", no_argument, 0, 'c'},
         {"ck-cond", no_argument, 0, 'c'},
         {"extend", no_argument, 0, 'e'},
         {"hex", no_argument, 0, 'H'},
         {"ignore", no_argument, 0, 'i'},
-        {"len", no_argument, 0, 'l'},
+        {"interval", required_argument, 0, 'I'},
+        {"len", required_argument, 0, 'l'},
+        {"num", required_argument, 0, 'n'},
+        {"parallel", required_argument, 0, 'p'},
         {"raw", no_argument, 0, 'r'},
         {"reset", no_argument, 0, 'R'},
         {"help", no_argument, 0, 'h'},
@@ -111,9 +120,11 @@ usage()
 {
     pr2serr("Usage: sg_sat_phy_event [--ck_cond] [--extend] [--help] [--hex] "
             "[--ignore]\n"
-            "                        [--len=16|12] [--raw] [--reset] "
+            "                        [--interval=SECS] [--len=16|12] "
+            "[--num=NUM]\n"
+            "                        [--parallel=Q] [--raw] [--reset] "
             "[--verbose]\n"
-            "                        [--version] DEVICE\n"
+            "                        [--version] DEVICE [DEVICE...]\n"
             "  where:\n"
             "    --ck_cond|-c    sets ck_cond bit in cdb (def: 0)\n"
             "    --extend|-e     sets extend bit in cdb (def: 0)\n"
@@ -122,14 +133,25 @@ usage()
             "                    hex words\n"
             "    --ignore|-i     ignore identifier names, output id value "
             "instead\n"
+            "    --interval=SECS|-I SECS    poll every SECS seconds, each "
+            "DEVICE\n"
+            "                               is kept open between polls\n"
             "    --len=16|12 | -l 16|12    cdb length: 16 or 12 bytes "
             "(default: 16)\n"
+            "    --num=NUM|-n NUM    number of polls (def: 1; with "
+            "--interval=SECS\n"
+            "                        0 which is until killed)\n"
+            "    --parallel=Q|-p Q    poll up to Q DEVICEs at once (def: "
+            "8)\n"
             "    --raw|-r        output response in binary to stdout\n"
             "    --reset|-R      reset counters (after read)\n"
             "    --verbose|-v    increase verbosity\n"
             "    --version|-V    print version string then exit\n\n"
             "Sends an ATA READ LOG EXT command via a SAT pass through to "
-            "fetch\nlog page 11h which contains SATA phy event counters\n");
+            "fetch\nlog page 11h which contains SATA phy event counters. "
+            "With several DEVICEs\nor --interval=SECS each DEVICE's "
+            "IDENTIFY DEVICE data is also fetched\nand then held until a "
+            "reset is detected.\n");
 }
 
 static const char *
@@ -153,13 +175,14 @@ dStrRaw(const uint8_t * str, int len)
         printf("%c", str[k]);
 }
 
-/* ATA READ LOG EXT command [2Fh, PIO data-in] */
+/* ATA READ LOG EXT command [2Fh, PIO data-in] or another PIO data-in
+ * command given by ata_cmd (e.g. IDENTIFY DEVICE [ECh]) */
 /* N.B. "log_addr" is the log page number, "page_in_log" is usually 0 */
 static int
-do_read_log_ext(int sg_fd, int log_addr, int page_in_log, int feature,
-                int blk_count, void * resp, int mx_resp_len, int cdb_len,
-                bool ck_cond, bool extend, int do_hex, bool do_raw,
-                int verbose)
+do_ata_data_in(int sg_fd, int ata_cmd, int log_addr, int page_in_log,
+               int feature, int blk_count, void * resp, int mx_resp_len,
+               int cdb_len, bool ck_cond, bool extend, int do_hex,
+               bool do_raw, int verbose)
 {
     /* Following for ATA READ/WRITE MULTIPLE (EXT) cmds, normally 0 */
 #if 0
@@ -198,7 +221,7 @@ do_read_log_ext(int sg_fd, int log_addr, int page_in_log, int feature,
         apt_cdb[9] = (page_in_log >> 8) & 0xff;
                 /* lba_mid(15:8) == LBA(39:32) */
         apt_cdb[10] = page_in_log & 0xff; /* lba_mid(7:0) == LBA(15:8) */
-        apt_cdb[14] = ATA_READ_LOG_EXT;
+        apt_cdb[14] = ata_cmd;
         apt_cdb[1] = (multiple_count << 5) | (protocol << 1);
         if (extend)
             apt_cdb[1] |= 0x1;
@@ -223,7 +246,7 @@ do_read_log_ext(int sg_fd, int log_addr, int page_in_log, int feature,
         apt12_cdb[4] = blk_count & 0xff;        /* sector_count(7:0) */
         apt12_cdb[5] = log_addr & 0xff;  /* lba_low(7:0) == LBA(7:0) */
         apt12_cdb[6] = page_in_log & 0xff; /* lba_mid(7:0) == LBA(15:8) */
-        apt12_cdb[9] = ATA_READ_LOG_EXT;
+        apt12_cdb[9] = ata_cmd;
         apt12_cdb[1] = (multiple_count << 5) | (protocol << 1);
         apt12_cdb[2] = t_length;
         if (ck_cond)
@@ -366,6 +389,259 @@ do_read_log_ext(int sg_fd, int log_addr, int page_in_log, int feature,
     return 0;
 }
 
+/* Places the value of the phy event counter with identifier id (vendor
+ * bit clear) from the log page in buff into *valp. Returns true if found */
+static bool
+get_phy_counter(const uint8_t * buff, int id, uint64_t * valp)
+{
+    int k, j, len, an_id;
+    uint64_t ull;
+
+    for (k = 4; k < 512; k += (len + 2)) {
+        an_id = sg_get_unaligned_le16(buff + k);
+        if (0 == an_id)
+            break;
+        len = ((an_id >> 12) & 0x7) * 2;
+        if ((k + 2 + len) > 512)
+            break;
+        if ((an_id & 0x8fff) != id)
+            continue;
+        for (ull = 0, j = len - 1; j >= 0; --j)
+            ull = (ull << 8) | buff[k + 2 + j];
+        *valp = ull;
+        return true;
+    }
+    return false;
+}
+
+static void
+show_phy_events(const uint8_t * buff, bool ignore, const char * leadin)
+{
+    int k, j, id, len, vendor;
+    uint64_t ull;
+    const char * cp;
+
+    for (k = 4; k < 512; k += (len + 2)) {
+        id = (buff[k + 1] << 8) + buff[k];
+        if (0 == id)
+            break;
+        len = ((id >> 12) & 0x7) * 2;
+        vendor = !!(id & 0x8000);
+        id = id & 0xfff;
+        ull = 0;
+        for (j = len - 1; j >= 0; --j) {
+            if (j < (len - 1))
+                ull <<= 8;
+            ull |= buff[k + 2 + j];
+        }
+        cp = NULL;
+        if ((0 == vendor) && (! ignore))
+            cp = find_phy_desc(id);
+        if (cp)
+            printf("%s%s: %" PRIu64 "\n", leadin, cp, ull);
+        else
+            printf("%sid=0x%x, vendor=%d, data_len=%d, "
+                   "val=%" PRIu64 "\n", leadin, id, vendor, len, ull);
+    }
+}
+
+/* ATA strings in IDENTIFY DEVICE data have the two bytes of each word
+ * swapped. Places num_words words starting at word_off into b with
+ * trailing spaces removed. */
+static void
+ata_ident_str(const uint8_t * ident, int word_off, int num_words, char * b)
+{
+    int k;
+    const uint8_t * bp = ident + (2 * word_off);
+
+    for (k = 0; k < num_words; ++k) {
+        b[2 * k] = bp[(2 * k) + 1];
+        b[(2 * k) + 1] = bp[2 * k];
+    }
+    for (k = 2 * num_words; (k > 0) && (' ' == b[k - 1]); --k)
+        ;
+    b[k] = '\0';
+}
+
+/* One per DEVICE when polling or given several DEVICEs. The file
+ * descriptor is kept open, and the IDENTIFY DEVICE data kept, across
+ * polls. */
+struct phy_dev_t {
+    bool ident_valid;   /* cleared when a reset is detected */
+    bool have_comreset;
+    int sg_fd;
+    int res;            /* of this poll: 0 or SG_LIB_CAT_* */
+    int num_idents;     /* IDENTIFY DEVICE commands sent */
+    uint64_t comreset;  /* phy event counter 0xa at previous poll */
+    const char * dev_name;
+    uint8_t ident[512];
+    uint8_t log[READ_LOG_EXT_RESPONSE_LEN];
+};
+
+struct phy_work_t {
+    bool ck_cond;
+    bool extend;
+    bool reset;
+    int cdb_len;
+    int num_devs;
+    int verbose;
+    struct phy_dev_t * dev_arr;
+};
+
+/* Polls one DEVICE: IDENTIFY DEVICE unless that is held from an earlier
+ * poll, then READ LOG EXT of the phy event counters. A unit attention or
+ * an increase in the COMRESET signature counter (id 0xa) means the drive
+ * has been reset, so the held IDENTIFY DEVICE data is fetched again. */
+static int
+phy_poll_dev(struct phy_work_t * wp, struct phy_dev_t * dp)
+{
+    bool got;
+    int k, res;
+    uint64_t ull = 0;
+
+    for (k = 0; k < 2; ++k) {   /* second time only after unit attention */
+        if (! dp->ident_valid) {
+            res = do_ata_data_in(dp->sg_fd, ATA_IDENTIFY_DEVICE, 0, 0, 0, 1,
+                                 dp->ident, sizeof(dp->ident), wp->cdb_len,
+                                 wp->ck_cond, wp->extend, 0, false,
+                                 wp->verbose);
+            if (SG_LIB_CAT_UNIT_ATTENTION == res)
+                continue;
+            if (res)
+                return res;
+            dp->ident_valid = true;
+            ++dp->num_idents;
+        }
+        res = do_ata_data_in(dp->sg_fd, ATA_READ_LOG_EXT,
+                             SATA_PHY_EVENT_LPAGE, 0 /* page_in_log */,
+                             (wp->reset ? 1 : 0) /* feature */,
+                             1 /* blk_count */, dp->log, sizeof(dp->log),
+                             wp->cdb_len, wp->ck_cond, wp->extend, 0, false,
+                             wp->verbose);
+        if (SG_LIB_CAT_UNIT_ATTENTION == res) {
+            dp->ident_valid = false;
+            continue;
+        }
+        break;
+    }
+    if (res)
+        return res;
+    got = get_phy_counter(dp->log, 0xa, &ull);
+    if (got && dp->have_comreset && (ull > dp->comreset)) {
+        if (wp->verbose)
+            pr2serr("%s: COMRESET seen, IDENTIFY DEVICE again\n",
+                    dp->dev_name);
+        res = do_ata_data_in(dp->sg_fd, ATA_IDENTIFY_DEVICE, 0, 0, 0, 1,
+                             dp->ident, sizeof(dp->ident), wp->cdb_len,
+                             wp->ck_cond, wp->extend, 0, false, wp->verbose);
+        dp->ident_valid = (0 == res);
+        if (0 == res)
+            ++dp->num_idents;
+    }
+    dp->have_comreset = got;
+    /* after --reset the counters start again from 0 */
+    dp->comreset = wp->reset ? 0 : ull;
+    return 0;
+}
+
+static int
+phy_poll_one(int64_t k, void * ctx)
+{
+    int res;
+    struct phy_work_t * wp = (struct phy_work_t *)ctx;
+
+    res = phy_poll_dev(wp, wp->dev_arr + k);
+    wp->dev_arr[k].res = (res >= 0) ? res : SG_LIB_CAT_OTHER;
+    return 0;
+}
+
+/* Handles several DEVICEs and/or --interval=SECS. Each DEVICE is opened
+ * once and polled num_polls times (0 -> until killed). After each poll
+ * the results are output in DEVICE order. Returns 0 if every poll of
+ * every DEVICE succeeded, else the first (in DEVICE order) error of the
+ * last poll that had one. */
+static int
+phy_multi(char * dev_names[], int num_devs, int interval, int num_polls,
+          int num_q, bool ignore, int hex, struct phy_work_t * wp)
+{
+    int k, n, res, err, poll_ret;
+    int ret = 0;
+    struct phy_dev_t * dp;
+    char m[48];
+    char s[24];
+    char f[12];
+    char b[80];
+
+    wp->dev_arr = (struct phy_dev_t *)calloc(num_devs, sizeof(*dp));
+    if (NULL == wp->dev_arr) {
+        pr2serr("%s: out of memory\n", __func__);
+        return sg_convert_errno(ENOMEM);
+    }
+    wp->num_devs = num_devs;
+    for (k = 0, dp = wp->dev_arr; k < num_devs; ++k, ++dp)
+        dp->sg_fd = -1;
+    for (k = 0, dp = wp->dev_arr; k < num_devs; ++k, ++dp) {
+        dp->dev_name = dev_names[k];
+        dp->sg_fd = open(dp->dev_name, O_RDWR);
+        if (dp->sg_fd < 0) {
+            err = errno;
+            pr2serr("%s: open error: %s\n", dp->dev_name,
+                    safe_strerror(err));
+            ret = sg_convert_errno(err);
+            goto fini;
+        }
+    }
+    for (n = 0; (0 == num_polls) || (n < num_polls); ++n) {
+        if (n > 0)
+            sg_sleep_secs(interval);
+        sg_par_each(num_devs, num_q, phy_poll_one, wp);
+        if (num_polls != 1)
+            printf("Poll %d:\n", n + 1);
+        poll_ret = 0;
+        for (k = 0, dp = wp->dev_arr; k < num_devs; ++k, ++dp) {
+            if (dp->res) {
+                if (0 == poll_ret)
+                    poll_ret = dp->res;
+                sg_get_category_sense_str(dp->res, sizeof(b), b,
+                                          wp->verbose);
+                printf("%s: failed: %s\n", dp->dev_name, b);
+                continue;
+            }
+            if (dp->ident_valid) {
+                ata_ident_str(dp->ident, 27, 20, m);
+                ata_ident_str(dp->ident, 10, 10, s);
+                ata_ident_str(dp->ident, 23, 4, f);
+                printf("%s: %s  serial: %s  firmware: %s\n", dp->dev_name,
+                       m, s, f);
+            } else
+                printf("%s:\n", dp->dev_name);
+            if (1 == hex)
+                hex2stdout(dp->log, sizeof(dp->log), 0);
+            else if (hex > 1)
+                dWordHex((const unsigned short *)dp->log,
+                         sizeof(dp->log) / 2, 0, sg_is_big_endian());
+            else
+                show_phy_events(dp->log, ignore, "  ");
+        }
+        fflush(stdout);
+        if (poll_ret)
+            ret = poll_ret;
+    }
+fini:
+    for (k = 0, dp = wp->dev_arr; k < num_devs; ++k, ++dp) {
+        if (dp->sg_fd < 0)
+            continue;
+        if (wp->verbose > 1)
+            pr2serr("%s: IDENTIFY DEVICE sent %d time%s\n", dp->dev_name,
+                    dp->num_idents, ((1 == dp->num_idents) ? "" : "s"));
+        res = close(dp->sg_fd);
+        if ((res < 0) && (0 == ret))
+            ret = sg_convert_errno(errno);
+    }
+    free(wp->dev_arr);
+    return ret;
+}
+
 
 int main(int argc, char * argv[])
 {
@@ -376,7 +652,10 @@ int main(int argc, char * argv[])
     bool reset = false;
     bool verbose_given = false;
     bool version_given = false;
-    int sg_fd, c, k, j, res, id, len, vendor, err;
+    int sg_fd, c, res, err;
+    int interval = -1;
+    int num_polls = -1;
+    int num_q = PHY_DEF_PARALLEL;
     char * device_name = 0;
     char ebuff[EBUFF_SZ];
     uint8_t inBuff[READ_LOG_EXT_RESPONSE_LEN];
@@ -384,14 +663,13 @@ int main(int argc, char * argv[])
     int hex = 0;
     int verbose = 0;
     int ret = 0;
-    uint64_t ull;
-    const char * cp;
+    struct phy_work_t work;
 
     memset(inBuff, 0, sizeof(inBuff));
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "cehHil:rRvV",
+        c = getopt_long(argc, argv, "cehHiI:l:n:p:rRvV",
                         long_options, &option_index);
         if (c == -1)
             break;
@@ -413,6 +691,13 @@ int main(int argc, char * argv[])
         case 'i':
             ignore = true;
             break;
+        case 'I':
+            interval = sg_get_num(optarg);
+            if (interval < 0) {
+                pr2serr("bad argument to '--interval='\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
         case 'l':
             cdb_len = sg_get_num(optarg);
             if (! ((cdb_len == 12) || (cdb_len == 16))) {
@@ -420,6 +705,18 @@ int main(int argc, char * argv[])
                 return SG_LIB_SYNTAX_ERROR;
             }
             break;
+        case 'n':
+            num_polls = sg_get_num(optarg);
+            if (num_polls < 0) {
+                pr2serr("bad argument to '--num='\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case 'p':
+            num_q = sg_par_get_num(optarg, 1, PHY_MAX_PARALLEL);
+            if (num_q < 0)
+                return SG_LIB_SYNTAX_ERROR;
+            break;
         case 'r':
             raw = true;
             break;
@@ -439,18 +736,8 @@ int main(int argc, char * argv[])
             return SG_LIB_SYNTAX_ERROR;
         }
     }
-    if (optind < argc) {
-        if (NULL == device_name) {
-            device_name = argv[optind];
-            ++optind;
-        }
-        if (optind < argc) {
-            for (; optind < argc; ++optind)
-                pr2serr("Unexpected extra argument: %s\n", argv[optind]);
-            usage();
-            return SG_LIB_SYNTAX_ERROR;
-        }
-    }
+    if (optind < argc)
+        device_name = argv[optind];
 #ifdef DEBUG
     pr2serr("In DEBUG mode, ");
     if (verbose_given && version_given) {
@@ -476,6 +763,25 @@ int main(int argc, char * argv[])
         usage();
         return SG_LIB_SYNTAX_ERROR;
     }
+    if (((argc - optind) > 1) || (interval >= 0) || (num_polls > 1)) {
+        if (raw) {
+            pr2serr("--raw is for a single DEVICE polled once\n");
+            return SG_LIB_CONTRADICT;
+        }
+        if (num_polls < 0)
+            num_polls = (interval >= 0) ? 0 : 1;
+        if (interval < 0)
+            interval = 0;
+        memset(&work, 0, sizeof(work));
+        work.ck_cond = ck_cond;
+        work.extend = extend;
+        work.reset = reset;
+        work.cdb_len = cdb_len;
+        work.verbose = verbose;
+        ret = phy_multi(argv + optind, argc - optind, interval, num_polls,
+                        num_q, ignore, hex, &work);
+        return (ret >= 0) ? ret : SG_LIB_CAT_OTHER;
+    }
     if (raw) {
         if (sg_set_binary_mode(STDOUT_FILENO) < 0) {
             perror("sg_set_binary_mode");
@@ -490,37 +796,16 @@ int main(int argc, char * argv[])
         perror(ebuff);
         return sg_convert_errno(err);
     }
-    ret = do_read_log_ext(sg_fd, SATA_PHY_EVENT_LPAGE,
-                          0 /* page_in_log */,
-                          (reset ? 1 : 0) /* feature */,
-                          1 /* blk_count */, inBuff,
-                          READ_LOG_EXT_RESPONSE_LEN, cdb_len, ck_cond,
-                          extend, hex, raw, verbose);
+    ret = do_ata_data_in(sg_fd, ATA_READ_LOG_EXT, SATA_PHY_EVENT_LPAGE,
+                         0 /* page_in_log */,
+                         (reset ? 1 : 0) /* feature */,
+                         1 /* blk_count */, inBuff,
+                         READ_LOG_EXT_RESPONSE_LEN, cdb_len, ck_cond,
+                         extend, hex, raw, verbose);
 
     if ((0 == ret) && (0 == hex) && (! raw)) {
         printf("SATA phy event counters:\n");
-        for (k = 4; k < 512; k += (len + 2)) {
-            id = (inBuff[k + 1] << 8) + inBuff[k];
-            if (0 == id)
-                break;
-            len = ((id >> 12) & 0x7) * 2;
-            vendor = !!(id & 0x8000);
-            id = id & 0xfff;
-            ull = 0;
-            for (j = len - 1; j >= 0; --j) {
-                if (j < (len - 1))
-                    ull <<= 8;
-                ull |= inBuff[k + 2 + j];
-            }
-            cp = NULL;
-            if ((0 == vendor) && (! ignore))
-                cp = find_phy_desc(id);
-            if (cp)
-                printf("  %s: %" PRIu64 "\n", cp, ull);
-            else
-                printf("  id=0x%x, vendor=%d, data_len=%d, "
-                       "val=%" PRIu64 "\n", id, vendor, len, ull);
-        }
+        show_phy_events(inBuff, ignore, "  ");
     }
 
     res = close(sg_fd);
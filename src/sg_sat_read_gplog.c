@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2014-2023 Hannes Reinecke, SUSE Linux GmbH.
+ * Copyright (c) 2014-2026 Hannes Reinecke, SUSE Linux GmbH.
  * All rights reserved.
  * Use of this source code is governed by a BSD-style
  * license that can be found in the BSD_LICENSE file.
@@ -26,6 +26,7 @@
 #include "sg_cmds_extra.h"
 #include "sg_unaligned.h"
 #include "sg_pr2serr.h"
+#include "sg_json_sg_lib.h"
 
 /* This program uses a ATA PASS-THROUGH SCSI command. This usage is
  * defined in the SCSI to ATA Translation (SAT) drafts and standards.
@@ -63,13 +64,18 @@
 #define DEF_TIMEOUT 20
 
 #define MAX_LAR_LIST_ELEMS 8
+#define MAX_PPT 0xffff
 
-static const char * version_str = "1.29 20230519";
+static const char * version_str = "1.30 20261014";
 
 struct opts_t {
     bool ck_cond;
+    bool do_auto;       /* pick READ LOG (DMA) EXT and PPT to suit DEVICE */
+    bool do_json;
     bool do_multiple;
     bool do_smart;
+    bool ppt_given;
+    bool probing;       /* trying READ LOG DMA EXT, quiet if rejected */
     bool rdonly;
     bool no_output;
     int cdb_len;
@@ -81,16 +87,25 @@ struct opts_t {
     uint8_t la_lo_a[MAX_LAR_LIST_ELEMS];
     uint8_t la_hi_a[MAX_LAR_LIST_ELEMS];
     const char * device_name;
+    const char * json_arg;
+    const char * js_file;
+    sgj_state * jsp;            /* points to json_st */
+    sgj_opaque_p xfer_ap;       /* JSON array for current log address */
+    sgj_state json_st;
 };
 
 static struct option long_options[] = {
     {"address", required_argument, 0, 'a'},
+    {"auto", no_argument, 0, 'A'},
     {"count", required_argument, 0, 'c'},
     {"ck_cond", no_argument, 0, 'C'},
     {"ck-cond", no_argument, 0, 'C'},
     {"dma", no_argument, 0, 'd'},
     {"help", no_argument, 0, 'h'},
     {"hex", no_argument, 0, 'H'},
+    {"json", optional_argument, 0, '^'},    /* short option is '-j' */
+    {"js-file", required_argument, 0, 'J'},
+    {"js_file", required_argument, 0, 'J'},
     {"len", required_argument, 0, 'l'},
     {"log", required_argument, 0, 'L'},
     {"page", required_argument, 0, 'p'},
@@ -107,15 +122,22 @@ static void
 usage()
 {
     pr2serr("Usage: "
-          "sg_sat_read_gplog [--address=LA_L] [--ck_cond] [--count=CO] "
-          "[--dma]\n"
-          "                         [--help] [--hex] [--len=CDB_LEN] "
-          "[--log=LA_L]\n"
-          "                         [--ppt=PPT] [--readonly] [--smart] "
-          "[--verbose]\n"
-          "                         [--version] DEVICE\n"
+          "sg_sat_read_gplog [--address=LA_L] [--auto] [--ck_cond] "
+          "[--count=CO]\n"
+          "                         [--dma] [--help] [--hex] [--json[=JO]] "
+          "[--js-file=JFN]\n"
+          "                         [--len=CDB_LEN] [--log=LA_L] "
+          "[--ppt=PPT] [--readonly]\n"
+          "                         [--smart] [--verbose] [--version] "
+          "DEVICE\n"
           "  where:\n"
           "    --address=LA_L | -a LA_L    same as --log=LA_L option below\n"
+          "    --auto | -A             try READ LOG DMA EXT, if rejected use "
+          "READ LOG\n"
+          "                            EXT; unless --ppt= given, size "
+          "transfers to\n"
+          "                            the DEVICE's maximum transfer "
+          "length\n"
           "    --ck_cond | -C          set ck_cond field in pass-through "
           "(def: 0)\n"
           "    --count=CO | -c CO      count of page numbers to fetch "
@@ -127,6 +149,15 @@ usage()
           "yields hex\n"
           "                            words + ASCII (def), -HHH hex words "
           "only\n"
+          "    --json[=JO] | -j[=JO]    output in JSON instead of plain "
+          "text; all\n"
+          "                             log pages in one JSON object. Use "
+          "--json=?\n"
+          "                             for JSON help\n"
+          "    --js-file=JFN | -J JFN    JFN is a filename to which JSON "
+          "output is\n"
+          "                              written (def: stdout); truncates "
+          "then writes\n"
           "    --len=CDB_LEN | -l CDB_LEN    cdb length: 12, 16 or 32 bytes "
           "(def: 16)\n"
           "    --log=LA_L | -L LA_L    Log address, log address range or "
@@ -174,6 +205,33 @@ show_x_log_directory(int ata_cmd, const uint8_t * buff, int num_bytes)
     }
 }
 
+/* JSON form of the log directory in buff */
+static void
+js_log_directory(sgj_state * jsp, sgj_opaque_p jop, const uint8_t * buff,
+                 int num_bytes)
+{
+    int k;
+    uint16_t w;
+    sgj_opaque_p jo2p;
+    sgj_opaque_p jo3p;
+    sgj_opaque_p jap;
+
+    jo2p = sgj_named_subobject_r(jsp, jop, "log_directory");
+    if (num_bytes >= 2)
+        sgj_js_nv_ihex(jsp, jo2p, "logging_version",
+                       sg_get_unaligned_le16(buff));
+    jap = sgj_named_subarray_r(jsp, jo2p, "log_address_list");
+    for (k = 2; (k < num_bytes) && (k < 512); k += 2) {
+        w = sg_get_unaligned_le16(buff + k);
+        if (0 == w)
+            continue;
+        jo3p = sgj_new_unattached_object_r(jsp);
+        sgj_js_nv_ihex(jsp, jo3p, "log_address", k >> 1);
+        sgj_js_nv_i(jsp, jo3p, "number_of_pages", w);
+        sgj_js_nv_o(jsp, jap, NULL, jo3p);
+    }
+}
+
 /* Return of 0 is good. If read broken into multiple pieces due to
  * --count=CO being > --ppt=PPT then inbuff will contain the last piece
  * read and *inbuff_wr_bytesp will hold its length in bytes. */
@@ -220,7 +278,7 @@ do_read_gplog(int sg_fd, int ata_cmd, uint8_t la, uint8_t * inbuff,
         if (ata_cmd == ATA_SMART_READ_LOG)
             ata_cmd_name = "SMART READ LOG";
     }
-    if ((! op->no_output) && (op->hex > 4))
+    if ((! op->no_output) && (! op->do_json) && (op->hex > 4))
         printf("\n# Log address: 0x%x, page number: %d, count: %d\n",
                la, op->pn, op->count);
     if (inbuff_wr_bytesp)
@@ -344,7 +402,15 @@ do_read_gplog(int sg_fd, int ata_cmd, uint8_t la, uint8_t * inbuff,
 
             if (op->no_output)
                 ;
-            else if ((DIRECTORY_LOG_ADDR == la) && (0 == op->hex))
+            else if (op->do_json) {
+                sgj_state * jsp = op->jsp;
+                sgj_opaque_p jo2p = sgj_new_unattached_object_r(jsp);
+
+                sgj_js_nv_ihex(jsp, jo2p, "page_number", k);
+                sgj_js_nv_i(jsp, jo2p, "number_of_pages", num_bytes / 512);
+                sgj_js_nv_hex_bytes(jsp, jo2p, "data", inbuff, num_bytes);
+                sgj_js_nv_o(jsp, op->xfer_ap, NULL, jo2p);
+            } else if ((DIRECTORY_LOG_ADDR == la) && (0 == op->hex))
                 show_x_log_directory(ata_cmd, inbuff, num_bytes);
             else if ((0 == op->hex) || (2 == op->hex))
                 dWordHex((const unsigned short *)inbuff, num_words, 0,
@@ -367,11 +433,11 @@ do_read_gplog(int sg_fd, int ata_cmd, uint8_t la, uint8_t * inbuff,
                 case SPC_SK_ILLEGAL_REQUEST:
                     if ((0x20 == ssh.asc) && (0x0 == ssh.ascq)) {
                         ret = SG_LIB_CAT_INVALID_OP;
-                        if (vb < 2)
+                        if ((vb < 2) && (! op->probing))
                             pr2serr("%s not supported\n", pt_name);
                     } else {
                         ret = SG_LIB_CAT_ILLEGAL_REQ;
-                        if (vb < 2)
+                        if ((vb < 2) && (! op->probing))
                             pr2serr("%s, bad field in cdb\n", pt_name);
                     }
                     return ret;
@@ -412,7 +478,8 @@ do_read_gplog(int sg_fd, int ata_cmd, uint8_t la, uint8_t * inbuff,
                         pr2serr("Aborted command: protection information\n");
                         return SG_LIB_CAT_PROTECTION;
                     } else {
-                        pr2serr("Aborted command\n");
+                        if (! op->probing)
+                            pr2serr("Aborted command\n");
                         return SG_LIB_CAT_ABORTED_COMMAND;
                     }
                 case SPC_SK_DATA_PROTECT:
@@ -453,9 +520,10 @@ do_read_gplog(int sg_fd, int ata_cmd, uint8_t la, uint8_t * inbuff,
                     "indicated\n");
         if (got_ard) {
             if (ata_ret_desc[3] & 0x4) {
+                if (! op->probing)
                     pr2serr("error indication in returned FIS: aborted "
                             "command\n");
-                    return SG_LIB_CAT_ABORTED_COMMAND;
+                return SG_LIB_CAT_ABORTED_COMMAND;
             }
         }
     }
@@ -603,6 +671,104 @@ get_next_la(int * prev_la_indp, int * prev_la_valp, const struct opts_t * op)
         return la_in + 1;
 }
 
+/* Returns the DEVICE's maximum transfer length in 512 byte log pages, from
+ * the Block Limits VPD page and the logical block length, or 0 if that is
+ * not known */
+static int
+get_max_ppt(int sg_fd, int vb)
+{
+    uint32_t mtl;
+    uint32_t lb_len = 512;
+    uint64_t n;
+    uint8_t b[64];
+
+    if (sg_ll_inquiry(sg_fd, false, true /* evpd */, 0xb0 /* Block Limits */,
+                      b, sizeof(b), false, vb) || (0xb0 != b[1]))
+        return 0;
+    mtl = sg_get_unaligned_be32(b + 8);
+    if (0 == mtl)
+        return 0;       /* 0 means no limit reported */
+    if ((0 == sg_ll_readcap_10(sg_fd, false, 0, b, 8, false, vb)) &&
+        (sg_get_unaligned_be32(b + 4) > 512))
+        lb_len = sg_get_unaligned_be32(b + 4);
+    n = ((uint64_t)mtl * lb_len) / 512;
+    return (n > MAX_PPT) ? MAX_PPT : (int)n;
+}
+
+/* Reads count (in op) log pages at log address la, starting at page number
+ * pn (in op). With --auto, the first call tries READ LOG DMA EXT and if the
+ * DEVICE rejects it, *ata_cmdp is changed to READ LOG EXT which is then
+ * used for this and following calls. With --json, if jap is given the
+ * log pages read are placed in a new object appended to jap. */
+static int
+read_log_addr(int sg_fd, int * ata_cmdp, uint8_t la, uint8_t * inbuff,
+              int * inbuff_wr_bytesp, struct opts_t * op, sgj_opaque_p jap)
+{
+    int res;
+    sgj_state * jsp = op->jsp;
+    sgj_opaque_p jo2p = NULL;
+
+    if (op->do_json && jap) {
+        jo2p = sgj_new_unattached_object_r(jsp);
+        sgj_js_nv_ihex(jsp, jo2p, "log_address", la);
+        sgj_js_nv_i(jsp, jo2p, "number_of_pages", op->count);
+        op->xfer_ap = sgj_named_subarray_r(jsp, jo2p, "transfer_list");
+    }
+    res = do_read_gplog(sg_fd, *ata_cmdp, la, inbuff, inbuff_wr_bytesp, op);
+    if (op->probing) {
+        op->probing = false;
+        if ((SG_LIB_CAT_INVALID_OP == res) ||
+            (SG_LIB_CAT_ILLEGAL_REQ == res) ||
+            (SG_LIB_CAT_ABORTED_COMMAND == res) || (SG_LIB_CAT_SENSE == res)) {
+            if (op->verbose)
+                pr2serr("READ LOG DMA EXT rejected, so use READ LOG EXT\n");
+            *ata_cmdp = ATA_READ_LOG_EXT;
+            res = do_read_gplog(sg_fd, *ata_cmdp, la, inbuff,
+                                inbuff_wr_bytesp, op);
+        }
+    }
+    if (jo2p) {
+        if (res)
+            sgj_js_nv_i(jsp, jo2p, "exit_status", res);
+        sgj_js_nv_o(jsp, jap, NULL, jo2p);
+    }
+    return res;
+}
+
+/* Handles short options after '-j' including a sequence of short options
+ * that include one 'j' (for JSON). Want optional argument to '-j' to be
+ * prefixed by '='. Return 0 for good, SG_LIB_SYNTAX_ERROR for syntax
+ * error. */
+static int
+chk_short_opts(const char sopt_ch, struct opts_t * op)
+{
+    /* only need to process short, non-argument options */
+    switch (sopt_ch) {
+    case 'A':
+        op->do_auto = true;
+        break;
+    case 'C':
+        op->ck_cond = true;
+        break;
+    case 'H':
+        ++op->hex;
+        break;
+    case 'j':
+        break;  /* simply ignore second 'j' (e.g. '-jxj') */
+    case 'r':
+        op->rdonly = true;
+        break;
+    case 'v':
+        ++op->verbose;
+        break;
+    default:
+        pr2serr("unrecognised option code %c [0x%x] ??\n", sopt_ch,
+                sopt_ch);
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    return 0;
+}
+
 
 int
 main(int argc, char * argv[])
@@ -619,10 +785,16 @@ main(int argc, char * argv[])
     uint8_t *free_inbuff = NULL;
     struct opts_t opts;
     struct opts_t * op;
+    sgj_state * jsp;
+    sgj_opaque_p jop = NULL;
+    sgj_opaque_p jo2p = NULL;
+    sgj_opaque_p jap = NULL;
     char b[80];
 
     op = &opts;
     memset(op, 0, sizeof(opts));
+    jsp = &op->json_st;
+    op->jsp = jsp;
     op->cdb_len = SAT_ATA_PASS_THROUGH16_LEN;
     op->ppt = DEF_PPT;
     op->count = 1;
@@ -632,7 +804,7 @@ main(int argc, char * argv[])
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "a:c:CdhHl:L:p:P:rsvV", long_options,
+        c = getopt_long(argc, argv, "a:Ac:Cdhj::HJ:l:L:p:P:rsvV", long_options,
                         &option_index);
         if (c == -1)
             break;
@@ -647,6 +819,9 @@ main(int argc, char * argv[])
             if ((op->la_lo_a[0] < la) || (la < op->la_lo_a[1]))
                 op->do_multiple = true;
             break;
+        case 'A':
+            op->do_auto = true;
+            break;
         case 'c':
             op->count = sg_get_num(optarg);
             if ((op->count < 1) || (op->count > 0xffff)) {
@@ -672,6 +847,33 @@ main(int argc, char * argv[])
         case 'H':
             ++op->hex;
             break;
+        case 'j':       /* for: -j[=JO] */
+        case '^':       /* for: --json[=JO] */
+            op->do_json = true;
+            /* Now want '=' to precede all JSON optional arguments */
+            if (optarg) {
+                int q;
+
+                if ('^' == c) {
+                    op->json_arg = optarg;
+                    break;
+                } else if ('=' == *optarg) {
+                    op->json_arg = optarg + 1;
+                    break;
+                }
+                n = strlen(optarg);
+                for (k = 0; k < n; ++k) {
+                    q = chk_short_opts(*(optarg + k), op);
+                    if (SG_LIB_SYNTAX_ERROR == q)
+                        return SG_LIB_SYNTAX_ERROR;
+                }
+            } else
+                op->json_arg = NULL;
+            break;
+        case 'J':
+            op->do_json = true;
+            op->js_file = optarg;
+            break;
         case 'l':
            op->cdb_len = sg_get_num(optarg);
            if (! ((op->cdb_len == 12) || (op->cdb_len == 16) ||
@@ -693,6 +895,7 @@ main(int argc, char * argv[])
                 pr2serr("bad argument for '--ppt=', expect 1 to 0xffff\n");
                 return SG_LIB_SYNTAX_ERROR;
             }
+            op->ppt_given = true;
             break;
         case 'r':
             op->rdonly = true;
@@ -753,6 +956,20 @@ main(int argc, char * argv[])
         pr2serr("version: %s\n", version_str);
         return 0;
     }
+    if (op->do_json) {
+        if (! sgj_init_state(jsp, op->json_arg)) {
+            int bad_char = jsp->first_bad_char;
+            char e[1500];
+
+            if (bad_char) {
+                pr2serr("bad argument to --json= option, unrecognized "
+                        "character '%c'\n\n", bad_char);
+            }
+            sg_json_usage(0, e, sizeof(e));
+            pr2serr("%s", e);
+            return SG_LIB_SYNTAX_ERROR;
+        }
+    }
 
     if (NULL == op->device_name) {
         pr2serr("Missing device name!\n\n");
@@ -778,13 +995,15 @@ main(int argc, char * argv[])
             return SG_LIB_SYNTAX_ERROR;
         }
     }
-    n = op->ppt * 512;
-    inbuff = (uint8_t *)sg_memalign(n, 0, &free_inbuff, op->verbose > 3);
-    if (!inbuff) {
-        pr2serr("Cannot allocate output buffer of size %d\n", n);
-        return SG_LIB_CAT_OTHER;
-    } else if (op->verbose > 3)
-        pr2serr("allocated %d bytes successfully on heap\n", n);
+    if (op->do_auto && (ATA_READ_LOG_EXT != ata_cmd)) {
+        pr2serr("--auto chooses between READ LOG DMA EXT and READ LOG EXT "
+                "so --dma\nand --smart are not expected\n");
+        return SG_LIB_CONTRADICT;
+    }
+    if (op->do_json) {
+        jop = sgj_start_r(MY_NAME, version_str, argc, argv, jsp);
+        jo2p = sgj_named_subobject_r(jsp, jop, "ata_read_log");
+    }
 
     if ((sg_fd = sg_cmds_open_device(op->device_name, op->rdonly,
                                      op->verbose)) < 0) {
@@ -794,6 +1013,30 @@ main(int argc, char * argv[])
         ret = sg_convert_errno(-sg_fd);
         goto fini;
     }
+    if (op->do_auto) {
+        if (! op->ppt_given) {
+            n = get_max_ppt(sg_fd, op->verbose);
+            if ((12 == op->cdb_len) && (n > 0xff))
+                n = 0xff;       /* single byte count field */
+            if (n > 0)
+                op->ppt = n;
+            if (op->verbose)
+                pr2serr("pages per transfer: %d%s\n", op->ppt,
+                        ((n > 0) ? " (from Block Limits VPD page)" : ""));
+        }
+        ata_cmd = ATA_READ_LOG_DMA_EXT;
+        op->probing = true;
+    }
+    n = op->ppt * 512;
+    inbuff = (uint8_t *)sg_memalign(n, 0, &free_inbuff, op->verbose > 3);
+    if (!inbuff) {
+        pr2serr("Cannot allocate output buffer of size %d\n", n);
+        ret = sg_convert_errno(ENOMEM);
+        goto fini;
+    } else if (op->verbose > 3)
+        pr2serr("allocated %d bytes successfully on heap\n", n);
+    if (op->do_json)
+        jap = sgj_named_subarray_r(jsp, jo2p, "log_list");
     if (op->do_multiple) {
         int hold_pn = op->pn;
         int la_val;
@@ -809,19 +1052,22 @@ main(int argc, char * argv[])
         la_val = get_next_la(&prev_la_ind, &prev_la_val, op);
         if (la_val < 0)
             goto fini;
-        else if (la_val > 0)
+        else if ((la_val > 0) || op->do_json)
             op->no_output = true;
         op->count = 1;
         la = DIRECTORY_LOG_ADDR;
         op->pn = 0;
         /* read log directory page */
-        ret = do_read_gplog(sg_fd, ata_cmd, la, inbuff, &bytes_fetched, op);
+        ret = read_log_addr(sg_fd, &ata_cmd, la, inbuff, &bytes_fetched, op,
+                            NULL);
         if (0 == ret) {
             uint8_t d[512];
 
             /* need copy of log directory cause inbuff gets overwritten */
             memcpy(d, inbuff, bytes_fetched);
             op->no_output = false;
+            if (op->do_json)
+                js_log_directory(jsp, jo2p, d, bytes_fetched);
             if (0 == la_val) {
                 prev_la_val = la_val;
                 la_val = get_next_la(&prev_la_ind, &prev_la_val, op);
@@ -833,7 +1079,7 @@ main(int argc, char * argv[])
 
                 k = (la_val << 1);
                 if ((k + 1) >= bytes_fetched)
-                    continue;
+                    break;
                 w = sg_get_unaligned_le16(d + k);
                 if (w > 0) {
                     if ((hold_pn > 0) && (w > hold_pn))
@@ -841,9 +1087,14 @@ main(int argc, char * argv[])
                     op->count = w;  /* --ppt=PPT may break into smaller */
                     la = la_val;
                     op->pn = 0;
-                    ret = do_read_gplog(sg_fd, ata_cmd, la, inbuff, NULL, op);
-                    if (ret)
-                        break;
+                    res = read_log_addr(sg_fd, &ata_cmd, la, inbuff, NULL,
+                                        op, jap);
+                    if (res) {
+                        if (0 == ret)
+                            ret = res;
+                        if (! op->do_json)
+                            break;  /* JSON: note error, try next LA */
+                    }
                 }
                 prev_la_val = la_val;
                 la_val = get_next_la(&prev_la_ind, &prev_la_val, op);
@@ -851,7 +1102,14 @@ main(int argc, char * argv[])
         }
     } else {
         la = op->la_lo_a[0];
-        ret = do_read_gplog(sg_fd, ata_cmd, la, inbuff, NULL, op);
+        ret = read_log_addr(sg_fd, &ata_cmd, la, inbuff, NULL, op, jap);
+    }
+    if (jo2p) {
+        sgj_js_nv_s(jsp, jo2p, "ata_command",
+                    (ATA_SMART_READ_LOG == ata_cmd) ? "SMART READ LOG" :
+                    ((ATA_READ_LOG_DMA_EXT == ata_cmd) ? "READ LOG DMA EXT" :
+                                                         "READ LOG EXT"));
+        sgj_js_nv_i(jsp, jo2p, "pages_per_transfer", op->ppt);
     }
 
 fini:
@@ -871,5 +1129,26 @@ fini:
     }
     if (free_inbuff)
         free(free_inbuff);
-    return (ret >= 0) ? ret : SG_LIB_CAT_OTHER;
+    ret = (ret >= 0) ? ret : SG_LIB_CAT_OTHER;
+    if (op->do_json) {
+        FILE * fp = stdout;
+
+        if (op->js_file) {
+            if ((1 != strlen(op->js_file)) || ('-' != op->js_file[0])) {
+                fp = fopen(op->js_file, "w");   /* truncate if exists */
+                if (NULL == fp) {
+                    pr2serr("unable to open file: %s\n", op->js_file);
+                    if (0 == ret)
+                        ret = SG_LIB_FILE_ERROR;
+                }
+            }
+            /* '--js-file=-' will send JSON output to stdout */
+        }
+        if (fp)
+            sgj_js2file(jsp, NULL, ret, fp);
+        if (op->js_file && fp && (stdout != fp))
+            fclose(fp);
+        sgj_finish(jsp);
+    }
+    return ret;
 }
@@ -1,5 +1,5 @@
 /* A utility program originally written for the Linux OS SCSI subsystem.
- *  Copyright (C) 1999 - 2023 D. Gilbert
+ *  Copyright (C) 1999 - 2026 D. Gilbert
  *  This program is free software; you can redistribute it and/or modify
  *  it under the terms of the GNU General Public License as published by
  *  the Free Software Foundation; either version 2, or (at your option)
@@ -13,6 +13,8 @@
  * Options: -a   alpha scan: scan /dev/sga,b,c, ....
  *          -i   do SCSI inquiry on device (implies -w)
  *          -n   numeric scan: scan /dev/sg0,1,2, ....
+ *          -p=NUM  concurrent scan, up to NUM devices at a time
+ *          -t=SECS  INQUIRY timeout (def: 20 seconds)
  *          -V   output version string and exit
  *          -w   open writable (new driver opens readable unless -i)
  *          -x   extra information output
@@ -41,8 +43,10 @@
 #include <string.h>
 #include <ctype.h>
 #include <errno.h>
+#include <time.h>
 #include <dirent.h>
 #include <libgen.h>
+#include <pthread.h>
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -53,7 +57,7 @@
 #include "sg_pr2serr.h"
 
 
-static const char * version_str = "4.18 20220118";
+static const char * version_str = "4.19 20261014";
 
 #define ME "sg_scan: "
 
@@ -66,6 +70,22 @@ static const char * version_str = "4.18 20220118";
 #define EBUFF_SZ 256
 #define FNAME_SZ 64
 #define PRESENT_ARRAY_SIZE 8192
+#define DEF_INQ_TIMEOUT 20      /* seconds */
+#define SCAN_EXTRA_SECS 5       /* beyond INQUIRY timeout for open+ioctls */
+#define MAX_SCAN_WORKERS 256
+
+/* scan_one() return values */
+#define SCAN_OK 0
+#define SCAN_BUSY 1             /* O_EXCL lock held elsewhere */
+#define SCAN_MISSING 2          /* ENODEV, ENOENT or ENXIO: silent error */
+#define SCAN_ERR 3
+#define SCAN_EACCES 4
+
+/* scan_dev_t::state values for the concurrent scan */
+#define SD_PENDING 0
+#define SD_RUNNING 1
+#define SD_DONE 2
+#define SD_TIMED_OUT 3
 
 static const char * sysfs_sg_dir = "/sys/class/scsi_generic";
 static int * gen_index_arr;
@@ -88,22 +108,62 @@ typedef struct my_sg_scsi_id {
     int unused2;        /* ditto */
 } My_sg_scsi_id;
 
-int sg3_inq(int sg_fd, uint8_t * inqBuff, bool do_extra);
+struct scan_opts_t {
+    bool do_extra;
+    bool do_inquiry;
+    bool has_file_args;
+    int flags;          /* for open(2) */
+    int inq_tmo;        /* INQUIRY timeout in seconds */
+    int verbose;
+};
+
+/* One per device in the concurrent scan, protected by scan_mutex */
+struct scan_dev_t {
+    int state;          /* SD_* value */
+    int res;            /* SCAN_* value from scan_one() */
+    uint64_t start_ms;
+    char * out;         /* what scan_one() output, NULL if nothing */
+    size_t out_len;
+    char name[FNAME_SZ];
+    const char * namep; /* name or a command line argument */
+};
+
+static pthread_mutex_t scan_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t scan_cv = PTHREAD_COND_INITIALIZER;
+static struct scan_dev_t * scan_devs;
+static int scan_num_devs;
+static int scan_next;           /* next device to be claimed by a worker */
+static int scan_num_finished;   /* done or timed out */
+static const struct scan_opts_t * scan_op;
+
+int sg3_inq(int sg_fd, uint8_t * inqBuff, bool do_extra, int tmo_secs,
+            FILE * fp);
 int scsi_inq(int sg_fd, uint8_t * inqBuff);
-int try_ata_identity(const char * file_namep, int ata_fd, bool do_inq);
+int try_ata_identity(const char * file_namep, int ata_fd, bool do_inq,
+                     FILE * fp);
 
 static uint8_t inq_cdb[INQ_CMD_LEN] =
                                 {0x12, 0, 0, 0, INQ_REPLY_LEN, 0};
 
 
-void usage()
+static void
+usage()
 {
-    printf("Usage: sg_scan [-a] [-i] [-n] [-v] [-V] [-w] [-x] "
-           "[DEVICE]*\n");
+    printf("Usage: sg_scan [-a] [-i] [-n] [-p=NUM] [-t=SECS] [-v] [-V] [-w] "
+           "[-x]\n"
+           "               [DEVICE]*\n");
     printf("  where:\n");
     printf("    -a    do alpha scan (ie sga, sgb, sgc)\n");
     printf("    -i    do SCSI INQUIRY, output results\n");
     printf("    -n    do numeric scan (ie sg0, sg1...) [default]\n");
+    printf("    -p=NUM    concurrent scan of up to NUM devices at a time, "
+           "output\n"
+           "              follows in order once all have answered or timed "
+           "out\n");
+    printf("    -t=SECS    INQUIRY timeout (def: %d seconds); when -p=NUM "
+           "is given a\n"
+           "               device taking %d seconds longer is skipped\n",
+           DEF_INQ_TIMEOUT, SCAN_EXTRA_SECS);
     printf("    -v    increase verbosity\n");
     printf("    -V    output version string then exit\n");
     printf("    -w    force open with read/write flag\n");
@@ -169,35 +229,273 @@ void make_dev_name(char * fname, int k, bool do_numeric)
     }
 }
 
+/* Opens file_namep, outputs its SCSI (or ATA) address to fp and, if
+ * requested, INQUIRY results. Returns a SCAN_* value. */
+static int
+scan_one(const char * file_namep, const struct scan_opts_t * sop, FILE * fp)
+{
+    int sg_fd, res, f;
+    int ret = SCAN_OK;
+    int emul = -1;
+    int host_no;
+    char ebuff[EBUFF_SZ];
+    uint8_t inqBuff[INQ_REPLY_LEN];
+    My_scsi_idlun my_idlun;
+
+    sg_fd = open(file_namep, sop->flags);
+    if (sg_fd < 0) {
+        if (EBUSY == errno) {
+            fprintf(fp, "%s: device busy (O_EXCL lock), skipping\n",
+                    file_namep);
+            return SCAN_BUSY;
+        } else if ((ENODEV == errno) || (ENOENT == errno) ||
+                   (ENXIO == errno)) {
+            if (sop->verbose)
+                pr2serr("Unable to open: %s, errno=%d\n", file_namep,
+                        errno);
+            return SCAN_MISSING;
+        } else {
+            ret = (EACCES == errno) ? SCAN_EACCES : SCAN_ERR;
+            snprintf(ebuff, EBUFF_SZ, ME "Error opening %s ", file_namep);
+            perror(ebuff);
+            return ret;
+        }
+    }
+    res = ioctl(sg_fd, SCSI_IOCTL_GET_IDLUN, &my_idlun);
+    if (res < 0) {
+        res = try_ata_identity(file_namep, sg_fd, sop->do_inquiry, fp);
+        if (res) {
+            snprintf(ebuff, EBUFF_SZ, ME "device %s failed on scsi+ata "
+                     "ioctl, skip", file_namep);
+            perror(ebuff);
+            ret = SCAN_ERR;
+        }
+        goto fini;
+    }
+    res = ioctl(sg_fd, SCSI_IOCTL_GET_BUS_NUMBER, &host_no);
+    if (res < 0) {
+        snprintf(ebuff, EBUFF_SZ, ME "device %s failed on scsi "
+                 "ioctl(2), skip", file_namep);
+        perror(ebuff);
+        ret = SCAN_ERR;
+        goto fini;
+    }
+    res = ioctl(sg_fd, SG_EMULATED_HOST, &emul);
+    if (res < 0)
+        emul = -1;
+    fprintf(fp, "%s: scsi%d channel=%d id=%d lun=%d", file_namep, host_no,
+            (my_idlun.dev_id >> 16) & 0xff, my_idlun.dev_id & 0xff,
+            (my_idlun.dev_id >> 8) & 0xff);
+    if (1 == emul)
+        fprintf(fp, " [em]");
+#if 0
+    fprintf(fp, ", huid=%d", my_idlun.host_unique_id);
+#endif
+    if (! sop->has_file_args) {
+        My_sg_scsi_id m_id; /* compatible with sg_scsi_id_t in sg.h */
+
+        res = ioctl(sg_fd, SG_GET_SCSI_ID, &m_id);
+        if (res < 0) {
+            snprintf(ebuff, EBUFF_SZ, ME "device %s failed "
+                     "SG_GET_SCSI_ID ioctl(4), skip", file_namep);
+            perror(ebuff);
+            ret = SCAN_ERR;
+            goto fini;
+        }
+        /* fprintf(fp, "  type=%d", m_id.scsi_type); */
+        if (sop->do_extra)
+            fprintf(fp, "  cmd_per_lun=%hd queue_depth=%hd\n",
+                    m_id.h_cmd_per_lun, m_id.d_queue_depth);
+        else
+            fprintf(fp, "\n");
+    }
+    else
+        fprintf(fp, "\n");
+    if (sop->do_inquiry) {
+        if ((ioctl(sg_fd, SG_GET_VERSION_NUM, &f) >= 0) && (f >= 30000)) {
+            res = sg3_inq(sg_fd, inqBuff, sop->do_extra, sop->inq_tmo, fp);
+            if (res)
+                ret = SCAN_ERR;
+        }
+    }
+fini:
+    if (close(sg_fd) < 0) {
+        snprintf(ebuff, EBUFF_SZ, ME "Error closing %s ", file_namep);
+        perror(ebuff);
+        ret = SCAN_ERR;
+    }
+    return ret;
+}
+
+static uint64_t
+get_mono_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
+
+/* Claims devices until none are left, capturing the output of each. Exits
+ * after its current device timed out since a replacement worker has then
+ * been started. */
+static void *
+scan_worker(void * v_p)
+{
+    int k, res;
+    FILE * fp;
+    char * out;
+    size_t out_len;
+    struct scan_dev_t * sdp;
+
+    if (v_p) { }
+    while (true) {
+        pthread_mutex_lock(&scan_mutex);
+        if (scan_next >= scan_num_devs) {
+            pthread_mutex_unlock(&scan_mutex);
+            break;
+        }
+        k = scan_next++;
+        sdp = scan_devs + k;
+        sdp->state = SD_RUNNING;
+        sdp->start_ms = get_mono_ms();
+        pthread_mutex_unlock(&scan_mutex);
+
+        out = NULL;
+        out_len = 0;
+        fp = open_memstream(&out, &out_len);
+        res = scan_one(sdp->namep, scan_op, fp ? fp : stdout);
+        if (fp)
+            fclose(fp);
+
+        pthread_mutex_lock(&scan_mutex);
+        if (SD_RUNNING == sdp->state) {
+            sdp->state = SD_DONE;
+            sdp->res = res;
+            sdp->out = out;
+            sdp->out_len = out_len;
+            ++scan_num_finished;
+            pthread_cond_signal(&scan_cv);
+            pthread_mutex_unlock(&scan_mutex);
+        } else {        /* timed out, main thread has given up on it */
+            pthread_mutex_unlock(&scan_mutex);
+            free(out);
+            break;
+        }
+    }
+    return NULL;
+}
+
+static bool
+scan_start_worker(void)
+{
+    pthread_t tid;
+
+    if (pthread_create(&tid, NULL, scan_worker, NULL))
+        return false;
+    pthread_detach(tid);
+    return true;
+}
+
+/* Scans scan_devs[] with up to num_workers threads. A device that has not
+ * finished within the INQUIRY timeout plus SCAN_EXTRA_SECS is reported as
+ * timed out and its worker replaced, so a hung device only delays the scan
+ * by that much. Then outputs the results in device order. Returns the
+ * number of errors. */
+static int
+scan_concurrent(int num_workers, const struct scan_opts_t * sop,
+                bool * eaccesp)
+{
+    int k, num;
+    int num_errors = 0;
+    int tmo_ms = (sop->inq_tmo + SCAN_EXTRA_SECS) * 1000;
+    uint64_t now, dl, earliest;
+    struct scan_dev_t * sdp;
+    struct timespec ts;
+
+    scan_op = sop;
+    num = (num_workers < scan_num_devs) ? num_workers : scan_num_devs;
+    for (k = 0; k < num; ++k) {
+        if (! scan_start_worker()) {
+            if (0 == k) {
+                pr2serr(ME "unable to start worker thread\n");
+                return -1;
+            }
+            break;
+        }
+    }
+    pthread_mutex_lock(&scan_mutex);
+    while (scan_num_finished < scan_num_devs) {
+        now = get_mono_ms();
+        earliest = 0;
+        for (k = 0; k < scan_num_devs; ++k) {
+            sdp = scan_devs + k;
+            if (SD_RUNNING != sdp->state)
+                continue;
+            dl = sdp->start_ms + tmo_ms;
+            if (dl <= now) {
+                sdp->state = SD_TIMED_OUT;
+                ++scan_num_finished;
+                if (scan_next < scan_num_devs)
+                    scan_start_worker();
+            } else if ((0 == earliest) || (dl < earliest))
+                earliest = dl;
+        }
+        if (scan_num_finished >= scan_num_devs)
+            break;
+        if (earliest) {
+            clock_gettime(CLOCK_REALTIME, &ts);
+            dl = ((uint64_t)ts.tv_nsec / 1000000) + (earliest - now);
+            ts.tv_sec += dl / 1000;
+            ts.tv_nsec = (dl % 1000) * 1000000;
+            pthread_cond_timedwait(&scan_cv, &scan_mutex, &ts);
+        } else
+            pthread_cond_wait(&scan_cv, &scan_mutex);
+    }
+    pthread_mutex_unlock(&scan_mutex);
+
+    for (k = 0; k < scan_num_devs; ++k) {
+        sdp = scan_devs + k;
+        if (SD_TIMED_OUT == sdp->state) {
+            printf("%s: no response within %d seconds, skipped\n",
+                   sdp->namep, tmo_ms / 1000);
+            ++num_errors;
+            continue;
+        }
+        if (sdp->out) {
+            fwrite(sdp->out, 1, sdp->out_len, stdout);
+            free(sdp->out);
+        }
+        if ((SCAN_ERR == sdp->res) || (SCAN_EACCES == sdp->res))
+            ++num_errors;
+        if (SCAN_EACCES == sdp->res)
+            *eaccesp = true;
+    }
+    return num_errors;
+}
+
 
 int main(int argc, char * argv[])
 {
-    bool do_extra = false;
-    bool do_inquiry = false;
     bool do_numeric = NUMERIC_SCAN_DEF;
     bool eacces_err = false;
-    bool has_file_args = false;
     bool has_sysfs_sg = false;
     bool jmp_out;
-    bool sg_ver3 = false;
-    bool sg_ver3_set = false;
     bool writeable = false;
-    int sg_fd, res, k, j, f, plen;
-    int emul = -1;
-    int flags;
-    int host_no;
+    int res, k, j, plen;
     const int max_file_args = PRESENT_ARRAY_SIZE;
     int num_errors = 0;
     int num_silent = 0;
-    int verbose = 0;
+    int num_workers = 0;
     char * file_namep;
     const char * cp;
     char fname[FNAME_SZ];
-    char ebuff[EBUFF_SZ];
-    uint8_t inqBuff[INQ_REPLY_LEN];
-    My_scsi_idlun my_idlun;
     struct stat a_stat;
+    struct scan_opts_t opts;
+    struct scan_opts_t * sop = &opts;
 
+    memset(sop, 0, sizeof(opts));
+    sop->inq_tmo = DEF_INQ_TIMEOUT;
     if (NULL == (gen_index_arr =
                  (int *)calloc(max_file_args + 1, sizeof(int)))) {
         printf(ME "Out of memory\n");
@@ -223,13 +521,13 @@ int main(int argc, char * argv[])
                     usage();
                     return 0;
                 case 'i':
-                    do_inquiry = true;
+                    sop->do_inquiry = true;
                     break;
                 case 'n':
                     do_numeric = true;
                     break;
                 case 'v':
-                    ++verbose;
+                    ++sop->verbose;
                     break;
                 case 'V':
                     pr2serr("Version string: %s\n", version_str);
@@ -238,7 +536,7 @@ int main(int argc, char * argv[])
                     writeable = true;
                     break;
                 case 'x':
-                    do_extra = true;
+                    sop->do_extra = true;
                     break;
                 default:
                     jmp_out = true;
@@ -249,14 +547,28 @@ int main(int argc, char * argv[])
             }
             if (plen <= 0)
                 continue;
-            if (jmp_out) {
+            if (0 == strncmp("p=", cp, 2)) {
+                num_workers = sg_get_num(cp + 2);
+                if ((num_workers < 1) || (num_workers > MAX_SCAN_WORKERS)) {
+                    pr2serr("Expect a number from 1 to %d after 'p='\n",
+                            MAX_SCAN_WORKERS);
+                    return SG_LIB_SYNTAX_ERROR;
+                }
+            } else if (0 == strncmp("t=", cp, 2)) {
+                sop->inq_tmo = sg_get_num(cp + 2);
+                if (sop->inq_tmo < 1) {
+                    pr2serr("Expect a positive number of seconds after "
+                            "'t='\n");
+                    return SG_LIB_SYNTAX_ERROR;
+                }
+            } else if (jmp_out) {
                 pr2serr("Unrecognized option: %s\n", cp);
                 usage();
                 return SG_LIB_SYNTAX_ERROR;
             }
         } else {
             if (j < max_file_args) {
-                has_file_args = true;
+                sop->has_file_args = true;
                 gen_index_arr[j++] = k;
             } else {
                 printf("Too many command line arguments\n");
@@ -265,129 +577,85 @@ int main(int argc, char * argv[])
         }
     }
 
-    if ((! has_file_args) && (stat(sysfs_sg_dir, &a_stat) >= 0) &&
+    if ((! sop->has_file_args) && (stat(sysfs_sg_dir, &a_stat) >= 0) &&
         (S_ISDIR(a_stat.st_mode)))
         has_sysfs_sg = !! sysfs_sg_scan(sysfs_sg_dir);
 
-    flags = O_NONBLOCK | (writeable ? O_RDWR : O_RDONLY);
-
-    for (k = 0, res = 0, j = 0;
-         (k < max_file_args)  && (has_file_args || (num_errors < MAX_ERRORS));
-         ++k, res = ((sg_fd >= 0) ? close(sg_fd) : 0)) {
-        if (res < 0) {
-            snprintf(ebuff, EBUFF_SZ, ME "Error closing %s ", fname);
-            perror(ebuff);
-            return SG_LIB_FILE_ERROR;
+    sop->flags = O_NONBLOCK | (writeable ? O_RDWR : O_RDONLY);
+
+    if ((num_workers > 0) && (! sop->has_file_args) && (! has_sysfs_sg) &&
+        sop->verbose)
+        pr2serr("-p=NUM needs DEVICE arguments or sysfs, so serial scan\n");
+    if ((num_workers > 0) && (sop->has_file_args || has_sysfs_sg)) {
+        if (sop->has_file_args)
+            scan_num_devs = j;
+        else {
+            for (k = 0, scan_num_devs = 0; k < max_file_args; ++k) {
+                if (gen_index_arr[k])
+                    ++scan_num_devs;
+            }
+        }
+        scan_devs = (struct scan_dev_t *)calloc(scan_num_devs + 1,
+                                                sizeof(struct scan_dev_t));
+        if (NULL == scan_devs) {
+            printf(ME "Out of memory\n");
+            return SG_LIB_CAT_OTHER;
+        }
+        for (k = 0, j = 0; j < scan_num_devs; ++k) {
+            if (sop->has_file_args)
+                scan_devs[j].namep = argv[gen_index_arr[k]];
+            else if (gen_index_arr[k]) {
+                make_dev_name(scan_devs[j].name, k, 1);
+                scan_devs[j].namep = scan_devs[j].name;
+            } else
+                continue;
+            ++j;
         }
-        if (has_file_args) {
+        num_errors = scan_concurrent(num_workers, sop, &eacces_err);
+        if (num_errors >= 0) {
+            if (eacces_err)
+                printf("    root access may be required\n");
+            return 0;
+        }
+        num_errors = 0;     /* no threads, fall back to serial scan */
+    }
+
+    for (k = 0, j = 0;
+         (k < max_file_args) &&
+         (sop->has_file_args || (num_errors < MAX_ERRORS)); ++k) {
+        if (sop->has_file_args) {
             if (gen_index_arr[j])
                 file_namep = argv[gen_index_arr[j++]];
             else
                 break;
         } else if (has_sysfs_sg) {
-            if (0 == gen_index_arr[k]) {
-                sg_fd = -1;
+            if (0 == gen_index_arr[k])
                 continue;
-            }
             make_dev_name(fname, k, 1);
             file_namep = fname;
         } else {
             make_dev_name(fname, k, do_numeric);
             file_namep = fname;
         }
-
-        sg_fd = open(file_namep, flags);
-        if (sg_fd < 0) {
-            if (EBUSY == errno) {
-                printf("%s: device busy (O_EXCL lock), skipping\n",
-                       file_namep);
-                continue;
-            }
-            else if ((ENODEV == errno) || (ENOENT == errno) ||
-                     (ENXIO == errno)) {
-                if (verbose)
-                    pr2serr("Unable to open: %s, errno=%d\n", file_namep,
-                            errno);
-                ++num_errors;
-                ++num_silent;
-                continue;
-            }
-            else {
-                if (EACCES == errno)
-                    eacces_err = true;
-                snprintf(ebuff, EBUFF_SZ, ME "Error opening %s ", file_namep);
-                perror(ebuff);
-                ++num_errors;
-                continue;
-            }
-        }
-        res = ioctl(sg_fd, SCSI_IOCTL_GET_IDLUN, &my_idlun);
-        if (res < 0) {
-            res = try_ata_identity(file_namep, sg_fd, do_inquiry);
-            if (res == 0)
-                continue;
-            snprintf(ebuff, EBUFF_SZ, ME "device %s failed on scsi+ata "
-                     "ioctl, skip", file_namep);
-            perror(ebuff);
+        res = scan_one(file_namep, sop, stdout);
+        switch (res) {
+        case SCAN_MISSING:
+            ++num_silent;
             ++num_errors;
-            continue;
-        }
-        res = ioctl(sg_fd, SCSI_IOCTL_GET_BUS_NUMBER, &host_no);
-        if (res < 0) {
-            snprintf(ebuff, EBUFF_SZ, ME "device %s failed on scsi "
-                     "ioctl(2), skip", file_namep);
-            perror(ebuff);
+            break;
+        case SCAN_EACCES:
+            eacces_err = true;
             ++num_errors;
-            continue;
-        }
-        res = ioctl(sg_fd, SG_EMULATED_HOST, &emul);
-        if (res < 0)
-            emul = -1;
-        printf("%s: scsi%d channel=%d id=%d lun=%d", file_namep, host_no,
-               (my_idlun.dev_id >> 16) & 0xff, my_idlun.dev_id & 0xff,
-               (my_idlun.dev_id >> 8) & 0xff);
-        if (1 == emul)
-            printf(" [em]");
-#if 0
-        printf(", huid=%d", my_idlun.host_unique_id);
-#endif
-        if (! has_file_args) {
-            My_sg_scsi_id m_id; /* compatible with sg_scsi_id_t in sg.h */
-
-            res = ioctl(sg_fd, SG_GET_SCSI_ID, &m_id);
-            if (res < 0) {
-                snprintf(ebuff, EBUFF_SZ, ME "device %s failed "
-                         "SG_GET_SCSI_ID ioctl(4), skip", file_namep);
-                perror(ebuff);
-                ++num_errors;
-                continue;
-            }
-            /* printf("  type=%d", m_id.scsi_type); */
-            if (do_extra)
-                printf("  cmd_per_lun=%hd queue_depth=%hd\n",
-                       m_id.h_cmd_per_lun, m_id.d_queue_depth);
-            else
-                printf("\n");
-        }
-        else
-            printf("\n");
-        if (do_inquiry) {
-            if (! sg_ver3_set) {
-                sg_ver3 = false;
-                sg_ver3_set = true;
-                if ((ioctl(sg_fd, SG_GET_VERSION_NUM, &f) >= 0) &&
-                    (f >= 30000))
-                    sg_ver3 = true;
-            }
-            if (sg_ver3) {
-                res = sg3_inq(sg_fd, inqBuff, do_extra);
-                if (res)
-                    ++num_errors;
-            }
+            break;
+        case SCAN_ERR:
+            ++num_errors;
+            break;
+        default:
+            break;
         }
     }           /* end of large for loop <<<<<<<<<<<<<<<<< */
     if ((num_errors >= MAX_ERRORS) && (num_silent < num_errors) &&
-        (! has_file_args)) {
+        (! sop->has_file_args)) {
         printf("Stopping because there are too many error\n");
         if (eacces_err)
             printf("    root access may be required\n");
@@ -395,7 +663,8 @@ int main(int argc, char * argv[])
     return 0;
 }
 
-int sg3_inq(int sg_fd, uint8_t * inqBuff, bool do_extra)
+int sg3_inq(int sg_fd, uint8_t * inqBuff, bool do_extra, int tmo_secs,
+            FILE * fp)
 {
     bool ok;
     int err, sg_io;
@@ -412,7 +681,7 @@ int sg3_inq(int sg_fd, uint8_t * inqBuff, bool do_extra)
     io_hdr.dxferp = inqBuff;
     io_hdr.cmdp = inq_cdb;
     io_hdr.sbp = sense_buffer;
-    io_hdr.timeout = 20000;     /* 20000 millisecs == 20 seconds */
+    io_hdr.timeout = tmo_secs * 1000;   /* def: 20 seconds */
 
     ok = true;
     sg_io = 0;
@@ -421,7 +690,8 @@ int sg3_inq(int sg_fd, uint8_t * inqBuff, bool do_extra)
             perror(ME "Inquiry SG_IO + SCSI_IOCTL_SEND_COMMAND ioctl error");
             return 1;
         } else if (err) {
-            printf(ME "SCSI_IOCTL_SEND_COMMAND ioctl error=0x%x\n", err);
+            fprintf(fp, ME "SCSI_IOCTL_SEND_COMMAND ioctl error=0x%x\n",
+                    err);
             return 1;
         }
     } else {
@@ -448,14 +718,14 @@ int sg3_inq(int sg_fd, uint8_t * inqBuff, bool do_extra)
     if (ok) { /* output result if it is available */
         char * p = (char *)inqBuff;
 
-        printf("    %.8s  %.16s  %.4s ", p + 8, p + 16, p + 32);
-        printf("[rmb=%d cmdq=%d pqual=%d pdev=0x%x] ",
-               !!(p[1] & 0x80), !!(p[7] & 2), (p[0] & 0xe0) >> 5,
-               (p[0] & PDT_MASK));
+        fprintf(fp, "    %.8s  %.16s  %.4s ", p + 8, p + 16, p + 32);
+        fprintf(fp, "[rmb=%d cmdq=%d pqual=%d pdev=0x%x] ",
+                !!(p[1] & 0x80), !!(p[7] & 2), (p[0] & 0xe0) >> 5,
+                (p[0] & PDT_MASK));
         if (do_extra && sg_io)
-            printf("dur=%ums\n", io_hdr.duration);
+            fprintf(fp, "dur=%ums\n", io_hdr.duration);
         else
-            printf("\n");
+            fprintf(fp, "\n");
     }
     return 0;
 }
@@ -578,13 +848,13 @@ void formatdriveidstring(char *out, const char *in, int n)
  * space. Please note that this is needed on both big- and
  * little-endian hardware.
  */
-void printswap(char *output, char *in, unsigned int n)
+void printswap(FILE * fp, char *output, char *in, unsigned int n)
 {
     formatdriveidstring(output, in, n);
     if (*output)
-        printf("%.*s   ", (int)n, output);
+        fprintf(fp, "%.*s   ", (int)n, output);
     else
-        printf("%.*s   ", (int)n, "[No Information Found]\n");
+        fprintf(fp, "%.*s   ", (int)n, "[No Information Found]\n");
 }
 
 #define ATA_IDENTIFY_BUFF_SZ  sizeof(struct ata_identify_device)
@@ -606,7 +876,8 @@ int ata_command_interface(int device, char *data)
     return 0;
 }
 
-int try_ata_identity(const char * file_namep, int ata_fd, bool do_inq)
+int try_ata_identity(const char * file_namep, int ata_fd, bool do_inq,
+                     FILE * fp)
 {
     struct ata_identify_device ata_ident;
     char model[64];
@@ -617,13 +888,13 @@ int try_ata_identity(const char * file_namep, int ata_fd, bool do_inq)
     res = ata_command_interface(ata_fd, (char *)&ata_ident);
     if (res)
         return res;
-    printf("%s: ATA device\n", file_namep);
+    fprintf(fp, "%s: ATA device\n", file_namep);
     if (do_inq) {
-        printf("    ");
-        printswap(model, (char *)ata_ident.model, 40);
-        printswap(serial, (char *)ata_ident.serial_no, 20);
-        printswap(firm, (char *)ata_ident.fw_rev, 8);
-        printf("\n");
+        fprintf(fp, "    ");
+        printswap(fp, model, (char *)ata_ident.model, 40);
+        printswap(fp, serial, (char *)ata_ident.serial_no, 20);
+        printswap(fp, firm, (char *)ata_ident.fw_rev, 8);
+        fprintf(fp, "\n");
     }
     return res;
 }
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2006-2022 Douglas Gilbert.
+ * Copyright (c) 2006-2026 Douglas Gilbert.
  * All rights reserved.
  * Use of this source code is governed by a BSD-style
  * license that can be found in the BSD_LICENSE file.
@@ -10,7 +10,8 @@
 /*
  * This utility shows the relationship between various device names and
  * volumes in Windows OSes (Windows 2000, 2003, XP and Vista). There is
- * an optional scsi adapter scan.
+ * an optional scsi adapter scan. Devices are probed by a pool of worker
+ * threads, each query with a timeout, and the output is sorted.
  */
 
 #ifdef HAVE_CONFIG_H
@@ -29,6 +30,7 @@
 
 #include "sg_lib.h"
 #include "sg_pt.h"
+#include "sg_par.h"
 #include "sg_pr2serr.h"
 
 #ifdef _WIN32_WINNT
@@ -43,7 +45,7 @@
 
 #include "sg_pt_win32.h"
 
-static const char * version_str = "1.23 (win32) 20220127";
+static const char * version_str = "1.24 (win32) 20261015";
 
 #define MAX_SCSI_ELEMS 4096
 #define MAX_ADAPTER_NUM 256
@@ -52,6 +54,10 @@ static const char * version_str = "1.23 (win32) 20220127";
 #define MAX_TAPE_NUM 512
 #define MAX_HOLE_COUNT 16
 #define MAX_GET_INQUIRY_DATA_SZ (32 * 1024)
+#define NUM_VOLUMES 24          /* 'C' to 'Z' */
+#define DEF_NUM_WORKERS 16
+#define MAX_NUM_WORKERS 64      /* WaitForMultipleObjects() limit */
+#define DEF_TIMEOUT_SECS 10
 
 
 union STORAGE_DEVICE_DESCRIPTOR_DATA {
@@ -69,22 +75,68 @@ struct storage_elem {
     char    volume_letters[32];
     bool qp_descriptor_valid;
     bool qp_uid_valid;
+    bool timed_out;
+    int cls;            /* SC_* value, the first sort key */
+    int num;            /* <n> in the class device name, second sort key */
     union STORAGE_DEVICE_DESCRIPTOR_DATA qp_descriptor;
     union STORAGE_DEVICE_UID_DATA qp_uid;
 };
 
+/* Classes of device name that are probed, in output order */
+enum scan_cls_e {SC_PD = 0, SC_CDROM, SC_TAPE, SC_VOLUME, SC_ADAPTER,
+                 SC_NUM_CLS};
+
+/* The names in a class are numbered from 0 and probed in ascending order,
+ * several at once. A class is finished when max_holes numbers after the
+ * highest one found have failed to open. */
+struct scan_cls_t {
+    const char * dos_fmt;       /* for CreateFile() */
+    const char * short_fmt;     /* for storage_elem::name */
+    int max_num;
+    int max_holes;
+    bool wanted;
+    int next;                   /* next number to probe */
+    int highest;                /* highest number opened, -1 for none */
+    int in_flight;
+};
+
+struct adapter_elem {
+    char * inq_dbp;     /* IOCTL_SCSI_GET_INQUIRY_DATA response */
+    uint8_t * free_inq_dbp;
+};
+
 
 static struct storage_elem * storage_arr;
 static uint8_t * free_storage_arr;
 static int next_unused_elem = 0;
 static int verbose = 0;
+static int timeout_ms = DEF_TIMEOUT_SECS * 1000;
+
+static struct scan_cls_t scan_cls_arr[SC_NUM_CLS] = {
+    {"\\\\.\\PhysicalDrive%d", "PD%d", MAX_PHYSICALDRIVE_NUM,
+     MAX_HOLE_COUNT, false, 0, -1, 0},
+    {"\\\\.\\CDROM%d", "CDROM%d", MAX_CDROM_NUM, MAX_HOLE_COUNT, false, 0,
+     -1, 0},
+    {"\\\\.\\TAPE%d", "TAPE%d", MAX_TAPE_NUM, MAX_HOLE_COUNT, false, 0, -1,
+     0},
+    {NULL, NULL, NUM_VOLUMES, NUM_VOLUMES, false, 0, -1, 0},
+    {"\\\\.\\SCSI%d:", "SCSI%d:", MAX_ADAPTER_NUM, MAX_HOLE_COUNT, false,
+     0, -1, 0},
+};
+
+/* guards scan_cls_arr, storage_arr and next_unused_elem while scanning */
+static CRITICAL_SECTION scan_cs;
+static struct storage_elem vol_arr[NUM_VOLUMES];
+static struct adapter_elem adapter_arr[MAX_ADAPTER_NUM];
 
 static struct option long_options[] = {
         {"bus", no_argument, 0, 'b'},
         {"help", no_argument, 0, 'h'},
         {"letter", required_argument, 0, 'l'},
+        {"parallel", required_argument, 0, 'P'},
         {"verbose", no_argument, 0, 'v'},
         {"scsi", no_argument, 0, 's'},
+        {"timeout", required_argument, 0, 't'},
         {"version", no_argument, 0, 'V'},
         {0, 0, 0, 0},
 };
@@ -93,20 +145,28 @@ static struct option long_options[] = {
 static void
 usage()
 {
-    pr2serr("Usage: sg_scan  [--bus] [--help] [--letter=VL] [--scsi] "
-            "[--verbose] [--version]\n");
+    pr2serr("Usage: sg_scan  [--bus] [--help] [--letter=VL] [--parallel=Q] "
+            "[--scsi]\n"
+            "                [--timeout=SECS] [--verbose] [--version]\n");
     pr2serr("       --bus|-b        output bus type\n"
             "       --help|-h       output this usage message then exit\n"
             "       --letter=VL|-l VL    volume letter (e.g. 'F' for F:) "
             "to match\n"
+            "       --parallel=Q|-P Q    probe up to Q devices at once "
+            "(def: %d)\n"
             "       --scsi|-s       used once: show SCSI adapters (tuple) "
             "scan after\n"
             "                       device scan; default: show no "
             "adapters;\n"
             "                       used twice: show only adapters\n"
+            "       --timeout=SECS|-t SECS    give up on a device that has "
+            "not\n"
+            "                                 responded after SECS seconds "
+            "(def: %d)\n"
             "       --verbose|-v    increase verbosity\n"
             "       --version|-V    print version string and exit\n\n"
-            "Scan for storage and related device names\n");
+            "Scan for storage and related device names\n", DEF_NUM_WORKERS,
+            DEF_TIMEOUT_SECS);
 }
 
 static char *
@@ -202,26 +262,64 @@ get_bus_type(int bt)
     }
 }
 
+/* Issues an overlapped DeviceIoControl() on fh (opened with
+ * FILE_FLAG_OVERLAPPED) and waits up to timeout_ms for it. If that
+ * passes the request is cancelled and *timed_outp is set. Returns true if
+ * the request succeeded, otherwise false with the error in *errp. */
+static bool
+ovl_ioctl(HANDLE fh, DWORD code, void * inp, DWORD in_len, void * outp,
+          DWORD out_len, DWORD * num_outp, DWORD * errp, bool * timed_outp)
+{
+    BOOL ok;
+    OVERLAPPED ovl;
+
+    *errp = 0;
+    *timed_outp = false;
+    memset(&ovl, 0, sizeof(ovl));
+    ovl.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (NULL == ovl.hEvent) {
+        *errp = GetLastError();
+        return false;
+    }
+    ok = DeviceIoControl(fh, code, inp, in_len, outp, out_len, num_outp,
+                         &ovl);
+    if ((! ok) && (ERROR_IO_PENDING == GetLastError())) {
+        if (WAIT_TIMEOUT == WaitForSingleObject(ovl.hEvent, timeout_ms)) {
+            CancelIoEx(fh, &ovl);
+            GetOverlappedResult(fh, &ovl, num_outp, TRUE);
+            *timed_outp = true;
+            ok = FALSE;
+            SetLastError(WAIT_TIMEOUT);
+        } else
+            ok = GetOverlappedResult(fh, &ovl, num_outp, FALSE);
+    }
+    if (! ok)
+        *errp = GetLastError();
+    CloseHandle(ovl.hEvent);
+    return !! ok;
+}
+
+/* Returns 0 if successful, -ETIMEDOUT if the device did not respond in
+ * time, else -ENOSYS */
 static int
 query_dev_property(HANDLE hdevice,
                    union STORAGE_DEVICE_DESCRIPTOR_DATA * data)
 {
+    bool timed_out;
     DWORD num_out, err;
     char b[256];
     STORAGE_PROPERTY_QUERY query = {StorageDeviceProperty,
                                     PropertyStandardQuery, {0} };
 
     memset(data, 0, sizeof(*data));
-    if (! DeviceIoControl(hdevice, IOCTL_STORAGE_QUERY_PROPERTY,
-                          &query, sizeof(query), data, sizeof(*data),
-                          &num_out, NULL)) {
-        if (verbose > 2) {
-            err = GetLastError();
+    if (! ovl_ioctl(hdevice, IOCTL_STORAGE_QUERY_PROPERTY, &query,
+                    sizeof(query), data, sizeof(*data), &num_out, &err,
+                    &timed_out)) {
+        if (verbose > 2)
             pr2serr("  IOCTL_STORAGE_QUERY_PROPERTY(Devprop) failed, "
                     "Error=%u %s\n", (unsigned int)err,
                     get_err_str(err, sizeof(b), b));
-        }
-        return -ENOSYS;
+        return timed_out ? -ETIMEDOUT : -ENOSYS;
     }
 
     if (verbose > 3)
@@ -230,9 +328,12 @@ query_dev_property(HANDLE hdevice,
     return 0;
 }
 
+/* Returns 0 if successful or the property does not exist, -ETIMEDOUT if
+ * the device did not respond in time, else -ENOSYS */
 static int
 query_dev_uid(HANDLE hdevice, union STORAGE_DEVICE_UID_DATA * data)
 {
+    bool timed_out;
     DWORD num_out, err;
     char b[256];
     STORAGE_PROPERTY_QUERY query = {StorageDeviceUniqueIdProperty,
@@ -241,14 +342,14 @@ query_dev_uid(HANDLE hdevice, union STORAGE_DEVICE_UID_DATA * data)
     memset(data, 0, sizeof(*data));
     num_out = 0;
     query.QueryType = PropertyExistsQuery;
-    if (! DeviceIoControl(hdevice, IOCTL_STORAGE_QUERY_PROPERTY,
-                          &query, sizeof(query), NULL, 0, &num_out, NULL)) {
-        if (verbose > 2) {
-            err = GetLastError();
+    if (! ovl_ioctl(hdevice, IOCTL_STORAGE_QUERY_PROPERTY, &query,
+                    sizeof(query), NULL, 0, &num_out, &err, &timed_out)) {
+        if (timed_out)
+            return -ETIMEDOUT;
+        if (verbose > 2)
             pr2serr("  IOCTL_STORAGE_QUERY_PROPERTY(DevUid(exists)) failed, "
                     "Error=%u %s\n", (unsigned int)err,
                     get_err_str(err, sizeof(b), b));
-        }
         if (verbose > 3)
             pr2serr("      num_out=%u\n", (unsigned int)num_out);
         /* interpret any error to mean this property doesn't exist */
@@ -256,16 +357,14 @@ query_dev_uid(HANDLE hdevice, union STORAGE_DEVICE_UID_DATA * data)
     }
 
     query.QueryType = PropertyStandardQuery;
-    if (! DeviceIoControl(hdevice, IOCTL_STORAGE_QUERY_PROPERTY,
-                          &query, sizeof(query), data, sizeof(*data),
-                          &num_out, NULL)) {
-        if (verbose > 2) {
-            err = GetLastError();
+    if (! ovl_ioctl(hdevice, IOCTL_STORAGE_QUERY_PROPERTY, &query,
+                    sizeof(query), data, sizeof(*data), &num_out, &err,
+                    &timed_out)) {
+        if (verbose > 2)
             pr2serr("  IOCTL_STORAGE_QUERY_PROPERTY(DevUid) failed, Error=%u "
                     "%s\n", (unsigned int)err,
                     get_err_str(err, sizeof(b), b));
-        }
-        return -ENOSYS;
+        return timed_out ? -ETIMEDOUT : -ENOSYS;
     }
     if (verbose > 3)
         pr2serr("  IOCTL_STORAGE_QUERY_PROPERTY(DevUid) num_out=%u\n",
@@ -311,20 +410,15 @@ check_devices(const struct storage_elem * sep)
     return 0;
 }
 
-static int
-enum_scsi_adapters(void)
+/* Fetches the IOCTL_SCSI_GET_INQUIRY_DATA response of adapter number num
+ * into adapter_arr[num] for print_adapter(). */
+static void
+probe_adapter(HANDLE fh, const char * adapter_name, int num)
 {
-    int k, j;
-    int hole_count = 0;
-    HANDLE fh;
-    ULONG dummy;
-    DWORD err = 0;
-    BYTE bus;
-    BOOL success;
-    char adapter_name[64];
+    bool timed_out;
+    DWORD dummy, err;
     char * inq_dbp;
     uint8_t * free_inq_dbp = NULL;
-    PSCSI_ADAPTER_BUS_INFO  ai;
     char b[256];
 
     inq_dbp = (char *)sg_memalign(MAX_GET_INQUIRY_DATA_SZ, 0, &free_inq_dbp,
@@ -332,277 +426,264 @@ enum_scsi_adapters(void)
     if (NULL == inq_dbp) {
         pr2serr("%s: unable to allocate %d bytes on heap\n", __func__,
                 MAX_GET_INQUIRY_DATA_SZ);
-        return sg_convert_errno(ENOMEM);
+        return;
     }
-
-    for (k = 0; k < MAX_ADAPTER_NUM; ++k) {
-        snprintf(adapter_name, sizeof (adapter_name), "\\\\.\\SCSI%d:", k);
-        fh = CreateFile(adapter_name, GENERIC_READ | GENERIC_WRITE,
-                        FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
-                        OPEN_EXISTING, 0, NULL);
-        if (fh != INVALID_HANDLE_VALUE) {
-            hole_count = 0;
-            success = DeviceIoControl(fh, IOCTL_SCSI_GET_INQUIRY_DATA, NULL,
-                                      0, inq_dbp, MAX_GET_INQUIRY_DATA_SZ,
-                                      &dummy, NULL);
-            if (success) {
-                PSCSI_BUS_DATA pbd;
-                PSCSI_INQUIRY_DATA pid;
-                int num_lus, off;
-
-                ai = (PSCSI_ADAPTER_BUS_INFO)inq_dbp;
-                for (bus = 0; bus < ai->NumberOfBusses; bus++) {
-                    pbd = ai->BusData + bus;
-                    num_lus = pbd->NumberOfLogicalUnits;
-                    off = pbd->InquiryDataOffset;
-                    for (j = 0; j < num_lus; ++j) {
-                        if ((off < (int)sizeof(SCSI_ADAPTER_BUS_INFO)) ||
-                            (off > (MAX_GET_INQUIRY_DATA_SZ -
-                                    (int)sizeof(SCSI_INQUIRY_DATA))))
-                            break;
-                        pid = (PSCSI_INQUIRY_DATA)(inq_dbp + off);
-                        snprintf(b, sizeof(b) - 1, "SCSI%d:%d,%d,%d ", k,
-                                 pid->PathId, pid->TargetId, pid->Lun);
-                        printf("%-15s", b);
-                        snprintf(b, sizeof(b) - 1, "claimed=%d pdt=%xh %s ",
-                                 pid->DeviceClaimed,
-                                 pid->InquiryData[0] % PDT_MASK,
-                                 ((0 == pid->InquiryData[4]) ? "dubious" :
-                                                               ""));
-                        printf("%-26s", b);
-                        printf("%.8s  %.16s  %.4s\n", pid->InquiryData + 8,
-                               pid->InquiryData + 16, pid->InquiryData + 32);
-                        off = pid->NextInquiryDataOffset;
-                    }
-                }
-            } else {
-                err = GetLastError();
-                pr2serr("%s: IOCTL_SCSI_GET_INQUIRY_DATA failed err=%u\n\t%s",
-                        adapter_name, (unsigned int)err,
-                        get_err_str(err, sizeof(b), b));
-                err = SG_LIB_WINDOWS_ERR;
-            }
-            CloseHandle(fh);
-        } else {
-            err = GetLastError();
-            if (ERROR_SHARING_VIOLATION == err)
-                pr2serr("%s: in use by other process (sharing violation "
-                        "[34])\n", adapter_name);
-            else if (verbose > 3)
-                pr2serr("%s: CreateFile failed err=%u\n\t%s", adapter_name,
-                        (unsigned int)err, get_err_str(err, sizeof(b), b));
-            if (++hole_count >= MAX_HOLE_COUNT)
-                break;
-            /* hope problem is local to this adapter so continue to next */
-        }
+    if (ovl_ioctl(fh, IOCTL_SCSI_GET_INQUIRY_DATA, NULL, 0, inq_dbp,
+                  MAX_GET_INQUIRY_DATA_SZ, &dummy, &err, &timed_out)) {
+        adapter_arr[num].inq_dbp = inq_dbp;
+        adapter_arr[num].free_inq_dbp = free_inq_dbp;
+        return;
     }
+    if (timed_out)
+        pr2serr("%s: no response after %d seconds, skipped\n", adapter_name,
+                timeout_ms / 1000);
+    else
+        pr2serr("%s: IOCTL_SCSI_GET_INQUIRY_DATA failed err=%u\n\t%s",
+                adapter_name, (unsigned int)err,
+                get_err_str(err, sizeof(b), b));
     if (free_inq_dbp)
         free(free_inq_dbp);
-    return 0;
 }
 
-static int
-enum_volumes(char letter)
+static void
+print_adapter(int num, const char * inq_dbp)
 {
-    int k;
-    HANDLE fh;
-    char adapter_name[64];
-    struct storage_elem tmp_se;
+    int j, num_lus, off;
+    BYTE bus;
+    PSCSI_ADAPTER_BUS_INFO ai = (PSCSI_ADAPTER_BUS_INFO)inq_dbp;
+    PSCSI_BUS_DATA pbd;
+    PSCSI_INQUIRY_DATA pid;
+    char b[256];
 
-    if (verbose > 2)
-        pr2serr("%s: enter\n", __FUNCTION__ );
-    for (k = 0; k < 24; ++k) {
-        memset(&tmp_se, 0, sizeof(tmp_se));
-        snprintf(adapter_name, sizeof (adapter_name), "\\\\.\\%c:", 'C' + k);
-        tmp_se.name[0] = 'C' + k;
-        fh = CreateFile(adapter_name, GENERIC_READ | GENERIC_WRITE,
-                        FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
-                        OPEN_EXISTING, 0, NULL);
-        if (fh != INVALID_HANDLE_VALUE) {
-            if (query_dev_property(fh, &tmp_se.qp_descriptor) < 0)
-                pr2serr("%s: query_dev_property failed\n", __FUNCTION__ );
-            else
-                tmp_se.qp_descriptor_valid = true;
-            if (query_dev_uid(fh, &tmp_se.qp_uid) < 0) {
-                if (verbose > 2)
-                    pr2serr("%s: query_dev_uid failed\n", __FUNCTION__ );
-            } else
-                tmp_se.qp_uid_valid = true;
-            if (('\0' == letter) || (letter == tmp_se.name[0]))
-                check_devices(&tmp_se);
-            CloseHandle(fh);
+    for (bus = 0; bus < ai->NumberOfBusses; bus++) {
+        pbd = ai->BusData + bus;
+        num_lus = pbd->NumberOfLogicalUnits;
+        off = pbd->InquiryDataOffset;
+        for (j = 0; j < num_lus; ++j) {
+            if ((off < (int)sizeof(SCSI_ADAPTER_BUS_INFO)) ||
+                (off > (MAX_GET_INQUIRY_DATA_SZ -
+                        (int)sizeof(SCSI_INQUIRY_DATA))))
+                break;
+            pid = (PSCSI_INQUIRY_DATA)(inq_dbp + off);
+            snprintf(b, sizeof(b) - 1, "SCSI%d:%d,%d,%d ", num,
+                     pid->PathId, pid->TargetId, pid->Lun);
+            printf("%-15s", b);
+            snprintf(b, sizeof(b) - 1, "claimed=%d pdt=%xh %s ",
+                     pid->DeviceClaimed, pid->InquiryData[0] % PDT_MASK,
+                     ((0 == pid->InquiryData[4]) ? "dubious" : ""));
+            printf("%-26s", b);
+            printf("%.8s  %.16s  %.4s\n", pid->InquiryData + 8,
+                   pid->InquiryData + 16, pid->InquiryData + 32);
+            off = pid->NextInquiryDataOffset;
         }
     }
-    return 0;
 }
 
-static int
-enum_pds(void)
+/* Opens the device numbered num in class cls_i and queries it, placing
+ * what it finds in storage_arr, vol_arr or adapter_arr. Returns true if
+ * the device could be opened. Called by the workers without scan_cs
+ * held. */
+static bool
+probe_dev(int cls_i, int num)
 {
-    int k;
-    int hole_count = 0;
+    int res;
     HANDLE fh;
     DWORD err;
+    const struct scan_cls_t * scp = scan_cls_arr + cls_i;
     char adapter_name[64];
     char b[256];
     struct storage_elem tmp_se;
 
-    if (verbose > 2)
-        pr2serr("%s: enter\n", __FUNCTION__ );
-    for (k = 0; k < MAX_PHYSICALDRIVE_NUM; ++k) {
-        memset(&tmp_se, 0, sizeof(tmp_se));
-        snprintf(adapter_name, sizeof (adapter_name),
-                 "\\\\.\\PhysicalDrive%d", k);
-        snprintf(tmp_se.name, sizeof(tmp_se.name), "PD%d", k);
-        fh = CreateFile(adapter_name, GENERIC_READ | GENERIC_WRITE,
-                        FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
-                        OPEN_EXISTING, 0, NULL);
-        if (fh != INVALID_HANDLE_VALUE) {
-            if (query_dev_property(fh, &tmp_se.qp_descriptor) < 0)
-                pr2serr("%s: query_dev_property failed\n", __FUNCTION__ );
-            else
-                tmp_se.qp_descriptor_valid = true;
-            if (query_dev_uid(fh, &tmp_se.qp_uid) < 0) {
-                if (verbose > 2)
-                    pr2serr("%s: query_dev_uid failed\n", __FUNCTION__ );
-            } else
-                tmp_se.qp_uid_valid = true;
-            hole_count = 0;
-            memcpy(&storage_arr[next_unused_elem++], &tmp_se, sizeof(tmp_se));
-            CloseHandle(fh);
-        } else {
-            err = GetLastError();
-            if ((0 == k) && (ERROR_ACCESS_DENIED == err))
-                pr2serr("Access denied on %s, may need Administrator\n",
-                        adapter_name);
-            if (ERROR_SHARING_VIOLATION == err)
-                pr2serr("%s: in use by other process (sharing violation "
-                        "[34])\n", adapter_name);
-            else if (verbose > 3)
-                pr2serr("%s: CreateFile failed err=%u\n\t%s", adapter_name,
-                        (unsigned int)err, get_err_str(err, sizeof(b), b));
-            if (++hole_count >= MAX_HOLE_COUNT)
-                break;
-        }
+    memset(&tmp_se, 0, sizeof(tmp_se));
+    tmp_se.cls = cls_i;
+    tmp_se.num = num;
+    if (SC_VOLUME == cls_i) {
+        snprintf(adapter_name, sizeof(adapter_name), "\\\\.\\%c:",
+                 'C' + num);
+        tmp_se.name[0] = 'C' + num;
+    } else {
+        snprintf(adapter_name, sizeof(adapter_name), scp->dos_fmt, num);
+        snprintf(tmp_se.name, sizeof(tmp_se.name), scp->short_fmt, num);
     }
-    return 0;
+    fh = CreateFile(adapter_name, GENERIC_READ | GENERIC_WRITE,
+                    FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                    OPEN_EXISTING, FILE_FLAG_OVERLAPPED, NULL);
+    if (INVALID_HANDLE_VALUE == fh) {
+        if (SC_VOLUME == cls_i)
+            return false;
+        err = GetLastError();
+        if ((SC_PD == cls_i) && (0 == num) && (ERROR_ACCESS_DENIED == err))
+            pr2serr("Access denied on %s, may need Administrator\n",
+                    adapter_name);
+        if (ERROR_SHARING_VIOLATION == err)
+            pr2serr("%s: in use by other process (sharing violation "
+                    "[34])\n", adapter_name);
+        else if (verbose > 3)
+            pr2serr("%s: CreateFile failed err=%u\n\t%s", adapter_name,
+                    (unsigned int)err, get_err_str(err, sizeof(b), b));
+        return false;
+    }
+    if (SC_ADAPTER == cls_i) {
+        probe_adapter(fh, adapter_name, num);
+        CloseHandle(fh);
+        return true;
+    }
+    res = query_dev_property(fh, &tmp_se.qp_descriptor);
+    if (0 == res)
+        tmp_se.qp_descriptor_valid = true;
+    else if (-ETIMEDOUT == res)
+        tmp_se.timed_out = true;
+    else
+        pr2serr("%s: query_dev_property failed\n", adapter_name);
+    if (! tmp_se.timed_out) {
+        res = query_dev_uid(fh, &tmp_se.qp_uid);
+        if (0 == res)
+            tmp_se.qp_uid_valid = true;
+        else if (-ETIMEDOUT == res)
+            tmp_se.timed_out = true;
+        else if (verbose > 2)
+            pr2serr("%s: query_dev_uid failed\n", adapter_name);
+    }
+    if (tmp_se.timed_out)
+        pr2serr("%s: no response after %d seconds, skipped\n", adapter_name,
+                timeout_ms / 1000);
+    CloseHandle(fh);
+    EnterCriticalSection(&scan_cs);
+    if (SC_VOLUME == cls_i)
+        memcpy(vol_arr + num, &tmp_se, sizeof(tmp_se));
+    else if (next_unused_elem < MAX_SCSI_ELEMS)
+        memcpy(&storage_arr[next_unused_elem++], &tmp_se, sizeof(tmp_se));
+    LeaveCriticalSection(&scan_cs);
+    return true;
 }
 
-static int
-enum_cdroms(void)
+/* Picks the next device to probe, from the first class that has one.
+ * Returns false if there is none; then *waitp is set if an outstanding
+ * probe may still find a device and so extend its class. Called with
+ * scan_cs held. */
+static bool
+next_probe(int * cls_ip, int * nump, bool * waitp)
 {
     int k;
-    int hole_count = 0;
-    HANDLE fh;
-    DWORD err;
-    char adapter_name[64];
-    char b[256];
-    struct storage_elem tmp_se;
+    struct scan_cls_t * scp;
 
-    if (verbose > 2)
-        pr2serr("%s: enter\n", __FUNCTION__ );
-    for (k = 0; k < MAX_CDROM_NUM; ++k) {
-        memset(&tmp_se, 0, sizeof(tmp_se));
-        snprintf(adapter_name, sizeof (adapter_name), "\\\\.\\CDROM%d", k);
-        snprintf(tmp_se.name, sizeof(tmp_se.name), "CDROM%d", k);
-        fh = CreateFile(adapter_name, GENERIC_READ | GENERIC_WRITE,
-                        FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
-                        OPEN_EXISTING, 0, NULL);
-        if (fh != INVALID_HANDLE_VALUE) {
-            if (query_dev_property(fh, &tmp_se.qp_descriptor) < 0)
-                pr2serr("%s: query_dev_property failed\n", __FUNCTION__ );
-            else
-                tmp_se.qp_descriptor_valid = true;
-            if (query_dev_uid(fh, &tmp_se.qp_uid) < 0) {
-                if (verbose > 2)
-                    pr2serr("%s: query_dev_uid failed\n", __FUNCTION__ );
-            } else
-                tmp_se.qp_uid_valid = true;
-            hole_count = 0;
-            memcpy(&storage_arr[next_unused_elem++], &tmp_se, sizeof(tmp_se));
-            CloseHandle(fh);
-        } else {
-            err = GetLastError();
-            if (ERROR_SHARING_VIOLATION == err)
-                pr2serr("%s: in use by other process (sharing violation "
-                        "[34])\n", adapter_name);
-            else if (verbose > 3)
-                pr2serr("%s: CreateFile failed err=%u\n\t%s", adapter_name,
-                        (unsigned int)err, get_err_str(err, sizeof(b), b));
-            if (++hole_count >= MAX_HOLE_COUNT)
+    *waitp = false;
+    for (k = 0, scp = scan_cls_arr; k < SC_NUM_CLS; ++k, ++scp) {
+        if ((! scp->wanted) || (scp->next >= scp->max_num))
+            continue;
+        if (scp->next <= (scp->highest + scp->max_holes)) {
+            *cls_ip = k;
+            *nump = scp->next++;
+            ++scp->in_flight;
+            return true;
+        }
+        if (scp->in_flight > 0)
+            *waitp = true;
+    }
+    return false;
+}
+
+static DWORD WINAPI
+scan_worker(LPVOID param)
+{
+    bool found, wait;
+    int cls_i, num;
+    struct scan_cls_t * scp;
+
+    (void)param;
+    while (true) {
+        EnterCriticalSection(&scan_cs);
+        if (! next_probe(&cls_i, &num, &wait)) {
+            LeaveCriticalSection(&scan_cs);
+            if (! wait)
                 break;
+            Sleep(1);
+            continue;
         }
+        LeaveCriticalSection(&scan_cs);
+        found = probe_dev(cls_i, num);
+        EnterCriticalSection(&scan_cs);
+        scp = scan_cls_arr + cls_i;
+        --scp->in_flight;
+        if (found && (num > scp->highest))
+            scp->highest = num;
+        LeaveCriticalSection(&scan_cs);
     }
     return 0;
 }
 
-static int
-enum_tapes(void)
+/* Probes the wanted classes with num_workers threads (this one included) */
+static void
+scan_run(int num_workers)
 {
     int k;
-    int hole_count = 0;
-    HANDLE fh;
-    DWORD err;
-    char adapter_name[64];
-    char b[256];
-    struct storage_elem tmp_se;
-
-    if (verbose > 2)
-        pr2serr("%s: enter\n", __FUNCTION__ );
-    for (k = 0; k < MAX_TAPE_NUM; ++k) {
-        memset(&tmp_se, 0, sizeof(tmp_se));
-        snprintf(adapter_name, sizeof (adapter_name), "\\\\.\\TAPE%d", k);
-        snprintf(tmp_se.name, sizeof(tmp_se.name), "TAPE%d", k);
-        fh = CreateFile(adapter_name, GENERIC_READ | GENERIC_WRITE,
-                        FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
-                        OPEN_EXISTING, 0, NULL);
-        if (fh != INVALID_HANDLE_VALUE) {
-            if (query_dev_property(fh, &tmp_se.qp_descriptor) < 0)
-                pr2serr("%s: query_dev_property failed\n", __FUNCTION__ );
-            else
-                tmp_se.qp_descriptor_valid = true;
-            if (query_dev_uid(fh, &tmp_se.qp_uid) < 0) {
-                if (verbose > 2)
-                    pr2serr("%s: query_dev_uid failed\n", __FUNCTION__ );
-            } else
-                tmp_se.qp_uid_valid = true;
-            hole_count = 0;
-            memcpy(&storage_arr[next_unused_elem++], &tmp_se, sizeof(tmp_se));
-            CloseHandle(fh);
-        } else {
-            err = GetLastError();
-            if (ERROR_SHARING_VIOLATION == err)
-                pr2serr("%s: in use by other process (sharing violation "
-                        "[34])\n", adapter_name);
-            else if (verbose > 3)
-                pr2serr("%s: CreateFile failed err=%u\n\t%s", adapter_name,
-                        (unsigned int)err, get_err_str(err, sizeof(b), b));
-            if (++hole_count >= MAX_HOLE_COUNT)
-                break;
+    int n = 0;
+    HANDLE th_arr[MAX_NUM_WORKERS];
+
+    InitializeCriticalSection(&scan_cs);
+    for (k = 1; k < num_workers; ++k) {
+        th_arr[n] = CreateThread(NULL, 0, scan_worker, NULL, 0, NULL);
+        if (NULL == th_arr[n]) {
+            if (verbose)
+                pr2serr("%s: CreateThread failed err=%u, using %d "
+                        "workers\n", __func__, (unsigned int)GetLastError(),
+                        n + 1);
+            break;
         }
+        ++n;
     }
+    if (verbose > 2)
+        pr2serr("%s: %d workers, timeout %d ms\n", __func__, n + 1,
+                timeout_ms);
+    scan_worker(NULL);
+    if (n > 0) {
+        WaitForMultipleObjects(n, th_arr, TRUE, INFINITE);
+        for (k = 0; k < n; ++k)
+            CloseHandle(th_arr[k]);
+    }
+    DeleteCriticalSection(&scan_cs);
+}
+
+/* Orders by class (e.g. all PhysicalDrives first) then by number */
+static int
+cmp_storage_elem(const void * ap, const void * bp)
+{
+    const struct storage_elem * a = (const struct storage_elem *)ap;
+    const struct storage_elem * b = (const struct storage_elem *)bp;
+
+    if (a->cls != b->cls)
+        return (a->cls < b->cls) ? -1 : 1;
+    if (a->num != b->num)
+        return (a->num < b->num) ? -1 : 1;
     return 0;
 }
 
 static int
-sg_do_wscan(char letter, bool show_bt, int scsi_scan)
+sg_do_wscan(char letter, bool show_bt, int scsi_scan, int num_workers)
 {
     int k, j, n;
     struct storage_elem * sp;
 
     if (scsi_scan < 2) {
-        k = enum_pds();
-        if (k)
-            return k;
-        k = enum_cdroms();
-        if (k)
-            return k;
-        k = enum_tapes();
-        if (k)
-            return k;
-        k = enum_volumes(letter);
-        if (k)
-            return k;
+        scan_cls_arr[SC_PD].wanted = true;
+        scan_cls_arr[SC_CDROM].wanted = true;
+        scan_cls_arr[SC_TAPE].wanted = true;
+        scan_cls_arr[SC_VOLUME].wanted = true;
+    }
+    if (scsi_scan)
+        scan_cls_arr[SC_ADAPTER].wanted = true;
+    scan_run(num_workers);
+
+    if (scsi_scan < 2) {
+        qsort(storage_arr, next_unused_elem, sizeof(struct storage_elem),
+              cmp_storage_elem);
+        for (k = 0; k < NUM_VOLUMES; ++k) {
+            sp = vol_arr + k;
+            if (('\0' == sp->name[0]) || sp->timed_out)
+                continue;
+            if (('\0' == letter) || (letter == sp->name[0]))
+                check_devices(sp);
+        }
 
         for (k = 0; k < next_unused_elem; ++k) {
             sp = storage_arr + k;
@@ -641,7 +722,9 @@ sg_do_wscan(char letter, bool show_bt, int scsi_scan)
                 printf("\n");
                 if (verbose > 2)
                     hex2stderr((const uint8_t *)sp->qp_descriptor.raw, 144, 0);
-            } else
+            } else if (sp->timed_out)
+                printf("<no response>\n");
+            else
                 printf("\n");
             if ((verbose > 3) && sp->qp_uid_valid) {
                 printf("  UID valid, in hex:\n");
@@ -654,7 +737,13 @@ sg_do_wscan(char letter, bool show_bt, int scsi_scan)
     if (scsi_scan) {
         if (scsi_scan < 2)
             printf("\n");
-        enum_scsi_adapters();
+        for (k = 0; k < MAX_ADAPTER_NUM; ++k) {
+            if (NULL == adapter_arr[k].inq_dbp)
+                continue;
+            print_adapter(k, adapter_arr[k].inq_dbp);
+            if (adapter_arr[k].free_inq_dbp)
+                free(adapter_arr[k].free_inq_dbp);
+        }
     }
     return 0;
 }
@@ -664,14 +753,15 @@ int
 main(int argc, char * argv[])
 {
     bool show_bt = false;
-    int c, ret;
+    int c, k, ret;
     int vol_letter = 0;
     int scsi_scan = 0;
+    int num_workers = DEF_NUM_WORKERS;
 
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "bhHl:svV", long_options,
+        c = getopt_long(argc, argv, "bhHl:P:st:vV", long_options,
                         &option_index);
         if (c == -1)
             break;
@@ -693,9 +783,25 @@ main(int argc, char * argv[])
                 return SG_LIB_SYNTAX_ERROR;
             }
             break;
+        case 'P':
+            num_workers = sg_par_get_num(optarg, 1, MAX_NUM_WORKERS);
+            if (num_workers < 0) {
+                usage();
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
         case 's':
             ++scsi_scan;
             break;
+        case 't':
+            k = sg_get_num(optarg);
+            if ((k < 1) || (k > 3600)) {
+                pr2serr("'--timeout=' expects seconds from 1 to 3600\n");
+                usage();
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            timeout_ms = k * 1000;
+            break;
         case 'v':
             ++verbose;
             break;
@@ -721,7 +827,7 @@ main(int argc, char * argv[])
                   sg_memalign(sizeof(struct storage_elem) * MAX_SCSI_ELEMS, 0,
                               &free_storage_arr, false);
     if (storage_arr) {
-        ret = sg_do_wscan(vol_letter, show_bt, scsi_scan);
+        ret = sg_do_wscan(vol_letter, show_bt, scsi_scan, num_workers);
         if (free_storage_arr)
             free(free_storage_arr);
     } else {
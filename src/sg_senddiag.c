@@ -1,6 +1,6 @@
 /*
  * A utility program originally written for the Linux OS SCSI subsystem
- *    Copyright (C) 2003-2022 D. Gilbert
+ *    Copyright (C) 2003-2026 D. Gilbert
  * This program is free software; you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
  * the Free Software Foundation; either version 2, or (at your option)
@@ -10,14 +10,20 @@
 
    This program issues the SCSI SEND DIAGNOSTIC command and in one case
    the SCSI RECEIVE DIAGNOSTIC command to list supported diagnostic pages.
+   Given several DEVICEs (or --wait) it starts a background self-test on
+   each and follows them all to completion from one loop.
 */
 
 #include <unistd.h>
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
 #include <getopt.h>
 
 #ifdef HAVE_CONFIG_H
@@ -31,20 +37,34 @@
 #include "sg_pt.h"      /* needed for scsi_pt_win32_direct() */
 #endif
 #include "sg_unaligned.h"
+#include "sg_mpoll.h"
 #include "sg_pr2serr.h"
 
 
-static const char * version_str = "0.65 20220128";
+static const char * version_str = "0.66 20261015";
 
-#define ME "sg_senddiag: "
+#define MY_NAME "sg_senddiag"
+#define ME MY_NAME ": "
 
 #define DEF_ALLOC_LEN (1024 * 4)
 
+/* Self-test results log page: 20 parameters, most recent first */
+#define ST_RES_LPAGE 0x10
+#define ST_RES_PARAM_LEN 20
+#define ST_RES_LOG_LEN (4 + (20 * ST_RES_PARAM_LEN))
+#define ST_RES_IN_PROGRESS 0xf
+#define ST_RES_MAX_UNSEEN 3     /* polls before a test not logged is failed */
+#define ST_RS_LEN 252
+
 static struct option long_options[] = {
+        {"concurrency", required_argument, 0, 'c'},
         {"doff", no_argument, 0, 'd'},
         {"extdur", no_argument, 0, 'e'},
         {"help", no_argument, 0, 'h'},
         {"hex", no_argument, 0, 'H'},
+        {"json", optional_argument, 0, '^'},    /* short option is '-j' */
+        {"js-file", required_argument, 0, 'J'},
+        {"js_file", required_argument, 0, 'J'},
         {"list", no_argument, 0, 'l'},
         {"maxlen", required_argument, 0, 'm'},
         {"new", no_argument, 0, 'N'},
@@ -58,6 +78,7 @@ static struct option long_options[] = {
         {"uoff", no_argument, 0, 'u'},
         {"verbose", no_argument, 0, 'v'},
         {"version", no_argument, 0, 'V'},
+        {"wait", no_argument, 0, 'w'},
         {0, 0, 0, 0},
 };
 
@@ -65,10 +86,12 @@ struct opts_t {
     bool do_deftest;
     bool do_doff;
     bool do_extdur;
+    bool do_json;
     bool do_list;
     bool do_pf;
     bool do_raw;
     bool do_uoff;
+    bool do_wait;
     bool opt_new;
     bool verbose_given;
     bool version_given;
@@ -79,22 +102,34 @@ struct opts_t {
     int do_selftest;
     int timeout;
     int verbose;
-    const char * device_name;
+    int concurrency;    /* most self-tests running at once, 0: no limit */
+    int num_devs;
+    const char * device_name;   /* first (or only) DEVICE */
+    const char ** dev_names;
     const char * raw_arg;
+    const char * json_arg;      /* carries [JO] if any */
+    const char * js_file;       /* --js-file= argument */
+    sgj_state json_st;
 };
 
 
 static void
 usage()
 {
-    printf("Usage: sg_senddiag [--doff] [--extdur] [--help] [--hex] "
-           "[--list]\n"
-           "                   [--maxlen=LEN] [--page=PG] [--pf] "
-           "[--raw=H,H...]\n"
-           "                   [--selftest=ST] [--test] [--timeout=SECS] "
-           "[--uoff]\n"
-           "                   [--verbose] [--version] [DEVICE]\n"
+    printf("Usage: sg_senddiag [--concurrency=N] [--doff] [--extdur] "
+           "[--help] [--hex]\n"
+           "                   [--json[=JO]] [--js-file=JFN] [--list] "
+           "[--maxlen=LEN]\n"
+           "                   [--page=PG] [--pf] [--raw=H,H...] "
+           "[--selftest=ST]\n"
+           "                   [--test] [--timeout=SECS] [--uoff] "
+           "[--verbose] [--version]\n"
+           "                   [--wait] [DEVICE...]\n"
            "  where:\n"
+           "    --concurrency=N|-c N    with several DEVICEs: at most N "
+           "self-tests\n"
+           "                            running at once (def: 0 -> no "
+           "limit)\n"
            "    --doff|-d       device online (def: 0, only with '--test')\n"
            "    --extdur|-e     duration of an extended self-test (from mode "
            "page 0xa)\n"
@@ -102,6 +137,15 @@ usage()
            "    --hex|-H        output RDR in hex; twice: plus ASCII; thrice: "
            "suitable\n"
            "                    for '--raw=-' with later invocation\n"
+           "    --json[=JO]|-j[=JO]    output in JSON instead of plain text "
+           "(only\n"
+           "                           with --wait or several DEVICEs). Use "
+           "--json=?\n"
+           "                           for JSON help\n"
+           "    --js-file=JFN|-J JFN    JFN is a filename to which JSON "
+           "output is\n"
+           "                            written (def: stdout); truncates "
+           "then writes\n"
            "    --list|-l       list supported page codes (with or without "
            "DEVICE)\n"
            "    --maxlen=LEN|-m LEN    parameter list length or maximum "
@@ -122,13 +166,22 @@ usage()
            "extended\n"
            "    --test|-t       default self-test\n"
            "    --timeout=SECS|-T SECS    timeout for foreground self tests\n"
-           "                            unit: second (def: 7200 seconds)\n"
+           "                            unit: second (def: 7200 seconds); "
+           "with\n"
+           "                            --wait: longest wait for each "
+           "self-test\n"
            "    --uoff|-u       unit offline (def: 0, only with '--test')\n"
            "    --verbose|-v    increase verbosity\n"
            "    --old|-O        use old interface (use as first option)\n"
-           "    --version|-V    output version string then exit\n\n"
+           "    --version|-V    output version string then exit\n"
+           "    --wait|-w       start background self-test (ST 1 or 2) then "
+           "wait,\n"
+           "                    polling, for its result. Implied by several "
+           "DEVICEs\n\n"
            "Performs a SCSI SEND DIAGNOSTIC (and/or a RECEIVE DIAGNOSTIC "
-           "RESULTS) command\n"
+           "RESULTS) command.\nWith several DEVICEs starts a background "
+           "self-test on each and polls them\nall, from one loop, until "
+           "their results are in the Self-Test results log\npage.\n"
         );
 }
 
@@ -174,12 +227,20 @@ new_parse_cmd_line(struct opts_t * op, int argc, char * argv[])
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "dehHlm:NOpP:r:s:tT:uvV", long_options,
-                        &option_index);
+        c = getopt_long(argc, argv, "^c:dehHj::J:lm:NOpP:r:s:tT:uvVw",
+                        long_options, &option_index);
         if (c == -1)
             break;
 
         switch (c) {
+        case 'c':
+            n = sg_get_num(optarg);
+            if (n < 0) {
+                pr2serr("bad argument to '--concurrency='\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            op->concurrency = n;
+            break;
         case 'd':
             op->do_doff = true;
             break;
@@ -193,6 +254,17 @@ new_parse_cmd_line(struct opts_t * op, int argc, char * argv[])
         case 'H':
             ++op->do_hex;
             break;
+        case 'j':       /* for: -j[=JO] */
+        case '^':       /* for: --json[=JO] */
+            op->do_json = true;
+            /* Now want '=' to be next character and step over it */
+            op->json_arg = (('j' == c) && optarg && ('=' == *optarg)) ?
+                           optarg + 1 : optarg;
+            break;
+        case 'J':
+            op->do_json = true;
+            op->js_file = optarg;
+            break;
         case 'l':
             op->do_list = true;
             break;
@@ -256,6 +328,9 @@ new_parse_cmd_line(struct opts_t * op, int argc, char * argv[])
         case 'V':
             op->version_given = true;
             break;
+        case 'w':
+            op->do_wait = true;
+            break;
         default:
             pr2serr("unrecognised option code %c [0x%x]\n", c, c);
             if (op->do_help)
@@ -265,16 +340,10 @@ new_parse_cmd_line(struct opts_t * op, int argc, char * argv[])
         }
     }
     if (optind < argc) {
-        if (NULL == op->device_name) {
-            op->device_name = argv[optind];
-            ++optind;
-        }
-        if (optind < argc) {
-            for (; optind < argc; ++optind)
-                pr2serr("Unexpected extra argument: %s\n", argv[optind]);
-            usage();
-            return SG_LIB_SYNTAX_ERROR;
-        }
+        /* all remaining arguments are DEVICEs */
+        op->dev_names = (const char **)(argv + optind);
+        op->num_devs = argc - optind;
+        op->device_name = argv[optind];
     }
     return 0;
 }
@@ -672,6 +741,373 @@ list_page_codes()
                (pcdp->desc ? pcdp->desc : "<unknown>"));
 }
 
+/* Following two from the Self-test results log page, see sg_logs */
+static const char * self_test_code[] = {
+    "default", "background short", "background extended", "reserved",
+    "aborted background", "foreground short", "foreground extended",
+    "reserved"};
+
+static const char * self_test_result[] = {
+    "completed without error",
+    "aborted by SEND DIAGNOSTIC",
+    "aborted other than by SEND DIAGNOSTIC",
+    "unknown error, unable to complete",
+    "self test completed with failure in test segment (which one unknown)",
+    "first segment in self test failed",
+    "second segment in self test failed",
+    "another segment in self test failed",
+    "reserved", "reserved", "reserved", "reserved", "reserved", "reserved",
+    "reserved", "self test in progress"};
+
+/* Self-test state of one DEVICE; its polling state is in the sg_mpoll_dev
+ * element with the same index. */
+struct st_dev {
+    bool logged;        /* 'entry' holds the result of this self-test */
+    int unseen;         /* polls finding no trace of the self-test */
+    uint8_t before[ST_RES_LOG_LEN];     /* log page prior to the start */
+    uint8_t entry[ST_RES_PARAM_LEN];
+};
+
+/* Fetches the Self-test results log page into resp, zero filling beyond
+ * what the device returns. Returns 0 or an exit status. */
+static int
+fetch_st_results(int sg_fd, uint8_t * resp, int vb)
+{
+    int res, len;
+    int resid = 0;
+
+    res = sg_ll_log_sense_v2(sg_fd, false, false, 1 /* cumulative */,
+                             ST_RES_LPAGE, 0, 0, resp, ST_RES_LOG_LEN, 0,
+                             &resid, vb > 0, vb);
+    if (res)
+        return res;
+    len = ST_RES_LOG_LEN - resid;
+    if ((len < (4 + ST_RES_PARAM_LEN)) ||
+        (ST_RES_LPAGE != (resp[0] & 0x3f))) {
+        pr2serr("Self-test results log page response malformed (len=%d)\n",
+                len);
+        return SG_LIB_CAT_MALFORMED;
+    }
+    memset(resp + len, 0, ST_RES_LOG_LEN - len);
+    return 0;
+}
+
+/* True when a new result has been logged since the 'before' snapshot. The
+ * entries are compared without their parameter codes since those are
+ * fixed by position while the entries move down the page as new ones
+ * are added. */
+static bool
+st_results_changed(const uint8_t * before, const uint8_t * now)
+{
+    int k;
+
+    for (k = 0; k < 20; ++k) {
+        if (memcmp(before + 4 + (k * ST_RES_PARAM_LEN) + 4,
+                   now + 4 + (k * ST_RES_PARAM_LEN) + 4,
+                   ST_RES_PARAM_LEN - 4))
+            return true;
+    }
+    return false;
+}
+
+static void
+st_done(struct sg_mpoll_dev * mdp, int res)
+{
+    int ret;
+
+    mdp->active = false;
+    mdp->res = (res < 0) ? SG_LIB_CAT_OTHER : res;
+    mdp->end_ms = sg_mpoll_now_ms();
+    if (mdp->sg_fd >= 0) {
+        ret = sg_cmds_close_device(mdp->sg_fd);
+        if (ret < 0)
+            pr2serr("close error: %s: %s\n", mdp->dev_name,
+                    safe_strerror(-ret));
+        mdp->sg_fd = -1;
+    }
+}
+
+static void
+st_pr_done(const struct sg_mpoll_dev * mdp, const struct st_dev * sdp,
+           sgj_state * jsp)
+{
+    int rc, sk;
+    int64_t secs = (mdp->end_ms - mdp->start_ms + 500) / 1000;
+    const uint8_t * bp = sdp->entry;
+    char b[80];
+    char e[80];
+
+    if (! sdp->logged) {
+        if (! sg_exit2str(mdp->res, false, sizeof(b), b))
+            snprintf(b, sizeof(b), "exit status %d", mdp->res);
+        sgj_pr_hr(jsp, "%s: gave up after %d seconds: %s\n", mdp->dev_name,
+                  (int)secs, b);
+        return;
+    }
+    rc = bp[4] & 0xf;
+    sgj_pr_hr(jsp, "%s: %s self-test %s [%d] after %d seconds\n",
+              mdp->dev_name, self_test_code[(bp[4] >> 5) & 0x7],
+              self_test_result[rc], rc, (int)secs);
+    if ((rc > 0) && (rc < ST_RES_IN_PROGRESS)) {
+        if (bp[5])
+            sgj_pr_hr(jsp, "    self-test number = %d\n", (int)bp[5]);
+        if (! sg_all_ffs(bp + 8, 8))
+            sgj_pr_hr(jsp, "    address of first failure = 0x%" PRIx64
+                      "\n", sg_get_unaligned_be64(bp + 8));
+        sk = bp[16] & 0xf;
+        if (sk)
+            sgj_pr_hr(jsp, "    sense key = 0x%x [%s], %s\n", sk,
+                      sg_get_sense_key_str(sk, sizeof(e), e),
+                      sg_get_asc_ascq_str(bp[17], bp[18], sizeof(b), b));
+    }
+}
+
+/* Opens the DEVICE, notes its Self-test results log page then starts the
+ * background self-test with SEND DIAGNOSTIC. */
+static void
+st_start(const struct opts_t * op, struct sg_mpoll_dev * mdp,
+         struct st_dev * sdp, sgj_state * jsp)
+{
+    int res, sg_fd;
+    int vb = op->verbose;
+    char b[80];
+
+    sg_fd = sg_cmds_open_device(mdp->dev_name, false /* rw */, vb);
+    if (sg_fd < 0) {
+        pr2serr(ME "error opening file: %s: %s\n", mdp->dev_name,
+                safe_strerror(-sg_fd));
+        mdp->res = sg_convert_errno(-sg_fd);
+        return;
+    }
+    mdp->sg_fd = sg_fd;
+    res = fetch_st_results(sg_fd, sdp->before, vb);
+    if (res) {
+        sg_get_category_sense_str(res, sizeof(b), b, vb);
+        pr2serr("%s: Self-test results log page: %s\n", mdp->dev_name, b);
+        st_done(mdp, res);
+        return;
+    }
+    res = do_senddiag(sg_fd, op->do_selftest, op->do_pf, false, false,
+                      false, NULL, 0, 0, true, vb);
+    if (res) {
+        sg_get_category_sense_str(res, sizeof(b), b, vb);
+        pr2serr("%s: SEND DIAGNOSTIC: %s\n", mdp->dev_name, b);
+        st_done(mdp, res);
+        return;
+    }
+    sg_mpoll_started(mdp, sg_fd, true, 0);
+    sgj_pr_hr(jsp, "%s: %s self-test started\n", mdp->dev_name,
+              self_test_code[op->do_selftest]);
+}
+
+/* REQUEST SENSE (for the progress indication only) then the Self-test
+ * results log page which tells whether the self-test has finished. */
+static void
+st_poll(const struct opts_t * op, struct sg_mpoll_dev * mdp,
+        struct st_dev * sdp, uint8_t * resp, sgj_state * jsp)
+{
+    int res, len;
+    int progress = -1;
+    int vb = op->verbose;
+    const uint8_t * bp;
+    char b[80];
+
+    ++mdp->num_polls;
+    memset(resp, 0, ST_RS_LEN);
+    if (0 == sg_ll_request_sense(mdp->sg_fd, false, resp, ST_RS_LEN, false,
+                                 (vb > 1) ? (vb - 1) : 0)) {
+        len = resp[7] + 8;
+        if (len > ST_RS_LEN)
+            len = ST_RS_LEN;
+        if (sg_get_sense_progress_fld(resp, len, &progress))
+            mdp->progress = progress;
+    }
+    res = fetch_st_results(mdp->sg_fd, resp, vb);
+    if (res) {
+        sg_get_category_sense_str(res, sizeof(b), b, vb);
+        pr2serr("%s: Self-test results log page: %s\n", mdp->dev_name, b);
+        st_done(mdp, res);
+        st_pr_done(mdp, sdp, jsp);
+        return;
+    }
+    bp = resp + 4;
+    if (ST_RES_IN_PROGRESS == (bp[4] & 0xf))
+        sdp->unseen = 0;
+    else if (st_results_changed(sdp->before, resp)) {
+        memcpy(sdp->entry, bp, ST_RES_PARAM_LEN);
+        sdp->logged = true;
+        switch (bp[4] & 0xf) {
+        case 0:
+            res = 0;
+            break;
+        case 1:
+        case 2:
+            res = SG_LIB_CAT_ABORTED_COMMAND;
+            break;
+        default:
+            res = SG_LIB_CAT_MEDIUM_HARD;
+            break;
+        }
+        st_done(mdp, res);
+        st_pr_done(mdp, sdp, jsp);
+        return;
+    } else if (progress >= 0)
+        sdp->unseen = 0;
+    else if (++sdp->unseen >= ST_RES_MAX_UNSEEN) {
+        pr2serr("%s: self-test neither in progress nor logged\n",
+                mdp->dev_name);
+        st_done(mdp, SG_LIB_CAT_OTHER);
+        st_pr_done(mdp, sdp, jsp);
+        return;
+    }
+    if (vb && (mdp->progress >= 0))
+        pr2serr("%s: self-test %d%% done\n", mdp->dev_name,
+                (mdp->progress * 100) / 65536);
+    if ((op->timeout > 0) &&
+        ((sg_mpoll_now_ms() - mdp->start_ms) >= (op->timeout * 1000LL))) {
+        /* the self-test carries on, this process stops waiting */
+        st_done(mdp, SG_LIB_CAT_TIMEOUT);
+        st_pr_done(mdp, sdp, jsp);
+    }
+}
+
+static void
+st_fleet_js(sgj_state * jsp, sgj_opaque_p jop,
+            const struct sg_mpoll_dev * mdp_arr,
+            const struct st_dev * sd_arr, int num)
+{
+    int k, rc, sk;
+    const struct sg_mpoll_dev * mdp;
+    const struct st_dev * sdp;
+    const uint8_t * bp;
+    sgj_opaque_p jo2p, jap;
+    char b[80];
+
+    jap = sgj_named_subarray_r(jsp, jop, "device_list");
+    for (k = 0, mdp = mdp_arr, sdp = sd_arr; k < num; ++k, ++mdp, ++sdp) {
+        jo2p = sgj_new_unattached_object_r(jsp);
+        sgj_js_nv_s(jsp, jo2p, "device_name", mdp->dev_name);
+        sgj_js_nv_b(jsp, jo2p, "started", mdp->started);
+        if (! sg_exit2str(mdp->res, true, sizeof(b), b))
+            b[0] = '\0';
+        sgj_js_nv_istr(jsp, jo2p, "exit_status", mdp->res, NULL, b);
+        sgj_js_nv_i(jsp, jo2p, "number_of_polls", mdp->num_polls);
+        if (mdp->started)
+            sgj_js_nv_i(jsp, jo2p, "elapsed_seconds",
+                        (mdp->end_ms - mdp->start_ms + 500) / 1000);
+        if (sdp->logged) {
+            bp = sdp->entry;
+            rc = bp[4] & 0xf;
+            sgj_js_nv_istr(jsp, jo2p, "self_test_code", (bp[4] >> 5) & 0x7,
+                           NULL, self_test_code[(bp[4] >> 5) & 0x7]);
+            sgj_js_nv_istr(jsp, jo2p, "self_test_result", rc, NULL,
+                           self_test_result[rc]);
+            sgj_js_nv_i(jsp, jo2p, "self_test_number", bp[5]);
+            sgj_js_nv_i(jsp, jo2p, "accumulated_power_on_hours",
+                        sg_get_unaligned_be16(bp + 6));
+            if (! sg_all_ffs(bp + 8, 8))
+                sgj_js_nv_ihex(jsp, jo2p, "address_of_first_failure",
+                               sg_get_unaligned_be64(bp + 8));
+            sk = bp[16] & 0xf;
+            sgj_js_nv_ihexstr(jsp, jo2p, "sense_key", sk, NULL,
+                              sg_get_sense_key_str(sk, sizeof(b), b));
+            sgj_js_nv_ihex(jsp, jo2p, "additional_sense_code", bp[17]);
+            sgj_js_nv_ihex(jsp, jo2p, "additional_sense_code_qualifier",
+                           bp[18]);
+        } else if (mdp->progress >= 0)
+            sgj_js_nv_i(jsp, jo2p, "progress_percent",
+                        (mdp->progress * 100) / 65536);
+        sgj_js_nv_o(jsp, jap, NULL /* name */, jo2p);
+    }
+}
+
+/* Starts a background self-test on each DEVICE, no more than
+ * op->concurrency at once, and polls those running from one loop until
+ * each has a result in its Self-test results log page. The wait between
+ * rounds doubles from SG_MPOLL_DEF_MIN_SECS to SG_MPOLL_DEF_MAX_SECS,
+ * starting again when more self-tests are started, but is not much beyond
+ * when the nearest is expected to finish. Returns the exit status of the
+ * first DEVICE that failed, else 0. */
+static int
+selftest_fleet(struct opts_t * op, sgj_opaque_p jop)
+{
+    bool more;
+    int k, next, n_act, max_act, wait_secs, n_good;
+    int ret = 0;
+    int64_t now, eta, wait_ms;
+    struct sg_mpoll_dev * mdp_arr;
+    struct sg_mpoll_dev * mdp;
+    struct st_dev * sd_arr;
+    sgj_state * jsp = &op->json_st;
+    uint8_t resp[ST_RES_LOG_LEN];
+
+    mdp_arr = (struct sg_mpoll_dev *)calloc(op->num_devs, sizeof(*mdp_arr));
+    sd_arr = (struct st_dev *)calloc(op->num_devs, sizeof(*sd_arr));
+    if ((NULL == mdp_arr) || (NULL == sd_arr)) {
+        pr2serr("%s: unable to obtain heap\n", __func__);
+        ret = sg_convert_errno(ENOMEM);
+        goto fini;
+    }
+    for (k = 0, mdp = mdp_arr; k < op->num_devs; ++k, ++mdp) {
+        mdp->dev_name = op->dev_names[k];
+        mdp->sg_fd = -1;
+        mdp->progress = -1;
+    }
+    max_act = (op->concurrency > 0) ? op->concurrency : op->num_devs;
+    wait_secs = SG_MPOLL_DEF_MIN_SECS;
+    for (next = 0; ; ) {
+        for (k = 0, n_act = 0, mdp = mdp_arr; k < next; ++k, ++mdp) {
+            if (mdp->active)
+                ++n_act;
+        }
+        for (more = false; (n_act < max_act) && (next < op->num_devs);
+             ++next) {
+            st_start(op, mdp_arr + next, sd_arr + next, jsp);
+            if (mdp_arr[next].active) {
+                ++n_act;
+                more = true;
+            }
+        }
+        if (0 == n_act)
+            break;
+        if (more)
+            wait_secs = SG_MPOLL_DEF_MIN_SECS;
+        wait_ms = wait_secs * 1000;
+        now = sg_mpoll_now_ms();
+        for (k = 0, mdp = mdp_arr; k < next; ++k, ++mdp) {
+            if ((! mdp->active) || (mdp->progress <= 0))
+                continue;
+            eta = ((now - mdp->start_ms) * (65536 - mdp->progress)) /
+                  mdp->progress;
+            if (eta < wait_ms)
+                wait_ms = (eta > (SG_MPOLL_DEF_MIN_SECS * 1000)) ? eta :
+                          (SG_MPOLL_DEF_MIN_SECS * 1000);
+        }
+        sg_mpoll_sleep_ms((int)wait_ms);
+        for (k = 0, mdp = mdp_arr; k < next; ++k, ++mdp) {
+            if (mdp->active)
+                st_poll(op, mdp, sd_arr + k, resp, jsp);
+        }
+        wait_secs *= 2;
+        if (wait_secs > SG_MPOLL_DEF_MAX_SECS)
+            wait_secs = SG_MPOLL_DEF_MAX_SECS;
+    }
+    for (k = 0, n_good = 0, mdp = mdp_arr; k < op->num_devs; ++k, ++mdp) {
+        if (0 == mdp->res)
+            ++n_good;
+        else if (0 == ret)
+            ret = mdp->res;
+    }
+    sgj_pr_hr(jsp, "%d of %d self-tests completed without error\n", n_good,
+              op->num_devs);
+    if (jsp->pr_as_json)
+        st_fleet_js(jsp, jop, mdp_arr, sd_arr, op->num_devs);
+fini:
+    free(sd_arr);
+    free(mdp_arr);
+    return ret;
+}
+
 
 int
 main(int argc, char * argv[])
@@ -687,9 +1123,12 @@ main(int argc, char * argv[])
     const char * cp;
     uint8_t * read_in = NULL;
     uint8_t * free_read_in = NULL;
+    sgj_state * jsp;
+    sgj_opaque_p jop = NULL;
 
     op = &opts;
     memset(op, 0, sizeof(opts));
+    jsp = &op->json_st;
     op->maxlen = DEF_ALLOC_LEN;
     op->page_code = -1;
     res = parse_cmd_line(op, argc, argv);
@@ -725,6 +1164,10 @@ main(int argc, char * argv[])
 
     rsp_buff_size = op->maxlen;
 
+    if (op->device_name && (0 == op->num_devs)) {
+        op->dev_names = &op->device_name;       /* old interface */
+        op->num_devs = 1;
+    }
     if (NULL == op->device_name) {
         if (op->do_list) {
             list_page_codes();
@@ -803,6 +1246,42 @@ main(int argc, char * argv[])
                        "'-raw='\n");
         }
     }
+    if ((op->num_devs > 1) || op->do_wait) {
+        if ((1 != op->do_selftest) && (2 != op->do_selftest)) {
+            pr2serr("several DEVICEs or --wait need --selftest=1 or "
+                    "--selftest=2\n");
+            ret = SG_LIB_CONTRADICT;
+            goto fini;
+        }
+        if (op->do_extdur || op->do_list || (op->page_code >= 0)) {
+            pr2serr("several DEVICEs or --wait cannot be used with '-e', "
+                    "'-l' or '-P'\n");
+            ret = SG_LIB_CONTRADICT;
+            goto fini;
+        }
+        if (op->do_json) {
+            if (! sgj_init_state(jsp, op->json_arg)) {
+                int bad_char = jsp->first_bad_char;
+                char e[1500];
+
+                if (bad_char)
+                    pr2serr("bad argument to --json= option, unrecognized "
+                            "character '%c'\n\n", bad_char);
+                sg_json_usage(0, e, sizeof(e));
+                pr2serr("%s", e);
+                ret = SG_LIB_SYNTAX_ERROR;
+                goto fini;
+            }
+            jop = sgj_start_r(MY_NAME, version_str, argc, argv, jsp);
+        }
+        ret = selftest_fleet(op, jop);
+        goto fini;
+    } else if (op->do_json) {
+        pr2serr("--json is only available with --wait or several "
+                "DEVICEs\n");
+        ret = SG_LIB_CONTRADICT;
+        goto fini;
+    }
 #ifdef SG_LIB_WIN32
 #ifdef SG_LIB_WIN32_DIRECT
     if (vb > 4)
@@ -967,5 +1446,36 @@ fini:
             pr2serr("Some error occurred, try again with '-v' "
                     "or '-vv' for more information\n");
     }
-    return (ret >= 0) ? ret : SG_LIB_CAT_OTHER;
+    ret = (ret >= 0) ? ret : SG_LIB_CAT_OTHER;
+    if (jsp->pr_as_json) {
+        FILE * fp = stdout;
+
+        if (op->js_file) {
+            if ((1 != strlen(op->js_file)) || ('-' != op->js_file[0])) {
+                fp = fopen(op->js_file, "w");   /* truncate if exists */
+                if (NULL == fp) {
+                    int e = errno;
+
+                    pr2serr("unable to open file: %s [%s]\n", op->js_file,
+                            safe_strerror(e));
+                    ret = sg_convert_errno(e);
+                }
+            }
+            /* '--js-file=-' will send JSON output to stdout */
+        }
+        if (fp) {
+            const char * estr = NULL;
+            char b[80];
+
+            if (sg_exit2str(ret, jsp->verbose, sizeof(b), b)) {
+                if (strlen(b) > 0)
+                    estr = b;
+            }
+            sgj_js2file_estr(jsp, NULL, ret, estr, fp);
+        }
+        if (op->js_file && fp && (stdout != fp))
+            fclose(fp);
+        sgj_finish(jsp);
+    }
+    return ret;
 }
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2004-2023 Douglas Gilbert.
+ * Copyright (c) 2004-2026 Douglas Gilbert.
  * All rights reserved.
  * Use of this source code is governed by a BSD-style
  * license that can be found in the BSD_LICENSE file.
@@ -17,6 +17,7 @@
 #include <ctype.h>
 #include <errno.h>
 #include <time.h>
+#include <signal.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <getopt.h>
@@ -41,7 +42,7 @@
  * commands tailored for SES (enclosure) devices.
  */
 
-static const char * version_str = "2.85 20230518";    /* ses4r04 */
+static const char * version_str = "2.91 20261015";    /* ses4r04 */
 
 #define MY_NAME "sg_ses"
 
@@ -57,11 +58,6 @@ static const char * version_str = "2.85 20230518";    /* ses4r04 */
 #define MIN_DATA_IN_SZ 8192     /* use max(MIN_DATA_IN_SZ, op->maxlen) for
                                  * the size of data_arr */
 #define MX_DATA_IN_LINES (16 * 1024)
-#define MX_JOIN_ROWS 520        /* element index fields in dpages are only 8
-                                 * bit, and index 0xff (255) is sometimes used
-                                 * for 'not applicable'. However this limit
-                                 * can bypassed with sub-enclosure numbers.
-                                 * So try higher figure. */
 #define MX_DATA_IN_DESCS 32
 #define NUM_ACTIVE_ET_AESP_ARR 32
 
@@ -135,14 +131,25 @@ struct element_type_t {
     const char * desc;
 };
 
-#define CGS_CL_ARR_MAX_SZ 8
+#define CGS_CL_ARR_MAX_SZ 256     /* e.g. one --set= per slot of a JBOD */
 #define CGS_STR_MAX_SZ 80
+#define JOIN_HASH_MIN_SZ 1024   /* power of 2, grown to 2 * join rows */
 
 enum cgs_select_t {CLEAR_OPT, GET_OPT, SET_OPT};
 
+/* Element selected by --descriptor=, --dev-slot-num=, --index= or
+ * --sas-addr=; only one of them is set */
+struct cgs_sel_t {
+    const char * desc_name;
+    const char * index_str;
+    int dev_slot_num;           /* -1 if not given */
+    uint8_t sas_addr[8];        /* all zeros if not given */
+};
+
 struct cgs_cl_t {
     enum cgs_select_t cgs_sel;
     bool last_cs;       /* true only for last --clear= or --set= */
+    struct cgs_sel_t sel;       /* selector given before this option */
     char cgs_str[CGS_STR_MAX_SZ];
 };
 
@@ -159,6 +166,7 @@ struct opts_t {
     bool ind_given;     /* '--index=...' or '-I ...' */
     bool many_dpages;   /* user supplied data has more than one dpage */
     bool mask_ign;      /* element read-mask-modify-write actions */
+    bool multi_sel;     /* different selectors for --clear=, --get=, --set= */
     bool no_config;     /* -F  (do not depend on config dpage) */
     bool no_time;       /* -y  (do not call REPORT TIMESTAMP) */
     bool o_readonly;
@@ -189,7 +197,9 @@ struct opts_t {
     int seid;
     int page_code;      /* recognised abbreviations converted to dpage num */
     int verbose;
+    int watch_secs;     /* --watch=SECS poll interval, 0 for a single pass */
     int num_cgs;        /* number of --clear-, --get= and --set= options */
+    int num_sel;        /* number of element selector options given */
     int mx_arr_len;     /* allocated size of data_arr */
     int arr_len;        /* valid bytes in data_arr */
     uint8_t * data_arr;
@@ -202,6 +212,8 @@ struct opts_t {
     const char * json_arg;
     const char * js_file;
     sgj_state json_st;
+    struct cgs_sel_t cur_sel;   /* most recent element selector */
+    struct cgs_sel_t first_sel;
     struct cgs_cl_t cgs_cl_arr[CGS_CL_ARR_MAX_SZ];
     uint8_t sas_addr[8];  /* Big endian byte sequence */
     char tmp_arr[8];
@@ -274,6 +286,7 @@ struct th_es_t {
     struct join_row_t * j_base;
     int num_j_rows;
     int num_j_eoe;
+    const uint8_t * prev_es;    /* when non-NULL only show changed elements */
 };
 
 /* Representation of <acronym>[=<value>] or
@@ -312,6 +325,20 @@ struct enclosure_info {
     uint8_t product_rev_level[4]; /* may differ from INQUIRY response */
 };
 
+/* With --watch and --join, what was learnt from the Configuration and
+ * Element Descriptor dpages is kept between polls until the generation
+ * code changes. A copy of the previous Enclosure Status dpage allows only
+ * the elements whose status changed to be output. */
+struct join_cache_t {
+    bool valid;
+    uint32_t gen_code;
+    int num_ths;
+    int prev_es_len;
+    uint8_t * prev_es;
+    uint8_t * free_prev_es;
+    struct enclosure_info primary_info;
+};
+
 /* When --status is given with --data= the file contents may contain more
  * than one dpage to be decoded. */
 struct data_in_desc_t {
@@ -364,9 +391,36 @@ struct data_in_desc_t {
  *
  *
  */
-static struct join_row_t join_arr[MX_JOIN_ROWS];
-static struct join_row_t * join_arr_lastp = join_arr + MX_JOIN_ROWS - 1;
+/* join_arr has one row per overall and individual element counted in the
+ * Configuration dpage (plus an all zero row beyond the last), as sized by
+ * join_arr_size(). That block also holds the hash tables of join_idx and
+ * only grows, so --watch polls reuse it. */
+static struct join_row_t * join_arr;
+static struct join_row_t * join_arr_lastp;
+static int join_arr_sz;         /* number of rows, including the zero row */
 static bool join_done = false;
+static struct join_cache_t join_cache;
+
+/* Built after each join so that --clear=, --get= and --set= find their
+ * element without walking join_arr. Hash table entries hold row + 1 so
+ * that 0 is empty; collisions use linear probing. */
+struct join_index_t {
+    int num_rows;
+    int num_ths;
+    int hash_sz;                        /* entries in each hash table */
+    int32_t th_row[MX_ELEM_HDR];        /* row of overall element */
+    int32_t dsn_row[256];               /* -1 if no such device slot */
+    uint32_t * desc_hash;               /* in join_arr's block */
+    uint32_t * sas_hash;
+};
+
+static struct join_index_t join_idx;
+
+/* Row of join_arr for each element index (EI) that an AES descriptor with
+ * EIP=1 may hold: by ei_eoe, and by ei_aess for when the EIs turn out to be
+ * broken. Filled by join_juggle_aes(), -1 if there is no such row. */
+static int32_t join_eoe_row[256];
+static int32_t join_aess_row[256];
 
 static struct type_desc_hdr_t type_desc_hdr_arr[MX_ELEM_HDR];
 static int type_desc_hdr_count = 0;
@@ -483,6 +537,7 @@ static const struct option long_options[] = {
     {"verbose", no_argument, 0, 'v'},
     {"version", no_argument, 0, 'V'},
     {"warn", no_argument, 0, 'w'},
+    {"watch", required_argument, 0, 'W'},
     {0, 0, 0, 0},
 };
 
@@ -922,6 +977,7 @@ static int strcase_eq(const char * s1p, const char * s2p);
 static void enumerate_diag_pages(void);
 static bool saddr_non_zero(const uint8_t * bp);
 static const char * find_in_diag_page_desc(int page_num);
+static int join_index_find(const struct opts_t * op);
 
 static void gen_usage(bool long_opt)
 {
@@ -937,7 +993,8 @@ static void gen_usage(bool long_opt)
             "[--no-time]\n"
             "            [--page=PG] [--quiet] [--raw] [--readonly] "
             "[--sas-addr=SA]\n"
-            "            [--status] [--verbose] [--warn] DEVICE\n"
+            "            [--status] [--verbose] [--warn] [--watch=SECS] "
+            "DEVICE\n"
             );
     else
         pr2serr(
@@ -945,7 +1002,8 @@ static void gen_usage(bool long_opt)
             "[-H]\n"
             "            [-I IIA|TIA,II] [-i] [-j] [-m LEN] [-F] [-y] "
             "[-p PG] [-q]\n"
-            "            [-r] [-R] [-A SA] [-s] [-v] [-w] DEVICE\n"
+            "            [-r] [-R] [-A SA] [-s] [-v] [-w] [-W SECS] "
+            "DEVICE\n"
             );
 
 }
@@ -1160,7 +1218,11 @@ usage(int help_num)
             "read-write)\n"
             "    --verbose|-v        increase verbosity\n"
             "    --version|-V        print version string and exit\n"
-            "    --warn|-w           warn about join (and other) issues\n\n"
+            "    --warn|-w           warn about join (and other) issues\n"
+            "    --watch=SECS|-W SECS    keep DEVICE open and fetch the "
+            "status page(s)\n"
+            "                            or join every SECS seconds until "
+            "interrupted\n\n"
             "SES dpage contents may be fetched from a file named FN by "
             "either\n'--data=@FN' or '--inhex=FN' and it can be parsed and "
             "DEVICE, if given,\nwill be ignored. However when '--control' is "
@@ -1461,6 +1523,36 @@ chk_short_opts(const char sopt_ch, struct opts_t * op)
     return 0;
 }
 
+/* Called after each element selector option (c is its short form). The
+ * selector is kept for the --clear=, --get= and --set= options that follow
+ * it so that each of those can act on a different element. */
+static void
+cgs_sel_note(int c, struct opts_t * op)
+{
+    struct cgs_sel_t * selp = &op->cur_sel;
+
+    memset(selp, 0, sizeof(*selp));
+    selp->dev_slot_num = -1;
+    switch (c) {
+    case 'A':
+        memcpy(selp->sas_addr, op->sas_addr, 8);
+        break;
+    case 'D':
+        selp->desc_name = op->desc_name;
+        break;
+    case 'I':
+        selp->index_str = op->index_str;
+        break;
+    case 'x':
+        selp->dev_slot_num = op->dev_slot_num;
+        break;
+    default:
+        break;
+    }
+    if (0 == op->num_sel++)
+        op->first_sel = *selp;
+}
+
 /* command line process, options and arguments. Returns 0 if ok. */
 static int
 parse_cmd_line(struct opts_t *op, int argc, char *argv[])
@@ -1476,7 +1568,7 @@ parse_cmd_line(struct opts_t *op, int argc, char *argv[])
         int option_index = 0;
 
         c = getopt_long(argc, argv, "^aA:b:cC:d:D:eE:fFG:hHiI:jJ::ln:N:m:Mp:"
-                        "qQ:rRsS:vVwx:X:yz", long_options, &option_index);
+                        "qQ:rRsS:vVwW:x:X:yz", long_options, &option_index);
         if (c == -1)
             break;
 
@@ -1498,6 +1590,7 @@ parse_cmd_line(struct opts_t *op, int argc, char *argv[])
                 pr2serr("error decoding '--sas-addr=SA' argument\n");
                 goto err_fini;
             }
+            cgs_sel_note(c, op);
             break;
         case 'b':
             op->byte1 = sg_get_num_nomult(optarg);
@@ -1520,6 +1613,7 @@ parse_cmd_line(struct opts_t *op, int argc, char *argv[])
             if (op->num_cgs < CGS_CL_ARR_MAX_SZ) {
                 op->cgs_cl_arr[op->num_cgs].cgs_sel = CLEAR_OPT;
                 strcpy(op->cgs_cl_arr[op->num_cgs].cgs_str, optarg);
+                op->cgs_cl_arr[op->num_cgs].sel = op->cur_sel;
                 ++op->num_cgs;
             } else {
                 pr2serr("Too many --clear=, --get= and --set= options "
@@ -1534,6 +1628,7 @@ parse_cmd_line(struct opts_t *op, int argc, char *argv[])
             break;
         case 'D':
             op->desc_name = optarg;
+            cgs_sel_note(c, op);
             break;
         case 'e':
             ++op->enumerate;
@@ -1565,6 +1660,7 @@ parse_cmd_line(struct opts_t *op, int argc, char *argv[])
             if (op->num_cgs < CGS_CL_ARR_MAX_SZ) {
                 op->cgs_cl_arr[op->num_cgs].cgs_sel = GET_OPT;
                 strcpy(op->cgs_cl_arr[op->num_cgs].cgs_str, optarg);
+                op->cgs_cl_arr[op->num_cgs].sel = op->cur_sel;
                 ++op->num_cgs;
             } else {
                 pr2serr("Too many --clear=, --get= and --set= options "
@@ -1588,6 +1684,7 @@ parse_cmd_line(struct opts_t *op, int argc, char *argv[])
             break;
         case 'I':
             op->index_str = optarg;
+            cgs_sel_note(c, op);
             break;
         case 'j':
             ++op->do_join;
@@ -1702,6 +1799,7 @@ parse_cmd_line(struct opts_t *op, int argc, char *argv[])
             if (op->num_cgs < CGS_CL_ARR_MAX_SZ) {
                 op->cgs_cl_arr[op->num_cgs].cgs_sel = SET_OPT;
                 strcpy(op->cgs_cl_arr[op->num_cgs].cgs_str, optarg);
+                op->cgs_cl_arr[op->num_cgs].sel = op->cur_sel;
                 ++op->num_cgs;
             } else {
                 pr2serr("Too many --clear=, --get= and --set= options "
@@ -1720,6 +1818,14 @@ parse_cmd_line(struct opts_t *op, int argc, char *argv[])
         case 'w':
             op->do_warn = true;
             break;
+        case 'W':
+            op->watch_secs = sg_get_num_nomult(optarg);
+            if (op->watch_secs < 1) {
+                pr2serr("bad argument to '--watch=', expect 1 or more "
+                        "seconds\n");
+                goto err_fini;
+            }
+            break;
         case 'x':
             op->dev_slot_num = sg_get_num_nomult(optarg);
             if ((op->dev_slot_num < 0) || (op->dev_slot_num > 255)) {
@@ -1727,6 +1833,7 @@ parse_cmd_line(struct opts_t *op, int argc, char *argv[])
                         "inclusive)\n");
                 goto err_fini;
             }
+            cgs_sel_note(c, op);
             break;
         case 'X':       /* --inhex=FN for compatibility with other utils */
             inhex_arg = optarg;
@@ -1747,6 +1854,17 @@ parse_cmd_line(struct opts_t *op, int argc, char *argv[])
     }
     if (op->do_help || op->version_given)
         return 0;
+    if ((op->num_sel > 1) && (op->num_cgs > 0)) {
+        /* --clear=, --get= and --set= before the first selector use it */
+        op->multi_sel = true;
+        for (n = 0; n < op->num_cgs; ++n) {
+            struct cgs_sel_t * selp = &op->cgs_cl_arr[n].sel;
+
+            if ((NULL == selp->desc_name) && (NULL == selp->index_str) &&
+                (selp->dev_slot_num < 0) && (! saddr_non_zero(selp->sas_addr)))
+                *selp = op->first_sel;
+        }
+    }
     if (optind < argc) {
         if (NULL == op->dev_name) {
             op->dev_name = argv[optind];
@@ -1876,8 +1994,8 @@ parse_cmd_line(struct opts_t *op, int argc, char *argv[])
             return ret;
         }
     }
-    if (op->desc_name || (op->dev_slot_num >= 0) ||
-        saddr_non_zero(op->sas_addr)) {
+    if ((op->desc_name || (op->dev_slot_num >= 0) ||
+         saddr_non_zero(op->sas_addr)) && (! op->multi_sel)) {
         if (op->ind_given) {
             pr2serr("cannot have --index with either --descriptor, "
                     "--dev-slot-num or --sas-addr\n");
@@ -1962,6 +2080,16 @@ parse_cmd_line(struct opts_t *op, int argc, char *argv[])
         }
         goto err_help;
     }
+    if (op->watch_secs > 0) {
+        if (op->do_control || op->num_cgs || op->data_or_inhex ||
+            (op->do_raw > 1)) {
+            pr2serr("--watch=SECS fetches status from DEVICE so conflicts "
+                    "with --control,\n--clear=, --get=, --set=, --data=, "
+                    "--inhex= and '-rr'\n");
+            res = SG_LIB_CONTRADICT;
+            goto err_fini;
+        }
+    }
     if (op->do_all && (op->do_hex > 2)) {
         if (op->do_hex < 6) {
             pr2serr("The --all and -HHH (-HHHH, or -HHHHH) options "
@@ -2737,6 +2865,36 @@ truncated:
  * non NULL the writes rimary enclosure info where it points.
  * Returns total number of type descriptor headers written to 'tdhp' or -1
  * if there is a problem */
+/* Converts the element type (and its instance) given to --index= into a
+ * type header index. Returns false if not found. */
+static bool
+ind_etp_to_th(const struct type_desc_hdr_t * tdhp, int num_ths,
+              struct opts_t * op)
+{
+    int k;
+    int n = op->ind_et_inst;
+
+    for (k = 0; k < num_ths; ++k) {
+        if (op->ind_etp->elem_type_code == tdhp[k].etype) {
+            if (0 == n)
+                break;
+            else
+                --n;
+        }
+    }
+    if (k < num_ths) {
+        op->ind_th = k;
+        return true;
+    }
+    if (op->ind_et_inst)
+        pr2serr("%s: unable to find %s '%s%d'\n", __func__, et_s,
+                op->ind_etp->abbrev, op->ind_et_inst);
+    else
+        pr2serr("%s: unable to find %s '%s'\n", __func__, et_s,
+                op->ind_etp->abbrev);
+    return false;
+}
+
 static int
 build_type_desc_hdr_arr(struct sg_pt_base * ptvp,
                          struct type_desc_hdr_t * tdhp, int max_elems,
@@ -2744,7 +2902,7 @@ build_type_desc_hdr_arr(struct sg_pt_base * ptvp,
                         struct enclosure_info * primary_ip,
                         struct opts_t * op)
 {
-    int resp_len, k, el, num_subs, sum_type_dheaders, res, n;
+    int resp_len, k, el, num_subs, sum_type_dheaders, res;
     int ret = 0;
     uint32_t gen_code;
     const uint8_t * bp;
@@ -2817,28 +2975,10 @@ build_type_desc_hdr_arr(struct sg_pt_base * ptvp,
         tdhp[k].se_id = bp[2];
         tdhp[k].txt_len = bp[3];
     }
-    if (op->ind_given && op->ind_etp) {
-        n = op->ind_et_inst;
-        for (k = 0; k < sum_type_dheaders; ++k) {
-            if (op->ind_etp->elem_type_code == tdhp[k].etype) {
-                if (0 == n)
-                    break;
-                else
-                    --n;
-            }
-        }
-        if (k < sum_type_dheaders)
-            op->ind_th = k;
-        else {
-            if (op->ind_et_inst)
-                pr2serr("%s: unable to find %s '%s%d'\n", __func__, et_s,
-                        op->ind_etp->abbrev, op->ind_et_inst);
-            else
-                pr2serr("%s: unable to find %s '%s'\n", __func__, et_s,
-                        op->ind_etp->abbrev);
-            ret = -1;
-            goto the_end;
-        }
+    if (op->ind_given && op->ind_etp &&
+        (! ind_etp_to_th(tdhp, sum_type_dheaders, op))) {
+        ret = -1;
+        goto the_end;
     }
     ret = sum_type_dheaders;
     goto the_end;
@@ -6515,7 +6655,7 @@ static bool
 join_aes_helper(const uint8_t * ae_bp, const uint8_t * ae_last_bp,
                 const struct th_es_t * tesp, const struct opts_t * op)
 {
-    int k, j, ei, eiioe, aes_i, hex, blen;
+    int k, j, n, ei, eiioe, aes_i, hex, blen;
     bool eip, broken_ei;
     struct join_row_t * jrp;
     struct join_row_t * jr2p;
@@ -6575,21 +6715,14 @@ join_aes_helper(const uint8_t * ae_bp, const uint8_t * ae_last_bp,
                     ei = ae_bp[3];
 try_again:
                     /* Check AES dpage descriptor ei is valid */
-                    for (jr2p = tesp->j_base; jr2p->enc_statp; ++jr2p) {
-                        if (broken_ei) {
-                            if (ei == jr2p->ei_aess)
-                                break;
-                        } else {
-                            if (ei == jr2p->ei_eoe)
-                                break;
-                        }
-                    }
-                    if (NULL == jr2p->enc_statp) {
+                    n = broken_ei ? join_aess_row[ei] : join_eoe_row[ei];
+                    if (n < 0) {
                         pr2serr("warning: %s: oi=%d, ei=%d (broken_ei=%d) "
                                 "not in join_arr\n", __func__, k, ei,
                                 (int)broken_ei);
                         return broken_ei;
                     }
+                    jr2p = tesp->j_base + n;
                     if (! is_et_used_by_aes(jr2p->etype)) {
                         /* unexpected element type so  ... */
                         broken_ei = true;
@@ -6632,15 +6765,13 @@ try_again:
                         jr2p->ae_statp = ae_bp;
                 } else if (eip) {              /* EIP and EIIOE=2,3 */
                     ei = ae_bp[3];
-                    for (jr2p = tesp->j_base; jr2p->enc_statp; ++jr2p) {
-                        if (ei == jr2p->ei_eoe)
-                            break;  /* good, found match on ei_eoe */
-                    }
-                    if (NULL == jr2p->enc_statp) {
+                    n = join_eoe_row[ei];
+                    if (n < 0) {
                         pr2serr("warning: %s: oi=%d, ei=%d, not in "
                                 "join_arr\n", __func__, k, ei);
                         return broken_ei;
                     }
+                    jr2p = tesp->j_base + n;    /* match on ei_eoe */
                     if (! is_et_used_by_aes(jr2p->etype)) {
                         pr2serr("warning: %s: oi=%d, ei=%d, unexpected "
                                 "%s=0x%x\n", __func__, k, ei, et_sn,
@@ -6700,6 +6831,7 @@ join_array_display(struct th_es_t * tesp, struct opts_t * op,
 {
     bool got1, need_aes;
     int k, j, n, desc_len, dn_len;
+    int num_shown = 0;
     const uint8_t * ae_bp;
     const char * cp;
     const uint8_t * ed_bp;
@@ -6720,13 +6852,20 @@ join_array_display(struct th_es_t * tesp, struct opts_t * op,
     if (jsp->pr_as_json) {
         /* re-use (overwrite) passed jop argument */
         jop = sgj_named_subobject_r(jsp, jop, "join_of_diagnostic_pages");
+        if (tesp->prev_es)
+            sgj_js_nv_b(jsp, jop, "changed_elements_only", true);
         jap = sgj_named_subarray_r(jsp, jop, "element_list");
     }
     need_aes = (op->page_code_given &&
                 (ADD_ELEM_STATUS_DPC == op->page_code));
     dn_len = op->desc_name ? (int)strlen(op->desc_name) : 0;
-    for (k = 0, jrp = tesp->j_base, got1 = false;
-         ((k < MX_JOIN_ROWS) && jrp->enc_statp); ++k, ++jrp) {
+    /* start at the first row the element selector matches so that, for
+     * example, --sas-addr= does not compare every row */
+    k = join_index_find(op);
+    if (k < 0)
+        k = join_idx.num_rows;
+    for (jrp = tesp->j_base + k, got1 = false;
+         ((k < join_arr_sz) && jrp->enc_statp); ++k, ++jrp) {
         if (op->ind_given) {
             if (op->ind_th != jrp->th_i)
                 continue;
@@ -6763,6 +6902,11 @@ join_array_display(struct th_es_t * tesp, struct opts_t * op,
         got1 = true;
         if ((op->do_filter > 1) && (1 != (0xf & jrp->enc_statp[0])))
             continue;   /* when '-ff' and status!=OK, skip */
+        if (tesp->prev_es &&
+            (0 == memcmp(jrp->enc_statp,
+                         tesp->prev_es + (jrp->enc_statp - enc_stat_rsp), 4)))
+            continue;   /* --watch: status same as previous poll */
+        ++num_shown;
         cp = etype_str(jrp->etype, b, blen);
         if (ed_bp) {
             desc_len = sg_get_unaligned_be16(ed_bp + 2) + 4;
@@ -6830,7 +6974,9 @@ join_array_display(struct th_es_t * tesp, struct opts_t * op,
         else if (saddr_non_zero(op->sas_addr))
             sgj_pr_hr(jsp, "      >>> no match on --sas-addr=0x%" PRIx64 "\n",
                       sg_get_unaligned_be64(op->sas_addr + 0));
-    }
+    } else if (tesp->prev_es && (0 == num_shown))
+        sgj_pr_hr(jsp, "  no element status changed since the previous "
+                  "poll\n");
     free(b);
 }
 
@@ -6850,7 +6996,7 @@ join_array_dump(struct th_es_t * tesp, int broken_ei, struct opts_t * op)
     pr2serr("[<element_type>: <type_hdr_index>,<elem_ind_within>]\n");
     pr2serr("'-1' indicates overall element or not applicable.\n");
     jrp = tesp->j_base;
-    for (k = 0; ((k < MX_JOIN_ROWS) && jrp->enc_statp); ++k, ++jrp) {
+    for (k = 0; ((k < join_arr_sz) && jrp->enc_statp); ++k, ++jrp) {
         pr2serr("[0x%x: %d,%d] ", jrp->etype, jrp->th_i, jrp->indiv_i);
         if (jrp->se_id > 0)
             pr2serr("se_id=%d ", jrp->se_id);
@@ -6891,6 +7037,177 @@ join_array_dump(struct th_es_t * tesp, int broken_ei, struct opts_t * op)
     pr2serr("broken_ei=%d\n", (int)broken_ei);
 }
 
+/* FNV-1a hash */
+static uint32_t
+join_hash(const uint8_t * bp, int len)
+{
+    uint32_t h = 2166136261U;
+
+    while (len-- > 0) {
+        h ^= *bp++;
+        h *= 16777619U;
+    }
+    return h & (join_idx.hash_sz - 1);
+}
+
+/* Returns length of element descriptor string at ed_bp less any trailing
+ * NULLs */
+static int
+elem_desc_str_len(const uint8_t * ed_bp)
+{
+    int desc_len = sg_get_unaligned_be16(ed_bp + 2);
+
+    /* some element descriptor strings have trailing NULLs and count them
+     * in their length; adjust */
+    while (desc_len && ('\0' == ed_bp[4 + desc_len - 1]))
+        --desc_len;
+    return desc_len;
+}
+
+/* Places row k in hash table htp unless an earlier row has the same key,
+ * the first match is the one that a walk of join_arr would find */
+static void
+join_index_add(uint32_t * htp, const uint8_t * key, int key_len, int k,
+               bool by_desc)
+{
+    int j, n;
+    const struct join_row_t * jrp;
+
+    for (j = join_hash(key, key_len); htp[j];
+         j = (j + 1) & (join_idx.hash_sz - 1)) {
+        jrp = join_arr + htp[j] - 1;
+        if (by_desc) {
+            n = elem_desc_str_len(jrp->elem_descp);
+            if ((n == key_len) &&
+                (0 == memcmp(jrp->elem_descp + 4, key, key_len)))
+                return;
+        } else if (0 == memcmp(jrp->sas_addr, key, 8))
+            return;
+    }
+    htp[j] = (uint32_t)(k + 1);
+}
+
+static void
+join_index_build(const struct th_es_t * tesp)
+{
+    int k, n;
+    const struct join_row_t * jrp;
+    struct join_index_t * jip = &join_idx;
+
+    memset(jip->th_row, 0xff, sizeof(jip->th_row));
+    memset(jip->dsn_row, 0xff, sizeof(jip->dsn_row));
+    memset(jip->desc_hash, 0, jip->hash_sz * sizeof(uint32_t));
+    memset(jip->sas_hash, 0, jip->hash_sz * sizeof(uint32_t));
+    jip->num_ths = tesp->num_ths;
+    for (k = 0, jrp = join_arr; ((k < join_arr_sz) && jrp->enc_statp);
+         ++k, ++jrp) {
+        if ((-1 == jrp->indiv_i) && (jrp->th_i < MX_ELEM_HDR))
+            jip->th_row[jrp->th_i] = k;
+        if ((jrp->dev_slot_num >= 0) && (jrp->dev_slot_num < 256) &&
+            (jip->dsn_row[jrp->dev_slot_num] < 0))
+            jip->dsn_row[jrp->dev_slot_num] = k;
+        if (jrp->elem_descp && ((n = elem_desc_str_len(jrp->elem_descp)) > 0))
+            join_index_add(jip->desc_hash, jrp->elem_descp + 4, n, k, true);
+        if (saddr_non_zero(jrp->sas_addr))
+            join_index_add(jip->sas_hash, jrp->sas_addr, 8, k, false);
+    }
+    jip->num_rows = k;
+    if (k < join_arr_sz)
+        join_arr[k].enc_statp = NULL;   /* may be stale from earlier join */
+}
+
+/* Returns the first row of join_arr that the element selector in op could
+ * match, or -1 if there is none. For --index= the rows following the one
+ * returned may also match. */
+static int
+join_index_find(const struct opts_t * op)
+{
+    int j, n;
+    const uint32_t * htp;
+    const struct join_row_t * jrp;
+    const struct join_index_t * jip = &join_idx;
+
+    if (op->ind_given) {
+        if ((op->ind_th < 0) || (op->ind_th >= jip->num_ths) ||
+            (op->ind_th >= MX_ELEM_HDR))
+            return -1;
+        return jip->th_row[op->ind_th];
+    } else if (op->desc_name) {
+        n = (int)strlen(op->desc_name);
+        htp = jip->desc_hash;
+        for (j = join_hash((const uint8_t *)op->desc_name, n); htp[j];
+             j = (j + 1) & (join_idx.hash_sz - 1)) {
+            jrp = join_arr + htp[j] - 1;
+            if ((elem_desc_str_len(jrp->elem_descp) == n) &&
+                (0 == strncmp(op->desc_name,
+                              (const char *)(jrp->elem_descp + 4), n)))
+                return htp[j] - 1;
+        }
+        return -1;
+    } else if (op->dev_slot_num >= 0)
+        return (op->dev_slot_num < 256) ? jip->dsn_row[op->dev_slot_num] :
+                                          -1;
+    else if (saddr_non_zero(op->sas_addr)) {
+        htp = jip->sas_hash;
+        for (j = join_hash(op->sas_addr, 8); htp[j];
+             j = (j + 1) & (join_idx.hash_sz - 1)) {
+            if (0 == memcmp(join_arr[htp[j] - 1].sas_addr, op->sas_addr, 8))
+                return htp[j] - 1;
+        }
+        return -1;
+    }
+    return 0;
+}
+
+/* Forgets the Configuration dpage and the --watch join cache, so they are
+ * fetched again */
+static void
+ses_config_discard(void)
+{
+    if (free_config_dp_resp)
+        free(free_config_dp_resp);
+    free_config_dp_resp = NULL;
+    config_dp_resp = NULL;
+    join_cache.valid = false;
+    join_cache.prev_es_len = 0;
+}
+
+/* Sizes join_arr for the overall and individual elements of the num_ths
+ * type descriptor headers in tdhp, with hash tables for join_idx of at
+ * least twice that many entries, then zeros it. The block is only
+ * reallocated when it must grow. Returns 0 or an exit status. */
+static int
+join_arr_size(const struct type_desc_hdr_t * tdhp, int num_ths)
+{
+    int k, num_rows, hash_sz;
+    size_t rows_len;
+    uint8_t * bp;
+
+    for (k = 0, num_rows = 1 /* zero row */; k < num_ths; ++k, ++tdhp)
+        num_rows += 1 + tdhp->num_elements;
+    if (num_rows > join_arr_sz) {
+        for (hash_sz = JOIN_HASH_MIN_SZ; hash_sz < (2 * num_rows);
+             hash_sz <<= 1)
+            ;
+        rows_len = num_rows * sizeof(struct join_row_t);
+        bp = (uint8_t *)realloc(join_arr,
+                                rows_len + (2 * hash_sz * sizeof(uint32_t)));
+        if (NULL == bp) {
+            pr2serr("%s: unable to allocate join array of %d rows\n",
+                    __func__, num_rows);
+            return sg_convert_errno(ENOMEM);
+        }
+        join_arr = (struct join_row_t *)bp;
+        join_arr_sz = num_rows;
+        join_idx.hash_sz = hash_sz;
+        join_idx.desc_hash = (uint32_t *)(bp + rows_len);
+        join_idx.sas_hash = join_idx.desc_hash + hash_sz;
+    }
+    join_arr_lastp = join_arr + num_rows - 1;
+    memset(join_arr, 0, num_rows * sizeof(struct join_row_t));
+    return 0;
+}
+
 /* EIIOE juggling (standards + heuristics) for join with AES page */
 static void
 join_juggle_aes(struct th_es_t * tesp, uint8_t * es_bp, const uint8_t * ed_bp,
@@ -6902,6 +7219,8 @@ join_juggle_aes(struct th_es_t * tesp, uint8_t * es_bp, const uint8_t * ed_bp,
 
     jrp = tesp->j_base;
     tdhp = tesp->th_base;
+    memset(join_eoe_row, 0xff, sizeof(join_eoe_row));
+    memset(join_aess_row, 0xff, sizeof(join_aess_row));
     for (k = 0, eoe = 0, ei4aess = 0; k < tesp->num_ths; ++k, ++tdhp) {
         bool et_used_by_aes;
 
@@ -6921,7 +7240,7 @@ join_juggle_aes(struct th_es_t * tesp, uint8_t * es_bp, const uint8_t * ed_bp,
         jrp->ae_statp = NULL;
         jrp->thresh_inp = t_bp;
         jrp->dev_slot_num = -1;
-        /* assume sas_addr[8] zeroed since it's static file scope */
+        /* assume sas_addr[8] zeroed by join_arr_size() */
         if (t_bp)
             t_bp += 4;
         ++jrp;
@@ -6930,10 +7249,14 @@ join_juggle_aes(struct th_es_t * tesp, uint8_t * es_bp, const uint8_t * ed_bp,
                 break;
             jrp->th_i = k;
             jrp->indiv_i = j;
+            if (eoe < 256)
+                join_eoe_row[eoe] = (int32_t)(jrp - tesp->j_base);
             jrp->ei_eoe = eoe++;
-            if (et_used_by_aes)
+            if (et_used_by_aes) {
+                if (ei4aess < 256)
+                    join_aess_row[ei4aess] = (int32_t)(jrp - tesp->j_base);
                 jrp->ei_aess = ei4aess++;
-            else
+            } else
                 jrp->ei_aess = -1;
             jrp->etype = tdhp->etype;
             jrp->se_id = tdhp->se_id;
@@ -6944,7 +7267,7 @@ join_juggle_aes(struct th_es_t * tesp, uint8_t * es_bp, const uint8_t * ed_bp,
                 ed_bp += sg_get_unaligned_be16(ed_bp + 2) + 4;
             jrp->thresh_inp = t_bp;
             jrp->dev_slot_num = -1;
-            /* assume sas_addr[8] zeroed since it's static file scope */
+            /* assume sas_addr[8] zeroed by join_arr_size() */
             if (t_bp)
                 t_bp += 4;
             jrp->ae_statp = NULL;
@@ -6970,6 +7293,7 @@ join_work(struct sg_pt_base * ptvp, bool display, struct opts_t * op,
           sgj_opaque_p jop)
 {
     bool broken_ei;
+    bool incr = (op->watch_secs > 0) && join_cache.valid;
     int res, n, num_ths, mlen;
     uint32_t ref_gen_code, gen_code;
     const uint8_t * ae_bp;
@@ -6987,16 +7311,24 @@ join_work(struct sg_pt_base * ptvp, bool display, struct opts_t * op,
     struct th_es_t tes;
     static const int blen = sizeof(b);
 
-    memset(&primary_info, 0, sizeof(primary_info));
-    num_ths = build_type_desc_hdr_arr(ptvp, type_desc_hdr_arr, MX_ELEM_HDR,
-                                      &ref_gen_code, &primary_info, op);
-    if (num_ths < 0)
-        return num_ths;
+again:
+    if (incr) {         /* --watch: configuration unchanged so far */
+        num_ths = join_cache.num_ths;
+        ref_gen_code = join_cache.gen_code;
+        primary_info = join_cache.primary_info;
+    } else {
+        memset(&primary_info, 0, sizeof(primary_info));
+        num_ths = build_type_desc_hdr_arr(ptvp, type_desc_hdr_arr,
+                                          MX_ELEM_HDR, &ref_gen_code,
+                                          &primary_info, op);
+        if (num_ths < 0)
+            return num_ths;
+    }
     tesp = &tes;
     memset(tesp, 0, sizeof(tes));
     tesp->th_base = type_desc_hdr_arr;
     tesp->num_ths = num_ths;
-    if (display && primary_info.have_info) {
+    if (display && primary_info.have_info && (! incr)) {
         int j;
 
         n = sg_scnpr(b, blen, "%s (hex): ", peli);
@@ -7018,12 +7350,25 @@ join_work(struct sg_pt_base * ptvp, bool display, struct opts_t * op,
     }
     gen_code = sg_get_unaligned_be32(enc_stat_rsp + 4);
     if (ref_gen_code != gen_code) {
+        if (incr) {
+            if (op->verbose)
+                pr2serr("generation code changed, fetch configuration "
+                        "again\n");
+            ses_config_discard();
+            incr = false;
+            goto again;
+        }
         pr2serr("%s", soec);
         return -1;
     }
     es_bp = enc_stat_rsp + 8;
     /* es_last_bp = enc_stat_rsp + enc_stat_rsp_len - 1; */
 
+    if (incr) {         /* Element Descriptor dpage only changes with gen */
+        res = 0;
+        ed_bp = (elem_desc_rsp_len >= 8) ? (elem_desc_rsp + 8) : NULL;
+        goto skip_ed;
+    }
     mlen = elem_desc_rsp_sz;
     if (mlen > op->maxlen)
         mlen = op->maxlen;
@@ -7048,6 +7393,7 @@ join_work(struct sg_pt_base * ptvp, bool display, struct opts_t * op,
         if (op->verbose)
             pr2serr("  Element Descriptor page %s\n", not_avail);
     }
+skip_ed:
 
     /* check if we want to add the AES page to the join */
     if (display || (ADD_ELEM_STATUS_DPC == op->page_code) ||
@@ -7119,6 +7465,9 @@ join_work(struct sg_pt_base * ptvp, bool display, struct opts_t * op,
         t_bp = NULL;
     }
 
+    res = join_arr_size(type_desc_hdr_arr, num_ths);
+    if (res)
+        return res;
     tesp->j_base = join_arr;
     join_juggle_aes(tesp, es_bp, ed_bp, t_bp);
 
@@ -7129,7 +7478,15 @@ join_work(struct sg_pt_base * ptvp, bool display, struct opts_t * op,
     if (op->verbose > 3)
         join_array_dump(tesp, broken_ei, op);
 
+    join_index_build(tesp);
     join_done = true;
+    if (op->watch_secs > 0) {
+        if (incr && (join_cache.prev_es_len == enc_stat_rsp_len))
+            tesp->prev_es = join_cache.prev_es;
+        if (NULL == join_cache.prev_es)
+            join_cache.prev_es = sg_memalign(enc_stat_rsp_sz, 0,
+                                             &join_cache.free_prev_es, false);
+    }
     if (display) {
         join_array_display(tesp, op, jop);
         if (op->do_all) {
@@ -7149,6 +7506,14 @@ join_work(struct sg_pt_base * ptvp, bool display, struct opts_t * op,
             free(free_resp);
         }
     }
+    if ((op->watch_secs > 0) && join_cache.prev_es) {
+        memcpy(join_cache.prev_es, enc_stat_rsp, enc_stat_rsp_len);
+        join_cache.prev_es_len = enc_stat_rsp_len;
+        join_cache.gen_code = ref_gen_code;
+        join_cache.num_ths = num_ths;
+        join_cache.primary_info = primary_info;
+        join_cache.valid = true;
+    }
 fini:
     return res;
 
@@ -7412,11 +7777,13 @@ cgs_additional_el(const struct join_row_t * jrp,
  * Returns 0 for success, any other return value is an error. */
 static int
 ses_cgs(struct sg_pt_base * ptvp, const struct tuple_acronym_val * tavp,
-        bool last, struct opts_t * op, sgj_opaque_p jop)
+        const struct cgs_sel_t * selp, bool last, struct opts_t * op,
+        sgj_opaque_p jop)
 {
     int ret, k, j, desc_len, dn_len;
     int last_indiv_i = -2;
     bool found;
+    bool looked_up = false;
     struct join_row_t * jrp;
     const uint8_t * ed_bp;
     char b[64];
@@ -7462,8 +7829,28 @@ ses_cgs(struct sg_pt_base * ptvp, const struct tuple_acronym_val * tavp,
         if (ret)
             return ret;
     }
+    if (selp) {         /* this option has its own element selector */
+        op->desc_name = selp->desc_name;
+        op->dev_slot_num = selp->dev_slot_num;
+        memcpy(op->sas_addr, selp->sas_addr, 8);
+        op->ind_given = false;
+        op->ind_etp = NULL;
+        if (selp->index_str) {
+            op->index_str = selp->index_str;
+            if (parse_index(op))
+                return SG_LIB_SYNTAX_ERROR;
+            if (op->ind_etp &&
+                (! ind_etp_to_th(type_desc_hdr_arr, join_idx.num_ths, op)))
+                return -1;
+        }
+    }
     dn_len = op->desc_name ? (int)strlen(op->desc_name) : 0;
-    for (k = 0, jrp = join_arr; ((k < MX_JOIN_ROWS) && jrp->enc_statp);
+    k = join_index_find(op);
+    if (k < 0) {        /* no match, so skip the walk */
+        k = join_idx.num_rows;
+        looked_up = true;
+    }
+    for (jrp = join_arr + k; ((k < join_arr_sz) && jrp->enc_statp);
          ++k, ++jrp) {
         if (op->ind_given) {
             if (op->ind_th != jrp->th_i)
@@ -7516,8 +7903,8 @@ ses_cgs(struct sg_pt_base * ptvp, const struct tuple_acronym_val * tavp,
         if (op->ind_indiv_last <= jrp->indiv_i)  /* op->ind_indiv) */
             break;
     }   /* end of loop over join array */
-    if ((k >= MX_JOIN_ROWS || (NULL == jrp->enc_statp))) {
-        if (k >= MX_JOIN_ROWS)
+    if ((k >= join_arr_sz || (NULL == jrp->enc_statp))) {
+        if ((k >= join_arr_sz) && (! looked_up))
             pr2serr("%s: join array overflow ??\n", __func__);
         if (op->desc_name)
             pr2serr("descriptor name: %s %s (check the 'ed' page [0x7])\n",
@@ -7692,6 +8079,88 @@ enumerate_work(const struct opts_t * op)
     }
 }
 
+/* --watch=SECS keeps DEVICE open and repeats the status dpage fetch (or
+ * the join) until SIGINT or SIGTERM arrives. The Configuration dpage is
+ * kept between polls unless a poll fails (e.g. the generation code has
+ * changed) in which case it is fetched again on the next poll. Each poll
+ * is output as a separate JSON object when --json is given. */
+static volatile sig_atomic_t watch_stop;
+
+static void
+watch_sig_handler(int sig)
+{
+    if (sig) { }        /* suppress warning */
+    watch_stop = 1;
+}
+
+static int
+ses_watch(struct sg_pt_base * ptvp, struct opts_t * op, int argc,
+          char * argv[], sgj_opaque_p * jopp)
+{
+    bool as_json;
+    int poll_num, ret;
+    time_t t;
+    FILE * fp = stdout;
+    struct tm * tmp;
+    sgj_state * jsp = &op->json_st;
+    sgj_opaque_p jo2p;
+    char b[64];
+
+    as_json = jsp->pr_as_json;
+    if (as_json && op->js_file &&
+        ((1 != strlen(op->js_file)) || ('-' != op->js_file[0]))) {
+        fp = fopen(op->js_file, "w");   /* truncate if exists */
+        if (NULL == fp) {
+            int e = errno;
+
+            pr2serr("unable to open file: %s [%s]\n", op->js_file,
+                    safe_strerror(e));
+            return sg_convert_errno(e);
+        }
+    }
+    signal(SIGINT, watch_sig_handler);
+    signal(SIGTERM, watch_sig_handler);
+    for (poll_num = 1, ret = 0; ; ++poll_num) {
+        t = time(NULL);
+        tmp = localtime(&t);
+        if ((NULL == tmp) || (0 == strftime(b, sizeof(b), "%F %T", tmp)))
+            snprintf(b, sizeof(b), "%" PRId64 "", (int64_t)t);
+        if (0 == op->do_raw)
+            sgj_pr_hr(jsp, "Poll %d at %s:\n", poll_num, b);
+        if (as_json) {
+            jo2p = sgj_named_subobject_r(jsp, *jopp, "watch");
+            sgj_js_nv_i(jsp, jo2p, "interval_seconds", op->watch_secs);
+            sgj_js_nv_i(jsp, jo2p, "poll_number", poll_num);
+            sgj_js_nv_i(jsp, jo2p, "seconds_since_epoch", (int64_t)t);
+            sgj_js_nv_s(jsp, jo2p, "local_time", b);
+        }
+        if (op->do_join)
+            ret = join_work(ptvp, true, op, *jopp);
+        else
+            ret = process_1ormore_status_dpages(ptvp, op, *jopp);
+        if (ret)
+            ses_config_discard();   /* may be stale, fetch it again */
+        if (as_json) {
+            sgj_js2file(jsp, NULL, (ret >= 0) ? ret : SG_LIB_CAT_OTHER, fp);
+            sgj_finish(jsp);
+            *jopp = NULL;
+        } else if (0 == op->do_raw)
+            sgj_pr_hr(jsp, "\n");
+        fflush(fp);
+        while ((! watch_stop) && ((time(NULL) - t) < op->watch_secs))
+            sg_sleep_secs(1);
+        if (watch_stop)
+            break;
+        if (as_json)
+            *jopp = sgj_start_r(MY_NAME, version_str, argc, argv, jsp);
+    }
+    if (stdout != fp)
+        fclose(fp);
+    ses_config_discard();
+    if (join_cache.free_prev_es)
+        free(join_cache.free_prev_es);
+    return ret;
+}
 
 int
 main(int argc, char * argv[])
@@ -7787,6 +8256,7 @@ main(int argc, char * argv[])
         enumerate_work(op);
         goto early_out;
     }
+    sgj_hr_buffered();
     if (op->do_json) {
         if (! sgj_init_state(jsp, op->json_arg)) {
             int bad_char = jsp->first_bad_char;
@@ -7867,7 +8337,8 @@ main(int argc, char * argv[])
                     tavp->val = DEF_SET_VAL;
             }
             if (!strcmp(cgs_clp->cgs_str, "sas_addr") &&
-                op->dev_slot_num < 0) {
+                ((op->multi_sel ? cgs_clp->sel.dev_slot_num :
+                                  op->dev_slot_num) < 0)) {
                 pr2serr("--get=sas_addr requires --dev-slot-num.  For "
                         "expander SAS address, use exp_sas_addr instead.\n");
                 ret = SG_LIB_SYNTAX_ERROR;
@@ -8027,11 +8498,14 @@ main(int argc, char * argv[])
     else if (have_cgs) {
         for (k = 0, tavp = tav_arr, cgs_clp = op->cgs_cl_arr;
              k < op->num_cgs; ++k, ++tavp, ++cgs_clp) {
-            ret = ses_cgs(ptvp, tavp, cgs_clp->last_cs, op, jop);
+            ret = ses_cgs(ptvp, tavp, op->multi_sel ? &cgs_clp->sel : NULL,
+                          cgs_clp->last_cs, op, jop);
             if (ret)
                 break;
         }
-    } else if (op->do_join)
+    } else if (op->watch_secs > 0)
+        ret = ses_watch(ptvp, op, argc, argv, &jop);
+    else if (op->do_join)
         ret = join_work(ptvp, true, op, jop);
     else if (op->do_status)
         ret = process_1ormore_status_dpages(ptvp, op, jop);
@@ -8158,6 +8632,8 @@ early_out:
         free(op->free_data_arr);
     if (free_config_dp_resp)
         free(free_config_dp_resp);
+    if (join_arr)
+        free(join_arr);
     ret = (ret >= 0) ? ret : SG_LIB_CAT_OTHER;
     if (as_json && jop) {
         FILE * fp = stdout;
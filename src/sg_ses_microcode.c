@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2014-2023 Douglas Gilbert.
+ * Copyright (c) 2014-2026 Douglas Gilbert.
  * All rights reserved.
  * Use of this source code is governed by a BSD-style
  * license that can be found in the BSD_LICENSE file.
@@ -32,8 +32,11 @@
 #include "sg_cmds_basic.h"
 #include "sg_cmds_extra.h"
 #include "sg_unaligned.h"
+#include "sg_par.h"
 #include "sg_pr2serr.h"
 
+#include "sg_fw_common.h"
+
 #ifdef SG_LIB_WIN32
 #ifdef SG_LIB_WIN32_DIRECT
 #include "sg_pt.h"      /* needed for scsi_pt_win32_direct() */
@@ -45,7 +48,7 @@
  * RESULTS commands in order to send microcode to the given SES device.
  */
 
-static const char * version_str = "1.20 20230519";    /* ses4r02 */
+static const char * version_str = "1.22 20261015";    /* ses4r02 */
 
 #define ME "sg_ses_microcode: "
 #define MAX_XFER_LEN (128 * 1024 * 1024)
@@ -84,6 +87,7 @@ static struct option long_options[] = {
     {"mode", required_argument, 0, 'm'},
     {"non", no_argument, 0, 'N'},
     {"offset", required_argument, 0, 'o'},
+    {"parallel", required_argument, 0, 'p'},
     {"skip", required_argument, 0, 's'},
     {"subenc", required_argument, 0, 'S'},
     {"tlength", required_argument, 0, 't'},
@@ -160,6 +164,16 @@ uint8_t dummy_rd_resp[] = {
     0,  3,  0,  0,  0x0, 0x40, 0x0, 0x0,  0, 0, 0,  0,  0x0, 0x0, 0x0, 0x0,
 };
 
+/* Per DEVICE state when microcode is sent to several DEVICEs */
+struct ses_dev_t {
+    uint32_t gen_code;
+    int rsp_len;
+    uint8_t * dip;
+    uint8_t * free_dip;
+    struct dout_buff_t dout;
+    uint8_t dry_rd_resp[sizeof(dummy_rd_resp)];
+};
+
 
 static void
 usage()
@@ -169,11 +183,11 @@ usage()
             "[--id=ID]\n"
             "                        [--in=FILE] [--length=LEN] [--mode=MO] "
             "[--non]\n"
-            "                        [--offset=OFF] [--skip=SKIP] "
-            "[--subenc=SEID]\n"
-            "                        [--tlength=TLEN] [--verbose] "
-            "[--version]\n"
-            "                        DEVICE\n"
+            "                        [--offset=OFF] [--parallel=Q] "
+            "[--skip=SKIP]\n"
+            "                        [--subenc=SEID] [--tlength=TLEN] "
+            "[--verbose]\n"
+            "                        [--version] DEVICE [DEVICE...]\n"
             "  where:\n"
             "    --bpw=CS|-b CS         CS is chunk size: bytes per send "
             "diagnostic\n"
@@ -203,6 +217,9 @@ usage()
             "    --offset=OFF|-o OFF    buffer offset (unit: bytes, def: "
             "0);\n"
             "                           ignored if --bpw=CS given\n"
+            "    --parallel=Q|-p Q      with several DEVICEs, download to up "
+            "to Q of\n"
+            "                           them at the same time (def: 8)\n"
             "    --skip=SKIP|-s SKIP    bytes in file FILE to skip before "
             "reading\n"
             "    --subenc=SEID|-S SEID     subenclosure identifier (def: 0 "
@@ -216,7 +233,10 @@ usage()
             "Does one or more SCSI SEND DIAGNOSTIC followed by RECEIVE "
             "DIAGNOSTIC\nRESULTS command sequences in order to download "
             "microcode. Use '-m xxx'\nto list available modes. With only "
-            "DEVICE given, the Download Microcode\nStatus dpage is output.\n"
+            "DEVICE given, the Download Microcode\nStatus dpage is output. "
+            "With several DEVICEs FILE is read once and sent\nto all of them; "
+            "then with ',act' the deferred microcode is activated on\nall "
+            "that succeeded.\n"
           );
 }
 
@@ -295,7 +315,8 @@ static int
 send_then_receive(int sg_fd, uint32_t gen_code, int off_off,
                   const uint8_t * dmp, int dmp_len,
                   struct dout_buff_t * wp, uint8_t * dip,
-                  int din_len, bool last, const struct opts_t * op)
+                  int din_len, bool last, const struct opts_t * op,
+                  uint8_t * dry_rdp)
 {
     bool send_data = false;
     int do_len, rem, res, rsp_len, k, n, num, mc_status, resid, act_len, verb;
@@ -360,15 +381,15 @@ send_then_receive(int sg_fd, uint32_t gen_code, int off_off,
             int s = op->mc_offset + off_off + dmp_len;
 
             n = 8 + (op->mc_subenc * 16);
-            dummy_rd_resp[n + 11] = op->mc_id;
+            dry_rdp[n + 11] = op->mc_id;
             sg_put_unaligned_be32(((send_data && (! last)) ? s : 0),
-                                  dummy_rd_resp + n + 12);
+                                  dry_rdp + n + 12);
             if (MODE_ABORT_MC == op->mc_mode)
-                dummy_rd_resp[n + 2] = 0x80;
+                dry_rdp[n + 2] = 0x80;
             else if (MODE_ACTIVATE_MC == op->mc_mode)
-                dummy_rd_resp[n + 2] = 0x0;     /* done */
+                dry_rdp[n + 2] = 0x0;     /* done */
             else
-                dummy_rd_resp[n + 2] = (s >= op->mc_tlen) ? 0x13 : 0x1;
+                dry_rdp[n + 2] = (s >= op->mc_tlen) ? 0x13 : 0x1;
         }
         res = 0;
     } else
@@ -415,7 +436,7 @@ send_then_receive(int sg_fd, uint32_t gen_code, int off_off,
     if (op->dry_run) {
         n = sizeof(dummy_rd_resp);
         n = (n < din_len) ? n : din_len;
-        memcpy(dip, dummy_rd_resp, n);
+        memcpy(dip, dry_rdp, n);
         resid = din_len - n;
         res = 0;
     } else
@@ -475,18 +496,118 @@ send_then_receive(int sg_fd, uint32_t gen_code, int off_off,
     return ret;
 }
 
+/* Fetches the Download microcode status dpage into dip (or, with --dry-run,
+ * copies dry_rdp into it). Returns 0 and sets *rsp_lenp on success */
+static int
+fetch_dl_mc_sdg(int sg_fd, uint8_t * dip, int din_len, uint8_t * dry_rdp,
+                int * rsp_lenp, const struct opts_t * op)
+{
+    int n, res, rsp_len, act_len;
+    int resid = 0;
+    int verb = (op->verbose > 1) ? op->verbose - 1 : 0;
+
+    if (op->dry_run) {
+        n = sizeof(dummy_rd_resp);
+        n = (n < din_len) ? n : din_len;
+        memcpy(dip, dry_rdp, n);
+        resid = din_len - n;
+        res = 0;
+    } else
+        res = sg_ll_receive_diag_v2(sg_fd, true /* pcv */,
+                                    DPC_DOWNLOAD_MICROCODE, dip, din_len,
+                                    0 /*default timeout */, &resid, true,
+                                    verb);
+    if (res)
+        return res;
+    rsp_len = sg_get_unaligned_be16(dip + 2) + 4;
+    act_len = din_len - resid;
+    if (rsp_len > din_len) {
+        pr2serr("<<< warning response buffer too small [%d but need "
+                "%d]>>>\n", din_len, rsp_len);
+        rsp_len = din_len;
+    }
+    if (rsp_len > act_len) {
+        pr2serr("<<< warning response too short [actually got %d but "
+                "need %d]>>>\n", act_len, rsp_len);
+        rsp_len = act_len;
+    }
+    if (rsp_len < 8) {
+        pr2serr("Download microcode status dpage too short\n");
+        return SG_LIB_CAT_OTHER;
+    }
+    if ((op->verbose > 2) || (op->dry_run && op->verbose))
+        pr2serr("rec diag(ini): rsp_len=%d, num_sub-enc=%u "
+                "rec_gen_code=%u\n", rsp_len, dip[1],
+                sg_get_unaligned_be32(dip + 4));
+    *rsp_lenp = rsp_len;
+    return 0;
+}
+
+/* fw_ops_t callbacks for sending microcode to several DEVICEs */
+static int
+ses_prep(struct fw_dev_t * dp, void * ctx)
+{
+    int res;
+    const struct opts_t * op = (const struct opts_t *)ctx;
+    struct ses_dev_t * sdp = (struct ses_dev_t *)dp->priv;
+
+    memcpy(sdp->dry_rd_resp, dummy_rd_resp, sizeof(dummy_rd_resp));
+    sdp->dip = sg_memalign(DEF_DIN_LEN, 0, &sdp->free_dip,
+                           op->verbose > 3);
+    if (NULL == sdp->dip) {
+        pr2serr("%s: out of memory (data-in buffer)\n", dp->dev_name);
+        return sg_convert_errno(ENOMEM);
+    }
+    res = fetch_dl_mc_sdg(dp->sg_fd, sdp->dip, DEF_DIN_LEN, sdp->dry_rd_resp,
+                          &sdp->rsp_len, op);
+    if (0 == res)
+        sdp->gen_code = sg_get_unaligned_be32(sdp->dip + 4);
+    return res;
+}
+
+static int
+ses_chunk(struct fw_dev_t * dp, int off, const uint8_t * bp, int len,
+          bool last, void * ctx)
+{
+    struct ses_dev_t * sdp = (struct ses_dev_t *)dp->priv;
+
+    return send_then_receive(dp->sg_fd, sdp->gen_code, off, bp, len,
+                             &sdp->dout, sdp->dip, DEF_DIN_LEN, last,
+                             (const struct opts_t *)ctx, sdp->dry_rd_resp);
+}
+
+static int
+ses_activate(struct fw_dev_t * dp, void * ctx)
+{
+    struct ses_dev_t * sdp = (struct ses_dev_t *)dp->priv;
+    struct opts_t act_opts;
+
+    /* a copy since other threads may be using *ctx */
+    memcpy(&act_opts, ctx, sizeof(act_opts));
+    act_opts.mc_mode = MODE_ACTIVATE_MC;
+    if (act_opts.verbose)
+        pr2serr("%s: sending Activate deferred microcode [0xf]\n",
+                dp->dev_name);
+    return send_then_receive(dp->sg_fd, sdp->gen_code, 0, NULL, 0,
+                             &sdp->dout, sdp->dip, DEF_DIN_LEN, true,
+                             &act_opts, sdp->dry_rd_resp);
+}
+
 
 int
 main(int argc, char * argv[])
 {
-    bool last, got_stdin, is_reg;
+    bool last, is_reg;
+    bool got_stdin = false;
     bool want_file = false;
     bool verbose_given = false;
     bool version_given = false;
-    int res, c, len, k, n, rsp_len, resid, act_len, din_len, verb;
+    int res, c, len, k, n, rsp_len, din_len;
     int sg_fd = -1;
     int infd = -1;
     int do_help = 0;
+    int num_devs = 0;
+    int num_q = FW_DEF_PARALLEL;
     int ret = 0;
     uint32_t gen_code = 0;
     const char * device_name = NULL;
@@ -501,15 +622,19 @@ main(int argc, char * argv[])
     struct opts_t opts;
     struct opts_t * op;
     const struct mode_s * mp;
+    struct fw_dev_t * dev_arr = NULL;
+    struct ses_dev_t * sdev_arr = NULL;
+    struct fw_image_t image;
 
     op = &opts;
+    memset(&image, 0, sizeof(image));
     memset(op, 0, sizeof(opts));
     memset(&dout, 0, sizeof(dout));
     din_len = DEF_DIN_LEN;
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "b:dehi:I:l:m:No:s:S:t:vV", long_options,
+        c = getopt_long(argc, argv, "b:dehi:I:l:m:No:p:s:S:t:vV", long_options,
                         &option_index);
         if (c == -1)
             break;
@@ -592,6 +717,11 @@ main(int argc, char * argv[])
                 return SG_LIB_SYNTAX_ERROR;
             }
             break;
+        case 'p':
+            num_q = sg_par_get_num(optarg, 1, FW_MAX_PARALLEL);
+            if (num_q < 0)
+                return SG_LIB_SYNTAX_ERROR;
+            break;
         case 's':
            op->mc_skip = sg_get_num(optarg);
            if (op->mc_skip < 0) {
@@ -636,16 +766,8 @@ main(int argc, char * argv[])
         return 0;
     }
     if (optind < argc) {
-        if (NULL == device_name) {
-            device_name = argv[optind];
-            ++optind;
-        }
-        if (optind < argc) {
-            for (; optind < argc; ++optind)
-                pr2serr("Unexpected extra argument: %s\n", argv[optind]);
-            usage();
-            return SG_LIB_SYNTAX_ERROR;
-        }
+        device_name = argv[optind];
+        num_devs = argc - optind;
     }
 
 #ifdef DEBUG
@@ -690,6 +812,11 @@ main(int argc, char * argv[])
                 op->mc_mode);
         break;
     }
+    if ((num_devs > 1) && (MODE_DNLD_STATUS == op->mc_mode)) {
+        pr2serr("with several DEVICEs, a mode other than dmc_status is "
+                "needed\n");
+        return SG_LIB_CONTRADICT;
+    }
 
     if ((op->mc_len > 0) && (op->bpw > op->mc_len)) {
         pr2serr("trim chunk size (CS) to be the same as LEN\n");
@@ -710,18 +837,24 @@ main(int argc, char * argv[])
 #endif
 #endif
 
-    sg_fd = sg_cmds_open_device(device_name, false /* rw */, op->verbose);
-    if (sg_fd < 0) {
-        if (op->verbose)
-            pr2serr(ME "open error: %s: %s\n", device_name,
-                    safe_strerror(-sg_fd));
-        ret = sg_convert_errno(-sg_fd);
-        goto fini;
-    }
-
     if (file_name && (! want_file))
         pr2serr("ignoring --in=FILE option\n");
-    else if (file_name) {
+    else if ((num_devs > 1) && file_name && strcmp(file_name, "-")) {
+        /* read (or map) FILE once, all DEVICEs share it */
+        ret = fw_image_from_file(file_name, op->mc_skip,
+                                 (op->mc_len_given ? op->mc_len : 0), &image,
+                                 op->verbose);
+        if (ret)
+            goto fini;
+        op->mc_len = image.len;
+        if (op->mc_len > MAX_XFER_LEN) {
+            pr2serr("file size or requested length (%d) exceeds "
+                    "MAX_XFER_LEN of %d bytes\n", op->mc_len,
+                    MAX_XFER_LEN);
+            ret = SG_LIB_FILE_ERROR;
+            goto fini;
+        }
+    } else if (file_name) {
         got_stdin = (0 == strcmp(file_name, "-"));
         if (got_stdin)
             infd = STDIN_FILENO;
@@ -824,6 +957,48 @@ main(int argc, char * argv[])
                 "microcode status\ndpage might be dangerous\n");
         goto fini;
     }
+    if (num_devs > 1) {
+        struct fw_ops_t fw_ops;
+
+        dev_arr = (struct fw_dev_t *)calloc(num_devs, sizeof(*dev_arr));
+        sdev_arr = (struct ses_dev_t *)calloc(num_devs, sizeof(*sdev_arr));
+        if ((NULL == dev_arr) || (NULL == sdev_arr)) {
+            pr2serr(ME "out of memory\n");
+            ret = sg_convert_errno(ENOMEM);
+            goto fini;
+        }
+        for (k = 0; k < num_devs; ++k) {
+            dev_arr[k].dev_name = argv[optind + k];
+            dev_arr[k].priv = sdev_arr + k;
+        }
+        if (NULL == image.bp) {
+            image.bp = dmp;
+            image.len = dmp ? op->mc_len : 0;
+        }
+        memset(&fw_ops, 0, sizeof(fw_ops));
+        fw_ops.prep_fn = ses_prep;
+        fw_ops.chunk_fn = ses_chunk;
+        if (op->bpw_then_activate && want_file)
+            fw_ops.act_fn = ses_activate;
+        ret = fw_run_all(dev_arr, num_devs, &image, op->bpw, num_q, &fw_ops,
+                         op, "SEND DIAGNOSTIC", op->verbose);
+        for (k = 0; k < num_devs; ++k) {
+            if (sdev_arr[k].dout.free_doutp)
+                free(sdev_arr[k].dout.free_doutp);
+            if (sdev_arr[k].free_dip)
+                free(sdev_arr[k].free_dip);
+        }
+        goto fini;
+    }
+
+    sg_fd = sg_cmds_open_device(device_name, false /* rw */, op->verbose);
+    if (sg_fd < 0) {
+        if (op->verbose)
+            pr2serr(ME "open error: %s: %s\n", device_name,
+                    safe_strerror(-sg_fd));
+        ret = sg_convert_errno(-sg_fd);
+        goto fini;
+    }
 
     dip = sg_memalign(din_len, 0, &free_dip, op->verbose > 3);
     if (NULL == dip) {
@@ -831,45 +1006,10 @@ main(int argc, char * argv[])
         ret = SG_LIB_CAT_OTHER;
         goto fini;
     }
-    verb = (op->verbose > 1) ? op->verbose - 1 : 0;
     /* Fetch Download microcode status dpage for generation code ++ */
-    if (op->dry_run) {
-        n = sizeof(dummy_rd_resp);
-        n = (n < din_len) ? n : din_len;
-        memcpy(dip, dummy_rd_resp, n);
-        resid = din_len - n;
-        res = 0;
-    } else
-        res = sg_ll_receive_diag_v2(sg_fd, true /* pcv */,
-                                    DPC_DOWNLOAD_MICROCODE, dip, din_len,
-                                    0 /*default timeout */, &resid, true,
-                                    verb);
-    if (0 == res) {
-        rsp_len = sg_get_unaligned_be16(dip + 2) + 4;
-        act_len = din_len - resid;
-        if (rsp_len > din_len) {
-            pr2serr("<<< warning response buffer too small [%d but need "
-                    "%d]>>>\n", din_len, rsp_len);
-            rsp_len = din_len;
-        }
-        if (rsp_len > act_len) {
-            pr2serr("<<< warning response too short [actually got %d but "
-                    "need %d]>>>\n", act_len, rsp_len);
-            rsp_len = act_len;
-        }
-        if (rsp_len < 8) {
-            pr2serr("Download microcode status dpage too short\n");
-            ret = SG_LIB_CAT_OTHER;
-            goto fini;
-        }
-        if ((op->verbose > 2) || (op->dry_run && op->verbose))
-            pr2serr("rec diag(ini): rsp_len=%d, num_sub-enc=%u "
-                    "rec_gen_code=%u\n", rsp_len, dip[1],
-                    sg_get_unaligned_be32(dip + 4));
-    } else {
-        ret = res;
+    ret = fetch_dl_mc_sdg(sg_fd, dip, din_len, dummy_rd_resp, &rsp_len, op);
+    if (ret)
         goto fini;
-    }
     gen_code = sg_get_unaligned_be32(dip + 4);
 
     if (MODE_DNLD_STATUS == op->mc_mode) {
@@ -877,7 +1017,7 @@ main(int argc, char * argv[])
         goto fini;
     } else if (! want_file) {   /* ACTIVATE and ABORT */
         res = send_then_receive(sg_fd, gen_code, 0, NULL, 0, &dout, dip,
-                                din_len, true, op);
+                                din_len, true, op, dummy_rd_resp);
         ret = res;
         goto fini;
     }
@@ -894,7 +1034,7 @@ main(int argc, char * argv[])
                 pr2serr("bpw loop: mode=0x%x, id=%d, off_off=%d, len=%d, "
                         "last=%d\n", op->mc_mode, op->mc_id, k, n, last);
             res = send_then_receive(sg_fd, gen_code, k, dmp + k, n, &dout,
-                                    dip, din_len, last, op);
+                                    dip, din_len, last, op, dummy_rd_resp);
             if (res)
                 break;
         }
@@ -903,19 +1043,24 @@ main(int argc, char * argv[])
             if (op->verbose)
                 pr2serr("sending Activate deferred microcode [0xf]\n");
             res = send_then_receive(sg_fd, gen_code, 0, NULL, 0, &dout,
-                                    dip, din_len, true, op);
+                                    dip, din_len, true, op, dummy_rd_resp);
         }
     } else {
         if (op->verbose)
             pr2serr("single: mode=0x%x, id=%d, offset=%d, len=%d\n",
                     op->mc_mode, op->mc_id, op->mc_offset, op->mc_len);
         res = send_then_receive(sg_fd, gen_code, 0, dmp, op->mc_len, &dout,
-                                dip, din_len, true, op);
+                                dip, din_len, true, op, dummy_rd_resp);
     }
     if (res)
         ret = res;
 
 fini:
+    fw_image_free(&image);      /* no-op if image.bp borrowed dmp */
+    if (dev_arr)
+        free(dev_arr);
+    if (sdev_arr)
+        free(sdev_arr);
     if ((infd >= 0) && (! got_stdin))
         close(infd);
     if (dmp)
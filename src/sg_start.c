@@ -26,6 +26,7 @@
 #include <unistd.h>
 #include <string.h>
 #include <fcntl.h>
+#include <errno.h>
 #include <getopt.h>
 
 #ifdef HAVE_CONFIG_H
@@ -33,13 +34,18 @@
 #endif
 #include "sg_lib.h"
 #include "sg_cmds_basic.h"
+#include "sg_mpoll.h"
 #include "sg_pr2serr.h"
 
 
-static const char * version_str = "0.68 20230407";  /* sbc3r14; mmc6r01a */
+static const char * version_str = "0.69 20261015";  /* sbc3r14; mmc6r01a */
 
 static const char * my_name = "sg_start: ";
 
+#define DEF_STAGGER_MS 1000
+#define DEF_READY_TMO_SECS 300
+#define READY_POLL_MS 500
+
 static struct option long_options[] = {
         {"eject", no_argument, 0, 'e'},
         {"fl", required_argument, 0, 'f'},
@@ -54,7 +60,9 @@ static struct option long_options[] = {
         {"pc", required_argument, 0, 'p'},
         {"readonly", no_argument, 0, 'r'},
         {"start", no_argument, 0, 's'},
+        {"stagger", required_argument, 0, 'T'},
         {"stop", no_argument, 0, 'S'},
+        {"tmo", required_argument, 0, 't'},
         {"verbose", no_argument, 0, 'v'},
         {"version", no_argument, 0, 'V'},
         {0, 0, 0, 0},
@@ -76,8 +84,13 @@ struct opts_t {
     int do_help;
     int do_mod;
     int do_pc;
+    int num_devs;
+    int stagger_num;            /* 0 -> start all DEVICEs at once */
+    int stagger_ms;             /* 0 -> when fewer than stagger_num busy */
+    int tmo_secs;               /* how long to wait for each to be ready */
     int verbose;
     const char * device_name;
+    const char ** dev_names;    /* num_devs elements */
 };
 
 static void
@@ -87,8 +100,9 @@ usage()
             "[--immed] [--load] [--loej]\n"
             "                [--mod=PC_MOD] [--noflush] [--pc=PC] "
             "[--readonly]\n"
-            "                [--start] [--stop] [--verbose] "
-            "[--version] DEVICE\n"
+            "                [--stagger=NUM[,MS]] [--start] [--stop] "
+            "[--tmo=SECS]\n"
+            "                [--verbose] [--version] DEVICE [DEVICE...]\n"
             "  where:\n"
             "    --eject|-e      stop unit then eject the medium\n"
             "    --fl=FL|-f FL    format layer number (mmc5)\n"
@@ -112,18 +126,31 @@ usage()
             "5 -> sleep (mmc)\n"
             "    --readonly|-r    open DEVICE read-only (def: read-write)\n"
             "                     recommended if DEVICE is ATA disk\n"
+            "    --stagger=NUM[,MS]|-T NUM[,MS]    with several DEVICEs: "
+            "start NUM\n"
+            "                    of them then wait MS milliseconds (def: "
+            "1000)\n"
+            "                    before the next NUM; when MS is 0 keep "
+            "at most NUM\n"
+            "                    becoming ready (def: all DEVICEs at "
+            "once)\n"
             "    --start|-s      start unit, corresponds to START bit "
             "in cdb,\n"
             "                    default (START=1) if no other options "
             "given\n"
             "    --stop|-S       stop unit (e.g. spin down disk)\n"
+            "    --tmo=SECS|-t SECS    with several DEVICEs: wait at most "
+            "SECS for\n"
+            "                          each to become ready (def: 300)\n"
             "    --verbose|-v    increase verbosity\n"
             "    --old|-O        use old interface (use as first option)\n"
             "    --version|-V    print version string then exit\n\n"
             "    Example: 'sg_start --stop /dev/sdb'    stops unit\n"
             "             'sg_start --eject /dev/scd0'  stops unit and "
             "ejects medium\n\n"
-            "Performs a SCSI START STOP UNIT command\n"
+            "Performs a SCSI START STOP UNIT command. With several DEVICEs "
+            "IMMED is\nset and, when starting, each is polled with TEST "
+            "UNIT READY until ready\n"
             );
 }
 
@@ -176,12 +203,13 @@ usage_old()
 static int
 new_parse_cmd_line(struct opts_t * op, int argc, char * argv[])
 {
-    int c, n, err;
+    int c, n;
+    const char * cp;
 
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "ef:hilLm:nNOp:rsSvV", long_options,
+        c = getopt_long(argc, argv, "ef:hilLm:nNOp:rsSt:T:vV", long_options,
                         &option_index);
         if (c == -1)
             break;
@@ -251,6 +279,34 @@ new_parse_cmd_line(struct opts_t * op, int argc, char * argv[])
         case 'S':
             op->do_stop = true;
             break;
+        case 't':
+            n = sg_get_num(optarg);
+            if (n < 0) {
+                pr2serr("bad argument to '--tmo='\n");
+                usage();
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            op->tmo_secs = n;
+            break;
+        case 'T':
+            n = sg_get_num(optarg);
+            if (n < 1) {
+                pr2serr("bad NUM argument to '--stagger='\n");
+                usage();
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            op->stagger_num = n;
+            cp = strchr(optarg, ',');
+            if (cp) {
+                n = sg_get_num(cp + 1);
+                if (n < 0) {
+                    pr2serr("bad MS argument to '--stagger='\n");
+                    usage();
+                    return SG_LIB_SYNTAX_ERROR;
+                }
+                op->stagger_ms = n;
+            }
+            break;
         case 'v':
             op->verbose_given = true;
             ++op->verbose;
@@ -266,7 +322,6 @@ new_parse_cmd_line(struct opts_t * op, int argc, char * argv[])
             return SG_LIB_SYNTAX_ERROR;
         }
     }
-    err = 0;
     for (; optind < argc; ++optind) {
         if (1 == strlen(argv[optind])) {
             if (0 == strcmp("0", argv[optind])) {
@@ -277,18 +332,18 @@ new_parse_cmd_line(struct opts_t * op, int argc, char * argv[])
                 continue;
             }
         }
+        if (NULL == op->dev_names) {
+            op->dev_names = (const char **)calloc(argc, sizeof(char *));
+            if (NULL == op->dev_names) {
+                pr2serr("%s: out of memory\n", __func__);
+                return sg_convert_errno(ENOMEM);
+            }
+        }
+        op->dev_names[op->num_devs++] = argv[optind];
         if (NULL == op->device_name)
             op->device_name = argv[optind];
-        else {
-            pr2serr("Unexpected extra argument: %s\n", argv[optind]);
-            ++err;
-        }
     }
-    if (err) {
-        usage();
-        return SG_LIB_SYNTAX_ERROR;
-    } else
-        return 0;
+    return 0;
 }
 
 static int
@@ -485,6 +540,155 @@ parse_cmd_line(struct opts_t * op, int argc, char * argv[])
     return res;
 }
 
+/* Sends the START STOP UNIT command that the options call for. */
+static int
+do_ssu(int sg_fd, const struct opts_t * op, bool immed)
+{
+    if (op->do_fl >= 0)
+        return sg_ll_start_stop_unit(sg_fd, immed, op->do_fl, 0 /* pc */,
+                                     true /* fl */, true /* loej */,
+                                     true /*start */, true /* noisy */,
+                                     op->verbose);
+    else if (op->do_pc > 0)
+        return sg_ll_start_stop_unit(sg_fd, immed, op->do_mod, op->do_pc,
+                                     op->do_noflush, false, false, true,
+                                     op->verbose);
+    return sg_ll_start_stop_unit(sg_fd, immed, 0, false, op->do_noflush,
+                                 op->do_loej, op->do_start, true,
+                                 op->verbose);
+}
+
+/* Sends START STOP UNIT, with IMMED set, to all op->dev_names from one
+ * loop. DEVICEs are started op->stagger_num at a time, either every
+ * op->stagger_ms milliseconds or, if that is 0, whenever fewer than
+ * op->stagger_num are still becoming ready. When starting (but not for
+ * power condition changes or stops) each DEVICE is polled with TEST UNIT
+ * READY until it is ready or op->tmo_secs have elapsed. Returns 0 if all
+ * succeeded else the result of the first DEVICE (in command line order)
+ * that failed. */
+static int
+start_fleet(const struct opts_t * op)
+{
+    bool poll_ready = (op->do_start && (op->do_pc <= 0));
+    int k, res, n_act, n_todo, wait_ms;
+    int next_ind = 0;
+    int num_failed = 0;
+    int ret = 0;
+    int vb = op->verbose;
+    int stag_num = (op->stagger_num > 0) ? op->stagger_num : op->num_devs;
+    int64_t now, ms;
+    int64_t next_start_ms = 0;
+    struct sg_mpoll_dev * mdp_arr;
+    struct sg_mpoll_dev * mdp;
+    char b[80];
+
+    mdp_arr = (struct sg_mpoll_dev *)calloc(op->num_devs, sizeof(*mdp_arr));
+    if (NULL == mdp_arr) {
+        pr2serr("%s: out of memory\n", __func__);
+        return sg_convert_errno(ENOMEM);
+    }
+    for (k = 0, mdp = mdp_arr; k < op->num_devs; ++k, ++mdp) {
+        mdp->dev_name = op->dev_names[k];
+        mdp->progress = -1;
+        mdp->until_ready = true;
+        mdp->sg_fd = sg_cmds_open_device(mdp->dev_name, op->do_readonly, vb);
+        if (mdp->sg_fd < 0) {
+            pr2serr("Error trying to open %s: %s\n", mdp->dev_name,
+                    safe_strerror(-mdp->sg_fd));
+            mdp->res = sg_convert_errno(-mdp->sg_fd);
+            mdp->sg_fd = -1;
+        }
+    }
+    while (1) {
+        now = sg_mpoll_now_ms();
+        for (k = 0, n_act = 0, mdp = mdp_arr; k < op->num_devs; ++k, ++mdp) {
+            if (mdp->active)
+                ++n_act;
+        }
+        /* how many more DEVICEs may be started now */
+        if (op->stagger_ms > 0)
+            n_todo = (now >= next_start_ms) ? stag_num : 0;
+        else
+            n_todo = stag_num - n_act;
+        if ((n_todo > 0) && (next_ind < op->num_devs) &&
+            (op->stagger_ms > 0))
+            next_start_ms = now + op->stagger_ms;
+        for ( ; (n_todo > 0) && (next_ind < op->num_devs); ++next_ind) {
+            mdp = mdp_arr + next_ind;
+            if (mdp->sg_fd < 0)
+                continue;
+            if (vb)
+                pr2serr("%s: START STOP UNIT\n", mdp->dev_name);
+            res = do_ssu(mdp->sg_fd, op, true);
+            if (res) {
+                sg_get_category_sense_str(res, sizeof(b), b, vb);
+                pr2serr("%s: START STOP UNIT command failed: %s\n",
+                        mdp->dev_name, b);
+            }
+            sg_mpoll_started(mdp, mdp->sg_fd, poll_ready, res);
+            if (mdp->active)
+                ++n_act;
+            --n_todo;
+        }
+        for (k = 0, mdp = mdp_arr; k < op->num_devs; ++k, ++mdp) {
+            if (! mdp->active)
+                continue;
+            sg_mpoll_poll(mdp, vb);
+            if (mdp->active) {
+                if ((op->tmo_secs > 0) &&
+                    ((now - mdp->start_ms) > (op->tmo_secs * 1000LL))) {
+                    pr2serr("%s: not ready after %d seconds\n",
+                            mdp->dev_name, op->tmo_secs);
+                    mdp->active = false;
+                    mdp->res = SG_LIB_CAT_TIMEOUT;
+                    mdp->end_ms = now;
+                }
+                continue;
+            }
+            if (mdp->res) {
+                sg_get_category_sense_str(mdp->res, sizeof(b), b, vb);
+                pr2serr("%s: TEST UNIT READY failed: %s\n", mdp->dev_name,
+                        b);
+            } else if (vb) {
+                ms = mdp->end_ms - mdp->start_ms;
+                pr2serr("%s: ready after %d.%03d seconds, %d polls\n",
+                        mdp->dev_name, (int)(ms / 1000), (int)(ms % 1000),
+                        mdp->num_polls);
+            }
+        }
+        for (k = 0, n_act = 0, mdp = mdp_arr; k < op->num_devs; ++k, ++mdp) {
+            if (mdp->active)
+                ++n_act;
+        }
+        if ((0 == n_act) && (next_ind >= op->num_devs))
+            break;
+        wait_ms = n_act ? READY_POLL_MS : op->stagger_ms;
+        if ((op->stagger_ms > 0) && (next_ind < op->num_devs)) {
+            ms = next_start_ms - sg_mpoll_now_ms();
+            if (ms < wait_ms)
+                wait_ms = (ms > 0) ? (int)ms : 0;
+        }
+        sg_mpoll_sleep_ms(wait_ms);
+    }
+    for (k = 0, mdp = mdp_arr; k < op->num_devs; ++k, ++mdp) {
+        if (mdp->sg_fd >= 0) {
+            res = sg_cmds_close_device(mdp->sg_fd);
+            if ((res < 0) && (0 == mdp->res))
+                mdp->res = sg_convert_errno(-res);
+        }
+        if (mdp->res) {
+            ++num_failed;
+            if (0 == ret)
+                ret = mdp->res;
+        }
+    }
+    if (num_failed)
+        pr2serr("%d of %d DEVICEs failed\n", num_failed, op->num_devs);
+    free(mdp_arr);
+    return ret;
+}
+
+
 
 int
 main(int argc, char * argv[])
@@ -498,6 +702,8 @@ main(int argc, char * argv[])
     op = &opts;
     memset(op, 0, sizeof(opts));
     op->do_fl = -1;    /* only when >= 0 set FL bit */
+    op->stagger_ms = DEF_STAGGER_MS;
+    op->tmo_secs = DEF_READY_TMO_SECS;
     if (getenv("SG3_UTILS_INVOCATION"))
         sg_rep_invocation(my_name, version_str, argc, argv, stderr);
     res = parse_cmd_line(op, argc, argv);
@@ -571,6 +777,10 @@ main(int argc, char * argv[])
             return SG_LIB_CONTRADICT;
         }
     }
+    if ((op->num_devs > 1) || (op->stagger_num > 0)) {
+        ret = start_fleet(op);
+        goto fini;
+    }
 
     sg_fd = sg_cmds_open_device(op->device_name, op->do_readonly,
                                 op->verbose);
@@ -582,19 +792,7 @@ main(int argc, char * argv[])
         goto fini;
     }
 
-    if (op->do_fl >= 0)
-        res = sg_ll_start_stop_unit(sg_fd, op->do_immed, op->do_fl, 0 /* pc */,
-                                    true /* fl */, true /* loej */,
-                                    true /*start */, true /* noisy */,
-                                    op->verbose);
-    else if (op->do_pc > 0)
-        res = sg_ll_start_stop_unit(sg_fd, op->do_immed, op->do_mod,
-                                    op->do_pc, op->do_noflush, false, false,
-                                    true, op->verbose);
-    else
-        res = sg_ll_start_stop_unit(sg_fd, op->do_immed, 0, false,
-                                    op->do_noflush, op->do_loej,
-                                    op->do_start, true, op->verbose);
+    res = do_ssu(sg_fd, op, op->do_immed);
     ret = res;
     if (res) {
         if (op->verbose < 2) {
@@ -613,6 +811,8 @@ fini:
                 ret = sg_convert_errno(-res);
         }
     }
+    if (op->dev_names)
+        free(op->dev_names);
     if (0 == op->verbose) {
         if (! sg_if_can2stderr("sg_start failed: ", ret))
             pr2serr("Some error occurred, try again with '-v' "
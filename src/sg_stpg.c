@@ -15,6 +15,7 @@
 #include <stdbool.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
 #include <getopt.h>
 #define __STDC_FORMAT_MACROS 1
 
@@ -25,16 +26,20 @@
 #include "sg_cmds_basic.h"
 #include "sg_cmds_extra.h"
 #include "sg_unaligned.h"
+#include "sg_alua.h"
+#include "sg_par.h"
 #include "sg_pr2serr.h"
 
 /* A utility program originally written for the Linux OS SCSI subsystem.
  *
  *
  * This program issues the SCSI command SET TARGET PORT GROUPS
- * to the given SCSI device.
+ * to the given SCSI device. When given several DEVICEs (paths) they are
+ * grouped by logical unit and one SET TARGET PORT GROUPS command is sent
+ * to each logical unit, concurrently.
  */
 
-static const char * version_str = "1.22 20230519";
+static const char * version_str = "1.23 20261015";
 
 #define TGT_GRP_BUFF_LEN 1024
 #define MX_ALLOC_LEN (0xc000 + 0x80)
@@ -79,12 +84,26 @@ struct tgtgrp {
         int valid;
 };
 
+struct stpg_lu_t {              /* one SET TARGET PORT GROUPS per LU */
+        int path_ind;           /* path (in pa_arr) it is sent on */
+        int param_len;
+        int res;
+        uint8_t param[TGT_GRP_BUFF_LEN];
+};
+
+struct stpg_batch_t {
+        struct sg_alua_path * pa_arr;
+        struct stpg_lu_t * lu_arr;
+        int verbose;
+};
+
 static struct option long_options[] = {
         {"active", no_argument, 0, 'a'},
         {"help", no_argument, 0, 'h'},
         {"hex", no_argument, 0, 'H'},
         {"offline", no_argument, 0, 'l'},
         {"optimized", no_argument, 0, 'o'},
+        {"parallel", required_argument, 0, 'p'},
         {"raw", no_argument, 0, 'r'},
         {"standby", no_argument, 0, 's'},
         {"state", required_argument, 0, 'S'},
@@ -99,10 +118,12 @@ static void
 usage()
 {
     pr2serr("Usage: sg_stpg   [--active] [--help] [--hex] [--offline] "
-            "[--optimized] [--raw]\n"
-            "                 [--standby] [--state=S,S...] [--tp=P,P...] "
-            "[--unavailable]\n"
-            "                 [--verbose] [--version] DEVICE\n"
+            "[--optimized]\n"
+            "                 [--parallel=Q] [--raw] [--standby] "
+            "[--state=S,S...]\n"
+            "                 [--tp=P,P...] [--unavailable] [--verbose] "
+            "[--version]\n"
+            "                 DEVICE [DEVICE...]\n"
             "  where:\n"
             "    --active|-a        set asymm. access state to "
             "active/non-optimized\n"
@@ -115,6 +136,9 @@ usage()
             "group id\n"
             "    --optimized|-o     set asymm. access state to "
             "active/optimized\n"
+            "    --parallel=Q|-p Q    with several DEVICEs, at most Q "
+            "commands at once\n"
+            "                         (def: 32)\n"
             "    --raw|-r           output report response in binary to "
             "stdout, then exit\n"
             "    --standby|-s       set asymm. access state to standby\n"
@@ -127,7 +151,10 @@ usage()
             "    --unavailable|-u   set asymm. access state to unavailable\n"
             "    --verbose|-v       increase verbosity\n"
             "    --version|-V       print version string and exit\n\n"
-            "Performs a SCSI SET TARGET PORT GROUPS command\n");
+            "Performs a SCSI SET TARGET PORT GROUPS command. With several "
+            "DEVICEs (paths)\none command is sent to each logical unit, "
+            "without --tp setting the\ntarget port groups of the given "
+            "paths.\n");
 }
 
 static void
@@ -222,7 +249,7 @@ decode_tpgs_state(const int st)
 
 static int
 transition_tpgs_states(struct tgtgrp *tgtState, int numgrp, int portgroup,
-                       int newstate)
+                       int newstate, bool noisy)
 {
      int i,oldstate;
 
@@ -261,6 +288,8 @@ transition_tpgs_states(struct tgtgrp *tgtState, int numgrp, int portgroup,
                }
           }
      }
+     if (! noisy)
+          return 0;
      printf("New target port groups:\n");
      for (i = 0; i < numgrp; i++) {
             printf("  target port group id : 0x%x\n",
@@ -408,6 +437,143 @@ build_state_arr(const char * inp, int * state_arr, int * state_arr_len,
     return 0;
 }
 
+static int
+stpg_set_one(int64_t k, void * ctx)
+{
+    struct stpg_batch_t * bp = (struct stpg_batch_t *)ctx;
+    struct stpg_lu_t * lup = bp->lu_arr + k;
+    const struct sg_alua_path * pap = bp->pa_arr + lup->path_ind;
+
+    lup->res = sg_ll_set_tgt_prt_grp(pap->sg_fd, lup->param, lup->param_len,
+                                     true, bp->verbose);
+    return 0;
+}
+
+/* Discovers all num_devs paths concurrently, groups them by logical unit
+ * and then sends one SET TARGET PORT GROUPS to each logical unit (on the
+ * first path to it that answered), again concurrently. If port_arr_len is
+ * 0 the target port group of each given path is set to state, otherwise
+ * the --tp and --state lists are sent to each logical unit. Returns 0 if
+ * all succeeded, else the first failure in command line order. */
+static int
+stpg_multi(const char ** dev_names, int num_devs, int num_parallel,
+           int state, const int * port_arr, const int * state_arr,
+           int port_arr_len, int verbose)
+{
+    bool * done_arr = NULL;
+    int k, j, n, num_lus, numgrp;
+    int ret = 0;
+    struct sg_alua_path * pa_arr;
+    struct sg_alua_path * pap;
+    const struct sg_alua_path * qp;
+    struct stpg_lu_t * lu_arr = NULL;
+    struct stpg_lu_t * lup;
+    uint8_t * bp;
+    struct tgtgrp tgtGrpState[SG_ALUA_MAX_TPGS];
+    struct stpg_batch_t batch;
+    char b[80];
+
+    pa_arr = (struct sg_alua_path *)calloc(num_devs, sizeof(*pa_arr));
+    lu_arr = (struct stpg_lu_t *)calloc(num_devs, sizeof(*lu_arr));
+    done_arr = (bool *)calloc(num_devs, sizeof(bool));
+    if ((NULL == pa_arr) || (NULL == lu_arr) || (NULL == done_arr)) {
+        pr2serr("%s: out of memory\n", __func__);
+        ret = sg_convert_errno(ENOMEM);
+        goto fini;
+    }
+    for (k = 0; k < num_devs; ++k) {
+        pa_arr[k].dev_name = dev_names[k];
+        pa_arr[k].keep_open = true;
+    }
+    sg_alua_discover(pa_arr, num_devs, num_parallel, false /* rw */,
+                     verbose);
+    for (k = 0, num_lus = 0, pap = pa_arr; k < num_devs; ++k, ++pap) {
+        if (done_arr[k] || pap->res)
+            continue;
+        if (0 == pap->lu_id[0]) {
+            pr2serr("%s: no logical unit designator, skipped\n",
+                    pap->dev_name);
+            pap->res = SG_LIB_CAT_MALFORMED;
+            continue;
+        }
+        lup = lu_arr + num_lus;
+        lup->path_ind = k;
+        bp = lup->param;
+        if (port_arr_len > 0) {
+            for (j = 0; j < num_devs; ++j) {
+                if (0 == strcmp(pa_arr[j].lu_id, pap->lu_id))
+                    done_arr[j] = true;
+            }
+            for (j = 0, bp += 4; j < port_arr_len; ++j, bp += 4) {
+                bp[0] = state_arr[j] & 0xf;
+                sg_put_unaligned_be16((uint16_t)port_arr[j], bp + 2);
+            }
+            lup->param_len = port_arr_len * 4 + 4;
+        } else {
+            numgrp = pap->num_tpgs;
+            for (j = 0; j < numgrp; ++j) {
+                tgtGrpState[j].id = pap->tpg_arr[j].id;
+                tgtGrpState[j].current = pap->tpg_arr[j].state;
+                tgtGrpState[j].valid = pap->tpg_arr[j].sup;
+            }
+            /* each given path to this LU selects a group to transition */
+            for (j = k, n = 0; j < num_devs; ++j) {
+                qp = pa_arr + j;
+                if (0 != strcmp(qp->lu_id, pap->lu_id))
+                    continue;
+                done_arr[j] = true;
+                if (qp->res || (qp->tpg < 0))
+                    continue;
+                if (transition_tpgs_states(tgtGrpState, numgrp, qp->tpg,
+                                           state, false)) {
+                    pa_arr[j].res = SG_LIB_SYNTAX_ERROR;
+                    continue;
+                }
+                ++n;
+            }
+            if (0 == n)
+                continue;
+            encode_tpgs_states(bp, tgtGrpState, numgrp);
+            lup->param_len = numgrp * 4 + 4;
+        }
+        ++num_lus;
+    }
+    batch.pa_arr = pa_arr;
+    batch.lu_arr = lu_arr;
+    batch.verbose = verbose;
+    sg_par_each(num_lus, num_parallel, stpg_set_one, &batch);
+    for (k = 0, lup = lu_arr; k < num_lus; ++k, ++lup) {
+        pap = pa_arr + lup->path_ind;
+        printf("Logical unit %s via %s:", pap->lu_id, pap->dev_name);
+        for (j = 4; j < lup->param_len; j += 4)
+            printf(" 0x%x->0x%x", sg_get_unaligned_be16(lup->param + j + 2),
+                   lup->param[j] & 0xf);
+        if (lup->res) {
+            sg_get_category_sense_str(lup->res, sizeof(b), b, verbose);
+            printf("  failed: %s\n", b);
+            pap->res = lup->res;
+        } else
+            printf("  ok\n");
+    }
+    for (k = 0, n = 0; k < num_devs; ++k) {
+        if (pa_arr[k].res) {
+            ++n;
+            if (0 == ret)
+                ret = pa_arr[k].res;
+        }
+    }
+    if (n)
+        pr2serr("%d of %d DEVICEs failed\n", n, num_devs);
+fini:
+    if (pa_arr) {
+        sg_alua_close(pa_arr, num_devs);
+        free(pa_arr);
+    }
+    free(lu_arr);
+    free(done_arr);
+    return ret;
+}
+
 
 int
 main(int argc, char * argv[])
@@ -418,6 +584,8 @@ main(int argc, char * argv[])
     bool version_given = false;
     int k, off, res, c, report_len, tgt_port_count;
     int sg_fd = -1;
+    int num_devs = 0;
+    int num_parallel = SG_ALUA_DEF_PARALLEL;
     int port_arr_len = 0;
     int verbose = 0;
     uint8_t reportTgtGrpBuff[TGT_GRP_BUFF_LEN];
@@ -436,12 +604,13 @@ main(int argc, char * argv[])
     int relport = -1;
     int numgrp = 0;
     const char * device_name = NULL;
+    const char ** dev_names = NULL;
     int ret = 0;
 
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "ahHloOrsS:t:uvV", long_options,
+        c = getopt_long(argc, argv, "ahHloOp:rsS:t:uvV", long_options,
                         &option_index);
         if (c == -1)
             break;
@@ -464,6 +633,11 @@ main(int argc, char * argv[])
         case 'o':
             state = TPGS_STATE_OPTIMIZED;
             break;
+        case 'p':
+            num_parallel = sg_par_get_num(optarg, 1, SG_ALUA_MAX_PARALLEL);
+            if (num_parallel < 0)
+                return SG_LIB_SYNTAX_ERROR;
+            break;
         case 'r':
             raw = true;
             break;
@@ -493,16 +667,9 @@ main(int argc, char * argv[])
         }
     }
     if (optind < argc) {
-        if (NULL == device_name) {
-            device_name = argv[optind];
-            ++optind;
-        }
-        if (optind < argc) {
-            for (; optind < argc; ++optind)
-                pr2serr("Unexpected extra argument: %s\n", argv[optind]);
-            usage();
-            return SG_LIB_SYNTAX_ERROR;
-        }
+        device_name = argv[optind];
+        dev_names = (const char **)(argv + optind);
+        num_devs = argc - optind;
     }
 #ifdef DEBUG
     pr2serr("In DEBUG mode, ");
@@ -582,6 +749,15 @@ main(int argc, char * argv[])
         usage();
         return SG_LIB_SYNTAX_ERROR;
     }
+    if (num_devs > 1) {
+        if (raw || hex) {
+            pr2serr("--raw and --hex need a single DEVICE\n");
+            return SG_LIB_CONTRADICT;
+        }
+        ret = stpg_multi(dev_names, num_devs, num_parallel, state, port_arr,
+                         state_arr, port_arr_len, verbose);
+        goto err_out;
+    }
     sg_fd = sg_cmds_open_device(device_name, false /* rw */, verbose);
     if (sg_fd < 0) {
         if (verbose)
@@ -680,7 +856,7 @@ main(int argc, char * argv[])
         decode_tpgs_state(state);
         printf("\n");
 
-        transition_tpgs_states(tgtGrpState, numgrp, portgroup, state);
+        transition_tpgs_states(tgtGrpState, numgrp, portgroup, state, true);
 
         memset(setTgtGrpBuff, 0x0, sizeof(setTgtGrpBuff));
         /* trunc = 0; */
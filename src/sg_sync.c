@@ -16,6 +16,7 @@
 #include <string.h>
 #include <limits.h>
 #include <getopt.h>
+#include <errno.h>
 #define __STDC_FORMAT_MACROS 1
 #include <inttypes.h>
 
@@ -27,6 +28,8 @@
 #include "sg_cmds_basic.h"
 #include "sg_pt.h"
 #include "sg_unaligned.h"
+#include "sg_mpoll.h"
+#include "sg_par.h"
 #include "sg_pr2serr.h"
 
 /* A utility program for the Linux OS SCSI subsystem.
@@ -34,10 +37,11 @@
  *
  * This program issues the SCSI command SYNCHRONIZE CACHE(10 or 16) to the
  * given device. This command is defined for SCSI "direct access" devices
- * (e.g. disks).
+ * (e.g. disks). When given several DEVICEs, and/or with --split=NS, the
+ * commands are sent concurrently from a pool of threads.
  */
 
-static const char * version_str = "1.30 20230519";
+static const char * version_str = "1.31 20261015";
 
 static const char * my_name = "sg_sync: ";
 
@@ -45,6 +49,48 @@ static const char * my_name = "sg_sync: ";
 #define SYNCHRONIZE_CACHE16_CMDLEN  16
 #define SENSE_BUFF_LEN  64
 #define DEF_PT_TIMEOUT  60       /* 60 seconds */
+#define RCAP16_RESP_LEN 32
+#define SYNC_MAX_PARALLEL SG_PAR_MAX
+#define SYNC_DEF_PARALLEL 32
+#define SYNC_MAX_SPLIT 1024
+
+struct sync_opts_t {
+    bool do_16;
+    bool immed;
+    bool sync_nv;
+    bool wait;
+    int group;
+    int num_parallel;
+    int split;
+    int tmo_secs;
+    int verbose;
+    int64_t count;
+    int64_t lba;
+};
+
+struct sync_dev_t {
+    int sg_fd;
+    int res;                    /* first failure on this DEVICE, or 0 */
+    uint64_t lba;               /* range to synchronize on this DEVICE */
+    uint64_t num_lb;            /* 0 -> all blocks from lba */
+    int64_t start_ms;
+    int64_t end_ms;
+    const char * dev_name;
+};
+
+struct sync_item_t {            /* one SYNCHRONIZE CACHE command */
+    int dev_ind;
+    bool immed;
+    uint64_t lba;
+    unsigned int num_lb;
+};
+
+struct sync_batch_t {
+    const struct sync_opts_t * op;
+    struct sync_dev_t * dev_arr;
+    struct sync_item_t * item_arr;
+    int num_items;
+};
 
 
 static struct option long_options[] = {
@@ -54,11 +100,14 @@ static struct option long_options[] = {
         {"help", no_argument, 0, 'h'},
         {"immed", no_argument, 0, 'i'},
         {"lba", required_argument, 0, 'l'},
+        {"parallel", required_argument, 0, 'p'},
+        {"split", required_argument, 0, 'n'},
         {"sync-nv", no_argument, 0, 's'},
         {"timeout", required_argument, 0, 't'},
         {"tmo", required_argument, 0, 't'},
         {"verbose", no_argument, 0, 'v'},
         {"version", no_argument, 0, 'V'},
+        {"wait", no_argument, 0, 'w'},
         {0, 0, 0, 0},
 };
 
@@ -67,9 +116,11 @@ usage()
 {
     pr2serr("Usage: sg_sync    [--16] [--count=COUNT] [--group=GN] [--help] "
             "[--immed]\n"
-            "                  [--lba=LBA] [--sync-nv] [--timeout=SECS] "
-            "[--verbose]\n"
-            "                  [--version] DEVICE\n"
+            "                  [--lba=LBA] [--parallel=Q] [--split=NS] "
+            "[--sync-nv]\n"
+            "                  [--timeout=SECS] [--verbose] [--version] "
+            "[--wait]\n"
+            "                  DEVICE [DEVICE...]\n"
             "  where:\n"
             "    --16|-S             calls SYNCHRONIZE CACHE(16) (def: is "
             "10 byte\n"
@@ -85,6 +136,11 @@ usage()
             "    --lba=LBA|-l LBA    logical block address to start sync "
             "operation\n"
             "                        from (def: 0)\n"
+            "    --parallel=Q|-p Q    at most Q commands outstanding at once "
+            "(def: 32)\n"
+            "    --split=NS|-n NS    split range into NS sub-ranges, each "
+            "with its\n"
+            "                        own SYNCHRONIZE CACHE(16) (def: 1)\n"
             "    --sync-nv|-s        synchronize to non-volatile storage "
             "(if distinct\n"
             "                        from medium). Obsolete in sbc3r35d.\n"
@@ -92,8 +148,14 @@ usage()
             "active\n"
             "                              if '--16' given (def: 60 seconds)\n"
             "    --verbose|-v        increase verbosity\n"
-            "    --version|-V        print version string and exit\n\n"
-            "Performs a SCSI SYNCHRONIZE CACHE(10 or 16) command\n");
+            "    --version|-V        print version string and exit\n"
+            "    --wait|-w           with --immed, after the sub-ranges "
+            "follow with a\n"
+            "                        SYNCHRONIZE CACHE without IMMED on each "
+            "DEVICE\n\n"
+            "Performs a SCSI SYNCHRONIZE CACHE(10 or 16) command. Several "
+            "DEVICEs\nand the sub-ranges of --split are synchronized "
+            "concurrently.\n");
 }
 
 static int
@@ -155,48 +217,256 @@ sg_ll_sync_cache_16(int sg_fd, bool sync_nv, bool immed, int group,
     return ret;
 }
 
+/* Sends one SYNCHRONIZE CACHE command, the 16 byte variant if do_16. */
+static int
+sync_one(int sg_fd, const struct sync_opts_t * op, bool do_16, bool immed,
+         uint64_t lba, unsigned int num_lb)
+{
+    if (do_16)
+        return sg_ll_sync_cache_16(sg_fd, op->sync_nv, immed, op->group,
+                                   lba, num_lb, op->tmo_secs, true,
+                                   op->verbose);
+    return sg_ll_sync_cache_10(sg_fd, op->sync_nv, immed, op->group,
+                               (unsigned int)lba, num_lb, true, op->verbose);
+}
+
+/* When splitting with a COUNT of 0, the range runs to the last LBA which
+ * is found with READ CAPACITY(16). Returns 0 if ok. */
+static int
+sync_dev_range(struct sync_dev_t * dp, const struct sync_opts_t * op)
+{
+    int res;
+    uint64_t last_lba;
+    uint8_t rc_buff[RCAP16_RESP_LEN];
+
+    dp->lba = (uint64_t)op->lba;
+    dp->num_lb = (uint64_t)op->count;
+    if ((op->split < 2) || (dp->num_lb > 0))
+        return 0;
+    res = sg_ll_readcap_16(dp->sg_fd, false, 0, rc_buff, sizeof(rc_buff),
+                           true, op->verbose);
+    if (res) {
+        pr2serr("%s: READ CAPACITY(16) needed by --split failed\n",
+                dp->dev_name);
+        return res;
+    }
+    last_lba = sg_get_unaligned_be64(rc_buff + 0);
+    if (dp->lba > last_lba) {
+        pr2serr("%s: LBA 0x%" PRIx64 " exceeds last LBA 0x%" PRIx64 "\n",
+                dp->dev_name, dp->lba, last_lba);
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    dp->num_lb = last_lba - dp->lba + 1;
+    if (((dp->num_lb + op->split - 1) / op->split) > UINT_MAX) {
+        pr2serr("%s: sub-ranges exceed 32 bits, need --split=%" PRIu64
+                " or more\n", dp->dev_name,
+                (dp->num_lb + UINT_MAX - 1) / UINT_MAX);
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    return 0;
+}
+
+/* Appends the commands for one DEVICE to bp->item_arr: its range cut into
+ * (at most) op->split sub-ranges of about the same size. */
+static void
+sync_add_items(struct sync_batch_t * bp, int dev_ind)
+{
+    int n;
+    uint64_t per, lba, rem;
+    const struct sync_opts_t * op = bp->op;
+    const struct sync_dev_t * dp = bp->dev_arr + dev_ind;
+    struct sync_item_t * ip;
+
+    n = (op->split > 1) ? op->split : 1;
+    if (n > 1) {
+        if ((uint64_t)n > dp->num_lb)
+            n = (int)dp->num_lb;
+        per = (dp->num_lb + n - 1) / n;
+    } else
+        per = dp->num_lb;
+    for (lba = dp->lba, rem = dp->num_lb; ; ) {
+        ip = bp->item_arr + bp->num_items++;
+        ip->dev_ind = dev_ind;
+        ip->immed = op->immed;
+        ip->lba = lba;
+        ip->num_lb = (unsigned int)((rem < per) ? rem : per);
+        if ((0 == per) || (rem <= per))
+            break;
+        lba += per;
+        rem -= per;
+    }
+}
+
+/* Sends SYNCHRONIZE CACHE item k of the batch in ctx */
+static int
+sync_item(int64_t k, void * ctx)
+{
+    int res;
+    struct sync_batch_t * bp = (struct sync_batch_t *)ctx;
+    const struct sync_opts_t * op = bp->op;
+    const struct sync_item_t * ip = bp->item_arr + k;
+    struct sync_dev_t * dp = bp->dev_arr + ip->dev_ind;
+
+    if (dp->res)
+        return 0;       /* earlier sub-range on this DEVICE failed */
+    if (op->verbose > 1)
+        pr2serr("%s: sync lba=0x%" PRIx64 ", num=%u%s\n", dp->dev_name,
+                ip->lba, ip->num_lb, ip->immed ? " [immed]" : "");
+    res = sync_one(dp->sg_fd, op, (op->do_16 || (op->split > 1)),
+                   ip->immed, ip->lba, ip->num_lb);
+    if (res) {
+        char b[80];
+
+        sg_get_category_sense_str(res, sizeof(b), b, op->verbose);
+        pr2serr("%s: synchronize cache failed: %s\n", dp->dev_name, b);
+    }
+    sg_par_lock();
+    if (res && (0 == dp->res))
+        dp->res = res;
+    dp->end_ms = sg_mpoll_now_ms();
+    sg_par_unlock();
+    return 0;
+}
+
+/* Runs bp->item_arr on at most op->num_parallel threads */
+static void
+sync_run_items(struct sync_batch_t * bp)
+{
+    if (bp->op->verbose > 1)
+        pr2serr("%d commands, up to %d at once\n", bp->num_items,
+                bp->op->num_parallel);
+    sg_par_each(bp->num_items, bp->op->num_parallel, sync_item, bp);
+}
+
+/* Synchronizes several DEVICEs, and/or sub-ranges of them, concurrently.
+ * With --wait the IMMED commands are followed by a SYNCHRONIZE CACHE
+ * without IMMED over the whole range of each DEVICE: SBC gives no progress
+ * indication for this command so its completion is what shows that the
+ * cache has been flushed. Returns 0 if all succeeded else the result of
+ * the first DEVICE (in command line order) that failed. */
+static int
+sync_multi(const struct sync_opts_t * op, const char ** dev_names,
+           int num_devs)
+{
+    int k, res;
+    int num_failed = 0;
+    int ret = 0;
+    int64_t ms;
+    struct sync_dev_t * dp;
+    struct sync_batch_t batch;
+
+    memset(&batch, 0, sizeof(batch));
+    batch.op = op;
+    batch.dev_arr = (struct sync_dev_t *)calloc(num_devs,
+                                                sizeof(struct sync_dev_t));
+    batch.item_arr = (struct sync_item_t *)calloc(num_devs *
+                                ((op->split > 1) ? op->split : 1),
+                                sizeof(struct sync_item_t));
+    if ((NULL == batch.dev_arr) || (NULL == batch.item_arr)) {
+        pr2serr("%s: out of memory\n", __func__);
+        ret = sg_convert_errno(ENOMEM);
+        goto fini;
+    }
+    for (k = 0, dp = batch.dev_arr; k < num_devs; ++k, ++dp) {
+        dp->dev_name = dev_names[k];
+        dp->sg_fd = sg_cmds_open_device(dp->dev_name, false /* rw */,
+                                        op->verbose);
+        if (dp->sg_fd < 0) {
+            pr2serr("open error: %s: %s\n", dp->dev_name,
+                    safe_strerror(-dp->sg_fd));
+            dp->res = sg_convert_errno(-dp->sg_fd);
+            continue;
+        }
+        dp->res = sync_dev_range(dp, op);
+        if (0 == dp->res)
+            sync_add_items(&batch, k);
+    }
+    ms = sg_mpoll_now_ms();
+    for (k = 0, dp = batch.dev_arr; k < num_devs; ++k, ++dp)
+        dp->start_ms = ms;
+    sync_run_items(&batch);
+    if (op->wait && op->immed) {
+        batch.num_items = 0;
+        for (k = 0, dp = batch.dev_arr; k < num_devs; ++k, ++dp) {
+            struct sync_item_t * ip;
+
+            if ((dp->sg_fd < 0) || dp->res)
+                continue;
+            ip = batch.item_arr + batch.num_items++;
+            ip->dev_ind = k;
+            ip->immed = false;
+            ip->lba = dp->lba;
+            /* 0 means "to the last LBA" which covers a too long range */
+            ip->num_lb = (dp->num_lb > UINT_MAX) ? 0 :
+                                                   (unsigned int)dp->num_lb;
+        }
+        sync_run_items(&batch);
+    }
+fini:
+    for (k = 0, dp = batch.dev_arr; dp && (k < num_devs); ++k, ++dp) {
+        if (dp->sg_fd >= 0) {
+            res = sg_cmds_close_device(dp->sg_fd);
+            if ((res < 0) && (0 == dp->res))
+                dp->res = sg_convert_errno(-res);
+            dp->sg_fd = -1;
+        }
+        if (dp->res) {
+            ++num_failed;
+            if (0 == ret)
+                ret = dp->res;
+        } else if (op->verbose) {
+            ms = (dp->end_ms > dp->start_ms) ? dp->end_ms - dp->start_ms : 0;
+            pr2serr("%s: synchronized in %d.%03d seconds\n", dp->dev_name,
+                    (int)(ms / 1000), (int)(ms % 1000));
+        }
+    }
+    if (num_failed && (num_devs > 1))
+        pr2serr("%d of %d DEVICEs failed\n", num_failed, num_devs);
+    free(batch.item_arr);
+    free(batch.dev_arr);
+    return ret;
+}
+
 
 int
 main(int argc, char * argv[])
 {
-    bool do_16 = false;
-    bool immed = false;
-    bool sync_nv = false;
     bool verbose_given = false;
     bool version_given = false;
     int res, c;
     int sg_fd = -1;
-    int group = 0;
+    int num_devs = 0;
     int ret = 0;
-    int tmo_secs = DEF_PT_TIMEOUT;
     int verbose = 0;
-    unsigned int num_lb = 0;
-    int64_t count = 0;
-    int64_t lba = 0;
     const char * device_name = NULL;
+    const char ** dev_names = NULL;
+    struct sync_opts_t opts;
+    struct sync_opts_t * op = &opts;
 
     if (getenv("SG3_UTILS_INVOCATION"))
         sg_rep_invocation(my_name, version_str, argc, argv, stderr);
+    memset(op, 0, sizeof(opts));
+    op->tmo_secs = DEF_PT_TIMEOUT;
+    op->num_parallel = SYNC_DEF_PARALLEL;
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "c:g:hil:sSt:vV", long_options,
+        c = getopt_long(argc, argv, "c:g:hil:n:p:sSt:vVw", long_options,
                         &option_index);
         if (c == -1)
             break;
 
         switch (c) {
         case 'c':
-            count = sg_get_llnum(optarg);
-            if ((count < 0) || (count > UINT_MAX)) {
+            op->count = sg_get_llnum(optarg);
+            if ((op->count < 0) || (op->count > UINT_MAX)) {
                 pr2serr("bad argument to '--count'\n");
                 return SG_LIB_SYNTAX_ERROR;
             }
-            num_lb = (unsigned int)count;
             break;
         case 'g':
-            group = sg_get_num(optarg);
-            if ((group < 0) || (group > 63)) {
+            op->group = sg_get_num(optarg);
+            if ((op->group < 0) || (op->group > 63)) {
                 pr2serr("bad argument to '--group'\n");
                 return SG_LIB_SYNTAX_ERROR;
             }
@@ -206,24 +476,37 @@ main(int argc, char * argv[])
             usage();
             return 0;
         case 'i':
-            immed = true;
+            op->immed = true;
             break;
         case 'l':
-            lba = sg_get_llnum(optarg);
-            if (lba < 0) {
+            op->lba = sg_get_llnum(optarg);
+            if (op->lba < 0) {
                 pr2serr("bad argument to '--lba'\n");
                 return SG_LIB_SYNTAX_ERROR;
             }
             break;
+        case 'n':
+            op->split = sg_get_num(optarg);
+            if ((op->split < 1) || (op->split > SYNC_MAX_SPLIT)) {
+                pr2serr("bad argument to '--split', expect 1 to %d\n",
+                        SYNC_MAX_SPLIT);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case 'p':
+            op->num_parallel = sg_par_get_num(optarg, 1, SYNC_MAX_PARALLEL);
+            if (op->num_parallel < 0)
+                return SG_LIB_SYNTAX_ERROR;
+            break;
         case 's':
-            sync_nv = true;
+            op->sync_nv = true;
             break;
         case 'S':
-            do_16 = true;
+            op->do_16 = true;
             break;
         case 't':
-            tmo_secs = sg_get_num(optarg);
-            if (tmo_secs < 0) {
+            op->tmo_secs = sg_get_num(optarg);
+            if (op->tmo_secs < 0) {
                 pr2serr("bad argument to '--timeout'\n");
                 return SG_LIB_SYNTAX_ERROR;
             }
@@ -235,6 +518,9 @@ main(int argc, char * argv[])
         case 'V':
             version_given = true;
             break;
+        case 'w':
+            op->wait = true;
+            break;
         default:
             pr2serr("unrecognised option code 0x%x ??\n", c);
             usage();
@@ -242,16 +528,9 @@ main(int argc, char * argv[])
         }
     }
     if (optind < argc) {
-        if (NULL == device_name) {
-            device_name = argv[optind];
-            ++optind;
-        }
-        if (optind < argc) {
-            for (; optind < argc; ++optind)
-                pr2serr("Unexpected extra argument: %s\n", argv[optind]);
-            usage();
-            return SG_LIB_SYNTAX_ERROR;
-        }
+        device_name = argv[optind];
+        dev_names = (const char **)(argv + optind);
+        num_devs = argc - optind;
     }
 
 #ifdef DEBUG
@@ -275,11 +554,19 @@ main(int argc, char * argv[])
         return 0;
     }
 
+    op->verbose = verbose;
+
     if (NULL == device_name) {
         pr2serr("Missing device name!\n\n");
         usage();
         return SG_LIB_SYNTAX_ERROR;
     }
+    if (op->wait && (! op->immed))
+        pr2serr("--wait only has an effect together with --immed\n");
+    if ((num_devs > 1) || (op->split > 1)) {
+        ret = sync_multi(op, dev_names, num_devs);
+        goto fini;
+    }
     sg_fd = sg_cmds_open_device(device_name, false /* rw */, verbose);
     if (sg_fd < 0) {
         if (verbose)
@@ -289,12 +576,8 @@ main(int argc, char * argv[])
         goto fini;
     }
 
-    if (do_16)
-        res = sg_ll_sync_cache_16(sg_fd, sync_nv, immed, group, lba, num_lb,
-                                  tmo_secs, true, verbose);
-    else
-        res = sg_ll_sync_cache_10(sg_fd, sync_nv, immed, group,
-                                  (unsigned int)lba, num_lb, true, verbose);
+    res = sync_one(sg_fd, op, op->do_16, op->immed, (uint64_t)op->lba,
+                   (unsigned int)op->count);
     ret = res;
     if (res) {
         char b[80];
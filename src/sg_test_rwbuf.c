@@ -1,7 +1,7 @@
 /*
  * (c) 2000 Kurt Garloff
  * heavily based on Douglas Gilbert's sg_rbuf program.
- * (c) 1999-2023 Douglas Gilbert
+ * (c) 1999-2026 Douglas Gilbert
  *
  * Program to test the SCSI host adapter by issuing
  * write and read operations on a device's buffer
@@ -33,8 +33,12 @@
 #include <string.h>
 #include <errno.h>
 #include <getopt.h>
+#include <pthread.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
 #include <sys/ioctl.h>
 #include <sys/types.h>
+#include <sys/time.h>
 #include <time.h>
 
 #ifdef HAVE_CONFIG_H
@@ -43,11 +47,13 @@
 
 #include "sg_lib.h"
 #include "sg_io_linux.h"
+#include "sg_pt.h"
+#include "sg_hash.h"
 #include "sg_unaligned.h"
 #include "sg_pr2serr.h"
 
 
-static const char * version_str = "1.22 20230519";
+static const char * version_str = "1.23 20261014";
 
 #define BPI (signed)(sizeof(int))
 
@@ -82,6 +88,8 @@ static struct option long_options[] = {
         {"quick", no_argument, 0, 'q'},
         {"addrd", required_argument, 0, 'r'},
         {"size", required_argument, 0, 's'},
+        {"soak", required_argument, 0, 'S'},
+        {"threads", required_argument, 0, 'T'},
         {"times", required_argument, 0, 't'},
         {"verbose", no_argument, 0, 'v'},
         {"version", no_argument, 0, 'V'},
@@ -358,13 +366,428 @@ int write_buffer (int sg_fd, unsigned ssize)
         return res;
 }
 
-void usage ()
+/* Soak mode: each thread owns a slice of the device's buffer (placed with
+ * the BUFFER OFFSET field) and repeatedly writes a pattern to it then reads
+ * it back, checking the CRC32C of what was read against what was written.
+ * The patterns rotate between cycles. All threads run at once until the
+ * given number of seconds has elapsed. */
+
+#define SOAK_MAX_THREADS 16
+#define SOAK_PROGRESS_SECS 10
+#define SOAK_MAX_REPORTS 10     /* miscompares detailed per thread */
+
+static const char * soak_pat_names[] = {
+        "random", "zeros", "ones", "0xaa/0x55", "walking ones", "counting",
+};
+#define SOAK_NUM_PATTERNS \
+        (int)(sizeof(soak_pat_names) / sizeof(soak_pat_names[0]))
+
+struct soak_thr_t {
+        int id;
+        int res;                /* first command error (or -1) */
+        uint32_t offset;        /* of this thread's slice of buffer */
+        uint32_t len;
+        uint64_t cycles;
+        uint64_t miscompares;
+        uint64_t cmd_errs;
+        struct sg_pt_lat_hist wr_lat;
+        struct sg_pt_lat_hist rd_lat;
+};
+
+static int soak_secs = 0;
+static int num_threads = 1;
+static int soak_active = 0;
+static uint64_t soak_deadline_ns;
+static const char * soak_dev_name;
+static pthread_mutex_t soak_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t soak_cv = PTHREAD_COND_INITIALIZER;
+
+
+static void
+lat_add(struct sg_pt_lat_hist * hp, uint64_t lat_ns)
+{
+        if ((0 == hp->count) || (lat_ns < hp->min_ns))
+                hp->min_ns = lat_ns;
+        if (lat_ns > hp->max_ns)
+                hp->max_ns = lat_ns;
+        ++hp->count;
+        hp->sum_ns += lat_ns;
+        ++hp->bucket[sg_pt_lat_bucket_idx(lat_ns)];
+}
+
+static void
+lat_merge(struct sg_pt_lat_hist * dp, const struct sg_pt_lat_hist * sp)
+{
+        int k;
+
+        if (0 == sp->count)
+                return;
+        if ((0 == dp->count) || (sp->min_ns < dp->min_ns))
+                dp->min_ns = sp->min_ns;
+        if (sp->max_ns > dp->max_ns)
+                dp->max_ns = sp->max_ns;
+        dp->count += sp->count;
+        dp->sum_ns += sp->sum_ns;
+        for (k = 0; k < SG_PT_LAT_NUM_BUCKETS; ++k)
+                dp->bucket[k] += sp->bucket[k];
+}
+
+static void
+lat_report(const struct sg_pt_lat_hist * hp, const char * leadin)
+{
+        if (0 == hp->count)
+                return;
+        printf("%s latency min/avg/max: %.1f/%.1f/%.1f us, p50/p99/p99.9: "
+               "%.1f/%.1f/%.1f us\n", leadin, hp->min_ns / 1000.0,
+               ((double)hp->sum_ns / hp->count) / 1000.0,
+               hp->max_ns / 1000.0, sg_pt_lat_percentile(hp, 50.0) / 1000.0,
+               sg_pt_lat_percentile(hp, 99.0) / 1000.0,
+               sg_pt_lat_percentile(hp, 99.9) / 1000.0);
+}
+
+static void
+soak_fill(uint8_t * bp, uint32_t len, int pat, uint64_t * seedp)
+{
+        uint32_t k;
+        uint64_t x;
+
+        switch (pat) {
+        case 0:
+                for (k = 0, x = *seedp; k < len; ++k) {
+                        if (0 == (k & 7)) {
+                                x ^= x << 13;
+                                x ^= x >> 7;
+                                x ^= x << 17;
+                        }
+                        bp[k] = (uint8_t)(x >> (8 * (k & 7)));
+                }
+                *seedp = x;
+                break;
+        case 1:
+                memset(bp, 0, len);
+                break;
+        case 2:
+                memset(bp, 0xff, len);
+                break;
+        case 3:
+                for (k = 0; k < len; ++k)
+                        bp[k] = (k & 1) ? 0x55 : 0xaa;
+                break;
+        case 4:
+                for (k = 0; k < len; ++k)
+                        bp[k] = (uint8_t)(1 << (k & 7));
+                break;
+        default:
+                for (k = 0; k < len; ++k)
+                        bp[k] = (uint8_t)k;
+                break;
+        }
+}
+
+/* Sends a WRITE or READ BUFFER (data mode, buffer id 0) of len bytes at
+ * offset. Returns 0 if good, SG_LIB_CAT_* value or -1 if the ioctl
+ * failed. */
+static int
+soak_cmd(int sg_fd, bool is_wr, uint8_t * bp, uint32_t offset,
+         uint32_t len, int id)
+{
+        int res;
+        uint8_t cdb[10];
+        uint8_t sense_buffer[32];
+        struct sg_io_hdr io_hdr;
+        char b[80];
+
+        memset(cdb, 0, sizeof(cdb));
+        cdb[0] = is_wr ? WRITE_BUFFER : READ_BUFFER;
+        cdb[1] = RWB_MODE_DATA;
+        sg_put_unaligned_be24(offset, cdb + 3);
+        sg_put_unaligned_be24(len, cdb + 6);
+        memset(&io_hdr, 0, sizeof(struct sg_io_hdr));
+        io_hdr.interface_id = 'S';
+        io_hdr.cmd_len = sizeof(cdb);
+        io_hdr.mx_sb_len = sizeof(sense_buffer);
+        io_hdr.dxfer_direction = is_wr ? SG_DXFER_TO_DEV : SG_DXFER_FROM_DEV;
+        io_hdr.dxfer_len = len;
+        io_hdr.dxferp = bp;
+        io_hdr.cmdp = cdb;
+        io_hdr.sbp = sense_buffer;
+        io_hdr.pack_id = id;
+        io_hdr.timeout = 60000;     /* 60000 millisecs == 60 seconds */
+        if (verbose > 1)
+                pr2serr("    [%d] %s buffer cdb: %s\n", id,
+                        is_wr ? "write" : "read",
+                        sg_get_command_str(cdb, (int)sizeof(cdb), false,
+                                           sizeof(b), b));
+        if (ioctl(sg_fd, SG_IO, &io_hdr) < 0) {
+                perror(is_wr ? ME "SG_IO WRITE BUFFER data error" :
+                               ME "SG_IO READ BUFFER data error");
+                return -1;
+        }
+        res = sg_err_category3(&io_hdr);
+        switch (res) {
+        case SG_LIB_CAT_CLEAN:
+                return 0;
+        case SG_LIB_CAT_RECOVERED:
+                if (verbose)
+                        sg_chk_n_print3(is_wr ? "WRITE BUFFER, continuing" :
+                                        "READ BUFFER, continuing", &io_hdr,
+                                        verbose > 1);
+                return 0;
+        default:
+                snprintf(b, sizeof(b), "[%d] %s BUFFER data error", id,
+                         is_wr ? "WRITE" : "READ");
+                sg_chk_n_print3(b, &io_hdr, verbose > 1);
+                return res;
+        }
+}
+
+static uint32_t
+soak_crc(const uint8_t * bp, uint32_t len)
+{
+        struct sg_hash_ctx hc;
+        uint8_t d[SG_HASH_MAX_DIGEST_LEN];
+
+        sg_hash_init(&hc, SG_HASH_CRC32C);
+        sg_hash_update(&hc, bp, len);
+        sg_hash_final(&hc, d);
+        return sg_get_unaligned_be32(d);
+}
+
+static void *
+soak_worker(void * v_tp)
+{
+        struct soak_thr_t * tp = (struct soak_thr_t *)v_tp;
+        int k, pat, res, err;
+        int sg_fd;
+        uint32_t crc_w, crc_r, diff;
+        uint64_t t0, t1;
+        uint64_t seed = 0x9e3779b97f4a7c15ULL * (uint64_t)(tp->id + 1);
+        uint8_t * wbp;
+        uint8_t * rbp;
+        uint8_t * free_wbp = NULL;
+        uint8_t * free_rbp = NULL;
+        struct sg_pt_lat_hist wr_lat, rd_lat;
+
+        memset(&wr_lat, 0, sizeof(wr_lat));
+        memset(&rd_lat, 0, sizeof(rd_lat));
+        sg_fd = open(soak_dev_name, O_RDWR | O_NONBLOCK);
+        if (sg_fd < 0) {
+                err = errno;
+                pr2serr(ME "[%d] open error: %s\n", tp->id,
+                        safe_strerror(err));
+                tp->res = sg_convert_errno(err);
+                goto fini;
+        }
+        wbp = sg_memalign(tp->len, 0, &free_wbp, false);
+        rbp = sg_memalign(tp->len, 0, &free_rbp, false);
+        if ((NULL == wbp) || (NULL == rbp)) {
+                pr2serr(ME "[%d] out of memory\n", tp->id);
+                tp->res = sg_convert_errno(ENOMEM);
+                goto fini;
+        }
+        for (k = 0; sg_get_mono_ns() < soak_deadline_ns; ++k) {
+                pat = (k + tp->id) % SOAK_NUM_PATTERNS;
+                soak_fill(wbp, tp->len, pat, &seed);
+                crc_w = soak_crc(wbp, tp->len);
+                t0 = sg_get_mono_ns();
+                res = soak_cmd(sg_fd, true, wbp, tp->offset, tp->len, tp->id);
+                t1 = sg_get_mono_ns();
+                if (0 == res) {
+                        lat_add(&wr_lat, t1 - t0);
+                        /* so stale data is not mistaken for a good read */
+                        memset(rbp, ~wbp[0], tp->len);
+                        t0 = sg_get_mono_ns();
+                        res = soak_cmd(sg_fd, false, rbp, tp->offset,
+                                       tp->len, tp->id);
+                        t1 = sg_get_mono_ns();
+                }
+                pthread_mutex_lock(&soak_mtx);
+                if (res) {
+                        ++tp->cmd_errs;
+                        if (0 == tp->res)
+                                tp->res = res;
+                } else {
+                        lat_add(&rd_lat, t1 - t0);
+                        ++tp->cycles;
+                }
+                pthread_mutex_unlock(&soak_mtx);
+                if (res < 0)
+                        break;  /* ioctl failed, give up on this thread */
+                if (res)
+                        continue;
+                crc_r = soak_crc(rbp, tp->len);
+                if (crc_r == crc_w)
+                        continue;
+                diff = mymemcmp(wbp, rbp, tp->len);
+                pthread_mutex_lock(&soak_mtx);
+                if (++tp->miscompares > SOAK_MAX_REPORTS) {
+                        pthread_mutex_unlock(&soak_mtx);
+                        continue;
+                }
+                printf("[%d] cycle %d, pattern %s: CRC32C wrote 0x%08x, "
+                       "read 0x%08x; first difference at buffer offset %u: "
+                       "wrote 0x%02x, read 0x%02x\n", tp->id, k,
+                       soak_pat_names[pat], crc_w, crc_r, tp->offset + diff,
+                       wbp[diff], rbp[diff]);
+                if (SOAK_MAX_REPORTS == tp->miscompares)
+                        printf("[%d] further miscompares only counted\n",
+                               tp->id);
+                pthread_mutex_unlock(&soak_mtx);
+        }
+fini:
+        if (free_wbp)
+                free(free_wbp);
+        if (free_rbp)
+                free(free_rbp);
+        if (sg_fd >= 0)
+                close(sg_fd);
+        pthread_mutex_lock(&soak_mtx);
+        tp->wr_lat = wr_lat;
+        tp->rd_lat = rd_lat;
+        --soak_active;
+        pthread_cond_signal(&soak_cv);
+        pthread_mutex_unlock(&soak_mtx);
+        return NULL;
+}
+
+static void
+soak_totals(const struct soak_thr_t * thr_arr, int num, uint64_t * cyclesp,
+            uint64_t * miscmpp, uint64_t * errsp)
+{
+        int k;
+
+        *cyclesp = 0;
+        *miscmpp = 0;
+        *errsp = 0;
+        for (k = 0; k < num; ++k) {
+                *cyclesp += thr_arr[k].cycles;
+                *miscmpp += thr_arr[k].miscompares;
+                *errsp += thr_arr[k].cmd_errs;
+        }
+}
+
+/* Runs the soak test on 'soak_sz' bytes of the device's buffer, split between
+ * num_threads threads. Returns 0 if all cycles were good. */
+static int
+do_soak(int soak_sz)
+{
+        int k, n, err;
+        int ret = 0;
+        uint32_t align, slice;
+        uint64_t start_ns, elapsed_ns, cycles, miscmps, errs, bytes;
+        uint64_t prev_bytes = 0;
+        uint64_t prev_ns;
+        double secs;
+        struct timeval now_tv;
+        struct timespec wait_ts;
+        struct sg_hash_ctx hc;
+        struct sg_pt_lat_hist wr_lat, rd_lat;
+        struct soak_thr_t thr_arr[SOAK_MAX_THREADS];
+        pthread_t tid_arr[SOAK_MAX_THREADS];
+
+        if (num_threads > 1) {
+                if (0xff == buf_granul) {
+                        pr2serr(ME "device only accepts a buffer offset of "
+                                "0, so --threads=1 is needed\n");
+                        return SG_LIB_CAT_OTHER;
+                }
+                align = 1U << buf_granul;
+                slice = ((uint32_t)soak_sz / num_threads) & ~(align - 1);
+        } else
+                slice = soak_sz;
+        if (slice < 8) {
+                pr2serr(ME "each of %d slices of the %d byte buffer would "
+                        "be less than 8 bytes\n", num_threads, soak_sz);
+                return SG_LIB_CAT_OTHER;
+        }
+        memset(thr_arr, 0, sizeof(thr_arr));
+        memset(&wr_lat, 0, sizeof(wr_lat));
+        memset(&rd_lat, 0, sizeof(rd_lat));
+        sg_hash_init(&hc, SG_HASH_CRC32C);  /* builds table before threads */
+        printf("Soak test for %d seconds with %d thread%s each writing then "
+               "reading %u bytes\n", soak_secs, num_threads,
+               (num_threads > 1) ? "s" : "", slice);
+        fflush(stdout);
+        start_ns = sg_get_mono_ns();
+        prev_ns = start_ns;
+        soak_deadline_ns = start_ns + ((uint64_t)soak_secs * 1000000000);
+        for (k = 0; k < num_threads; ++k) {
+                thr_arr[k].id = k;
+                thr_arr[k].offset = k * slice;
+                thr_arr[k].len = slice;
+                pthread_mutex_lock(&soak_mtx);
+                ++soak_active;
+                pthread_mutex_unlock(&soak_mtx);
+                err = pthread_create(tid_arr + k, NULL, soak_worker,
+                                     thr_arr + k);
+                if (err) {
+                        pr2serr(ME "pthread_create: %s\n",
+                                safe_strerror(err));
+                        pthread_mutex_lock(&soak_mtx);
+                        --soak_active;
+                        pthread_mutex_unlock(&soak_mtx);
+                        ret = sg_convert_errno(err);
+                        break;
+                }
+        }
+        n = k;
+        pthread_mutex_lock(&soak_mtx);
+        gettimeofday(&now_tv, NULL);
+        wait_ts.tv_sec = now_tv.tv_sec + SOAK_PROGRESS_SECS;
+        wait_ts.tv_nsec = now_tv.tv_usec * 1000;
+        while (soak_active > 0) {
+                if (ETIMEDOUT != pthread_cond_timedwait(&soak_cv, &soak_mtx,
+                                                        &wait_ts))
+                        continue;
+                wait_ts.tv_sec += SOAK_PROGRESS_SECS;
+                soak_totals(thr_arr, n, &cycles, &miscmps, &errs);
+                bytes = cycles * slice;
+                elapsed_ns = sg_get_mono_ns();
+                secs = (double)(elapsed_ns - prev_ns) / 1000000000.0;
+                pr2serr("  %5.0f s: %" PRIu64 " cycles, %.2f MB/sec each "
+                        "way, %" PRIu64 " miscompares, %" PRIu64 " command "
+                        "errors\n", (elapsed_ns - start_ns) / 1000000000.0,
+                        cycles, (secs > 0.0) ?
+                        ((bytes - prev_bytes) / (secs * 1000000.0)) : 0.0,
+                        miscmps, errs);
+                prev_bytes = bytes;
+                prev_ns = elapsed_ns;
+        }
+        pthread_mutex_unlock(&soak_mtx);
+        for (k = 0; k < n; ++k)
+                pthread_join(tid_arr[k], NULL);
+        elapsed_ns = sg_get_mono_ns() - start_ns;
+        secs = (double)elapsed_ns / 1000000000.0;
+        soak_totals(thr_arr, n, &cycles, &miscmps, &errs);
+        for (k = 0; k < n; ++k) {
+                lat_merge(&wr_lat, &thr_arr[k].wr_lat);
+                lat_merge(&rd_lat, &thr_arr[k].rd_lat);
+                if (thr_arr[k].res && (0 == ret))
+                        ret = thr_arr[k].res;
+        }
+        bytes = cycles * slice;
+        printf("%" PRIu64 " write/read cycles in %.2f secs, %.2f MB written "
+               "and read", cycles, secs, bytes / 1000000.0);
+        if (secs > 0.0)
+                printf(", %.2f MB/sec each way", bytes / (secs * 1000000.0));
+        printf("\n");
+        lat_report(&wr_lat, "WRITE BUFFER");
+        lat_report(&rd_lat, "READ BUFFER");
+        printf("%" PRIu64 " miscompares, %" PRIu64 " command errors\n",
+               miscmps, errs);
+        if (miscmps)
+                return SG_LIB_CAT_MALFORMED;
+        return (ret >= 0) ? ret : SG_LIB_CAT_OTHER;
+}
+
+static void
+usage()
 {
         printf ("Usage: sg_test_rwbuf [--addrd=AR] [--addwr=AW] [--help] "
                 "[--quick]\n");
-        printf ("                     --size=SZ [--times=NUM] [--verbose] "
-                "[--version]\n"
-                "                     DEVICE\n"
+        printf ("                     --size=SZ [--soak=SECS] "
+                "[--threads=THR] [--times=NUM]\n"
+                "                     [--verbose] [--version] DEVICE\n"
                 " or\n"
                 "       sg_test_rwbuf DEVICE SZ [AW] [AR]\n");
         printf ("  where:\n"
@@ -375,6 +798,13 @@ void usage ()
                 "    --quick|-q       output read buffer size then exit\n"
                 "    --size=SZ|-s     size of buffer (in bytes) to write "
                 "then read back\n"
+                "    --soak=SECS|-S   write then read back rotating "
+                "patterns for SECS\n"
+                "                     seconds, checking CRC32C (SZ "
+                "default: whole buffer)\n"
+                "    --threads=THR|-T    with --soak: THR threads each on "
+                "its own slice\n"
+                "                        of the buffer (def: 1, max: 16)\n"
                 "    --times=NUM|-t   number of times to run test "
                 "(default 1)\n"
                 "    --verbose|-v     increase verbosity of output\n"
@@ -405,7 +835,7 @@ int main (int argc, char * argv[])
                 int option_index = 0;
                 int c;
 
-                c = getopt_long(argc, argv, "hqr:s:t:w:vV",
+                c = getopt_long(argc, argv, "hqr:s:S:t:T:w:vV",
                                 long_options, &option_index);
                 if (c == -1)
                         break;
@@ -431,6 +861,23 @@ int main (int argc, char * argv[])
                                 return SG_LIB_SYNTAX_ERROR;
                         }
                         break;
+                case 'S':
+                        soak_secs = sg_get_num(optarg);
+                        if (soak_secs < 1) {
+                                pr2serr("bad argument to '--soak', expect 1 "
+                                        "or more\n");
+                                return SG_LIB_SYNTAX_ERROR;
+                        }
+                        break;
+                case 'T':
+                        num_threads = sg_get_num(optarg);
+                        if ((num_threads < 1) ||
+                            (num_threads > SOAK_MAX_THREADS)) {
+                                pr2serr("bad argument to '--threads', expect "
+                                        "1 to %d\n", SOAK_MAX_THREADS);
+                                return SG_LIB_SYNTAX_ERROR;
+                        }
+                        break;
                 case 't':
                         times = sg_get_num(optarg);
                         if (-1 == times) {
@@ -525,7 +972,17 @@ int main (int argc, char * argv[])
                 usage();
                 return SG_LIB_SYNTAX_ERROR;
         }
-        if ((size <= 0) && (! do_quick)) {
+        if (soak_secs > 0) {
+                if (do_quick || addread || addwrite || (times > 1)) {
+                        pr2serr("--soak cannot be used with --quick, "
+                                "--addrd, --addwr or --times\n");
+                        return SG_LIB_CONTRADICT;
+                }
+        } else if (num_threads > 1) {
+                pr2serr("--threads needs --soak\n");
+                return SG_LIB_CONTRADICT;
+        }
+        if ((size <= 0) && (! do_quick) && (0 == soak_secs)) {
                 pr2serr("must give '--size' or '--quick' options or <sz> "
                         "argument\n");
                 usage();
@@ -552,6 +1009,11 @@ int main (int argc, char * argv[])
                 ret = SG_LIB_CAT_OTHER;
                 goto err_out;
         }
+        if (soak_secs > 0) {
+                soak_dev_name = device_name;
+                ret = do_soak((size > 0) ? size : buf_capacity);
+                goto err_out;
+        }
 
         cmpbuf = (uint8_t *)sg_memalign(size, 0, &free_cmpbuf, false);
         for (k = 0; k < times; ++k) {
@@ -578,7 +1040,7 @@ err_out:
         }
         if ((0 == ret) && (! do_quick))
                 printf ("Success\n");
-        else if (times > 1)
+        else if ((times > 1) && (0 == soak_secs))
                 printf ("Failed after %d successful cycles\n", k);
         return (ret >= 0) ? ret : SG_LIB_CAT_OTHER;
 }
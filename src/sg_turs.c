@@ -1,5 +1,5 @@
 /*
- * Copyright (C) 2000-2023 D. Gilbert
+ * Copyright (C) 2000-2026 D. Gilbert
  * This program is free software; you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
  * the Free Software Foundation; either version 2, or (at your option)
@@ -13,6 +13,8 @@
  * commands to the given sg device. Since TUR is a simple command involing
  * no data transfer (and no REQUEST SENSE command iff the unit is ready)
  * then this can be used for timing per SCSI command overheads.
+ * When several DEVICEs are given (or a glob pattern), they are probed
+ * concurrently with a bounded number of commands in flight.
  */
 
 #include <unistd.h>
@@ -25,6 +27,7 @@
 #include <time.h>
 #include <errno.h>
 #include <getopt.h>
+#include <limits.h>
 #define __STDC_FORMAT_MACROS 1
 #include <inttypes.h>
 
@@ -39,32 +42,46 @@
 #include <sys/time.h>
 #endif
 
+#ifndef SG_LIB_WIN32
+#include <glob.h>
+#endif
+
 #include "sg_lib.h"
 #include "sg_cmds_basic.h"
 #include "sg_pt.h"
+#include "sg_mux.h"
+#include "sg_json_sg_lib.h"
+#include "sg_par.h"
 #include "sg_pr2serr.h"
 
 
-static const char * version_str = "3.55 20230502";
+static const char * version_str = "3.58 20261015";
 
 static const char * my_name = "sg_turs: ";
 
 static const char * tur_s = "Test unit ready";
 
 #define DEF_PT_TIMEOUT  60       /* 60 seconds */
+#define DEF_PARALLEL 32         /* commands in flight with several DEVICEs */
+#define MAX_PARALLEL 4096
+#define MAX_SLOWEST 64
+#define DEF_SLOWEST 8           /* when --time is given twice */
 
 
 static struct option long_options[] = {
         {"ascq", required_argument, 0, 'a'},
         {"delay", required_argument, 0, 'd'},
         {"help", no_argument, 0, 'h'},
+        {"json", optional_argument, 0, '^'},    /* short option is '-j' */
         {"low", no_argument, 0, 'l'},   /* use sg_pt, minimize open()s */
         {"new", no_argument, 0, 'N'},
         {"number", required_argument, 0, 'n'},
         {"num", required_argument, 0, 'n'}, /* added in v3.32 (sg3_utils
                                 * v1.43) for sg_requests compatibility */
         {"old", no_argument, 0, 'O'},
+        {"parallel", required_argument, 0, 'P'},
         {"progress", no_argument, 0, 'p'},
+        {"slowest", required_argument, 0, 'S'},
         {"time", no_argument, 0, 't'},
         {"timeout", required_argument, 0, 'T'},
         {"tmo", required_argument, 0, 'T'},
@@ -75,9 +92,9 @@ static struct option long_options[] = {
 
 struct opts_t {
     bool delay_given;
+    bool do_json;
     bool do_low;
     bool do_progress;
-    bool do_time;
     bool opts_new;
     bool verbose_given;
     bool version_given;
@@ -86,15 +103,66 @@ struct opts_t {
     int delay;
     int do_help;
     int do_number;
+    int do_time;
+    int num_slowest;    /* 0 if neither --slowest= nor -tt given */
+    int num_devs;       /* number of DEVICE names after glob expansion */
+    int num_parallel;   /* 0 if --parallel= not given */
     int tmo;
     int verbose;
-    const char * device_name;
+    const char * device_name;   /* first DEVICE name (before expansion) */
+    const char * json_arg;      /* carries [JO] from --json[=JO] */
+    uint64_t start_ns;          /* when several DEVICEs are probed */
+    const char ** dev_arr;      /* DEVICE names, num_devs of them */
+    int num_dev_args;
+    char ** dev_args;           /* DEVICE arguments as given */
+    sgj_state json_st;
+#ifndef SG_LIB_WIN32
+    glob_t dev_glob;
+#endif
+};
+
+/* Fixed size record of command latencies: a histogram (in the format of
+ * the sg_pt_lat_*() functions) plus the slowest commands, kept in
+ * descending order of latency. */
+struct tur_slow_t {
+    int64_t idx;        /* command number, origin 0 */
+    uint64_t at_ns;     /* when sent, relative to the first command */
+    uint64_t lat_ns;
+};
+
+struct tur_lat_t {
+    struct sg_pt_lat_hist h;
+    int num_slow;
+    struct tur_slow_t slow[MAX_SLOWEST];
 };
 
 struct loop_res_t {
     bool reported;
     int num_errs;
     int ret;
+    uint64_t start_ns;
+    struct tur_lat_t * latp;    /* NULL unless --time given */
+};
+
+/* One per DEVICE when several are probed concurrently. Each DEVICE has at
+ * most one TUR in flight; --parallel=P bounds the total. */
+struct tur_dev_t {
+    bool in_flight;
+    bool done;
+    bool sync_only;     /* read-only or no mux: command completes on submit */
+    int fd;
+    int num_done;
+    int num_errs;
+    int ret;            /* of the last TUR, or of the failed open */
+    uint64_t start_ns;
+    uint64_t next_ns;   /* when --delay=MS is given */
+    const char * name;
+    struct sg_pt_base * ptvp;
+    const struct opts_t * op;
+    struct sg_mux_cmd mc;
+    uint8_t cdb[6];     /* TUR's cdb is 6 zeros */
+    uint8_t sense_b[64];
+    struct tur_lat_t lat;
 };
 
 
@@ -102,11 +170,12 @@ static void
 usage()
 {
     printf("Usage: sg_turs [--ascq=ASC[,ASQ]] [--delay=MS] [--help] "
-           "[--low]\n"
-           "               [--number=NUM] [--num=NUM] [--progress] "
-           "[--time]\n"
-           "               [--timeout=SE] [--verbose] [--version] "
-	   "DEVICE\n"
+           "[--json[=JO]]\n"
+           "               [--low] [--number=NUM] [--num=NUM] "
+           "[--parallel=P]\n"
+           "               [--progress] [--time] [--timeout=SE] "
+           "[--verbose]\n"
+           "               [--version] DEVICE [DEVICE...]\n"
            "  where:\n"
            "    --ascq=ASC[,ASQ] |    check sense from TUR for match on "
            "ASC[,ASQ]\n"
@@ -114,18 +183,29 @@ usage()
            "    --delay=MS|-d MS    delay MS miiliseconds before sending "
            "each tur\n"
            "    --help|-h        print usage message then exit\n"
+           "    --json[=JO]|-j[=JO]    output in JSON instead of plain "
+           "text\n"
+           "                           Use --json=? for JSON help\n"
            "    --low|-l         use low level (sg_pt) interface for "
            "speed\n"
            "    --number=NUM|-n NUM    number of test_unit_ready commands "
            "(def: 1)\n"
            "    --num=NUM|-n NUM       same action as '--number=NUM'\n"
            "    --old|-O         use old interface (use as first option)\n"
+           "    --parallel=P|-P P    maximum number of TURs in flight when "
+           "probing\n"
+           "                         several DEVICEs (def: %d)\n"
            "    --progress|-p    outputs progress indication (percentage) "
            "if available\n"
            "                     waits 30 seconds before TUR unless "
            "--delay=MS given\n"
-           "    --time|-t        outputs total duration and commands per "
-           "second\n"
+           "    --slowest=N|-S N    with --time also list the N slowest "
+           "commands\n"
+           "                        (def: %d when --time given twice)\n"
+           "    --time|-t        outputs total duration, commands per "
+           "second and\n"
+           "                     latency percentiles; twice: also the "
+           "histogram\n"
            "    --timeout SE |-T SE    command timeout on each "
            "test_unit_ready command\n"
 	   "                           (def: 0 which is mapped to 60 "
@@ -133,7 +213,10 @@ usage()
            "    --verbose|-v     increase verbosity\n"
            "    --version|-V     print version string then exit\n\n"
            "Performs a SCSI TEST UNIT READY command (or many of them).\n"
-           "This SCSI command is often known by its abbreviation: TUR .\n");
+           "This SCSI command is often known by its abbreviation: TUR . "
+           "When more than\none DEVICE is given (a DEVICE may be a glob "
+           "pattern such as '/dev/sg*')\nthey are probed concurrently and "
+           "latency min/avg/max is shown for each.\n", DEF_PARALLEL, DEF_SLOWEST);
 }
 
 static void
@@ -174,7 +257,7 @@ new_parse_cmd_line(struct opts_t * op, int argc, char * argv[])
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "a:d:hln:NOptT:vV", long_options,
+        c = getopt_long(argc, argv, "a:d:hj::ln:NOpP:S:tT:vV", long_options,
                         &option_index);
         if (c == -1)
             break;
@@ -216,6 +299,15 @@ new_parse_cmd_line(struct opts_t * op, int argc, char * argv[])
         case '?':
             ++op->do_help;
             break;
+        case 'j':       /* for: -j[=JO] */
+        case '^':       /* for: --json[=JO] */
+            op->do_json = true;
+            if (optarg)
+                op->json_arg = (('j' == c) && ('=' == *optarg)) ?
+                               optarg + 1 : optarg;
+            else
+                op->json_arg = NULL;
+            break;
         case 'l':
             op->do_low = true;
             break;
@@ -236,8 +328,23 @@ new_parse_cmd_line(struct opts_t * op, int argc, char * argv[])
         case 'p':
             op->do_progress = true;
             break;
+        case 'P':
+            n = sg_par_get_num(optarg, 1, MAX_PARALLEL);
+            if (n < 0)
+                return SG_LIB_SYNTAX_ERROR;
+            op->num_parallel = n;
+            break;
+        case 'S':
+            n = sg_get_num(optarg);
+            if ((n < 1) || (n > MAX_SLOWEST)) {
+                pr2serr("bad argument to '--slowest=', expect 1 to %d\n",
+                        MAX_SLOWEST);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            op->num_slowest = n;
+            break;
         case 't':
-            op->do_time = true;
+            ++op->do_time;
             break;
         case 'T':
             n = sg_get_num(optarg);
@@ -264,16 +371,10 @@ new_parse_cmd_line(struct opts_t * op, int argc, char * argv[])
         }
     }
     if (optind < argc) {
-        if (NULL == op->device_name) {
+        if (NULL == op->device_name)
             op->device_name = argv[optind];
-            ++optind;
-        }
-        if (optind < argc) {
-            for (; optind < argc; ++optind)
-                pr2serr("Unexpected extra argument: %s\n", argv[optind]);
-            usage();
-            return SG_LIB_SYNTAX_ERROR;
-        }
+        op->dev_args = argv + optind;
+        op->num_dev_args = argc - optind;
     }
     return 0;
 }
@@ -305,7 +406,7 @@ old_parse_cmd_line(struct opts_t * op, int argc, char * argv[])
                     op->do_progress = true;
                     break;
                 case 't':
-                    op->do_time = true;
+                    ++op->do_time;
                     break;
                 case 'v':
                     op->verbose_given = true;
@@ -348,9 +449,11 @@ old_parse_cmd_line(struct opts_t * op, int argc, char * argv[])
                 usage_old();
                 return SG_LIB_SYNTAX_ERROR;
             }
-        } else if (0 == op->device_name)
+        } else if (0 == op->device_name) {
             op->device_name = cp;
-        else {
+            op->dev_args = argv + k;
+            op->num_dev_args = 1;
+        } else {
             pr2serr("too many arguments, got: %s, not expecting: %s\n",
                     op->device_name, cp);
             usage_old();
@@ -422,6 +525,137 @@ wait_millisecs(int millisecs)
 }
 #endif
 
+/* Expands any glob patterns among the DEVICE arguments into op->dev_arr.
+ * Arguments that match nothing are kept as given so that opening them
+ * reports the error. Returns 0 on success. */
+static int
+expand_devices(struct opts_t * op)
+{
+    int k;
+
+#ifndef SG_LIB_WIN32
+    for (k = 0; k < op->num_dev_args; ++k) {
+        int res = glob(op->dev_args[k], GLOB_NOCHECK | (k ? GLOB_APPEND : 0),
+                       NULL, &op->dev_glob);
+
+        if (res) {
+            pr2serr("%s: glob() failed on %s\n", __func__, op->dev_args[k]);
+            return (GLOB_NOSPACE == res) ? sg_convert_errno(ENOMEM) :
+                                           SG_LIB_SYNTAX_ERROR;
+        }
+    }
+    if (op->num_dev_args > 0) {
+        if (op->dev_glob.gl_pathc > INT_MAX) {
+            pr2serr("%s: too many DEVICEs\n", __func__);
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        op->num_devs = (int)op->dev_glob.gl_pathc;
+        op->dev_arr = (const char **)op->dev_glob.gl_pathv;
+    }
+#else
+    k = 0;
+    op->num_devs = op->num_dev_args;
+    op->dev_arr = (const char **)op->dev_args;
+#endif
+    return 0;
+}
+
+/* Adds the latency of command number 'idx', sent 'at_ns' after the first
+ * one, to *lp keeping (up to) 'max_slow' of the slowest. */
+static void
+tur_lat_add(struct tur_lat_t * lp, uint64_t lat_ns, uint64_t at_ns,
+            int64_t idx, int max_slow)
+{
+    int k, n;
+    struct sg_pt_lat_hist * hp = &lp->h;
+
+    if ((0 == hp->count) || (lat_ns < hp->min_ns))
+        hp->min_ns = lat_ns;
+    if (lat_ns > hp->max_ns)
+        hp->max_ns = lat_ns;
+    ++hp->count;
+    hp->sum_ns += lat_ns;
+    ++hp->bucket[sg_pt_lat_bucket_idx(lat_ns)];
+    if (max_slow < 1)
+        return;
+    n = lp->num_slow;
+    if (n >= max_slow) {
+        if (lat_ns <= lp->slow[max_slow - 1].lat_ns)
+            return;
+        n = max_slow - 1;       /* drop the fastest of the slowest */
+    }
+    for (k = n; (k > 0) && (lp->slow[k - 1].lat_ns < lat_ns); --k)
+        lp->slow[k] = lp->slow[k - 1];
+    lp->slow[k].idx = idx;
+    lp->slow[k].at_ns = at_ns;
+    lp->slow[k].lat_ns = lat_ns;
+    lp->num_slow = n + 1;
+}
+
+/* Outputs latency percentiles from *lp, then the histogram when --time is
+ * given twice and the slowest commands if any were kept. Plain text lines
+ * start with 'leadin'; in JSON mode name:value pairs are added to jop. */
+static void
+tur_lat_report(const struct tur_lat_t * lp, const char * leadin,
+               struct opts_t * op, sgj_opaque_p jop)
+{
+    int k;
+    uint64_t cnt, lo;
+    const struct sg_pt_lat_hist * hp = &lp->h;
+    sgj_state * jsp = &op->json_st;
+    sgj_opaque_p jap, jo2p;
+
+    cnt = hp->count;
+    if (0 == cnt)
+        return;
+    sgj_pr_hr(jsp, "%slatency p50/p90/p99/p99.9: %.1f/%.1f/%.1f/%.1f us\n",
+              leadin, sg_pt_lat_percentile(hp, 50.0) / 1000.0,
+              sg_pt_lat_percentile(hp, 90.0) / 1000.0,
+              sg_pt_lat_percentile(hp, 99.0) / 1000.0,
+              sg_pt_lat_percentile(hp, 99.9) / 1000.0);
+    sgj_js_nv_i(jsp, jop, "latency_p50_ns", sg_pt_lat_percentile(hp, 50.0));
+    sgj_js_nv_i(jsp, jop, "latency_p90_ns", sg_pt_lat_percentile(hp, 90.0));
+    sgj_js_nv_i(jsp, jop, "latency_p99_ns", sg_pt_lat_percentile(hp, 99.0));
+    sgj_js_nv_i(jsp, jop, "latency_p99_9_ns",
+                sg_pt_lat_percentile(hp, 99.9));
+    if (op->do_time > 1) {
+        if (jsp->pr_as_json)
+            sgj_js_pt_lat(jsp, jop, hp, 1);
+        for (k = 0; k < SG_PT_LAT_NUM_BUCKETS; ++k) {
+            if (0 == hp->bucket[k])
+                continue;
+            lo = sg_pt_lat_bucket_ns(k);
+            if (k < (SG_PT_LAT_NUM_BUCKETS - 1))
+                sgj_pr_hr(jsp, "%s  %10.1f to %10.1f us: %10" PRIu64
+                          " (%5.2f%%)\n", leadin, lo / 1000.0,
+                          sg_pt_lat_bucket_ns(k + 1) / 1000.0,
+                          hp->bucket[k], (100.0 * hp->bucket[k]) / cnt);
+            else
+                sgj_pr_hr(jsp, "%s  %10.1f us or more   : %10" PRIu64
+                          " (%5.2f%%)\n", leadin, lo / 1000.0,
+                          hp->bucket[k], (100.0 * hp->bucket[k]) / cnt);
+        }
+    }
+    if (lp->num_slow < 1)
+        return;
+    sgj_pr_hr(jsp, "%sslowest %d commands:\n", leadin, lp->num_slow);
+    jap = sgj_named_subarray_r(jsp, jop, "slowest_command_list");
+    for (k = 0; k < lp->num_slow; ++k) {
+        const struct tur_slow_t * sp = lp->slow + k;
+
+        sgj_pr_hr(jsp, "%s  #%" PRId64 " sent at +%.3f ms took %.1f us\n",
+                  leadin, sp->idx, sp->at_ns / 1000000.0,
+                  sp->lat_ns / 1000.0);
+        if (jsp->pr_as_json) {
+            jo2p = sgj_new_unattached_object_r(jsp);
+            sgj_js_nv_i(jsp, jo2p, "command_index", sp->idx);
+            sgj_js_nv_i(jsp, jo2p, "start_offset_ns", sp->at_ns);
+            sgj_js_nv_i(jsp, jo2p, "latency_ns", sp->lat_ns);
+            sgj_js_nv_o(jsp, jap, NULL /* name */, jo2p);
+        }
+    }
+}
+
 /* Invokes a SCSI TEST UNIT READY command.
  * N.B. To access the sense buffer outside this routine then one be
  * provided by the caller.
@@ -506,6 +740,7 @@ loop_turs(struct sg_pt_base * ptvp, struct loop_res_t * resp,
     int k, res;
     int packet_id = 0;
     int vb = op->verbose;
+    uint64_t t_ns = 0;
     char b[80];
     uint8_t sense_b[64] SG_C_CPP_ZERO_INIT;
 
@@ -521,7 +756,12 @@ loop_turs(struct sg_pt_base * ptvp, struct loop_res_t * resp,
             set_scsi_pt_cdb(ptvp, cdb, sizeof(cdb));
             set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
             set_scsi_pt_packet_id(ptvp, ++packet_id);
+            if (resp->latp)
+                t_ns = sg_get_mono_ns();
             rs = do_scsi_pt(ptvp, -1, op->tmo, vb);
+            if (resp->latp)
+                tur_lat_add(resp->latp, sg_get_mono_ns() - t_ns,
+                            t_ns - resp->start_ns, k, op->num_slowest);
             n = sg_cmds_process_resp(ptvp, tur_s, rs, (0 == k),
                                      vb, &sense_cat);
             if (-1 == n) {
@@ -595,7 +835,12 @@ loop_turs(struct sg_pt_base * ptvp, struct loop_res_t * resp,
                 wait_millisecs(op->delay);
             set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
             /* Might get Unit Attention on first invocation */
+            if (resp->latp)
+                t_ns = sg_get_mono_ns();
             res = ll_test_unit_ready(ptvp, k, op->tmo, NULL, (0 == k), vb);
+            if (resp->latp)
+                tur_lat_add(resp->latp, sg_get_mono_ns() - t_ns,
+                            t_ns - resp->start_ns, k, op->num_slowest);
             if (res) {
                 ++resp->num_errs;
                 resp->ret = res;
@@ -626,6 +871,280 @@ loop_turs(struct sg_pt_base * ptvp, struct loop_res_t * resp,
     }
 }
 
+/* Processes the response of the TUR last sent to dp, received at 'now'. */
+static void
+multi_tur_done(struct tur_dev_t * dp, int res, uint64_t now,
+               const struct opts_t * op)
+{
+    int n, sense_cat;
+    struct sg_scsi_sense_hdr ssh;
+
+    dp->in_flight = false;
+    tur_lat_add(&dp->lat, now - dp->start_ns, dp->start_ns - op->start_ns,
+                dp->num_done, op->num_slowest);
+    ++dp->num_done;
+    n = sg_cmds_process_resp(dp->ptvp, tur_s, res, op->verbose > 0,
+                             op->verbose, &sense_cat);
+    if (-1 == n) {
+        ++dp->num_errs;
+        if (get_scsi_pt_transport_err(dp->ptvp))
+            dp->ret = SG_LIB_TRANSPORT_ERROR;
+        else
+            dp->ret = sg_convert_errno(get_scsi_pt_os_err(dp->ptvp));
+        dp->done = true;        /* no point in sending more */
+    } else if (-2 == n) {
+        switch (sense_cat) {
+        case SG_LIB_CAT_RECOVERED:
+        case SG_LIB_CAT_NO_SENSE:
+            dp->ret = 0;
+            break;
+        case SG_LIB_CAT_UNIT_ATTENTION:
+            ++dp->num_errs;     /* ignored, like a single DEVICE */
+            break;
+        case SG_LIB_CAT_NOT_READY:
+            ++dp->num_errs;
+            dp->ret = sense_cat;
+            if ((op->asc > 0) &&
+                sg_scsi_normalize_sense(dp->sense_b,
+                                        get_scsi_pt_sense_len(dp->ptvp),
+                                        &ssh) && (op->asc == ssh.asc) &&
+                ((op->ascq < 0) || (op->ascq == ssh.ascq)))
+                dp->ret = SG_LIB_OK_FALSE;
+            break;
+        default:
+            ++dp->num_errs;
+            dp->ret = sense_cat;
+            break;
+        }
+    } else
+        dp->ret = 0;
+    partial_clear_scsi_pt_obj(dp->ptvp);
+    if (dp->num_done >= op->do_number)
+        dp->done = true;
+    else if (op->delay > 0)
+        dp->next_ns = now + ((uint64_t)op->delay * 1000000);
+}
+
+/* sg_mux done() callback */
+static void
+multi_tur_mux_done(struct sg_mux_cmd * mcp, void * ctx)
+{
+    struct tur_dev_t * dp = (struct tur_dev_t *)ctx;
+
+    multi_tur_done(dp, mcp->res, sg_get_mono_ns(), dp->op);
+}
+
+/* Sends a TUR to dp through the mux without waiting for it to complete,
+ * unless the DEVICE could only be opened read-only (the sg driver's v3
+ * interface needs write() for asynchronous commands) or there is no mux,
+ * in which case it completes here. */
+static void
+multi_tur_submit(struct tur_dev_t * dp, struct sg_mux * mxp,
+                 const struct opts_t * op)
+{
+    int res;
+
+    set_scsi_pt_cdb(dp->ptvp, dp->cdb, sizeof(dp->cdb));
+    set_scsi_pt_sense(dp->ptvp, dp->sense_b, sizeof(dp->sense_b));
+    dp->start_ns = sg_get_mono_ns();
+    if (dp->sync_only) {
+        set_scsi_pt_packet_id(dp->ptvp, dp->num_done + 1);
+        res = do_scsi_pt(dp->ptvp, -1, op->tmo, op->verbose);
+        multi_tur_done(dp, res, sg_get_mono_ns(), op);
+        return;
+    }
+    res = sg_mux_submit(mxp, &dp->mc);
+    if (res) {
+        multi_tur_done(dp, res, sg_get_mono_ns(), op);
+        return;
+    }
+    dp->in_flight = true;
+}
+
+/* Sends --number=NUM TURs to each of the DEVICEs, keeping up to
+ * --parallel=P of them in flight, then outputs latency min/avg/max for
+ * each DEVICE (and a summary). Returns the exit status of the first DEVICE
+ * whose last TUR (or open) failed, else 0. */
+static int
+multi_turs(struct opts_t * op, sgj_opaque_p jop)
+{
+    int k, fd, in_flight, remaining, ms, res;
+    int ret = 0;
+    int num_err_devs = 0;
+    int64_t num_turs = 0;
+    int max_par = op->num_parallel ? op->num_parallel : DEF_PARALLEL;
+    uint64_t start_ns, now, soonest, elapsed_ns;
+    double avg_us;
+    sgj_state * jsp = &op->json_st;
+    sgj_opaque_p jap = NULL;
+    sgj_opaque_p jo2p;
+    const struct sg_pt_lat_hist * hp;
+    struct tur_dev_t * dp;
+    struct tur_dev_t * devs;
+    struct sg_mux * mxp;
+    char b[144];
+
+    devs = (struct tur_dev_t *)calloc(op->num_devs, sizeof(*devs));
+    if (NULL == devs) {
+        pr2serr("%s: out of memory\n", __func__);
+        return sg_convert_errno(ENOMEM);
+    }
+    mxp = sg_mux_new(op->verbose);
+    if ((NULL == mxp) && op->verbose)
+        pr2serr("no asynchronous interface, each TUR completes before the "
+                "next is sent\n");
+    for (k = 0, remaining = 0; k < op->num_devs; ++k) {
+        dp = devs + k;
+        dp->name = op->dev_arr[k];
+        fd = sg_cmds_open_flags(dp->name, O_RDWR | O_NONBLOCK, op->verbose);
+        if ((-EACCES == fd) || (-EROFS == fd) || (-EPERM == fd)) {
+            fd = sg_cmds_open_device(dp->name, true /* ro */, op->verbose);
+            dp->sync_only = true;
+        }
+        if (fd < 0) {
+            pr2serr("%serror opening file: %s: %s\n", my_name, dp->name,
+                    safe_strerror(-fd));
+            dp->ret = sg_convert_errno(-fd);
+            dp->fd = -1;
+            dp->done = true;
+            continue;
+        }
+        dp->fd = fd;
+        dp->ptvp = construct_scsi_pt_obj_with_fd(fd, op->verbose);
+        if ((NULL == dp->ptvp) || get_scsi_pt_os_err(dp->ptvp)) {
+            pr2serr("%sunable to construct pt object for %s\n", my_name,
+                    dp->name);
+            dp->ret = sg_convert_errno(dp->ptvp ?
+                              get_scsi_pt_os_err(dp->ptvp) : ENOMEM);
+            dp->done = true;
+            continue;
+        }
+        dp->op = op;
+        dp->mc.fd = fd;
+        dp->mc.timeout_secs = op->tmo;
+        dp->mc.ptp = dp->ptvp;
+        dp->mc.ctx = dp;
+        dp->mc.done = multi_tur_mux_done;
+        if ((NULL == mxp) || (! dp->sync_only && sg_mux_add_fd(mxp, fd)))
+            dp->sync_only = true;
+        ++remaining;
+    }
+
+    start_ns = sg_get_mono_ns();
+    op->start_ns = start_ns;
+    for (in_flight = 0; remaining > 0; ) {
+        /* top up to max_par commands in flight */
+        now = sg_get_mono_ns();
+        soonest = 0;
+        for (k = 0; (k < op->num_devs) && (in_flight < max_par); ++k) {
+            dp = devs + k;
+            if (dp->done || dp->in_flight)
+                continue;
+            if (dp->next_ns > now) {
+                if ((0 == soonest) || (dp->next_ns < soonest))
+                    soonest = dp->next_ns;
+                continue;
+            }
+            multi_tur_submit(dp, mxp, op);
+            if (dp->in_flight)
+                ++in_flight;
+            else if (dp->done)
+                --remaining;
+        }
+        if (0 == in_flight) {
+            if (soonest > now)
+                wait_millisecs((int)((soonest - now + 999999) / 1000000));
+            continue;
+        }
+        ms = -1;
+        if (soonest > now)      /* --delay=MS pending on an idle DEVICE */
+            ms = (int)((soonest - now + 999999) / 1000000);
+        res = sg_mux_run(mxp, ms);
+        if (res < 0) {
+            pr2serr("waiting for responses: %s\n", safe_strerror(-res));
+            ret = sg_convert_errno(-res);
+            break;
+        }
+        for (k = 0, in_flight = 0, remaining = 0; k < op->num_devs; ++k) {
+            if (devs[k].in_flight)
+                ++in_flight;
+            if (! devs[k].done)
+                ++remaining;
+        }
+    }
+    elapsed_ns = sg_get_mono_ns() - start_ns;
+
+    if (jsp->pr_as_json)
+        jap = sgj_named_subarray_r(jsp, jop, "device_list");
+    for (k = 0; k < op->num_devs; ++k) {
+        dp = devs + k;
+        num_turs += dp->num_done;
+        if (dp->ret) {
+            ++num_err_devs;
+            if (0 == ret)
+                ret = dp->ret;
+        }
+        hp = &dp->lat.h;
+        avg_us = hp->count ? ((double)hp->sum_ns / hp->count) / 1000.0 : 0.0;
+        if (dp->ret && (SG_LIB_OK_FALSE != dp->ret))
+            sg_exit2str(dp->ret, false, sizeof(b), b);
+        else
+            b[0] = '\0';
+        if (0 == dp->num_done)
+            sgj_pr_hr(jsp, "%s: no TURs completed%s%s\n", dp->name,
+                      (b[0] ? ", " : ""), b);
+        else
+            sgj_pr_hr(jsp, "%s: %d TURs, %d errors, latency min/avg/max: "
+                      "%.1f/%.1f/%.1f us%s%s%s\n", dp->name, dp->num_done,
+                      dp->num_errs, hp->min_ns / 1000.0, avg_us,
+                      hp->max_ns / 1000.0, (b[0] ? " [" : ""), b,
+                      (b[0] ? "]" : ""));
+        if (jsp->pr_as_json) {
+            jo2p = sgj_new_unattached_object_r(jsp);
+            sgj_js_nv_s(jsp, jo2p, "device_name", dp->name);
+            sgj_js_nv_i(jsp, jo2p, "tur_count", dp->num_done);
+            sgj_js_nv_i(jsp, jo2p, "error_count", dp->num_errs);
+            sgj_js_nv_i(jsp, jo2p, "latency_min_ns", hp->min_ns);
+            sgj_js_nv_i(jsp, jo2p, "latency_avg_ns", hp->count ?
+                        (int64_t)(hp->sum_ns / hp->count) : 0);
+            sgj_js_nv_i(jsp, jo2p, "latency_max_ns", hp->max_ns);
+            sgj_js_nv_i(jsp, jo2p, "exit_status", dp->ret);
+            if (b[0])
+                sgj_js_nv_s(jsp, jo2p, "exit_status_str", b);
+        } else
+            jo2p = NULL;
+        if (op->do_time || jsp->pr_as_json)
+            tur_lat_report(&dp->lat, "    ", op, jo2p);
+        if (jo2p)
+            sgj_js_nv_o(jsp, jap, NULL /* name */, jo2p);
+    }
+    sgj_pr_hr(jsp, "Probed %d devices with %" PRId64 " Test Unit Ready "
+              "commands in %.3f ms, %d with errors\n", op->num_devs,
+              num_turs, elapsed_ns / 1000000.0, num_err_devs);
+    if (op->do_time && (elapsed_ns > 0))
+        sgj_pr_hr(jsp, "%d operations/sec with up to %d in flight\n",
+                  (int)((num_turs * 1000000000.0) / elapsed_ns), max_par);
+    if (jsp->pr_as_json) {
+        jo2p = sgj_named_subobject_r(jsp, jop, "summary");
+        sgj_js_nv_i(jsp, jo2p, "device_count", op->num_devs);
+        sgj_js_nv_i(jsp, jo2p, "error_device_count", num_err_devs);
+        sgj_js_nv_i(jsp, jo2p, "tur_count", num_turs);
+        sgj_js_nv_i(jsp, jo2p, "max_in_flight", max_par);
+        sgj_js_nv_i(jsp, jo2p, "elapsed_ns", elapsed_ns);
+    }
+
+    sg_mux_free(mxp);
+    for (k = 0; k < op->num_devs; ++k) {
+        dp = devs + k;
+        if (dp->ptvp)
+            destruct_scsi_pt_obj(dp->ptvp);
+        if (dp->fd >= 0)
+            sg_cmds_close_device(dp->fd);
+    }
+    free(devs);
+    return ret;
+}
+
 
 int
 main(int argc, char * argv[])
@@ -643,9 +1162,12 @@ main(int argc, char * argv[])
 #endif
     struct loop_res_t loop_res;
     struct loop_res_t * resp = &loop_res;
+    struct tur_lat_t * latp = NULL;
     struct sg_pt_base * ptvp = NULL;
     struct opts_t opts;
     struct opts_t * op = &opts;
+    sgj_state * jsp = &op->json_st;
+    sgj_opaque_p jop = NULL;
 
 
     memset(op, 0, sizeof(opts));
@@ -682,6 +1204,10 @@ main(int argc, char * argv[])
         pr2serr("Version string: %s\n", version_str);
         return 0;
     }
+    if ((op->do_time > 1) && (0 == op->num_slowest))
+        op->num_slowest = DEF_SLOWEST;
+    if (op->num_slowest && (0 == op->do_time))
+        op->do_time = 1;
     if (op->do_progress && (! op->delay_given))
         op->delay = 30 * 1000;  /* progress has 30 second default delay */
 
@@ -692,6 +1218,35 @@ main(int argc, char * argv[])
     }
     if (0 == op->tmo)
         op->tmo = DEF_PT_TIMEOUT;
+    ret = expand_devices(op);
+    if (ret)
+        goto fini;
+    if ((op->num_devs > 1) || op->num_parallel || op->do_json) {
+        if (op->do_progress) {
+            pr2serr("--progress needs a single DEVICE and no --json or "
+                    "--parallel=\n");
+            ret = SG_LIB_CONTRADICT;
+            goto fini;
+        }
+        if (op->do_json) {
+            if (! sgj_init_state(jsp, op->json_arg)) {
+                int bad_char = jsp->first_bad_char;
+                char e[1500];
+
+                if (bad_char)
+                    pr2serr("bad argument to --json= option, unrecognized "
+                            "character '%c'\n\n", bad_char);
+                sg_json_usage(0, e, sizeof(e));
+                pr2serr("%s", e);
+                ret = SG_LIB_SYNTAX_ERROR;
+                goto fini;
+            }
+            jop = sgj_start_r(my_name, version_str, argc, argv, jsp);
+        }
+        ret = multi_turs(op, jop);
+        goto fini;
+    }
+    op->device_name = op->dev_arr[0];
 
     if ((sg_fd = sg_cmds_open_device(op->device_name, true /* ro */,
                                      op->verbose)) < 0) {
@@ -749,6 +1304,11 @@ main(int argc, char * argv[])
 #else
         start_tm_valid = false;
 #endif
+        if (op->do_time) {
+            latp = (struct tur_lat_t *)calloc(1, sizeof(*latp));
+            resp->latp = latp;  /* if NULL, no latency percentiles */
+            resp->start_ns = sg_get_mono_ns();
+        }
 
         num_done = loop_turs(ptvp, resp, op);
 
@@ -785,6 +1345,8 @@ main(int argc, char * argv[])
                 printf("; %d operations/sec\n", (int)(nom / elapsed_usecs));
             } else
                 printf("Recorded 0 or less elapsed microseconds ??\n");
+            if (latp)
+                tur_lat_report(latp, "", op, NULL);
         }
         if (((op->do_number > 1) || (resp->num_errs > 0)) &&
             (! resp->reported))
@@ -794,9 +1356,19 @@ main(int argc, char * argv[])
             ret = resp->ret;
     }
 fini:
+    if (latp)
+        free(latp);
     if (ptvp)
         destruct_scsi_pt_obj(ptvp);
     if (sg_fd >= 0)
         sg_cmds_close_device(sg_fd);
+    if (jsp->pr_as_json) {
+        sgj_js2file(jsp, NULL, ret, stdout);
+        sgj_finish(jsp);
+    }
+#ifndef SG_LIB_WIN32
+    if (op->num_dev_args > 0)
+        globfree(&op->dev_glob);
+#endif
     return (ret >= 0) ? ret : SG_LIB_CAT_OTHER;
 }
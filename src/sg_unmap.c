@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2009-2023 Douglas Gilbert.
+ * Copyright (c) 2009-2026 Douglas Gilbert.
  * All rights reserved.
  * Use of this source code is governed by a BSD-style
  * license that can be found in the BSD_LICENSE file.
@@ -14,6 +14,7 @@
 #include <stdarg.h>
 #include <stdbool.h>
 #include <string.h>
+#include <errno.h>
 #include <ctype.h>
 #include <getopt.h>
 #include <limits.h>
@@ -23,11 +24,22 @@
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
+
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+#include <time.h>
+#elif defined(HAVE_GETTIMEOFDAY)
+#include <time.h>
+#include <sys/time.h>
+#endif
+
 #include "sg_lib.h"
 #include "sg_cmds_basic.h"
 #include "sg_cmds_extra.h"
 #include "sg_unaligned.h"
+#include "sg_par.h"
 #include "sg_pr2serr.h"
+#include "sg_rcache.h"
+#include "sg_geom.h"
 
 
 /* A utility program originally written for the Linux OS SCSI subsystem.
@@ -36,14 +48,15 @@
  * logical blocks. Note that DATA MAY BE LOST.
  */
 
-static const char * version_str = "1.22 20230519";
+static const char * version_str = "1.25 20261015";
 static const char * my_name = "sg_unmap: ";
 
 
 #define DEF_TIMEOUT_SECS 60
 #define MAX_NUM_ADDR 128
-#define RCAP10_RESP_LEN 8
-#define RCAP16_RESP_LEN 32
+#define DEF_BATCH_PARALLEL 4
+#define MAX_BATCH_PARALLEL 64
+#define MAX_BATCH_DESCS 4095    /* PARAMETER LIST LENGTH field is 16 bits */
 
 #ifndef UINT32_MAX
 #define UINT32_MAX ((uint32_t)-1)
@@ -53,6 +66,8 @@ static const char * my_name = "sg_unmap: ";
 static struct option long_options[] = {
         {"all", required_argument, 0, 'A'},
         {"anchor", no_argument, 0, 'a'},
+        {"batch", required_argument, 0, 'B'},
+        {"cache", required_argument, 0, 'C'},
         {"dry-run", no_argument, 0, 'd'},
         {"dry_run", no_argument, 0, 'd'},
         {"force", no_argument, 0, 'f'},
@@ -61,6 +76,7 @@ static struct option long_options[] = {
         {"in", required_argument, 0, 'I'},
         {"lba", required_argument, 0, 'l'},
         {"num", required_argument, 0, 'n'},
+        {"parallel", required_argument, 0, 'p'},
         {"timeout", required_argument, 0, 't'},
         {"verbose", no_argument, 0, 'v'},
         {"version", no_argument, 0, 'V'},
@@ -72,12 +88,13 @@ static void
 usage()
 {
     pr2serr("Usage: "
-          "sg_unmap [--all=ST,RN[,LA]] [--anchor] [--dry-run] [--force]\n"
-          "                [--grpnum=GN] [--help] [--in=FILE] "
-          "[--lba=LBA,LBA...]\n"
-          "                [--num=NUM,NUM...] [--timeout=TO] [--verbose] "
-          "[--version]\n"
-          "                DEVICE\n"
+          "sg_unmap [--all=ST,RN[,LA]] [--anchor] [--batch=FILE] "
+          "[--cache=DIR]\n"
+          "                [--dry-run] [--force] [--grpnum=GN] [--help] "
+          "[--in=FILE]\n"
+          "                [--lba=LBA,LBA...] [--num=NUM,NUM...] "
+          "[--parallel=Q]\n"
+          "                [--timeout=TO] [--verbose] [--version] DEVICE\n"
           "  where:\n"
           "    --all=ST,RN[,LA]|-A ST,RN[,LA]    start unmaps at LBA ST, "
           "RN blocks\n"
@@ -85,6 +102,17 @@ usage()
           "until\n"
           "                         and including LBA LA (last)\n"
           "    --anchor|-a          set anchor field in cdb\n"
+          "    --batch=FILE|-B FILE    read any number of LBA, NUM pairs "
+          "from FILE\n"
+          "                            (or stdin if '-'), coalesce them and "
+          "send as\n"
+          "                            many UNMAP commands as the Block "
+          "Limits VPD\n"
+          "                            page requires\n"
+          "    --cache=DIR|-C DIR    use the response cache in DIR for "
+          "INQUIRY, READ\n"
+          "                          CAPACITY and the supported operation "
+          "codes\n"
           "    --dry-run|-d         prepare but skip UNMAP call(s)\n"
           "    --force|-f           don't ask for confirmation before "
           "zapping media\n"
@@ -100,6 +128,9 @@ usage()
           "blocks to\n"
           "                                      unmap starting at "
           "corresponding LBA\n"
+          "    --parallel=Q|-p Q    with --batch, up to Q UNMAP commands in "
+          "flight\n"
+          "                         (def: 4)\n"
           "    --timeout=TO|-t TO    command timeout (unit: seconds) "
           "(def: 60)\n"
           "    --verbose|-v         increase verbosity\n"
@@ -111,7 +142,10 @@ usage()
           "    sg_unmap --lba=0x12345 --num=1 /dev/sdb\n"
           "Example to unmap starting at LBA 0x12345, 256 blocks per command:"
           "\n    sg_unmap --all=0x12345,256 /dev/sg2\n"
-          "until the end if /dev/sg2 (assumed to be a storage device)\n\n"
+          "until the end if /dev/sg2 (assumed to be a storage device)\n"
+          "Example to unmap the extents listed in trim.lst, 8 commands in "
+          "flight:\n"
+          "    sg_unmap --batch=trim.lst --parallel=8 /dev/sg2\n\n"
           );
     pr2serr("WARNING: This utility will destroy data on DEVICE in the given "
             "range(s)\nthat will be unmapped. Unmap is also known as 'trim' "
@@ -348,6 +382,340 @@ bad_exit:
 }
 
 
+/* --batch=FILE state. Extents read from FILE are sorted and coalesced in
+ * exts[], then cut into block descriptors (descs[]) that are grouped into
+ * UNMAP commands (cmds[]) within the Block Limits VPD page limits. */
+struct um_ext_t {
+    uint64_t lba;
+    uint64_t num;
+};
+
+struct um_desc_t {
+    uint64_t lba;
+    uint32_t num;
+};
+
+struct um_cmd_t {
+    int first;          /* index into descs[] */
+    int num_descs;
+    int res;
+};
+
+struct um_batch_t {
+    bool anchor;
+    int sg_fd;
+    int grpnum;
+    int timeout;
+    int verbose;
+    int num_read;       /* extents (with NUM > 0) read from FILE */
+    int num_exts;       /* after coalescing */
+    int max_exts;
+    int num_descs;
+    int num_cmds;
+    int max_descs;      /* per UNMAP command */
+    uint32_t max_lbas;  /* per UNMAP command */
+    uint64_t num_blks;  /* after coalescing */
+    struct um_ext_t * exts;
+    struct um_desc_t * descs;
+    struct um_cmd_t * cmds;
+};
+
+/* Reads LBA,NUM pairs from the file named fn (stdin if "-") into bp->exts,
+ * growing it as needed. Same syntax as --in=FILE but without a limit on the
+ * number of pairs and NUM may exceed 32 bits. Pairs with a NUM of 0 are
+ * dropped. Returns 0 if ok, else a SG_LIB_* error. */
+static int
+batch_read(const char * fn, struct um_batch_t * bp)
+{
+    bool have_stdin = (0 == strcmp(fn, "-"));
+    bool have_lba = false;
+    int j, ret = 0;
+    int64_t ll;
+    uint64_t lba = 0;
+    char * cp;
+    struct um_ext_t * ep;
+    FILE * fp;
+    char line[1024];
+
+    if (have_stdin)
+        fp = stdin;
+    else if (NULL == (fp = fopen(fn, "r"))) {
+        ret = sg_convert_errno(errno);
+        pr2serr("%s: unable to open %s: %s\n", __func__, fn,
+                safe_strerror(errno));
+        return ret;
+    }
+    for (j = 1; fgets(line, sizeof(line), fp); ++j) {
+        cp = strchr(line, '#');
+        if (cp)
+            *cp = '\0';
+        for (cp = strtok(line, " ,\t\r\n"); cp; cp = strtok(NULL, " ,\t\r\n")) {
+            ll = sg_get_llnum(cp);
+            if (ll < 0) {
+                pr2serr("%s: unable to decode '%s' on line %d\n", __func__,
+                        cp, j);
+                ret = SG_LIB_SYNTAX_ERROR;
+                goto fini;
+            }
+            if (! have_lba) {
+                lba = (uint64_t)ll;
+                have_lba = true;
+                continue;
+            }
+            have_lba = false;
+            if (0 == ll)
+                continue;
+            if ((uint64_t)ll > (UINT64_MAX - lba)) {
+                pr2serr("%s: LBA 0x%" PRIx64 " plus NUM overflows on line "
+                        "%d\n", __func__, lba, j);
+                ret = SG_LIB_SYNTAX_ERROR;
+                goto fini;
+            }
+            if (bp->num_exts >= bp->max_exts) {
+                int n = (bp->max_exts > 0) ? (2 * bp->max_exts) : 1024;
+
+                ep = (struct um_ext_t *)realloc(bp->exts, n * sizeof(*ep));
+                if (NULL == ep) {
+                    pr2serr("%s: out of memory after %d extents\n", __func__,
+                            bp->num_exts);
+                    ret = sg_convert_errno(ENOMEM);
+                    goto fini;
+                }
+                bp->exts = ep;
+                bp->max_exts = n;
+            }
+            ep = bp->exts + bp->num_exts++;
+            ep->lba = lba;
+            ep->num = (uint64_t)ll;
+        }
+    }
+    if (have_lba) {
+        pr2serr("%s: expect LBA,NUM pairs but decoded odd number from %s\n",
+                __func__, have_stdin ? "stdin" : fn);
+        ret = SG_LIB_SYNTAX_ERROR;
+    }
+fini:
+    if (! have_stdin)
+        fclose(fp);
+    bp->num_read = bp->num_exts;
+    return ret;
+}
+
+static int
+ext_cmp(const void * a, const void * b)
+{
+    const struct um_ext_t * ap = (const struct um_ext_t *)a;
+    const struct um_ext_t * bp = (const struct um_ext_t *)b;
+
+    if (ap->lba != bp->lba)
+        return (ap->lba < bp->lba) ? -1 : 1;
+    return 0;
+}
+
+/* Sorts bp->exts then merges extents that overlap or are adjacent */
+static void
+batch_coalesce(struct um_batch_t * bp)
+{
+    int k, n;
+    uint64_t end;
+    struct um_ext_t * cur;
+    struct um_ext_t * ep;
+
+    bp->num_blks = 0;
+    if (bp->num_exts < 1)
+        return;
+    qsort(bp->exts, bp->num_exts, sizeof(struct um_ext_t), ext_cmp);
+    cur = bp->exts;
+    for (k = 1, n = 1; k < bp->num_exts; ++k) {
+        ep = bp->exts + k;
+        end = cur->lba + cur->num;
+        if (ep->lba <= end) {
+            if ((ep->lba + ep->num) > end)
+                cur->num = ep->lba + ep->num - cur->lba;
+        } else {
+            bp->num_blks += cur->num;
+            cur = bp->exts + n++;
+            *cur = *ep;
+        }
+    }
+    bp->num_blks += cur->num;
+    bp->num_exts = n;
+}
+
+/* Fetches MAXIMUM UNMAP LBA COUNT and MAXIMUM UNMAP BLOCK DESCRIPTOR COUNT
+ * from the Block Limits VPD page. If that page is not available, no limit on
+ * the LBA count and this utility's --in= limit on descriptors are assumed.
+ * Returns 0 if ok, SG_LIB_CAT_INVALID_OP if the page says UNMAP is not
+ * supported. */
+static int
+batch_limits(struct um_batch_t * bp)
+{
+    int vb = bp->verbose;
+    uint32_t max_ul = 0xffffffff;
+    uint32_t max_ud = MAX_NUM_ADDR;
+    struct sg_geom g;
+
+    if ((0 == sg_geom_get(bp->sg_fd, SG_GEOM_BL, &g, false,
+                          (vb > 1) ? vb - 1 : 0)) && g.have_bl) {
+        max_ul = g.max_unmap_lba_cnt;
+        max_ud = g.max_unmap_desc_cnt;
+        if ((0 == max_ul) || (0 == max_ud)) {
+            pr2serr("Block Limits VPD page: maximum unmap %s count is 0, "
+                    "UNMAP is not supported\n", (0 == max_ul) ? "LBA" :
+                    "block descriptor");
+            return SG_LIB_CAT_INVALID_OP;
+        }
+    } else if (vb)
+        pr2serr("Block Limits VPD page not available, assume up to %u "
+                "descriptors per UNMAP\n", max_ud);
+    bp->max_lbas = max_ul;
+    bp->max_descs = (max_ud < MAX_BATCH_DESCS) ? (int)max_ud :
+                                                 MAX_BATCH_DESCS;
+    if (vb)
+        pr2serr("Up to %d block descriptors and 0x%x blocks per UNMAP "
+                "command\n", bp->max_descs, bp->max_lbas);
+    return 0;
+}
+
+/* Cuts the coalesced extents into block descriptors and groups those into
+ * UNMAP commands, filling each command up to max_descs descriptors or
+ * max_lbas blocks (an extent may be split between commands). Returns 0 if
+ * ok. */
+static int
+batch_plan(struct um_batch_t * bp)
+{
+    int k, n;
+    int max_d = 0;
+    int max_c = 0;
+    uint32_t cmd_lbas = 0;
+    uint64_t lba, rem;
+    struct um_cmd_t * cmdp = NULL;
+    void * vp;
+
+    for (k = 0; k < bp->num_exts; ++k) {
+        lba = bp->exts[k].lba;
+        for (rem = bp->exts[k].num; rem > 0; lba += n, rem -= n) {
+            if ((NULL == cmdp) || (cmdp->num_descs >= bp->max_descs) ||
+                (cmd_lbas >= bp->max_lbas)) {
+                if (bp->num_cmds >= max_c) {
+                    max_c = max_c ? (2 * max_c) : 256;
+                    vp = realloc(bp->cmds, max_c * sizeof(struct um_cmd_t));
+                    if (NULL == vp)
+                        goto nomem;
+                    bp->cmds = (struct um_cmd_t *)vp;
+                }
+                cmdp = bp->cmds + bp->num_cmds++;
+                cmdp->first = bp->num_descs;
+                cmdp->num_descs = 0;
+                cmdp->res = 0;
+                cmd_lbas = 0;
+            }
+            n = (int)((rem < (uint64_t)(bp->max_lbas - cmd_lbas)) ? rem :
+                      (bp->max_lbas - cmd_lbas));
+            if (bp->num_descs >= max_d) {
+                max_d = max_d ? (2 * max_d) : 1024;
+                vp = realloc(bp->descs, max_d * sizeof(struct um_desc_t));
+                if (NULL == vp)
+                    goto nomem;
+                bp->descs = (struct um_desc_t *)vp;
+            }
+            bp->descs[bp->num_descs].lba = lba;
+            bp->descs[bp->num_descs].num = (uint32_t)n;
+            ++bp->num_descs;
+            ++cmdp->num_descs;
+            cmd_lbas += (uint32_t)n;
+        }
+    }
+    return 0;
+nomem:
+    pr2serr("%s: out of memory\n", __func__);
+    return sg_convert_errno(ENOMEM);
+}
+
+/* Sends UNMAP command k of the batch in ctx */
+static int
+batch_one(int64_t k, void * ctx)
+{
+    int j, n;
+    struct um_batch_t * bp = (struct um_batch_t *)ctx;
+    struct um_cmd_t * cmdp = bp->cmds + k;
+    struct um_desc_t * dp;
+    uint8_t * param;
+    uint8_t * ucp;
+    char b[80];
+
+    n = 16 * cmdp->num_descs;
+    param = (uint8_t *)calloc(1, 8 + n);
+    if (NULL == param) {
+        cmdp->res = sg_convert_errno(ENOMEM);
+        return 0;
+    }
+    sg_put_unaligned_be16((uint16_t)(n + 6), param + 0);
+    sg_put_unaligned_be16((uint16_t)n, param + 2);
+    dp = bp->descs + cmdp->first;
+    for (j = 0, ucp = param + 8; j < cmdp->num_descs; ++j, ++dp, ucp += 16) {
+        sg_put_unaligned_be64(dp->lba, ucp + 0);
+        sg_put_unaligned_be32(dp->num, ucp + 8);
+    }
+    cmdp->res = sg_ll_unmap_v2(bp->sg_fd, bp->anchor, bp->grpnum,
+                               bp->timeout, param, n + 8, true,
+                               (bp->verbose > 2) ? bp->verbose - 2 : 0);
+    if (cmdp->res) {
+        dp = bp->descs + cmdp->first;
+        sg_get_category_sense_str(cmdp->res, sizeof(b), b, bp->verbose);
+        pr2serr("UNMAP of %d descriptor%s from LBA 0x%" PRIx64 ": %s\n",
+                cmdp->num_descs, (cmdp->num_descs > 1) ? "s" : "", dp->lba,
+                b);
+    }
+    free(param);
+    return 0;
+}
+
+/* Sends the UNMAP commands planned in bp with up to num_q in flight then
+ * reports how many extents were unmapped per second. Returns 0 if all
+ * succeeded, else the result of the first command that failed. */
+static int
+batch_run(struct um_batch_t * bp, int num_q)
+{
+    int k;
+    int num_bad = 0;
+    int ret = 0;
+    uint64_t start_ns, ns;
+    double secs;
+
+    start_ns = sg_get_mono_ns();
+    if (bp->verbose > 1)
+        pr2serr("%s: %d commands, up to %d at once\n", __func__,
+                bp->num_cmds, num_q);
+    sg_par_each(bp->num_cmds, num_q, batch_one, bp);
+    ns = sg_get_mono_ns() - start_ns;
+    for (k = 0; k < bp->num_cmds; ++k) {
+        if (bp->cmds[k].res) {
+            ++num_bad;
+            if (0 == ret)
+                ret = bp->cmds[k].res;
+        }
+    }
+    printf("%d extents (%d after coalescing, %" PRIu64 " blocks) in %d "
+           "UNMAP commands, %d failed\n", bp->num_read, bp->num_exts,
+           bp->num_blks, bp->num_cmds, num_bad);
+    secs = (double)ns / 1000000000.0;
+    if (secs > 0.0)
+        printf("Time taken: %.3f secs, %.1f extents/sec, %.1f "
+               "commands/sec\n", secs, (double)bp->num_read / secs,
+               (double)bp->num_cmds / secs);
+    return ret;
+}
+
+static void
+batch_free(struct um_batch_t * bp)
+{
+    free(bp->exts);
+    free(bp->descs);
+    free(bp->cmds);
+}
+
+
 int
 main(int argc, char * argv[])
 {
@@ -360,6 +728,7 @@ main(int argc, char * argv[])
     int res, c, num, k, j;
     int sg_fd = -1;
     int grpnum = 0;
+    int num_q = DEF_BATCH_PARALLEL;
     int addr_arr_len = 0;
     int num_arr_len = 0;
     int param_len = 4;
@@ -373,21 +742,25 @@ main(int argc, char * argv[])
     const char * lba_op = NULL;
     const char * num_op = NULL;
     const char * in_op = NULL;
+    const char * batch_fn = NULL;
+    const char * cache_dir = NULL;
     const char * device_name = NULL;
     char * first_comma = NULL;
     char * second_comma = NULL;
     struct sg_simple_inquiry_resp inq_resp;
+    struct um_batch_t batch;
     uint64_t addr_arr[MAX_NUM_ADDR];
     uint32_t num_arr[MAX_NUM_ADDR];
     uint8_t param_arr[8 + (MAX_NUM_ADDR * 16)];
     static const char * tryvv_s = ", try '-vv' for more information";
 
+    memset(&batch, 0, sizeof(batch));
     if (getenv("SG3_UTILS_INVOCATION"))
         sg_rep_invocation(my_name, version_str, argc, argv, stderr);
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "aA:dfg:hI:Hl:n:t:vV", long_options,
+        c = getopt_long(argc, argv, "aA:B:C:dfg:hI:Hl:n:p:t:vV", long_options,
                         &option_index);
         if (c == -1)
             break;
@@ -396,6 +769,12 @@ main(int argc, char * argv[])
         case 'a':
             anchor = true;
             break;
+        case 'B':
+            batch_fn = optarg;
+            break;
+        case 'C':
+            cache_dir = optarg;
+            break;
         case 'A':
             first_comma = strchr(optarg, ',');
             if (NULL == first_comma) {
@@ -456,6 +835,11 @@ main(int argc, char * argv[])
         case 'n':
             num_op = optarg;
             break;
+        case 'p':
+            num_q = sg_par_get_num(optarg, 1, MAX_BATCH_PARALLEL);
+            if (num_q < 0)
+                return SG_LIB_SYNTAX_ERROR;
+            break;
         case 't':
             timeout = sg_get_num(optarg);
             if (timeout < 0)  {
@@ -517,7 +901,14 @@ main(int argc, char * argv[])
         return SG_LIB_SYNTAX_ERROR;
     }
 
-    if (all_rn > 0) {
+    if (batch_fn) {
+        if (lba_op || num_op || in_op || (all_rn > 0)) {
+            pr2serr("Can't have --batch= together with --all=, --lba=, "
+                    "--num= or --in=\n\n");
+            usage();
+            return SG_LIB_CONTRADICT;
+        }
+    } else if (all_rn > 0) {
         if (lba_op || num_op || in_op) {
             pr2serr("Can't have --all= together with --lba=, --num= or "
                     "--in=\n\n");
@@ -537,12 +928,30 @@ main(int argc, char * argv[])
             pr2serr("since '--lba=' is given, also need '--num='\n\n");
         else
             pr2serr("expect either both '--lba=' and '--num=', or "
-                    "'--in=', or '--all='\n\n");
+                    "'--in=', '--all=' or '--batch='\n\n");
         usage();
         return SG_LIB_CONTRADICT;
     }
 
-    if (all_rn > 0) {
+    if (batch_fn) {
+        batch.anchor = anchor;
+        batch.grpnum = grpnum;
+        batch.timeout = timeout;
+        batch.verbose = vb;
+        ret = batch_read(batch_fn, &batch);
+        if (ret)
+            goto err_out;
+        if (0 == batch.num_exts) {
+            pr2serr("no extents found in '--batch=' argument, file: %s\n",
+                    batch_fn);
+            ret = SG_LIB_SYNTAX_ERROR;
+            goto err_out;
+        }
+        batch_coalesce(&batch);
+        if (vb)
+            pr2serr("%d extents read, %d after coalescing\n",
+                    batch.num_read, batch.num_exts);
+    } else if (all_rn > 0) {
         if ((all_last > 0) && (all_start > all_last)) {
             pr2serr("in --all=ST,RN,LA start address (ST) exceeds last "
                     "address (LA)\n");
@@ -604,58 +1013,65 @@ main(int argc, char * argv[])
         pr2serr("open error: %s: %s\n", device_name, safe_strerror(-sg_fd));
         goto err_out;
     }
+    if (cache_dir)
+        sg_rcache_open(cache_dir, device_name, sg_fd, vb);
     ret = sg_simple_inquiry(sg_fd, &inq_resp, true, vb);
 
-    if (all_rn > 0) {
+    if (batch_fn) {
+        batch.sg_fd = sg_fd;
+        ret = batch_limits(&batch);
+        if (ret)
+            goto err_out;
+        ret = batch_plan(&batch);
+        if (ret)
+            goto err_out;
+        if (dry_run) {
+            pr2serr("Doing dry-run, would have unmapped %" PRIu64 " blocks "
+                    "in %d extents\n    using %d UNMAP commands with %d "
+                    "block descriptors\n", batch.num_blks, batch.num_exts,
+                    batch.num_cmds, batch.num_descs);
+            if (vb) {
+                for (k = 0; k < batch.num_cmds; ++k) {
+                    struct um_cmd_t * cmdp = batch.cmds + k;
+
+                    printf("UNMAP command %d:\n", k + 1);
+                    for (j = 0; j < cmdp->num_descs; ++j)
+                        printf("    0x%" PRIx64 ", 0x%x\n",
+                               batch.descs[cmdp->first + j].lba,
+                               batch.descs[cmdp->first + j].num);
+                }
+            }
+            goto err_out;
+        }
+        if (! do_force) {
+            char b[120];
+
+            printf("%s is:  %.8s  %.16s  %.4s\n", device_name,
+                   inq_resp.vendor, inq_resp.product, inq_resp.revision);
+            sg_sleep_secs(3);
+            snprintf(b, sizeof(b), "%s, %" PRIu64 " blocks in %d extents "
+                     "from LBA 0x%" PRIx64, device_name, batch.num_blks,
+                     batch.num_exts, batch.exts[0].lba);
+            sg_warn_and_wait("UNMAP (a.k.a. trim)", b, false);
+        }
+        ret = batch_run(&batch, num_q);
+    } else if (all_rn > 0) {
         bool last_retry;
         bool to_end_of_device = false;
         uint64_t ull;
         uint32_t bump;
 
         if (0 == all_last) {    /* READ CAPACITY(10 or 16) to find last */
-            uint8_t resp_buff[RCAP16_RESP_LEN];
-
-            res = sg_ll_readcap_16(sg_fd, false /* pmi */, 0 /* llba */,
-                                   resp_buff, RCAP16_RESP_LEN, true, vb);
-            if (SG_LIB_CAT_UNIT_ATTENTION == res) {
-                pr2serr("Read capacity(16) unit attention, try again\n");
-                res = sg_ll_readcap_16(sg_fd, false, 0, resp_buff,
-                                       RCAP16_RESP_LEN, true, vb);
-            }
-            if (0 == res) {
-                if (vb > 3) {
-                    pr2serr("Read capacity(16) response:\n");
-                    hex2stderr(resp_buff, RCAP16_RESP_LEN, 1);
-                }
-                all_last = sg_get_unaligned_be64(resp_buff + 0);
-            } else if ((SG_LIB_CAT_INVALID_OP == res) ||
-                       (SG_LIB_CAT_ILLEGAL_REQ == res)) {
-                if (vb)
-                    pr2serr("Read capacity(16) not supported, try Read "
-                            "capacity(10)\n");
-                res = sg_ll_readcap_10(sg_fd, false /* pmi */, 0 /* lba */,
-                                       resp_buff, RCAP10_RESP_LEN, true,
-                                       vb);
-                if (0 == res) {
-                    if (vb > 3) {
-                        pr2serr("Read capacity(10) response:\n");
-                        hex2stderr(resp_buff, RCAP10_RESP_LEN, 1);
-                    }
-                    all_last = (uint64_t)sg_get_unaligned_be32(resp_buff + 0);
-                } else {
-                    if (res < 0)
-                        res = sg_convert_errno(-res);
-                    pr2serr("Read capacity(10) failed\n");
-                    ret = res;
-                    goto err_out;
-                }
-            } else {
+            struct sg_geom g;
+
+            res = sg_geom_get(sg_fd, 0, &g, true, vb);
+            if (res) {
                 if (res < 0)
                     res = sg_convert_errno(-res);
-                pr2serr("Read capacity(16) failed\n");
                 ret = res;
                 goto err_out;
             }
+            all_last = g.num_blks - 1;
             if (all_start > all_last) {
                 pr2serr("after READ CAPACITY the last block (0x%" PRIx64
                         ") less than start address (0x%" PRIx64 ")\n",
@@ -784,6 +1200,7 @@ retry:
     }
 
 err_out:
+    batch_free(&batch);
     if (sg_fd >= 0) {
         res = sg_cmds_close_device(sg_fd);
         if (res < 0) {
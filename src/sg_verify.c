@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2004-2023 Douglas Gilbert.
+ * Copyright (c) 2004-2026 Douglas Gilbert.
  * All rights reserved.
  * Use of this source code is governed by a BSD-style
  * license that can be found in the BSD_LICENSE file.
@@ -22,10 +22,20 @@
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
+
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+#include <time.h>
+#elif defined(HAVE_GETTIMEOFDAY)
+#include <time.h>
+#include <sys/time.h>
+#endif
+
 #include "sg_lib.h"
 #include "sg_cmds_basic.h"
 #include "sg_cmds_extra.h"
+#include "sg_par.h"
 #include "sg_pr2serr.h"
+#include "sg_json_sg_lib.h"
 
 /* A utility program for the Linux OS SCSI subsystem.
  *
@@ -37,13 +47,21 @@
  * the count of blocks requested and the number of bytes transferred (when
  * BYTCHK>0) are "in sync". That caclculation is somewhat complicated by
  * the possibility of protection data (DIF).
+ *
+ * With --list=LF, --parallel=Q or --json the ranges are verified in BPC
+ * sized chunks with up to Q commands in flight. A medium error does not
+ * stop that scan: the rest of the chunk after the reported LBA is verified
+ * again and each bad LBA found is listed at the end.
  */
 
-static const char * version_str = "1.29 20230519";    /* sbc5r04 */
+static const char * version_str = "1.31 20261015";    /* sbc5r04 */
 
 #define ME "sg_verify: "
+#define MY_NAME "sg_verify"
 
 #define EBUFF_SZ 256
+#define MAX_VFY_PARALLEL 64
+#define VFY_PROGRESS_SECS 5
 
 
 static struct option long_options[] = {
@@ -57,9 +75,12 @@ static struct option long_options[] = {
         {"group", required_argument, 0, 'g'},
         {"help", no_argument, 0, 'h'},
         {"in", required_argument, 0, 'i'},
+        {"json", optional_argument, 0, '^'},    /* short option is '-j' */
         {"lba", required_argument, 0, 'l'},
+        {"list", required_argument, 0, 'L'},
         {"nbo", required_argument, 0, 'n'},     /* misspelling, legacy */
         {"ndo", required_argument, 0, 'n'},
+        {"parallel", required_argument, 0, 'p'},
         {"quiet", no_argument, 0, 'q'},
         {"readonly", no_argument, 0, 'r'},
         {"verbose", no_argument, 0, 'v'},
@@ -75,10 +96,11 @@ usage()
             "[--dpo]\n"
             "                 [--ebytchk=BCH] [--ff] [--group=GN] [--help] "
             "[--in=IF]\n"
-            "                 [--lba=LBA] [--ndo=NDO] [--quiet] "
-            "[--readonly]\n"
-            "                 [--verbose] [--version] [--vrprotect=VRP] "
-            "DEVICE\n"
+            "                 [--json[=JO]] [--lba=LBA] [--list=LF] "
+            "[--ndo=NDO]\n"
+            "                 [--parallel=Q] [--quiet] [--readonly] "
+            "[--verbose]\n"
+            "                 [--version] [--vrprotect=VRP] DEVICE\n"
             "  where:\n"
             "    --0|-0              fill buffer with zeros (don't read "
             "stdin)\n"
@@ -105,8 +127,14 @@ usage()
             "    --in=IF|-i IF       input from file called IF (def: "
             "stdin)\n"
             "                        only active if --ebytchk=BCH given\n"
+            "    --json[=JO]|-j[=JO]    output summary in JSON instead of "
+            "plain text.\n"
+            "                           Use --json=? for JSON help\n"
             "    --lba=LBA|-l LBA    logical block address to start "
             "verify (def: 0)\n"
+            "    --list=LF|-L LF     verify the LBA,COUNT pairs in file LF "
+            "(or stdin if\n"
+            "                        '-') rather than --lba= and --count=\n"
             "    --ndo=NDO|-n NDO    NDO is number of bytes placed in "
             "data-out buffer.\n"
             "                        These are fetched from IF (or "
@@ -115,6 +143,10 @@ usage()
             "Forces\n"
             "                        --bpc=COUNT. Sets BYTCHK (byte check) "
             "to 1\n"
+            "    --parallel=Q|-p Q    up to Q VERIFY commands in flight, "
+            "continue\n"
+            "                         after medium errors and list bad LBAs "
+            "(def: 1)\n"
             "    --quiet|-q          suppress miscompare report to stderr, "
             "still\n"
             "                        causes an exit status of 14\n"
@@ -129,11 +161,323 @@ usage()
             "(it was a single bit).\n");
 }
 
+struct vfy_range_t {
+    uint64_t lba;
+    uint64_t count;
+};
+
+struct vfy_bad_t {
+    uint64_t lba;       /* start of the command that failed */
+    uint32_t num;
+    int res;            /* SG_LIB_CAT_* value */
+    bool info_valid;
+    uint64_t bad_lba;   /* from the sense data INFORMATION field */
+};
+
+/* State shared by the jobs of the ranged (--list=, --parallel= or --json)
+ * scan. Chunks of up to bpc blocks are taken in LBA order from the ranges
+ * so the commands in flight cover adjacent stripes. The next chunk, the
+ * counts and the bad list are updated under sg_par_lock(). */
+struct vfy_scan_t {
+    bool dpo;
+    bool noisy;
+    bool stop;          /* after an error other than medium or miscompare */
+    bool verify16;
+    int sg_fd;
+    int bpc;
+    int group;
+    int vrprotect;
+    int verbose;
+    int num_ranges;
+    int max_ranges;
+    int num_cmds;
+    int num_bad;
+    int max_bad;
+    int res;            /* first failure */
+    int r_idx;          /* next chunk is in this range */
+    uint64_t r_off;     /* at this offset */
+    uint64_t total;     /* blocks in all ranges */
+    uint64_t done_blks;
+    uint64_t start_ns;
+    uint64_t pr_ns;
+    struct vfy_range_t * ranges;
+    struct vfy_bad_t * bads;
+};
+
+static int
+vfy_add_range(struct vfy_scan_t * sp, uint64_t lba, uint64_t count)
+{
+    struct vfy_range_t * rp;
+
+    if (sp->num_ranges >= sp->max_ranges) {
+        int n = sp->max_ranges ? (2 * sp->max_ranges) : 64;
+
+        rp = (struct vfy_range_t *)realloc(sp->ranges, n * sizeof(*rp));
+        if (NULL == rp) {
+            pr2serr("%s: out of memory\n", __func__);
+            return sg_convert_errno(ENOMEM);
+        }
+        sp->ranges = rp;
+        sp->max_ranges = n;
+    }
+    rp = sp->ranges + sp->num_ranges++;
+    rp->lba = lba;
+    rp->count = count;
+    sp->total += count;
+    return 0;
+}
+
+/* Reads LBA,COUNT pairs from the file named fn (stdin if "-"), separated
+ * by whitespace or commas; a '#' starts a comment to the end of a line.
+ * Pairs with a COUNT of 0 are dropped. Returns 0 if ok. */
+static int
+vfy_read_list(const char * fn, struct vfy_scan_t * sp)
+{
+    bool have_stdin = (0 == strcmp(fn, "-"));
+    bool have_lba = false;
+    int j, ret = 0;
+    int64_t ll;
+    uint64_t lba = 0;
+    char * cp;
+    FILE * fp;
+    char line[1024];
+
+    if (have_stdin)
+        fp = stdin;
+    else if (NULL == (fp = fopen(fn, "r"))) {
+        ret = sg_convert_errno(errno);
+        pr2serr("%s: unable to open %s: %s\n", __func__, fn,
+                safe_strerror(errno));
+        return ret;
+    }
+    for (j = 1; fgets(line, sizeof(line), fp); ++j) {
+        cp = strchr(line, '#');
+        if (cp)
+            *cp = '\0';
+        for (cp = strtok(line, " ,\t\r\n"); cp; cp = strtok(NULL, " ,\t\r\n")) {
+            ll = sg_get_llnum(cp);
+            if (ll < 0) {
+                pr2serr("%s: unable to decode '%s' on line %d\n", __func__,
+                        cp, j);
+                ret = SG_LIB_SYNTAX_ERROR;
+                goto fini;
+            }
+            if (! have_lba) {
+                lba = (uint64_t)ll;
+                have_lba = true;
+                continue;
+            }
+            have_lba = false;
+            if (ll > 0) {
+                ret = vfy_add_range(sp, lba, (uint64_t)ll);
+                if (ret)
+                    goto fini;
+            }
+        }
+    }
+    if (have_lba) {
+        pr2serr("%s: expect LBA,COUNT pairs but decoded odd number from "
+                "%s\n", __func__, have_stdin ? "stdin" : fn);
+        ret = SG_LIB_SYNTAX_ERROR;
+    }
+fini:
+    if (! have_stdin)
+        fclose(fp);
+    return ret;
+}
+
+/* Called under sg_par_lock() */
+static void
+vfy_add_bad(struct vfy_scan_t * sp, uint64_t lba, uint32_t num, int res,
+            bool info_valid, uint64_t bad_lba)
+{
+    struct vfy_bad_t * bp;
+
+    if (0 == sp->res)
+        sp->res = res;
+    if (sp->num_bad >= sp->max_bad) {
+        int n = sp->max_bad ? (2 * sp->max_bad) : 64;
+
+        bp = (struct vfy_bad_t *)realloc(sp->bads, n * sizeof(*bp));
+        if (NULL == bp) {
+            pr2serr("%s: out of memory, stopping\n", __func__);
+            sp->stop = true;
+            return;
+        }
+        sp->bads = bp;
+        sp->max_bad = n;
+    }
+    bp = sp->bads + sp->num_bad++;
+    bp->lba = lba;
+    bp->num = num;
+    bp->res = res;
+    bp->info_valid = info_valid;
+    bp->bad_lba = bad_lba;
+}
+
+/* Called under sg_par_lock() after blocks have been verified */
+static void
+vfy_progress(struct vfy_scan_t * sp)
+{
+    uint64_t now = sg_get_mono_ns();
+    double secs, rate;
+
+    if ((now - sp->pr_ns) < ((uint64_t)VFY_PROGRESS_SECS * 1000000000))
+        return;
+    sp->pr_ns = now;
+    secs = (double)(now - sp->start_ns) / 1000000000.0;
+    rate = (secs > 0.0) ? ((double)sp->done_blks / secs) : 0.0;
+    pr2serr("Verify: %.1f%% done, %" PRIu64 " of %" PRIu64 " blocks, %d "
+            "bad", (100.0 * (double)sp->done_blks) / (double)sp->total,
+            sp->done_blks, sp->total, sp->num_bad);
+    if (rate > 0.0)
+        pr2serr(", about %.0f secs to go",
+                (double)(sp->total - sp->done_blks) / rate);
+    pr2serr("\n");
+}
+
+/* Takes the next chunk and verifies it. Returns 1 once the scan should
+ * stop. */
+static int
+vfy_one(int64_t k, void * ctx)
+{
+    bool info_valid, stop;
+    int res, cmds;
+    unsigned int info;
+    uint32_t num, n;
+    uint64_t lba, end, info64;
+    struct vfy_scan_t * sp = (struct vfy_scan_t *)ctx;
+    struct vfy_range_t * rp;
+
+    if (k) { ; }        /* chunks are taken in order, k is not needed */
+    sg_par_lock();
+    while ((sp->r_idx < sp->num_ranges) &&
+           (sp->r_off >= sp->ranges[sp->r_idx].count)) {
+        ++sp->r_idx;
+        sp->r_off = 0;
+    }
+    if (sp->stop || (sp->r_idx >= sp->num_ranges)) {
+        sg_par_unlock();
+        return 1;
+    }
+    rp = sp->ranges + sp->r_idx;
+    lba = rp->lba + sp->r_off;
+    num = ((rp->count - sp->r_off) > (uint64_t)sp->bpc) ?
+          (uint32_t)sp->bpc : (uint32_t)(rp->count - sp->r_off);
+    sp->r_off += num;
+    sg_par_unlock();
+    /* after a medium error, verify the rest of the chunk again */
+    for (cmds = 0, end = lba + num; lba < end; lba += n) {
+        n = (uint32_t)(end - lba);
+        info = 0;
+        info64 = 0;
+        if (sp->verify16)
+            res = sg_ll_verify16(sp->sg_fd, sp->vrprotect, sp->dpo, 0, lba,
+                                 n, sp->group, NULL, 0, &info64, sp->noisy,
+                                 sp->verbose);
+        else {
+            res = sg_ll_verify10(sp->sg_fd, sp->vrprotect, sp->dpo, 0,
+                                 (unsigned int)lba, n, NULL, 0, &info,
+                                 sp->noisy, sp->verbose);
+            info64 = info;
+        }
+        ++cmds;
+        if (0 == res)
+            break;
+        info_valid = (SG_LIB_CAT_MEDIUM_HARD_WITH_INFO == res) &&
+                     (info64 >= lba) && (info64 < end);
+        sg_par_lock();
+        vfy_add_bad(sp, lba, n, res, info_valid, info64);
+        if ((SG_LIB_CAT_MEDIUM_HARD_WITH_INFO != res) &&
+            (SG_LIB_CAT_MEDIUM_HARD != res) &&
+            (SG_LIB_CAT_MISCOMPARE != res))
+            sp->stop = true;
+        sg_par_unlock();
+        if (! info_valid)
+            break;
+        n = (uint32_t)(info64 + 1 - lba);
+    }
+    sg_par_lock();
+    sp->num_cmds += cmds;
+    sp->done_blks += num;
+    vfy_progress(sp);
+    stop = sp->stop;
+    sg_par_unlock();
+    return stop ? 1 : 0;
+}
+
+/* Verifies the ranges in sp with up to num_q commands in flight then
+ * reports (in JSON if jsp->pr_as_json) the failing commands and any bad
+ * LBAs found. Returns 0 if all blocks verified, else the first failure. */
+static int
+vfy_scan(struct vfy_scan_t * sp, int num_q, sgj_state * jsp,
+         sgj_opaque_p jop)
+{
+    int k;
+    uint64_t ns;
+    double secs;
+    const char * vc = sp->verify16 ? "VERIFY(16)" : "VERIFY(10)";
+    struct vfy_bad_t * bp;
+    sgj_opaque_p jo2p, jo3p;
+    sgj_opaque_p jap;
+    char b[80];
+
+    sp->start_ns = sg_get_mono_ns();
+    sp->pr_ns = sp->start_ns;
+    for (k = 0, ns = 0; k < sp->num_ranges; ++k)
+        ns += (sp->ranges[k].count + sp->bpc - 1) / sp->bpc;
+    sg_par_each((int64_t)ns, num_q, vfy_one, sp);
+    ns = sg_get_mono_ns() - sp->start_ns;
+    secs = (double)ns / 1000000000.0;
+
+    jo2p = sgj_named_subobject_r(jsp, jop, "verify_summary");
+    sgj_pr_hr(jsp, "%s of %" PRIu64 " blocks in %d range%s: %d commands, "
+              "%d failed", vc, sp->total, sp->num_ranges,
+              (1 == sp->num_ranges) ? "" : "s", sp->num_cmds, sp->num_bad);
+    if (secs > 0.0)
+        sgj_pr_hr(jsp, ", %.3f secs", secs);
+    sgj_pr_hr(jsp, "\n");
+    if (sp->stop && (sp->done_blks < sp->total))
+        sgj_pr_hr(jsp, "  stopped after %" PRIu64 " blocks\n",
+                  sp->done_blks);
+    sgj_js_nv_i(jsp, jo2p, "number_of_ranges", sp->num_ranges);
+    sgj_js_nv_i(jsp, jo2p, "number_of_blocks", (int64_t)sp->total);
+    sgj_js_nv_i(jsp, jo2p, "verified_blocks", (int64_t)sp->done_blks);
+    sgj_js_nv_i(jsp, jo2p, "number_of_commands", sp->num_cmds);
+    sgj_js_nv_i(jsp, jo2p, "number_of_failed_commands", sp->num_bad);
+    sgj_js_nv_i(jsp, jo2p, "elapsed_ms", (int64_t)(ns / 1000000));
+    jap = sgj_named_subarray_r(jsp, jo2p, "failed_command_list");
+    for (k = 0, bp = sp->bads; k < sp->num_bad; ++k, ++bp) {
+        sg_get_category_sense_str(bp->res, sizeof(b), b, sp->verbose);
+        if (bp->info_valid)
+            sgj_pr_hr(jsp, "  bad LBA 0x%" PRIx64 " in command from LBA 0x%"
+                      PRIx64 " for %u blocks: %s\n", bp->bad_lba, bp->lba,
+                      bp->num, b);
+        else
+            sgj_pr_hr(jsp, "  command from LBA 0x%" PRIx64 " for %u "
+                      "blocks: %s\n", bp->lba, bp->num, b);
+        if (jsp->pr_as_json) {
+            jo3p = sgj_new_unattached_object_r(jsp);
+            sgj_js_nv_ihex(jsp, jo3p, "lba", (int64_t)bp->lba);
+            sgj_js_nv_i(jsp, jo3p, "number_of_blocks", bp->num);
+            if (bp->info_valid)
+                sgj_js_nv_ihex(jsp, jo3p, "bad_lba", (int64_t)bp->bad_lba);
+            sgj_js_nv_istr(jsp, jo3p, "sense_category", bp->res, NULL, b);
+            sgj_js_nv_o(jsp, jap, NULL /* name */, jo3p);
+        }
+    }
+    return sp->res;
+}
+
+
 int
 main(int argc, char * argv[])
 {
     bool bpc_given = false;
+    bool count_given = false;
+    bool do_json = false;
     bool dpo = false;
+    bool lba_given = false;
     bool ff_given = false;
     bool got_stdin = false;
     bool quiet = false;
@@ -142,7 +486,7 @@ main(int argc, char * argv[])
     bool verify16 = false;
     bool version_given = false;
     bool zero_given = false;
-    int res, c, num, nread, infd;
+    int res, c, k, num, nread, infd;
     int sg_fd = -1;
     int bpc = 128;
     int group = 0;
@@ -151,6 +495,7 @@ main(int argc, char * argv[])
     int verbose = 0;
     int ret = 0;
     int vrprotect = 0;
+    int num_q = 1;
     unsigned int info = 0;
     int64_t count = 1;
     int64_t ll;
@@ -162,13 +507,23 @@ main(int argc, char * argv[])
     uint8_t * free_ref_data = NULL;
     const char * device_name = NULL;
     const char * file_name = NULL;
+    const char * json_arg = NULL;
+    const char * list_fn = NULL;
     const char * vc;
+    sgj_opaque_p jop = NULL;
+    sgj_state * jsp;
+    struct vfy_scan_t scan;
+    sgj_state json_st;
     char ebuff[EBUFF_SZ];
 
+    memset(&scan, 0, sizeof(scan));
+    memset(&json_st, 0, sizeof(json_st));
+    jsp = &json_st;
+
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "0b:B:c:dE:fg:hi:l:n:P:qrSvV",
+        c = getopt_long(argc, argv, "0b:B:c:dE:fg:hi:j::l:L:n:p:P:qrSvV",
                         long_options, &option_index);
         if (c == -1)
             break;
@@ -191,6 +546,7 @@ main(int argc, char * argv[])
                 pr2serr("bad argument to '--count'\n");
                 return SG_LIB_SYNTAX_ERROR;
             }
+            count_given = true;
             break;
         case 'd':
             dpo = true;
@@ -219,6 +575,15 @@ main(int argc, char * argv[])
         case 'i':
             file_name = optarg;
             break;
+        case 'j':       /* for: -j[=JO] */
+        case '^':       /* for: --json[=JO] */
+            do_json = true;
+            if (optarg)
+                json_arg = (('j' == c) && ('=' == *optarg)) ? optarg + 1 :
+                                                              optarg;
+            else
+                json_arg = NULL;
+            break;
         case 'l':
             ll = sg_get_llnum(optarg);
             if (-1 == ll) {
@@ -226,6 +591,10 @@ main(int argc, char * argv[])
                 return SG_LIB_SYNTAX_ERROR;
             }
             lba = (uint64_t)ll;
+            lba_given = true;
+            break;
+        case 'L':
+            list_fn = optarg;
             break;
         case 'n':       /* number of bytes in data-out buffer */
         case 'B':       /* undocumented, old --bytchk=NDO option */
@@ -235,6 +604,11 @@ main(int argc, char * argv[])
                 return SG_LIB_SYNTAX_ERROR;
             }
             break;
+        case 'p':
+            num_q = sg_par_get_num(optarg, 1, MAX_VFY_PARALLEL);
+            if (num_q < 0)
+                return SG_LIB_SYNTAX_ERROR;
+            break;
         case 'P':
             vrprotect = sg_get_num(optarg);
             if (-1 == vrprotect) {
@@ -322,6 +696,54 @@ main(int argc, char * argv[])
                 file_name);
         return SG_LIB_CONTRADICT;
     }
+    if (list_fn || (num_q > 1) || do_json) {
+        uint64_t end;
+
+        if (ndo > 0) {
+            pr2serr("--list=, --parallel= and --json can't be used with "
+                    "--ndo=\n");
+            return SG_LIB_CONTRADICT;
+        }
+        if (list_fn && (lba_given || count_given)) {
+            pr2serr("--list=LF can't be used with --lba= or --count=\n");
+            return SG_LIB_CONTRADICT;
+        }
+        if (do_json) {
+            if (! sgj_init_state(jsp, json_arg)) {
+                int bad_char = jsp->first_bad_char;
+                char e[1500];
+
+                if (bad_char)
+                    pr2serr("bad argument to --json= option, unrecognized "
+                            "character '%c'\n\n", bad_char);
+                sg_json_usage(0, e, sizeof(e));
+                pr2serr("%s", e);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            jop = sgj_start_r(MY_NAME, version_str, argc, argv, jsp);
+        }
+        if (list_fn)
+            ret = vfy_read_list(list_fn, &scan);
+        else if (count > 0)
+            ret = vfy_add_range(&scan, lba, (uint64_t)count);
+        if (ret)
+            goto err_out;
+        if (0 == scan.num_ranges) {
+            pr2serr("no blocks to verify\n");
+            ret = SG_LIB_SYNTAX_ERROR;
+            goto err_out;
+        }
+        for (k = 0; k < scan.num_ranges; ++k) {
+            end = scan.ranges[k].lba + scan.ranges[k].count - 1;
+            if ((end > 0xffffffffLLU) && (! verify16)) {
+                pr2serr("'lba' exceed 32 bits, so use VERIFY(16)\n");
+                verify16 = true;
+            }
+        }
+        /* checked below as for a single range */
+        lba = 0;
+        count = 1;
+    }
 
     if ((bpc > 0xffff) && (! verify16)) {
         pr2serr("'%s' exceeds 65535, so use VERIFY(16)\n",
@@ -395,6 +817,18 @@ skip:
         goto err_out;
     }
 
+    if (scan.num_ranges > 0) {
+        scan.sg_fd = sg_fd;
+        scan.bpc = bpc;
+        scan.dpo = dpo;
+        scan.group = group;
+        scan.vrprotect = vrprotect;
+        scan.verify16 = verify16;
+        scan.noisy = ! quiet;
+        scan.verbose = verbose;
+        ret = vfy_scan(&scan, num_q, jsp, jop);
+        goto err_out;
+    }
     vc = verify16 ? "VERIFY(16)" : "VERIFY(10)";
     for (; count > 0; count -= bpc, lba += bpc) {
         num = (count > bpc) ? bpc : count;
@@ -459,10 +893,17 @@ skip:
     }
     if (free_ref_data)
         free(free_ref_data);
-    if (0 == verbose) {
+    free(scan.ranges);
+    free(scan.bads);
+    if ((0 == verbose) && (scan.num_ranges < 1)) {
         if (! sg_if_can2stderr("sg_verify failed: ", ret))
             pr2serr("Some error occurred, try again with '-v' "
                     "or '-vv' for more information\n");
     }
-    return (ret >= 0) ? ret : SG_LIB_CAT_OTHER;
+    ret = (ret >= 0) ? ret : SG_LIB_CAT_OTHER;
+    if (jsp->pr_as_json) {
+        sgj_js2file(jsp, NULL, ret, stdout);
+        sgj_finish(jsp);
+    }
+    return ret;
 }
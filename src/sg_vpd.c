@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2006-2023 Douglas Gilbert.
+ * Copyright (c) 2006-2026 Douglas Gilbert.
  * All rights reserved.
  * Use of this source code is governed by a BSD-style
  * license that can be found in the BSD_LICENSE file.
@@ -29,10 +29,14 @@
 #include "sg_lib.h"
 #include "sg_cmds_basic.h"
 #include "sg_pt.h"
+#include "sg_mux.h"
 #include "sg_unaligned.h"
+#include "sg_par.h"
 #include "sg_pr2serr.h"
 
 #include "sg_vpd_common.h"      /* shared with sg_inq */
+#include "sg_rcache.h"
+#include "sg_batch.h"
 
 /* This utility program was originally written for the Linux OS SCSI subsystem.
 
@@ -43,7 +47,7 @@
 
 */
 
-static const char * version_str = "1.96 20230518";  /* spc6r08 + sbc5r04 */
+static const char * version_str = "2.04 20261015";  /* spc6r08 + sbc5r04 */
 
 #define MY_NAME "sg_vpd"
 
@@ -69,24 +73,90 @@ static const char * version_str = "1.96 20230518";  /* spc6r08 + sbc5r04 */
 #define INQUIRY_CMDLEN  6
 #define DEF_PT_TIMEOUT  60       /* 60 seconds */
 
+/* For several DEVICEs (inventory mode) */
+#define INV_DEF_PAGES "sinq,di,sn"
+#define INV_MAX_PAGES 32
+#define INV_DEF_PARALLEL 32
+#define INV_MAX_PARALLEL 4096
+
+/* --all on a DEVICE */
+#define ALL_DEF_ALLOC_LEN 1024  /* first try for pages without a size hint */
+#define ALL_MAX_PARALLEL 8
+
+struct inv_page_t {
+    int pn;             /* VPD_NOPE_WANT_STD_INQ for standard INQUIRY */
+    int subvalue;
+};
+
+struct inv_dev_t {
+    bool in_flight;
+    bool done;          /* all pages fetched (or failed) */
+    bool sync_only;     /* read-only or no mux: command completes on submit */
+    int fd;
+    int pg_idx;         /* index into pages[] of next (or current) */
+    int ret;            /* first error, 0 if none */
+    const char * name;
+    struct sg_pt_base * ptvp;
+    uint8_t * resp;     /* num_pages responses, each alloc_len bytes */
+    int * resp_len;
+    int * resp_res;     /* 0 or error of the fetch of that page */
+    const struct opts_t * op;
+    struct sg_mux_cmd mc;
+    uint8_t cdb[INQUIRY_CMDLEN];
+    uint8_t sense_b[SENSE_BUFF_LEN];
+};
+
+/* The --devices=FN and --pages=PL inventory, pointed to by op->invp */
+struct inv_state_t {
+    int num_pages;
+    int alloc_len;
+    int num_names;
+    int max_names;
+    int num_args;       /* leading names[] from command line */
+    const char ** names;
+    struct sg_mux * mxp;        /* NULL: no asynchronous interface */
+    struct inv_page_t pages[INV_MAX_PAGES];
+};
+
+/* One VPD page of --all, fetched ahead of being decoded */
+struct all_page_t {
+    bool want;          /* (re-)fetch in the next round */
+    int pn;
+    int alloc_len;
+    int len;            /* bytes of the response held at rp */
+    int full_len;       /* page length field + 4 */
+    int res;
+    uint8_t * rp;
+    uint8_t * free_rp;
+};
+
+struct all_fetch_t {
+    int sg_fd;
+    int num_pages;
+    int vb;
+    bool qt;
+    struct all_page_t * pages;
+};
+
 
-uint8_t * rsp_buff;
 
 static int svpd_decode_t10(struct sg_pt_base * ptvp, struct opts_t * op,
                            sgj_opaque_p jop, int subvalue, int off,
                            const char * prefix);
 
 static int filter_dev_ids(const char * print_if_found, int num_leading,
-                          uint8_t * buff, int len, int m_assoc,
+                          uint8_t * buff, int len,
+                          const struct sg_vpd_dev_id_idx * ixp, int m_assoc,
                           struct opts_t * op, sgj_opaque_p jop);
 
 static const int rsp_buff_sz = MX_ALLOC_LEN + 2;
 
-static uint8_t * free_rsp_buff;
-
 static struct option long_options[] = {
         {"all", no_argument, 0, 'a'},
+        {"batch", required_argument, 0, 'B'},
+        {"cache", required_argument, 0, 'C'},
         {"debug", no_argument, 0, 'D'},
+        {"devices", required_argument, 0, 'd'},
         {"enumerate", no_argument, 0, 'e'},
         {"examine", no_argument, 0, 'E'},
         {"force", no_argument, 0, 'f'},
@@ -99,7 +169,11 @@ static struct option long_options[] = {
         {"js_file", required_argument, 0, 'J'},
         {"long", no_argument, 0, 'l'},
         {"maxlen", required_argument, 0, 'm'},
+        {"no-inquiry", no_argument, 0, 'n'},
+        {"no_inquiry", no_argument, 0, 'n'},
         {"page", required_argument, 0, 'p'},
+        {"pages", required_argument, 0, 'L'},
+        {"parallel", required_argument, 0, 'P'},
         {"quiet", no_argument, 0, 'q'},
         {"raw", no_argument, 0, 'r'},
         {"sinq_inraw", required_argument, 0, 'Q'},
@@ -179,19 +253,33 @@ static struct svpd_values_name_t standard_vpd_pg[] = {
 static void
 usage()
 {
-    pr2serr("Usage: sg_vpd  [--all] [--enumerate] [--examine] [--force] "
-            "[--help] [--hex]\n"
-            "               [--ident] [--inhex=FN] [--json[=JO]] "
-            "[--js-file=JFN]\n"
-            "               [--long] [--maxlen=LEN] [--page=PG] [--quiet] "
+    pr2serr("Usage: sg_vpd  [--all] [--batch=MF] [--cache=DIR] [--devices=FN] "
+            "[--enumerate]\n"
+            "               [--examine] [--force] [--help] [--hex] [--ident] "
+            "[--inhex=FN]\n"
+            "               [--json[=JO]]\n"
+            "               [--js-file=JFN] [--long] [--maxlen=LEN] "
+            "[--no-inquiry]\n"
+            "               [--page=PG] [--pages=PL] [--parallel=P] [--quiet] "
             "[--raw]\n"
             "               [--sinq_inraw=RFN] [--vendor=VP] [--verbose] "
             "[--version]\n"
-            "               DEVICE\n");
+            "               DEVICE*\n");
     pr2serr("  where:\n"
             "    --all|-a        output all pages listed in the supported "
             "pages VPD\n"
             "                    page\n"
+            "    --batch=MF|-B MF    decode each blob named in manifest MF "
+            "(lines of\n"
+            "                        'TAG FN [bin|hex]') as with --inhex=FN, "
+            "output\n"
+            "                        a JSON line for each\n"
+            "    --cache=DIR|-C DIR    reuse responses cached in directory "
+            "DIR while\n"
+            "                          the DEVICE reports no unit attention\n"
+            "    --devices=FN|-d FN    read DEVICE names from file FN, one "
+            "per line\n"
+            "                          ('-' for stdin)\n"
             "    --enumerate|-e    enumerate known VPD pages names (ignore "
             "DEVICE),\n"
             "                      can be used with --page=num to search\n"
@@ -219,12 +307,27 @@ usage()
             "    --maxlen=LEN|-m LEN    max response length (allocation "
             "length in cdb)\n"
             "                           (def: 0 -> 252 bytes)\n"
+            "    --no-inquiry|-n    same as --force, for scripts: no "
+            "preliminary\n"
+            "                       INQUIRY, just fetch the requested "
+            "page\n"
             "    --page=PG|-p PG    fetch VPD page where PG is an "
             "acronym, or a decimal\n"
             "                       number unless hex indicator "
             "is given (e.g. '0x83');\n"
             "                       can also take PG,VP as an "
             "operand\n"
+            "    --pages=PL|-L PL    comma separated list of pages (as for "
+            "--page=PG)\n"
+            "                        fetched from each DEVICE (def: "
+            "'%s')\n"
+            "    --parallel=P|-P P    with several DEVICEs, up to P of "
+            "them have an\n"
+            "                         INQUIRY in flight (def: %d); with "
+            "--batch=MF\n"
+            "                         up to P blobs are decoded at once "
+            "(def: number\n"
+            "                         of processors)\n"
             "    --quiet|-q      suppress some decoding and error output\n"
             "    --raw|-r        output page in binary; if --inhex=FN is "
             "also\n"
@@ -240,7 +343,12 @@ usage()
             "Fetch Vital Product Data (VPD) page using SCSI INQUIRY or "
             "decodes VPD\npage response held in file FN. To list available "
             "pages use '-e'. Also\n'-p -1' or '-p sinq' yields the standard "
-            "INQUIRY response.\n");
+            "INQUIRY response.\n"
+            "With several DEVICEs (or --devices= or --pages=) the pages "
+            "in PL are\nfetched from each DEVICE using asynchronous "
+            "commands and the output of\neach DEVICE follows when it "
+            "completes. '--json=r' gives one line per\nDEVICE.\n",
+            INV_DEF_PAGES, INV_DEF_PARALLEL);
 }
 
 static const struct svpd_values_name_t *
@@ -423,6 +531,7 @@ device_id_vpd_variants(uint8_t * buff, int len, int subvalue,
 {
     int m_a, blen;
     uint8_t * b;
+    struct sg_vpd_dev_id_idx di_idx;
 
     if (len < 4) {
         pr2serr("%s %s=%d\n", di_vpdp,  lts_s, len);
@@ -431,25 +540,27 @@ device_id_vpd_variants(uint8_t * buff, int len, int subvalue,
     blen = len - 4;
     b = buff + 4;
     m_a = -1;
+    /* one pass over the page, then each association visits only its own */
+    sg_vpd_dev_id_index(b, blen, &di_idx);
     if (0 == subvalue) {
         filter_dev_ids(sg_get_desig_assoc_str(VPD_ASSOC_LU), 0, b, blen,
-                       VPD_ASSOC_LU, op, jap);
+                       &di_idx, VPD_ASSOC_LU, op, jap);
         filter_dev_ids(sg_get_desig_assoc_str(VPD_ASSOC_TPORT), 0, b, blen,
-                       VPD_ASSOC_TPORT, op, jap);
+                       &di_idx, VPD_ASSOC_TPORT, op, jap);
         filter_dev_ids(sg_get_desig_assoc_str(VPD_ASSOC_TDEVICE), 0, b, blen,
-                       VPD_ASSOC_TDEVICE, op, jap);
+                       &di_idx, VPD_ASSOC_TDEVICE, op, jap);
     } else if (VPD_DI_SEL_AS_IS == subvalue)
-        filter_dev_ids(NULL, 0, b, blen, m_a, op, jap);
+        filter_dev_ids(NULL, 0, b, blen, &di_idx, m_a, op, jap);
     else {
         if (VPD_DI_SEL_LU & subvalue)
             filter_dev_ids(sg_get_desig_assoc_str(VPD_ASSOC_LU), 0, b, blen,
-                           VPD_ASSOC_LU, op, jap);
+                           &di_idx, VPD_ASSOC_LU, op, jap);
         if (VPD_DI_SEL_TPORT & subvalue)
             filter_dev_ids(sg_get_desig_assoc_str(VPD_ASSOC_TPORT), 0, b,
-                           blen, VPD_ASSOC_TPORT, op, jap);
+                           blen, &di_idx, VPD_ASSOC_TPORT, op, jap);
         if (VPD_DI_SEL_TARGET & subvalue)
             filter_dev_ids(sg_get_desig_assoc_str(VPD_ASSOC_TDEVICE), 0,
-                           b, blen, VPD_ASSOC_TDEVICE, op, jap);
+                           b, blen, &di_idx, VPD_ASSOC_TDEVICE, op, jap);
     }
 }
 
@@ -600,7 +711,7 @@ decode_scsi_ports_vpd_4vpd(uint8_t * buff, int len, struct opts_t * op,
                                         "designation_descriptor_list");
                 }
                 filter_dev_ids("", 2 /* leading spaces */, bp + bump + 4,
-                               tpd_len, VPD_ASSOC_TPORT, op, ja2p);
+                               tpd_len, NULL, VPD_ASSOC_TPORT, op, ja2p);
             }
         }
         bump += tpd_len + 4;
@@ -612,7 +723,8 @@ decode_scsi_ports_vpd_4vpd(uint8_t * buff, int len, struct opts_t * op,
    selected by association, designator type and/or code set. Not used
    for JSON output. */
 static int
-filter_dev_ids_quiet(uint8_t * buff, int len, int m_assoc)
+filter_dev_ids_quiet(uint8_t * buff, int len,
+                     const struct sg_vpd_dev_id_idx * ixp, int m_assoc)
 {
     int k, m, p_id, c_set, piv, desig_type, i_len, naa, off, u;
     int assoc, is_sas, rtp;
@@ -634,7 +746,7 @@ filter_dev_ids_quiet(uint8_t * buff, int len, int m_assoc)
             desig_type = 3;
             i_len = 16;
         } else {
-            u = sg_vpd_dev_id_iter(buff, len, &off, m_assoc, -1, -1);
+            u = sg_vpd_dev_id_next(ixp, &off, m_assoc, -1, -1);
             if (0 != u)
                 break;
             bp = buff + off;
@@ -807,10 +919,12 @@ filter_dev_ids_quiet(uint8_t * buff, int len, int m_assoc)
 }
 
 /* Prints outs designation descriptors (dd_s) selected by association,
-   designator type and/or code set. VPD_DEVICE_ID and VPD_SCSI_PORTS */
+   designator type and/or code set. VPD_DEVICE_ID and VPD_SCSI_PORTS. If
+   ixp is NULL the dd_s in buff are indexed here. */
 static int
 filter_dev_ids(const char * print_if_found, int num_leading, uint8_t * buff,
-               int len, int m_assoc, struct opts_t * op, sgj_opaque_p jap)
+               int len, const struct sg_vpd_dev_id_idx * ixp, int m_assoc,
+               struct opts_t * op, sgj_opaque_p jap)
 {
     bool printed, sgj_out_hr;
     int assoc, off, u, i_len;
@@ -819,12 +933,17 @@ filter_dev_ids(const char * print_if_found, int num_leading, uint8_t * buff,
     char b[1024];
     char sp[82];
     static const int blen = sizeof(b);
+    struct sg_vpd_dev_id_idx di_idx;
 
+    if (NULL == ixp) {
+        sg_vpd_dev_id_index(buff, len, &di_idx);
+        ixp = &di_idx;
+    }
     if (op->do_quiet && (! jsp->pr_as_json))
-        return filter_dev_ids_quiet(buff, len, m_assoc);
+        return filter_dev_ids_quiet(buff, len, ixp, m_assoc);
     sgj_out_hr = false;
     if (jsp->pr_as_json) {
-        int ret = filter_json_dev_ids(buff, len, m_assoc, op, jap);
+        int ret = filter_json_dev_ids(buff, len, ixp, m_assoc, op, jap);
 
         if (ret || (! jsp->pr_out_hr))
             return ret;
@@ -845,7 +964,7 @@ filter_dev_ids(const char * print_if_found, int num_leading, uint8_t * buff,
     }
     off = -1;
     printed = false;
-    while ((u = sg_vpd_dev_id_iter(buff, len, &off, m_assoc, -1, -1)) == 0) {
+    while ((u = sg_vpd_dev_id_next(ixp, &off, m_assoc, -1, -1)) == 0) {
         bp = buff + off;
         i_len = bp[3];
         if ((off + i_len + 4) > len) {
@@ -1094,7 +1213,7 @@ svpd_unable_to_decode(struct sg_pt_base * ptvp, struct opts_t * op,
     hex0 = (0 == dhex);
     b[0] = '\0';
     pg_c = op->vpd_pn;
-    rp = rsp_buff + off;
+    rp = op->rsp_buff + off;
     if (hex0 && (! op->do_raw) && (! op->examine_given))
         sgj_pr_hr(jsp, "Only hex output supported\n");
     if (subvalue)
@@ -1222,7 +1341,7 @@ svpd_decode_t10(struct sg_pt_base * ptvp, struct opts_t * op,
     else
         allow_name = true;
     allow_if_found = op->examine_given && (! op->do_quiet);
-    rp = rsp_buff + off;
+    rp = op->rsp_buff + off;
     if ((off > 0) && (VPD_NOPE_WANT_STD_INQ != op->vpd_pn))
         pn = rp[1];
     else
@@ -2236,16 +2355,168 @@ svpd_decode_t10(struct sg_pt_base * ptvp, struct opts_t * op,
     return res;
 }
 
+/* The VPD pages in one response set (e.g. as captured by 'sg_vpd --all
+ * --hex' from one device) are in ascending page number order. So with
+ * --inhex=FN, a page number that is not larger than the one before it starts
+ * another response set. Returns the number of response sets in the first
+ * in_len bytes of bp. */
+static int
+inhex_num_resp_sets(const uint8_t * bp, int in_len)
+{
+    int off, pn;
+    int prev_pn = -1;
+    int num = 0;
+
+    for (off = 0; (in_len - off) >= 4;
+         off += sg_get_unaligned_be16(bp + off + 2) + 4) {
+        pn = bp[off + 1];
+        if ((0 == num) || (pn <= prev_pn))
+            ++num;
+        prev_pn = pn;
+    }
+    return num;
+}
+
+/* Allocation length for the first fetch of VPD page pn by --all: the
+ * length of the cached response when the response cache has it, else a
+ * hint for pages that tend to be long, else ALL_DEF_ALLOC_LEN. */
+static int
+all_alloc_hint(int sg_fd, int pn)
+{
+    uint8_t b[4];
+    char name[16];
+
+    if (sg_rcache_active(sg_fd)) {
+        snprintf(name, sizeof(name), "vpd_%02x", pn);
+        if (4 == sg_rcache_get(sg_fd, name, b, sizeof(b)))
+            return sg_get_unaligned_be16(b + 2) + 4;
+    }
+    switch (pn) {
+    case VPD_SCSI_PORTS:
+        return 4096;
+    case VPD_ATA_INFO:
+        return VPD_ATA_INFO_LEN;
+    default:
+        return ALL_DEF_ALLOC_LEN;
+    }
+}
+
+/* Fetches the page at pp, checking it as vpd_fetch_page() does */
+static void
+all_fetch_page(struct all_page_t * pp, const struct all_fetch_t * afp)
+{
+    int resid = 0;
+    int n;
+
+    pp->want = false;
+    pp->len = 0;
+    pp->full_len = 0;
+    pp->res = sg_ll_inquiry_v2(afp->sg_fd, true, pp->pn, pp->rp,
+                               pp->alloc_len, DEF_PT_TIMEOUT, &resid,
+                               ! afp->qt, afp->vb);
+    if (pp->res)
+        return;
+    n = pp->alloc_len - resid;
+    if ((n < 4) || (pp->pn != pp->rp[1]) ||
+        ((0x80 == pp->pn) && (0x2 == pp->rp[2]) && (0x2 == pp->rp[3]))) {
+        if (! afp->qt)
+            pr2serr("invalid response to VPD page 0x%x\n", pp->pn);
+        pp->res = SG_LIB_CAT_MALFORMED;
+        return;
+    }
+    pp->full_len = sg_get_unaligned_be16(pp->rp + 2) + 4;
+    pp->len = (pp->full_len < n) ? pp->full_len : n;
+}
+
+/* Called by sg_par_each() for the k-th page */
+static int
+all_fetch_one(int64_t k, void * ctx)
+{
+    struct all_fetch_t * afp = (struct all_fetch_t *)ctx;
+
+    if (afp->pages[k].want)
+        all_fetch_page(afp->pages + k, afp);
+    return 0;
+}
+
+/* Fetches the pages listed in the Supported VPD pages page at vpd0_rp
+ * (n entries) that are not above max_pn, all at once: each with an
+ * allocation length from all_alloc_hint() (or --maxlen=LEN), then again
+ * only for those that were truncated. Returns an array of num_pages or
+ * NULL if out of memory. */
+static struct all_page_t *
+all_fetch_pages(int sg_fd, const uint8_t * vpd0_rp, int n, int max_pn,
+                const struct opts_t * op, int * num_pagesp)
+{
+    int k, num, num_want;
+    struct all_page_t * pp;
+    struct all_fetch_t af;
+
+    memset(&af, 0, sizeof(af));
+    af.pages = (struct all_page_t *)calloc(n > 0 ? n : 1,
+                                           sizeof(struct all_page_t));
+    if (NULL == af.pages)
+        return NULL;
+    for (k = 0, num = 0; k < n; ++k) {
+        if (vpd0_rp[4 + k] > max_pn)
+            continue;
+        pp = af.pages + num++;
+        pp->pn = vpd0_rp[4 + k];
+        pp->want = true;
+        pp->alloc_len = (op->maxlen > 0) ? op->maxlen :
+                                           all_alloc_hint(sg_fd, pp->pn);
+    }
+    af.sg_fd = sg_fd;
+    af.num_pages = num;
+    af.vb = op->verbose;
+    af.qt = op->do_quiet;
+    for (num_want = num; num_want > 0; ) {
+        for (k = 0; k < num; ++k) {
+            pp = af.pages + k;
+            if (! pp->want)
+                continue;
+            pp->rp = sg_memalign(pp->alloc_len, 0, &pp->free_rp, false);
+            if (NULL == pp->rp) {
+                pp->res = sg_convert_errno(ENOMEM);
+                pp->want = false;
+            }
+        }
+        /* up to ALL_MAX_PARALLEL INQUIRY commands in flight, each from
+         * its own thread sharing sg_fd */
+        sg_par_each(num, ALL_MAX_PARALLEL, all_fetch_one, &af);
+        if (op->maxlen > 0)
+            break;      /* as with a single page, truncate to --maxlen= */
+        for (k = 0, num_want = 0; k < num; ++k) {
+            pp = af.pages + k;
+            if ((0 == pp->res) && (pp->full_len > pp->alloc_len) &&
+                (pp->full_len <= MX_ALLOC_LEN)) {
+                if (op->verbose > 1)
+                    pr2serr("%s: VPD page 0x%x truncated at %d bytes, "
+                            "fetch %d\n", __func__, pp->pn, pp->alloc_len,
+                            pp->full_len);
+                free(pp->free_rp);
+                pp->free_rp = NULL;
+                pp->alloc_len = pp->full_len;
+                pp->want = true;
+                ++num_want;
+            }
+        }
+    }
+    *num_pagesp = num;
+    return af.pages;
+}
+
 static int
 svpd_decode_all(struct sg_pt_base * ptvp, struct opts_t * op,
                 sgj_opaque_p jop)
 {
-    int k, res, rlen, n, pn;
+    int k, res, rlen, n, pn, num_pages;
     int max_pn = 255;
     int any_err = 0;
     sgj_state * jsp = &op->json_st;
     uint8_t vpd0_buff[512];
     uint8_t * rp = vpd0_buff;
+    struct all_page_t * pages;
 
     if (op->vpd_pn > 0)
         max_pn = op->vpd_pn;
@@ -2273,10 +2544,15 @@ svpd_decode_all(struct sg_pt_base * ptvp, struct opts_t * op,
                         n + 4);
             n = (rlen - 4);
         }
-        for (k = 0; k < n; ++k) {
-            pn = rp[4 + k];
-            if (pn > max_pn)
-                continue;
+        pages = all_fetch_pages(get_pt_file_handle(ptvp), rp, n, max_pn, op,
+                                &num_pages);
+        if (NULL == pages) {
+            pr2serr("%s: out of memory\n", __func__);
+            return sg_convert_errno(ENOMEM);
+        }
+        rlen = op->maxlen;
+        for (k = 0; k < num_pages; ++k) {
+            pn = pages[k].pn;
             op->vpd_pn = pn;
             if (k > 0)
                 sgj_pr_hr(jsp, "\n");
@@ -2287,11 +2563,18 @@ svpd_decode_all(struct sg_pt_base * ptvp, struct opts_t * op,
                     printf("[0x%x] ", pn);
             }
 
-            res = svpd_decode_t10(ptvp, op, jop, 0, 0, NULL);
-            if (SG_LIB_CAT_OTHER == res) {
-                res = svpd_decode_vendor(ptvp, op, jop, 0);
-                if (SG_LIB_CAT_OTHER == res)
-                    res = svpd_unable_to_decode(ptvp, op, jop, 0, 0);
+            /* decode the response held, as if read with --inhex=FN */
+            res = pages[k].res;
+            if (0 == res) {
+                memcpy(op->rsp_buff, pages[k].rp, pages[k].len);
+                op->maxlen = pages[k].len;
+                res = svpd_decode_t10(NULL, op, jop, 0, 0, NULL);
+                if (SG_LIB_CAT_OTHER == res) {
+                    res = svpd_decode_vendor(NULL, op, jop, 0);
+                    if (SG_LIB_CAT_OTHER == res)
+                        res = svpd_unable_to_decode(NULL, op, jop, 0, 0);
+                }
+                op->maxlen = rlen;
             }
             if (! op->do_quiet) {
                 if (SG_LIB_CAT_ABORTED_COMMAND == res)
@@ -2306,18 +2589,33 @@ svpd_decode_all(struct sg_pt_base * ptvp, struct opts_t * op,
             if (res)
                 any_err = res;
         }
+        for (k = 0; k < num_pages; ++k)
+            free(pages[k].free_rp);
+        free(pages);
         res = any_err;
     } else {    /* input is coming from --inhex=FN */
-        int bump, off;
+        bool multi;
+        int bump, off, num_sets;
         int in_len = op->maxlen;
         int prev_pn = -1;
+        sgj_opaque_p jo2p = jop;
+        sgj_opaque_p jap = NULL;
 
         res = 0;
         if (op->page_given && (VPD_NOPE_WANT_STD_INQ == op->vpd_pn))
             return svpd_decode_t10(NULL, op, jop, 0, 0, NULL);
 
-        for (off = 0; off < in_len; off += bump) {
-            rp = rsp_buff + off;
+        num_sets = inhex_num_resp_sets(op->rsp_buff, in_len);
+        multi = (num_sets > 1);
+        if (multi && jsp->pr_as_json)
+            jap = sgj_named_subarray_r(jsp, jop, "response_set_list");
+        for (off = 0, num_sets = 0; off < in_len; off += bump) {
+            if ((in_len - off) < 4) {
+                pr2serr("%s: %d bytes left over at end, ignored\n", __func__,
+                        in_len - off);
+                break;
+            }
+            rp = op->rsp_buff + off;
             pn = rp[1];
             bump = sg_get_unaligned_be16(rp + 2) + 4;
             if ((off + bump) > in_len) {
@@ -2325,14 +2623,20 @@ svpd_decode_all(struct sg_pt_base * ptvp, struct opts_t * op,
                         pn, bump);
                 bump = in_len - off;
             }
-            if (op->page_given && (pn != op->vpd_pn))
-                continue;
-            if (pn <= prev_pn) {
-                pr2serr("%s: prev_pn=0x%x, this pn=0x%x, not ascending so "
-                        "exit\n", __func__, prev_pn, pn);
-                break;
+            if ((0 == num_sets) || (pn <= prev_pn)) {
+                ++num_sets;
+                if (multi) {
+                    sgj_pr_hr(jsp, "%sResponse set %d, at offset %d:\n",
+                              ((num_sets > 1) ? "\n" : ""), num_sets, off);
+                    if (jap) {
+                        jo2p = sgj_new_unattached_object_r(jsp);
+                        sgj_js_nv_o(jsp, jap, NULL /* name */, jo2p);
+                    }
+                }
             }
             prev_pn = pn;
+            if (op->page_given && (pn != op->vpd_pn))
+                continue;
             op->vpd_pn = pn;
             if (pn > max_pn) {
                 if (op->verbose > 2)
@@ -2347,11 +2651,11 @@ svpd_decode_all(struct sg_pt_base * ptvp, struct opts_t * op,
                     sgj_pr_hr(jsp, "[0x%x] ", pn);
             }
 
-            res = svpd_decode_t10(NULL, op, jop, 0, off, NULL);
+            res = svpd_decode_t10(NULL, op, jo2p, 0, off, NULL);
             if (SG_LIB_CAT_OTHER == res) {
-                res = svpd_decode_vendor(NULL, op, jop, off);
+                res = svpd_decode_vendor(NULL, op, jo2p, off);
                 if (SG_LIB_CAT_OTHER == res)
-                    res = svpd_unable_to_decode(NULL, op, jop, 0, off);
+                    res = svpd_unable_to_decode(NULL, op, jo2p, 0, off);
             }
         }
     }
@@ -2426,6 +2730,455 @@ svpd_examine_all(struct sg_pt_base * ptvp, struct opts_t * op,
  * that include one 'j' (for JSON). Want optional argument to '-j' to be
  * prefixed by '='. Return 0 for good, SG_LIB_SYNTAX_ERROR for syntax error
  * and SG_LIB_OK_FALSE for exit with no error. */
+/* Appends DEVICE name to isp->names[]. Returns false if out of memory. */
+static bool
+inv_add_name(struct inv_state_t * isp, const char * name)
+{
+    const char ** npp;
+
+    if (isp->num_names >= isp->max_names) {
+        isp->max_names = isp->max_names ? (2 * isp->max_names) : 64;
+        npp = (const char **)realloc(isp->names,
+                                     isp->max_names * sizeof(*npp));
+        if (NULL == npp) {
+            pr2serr("%s: out of memory\n", __func__);
+            return false;
+        }
+        isp->names = npp;
+    }
+    isp->names[isp->num_names++] = name;
+    return true;
+}
+
+/* Reads DEVICE names from file fn ("-" for stdin), one per line. Leading
+ * and trailing whitespace is ignored as are empty lines and those
+ * starting with '#'. Returns 0 on success. */
+static int
+inv_read_devices(struct inv_state_t * isp, const char * fn)
+{
+    int n;
+    int ret = 0;
+    char * cp;
+    char * np;
+    FILE * fp;
+    char line[512];
+
+    if ((1 == strlen(fn)) && ('-' == fn[0]))
+        fp = stdin;
+    else {
+        fp = fopen(fn, "r");
+        if (NULL == fp) {
+            n = errno;
+            pr2serr("unable to open file: %s [%s]\n", fn, safe_strerror(n));
+            return sg_convert_errno(n);
+        }
+    }
+    while (fgets(line, sizeof(line), fp)) {
+        for (cp = line; isspace((uint8_t)*cp); ++cp)
+            ;
+        for (n = strlen(cp); (n > 0) && isspace((uint8_t)cp[n - 1]); --n)
+            cp[n - 1] = '\0';
+        if ((0 == n) || ('#' == *cp))
+            continue;
+        np = strdup(cp);
+        if ((NULL == np) || (! inv_add_name(isp, np))) {
+            free(np);
+            ret = sg_convert_errno(ENOMEM);
+            break;
+        }
+    }
+    if (stdin != fp)
+        fclose(fp);
+    return ret;
+}
+
+/* Parses the comma separated list of pages in pl into isp->pages[]. Each
+ * may be an acronym or a number, as accepted by --page=PG but without the
+ * PG,VP form. Returns 0 or SG_LIB_SYNTAX_ERROR. */
+static int
+inv_parse_pages(struct inv_state_t * isp, const char * pl)
+{
+    int n;
+    const char * cp;
+    const char * ep;
+    const struct svpd_values_name_t * vnp;
+    char b[32];
+
+    for (cp = pl, isp->num_pages = 0; *cp; cp = *ep ? (ep + 1) : ep) {
+        ep = strchr(cp, ',');
+        if (NULL == ep)
+            ep = cp + strlen(cp);
+        n = ep - cp;
+        if ((n < 1) || (n >= (int)sizeof(b))) {
+            pr2serr("bad element in --pages=%s\n", pl);
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        if (isp->num_pages >= INV_MAX_PAGES) {
+            pr2serr("--pages=PL allows no more than %d pages\n",
+                    INV_MAX_PAGES);
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        memcpy(b, cp, n);
+        b[n] = '\0';
+        if (isdigit((uint8_t)b[0])) {
+            n = sg_get_num_nomult(b);
+            if ((n < 0) || (n > 255)) {
+                pr2serr("Bad page code value: %s in --pages=\n", b);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            isp->pages[isp->num_pages].pn = n;
+            isp->pages[isp->num_pages].subvalue = 0;
+        } else {
+            vnp = sdp_find_vpd_by_acron(b);
+            if (NULL == vnp)
+                vnp = svpd_find_vendor_by_acron(b);
+            if ((NULL == vnp) && (0 == strcmp("stdinq", b)))
+                vnp = sdp_find_vpd_by_acron("sinq");
+            if (NULL == vnp) {
+                pr2serr("abbreviation %s in --pages= doesn't match a VPD "
+                        "page\n", b);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            isp->pages[isp->num_pages].pn = vnp->value;
+            isp->pages[isp->num_pages].subvalue = vnp->subvalue;
+        }
+        ++isp->num_pages;
+    }
+    if (0 == isp->num_pages) {
+        pr2serr("--pages=PL needs at least one page\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    return 0;
+}
+
+/* Called when the INQUIRY for page dp->pg_idx has completed (or failed to
+ * be sent), 'res' being from do_scsi_pt(), sg_mux_submit() or, via the
+ * mux, do_scsi_pt_receive(). */
+static void
+inv_done(struct inv_dev_t * dp, int res, const struct opts_t * op)
+{
+    int n, sense_cat, rlen;
+    int k = dp->pg_idx;
+    int rr = 0;
+    struct inv_state_t * isp = op->invp;
+    const uint8_t * bp = dp->resp + (k * isp->alloc_len);
+
+    dp->in_flight = false;
+    n = sg_cmds_process_resp(dp->ptvp, "inquiry", res, ! op->do_quiet,
+                             op->verbose, &sense_cat);
+    if (-1 == n) {
+        if (get_scsi_pt_transport_err(dp->ptvp))
+            rr = SG_LIB_TRANSPORT_ERROR;
+        else
+            rr = sg_convert_errno(get_scsi_pt_os_err(dp->ptvp));
+        if (0 == rr)
+            rr = SG_LIB_CAT_OTHER;
+    } else if ((-2 == n) && (SG_LIB_CAT_RECOVERED != sense_cat) &&
+               (SG_LIB_CAT_NO_SENSE != sense_cat))
+        rr = sense_cat;
+    rlen = isp->alloc_len - get_scsi_pt_resid(dp->ptvp);
+    if ((0 == rr) && ((rlen < 4) || ((isp->pages[k].pn >= 0) &&
+                                     (isp->pages[k].pn != bp[1]))))
+        rr = SG_LIB_CAT_MALFORMED;
+    dp->resp_res[k] = rr;
+    dp->resp_len[k] = rlen;
+    if (rr && (0 == dp->ret))
+        dp->ret = rr;
+    partial_clear_scsi_pt_obj(dp->ptvp);
+    if (-1 == n) {      /* no point in sending more */
+        for (++k; k < isp->num_pages; ++k)
+            dp->resp_res[k] = rr;
+        dp->pg_idx = isp->num_pages;
+    } else
+        ++dp->pg_idx;
+    if (dp->pg_idx >= isp->num_pages)
+        dp->done = true;
+}
+
+/* sg_mux done() callback */
+static void
+inv_mux_done(struct sg_mux_cmd * mcp, void * ctx)
+{
+    struct inv_dev_t * dp = (struct inv_dev_t *)ctx;
+
+    inv_done(dp, mcp->res, dp->op);
+}
+
+/* Sends the INQUIRY for page dp->pg_idx through the mux without waiting
+ * for it, unless the DEVICE could only be opened read-only or there is no
+ * mux in which case it completes here. */
+static void
+inv_submit(struct inv_dev_t * dp, const struct opts_t * op)
+{
+    int res;
+    struct inv_state_t * isp = op->invp;
+    const struct inv_page_t * pp = isp->pages + dp->pg_idx;
+
+    memset(dp->cdb, 0, sizeof(dp->cdb));
+    dp->cdb[0] = INQUIRY_CMD;
+    if (pp->pn >= 0) {
+        dp->cdb[1] = 0x1;       /* EVPD */
+        dp->cdb[2] = (uint8_t)pp->pn;
+    }
+    sg_put_unaligned_be16((uint16_t)isp->alloc_len, dp->cdb + 3);
+    set_scsi_pt_cdb(dp->ptvp, dp->cdb, sizeof(dp->cdb));
+    set_scsi_pt_sense(dp->ptvp, dp->sense_b, sizeof(dp->sense_b));
+    set_scsi_pt_data_in(dp->ptvp, dp->resp + (dp->pg_idx * isp->alloc_len),
+                        isp->alloc_len);
+    if (dp->sync_only) {
+        set_scsi_pt_packet_id(dp->ptvp, dp->pg_idx + 1);
+        res = do_scsi_pt(dp->ptvp, -1, DEF_PT_TIMEOUT, op->verbose);
+        inv_done(dp, res, op);
+        return;
+    }
+    res = sg_mux_submit(isp->mxp, &dp->mc);
+    if (res) {
+        inv_done(dp, res, op);
+        return;
+    }
+    dp->in_flight = true;
+}
+
+/* Decodes the responses held for DEVICE dp, as if each had been read with
+ * --inhex=FN, then closes it. In JSON mode its object is appended to jap
+ * (the streamed "device_list" array). */
+static void
+inv_output(struct inv_dev_t * dp, struct opts_t * op, sgj_opaque_p jap,
+           bool first)
+{
+    int k, res, len;
+    int maxlen = op->maxlen;
+    sgj_state * jsp = &op->json_st;
+    sgj_opaque_p jo2p = NULL;
+    sgj_opaque_p jo3p;
+    sgj_opaque_p jap2 = NULL;
+    const struct inv_page_t * pp;
+    char b[80];
+    char d[32];
+    struct inv_state_t * isp = op->invp;
+
+    if (jsp->pr_as_json) {
+        jo2p = sgj_new_unattached_object_r(jsp);
+        sgj_js_nv_s(jsp, jo2p, "device_name", dp->name);
+    } else
+        sgj_pr_hr(jsp, "%s%s:\n", (first ? "" : "\n"), dp->name);
+    for (k = 0; (k < isp->num_pages) && dp->resp; ++k) {
+        pp = isp->pages + k;
+        if (pp->pn < 0)
+            snprintf(d, sizeof(d), "standard INQUIRY");
+        else
+            snprintf(d, sizeof(d), "VPD page 0x%x", pp->pn);
+        res = dp->resp_res[k];
+        if (res) {
+            sg_get_category_sense_str(res, sizeof(b), b, op->verbose);
+            if (jo2p) {
+                if (NULL == jap2)
+                    jap2 = sgj_named_subarray_r(jsp, jo2p,
+                                                "page_error_list");
+                jo3p = sgj_new_unattached_object_r(jsp);
+                if (pp->pn >= 0)
+                    sgj_js_nv_i(jsp, jo3p, "page_code", pp->pn);
+                sgj_js_nv_s(jsp, jo3p, "page_name", d);
+                sgj_js_nv_istr(jsp, jo3p, "exit_status", res, NULL, b);
+                sgj_js_nv_o(jsp, jap2, NULL /* name */, jo3p);
+            } else if (! op->do_quiet)
+                sgj_pr_hr(jsp, "  fetching %s failed: %s\n", d, b);
+            continue;
+        }
+        len = dp->resp_len[k];
+        memcpy(op->rsp_buff, dp->resp + (k * isp->alloc_len), len);
+        op->vpd_pn = pp->pn;
+        op->maxlen = len;
+        res = svpd_decode_t10(NULL, op, jo2p, pp->subvalue, 0, NULL);
+        if (SG_LIB_CAT_OTHER == res) {
+            res = svpd_decode_vendor(NULL, op, jo2p, 0);
+            if (SG_LIB_CAT_OTHER == res)
+                svpd_unable_to_decode(NULL, op, jo2p, pp->subvalue, 0);
+        }
+    }
+    op->maxlen = maxlen;
+    if (jo2p) {
+        sg_exit2str(dp->ret, false, sizeof(b), b);
+        sgj_js_nv_istr(jsp, jo2p, "exit_status", dp->ret, NULL,
+                       dp->ret ? b : "good");
+        sgj_js_nv_o(jsp, jap, NULL /* name */, jo2p);
+    }
+    if (dp->ptvp) {
+        destruct_scsi_pt_obj(dp->ptvp);
+        dp->ptvp = NULL;
+    }
+    if (dp->fd >= 0) {
+        if (! dp->sync_only)
+            sg_mux_del_fd(op->invp->mxp, dp->fd);
+        sg_cmds_close_device(dp->fd);
+        dp->fd = -1;
+    }
+    free(dp->resp);
+    dp->resp = NULL;
+    free(dp->resp_len);
+    free(dp->resp_res);
+}
+
+/* Fetches the pages in isp->pages[] from each of the isp->names[] DEVICEs,
+ * keeping up to --parallel=P DEVICEs with an INQUIRY in flight. Each
+ * DEVICE's output follows as soon as it has all its responses so its
+ * JSON object can be streamed. Returns the exit status of the first
+ * DEVICE that had an error, else 0. */
+static int
+inv_run(struct opts_t * op, sgj_opaque_p jop, FILE * js_fp)
+{
+    bool first = true;
+    int k, fd, in_flight, remaining, res;
+    int ret = 0;
+    int num_err_devs = 0;
+    int max_par = op->num_parallel ? op->num_parallel : INV_DEF_PARALLEL;
+    int vb = op->verbose;
+    sgj_state * jsp = &op->json_st;
+    sgj_opaque_p jap = NULL;
+    sgj_opaque_p jo2p;
+    struct inv_dev_t * dp;
+    struct inv_dev_t * devs;
+    struct inv_state_t * isp = op->invp;
+
+    isp->alloc_len = (op->maxlen > 0) ? op->maxlen : DEF_ALLOC_LEN;
+    devs = (struct inv_dev_t *)calloc(isp->num_names, sizeof(*devs));
+    if (NULL == devs) {
+        pr2serr("%s: out of memory\n", __func__);
+        return sg_convert_errno(ENOMEM);
+    }
+    isp->mxp = sg_mux_new(vb);
+    if ((NULL == isp->mxp) && vb)
+        pr2serr("no asynchronous interface, each INQUIRY completes before "
+                "the next is sent\n");
+    if (jsp->pr_as_json)
+        jap = sgj_stream_subarray_r(jsp, "device_list", js_fp);
+    for (k = 0, remaining = 0; k < isp->num_names; ++k) {
+        dp = devs + k;
+        dp->name = isp->names[k];
+        dp->fd = -1;
+        dp->done = true;
+        fd = sg_cmds_open_flags(dp->name, O_RDWR | O_NONBLOCK, vb);
+        if ((-EACCES == fd) || (-EROFS == fd) || (-EPERM == fd)) {
+            fd = sg_cmds_open_device(dp->name, true /* ro */, vb);
+            dp->sync_only = true;
+        }
+        if (fd < 0) {
+            pr2serr("error opening file: %s: %s\n", dp->name,
+                    safe_strerror(-fd));
+            dp->ret = sg_convert_errno(-fd);
+            continue;
+        }
+        dp->fd = fd;
+        dp->ptvp = construct_scsi_pt_obj_with_fd(fd, vb);
+        dp->resp = (uint8_t *)calloc(isp->num_pages, isp->alloc_len);
+        dp->resp_len = (int *)calloc(isp->num_pages, sizeof(int));
+        dp->resp_res = (int *)calloc(isp->num_pages, sizeof(int));
+        if ((NULL == dp->ptvp) || (NULL == dp->resp) ||
+            (NULL == dp->resp_len) || (NULL == dp->resp_res)) {
+            pr2serr("%s: out of memory for %s\n", __func__, dp->name);
+            dp->ret = sg_convert_errno(ENOMEM);
+            free(dp->resp);
+            dp->resp = NULL;
+            continue;
+        }
+        dp->op = op;
+        dp->mc.fd = fd;
+        dp->mc.timeout_secs = DEF_PT_TIMEOUT;
+        dp->mc.ptp = dp->ptvp;
+        dp->mc.ctx = dp;
+        dp->mc.done = inv_mux_done;
+        if ((NULL == isp->mxp) ||
+            (! dp->sync_only && sg_mux_add_fd(isp->mxp, fd)))
+            dp->sync_only = true;
+        dp->done = false;
+        ++remaining;
+    }
+    /* output DEVICEs that failed to open */
+    for (k = 0; k < isp->num_names; ++k) {
+        dp = devs + k;
+        if (dp->done) {
+            inv_output(dp, op, jap, first);
+            first = false;
+        }
+    }
+
+    for (in_flight = 0; remaining > 0; ) {
+        /* top up to max_par DEVICEs with a command in flight */
+        for (k = 0; (k < isp->num_names) && (in_flight < max_par); ++k) {
+            dp = devs + k;
+            if (dp->done || dp->in_flight)
+                continue;
+            inv_submit(dp, op);
+            if (dp->in_flight)
+                ++in_flight;
+        }
+        if (in_flight > 0) {
+            res = sg_mux_run(isp->mxp, -1);
+            if (res < 0) {
+                pr2serr("waiting for responses: %s\n", safe_strerror(-res));
+                ret = sg_convert_errno(-res);
+                break;
+            }
+        }
+        for (k = 0, in_flight = 0, remaining = 0; k < isp->num_names; ++k) {
+            dp = devs + k;
+            if (dp->done) {
+                if (dp->resp) {
+                    inv_output(dp, op, jap, first);
+                    first = false;
+                }
+                continue;
+            }
+            ++remaining;
+            if (dp->in_flight)
+                ++in_flight;
+        }
+    }
+
+    for (k = 0; k < isp->num_names; ++k) {
+        if (devs[k].ret) {
+            ++num_err_devs;
+            if (0 == ret)
+                ret = devs[k].ret;
+        }
+    }
+    if (jsp->pr_as_json) {
+        jo2p = sgj_named_subobject_r(jsp, jop, "inventory_summary");
+        sgj_js_nv_i(jsp, jo2p, "number_of_devices", isp->num_names);
+        sgj_js_nv_i(jsp, jo2p, "number_of_pages", isp->num_pages);
+        sgj_js_nv_i(jsp, jo2p, "devices_with_errors", num_err_devs);
+    } else if ((vb > 0) || (num_err_devs > 0))
+        pr2serr("Inventory of %d DEVICEs, %d pages each: %d DEVICEs with "
+                "errors\n", isp->num_names, isp->num_pages, num_err_devs);
+    sg_mux_free(isp->mxp);
+    isp->mxp = NULL;
+    free(devs);
+    return ret;
+}
+
+/* Opens (truncating) the --js-file=JFN file, or returns stdout. Returns
+ * NULL if that fails in which case *retp is set. */
+static FILE *
+open_js_file(const struct opts_t * op, int * retp)
+{
+    FILE * fp = stdout;
+
+    if (op->js_file) {
+        if ((1 != strlen(op->js_file)) || ('-' != op->js_file[0])) {
+            fp = fopen(op->js_file, "w");   /* truncate if exists */
+            if (NULL == fp) {
+                int e = errno;
+
+                pr2serr("unable to open file: %s [%s]\n", op->js_file,
+                        safe_strerror(e));
+                *retp = sg_convert_errno(e);
+            }
+        }
+        /* '--js-file=-' will send JSON output to stdout */
+    }
+    return fp;
+}
+
 static int
 chk_short_opts(const char sopt_ch, struct opts_t * op)
 {
@@ -2445,6 +3198,7 @@ chk_short_opts(const char sopt_ch, struct opts_t * op)
         op->examine_given = true;
         break;
     case 'f':
+    case 'n':
         op->do_force = true;
         break;
     case 'h':
@@ -2490,6 +3244,7 @@ int
 main(int argc, char * argv[])
 {
     bool as_json = false;
+    bool inv_mode;
     int c, k, n, q, res, matches, vb;
     int sg_fd = -1;
     int inhex_len = 0;
@@ -2497,20 +3252,26 @@ main(int argc, char * argv[])
     int ret = 0;
     int subvalue = 0;
     const char * cp;
+    FILE * js_fp = NULL;
     struct sg_pt_base * ptvp = NULL;
     sgj_state * jsp;
     sgj_opaque_p jop = NULL;
     const struct svpd_values_name_t * vnp;
     struct opts_t opts SG_C_CPP_ZERO_INIT;
     struct opts_t * op = &opts;
+    struct inv_state_t inv_st SG_C_CPP_ZERO_INIT;
+    struct inv_state_t * isp = &inv_st;
+    struct sg_f2hex_map inhex_map SG_C_CPP_ZERO_INIT;
+    uint8_t * free_rsp_buff = NULL;
 
     if (getenv("SG3_UTILS_INVOCATION"))
         sg_rep_invocation(MY_NAME, version_str, argc, argv, stderr);
     op->vend_prod_num = -1;
+    op->invp = isp;
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "^aDeEfhHiI:j::J:lm:M:p:qQ:rvV",
+        c = getopt_long(argc, argv, "^aB:C:d:DeEfhHiI:j::J:lL:m:M:np:P:qQ:rvV",
                         long_options, &option_index);
         if (c == -1)
             break;
@@ -2519,6 +3280,15 @@ main(int argc, char * argv[])
         case 'a':
             op->do_all = true;
             break;
+        case 'B':
+            op->batch_fn = optarg;
+            break;
+        case 'C':
+            op->cache_dir = optarg;
+            break;
+        case 'd':
+            op->dev_list_fn = optarg;
+            break;
         case 'D':
             op->do_debug = true;
             break;
@@ -2530,6 +3300,7 @@ main(int argc, char * argv[])
             op->examine_given = true;
             break;
         case 'f':
+        case 'n':
             op->do_force = true;
             break;
         case 'h':
@@ -2580,6 +3351,9 @@ main(int argc, char * argv[])
         case 'l':
             op->do_long = true;
             break;
+        case 'L':
+            op->pages_str = optarg;
+            break;
         case 'm':
             op->maxlen = sg_get_num(optarg);
             if ((op->maxlen < 0) || (op->maxlen > MX_ALLOC_LEN)) {
@@ -2610,6 +3384,11 @@ main(int argc, char * argv[])
                 op->page_str = optarg;
             op->page_given = true;
             break;
+        case 'P':
+            op->num_parallel = sg_par_get_num(optarg, 1, INV_MAX_PARALLEL);
+            if (op->num_parallel < 0)
+                return SG_LIB_SYNTAX_ERROR;
+            break;
         case 'q':
             op->do_quiet = true;
             break;
@@ -2633,16 +3412,13 @@ main(int argc, char * argv[])
         }
     }
     if (optind < argc) {
-        if (NULL == op->device_name) {
+        if (NULL == op->device_name)
             op->device_name = argv[optind];
-            ++optind;
-        }
-        if (optind < argc) {
-            for (; optind < argc; ++optind)
-                pr2serr("Unexpected extra argument: %s\n", argv[optind]);
-            usage();
-            return SG_LIB_SYNTAX_ERROR;
+        for (; optind < argc; ++optind) {
+            if (! inv_add_name(isp, argv[optind]))
+                return sg_convert_errno(ENOMEM);
         }
+        isp->num_args = isp->num_names;
     }
 
 #ifdef DEBUG
@@ -2666,6 +3442,7 @@ main(int argc, char * argv[])
         return 0;
     }
     vb = op->verbose;
+    inv_mode = (isp->num_names > 1) || op->dev_list_fn || op->pages_str;
 
     if (op->do_enum) {
         if (op->device_name)
@@ -2726,6 +3503,15 @@ main(int argc, char * argv[])
         if (op->do_hex > 0)
             op->do_hex = -op->do_hex;
     }
+    if (op->batch_fn) {
+        if (op->device_name || op->inhex_fn || inv_mode || op->js_file) {
+            pr2serr("--batch=MF cannot be used with a DEVICE, --devices=, "
+                    "--inhex=,\n--js-file= or --pages=\n");
+            return SG_LIB_CONTRADICT;
+        }
+        op->do_json = true;     /* each blob is output as a JSON line */
+    }
+    sgj_hr_buffered();
     jsp = &op->json_st;
     if (op->do_json) {
         if (! sgj_init_state(jsp, op->json_arg)) {
@@ -2744,6 +3530,17 @@ main(int argc, char * argv[])
         jop = sgj_start_r(MY_NAME, version_str, argc, argv, jsp);
     }
     as_json = jsp->pr_as_json;
+    if (op->batch_fn) {
+        struct sg_batch_item bi;
+
+        if (! sg_batch_run(op->batch_fn, op->num_parallel, &bi, &ret, vb)) {
+            sgj_finish(jsp);
+            return ret;
+        }
+        op->inhex_fn = bi.fn;   /* now in a child, decoding one blob */
+        if (bi.as_binary >= 0)
+            op->do_raw = bi.as_binary;
+    }
 
     if (op->page_str) {
         if ('-' == op->page_str[0])
@@ -2831,16 +3628,61 @@ main(int argc, char * argv[])
         subvalue = op->vend_prod_num;
     }
 
-    rsp_buff = sg_memalign(rsp_buff_sz, 0 /* page align */, &free_rsp_buff,
-                           false);
-    if (NULL == rsp_buff) {
+    if (inv_mode) {
+        if (op->do_all || op->examine_given || op->inhex_fn ||
+            op->sinq_inraw_fn || op->do_raw || op->do_hex) {
+            pr2serr("several DEVICEs, --devices= and --pages= don't work "
+                    "with --all,\n--examine, --hex, --inhex=, --raw or "
+                    "--sinq_inraw=\n");
+            ret = SG_LIB_CONTRADICT;
+            goto fini;
+        }
+        if (op->dev_list_fn) {
+            ret = inv_read_devices(isp, op->dev_list_fn);
+            if (ret)
+                goto fini;
+        }
+        if (0 == isp->num_names) {
+            pr2serr("No DEVICE argument given, nor any in --devices=%s\n",
+                    op->dev_list_fn);
+            ret = SG_LIB_SYNTAX_ERROR;
+            goto fini;
+        }
+        op->device_name = isp->names[0];
+        if (op->pages_str) {
+            if (op->page_given || op->do_ident) {
+                pr2serr("give either --pages=PL or --page=PG (or --ident), "
+                        "not both\n");
+                ret = SG_LIB_CONTRADICT;
+                goto fini;
+            }
+            ret = inv_parse_pages(isp, op->pages_str);
+        } else if (op->page_given) {
+            isp->pages[0].pn = op->vpd_pn;
+            isp->pages[0].subvalue = subvalue;
+            isp->num_pages = 1;
+        } else if (op->do_ident) {
+            isp->pages[0].pn = VPD_DEVICE_ID;
+            isp->pages[0].subvalue = (op->do_ident > 1) ? VPD_DI_SEL_LU : 0;
+            isp->num_pages = 1;
+            if ((op->do_ident > 1) && (! op->do_long))
+                op->do_quiet = true;
+        } else
+            ret = inv_parse_pages(isp, INV_DEF_PAGES);
+        if (ret)
+            goto fini;
+    }
+
+    op->rsp_buff = sg_memalign(rsp_buff_sz, 0 /* page align */,
+                               &free_rsp_buff, false);
+    if (NULL == op->rsp_buff) {
         pr2serr("Unable to allocate %d bytes on heap\n", rsp_buff_sz);
         ret = sg_convert_errno(ENOMEM);
         goto fini;
     }
     if (op->sinq_inraw_fn) {
         /* Note: want to support both --sinq_inraw= and --inhex= options */
-        if ((ret = sg_f2hex_arr(op->sinq_inraw_fn, true, false, rsp_buff,
+        if ((ret = sg_f2hex_arr(op->sinq_inraw_fn, true, false, op->rsp_buff,
                                 &inraw_len, rsp_buff_sz))) {
             goto err_out;
         }
@@ -2850,7 +3692,7 @@ main(int argc, char * argv[])
             ret = SG_LIB_FILE_ERROR;
             goto err_out;
         }
-        memcpy(op->std_inq_a,  rsp_buff, 36);
+        memcpy(op->std_inq_a,  op->rsp_buff, 36);
         op->std_inq_a_valid = true;
     }
     if (op->inhex_fn) {
@@ -2859,33 +3701,38 @@ main(int argc, char * argv[])
             ret = SG_LIB_SYNTAX_ERROR;
             goto err_out;
         }
-        if ((ret = sg_f2hex_arr(op->inhex_fn, !!op->do_raw, false, rsp_buff,
-                                &inhex_len, rsp_buff_sz))) {
+        /* may hold many response sets, so no limit on its size */
+        if ((ret = sg_f2hex_mmap(op->inhex_fn, !!op->do_raw, false,
+                                 &inhex_map, 0)))
             goto err_out;
-        }
+        inhex_len = inhex_map.len;
+        if (inhex_len > rsp_buff_sz)
+            op->rsp_buff = inhex_map.bp;    /* decode in place, no copy */
+        else
+            memcpy(op->rsp_buff, inhex_map.bp, inhex_len);
         if (vb > 2)
             pr2serr("Read %d [0x%x] bytes of user supplied data\n", inhex_len,
                     inhex_len);
         if (vb > 3)
-            hex2stderr(rsp_buff, inhex_len, 0);
+            hex2stderr(op->rsp_buff, inhex_len, 0);
         op->do_raw = 0;         /* don't want raw on output with --inhex= */
         if ((NULL == op->page_str) && (! op->do_all)) {
             /* may be able to deduce VPD page */
-            if ((0x2 == (0xf & rsp_buff[3])) && (rsp_buff[2] > 2)) {
+            if ((0x2 == (0xf & op->rsp_buff[3])) && (op->rsp_buff[2] > 2)) {
                 if (vb)
                     pr2serr("Guessing from --inhex= this is a standard "
                             "INQUIRY\n");
-            } else if (rsp_buff[2] <= 2) {
+            } else if (op->rsp_buff[2] <= 2) {
                 if (vb)
                     pr2serr("Guessing from --inhex this is VPD page 0x%x\n",
-                            rsp_buff[1]);
-                op->vpd_pn = rsp_buff[1];
+                            op->rsp_buff[1]);
+                op->vpd_pn = op->rsp_buff[1];
             } else {
                 if (op->vpd_pn > 0x80) {
-                    op->vpd_pn = rsp_buff[1];
+                    op->vpd_pn = op->rsp_buff[1];
                     if (vb)
                         pr2serr("Guessing from --inhex this is VPD page "
-                                "0x%x\n", rsp_buff[1]);
+                                "0x%x\n", op->rsp_buff[1]);
                 } else {
                     op->vpd_pn = VPD_NOPE_WANT_STD_INQ;
                     if (vb)
@@ -2923,6 +3770,15 @@ main(int argc, char * argv[])
         }
     }
 
+    if (inv_mode) {
+        if (as_json) {
+            js_fp = open_js_file(op, &ret);
+            if (NULL == js_fp)
+                goto fini;
+        }
+        ret = inv_run(op, jop, js_fp);
+        goto fini;
+    }
     if (op->inhex_fn) {
         if ((0 == op->maxlen) || (inhex_len < op->maxlen))
             op->maxlen = inhex_len;
@@ -2940,15 +3796,15 @@ main(int argc, char * argv[])
         goto err_out;
     } else if (op->std_inq_a_valid && (NULL == op->device_name)) {
         /* nothing else to do ... */
-        /* --sinq_inraw=RFN contents still in rsp_buff */
+        /* --sinq_inraw=RFN contents still in op->rsp_buff */
         if (op->do_raw)
-            dStrRaw(rsp_buff, inraw_len);
+            dStrRaw(op->rsp_buff, inraw_len);
         else if (op->do_hex) {
             if (! op->do_quiet && (op->do_hex < 3))
                 sgj_pr_hr(jsp, "Standard Inquiry data format:\n");
-            hex2stdout(rsp_buff, inraw_len, (1 == op->do_hex) ? 0 : -1);
+            hex2stdout(op->rsp_buff, inraw_len, (1 == op->do_hex) ? 0 : -1);
         } else
-            std_inq_decode(rsp_buff, inraw_len, op, jop);
+            std_inq_decode(op->rsp_buff, inraw_len, op, jop);
         ret = 0;
         goto fini;
     }
@@ -2969,12 +3825,14 @@ main(int argc, char * argv[])
         ret = sg_convert_errno(ENOMEM);
         goto err_out;
     }
+    if (op->cache_dir)
+        sg_rcache_open(op->cache_dir, op->device_name, sg_fd, vb);
     if (op->examine_given) {
         ret = svpd_examine_all(ptvp, op, jop);
     } else if (op->do_all)
         ret = svpd_decode_all(ptvp, op, jop);
     else {
-        memset(rsp_buff, 0, rsp_buff_sz);
+        memset(op->rsp_buff, 0, rsp_buff_sz);
 
         res = svpd_decode_t10(ptvp, op, jop, subvalue, 0, NULL);
         if (SG_LIB_CAT_OTHER == res) {
@@ -3013,27 +3871,21 @@ fini:
             ret = sg_convert_errno(-res);
     }
     ret = (ret >= 0) ? ret : SG_LIB_CAT_OTHER;
+    if (isp->names) {
+        /* those after the command line DEVICEs are from --devices=FN */
+        for (k = isp->num_args; k < isp->num_names; ++k)
+            free((char *)isp->names[k]);
+        free(isp->names);
+    }
     if (as_json && jop) {
-        FILE * fp = stdout;
-
-        if (op->js_file) {
-            if ((1 != strlen(op->js_file)) || ('-' != op->js_file[0])) {
-                fp = fopen(op->js_file, "w");   /* truncate if exists */
-                if (NULL == fp) {
-                    int e = errno;
+        FILE * fp = js_fp ? js_fp : open_js_file(op, &ret);
 
-                    pr2serr("unable to open file: %s [%s]\n", op->js_file,
-                            safe_strerror(e));
-                    ret = sg_convert_errno(e);
-                }
-            }
-            /* '--js-file=-' will send JSON output to stdout */
-        }
         if (fp)
             sgj_js2file(jsp, NULL, ret, fp);
         if (op->js_file && fp && (stdout != fp))
             fclose(fp);
         sgj_finish(jsp);
     }
+    sg_f2hex_unmap(&inhex_map);
     return ret;
 }
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2006-2023 Douglas Gilbert.
+ * Copyright (c) 2006-2026 Douglas Gilbert.
  * All rights reserved.
  * Use of this source code is governed by a BSD-style
  * license that can be found in the BSD_LICENSE file.
@@ -92,11 +92,9 @@ static const char * const nl_s = "no limit";
 static const char * const nlr_s = "no limit reported";
 /* Earlier gcc compilers (e.g. 6.4) don't accept this first form when it is
  * used in another array of strings initialization (e.g. bdc_zoned_strs) */
-// static const char * const nr_s = "not reported";
-static char nr_s[] = "not reported";
+static const char nr_s[] = "not reported";
 static const char * const ns_s = "not supported";
-// static const char * const rsv_s = "Reserved";
-static char rsv_s[] = "Reserved";
+static const char rsv_s[] = "Reserved";
 static const char * const vs_s = "Vendor specific";
 static const char * const null_s = "";
 static const char * const mn_s = "meaning";
@@ -876,17 +874,24 @@ decode_power_condition(const uint8_t * buff, int len, struct opts_t * op,
                    true, "unit: millisecond");
 }
 
+/* If ixp is NULL the designation descriptors in buff are indexed here */
 int
-filter_json_dev_ids(uint8_t * buff, int len, int m_assoc, struct opts_t * op,
-                    sgj_opaque_p jap)
+filter_json_dev_ids(uint8_t * buff, int len,
+                    const struct sg_vpd_dev_id_idx * ixp, int m_assoc,
+                    struct opts_t * op, sgj_opaque_p jap)
 {
     int u, off, i_len;
     sgj_opaque_p jo2p;
     const uint8_t * bp;
     sgj_state * jsp = &op->json_st;
+    struct sg_vpd_dev_id_idx di_idx;
 
+    if (NULL == ixp) {
+        sg_vpd_dev_id_index(buff, len, &di_idx);
+        ixp = &di_idx;
+    }
     off = -1;
-    while ((u = sg_vpd_dev_id_iter(buff, len, &off, m_assoc, -1, -1)) == 0) {
+    while ((u = sg_vpd_dev_id_next(ixp, &off, m_assoc, -1, -1)) == 0) {
         bp = buff + off;
         i_len = bp[3];
         if ((off + i_len + 4) > len) {
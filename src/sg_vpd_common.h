@@ -2,7 +2,7 @@
 #define SG_VPD_COMMON_H
 
 /*
- * Copyright (c) 2022-2023 Douglas Gilbert.
+ * Copyright (c) 2022-2026 Douglas Gilbert.
  * All rights reserved.
  * Use of this source code is governed by a BSD-style
  * license that can be found in the BSD_LICENSE file.
@@ -121,6 +121,11 @@ extern "C" {
 
 
 /* This structure holds the union of options available in sg_inq and sg_vpd */
+struct inv_state_t;     /* private to sg_vpd.c */
+
+/* All the state of one invocation of sg_inq or sg_vpd. The decoders only
+ * use what they are given via this structure so several opts_t instances
+ * may decode at the same time in different threads. */
 struct opts_t {
     bool do_all;                /* sg_vpd */
     bool do_ata;                /* sg_inq */
@@ -155,17 +160,24 @@ struct opts_t {
     int examine;                /* sg_vpd */
     int maxlen;                 /* sg_inq[was: resp_len] + sg_vpd */
     int num_pages;              /* sg_inq */
+    int num_parallel;           /* sg_vpd */
     int page_pdt;               /* sg_inq */
     int vend_prod_num;          /* sg_vpd */
     int verbose;                /* sg_inq + sg_vpd */
     int vpd_pn;                 /* sg_vpd */
+    const char * batch_fn;      /* sg_vpd */
+    const char * cache_dir;     /* sg_inq + sg_vpd */
     const char * device_name;   /* sg_inq + sg_vpd */
+    const char * dev_list_fn;   /* sg_vpd */
     const char * page_str;      /* sg_inq + sg_vpd */
+    const char * pages_str;     /* sg_vpd */
     const char * inhex_fn;      /* sg_inq + sg_vpd */
     const char * json_arg;      /* sg_inq + sg_vpd */
     const char * js_file;       /* sg_inq + sg_vpd */
     const char * sinq_inraw_fn; /* sg_inq + sg_vpd */
     const char * vend_prod;     /* sg_vpd */
+    uint8_t * rsp_buff;         /* sg_inq + sg_vpd: response being decoded */
+    struct inv_state_t * invp;  /* sg_vpd */
     sgj_state json_st;
     uint8_t std_inq_a[36];
 };
@@ -202,7 +214,8 @@ void decode_cga_profile_vpd(const uint8_t * buff, int len, struct opts_t * op,
                        sgj_opaque_p jap);
 void decode_power_condition(const uint8_t * buff, int len, struct opts_t * op,
                             sgj_opaque_p jop);
-int filter_json_dev_ids(uint8_t * buff, int len, int m_assoc,
+int filter_json_dev_ids(uint8_t * buff, int len,
+                        const struct sg_vpd_dev_id_idx * ixp, int m_assoc,
                         struct opts_t * op, sgj_opaque_p jap);
 void decode_ata_info_vpd(const uint8_t * buff, int len, struct opts_t * op,
                         sgj_opaque_p jop);
@@ -281,7 +294,6 @@ int vpd_fetch_page(struct sg_pt_base * ptvp, uint8_t * rp, int page,
 void named_hhh_output(const char * pname, const uint8_t * buff, int len,
                       const struct opts_t * op);
 
-extern uint8_t * rsp_buff;
 extern const char * t10_vendor_id_hr;
 extern const char * t10_vendor_id_js;
 extern const char * product_id_hr;
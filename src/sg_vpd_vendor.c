@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2006-2023 Douglas Gilbert.
+ * Copyright (c) 2006-2026 Douglas Gilbert.
  * All rights reserved.
  * Use of this source code is governed by a BSD-style
  * license that can be found in the BSD_LICENSE file.
@@ -1072,7 +1072,7 @@ svpd_decode_vendor(struct sg_pt_base * ptvp, struct opts_t * op,
     default:    /* not known so return prior to fetching page */
         return SG_LIB_CAT_OTHER;
     }
-    rp = rsp_buff + off;
+    rp = op->rsp_buff + off;
     if (ptvp) {
         if (0 == alloc_len)
             alloc_len = DEF_ALLOC_LEN;
@@ -16,6 +16,9 @@
 #include <string.h>
 #include <getopt.h>
 #include <ctype.h>
+#include <errno.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -24,6 +27,8 @@
 #include "sg_lib.h"
 #include "sg_cmds_basic.h"
 #include "sg_unaligned.h"
+#include "sg_mpoll.h"
+#include "sg_par.h"
 #include "sg_pr2serr.h"
 
 /* A utility program originally written for the Linux OS SCSI subsystem.
@@ -32,7 +37,7 @@
  * mode page on the given device.
  */
 
-static const char * version_str = "1.29 20230519";
+static const char * version_str = "1.30 20261015";
 
 #define ME "sg_wr_mode: "
 
@@ -41,16 +46,59 @@ static const char * version_str = "1.29 20230519";
 
 #define EBUFF_SZ 256
 
+#define DEF_PARALLEL 32
+#define MAX_PARALLEL 256
+
+/* --policy: the template and how to apply it, read-only for the threads */
+struct wm_policy_t {
+    bool dbd;
+    bool dry_run;
+    bool mode_6;
+    bool save;
+    int pg_code;
+    int sub_pg_code;
+    int tmpl_len;
+    int verbose;
+    uint8_t tmpl[MX_ALLOC_LEN];         /* desired values (--contents=) */
+    uint8_t mask[MX_ALLOC_LEN];         /* bits of tmpl to enforce */
+};
+
+enum wm_outcome {
+    WM_FAILED = 0,
+    WM_COMPLIANT,
+    WM_CHANGED,
+    WM_WOULD_CHANGE,
+};
+
+struct wm_dev_t {
+    enum wm_outcome outcome;
+    int res;
+    int num_diff;               /* bytes of the mode page that differ */
+    int64_t elapsed_ms;
+    const char * dev_name;
+    char reason[80];            /* when a failure is not a SCSI error */
+};
+
+struct wm_batch_t {
+    int num_devs;
+    const struct wm_policy_t * pp;
+    struct wm_dev_t * dev_arr;
+};
+
 
 static struct option long_options[] = {
         {"cfile", required_argument, 0, 'C'},
         {"contents", required_argument, 0, 'c'},
         {"dbd", no_argument, 0, 'd'},
+        {"dry-run", no_argument, 0, 'n'},
+        {"dry_run", no_argument, 0, 'n'},
         {"force", no_argument, 0, 'f'},
         {"help", no_argument, 0, 'h'},
         {"len", required_argument, 0, 'l'},
         {"mask", required_argument, 0, 'm'},
         {"page", required_argument, 0, 'p'},
+        {"parallel", required_argument, 0, 'q'},
+        {"policy", no_argument, 0, 'P'},
         {"raw", no_argument, 0, 'r'},
         {"rtd", no_argument, 0, 'R'},
         {"save", no_argument, 0, 's'},
@@ -65,11 +113,14 @@ static void
 usage()
 {
     pr2serr("Usage: sg_wr_mode [--cfile=CF] [--contents=H,H...] [--dbd] "
-            "[--force]\n"
-            "                  [--help] [--len=10|6] [--mask=M,M...]\n"
-            "                  [--page=PG_H[,SPG_H]] [--raw] [--rtd] "
-            "[--save]\n"
-            "                  [--six] [--verbose] [--version] DEVICE\n"
+            "[--dry-run]\n"
+            "                  [--force] [--help] [--len=10|6] "
+            "[--mask=M,M...]\n"
+            "                  [--page=PG_H[,SPG_H]] [--parallel=Q] "
+            "[--policy]\n"
+            "                  [--raw] [--rtd] [--save] [--six] [--verbose] "
+            "[--version]\n"
+            "                  DEVICE [DEVICE...]\n"
             "  where:\n"
             "    --cfile=CF | -C CF    contents in a file called CF\n"
             "    --contents=H,H... | -c H,H...    comma separated string "
@@ -80,6 +131,9 @@ usage()
             " to write\n"
             "    --dbd | -d            disable block descriptors (DBD bit"
             " in cdb)\n"
+            "    --dry-run | -n        with --policy: report DEVICEs that "
+            "differ,\n"
+            "                          send no MODE SELECT\n"
             "    --force | -f          force the contents to be written\n"
             "    --help | -h           print out usage message\n"
             "    --len=10|6 | -l 10|6    use 10 byte (def) or 6 byte "
@@ -93,6 +147,12 @@ usage()
             "    --page=PG_H,SPG_H | -p PG_H,SPG_H    page and subpage code "
             "to be\n"
             "                                         written (in hex)\n"
+            "    --parallel=Q | -q Q    with --policy: at most Q DEVICEs at "
+            "once (def: %d)\n"
+            "    --policy | -P         contents (and mask) is a template; "
+            "MODE SELECT\n"
+            "                          only sent to DEVICEs whose page "
+            "differs\n"
             "    --raw | -r            contents of CF file decoded as "
             "binary\n"
             "    --rtd | -R            set RTD bit (revert to defaults) in "
@@ -105,7 +165,8 @@ usage()
             "    --verbose | -v        increase verbosity\n"
             "    --version | -V        print version string and exit\n\n"
             "writes given mode page with SCSI MODE SELECT (10 or 6) "
-            "command\n");
+            "command. Several\n"
+            "DEVICEs need --policy\n", DEF_PARALLEL);
 }
 
 
@@ -233,6 +294,225 @@ build_mask(const char * inp, uint8_t * mask_arr, int * mask_arr_len,
     return 0;
 }
 
+/* Reads the current mode page (and its header) again, puts mp (mp_len
+ * bytes long) in place of the page and sends a MODE SELECT. */
+static int
+policy_select(int sg_fd, const struct wm_policy_t * pp, const uint8_t * mp,
+              int mp_len, struct wm_dev_t * dp)
+{
+    int res, off, md_len, alloc_len, pdt;
+    struct sg_simple_inquiry_resp inq_data;
+    uint8_t ref_md[MX_ALLOC_LEN];
+    char ebuff[EBUFF_SZ];
+
+    if (0 == sg_simple_inquiry(sg_fd, &inq_data, false, pp->verbose))
+        pdt = inq_data.peripheral_type;
+    else
+        pdt = PDT_UNKNOWN;
+    memset(ref_md, 0, sizeof(ref_md));
+    alloc_len = pp->mode_6 ? SHORT_ALLOC_LEN : MX_ALLOC_LEN;
+    if (pp->mode_6)
+        res = sg_ll_mode_sense6(sg_fd, pp->dbd, 0 /* current */, pp->pg_code,
+                                pp->sub_pg_code, ref_md, alloc_len, true,
+                                pp->verbose);
+    else
+        res = sg_ll_mode_sense10(sg_fd, false /* llbaa */, pp->dbd,
+                                 0 /* current */, pp->pg_code,
+                                 pp->sub_pg_code, ref_md, alloc_len, true,
+                                 pp->verbose);
+    if (res)
+        return res;
+    off = sg_mode_page_offset(ref_md, alloc_len, pp->mode_6, ebuff,
+                              EBUFF_SZ);
+    md_len = sg_msense_calc_length(ref_md, alloc_len, pp->mode_6, NULL);
+    if ((off < 0) || (md_len < 0) || (md_len > alloc_len) ||
+        ((md_len - off) != mp_len)) {
+        snprintf(dp->reason, sizeof(dp->reason), "mode page changed length "
+                 "or is malformed");
+        return SG_LIB_CAT_MALFORMED;
+    }
+    ref_md[0] = 0;      /* mode data length reserved for mode select */
+    if (! pp->mode_6)
+        ref_md[1] = 0;
+    if (0 == pdt)       /* for disks mask out DPOFUA bit */
+        ref_md[pp->mode_6 ? 2 : 3] &= 0xef;
+    memcpy(ref_md + off, mp, mp_len);
+    ref_md[off] &= 0x7f;        /* PS bit reserved in mode select */
+    if (pp->mode_6)
+        return sg_ll_mode_select6_v2(sg_fd, true /* PF */, false, pp->save,
+                                     ref_md, md_len, true, pp->verbose);
+    return sg_ll_mode_select10_v2(sg_fd, true /* PF */, false, pp->save,
+                                  ref_md, md_len, true, pp->verbose);
+}
+
+/* Fetches the current, changeable and (with --save) saved values of the
+ * page, applies the template to the current values and sends a MODE
+ * SELECT only if that (or the saved values) differ. */
+static void
+policy_one(const struct wm_policy_t * pp, struct wm_dev_t * dp)
+{
+    bool need = false;
+    int k, res, smask, mp_len, diff;
+    int sg_fd;
+    int64_t start_ms = sg_mpoll_now_ms();
+    uint8_t cur[MX_ALLOC_LEN];
+    uint8_t chg[MX_ALLOC_LEN];
+    uint8_t sav[MX_ALLOC_LEN];
+    uint8_t want[MX_ALLOC_LEN];
+    void * pc_arr[4];
+
+    sg_fd = sg_cmds_open_device(dp->dev_name, false /* rw */, pp->verbose);
+    if (sg_fd < 0) {
+        snprintf(dp->reason, sizeof(dp->reason), "open error: %s",
+                 safe_strerror(-sg_fd));
+        dp->res = sg_convert_errno(-sg_fd);
+        goto fini;
+    }
+    pc_arr[0] = cur;
+    pc_arr[1] = chg;
+    pc_arr[2] = NULL;
+    pc_arr[3] = pp->save ? sav : NULL;
+    mp_len = 0;
+    res = sg_get_mode_page_controls(sg_fd, pp->mode_6, pp->pg_code,
+                                    pp->sub_pg_code, pp->dbd, true,
+                                    MX_ALLOC_LEN, &smask, pc_arr, &mp_len,
+                                    pp->verbose);
+    if (! (smask & 1)) {
+        dp->res = res ? res : SG_LIB_CAT_OTHER;
+        goto fini;
+    }
+    if ((mp_len < 2) || (mp_len > MX_ALLOC_LEN)) {
+        snprintf(dp->reason, sizeof(dp->reason), "bad mode page length=%d",
+                 mp_len);
+        dp->res = SG_LIB_CAT_MALFORMED;
+        goto fini;
+    }
+    if (! (smask & 2)) {
+        if (pp->verbose)
+            pr2serr("%s: no changeable values, assume all are\n",
+                    dp->dev_name);
+        memset(chg, 0xff, mp_len);
+    }
+    if (pp->tmpl_len > mp_len) {
+        snprintf(dp->reason, sizeof(dp->reason), "template longer than "
+                 "mode page (%d bytes)", mp_len);
+        dp->res = SG_LIB_CAT_OTHER;
+        goto fini;
+    }
+    if (pp->save && (! (cur[0] & 0x80))) {
+        snprintf(dp->reason, sizeof(dp->reason), "PS bit clear, page not "
+                 "saveable");
+        dp->res = SG_LIB_CAT_OTHER;
+        goto fini;
+    }
+    memcpy(want, cur, mp_len);
+    for (k = 2; k < pp->tmpl_len; ++k) {       /* skip page code + length */
+        want[k] = (cur[k] & ~pp->mask[k]) | (pp->tmpl[k] & pp->mask[k]);
+        diff = want[k] ^ cur[k];
+        if (diff & ~chg[k]) {
+            snprintf(dp->reason, sizeof(dp->reason), "byte %d mask 0x%x "
+                     "not changeable", k, diff & ~chg[k]);
+            dp->res = SG_LIB_CAT_INVALID_PARAM;
+            goto fini;
+        }
+        if (diff)
+            ++dp->num_diff;
+        else if (pp->save && (smask & 8) &&
+                 ((want[k] ^ sav[k]) & pp->mask[k]))
+            need = true;        /* current ok but saved value differs */
+    }
+    if (dp->num_diff)
+        need = true;
+    if (! need)
+        dp->outcome = WM_COMPLIANT;
+    else if (pp->dry_run)
+        dp->outcome = WM_WOULD_CHANGE;
+    else {
+        dp->res = policy_select(sg_fd, pp, want, mp_len, dp);
+        if (0 == dp->res)
+            dp->outcome = WM_CHANGED;
+    }
+fini:
+    if (sg_fd >= 0)
+        sg_cmds_close_device(sg_fd);
+    dp->elapsed_ms = sg_mpoll_now_ms() - start_ms;
+}
+
+/* Called by sg_par_each() for the k-th DEVICE */
+static int
+policy_dev_one(int64_t k, void * ctx)
+{
+    struct wm_batch_t * bp = (struct wm_batch_t *)ctx;
+
+    policy_one(bp->pp, bp->dev_arr + k);
+    return 0;
+}
+
+/* Applies the policy to num_devs DEVICEs on at most num_par threads (the
+ * caller being one of them) and outputs one line per DEVICE, in command
+ * line order. Returns 0 if all succeeded, else the first failure. */
+static int
+policy_multi(const char ** dev_names, int num_devs, int num_par,
+             const struct wm_policy_t * pp)
+{
+    int k, n;
+    int num_chg = 0;
+    int ret = 0;
+    struct wm_dev_t * dp;
+    struct wm_batch_t batch;
+    char b[80];
+
+    memset(&batch, 0, sizeof(batch));
+    batch.dev_arr = (struct wm_dev_t *)calloc(num_devs, sizeof(*dp));
+    if (NULL == batch.dev_arr) {
+        pr2serr("%s: out of memory\n", __func__);
+        return sg_convert_errno(ENOMEM);
+    }
+    for (k = 0; k < num_devs; ++k)
+        batch.dev_arr[k].dev_name = dev_names[k];
+    batch.num_devs = num_devs;
+    batch.pp = pp;
+    sg_par_each(num_devs, num_par, policy_dev_one, &batch);
+    for (k = 0, n = 0, dp = batch.dev_arr; k < num_devs; ++k, ++dp) {
+        switch (dp->outcome) {
+        case WM_COMPLIANT:
+            printf("%s: compliant, %" PRId64 " ms\n", dp->dev_name,
+                   dp->elapsed_ms);
+            break;
+        case WM_CHANGED:
+            ++num_chg;
+            printf("%s: changed (%d bytes), %" PRId64 " ms\n",
+                   dp->dev_name, dp->num_diff, dp->elapsed_ms);
+            break;
+        case WM_WOULD_CHANGE:
+            ++num_chg;
+            printf("%s: differs (%d bytes), %" PRId64 " ms\n",
+                   dp->dev_name, dp->num_diff, dp->elapsed_ms);
+            break;
+        case WM_FAILED:
+        default:
+            ++n;
+            if (0 == ret)
+                ret = dp->res;
+            if (dp->reason[0])
+                printf("%s: failed: %s\n", dp->dev_name, dp->reason);
+            else {
+                sg_get_category_sense_str(dp->res, sizeof(b), b,
+                                          pp->verbose);
+                printf("%s: failed: %s\n", dp->dev_name, b);
+            }
+            break;
+        }
+    }
+    if (pp->verbose)
+        pr2serr("%d of %d DEVICEs %s\n", num_chg, num_devs,
+                pp->dry_run ? "differ" : "changed");
+    if (n)
+        pr2serr("%d of %d DEVICEs failed\n", n, num_devs);
+    free(batch.dev_arr);
+    return ret;
+}
+
 
 int
 main(int argc, char * argv[])
@@ -243,13 +523,17 @@ main(int argc, char * argv[])
     bool got_contents = false;
     bool got_mask = false;
     bool mode_6 = false;        /* so default is mode_10 */
+    bool dry_run = false;
+    bool policy = false;
     bool rtd = false;   /* added in spc5r11 */
     bool save = false;
     bool verbose_given = false;
     bool version_given = false;
     int res, c, num, alloc_len, off, pdt, k, md_len, hdr_len, bd_len;
-    int mask_in_len;
+    int mask_in_len = 0;
     int sg_fd = -1;
+    int num_devs = 0;
+    int num_par = DEF_PARALLEL;
     int pg_code = -1;
     int sub_pg_code = 0;
     int verbose = 0;
@@ -259,6 +543,8 @@ main(int argc, char * argv[])
     const char * device_name = NULL;
     const char * cfile_arg = NULL;
     const char * contents_arg = NULL;
+    const char ** dev_names = NULL;
+    struct wm_policy_t * pp;
     uint8_t read_in[MX_ALLOC_LEN];
     uint8_t mask_in[MX_ALLOC_LEN];
     uint8_t ref_md[MX_ALLOC_LEN];
@@ -273,7 +559,7 @@ main(int argc, char * argv[])
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "6c:C:dfhl:m:p:rRsvV", long_options,
+        c = getopt_long(argc, argv, "6c:C:dfhl:m:np:Pq:rRsvV", long_options,
                         &option_index);
         if (c == -1)
             break;
@@ -316,6 +602,9 @@ main(int argc, char * argv[])
             }
             got_mask = true;
             break;
+        case 'n':
+            dry_run = true;
+            break;
         case 'p':
            if (NULL == strchr(optarg, ',')) {
                 num = sscanf(optarg, "%x", &u);
@@ -339,6 +628,14 @@ main(int argc, char * argv[])
                 return SG_LIB_SYNTAX_ERROR;
             }
             break;
+        case 'P':
+            policy = true;
+            break;
+        case 'q':
+            num_par = sg_par_get_num(optarg, 1, MAX_PARALLEL);
+            if (num_par < 0)
+                return SG_LIB_SYNTAX_ERROR;
+            break;
         case 'r':
             do_raw = true;
             break;
@@ -364,11 +661,14 @@ main(int argc, char * argv[])
     if (optind < argc) {
         if (NULL == device_name) {
             device_name = argv[optind];
+            dev_names = (const char **)(argv + optind);
+            num_devs = argc - optind;
             ++optind;
         }
-        if (optind < argc) {
+        if ((optind < argc) && (! policy)) {
             for (; optind < argc; ++optind)
                 pr2serr("Unexpected extra argument: %s\n", argv[optind]);
+            pr2serr("several DEVICEs need '--policy'\n");
             usage();
             return SG_LIB_SYNTAX_ERROR;
         }
@@ -379,7 +679,8 @@ main(int argc, char * argv[])
             return SG_LIB_SYNTAX_ERROR;
         }
         memset(read_in, 0, read_in_sz);
-        if ((ret = build_mode_page(optarg, !! cfile_arg, do_raw, read_in,
+        if ((ret = build_mode_page(cfile_arg ? cfile_arg : contents_arg,
+                                   !! cfile_arg, do_raw, read_in,
                                    &read_in_len, read_in_sz))) {
             pr2serr("bad argument to '%s'\n", cfile_arg ? "--cfile=" :
                                                           "--contents=");
@@ -424,6 +725,52 @@ main(int argc, char * argv[])
         usage();
         return SG_LIB_CONTRADICT;
     }
+    if (dry_run && (! policy)) {
+        pr2serr("'--dry-run' only applies to '--policy'\n\n");
+        usage();
+        return SG_LIB_CONTRADICT;
+    }
+    if (policy) {
+        if (force || rtd) {
+            pr2serr("cannot use '--policy' with '--force' or '--rtd'\n\n");
+            usage();
+            return SG_LIB_CONTRADICT;
+        }
+        if ((! got_contents) || (read_in_len < 2)) {
+            pr2serr("'--policy' needs a template from '--contents=' or "
+                    "'--cfile='\n\n");
+            usage();
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        if ((pg_code != (read_in[0] & 0x3f)) ||
+            (!! (read_in[0] & 0x40) != !! sub_pg_code) ||
+            ((read_in[0] & 0x40) && (read_in[1] != sub_pg_code))) {
+            pr2serr("template page_code (and subpage) does not match "
+                    "'--page='\n");
+            return SG_LIB_CONTRADICT;
+        }
+        pp = (struct wm_policy_t *)calloc(1, sizeof(*pp));
+        if (NULL == pp) {
+            pr2serr("out of memory\n");
+            return sg_convert_errno(ENOMEM);
+        }
+        pp->dbd = dbd;
+        pp->dry_run = dry_run;
+        pp->mode_6 = mode_6;
+        pp->save = save;
+        pp->pg_code = pg_code;
+        pp->sub_pg_code = sub_pg_code;
+        pp->verbose = verbose;
+        pp->tmpl_len = read_in_len;
+        memcpy(pp->tmpl, read_in, read_in_len);
+        /* without --mask every bit in the template is enforced */
+        for (k = 0; k < read_in_len; ++k)
+            pp->mask[k] = (got_mask && (k < mask_in_len)) ? mask_in[k] :
+                                                           0xff;
+        ret = policy_multi(dev_names, num_devs, num_par, pp);
+        free(pp);
+        return (ret >= 0) ? ret : SG_LIB_CAT_OTHER;
+    }
 
     sg_fd = sg_cmds_open_device(device_name, false /* rw */, verbose);
     if (sg_fd < 0) {
@@ -379,7 +379,7 @@ find_value_by_acronym(const char * cp, const struct acron_nv_t * anvp)
     return NULL;  /* not found */
 }
 
-const char * a_format[] = {
+static const char * a_format[] = {
     "binary",
     "ascii",
     "text",
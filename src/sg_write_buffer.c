@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2006-2023 Luben Tuikov and Douglas Gilbert.
+ * Copyright (c) 2006-2026 Luben Tuikov and Douglas Gilbert.
  * All rights reserved.
  * Use of this source code is governed by a BSD-style
  * license that can be found in the BSD_LICENSE file.
@@ -28,8 +28,11 @@
 #include "sg_cmds_basic.h"
 #include "sg_cmds_extra.h"
 #include "sg_unaligned.h"
+#include "sg_par.h"
 #include "sg_pr2serr.h"
 
+#include "sg_fw_common.h"
+
 #ifdef SG_LIB_WIN32
 #ifdef SG_LIB_WIN32_DIRECT
 #include "sg_pt.h"      /* needed for scsi_pt_win32_direct() */
@@ -40,7 +43,7 @@
  * This utility issues the SCSI WRITE BUFFER command to the given device.
  */
 
-static const char * version_str = "1.32 20230519";    /* spc6r07 */
+static const char * version_str = "1.34 20261015";    /* spc6r07 */
 
 static const char * my_name = "sg_write_buffer: ";    /* spc6r07 */
 
@@ -62,6 +65,7 @@ static struct option long_options[] = {
         {"length", required_argument, 0, 'l'},
         {"mode", required_argument, 0, 'm'},
         {"offset", required_argument, 0, 'o'},
+        {"parallel", required_argument, 0, 'p'},
         {"read-stdin", no_argument, 0, 'r'},
         {"read_stdin", no_argument, 0, 'r'},
         {"raw", no_argument, 0, 'r'},
@@ -82,10 +86,11 @@ usage()
             "[--in=FILE]\n"
             "                       [--length=LEN] [--mode=MO] "
             "[--offset=OFF]\n"
-            "                       [--read-stdin] [--skip=SKIP] "
-            "[--specific=MS]\n"
-            "                       [--timeout=TO] [--verbose] [--version] "
-            "DEVICE\n"
+            "                       [--parallel=Q] [--read-stdin] "
+            "[--skip=SKIP]\n"
+            "                       [--specific=MS] [--timeout=TO] "
+            "[--verbose]\n"
+            "                       [--version] DEVICE [DEVICE...]\n"
             "  where:\n"
             "    --bpw=CS|-b CS         CS is chunk size: bytes per write "
             "buffer\n"
@@ -106,6 +111,9 @@ usage()
             "                           (def: 0 -> 'combined header and "
             "data' (obs))\n"
             "    --offset=OFF|-o OFF    buffer offset (unit: bytes, def: 0)\n"
+            "    --parallel=Q|-p Q      with several DEVICEs, download to up "
+            "to Q of\n"
+            "                           them at the same time (def: 8)\n"
             "    --read-stdin|-r        read from stdin (same as '-I -')\n"
             "    --skip=SKIP|-s SKIP    bytes in file FILE to skip before "
             "reading\n"
@@ -119,6 +127,9 @@ usage()
             "to list\navailable modes. A chunk size of 4 KB ('--bpw=4k') "
             "seems to work well.\nExample: sg_write_buffer -b 4k -I xxx.lod "
             "-m 7 /dev/sg3\n"
+            "With several DEVICEs FILE is read once and sent to all of "
+            "them; then with\n',act' the deferred microcode is activated on "
+            "all that succeeded.\n"
           );
 
 }
@@ -189,6 +200,52 @@ print_modes(void)
             "dmc_offs_ev_defer mode downloads.\n");
 }
 
+/* What each WRITE BUFFER command sent to several DEVICEs has in common */
+struct wb_fleet_t {
+    bool dry_run;
+    int wb_mode;
+    int wb_mspec;
+    int wb_id;
+    int wb_offset;
+    int wb_timeout;
+    int verbose;
+};
+
+static int
+wb_chunk(struct fw_dev_t * dp, int off, const uint8_t * bp, int len,
+         bool last, void * ctx)
+{
+    const struct wb_fleet_t * fp = (const struct wb_fleet_t *)ctx;
+
+    if (last) { }       /* suppress warning */
+    if (fp->verbose)
+        pr2serr("%s: sending write buffer, mode=0x%x, mspec=%d, id=%d, "
+                "offset=%d, len=%d\n", dp->dev_name, fp->wb_mode,
+                fp->wb_mspec, fp->wb_id, fp->wb_offset + off, len);
+    if (fp->dry_run)
+        return 0;
+    /* data-out only, so the shared (perhaps mapped) image is not written */
+    return sg_ll_write_buffer_v2(dp->sg_fd, fp->wb_mode, fp->wb_mspec,
+                                 fp->wb_id, fp->wb_offset + off, (void *)bp,
+                                 len, fp->wb_timeout, true, fp->verbose);
+}
+
+static int
+wb_activate(struct fw_dev_t * dp, void * ctx)
+{
+    const struct wb_fleet_t * fp = (const struct wb_fleet_t *)ctx;
+
+    if (fp->verbose)
+        pr2serr("%s: sending Activate deferred microcode [0xf]\n",
+                dp->dev_name);
+    if (fp->dry_run)
+        return 0;
+    return sg_ll_write_buffer_v2(dp->sg_fd, MODE_ACTIVATE_MC,
+                                 0 /* m_specific */, 0 /* buffer_id */,
+                                 0 /* buffer_offset */, NULL, 0,
+                                 fp->wb_timeout, true, fp->verbose);
+}
+
 
 int
 main(int argc, char * argv[])
@@ -203,6 +260,8 @@ main(int argc, char * argv[])
     int sg_fd = -1;
     int bpw = 0;
     int do_help = 0;
+    int num_devs = 0;
+    int num_q = FW_DEF_PARALLEL;
     int ret = 0;
     int verbose = 0;
     int wb_id = 0;
@@ -219,14 +278,17 @@ main(int argc, char * argv[])
     uint8_t * free_dop = NULL;
     char * cp;
     const struct mode_s * mp;
+    struct fw_dev_t * dev_arr = NULL;
+    struct fw_image_t image;
     char ebuff[EBUFF_SZ];
 
+    memset(&image, 0, sizeof(image));
     if (getenv("SG3_UTILS_INVOCATION"))
         sg_rep_invocation(my_name, version_str, argc, argv, stderr);
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "b:dhi:I:l:m:o:rs:S:t:vV", long_options,
+        c = getopt_long(argc, argv, "b:dhi:I:l:m:o:p:rs:S:t:vV", long_options,
                         &option_index);
         if (c == -1)
             break;
@@ -299,6 +361,11 @@ main(int argc, char * argv[])
                 return SG_LIB_SYNTAX_ERROR;
             }
             break;
+        case 'p':
+            num_q = sg_par_get_num(optarg, 1, FW_MAX_PARALLEL);
+            if (num_q < 0)
+                return SG_LIB_SYNTAX_ERROR;
+            break;
         case 'r':       /* --read-stdin and --raw (previous name) */
             file_name = "-";
             break;
@@ -346,16 +413,8 @@ main(int argc, char * argv[])
         return 0;
     }
     if (optind < argc) {
-        if (NULL == device_name) {
-            device_name = argv[optind];
-            ++optind;
-        }
-        if (optind < argc) {
-            for (; optind < argc; ++optind)
-                pr2serr("Unexpected extra argument: %s\n", argv[optind]);
-            usage();
-            return SG_LIB_SYNTAX_ERROR;
-        }
+        device_name = argv[optind];
+        num_devs = argc - optind;
     }
 
 #ifdef DEBUG
@@ -399,15 +458,15 @@ main(int argc, char * argv[])
 #endif
 #endif
 
-    sg_fd = sg_cmds_open_device(device_name, false /* rw */, verbose);
-    if (sg_fd < 0) {
-        if (verbose)
-            pr2serr("%sopen error: %s: %s\n", my_name, device_name,
-                    safe_strerror(-sg_fd));
-        ret = sg_convert_errno(-sg_fd);
-        goto err_out;
-    }
-    if (file_name || (wb_len > 0)) {
+    if ((num_devs > 1) && file_name && strcmp(file_name, "-")) {
+        /* read (or map) FILE once, all DEVICEs share it */
+        ret = fw_image_from_file(file_name, wb_skip,
+                                 (wb_len_given ? wb_len : 0), &image,
+                                 verbose);
+        if (ret)
+            goto err_out;
+        wb_len = image.len;
+    } else if (file_name || (wb_len > 0)) {
         if (0 == wb_len)
             wb_len = DEF_XFER_LEN;
         dop = sg_memalign(wb_len, 0, &free_dop, false);
@@ -520,6 +579,47 @@ main(int argc, char * argv[])
         }
     }
 
+    if (num_devs > 1) {
+        struct wb_fleet_t fleet;
+        struct fw_ops_t fw_ops;
+
+        dev_arr = (struct fw_dev_t *)calloc(num_devs, sizeof(*dev_arr));
+        if (NULL == dev_arr) {
+            pr2serr("%sout of memory\n", my_name);
+            ret = sg_convert_errno(ENOMEM);
+            goto err_out;
+        }
+        for (k = 0; k < num_devs; ++k)
+            dev_arr[k].dev_name = argv[optind + k];
+        if (NULL == image.bp) {
+            image.bp = dop;
+            image.len = dop ? wb_len : 0;
+        }
+        memset(&fleet, 0, sizeof(fleet));
+        fleet.dry_run = dry_run;
+        fleet.wb_mode = wb_mode;
+        fleet.wb_mspec = wb_mspec;
+        fleet.wb_id = wb_id;
+        fleet.wb_offset = wb_offset;
+        fleet.wb_timeout = wb_timeout;
+        fleet.verbose = verbose;
+        memset(&fw_ops, 0, sizeof(fw_ops));
+        fw_ops.chunk_fn = wb_chunk;
+        if (bpw_then_activate)
+            fw_ops.act_fn = wb_activate;
+        ret = fw_run_all(dev_arr, num_devs, &image, bpw, num_q, &fw_ops,
+                         &fleet, "WRITE BUFFER", verbose);
+        goto err_out;
+    }
+
+    sg_fd = sg_cmds_open_device(device_name, false /* rw */, verbose);
+    if (sg_fd < 0) {
+        if (verbose)
+            pr2serr("%sopen error: %s: %s\n", my_name, device_name,
+                    safe_strerror(-sg_fd));
+        ret = sg_convert_errno(-sg_fd);
+        goto err_out;
+    }
     res = 0;
     if (bpw > 0) {
         for (k = 0; k < wb_len; k += n) {
@@ -581,6 +681,9 @@ main(int argc, char * argv[])
     }
 
 err_out:
+    fw_image_free(&image);      /* no-op if image.bp borrowed dop */
+    if (dev_arr)
+        free(dev_arr);
     if (free_dop)
         free(free_dop);
     if (read_buf)
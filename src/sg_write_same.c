@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2009-2022 Douglas Gilbert.
+ * Copyright (c) 2009-2026 Douglas Gilbert.
  * All rights reserved.
  * Use of this source code is governed by a BSD-style
  * license that can be found in the BSD_LICENSE file.
@@ -26,14 +26,25 @@
 #include "config.h"
 #endif
 
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+#include <time.h>
+#elif defined(HAVE_GETTIMEOFDAY)
+#include <time.h>
+#include <sys/time.h>
+#endif
+
 #include "sg_lib.h"
 #include "sg_pt.h"
 #include "sg_cmds_basic.h"
 #include "sg_cmds_extra.h"
 #include "sg_unaligned.h"
+#include "sg_par.h"
 #include "sg_pr2serr.h"
+#include "sg_rcache.h"
+#include "sg_geom.h"
+#include "sg_pat.h"
 
-static const char * version_str = "1.34 20220127";
+static const char * version_str = "1.38 20261015";
 
 
 #define ME "sg_write_same: "
@@ -46,14 +57,16 @@ static const char * version_str = "1.34 20220127";
 #define WRITE_SAME10_LEN 10
 #define WRITE_SAME16_LEN 16
 #define WRITE_SAME32_LEN 32
-#define RCAP10_RESP_LEN 8
-#define RCAP16_RESP_LEN 32
 #define SENSE_BUFF_LEN 64       /* Arbitrary, could be larger */
 #define DEF_TIMEOUT_SECS 60
 #define DEF_WS_CDB_SIZE WRITE_SAME10_LEN
 #define DEF_WS_NUMBLOCKS 1
 #define MAX_XFER_LEN (64 * 1024)
 #define EBUFF_SZ 512
+#define DEF_ALL_PARALLEL 4
+#define MAX_ALL_PARALLEL 64
+#define DEF_ALL_WS_BLOCKS 0x10000  /* when no MAXIMUM WRITE SAME LENGTH */
+#define ALL_PROGRESS_SECS 5
 
 #ifndef UINT32_MAX
 #define UINT32_MAX ((uint32_t)-1)
@@ -63,7 +76,9 @@ static struct option long_options[] = {
     {"10", no_argument, 0, 'R'},
     {"16", no_argument, 0, 'S'},
     {"32", no_argument, 0, 'T'},
+    {"all", no_argument, 0, 'A'},
     {"anchor", no_argument, 0, 'a'},
+    {"cache", required_argument, 0, 'C'},
     {"ff", no_argument, 0, 'f'},
     {"grpnum", required_argument, 0, 'g'},
     {"help", no_argument, 0, 'h'},
@@ -72,6 +87,7 @@ static struct option long_options[] = {
     {"lbdata", no_argument, 0, 'L'},
     {"ndob", no_argument, 0, 'N'},
     {"num", required_argument, 0, 'n'},
+    {"parallel", required_argument, 0, 'p'},
     {"pbdata", no_argument, 0, 'P'},
     {"timeout", required_argument, 0, 't'},
     {"unmap", no_argument, 0, 'U'},
@@ -83,6 +99,7 @@ static struct option long_options[] = {
 };
 
 struct opts_t {
+    bool all;
     bool anchor;
     bool ff;
     bool ndob;
@@ -94,12 +111,16 @@ struct opts_t {
     bool want_ws10;
     int grpnum;
     int numblocks;
+    int num_par;        /* --parallel=Q with --all */
     int timeout;
     int verbose;
     int wrprotect;
     int xfer_len;
     int pref_cdb_size;
     uint64_t lba;
+    uint64_t all_num;   /* --num=NUM with --all, 0 -> to end of device */
+    const char * cache_dir;
+    struct sg_pat pat;  /* --in=pat:PAT, kind SG_PAT_NONE otherwise */
     char ifilename[256];
 };
 
@@ -107,12 +128,13 @@ struct opts_t {
 static void
 usage()
 {
-    pr2serr("Usage: sg_write_same [--10] [--16] [--32] [--anchor] "
-            "[-ff] [--grpnum=GN]\n"
-            "                     [--help] [--in=IF] [--lba=LBA] [--lbdata] "
-            "[--ndob]\n"
-            "                     [--num=NUM] [--pbdata] [--timeout=TO] "
-            "[--unmap]\n"
+    pr2serr("Usage: sg_write_same [--10] [--16] [--32] [--all] [--anchor] "
+            "[--cache=DIR]\n"
+            "                     [--ff] [--grpnum=GN] [--help] [--in=IF] "
+            "[--lba=LBA]\n"
+            "                     [--lbdata] [--ndob] [--num=NUM] "
+            "[--parallel=Q]\n"
+            "                     [--pbdata] [--timeout=TO] [--unmap]\n"
             "                     [--verbose] [--version] [--wrprotect=WRP] "
             "[xferlen=LEN]\n"
             "                     DEVICE\n"
@@ -124,7 +146,16 @@ usage()
             "                         LBA+NUM > 32 bits, or NUM > 65535; "
             "then def 16)\n"
             "    --32|-T              send WRITE SAME(32) (def: 10 or 16)\n"
+            "    --all|-A             write from LBA to the end of DEVICE "
+            "(or NUM\n"
+            "                         blocks) with as many WRITE SAME(16 "
+            "or 32)\n"
+            "                         commands as the Block Limits VPD "
+            "page needs\n"
             "    --anchor|-a          set ANCHOR field in cdb\n"
+            "    --cache=DIR|-C DIR    use the response cache in DIR for "
+            "READ CAPACITY\n"
+            "                          and the supported operation codes\n"
             "    --ff|-f              use buffer of 0xff bytes for fill "
             "(def: 0x0 bytes)\n"
             "    --grpnum=GN|-g GN    GN is group number field (def: 0)\n"
@@ -132,7 +163,10 @@ usage()
             "    --in=IF|-i IF        IF is file to fetch one block of data "
             "from (use LEN\n"
             "                         bytes or whole file). Block written to "
-            "DEVICE\n"
+            "DEVICE.\n"
+            "                         Or pat:PAT for a generated block: zero, "
+            "ff, HEX,\n"
+            "                         lba or prng[,SEED] (block at LBA)\n"
             "    --lba=LBA|-l LBA     LBA is the logical block address to "
             "start (def: 0)\n"
             "    --lbdata|-L          set LBDATA bit (obsolete)\n"
@@ -142,6 +176,8 @@ usage()
             "write (def: 1)\n"
             "                         [Beware NUM==0 may mean: 'rest of "
             "device']\n"
+            "    --parallel=Q|-p Q    with --all, up to Q commands in "
+            "flight (def: 4)\n"
             "    --pbdata|-P          set PBDATA bit (obsolete)\n"
             "    --timeout=TO|-t TO    command timeout (unit: seconds) (def: "
             "60)\n"
@@ -160,6 +196,8 @@ usage()
             "LBPRZ field. As a precaution one of the '--in=',\n'--lba=' or "
             "'--num=' options is required.\nAnother implementation of WRITE "
             "SAME is found in the sg_write_x utility.\n"
+            "Example to zero all of /dev/sg2 with 8 commands in flight:\n"
+            "    sg_write_same --all --ndob --parallel=8 /dev/sg2\n"
             );
 }
 
@@ -192,8 +230,26 @@ do_write_same(int sg_fd, const struct opts_t * op, const void * dataoutp,
             }
         }
     }
+    if ((WRITE_SAME10_LEN == cdb_len) && (! op->want_ws10) &&
+        (0 == sg_supp_ops_query(sg_fd, WRITE_SAME10_OP, -1)) &&
+        (1 == sg_supp_ops_query(sg_fd, WRITE_SAME16_OP, -1))) {
+        cdb_len = WRITE_SAME16_LEN;
+        if (op->verbose)
+            pr2serr("use WRITE SAME(16) since the 10 byte cdb is not "
+                    "supported\n");
+    }
     if (act_cdb_lenp)
         *act_cdb_lenp = cdb_len;
+    if (WRITE_SAME32_LEN == cdb_len)
+        res = sg_supp_ops_query(sg_fd, VARIABLE_LEN_OP, WRITE_SAME32_SA);
+    else
+        res = sg_supp_ops_query(sg_fd, (WRITE_SAME16_LEN == cdb_len) ?
+                                WRITE_SAME16_OP : WRITE_SAME10_OP, -1);
+    if (0 == res) {     /* known to be unsupported, don't send it */
+        pr2serr("Write same(%d) not in supported operation codes\n",
+                cdb_len);
+        return SG_LIB_CAT_INVALID_OP;
+    }
     switch (cdb_len) {
     case WRITE_SAME10_LEN:
         ws_cdb[0] = WRITE_SAME10_OP;
@@ -315,6 +371,172 @@ do_write_same(int sg_fd, const struct opts_t * op, const void * dataoutp,
     return ret;
 }
 
+/* --all state shared by the jobs issuing WRITE SAME commands. Job k
+ * writes the k-th chunk of the range, of up to chunk blocks. The counts,
+ * the first failure and pr_ns are updated under sg_par_lock(). */
+struct ws_all_t {
+    int sg_fd;
+    int num_cmds;
+    int res;            /* of the first command that failed */
+    uint32_t block_size;        /* 0 -> not known */
+    uint64_t start_lba;
+    uint64_t end_lba;   /* one past the last block to write */
+    uint64_t chunk;
+    uint64_t done_blks;
+    uint64_t bad_lba;   /* start of the command that failed */
+    uint64_t start_ns;
+    uint64_t pr_ns;     /* when progress was last reported */
+    const struct opts_t * op;
+    const uint8_t * dataoutp;
+};
+
+/* Fetches the Maximum LBA and block size with READ CAPACITY(16), falling
+ * back to READ CAPACITY(10), along with the Block Limits VPD page that
+ * ws_all() wants. Returns 0 on success. */
+static int
+ws_all_capacity(int sg_fd, uint64_t * max_lbap, uint32_t * blk_szp, int vb)
+{
+    int res;
+    struct sg_geom g;
+
+    res = sg_geom_get(sg_fd, SG_GEOM_BL, &g, true, (vb ? (vb - 1) : 0));
+    if (res)
+        return (res < 0) ? sg_convert_errno(-res) : res;
+    *max_lbap = g.num_blks - 1;
+    *blk_szp = g.blk_sz;
+    return 0;
+}
+
+/* Called under sg_par_lock() after blocks have been written. Outputs a
+ * progress line if ALL_PROGRESS_SECS have passed since the last one. */
+static void
+ws_all_progress(struct ws_all_t * ap)
+{
+    uint64_t now = sg_get_mono_ns();
+    uint64_t total = ap->end_lba - ap->start_lba;
+    double secs, rate;
+
+    if ((now - ap->pr_ns) < ((uint64_t)ALL_PROGRESS_SECS * 1000000000))
+        return;
+    ap->pr_ns = now;
+    secs = (double)(now - ap->start_ns) / 1000000000.0;
+    rate = (secs > 0.0) ? ((double)ap->done_blks / secs) : 0.0;
+    pr2serr("Write same: %.1f%% done, %" PRIu64 " of %" PRIu64 " blocks",
+            (100.0 * (double)ap->done_blks) / (double)total, ap->done_blks,
+            total);
+    if (rate > 0.0)
+        pr2serr(", about %.0f secs to go",
+                (double)(total - ap->done_blks) / rate);
+    pr2serr("\n");
+}
+
+/* Writes chunk k. Returns the result of a failed command, which stops
+ * further chunks being started. */
+static int
+ws_all_one(int64_t k, void * ctx)
+{
+    int res;
+    uint64_t lba, n;
+    struct ws_all_t * ap = (struct ws_all_t *)ctx;
+    struct opts_t o;
+
+    lba = ap->start_lba + ((uint64_t)k * ap->chunk);
+    n = ap->end_lba - lba;
+    if (n > ap->chunk)
+        n = ap->chunk;
+    o = *ap->op;
+    o.lba = lba;
+    o.numblocks = (int)n;
+    res = do_write_same(ap->sg_fd, &o, ap->dataoutp, NULL);
+    sg_par_lock();
+    ++ap->num_cmds;
+    if (res) {
+        if (0 == ap->res) {
+            ap->res = res;
+            ap->bad_lba = lba;
+        }
+    } else {
+        ap->done_blks += n;
+        ws_all_progress(ap);
+    }
+    sg_par_unlock();
+    return res;
+}
+
+/* --all: writes from op->lba to the end of the device (or op->all_num
+ * blocks) splitting the range into commands of up to the MAXIMUM WRITE
+ * SAME LENGTH in the Block Limits VPD page, with up to op->num_par in
+ * flight. Stops issuing commands after the first failure. Returns 0 if
+ * the whole range was written. */
+static int
+ws_all(int sg_fd, const struct opts_t * op, const uint8_t * dataoutp,
+       uint64_t max_lba, uint32_t block_size)
+{
+    int vb = op->verbose;
+    uint64_t max_ws = 0;
+    uint64_t ns;
+    double secs;
+    struct ws_all_t wa;
+    struct sg_geom g;
+
+    memset(&wa, 0, sizeof(wa));
+    wa.sg_fd = sg_fd;
+    wa.op = op;
+    wa.dataoutp = dataoutp;
+    wa.block_size = block_size;
+    wa.start_lba = op->lba;
+    if (op->lba > max_lba) {
+        pr2serr("--lba=0x%" PRIx64 " is beyond the Maximum LBA (0x%" PRIx64
+                ")\n", op->lba, max_lba);
+        return SG_LIB_LBA_OUT_OF_RANGE;
+    }
+    if (op->all_num > 0) {
+        if (op->all_num > (max_lba + 1 - op->lba)) {
+            pr2serr("--lba= plus --num= goes beyond the Maximum LBA (0x%"
+                    PRIx64 ")\n", max_lba);
+            return SG_LIB_LBA_OUT_OF_RANGE;
+        }
+        wa.end_lba = op->lba + op->all_num;
+    } else
+        wa.end_lba = max_lba + 1;
+    if ((0 == sg_geom_get(sg_fd, SG_GEOM_BL, &g, false,
+                          (vb > 1) ? vb - 1 : 0)) && g.have_bl)
+        max_ws = g.max_ws_len;
+    if (0 == max_ws) {
+        max_ws = DEF_ALL_WS_BLOCKS;
+        if (vb)
+            pr2serr("No MAXIMUM WRITE SAME LENGTH in Block Limits VPD page, "
+                    "using %" PRIu64 " blocks\n", max_ws);
+    }
+    /* NUMBER OF LOGICAL BLOCKS is 32 bits, keep within op->numblocks */
+    wa.chunk = (max_ws > INT_MAX) ? INT_MAX : max_ws;
+    if (vb)
+        pr2serr("Write same(%d) from LBA 0x%" PRIx64 " for %" PRIu64
+                " blocks, up to %" PRIu64 " blocks per command\n",
+                op->pref_cdb_size, wa.start_lba, wa.end_lba - wa.start_lba,
+                wa.chunk);
+    wa.start_ns = sg_get_mono_ns();
+    wa.pr_ns = wa.start_ns;
+    ns = (wa.end_lba - wa.start_lba + wa.chunk - 1) / wa.chunk;
+    sg_par_each((int64_t)ns, op->num_par, ws_all_one, &wa);
+    ns = sg_get_mono_ns() - wa.start_ns;
+    secs = (double)ns / 1000000000.0;
+    printf("Wrote %" PRIu64 " blocks from LBA 0x%" PRIx64 " in %d "
+           "commands", wa.done_blks, wa.start_lba, wa.num_cmds);
+    if (secs > 0.0) {
+        printf(", %.3f secs", secs);
+        if (block_size > 0)
+            printf(", %.1f MB/sec", ((double)wa.done_blks * block_size) /
+                   (secs * 1000000.0));
+    }
+    printf("\n");
+    if (wa.res)
+        pr2serr("Write same(%d) failed on the command starting at LBA 0x%"
+                PRIx64 ", no more were sent\n", op->pref_cdb_size,
+                wa.bad_lba);
+    return wa.res;
+}
+
 
 int
 main(int argc, char * argv[])
@@ -328,6 +550,8 @@ main(int argc, char * argv[])
     int sg_fd = -1;
     int ret = -1;
     uint32_t block_size;
+    uint32_t all_blk_sz = 0;
+    uint64_t all_max_lba = 0;
     int64_t ll;
     const char * device_name = NULL;
     struct opts_t * op;
@@ -335,7 +559,6 @@ main(int argc, char * argv[])
     uint8_t * free_wBuff = NULL;
     char ebuff[EBUFF_SZ];
     char b[80];
-    uint8_t resp_buff[RCAP16_RESP_LEN];
     struct opts_t opts;
     struct stat a_stat;
 
@@ -344,10 +567,11 @@ main(int argc, char * argv[])
     op->numblocks = DEF_WS_NUMBLOCKS;
     op->pref_cdb_size = DEF_WS_CDB_SIZE;
     op->timeout = DEF_TIMEOUT_SECS;
+    op->num_par = DEF_ALL_PARALLEL;
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "afg:hi:l:Ln:NPRSt:TUvVw:x:",
+        c = getopt_long(argc, argv, "aAC:fg:hi:l:Ln:Np:PRSt:TUvVw:x:",
                         long_options, &option_index);
         if (c == -1)
             break;
@@ -356,6 +580,12 @@ main(int argc, char * argv[])
         case 'a':
             op->anchor = true;
             break;
+        case 'A':
+            op->all = true;
+            break;
+        case 'C':
+            op->cache_dir = optarg;
+            break;
         case 'f':
             op->ff = true;
             break;
@@ -388,13 +618,20 @@ main(int argc, char * argv[])
             op->lbdata = true;
             break;
         case 'n':
-            op->numblocks = sg_get_num(optarg);
-            if (op->numblocks < 0)  {
+            ll = sg_get_llnum(optarg);
+            if (-1 == ll) {
                 pr2serr("bad argument to '--num'\n");
                 return SG_LIB_SYNTAX_ERROR;
             }
+            op->all_num = (uint64_t)ll;
+            op->numblocks = (ll > INT_MAX) ? -1 : (int)ll;
             num_given = true;
             break;
+        case 'p':
+            op->num_par = sg_par_get_num(optarg, 1, MAX_ALL_PARALLEL);
+            if (op->num_par < 0)
+                return SG_LIB_SYNTAX_ERROR;
+            break;
         case 'N':
             op->ndob = true;
             break;
@@ -500,10 +737,22 @@ main(int argc, char * argv[])
     }
     vb = op->verbose;
 
-    if ((! if_given) && (! lba_given) && (! num_given)) {
-        pr2serr("As a precaution, one of '--in=', '--lba=' or '--num=' is "
-                "required\n");
+    if (op->all) {
+        if (op->want_ws10 || (WRITE_SAME10_LEN == op->pref_cdb_size)) {
+            if (op->want_ws10) {
+                pr2serr("--all needs WRITE SAME(16) or (32), not --10\n");
+                return SG_LIB_CONTRADICT;
+            }
+            op->pref_cdb_size = WRITE_SAME16_LEN;
+        }
+    } else if ((! if_given) && (! lba_given) && (! num_given)) {
+        pr2serr("As a precaution, one of '--in=', '--lba=', '--num=' or "
+                "'--all' is required\n");
         return SG_LIB_CONTRADICT;
+    } else if (op->numblocks < 0) {
+        pr2serr("'--num=' too large, without '--all' it must be less than "
+                "2**31\n");
+        return SG_LIB_SYNTAX_ERROR;
     }
 
     if (op->ndob) {
@@ -516,6 +765,11 @@ main(int argc, char * argv[])
                     "acceptable\n");
             return SG_LIB_CONTRADICT;
         }
+    } else if (sg_pat_is_pat(op->ifilename)) {
+        if (! sg_pat_parse(op->ifilename, &op->pat)) {
+            pr2serr("bad pattern in '--in=%s'\n", op->ifilename);
+            return SG_LIB_SYNTAX_ERROR;
+        }
     } else if (op->ifilename[0]) {
         got_stdin = (0 == strcmp(op->ifilename, "-"));
         if (! got_stdin) {
@@ -540,48 +794,29 @@ main(int argc, char * argv[])
         ret = sg_convert_errno(-sg_fd);
         goto err_out;
     }
+    if (op->cache_dir)
+        sg_rcache_open(op->cache_dir, device_name, sg_fd, vb);
+    if (op->all) {
+        ret = ws_all_capacity(sg_fd, &all_max_lba, &all_blk_sz, vb);
+        if (ret)
+            goto err_out;
+    }
 
     if (! op->ndob) {
         prot_en = false;
         if (0 == op->xfer_len) {
-            res = sg_ll_readcap_16(sg_fd, false /* pmi */, 0 /* llba */,
-                                   resp_buff, RCAP16_RESP_LEN, true,
-                                   (vb ? (vb - 1): 0));
-            if (SG_LIB_CAT_UNIT_ATTENTION == res) {
-                pr2serr("Read capacity(16) unit attention, try again\n");
-                res = sg_ll_readcap_16(sg_fd, false, 0, resp_buff,
-                                       RCAP16_RESP_LEN, true,
-                                       (vb ? (vb - 1): 0));
-            }
+            struct sg_geom g;
+
+            res = sg_geom_get(sg_fd, 0, &g, false, (vb ? (vb - 1): 0));
             if (0 == res) {
-                if (vb > 3)
-                    hex2stderr(resp_buff, RCAP16_RESP_LEN, 1);
-                block_size = sg_get_unaligned_be32(resp_buff + 8);
-                prot_en = !!(resp_buff[12] & 0x1);
+                block_size = g.blk_sz;
+                prot_en = g.prot_en;
                 op->xfer_len = block_size;
                 if (prot_en && (op->wrprotect > 0))
                     op->xfer_len += 8;
-            } else if ((SG_LIB_CAT_INVALID_OP == res) ||
-                       (SG_LIB_CAT_ILLEGAL_REQ == res)) {
-                if (vb)
-                    pr2serr("Read capacity(16) not supported, try Read "
-                            "capacity(10)\n");
-                res = sg_ll_readcap_10(sg_fd, false /* pmi */, 0 /* lba */,
-                                       resp_buff, RCAP10_RESP_LEN, true,
-                                       (vb ? (vb - 1): 0));
-                if (0 == res) {
-                    if (vb > 3)
-                        hex2stderr(resp_buff, RCAP10_RESP_LEN, 1);
-                    block_size = sg_get_unaligned_be32(resp_buff + 4);
-                    op->xfer_len = block_size;
-                } else {
-                    sg_get_category_sense_str(res, sizeof(b), b, vb);
-                    pr2serr("Read capacity(10): %s\n", b);
-                    pr2serr("Unable to calculate block size\n");
-                }
             } else if (vb) {
                 sg_get_category_sense_str(res, sizeof(b), b, vb);
-                pr2serr("Read capacity(16): %s\n", b);
+                pr2serr("Read capacity: %s\n", b);
                 pr2serr("Unable to calculate block size\n");
             }
         }
@@ -606,7 +841,17 @@ main(int argc, char * argv[])
         }
         if (op->ff)
             memset(wBuff, 0xff, op->xfer_len);
-        if (op->ifilename[0]) {
+        if (SG_PAT_NONE != op->pat.kind) {
+            int pi_len = (prot_en && (op->wrprotect > 0)) ? 8 : 0;
+
+            /* protection information, if any, as for the default */
+            sg_pat_fill(&op->pat, wBuff, op->xfer_len - pi_len, op->lba, 1);
+            if (pi_len)
+                memset(wBuff + op->xfer_len - pi_len, 0xff, pi_len);
+            if (vb)
+                pr2serr("Data-out buffer of %d bytes from %s\n",
+                        op->xfer_len, sg_pat_str(&op->pat, ebuff, EBUFF_SZ));
+        } else if (op->ifilename[0]) {
             if (got_stdin) {
                 infd = STDIN_FILENO;
                 if (sg_set_binary_mode(STDIN_FILENO) < 0)
@@ -652,6 +897,10 @@ main(int argc, char * argv[])
         }
     }
 
+    if (op->all) {
+        ret = ws_all(sg_fd, op, wBuff, all_max_lba, all_blk_sz);
+        goto err_out;
+    }
     ret = do_write_same(sg_fd, op, wBuff, &act_cdb_len);
     if (ret) {
         sg_get_category_sense_str(ret, sizeof(b), b, vb);
@@ -10,7 +10,8 @@
  * device. It sends the command with the logical block address passed as the
  * LBA argument, for the given number of blocks. The number of bytes sent is
  * supplied separately, either by the size of the given file (IF) or
- * explicitly with ILEN.
+ * explicitly with ILEN. With --all or --range many commands are kept in
+ * flight to write and verify whole ranges of blocks.
  *
  * This code was contributed by Bruno Goncalves
  */
@@ -37,10 +38,14 @@
 #include "sg_lib.h"
 #include "sg_pt.h"
 #include "sg_cmds_basic.h"
+#include "sg_dd_eng.h"
+#include "sg_mux.h"
+#include "sg_mpoll.h"
+#include "sg_json_sg_lib.h"
 #include "sg_unaligned.h"
 #include "sg_pr2serr.h"
 
-static const char * version_str = "1.22 20230519";
+static const char * version_str = "1.23 20261015";
 
 
 #define ME "sg_write_verify: "
@@ -51,24 +56,45 @@ static const char * version_str = "1.22 20230519";
 #define WRITE_VERIFY10_CMDLEN   10
 #define WRITE_VERIFY16_CMD      0x8e
 #define WRITE_VERIFY16_CMDLEN   16
+#define WRITE10_CMD             0x2a
+#define WRITE16_CMD             0x8a
+#define VERIFY10_CMD            0x2f
+#define VERIFY16_CMD            0x8f
 
 #define WRPROTECT_MASK  (0x7)
 #define WRPROTECT_SHIFT (5)
 
 #define DEF_TIMEOUT_SECS 60
+#define DEF_PL_NUM 128          /* blocks per command with --all or --range */
+#define MAX_QD 256
+#define MAX_RANGES 64
+#define MAX_ERR_LBAS 1024       /* listed, more are counted */
+#define PROGRESS_SECS 5
+
+#define PL_STG_WAV 0            /* WRITE AND VERIFY */
+#define PL_STG_WRITE 1
+#define PL_STG_VERIFY 2
 
 
 static struct option long_options[] = {
     {"16", no_argument, 0, 'S'},
+    {"all", no_argument, 0, 'A'},
     {"bytchk", required_argument, 0, 'b'},
     {"dpo", no_argument, 0, 'd'},
     {"group", required_argument, 0, 'g'},
     {"help", no_argument, 0, 'h'},
     {"ilen", required_argument, 0, 'I'},
     {"in", required_argument, 0, 'i'},
+    {"json", optional_argument, 0, '^'},    /* short option is '-j' */
+    {"js-file", required_argument, 0, 'J'},
+    {"js_file", required_argument, 0, 'J'},
     {"lba", required_argument, 0, 'l'},
     {"num", required_argument, 0, 'n'},
+    {"progress", no_argument, 0, 'p'},
+    {"qd", required_argument, 0, 'q'},
+    {"range", required_argument, 0, 'r'},
     {"repeat", no_argument, 0, 'R'},
+    {"split", no_argument, 0, 's'},
     {"timeout", required_argument, 0, 't'},
     {"verbose", no_argument, 0, 'v'},
     {"version", no_argument, 0, 'V'},
@@ -82,13 +108,19 @@ usage()
 {
     pr2serr("Usage: sg_write_verify [--16] [--bytchk=BC] [--dpo] [--group=GN] "
             "[--help]\n"
-            "                       [--ilen=IL] [--in=IF] --lba=LBA "
-            "[--num=NUM]\n"
-            "                       [--repeat] [--timeout=TO] [--verbose] "
-            "[--version]\n"
-            "                       [--wrprotect=WPR] DEVICE\n"
+            "                       [--ilen=IL] [--in=IF] [--json[=JO]] "
+            "[--js-file=JFN]\n"
+            "                       --lba=LBA [--num=NUM] [--repeat] "
+            "[--timeout=TO]\n"
+            "                       [--verbose] [--version] "
+            "[--wrprotect=WPR] DEVICE\n"
+            "       sg_write_verify --all|--range=LBA,CNT [--qd=QD] "
+            "[--progress] [--split]\n"
+            "                       [--num=NUM] [--in=IF] ... DEVICE\n"
             "  where:\n"
             "    --16|-S              do WRITE AND VERIFY(16) (default: 10)\n"
+            "    --all|-A             write and verify every block of "
+            "DEVICE\n"
             "    --bytchk=BC|-b BC    set BYTCHK field (default: 0)\n"
             "    --dpo|-d             set DPO bit (default: 0)\n"
             "    --group=GN|-g GN     GN is group number (default: 0)\n"
@@ -99,15 +131,37 @@ usage()
             "size)\n"
             "    --in=IF|-i IF        IF is a file containing the data to "
             "be written\n"
+            "    --json[=JO]|-j[=JO]    output in JSON instead of plain "
+            "text\n"
+            "                           use --json=? for JSON help\n"
+            "    --js-file=JFN|-J JFN    JFN is a filename to which JSON "
+            "output is\n"
+            "                            written (def: stdout); truncates "
+            "then writes\n"
             "    --lba=LBA|-l LBA     LBA of the first block to write "
             "and verify;\n"
             "                         no default, must be given\n"
             "    --num=NUM|-n NUM     logical blocks to write and verify "
-            "(def: 1)\n"
+            "(def: 1, or\n"
+            "                         %d per command with --all or "
+            "--range)\n"
+            "    --progress|-p        report progress every %d seconds "
+            "on stderr\n"
+            "    --qd=QD|-q QD        commands in flight with --all or "
+            "--range\n"
+            "                         (def: 1, max: %d)\n"
+            "    --range=LBA,CNT|-r LBA,CNT    write and verify CNT blocks "
+            "from LBA,\n"
+            "                                  may be given up to %d "
+            "times\n"
             "    --repeat|-R          while IF still has data to read, send "
             "another\n"
             "                         command, bumping LBA with up to NUM "
             "blocks again\n"
+            "    --split|-s           WRITE then VERIFY each NUM blocks "
+            "rather than\n"
+            "                         WRITE AND VERIFY (with --all or "
+            "--range)\n"
             "    --timeout=TO|-t TO   command timeout in seconds (def: 60)\n"
             "    --verbose|-v         increase verbosity\n"
             "    --version|-V         print version string then exit\n"
@@ -117,6 +171,9 @@ usage()
             "startings\nat LBA for NUM logical blocks. More commands "
             "performed only if '--repeat'\noption given. Data to be written "
             "is fetched from the IF file.\n"
+            "With --all or --range the blocks are covered by commands of "
+            "NUM blocks\nwith up to QD in flight.\n",
+            DEF_PL_NUM, PROGRESS_SECS, MAX_QD, MAX_RANGES
          );
 }
 
@@ -273,16 +330,528 @@ open_if(const char * fn, int got_stdin)
     return fd;
 }
 
+/* With --all or --range the blocks are written and verified in commands
+ * of NUM blocks, up to QD of them in flight at once. */
+
+struct wv_range {
+    uint64_t lba;
+    uint64_t num;
+};
+
+/* Where a command failed: the INFORMATION field of its sense data when
+ * valid, else the first block of the command. */
+struct wv_err {
+    uint64_t lba;
+    uint64_t cmd_lba;
+    uint32_t num;       /* blocks of the failed command */
+    int stage;          /* PL_STG_* */
+    int sense_cat;
+    bool info_valid;
+};
+
+struct wv_pl;
+
+struct wv_slot {
+    struct sg_mux_cmd mc;       /* mc.ptp is this slot's pt object */
+    bool busy;
+    bool pending;       /* stage is ready to be submitted */
+    int stage;          /* PL_STG_* */
+    uint32_t num;
+    uint64_t lba;
+    struct wv_pl * plp;
+    uint8_t cdb[WRITE_VERIFY16_CMDLEN];
+    uint8_t sense[SENSE_BUFF_LEN];
+};
+
+struct wv_pl {
+    bool do_16;
+    bool dpo;
+    bool split;         /* WRITE then VERIFY rather than WRITE AND VERIFY */
+    bool progress;
+    bool stop;
+    int bytchk;
+    int group;
+    int wrprotect;
+    int timeout;
+    int verbose;
+    int qd;
+    int blk_sz;
+    int sg_fd;
+    int ret;            /* error that stopped the run */
+    int first_err_cat;
+    int num_ranges;
+    int cur_range;
+    int num_err_arr;
+    uint32_t num_lb;    /* per command */
+    uint64_t cur_lba;   /* next block of cur_range to start */
+    uint64_t tot_blks;
+    uint64_t done_blks; /* written and verified without error */
+    uint64_t num_errs;
+    int64_t start_ms;
+    struct wv_range ranges[MAX_RANGES];
+    struct wv_err err_arr[MAX_ERR_LBAS];
+    uint8_t * dob;      /* NUM blocks of data-out shared by all commands */
+    struct sg_mux * mxp;        /* NULL: one command at a time */
+    struct wv_slot * slots;
+};
+
+static const char * pl_stg_name[] = {"Write and verify", "Write", "Verify"};
+
+static void
+pl_build_cdb(const struct wv_pl * plp, struct wv_slot * sp)
+{
+    uint8_t * cdbp = sp->cdb;
+
+    memset(cdbp, 0, sizeof(sp->cdb));
+    switch (sp->stage) {
+    case PL_STG_WAV:
+        cdbp[0] = plp->do_16 ? WRITE_VERIFY16_CMD : WRITE_VERIFY10_CMD;
+        break;
+    case PL_STG_WRITE:
+        cdbp[0] = plp->do_16 ? WRITE16_CMD : WRITE10_CMD;
+        break;
+    default:
+        cdbp[0] = plp->do_16 ? VERIFY16_CMD : VERIFY10_CMD;
+        break;
+    }
+    /* WRPROTECT and VRPROTECT share a position */
+    cdbp[1] = ((plp->wrprotect & WRPROTECT_MASK) << WRPROTECT_SHIFT);
+    if (plp->dpo)
+        cdbp[1] |= 0x10;
+    if (plp->bytchk && (PL_STG_WRITE != sp->stage))
+        cdbp[1] |= ((plp->bytchk & 0x3) << 1);
+    if (plp->do_16) {
+        sg_put_unaligned_be64(sp->lba, cdbp + 2);
+        sg_put_unaligned_be32(sp->num, cdbp + 10);
+        cdbp[14] = plp->group & GRPNUM_MASK;
+    } else {
+        sg_put_unaligned_be32((uint32_t)sp->lba, cdbp + 2);
+        cdbp[6] = plp->group & GRPNUM_MASK;
+        sg_put_unaligned_be16((uint16_t)sp->num, cdbp + 7);
+    }
+}
+
+/* Gives sp the next blocks to write and verify. Returns false when there
+ * are none left. */
+static bool
+pl_next_chunk(struct wv_pl * plp, struct wv_slot * sp)
+{
+    uint64_t end;
+    const struct wv_range * rp;
+
+    while (plp->cur_range < plp->num_ranges) {
+        rp = plp->ranges + plp->cur_range;
+        end = rp->lba + rp->num;
+        if (plp->cur_lba < end) {
+            sp->lba = plp->cur_lba;
+            sp->num = ((end - plp->cur_lba) < plp->num_lb) ?
+                      (uint32_t)(end - plp->cur_lba) : plp->num_lb;
+            plp->cur_lba += sp->num;
+            sp->stage = plp->split ? PL_STG_WRITE : PL_STG_WAV;
+            sp->pending = true;
+            return true;
+        }
+        if (++plp->cur_range < plp->num_ranges)
+            plp->cur_lba = plp->ranges[plp->cur_range].lba;
+    }
+    return false;
+}
+
+static void
+pl_record_err(struct wv_pl * plp, const struct wv_slot * sp, int sense_cat)
+{
+    struct wv_err * ep;
+    uint64_t ull = 0;
+
+    if (0 == plp->num_errs++)
+        plp->first_err_cat = sense_cat;
+    if (plp->num_err_arr >= MAX_ERR_LBAS)
+        return;         /* counted but not listed */
+    ep = plp->err_arr + plp->num_err_arr++;
+    ep->info_valid = sg_get_sense_info_fld(sp->sense,
+                                           get_scsi_pt_sense_len(sp->mc.ptp),
+                                           &ull);
+    ep->lba = ep->info_valid ? ull : sp->lba;
+    ep->cmd_lba = sp->lba;
+    ep->num = sp->num;
+    ep->stage = sp->stage;
+    ep->sense_cat = sense_cat;
+    if (plp->verbose)
+        pr2serr("%s failed at lba=%" PRIu64 " [0x%" PRIx64 "]\n",
+                pl_stg_name[sp->stage], ep->lba, ep->lba);
+}
+
+/* sg_mux done() callback, also called directly when there is no mux */
+static void
+pl_done(struct sg_mux_cmd * mcp, void * ctx)
+{
+    int res;
+    int sense_cat = 0;
+    struct wv_slot * sp = (struct wv_slot *)ctx;
+    struct wv_pl * plp = sp->plp;
+
+    sp->busy = false;
+    res = sg_cmds_process_resp(mcp->ptp, pl_stg_name[sp->stage], mcp->res,
+                               plp->verbose > 0, plp->verbose, &sense_cat);
+    if ((-2 == res) && ((SG_LIB_CAT_RECOVERED == sense_cat) ||
+                        (SG_LIB_CAT_NO_SENSE == sense_cat)))
+        res = 0;
+    if (0 == res) {
+        if (PL_STG_WRITE == sp->stage) {
+            sp->stage = PL_STG_VERIFY;
+            sp->pending = true;
+        } else
+            plp->done_blks += sp->num;
+        return;
+    }
+    if (-1 == res) {
+        if (get_scsi_pt_transport_err(mcp->ptp))
+            plp->ret = SG_LIB_TRANSPORT_ERROR;
+        else
+            plp->ret = sg_convert_errno(get_scsi_pt_os_err(mcp->ptp));
+        if (0 == plp->ret)
+            plp->ret = SG_LIB_CAT_OTHER;
+        plp->stop = true;
+        return;
+    }
+    switch (sense_cat) {
+    case SG_LIB_CAT_INVALID_OP:
+        if (PL_STG_WAV == sp->stage) {
+            /* no WRITE AND VERIFY: WRITE then VERIFY instead */
+            if (! plp->split) {
+                plp->split = true;
+                pr2serr("%s not supported, using Write then Verify\n",
+                        pl_stg_name[PL_STG_WAV]);
+            }
+            sp->stage = PL_STG_WRITE;
+            sp->pending = true;
+            return;
+        }
+        break;
+    case SG_LIB_CAT_MEDIUM_HARD:
+    case SG_LIB_CAT_MISCOMPARE:
+    case SG_LIB_CAT_PROTECTION:
+        pl_record_err(plp, sp, sense_cat);      /* and carry on */
+        return;
+    default:
+        break;
+    }
+    pl_record_err(plp, sp, sense_cat);
+    plp->ret = sense_cat;
+    plp->stop = true;
+}
+
+/* Returns 0, -EAGAIN or -EBUSY if the device queue is full, else another
+ * value from do_scsi_pt_submit() */
+static int
+pl_submit(struct wv_pl * plp, struct wv_slot * sp)
+{
+    int res, dlen;
+    struct sg_pt_base * ptvp = sp->mc.ptp;
+
+    pl_build_cdb(plp, sp);
+    clear_scsi_pt_obj(ptvp);
+    set_scsi_pt_cdb(ptvp, sp->cdb, plp->do_16 ? WRITE_VERIFY16_CMDLEN :
+                                                WRITE_VERIFY10_CMDLEN);
+    set_scsi_pt_sense(ptvp, sp->sense, sizeof(sp->sense));
+    if (PL_STG_VERIFY != sp->stage)
+        dlen = sp->num * plp->blk_sz;
+    else if (1 == plp->bytchk)
+        dlen = sp->num * plp->blk_sz;
+    else if (3 == plp->bytchk)
+        dlen = plp->blk_sz;     /* one block compared with each */
+    else
+        dlen = 0;
+    if (dlen > 0)
+        set_scsi_pt_data_out(ptvp, plp->dob, dlen);
+    if (plp->verbose > 1) {
+        char d[128];
+
+        pr2serr("    %s cdb: %s\n", pl_stg_name[sp->stage],
+                sg_get_command_str(sp->cdb, plp->do_16 ? 16 : 10, false,
+                                   sizeof(d), d));
+    }
+    sp->busy = true;
+    sp->pending = false;
+    if (plp->mxp) {
+        res = sg_mux_submit(plp->mxp, &sp->mc);
+        if (res) {
+            sp->busy = false;
+            sp->pending = true;
+        }
+        return res;
+    }
+    sp->mc.res = do_scsi_pt(ptvp, plp->sg_fd, plp->timeout, plp->verbose);
+    pl_done(&sp->mc, sp);
+    return 0;
+}
+
+static void
+pl_progress(const struct wv_pl * plp, bool as_json)
+{
+    int64_t ms = sg_mpoll_now_ms() - plp->start_ms;
+    double pct = plp->tot_blks ? ((100.0 * plp->done_blks) / plp->tot_blks) :
+                                 0.0;
+    double mbps = (ms > 0) ? (((double)plp->done_blks * plp->blk_sz) /
+                              (ms * 1000.0)) : 0.0;
+
+    if (as_json)        /* one JSON object per line */
+        pr2serr("{\"progress\": {\"percent\": %.1f, \"blocks_done\": %"
+                PRIu64 ", \"blocks_total\": %" PRIu64 ", \"next_lba\": %"
+                PRIu64 ", \"elapsed_ms\": %" PRId64 ", \"mb_per_second\": "
+                "%.1f, \"errors\": %" PRIu64 "}}\n", pct, plp->done_blks,
+                plp->tot_blks, plp->cur_lba, ms, mbps, plp->num_errs);
+    else
+        pr2serr("Progress: %.1f%% done, %" PRIu64 " of %" PRIu64 " blocks, "
+                "%.1f MB/s, %" PRIu64 " errors\n", pct, plp->done_blks,
+                plp->tot_blks, mbps, plp->num_errs);
+}
+
+/* Keeps up to QD commands in flight until all the ranges are written and
+ * verified or an error stops the run. Returns 0 or an exit status. */
+static int
+pl_run(struct wv_pl * plp, bool as_json)
+{
+    bool full, more;
+    int k, res;
+    int64_t next_prog_ms;
+    struct wv_slot * sp;
+
+    plp->start_ms = sg_mpoll_now_ms();
+    next_prog_ms = plp->start_ms + (PROGRESS_SECS * 1000);
+    plp->cur_range = 0;
+    plp->cur_lba = plp->ranges[0].lba;
+    more = true;
+    while (true) {
+        full = false;
+        for (k = 0; (k < plp->qd) && (! plp->stop) && (! full); ++k) {
+            sp = plp->slots + k;
+            if (sp->busy)
+                continue;
+            if ((! sp->pending) && ((! more) ||
+                                    (! (more = pl_next_chunk(plp, sp)))))
+                continue;
+            res = pl_submit(plp, sp);
+            if ((-EAGAIN == res) || (-EBUSY == res))
+                full = true;
+            else if (res) {
+                pr2serr("%s: submit failed: %s\n", pl_stg_name[sp->stage],
+                        (res < 0) ? safe_strerror(-res) :
+                                    "pass-through error");
+                plp->ret = (res < 0) ? sg_convert_errno(-res) :
+                                       SG_LIB_CAT_OTHER;
+                plp->stop = true;
+            }
+        }
+        if (plp->mxp && (sg_mux_in_flight(plp->mxp) > 0)) {
+            res = sg_mux_run(plp->mxp, 1000);
+            if (res < 0) {
+                pr2serr("waiting for responses: %s\n", safe_strerror(-res));
+                if (0 == plp->ret)
+                    plp->ret = sg_convert_errno(-res);
+                break;
+            }
+        } else {
+            for (k = 0; k < plp->qd; ++k) {
+                if (plp->slots[k].pending)
+                    break;
+            }
+            if (plp->stop || ((! more) && (k >= plp->qd)))
+                break;
+            if (full)
+                sg_mpoll_sleep_ms(1);
+        }
+        if (plp->progress && (sg_mpoll_now_ms() >= next_prog_ms)) {
+            pl_progress(plp, as_json);
+            next_prog_ms += PROGRESS_SECS * 1000;
+        }
+    }
+    if (plp->progress)
+        pl_progress(plp, as_json);
+    if (plp->ret)
+        return plp->ret;
+    return plp->num_errs ? plp->first_err_cat : 0;
+}
+
+static void
+pl_report(const struct wv_pl * plp, sgj_state * jsp, sgj_opaque_p jop)
+{
+    int k;
+    int64_t ms = sg_mpoll_now_ms() - plp->start_ms;
+    double mbps = (ms > 0) ? (((double)plp->done_blks * plp->blk_sz) /
+                              (ms * 1000.0)) : 0.0;
+    const struct wv_err * ep;
+    sgj_opaque_p jap, jo2p;
+    char b[80];
+
+    sgj_pr_hr(jsp, "%" PRIu64 " of %" PRIu64 " blocks written and verified "
+              "in %.2f seconds, %.1f MB/s; %" PRIu64 " errors\n",
+              plp->done_blks, plp->tot_blks, ms / 1000.0, mbps,
+              plp->num_errs);
+    sgj_js_nv_s(jsp, jop, "method", plp->split ? "write then verify" :
+                                                 "write and verify");
+    sgj_js_nv_i(jsp, jop, "queue_depth", plp->qd);
+    sgj_js_nv_i(jsp, jop, "block_size", plp->blk_sz);
+    sgj_js_nv_i(jsp, jop, "blocks_total", plp->tot_blks);
+    sgj_js_nv_i(jsp, jop, "blocks_done", plp->done_blks);
+    sgj_js_nv_i(jsp, jop, "elapsed_ms", ms);
+    sgj_js_nv_i(jsp, jop, "kb_per_second", (int64_t)(mbps * 1000.0));
+    sgj_js_nv_i(jsp, jop, "error_count", plp->num_errs);
+    jap = sgj_named_subarray_r(jsp, jop, "error_list");
+    for (k = 0; k < plp->num_err_arr; ++k) {
+        ep = plp->err_arr + k;
+        sg_get_category_sense_str(ep->sense_cat, sizeof(b), b, 0);
+        sgj_pr_hr(jsp, "  %s failed at lba=%" PRIu64 " [0x%" PRIx64 "]%s: "
+                  "%s\n", pl_stg_name[ep->stage], ep->lba, ep->lba,
+                  ep->info_valid ? "" : " (command start)", b);
+        jo2p = sgj_new_unattached_object_r(jsp);
+        sgj_js_nv_i(jsp, jo2p, "lba", ep->lba);
+        sgj_js_nv_b(jsp, jo2p, "lba_from_sense", ep->info_valid);
+        sgj_js_nv_i(jsp, jo2p, "command_lba", ep->cmd_lba);
+        sgj_js_nv_i(jsp, jo2p, "command_blocks", ep->num);
+        sgj_js_nv_s(jsp, jo2p, "command", pl_stg_name[ep->stage]);
+        sgj_js_nv_ihexstr(jsp, jo2p, "sense_category", ep->sense_cat, NULL,
+                          b);
+        sgj_js_nv_o(jsp, jap, NULL /* name */, jo2p);
+    }
+    if (plp->num_errs > (uint64_t)plp->num_err_arr)
+        sgj_pr_hr(jsp, "  ... only the first %d errors are listed\n",
+                  MAX_ERR_LBAS);
+}
+
+/* Finds the capacity, checks the ranges against it, fills the data-out
+ * buffer then runs the pipeline. Returns 0 or an exit status. */
+static int
+pl_setup_run(struct wv_pl * plp, bool given_do_16, const char * ifnp,
+             sgj_state * jsp, sgj_opaque_p jop)
+{
+    int k, n, res, len, ifd;
+    int ret = 0;
+    int64_t num_blks;
+    uint64_t end;
+    uint8_t * free_dob = NULL;
+
+    res = sg_dde_read_capacity(plp->sg_fd, &num_blks, &plp->blk_sz, true,
+                               plp->verbose);
+    if (res) {
+        pr2serr("unable to find capacity of device\n");
+        return res;
+    }
+    if (0 == plp->num_ranges) {     /* --all */
+        plp->ranges[0].lba = 0;
+        plp->ranges[0].num = (uint64_t)num_blks;
+        plp->num_ranges = 1;
+    }
+    for (k = 0, plp->tot_blks = 0; k < plp->num_ranges; ++k) {
+        end = plp->ranges[k].lba + plp->ranges[k].num;
+        if (end > (uint64_t)num_blks) {
+            pr2serr("range %d ends beyond the last block (%" PRId64 ")\n",
+                    k + 1, num_blks - 1);
+            return SG_LIB_LBA_OUT_OF_RANGE;
+        }
+        if ((end > UINT_MAX) && (! plp->do_16)) {
+            plp->do_16 = true;
+            if (plp->verbose && (! given_do_16))
+                pr2serr("Switching to 16 byte cdbs because LBA too large\n");
+        }
+        plp->tot_blks += plp->ranges[k].num;
+    }
+    if ((plp->num_lb > 0xffff) && (! plp->do_16))
+        plp->do_16 = true;
+    len = plp->num_lb * plp->blk_sz;
+    plp->dob = (uint8_t *)sg_memalign(len, 0, &free_dob, plp->verbose > 3);
+    if (NULL == plp->dob) {
+        pr2serr(ME "out of memory\n");
+        return sg_convert_errno(ENOMEM);
+    }
+    if (ifnp) {         /* the start of IF, repeated to fill NUM blocks */
+        ifd = ((1 == strlen(ifnp)) && ('-' == ifnp[0])) ? STDIN_FILENO :
+                                                          open_if(ifnp, 0);
+        if (ifd < 0) {
+            ret = -ifd;
+            goto fini;
+        }
+        for (n = 0; n < len; n += res) {
+            res = read(ifd, plp->dob + n, len - n);
+            if (res <= 0)
+                break;
+        }
+        if (STDIN_FILENO != ifd)
+            close(ifd);
+        if (n < 1) {
+            pr2serr("Could not read from %s\n", ifnp);
+            ret = SG_LIB_FILE_ERROR;
+            goto fini;
+        }
+        for (k = n; k < len; ++k)
+            plp->dob[k] = plp->dob[k - n];
+    } else
+        memset(plp->dob, 0xff, len);
+    plp->mxp = sg_mux_new(plp->verbose);
+    if (plp->mxp && sg_mux_add_fd(plp->mxp, plp->sg_fd)) {
+        sg_mux_free(plp->mxp);
+        plp->mxp = NULL;
+    }
+    if ((NULL == plp->mxp) && (plp->qd > 1)) {
+        if (plp->verbose)
+            pr2serr("no asynchronous interface, QD reduced to 1\n");
+        plp->qd = 1;
+    }
+    plp->slots = (struct wv_slot *)calloc(plp->qd, sizeof(struct wv_slot));
+    if (NULL == plp->slots) {
+        pr2serr(ME "out of memory\n");
+        ret = sg_convert_errno(ENOMEM);
+        goto fini;
+    }
+    for (k = 0; k < plp->qd; ++k) {
+        struct wv_slot * sp = plp->slots + k;
+
+        sp->plp = plp;
+        sp->mc.fd = plp->sg_fd;
+        sp->mc.timeout_secs = plp->timeout;
+        sp->mc.ctx = sp;
+        sp->mc.done = pl_done;
+        sp->mc.ptp = construct_scsi_pt_obj_with_fd(plp->sg_fd,
+                                                   plp->verbose);
+        if (NULL == sp->mc.ptp) {
+            pr2serr(ME "out of memory\n");
+            ret = sg_convert_errno(ENOMEM);
+            goto fini;
+        }
+    }
+    ret = pl_run(plp, jsp->pr_as_json);
+    pl_report(plp, jsp, jop);
+fini:
+    sg_mux_free(plp->mxp);
+    plp->mxp = NULL;
+    if (plp->slots) {
+        for (k = 0; k < plp->qd; ++k) {
+            if (plp->slots[k].mc.ptp)
+                destruct_scsi_pt_obj(plp->slots[k].mc.ptp);
+        }
+        free(plp->slots);
+        plp->slots = NULL;
+    }
+    free(free_dob);
+    return ret;
+}
+
 int
 main(int argc, char * argv[])
 {
     bool do_16 = false;
+    bool do_all = false;
+    bool do_json = false;
     bool dpo = false;
     bool first_time;
     bool given_do_16 = false;
     bool has_filename = false;
     bool lba_given = false;
+    bool num_given = false;
+    bool pipelined;
+    bool progress = false;
     bool repeat = false;
+    bool split = false;
     bool verbose_given = false;
     bool version_given = false;
     int sg_fd, res, c, n;
@@ -290,6 +859,8 @@ main(int argc, char * argv[])
     int group = 0;
     int ilen = -1;
     int ifd = -1;
+    int num_ranges = 0;
+    int qd = 1;
     int b_p_lb = 512;
     int ret = 1;
     int timeout = DEF_TIMEOUT_SECS;
@@ -305,18 +876,30 @@ main(int argc, char * argv[])
     uint8_t * free_wrkBuff = NULL;
     const char * device_name = NULL;
     const char * ifnp;
+    const char * json_arg = NULL;
+    const char * js_file = NULL;
+    const char * cp;
+    struct wv_pl * plp = NULL;
+    sgj_state * jsp;
+    sgj_opaque_p jop = NULL;
     char cmd_name[32];
+    sgj_state json_st SG_C_CPP_ZERO_INIT;
+    struct wv_range ranges[MAX_RANGES];
 
     ifnp = "";          /* keep MinGW quiet */
+    jsp = &json_st;
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "b:dg:hi:I:l:n:RSt:w:vV", long_options,
-                       &option_index);
+        c = getopt_long(argc, argv, "^Ab:dg:hi:I:j::J:l:n:pq:r:RsSt:w:vV",
+                        long_options, &option_index);
         if (c == -1)
             break;
 
         switch (c) {
+        case 'A':
+            do_all = true;
+            break;
         case 'b':
             /* Only bytchk=0 and =1 are meaningful for this command in
              * sbc4r02 (not =2 nor =3) but that may change in the future. */
@@ -351,6 +934,28 @@ main(int argc, char * argv[])
                 return SG_LIB_SYNTAX_ERROR;
             }
             break;
+        case 'j':       /* for: -j[=JO] */
+        case '^':       /* for: --json[=JO] */
+            do_json = true;
+            /* Now want '=' to precede all JSON optional arguments */
+            if (optarg) {
+                if ('^' == c) {
+                    json_arg = optarg;
+                    break;
+                } else if ('=' == *optarg) {
+                    json_arg = optarg + 1;
+                    break;
+                }
+                pr2serr("-j expects its optional argument to start with "
+                        "'='\n");
+                return SG_LIB_SYNTAX_ERROR;
+            } else
+                json_arg = NULL;
+            break;
+        case 'J':
+            do_json = true;
+            js_file = optarg;
+            break;
         case 'l':
             if (lba_given) {
                 pr2serr("must have one and only one '--lba'\n");
@@ -371,10 +976,45 @@ main(int argc, char * argv[])
                 return SG_LIB_SYNTAX_ERROR;
             }
             num_lb = (uint32_t)n;
+            num_given = true;
+            break;
+        case 'p':
+            progress = true;
+            break;
+        case 'q':
+            qd = sg_get_num(optarg);
+            if ((qd < 1) || (qd > MAX_QD)) {
+                pr2serr("argument to '--qd' expected to be 1 to %d\n",
+                        MAX_QD);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case 'r':
+            if (num_ranges >= MAX_RANGES) {
+                pr2serr("'--range' may be given up to %d times\n",
+                        MAX_RANGES);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            ll = sg_get_llnum(optarg);
+            cp = strchr(optarg, ',');
+            if ((ll < 0) || (NULL == cp)) {
+                pr2serr("'--range' expects LBA,CNT\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            ranges[num_ranges].lba = (uint64_t)ll;
+            ll = sg_get_llnum(cp + 1);
+            if (ll < 1) {
+                pr2serr("bad CNT in '--range=LBA,CNT'\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            ranges[num_ranges++].num = (uint64_t)ll;
             break;
         case 'R':
             repeat = true;
             break;
+        case 's':
+            split = true;
+            break;
         case 'S':
             do_16 = true;
             given_do_16 = true;
@@ -447,10 +1087,46 @@ main(int argc, char * argv[])
         usage();
         return SG_LIB_SYNTAX_ERROR;
     }
-    if (! lba_given) {
-        pr2serr("need a --lba=LBA option\n");
-        usage();
-        return SG_LIB_SYNTAX_ERROR;
+    pipelined = do_all || (num_ranges > 0);
+    if (pipelined) {
+        if (do_all && (num_ranges > 0)) {
+            pr2serr("give either --all or --range=, not both\n");
+            return SG_LIB_CONTRADICT;
+        }
+        if (lba_given || repeat || (ilen > 0)) {
+            pr2serr("--lba=, --repeat and --ilen= are not used with --all "
+                    "or --range=\n");
+            return SG_LIB_CONTRADICT;
+        }
+        if (0 == num_lb) {
+            pr2serr("--num= must be at least 1 with --all or --range=\n");
+            return SG_LIB_SYNTAX_ERROR;
+        }
+    } else {
+        if ((qd > 1) || split || progress) {
+            pr2serr("--qd=, --split and --progress need --all or "
+                    "--range=\n");
+            return SG_LIB_CONTRADICT;
+        }
+        if (! lba_given) {
+            pr2serr("need a --lba=LBA option\n");
+            usage();
+            return SG_LIB_SYNTAX_ERROR;
+        }
+    }
+    if (do_json) {
+        if (! sgj_init_state(jsp, json_arg)) {
+            int bad_char = jsp->first_bad_char;
+            char e[1500];
+
+            if (bad_char)
+                pr2serr("bad argument to --json= option, unrecognized "
+                        "character '%c'\n\n", bad_char);
+            sg_json_usage(0, e, sizeof(e));
+            pr2serr("%s", e);
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        jop = sgj_start_r("sg_write_verify", version_str, argc, argv, jsp);
     }
     if (repeat) {
         if (! has_filename) {
@@ -479,6 +1155,31 @@ main(int argc, char * argv[])
         pr2serr(ME "open error: %s: %s\n", device_name, safe_strerror(-sg_fd));
         goto err_out;
     }
+    if (pipelined) {
+        plp = (struct wv_pl *)calloc(1, sizeof(*plp));
+        if (NULL == plp) {
+            pr2serr(ME "out of memory\n");
+            ret = sg_convert_errno(ENOMEM);
+            goto err_out;
+        }
+        plp->do_16 = do_16;
+        plp->dpo = dpo;
+        plp->split = split;
+        plp->progress = progress;
+        plp->bytchk = bytchk;
+        plp->group = group;
+        plp->wrprotect = wrprotect;
+        plp->timeout = timeout;
+        plp->verbose = verbose;
+        plp->qd = qd;
+        plp->sg_fd = sg_fd;
+        plp->num_lb = num_given ? num_lb : DEF_PL_NUM;
+        plp->num_ranges = num_ranges;
+        memcpy(plp->ranges, ranges, num_ranges * sizeof(ranges[0]));
+        ret = pl_setup_run(plp, given_do_16, has_filename ? ifnp : NULL,
+                           jsp, jop);
+        goto err_out;
+    }
 
     if ((! do_16) && (llba > UINT_MAX))
         do_16 = true;
@@ -615,8 +1316,12 @@ err_out:
     if (repeat)
         pr2serr("%d [0x%x] logical blocks written, in total\n", tnum_lb_wr,
                 tnum_lb_wr);
+    if ((! pipelined) && (sg_fd >= 0))
+        sgj_js_nv_i(jsp, jop, "blocks_written_and_verified",
+                    repeat ? tnum_lb_wr : (ret ? 0 : (int)num_lb));
     if (free_wrkBuff)
         free(free_wrkBuff);
+    free(plp);
     if ((ifd >= 0) && (STDIN_FILENO != ifd))
         close(ifd);
     res = sg_cmds_close_device(sg_fd);
@@ -625,10 +1330,41 @@ err_out:
         if (0 == ret)
             ret = sg_convert_errno(-res);
     }
-    if (ret && (0 == verbose)) {
+    if (ret && (0 == verbose) && (! pipelined)) {
         if (! sg_if_can2stderr("sg_write_verify failed: ", ret))
             pr2serr("Some error occurred, try again with '-v' "
                     "or '-vv' for more information\n");
     }
-    return (ret >= 0) ? ret : SG_LIB_CAT_OTHER;
+    ret = (ret >= 0) ? ret : SG_LIB_CAT_OTHER;
+    if (jsp->pr_as_json) {
+        FILE * fp = stdout;
+
+        if (js_file) {
+            if ((1 != strlen(js_file)) || ('-' != js_file[0])) {
+                fp = fopen(js_file, "w");   /* truncate if exists */
+                if (NULL == fp) {
+                    int e = errno;
+
+                    pr2serr("unable to open file: %s [%s]\n", js_file,
+                            safe_strerror(e));
+                    ret = sg_convert_errno(e);
+                }
+            }
+            /* '--js-file=-' will send JSON output to stdout */
+        }
+        if (fp) {
+            const char * estr = NULL;
+            char b[80];
+
+            if (sg_exit2str(ret, jsp->verbose, sizeof(b), b)) {
+                if (strlen(b) > 0)
+                    estr = b;
+            }
+            sgj_js2file_estr(jsp, NULL, ret, estr, fp);
+        }
+        if (js_file && fp && (stdout != fp))
+            fclose(fp);
+        sgj_finish(jsp);
+    }
+    return ret;
 }
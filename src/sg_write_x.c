@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2017-2023 Douglas Gilbert.
+ * Copyright (c) 2017-2026 Douglas Gilbert.
  * All rights reserved.
  * Use of this source code is governed by a BSD-style
  * license that can be found in the BSD_LICENSE file.
@@ -31,14 +31,28 @@
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
+
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+#include <time.h>
+#elif defined(HAVE_GETTIMEOFDAY)
+#include <time.h>
+#include <sys/time.h>
+#endif
+
+#ifndef SG_LIB_WIN32
+#include <sys/mman.h>
+#endif
 #include "sg_lib.h"
 #include "sg_pt.h"
 #include "sg_cmds_basic.h"
 #include "sg_cmds_extra.h"
+#include "sg_sgl.h"
 #include "sg_unaligned.h"
+#include "sg_par.h"
 #include "sg_pr2serr.h"
+#include "sg_pat.h"
 
-static const char * version_str = "1.33 20230502";
+static const char * version_str = "1.36 20261015";
 
 static const char * my_name = "sg_write_x: ";
 
@@ -81,6 +95,11 @@ static const char * my_name = "sg_write_x: ";
 
 #define MAX_NUM_ADDR 128
 
+#define MAX_MMAP_PARALLEL 64
+#define DEF_MMAP_MAX_RDS 256    /* when device reports no limit */
+#define DEF_MMAP_MAX_BLOCKS 0x800       /* likewise, per command */
+#define MMAP_PROGRESS_SECS 5
+
 #ifndef UINT32_MAX
 #define UINT32_MAX ((uint32_t)-1)
 #endif
@@ -107,10 +126,12 @@ static struct option long_options[] = {
     {"help", no_argument, 0, 'h'},
     {"in", required_argument, 0, 'i'},
     {"lba", required_argument, 0, 'l'},
+    {"mmap", no_argument, 0, 'm'},
     {"normal", no_argument, 0, 'N'},
     {"num", required_argument, 0, 'n'},
     {"offset", required_argument, 0, 'o'},
     {"or", no_argument, 0, 'O'},
+    {"parallel", required_argument, 0, 'p'},
     {"quiet", no_argument, 0, 'Q'},
     {"ref-tag", required_argument, 0, 'r'},
     {"ref_tag", required_argument, 0, 'r'},
@@ -140,6 +161,7 @@ struct opts_t {
     bool do_atomic;             /* selects  WRITE ATOMIC(16 or 32) */
                                 /*  --atomic=AB  AB --> .atomic_boundary */
     bool do_combined;           /* -c DOF --> .scat_lbdof */
+    bool do_mmap;               /* -m  split raw SF into many commands */
     bool do_or;                 /* -O  ORWRITE(16 or 32) */
     bool do_quiet;              /* -Q  suppress some messages */
     bool do_scat_raw;
@@ -165,6 +187,7 @@ struct opts_t {
     int dry_run;        /* temporary write when used more than once */
     int grpnum;         /* "Group Number", 0 to 0x3f (GRPNUM_MASK) */
     int help;
+    int num_par;        /* --parallel=Q, commands in flight with --mmap */
     int pi_type;        /* -1: unknown: 0: type 0 (none): 1: type 1 */
     int strict;         /* > 0, report then exit on questionable meta data */
     int timeout;        /* timeout (in seconds) to abort SCSI commands */
@@ -199,6 +222,7 @@ struct opts_t {
     const char * if_name;       /* from --in=IF */
     const char * scat_filename; /* from --scat-file=SF */
     const char * cmd_name;      /* e.g. 'Write atomic' */
+    struct sg_pat pat;          /* --in=pat:PAT, else kind SG_PAT_NONE */
     char cdb_name[24];          /* e.g. 'Write atomic(16)' */
 };
 
@@ -218,9 +242,11 @@ usage(int do_help)
             "[--dry-run]\n"
             "           [--fua] [--generation=EOG,NOG] [--grpnum=GN] "
             "[--help] --in=IF\n"
-            "           [--lba=LBA,LBA...] [--normal] [--num=NUM,NUM...]\n"
-            "           [--offset=OFF[,DLEN]] [--or] [--quiet] "
-            "[--ref-tag=RT]\n"
+            "           [--lba=LBA,LBA...] [--mmap] [--normal] "
+            "[--num=NUM,NUM...]\n"
+            "           [--offset=OFF[,DLEN]] [--or] [--parallel=Q] "
+            "[--quiet]\n"
+            "           [--ref-tag=RT]\n"
             "           [--same=NDOB] [--scat-file=SF] [--scat-raw] "
             "[--scattered=RD]\n"
             "           [--stream=ID] [--strict] [--tag-mask=TM] "
@@ -234,8 +260,9 @@ usage(int do_help)
                 "[-c DOF] [-D DLD]\n"
                 "           [-d] [-x] [-f] [-G EOG,NOG] [-g GN] [-h] -i IF "
                 "[-l LBA,LBA...]\n"
-                "           [-N] [-n NUM,NUM...] [-o OFF[,DLEN]] [-O] [-Q] "
-                "[-r RT] [-M NDOB]\n"
+                "           [-m] [-N] [-n NUM,NUM...] [-o OFF[,DLEN]] [-O] "
+                "[-p Q] [-Q]\n"
+                "           [-r RT] [-M NDOB]\n"
                 "           [-q SF] [-R] [-S RD] [-T ID] [-s] [-t TM] [-I TO] "
                 "[-u U_A] [-v]\n"
                 "           [-V] [-w WPR] DEVICE\n"
@@ -253,7 +280,7 @@ usage(int do_help)
             "    --atomic=AB|-A AB    send WRITE ATOMIC command with AB "
             "being its\n"
             "                         Atomic Boundary field (0 to 0xffff)\n"
-            "    --bmop=OP,PGP|-p OP,PGP    set BMOP field to OP and "
+            "    --bmop=OP,PGP|-B OP,PGP    set BMOP field to OP and "
             " Previous\n"
             "                               Generation Processing field "
             "to PGP\n"
@@ -289,11 +316,17 @@ usage(int do_help)
             "data from.\n"
             "                       Blocks written to DEVICE. 1 or no "
             "blocks read\n"
-            "                       in the case of WRITE SAME\n"
+            "                       in the case of WRITE SAME. Or pat:PAT "
+            "for generated\n"
+            "                       data: zero, ff, HEX, lba or "
+            "prng[,SEED]\n"
             "    --lba=LBA,LBA...     list of LBAs (Logical Block Addresses) "
             "to start\n"
             "        |-l LBA,LBA...   writes (def: --lba=0). Alternative is "
             "--scat-file=SF\n"
+            "    --mmap|-m          memory map raw SF and IF, split into "
+            "as many\n"
+            "                       WRITE SCATTERED commands as needed\n"
             "    --normal|-N        send 'normal' WRITE command (default "
             "when no other\n"
             "                       command option given)\n"
@@ -306,6 +339,9 @@ usage(int do_help)
             "        |-o OFF[,DLEN]     (def: 0), then read DLEN bytes(def: "
             "rest of IF)\n"
             "    --or|-O            send ORWRITE command\n"
+            "    --parallel=Q|-p Q    with --mmap keep up to Q commands in "
+            "flight\n"
+            "                         (def: 1)\n"
             "    --quiet|-Q         suppress some informational messages\n"
             "    --ref-tag=RT|-r RT     expected reference tag field (def: "
             "0xffffffff)\n"
@@ -780,6 +816,53 @@ parse_scat_pi_line(const char * lcp, uint8_t * up, uint32_t * sum_num)
     return 0;
 }
 
+/* Places the elements of the binary sgl file (see sg_sgl.h) named
+ * scat_fname in LBA range descriptors starting at up + lbard_sz, as
+ * build_t10_scat() does for text, with the PI fields (when !do_16) set to
+ * their defaults. up may be NULL. Returns 0 if ok, else error number. */
+static int
+build_t10_scat_bin(const char * scat_fname, bool do_16, bool parse_one,
+                   uint8_t * up, uint16_t * num_scat_elems, uint32_t * sum_num,
+                   uint32_t max_list_blen)
+{
+    int res;
+    int64_t k;
+    uint32_t n = lbard_sz;
+    struct sg_sgl_bin sb;
+    const struct sg_sgl_elem * ep;
+
+    res = sg_sgl_bin_map(scat_fname, &sb, true);
+    if (res)
+        return res;
+    for (k = 0, ep = sb.elems; k < sb.num_elems; ++k, ++ep) {
+        if ((max_list_blen > 0) && ((n + lbard_sz) > max_list_blen))
+            break;
+        if (k >= UINT16_MAX) {
+            pr2serr("%s: more than %u elements in %s\n", __func__,
+                    UINT16_MAX, scat_fname);
+            sg_sgl_bin_unmap(&sb);
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        if (up) {
+            sg_put_unaligned_be64(ep->lba, up + n + 0);
+            sg_put_unaligned_be32(ep->num, up + n + 8);
+            if (! do_16) {
+                sg_put_unaligned_be32((uint32_t)DEF_RT, up + n + 12);
+                sg_put_unaligned_be16((uint16_t)DEF_AT, up + n + 16);
+                sg_put_unaligned_be16((uint16_t)DEF_TM, up + n + 18);
+            }
+        }
+        if (sum_num)
+            *sum_num += ep->num;
+        n += lbard_sz;
+        if (parse_one)
+            break;
+    }
+    sg_sgl_bin_unmap(&sb);
+    *num_scat_elems = (n / lbard_sz) - 1;
+    return 0;
+}
+
 /* Read pairs or quintets from a scat_file and places them in a T10 scatter
  * list array is built starting at at t10_scat_list_out (i.e. as per T10 the
  * first 32 bytes are zeros followed by the first LBA range descriptor (also
@@ -799,7 +882,8 @@ parse_scat_pi_line(const char * lcp, uint8_t * up, uint32_t * sum_num)
  * else error number. If ok also yields the number of LBA range descriptors
  * written in num_scat_elems and the sum of NUM elements found. Note that
  * sum_num is not initialized to 0. If parse_one is true then exits
- * after one LBA range descriptor is decoded. */
+ * after one LBA range descriptor is decoded. A binary sgl file (e.g. from
+ * testing/sg_sgl_conv) is also accepted. */
 static int
 build_t10_scat(const char * scat_fname, bool do_16, bool parse_one,
                uint8_t * t10_scat_list_out, uint16_t * num_scat_elems,
@@ -826,6 +910,9 @@ build_t10_scat(const char * scat_fname, bool do_16, bool parse_one,
     n = lbard_sz;
 
     have_stdin = ((1 == strlen(scat_fname)) && ('-' == scat_fname[0]));
+    if ((! have_stdin) && sg_sgl_is_bin_file(scat_fname))
+        return build_t10_scat_bin(scat_fname, do_16, parse_one, up,
+                                  num_scat_elems, sum_num, max_list_blen);
     if (have_stdin) {
         fp = stdin;
         scat_fname = "<stdin>";
@@ -1509,7 +1596,7 @@ do_read_capacity(int sg_fd, struct opts_t *op)
 
 #define WANT_ZERO_EXIT 9999
 static const char * const opt_long_ctl_str =
-    "36a:A:b:B:c:dD:Efg:G:hi:I:l:M:n:No:Oq:Qr:RsS:t:T:u:vVw:x";
+    "36a:A:b:B:c:dD:Efg:G:hi:I:l:mM:n:No:Op:q:Qr:RsS:t:T:u:vVw:x";
 
 /* command line processing, options and arguments. Returns 0 if ok,
  * returns WANT_ZERO_EXIT so upper level yields an exist status of zero.
@@ -1729,10 +1816,19 @@ parse_cmd_line(struct opts_t *op, int argc, char *argv[],
                 op->if_dlen = (uint32_t)ll;
             }
             break;
+        case 'm':
+            op->do_mmap = true;
+            break;
         case 'O':
             op->do_or = true;
             op->cmd_name = "Orwrite";
             break;
+        case 'p':
+            j = sg_par_get_num(optarg, 1, MAX_MMAP_PARALLEL);
+            if (j < 0)
+                return SG_LIB_SYNTAX_ERROR;
+            op->num_par = j;
+            break;
         case 'q':
             op->scat_filename = optarg;
             break;
@@ -2169,6 +2265,438 @@ finii:
 }
 
 
+/* --mmap state shared by the jobs issuing WRITE SCATTERED commands. The
+ * LBA range descriptors (RDs) of the raw SF and the data of IF are memory
+ * mapped. Command k starts at cur_arr[k]; it has the RDs (or parts of RDs)
+ * that follow, up to the per command limits, and the data for them which
+ * is contiguous in IF. The counts, the first failure, pr_ns and the spare
+ * data-out buffers are updated under sg_par_lock(). */
+struct sx_cur_t {
+    uint64_t rd_idx;    /* next RD in SF */
+    uint32_t rd_used;   /* blocks of that RD already claimed */
+    uint64_t data_off;  /* byte offset of its data from .datap */
+};
+
+struct sx_buf_t {
+    uint8_t * up;
+    uint8_t * free_up;
+};
+
+struct sx_mmap_t {
+    int sg_fd;
+    int res;            /* of the first command that failed */
+    uint32_t max_rds;   /* RDs per command */
+    uint32_t max_blks;  /* blocks per command */
+    uint32_t max_rd_blks;       /* blocks per RD, 0 -> no limit */
+    uint32_t buf_len;   /* data-out buffer length for the largest command */
+    uint64_t num_rds;   /* in SF */
+    uint64_t tot_blks;  /* sum of NUMs in SF */
+    uint64_t num_cmds;
+    uint64_t sent_rds;  /* may exceed num_rds when RDs are split */
+    uint64_t done_blks;
+    uint64_t bad_lba;   /* first LBA of the command that failed */
+    uint64_t start_ns;
+    uint64_t pr_ns;     /* when progress was last reported */
+    const uint8_t * rdp;        /* first RD (after the 32 byte header) */
+    const uint8_t * datap;      /* at OFF in IF */
+    const struct opts_t * op;
+    struct sx_cur_t * cur_arr;  /* where each command starts */
+    int num_spare;
+    struct sx_buf_t spare_arr[MAX_MMAP_PARALLEL];   /* data-out buffers */
+};
+
+/* Advances *cp over the RDs for one command, placing the number of RDs and
+ * blocks in *num_rdp and *blksp. If dop is non-NULL the RDs are also built
+ * in the data-out buffer dop (after its 32 byte header). An RD that is too
+ * long for what remains of a command is split, the rest starting the next
+ * command. RDs with a NUM of zero are skipped. */
+static void
+sx_step(const struct sx_mmap_t * mp, struct sx_cur_t * cp, uint8_t * dop,
+        uint32_t * num_rdp, uint32_t * blksp)
+{
+    uint32_t n, k, num, rt;
+    uint32_t blks = 0;
+    const uint8_t * rp;
+    uint8_t * dp;
+
+    for (n = 0; (cp->rd_idx < mp->num_rds) && (n < mp->max_rds) &&
+                (blks < mp->max_blks); ) {
+        rp = mp->rdp + (cp->rd_idx * lbard_sz);
+        num = sg_get_unaligned_be32(rp + 8);
+        k = num - cp->rd_used;
+        if (k > (mp->max_blks - blks))
+            k = mp->max_blks - blks;
+        if ((mp->max_rd_blks > 0) && (k > mp->max_rd_blks))
+            k = mp->max_rd_blks;
+        if ((k > 0) && dop) {
+            dp = dop + ((n + 1) * lbard_sz);
+            memset(dp, 0, lbard_sz);
+            sg_put_unaligned_be64(sg_get_unaligned_be64(rp + 0) +
+                                  cp->rd_used, dp + 0);
+            sg_put_unaligned_be32(k, dp + 8);
+            if (mp->op->do_32) {
+                rt = sg_get_unaligned_be32(rp + 12);
+                if (DEF_RT != rt)       /* RT of the first block sent */
+                    rt += cp->rd_used;
+                sg_put_unaligned_be32(rt, dp + 12);
+                memcpy(dp + 16, rp + 16, 4);    /* AT and TM */
+            }
+        }
+        if (k > 0) {
+            ++n;
+            blks += k;
+        }
+        cp->rd_used += k;
+        if (cp->rd_used >= num) {
+            ++cp->rd_idx;
+            cp->rd_used = 0;
+        }
+    }
+    cp->data_off += (uint64_t)blks * mp->op->bs_pi_do;
+    *num_rdp = n;
+    *blksp = blks;
+}
+
+/* Called under sg_par_lock() after blocks have been written. Outputs a
+ * progress line if MMAP_PROGRESS_SECS have passed since the last one. */
+static void
+sx_progress(struct sx_mmap_t * mp)
+{
+    uint64_t now = sg_get_mono_ns();
+    double secs, rate;
+
+    if ((now - mp->pr_ns) < ((uint64_t)MMAP_PROGRESS_SECS * 1000000000))
+        return;
+    mp->pr_ns = now;
+    secs = (double)(now - mp->start_ns) / 1000000000.0;
+    rate = (secs > 0.0) ? ((double)mp->done_blks / secs) : 0.0;
+    pr2serr("Write scattered: %.1f%% done, %" PRIu64 " of %" PRIu64
+            " blocks", (100.0 * (double)mp->done_blks) /
+            (double)mp->tot_blks, mp->done_blks, mp->tot_blks);
+    if (rate > 0.0)
+        pr2serr(", about %.0f secs to go",
+                (double)(mp->tot_blks - mp->done_blks) / rate);
+    pr2serr("\n");
+}
+
+/* Sends command k. Returns the result of a failed command, which stops
+ * further commands being started. */
+static int
+sx_one(int64_t k, void * ctx)
+{
+    int res;
+    uint32_t nrd, blks, d, lbdof;
+    uint64_t data_off;
+    struct sx_mmap_t * mp = (struct sx_mmap_t *)ctx;
+    const struct opts_t * op = mp->op;
+    struct sx_cur_t cur = mp->cur_arr[k];
+    struct sx_buf_t buf;
+    struct opts_t o;
+
+    /* data-out buffers are reused, at most one per command in flight */
+    memset(&buf, 0, sizeof(buf));
+    sg_par_lock();
+    if (mp->num_spare > 0)
+        buf = mp->spare_arr[--mp->num_spare];
+    sg_par_unlock();
+    if (NULL == buf.up) {
+        buf.up = sg_memalign(mp->buf_len, 0, &buf.free_up, false);
+        if (NULL == buf.up) {
+            pr2serr("%s: unable to allocate %u bytes\n", __func__,
+                    mp->buf_len);
+            sg_par_lock();
+            if (0 == mp->res)
+                mp->res = sg_convert_errno(ENOMEM);
+            sg_par_unlock();
+            return sg_convert_errno(ENOMEM);
+        }
+    }
+    memset(buf.up, 0, lbard_sz);
+    data_off = cur.data_off;
+    sx_step(mp, &cur, buf.up, &nrd, &blks);
+    d = lbard_sz * (nrd + 1);
+    lbdof = (d + op->bs_pi_do - 1) / op->bs_pi_do;
+    if (lbdof * op->bs_pi_do > d)
+        memset(buf.up + d, 0, (lbdof * op->bs_pi_do) - d);
+    /* one copy, from the mapped IF straight into the data-out buffer */
+    memcpy(buf.up + (lbdof * op->bs_pi_do), mp->datap + data_off,
+           (size_t)blks * op->bs_pi_do);
+    o = *op;
+    o.scat_lbdof = (uint16_t)lbdof;
+    o.scat_num_lbard = (uint16_t)nrd;
+    o.numblocks = blks;
+    o.xfer_bytes = (ssize_t)blks * op->bs_pi_do;
+    res = do_write_x(mp->sg_fd, buf.up, (lbdof + blks) * op->bs_pi_do, &o);
+    sg_par_lock();
+    ++mp->num_cmds;
+    mp->sent_rds += nrd;
+    if (res) {
+        if (0 == mp->res) {
+            mp->res = res;
+            mp->bad_lba = sg_get_unaligned_be64(buf.up + lbard_sz);
+        }
+    } else {
+        mp->done_blks += blks;
+        sx_progress(mp);
+    }
+    if (mp->num_spare < MAX_MMAP_PARALLEL)
+        mp->spare_arr[mp->num_spare++] = buf;
+    else
+        free(buf.free_up);
+    sg_par_unlock();
+    return res;
+}
+
+/* Maps len bytes of the file open as fd, from byte offset 0, placing the
+ * mapping in *mapp. Without mmap() the file is read into a buffer instead.
+ * Returns 0 on success. */
+static int
+sx_map_file(int fd, uint64_t len, uint8_t ** mapp, const char * fname)
+{
+    int err;
+
+#ifndef SG_LIB_WIN32
+    *mapp = (uint8_t *)mmap(NULL, (size_t)len, PROT_READ, MAP_SHARED, fd, 0);
+    if (MAP_FAILED == (void *)*mapp) {
+        err = errno;
+        *mapp = NULL;
+        pr2serr("unable to mmap %s: %s\n", fname, safe_strerror(err));
+        return sg_convert_errno(err);
+    }
+#ifdef MADV_SEQUENTIAL
+    madvise(*mapp, (size_t)len, MADV_SEQUENTIAL);
+#endif
+    return 0;
+#else
+    *mapp = (uint8_t *)malloc((size_t)len);
+    if (NULL == *mapp) {
+        pr2serr("unable to allocate %" PRIu64 " bytes for %s\n", len, fname);
+        return sg_convert_errno(ENOMEM);
+    }
+    if ((lseek(fd, 0, SEEK_SET) < 0) ||
+        (read(fd, *mapp, (size_t)len) != (ssize_t)len)) {
+        err = errno;
+        pr2serr("unable to read %s: %s\n", fname, safe_strerror(err));
+        free(*mapp);
+        *mapp = NULL;
+        return err ? sg_convert_errno(err) : SG_LIB_FILE_ERROR;
+    }
+    return 0;
+#endif
+}
+
+static void
+sx_unmap_file(uint8_t * mapp, uint64_t len)
+{
+    if (NULL == mapp)
+        return;
+#ifndef SG_LIB_WIN32
+    munmap(mapp, (size_t)len);
+#else
+    if (len) { ; }      /* suppress warning */
+    free(mapp);
+#endif
+}
+
+/* Fetches the per command limits for WRITE SCATTERED from the Block Limits
+ * Extension VPD page, falling back to MAXIMUM TRANSFER LENGTH in the Block
+ * Limits VPD page. A limit not reported is left as 0. */
+static void
+sx_limits(int sg_fd, struct sx_mmap_t * mp, int vb)
+{
+    uint8_t b[64];
+
+    if ((0 == sg_ll_inquiry(sg_fd, false, true, 0xb7 /* Block Limits Ext */,
+                            b, sizeof(b), false, (vb > 1) ? vb - 1 : 0)) &&
+        (0xb7 == b[1]) && (sg_get_unaligned_be16(b + 2) >= 0x18)) {
+        mp->max_rd_blks = sg_get_unaligned_be32(b + 16);
+        mp->max_rds = sg_get_unaligned_be16(b + 22);
+        mp->max_blks = sg_get_unaligned_be32(b + 24);
+    } else if (vb)
+        pr2serr("Unable to fetch Block Limits Extension VPD page\n");
+    if ((0 == mp->max_blks) &&
+        (0 == sg_ll_inquiry(sg_fd, false, true, 0xb0 /* Block Limits */, b,
+                            sizeof(b), false, (vb > 1) ? vb - 1 : 0)) &&
+        (0xb0 == b[1]) && (sg_get_unaligned_be16(b + 2) >= 0x3c))
+        mp->max_blks = sg_get_unaligned_be32(b + 8);
+}
+
+/* --mmap: memory maps the raw SF, whose RDs follow a 32 byte header, and
+ * IF from byte offset OFF which holds the data for those RDs in the same
+ * order. Issues as many WRITE SCATTERED commands as the device's limits
+ * require, with up to --parallel=Q in flight. RD (from --scattered=RD) when
+ * non-zero is a further limit on the RDs per command. Stops issuing
+ * commands after the first failure. Returns 0 if all RDs were written. */
+static int
+sx_mmap(int sg_fd, int infd, int sfr_fd, const struct opts_t * op)
+{
+    int k, ret;
+    int vb = op->verbose;
+    uint32_t nrd, blks, d;
+    uint64_t sf_len, if_len, first, ns;
+    uint64_t need = 0;
+    uint64_t num_cmds = 0;
+    uint64_t max_cmds = 0;
+    uint64_t sent_rds = 0;
+    double secs;
+    uint8_t * sf_map = NULL;
+    uint8_t * if_map = NULL;
+    const uint8_t * rp;
+    struct sx_cur_t cur;
+    struct stat a_st;
+    struct sx_mmap_t ma;
+
+    memset(&ma, 0, sizeof(ma));
+    ma.sg_fd = sg_fd;
+    ma.op = op;
+    if (fstat(sfr_fd, &a_st) < 0) {
+        ret = sg_convert_errno(errno);
+        perror("fstat on SF");
+        return ret;
+    }
+    sf_len = a_st.st_size;
+    if (sf_len < (2 * lbard_sz)) {
+        pr2serr("raw scatter file must be at least 64 bytes long (length: %"
+                PRIu64 ")\n", sf_len);
+        return SG_LIB_FILE_ERROR;
+    }
+    if ((fstat(infd, &a_st) < 0) || (! S_ISREG(a_st.st_mode))) {
+        pr2serr("--mmap needs IF to be a regular file\n");
+        return SG_LIB_FILE_ERROR;
+    }
+    if_len = a_st.st_size;
+    if ((op->if_dlen > 0) && ((op->if_offset + op->if_dlen) < if_len))
+        if_len = op->if_offset + op->if_dlen;   /* from --offset=OFF,DLEN */
+    ret = sx_map_file(sfr_fd, sf_len, &sf_map, op->scat_filename);
+    if (ret)
+        return ret;
+    if (op->strict) {
+        if (! sg_all_zeros(sf_map, lbard_sz)) {
+            pr2serr("first 32 bytes of SF should be zero\n");
+            ret = SG_LIB_FILE_ERROR;
+            goto fini;
+        }
+        if (0 != (sf_len % lbard_sz)) {
+            pr2serr("SF length (%" PRIu64 ") is not a multiple of %u\n",
+                    sf_len, lbard_sz);
+            ret = SG_LIB_FILE_ERROR;
+            goto fini;
+        }
+    }
+    /* count RDs up to the end of SF or a degenerate RD */
+    ma.rdp = sf_map + lbard_sz;
+    for (rp = ma.rdp; (rp + lbard_sz) <= (sf_map + sf_len); rp += lbard_sz) {
+        if (sg_all_zeros(rp, 12))
+            break;
+        ++ma.num_rds;
+        ma.tot_blks += sg_get_unaligned_be32(rp + 8);
+    }
+    if (0 == ma.tot_blks) {
+        pr2serr("No blocks to write in %ss found in SF\n", lbard_str);
+        ret = SG_LIB_FILE_ERROR;
+        goto fini;
+    }
+    need = ma.tot_blks * op->bs_pi_do;
+    if ((op->if_offset >= if_len) || ((if_len - op->if_offset) < need)) {
+        pr2serr("IF has less than the %" PRIu64 " bytes (after OFF) needed "
+                "for the %" PRIu64 " blocks in SF\n", need, ma.tot_blks);
+        ret = SG_LIB_FILE_ERROR;
+        goto fini;
+    }
+    if (((if_len - op->if_offset) > need) && (op->strict || vb)) {
+        pr2serr("IF has more than the %" PRIu64 " bytes (after OFF) needed, "
+                "%s ...\n", need, (op->strict > 1) ? "exiting" : "continuing");
+        if (op->strict > 1) {
+            ret = SG_LIB_FILE_ERROR;
+            goto fini;
+        }
+    }
+    need += op->if_offset;
+    ret = sx_map_file(infd, need, &if_map, op->if_name);
+    if (ret)
+        goto fini;
+    ma.datap = if_map + op->if_offset;
+
+    sx_limits(sg_fd, &ma, vb);
+    if (0 == ma.max_rds)
+        ma.max_rds = DEF_MMAP_MAX_RDS;
+    if ((op->scat_num_lbard > 0) && (op->scat_num_lbard < ma.max_rds))
+        ma.max_rds = op->scat_num_lbard;
+    if (0 == ma.max_blks)
+        ma.max_blks = DEF_MMAP_MAX_BLOCKS;
+    /* keep the data-out buffer length within a signed int */
+    d = ((lbard_sz * (ma.max_rds + 1)) + op->bs_pi_do - 1) / op->bs_pi_do;
+    if (((uint64_t)d + ma.max_blks) * op->bs_pi_do > INT_MAX)
+        ma.max_blks = (INT_MAX / op->bs_pi_do) - d;
+    ma.buf_len = (d + ma.max_blks) * op->bs_pi_do;
+    if (vb)
+        pr2serr("%s: %" PRIu64 " %ss, %" PRIu64 " blocks; per command up to "
+                "%u %ss and %u blocks\n", op->cdb_name, ma.num_rds,
+                lbard_str, ma.tot_blks, ma.max_rds, lbard_str, ma.max_blks);
+
+    /* find where each command starts by stepping through the RDs */
+    memset(&cur, 0, sizeof(cur));
+    while (cur.rd_idx < ma.num_rds) {
+        struct sx_cur_t start = cur;
+
+        first = cur.rd_idx;
+        sx_step(&ma, &cur, NULL, &nrd, &blks);
+        if (0 == nrd)
+            continue;
+        if (num_cmds >= max_cmds) {
+            struct sx_cur_t * cap;
+
+            max_cmds = max_cmds ? (2 * max_cmds) : 1024;
+            cap = (struct sx_cur_t *)realloc(ma.cur_arr,
+                                             max_cmds * sizeof(*cap));
+            if (NULL == cap) {
+                pr2serr("%s: out of memory\n", __func__);
+                ret = sg_convert_errno(ENOMEM);
+                goto fini;
+            }
+            ma.cur_arr = cap;
+        }
+        ma.cur_arr[num_cmds++] = start;
+        sent_rds += nrd;
+        if (op->dry_run && (vb > 1))
+            pr2serr("  command %" PRIu64 ": %u %ss from %s %" PRIu64
+                    ", %u blocks\n", num_cmds, nrd, lbard_str, lbard_str,
+                    first, blks);
+    }
+    if (op->dry_run) {
+        printf("Would send %" PRIu64 " %s commands with %" PRIu64 " %ss for "
+               "%" PRIu64 " blocks\n", num_cmds, op->cdb_name, sent_rds,
+               lbard_str, ma.tot_blks);
+        goto fini;
+    }
+
+    ma.start_ns = sg_get_mono_ns();
+    ma.pr_ns = ma.start_ns;
+    sg_par_each((int64_t)num_cmds, ((op->num_par > 0) ? op->num_par : 1),
+                sx_one, &ma);
+    ns = sg_get_mono_ns() - ma.start_ns;
+    secs = (double)ns / 1000000000.0;
+    printf("Wrote %" PRIu64 " blocks from %" PRIu64 " %ss in %" PRIu64
+           " commands", ma.done_blks, ma.num_rds, lbard_str, ma.num_cmds);
+    if (secs > 0.0)
+        printf(", %.3f secs, %.1f MB/sec", secs,
+               ((double)ma.done_blks * op->bs) / (secs * 1000000.0));
+    printf("\n");
+    ret = ma.res;
+    if (ret)
+        pr2serr("%s failed on the command whose first %s has LBA 0x%"
+                PRIx64 ", no more were sent\n", op->cdb_name, lbard_str,
+                ma.bad_lba);
+fini:
+    for (k = 0; k < ma.num_spare; ++k)
+        free(ma.spare_arr[k].free_up);
+    free(ma.cur_arr);
+    sx_unmap_file(if_map, need);
+    sx_unmap_file(sf_map, sf_len);
+    return ret;
+}
+
+
 int
 main(int argc, char * argv[])
 {
@@ -2306,6 +2834,16 @@ main(int argc, char * argv[])
                 "error\n");
         return SG_LIB_CONTRADICT;
     }
+    if (op->do_mmap) {
+        if (! (op->do_scattered && op->do_scat_raw)) {
+            pr2serr("--mmap needs --scattered=RD, --scat-file=SF and "
+                    "--scat-raw\n");
+            return SG_LIB_CONTRADICT;
+        }
+    } else if (op->num_par > 1) {
+        pr2serr("--parallel=Q only applies with --mmap\n");
+        return SG_LIB_CONTRADICT;
+    }
     n = (!! op->scat_filename) + (!! (lba_op || num_op)) +
         (!! op->do_combined);
     if (n > 1) {
@@ -2335,7 +2873,17 @@ main(int argc, char * argv[])
             usage((op->help > 0) ? op->help : 0);
             return SG_LIB_SYNTAX_ERROR;
         }
-        if ((1 == strlen(op->if_name)) && ('-' == op->if_name[0])) {
+        if (sg_pat_is_pat(op->if_name)) {
+            if (! sg_pat_parse(op->if_name, &op->pat)) {
+                pr2serr("bad pattern in '--in=%s'\n", op->if_name);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            if (op->do_scattered || op->do_mmap) {
+                pr2serr("--in=%s can't be used with --scattered or "
+                        "--mmap\n", op->if_name);
+                return SG_LIB_CONTRADICT;
+            }
+        } else if ((1 == strlen(op->if_name)) && ('-' == op->if_name[0])) {
             got_stdin = true;
             infd = STDIN_FILENO;
             if (sg_set_binary_mode(STDIN_FILENO) < 0) {
@@ -2374,7 +2922,7 @@ main(int argc, char * argv[])
                     PRIu64 ")\n", op->if_offset, (uint64_t)if_readable_len);
             goto file_err_out;
         }
-        if (op->if_offset > 0) {
+        if ((op->if_offset > 0) && (SG_PAT_NONE == op->pat.kind)) {
             off_t off = op->if_offset;
             off_t h = if_readable_len;
 
@@ -2500,6 +3048,17 @@ main(int argc, char * argv[])
             ret = sg_convert_errno(err);
             goto err_out;
         }
+        if (op->do_scat_raw && S_ISREG(sf_stat.st_mode) &&
+            sg_sgl_is_bin_file(op->scat_filename)) {
+            if (op->do_mmap) {
+                pr2serr("--mmap needs SF in T10 raw format, not a binary "
+                        "sgl file\n");
+                goto file_err_out;
+            }
+            if (vb)
+                pr2serr("SF is a binary sgl file, ignore --scat-raw\n");
+            op->do_scat_raw = false;
+        }
         if (op->do_scat_raw) {
             if (! S_ISREG(sf_stat.st_mode)) {
                 pr2serr("Expect scatter file to be a regular file\n");
@@ -2543,6 +3102,10 @@ main(int argc, char * argv[])
         }
     }
 
+    if (op->do_mmap) {
+        ret = sx_mmap(sg_fd, infd, sfr_fd, op);
+        goto fini;
+    }
     if (op->do_scattered) {
         ret = process_scattered(sg_fd, infd, if_len, if_readable_len, sfr_fd,
                                 sf_len, addr_arr, addr_arr_len, num_arr,
@@ -2624,10 +3187,20 @@ main(int argc, char * argv[])
             ret = sg_convert_errno(ENOMEM);
             goto err_out;
         }
-        ret = bin_read(infd, up, ((if_len < do_len) ? if_len : do_len),
-                       "IF 5");
-        if (ret)
-            goto fini;
+        if (SG_PAT_NONE != op->pat.kind) {
+            if (op->bs_pi_do != op->bs) {
+                pr2serr("--in=%s can't supply protection information\n",
+                        op->if_name);
+                ret = SG_LIB_CONTRADICT;
+                goto fini;
+            }
+            sg_pat_fill(&op->pat, up, op->bs, op->lba, do_len / op->bs);
+        } else {
+            ret = bin_read(infd, up, ((if_len < do_len) ? if_len : do_len),
+                           "IF 5");
+            if (ret)
+                goto fini;
+        }
     } else
         up = NULL;
 
@@ -48,6 +48,7 @@
 #include <limits.h>
 #define __STDC_FORMAT_MACROS 1
 #include <inttypes.h>
+#include <pthread.h>
 #include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <sys/time.h>
@@ -65,11 +66,12 @@
 #include "sg_lib.h"
 #include "sg_cmds_basic.h"
 #include "sg_cmds_extra.h"
+#include "sg_pt.h"
 #include "sg_io_linux.h"
 #include "sg_unaligned.h"
 #include "sg_pr2serr.h"
 
-static const char * version_str = "0.75 20230519";
+static const char * version_str = "0.78 20261015";
 
 #define ME "sg_xcopy: "
 
@@ -159,6 +161,12 @@ static const char * version_str = "0.75 20230519";
 
 #define MIN_RESERVED_SIZE 8192
 
+#define MAX_XCOPY_LISTS 32     /* EXTENDED COPY commands in flight */
+
+#define ODX_ROD_TOK_LEN 512
+#define ODX_DEF_CHUNK_BYTES (16 * 1024 * 1024) /* when VPD has no optimal */
+#define ODX_RRTI_RESP_LEN 1024
+
 #define MAX_UNIT_ATTENTIONS 10
 #define MAX_ABORTED_CMDS 256
 
@@ -192,6 +200,7 @@ struct xcopy_fp_t {
     dev_t devno;
     uint32_t min_bytes;
     uint32_t max_bytes;
+    int max_conc;       /* maximum concurrent copies, 0 if not reported */
     int64_t num_sect;
     char fname[INOUTF_SZ];
 };
@@ -199,6 +208,64 @@ struct xcopy_fp_t {
 static struct xcopy_fp_t ixcf;
 static struct xcopy_fp_t oxcf;
 
+/* With lists=NL each worker thread keeps one EXTENDED COPY command, with
+ * its own list identifier, outstanding. Chunks are claimed in order under
+ * xc_mutex so segments are handed out like the single threaded loop. */
+struct xcopy_job_t {
+    int xcopy_fd;
+    int src_desc_len;
+    int dst_desc_len;
+    int seg_desc_type;
+    int bpt;
+    int res;            /* first error, 0 if none */
+    int64_t skip;
+    int64_t seek;
+    int64_t off;        /* next block (from skip and seek) to claim */
+    int64_t count;
+    const uint8_t * src_desc;
+    const uint8_t * dst_desc;
+};
+
+struct xcopy_thr_t {
+    pthread_t id;
+    uint8_t list_id;
+    struct xcopy_job_t * jp;
+};
+
+static pthread_mutex_t xc_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int num_xcopy = 0;
+
+/* odx=1: POPULATE TOKEN (plus RECEIVE ROD TOKEN INFORMATION) on IFILE for
+ * the next chunk is done by a helper thread while the main thread does
+ * WRITE USING TOKEN on OFILE for the current chunk. Two token slots are
+ * used in turn; both sides move through the range in order. */
+struct odx_tok_t {
+    int64_t off;        /* from skip and seek */
+    int64_t num;        /* blocks the token represents */
+    uint8_t tok[ODX_ROD_TOK_LEN];
+};
+
+struct odx_t {
+    int infd;
+    int outfd;
+    uint32_t list_id;   /* POPULATE TOKEN and RRTI; WUT uses list_id + 1 */
+    int64_t skip;
+    int64_t seek;
+    int64_t count;
+    int64_t chunk;      /* blocks per token */
+    /* following protected by xc_mutex */
+    bool stop;
+    bool prod_done;
+    int pt_res;
+    int wut_res;
+    int64_t produced;
+    int64_t consumed;
+    int64_t done_off;   /* blocks below this offset have been written */
+    struct odx_tok_t slot[2];
+};
+
+static pthread_cond_t odx_cv = PTHREAD_COND_INITIALIZER;
+
 static const char * read_cap_str = "Read capacity";
 static const char * rec_copy_op_params_str = "Receive copy operating "
                                              "parameters";
@@ -259,47 +326,6 @@ siginfo_handler(int sig)
     print_stats("  ");
 }
 
-static bool bsg_major_checked = false;
-static int bsg_major = 0;
-
-static void
-find_bsg_major(void)
-{
-    const char * proc_devices = "/proc/devices";
-    FILE *fp;
-    char a[128];
-    char b[128];
-    char * cp;
-    int n;
-
-    if (NULL == (fp = fopen(proc_devices, "r"))) {
-        if (verbose)
-            pr2serr("fopen %s failed: %s\n", proc_devices, strerror(errno));
-        return;
-    }
-    while ((cp = fgets(b, sizeof(b), fp))) {
-        if ((1 == sscanf(b, "%126s", a)) &&
-            (0 == memcmp(a, "Character", 9)))
-            break;
-    }
-    while (cp && (cp = fgets(b, sizeof(b), fp))) {
-        if (2 == sscanf(b, "%d %126s", &n, a)) {
-            if (0 == strcmp("bsg", a)) {
-                bsg_major = n;
-                break;
-            }
-        } else
-            break;
-    }
-    if (verbose > 5) {
-        if (cp)
-            pr2serr("found bsg_major=%d\n", bsg_major);
-        else
-            pr2serr("found no bsg char device in %s\n", proc_devices);
-    }
-    fclose(fp);
-}
-
 /* Returns a file descriptor on success (0 or greater), -1 for an open
  * error, -2 for a standard INQUIRY problem. */
 static int
@@ -384,11 +410,7 @@ dd_filetype(struct xcopy_fp_t * fp)
             return FT_SG;
         if (SCSI_TAPE_MAJOR == major(st.st_rdev))
             return FT_ST;
-        if (! bsg_major_checked) {
-            bsg_major_checked = true;
-            find_bsg_major();
-        }
-        if (bsg_major == (int)major(st.st_rdev))
+        if (sg_linux_get_caps(verbose)->bsg_major == (int)major(st.st_rdev))
             return FT_SG;
     } else if (S_ISBLK(st.st_mode)) {
         fp->devno = st.st_rdev;
@@ -522,12 +544,13 @@ primary_help:
             "                [count=COUNT] [dc=0|1] [ibs=BS]\n"
             "                [id_usage=hold|discard|disable] [if=IFILE] "
             "[iflag=FLAGS]\n"
-            "                [list_id=ID] [obs=BS] [of=OFILE] "
-            "[oflag=FLAGS] [prio=PRIO]\n"
-            "                [seek=SEEK] [skip=SKIP] [time=0|1] "
-            "[verbose=VERB]\n"
-            "                [--help] [--on_dst|--on_src] [--verbose] "
-            "[--version]\n\n"
+            "                [list_id=ID] [lists=NL] [obs=BS] [odx=0|1] "
+            "[of=OFILE]\n"
+            "                [oflag=FLAGS] [prio=PRIO]"
+            " [seek=SEEK] [skip=SKIP] [time=0|1]\n"
+            "                [verbose=VERB]"
+            " [--help] [--on_dst|--on_src] [--verbose]\n"
+            "                [--version]\n\n"
             "  where:\n"
             "    app         if argument is 1 then open OFILE in append "
             "mode\n"
@@ -548,8 +571,15 @@ primary_help:
             "    iflag       comma separated list of flags applying to "
             "IFILE\n"
             "    list_id     sets list_id field to ID (default: 1 or 0)\n"
+            "    lists       number of EXTENDED COPY commands kept in "
+            "flight, each\n"
+            "                with its own list_id: ID, ID+1, ... (def: 1)\n"
             "    obs         output block size (if given must be same as "
             "'bs=')\n"
+            "    odx         1->copy with POPULATE TOKEN and WRITE USING "
+            "TOKEN, falling\n"
+            "                back to host based copy (def: 0 -> "
+            "XCOPY(LID1))\n"
             "    of          file or device to write to (def: stdout), "
             "OFILE of '.'\n");
     pr2serr("                treated as /dev/null\n"
@@ -568,8 +598,8 @@ primary_help:
             "    --verbose|-v   same action as verbose=1\n"
             "    --version|-V   print version information then exit\n\n"
             "Copy from IFILE to OFILE, similar to dd command; "
-            "but using the SCSI\nEXTENDED COPY (XCOPY(LID1)) command. For "
-            "list of flags, use '-hh'.\n");
+            "but using the SCSI\nEXTENDED COPY (XCOPY(LID1)) command, or "
+            "ROD tokens with odx=1. For\nlist of flags, use '-hh'.\n");
     return;
 
 secondary_help:
@@ -619,8 +649,8 @@ scsi_encode_seg_desc(uint8_t *seg_desc, int seg_desc_type,
 
 static int
 scsi_extended_copy(int sg_fd, uint8_t list_id,
-                   uint8_t *src_desc, int src_desc_len,
-                   uint8_t *dst_desc, int dst_desc_len,
+                   const uint8_t *src_desc, int src_desc_len,
+                   const uint8_t *dst_desc, int dst_desc_len,
                    int seg_desc_type, int64_t num_blk,
                    uint64_t src_lba, uint64_t dst_lba)
 {
@@ -662,6 +692,440 @@ scsi_extended_copy(int sg_fd, uint8_t list_id,
     return res;
 }
 
+/* After a failed EXTENDED COPY, asks the copy manager how far list_id got
+ * with RECEIVE COPY STATUS(LID1). Only informative so errors are ignored. */
+static void
+scsi_copy_status(int sg_fd, uint8_t list_id)
+{
+    int res, verb;
+    uint8_t rsBuff[12];
+
+    if (3 == list_id_usage)     /* no list identifier to ask about */
+        return;
+    verb = (verbose > 1) ? (verbose - 2) : 0;
+    res = sg_ll_receive_copy_results(sg_fd, SA_COPY_STATUS_LID1, list_id,
+                                     rsBuff, sizeof(rsBuff), false, verb);
+    if (res) {
+        if (verbose)
+            pr2serr("Receive copy status(LID1) for list_id=%u failed\n",
+                    list_id);
+        return;
+    }
+    pr2serr("  list_id=%u: copy manager status=0x%x, segments processed=%u, "
+            "transfer count=%u (units=%u)\n", list_id, rsBuff[4] & 0x7f,
+            sg_get_unaligned_be16(rsBuff + 5),
+            sg_get_unaligned_be32(rsBuff + 8), rsBuff[7]);
+}
+
+static void *
+xcopy_thread(void * v_tp)
+{
+    int res, blocks;
+    int64_t off;
+    struct xcopy_thr_t * tp = (struct xcopy_thr_t *)v_tp;
+    struct xcopy_job_t * jp = tp->jp;
+
+    while (true) {
+        pthread_mutex_lock(&xc_mutex);
+        if (jp->res || (jp->off >= jp->count)) {
+            pthread_mutex_unlock(&xc_mutex);
+            break;
+        }
+        off = jp->off;
+        blocks = ((jp->count - off) > jp->bpt) ? jp->bpt :
+                                                 (int)(jp->count - off);
+        jp->off += blocks;
+        pthread_mutex_unlock(&xc_mutex);
+
+        res = scsi_extended_copy(jp->xcopy_fd, tp->list_id, jp->src_desc,
+                                 jp->src_desc_len, jp->dst_desc,
+                                 jp->dst_desc_len, jp->seg_desc_type,
+                                 blocks, jp->skip + off, jp->seek + off);
+        pthread_mutex_lock(&xc_mutex);
+        if (res) {
+            if (0 == jp->res)
+                jp->res = res;
+        } else {
+            in_full += blocks;
+            ++num_xcopy;
+        }
+        pthread_mutex_unlock(&xc_mutex);
+        if (res) {
+            scsi_copy_status(jp->xcopy_fd, tp->list_id);
+            break;
+        }
+    }
+    return NULL;
+}
+
+/* Scans the Third Party Copy VPD page of fd for the Block Device ROD Token
+ * Limits descriptor. Returns true if found, placing the maximum token
+ * transfer size and the optimal transfer count (in blocks, 0 if not
+ * reported) in *maxp and *optp. */
+static bool
+odx_rod_limits(int fd, const char * fname, uint64_t * maxp, uint64_t * optp)
+{
+    int res, len, k, desc_len;
+    uint8_t * bp;
+    uint8_t * vpdp;
+    uint8_t * free_vpdp = NULL;
+    bool found = false;
+    const int vpd_len = 8192;
+    int verb = (verbose > 1) ? (verbose - 2) : 0;
+
+    vpdp = sg_memalign(vpd_len, 0, &free_vpdp, false);
+    if (NULL == vpdp)
+        return false;
+    res = sg_ll_inquiry(fd, false, true, VPD_3PARTY_COPY, vpdp, vpd_len,
+                        false, verb);
+    if (res) {
+        if (verbose)
+            pr2serr("Third party copy VPD page not available on %s\n",
+                    fname);
+        goto fini;
+    }
+    len = sg_get_unaligned_be16(vpdp + 2) + 4;
+    if (len > vpd_len)
+        len = vpd_len;
+    for (k = 4; (k + 4) <= len; k += desc_len + 4) {
+        bp = vpdp + k;
+        desc_len = sg_get_unaligned_be16(bp + 2);
+        if (k + desc_len + 4 > len)
+            break;
+        if ((0 == sg_get_unaligned_be16(bp + 0)) && (desc_len >= 0x20)) {
+            *maxp = sg_get_unaligned_be64(bp + 20);
+            *optp = sg_get_unaligned_be64(bp + 28);
+            found = true;
+            break;
+        }
+    }
+    if (verbose) {
+        if (found)
+            pr2serr("    %s: maximum token transfer size=%" PRIu64 ", "
+                    "optimal transfer count=%" PRIu64 "\n", fname, *maxp,
+                    *optp);
+        else
+            pr2serr("    %s: no Block device ROD token limits descriptor\n",
+                    fname);
+    }
+fini:
+    free(free_vpdp);
+    return found;
+}
+
+/* POPULATE TOKEN for num blocks at lba, then fetches the ROD token into
+ * tokp with RECEIVE ROD TOKEN INFORMATION. The number of blocks the token
+ * represents (may be less than num) is placed in *tok_blksp. Returns 0 on
+ * success. */
+static int
+odx_populate(int fd, uint32_t list_id, uint64_t lba, uint32_t num,
+             uint8_t * tokp, int64_t * tok_blksp)
+{
+    int res, len, off, cstat;
+    int verb = (verbose > 1) ? (verbose - 2) : 0;
+    uint64_t tc;
+    uint8_t pl[32];
+    uint8_t rsp[ODX_RRTI_RESP_LEN];
+    char b[80];
+
+    memset(pl, 0, sizeof(pl));
+    sg_put_unaligned_be16(sizeof(pl) - 2, pl + 0);
+    sg_put_unaligned_be16(16, pl + 14);     /* one range descriptor */
+    sg_put_unaligned_be64(lba, pl + 16);
+    sg_put_unaligned_be32(num, pl + 24);
+    res = sg_ll_3party_copy_out(fd, SA_POP_TOK, list_id, DEF_GROUP_NUM,
+                                DEF_3PC_OUT_TIMEOUT, pl, sizeof(pl), true,
+                                verb);
+    if (res) {
+        sg_get_category_sense_str(res, sizeof(b), b, verb);
+        pr2serr("Populate token: %s\n", b);
+        return res;
+    }
+    res = sg_ll_receive_copy_results(fd, SA_ROD_TOK_INFO, list_id, rsp,
+                                     sizeof(rsp), true, verb);
+    if (res) {
+        sg_get_category_sense_str(res, sizeof(b), b, verb);
+        pr2serr("Receive ROD token information: %s\n", b);
+        return res;
+    }
+    len = sg_get_unaligned_be32(rsp + 0) + 4;
+    if (len > (int)sizeof(rsp))
+        len = sizeof(rsp);
+    cstat = rsp[5] & 0x7f;
+    if (((rsp[4] & 0x1f) != SA_POP_TOK) || ((0x1 != cstat) && (0x3 != cstat))) {
+        pr2serr("Receive ROD token information: unexpected response to "
+                "0x%x, copy operation status 0x%x\n", rsp[4] & 0x1f, cstat);
+        return SG_LIB_CAT_MALFORMED;
+    }
+    /* ROD token descriptors length then 2 reserved bytes, after sense */
+    off = 32 + rsp[13];
+    if ((off + 6 + ODX_ROD_TOK_LEN) > len) {
+        pr2serr("Receive ROD token information: response too short (%d) "
+                "for ROD token\n", len);
+        return SG_LIB_CAT_MALFORMED;
+    }
+    memcpy(tokp, rsp + off + 6, ODX_ROD_TOK_LEN);
+    tc = sg_get_unaligned_be64(rsp + 16);
+    /* transfer count units of 0xf1 are logical blocks */
+    *tok_blksp = ((0xf1 == rsp[15]) && (tc > 0) && (tc < num)) ?
+                 (int64_t)tc : (int64_t)num;
+    if (verbose > 1)
+        pr2serr("    populate token: lba=%" PRIu64 ", blocks=%" PRId64
+                "\n", lba, *tok_blksp);
+    return 0;
+}
+
+static int
+odx_write(int fd, uint32_t list_id, const uint8_t * tokp, uint64_t lba,
+          uint32_t num)
+{
+    int res;
+    int verb = (verbose > 1) ? (verbose - 2) : 0;
+    uint8_t pl[552];
+    char b[80];
+
+    memset(pl, 0, sizeof(pl));
+    sg_put_unaligned_be16(sizeof(pl) - 2, pl + 0);
+    memcpy(pl + 16, tokp, ODX_ROD_TOK_LEN);
+    sg_put_unaligned_be16(16, pl + 534);    /* one range descriptor */
+    sg_put_unaligned_be64(lba, pl + 536);
+    sg_put_unaligned_be32(num, pl + 544);
+    res = sg_ll_3party_copy_out(fd, SA_WR_USING_TOK, list_id, DEF_GROUP_NUM,
+                                DEF_3PC_OUT_TIMEOUT, pl, sizeof(pl), true,
+                                verb);
+    if (res) {
+        sg_get_category_sense_str(res, sizeof(b), b, verb);
+        pr2serr("Write using token: %s\n", b);
+    }
+    return res;
+}
+
+static void *
+odx_populate_thread(void * v_op)
+{
+    bool stop;
+    int res;
+    int64_t off, n, tok_blks;
+    struct odx_t * op = (struct odx_t *)v_op;
+    uint8_t tok[ODX_ROD_TOK_LEN];
+
+    for (off = 0; off < op->count; off += tok_blks) {
+        pthread_mutex_lock(&xc_mutex);
+        while ((! op->stop) && ((op->produced - op->consumed) >= 2))
+            pthread_cond_wait(&odx_cv, &xc_mutex);
+        stop = op->stop;
+        pthread_mutex_unlock(&xc_mutex);
+        if (stop)
+            break;
+        n = ((op->count - off) > op->chunk) ? op->chunk : (op->count - off);
+        res = odx_populate(op->infd, op->list_id, op->skip + off, n, tok,
+                           &tok_blks);
+        pthread_mutex_lock(&xc_mutex);
+        if (res) {
+            op->pt_res = res;
+            pthread_mutex_unlock(&xc_mutex);
+            break;
+        }
+        op->slot[op->produced % 2].off = off;
+        op->slot[op->produced % 2].num = tok_blks;
+        memcpy(op->slot[op->produced % 2].tok, tok, ODX_ROD_TOK_LEN);
+        ++op->produced;
+        pthread_cond_broadcast(&odx_cv);
+        pthread_mutex_unlock(&xc_mutex);
+    }
+    pthread_mutex_lock(&xc_mutex);
+    op->prod_done = true;
+    pthread_cond_broadcast(&odx_cv);
+    pthread_mutex_unlock(&xc_mutex);
+    return NULL;
+}
+
+/* READ(16) or WRITE(16) of blocks at lba, for the host based fallback */
+static int
+host_rw(int fd, bool wr, uint64_t lba, int blocks, uint8_t * bp, int bs)
+{
+    int res, ret, sense_cat;
+    int verb = (verbose > 1) ? (verbose - 2) : 0;
+    uint8_t cdb[16];
+    uint8_t sense_b[SENSE_BUFF_LEN];
+    struct sg_pt_base * ptvp;
+
+    memset(cdb, 0, sizeof(cdb));
+    cdb[0] = wr ? 0x8a : 0x88;
+    sg_put_unaligned_be64(lba, cdb + 2);
+    sg_put_unaligned_be32((uint32_t)blocks, cdb + 10);
+    ptvp = construct_scsi_pt_obj_with_fd(fd, verb);
+    if (NULL == ptvp)
+        return sg_convert_errno(ENOMEM);
+    set_scsi_pt_cdb(ptvp, cdb, sizeof(cdb));
+    set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
+    if (wr)
+        set_scsi_pt_data_out(ptvp, bp, blocks * bs);
+    else
+        set_scsi_pt_data_in(ptvp, bp, blocks * bs);
+    res = do_scsi_pt(ptvp, -1, DEF_TIMEOUT / 1000, verb);
+    ret = sg_cmds_process_resp(ptvp, (wr ? "write(16)" : "read(16)"), res,
+                               true, verb, &sense_cat);
+    if (-1 == ret)
+        ret = sg_convert_errno(get_scsi_pt_os_err(ptvp));
+    else if (-2 == ret) {
+        switch (sense_cat) {
+        case SG_LIB_CAT_RECOVERED:
+        case SG_LIB_CAT_NO_SENSE:
+            ret = 0;
+            break;
+        default:
+            ret = sense_cat;
+            break;
+        }
+    } else
+        ret = 0;
+    destruct_scsi_pt_obj(ptvp);
+    return ret;
+}
+
+/* Copies num blocks at offset off (from skip and seek) through a host
+ * buffer, bpt blocks at a time. Adds to *host_blksp. Returns 0 on
+ * success. */
+static int
+host_copy(const struct odx_t * op, int64_t off, int64_t num, int bpt,
+          int bs, int64_t * host_blksp)
+{
+    int res = 0;
+    int blocks;
+    uint8_t * bp;
+    uint8_t * free_bp = NULL;
+
+    bp = sg_memalign(bpt * bs, 0, &free_bp, false);
+    if (NULL == bp)
+        return sg_convert_errno(ENOMEM);
+    while (num > 0) {
+        blocks = (num > bpt) ? bpt : (int)num;
+        res = host_rw(op->infd, false, op->skip + off, blocks, bp, bs);
+        if (res) {
+            pr2serr("host copy: read at lba=%" PRId64 " failed\n",
+                    op->skip + off);
+            break;
+        }
+        res = host_rw(op->outfd, true, op->seek + off, blocks, bp, bs);
+        if (res) {
+            pr2serr("host copy: write at lba=%" PRId64 " failed\n",
+                    op->seek + off);
+            break;
+        }
+        off += blocks;
+        num -= blocks;
+        in_full += blocks;
+        *host_blksp += blocks;
+    }
+    free(free_bp);
+    return res;
+}
+
+/* odx=1 copy engine. Falls back to a host based copy of what remains when
+ * the device doesn't support ROD tokens or an offload command fails. */
+static int
+odx_copy(int infd, int outfd, uint32_t list_id, int64_t skip, int64_t seek,
+         int64_t count, int bpt, bool bpt_given, int bs)
+{
+    bool in_ok, out_ok;
+    int res, status;
+    int n_wut = 0;
+    int64_t host_blks = 0;
+    uint64_t in_max = 0, in_opt = 0, out_max = 0, out_opt = 0;
+    uint64_t lim;
+    pthread_t pt_id;
+    struct odx_t odx;
+    struct odx_t * op = &odx;
+    struct odx_tok_t * tp;
+
+    memset(op, 0, sizeof(*op));
+    op->infd = infd;
+    op->outfd = outfd;
+    op->list_id = list_id;
+    op->skip = skip;
+    op->seek = seek;
+    op->count = count;
+    in_ok = odx_rod_limits(infd, ixcf.fname, &in_max, &in_opt);
+    out_ok = odx_rod_limits(outfd, oxcf.fname, &out_max, &out_opt);
+    if (! (in_ok && out_ok)) {
+        pr2serr("ROD tokens not supported by %s, using host based copy\n",
+                in_ok ? oxcf.fname : ixcf.fname);
+        goto fallback;
+    }
+    if (bpt_given)
+        op->chunk = bpt;
+    else if (in_opt > 0)
+        op->chunk = in_opt;
+    else
+        op->chunk = ODX_DEF_CHUNK_BYTES / bs;
+    lim = UINT32_MAX;   /* NUMBER OF LOGICAL BLOCKS field */
+    if ((in_max > 0) && (in_max < lim))
+        lim = in_max;
+    if ((out_max > 0) && (out_max < lim))
+        lim = out_max;
+    if ((uint64_t)op->chunk > lim)
+        op->chunk = lim;
+    if (verbose)
+        pr2serr("ODX copy, count=%" PRId64 ", blocks per token=%" PRId64
+                ", list_id=%u (populate), %u (write)\n", count, op->chunk,
+                list_id, list_id + 1);
+
+    status = pthread_create(&pt_id, NULL, odx_populate_thread, op);
+    if (status) {
+        pr2serr("pthread_create: %s\n", safe_strerror(status));
+        return sg_convert_errno(status);
+    }
+    while (true) {
+        pthread_mutex_lock(&xc_mutex);
+        while ((op->produced == op->consumed) && (! op->prod_done))
+            pthread_cond_wait(&odx_cv, &xc_mutex);
+        if (op->produced == op->consumed) {
+            pthread_mutex_unlock(&xc_mutex);
+            break;
+        }
+        tp = op->slot + (op->consumed % 2);
+        pthread_mutex_unlock(&xc_mutex);
+        res = odx_write(outfd, list_id + 1, tp->tok, seek + tp->off,
+                        tp->num);
+        pthread_mutex_lock(&xc_mutex);
+        if (res) {
+            op->wut_res = res;
+            op->stop = true;
+        } else {
+            op->done_off = tp->off + tp->num;
+            in_full += tp->num;
+            ++op->consumed;
+            ++n_wut;
+        }
+        pthread_cond_broadcast(&odx_cv);
+        pthread_mutex_unlock(&xc_mutex);
+        if (res)
+            break;
+    }
+    pthread_join(pt_id, NULL);
+    if (op->done_off >= count) {
+        pr2serr("sg_xcopy: %" PRId64 " blocks, %d token%s\n", in_full,
+                n_wut, ((1 == n_wut) ? "" : "s"));
+        return 0;
+    }
+    pr2serr("offload stopped at block %" PRId64 " (of %" PRId64 "), using "
+            "host based copy for the rest\n", op->done_off, count);
+
+fallback:
+    res = host_copy(op, op->done_off, count - op->done_off,
+                    (bpt_given ? bpt : DEF_BLOCKS_PER_TRANSFER), bs,
+                    &host_blks);
+    if (res)
+        pr2serr("sg_xcopy: failed with error %d (%" PRId64 " blocks left)\n",
+                res, count - in_full);
+    else
+        pr2serr("sg_xcopy: %" PRId64 " blocks, %d token%s, %" PRId64
+                " blocks by host based copy\n", in_full, n_wut,
+                ((1 == n_wut) ? "" : "s"), host_blks);
+    return res;
+}
+
 /* Return of 0 -> success, see sg_ll_read_capacity*() otherwise */
 static int
 scsi_read_capacity(struct xcopy_fp_t *xfp)
@@ -779,6 +1243,9 @@ scsi_operating_parameter(struct xcopy_fp_t *xfp, int is_target)
         pr2serr("    Maximum stream device transfer size: %u\n",
                 (unsigned int)num);
         pr2serr("    Maximum concurrent copies: %u\n", rcBuff[36]);
+    }
+    xfp->max_conc = rcBuff[36];
+    if (verbose) {
         if (rcBuff[37] > 30)
             pr2serr("    Data segment granularity: 2**%u bytes\n",
                     rcBuff[37]);
@@ -1031,11 +1498,15 @@ static int
 desc_from_vpd_id(int sg_fd, uint8_t *desc, int desc_len,
                  unsigned int block_size, bool pad)
 {
-    int res, verb;
+    /* logical unit designators in order of preference */
+    static const int pref_arr[] = {3 /* NAA */, 2 /* EUI-64 */,
+                                   1 /* T10 */, 0 /* vendor specific */};
+    int k, res, verb;
     uint8_t rcBuff[256], *bp, *best = NULL;
     unsigned int len = 254;
-    int off = -1, i_len, best_len = 0, assoc, desig, f_desig = 0;
+    int off, i_len, best_len = 0, assoc, desig;
     char b[80];
+    struct sg_vpd_dev_id_idx di_idx;
 
     verb = (verbose ? verbose - 1: 0);
     memset(rcBuff, 0xff, len);
@@ -1070,47 +1541,32 @@ desc_from_vpd_id(int sg_fd, uint8_t *desc, int desc_len,
         hex2stderr(rcBuff, len, 1);
     }
 
-    while (sg_vpd_dev_id_iter(rcBuff + 4, len - 4, &off, 0, -1, -1) == 0) {
-        bp = rcBuff + 4 + off;
-        i_len = bp[3];
-        if (((unsigned int)off + i_len + 4) > len) {
-            pr2serr("    VPD page error: designator length %d longer "
-                    "than\n     remaining response length=%d\n", i_len,
-                    (len - off));
-            return SG_LIB_CAT_MALFORMED;
-        }
-        assoc = ((bp[1] >> 4) & 0x3);
-        desig = (bp[1] & 0xf);
-        if (verbose > 2)
-            pr2serr("    Desc %d: assoc %u desig %u len %d\n", off, assoc,
-                    desig, i_len);
-        /* Identification descriptor's Designator length must be <= 20. */
-        if (i_len > 20)
-            continue;
-        if (desig == /*NAA=*/3) {
+    sg_vpd_dev_id_index(rcBuff + 4, len - 4, &di_idx);
+    for (k = 0; (NULL == best) &&
+                (k < (int)(sizeof(pref_arr) / sizeof(pref_arr[0]))); ++k) {
+        for (off = -1; 0 == sg_vpd_dev_id_next(&di_idx, &off, 0, pref_arr[k],
+                                               -1); ) {
+            bp = rcBuff + 4 + off;
+            i_len = bp[3];
+            if (((unsigned int)off + i_len + 4) > len) {
+                pr2serr("    VPD page error: designator length %d longer "
+                        "than\n     remaining response length=%d\n", i_len,
+                        (len - off));
+                return SG_LIB_CAT_MALFORMED;
+            }
+            assoc = ((bp[1] >> 4) & 0x3);
+            desig = (bp[1] & 0xf);
+            if (verbose > 2)
+                pr2serr("    Desc %d: assoc %u desig %u len %d\n", off,
+                        assoc, desig, i_len);
+            /* Identification descriptor's Designator length must be
+             * <= 20. */
+            if (i_len > 20)
+                continue;
             best = bp;
             best_len = i_len;
             break;
         }
-        if (desig == /*EUI64=*/2) {
-            if (!best || f_desig < 2) {
-                best = bp;
-                best_len = i_len;
-                f_desig = 2;
-            }
-        } else if (desig == /*T10*/1) {
-            if (!best || f_desig == 0) {
-                best = bp;
-                best_len = i_len;
-                f_desig = desig;
-            }
-        } else if (desig == /*vend.spec.=*/0) {
-            if (!best) {
-                best = bp;
-                best_len = i_len;
-                f_desig = desig;
-            }
-        }
     }
     if (best) {
         if (verbose)
@@ -1318,6 +1774,7 @@ main(int argc, char * argv[])
 {
     bool bpt_given = false;
     bool list_id_given = false;
+    bool do_odx = false;
     bool on_src = false;
     bool on_src_dst_given = false;
     bool verbose_given = false;
@@ -1328,7 +1785,7 @@ main(int argc, char * argv[])
     int dst_desc_len;
     int ibs = 0;
     int num_help = 0;
-    int num_xcopy = 0;
+    int num_lists = 1;
     int obs = 0;
     int ret = 0;
     int seg_desc_type;
@@ -1341,6 +1798,7 @@ main(int argc, char * argv[])
     char str[STR_SZ];
     uint8_t src_desc[256];
     uint8_t dst_desc[256];
+    struct xcopy_fp_t * xcf;
 
     ixcf.fname[0] = '\0';
     oxcf.fname[0] = '\0';
@@ -1388,6 +1846,12 @@ main(int argc, char * argv[])
             }
             list_id = (ret & 0xff);
             list_id_given = true;
+        } else if (0 == strcmp(key, "lists")) {
+            num_lists = sg_get_num(buf);
+            if ((num_lists < 1) || (num_lists > MAX_XCOPY_LISTS)) {
+                pr2serr(ME "'lists=' expects 1 to %d\n", MAX_XCOPY_LISTS);
+                return SG_LIB_SYNTAX_ERROR;
+            }
         } else if (0 == strcmp(key, "id_usage")) {
             if (!strncmp(buf, "hold", 4))
                 list_id_usage = 0;
@@ -1449,6 +1913,8 @@ main(int argc, char * argv[])
             }
         } else if (0 == strcmp(key, "obs")) {
             obs = sg_get_num(buf);
+        } else if (0 == strcmp(key, "odx")) {
+            do_odx = !! sg_get_num(buf);
         } else if (strcmp(key, "of") == 0) {
             if ('\0' != oxcf.fname[0]) {
                 pr2serr("Second OFILE argument??\n");
@@ -1626,6 +2092,10 @@ main(int argc, char * argv[])
             pr2serr("list_id disabled by id_usage flag\n");
             return SG_LIB_SYNTAX_ERROR;
         }
+    } else if ((list_id + num_lists - 1) > 0xff) {
+        pr2serr("list_id=%u plus lists=%d exceeds the highest list_id (255)"
+                "\n", list_id, num_lists);
+        return SG_LIB_SYNTAX_ERROR;
     }
 
     if (verbose > 1)
@@ -1764,6 +2234,27 @@ main(int argc, char * argv[])
         }
     }
 
+    if (do_odx) {
+        if (dd_count < 0) {
+            pr2serr("Couldn't calculate count, please give one\n");
+            return SG_LIB_CAT_OTHER;
+        }
+        if (ixcf.sect_sz != oxcf.sect_sz) {
+            pr2serr("odx=1 needs IFILE and OFILE to have the same block "
+                    "size\n");
+            return SG_LIB_CONTRADICT;
+        }
+        if (do_time) {
+            gettimeofday(&start_tm, NULL);
+            start_tm_valid = true;
+        }
+        ret = odx_copy(infd, outfd, list_id, skip, seek, dd_count, bpt,
+                       bpt_given, ixcf.sect_sz);
+        if (do_time)
+            calc_duration_throughput(0);
+        goto fini;
+    }
+
     res = scsi_operating_parameter(&ixcf, 0);
     if (res < 0) {
         if (SG_LIB_CAT_UNIT_ATTENTION == -res) {
@@ -1898,27 +2389,72 @@ main(int argc, char * argv[])
         start_tm_valid = true;
     }
 
+    /* the device receiving XCOPY may limit the number of lists handled
+     * concurrently; more would only be queued (or rejected) */
+    xcf = on_src ? &ixcf : &oxcf;
+    if ((xcf->max_conc > 0) && (num_lists > xcf->max_conc)) {
+        pr2serr("lists=%d reduced to maximum concurrent copies (%d) of %s\n",
+                num_lists, xcf->max_conc, xcf->fname);
+        num_lists = xcf->max_conc;
+    }
     if (verbose)
         pr2serr("Start of loop, count=%" PRId64 ", bpt=%d, lba_in=%" PRId64
-                ", lba_out=%" PRId64 "\n", dd_count, bpt, skip, seek);
+                ", lba_out=%" PRId64 ", lists=%d\n", dd_count, bpt, skip,
+                seek, num_lists);
 
     xcopy_fd = (on_src) ? infd : outfd;
 
-    while (dd_count > 0) {
-        if (dd_count > bpt)
-            blocks = bpt;
-        else
-            blocks = dd_count;
-        res = scsi_extended_copy(xcopy_fd, list_id, src_desc, src_desc_len,
-                                 dst_desc, dst_desc_len, seg_desc_type,
-                                 blocks, skip, seek);
-        if (res != 0)
-            break;
-        in_full += blocks;
-        skip += blocks;
-        seek += blocks;
-        dd_count -= blocks;
-        num_xcopy++;
+    if (num_lists > 1) {
+        struct xcopy_job_t job;
+        struct xcopy_thr_t thr[MAX_XCOPY_LISTS];
+
+        memset(&job, 0, sizeof(job));
+        job.xcopy_fd = xcopy_fd;
+        job.src_desc = src_desc;
+        job.src_desc_len = src_desc_len;
+        job.dst_desc = dst_desc;
+        job.dst_desc_len = dst_desc_len;
+        job.seg_desc_type = seg_desc_type;
+        job.bpt = bpt;
+        job.skip = skip;
+        job.seek = seek;
+        job.count = dd_count;
+        for (k = 0; k < num_lists; ++k) {
+            thr[k].list_id = (list_id_usage == 3) ? 0 : (list_id + k);
+            thr[k].jp = &job;
+            n = pthread_create(&thr[k].id, NULL, xcopy_thread, thr + k);
+            if (n) {
+                pr2serr("pthread_create: %s\n", safe_strerror(n));
+                pthread_mutex_lock(&xc_mutex);
+                if (0 == job.res)
+                    job.res = sg_convert_errno(n);
+                pthread_mutex_unlock(&xc_mutex);
+                break;
+            }
+        }
+        for (n = 0; n < k; ++n)
+            pthread_join(thr[n].id, NULL);
+        res = job.res;
+        dd_count -= in_full;
+    } else {
+        while (dd_count > 0) {
+            if (dd_count > bpt)
+                blocks = bpt;
+            else
+                blocks = dd_count;
+            res = scsi_extended_copy(xcopy_fd, list_id, src_desc,
+                                     src_desc_len, dst_desc, dst_desc_len,
+                                     seg_desc_type, blocks, skip, seek);
+            if (res != 0) {
+                scsi_copy_status(xcopy_fd, list_id);
+                break;
+            }
+            in_full += blocks;
+            skip += blocks;
+            seek += blocks;
+            dd_count -= blocks;
+            num_xcopy++;
+        }
     }
 
     if (do_time)
@@ -28,6 +28,8 @@
 #include "sg_lib_data.h"
 #include "sg_pt.h"
 #include "sg_cmds_basic.h"
+#include "sg_mux.h"
+#include "sg_mpoll.h"
 #include "sg_unaligned.h"
 #include "sg_pr2serr.h"
 
@@ -35,21 +37,28 @@
  *
  *
  * This program issues either a SCSI ZONE ACTIVATE command or a ZONE QUERY
- * command to the given SCSI device. Based on zbc2r12.pdf .
+ * command to the given SCSI device. Based on zbc2r12.pdf . With --plan
+ * it issues many of them, checked first against the device's zone domains.
  */
 
-static const char * version_str = "1.05 20230407";
+static const char * version_str = "1.06 20261015";
 static const char * my_name = "sg_z_act_query: ";
 
 #define SG_ZBC_IN_CMDLEN 16
 #define Z_ACTIVATE_SA 0x8
 #define Z_QUERY_SA 0x9
+#define REP_ZONE_DOMAINS_SA 0x7
 
 #define SENSE_BUFF_LEN 64       /* Arbitrary, could be larger */
 #define DEF_PT_TIMEOUT 60       /* 60 seconds */
 #define DEF_ALLOC_LEN 8192
 #define Z_ACT_DESC_LEN 32
 #define MAX_ACT_QUERY_BUFF_LEN (16 * 1024 * 1024)
+#define Z_DOM_DESC_LEN 96
+#define MAX_ZDOMS 255
+#define MAX_PLAN_OPS 4096
+#define DEF_PLAN_QD 4
+#define MAX_PLAN_QD 64
 
 struct opts_t {
     bool do_all;
@@ -62,10 +71,57 @@ struct opts_t {
     uint16_t max_alloc;
     uint16_t num_zones;
     int hex_count;
+    int plan_qd;
     int vb;
     uint64_t st_lba;    /* Zone ID */
     const char * device_name;
     const char * inhex_fn;
+    const char * plan_fn;
+};
+
+/* A zone domain, from the REPORT ZONE DOMAINS response */
+struct zdom_t {
+    uint8_t id;
+    uint64_t num_zones;
+    uint64_t start_lba;
+    uint64_t end_lba;
+};
+
+/* One line of a --plan file, and its outcome */
+struct plan_op {
+    uint64_t zone_id;
+    uint64_t end_lba;   /* just past its zones, from the zone domain */
+    uint16_t num_zones;
+    uint8_t other_zdid;
+    int lnum;
+    int res;            /* -1: not sent, 0: good, else SG_LIB_CAT_* */
+    const struct zdom_t * zdp;  /* zone domain holding zone_id */
+    uint8_t resp[64];   /* response header, descriptors not fetched */
+};
+
+struct plan_t;
+
+struct plan_slot {
+    struct sg_mux_cmd mc;
+    struct plan_t * pp;
+    struct plan_op * pop;
+    bool busy;
+    uint8_t cdb[SG_ZBC_IN_CMDLEN];
+    uint8_t sense[SENSE_BUFF_LEN];
+};
+
+struct plan_t {
+    bool do_activate;
+    int sg_fd;
+    int qd;
+    int vb;
+    int num_ops;
+    int num_zdoms;
+    const char * sa_name;
+    struct plan_op * ops;
+    struct plan_slot * slots;
+    struct sg_mux * mxp;
+    struct zdom_t zdoms[MAX_ZDOMS];
 };
 
 static struct option long_options[] = {
@@ -79,6 +135,8 @@ static struct option long_options[] = {
         {"maxlen", required_argument, 0, 'm'},
         {"num", required_argument, 0, 'n'},
         {"other", required_argument, 0, 'o'},
+        {"plan", required_argument, 0, 'p'},
+        {"qd", required_argument, 0, 'Q'},
         {"query", no_argument, 0, 'q'},
         {"raw", no_argument, 0, 'r'},
         {"verbose", no_argument, 0, 'v'},
@@ -96,9 +154,9 @@ usage()
             "[--hex]\n"
             "                      [--inhex=FN] [--maxlen=LEN] [--num=ZS] "
             "[--other=ZDID]\n"
-            "                      [--query] [--raw] [--verbose] "
-            "[--version]\n"
-            "                      [--zone=ID] DEVICE\n");
+            "                      [--plan=PF] [--qd=QD] [--query] [--raw] "
+            "[--verbose]\n"
+            "                      [--version] [--zone=ID] DEVICE\n");
     pr2serr("  where:\n"
             "    --activate|-A      do ZONE ACTIVATE command (def: ZONE "
             "QUERY)\n"
@@ -116,6 +174,14 @@ usage()
             "given\n"
             "    --other=ZDID|-o ZDID    ZDID is placed in Other zone domain "
             "ID field\n"
+            "    --plan=PF|-p PF    PF is a file of operations, one per "
+            "line: zone ID,\n"
+            "                       number of zones and other zone domain "
+            "ID. Each is\n"
+            "                       checked then sent, results are "
+            "consolidated\n"
+            "    --qd=QD|-Q QD      with --plan: up to QD commands in flight "
+            "(def: %d)\n"
             "    --query|-q         do ZONE QUERY command (def: ZONE "
             "QUERY)\n"
             "    --raw|-r           output response in binary, or if "
@@ -128,7 +194,7 @@ usage()
             "Performs either a SCSI ZONE ACTIVATE command, or a ZONE QUERY "
             "command.\nArguments to options are decimal by default, for hex "
             "use a leading '0x'\nor a trailing 'h'. The default action is to "
-            "send a ZONE QUERY command.\n");
+            "send a ZONE QUERY command.\n", DEF_PLAN_QD);
 }
 
 /* Invokes a ZBC IN command (with either a ZONE ACTIVATE or a ZONE QUERY
@@ -340,6 +406,546 @@ decode_z_act_query(const uint8_t * ziBuff, int act_len, uint32_t zar_len,
     return 0;
 }
 
+/* With --plan=PF a file of operations, one per line, each a starting zone
+ * ID, a number of zones and the other zone domain ID, is checked against
+ * the zone domains the device reports (fetched once). Then each operation
+ * is sent as a ZONE QUERY (or ZONE ACTIVATE) command, with up to --qd=QD
+ * of them in flight at once, and the outcomes reported together. */
+
+/* Returns a string listing the set unmet prerequisite flags of ub */
+static char *
+unmet_prereq_str(uint8_t ub, char * b, int blen)
+{
+    int n = 0;
+
+    b[0] = '\0';
+    if (0x40 & ub)
+        n += sg_scn3pr(b, blen, n, "security,");
+    if (0x20 & ub)
+        n += sg_scn3pr(b, blen, n, "mult domn,");
+    if (0x10 & ub)
+        n += sg_scn3pr(b, blen, n, "rlm rstct,");
+    if (0x8 & ub)
+        n += sg_scn3pr(b, blen, n, "mult ztyp,");
+    if (0x4 & ub)
+        n += sg_scn3pr(b, blen, n, "rlm align,");
+    if (0x2 & ub)
+        n += sg_scn3pr(b, blen, n, "not empty,");
+    if (0x1 & ub)
+        n += sg_scn3pr(b, blen, n, "not inact,");
+    if (n > 0)
+        b[n - 1] = '\0';        /* drop trailing comma */
+    return b;
+}
+
+/* Reads the plan in fn ('-' for stdin) into pp->ops. Returns 0 or an exit
+ * status. */
+static int
+plan_read(const char * fn, struct plan_t * pp)
+{
+    int k, lnum, n, len;
+    int ret = 0;
+    int64_t ll;
+    int64_t val[3];
+    FILE * fp;
+    char * cp;
+    char line[256];
+    struct plan_op * pop;
+
+    if ((1 == strlen(fn)) && ('-' == fn[0]))
+        fp = stdin;
+    else {
+        fp = fopen(fn, "r");
+        if (NULL == fp) {
+            pr2serr("unable to open plan %s: %s\n", fn,
+                    safe_strerror(errno));
+            return SG_LIB_FILE_ERROR;
+        }
+    }
+    for (lnum = 1; fgets(line, sizeof(line), fp); ++lnum) {
+        cp = strchr(line, '#');
+        if (cp)
+            *cp = '\0';
+        len = strlen(line);
+        while ((len > 0) && isspace((uint8_t)line[len - 1]))
+            line[--len] = '\0';
+        cp = line + strspn(line, " \t");
+        if ('\0' == *cp)
+            continue;
+        for (k = 0; k < 3; ++k) {
+            ll = sg_get_llnum_nomult(cp);
+            if (-1 == ll)
+                break;
+            val[k] = ll;
+            n = strcspn(cp, " ,\t");
+            cp += n;
+            cp += strspn(cp, " ,\t");
+            if ('\0' == *cp) {
+                ++k;
+                break;
+            }
+        }
+        if ((3 != k) || ('\0' != *cp)) {
+            pr2serr("plan line %d: expected ZONE_ID,NUM_ZONES,DOMAIN_ID\n",
+                    lnum);
+            ret = SG_LIB_SYNTAX_ERROR;
+            break;
+        }
+        if ((val[1] < 1) || (val[1] > 0xffff) || (val[2] > 0xff)) {
+            pr2serr("plan line %d: NUM_ZONES must be 1 to 65535 and "
+                    "DOMAIN_ID 0 to 255\n", lnum);
+            ret = SG_LIB_SYNTAX_ERROR;
+            break;
+        }
+        if (pp->num_ops >= MAX_PLAN_OPS) {
+            pr2serr("plan has more than %d operations\n", MAX_PLAN_OPS);
+            ret = SG_LIB_SYNTAX_ERROR;
+            break;
+        }
+        pop = pp->ops + pp->num_ops++;
+        pop->zone_id = (uint64_t)val[0];
+        pop->num_zones = (uint16_t)val[1];
+        pop->other_zdid = (uint8_t)val[2];
+        pop->lnum = lnum;
+        pop->res = -1;
+    }
+    if (stdin != fp)
+        fclose(fp);
+    if ((0 == ret) && (0 == pp->num_ops)) {
+        pr2serr("plan %s has no operations\n", fn);
+        ret = SG_LIB_SYNTAX_ERROR;
+    }
+    return ret;
+}
+
+/* Sends REPORT ZONE DOMAINS (all domains) once and keeps the domains in
+ * pp->zdoms. Returns 0 or an exit status. */
+static int
+plan_get_zdomains(struct plan_t * pp)
+{
+    int k, res, sense_cat, resid, rlen, num;
+    int ret = 0;
+    struct sg_pt_base * ptvp;
+    uint8_t * rp;
+    uint8_t * free_rp = NULL;
+    const uint8_t * bp;
+    uint8_t cdb[SG_ZBC_IN_CMDLEN] =
+          {SG_ZBC_IN, REP_ZONE_DOMAINS_SA, 0, 0,  0, 0, 0, 0,
+           0, 0, 0, 0,  0, 0, 0, 0};
+    uint8_t sense_b[SENSE_BUFF_LEN] SG_C_CPP_ZERO_INIT;
+    static const int rlen_max = 64 + (MAX_ZDOMS * Z_DOM_DESC_LEN);
+    static const char * const rzd_s = "Report zone domains";
+
+    rp = (uint8_t *)sg_memalign(rlen_max, 0, &free_rp, pp->vb > 3);
+    ptvp = construct_scsi_pt_obj();
+    if ((NULL == rp) || (NULL == ptvp)) {
+        pr2serr("%s: out of memory\n", rzd_s);
+        ret = sg_convert_errno(ENOMEM);
+        goto fini;
+    }
+    sg_put_unaligned_be32(rlen_max, cdb + 10);
+    if (pp->vb) {
+        char d[128];
+
+        pr2serr("    %s cdb: %s\n", rzd_s,
+                sg_get_command_str(cdb, SG_ZBC_IN_CMDLEN, false, sizeof(d),
+                                   d));
+    }
+    set_scsi_pt_cdb(ptvp, cdb, sizeof(cdb));
+    set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
+    set_scsi_pt_data_in(ptvp, rp, rlen_max);
+    res = do_scsi_pt(ptvp, pp->sg_fd, DEF_PT_TIMEOUT, pp->vb);
+    res = sg_cmds_process_resp(ptvp, rzd_s, res, true /* noisy */, pp->vb,
+                               &sense_cat);
+    if (-1 == res) {
+        if (get_scsi_pt_transport_err(ptvp))
+            ret = SG_LIB_TRANSPORT_ERROR;
+        else
+            ret = sg_convert_errno(get_scsi_pt_os_err(ptvp));
+        goto fini;
+    } else if ((-2 == res) && (SG_LIB_CAT_RECOVERED != sense_cat) &&
+               (SG_LIB_CAT_NO_SENSE != sense_cat)) {
+        ret = sense_cat;
+        if (SG_LIB_CAT_INVALID_OP == ret)
+            pr2serr("%s command not supported, is this a zone domains "
+                    "device?\n", rzd_s);
+        goto fini;
+    }
+    resid = get_scsi_pt_resid(ptvp);
+    rlen = rlen_max - resid;
+    if (rlen < 64) {
+        pr2serr("%s: response too short (%d bytes)\n", rzd_s, rlen);
+        ret = SG_LIB_CAT_MALFORMED;
+        goto fini;
+    }
+    num = (rlen - 64) / Z_DOM_DESC_LEN;
+    if (num > rp[9])    /* number of zone domains reported */
+        num = rp[9];
+    for (k = 0, bp = rp + 64; k < num; ++k, bp += Z_DOM_DESC_LEN) {
+        pp->zdoms[k].id = bp[0];
+        pp->zdoms[k].num_zones = sg_get_unaligned_be64(bp + 16);
+        pp->zdoms[k].start_lba = sg_get_unaligned_be64(bp + 24);
+        pp->zdoms[k].end_lba = sg_get_unaligned_be64(bp + 32);
+        if (pp->vb > 1)
+            pr2serr("zone domain %u: %" PRIu64 " zones, LBAs 0x%" PRIx64
+                    " to 0x%" PRIx64 "\n", bp[0], pp->zdoms[k].num_zones,
+                    pp->zdoms[k].start_lba, pp->zdoms[k].end_lba);
+    }
+    pp->num_zdoms = num;
+    if (0 == num) {
+        pr2serr("%s: no zone domains reported\n", rzd_s);
+        ret = SG_LIB_CAT_MALFORMED;
+    }
+fini:
+    if (ptvp)
+        destruct_scsi_pt_obj(ptvp);
+    free(free_rp);
+    return ret;
+}
+
+static const struct zdom_t *
+plan_find_zdom(const struct plan_t * pp, uint8_t id)
+{
+    int k;
+
+    for (k = 0; k < pp->num_zdoms; ++k) {
+        if (id == pp->zdoms[k].id)
+            return pp->zdoms + k;
+    }
+    return NULL;
+}
+
+/* Checks each operation: its zones must start on a zone boundary within
+ * one reported domain, the other domain must exist and differ, and no two
+ * operations may cover the same zones. Returns the number of problems. */
+static int
+plan_validate(struct plan_t * pp)
+{
+    int j, k;
+    int num_bad = 0;
+    uint64_t zsz, idx;
+    struct plan_op * pop;
+    const struct plan_op * p2;
+    const struct zdom_t * zdp;
+
+    for (k = 0; k < pp->num_ops; ++k) {
+        pop = pp->ops + k;
+        pop->zdp = NULL;
+        for (j = 0; j < pp->num_zdoms; ++j) {
+            zdp = pp->zdoms + j;
+            if ((pop->zone_id >= zdp->start_lba) &&
+                (pop->zone_id <= zdp->end_lba)) {
+                pop->zdp = zdp;
+                break;
+            }
+        }
+        zdp = pop->zdp;
+        if (NULL == zdp) {
+            pr2serr("plan line %d: zone ID 0x%" PRIx64 " is not in any zone "
+                    "domain\n", pop->lnum, pop->zone_id);
+            ++num_bad;
+            continue;
+        }
+        if (zdp->num_zones > 0) {
+            zsz = (zdp->end_lba - zdp->start_lba + 1) / zdp->num_zones;
+            if ((zsz > 0) && (0 != ((pop->zone_id - zdp->start_lba) % zsz))) {
+                pr2serr("plan line %d: zone ID 0x%" PRIx64 " is not the "
+                        "start of a zone\n", pop->lnum, pop->zone_id);
+                ++num_bad;
+            }
+            idx = (zsz > 0) ? ((pop->zone_id - zdp->start_lba) / zsz) : 0;
+            if ((idx + pop->num_zones) > zdp->num_zones) {
+                pr2serr("plan line %d: %u zones go beyond the end of zone "
+                        "domain %u\n", pop->lnum, pop->num_zones, zdp->id);
+                ++num_bad;
+            }
+            pop->end_lba = pop->zone_id + (pop->num_zones * zsz);
+        } else
+            pop->end_lba = pop->zone_id + 1;
+        if (NULL == plan_find_zdom(pp, pop->other_zdid)) {
+            pr2serr("plan line %d: zone domain %u not reported by the "
+                    "device\n", pop->lnum, pop->other_zdid);
+            ++num_bad;
+        } else if (pop->other_zdid == zdp->id) {
+            pr2serr("plan line %d: zones already in zone domain %u\n",
+                    pop->lnum, zdp->id);
+            ++num_bad;
+        }
+        for (j = 0; j < k; ++j) {
+            p2 = pp->ops + j;
+            if (p2->zdp && (p2->zdp == zdp) &&
+                (pop->zone_id < p2->end_lba) &&
+                (p2->zone_id < pop->end_lba)) {
+                pr2serr("plan line %d: overlaps the zones of line %d\n",
+                        pop->lnum, p2->lnum);
+                ++num_bad;
+                break;
+            }
+        }
+    }
+    return num_bad;
+}
+
+/* sg_mux done() callback, also called directly when there is no mux */
+static void
+plan_done(struct sg_mux_cmd * mcp, void * ctx)
+{
+    int res;
+    int sense_cat = 0;
+    struct plan_slot * sp = (struct plan_slot *)ctx;
+    struct plan_t * pp = sp->pp;
+    struct plan_op * pop = sp->pop;
+
+    sp->busy = false;
+    res = sg_cmds_process_resp(mcp->ptp, pp->sa_name, mcp->res,
+                               pp->vb > 0, pp->vb, &sense_cat);
+    if ((-2 == res) && ((SG_LIB_CAT_RECOVERED == sense_cat) ||
+                        (SG_LIB_CAT_NO_SENSE == sense_cat)))
+        res = 0;
+    if (res >= 0)
+        pop->res = 0;
+    else if (-2 == res)
+        pop->res = sense_cat;
+    else {
+        if (get_scsi_pt_transport_err(mcp->ptp))
+            pop->res = SG_LIB_TRANSPORT_ERROR;
+        else
+            pop->res = sg_convert_errno(get_scsi_pt_os_err(mcp->ptp));
+        if (0 == pop->res)
+            pop->res = SG_LIB_CAT_OTHER;
+    }
+}
+
+/* Returns 0, -EAGAIN or -EBUSY if the device queue is full, else another
+ * value from do_scsi_pt_submit() */
+static int
+plan_submit(struct plan_t * pp, struct plan_slot * sp)
+{
+    int res;
+    struct plan_op * pop = sp->pop;
+    struct sg_pt_base * ptvp = sp->mc.ptp;
+
+    memset(sp->cdb, 0, sizeof(sp->cdb));
+    sp->cdb[0] = SG_ZBC_IN;
+    sp->cdb[1] = pp->do_activate ? Z_ACTIVATE_SA : Z_QUERY_SA;
+    sg_put_unaligned_be64(pop->zone_id, sp->cdb + 2);
+    sg_put_unaligned_be16(pop->num_zones, sp->cdb + 10);
+    sg_put_unaligned_be16(sizeof(pop->resp), sp->cdb + 12);
+    sp->cdb[14] = pop->other_zdid;
+    clear_scsi_pt_obj(ptvp);
+    set_scsi_pt_cdb(ptvp, sp->cdb, sizeof(sp->cdb));
+    set_scsi_pt_sense(ptvp, sp->sense, sizeof(sp->sense));
+    set_scsi_pt_data_in(ptvp, pop->resp, sizeof(pop->resp));
+    if (pp->vb > 1) {
+        char d[128];
+
+        pr2serr("    %s cdb: %s\n", pp->sa_name,
+                sg_get_command_str(sp->cdb, SG_ZBC_IN_CMDLEN, false,
+                                   sizeof(d), d));
+    }
+    sp->busy = true;
+    if (pp->mxp) {
+        res = sg_mux_submit(pp->mxp, &sp->mc);
+        if (res)
+            sp->busy = false;
+        return res;
+    }
+    sp->mc.res = do_scsi_pt(ptvp, pp->sg_fd, DEF_PT_TIMEOUT, pp->vb);
+    plan_done(&sp->mc, sp);
+    return 0;
+}
+
+/* Keeps up to QD operations in flight until all are done. Returns 0 or
+ * an exit status if a command could not be submitted. */
+static int
+plan_issue(struct plan_t * pp)
+{
+    bool full;
+    int k, res;
+    int next_op = 0;
+    int ret = 0;
+    struct plan_slot * sp;
+
+    while (true) {
+        full = false;
+        for (k = 0; (k < pp->qd) && (! full) && (0 == ret) &&
+                    (next_op < pp->num_ops); ++k) {
+            sp = pp->slots + k;
+            if (sp->busy)
+                continue;
+            sp->pop = pp->ops + next_op;
+            res = plan_submit(pp, sp);
+            if (0 == res)
+                ++next_op;
+            else if ((-EAGAIN == res) || (-EBUSY == res))
+                full = true;
+            else {
+                pr2serr("%s: submit failed: %s\n", pp->sa_name,
+                        (res < 0) ? safe_strerror(-res) :
+                                    "pass-through error");
+                ret = (res < 0) ? sg_convert_errno(-res) : SG_LIB_CAT_OTHER;
+            }
+        }
+        if (pp->mxp && (sg_mux_in_flight(pp->mxp) > 0)) {
+            res = sg_mux_run(pp->mxp, 1000);
+            if (res < 0) {
+                pr2serr("waiting for responses: %s\n", safe_strerror(-res));
+                if (0 == ret)
+                    ret = sg_convert_errno(-res);
+                break;
+            }
+        } else if (ret || (next_op >= pp->num_ops))
+            break;
+        else if (full)
+            sg_mpoll_sleep_ms(1);
+    }
+    return ret;
+}
+
+/* One line per operation then a summary. Returns 0 if every operation
+ * succeeded (and, for ZONE ACTIVATE, activated its zones), else the exit
+ * status of the first (in plan order) that did not. */
+static int
+plan_report(const struct plan_t * pp)
+{
+    int k, n_ok, n_unmet, n_fail, n_skip;
+    int ret = 0;
+    const struct plan_op * pop;
+    const uint8_t * rp;
+    char b[128];
+    char e[80];
+
+    n_ok = n_unmet = n_fail = n_skip = 0;
+    printf("%s plan: %d operations\n", pp->sa_name, pp->num_ops);
+    printf("  line  zone ID             zones  domain  outcome\n");
+    for (k = 0; k < pp->num_ops; ++k) {
+        pop = pp->ops + k;
+        rp = pop->resp;
+        if (pop->res < 0) {
+            ++n_skip;
+            snprintf(b, sizeof(b), "not sent");
+        } else if (pop->res > 0) {
+            ++n_fail;
+            sg_get_category_sense_str(pop->res, sizeof(e), e, pp->vb);
+            snprintf(b, sizeof(b), "failed: %s", e);
+            if (0 == ret)
+                ret = pop->res;
+        } else if (rp[9]) {
+            ++n_unmet;
+            if (0x40 & rp[8])
+                snprintf(b, sizeof(b), "unmet: %s, zone ID 0x%" PRIx64,
+                         unmet_prereq_str(rp[9], e, sizeof(e)),
+                         sg_get_unaligned_be64(rp + 24));
+            else
+                snprintf(b, sizeof(b), "unmet: %s",
+                         unmet_prereq_str(rp[9], e, sizeof(e)));
+            if (pp->do_activate && (0 == ret))
+                ret = SG_LIB_CAT_OTHER;
+        } else if (pp->do_activate && (0 == (0x1 & rp[8]))) {
+            ++n_unmet;
+            snprintf(b, sizeof(b), "not activated");
+            if (0 == ret)
+                ret = SG_LIB_CAT_OTHER;
+        } else {
+            ++n_ok;
+            snprintf(b, sizeof(b), "%s", pp->do_activate ? "activated" :
+                                                           "ok");
+        }
+        printf("  %4d  0x%-16" PRIx64 "  %5u  %6u  %s\n", pop->lnum,
+               pop->zone_id, pop->num_zones, pop->other_zdid, b);
+    }
+    printf("Summary: %d %s, %d with unmet prerequisites, %d failed, %d not "
+           "sent\n", n_ok, pp->do_activate ? "activated" : "ok", n_unmet,
+           n_fail, n_skip);
+    return ret;
+}
+
+static int
+plan_run(int sg_fd, const struct opts_t * op, const char * sa_name)
+{
+    int k, n, res;
+    int ret = 0;
+    struct plan_t * pp;
+
+    pp = (struct plan_t *)calloc(1, sizeof(*pp));
+    if (pp)
+        pp->ops = (struct plan_op *)calloc(MAX_PLAN_OPS, sizeof(*pp->ops));
+    if ((NULL == pp) || (NULL == pp->ops)) {
+        pr2serr("%s: out of memory\n", __func__);
+        free(pp);
+        return sg_convert_errno(ENOMEM);
+    }
+    pp->sg_fd = sg_fd;
+    pp->do_activate = op->do_activate;
+    pp->qd = op->plan_qd;
+    pp->vb = op->vb;
+    pp->sa_name = sa_name;
+    ret = plan_read(op->plan_fn, pp);
+    if (ret)
+        goto fini;
+    ret = plan_get_zdomains(pp);
+    if (ret)
+        goto fini;
+    n = plan_validate(pp);
+    if (n > 0) {
+        if (! op->do_force) {
+            pr2serr("%d problem%s found in plan, nothing sent; use --force "
+                    "to send anyway\n", n, ((1 == n) ? "" : "s"));
+            ret = SG_LIB_CONTRADICT;
+            goto fini;
+        }
+        pr2serr("%d problem%s found in plan, continuing due to --force\n",
+                n, ((1 == n) ? "" : "s"));
+    }
+    if (pp->qd > pp->num_ops)
+        pp->qd = pp->num_ops;
+    pp->mxp = sg_mux_new(pp->vb);
+    if (pp->mxp && sg_mux_add_fd(pp->mxp, sg_fd)) {
+        sg_mux_free(pp->mxp);
+        pp->mxp = NULL;
+    }
+    if ((NULL == pp->mxp) && (pp->qd > 1)) {
+        if (pp->vb)
+            pr2serr("no asynchronous interface, QD reduced to 1\n");
+        pp->qd = 1;
+    }
+    pp->slots = (struct plan_slot *)calloc(pp->qd, sizeof(*pp->slots));
+    if (NULL == pp->slots) {
+        ret = sg_convert_errno(ENOMEM);
+        goto fini;
+    }
+    for (k = 0; k < pp->qd; ++k) {
+        struct plan_slot * sp = pp->slots + k;
+
+        sp->pp = pp;
+        sp->mc.fd = sg_fd;
+        sp->mc.timeout_secs = DEF_PT_TIMEOUT;
+        sp->mc.ctx = sp;
+        sp->mc.done = plan_done;
+        sp->mc.ptp = construct_scsi_pt_obj_with_fd(sg_fd, pp->vb);
+        if (NULL == sp->mc.ptp) {
+            ret = sg_convert_errno(ENOMEM);
+            goto fini;
+        }
+    }
+    ret = plan_issue(pp);
+    res = plan_report(pp);
+    if (0 == ret)
+        ret = res;
+fini:
+    sg_mux_free(pp->mxp);
+    if (pp->slots) {
+        for (k = 0; k < pp->qd; ++k) {
+            if (pp->slots[k].mc.ptp)
+                destruct_scsi_pt_obj(pp->slots[k].mc.ptp);
+        }
+        free(pp->slots);
+    }
+    free(pp->ops);
+    free(pp);
+    return ret;
+}
+
 static void
 dStrRaw(const uint8_t * str, int len)
 {
@@ -374,7 +980,7 @@ main(int argc, char * argv[])
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "aAfhHi:m:n:o:qrvVz:", long_options,
+        c = getopt_long(argc, argv, "aAfhHi:m:n:o:p:qQ:rvVz:", long_options,
                         &option_index);
         if (c == -1)
             break;
@@ -427,9 +1033,21 @@ main(int argc, char * argv[])
             }
             op->other_zdid = (uint8_t)n;
             break;
+        case 'p':
+            op->plan_fn = optarg;
+            break;
         case 'q':
             op->do_query = true;
             break;
+        case 'Q':
+            n = sg_get_num(optarg);
+            if ((n < 1) || (n > MAX_PLAN_QD)) {
+                pr2serr("--qd=QD expects an argument between 1 and %d\n",
+                        MAX_PLAN_QD);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            op->plan_qd = n;
+            break;
         case 'r':
             op->do_raw = true;
             break;
@@ -485,6 +1103,20 @@ main(int argc, char * argv[])
         return SG_LIB_CONTRADICT;
     }
     sa_name = op->do_activate ? "Zone activate" : "Zone query";
+    if (op->plan_fn) {
+        if (op->inhex_fn || op->do_all || op->do_raw || op->hex_count) {
+            pr2serr("--plan= can't be used with --all, --hex, --inhex= or "
+                    "--raw\n");
+            return SG_LIB_CONTRADICT;
+        }
+        if (NULL == op->device_name) {
+            pr2serr("--plan= needs a DEVICE\n\n");
+            usage();
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        if (0 == op->plan_qd)
+            op->plan_qd = DEF_PLAN_QD;
+    }
     if (op->device_name && op->inhex_fn) {
         pr2serr("ignoring DEVICE, best to give DEVICE or --inhex=FN, but "
                 "not both\n");
@@ -552,6 +1184,11 @@ main(int argc, char * argv[])
         ret = sg_convert_errno(err);
         goto the_end;
     }
+    if (op->plan_fn) {
+        ret = plan_run(sg_fd, op, sa_name);
+        no_final_msg = true;    /* plan_run() reported the outcome */
+        goto the_end;
+    }
 
     res = sg_ll_zone_act_query(sg_fd, op, ziBuff, &resid);
     ret = res;
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2014-2023 Douglas Gilbert.
+ * Copyright (c) 2014-2026 Douglas Gilbert.
  * All rights reserved.
  * Use of this source code is governed by a BSD-style
  * license that can be found in the BSD_LICENSE file.
@@ -28,8 +28,11 @@
 #include "sg_pt.h"
 #include "sg_cmds_basic.h"
 #include "sg_unaligned.h"
+#include "sg_par.h"
 #include "sg_pr2serr.h"
 
+#include "sg_zone_common.h"
+
 /* A utility program originally written for the Linux OS SCSI subsystem.
  *
  * This program issues one of the following SCSI commands:
@@ -38,9 +41,12 @@
  *   - OPEN ZONE
  *   - REMOVE ELEMENT AND MODIFY ZONES
  *   - SEQUENTIALIZE ZONE
+ *
+ * Apart from REMOVE ELEMENT AND MODIFY ZONES, those commands can be applied
+ * to a list of zones with several commands in flight.
  */
 
-static const char * version_str = "1.20 20230519";
+static const char * version_str = "1.22 20261015";
 
 #define SG_ZONING_OUT_CMDLEN 16
 #define CLOSE_ZONE_SA 0x1
@@ -58,9 +64,12 @@ static struct option long_options[] = {
         {"close", no_argument, 0, 'c'},
         {"count", required_argument, 0, 'C'},
         {"element", required_argument, 0, 'e'},
+        {"filter", required_argument, 0, 'F'},
         {"finish", no_argument, 0, 'f'},
         {"help", no_argument, 0, 'h'},
+        {"list", required_argument, 0, 'l'},
         {"open", no_argument, 0, 'o'},
+        {"parallel", required_argument, 0, 'p'},
         {"quick", no_argument, 0, 'q'},
         {"remove", no_argument, 0, 'r'},
         {"reset-all", no_argument, 0, 'R'},     /* same as --all */
@@ -99,12 +108,12 @@ usage()
 {
     pr2serr("Usage: "
             "sg_zone  [--all] [--close] [--count=ZC] [--element=EID] "
-            "[--finish]\n"
-            "                [--help] [--open] [--quick] [--remove] "
-            "[--sequentialize]\n"
-            "                [--timeout=SE] [--verbose] [--version] "
-            "[--zone=ID]\n"
-            "                DEVICE\n");
+            "[--filter=CN]\n"
+            "                [--finish] [--help] [--list=FN] [--open] "
+            "[--parallel=Q]\n"
+            "                [--quick] [--remove] [--sequentialize] "
+            "[--timeout=SE]\n"
+            "                [--verbose] [--version] [--zone=ID] DEVICE\n");
     pr2serr("  where:\n"
             "    --all|-a           sets the ALL flag in the cdb\n"
             "    --close|-c         issue CLOSE ZONE command\n"
@@ -113,9 +122,19 @@ usage()
             "remove;\n"
             "                            default is 0 which is an invalid "
             "EID\n"
+            "    --filter=CN|-F CN    act on zones whose condition is CN "
+            "(e.g. 'closed')\n"
+            "                         as found by REPORT ZONES; '-F xxx' "
+            "lists names\n"
             "    --finish|-f        issue FINISH ZONE command\n"
             "    --help|-h          print out usage message\n"
+            "    --list=FN|-l FN    act on zones whose IDs are in file FN "
+            "('-' for\n"
+            "                       stdin); adjacent zones share a command\n"
             "    --open|-o          issue OPEN ZONE command\n"
+            "    --parallel=Q|-p Q    with --list or --filter, up to Q "
+            "commands in\n"
+            "                         flight (def: %d, max: %d)\n"
             "    --quick|-q         bypass 15 second warn and wait "
             "(for --remove)\n"
             "    --remove|-r        issue REMOVE ELEMENT AND MODIFY ZONES "
@@ -130,7 +149,8 @@ usage()
             "Performs a SCSI OPEN ZONE, CLOSE ZONE, FINISH ZONE, "
             "REMOVE ELEMENT AND\nMODIFY ZONES or SEQUENTIALIZE ZONE "
             "command. Either --close, --finish,\n--open, --remove or "
-            "--sequentialize option needs to be given.\n");
+            "--sequentialize option needs to be given.\n",
+            ZL_DEF_PARALLEL, ZL_MAX_PARALLEL);
 }
 
 /* Invokes the zone out command indicated by 'sa' (ZBC).  Return of 0
@@ -196,6 +216,22 @@ sg_ll_zone_out(int sg_fd, int sa, uint64_t zid, uint16_t zc, bool all,
     return ret;
 }
 
+struct zo_ctx_t {
+    int sa;
+    int tmo;
+    int verbose;
+};
+
+/* zl_cmd_f callback */
+static int
+zo_zl_cmd(int sg_fd, uint64_t zid, uint16_t zc, void * ctx)
+{
+    const struct zo_ctx_t * zcp = (const struct zo_ctx_t *)ctx;
+
+    return sg_ll_zone_out(sg_fd, zcp->sa, zid, zc, false, zcp->tmo, true,
+                          zcp->verbose);
+}
+
 
 int
 main(int argc, char * argv[])
@@ -210,22 +246,31 @@ main(int argc, char * argv[])
     bool sequentialize = false;
     bool verbose_given = false;
     bool version_given = false;
+    bool zid_given = false;
+    bool zc_given = false;
     int res, c, n;
     int sg_fd = -1;
     int tmo = DEF_PT_TIMEOUT;
     int verbose = 0;
     int ret = 0;
     int sa = 0;
+    int filter_ro = 0;
+    int num_q = ZL_DEF_PARALLEL;
     uint16_t zc = 0;
     uint64_t zid = 0;
     int64_t ll;
     const char * device_name = NULL;
+    const char * list_fn = NULL;
     const char * sa_name;
+    struct zl_list_t zl_list;
+    struct zo_ctx_t zo_ctx;
+
+    memset(&zl_list, 0, sizeof(zl_list));
 
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "acC:e:fhoqrRSt:vVz:", long_options,
+        c = getopt_long(argc, argv, "acC:e:fF:hl:op:qrRSt:vVz:", long_options,
                         &option_index);
         if (c == -1)
             break;
@@ -247,6 +292,7 @@ main(int argc, char * argv[])
                 return SG_LIB_SYNTAX_ERROR;
             }
             zc = (uint16_t)n;
+            zc_given = true;
             break;
         case 'e':
             ll = sg_get_llnum(optarg);
@@ -263,14 +309,30 @@ main(int argc, char * argv[])
             finish = true;
             sa = FINISH_ZONE_SA;
             break;
+        case 'F':
+            filter_ro = zl_cond2ro(optarg);
+            if (filter_ro < 0) {
+                pr2serr("bad argument to '--filter=CN'\n");
+                zl_cond_usage();
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
         case 'h':
         case '?':
             usage();
             return 0;
+        case 'l':
+            list_fn = optarg;
+            break;
         case 'o':
             open = true;
             sa = OPEN_ZONE_SA;
             break;
+        case 'p':
+            num_q = sg_par_get_num(optarg, 1, ZL_MAX_PARALLEL);
+            if (num_q < 0)
+                return SG_LIB_SYNTAX_ERROR;
+            break;
         case 'q':
             quick = true;
             break;
@@ -303,6 +365,7 @@ main(int argc, char * argv[])
                 return SG_LIB_SYNTAX_ERROR;
             }
             zid = (uint64_t)ll;
+            zid_given = true;
             break;
         default:
             pr2serr("unrecognised option code 0x%x ??\n", c);
@@ -359,6 +422,23 @@ main(int argc, char * argv[])
         usage();
         return SG_LIB_CONTRADICT;
     }
+    if (list_fn || filter_ro) {
+        if (list_fn && filter_ro) {
+            pr2serr("--list=FN and --filter=CN options are mutually "
+                    "exclusive\n");
+            return SG_LIB_CONTRADICT;
+        }
+        if (reamz) {
+            pr2serr("--list=FN and --filter=CN options cannot be used with "
+                    "--remove\n");
+            return SG_LIB_CONTRADICT;
+        }
+        if (zid_given || all || zc_given) {
+            pr2serr("--list=FN and --filter=CN options contradict --zone=ID, "
+                    "--all and --count=ZC\n");
+            return SG_LIB_CONTRADICT;
+        }
+    }
     sa_name = sa_name_arr[sa];
 
     if (0 == tmo)
@@ -382,6 +462,27 @@ main(int argc, char * argv[])
         sg_warn_and_wait(sa_name_arr[REM_ELEM_MOD_ZONES_SA], device_name,
                          false);
 
+    if (list_fn || filter_ro) {
+        if (list_fn)
+            ret = zl_read_file(list_fn, &zl_list);
+        else
+            ret = zl_from_report(sg_fd, filter_ro, &zl_list, verbose);
+        if (0 == ret)
+            ret = zl_coalesce(sg_fd, &zl_list, verbose);
+        if (ret)
+            goto fini;
+        if (0 == zl_list.num_zones) {
+            if (verbose)
+                pr2serr("no zones to act on\n");
+            goto fini;
+        }
+        zo_ctx.sa = sa;
+        zo_ctx.tmo = tmo;
+        zo_ctx.verbose = verbose;
+        ret = zl_run_all(sg_fd, &zl_list, num_q, zo_zl_cmd, &zo_ctx,
+                         sa_name, verbose);
+        goto fini;
+    }
     res = sg_ll_zone_out(sg_fd, sa, zid, zc, all, tmo, true, verbose);
     ret = res;
     if (res) {
@@ -396,6 +497,7 @@ main(int argc, char * argv[])
     }
 
 fini:
+    zl_free(&zl_list);
     if (sg_fd >= 0) {
         res = sg_cmds_close_device(sg_fd);
         if (res < 0) {
@@ -0,0 +1,378 @@
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "sg_lib.h"
+#include "sg_cmds_extra.h"
+#include "sg_unaligned.h"
+#include "sg_par.h"
+#include "sg_pr2serr.h"
+
+#include "sg_zone_common.h"
+
+/* This file holds the zone list handling shared by the sg_reset_wp and
+ * sg_zone utilities. */
+
+#define ZL_RESP_LEN (64 * 1024)
+#define ZL_DESC_LEN 64          /* also the REPORT ZONES header length */
+#define ZL_LINE_LEN 1024
+
+struct zl_cond_name_t {
+    int ro;                     /* reporting option */
+    const char * name;
+    const char * desc;
+};
+
+static const struct zl_cond_name_t zl_cond_names[] = {
+    {0x1, "empty", "empty"},
+    {0x2, "iopen", "implicitly opened"},
+    {0x3, "eopen", "explicitly opened"},
+    {0x4, "closed", "closed"},
+    {0x5, "full", "full"},
+    {0x6, "ro", "read only"},
+    {0x7, "offline", "offline"},
+    {0x8, "inactive", "inactive"},
+    {0x10, "rwp", "reset write pointer recommended"},
+    {0x3f, "nwp", "not write pointer"},
+    {0, NULL, NULL},
+};
+
+int
+zl_cond2ro(const char * cp)
+{
+    int n;
+    const struct zl_cond_name_t * cnp;
+
+    for (cnp = zl_cond_names; cnp->name; ++cnp) {
+        if (0 == strcmp(cp, cnp->name))
+            return cnp->ro;
+    }
+    n = sg_get_num_nomult(cp);
+    return ((n > 0) && (n < 0x40)) ? n : -1;
+}
+
+void
+zl_cond_usage(void)
+{
+    const struct zl_cond_name_t * cnp;
+
+    pr2serr("Zone condition names (or reporting option numbers):\n");
+    for (cnp = zl_cond_names; cnp->name; ++cnp)
+        pr2serr("    %-10s 0x%-4x %s\n", cnp->name, cnp->ro, cnp->desc);
+}
+
+static int
+zl_add(struct zl_list_t * zlp, uint64_t zid, uint64_t len)
+{
+    if (zlp->num_zones >= zlp->max_zones) {
+        int n = zlp->max_zones ? (2 * zlp->max_zones) : 256;
+        struct zl_zone_t * zp;
+
+        zp = (struct zl_zone_t *)realloc(zlp->zones, n * sizeof(*zp));
+        if (NULL == zp) {
+            pr2serr("%s: out of memory\n", __func__);
+            return sg_convert_errno(ENOMEM);
+        }
+        zlp->zones = zp;
+        zlp->max_zones = n;
+    }
+    zlp->zones[zlp->num_zones].zid = zid;
+    zlp->zones[zlp->num_zones].len = len;
+    ++zlp->num_zones;
+    return 0;
+}
+
+int
+zl_read_file(const char * fn, struct zl_list_t * zlp)
+{
+    bool is_stdin = (0 == strcmp(fn, "-"));
+    int res = 0;
+    int line_num = 0;
+    int64_t ll;
+    FILE * fp;
+    char * cp;
+    char line[ZL_LINE_LEN];
+
+    fp = is_stdin ? stdin : fopen(fn, "r");
+    if (NULL == fp) {
+        int e = errno;
+
+        pr2serr("unable to open %s: %s\n", fn, safe_strerror(e));
+        return sg_convert_errno(e);
+    }
+    while (fgets(line, sizeof(line), fp)) {
+        ++line_num;
+        cp = strchr(line, '#');
+        if (cp)
+            *cp = '\0';
+        for (cp = strtok(line, " \t,\r\n"); cp; cp = strtok(NULL, " \t,\r\n")) {
+            ll = sg_get_llnum(cp);
+            if (ll < 0) {
+                pr2serr("%s, line %d: bad zone ID: %s\n", fn, line_num, cp);
+                res = SG_LIB_SYNTAX_ERROR;
+                goto fini;
+            }
+            res = zl_add(zlp, (uint64_t)ll, 0);
+            if (res)
+                goto fini;
+        }
+    }
+fini:
+    if (! is_stdin)
+        fclose(fp);
+    return res;
+}
+
+int
+zl_from_report(int sg_fd, int report_opts, struct zl_list_t * zlp,
+               int verbose)
+{
+    int k, n, res, resid;
+    uint64_t lba = 0;
+    uint64_t mx_lba, zs_lba, zn_len;
+    uint8_t * buf;
+    uint8_t * free_buf;
+    const uint8_t * bp;
+    char b[80];
+
+    buf = sg_memalign(ZL_RESP_LEN, 0, &free_buf, false);
+    if (NULL == buf) {
+        pr2serr("%s: out of memory\n", __func__);
+        return sg_convert_errno(ENOMEM);
+    }
+    while (true) {
+        res = sg_ll_report_zones(sg_fd, lba, true, report_opts, buf,
+                                 ZL_RESP_LEN, &resid, true, verbose);
+        if (res) {
+            sg_get_category_sense_str(res, sizeof(b), b, verbose);
+            pr2serr("Report zones command: %s\n", b);
+            break;
+        }
+        n = (ZL_RESP_LEN - resid - ZL_DESC_LEN) / ZL_DESC_LEN;
+        if (n < 1)
+            break;
+        mx_lba = sg_get_unaligned_be64(buf + 8);
+        for (k = 0, bp = buf + ZL_DESC_LEN; k < n; ++k, bp += ZL_DESC_LEN) {
+            zn_len = sg_get_unaligned_be64(bp + 8);
+            zs_lba = sg_get_unaligned_be64(bp + 16);
+            res = zl_add(zlp, zs_lba, zn_len);
+            if (res)
+                goto fini;
+            lba = zs_lba + zn_len;
+        }
+        if ((n < (ZL_RESP_LEN - ZL_DESC_LEN) / ZL_DESC_LEN) ||
+            (lba > mx_lba) || (0 == zn_len))
+            break;
+    }
+    if (verbose)
+        pr2serr("%d zones selected by reporting option 0x%x\n",
+                zlp->num_zones, report_opts);
+fini:
+    free(free_buf);
+    return res;
+}
+
+static int
+zl_cmp(const void * a, const void * b)
+{
+    uint64_t x = ((const struct zl_zone_t *)a)->zid;
+    uint64_t y = ((const struct zl_zone_t *)b)->zid;
+
+    return (x < y) ? -1 : ((x > y) ? 1 : 0);
+}
+
+/* Finds the length of each zone in zlp (sorted) whose length is not known
+ * with REPORT ZONES commands, each starting at the first such zone */
+static int
+zl_find_lens(int sg_fd, struct zl_list_t * zlp, int verbose)
+{
+    int j, n, res, resid, start_k;
+    int k = 0;
+    int num = zlp->num_zones;
+    uint64_t zs_lba;
+    uint8_t * buf;
+    uint8_t * free_buf;
+    const uint8_t * bp;
+    struct zl_zone_t * zp = zlp->zones;
+    char b[80];
+
+    buf = sg_memalign(ZL_RESP_LEN, 0, &free_buf, false);
+    if (NULL == buf) {
+        pr2serr("%s: out of memory\n", __func__);
+        return sg_convert_errno(ENOMEM);
+    }
+    res = 0;
+    while (true) {
+        for ( ; (k < num) && (zp[k].len > 0); ++k)
+            ;
+        if (k >= num)
+            break;
+        start_k = k;
+        res = sg_ll_report_zones(sg_fd, zp[k].zid, true, 0, buf,
+                                 ZL_RESP_LEN, &resid, true, verbose);
+        if (res) {
+            sg_get_category_sense_str(res, sizeof(b), b, verbose);
+            pr2serr("Report zones command from LBA 0x%" PRIx64 ": %s\n",
+                    zp[k].zid, b);
+            break;
+        }
+        n = (ZL_RESP_LEN - resid - ZL_DESC_LEN) / ZL_DESC_LEN;
+        for (j = 0, bp = buf + ZL_DESC_LEN; (j < n) && (k < num);
+             ++j, bp += ZL_DESC_LEN) {
+            zs_lba = sg_get_unaligned_be64(bp + 16);
+            for ( ; (k < num) && (zp[k].zid <= zs_lba); ++k) {
+                if (zp[k].zid == zs_lba) {
+                    zp[k].len = sg_get_unaligned_be64(bp + 8);
+                    continue;
+                }
+                if (0 == zp[k].len)
+                    break;
+            }
+            if ((k < num) && (0 == zp[k].len) && (zp[k].zid < zs_lba))
+                break;
+        }
+        if ((k < num) && (0 == zp[k].len) &&
+            ((k == start_k) || (j < n))) {
+            pr2serr("zone ID 0x%" PRIx64 " is not the starting LBA of a "
+                    "zone\n", zp[k].zid);
+            res = SG_LIB_LBA_OUT_OF_RANGE;
+            break;
+        }
+    }
+    free(free_buf);
+    return res;
+}
+
+int
+zl_coalesce(int sg_fd, struct zl_list_t * zlp, int verbose)
+{
+    int k, j, res;
+    struct zl_zone_t * zp = zlp->zones;
+    struct zl_run_t * rp;
+
+    if (zlp->num_zones < 1)
+        return 0;
+    qsort(zp, zlp->num_zones, sizeof(*zp), zl_cmp);
+    for (k = 0, j = 1; j < zlp->num_zones; ++j) {
+        if (zp[j].zid == zp[k].zid) {
+            if (0 == zp[k].len)
+                zp[k].len = zp[j].len;
+        } else
+            zp[++k] = zp[j];
+    }
+    zlp->num_zones = k + 1;
+    res = zl_find_lens(sg_fd, zlp, verbose);
+    if (res)
+        return res;
+    zlp->runs = (struct zl_run_t *)calloc(zlp->num_zones, sizeof(*rp));
+    if (NULL == zlp->runs) {
+        pr2serr("%s: out of memory\n", __func__);
+        return sg_convert_errno(ENOMEM);
+    }
+    rp = zlp->runs;
+    rp->zid = zp[0].zid;
+    rp->count = 1;
+    for (k = 1; k < zlp->num_zones; ++k) {
+        if ((zp[k].zid == zp[k - 1].zid + zp[k - 1].len) &&
+            (rp->count < ZL_MAX_RUN_COUNT))
+            ++rp->count;
+        else {
+            ++rp;
+            rp->zid = zp[k].zid;
+            rp->count = 1;
+        }
+    }
+    zlp->num_runs = (int)(rp - zlp->runs) + 1;
+    if (verbose)
+        pr2serr("%d zones coalesced into %d runs of adjacent zones\n",
+                zlp->num_zones, zlp->num_runs);
+    return 0;
+}
+
+struct zl_work_t {
+    int sg_fd;
+    int verbose;
+    struct zl_list_t * zlp;
+    zl_cmd_f cmd_fn;
+    void * ctx;
+    const char * cmd_name;
+};
+
+/* Issues the command for run k */
+static int
+zl_run_one(int64_t k, void * ctx)
+{
+    struct zl_work_t * wp = (struct zl_work_t *)ctx;
+    struct zl_run_t * rp = wp->zlp->runs + k;
+    char b[80];
+
+    /* a ZONE COUNT of 0 also acts on one zone, as without a list */
+    rp->res = wp->cmd_fn(wp->sg_fd, rp->zid,
+                         (uint16_t)((rp->count > 1) ? rp->count : 0),
+                         wp->ctx);
+    if (rp->res) {
+        sg_get_category_sense_str(rp->res, sizeof(b), b, wp->verbose);
+        pr2serr("%s command, zone ID 0x%" PRIx64 " (%u zone%s): %s\n",
+                wp->cmd_name, rp->zid, rp->count,
+                (rp->count > 1) ? "s" : "", b);
+    }
+    return 0;
+}
+
+int
+zl_run_all(int sg_fd, struct zl_list_t * zlp, int num_q, zl_cmd_f cmd_fn,
+           void * ctx, const char * cmd_name, int verbose)
+{
+    int k;
+    int num_bad = 0;
+    int ret = 0;
+    struct zl_work_t work;
+
+    memset(&work, 0, sizeof(work));
+    work.sg_fd = sg_fd;
+    work.verbose = verbose;
+    work.zlp = zlp;
+    work.cmd_fn = cmd_fn;
+    work.ctx = ctx;
+    work.cmd_name = cmd_name;
+    if (verbose > 1)
+        pr2serr("%s: %d runs, up to %d at once\n", __func__, zlp->num_runs,
+                num_q);
+    sg_par_each(zlp->num_runs, num_q, zl_run_one, &work);
+    for (k = 0; k < zlp->num_runs; ++k) {
+        if (zlp->runs[k].res) {
+            ++num_bad;
+            if (0 == ret)
+                ret = zlp->runs[k].res;
+        }
+    }
+    if (verbose || num_bad)
+        pr2serr("%s: %d zones in %d commands, %d failed\n", cmd_name,
+                zlp->num_zones, zlp->num_runs, num_bad);
+    return ret;
+}
+
+void
+zl_free(struct zl_list_t * zlp)
+{
+    free(zlp->zones);
+    free(zlp->runs);
+    memset(zlp, 0, sizeof(*zlp));
+}
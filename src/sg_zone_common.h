@@ -0,0 +1,92 @@
+#ifndef SG_ZONE_COMMON_H
+#define SG_ZONE_COMMON_H
+
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/* This is a common header file for the sg_reset_wp and sg_zone utilities.
+ * It handles a list of zones, given in a file or selected by zone condition
+ * with REPORT ZONES, that is coalesced into runs of adjacent zones so each
+ * run can be the subject of one zone out command (using its ZONE COUNT
+ * field). The commands are then issued with a bounded number in flight. */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ZL_MAX_PARALLEL 64
+#define ZL_DEF_PARALLEL 4
+#define ZL_MAX_RUN_COUNT 0xffff /* ZONE COUNT field is 16 bits */
+
+struct zl_zone_t {
+    uint64_t zid;       /* zone start LBA */
+    uint64_t len;       /* zone length in logical blocks, 0 -> not known */
+};
+
+struct zl_run_t {
+    uint64_t zid;       /* start LBA of the first zone in the run */
+    uint32_t count;     /* number of adjacent zones, 1 to 0xffff */
+    int res;            /* result of the command sent for this run */
+};
+
+struct zl_list_t {
+    int num_zones;
+    int max_zones;
+    int num_runs;
+    struct zl_zone_t * zones;
+    struct zl_run_t * runs;
+};
+
+/* Issues one zone out command for zone zid with ZONE COUNT zc. Returns 0
+ * on success else a SG_LIB_CAT_* value or -1 */
+typedef int (*zl_cmd_f)(int sg_fd, uint64_t zid, uint16_t zc, void * ctx);
+
+/* Returns the reporting option (for REPORT ZONES) that selects the zone
+ * condition named (or numbered) by cp, or -1 if it is not recognized */
+int zl_cond2ro(const char * cp);
+
+/* Lists the zone condition names that zl_cond2ro() accepts on stderr */
+void zl_cond_usage(void);
+
+/* Adds the zone start LBAs in the file named fn ("-" for stdin) to zlp.
+ * They are separated by whitespace or commas; a '#' starts a comment that
+ * continues to the end of a line. Returns 0 on success */
+int zl_read_file(const char * fn, struct zl_list_t * zlp);
+
+/* Adds the zones that REPORT ZONES, with report_opts in its REPORTING
+ * OPTIONS field, returns to zlp. Returns 0 on success */
+int zl_from_report(int sg_fd, int report_opts, struct zl_list_t * zlp,
+                   int verbose);
+
+/* Sorts the zones in zlp removing duplicates, finds the length of any zone
+ * where that is not known (checking each is a zone start LBA), then
+ * coalesces adjacent zones into runs. Returns 0 on success */
+int zl_coalesce(int sg_fd, struct zl_list_t * zlp, int verbose);
+
+/* Calls cmd_fn for each run in zlp with up to num_q in flight. Errors are
+ * reported (using cmd_name) as they occur and do not stop other runs.
+ * Returns 0 if all succeeded else the result of the first run that
+ * failed */
+int zl_run_all(int sg_fd, struct zl_list_t * zlp, int num_q, zl_cmd_f cmd_fn,
+               void * ctx, const char * cmd_name, int verbose);
+
+void zl_free(struct zl_list_t * zlp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* SG_ZONE_COMMON_H */
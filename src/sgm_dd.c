@@ -49,6 +49,7 @@
 #include <limits.h>
 #define __STDC_FORMAT_MACROS 1
 #include <inttypes.h>
+#include <poll.h>
 #include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <sys/time.h>
@@ -68,9 +69,10 @@
 #include "sg_io_linux.h"
 #include "sg_unaligned.h"
 #include "sg_pr2serr.h"
+#include "sg_dd_eng.h"
 
 
-static const char * version_str = "1.24 20230519";
+static const char * version_str = "1.29 20261015";
 
 static const char * my_name = "sgm_dd: ";
 
@@ -81,6 +83,11 @@ static const char * my_name = "sgm_dd: ";
 #define MAX_SCSI_CDBSZ 16
 #define MAX_BPT_VALUE (1 << 24)         /* used for maximum bs as well */
 #define MAX_COUNT_SKIP_SEEK (1LL << 48) /* coverity wants upper bound */
+#define MAX_QUEUE_DEPTH 16      /* qd=QD, each has its own sg fd */
+
+#define STR_SZ 1024
+#define INOUTF_SZ 512
+#define EBUFF_SZ 768
 
 
 
@@ -94,21 +101,13 @@ static const char * my_name = "sgm_dd: ";
 
 #define DEF_TIMEOUT 60000       /* 60,000 millisecs == 60 seconds */
 
-#ifndef RAW_MAJOR
-#define RAW_MAJOR 255   /*unlikely value */
-#endif
-
-#define FT_OTHER 1              /* filetype other than one of following */
-#define FT_SG 2                 /* filetype is sg char device */
-#define FT_RAW 4                /* filetype is raw char device */
-#define FT_DEV_NULL 8           /* either "/dev/null" or "." as filename */
-#define FT_ST 16                /* filetype is st char device (tape) */
-#define FT_BLOCK 32             /* filetype is a block device */
-#define FT_ERROR 64             /* couldn't "stat" file */
-
-#define DEV_NULL_MINOR_NUM 3
-
-#define MIN_RESERVED_SIZE 8192
+#define FT_OTHER SG_DDE_FT_OTHER  /* filetype other than one of following */
+#define FT_SG SG_DDE_FT_SG        /* filetype is sg char device */
+#define FT_RAW SG_DDE_FT_RAW      /* filetype is raw char device */
+#define FT_DEV_NULL SG_DDE_FT_DEV_NULL  /* "/dev/null" or "." as filename */
+#define FT_ST SG_DDE_FT_ST        /* filetype is st char device (tape) */
+#define FT_BLOCK SG_DDE_FT_BLOCK  /* filetype is a block device */
+#define FT_ERROR SG_DDE_FT_ERROR  /* couldn't "stat" file */
 
 static int sum_of_resids = 0;
 
@@ -128,8 +127,6 @@ static struct timeval start_tm;
 static int blk_sz = 0;
 static uint32_t glob_pack_id = 0;       /* pre-increment */
 
-static const char * sg_allow_dio = "/sys/module/sg/parameters/allow_dio";
-
 struct flags_t {
     bool append;
     bool dio;
@@ -138,6 +135,7 @@ struct flags_t {
     bool dsync;
     bool excl;
     bool fua;
+    bool hugepage;
 };
 
 
@@ -310,53 +308,6 @@ siginfo_handler(int sig)
         calc_duration_throughput(true);
 }
 
-static int
-dd_filetype(const char * filename)
-{
-    size_t len = strlen(filename);
-    struct stat st;
-
-    if ((1 == len) && ('.' == filename[0]))
-        return FT_DEV_NULL;
-    if (stat(filename, &st) < 0)
-        return FT_ERROR;
-    if (S_ISCHR(st.st_mode)) {
-        if ((MEM_MAJOR == major(st.st_rdev)) &&
-            (DEV_NULL_MINOR_NUM == minor(st.st_rdev)))
-            return FT_DEV_NULL;
-        if (RAW_MAJOR == major(st.st_rdev))
-            return FT_RAW;
-        if (SCSI_GENERIC_MAJOR == major(st.st_rdev))
-            return FT_SG;
-        if (SCSI_TAPE_MAJOR == major(st.st_rdev))
-            return FT_ST;
-    } else if (S_ISBLK(st.st_mode))
-        return FT_BLOCK;
-    return FT_OTHER;
-}
-
-static char *
-dd_filetype_str(int ft, char * buff, int bufflen)
-{
-    int off = 0;
-
-    if (FT_DEV_NULL & ft)
-        off += sg_scn3pr(buff, bufflen, off, "null device ");
-    if (FT_SG & ft)
-        off += sg_scn3pr(buff, bufflen, off, "SCSI generic (sg) device ");
-    if (FT_BLOCK & ft)
-        off += sg_scn3pr(buff, bufflen, off, "block device ");
-    if (FT_ST & ft)
-        off += sg_scn3pr(buff, bufflen, off, "SCSI tape device ");
-    if (FT_RAW & ft)
-        off += sg_scn3pr(buff, bufflen, off, "raw device ");
-    if (FT_OTHER & ft)
-        off += sg_scn3pr(buff, bufflen, off, "other (perhaps ordinary file) ");
-    if (FT_ERROR & ft)
-        sg_scn3pr(buff, bufflen, off, "unable to 'stat' file ");
-    return buff;
-}
-
 static void
 usage()
 {
@@ -367,8 +318,9 @@ usage()
             "               [--help] [--version]\n\n");
     pr2serr("               [bpt=BPT] [cdbsz=6|10|12|16] [dio=0|1] "
             "[fua=0|1|2|3]\n"
-            "               [sync=0|1] [time=0|1] [verbose=VERB] "
-            "[--dry-run] [--progress] [--verbose]\n\n"
+            "               [qd=QD] [sync=0|1] [time=0|1] [verbose=VERB] "
+            "[--dry-run]\n"
+            "               [--progress] [--verbose]\n\n"
             "  where:\n"
             "    bpt         is blocks_per_transfer (default is 128)\n"
             "    bs          must be device logical block size (default "
@@ -383,13 +335,16 @@ usage()
             "    if          file or device to read from (def: stdin)\n");
     pr2serr("    iflag       comma separated list from: [direct,dpo,dsync,"
             "excl,fua,\n"
-            "                null]\n"
+            "                hugepage,null]\n"
             "    of          file or device to write to (def: stdout), "
             "OFILE of '.'\n"
             "                treated as /dev/null\n"
             "    oflag       comma separated list from: [append,dio,direct,"
             "dpo,dsync,\n"
-            "                excl,fua,null]\n"
+            "                excl,fua,hugepage,null]\n"
+            "    qd          commands in flight on the mmap-ed sg device, "
+            "each on its\n"
+            "                own open of it (def: 1, max: 16)\n"
             "    seek        block position to start writing to OFILE\n"
             "    skip        block position to start reading from IFILE\n"
             "    sync        0->no sync(def), 1->SYNCHRONIZE CACHE on OFILE "
@@ -407,172 +362,20 @@ usage()
             "specialized for SCSI devices for which mmap-ed IO attempted\n");
 }
 
-/* Return of 0 -> success, see sg_ll_read_capacity*() otherwise */
-static int
-scsi_read_capacity(int sg_fd, int64_t * num_sect, int * sect_sz)
-{
-    int res, verb;
-    unsigned int ui;
-    uint8_t rcBuff[RCAP16_REPLY_LEN];
-
-    verb = (verbose ? verbose - 1: 0);
-    res = sg_ll_readcap_10(sg_fd, 0, 0, rcBuff, READ_CAP_REPLY_LEN, false,
-                           verb);
-    if (0 != res)
-        return res;
-
-    if ((0xff == rcBuff[0]) && (0xff == rcBuff[1]) && (0xff == rcBuff[2]) &&
-        (0xff == rcBuff[3])) {
-
-        res = sg_ll_readcap_16(sg_fd, 0, 0, rcBuff, RCAP16_REPLY_LEN, false,
-                               verb);
-        if (0 != res)
-            return res;
-        *num_sect = sg_get_unaligned_be64(rcBuff + 0) + 1;
-        *sect_sz = sg_get_unaligned_be32(rcBuff + 8);
-    } else {
-        ui = sg_get_unaligned_be32(rcBuff + 0);
-        /* take care not to sign extend values > 0x7fffffff */
-        *num_sect = (int64_t)ui + 1;
-        *sect_sz = sg_get_unaligned_be32(rcBuff + 4);
-    }
-    if (verb)
-        pr2serr("      number of blocks=%" PRId64 " [0x%" PRIx64 "], block "
-                "size=%d\n", *num_sect, *num_sect, *sect_sz);
-    return 0;
-}
-
-/* Return of 0 -> success, -1 -> failure. BLKGETSIZE64, BLKGETSIZE and */
-/* BLKSSZGET macros problematic (from <linux/fs.h> or <sys/mount.h>). */
-static int
-read_blkdev_capacity(int sg_fd, int64_t * num_sect, int * sect_sz)
-{
-#ifdef BLKSSZGET
-    if ((ioctl(sg_fd, BLKSSZGET, sect_sz) < 0) && (*sect_sz > 0)) {
-        perror("BLKSSZGET ioctl error");
-        return -1;
-    } else {
- #ifdef BLKGETSIZE64
-        uint64_t ull;
-
-        if (ioctl(sg_fd, BLKGETSIZE64, &ull) < 0) {
-
-            perror("BLKGETSIZE64 ioctl error");
-            return -1;
-        }
-        *num_sect = ((int64_t)ull / (int64_t)*sect_sz);
-        if (verbose > 1)
-            pr2serr("      [bgs64] number of blocks=%" PRId64 " [0x%" PRIx64
-                    "], logical block size=%d\n", *num_sect, *num_sect,
-                    *sect_sz);
- #else
-        unsigned long ul;
-
-        if (ioctl(sg_fd, BLKGETSIZE, &ul) < 0) {
-            perror("BLKGETSIZE ioctl error");
-            return -1;
-        }
-        *num_sect = (int64_t)ul;
-        if (verbose > 1)
-            pr2serr("      [bgs] number of blocks=%" PRId64 " [0x%" PRIx64
-                    "], logical block size=%d\n", *num_sect, *num_sect,
-                    *sect_sz);
- #endif
-    }
-    return 0;
-#else
-    if (verbose)
-        pr2serr("      BLKSSZGET+BLKGETSIZE ioctl not available\n");
-    *num_sect = 0;
-    *sect_sz = 0;
-    return -1;
-#endif
-}
-
-static int
-sg_build_scsi_cdb(uint8_t * cdbp, int cdb_sz, unsigned int blocks,
-                  int64_t start_block, bool write_true, bool fua, bool dpo)
-{
-    int sz_ind;
-    int rd_opcode[] = {0x8, 0x28, 0xa8, 0x88};
-    int wr_opcode[] = {0xa, 0x2a, 0xaa, 0x8a};
-
-    memset(cdbp, 0, cdb_sz);
-    if (dpo)
-        cdbp[1] |= 0x10;
-    if (fua)
-        cdbp[1] |= 0x8;
-    switch (cdb_sz) {
-    case 6:
-        sz_ind = 0;
-        cdbp[0] = (uint8_t)(write_true ? wr_opcode[sz_ind] :
-                                               rd_opcode[sz_ind]);
-        sg_put_unaligned_be24(0x1fffff & start_block, cdbp + 1);
-        cdbp[4] = (256 == blocks) ? 0 : (uint8_t)blocks;
-        if (blocks > 256) {
-            pr2serr("%sfor 6 byte commands, maximum number of blocks is "
-                    "256\n", my_name);
-            return 1;
-        }
-        if ((start_block + blocks - 1) & (~0x1fffff)) {
-            pr2serr("%sfor 6 byte commands, can't address blocks beyond "
-                    "%d\n", my_name, 0x1fffff);
-            return 1;
-        }
-        if (dpo || fua) {
-            pr2serr("%sfor 6 byte commands, neither dpo nor fua bits "
-                    "supported\n", my_name);
-            return 1;
-        }
-        break;
-    case 10:
-        sz_ind = 1;
-        cdbp[0] = (uint8_t)(write_true ? wr_opcode[sz_ind] :
-                                               rd_opcode[sz_ind]);
-        sg_put_unaligned_be32((uint32_t)start_block, cdbp + 2);
-        sg_put_unaligned_be16((uint16_t)blocks, cdbp + 7);
-        if (blocks & (~0xffff)) {
-            pr2serr("%sfor 10 byte commands, maximum number of blocks is "
-                    "%d\n", my_name, 0xffff);
-            return 1;
-        }
-        break;
-    case 12:
-        sz_ind = 2;
-        cdbp[0] = (uint8_t)(write_true ? wr_opcode[sz_ind] :
-                                               rd_opcode[sz_ind]);
-        sg_put_unaligned_be32((uint32_t)start_block, cdbp + 2);
-        sg_put_unaligned_be32((uint32_t)blocks, cdbp + 6);
-        break;
-    case 16:
-        sz_ind = 3;
-        cdbp[0] = (uint8_t)(write_true ? wr_opcode[sz_ind] :
-                                               rd_opcode[sz_ind]);
-        sg_put_unaligned_be64((uint64_t)start_block, cdbp + 2);
-        sg_put_unaligned_be32((uint32_t)blocks, cdbp + 10);
-        break;
-    default:
-        pr2serr("%sexpected cdb size of 6, 10, 12, or 16 but got %d\n",
-                my_name, cdb_sz);
-        return 1;
-    }
-    return 0;
-}
-
 /* Returns 0 -> successful, various SG_LIB_CAT_* positive values,
  * -2 -> recoverable (ENOMEM), -1 -> unrecoverable error */
 static int
 sg_read(int sg_fd, uint8_t * buff, int blocks, int64_t from_block,
-        int bs, int cdbsz, bool fua, bool dpo, bool do_mmap)
+        int bs, const struct sg_dde_cdb_tmpl * tp, bool do_mmap)
 {
     bool print_cdb_after = false;
     int res;
+    int cdbsz = tp->cdb_sz;
     uint8_t rdCmd[MAX_SCSI_CDBSZ];
     uint8_t senseBuff[SENSE_BUFF_LEN] SG_C_CPP_ZERO_INIT;
     struct sg_io_hdr io_hdr;
 
-    if (sg_build_scsi_cdb(rdCmd, cdbsz, blocks, from_block, false, fua,
-                          dpo)) {
+    if (sg_dde_cdb_tmpl_fill(tp, rdCmd, blocks, from_block)) {
         pr2serr("%sbad rd cdb build, from_block=%" PRId64 ", blocks=%d\n",
                 my_name, from_block, blocks);
         return SG_LIB_SYNTAX_ERROR;
@@ -663,15 +466,17 @@ sg_read(int sg_fd, uint8_t * buff, int blocks, int64_t from_block,
  * -2 -> recoverable (ENOMEM), -1 -> unrecoverable error */
 static int
 sg_write(int sg_fd, uint8_t * buff, int blocks, int64_t to_block,
-         int bs, int cdbsz, bool fua, bool dpo, bool do_mmap, bool * diop)
+         int bs, const struct sg_dde_cdb_tmpl * tp, bool do_mmap,
+         bool * diop)
 {
     bool print_cdb_after = false;
     int res;
+    int cdbsz = tp->cdb_sz;
     uint8_t wrCmd[MAX_SCSI_CDBSZ];
     uint8_t senseBuff[SENSE_BUFF_LEN] SG_C_CPP_ZERO_INIT;
     struct sg_io_hdr io_hdr SG_C_CPP_ZERO_INIT;
 
-    if (sg_build_scsi_cdb(wrCmd, cdbsz, blocks, to_block, true, fua, dpo)) {
+    if (sg_dde_cdb_tmpl_fill(tp, wrCmd, blocks, to_block)) {
         pr2serr("%sbad wr cdb build, to_block=%" PRId64 ", blocks=%d\n",
                 my_name, to_block, blocks);
         return SG_LIB_SYNTAX_ERROR;
@@ -759,6 +564,186 @@ sg_write(int sg_fd, uint8_t * buff, int blocks, int64_t to_block,
     return 0;
 }
 
+/* qd=QD: one sg file descriptor, and so one reserve buffer mmap-ed, per
+ * command in flight. Slot 0 uses the fd opened for IFILE (or OFILE) and
+ * the others re-open that device. Commands are started with write(2) and
+ * collected with read(2) in the order they were started so OFILE is still
+ * written in block order. */
+struct mm_slot {
+    int fd;
+    int res_sz;         /* of the mmap-ed reserve buffer at mmp */
+    int blocks;
+    int64_t lba;
+    uint8_t * mmp;
+    struct sg_io_hdr io_hdr;
+    uint8_t cdb[MAX_SCSI_CDBSZ];
+    uint8_t sense[SENSE_BUFF_LEN];
+};
+
+struct mm_ring {
+    int qd;
+    int bpt;
+    int head;           /* oldest command in flight */
+    int num_busy;
+    bool wr;            /* mmap-ed side is OFILE, else IFILE */
+    const struct sg_dde_cdb_tmpl * tp;
+    struct mm_slot slot[MAX_QUEUE_DEPTH];
+};
+
+/* Starts a READ (or WRITE) of blocks at lba on the next free slot with its
+ * reserve buffer as the data buffer. Returns 0, SG_LIB_SYNTAX_ERROR or -1. */
+static int
+mm_start(struct mm_ring * rp, int blocks, int64_t lba)
+{
+    int res;
+    struct mm_slot * sp = rp->slot + ((rp->head + rp->num_busy) % rp->qd);
+    struct sg_io_hdr * hp = &sp->io_hdr;
+
+    if (sg_dde_cdb_tmpl_fill(rp->tp, sp->cdb, blocks, lba)) {
+        pr2serr("%sbad %s cdb build, lba=%" PRId64 ", blocks=%d\n", my_name,
+                (rp->wr ? "wr" : "rd"), lba, blocks);
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    memset(hp, 0, sizeof(*hp));
+    hp->interface_id = 'S';
+    hp->cmd_len = rp->tp->cdb_sz;
+    hp->cmdp = sp->cdb;
+    hp->dxfer_direction = rp->wr ? SG_DXFER_TO_DEV : SG_DXFER_FROM_DEV;
+    hp->dxfer_len = blk_sz * blocks;
+    hp->mx_sb_len = SENSE_BUFF_LEN;
+    hp->sbp = sp->sense;
+    hp->timeout = DEF_TIMEOUT;
+    hp->pack_id = (int)++glob_pack_id;
+    hp->flags = SG_FLAG_MMAP_IO;
+    if (verbose > 2) {
+        char b[128];
+
+        pr2serr("    %s cdb: %s\n", (rp->wr ? "Write" : "Read"),
+                sg_get_command_str(sp->cdb, hp->cmd_len, false, sizeof(b),
+                                   b));
+    }
+    while (((res = write(sp->fd, hp, sizeof(*hp))) < 0) &&
+           ((EINTR == errno) || (EAGAIN == errno) || (EBUSY == errno)))
+        ;
+    if (res < 0) {
+        char e[64];
+
+        snprintf(e, sizeof(e), "%s%s: write to sg", my_name, __func__);
+        perror(e);
+        return -1;
+    }
+    sp->blocks = blocks;
+    sp->lba = lba;
+    ++rp->num_busy;
+    return 0;
+}
+
+/* Waits for the oldest command in flight and frees its slot, pointed to by
+ * *spp. Returns 0 -> successful, various SG_LIB_CAT_* positive values or -1
+ * as sg_read() and sg_write() do. */
+static int
+mm_finish(struct mm_ring * rp, struct mm_slot ** spp)
+{
+    bool wr = rp->wr;
+    int res;
+    struct mm_slot * sp = rp->slot + rp->head;
+    struct sg_io_hdr * hp = &sp->io_hdr;
+    struct pollfd pfd;
+
+    *spp = sp;
+    rp->head = (rp->head + 1) % rp->qd;
+    --rp->num_busy;
+    pfd.fd = sp->fd;
+    pfd.events = POLLIN;
+    while (((res = read(sp->fd, hp, sizeof(*hp))) < 0) &&
+           ((EINTR == errno) || (EAGAIN == errno) || (EBUSY == errno))) {
+        if (EAGAIN == errno)
+            poll(&pfd, 1, -1);  /* fd is O_NONBLOCK */
+    }
+    if (res < 0) {
+        char e[64];
+
+        snprintf(e, sizeof(e), "%s%s: read from sg", my_name, __func__);
+        perror(e);
+        return -1;
+    }
+    if (verbose > 2)
+        pr2serr("      duration=%u ms\n", hp->duration);
+    res = sg_err_category3(hp);
+    switch (res) {
+    case SG_LIB_CAT_CLEAN:
+        break;
+    case SG_LIB_CAT_RECOVERED:
+        sg_chk_n_print3(wr ? "Writing, continuing" : "Reading, continuing",
+                        hp, verbose > 1);
+        break;
+    case SG_LIB_CAT_NOT_READY:
+    case SG_LIB_CAT_MEDIUM_HARD:
+        return res;
+    default:
+        sg_chk_n_print3(wr ? "writing" : "reading", hp, verbose > 1);
+        if (verbose && (SG_LIB_CAT_ILLEGAL_REQ == res))
+            sg_print_command_len(sp->cdb, hp->cmd_len);
+        return res;
+    }
+    if (! wr)
+        sum_of_resids += hp->resid;
+    return 0;
+}
+
+/* Waits for, and ignores the outcome of, the commands still in flight */
+static void
+mm_drain(struct mm_ring * rp)
+{
+    struct mm_slot * sp;
+
+    while (rp->num_busy > 0)
+        mm_finish(rp, &sp);
+}
+
+/* Opens fn again for slot k of the ring, sizes its reserve buffer for bpt
+ * blocks and mmap-s that. Returns 0 or an exit status. */
+static int
+mm_slot_open(struct mm_ring * rp, int k, const char * fn, int flags, int bpt)
+{
+    int res, err, t;
+    int bpt_k = bpt;
+    struct mm_slot * sp = rp->slot + k;
+    struct sg_dde_resbuf rb;
+    char ebuff[EBUFF_SZ];
+
+    if ((sp->fd = open(fn, flags)) < 0) {
+        err = errno;
+        snprintf(ebuff, EBUFF_SZ, "%scould not open %s for qd=%d", my_name,
+                 fn, rp->qd);
+        perror(ebuff);
+        return sg_convert_errno(err);
+    }
+    res = ioctl(sp->fd, SG_GET_VERSION_NUM, &t);
+    if ((res < 0) || (t < 30122)) {
+        pr2serr("%ssg driver prior to 3.1.22\n", my_name);
+        return SG_LIB_FILE_ERROR;
+    }
+    res = sg_dde_resbuf_size(sp->fd, blk_sz, &bpt_k, SG_DDE_RB_MMAP, &rb,
+                             my_name, (k > 1) ? 0 : verbose);
+    if (res)
+        return res;
+    if (0 == (SG_DDE_RB_MMAP & rb.got))
+        return SG_LIB_CAT_OTHER;
+    sp->res_sz = rb.need;
+    sp->mmp = (uint8_t *)mmap(NULL, sp->res_sz, PROT_READ | PROT_WRITE,
+                              MAP_SHARED, sp->fd, 0);
+    if (MAP_FAILED == sp->mmp) {
+        err = errno;
+        sp->mmp = NULL;
+        snprintf(ebuff, EBUFF_SZ, "%serror using mmap() on file: %s",
+                 my_name, fn);
+        perror(ebuff);
+        return sg_convert_errno(err);
+    }
+    return 0;
+}
+
 static int
 process_flags(const char * arg, struct flags_t * fp)
 {
@@ -791,6 +776,8 @@ process_flags(const char * arg, struct flags_t * fp)
             fp->excl = true;
         else if (0 == strcmp(cp, "fua"))
             fp->fua = true;
+        else if (0 == strcmp(cp, "hugepage"))
+            fp->hugepage = true;
         else if (0 == strcmp(cp, "null"))
             ;
         else {
@@ -946,10 +933,176 @@ check_progress()
 #endif
 }
 
+/* Copy loop for qd=QD when IFILE is the mmap-ed sg device. Keeps up to QD
+ * READs in flight and writes out the data of the oldest as it completes.
+ * Returns 0 or an error as the loop in main() does. */
+static int
+mm_copy_rd(struct mm_ring * rp, int64_t skip, int outfd, int out_type,
+           int64_t seek, const struct sg_dde_cdb_tmpl * wr_tp, bool dio,
+           int * num_dio_not_donep)
+{
+    bool dio_res;
+    int res, blocks;
+    int ret = 0;
+    int64_t to_read = dd_count;
+    struct mm_slot * sp;
+    char ebuff[EBUFF_SZ];
 
-#define STR_SZ 1024
-#define INOUTF_SZ 512
-#define EBUFF_SZ 768
+    while (dd_count > 0) {
+        while ((rp->num_busy < rp->qd) && (to_read > 0)) {
+            blocks = (to_read > rp->bpt) ? rp->bpt : to_read;
+            if ((ret = mm_start(rp, blocks, skip)))
+                break;
+            skip += blocks;
+            to_read -= blocks;
+        }
+        if ((0 != ret) || (0 == rp->num_busy))
+            break;
+        res = mm_finish(rp, &sp);
+        blocks = sp->blocks;
+        if ((SG_LIB_CAT_UNIT_ATTENTION == res) ||
+            (SG_LIB_CAT_ABORTED_COMMAND == res)) {
+            pr2serr("Unit attention or aborted command, continuing (r)\n");
+            res = sg_read(sp->fd, sp->mmp, blocks, sp->lba, blk_sz, rp->tp,
+                          true);
+        }
+        if (0 != res) {
+            pr2serr("sg_read failed, skip=%" PRId64 "\n", sp->lba);
+            ret = res;
+            break;
+        }
+        in_full += blocks;
+
+        if (FT_SG == out_type) {
+            dio_res = dio;
+            ret = sg_write(outfd, sp->mmp, blocks, seek, blk_sz, wr_tp,
+                           false, &dio_res);
+            if ((SG_LIB_CAT_UNIT_ATTENTION == ret) ||
+                (SG_LIB_CAT_ABORTED_COMMAND == ret)) {
+                pr2serr("Unit attention or aborted command, continuing (w)\n");
+                dio_res = dio;
+                ret = sg_write(outfd, sp->mmp, blocks, seek, blk_sz, wr_tp,
+                               false, &dio_res);
+            }
+            if (0 != ret) {
+                pr2serr("sg_write failed, seek=%" PRId64 "\n", seek);
+                break;
+            }
+            out_full += blocks;
+            if (dio && (! dio_res))
+                ++*num_dio_not_donep;
+        } else if (FT_DEV_NULL == out_type)
+            out_full += blocks; /* act as if written out without error */
+        else {
+            while (((res = write(outfd, sp->mmp, blocks * blk_sz)) < 0) &&
+                   ((EINTR == errno) || (EAGAIN == errno) ||
+                    (EBUSY == errno)))
+                ;
+            if (verbose > 2)
+                pr2serr("write(unix): count=%d, res=%d\n", blocks * blk_sz,
+                        res);
+            if (res < 0) {
+                snprintf(ebuff, EBUFF_SZ, "%swriting, seek=%" PRId64 " ",
+                         my_name, seek);
+                perror(ebuff);
+                break;
+            } else if (res < blocks * blk_sz) {
+                pr2serr("output file probably full, seek=%" PRId64 " ", seek);
+                blocks = res / blk_sz;
+                out_full += blocks;
+                if ((res % blk_sz) > 0)
+                    out_partial++;
+                break;
+            }
+            out_full += blocks;
+        }
+        dd_count -= blocks;
+        seek += blocks;
+        if ((progress > 0) && check_progress()) {
+            calc_duration_throughput(true);
+            print_stats();
+        }
+    }
+    mm_drain(rp);
+    return ret;
+}
+
+/* Copy loop for qd=QD when OFILE is the mmap-ed sg device. Reads IFILE
+ * into the reserve buffer of a free slot and starts the WRITE from it,
+ * only waiting for the oldest WRITE when all QD are in flight. Returns 0
+ * or an error as the loop in main() does. */
+static int
+mm_copy_wr(struct mm_ring * rp, int infd, int64_t skip, int64_t seek)
+{
+    bool eof = false;
+    int res, blocks;
+    int ret = 0;
+    int64_t to_read = dd_count;
+    struct mm_slot * sp;
+    char ebuff[EBUFF_SZ];
+
+    while (dd_count > 0) {
+        if ((rp->num_busy < rp->qd) && (to_read > 0) && (! eof)) {
+            sp = rp->slot + ((rp->head + rp->num_busy) % rp->qd);
+            blocks = (to_read > rp->bpt) ? rp->bpt : to_read;
+            while (((res = read(infd, sp->mmp, blocks * blk_sz)) < 0) &&
+                   ((EINTR == errno) || (EAGAIN == errno) ||
+                    (EBUSY == errno)))
+                ;
+            if (verbose > 2)
+                pr2serr("read(unix): count=%d, res=%d\n", blocks * blk_sz,
+                        res);
+            if (res < 0) {
+                snprintf(ebuff, EBUFF_SZ, "%sreading, skip=%" PRId64 " ",
+                         my_name, skip);
+                perror(ebuff);
+                ret = -1;
+                break;
+            } else if (res < blocks * blk_sz) {
+                eof = true;
+                blocks = res / blk_sz;
+                if ((res % blk_sz) > 0) {
+                    blocks++;
+                    in_partial++;
+                }
+            }
+            in_full += blocks;
+            to_read -= blocks;
+            skip += blocks;
+            if (blocks > 0) {
+                if ((ret = mm_start(rp, blocks, seek)))
+                    break;
+                seek += blocks;
+            }
+            continue;
+        }
+        if (0 == rp->num_busy) {
+            if (eof)
+                dd_count = 0;   /* as the loop in main() on a short read */
+            break;
+        }
+        res = mm_finish(rp, &sp);
+        if ((SG_LIB_CAT_UNIT_ATTENTION == res) ||
+            (SG_LIB_CAT_ABORTED_COMMAND == res)) {
+            pr2serr("Unit attention or aborted command, continuing (w)\n");
+            res = sg_write(sp->fd, sp->mmp, sp->blocks, sp->lba, blk_sz,
+                           rp->tp, true, NULL);
+        }
+        if (0 != res) {
+            pr2serr("sg_write failed, seek=%" PRId64 "\n", sp->lba);
+            ret = res;
+            break;
+        }
+        out_full += sp->blocks;
+        dd_count -= sp->blocks;
+        if ((progress > 0) && check_progress()) {
+            calc_duration_throughput(true);
+            print_stats();
+        }
+    }
+    mm_drain(rp);
+    return ret;
+}
 
 int
 main(int argc, char * argv[])
@@ -970,11 +1123,15 @@ main(int argc, char * argv[])
     int out_res_sz = 0;
     int out_sect_sz;
     int out_type = FT_OTHER;
+    int qd = 1;
+    int vb_m1;
+    struct sg_dde_cdb_tmpl rd_tmpl;
+    struct sg_dde_cdb_tmpl wr_tmpl;
+    struct sg_dde_resbuf rb;
     int num_dio_not_done = 0;
     int ret = 0;
     int scsi_cdbsz_in = DEF_SCSI_CDBSZ;
     int scsi_cdbsz_out = DEF_SCSI_CDBSZ;
-    size_t psz;
     int64_t in_num_sect = -1;
     int64_t out_num_sect = -1;
     int64_t skip = 0;
@@ -982,6 +1139,7 @@ main(int argc, char * argv[])
     char * buf;
     char * key;
     uint8_t * wrkPos;
+    int hp_kind = SG_HUGEPAGE_NONE;
     uint8_t * wrkBuff = NULL;
     uint8_t * wrkMmap = NULL;
     char inf[INOUTF_SZ];
@@ -991,16 +1149,13 @@ main(int argc, char * argv[])
     char b[80];
     struct flags_t in_flags;
     struct flags_t out_flags;
+    struct mm_ring ring;
     static const char * bat_s = "bad argument to";
     static const int blen = sizeof(b);
 
-#if defined(HAVE_SYSCONF) && defined(_SC_PAGESIZE)
-    psz = sysconf(_SC_PAGESIZE); /* POSIX.1 (was getpagesize()) */
-#else
-    psz = 4096;     /* give up, pick likely figure */
-#endif
     inf[0] = '\0';
     outf[0] = '\0';
+    memset(&ring, 0, sizeof(ring));
     memset(&in_flags, 0, sizeof(in_flags));
     memset(&out_flags, 0, sizeof(out_flags));
     if (getenv("SG3_UTILS_INVOCATION"))
@@ -1094,6 +1249,13 @@ main(int argc, char * argv[])
                 pr2serr("%s%s 'obs'\n", my_name, bat_s);
                 return SG_LIB_SYNTAX_ERROR;
             }
+        } else if (0 == strcmp(key,"qd")) {
+            qd = sg_get_num(buf);
+            if ((qd < 1) || (qd > MAX_QUEUE_DEPTH)) {
+                pr2serr("%s'qd' expects 1 to %d\n", my_name,
+                        MAX_QUEUE_DEPTH);
+                return SG_LIB_SYNTAX_ERROR;
+            }
         } else if (0 == strcmp(key,"seek")) {
             seek = sg_get_llnum(buf);
             if ((seek < 0) || (seek > MAX_COUNT_SKIP_SEEK)) {
@@ -1219,10 +1381,10 @@ main(int argc, char * argv[])
     infd = STDIN_FILENO;
     outfd = STDOUT_FILENO;
     if (inf[0] && ('-' != inf[0])) {
-        in_type = dd_filetype(inf);
+        in_type = sg_dde_filetype(inf, 0, verbose);
         if (verbose > 1)
             pr2serr(" >> Input file type: %s\n",
-                    dd_filetype_str(in_type, ebuff, sizeof(ebuff)));
+                    sg_dde_filetype_str(in_type, ebuff, sizeof(ebuff)));
 
         if (FT_ERROR == in_type) {
             pr2serr("%sunable to access %s\n", my_name, inf);
@@ -1250,27 +1412,16 @@ main(int argc, char * argv[])
                 pr2serr("%ssg driver prior to 3.1.22\n", my_name);
                 return SG_LIB_FILE_ERROR;
             }
-            in_res_sz = blk_sz * bpt;
-            if (0 != (in_res_sz % psz)) /* round up to next page */
-                in_res_sz = ((in_res_sz / psz) + 1) * psz;
-            if (ioctl(infd, SG_GET_RESERVED_SIZE, &t) < 0) {
-                err = errno;
-                snprintf(ebuff, EBUFF_SZ, "%sSG_GET_RESERVED_SIZE error",
-                         my_name);
-                perror(ebuff);
-                return sg_convert_errno(err);
-            }
-            if (t < MIN_RESERVED_SIZE)
-                t = MIN_RESERVED_SIZE;
-            if (in_res_sz > t) {
-                if (ioctl(infd, SG_SET_RESERVED_SIZE, &in_res_sz) < 0) {
-                    err = errno;
-                    snprintf(ebuff, EBUFF_SZ, "%sSG_SET_RESERVED_SIZE error",
-                             my_name);
-                    perror(ebuff);
-                    return sg_convert_errno(err);
-                }
-            }
+            /* lowers bpt, if need be, so the reserve buffer can be
+             * mmap-ed */
+            res = sg_dde_resbuf_size(infd, blk_sz, &bpt,
+                                     SG_DDE_RB_MMAP | SG_DDE_RB_FIT, &rb,
+                                     my_name, verbose);
+            if (res)
+                return res;
+            if (0 == (SG_DDE_RB_MMAP & rb.got))
+                return SG_LIB_CAT_OTHER;
+            in_res_sz = rb.need;
             wrkMmap = (uint8_t *)mmap(NULL, in_res_sz,
                                  PROT_READ | PROT_WRITE, MAP_SHARED, infd, 0);
             if (MAP_FAILED == wrkMmap) {
@@ -1314,10 +1465,10 @@ main(int argc, char * argv[])
     }
 
     if (outf[0] && ('-' != outf[0])) {
-        out_type = dd_filetype(outf);
+        out_type = sg_dde_filetype(outf, 0, verbose);
         if (verbose > 1)
             pr2serr(" >> Output file type: %s\n",
-                    dd_filetype_str(out_type, ebuff, sizeof(ebuff)));
+                    sg_dde_filetype_str(out_type, ebuff, sizeof(ebuff)));
 
         if (FT_ST == out_type) {
             pr2serr("%sunable to use scsi tape device %s\n", my_name, outf);
@@ -1343,25 +1494,18 @@ main(int argc, char * argv[])
                 pr2serr("%ssg driver prior to 3.1.22\n", my_name);
                 return SG_LIB_FILE_ERROR;
             }
-            if (ioctl(outfd, SG_GET_RESERVED_SIZE, &t) < 0) {
-                err = errno;
-                snprintf(ebuff, EBUFF_SZ, "%sSG_GET_RESERVED_SIZE error",
-                         my_name);
-                perror(ebuff);
-                return sg_convert_errno(err);
-            }
-           if (t < MIN_RESERVED_SIZE)
-                t = MIN_RESERVED_SIZE;
-            out_res_sz = blk_sz * bpt;
-            if (out_res_sz > t) {
-                if (ioctl(outfd, SG_SET_RESERVED_SIZE, &out_res_sz) < 0) {
-                    err = errno;
-                    snprintf(ebuff, EBUFF_SZ, "%sSG_SET_RESERVED_SIZE error",
-                             my_name);
-                    perror(ebuff);
-                    return sg_convert_errno(err);
-                }
-            }
+            /* mmap-ed here unless IFILE was, then direct IO may be used */
+            if (wrkMmap)
+                t = out_flags.dio ? SG_DDE_RB_DIO : 0;
+            else
+                t = SG_DDE_RB_MMAP;
+            res = sg_dde_resbuf_size(outfd, blk_sz, &bpt, t | SG_DDE_RB_FIT,
+                                     &rb, my_name, verbose);
+            if (res)
+                return res;
+            if ((SG_DDE_RB_MMAP & t) && (0 == (SG_DDE_RB_MMAP & rb.got)))
+                return SG_LIB_CAT_OTHER;
+            out_res_sz = rb.need;
             if (NULL == wrkMmap) {
                 wrkMmap = (uint8_t *)mmap(NULL, out_res_sz,
                                 PROT_READ | PROT_WRITE, MAP_SHARED, outfd, 0);
@@ -1427,16 +1571,20 @@ main(int argc, char * argv[])
         pr2serr("For more information use '--help'\n");
         return SG_LIB_CONTRADICT;
     }
+    vb_m1 = verbose ? verbose - 1 : 0;
     if (dd_count < 0) {
         in_num_sect = -1;
         if (FT_SG == in_type) {
-            res = scsi_read_capacity(infd, &in_num_sect, &in_sect_sz);
+            res = sg_dde_read_capacity(infd, &in_num_sect, &in_sect_sz,
+                                       false, vb_m1);
             if (SG_LIB_CAT_UNIT_ATTENTION == res) {
                 pr2serr("Unit attention(in), continuing\n");
-                res = scsi_read_capacity(infd, &in_num_sect, &in_sect_sz);
+                res = sg_dde_read_capacity(infd, &in_num_sect,
+                                           &in_sect_sz, false, vb_m1);
             } else if (SG_LIB_CAT_ABORTED_COMMAND == res) {
                 pr2serr("Aborted command(in), continuing\n");
-                res = scsi_read_capacity(infd, &in_num_sect, &in_sect_sz);
+                res = sg_dde_read_capacity(infd, &in_num_sect,
+                                           &in_sect_sz, false, vb_m1);
             }
             if (0 != res) {
                 sg_get_category_sense_str(res, blen, b, verbose);
@@ -1444,7 +1592,8 @@ main(int argc, char * argv[])
                 in_num_sect = -1;
             }
         } else if (FT_BLOCK == in_type) {
-            if (0 != read_blkdev_capacity(infd, &in_num_sect, &in_sect_sz)) {
+            if (0 != sg_dde_blkdev_capacity(infd, &in_num_sect, &in_sect_sz,
+                                            vb_m1)) {
                 pr2serr("Unable to read block capacity on %s\n", inf);
                 in_num_sect = -1;
             }
@@ -1459,13 +1608,16 @@ main(int argc, char * argv[])
 
         out_num_sect = -1;
         if (FT_SG == out_type) {
-            res = scsi_read_capacity(outfd, &out_num_sect, &out_sect_sz);
+            res = sg_dde_read_capacity(outfd, &out_num_sect, &out_sect_sz,
+                                       false, vb_m1);
             if (SG_LIB_CAT_UNIT_ATTENTION == res) {
                 pr2serr("Unit attention(out), continuing\n");
-                res = scsi_read_capacity(outfd, &out_num_sect, &out_sect_sz);
+                res = sg_dde_read_capacity(outfd, &out_num_sect,
+                                           &out_sect_sz, false, vb_m1);
             } else if (SG_LIB_CAT_ABORTED_COMMAND == res) {
                 pr2serr("Aborted command(out), continuing\n");
-                res = scsi_read_capacity(outfd, &out_num_sect, &out_sect_sz);
+                res = sg_dde_read_capacity(outfd, &out_num_sect,
+                                           &out_sect_sz, false, vb_m1);
             }
             if (0 != res) {
                 sg_get_category_sense_str(res, blen, b, verbose);
@@ -1473,8 +1625,8 @@ main(int argc, char * argv[])
                 out_num_sect = -1;
             }
         } else if (FT_BLOCK == out_type) {
-            if (0 != read_blkdev_capacity(outfd, &out_num_sect,
-                                          &out_sect_sz)) {
+            if (0 != sg_dde_blkdev_capacity(outfd, &out_num_sect,
+                                            &out_sect_sz, vb_m1)) {
                 pr2serr("Unable to read block capacity on %s\n", outf);
                 out_num_sect = -1;
             }
@@ -1520,28 +1672,65 @@ main(int argc, char * argv[])
             scsi_cdbsz_out = MAX_SCSI_CDBSZ;
         }
     }
+    /* cdbs only differ in their LBA and TRANSFER LENGTH fields */
+    if ((FT_SG == in_type) &&
+        sg_dde_cdb_tmpl_init(&rd_tmpl, scsi_cdbsz_in, false, in_flags.fua,
+                             in_flags.dpo, my_name))
+        return SG_LIB_SYNTAX_ERROR;
+    if ((FT_SG == out_type) &&
+        sg_dde_cdb_tmpl_init(&wr_tmpl, scsi_cdbsz_out, true, out_flags.fua,
+                             out_flags.dpo, my_name))
+        return SG_LIB_SYNTAX_ERROR;
 
     if (out_flags.dio && (FT_SG != in_type)) {
         out_flags.dio = false;
         pr2serr(">>> dio only performed on 'of' side when 'if' is an sg "
                 "device\n");
     }
-    if (out_flags.dio) {
-        int fd;
-        char c;
-
-        if ((fd = open(sg_allow_dio, O_RDONLY)) >= 0) {
-            if (1 == read(fd, &c, 1)) {
-                if ('0' == c)
-                    pr2serr(">>> %s set to '0' but should be set to '1' for "
-                            "direct IO\n", sg_allow_dio);
-            }
-            close(fd);
+
+    if ((qd > 1) && (NULL == wrkMmap)) {
+        pr2serr(">>> qd=%d ignored, neither IFILE nor OFILE is mmap-ed\n",
+                qd);
+        qd = 1;
+    }
+    if (qd > 1) {
+        bool rd_mm = (FT_SG == in_type);
+        const struct flags_t * mfp = rd_mm ? &in_flags : &out_flags;
+
+        if (mfp->excl) {
+            pr2serr("%sqd=%d needs the sg device opened %d times so can't "
+                    "be used with the excl flag\n", my_name, qd, qd);
+            return SG_LIB_CONTRADICT;
+        }
+        ring.qd = qd;
+        ring.bpt = bpt;
+        ring.wr = ! rd_mm;
+        ring.tp = rd_mm ? &rd_tmpl : &wr_tmpl;
+        ring.slot[0].fd = rd_mm ? infd : outfd;
+        ring.slot[0].mmp = wrkMmap;
+        ring.slot[0].res_sz = rd_mm ? in_res_sz : out_res_sz;
+        flags = O_RDWR | O_NONBLOCK;
+        if (mfp->direct)
+            flags |= O_DIRECT;
+        if (mfp->dsync)
+            flags |= O_SYNC;
+        for (k = 1; k < qd; ++k) {
+            ring.slot[k].fd = -1;
+            if ((res = mm_slot_open(&ring, k, rd_mm ? inf : outf, flags,
+                                    bpt)))
+                return res;
         }
     }
 
     if (wrkMmap) {
         wrkPos = wrkMmap;
+    } else if (in_flags.hugepage || out_flags.hugepage) {
+        wrkPos = sg_memalign_hugepage(blk_sz * bpt, &wrkBuff, &hp_kind,
+                                      verbose > 0);
+        if (NULL == wrkPos) {
+            pr2serr("Not enough user memory\n");
+            return sg_convert_errno(ENOMEM);
+        }
     } else {
         wrkPos = (uint8_t *)sg_memalign(blk_sz * bpt, 0, &wrkBuff,
                                         verbose > 3);
@@ -1572,17 +1761,24 @@ main(int argc, char * argv[])
         pr2serr("Since both 'if' and 'of' are sg devices, only do mmap-ed "
                 "transfers on 'if'\n");
 
-    while (dd_count > 0) {      /* start of main copy loop */
+    if (qd > 1) {
+        if (FT_SG == in_type)
+            ret = mm_copy_rd(&ring, skip, outfd, out_type, seek, &wr_tmpl,
+                             out_flags.dio, &num_dio_not_done);
+        else
+            ret = mm_copy_wr(&ring, infd, skip, seek);
+    }
+    /* with qd=QD the copy has been done (or has failed) by now */
+    while ((1 == qd) && (dd_count > 0)) {      /* start of main copy loop */
         blocks = (dd_count > blocks_per) ? blocks_per : dd_count;
         if (FT_SG == in_type) {
-            ret = sg_read(infd, wrkPos, blocks, skip, blk_sz, scsi_cdbsz_in,
-                          in_flags.fua, in_flags.dpo, true);
+            ret = sg_read(infd, wrkPos, blocks, skip, blk_sz, &rd_tmpl,
+                          true);
             if ((SG_LIB_CAT_UNIT_ATTENTION == ret) ||
                 (SG_LIB_CAT_ABORTED_COMMAND == ret)) {
                 pr2serr("Unit attention or aborted command, continuing "
                         "(r)\n");
-                ret = sg_read(infd, wrkPos, blocks, skip, blk_sz,
-                              scsi_cdbsz_in, in_flags.fua, in_flags.dpo,
+                ret = sg_read(infd, wrkPos, blocks, skip, blk_sz, &rd_tmpl,
                               true);
             }
             if (0 != ret) {
@@ -1625,14 +1821,13 @@ main(int argc, char * argv[])
             bool dio_res = out_flags.dio;
             bool do_mmap = (FT_SG != in_type);
 
-            ret = sg_write(outfd, wrkPos, blocks, seek, blk_sz, scsi_cdbsz_out,
-                           out_flags.fua, out_flags.dpo, do_mmap, &dio_res);
+            ret = sg_write(outfd, wrkPos, blocks, seek, blk_sz, &wr_tmpl,
+                           do_mmap, &dio_res);
             if ((SG_LIB_CAT_UNIT_ATTENTION == ret) ||
                 (SG_LIB_CAT_ABORTED_COMMAND == ret)) {
                 pr2serr("Unit attention or aborted command, continuing (w)\n");
                 dio_res = out_flags.dio;
-                ret = sg_write(outfd, wrkPos, blocks, seek, blk_sz,
-                               scsi_cdbsz_out, out_flags.fua, out_flags.dpo,
+                ret = sg_write(outfd, wrkPos, blocks, seek, blk_sz, &wr_tmpl,
                                do_mmap, &dio_res);
             }
             if (0 != ret) {
@@ -1703,7 +1898,13 @@ main(int argc, char * argv[])
 
 fini:
     if (wrkBuff)
-        free(wrkBuff);
+        sg_free_hugepage(wrkBuff, blk_sz * bpt, hp_kind);
+    for (k = 1; k < ring.qd; ++k) {
+        if (ring.slot[k].mmp)
+            munmap(ring.slot[k].mmp, ring.slot[k].res_sz);
+        if (ring.slot[k].fd >= 0)
+            close(ring.slot[k].fd);
+    }
     if ((STDIN_FILENO != infd) && (infd >= 0))
         close(infd);
     if ((STDOUT_FILENO != outfd) && (FT_DEV_NULL != out_type)) {
@@ -1,7 +1,7 @@
 /* A utility program for copying files. Specialised for "files" that
  * represent devices that understand the SCSI command set.
  *
- * Copyright (C) 1999 - 2023 D. Gilbert and P. Allworth
+ * Copyright (C) 1999 - 2026 D. Gilbert and P. Allworth
  * This program is free software; you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
  * the Free Software Foundation; either version 2, or (at your option)
@@ -45,7 +45,9 @@
 #include <errno.h>
 #include <time.h>               /* for clock_gettime() */
 #include <limits.h>
+#include <dirent.h>
 #include <pthread.h>
+#include <sched.h>              /* for sched_getcpu() and cpu_set_t */
 #include <signal.h>
 #define __STDC_FORMAT_MACROS 1
 #include <inttypes.h>
@@ -75,6 +77,11 @@
 #endif
 #endif
 
+#if defined(__x86_64__) && defined(__GNUC__)
+#define SGP_ADDR_X86 1
+#include <immintrin.h>
+#endif
+
 #if 0
 /* The following warning produces a warning itself pre c++23 and c23 */
 #ifndef HAVE_C11_ATOMICS
@@ -83,13 +90,25 @@
 #endif
 
 #include "sg_lib.h"
+#include "sg_lib_data.h"
 #include "sg_cmds_basic.h"
+#include "sg_cmds_extra.h"
 #include "sg_io_linux.h"
 #include "sg_unaligned.h"
 #include "sg_pr2serr.h"
+#include "sg_dd_eng.h"
+#include "sg_pt.h"              /* for sg_pt_lat_*() */
+#include "sg_json_sg_lib.h"
+#include "sg_hash.h"
+#include "sg_sgl.h"
+#include "sg_sdt.h"
+#include "sg_err_stats.h"
+#include "sg_cpu_stats.h"
+#include "sg_pat.h"
+#include "sg_cimg.h"
 
 
-static const char * version_str = "5.92 20230519";
+static const char * version_str = "6.19 20261015";
 
 #define DEF_BLOCK_SIZE 512
 #define DEF_BLOCKS_PER_TRANSFER 128
@@ -108,22 +127,45 @@ static const char * version_str = "5.92 20230519";
 
 #define SGP_READ10 0x28
 #define SGP_WRITE10 0x2a
+#define SGP_WRITE_STREAM16 0x9a
+#define STREAM_CONTROL_SA 0x14
+#define MAX_STREAMS 64
+
+/* streams=N,MAP: how each write to OFILE is given one of the N streams */
+#define SGP_STR_THREAD 0        /* worker thread k uses stream k % N */
+#define SGP_STR_LBA 1           /* N equal slices of the blocks copied */
+#define SGP_STR_SEG 2           /* seek= list element k uses stream k % N */
 #define DEF_NUM_THREADS 4
 #define MAX_NUM_THREADS 1024  /* was SG_MAX_QUEUE (16) but no longer applies */
-
-#ifndef RAW_MAJOR
-#define RAW_MAJOR 255   /*unlikely value */
-#endif
-
-#define FT_OTHER 1              /* filetype other than one of the following */
-#define FT_SG 2                 /* filetype is sg char device */
-#define FT_RAW 4                /* filetype is raw char device */
-#define FT_DEV_NULL 8           /* either "/dev/null" or "." as filename */
-#define FT_ST 16                /* filetype is st char device (tape) */
-#define FT_BLOCK 32             /* filetype is a block device */
-#define FT_ERROR 64             /* couldn't "stat" file */
-
-#define DEV_NULL_MINOR_NUM 3
+#define DEF_QUEUE_DEPTH 1       /* commands outstanding per worker thread */
+#define MAX_QUEUE_DEPTH 64
+
+/* interval=SECS times each read and write with sg_pt_lat_record() using
+ * these keys rather than device numbers */
+#define LAT_IN_ID 1
+#define LAT_OUT_ID 2
+#define LAT_ARR_SZ 16
+
+/* ckpt=CFILE[,SECS] keeps a journal of where the copy is up to. The first
+ * line holds skip, seek and count of the original invocation and done,
+ * the number of blocks from the start of that range that have all been
+ * written. Since worker threads complete out of order, a second line may
+ * follow with a bit (in hex, least significant first) for each bpt sized
+ * range after done, set when that range has also been written. */
+#define DEF_CKPT_SECS 10
+#define CKPT_PR_FMT "sg3_utils checkpoint: bs=%d skip=%" PRId64 " seek=%" \
+                    PRId64 " count=%" PRId64 " done=%" PRId64 "\n"
+#define CKPT_SC_FMT "sg3_utils checkpoint: bs=%d skip=%" SCNd64 " seek=%" \
+                    SCNd64 " count=%" SCNd64 " done=%" SCNd64
+#define MAX_CPU_LIST CPU_SETSIZE
+
+#define FT_OTHER SG_DDE_FT_OTHER  /* filetype other than one of following */
+#define FT_SG SG_DDE_FT_SG        /* filetype is sg char device */
+#define FT_RAW SG_DDE_FT_RAW      /* filetype is raw char device */
+#define FT_DEV_NULL SG_DDE_FT_DEV_NULL  /* "/dev/null" or "." as filename */
+#define FT_ST SG_DDE_FT_ST        /* filetype is st char device (tape) */
+#define FT_BLOCK SG_DDE_FT_BLOCK  /* filetype is a block device */
+#define FT_ERROR SG_DDE_FT_ERROR  /* couldn't "stat" file */
 
 #define EBUFF_SZ 768
 
@@ -137,49 +179,278 @@ static const char * version_str = "5.92 20230519";
 
 struct flags_t {
     bool append;
+    bool cimage;
     bool coe;
+    bool delta;
     bool dio;
     bool direct;
     bool dpo;
     bool dsync;
     bool excl;
+    bool extents;
     bool fua;
+    bool hugepage;
     bool mmap;
+    bool share;
+    bool uring;
+    bool zoned;
+};
+
+/* iflag=share or oflag=share: with the v4 sg driver (4.0.45 or later) the
+ * read side fd of each worker lends its reserve buffer to the write side
+ * fd, so the data read from IFILE is written to OFILE without being copied
+ * to or from user space. Older drivers don't have SG_SET_GET_EXTENDED, so
+ * its part of the driver's interface is defined here when needed. */
+#define SG_SHARE_MIN_VERSION 40045
+
+#ifndef SG_SET_GET_EXTENDED
+
+struct sg_extended_info {
+    uint32_t   sei_wr_mask;    /* OR-ed SG_SEIM_* user->driver values */
+    uint32_t   sei_rd_mask;    /* OR-ed SG_SEIM_* driver->user values */
+    uint32_t   ctl_flags_wr_mask;      /* OR-ed SG_CTL_FLAGM_* values */
+    uint32_t   ctl_flags_rd_mask;      /* OR-ed SG_CTL_FLAGM_* values */
+    uint32_t   ctl_flags;      /* bit values OR-ed, see SG_CTL_FLAGM_* */
+    uint32_t   read_value;     /* write SG_SEIRV_*, read back related */
+
+    uint32_t   reserved_sz;    /* data/sgl size of pre-allocated request */
+    uint32_t   tot_fd_thresh;  /* total data/sgat for this fd, 0: no limit */
+    uint32_t   minor_index;    /* rd: kernel's sg device minor number */
+    uint32_t   share_fd;       /* SHARE_FD and CHG_SHARE_FD use this */
+    uint32_t   sgat_elem_sz;   /* sgat element size (must be power of 2) */
+    uint8_t    pad_to_96[52];  /* pad so struct is 96 bytes long */
+};
+
+#define SG_SET_GET_EXTENDED _IOWR(0x22, 0x51, struct sg_extended_info)
+
+#endif
+
+#ifndef SG_SEIM_SHARE_FD
+#define SG_SEIM_SHARE_FD 0x20   /* write-side gives fd of read-side */
+#endif
+#ifndef SGV4_FLAG_SHARE
+#define SGV4_FLAG_SHARE 0x4000  /* share IO buffer; needs SG_SEIM_SHARE_FD */
+#endif
+
+#ifdef HAVE_C11_ATOMICS
+#define SGP_ATOMIC _Atomic
+#else
+#define SGP_ATOMIC volatile
+#endif
+
+/* Data written often by one thread is kept off cache lines that other
+ * threads write or read often, so the line does not bounce between cores
+ * with each update (false sharing). */
+#define SGP_CACHE_LINE 64
+#if defined(__GNUC__)
+#define SGP_CL_ALIGNED __attribute__((aligned(SGP_CACHE_LINE)))
+#else
+#define SGP_CL_ALIGNED
+#endif
+
+/* Counters bumped as transfers complete. Rather than every worker thread
+ * adding to the same ones in opts_t, each worker has its own shard which
+ * only it writes. Readers (progress reports, the final statistics) sum
+ * the shards, see shards_sum(). */
+struct sgp_shard
+{
+    SGP_ATOMIC int64_t in_blks;         /* blocks read, or generated */
+    SGP_ATOMIC int64_t out_blks;        /* blocks written to OFILE */
+    SGP_ATOMIC int64_t same_blks;       /* oflag=delta: not written */
+    SGP_ATOMIC int in_partial;
+    SGP_ATOMIC int out_partial;
+    SGP_ATOMIC int dio_incomplete_count;
+    SGP_ATOMIC int sum_of_resids;
+    SGP_ATOMIC int64_t cpu_ns;          /* worker's CPU time, set on exit */
+} SGP_CL_ALIGNED;
+
+/* bpt=auto probes transfer sizes from AUTO_BPT_MIN_BYTES up to what the
+ * devices and kernel will take (at most AUTO_BPT_MAX_BYTES) by reading
+ * AUTO_BPT_PROBE_BYTES of IFILE with each, before the worker threads are
+ * started. The range claimed by each worker is bpt blocks so, unlike
+ * sg_dd, the size can't be changed once the copy has started. */
+#define AUTO_BPT_MIN_BYTES (64 * 1024)
+#define AUTO_BPT_MAX_BYTES (8 * 1024 * 1024)
+#define AUTO_BPT_PROBE_BYTES (16 * 1024 * 1024)
+#define AUTO_BPT_MAX_CANDS 16
+
+/* Worker threads claim ranges of blocks with an atomic fetch-add on
+ * opts_t::in_next so they never serialize on a mutex to do that. Only when
+ * an input or output is sequential (e.g. a pipe) are its transfers done in
+ * block order: a thread waits until the turn's 'next' offset equals the
+ * offset it claimed, does its transfer and then advances 'next'. So the
+ * reorder window is at most one claimed range per worker thread. */
+struct sgp_turn
+{
+    SGP_ATOMIC int64_t next;        /* block offset of transfer to go next */
+    SGP_ATOMIC int waiters;         /* threads blocked on out_sync_cv */
+};
+
+/* oflag=zoned: OFILE is a zoned (ZBC) sg device whose sequential write
+ * required zones must be written in order, at their write pointer. Before
+ * the copy starts REPORT ZONES finds the zones the output range covers and
+ * checks each write pointer is where the copy will start writing that zone.
+ * Then, rather than claiming ranges from opts_t::in_next, each worker
+ * thread claims a whole zone and writes it from start to end, one command
+ * at a time. So up to thr= zones are open and being written at once. */
+struct sgp_zone
+{
+    int64_t off;        /* block offset (from seek) where zone's part starts */
+    int64_t end;        /* and ends (exclusive) */
+};
+
+struct zone_cur
+{       /* one instance per worker thread */
+    int64_t idx;        /* into opts_t::zones, -1 before first claim */
+    int64_t off;        /* next block offset to claim in that zone */
+};
+
+/* verify=MB: once a range has been written its worker thread swaps the
+ * buffer holding that data for a free one from a pool of about MB
+ * megabytes, then queues the written data. Verifier threads take ranges
+ * off that queue and either read them back from OFILE and compare, or on
+ * a sg device send the data with VERIFY (BYTCHK=1) so the device compares.
+ * Writers wait when the pool is empty, which bounds the memory used. */
+struct vfy_elem
+{
+    uint8_t * buffp;
+    uint8_t * alloc_bp;
+    int hp_kind;                /* SG_HUGEPAGE_* of alloc_bp */
+    int num_blks;
+    int64_t blk;                /* block address in OFILE */
+    struct vfy_elem * nextp;
+};
+
+struct vfy_stage
+{
+    bool done;                  /* no more ranges will be queued */
+    int num_elems;
+    int num_thr;
+    struct vfy_elem * elems;
+    struct vfy_elem * free_lp;  /* stack of free elements */
+    struct vfy_elem * headp;    /* queue of ranges waiting to be verified */
+    struct vfy_elem * tailp;
+    pthread_mutex_t mutex;
+    pthread_cond_t free_cv;     /* an element put on free_lp */
+    pthread_cond_t queue_cv;    /* an element queued or done set */
+    SGP_ATOMIC int64_t verified_blks;
+    SGP_ATOMIC int miscompares;
+    pthread_t threads[MAX_NUM_THREADS];
+};
+
+/* of2=OFILE2[,OFILE3...]: extra outputs, each written with the same data
+ * as OFILE by helper threads of the worker thread that read it */
+#define MAX_FANOUT 8    /* outputs, OFILE included */
+
+struct fan_out
+{
+    int fd;
+    int type;           /* FT_SG, FT_BLOCK, FT_RAW or FT_OTHER */
+    int cdbsz;          /* for FT_SG */
+    struct sg_dde_cdb_tmpl tmpl;        /* WRITE cdb for FT_SG */
+    bool seq;           /* can't take positioned writes (e.g. a pipe) */
+    off64_t pos;        /* file position of seek=SEEK, -1 when seq */
+    struct sgp_turn turn;       /* orders the writes when seq */
+    SGP_ATOMIC int64_t out_blks;        /* blocks written so far */
+    char fn[INOUTF_SZ];
 };
 
 struct opts_t
-{       /* one instance visible to all threads */
+{       /* one instance visible to all threads; the fields up to the
+         * shared state at the end are not changed once the copy starts */
     int infd;
     int64_t skip;
     int in_type;
     int cdbsz_in;
     struct flags_t in_flags;
-    int64_t in_blk;                 /* next block address to read */
-    int64_t in_count;               /* blocks remaining for next read */
-    int64_t in_rem_count;           /* count of remaining in blocks */
-    int in_partial;
-    pthread_mutex_t inout_mutex;
+    struct sg_dde_cdb_tmpl rd_tmpl; /* READ cdb when in_type is FT_SG */
+    int64_t in_rem_count;   /* in blocks remaining at start, less the
+                             * shards' in_blks */
+    off64_t in_pos;                 /* byte offset of skip if pread() is ok */
+    struct sg_sgl i_sgl;            /* skip=SGL, num_elems 0 if not given */
     int outfd;
     int64_t seek;
     int out_type;
     int cdbsz_out;
     struct flags_t out_flags;
-    int64_t out_blk;                /* next block address to write */
-    int64_t out_count;              /* blocks remaining for next write */
-    int64_t out_rem_count;          /* count of remaining out blocks */
-    int out_partial;
-    pthread_cond_t out_sync_cv;
+    struct sg_dde_cdb_tmpl wr_tmpl; /* WRITE cdb when out_type is FT_SG */
+    int64_t out_rem_count;  /* out blocks remaining at start, see out_rem() */
+    off64_t out_pos;                /* byte offset of seek if pwrite() is ok */
+    bool out_seq;                   /* writes must go out in block order */
+    struct sg_sgl o_sgl;            /* seek=SGL */
+    bool sgl_active;    /* either list given: claims stop at element ends */
+    int64_t ext_count;  /* iflag=extents: count before holes removed */
+    int num_zones;      /* oflag=zoned: elements in zones */
+    struct sgp_zone * zones;
     int bs;
     int bpt;
+    bool bpt_auto;      /* bpt=auto */
     int num_threads;
-    int dio_incomplete_count;
-    int sum_of_resids;
+    int qd;             /* sg commands each worker keeps outstanding */
+    int num_cpus;       /* > 0 when worker threads are pinned */
+    int numa_node;      /* node worker buffers are placed on, -1: don't */
+    bool cpus_given;    /* cpus=LIST: pin thread k to cpus[k % num_cpus] */
+    int cpus[MAX_CPU_LIST];
+    int num_hwq;        /* hwq=1: hardware queues of IFILE (or OFILE) */
+    char hwq_dir[PATH_MAX];     /* sysfs mq directory holding those */
     bool mmap_active;
+    bool share_active;  /* iflag=share or oflag=share, and usable */
     int chkaddr;        /* check read data contains 4 byte, big endian block
                          * addresses, once: check only 4 bytes per block */
+    bool genaddr;       /* --genaddr: data written is that address pattern */
+    uint32_t addr_seed; /* seed=S: xor-ed into each address of pattern */
+    struct sg_pat pat;  /* if=pat:PAT, kind SG_PAT_NONE otherwise */
+    int num_streams;    /* streams=N[,MAP] opened on OFILE, 0 -> none */
+    int str_map;        /* SGP_STR_* */
+    uint16_t str_ids[MAX_STREAMS];      /* assigned by STREAM CONTROL */
     int progress;       /* --progress or -p, checked in sig_listen_thread */
+    int interval;       /* interval=SECS, also checked in sig_listen_thread */
     int debug;
     int dry_run;
+    bool do_json;
+    const char * json_arg;      /* carries [JO] from --json[=JO] */
+    const char * rate_arg;      /* rate=BPS[,IOPS] or rate=@FN */
+    bool resume;                /* --resume: continue from ckpt=CFILE */
+    bool ckpt_skip_done;        /* claim_blocks() passes over marked ranges */
+    int ckpt_secs;              /* ckpt=CFILE,SECS, 0 -> only at the end */
+    int64_t ckpt_base;          /* blocks done before this skip and seek */
+    int64_t ckpt_skip;          /* skip, seek and count of original copy */
+    int64_t ckpt_seek;
+    int64_t ckpt_count;
+    int64_t ckpt_chunks;        /* number of bpt sized ranges in ckpt_map */
+    SGP_ATOMIC uint64_t * ckpt_map;     /* bit set when range written */
+    char * ckpt_hex;            /* map line read back by --resume */
+    int verify_mb;              /* verify=MB, 0 -> no read-back verify */
+    struct vfy_stage * vfyp;    /* NULL unless verify=MB given */
+    int num_fan;                /* of2= outputs in fan[] */
+    struct fan_out fan[MAX_FANOUT - 1];
+    int hash_alg;               /* hash=ALG[,MANIFEST], SG_HASH_NONE: off */
+    bool hash_stream;           /* digest of whole input, in block order */
+    FILE * hash_mfp;            /* per range digests, in completion order */
+    int cimg_alg;               /* compress=ALG[,LEVEL], SG_CIMG_NONE: off */
+    int cimg_level;
+    struct sg_cimg_hdr cimg_hdr;        /* of OFILE or (iflag=cimage) IFILE */
+    struct sg_cimg_ent * cimg_ents;     /* one per bpt sized range, filled
+                                         * as frames are written; or IFILE's
+                                         * index */
+    int64_t cimg_num_ents;
+    int64_t cimg_in_blks;       /* iflag=cimage: blocks in IFILE's image */
+    sgj_state json_st;
+    /* Shared state written by the worker threads. in_next is claimed from
+     * by every worker so it has a cache line of its own. */
+    SGP_ATOMIC int64_t in_next SGP_CL_ALIGNED; /* next block offset (from
+                                                * skip) to claim */
+    SGP_ATOMIC int64_t zone_next SGP_CL_ALIGNED; /* next index in zones */
+    SGP_ATOMIC int64_t in_end;      /* lowered from dd_count on short read */
+    SGP_ATOMIC int64_t cimg_next;   /* compress=: file offset of next frame */
+    pthread_mutex_t inout_mutex SGP_CL_ALIGNED;
+    pthread_cond_t out_sync_cv;     /* waiters for in_turn or out_turn */
+    struct sgp_turn in_turn;        /* only used when in_pos < 0 */
+    struct sgp_turn out_turn;       /* only used when out_seq is true */
+    struct sg_rate_lim rate_lim SGP_CL_ALIGNED; /* used by all workers */
+    struct sgp_turn hash_turn SGP_CL_ALIGNED; /* orders hash_ctx updates */
+    struct sg_hash_ctx hash_ctx;
+    pthread_mutex_t hash_mutex; /* serializes lines written to hash_mfp */
 };
 
 struct thread_arg
@@ -195,12 +466,18 @@ typedef struct request_element
     bool in_err;
     bool out_err;
     bool use_no_dxfer;
+    bool share;         /* READ and WRITE share the read side's buffer */
     int infd;
     int outfd;
     int64_t blk;
+    int64_t off;        /* block offset from skip and seek (list index) */
     int num_blks;
+    int in_bytes;       /* > 0 when last block read was partial */
+    int pat_blks;       /* if=pat:PAT, blocks of it already in buffp */
     uint8_t * buffp;
     uint8_t * alloc_bp;
+    int hp_kind;        /* SG_HUGEPAGE_* of alloc_bp */
+    uint64_t start_ns;  /* when sg command submitted, for interval= */
     struct sg_io_hdr io_hdr;
     uint8_t cdb[MAX_SCSI_CDBSZ];
     uint8_t sb[SENSE_BUFF_LEN];
@@ -209,11 +486,49 @@ typedef struct request_element
     int resid;
     int cdbsz_in;
     int cdbsz_out;
+    const struct sg_dde_cdb_tmpl * rd_tmplp;
+    const struct sg_dde_cdb_tmpl * wr_tmplp;
     struct flags_t in_flags;
     struct flags_t out_flags;
     int debug;
     uint32_t pack_id;
-} Rq_elem;
+    uint16_t str_id;    /* > 0: WRITE STREAM(16) with this stream id */
+    struct sg_err_stats * esp;  /* owning (worker or helper) thread's */
+    struct sg_dde_uring * urp;  /* iflag=uring or oflag=uring, per thread */
+    uint8_t * delta_bp; /* oflag=delta: OFILE read back, shared per thread */
+    uint8_t * cimg_bp;  /* compress= or iflag=cimage: frame buffer, and */
+    struct sg_cimg_ctx * czp;   /* compressor, both shared per thread */
+    struct sgp_shard * shp;     /* owning worker thread's counters */
+} SGP_CL_ALIGNED Rq_elem;  /* with qd>1 neighbours complete concurrently */
+
+/* Each worker thread has one of these, and a helper thread per of2=
+ * output, when of2= is given. The worker hands each batch it has read to
+ * its helpers then writes OFILE itself. Its buffers are only re-used for
+ * the next read once refs, the count of writes outstanding on them, has
+ * dropped to zero. */
+struct fan_batch;
+
+struct fan_arg
+{
+    struct fan_batch * fbp;
+    int idx;                    /* into opts_t::fan[] */
+    pthread_t id;
+    struct sg_err_stats * esp;  /* this helper's error statistics */
+};
+
+struct fan_batch
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t cv;          /* signalled on new batch and refs==0 */
+    const Rq_elem * reps;       /* worker's, shared read-only by helpers */
+    const int64_t * offs;
+    int n;
+    unsigned int gen;           /* bumped as each batch is handed out */
+    int refs;                   /* writes outstanding, worker's included */
+    bool err;                   /* some helper failed to write */
+    bool quit;
+    struct fan_arg args[MAX_FANOUT - 1];
+};
 
 static sigset_t signal_set;
 static pthread_t sig_listen_thread_id;
@@ -221,33 +536,36 @@ static pthread_t sig_listen_thread_id;
 static const char * sg_allow_dio = "/sys/module/sg/parameters/allow_dio";
 
 static void sg_in_operation(struct opts_t * clp, Rq_elem * rep);
-static void sg_out_operation(struct opts_t * clp, Rq_elem * rep,
-                             bool bump_out_blk);
+static void sg_in_batch(struct opts_t * clp, Rq_elem * reps, int n);
+static void sg_out_batch(struct opts_t * clp, Rq_elem * reps, int n);
+static void sg_out_operation(struct opts_t * clp, Rq_elem * rep);
 static void normal_in_operation(struct opts_t * clp, Rq_elem * rep,
                                 int blocks);
 static void normal_out_operation(struct opts_t * clp, Rq_elem * rep,
-                                 int blocks, bool bump_out_blk);
+                                 int blocks);
+static int normal_in_batch(struct opts_t * clp, Rq_elem * reps, int n);
+static int normal_out_batch(struct opts_t * clp, Rq_elem * reps, int n);
 static int sg_start_io(Rq_elem * rep);
 static int sg_finish_io(bool wr, Rq_elem * rep, pthread_mutex_t * a_mutp);
 static bool check_progress(struct opts_t * clp);
+static bool ckpt_test(struct opts_t * clp, int64_t idx);
 
 #ifdef HAVE_C11_ATOMICS
 
-/* Assume initialized to 0, but want to start at 1, hence adding 1 in macro */
-static atomic_uint ascending_val;
+/* Assume initialized to 0, but want to start at 1, hence adding 1 in macro.
+ * Bumped for each command so kept apart from exit_threads which every
+ * worker polls. */
+static atomic_uint ascending_val SGP_CL_ALIGNED;
 
-static atomic_uint num_eintr;
-static atomic_uint num_eagain;
-static atomic_uint num_ebusy;
-static atomic_bool exit_threads;
+static atomic_bool exit_threads SGP_CL_ALIGNED;
 
 #define GET_NEXT_PACK_ID(_v) (atomic_fetch_add(&ascending_val, _v) + (_v))
 
 #else
 
 static pthread_mutex_t av_mut = PTHREAD_MUTEX_INITIALIZER;
-static int ascending_val = 1;
-static volatile bool exit_threads;
+static int ascending_val SGP_CL_ALIGNED = 1;
+static volatile bool exit_threads SGP_CL_ALIGNED;
 
 static unsigned int
 GET_NEXT_PACK_ID(unsigned int val)
@@ -269,6 +587,13 @@ static pthread_mutex_t strerr_mut = PTHREAD_MUTEX_INITIALIZER;
 
 static pthread_t threads[MAX_NUM_THREADS];
 static struct thread_arg thr_arg_a[MAX_NUM_THREADS];
+/* Error statistics, num_fan + 1 per worker thread: the worker's own then
+ * one for each of its of2= helper threads */
+static struct sg_err_stats * err_stats_a;
+static int num_err_stats;
+/* Counters, one shard per worker thread */
+static struct sgp_shard * shard_a;
+static int num_shards;
 
 static bool shutting_down = false;
 static bool do_sync = false;
@@ -276,14 +601,90 @@ static bool do_time = false;
 static bool start_tm_valid = false;
 static struct opts_t my_opts;
 static struct timeval start_tm;
+static struct sg_cpu_snap start_cpu;   /* valid when time=1 */
 static int64_t dd_count = -1;
 static int exit_status = 0;
 static char infn[INOUTF_SZ];
 static char outfn[INOUTF_SZ];
+static char ckptfn[INOUTF_SZ];
+static char hashfn[INOUTF_SZ];
+static struct vfy_stage vfy_st;
 
 static const char * my_name = "sgp_dd: ";
 
 
+/* Adds val to a counter in the calling worker thread's shard. Only that
+ * thread writes the counter so a plain load and store will do, with no
+ * locked read-modify-write; readers in other threads see either value. */
+static void
+shard_add64(SGP_ATOMIC int64_t * vp, int64_t val)
+{
+#ifdef HAVE_C11_ATOMICS
+    atomic_store_explicit(vp, atomic_load_explicit(vp, memory_order_relaxed)
+                          + val, memory_order_relaxed);
+#else
+    *vp += val;
+#endif
+}
+
+static void
+shard_add(SGP_ATOMIC int * vp, int val)
+{
+#ifdef HAVE_C11_ATOMICS
+    atomic_store_explicit(vp, atomic_load_explicit(vp, memory_order_relaxed)
+                          + val, memory_order_relaxed);
+#else
+    *vp += val;
+#endif
+}
+
+/* Sums the counters of all the shards into *tp */
+static void
+shards_sum(struct sgp_shard * tp)
+{
+    int k;
+    int64_t in_blks = 0;
+    int64_t out_blks = 0;
+    int64_t same_blks = 0;
+    int in_part = 0;
+    int out_part = 0;
+    int dio_inc = 0;
+    int resids = 0;
+    int64_t cpu_ns = 0;
+    const struct sgp_shard * shp;
+
+    for (k = 0; k < num_shards; ++k) {
+        shp = shard_a + k;
+        in_blks += shp->in_blks;
+        out_blks += shp->out_blks;
+        same_blks += shp->same_blks;
+        in_part += shp->in_partial;
+        out_part += shp->out_partial;
+        dio_inc += shp->dio_incomplete_count;
+        resids += shp->sum_of_resids;
+        cpu_ns += shp->cpu_ns;
+    }
+    memset(tp, 0, sizeof(*tp));
+    tp->in_blks = in_blks;
+    tp->out_blks = out_blks;
+    tp->same_blks = same_blks;
+    tp->in_partial = in_part;
+    tp->out_partial = out_part;
+    tp->dio_incomplete_count = dio_inc;
+    tp->sum_of_resids = resids;
+    tp->cpu_ns = cpu_ns;
+}
+
+/* Count of out blocks remaining */
+static int64_t
+out_rem(const struct opts_t * clp)
+{
+    struct sgp_shard t;
+
+    shards_sum(&t);
+    return clp->out_rem_count - t.out_blks;
+}
+
 /* Note that duration measurements may be effected by "discontinuous jumps
  * in the system time". */
 static void
@@ -301,7 +702,7 @@ calc_duration_throughput(bool contin)
 
     f[0] = '\0';
     if (start_tm_valid && (start_tm.tv_sec || start_tm.tv_usec)) {
-        blks = dd_count - my_opts.out_rem_count;
+        blks = dd_count - out_rem(&my_opts);
         blk_sz = my_opts.bs;
         gettimeofday(&end_tm, NULL);
         res_tm.tv_sec = end_tm.tv_sec - start_tm.tv_sec;
@@ -391,7 +792,7 @@ calc_duration_throughput(bool contin)
     }
     a = res_tm.tv_sec;
     a += (0.000001 * res_tm.tv_usec);
-    b = (double)my_opts.bs * (dd_count - my_opts.out_rem_count);
+    b = (double)my_opts.bs * (dd_count - out_rem(&my_opts));
     pr2serr("time to transfer data %s %d.%06d secs",
             (contin ? "so far" : "was"), (int)res_tm.tv_sec,
             (int)res_tm.tv_usec);
@@ -405,18 +806,23 @@ calc_duration_throughput(bool contin)
 static void
 print_stats(const char * str)
 {
-    int64_t infull, outfull;
-
-    if (0 != my_opts.out_rem_count)
-        pr2serr("  remaining block count=%" PRId64 "\n",
-                my_opts.out_rem_count);
-    infull = dd_count - my_opts.in_rem_count;
+    int64_t infull, outfull, out_rem_count;
+    struct sgp_shard t;
+
+    shards_sum(&t);
+    out_rem_count = my_opts.out_rem_count - t.out_blks;
+    if (0 != out_rem_count)
+        pr2serr("  remaining block count=%" PRId64 "\n", out_rem_count);
+    infull = dd_count - (my_opts.in_rem_count - t.in_blks);
     pr2serr("%s%" PRId64 "+%d records in\n", str,
-            infull - my_opts.in_partial, my_opts.in_partial);
+            infull - t.in_partial, (int)t.in_partial);
 
-    outfull = dd_count - my_opts.out_rem_count;
+    outfull = dd_count - out_rem_count;
     pr2serr("%s%" PRId64 "+%d records out\n", str,
-            outfull - my_opts.out_partial, my_opts.out_partial);
+            outfull - t.out_partial, (int)t.out_partial);
+    if (my_opts.out_flags.delta)
+        pr2serr("%s%" PRId64 " of those already in OFILE so not written\n",
+                str, (int64_t)t.same_blks);
 }
 
 static void
@@ -445,6 +851,79 @@ siginfo_handler(int sig)
     print_stats("  ");
 }
 
+/* Merges the error statistics of all threads into *esp. Adds verify=MB
+ * miscompares in as the miscompare sense category. */
+static void
+err_stats_merge(struct opts_t * clp, struct sg_err_stats * esp)
+{
+    int k;
+
+    memset(esp, 0, sizeof(*esp));
+    for (k = 0; k < num_err_stats; ++k)
+        sg_err_stats_merge(esp, err_stats_a + k);
+    if (clp->vfyp)
+        esp->cat[SG_LIB_CAT_MISCOMPARE] += clp->vfyp->miscompares;
+}
+
+/* Number of commands completed so far, over all threads */
+static uint64_t
+err_stats_cmds(void)
+{
+    int k;
+    uint64_t n = 0;
+
+    for (k = 0; k < num_err_stats; ++k)
+        n += SG_ERR_STATS_LD(err_stats_a[k].cmds);
+    return n;
+}
+
+/* CPU cost of the copy so far, from the snapshot taken at its start. The
+ * thread time is that of the worker threads that have finished. Returns
+ * false if time=1 was not given or no snapshot is available. */
+static bool
+cpu_cost_so_far(struct opts_t * clp, struct sg_cpu_cost * cp)
+{
+    struct sg_cpu_snap now;
+    struct sgp_shard t;
+
+    if (! start_cpu.valid)
+        return false;
+    sg_cpu_snap(&now);
+    if (! sg_cpu_cost(&start_cpu, &now, (uint64_t)clp->bs *
+                      (dd_count - out_rem(clp)), err_stats_cmds(), cp))
+        return false;
+    shards_sum(&t);
+    cp->thr_secs = (double)t.cpu_ns / 1000000000.0;
+    return true;
+}
+
+/* Outputs the merged error statistics to stderr, each line starting with
+ * leadin. With --json they are also output as an "error_statistics"
+ * object on one line, to stdout (or stderr if OFILE is stdout), together
+ * with a "cpu_cost" object when time=1 is given. */
+static void
+err_stats_report(struct opts_t * clp, const char * leadin)
+{
+    sgj_state * jsp = &clp->json_st;
+    sgj_opaque_p jop;
+    struct sg_err_stats es;
+    struct sg_cpu_cost cc;
+
+    err_stats_merge(clp, &es);
+    sg_err_stats_pr(&es, leadin);
+    if (clp->do_json) {
+        FILE * fp = (STDOUT_FILENO == clp->outfd) ? stderr : stdout;
+
+        jop = sgj_start_r(NULL, NULL, 0, NULL, jsp);
+        sg_err_stats_js(jsp, jop, "error_statistics", &es);
+        if (cpu_cost_so_far(clp, &cc))
+            sg_cpu_cost_js(jsp, jop, "cpu_cost", &cc);
+        sgj_js2file(jsp, NULL, 0, fp);
+        sgj_finish(jsp);
+        fflush(fp);
+    }
+}
+
 static void
 install_handler(int sig_num, void (*sig_handler) (int sig))
 {
@@ -496,309 +975,2844 @@ tsafe_strerror(int code, char * ebp)
     } while (0)
 
 
-static int
-dd_filetype(const char * filename)
+static bool
+threads_exiting(void)
 {
-    struct stat st;
-    size_t len = strlen(filename);
-
-    if ((1 == len) && ('.' == filename[0]))
-        return FT_DEV_NULL;
-    if (stat(filename, &st) < 0)
-        return FT_ERROR;
-    if (S_ISCHR(st.st_mode)) {
-        if ((MEM_MAJOR == major(st.st_rdev)) &&
-            (DEV_NULL_MINOR_NUM == minor(st.st_rdev)))
-            return FT_DEV_NULL;
-        if (RAW_MAJOR == major(st.st_rdev))
-            return FT_RAW;
-        if (SCSI_GENERIC_MAJOR == major(st.st_rdev))
-            return FT_SG;
-        if (SCSI_TAPE_MAJOR == major(st.st_rdev))
-            return FT_ST;
-    } else if (S_ISBLK(st.st_mode))
-        return FT_BLOCK;
-    return FT_OTHER;
+#ifdef HAVE_C11_ATOMICS
+    return atomic_load(&exit_threads);
+#else
+    return exit_threads;
+#endif
+}
+
+/* Adds val to *vp, returning the value prior to the addition */
+static int64_t
+blk_fetch_add(SGP_ATOMIC int64_t * vp, int64_t val)
+{
+#ifdef HAVE_C11_ATOMICS
+    return atomic_fetch_add(vp, val);
+#else
+    int64_t res;
+
+    pthread_mutex_lock(&av_mut);
+    res = *vp;
+    *vp += val;
+    pthread_mutex_unlock(&av_mut);
+    return res;
+#endif
 }
 
 static void
-usage()
+wake_turn_waiters(struct opts_t * clp)
 {
-    pr2serr("Usage: sgp_dd  [bs=BS] [count=COUNT] [ibs=BS] [if=IFILE]"
-            " [iflag=FLAGS]\n"
-            "               [obs=BS] [of=OFILE] [oflag=FLAGS] "
-            "[seek=SEEK] [skip=SKIP]\n"
-            "               [--help] [--version]\n\n");
-    pr2serr("               [bpt=BPT] [cdbsz=6|10|12|16] [coe=0|1] "
-            "[deb=VERB] [dio=0|1]\n"
-            "               [fua=0|1|2|3] [sync=0|1] [thr=THR] "
-            "[time=0|1] [verbose=VERB]\n"
-            "               [--dry-run] [--progress] [--verbose]\n"
-            "  where:\n"
-            "    bpt         is blocks_per_transfer (default is 128)\n"
-            "    bs          must be device logical block size (default "
-            "512)\n"
-            "    cdbsz       size of SCSI READ or WRITE cdb (default is 10)\n"
-            "    coe         continue on error, 0->exit (def), "
-            "1->zero + continue\n"
-            "    count       number of blocks to copy (def: device size)\n"
-            "    deb         for debug, 0->none (def), > 0->varying degrees "
-            "of debug\n");
-    pr2serr("    dio         is direct IO, 1->attempt, 0->indirect IO (def)\n"
-            "    fua         force unit access: 0->don't(def), 1->OFILE, "
-            "2->IFILE,\n"
-            "                3->OFILE+IFILE\n"
-            "    if          file or device to read from (def: stdin)\n"
-            "    iflag       comma separated list from: [coe,dio,direct,dpo,"
-            "dsync,excl,\n"
-            "                fua,mmap,null]\n"
-            "    of          file or device to write to (def: stdout), "
-            "OFILE of '.'\n"
-            "                treated as /dev/null\n"
-            "    oflag       comma separated list from: [append,coe,dio,"
-            "direct,dpo,\n"
-            "                dsync,excl,fua,mmap,null]\n"
-            "    seek        block position to start writing to OFILE\n"
-            "    skip        block position to start reading from IFILE\n"
-            "    sync        0->no sync(def), 1->SYNCHRONIZE CACHE on OFILE "
-            "after copy\n"
-            "    thr         is number of threads, must be > 0, default 4, "
-            "max 1024\n"
-            "    time        0->no timing(def), 1->time plus calculate "
-            "throughput\n"
-            "    verbose     same as 'deb=VERB': increase verbosity\n"
-            "    --chkaddr|-c    check read data contains blk address\n"
-            "    --dry-run|-d    prepare but bypass copy/read\n"
-            "    --help|-h      output this usage message then exit\n"
-            "    --progress|-p    outputs progress report every 2 minutes\n"
-            "    --verbose|-v   increase verbosity of utility\n"
-            "    --version|-V   output version string then exit\n"
-            "Copy from IFILE to OFILE, similar to dd command\n"
-            "specialized for SCSI devices, uses multiple POSIX threads\n");
+    int status;
+
+    status = pthread_mutex_lock(&clp->inout_mutex);
+    if (0 != status) err_exit(status, "lock inout_mutex");
+    status = pthread_cond_broadcast(&clp->out_sync_cv);
+    if (0 != status) err_exit(status, "broadcast out_sync_cv");
+    status = pthread_mutex_unlock(&clp->inout_mutex);
+    if (0 != status) err_exit(status, "unlock inout_mutex");
+}
+
+/* LBA on IFILE of the block at offset off from skip, either skip=SKIP
+ * plus offset or taken from skip=SGL. */
+static int64_t
+in_lba(const struct opts_t * clp, int64_t off)
+{
+    if (clp->i_sgl.num_elems > 0)
+        return sg_sgl_idx_to_lba(&clp->i_sgl, off, NULL);
+    return clp->skip + off;
+}
+
+static int64_t
+out_lba(const struct opts_t * clp, int64_t off)
+{
+    if (clp->o_sgl.num_elems > 0)
+        return sg_sgl_idx_to_lba(&clp->o_sgl, off, NULL);
+    return clp->seek + off;
 }
 
+/* iflag=extents: builds skip= and seek= lists holding only the extents of
+ * IFILE that GET LBA STATUS reports as mapped, so deallocated ranges are
+ * neither read nor written. When IFILE doesn't support that command the
+ * whole range is copied. Returns 0 or an error that should stop the copy. */
 static int
-sgp_mem_mmap(int fd, int res_sz, uint8_t ** mmpp)
+extents_setup(struct opts_t * clp, int64_t skip, int64_t seek,
+              int64_t * countp)
 {
-    int t;
+    int k, res;
+    const struct sg_sgl_elem * ep;
 
-    if (ioctl(fd, SG_GET_RESERVED_SIZE, &t) < 0) {
-        perror("SG_GET_RESERVED_SIZE error");
-        return -1;
+    if (FT_SG != clp->in_type) {
+        pr2serr("iflag=extents needs IFILE to be a sg device, ignored\n");
+        return 0;
     }
-    if (t < (int)sg_get_page_size())
-        t = sg_get_page_size();
-    if (res_sz > t) {
-        if (ioctl(fd, SG_SET_RESERVED_SIZE, &res_sz) < 0) {
-            perror("SG_SET_RESERVED_SIZE error");
-            return -1;
-        }
+    res = sg_sgl_from_lba_status(&clp->i_sgl, clp->infd, skip, *countp,
+                                 clp->debug);
+    if (res) {
+        char b[80];
+
+        sg_get_category_sense_str(res, sizeof(b), b, clp->debug);
+        pr2serr("iflag=extents: GET LBA STATUS: %s, copying whole range\n",
+                b);
+        sg_sgl_free(&clp->i_sgl);
+        return 0;
     }
-    *mmpp = (uint8_t *)mmap(NULL, res_sz,
-                            PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-    if (MAP_FAILED == *mmpp) {
-        perror("mmap() failed");
-        return -1;
+    for (k = 0; k < clp->i_sgl.num_elems; ++k) {
+        ep = clp->i_sgl.elems + k;
+        if (! sg_sgl_append(&clp->o_sgl, ep->lba - skip + seek, ep->num))
+            return sg_convert_errno(ENOMEM);
     }
+    if (! sg_sgl_sum_scan(&clp->o_sgl))
+        return sg_convert_errno(ENOMEM);
+    clp->ext_count = *countp;
+    clp->sgl_active = true;
+    *countp = clp->i_sgl.sum;
+    pr2serr("iflag=extents: %d mapped extent%s, copying %" PRId64 " of %"
+            PRId64 " blocks\n", clp->i_sgl.num_elems,
+            (1 == clp->i_sgl.num_elems) ? "" : "s", *countp,
+            clp->ext_count);
+    if (clp->debug > 1)
+        sg_sgl_print(&clp->i_sgl, "extents", (clp->debug > 2), stderr);
     return 0;
 }
 
-/* Return of 0 -> success, see sg_ll_read_capacity*() otherwise */
+#define ZONES_RESP_LEN (64 * 1024)
+#define ZONE_DESC_LEN 64
+
+/* oflag=zoned: builds opts_t::zones for the count blocks of OFILE starting
+ * at seek, with REPORT ZONES. Each sequential write required zone in that
+ * range must have its write pointer where the copy starts writing it (i.e.
+ * at seek for the first zone and at the zone start for the others). Returns
+ * 0 or an error that should stop the copy. */
 static int
-scsi_read_capacity(int sg_fd, int64_t * num_sect, int * sect_sz)
+zones_setup(struct opts_t * clp, int64_t seek, int64_t count)
 {
-    int res;
-    uint8_t rcBuff[RCAP16_REPLY_LEN];
-
-    res = sg_ll_readcap_10(sg_fd, 0, 0, rcBuff, READ_CAP_REPLY_LEN, false, 0);
-    if (0 != res)
-        return res;
-
-    if ((0xff == rcBuff[0]) && (0xff == rcBuff[1]) && (0xff == rcBuff[2]) &&
-        (0xff == rcBuff[3])) {
-
-        res = sg_ll_readcap_16(sg_fd, 0, 0, rcBuff, RCAP16_REPLY_LEN, false,
-                               0);
-        if (0 != res)
-            return res;
-        *num_sect = sg_get_unaligned_be64(rcBuff + 0) + 1;
-        *sect_sz = sg_get_unaligned_be32(rcBuff + 8);
-    } else {
-        /* take care not to sign extend values > 0x7fffffff */
-        *num_sect = (int64_t)sg_get_unaligned_be32(rcBuff + 0) + 1;
-        *sect_sz = sg_get_unaligned_be32(rcBuff + 4);
+    int k, n, res, resid, zt;
+    int num_swr = 0;
+    int max_zones = 0;
+    int64_t zs_lba, zn_len, wp, from;
+    int64_t lba = seek;
+    int64_t end_lba = seek + count;
+    uint8_t * buf;
+    uint8_t * free_buf;
+    const uint8_t * bp;
+    struct sgp_zone * zp;
+    char b[80];
+
+    if (FT_SG != clp->out_type) {
+        pr2serr("oflag=zoned needs OFILE to be a sg device\n");
+        return SG_LIB_CONTRADICT;
     }
-    return 0;
+    buf = sg_memalign(ZONES_RESP_LEN, 0, &free_buf, false);
+    if (NULL == buf)
+        return sg_convert_errno(ENOMEM);
+    res = 0;
+    while (lba < end_lba) {
+        res = sg_ll_report_zones(clp->outfd, (uint64_t)lba, true, 0, buf,
+                                 ZONES_RESP_LEN, &resid, true, clp->debug);
+        if (res) {
+            sg_get_category_sense_str(res, sizeof(b), b, clp->debug);
+            pr2serr("oflag=zoned: REPORT ZONES: %s\n", b);
+            goto fini;
+        }
+        n = (ZONES_RESP_LEN - resid - ZONE_DESC_LEN) / ZONE_DESC_LEN;
+        if (n < 1)
+            break;
+        for (k = 0, bp = buf + ZONE_DESC_LEN; (k < n) && (lba < end_lba);
+             ++k, bp += ZONE_DESC_LEN) {
+            zt = bp[0] & 0xf;
+            zn_len = (int64_t)sg_get_unaligned_be64(bp + 8);
+            zs_lba = (int64_t)sg_get_unaligned_be64(bp + 16);
+            wp = (int64_t)sg_get_unaligned_be64(bp + 24);
+            if ((zn_len <= 0) || (zs_lba + zn_len <= lba))
+                continue;
+            from = (zs_lba > seek) ? zs_lba : seek;
+            if (2 == zt) {      /* sequential write required */
+                ++num_swr;
+                if (wp != from) {
+                    pr2serr("oflag=zoned: zone 0x%" PRIx64 " has its write "
+                            "pointer at 0x%" PRIx64 ", the copy would write "
+                            "from 0x%" PRIx64 "\n", (uint64_t)zs_lba,
+                            (uint64_t)wp, (uint64_t)from);
+                    res = SG_LIB_CONTRADICT;
+                    goto fini;
+                }
+            }
+            if (clp->num_zones >= max_zones) {
+                max_zones = max_zones ? (2 * max_zones) : 1024;
+                zp = (struct sgp_zone *)realloc(clp->zones,
+                                                max_zones * sizeof(*zp));
+                if (NULL == zp) {
+                    res = sg_convert_errno(ENOMEM);
+                    goto fini;
+                }
+                clp->zones = zp;
+            }
+            zp = clp->zones + clp->num_zones++;
+            zp->off = from - seek;
+            lba = zs_lba + zn_len;
+            zp->end = ((lba < end_lba) ? lba : end_lba) - seek;
+        }
+    }
+    if ((0 == res) && (lba < end_lba)) {
+        pr2serr("oflag=zoned: no zone reported at LBA 0x%" PRIx64 "\n",
+                (uint64_t)lba);
+        res = SG_LIB_LBA_OUT_OF_RANGE;
+    }
+    if ((0 == res) && clp->debug)
+        pr2serr("oflag=zoned: %d zones (%d sequential write required) to "
+                "be written, up to %d at once\n", clp->num_zones, num_swr,
+                clp->num_threads);
+fini:
+    free(free_buf);
+    return res;
 }
 
-/* Return of 0 -> success, -1 -> failure. BLKGETSIZE64, BLKGETSIZE and */
-/* BLKSSZGET macros problematic (from <linux/fs.h> or <sys/mount.h>). */
+/* Number of blocks, up to bpt, from offset off to the nearer end of a
+ * skip= or seek= list element. */
 static int
-read_blkdev_capacity(int sg_fd, int64_t * num_sect, int * sect_sz)
+sgl_span(const struct opts_t * clp, int64_t off)
 {
-#ifdef BLKSSZGET
-    if ((ioctl(sg_fd, BLKSSZGET, sect_sz) < 0) && (*sect_sz > 0)) {
-        perror("BLKSSZGET ioctl error");
-        return -1;
-    } else {
- #ifdef BLKGETSIZE64
-        uint64_t ull;
-
-        if (ioctl(sg_fd, BLKGETSIZE64, &ull) < 0) {
+    int rem;
+    int n = clp->bpt;
+
+    if ((clp->i_sgl.num_elems > 0) &&
+        (sg_sgl_idx_to_lba(&clp->i_sgl, off, &rem) >= 0) && (rem < n))
+        n = rem;
+    if ((clp->o_sgl.num_elems > 0) &&
+        (sg_sgl_idx_to_lba(&clp->o_sgl, off, &rem) >= 0) && (rem < n))
+        n = rem;
+    return n;
+}
 
-            perror("BLKGETSIZE64 ioctl error");
-            return -1;
-        }
-        *num_sect = ((int64_t)ull / (int64_t)*sect_sz);
- #else
-        unsigned long ul;
+/* With scatter gather lists claims can be shorter than bpt so the claimed
+ * size depends on where the claim starts. Returns the offset claimed and
+ * places its size in *np. */
+static int64_t
+sgl_claim(struct opts_t * clp, int * np)
+{
+    int64_t off;
 
-        if (ioctl(sg_fd, BLKGETSIZE, &ul) < 0) {
-            perror("BLKGETSIZE ioctl error");
-            return -1;
-        }
-        *num_sect = (int64_t)ul;
- #endif
-    }
-    return 0;
+#ifdef HAVE_C11_ATOMICS
+    off = atomic_load(&clp->in_next);
+    do {
+        *np = sgl_span(clp, off);
+    } while (! atomic_compare_exchange_weak(&clp->in_next, &off,
+                                            off + *np));
 #else
-    *num_sect = 0;
-    *sect_sz = 0;
-    return -1;
+    pthread_mutex_lock(&av_mut);
+    off = clp->in_next;
+    *np = sgl_span(clp, off);
+    clp->in_next += *np;
+    pthread_mutex_unlock(&av_mut);
 #endif
+    return off;
 }
 
-static void *
-sig_listen_thread(void * v_clp)
+/* Claims the next range of (up to bpt) blocks. Places the block offset
+ * (relative to skip and seek) of that range in *offp and returns the
+ * number of blocks in it. Returns 0 when there is nothing left to claim. */
+static int
+claim_blocks(struct opts_t * clp, volatile int64_t * offp)
 {
-    int sig_number;
-    struct opts_t * clp = (struct opts_t *)v_clp;
-    struct timespec ts;
-    siginfo_t info;
-
-    ts.tv_sec = 0;
-    ts.tv_nsec = 200 * 1000 * 1000;
+    int n;
+    int64_t off, rem;
 
     while (true) {
-        sig_number = sigtimedwait(&signal_set, &info, &ts);
-        if (shutting_down)
-            break;
-        if ((sig_number < 0) && (EAGAIN == errno)) {    /* time out */
-            if (clp->progress > 0) {
-                if (check_progress(clp)) {
-                    calc_duration_throughput(true);
-                    print_stats("");
-                }
-            }
-        }
-        if (SIGINT == sig_number) {
-            pr2serr("%sinterrupted by SIGINT\n", my_name);
-#ifdef HAVE_C11_ATOMICS
-            atomic_store(&exit_threads, true);
-#else
-            exit_threads = true;
-#endif
-            pthread_cond_broadcast(&clp->out_sync_cv);
+        if (clp->sgl_active)
+            off = sgl_claim(clp, &n);
+        else {
+            n = clp->bpt;
+            off = blk_fetch_add(&clp->in_next, n);
         }
+        rem = clp->in_end - off;
+        if (rem <= 0)
+            return 0;
+        /* when resuming, pass over ranges written by the previous run */
+        if (! (clp->ckpt_skip_done && ckpt_test(clp, off / clp->bpt)))
+            break;
     }
-    return NULL;
+    *offp = off;
+    return (rem > n) ? n : (int)rem;
 }
 
-static void
-cleanup_in(void * v_clp)
+/* oflag=zoned version of claim_blocks(). Continues in the zone given by
+ * zcp until its end, then claims the next unclaimed zone. */
+static int
+zone_claim_blocks(struct opts_t * clp, struct zone_cur * zcp,
+                  volatile int64_t * offp)
 {
-    struct opts_t * clp = (struct opts_t *)v_clp;
+    int64_t end, rem;
 
-    pr2serr("thread cancelled while in mutex held\n");
-    pthread_mutex_unlock(&clp->inout_mutex);
-    pthread_cond_broadcast(&clp->out_sync_cv);
+    while ((zcp->idx < 0) || (zcp->off >= clp->zones[zcp->idx].end)) {
+        zcp->idx = blk_fetch_add(&clp->zone_next, 1);
+        if (zcp->idx >= clp->num_zones)
+            return 0;
+        zcp->off = clp->zones[zcp->idx].off;
+    }
+    end = clp->zones[zcp->idx].end;
+    if (end > clp->in_end)
+        end = clp->in_end;
+    rem = end - zcp->off;
+    if (rem <= 0)
+        return 0;       /* input ended before this zone */
+    *offp = zcp->off;
+    if (rem > clp->bpt)
+        rem = clp->bpt;
+    zcp->off += rem;
+    return (int)rem;
 }
 
+/* Called when a read comes up short (e.g. EOF) so that no blocks at or
+ * beyond end are claimed or waited on. */
 static void
-cleanup_out(void * v_clp)
+lower_in_end(struct opts_t * clp, int64_t end)
 {
-    struct opts_t * clp = (struct opts_t *)v_clp;
-
-    pr2serr("thread cancelled while out mutex held\n");
-    pthread_mutex_unlock(&clp->inout_mutex);
-    pthread_cond_broadcast(&clp->out_sync_cv);
-}
+#ifdef HAVE_C11_ATOMICS
+    int64_t cur = atomic_load(&clp->in_end);
 
-static int
+    while ((end < cur) &&
+           (! atomic_compare_exchange_weak(&clp->in_end, &cur, end)))
+        ;
+#else
+    pthread_mutex_lock(&av_mut);
+    if (end < clp->in_end)
+        clp->in_end = end;
+    pthread_mutex_unlock(&av_mut);
+#endif
+    wake_turn_waiters(clp);
+}
+
+/* Waits until it is the turn of the transfer at block offset off. Returns
+ * true when that is so, false if the copy is being stopped or off is past
+ * the point where the input ended. */
+static bool
+wait_turn(struct opts_t * clp, struct sgp_turn * tp, int64_t off)
+{
+    bool ok;
+    int status;
+
+    if (tp->next == off)
+        return true;
+    status = pthread_mutex_lock(&clp->inout_mutex);
+    if (0 != status) err_exit(status, "lock inout_mutex");
+#ifdef HAVE_C11_ATOMICS
+    atomic_fetch_add(&tp->waiters, 1);
+#else
+    ++tp->waiters;
+#endif
+    while ((tp->next != off) && (off < clp->in_end) &&
+           (! threads_exiting())) {
+        status = pthread_cond_wait(&clp->out_sync_cv, &clp->inout_mutex);
+        if (0 != status) err_exit(status, "cond out_sync_cv");
+    }
+#ifdef HAVE_C11_ATOMICS
+    atomic_fetch_sub(&tp->waiters, 1);
+#else
+    --tp->waiters;
+#endif
+    ok = (tp->next == off);
+    status = pthread_mutex_unlock(&clp->inout_mutex);
+    if (0 != status) err_exit(status, "unlock inout_mutex");
+    return ok;
+}
+
+/* Hands the turn on to the transfer starting at block offset next_off.
+ * Only takes the mutex when some other thread is waiting. */
+static void
+advance_turn(struct opts_t * clp, struct sgp_turn * tp, int64_t next_off)
+{
+#ifdef HAVE_C11_ATOMICS
+    atomic_store(&tp->next, next_off);
+    if (atomic_load(&tp->waiters) > 0)
+        wake_turn_waiters(clp);
+#else
+    int status;
+
+    status = pthread_mutex_lock(&clp->inout_mutex);
+    if (0 != status) err_exit(status, "lock inout_mutex");
+    tp->next = next_off;
+    if (tp->waiters > 0)
+        pthread_cond_broadcast(&clp->out_sync_cv);
+    status = pthread_mutex_unlock(&clp->inout_mutex);
+    if (0 != status) err_exit(status, "unlock inout_mutex");
+#endif
+}
+
+/* Parses a list of CPU numbers such as "0-3,8,10-11" into cpus[]. Returns
+ * the number of CPUs placed in cpus[] or -1 if there is a syntax error. */
+static int
+parse_cpu_list(const char * cp, int * cpus, int max_cpus)
+{
+    int k, lo, hi, n;
+    char * ep;
+
+    for (n = 0; *cp; ) {
+        lo = (int)strtol(cp, &ep, 10);
+        if ((ep == cp) || (lo < 0))
+            return -1;
+        hi = lo;
+        if ('-' == *ep) {
+            cp = ep + 1;
+            hi = (int)strtol(cp, &ep, 10);
+            if ((ep == cp) || (hi < lo))
+                return -1;
+        }
+        for (k = lo; (k <= hi) && (n < max_cpus); ++k)
+            cpus[n++] = k;
+        if (',' == *ep)
+            ++ep;
+        else if (('\0' != *ep) && ('\n' != *ep))
+            return -1;
+        else
+            break;
+        cp = ep;
+    }
+    return n;
+}
+
+/* Returns the NUMA node of the host adapter (or other bus device) that
+ * the device node fname hangs off. The sysfs directory of the device is
+ * walked towards the root until a numa_node attribute is found. Returns
+ * -1 if that can't be determined. */
+static int
+dev_numa_node(const char * fname)
+{
+    int node = -1;
+    char * cp;
+    FILE * fp;
+    struct stat st;
+    char b[PATH_MAX + 16];
+    char path[PATH_MAX];
+
+    if ((stat(fname, &st) < 0) ||
+        ! (S_ISCHR(st.st_mode) || S_ISBLK(st.st_mode)))
+        return -1;
+    snprintf(b, sizeof(b), "/sys/dev/%s/%u:%u/device",
+             S_ISCHR(st.st_mode) ? "char" : "block", major(st.st_rdev),
+             minor(st.st_rdev));
+    if (NULL == realpath(b, path))
+        return -1;
+    while ((cp = strrchr(path, '/')) && (cp > path)) {
+        snprintf(b, sizeof(b), "%s/numa_node", path);
+        if ((fp = fopen(b, "r"))) {
+            if (1 != fscanf(fp, "%d", &node))
+                node = -1;
+            fclose(fp);
+            break;
+        }
+        *cp = '\0';
+    }
+    return node;
+}
+
+/* Places the CPUs belonging to NUMA node 'node' in cpus[]. Returns the
+ * number of CPUs found, 0 if none or the node is unknown. */
+static int
+node_cpu_list(int node, int * cpus, int max_cpus)
+{
+    int n = 0;
+    FILE * fp;
+    char b[128];
+
+    snprintf(b, sizeof(b), "/sys/devices/system/node/node%d/cpulist", node);
+    if (NULL == (fp = fopen(b, "r")))
+        return 0;
+    if (fgets(b, sizeof(b), fp))
+        n = parse_cpu_list(b, cpus, max_cpus);
+    fclose(fp);
+    return (n > 0) ? n : 0;
+}
+
+/* Finds the blk-mq directory in sysfs of the block device fname, or of
+ * the disk behind sg device fname, and places it in dir. Its
+ * subdirectories 0, 1, ... are the hardware queues, each with the
+ * cpu_list that submits on it. Returns the number of hardware queues, 0
+ * if there are none or they can't be found. */
+static int
+dev_hwq_dir(const char * fname, char * dir, int dlen)
+{
+    int n;
+    DIR * dp;
+    struct dirent * dep;
+    struct stat st;
+    char b[128];
+
+    dir[0] = '\0';
+    if (stat(fname, &st) < 0)
+        return 0;
+    if (S_ISBLK(st.st_mode)) {
+        snprintf(dir, dlen, "/sys/dev/block/%u:%u/mq", major(st.st_rdev),
+                 minor(st.st_rdev));
+        if (stat(dir, &st) < 0)         /* partition, use its disk's */
+            snprintf(dir + strlen(dir) - 2, dlen - strlen(dir) + 2,
+                     "../mq");
+    } else if (S_ISCHR(st.st_mode)) {
+        snprintf(b, sizeof(b), "/sys/dev/char/%u:%u/device/block",
+                 major(st.st_rdev), minor(st.st_rdev));
+        if (NULL == (dp = opendir(b)))
+            return 0;
+        while ((dep = readdir(dp))) {
+            if ('.' != dep->d_name[0]) {
+                snprintf(dir, dlen, "%s/%.64s/mq", b, dep->d_name);
+                break;
+            }
+        }
+        closedir(dp);
+    }
+    if (('\0' == dir[0]) || (NULL == (dp = opendir(dir))))
+        return 0;
+    for (n = 0; (dep = readdir(dp)); ) {
+        if (isdigit((uint8_t)dep->d_name[0]))
+            ++n;
+    }
+    closedir(dp);
+    return n;
+}
+
+/* Pins the calling worker thread. With cpus=LIST each worker gets one CPU
+ * from the list, round robin. Otherwise, with hwq=1, worker k may run on
+ * any CPU that submits on hardware queue k (modulo their number), and
+ * with numa=1 on any CPU of the node local to the host adapter. */
+static void
+pin_worker_thread(const struct opts_t * clp, int id)
+{
+    int k, n, status;
+    FILE * fp;
+    cpu_set_t cpuset;
+    char b[PATH_MAX + 32];
+    int cpus[MAX_CPU_LIST];
+
+    CPU_ZERO(&cpuset);
+    if (clp->cpus_given)
+        CPU_SET(clp->cpus[id % clp->num_cpus], &cpuset);
+    else if (clp->num_hwq > 0) {
+        n = 0;
+        snprintf(b, sizeof(b), "%s/%d/cpu_list", clp->hwq_dir,
+                 id % clp->num_hwq);
+        if ((fp = fopen(b, "r"))) {
+            if (fgets(b, sizeof(b), fp))
+                n = parse_cpu_list(b, cpus, MAX_CPU_LIST);
+            fclose(fp);
+        }
+        if (n <= 0) {
+            pr2serr("%sworker thread %d: no cpu_list for hardware queue "
+                    "%d\n", my_name, id, id % clp->num_hwq);
+            return;
+        }
+        for (k = 0; k < n; ++k)
+            CPU_SET(cpus[k], &cpuset);
+    } else {
+        for (k = 0; k < clp->num_cpus; ++k)
+            CPU_SET(clp->cpus[k], &cpuset);
+    }
+    status = pthread_setaffinity_np(pthread_self(), sizeof(cpuset),
+                                    &cpuset);
+    if (0 != status) {
+        char strerr_buff[STRERR_BUFF_LEN + 1];
+
+        pr2serr("%sunable to set affinity of worker thread %d: %s\n",
+                my_name, id, tsafe_strerror(status, strerr_buff));
+    } else if (clp->debug) {
+        if (clp->num_hwq > 0)
+            pr2serr("worker thread %d: running on cpu %d, submits on "
+                    "hardware queue %d\n", id, sched_getcpu(),
+                    id % clp->num_hwq);
+        else if (clp->numa_node >= 0)
+            pr2serr("worker thread %d: running on cpu %d, buffers on numa "
+                    "node %d\n", id, sched_getcpu(), clp->numa_node);
+        else
+            pr2serr("worker thread %d: running on cpu %d\n", id,
+                    sched_getcpu());
+    }
+}
+
+static void
+usage()
+{
+    pr2serr("Usage: sgp_dd  [bs=BS] [count=COUNT] [ibs=BS] [if=IFILE]"
+            " [iflag=FLAGS]\n"
+            "               [obs=BS] [of=OFILE] [of2=OFILE2[,OFILE3...]] "
+            "[oflag=FLAGS]\n"
+            "               [seek=SEEK] [skip=SKIP]\n"
+            "               [--help] [--version]\n\n");
+    pr2serr("               [bpt=BPT|auto] [cdbsz=6|10|12|16] "
+            "[ckpt=CFILE[,SECS]]\n"
+            "               [coe=0|1] [compress=ALG[,LEVEL]] [deb=VERB] "
+            "[dio=0|1]\n"
+            "               [hash=ALG[,MANIFEST]] [fua=0|1|2|3] [cpus=LIST] "
+            "[hwq=0|1]\n"
+            "               [interval=SECS] [numa=0|1] [qd=QD] "
+            "[rate=BPS[,IOPS]] [seed=S]\n"
+            "               [streams=N[,MAP]] [sync=0|1] [thr=THR] "
+            "[time=0|1] [verbose=VERB]\n"
+            "               [verify=MB] [--chkaddr] [--dry-run] [--genaddr] "
+            "[--json[=JO]]\n"
+            "               [--progress] [--resume] [--verbose]\n"
+            "  where:\n"
+            "    bpt         is blocks_per_transfer (default is 128); "
+            "'auto' probes\n"
+            "                sizes up to device limits reading IFILE, "
+            "then settles\n"
+            "    bs          must be device logical block size (default "
+            "512)\n"
+            "    cdbsz       size of SCSI READ or WRITE cdb (default is 10)\n"
+            "    ckpt        checkpoint journal CFILE, rewritten every SECS "
+            "seconds\n"
+            "                (def: 10) and when copy stops; see --resume\n"
+            "    coe         continue on error, 0->exit (def), "
+            "1->zero + continue\n"
+            "    compress    write OFILE as a compressed image, ALG is zstd "
+            "or lz4;\n"
+            "                restore with iflag=cimage\n"
+            "    count       number of blocks to copy (def: device size)\n"
+            "    cpus        pin worker thread k to k-th cpu in LIST "
+            "(e.g. 0-3,8)\n"
+            "    deb         for debug, 0->none (def), > 0->varying degrees "
+            "of debug\n");
+    pr2serr("    dio         is direct IO, 1->attempt, 0->indirect IO (def)\n"
+            "    fua         force unit access: 0->don't(def), 1->OFILE, "
+            "2->IFILE,\n"
+            "                3->OFILE+IFILE\n"
+            "    hash        ALG is crc32c, xxh64 or sha256; digest of data "
+            "read is\n"
+            "                printed at end; MANIFEST gets a digest per "
+            "range\n"
+            "    hwq         0->don't pin (def), 1->pin worker k to the "
+            "cpus of hardware\n"
+            "                queue k of IFILE (or OFILE), own fd with "
+            "uring flag\n"
+            "    if          file or device to read from (def: stdin); "
+            "or pat:PAT\n"
+            "                for generated data: zero, ff, HEX, lba or "
+            "prng[,SEED]\n"
+            "    iflag       comma separated list from: [cimage,coe,dio,"
+            "direct,dpo,dsync,\n"
+            "                excl,extents,fua,hugepage,mmap,null,share,"
+            "uring]\n"
+            "    interval    every SECS seconds report throughput, IOPS and "
+            "latency\n"
+            "                percentiles of that interval (def: 0 -> don't)\n"
+            "    of          file or device to write to (def: stdout), "
+            "OFILE of '.'\n"
+            "                treated as /dev/null\n"
+            "    of2         further outputs (up to 7) written with the same "
+            "data as\n"
+            "                OFILE, from one read of IFILE\n"
+            "    oflag       comma separated list from: [append,coe,delta,"
+            "dio,direct,\n"
+            "                dpo,dsync,excl,fua,hugepage,mmap,null,share,"
+            "uring,zoned]\n"
+            "    numa        1->run workers and place their buffers on "
+            "NUMA node of\n"
+            "                host adapter of IFILE (or OFILE)\n"
+            "    qd          sg commands each thread keeps outstanding "
+            "(def: 1, max 64)\n"
+            "    rate        limit copy to BPS bytes per second and IOPS "
+            "commands\n"
+            "                per second (0 -> no limit); '@FN' reads "
+            "BPS[,IOPS] from\n"
+            "                file FN, re-read on SIGHUP\n"
+            "    seek        block position to start writing to OFILE, or "
+            "a scatter\n"
+            "                gather list: LBA0,NUM0[,LBA1,NUM1...] or "
+            "@FN\n"
+            "    seed        xor-ed into each block address checked by "
+            "--chkaddr or\n"
+            "                placed by --genaddr (def: 0)\n"
+            "    skip        block position to start reading from IFILE, "
+            "or a list\n"
+            "    streams     open N streams on OFILE and write with WRITE "
+            "STREAM(16);\n"
+            "                MAP: thread (def), lba (N slices) or seg "
+            "(seek= list\n"
+            "                elements)\n"
+            "    sync        0->no sync(def), 1->SYNCHRONIZE CACHE on OFILE "
+            "after copy\n"
+            "    thr         is number of threads, must be > 0, default 4, "
+            "max 1024\n"
+            "    time        0->no timing(def), 1->time plus calculate "
+            "throughput\n"
+            "    verbose     same as 'deb=VERB': increase verbosity\n"
+            "    verify      read back (or VERIFY on sg OFILE) each range "
+            "written,\n"
+            "                holding up to MB megabytes of data while "
+            "copying\n"
+            "    --chkaddr|-c    check read data contains blk address\n"
+            "    --dry-run|-d    prepare but bypass copy/read\n"
+            "    --genaddr|-g    write blocks that contain their address, "
+            "replaces IFILE\n"
+            "    --help|-h      output this usage message then exit\n"
+            "    --json[=JO]    interval=SECS reports and error statistics "
+            "are output\n"
+            "                   as JSON lines (to stdout unless OFILE is "
+            "stdout),\n"
+            "                   JO is JSON options\n"
+            "    --progress|-p    outputs progress report every 2 minutes\n"
+            "    --resume|-r    continue the copy recorded in ckpt=CFILE\n"
+            "    --verbose|-v   increase verbosity of utility\n"
+            "    --version|-V   output version string then exit\n"
+            "Copy from IFILE to OFILE, similar to dd command\n"
+            "specialized for SCSI devices, uses multiple POSIX threads\n");
+}
+
+static int
+sgp_mem_mmap(int fd, int res_sz, uint8_t ** mmpp)
+{
+    int bpt = res_sz / my_opts.bs;
+    struct sg_dde_resbuf rb;
+
+    /* main() has already lowered bpt, if need be, so this should fit */
+    if (sg_dde_resbuf_size(fd, my_opts.bs, &bpt, SG_DDE_RB_MMAP, &rb, my_name,
+                           0) || (0 == (SG_DDE_RB_MMAP & rb.got)))
+        return -1;
+    *mmpp = (uint8_t *)mmap(NULL, res_sz,
+                            PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (MAP_FAILED == *mmpp) {
+        perror("mmap() failed");
+        return -1;
+    }
+    return 0;
+}
+
+/* Returns start time of a transfer for lat_add(), 0 if not timing */
+static uint64_t
+lat_start(void)
+{
+    return sg_pt_lat_is_enabled() ? sg_get_mono_ns() : 0;
+}
+
+/* Adds the time since t0_ns of the read (when 'id' is LAT_IN_ID) or write
+ * just completed to this thread's latency histograms. */
+static void
+lat_add(int id, uint64_t t0_ns)
+{
+    /* opcodes of READ(16) and WRITE(16) whatever the transfer method */
+    if (t0_ns)
+        sg_pt_lat_record(id, (LAT_IN_ID == id) ? 0x88 : 0x8a,
+                         SG_PT_LAT_SCSI, sg_get_mono_ns() - t0_ns);
+}
+
+/* Called from sig_listen_thread every 200 milliseconds when interval=SECS
+ * is given. The first call sets the reference. Thereafter, when SECS have
+ * elapsed since the previous report (or 'final' is true), outputs the
+ * throughput, IOPS and latency percentiles of reads and writes, merged
+ * over all worker threads, of that interval. The report is a line to
+ * stderr, or when --json is given a JSON object on one line to stdout (or
+ * stderr if OFILE is stdout). */
+static void
+interval_report(struct opts_t * clp, bool final)
+{
+    int j, k, num;
+    int n = 0;
+    int64_t blks;
+    uint64_t now, cnt;
+    double secs, r;
+    sgj_state * jsp = &clp->json_st;
+    sgj_opaque_p jop = NULL;
+    sgj_opaque_p jo2p;
+    const struct sg_pt_lat_hist * hp;
+    struct sg_pt_lat_hist lat_arr[LAT_ARR_SZ];
+    char b[256];
+    static const int blen = sizeof(b);
+    static const char * side_s[2] = {"in", "out"};
+    uint64_t cmds;
+    struct sg_cpu_snap cpu_now;
+    struct sg_cpu_cost cc;
+    static int count;
+    static int64_t prev_blks;
+    static uint64_t start_ns, prev_ns, prev_cmds;
+    static struct sg_cpu_snap prev_cpu;
+
+    now = sg_get_mono_ns();
+    if (0 == start_ns) {
+        start_ns = now;
+        prev_ns = now;
+        sg_pt_lat_snapshot(lat_arr, 0, true);
+        sg_cpu_snap(&prev_cpu);
+        prev_cmds = err_stats_cmds();
+        return;
+    }
+    if ((! final) &&
+        ((now - prev_ns) < (uint64_t)clp->interval * 1000000000))
+        return;
+    blks = dd_count - out_rem(clp);
+    if (final && (blks == prev_blks))
+        return;         /* nothing new since last report */
+    secs = (double)(now - prev_ns) / 1000000000.0;
+    if (secs < 0.000001)
+        secs = 0.000001;
+    r = ((double)clp->bs * (blks - prev_blks)) / secs;
+    num = sg_pt_lat_snapshot(lat_arr, LAT_ARR_SZ, true);
+    sg_cpu_snap(&cpu_now);
+    cmds = err_stats_cmds();
+    sg_cpu_cost(&prev_cpu, &cpu_now, (uint64_t)clp->bs * (blks - prev_blks),
+                cmds - prev_cmds, &cc);
+    ++count;
+    if (clp->do_json) {
+        jop = sgj_start_r(NULL, NULL, 0, NULL, jsp);
+        sgj_js_nv_i(jsp, jop, "interval", count);
+        sgj_js_nv_i(jsp, jop, "elapsed_ms", (now - start_ns) / 1000000);
+        sgj_js_nv_i(jsp, jop, "interval_ms", (now - prev_ns) / 1000000);
+        sgj_js_nv_i(jsp, jop, "blocks", blks - prev_blks);
+        sgj_js_nv_i(jsp, jop, "bytes_per_second", (int64_t)r);
+    } else
+        n = sg_scnpr(b, blen, "interval %d at %.1f secs: %.2f MB/sec",
+                     count, (double)(now - start_ns) / 1000000000.0,
+                     r / 1000000.0);
+    for (k = 0; k < 2; ++k) {
+        for (hp = NULL, j = 0; j < num; ++j) {
+            if (lat_arr[j].dev_id == (uint64_t)(LAT_IN_ID + k)) {
+                hp = lat_arr + j;
+                break;
+            }
+        }
+        cnt = hp ? hp->count : 0;
+        if (clp->do_json) {
+            jo2p = sgj_named_subobject_r(jsp, jop, side_s[k]);
+            sgj_js_nv_i(jsp, jo2p, "count", cnt);
+            sgj_js_nv_i(jsp, jo2p, "iops", (int64_t)(cnt / secs));
+            sgj_js_nv_i(jsp, jo2p, "p50_ns", sg_pt_lat_percentile(hp, 50.0));
+            sgj_js_nv_i(jsp, jo2p, "p99_ns", sg_pt_lat_percentile(hp, 99.0));
+            sgj_js_nv_i(jsp, jo2p, "p99_9_ns",
+                        sg_pt_lat_percentile(hp, 99.9));
+            sgj_js_nv_i(jsp, jo2p, "max_ns", cnt ? hp->max_ns : 0);
+        } else if (cnt > 0)
+            n += sg_scn3pr(b, blen, n, "; %s %.0f IOPS, lat p50/p99/p99.9 "
+                           "%.1f/%.1f/%.1f us", side_s[k], cnt / secs,
+                           sg_pt_lat_percentile(hp, 50.0) / 1000.0,
+                           sg_pt_lat_percentile(hp, 99.0) / 1000.0,
+                           sg_pt_lat_percentile(hp, 99.9) / 1000.0);
+    }
+    if (clp->do_json) {
+        FILE * fp = (STDOUT_FILENO == clp->outfd) ? stderr : stdout;
+
+        if (cpu_now.valid)
+            sg_cpu_cost_js(jsp, jop, "cpu_cost", &cc);
+        sgj_js2file(jsp, NULL, 0, fp);
+        sgj_finish(jsp);
+        fflush(fp);
+    } else {
+        if (cpu_now.valid) {
+            char c[80];
+
+            sg_scn3pr(b, blen, n, "; %s",
+                      sg_cpu_cost_str(&cc, c, sizeof(c)));
+        }
+        pr2serr("%s\n", b);
+    }
+    prev_ns = now;
+    prev_blks = blks;
+    prev_cpu = cpu_now;
+    prev_cmds = cmds;
+}
+
+/* Marks the bpt sized range at block offset off as written */
+static void
+ckpt_mark(struct opts_t * clp, int64_t off)
+{
+    int64_t idx = off / clp->bpt;
+    uint64_t bit = (uint64_t)1 << (idx & 63);
+
+    if ((NULL == clp->ckpt_map) || (idx >= clp->ckpt_chunks))
+        return;
+#ifdef HAVE_C11_ATOMICS
+    atomic_fetch_or(clp->ckpt_map + (idx >> 6), bit);
+#else
+    pthread_mutex_lock(&av_mut);
+    clp->ckpt_map[idx >> 6] |= bit;
+    pthread_mutex_unlock(&av_mut);
+#endif
+}
+
+static bool
+ckpt_test(struct opts_t * clp, int64_t idx)
+{
+    uint64_t w;
+
+#ifdef HAVE_C11_ATOMICS
+    w = atomic_load(clp->ckpt_map + (idx >> 6));
+#else
+    pthread_mutex_lock(&av_mut);
+    w = clp->ckpt_map[idx >> 6];
+    pthread_mutex_unlock(&av_mut);
+#endif
+    return !! (w & ((uint64_t)1 << (idx & 63)));
+}
+
+/* Writes the checkpoint journal to CFILE.tmp, syncs it, then renames it to
+ * CFILE so a crash leaves either the old or the new record. Called from
+ * sig_listen_thread and, once it has gone, with 'final' true from main().
+ * Unless 'final' is true does nothing if less than SECS have passed since
+ * the last call. Returns false if the journal could not be written. */
+static bool
+ckpt_write(struct opts_t * clp, bool final)
+{
+    static uint64_t prev_ns;
+    static int64_t low;         /* ranges before this have all been written */
+    bool ok;
+    int fd, k, v, n, blen;
+    int64_t j, high, last, done;
+    uint64_t now = sg_get_mono_ns();
+    char * b;
+    char tmp_fn[INOUTF_SZ + 8];
+
+    if ((! final) && (prev_ns > 0) &&
+        ((0 == clp->ckpt_secs) ||
+         ((now - prev_ns) < (uint64_t)clp->ckpt_secs * 1000000000)))
+        return true;
+    prev_ns = now;
+    while ((low < clp->ckpt_chunks) && ckpt_test(clp, low))
+        ++low;
+    done = low * clp->bpt;
+    if (done > clp->in_end)
+        done = clp->in_end;
+    high = clp->in_next / clp->bpt;     /* ranges claimed so far */
+    if (high > clp->ckpt_chunks)
+        high = clp->ckpt_chunks;
+    for (last = high - 1; last > low; --last) {
+        if (ckpt_test(clp, last))
+            break;
+    }
+    blen = 256 + (int)((last > low) ? ((last - low) / 4) : 0);
+    b = (char *)malloc(blen);
+    if (NULL == b)
+        return false;
+    n = sg_scnpr(b, blen, CKPT_PR_FMT, clp->bs, clp->ckpt_skip,
+                 clp->ckpt_seek, clp->ckpt_count, clp->ckpt_base + done);
+    if (last > low) {
+        n += sg_scn3pr(b, blen, n, "map: bpt=%d ", clp->bpt);
+        for (j = low; j <= last; j += 4) {
+            for (k = 0, v = 0; (k < 4) && ((j + k) <= last); ++k) {
+                if (ckpt_test(clp, j + k))
+                    v |= (1 << k);
+            }
+            b[n++] = "0123456789abcdef"[v];
+        }
+        b[n++] = '\n';
+    }
+    snprintf(tmp_fn, sizeof(tmp_fn), "%s.tmp", ckptfn);
+    fd = open(tmp_fn, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    ok = (fd >= 0);
+    if (ok) {
+        ok = (write(fd, b, n) == n) && (0 == fsync(fd));
+        close(fd);
+    }
+    if (ok)
+        ok = (0 == rename(tmp_fn, ckptfn));
+    if (! ok)
+        pr2serr("%sunable to write checkpoint to %s\n", my_name, ckptfn);
+    else if (clp->debug > 2)
+        pr2serr("checkpoint: %.*s", (int)(strchr(b, '\n') + 1 - b), b);
+    free(b);
+    return ok;
+}
+
+/* For --resume, reads the journal named by ckpt=CFILE and moves skip, seek
+ * and count on past the blocks that it says have all been written. Any of
+ * those values given on the command line must agree with the journal. A
+ * map of ranges written beyond that is kept in ckpt_hex. Returns 0 on
+ * success, else an exit status. */
+static int
+ckpt_resume(struct opts_t * clp, int64_t * skipp, int64_t * seekp)
+{
+    int n, bs, map_bpt;
+    long pos, end;
+    int64_t skip, seek, count, done;
+    FILE * fp;
+
+    fp = fopen(ckptfn, "r");
+    if (NULL == fp) {
+        pr2serr("%sunable to open checkpoint %s: %s\n", my_name, ckptfn,
+                safe_strerror(errno));
+        return SG_LIB_FILE_ERROR;
+    }
+    n = fscanf(fp, CKPT_SC_FMT, &bs, &skip, &seek, &count, &done);
+    if ((5 != n) || (skip < 0) || (seek < 0) || (count < 0) ||
+        (done < 0) || (done > count)) {
+        fclose(fp);
+        pr2serr("%s%s is not a valid checkpoint\n", my_name, ckptfn);
+        return SG_LIB_FILE_ERROR;
+    }
+    if ((bs != clp->bs) || (*skipp && (*skipp != skip)) ||
+        (*seekp && (*seekp != seek)) ||
+        ((dd_count >= 0) && (dd_count != count))) {
+        fclose(fp);
+        pr2serr("%scheckpoint was for bs=%d skip=%" PRId64 " seek=%" PRId64
+                " count=%" PRId64 ", conflicts with command line\n",
+                my_name, bs, skip, seek, count);
+        return SG_LIB_CONTRADICT;
+    }
+    if (1 == fscanf(fp, " map: bpt=%d ", &map_bpt)) {
+        pos = ftell(fp);
+        fseek(fp, 0, SEEK_END);
+        end = ftell(fp);
+        fseek(fp, pos, SEEK_SET);
+        if (clp->bpt_auto) {
+            clp->bpt = map_bpt;     /* no probing, keep what map used */
+            clp->bpt_auto = false;
+            pr2serr("bpt=auto: using bpt=%d from checkpoint map\n", map_bpt);
+        }
+        if (map_bpt != clp->bpt)
+            pr2serr("checkpoint map is for bpt=%d so ranges after block "
+                    "%" PRId64 " will be copied again\n", map_bpt, done);
+        else if ((end > pos) &&
+                 (clp->ckpt_hex = (char *)calloc(end - pos + 1, 1))) {
+            n = fread(clp->ckpt_hex, 1, end - pos, fp);
+            clp->ckpt_hex[n] = '\0';
+        }
+    }
+    fclose(fp);
+    clp->ckpt_skip = skip;
+    clp->ckpt_seek = seek;
+    clp->ckpt_count = count;
+    clp->ckpt_base = done;
+    *skipp = skip + done;
+    *seekp = seek + done;
+    dd_count = count - done;
+    pr2serr("Resuming from checkpoint: %" PRId64 " of %" PRId64 " blocks "
+            "already copied\n", done, count);
+    return 0;
+}
+
+/* Sets the bits in ckpt_map from the map read back by --resume and has
+ * claim_blocks() pass over those ranges. Returns the number of blocks in
+ * them. */
+static int64_t
+ckpt_load_map(struct opts_t * clp)
+{
+    int k, v;
+    int64_t j, idx, num;
+    int64_t blks = 0;
+    const char * cp;
+
+    for (cp = clp->ckpt_hex, j = 0; isxdigit((uint8_t)*cp); ++cp, j += 4) {
+        v = isdigit((uint8_t)*cp) ? (*cp - '0') :
+                                    (tolower((uint8_t)*cp) - 'a' + 10);
+        for (k = 0; k < 4; ++k) {
+            idx = j + k;
+            if ((0 == (v & (1 << k))) || (idx >= clp->ckpt_chunks))
+                continue;
+            ckpt_mark(clp, idx * clp->bpt);
+            num = dd_count - (idx * clp->bpt);
+            blks += (num > clp->bpt) ? clp->bpt : num;
+        }
+    }
+    clp->ckpt_skip_done = (blks > 0);
+    return blks;
+}
+
+/* Called by a worker thread once the range in rep has been written. Swaps
+ * rep's buffer with one from the pool and queues the written data to be
+ * verified. Waits if the pool is empty. */
+static void
+vfy_queue(struct opts_t * clp, Rq_elem * rep)
+{
+    int status, hp_kind;
+    uint8_t * bp;
+    struct vfy_stage * vsp = clp->vfyp;
+    struct vfy_elem * ep;
+
+    status = pthread_mutex_lock(&vsp->mutex);
+    if (0 != status) err_exit(status, "lock vfy mutex");
+    while (NULL == vsp->free_lp) {
+        status = pthread_cond_wait(&vsp->free_cv, &vsp->mutex);
+        if (0 != status) err_exit(status, "cond vfy free_cv");
+    }
+    ep = vsp->free_lp;
+    vsp->free_lp = ep->nextp;
+    status = pthread_mutex_unlock(&vsp->mutex);
+    if (0 != status) err_exit(status, "unlock vfy mutex");
+
+    bp = ep->buffp;
+    ep->buffp = rep->buffp;
+    rep->buffp = bp;
+    bp = ep->alloc_bp;
+    ep->alloc_bp = rep->alloc_bp;
+    rep->alloc_bp = bp;
+    hp_kind = ep->hp_kind;
+    ep->hp_kind = rep->hp_kind;
+    rep->hp_kind = hp_kind;
+    ep->blk = rep->blk;
+    ep->num_blks = rep->num_blks;
+    ep->nextp = NULL;
+
+    status = pthread_mutex_lock(&vsp->mutex);
+    if (0 != status) err_exit(status, "lock vfy mutex");
+    if (vsp->tailp)
+        vsp->tailp->nextp = ep;
+    else
+        vsp->headp = ep;
+    vsp->tailp = ep;
+    status = pthread_cond_signal(&vsp->queue_cv);
+    if (0 != status) err_exit(status, "signal vfy queue_cv");
+    status = pthread_mutex_unlock(&vsp->mutex);
+    if (0 != status) err_exit(status, "unlock vfy mutex");
+}
+
+static void
+vfy_miscompare(struct opts_t * clp, int64_t blk, int num_blks)
+{
+#ifdef HAVE_C11_ATOMICS
+    atomic_fetch_add(&clp->vfyp->miscompares, 1);
+#else
+    pthread_mutex_lock(&av_mut);
+    ++clp->vfyp->miscompares;
+    pthread_mutex_unlock(&av_mut);
+#endif
+    pr2serr(">> verify: miscompare in OFILE blocks %" PRId64 " to %" PRId64
+            "\n", blk, blk + num_blks - 1);
+    if (exit_status <= 0)
+        exit_status = SG_LIB_CAT_MISCOMPARE;
+}
+
+/* Verifies one range, rbuffp is only used when OFILE is not a sg device */
+static void
+vfy_range(struct opts_t * clp, struct vfy_elem * ep, uint8_t * rbuffp)
+{
+    int k, res;
+    int bs = clp->bs;
+    int len = ep->num_blks * bs;
+    off64_t pos;
+    char b[80];
+    char strerr_buff[STRERR_BUFF_LEN + 1];
+
+    if (FT_SG == clp->out_type) {
+        if ((MAX_SCSI_CDBSZ == clp->cdbsz_out) || (ep->blk > UINT_MAX))
+            res = sg_ll_verify16(clp->outfd, 0, false, 1 /* BYTCHK */,
+                                 ep->blk, ep->num_blks, 0, ep->buffp, len,
+                                 NULL, false, clp->debug > 1 ?
+                                 clp->debug - 1 : 0);
+        else
+            res = sg_ll_verify10(clp->outfd, 0, false, 1 /* BYTCHK */,
+                                 (unsigned int)ep->blk, ep->num_blks,
+                                 ep->buffp, len, NULL, false,
+                                 clp->debug > 1 ? clp->debug - 1 : 0);
+        if (SG_LIB_CAT_MISCOMPARE == res) {
+            vfy_miscompare(clp, ep->blk, ep->num_blks);
+            return;
+        } else if (res) {
+            sg_get_category_sense_str(res, sizeof(b), b, clp->debug);
+            pr2serr(">> verify: VERIFY at OFILE blk=%" PRId64 " failed: "
+                    "%s\n", ep->blk, b);
+            if (exit_status <= 0)
+                exit_status = res;
+            return;
+        }
+    } else {
+        pos = clp->out_pos + (ep->blk - clp->seek) * bs;
+        while (((res = pread(clp->outfd, rbuffp, len, pos)) < 0) &&
+               ((EINTR == errno) || (EAGAIN == errno)))
+            ;
+        if (res < len) {
+            pr2serr(">> verify: read back at OFILE blk=%" PRId64 " failed: "
+                    "%s\n", ep->blk, (res < 0) ?
+                    tsafe_strerror(errno, strerr_buff) : "short read");
+            if (exit_status <= 0)
+                exit_status = SG_LIB_FILE_ERROR;
+            return;
+        }
+        if (memcmp(rbuffp, ep->buffp, len)) {
+            for (k = 0; k < ep->num_blks; ++k) {
+                if (memcmp(rbuffp + (k * bs), ep->buffp + (k * bs), bs))
+                    break;
+            }
+            vfy_miscompare(clp, ep->blk + k, 1);
+            return;
+        }
+    }
+    blk_fetch_add(&clp->vfyp->verified_blks, ep->num_blks);
+}
+
+static void *
+vfy_thread(void * v_clp)
+{
+    int status;
+    uint8_t * rbuffp = NULL;
+    uint8_t * free_rbp = NULL;
+    struct opts_t * clp = (struct opts_t *)v_clp;
+    struct vfy_stage * vsp = clp->vfyp;
+    struct vfy_elem * ep;
+
+    if (FT_SG != clp->out_type) {
+        rbuffp = sg_memalign(clp->bpt * clp->bs, 0, &free_rbp, false);
+        if (NULL == rbuffp)
+            err_exit(ENOMEM, "out of memory creating verify buffer\n");
+    }
+    while (true) {
+        status = pthread_mutex_lock(&vsp->mutex);
+        if (0 != status) err_exit(status, "lock vfy mutex");
+        while ((NULL == vsp->headp) && (! vsp->done)) {
+            status = pthread_cond_wait(&vsp->queue_cv, &vsp->mutex);
+            if (0 != status) err_exit(status, "cond vfy queue_cv");
+        }
+        ep = vsp->headp;
+        if (ep) {
+            vsp->headp = ep->nextp;
+            if (NULL == vsp->headp)
+                vsp->tailp = NULL;
+        }
+        status = pthread_mutex_unlock(&vsp->mutex);
+        if (0 != status) err_exit(status, "unlock vfy mutex");
+        if (NULL == ep)
+            break;      /* queue empty and done */
+
+        vfy_range(clp, ep, rbuffp);
+
+        status = pthread_mutex_lock(&vsp->mutex);
+        if (0 != status) err_exit(status, "lock vfy mutex");
+        ep->nextp = vsp->free_lp;
+        vsp->free_lp = ep;
+        status = pthread_cond_signal(&vsp->free_cv);
+        if (0 != status) err_exit(status, "signal vfy free_cv");
+        status = pthread_mutex_unlock(&vsp->mutex);
+        if (0 != status) err_exit(status, "unlock vfy mutex");
+    }
+    free(free_rbp);
+    return NULL;
+}
+
+/* Builds the pool of verify=MB buffers and starts the verifier threads */
+static void
+vfy_start(struct opts_t * clp)
+{
+    int k, status;
+    int sz = clp->bpt * clp->bs;
+    struct vfy_stage * vsp = &vfy_st;
+    struct vfy_elem * ep;
+
+    vsp->num_elems = (int)(((int64_t)clp->verify_mb * 1024 * 1024) / sz);
+    if (vsp->num_elems < 1)
+        vsp->num_elems = 1;
+    vsp->num_thr = clp->num_threads;
+    vsp->elems = (struct vfy_elem *)calloc(vsp->num_elems,
+                                           sizeof(struct vfy_elem));
+    if (NULL == vsp->elems)
+        err_exit(ENOMEM, "out of memory creating verify pool\n");
+    for (k = 0; k < vsp->num_elems; ++k) {
+        ep = vsp->elems + k;
+        ep->buffp = sg_memalign(sz, 0, &ep->alloc_bp, false);
+        if (NULL == ep->buffp)
+            err_exit(ENOMEM, "out of memory creating verify pool\n");
+        ep->nextp = vsp->free_lp;
+        vsp->free_lp = ep;
+    }
+    status = pthread_mutex_init(&vsp->mutex, NULL);
+    if (0 != status) err_exit(status, "init vfy mutex");
+    status = pthread_cond_init(&vsp->free_cv, NULL);
+    if (0 != status) err_exit(status, "init vfy free_cv");
+    status = pthread_cond_init(&vsp->queue_cv, NULL);
+    if (0 != status) err_exit(status, "init vfy queue_cv");
+    clp->vfyp = vsp;
+    for (k = 0; k < vsp->num_thr; ++k) {
+        status = pthread_create(vsp->threads + k, NULL, vfy_thread,
+                                (void *)clp);
+        if (0 != status) err_exit(status, "pthread_create, vfy");
+    }
+    if (clp->debug)
+        pr2serr("verify: %d threads sharing %d buffers of %d bytes\n",
+                vsp->num_thr, vsp->num_elems, sz);
+}
+
+/* Waits for the verifier threads to finish what is queued, then reports */
+static void
+vfy_stop(struct opts_t * clp)
+{
+    int k, status;
+    struct vfy_stage * vsp = clp->vfyp;
+
+    status = pthread_mutex_lock(&vsp->mutex);
+    if (0 != status) err_exit(status, "lock vfy mutex");
+    vsp->done = true;
+    status = pthread_cond_broadcast(&vsp->queue_cv);
+    if (0 != status) err_exit(status, "broadcast vfy queue_cv");
+    status = pthread_mutex_unlock(&vsp->mutex);
+    if (0 != status) err_exit(status, "unlock vfy mutex");
+    for (k = 0; k < vsp->num_thr; ++k) {
+        status = pthread_join(vsp->threads[k], NULL);
+        if (0 != status) err_exit(status, "pthread_join, vfy");
+    }
+    for (k = 0; k < vsp->num_elems; ++k)
+        sg_free_hugepage(vsp->elems[k].alloc_bp, clp->bpt * clp->bs,
+                         vsp->elems[k].hp_kind);
+    free(vsp->elems);
+    vsp->elems = NULL;
+    pr2serr("Verified %" PRId64 " blocks of OFILE, %d miscompare%s\n",
+            (int64_t)vsp->verified_blks, (int)vsp->miscompares,
+            (1 == vsp->miscompares) ? "" : "s");
+}
+
+/* hash=ALG[,MANIFEST]: digests each range that a worker thread has read
+ * while the data is still in its buffer, before it is written. The per
+ * range digests for MANIFEST are done in parallel by the worker threads.
+ * The digest of the whole input stream needs the ranges in block order so
+ * hash_turn is taken for that, much like out_turn for sequential output. */
+static void
+hash_batch(struct opts_t * clp, const Rq_elem * reps, const int64_t * offs,
+           int n)
+{
+    int k, len, dlen, status;
+    const Rq_elem * rep;
+    struct sg_hash_ctx hc;
+    uint8_t d[SG_HASH_MAX_DIGEST_LEN];
+    char b[(2 * SG_HASH_MAX_DIGEST_LEN) + 1];
+
+    for (k = 0; k < n; ++k) {
+        rep = reps + k;
+        len = (rep->in_bytes > 0) ? rep->in_bytes : rep->num_blks * rep->bs;
+        if (clp->hash_mfp && (len > 0)) {
+            sg_hash_init(&hc, clp->hash_alg);
+            sg_hash_update(&hc, rep->buffp, len);
+            dlen = sg_hash_final(&hc, d);
+            sg_hash_hex(d, dlen, b, sizeof(b));
+            status = pthread_mutex_lock(&clp->hash_mutex);
+            if (0 != status) err_exit(status, "lock hash_mutex");
+            fprintf(clp->hash_mfp, "%" PRId64 " %d %s\n", rep->blk,
+                    rep->num_blks, b);
+            status = pthread_mutex_unlock(&clp->hash_mutex);
+            if (0 != status) err_exit(status, "unlock hash_mutex");
+        }
+        if (clp->hash_stream) {
+            if (! wait_turn(clp, &clp->hash_turn, offs[k]))
+                return;
+            sg_hash_update(&clp->hash_ctx, rep->buffp, len);
+            advance_turn(clp, &clp->hash_turn, offs[k] + rep->num_blks);
+        }
+    }
+}
+
+/* Called before the worker threads start. Returns false if MANIFEST could
+ * not be created. */
+static bool
+hash_open(struct opts_t * clp)
+{
+    int status;
+
+    status = pthread_mutex_init(&clp->hash_mutex, NULL);
+    if (0 != status) err_exit(status, "init hash_mutex");
+    /* also builds lookup tables, so before any worker thread is started */
+    sg_hash_init(&clp->hash_ctx, clp->hash_alg);
+    /* ranges passed over on resume would leave a gap in the stream */
+    clp->hash_stream = ! clp->ckpt_skip_done;
+    if (clp->debug)
+        pr2serr("hash=%s%s%s\n", sg_hash_alg_name(clp->hash_alg),
+                ((SG_HASH_CRC32C == clp->hash_alg) && sg_hash_crc32c_hw()) ?
+                " using CPU crc32 instruction" : "",
+                clp->hash_stream ? "" : ", per range only");
+    if ('\0' == hashfn[0])
+        return true;
+    clp->hash_mfp = fopen(hashfn, "w");
+    if (NULL == clp->hash_mfp) {
+        pr2serr("%sunable to create hash manifest %s: %s\n", my_name,
+                hashfn, safe_strerror(errno));
+        return false;
+    }
+    fprintf(clp->hash_mfp, "# sg3_utils hash manifest: alg=%s bs=%d if=%s\n"
+            "# lba blocks digest\n", sg_hash_alg_name(clp->hash_alg),
+            clp->bs, infn);
+    return true;
+}
+
+/* Called after the worker threads have exited */
+static void
+hash_close(struct opts_t * clp)
+{
+    int n;
+    uint8_t d[SG_HASH_MAX_DIGEST_LEN];
+    char b[(2 * SG_HASH_MAX_DIGEST_LEN) + 1];
+
+    if (clp->hash_stream) {
+        n = sg_hash_final(&clp->hash_ctx, d);
+        sg_hash_hex(d, n, b, sizeof(b));
+        pr2serr("%s (%s) = %s\n", sg_hash_alg_name(clp->hash_alg), infn, b);
+    } else
+        pr2serr("%s: resumed copy so no digest of whole input, see "
+                "MANIFEST\n", sg_hash_alg_name(clp->hash_alg));
+    if (clp->hash_mfp) {
+        if (clp->hash_stream)
+            fprintf(clp->hash_mfp, "# total bytes=%" PRIu64 " %s\n",
+                    clp->hash_ctx.total, b);
+        if (fclose(clp->hash_mfp))
+            pr2serr("%sproblem closing hash manifest %s: %s\n", my_name,
+                    hashfn, safe_strerror(errno));
+        clp->hash_mfp = NULL;
+    }
+    pthread_mutex_destroy(&clp->hash_mutex);
+}
+
+/* compress=ALG[,LEVEL]: OFILE is written as a compressed image (see
+ * sg_cimg.h). Each worker thread compresses the ranges it has read with
+ * its own compressor, so compression runs on up to thr= cores, then takes
+ * the next frame's file offset with an atomic fetch-add and writes the
+ * frame there. Ranges are bpt blocks and start at multiples of bpt, so the
+ * index entry of a range is at its offset / bpt. Only when OFILE is a pipe
+ * are the frames written in block order, taking out_turn. The index and
+ * trailer are written after the worker threads have exited. */
+static bool
+cimg_write_batch(struct opts_t * clp, Rq_elem * reps, const int64_t * offs,
+                 int n)
+{
+    int k, len, clen, res, err;
+    int cap = sg_cimg_bound(clp->cimg_alg, clp->bpt * clp->bs);
+    int64_t pos;
+    uint64_t t0_ns;
+    const uint8_t * bp;
+    struct sg_cimg_ent * ep;
+    Rq_elem * rep;
+    char strerr_buff[STRERR_BUFF_LEN + 1];
+
+    for (k = 0; k < n; ++k) {
+        rep = reps + k;
+        if (0 == rep->num_blks)
+            return false;       /* read nothing so leave loop */
+        if (threads_exiting())
+            return false;
+        t0_ns = lat_start();
+        len = rep->num_blks * rep->bs;
+        if ((rep->in_bytes > 0) && (rep->in_bytes < len))
+            memset(rep->buffp + rep->in_bytes, 0, len - rep->in_bytes);
+        ep = clp->cimg_ents + (offs[k] / clp->bpt);
+        ep->crc = sg_cimg_crc(rep->buffp, len);
+        clen = sg_cimg_compress(rep->czp, rep->buffp, len, rep->cimg_bp,
+                                cap);
+        if (clen < 0) {
+            pr2serr("%s: %s failed on blk=%" PRId64 "\n", __func__,
+                    sg_cimg_alg_name(clp->cimg_alg), rep->blk);
+            rep->out_err = true;
+            return false;
+        }
+        if (0 == clen) {        /* didn't shrink so store as is */
+            bp = rep->buffp;
+            clen = len;
+            ep->flags = SG_CIMG_F_RAW;
+        } else {
+            bp = rep->cimg_bp;
+            ep->flags = 0;
+        }
+        if (clp->out_seq) {
+            if (! wait_turn(clp, &clp->out_turn, offs[k]))
+                return false;
+            pos = clp->cimg_next;
+            clp->cimg_next = pos + clen;
+        } else
+            pos = blk_fetch_add(&clp->cimg_next, clen);
+        res = 0;
+        while (res < clen) {
+            err = clp->out_seq ? write(rep->outfd, bp + res, clen - res) :
+                        pwrite(rep->outfd, bp + res, clen - res, pos + res);
+            if (err < 0) {
+                if ((EINTR == errno) || (EAGAIN == errno)) {
+                    sg_err_stats_errno(rep->esp, errno);
+                    continue;
+                }
+                break;
+            }
+            res += err;
+        }
+        err = (res < clen) ? ((err < 0) ? errno : EIO) : 0;
+        if (clp->out_seq)
+            advance_turn(clp, &clp->out_turn, offs[k] + rep->num_blks);
+        sg_err_stats_cat(rep->esp, err ? sg_convert_errno(err) : 0);
+        if (err) {
+            sg_err_stats_errno(rep->esp, err);
+            pr2serr("error writing frame of blk=%" PRId64 ", %s\n",
+                    rep->blk, tsafe_strerror(err, strerr_buff));
+            rep->out_err = true;
+            return false;
+        }
+        ep->blk = offs[k];
+        ep->pos = pos;
+        ep->clen = clen;
+        ep->num_blks = rep->num_blks;   /* last, marks entry as valid */
+        lat_add(LAT_OUT_ID, t0_ns);
+        shard_add64(&rep->shp->out_blks, rep->num_blks);
+    }
+    return true;
+}
+
+/* iflag=cimage: the range each element of reps claimed starts at a chunk
+ * of IFILE's image, whose frame is read, decompressed into the element's
+ * buffer and checked against the CRC in the index. Frames are read with
+ * pread() so in any order. Returns the number of leading elements read
+ * without error. */
+static int
+cimg_read_batch(struct opts_t * clp, Rq_elem * reps, int n)
+{
+    int k, res;
+    int len = clp->bpt * clp->bs;
+    uint64_t t0_ns;
+    uint8_t * bp;
+    const struct sg_cimg_ent * ep;
+    Rq_elem * rep;
+    char strerr_buff[STRERR_BUFF_LEN + 1];
+
+    for (k = 0; k < n; ++k) {
+        rep = reps + k;
+        t0_ns = lat_start();
+        ep = sg_cimg_find(clp->cimg_ents, clp->cimg_num_ents,
+                          (uint64_t)rep->blk);
+        if ((NULL == ep) || (ep->blk != (uint64_t)rep->blk) ||
+            ((int)ep->num_blks < rep->num_blks)) {
+            pr2serr("%s: image has no chunk at blk=%" PRId64 " of %d "
+                    "blocks\n", __func__, rep->blk, rep->num_blks);
+            rep->in_err = true;
+            break;
+        }
+        bp = (ep->flags & SG_CIMG_F_RAW) ? rep->buffp : rep->cimg_bp;
+        while (((res = pread(rep->infd, bp, ep->clen, ep->pos)) < 0) &&
+               ((EINTR == errno) || (EAGAIN == errno)))
+            sg_err_stats_errno(rep->esp, errno);
+        sg_err_stats_cat(rep->esp, (res < 0) ? sg_convert_errno(errno) : 0);
+        if (res != (int)ep->clen) {
+            pr2serr("error reading frame of blk=%" PRId64 ", %s\n",
+                    rep->blk, (res < 0) ? tsafe_strerror(errno, strerr_buff)
+                                        : "short read");
+            rep->in_err = true;
+            break;
+        }
+        if (! (ep->flags & SG_CIMG_F_RAW))
+            res = sg_cimg_decompress(rep->czp, bp, ep->clen, rep->buffp,
+                                     len);
+        if ((res != (int)(ep->num_blks * rep->bs)) ||
+            (ep->crc != sg_cimg_crc(rep->buffp, res))) {
+            pr2serr("%s: frame of blk=%" PRId64 " is corrupt\n", __func__,
+                    rep->blk);
+            rep->in_err = true;
+            break;
+        }
+        lat_add(LAT_IN_ID, t0_ns);
+        shard_add64(&rep->shp->in_blks, rep->num_blks);
+    }
+    return k;
+}
+
+/* iflag=cimage: reads the header and index of IFILE before the block size
+ * and count are settled. The block size (if bs= is not given) and bpt
+ * come from the image. Returns 0 or a SG_LIB_* error. */
+static int
+cimg_load(struct opts_t * clp, bool bpt_given)
+{
+    int fd, res;
+    struct sg_cimg_hdr * hp = &clp->cimg_hdr;
+
+    if (FT_OTHER != sg_dde_filetype(infn, 0, 0)) {
+        pr2serr("%siflag=cimage needs IFILE to be a regular file\n",
+                my_name);
+        return SG_LIB_FILE_ERROR;
+    }
+    fd = open(infn, O_RDONLY);
+    if (fd < 0) {
+        res = errno;
+        pr2serr("%scould not open %s for reading: %s\n", my_name, infn,
+                safe_strerror(res));
+        return sg_convert_errno(res);
+    }
+    res = sg_cimg_load(fd, hp, &clp->cimg_ents, &clp->cimg_num_ents,
+                       &clp->cimg_in_blks, clp->debug);
+    close(fd);
+    if (res) {
+        pr2serr("%s%s is not a usable compressed image%s\n", my_name, infn,
+                clp->debug ? "" : ", try with -v");
+        return res;
+    }
+    if (SG_CIMG_RAW == hp->alg) {
+        pr2serr("%s%s is a sparse image, read it with sg_dd "
+                "iflag=simage\n", my_name, infn);
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if (! sg_cimg_alg_avail(hp->alg)) {
+        pr2serr("%s%s is compressed with %s which this build does not "
+                "support\n", my_name, infn, sg_cimg_alg_name(hp->alg));
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if (0 == clp->bs)
+        clp->bs = hp->bs;
+    else if (clp->bs != hp->bs) {
+        pr2serr("%sbs=%d but %s was made with bs=%d\n", my_name, clp->bs,
+                infn, hp->bs);
+        return SG_LIB_CONTRADICT;
+    }
+    if ((bpt_given || clp->bpt_auto) && (clp->bpt != hp->chunk_blks))
+        pr2serr("%sbpt set to %d, the blocks per chunk of %s\n", my_name,
+                hp->chunk_blks, infn);
+    clp->bpt = hp->chunk_blks;
+    clp->bpt_auto = false;
+    return 0;
+}
+
+/* compress=: called before the worker threads start, once bpt is final.
+ * Writes the header and makes room for the index. Returns 0 or a SG_LIB_*
+ * error. */
+static int
+cimg_open(struct opts_t * clp)
+{
+    int res;
+    uint8_t b[SG_CIMG_HDR_LEN];
+    struct sg_cimg_hdr * hp = &clp->cimg_hdr;
+
+    hp->alg = clp->cimg_alg;
+    hp->bs = clp->bs;
+    hp->chunk_blks = clp->bpt;
+    clp->cimg_num_ents = (clp->in_end + clp->bpt - 1) / clp->bpt;
+    clp->cimg_ents = (struct sg_cimg_ent *)
+                calloc(clp->cimg_num_ents + 1, sizeof(struct sg_cimg_ent));
+    if (NULL == clp->cimg_ents) {
+        pr2serr("%sout of memory for compressed image index\n", my_name);
+        return SG_LIB_CAT_OTHER;
+    }
+    sg_cimg_hdr_enc(hp, b);
+    if (clp->out_seq)
+        res = write(clp->outfd, b, sizeof(b));
+    else
+        res = pwrite(clp->outfd, b, sizeof(b), 0);
+    if (res != (int)sizeof(b)) {
+        res = (res < 0) ? errno : EIO;
+        pr2serr("%sunable to write header of %s: %s\n", my_name, outfn,
+                safe_strerror(res));
+        return sg_convert_errno(res);
+    }
+    clp->cimg_next = SG_CIMG_HDR_LEN;
+    if (clp->debug)
+        pr2serr("compress=%s: %d blocks per chunk, %" PRId64 " chunks\n",
+                sg_cimg_alg_name(hp->alg), hp->chunk_blks,
+                clp->cimg_num_ents);
+    return 0;
+}
+
+/* Called after the worker threads have exited. With compress= writes the
+ * index of the frames that were written (even if the copy stopped early,
+ * so the image can be restored up to there), trims OFILE after it and
+ * reports the compression ratio. Returns 0 or a SG_LIB_* error. */
+static int
+cimg_close(struct opts_t * clp)
+{
+    int res = 0;
+    int64_t k, nf;
+    uint64_t raw, end;
+
+    if (clp->cimg_alg && clp->cimg_ents) {
+        end = (uint64_t)clp->cimg_next;
+        res = sg_cimg_write_index(clp->outfd, clp->out_seq, end,
+                                  clp->cimg_ents, clp->cimg_num_ents, 0);
+        for (k = 0, nf = 0, raw = 0; k < clp->cimg_num_ents; ++k) {
+            if (clp->cimg_ents[k].num_blks > 0) {
+                ++nf;
+                raw += (uint64_t)clp->cimg_ents[k].num_blks * clp->bs;
+            }
+        }
+        end += (nf * SG_CIMG_ENT_LEN) + SG_CIMG_TRL_LEN;
+        if (res)
+            pr2serr("%sunable to write index of %s\n", my_name, outfn);
+        else if ((! clp->out_seq) && (ftruncate(clp->outfd, end) < 0))
+            pr2serr("%sunable to trim %s after its index: %s\n", my_name,
+                    outfn, safe_strerror(errno));
+        pr2serr("%s image: %" PRId64 " frames, %" PRIu64 " bytes in %"
+                PRIu64 " (%.2f:1)\n", sg_cimg_alg_name(clp->cimg_alg), nf,
+                raw, end, (end > 0) ? ((double)raw / (double)end) : 0.0);
+    }
+    free(clp->cimg_ents);
+    clp->cimg_ents = NULL;
+    return res;
+}
+
+static void *
+sig_listen_thread(void * v_clp)
+{
+    int sig_number;
+    struct opts_t * clp = (struct opts_t *)v_clp;
+    struct timespec ts;
+    siginfo_t info;
+
+    ts.tv_sec = 0;
+    ts.tv_nsec = 200 * 1000 * 1000;
+
+    if (clp->interval > 0)
+        interval_report(clp, false);    /* sets the reference */
+    while (true) {
+        sig_number = sigtimedwait(&signal_set, &info, &ts);
+        if (shutting_down)
+            break;
+        if ((sig_number < 0) && (EAGAIN == errno)) {    /* time out */
+            if (clp->progress > 0) {
+                if (check_progress(clp)) {
+                    calc_duration_throughput(true);
+                    print_stats("");
+                }
+            }
+            if (clp->interval > 0)
+                interval_report(clp, false);
+            if (ckptfn[0])
+                ckpt_write(clp, false);
+        }
+        if (SIGUSR1 == sig_number) {
+            pr2serr("Progress report, continuing ...\n");
+            if (do_time)
+                calc_duration_throughput(true);
+            print_stats("  ");
+            err_stats_report(clp, "  ");
+        }
+        if (SIGHUP == sig_number) {
+            if (! sg_rate_lim_parse(&clp->rate_lim, clp->rate_arg))
+                pr2serr("SIGHUP: unable to re-read %s, rate unchanged\n",
+                        clp->rate_arg + 1);
+            else if (clp->debug)
+                pr2serr("SIGHUP: rate now %" PRId64 " bytes/sec, %" PRId64
+                        " IOPS (0 -> no limit)\n", clp->rate_lim.bytes_ps,
+                        clp->rate_lim.iops);
+        }
+        if (SIGINT == sig_number) {
+            pr2serr("%sinterrupted by SIGINT\n", my_name);
+#ifdef HAVE_C11_ATOMICS
+            atomic_store(&exit_threads, true);
+#else
+            exit_threads = true;
+#endif
+            wake_turn_waiters(clp);
+        }
+    }
+    return NULL;
+}
+
+static void
+cleanup_in(void * v_clp)
+{
+    struct opts_t * clp = (struct opts_t *)v_clp;
+
+    pr2serr("thread cancelled while in mutex held\n");
+    pthread_mutex_unlock(&clp->inout_mutex);
+    pthread_cond_broadcast(&clp->out_sync_cv);
+}
+
+static void
+cleanup_out(void * v_clp)
+{
+    struct opts_t * clp = (struct opts_t *)v_clp;
+
+    pr2serr("thread cancelled while out mutex held\n");
+    pthread_mutex_unlock(&clp->inout_mutex);
+    pthread_cond_broadcast(&clp->out_sync_cv);
+}
+
+static int
 sg_prepare(int fd, int bs, int bpt)
 {
     int res, t;
+    struct sg_dde_resbuf rb;
+
+    res = ioctl(fd, SG_GET_VERSION_NUM, &t);
+    if ((res < 0) || (t < 30000)) {
+        pr2serr("%ssg driver prior to 3.x.y\n", my_name);
+        return 1;
+    }
+    if (sg_dde_resbuf_size(fd, bs, &bpt, 0, &rb, my_name, 0))
+        return 1;
+    t = 1;
+    res = ioctl(fd, SG_SET_FORCE_PACK_ID, &t);
+    if (res < 0)
+        perror("sgp_dd: SG_SET_FORCE_PACK_ID error");
+    return 0;
+}
+
+/* Has the write side sg fd take its data from the reserve buffer of the
+ * read side fd. Returns false if the driver doesn't support that. */
+static bool
+sg_share_prepare(int write_side_fd, int read_side_fd, int id, bool vb)
+{
+    struct sg_extended_info sei;
+    char strerr_buff[STRERR_BUFF_LEN + 1];
+
+    memset(&sei, 0, sizeof(sei));
+    sei.sei_wr_mask |= SG_SEIM_SHARE_FD;
+    sei.sei_rd_mask |= SG_SEIM_SHARE_FD;
+    sei.share_fd = read_side_fd;
+    if (ioctl(write_side_fd, SG_SET_GET_EXTENDED, &sei) < 0) {
+        if (vb)
+            pr2serr("thread=%d: ioctl(EXTENDED(shared_fd=%d)) failed: %s\n",
+                    id, read_side_fd, tsafe_strerror(errno, strerr_buff));
+        return false;
+    }
+    return true;
+}
+
+/* Decides, before the worker threads start, whether iflag=share or
+ * oflag=share can be honoured. When it can't the copy still goes ahead,
+ * through user space buffers, after saying why. */
+static void
+share_setup(struct opts_t * clp)
+{
+    int t;
+    const char * cp = NULL;
+    char b[64];
+
+    if ((FT_SG != clp->in_type) || (FT_SG != clp->out_type))
+        cp = "needs IFILE and OFILE to be sg devices";
+    else if (clp->mmap_active)
+        cp = "can't be used with the mmap flag";
+    else if (clp->in_flags.coe)
+        cp = "can't substitute zeros with iflag=coe";
+    else if (clp->chkaddr || clp->genaddr || clp->hash_alg ||
+             (clp->verify_mb > 0) || (clp->num_fan > 0) ||
+             clp->out_flags.delta)
+        cp = "keeps the data out of user space, but --chkaddr, --genaddr, "
+             "hash=, verify=, of2= or oflag=delta need it";
+    else if ((ioctl(clp->infd, SG_GET_VERSION_NUM, &t) < 0) ||
+             (t < SG_SHARE_MIN_VERSION) ||
+             (ioctl(clp->outfd, SG_GET_VERSION_NUM, &t) < 0) ||
+             (t < SG_SHARE_MIN_VERSION)) {
+        snprintf(b, sizeof(b), "needs sg driver %d.%d.%d or later",
+                 SG_SHARE_MIN_VERSION / 10000,
+                 (SG_SHARE_MIN_VERSION / 100) % 100,
+                 SG_SHARE_MIN_VERSION % 100);
+        cp = b;
+    }
+    if (cp) {
+        pr2serr("%sshare flag %s, copying via user space\n", my_name, cp);
+        return;
+    }
+    if (clp->qd > 1) {
+        /* each fd pair has one reserve buffer */
+        pr2serr("%sshare flag uses the sg reserve buffer so qd set to 1\n",
+                my_name);
+        clp->qd = 1;
+    }
+    clp->share_active = true;
+}
+
+/* Reads blocks at block offset off (from skip) of IFILE into bp for
+ * bpt=auto. Returns false on error or short read. */
+static bool
+auto_bpt_read(struct opts_t * clp, Rq_elem * rep, int64_t off, int blocks)
+{
+    int res;
+    static pthread_mutex_t probe_mut = PTHREAD_MUTEX_INITIALIZER;
+
+    if (FT_SG == clp->in_type) {
+        rep->blk = in_lba(clp, off);
+        rep->num_blks = blocks;
+        do {
+            if (0 != sg_start_io(rep))
+                return false;
+            res = sg_finish_io(false, rep, &probe_mut);
+        } while ((SG_LIB_CAT_ABORTED_COMMAND == res) ||
+                 (SG_LIB_CAT_UNIT_ATTENTION == res));
+        return (0 == res);
+    }
+    while (((res = pread(clp->infd, rep->buffp, blocks * clp->bs,
+                         clp->in_pos + ((in_lba(clp, off) - clp->skip) *
+                                        clp->bs))) < 0) &&
+           ((EINTR == errno) || (EAGAIN == errno)))
+        ;
+    return (res == (blocks * clp->bs));
+}
+
+/* bpt=auto: works out candidate transfer sizes from the limits of IFILE
+ * and OFILE. When IFILE can be read by position (or is a sg device) and
+ * the copy is long enough, reads AUTO_BPT_PROBE_BYTES with each size from
+ * successive parts of the range to be copied and sets clp->bpt to the
+ * fastest, or a smaller one within 5% of it. Otherwise uses the optimal
+ * transfer length if known. */
+static void
+auto_bpt_tune(struct opts_t * clp, int64_t count)
+{
+    int k, j, t, cap, mx, opt, i_opt, o_opt, num, best, per;
+    int bs = clp->bs;
+    int64_t off, n;
+    uint64_t t0;
+    double best_mbs;
+    int cands[AUTO_BPT_MAX_CANDS];
+    double r[AUTO_BPT_MAX_CANDS];
+    uint8_t * free_bp = NULL;
+    Rq_elem * rep;
+
+    mx = sg_dde_xfer_limits(clp->infd, clp->in_type, bs, &i_opt,
+                            clp->debug);
+    t = sg_dde_xfer_limits(clp->outfd, clp->out_type, bs, &o_opt,
+                           clp->debug);
+    if ((t > 0) && ((0 == mx) || (t < mx)))
+        mx = t;
+    opt = o_opt ? o_opt : i_opt;        /* the write side matters more */
+    cap = AUTO_BPT_MAX_BYTES / bs;
+    if ((mx > 0) && (mx < cap))
+        cap = mx;
+    if (cap > USHRT_MAX)        /* limit of READ(10) and WRITE(10) */
+        cap = USHRT_MAX;
+    if (cap < 1)
+        cap = 1;
+    /* ascending list of candidates: powers of 2, cap and opt */
+    num = 0;
+    k = AUTO_BPT_MIN_BYTES / bs;
+    for (k = (k > 0) ? k : 1; (k < cap) && (num < AUTO_BPT_MAX_CANDS - 2);
+         k *= 2)
+        cands[num++] = k;
+    cands[num++] = cap;
+    if ((opt > 0) && (opt < cap)) {
+        for (k = 0; (k < num) && (cands[k] < opt); ++k)
+            ;
+        if (cands[k] != opt) {
+            for (j = num; j > k; --j)
+                cands[j] = cands[j - 1];
+            cands[k] = opt;
+            ++num;
+        }
+    }
+    per = AUTO_BPT_PROBE_BYTES / bs;
+    if ((((FT_SG != clp->in_type) && (clp->in_pos < 0)) ||
+         (count < ((int64_t)num * per)))) {
+        /* can't read IFILE twice or the probe would be most of the copy */
+        if (opt > 0)
+            clp->bpt = (opt < cap) ? opt : cap;
+        else
+            clp->bpt = (clp->bpt < cap) ? clp->bpt : cap;
+        pr2serr("bpt=auto: unable to probe, using bpt=%d\n", clp->bpt);
+        return;
+    }
+    rep = (Rq_elem *)calloc(1, sizeof(Rq_elem));
+    if (rep)
+        rep->buffp = sg_memalign(cap * bs, 0, &free_bp, false);
+    if ((NULL == rep) || (NULL == rep->buffp)) {
+        pr2serr("bpt=auto: out of memory, bpt=%d\n", clp->bpt);
+        free(rep);
+        return;
+    }
+    rep->infd = clp->infd;
+    rep->bs = bs;
+    rep->esp = err_stats_a;     /* counted as worker thread 0's */
+    rep->shp = shard_a;
+    rep->cdbsz_in = clp->cdbsz_in;
+    rep->rd_tmplp = &clp->rd_tmpl;
+    rep->in_flags = clp->in_flags;
+    rep->in_flags.mmap = 0;
+    rep->in_flags.dio = 0;
+    rep->debug = clp->debug;
+    best = 0;
+    best_mbs = 0.0;
+    for (k = 0, off = 0; k < num; ++k) {
+        t0 = sg_get_mono_ns();
+        for (n = 0; n < per; n += cands[k], off += cands[k]) {
+            if (! auto_bpt_read(clp, rep, off, cands[k]))
+                break;
+        }
+        r[k] = (n * bs * 1000.0) / (double)(sg_get_mono_ns() - t0 + 1);
+        if (n < per) {
+            pr2serr("bpt=auto: probe read failed at bpt=%d\n", cands[k]);
+            num = k;
+            break;
+        }
+        if (clp->debug)
+            pr2serr("bpt=auto: bpt=%d: %.2f MB/sec\n", cands[k], r[k]);
+        if (r[k] > best_mbs) {
+            best_mbs = r[k];
+            best = k;
+        }
+    }
+    free(free_bp);
+    free(rep);
+    if (0 == num)
+        return;
+    for (k = 0; k < best; ++k) {
+        if (r[k] >= (0.95 * best_mbs))
+            break;
+    }
+    clp->bpt = cands[k];
+    pr2serr("bpt=auto: chose bpt=%d (%d KiB), %.2f MB/sec reading; device "
+            "limits: max=%d opt=%d blocks\n", clp->bpt,
+            (int)(((int64_t)clp->bpt * bs) / 1024), r[k], mx, opt);
+    if (FT_SG == clp->in_type)
+        sg_prepare(clp->infd, bs, clp->bpt);
+    if (FT_SG == clp->out_type)
+        sg_prepare(clp->outfd, bs, clp->bpt);
+}
+
+static int
+sg_in_open(const char * fnp, struct flags_t * flagp, int bs, int bpt)
+{
+    int flags = O_RDWR;
+    int fd, err;
+    char ebuff[800];
+
+    if (flagp->direct)
+        flags |= O_DIRECT;
+    if (flagp->excl)
+        flags |= O_EXCL;
+    if (flagp->dsync)
+        flags |= O_SYNC;
+
+    if ((fd = open(fnp, flags)) < 0) {
+        err = errno;
+        snprintf(ebuff, EBUFF_SZ, "%scould not open %s for sg "
+                 "reading", my_name, fnp);
+        perror(ebuff);
+        return -sg_convert_errno(err);
+    }
+    if (sg_prepare(fd, bs, bpt)) {
+        close(fd);
+        return -SG_LIB_FILE_ERROR;
+    }
+    return fd;
+}
+
+static int
+sg_out_open(const char * fnp, struct flags_t * flagp, int bs, int bpt)
+{
+    int flags = O_RDWR;
+    int fd, err;
+    char ebuff[800];
+
+    if (flagp->direct)
+        flags |= O_DIRECT;
+    if (flagp->excl)
+        flags |= O_EXCL;
+    if (flagp->dsync)
+        flags |= O_SYNC;
+
+    if ((fd = open(fnp, flags)) < 0) {
+        err = errno;
+        snprintf(ebuff, EBUFF_SZ, "%scould not open %s for sg "
+                 "writing", my_name, fnp);
+        perror(ebuff);
+        return -sg_convert_errno(err);
+    }
+    if (sg_prepare(fd, bs, bpt)) {
+        close(fd);
+        return -SG_LIB_FILE_ERROR;
+    }
+    return fd;
+}
+
+/* Opens block device fnp again, with the access mode and flags of fd, so
+ * a worker thread has a file of its own to register with its io_uring.
+ * Not done with the excl flag (the device is already held open). Returns
+ * the new file descriptor or -1, then fd should continue to be used. */
+static int
+reopen_blk(const char * fnp, int fd, const struct flags_t * flagp)
+{
+    int fl;
+
+    if (flagp->excl || ((fl = fcntl(fd, F_GETFL)) < 0))
+        return -1;
+    return open(fnp, fl & (O_ACCMODE | O_DIRECT | O_SYNC));
+}
+
+/* Opens the of2= outputs and positions them at seek=SEEK. Returns 0 on
+ * success, else an exit status. */
+static int
+fan_open(struct opts_t * clp, int64_t seek)
+{
+    int k, flags, err;
+    struct fan_out * fop;
+    char ebuff[EBUFF_SZ];
+
+    for (k = 0; k < clp->num_fan; ++k) {
+        fop = clp->fan + k;
+        fop->type = sg_dde_filetype(fop->fn, 0, 0);
+        fop->pos = -1;
+        fop->cdbsz = clp->cdbsz_out;
+        if ((FT_ST == fop->type) || (FT_DEV_NULL == fop->type)) {
+            pr2serr("%sof2=%s: can't use tape or /dev/null\n", my_name,
+                    fop->fn);
+            return SG_LIB_FILE_ERROR;
+        } else if (FT_SG == fop->type) {
+            fop->fd = sg_out_open(fop->fn, &clp->out_flags, clp->bs,
+                                  clp->bpt);
+            if (fop->fd < 0)
+                return -fop->fd;
+            if ((MAX_SCSI_CDBSZ != fop->cdbsz) &&
+                (((dd_count + seek) > UINT_MAX) || (clp->bpt > USHRT_MAX)))
+                fop->cdbsz = MAX_SCSI_CDBSZ;
+            if (sg_dde_cdb_tmpl_init(&fop->tmpl, fop->cdbsz, true,
+                                     clp->out_flags.fua, clp->out_flags.dpo,
+                                     my_name))
+                return SG_LIB_SYNTAX_ERROR;
+            continue;
+        }
+        flags = O_WRONLY;
+        if (FT_RAW != fop->type) {
+            flags |= O_CREAT;
+            if (clp->out_flags.direct)
+                flags |= O_DIRECT;
+            if (clp->out_flags.excl)
+                flags |= O_EXCL;
+            if (clp->out_flags.dsync)
+                flags |= O_SYNC;
+            if (clp->out_flags.append)
+                flags |= O_APPEND;
+        }
+        if ((fop->fd = open(fop->fn, flags, 0666)) < 0) {
+            err = errno;
+            snprintf(ebuff, EBUFF_SZ, "%scould not open %s for writing",
+                     my_name, fop->fn);
+            perror(ebuff);
+            return sg_convert_errno(err);
+        }
+        if (FT_ERROR == fop->type)
+            fop->type = FT_OTHER;       /* file was just created */
+        if ((seek > 0) &&
+            (lseek64(fop->fd, (off64_t)seek * clp->bs, SEEK_SET) < 0)) {
+            err = errno;
+            snprintf(ebuff, EBUFF_SZ, "%scouldn't seek to required "
+                     "position on %s", my_name, fop->fn);
+            perror(ebuff);
+            return sg_convert_errno(err);
+        }
+        if (! clp->out_flags.append)
+            fop->pos = lseek64(fop->fd, 0, SEEK_CUR);
+        fop->seq = (fop->pos < 0);
+        if (fop->seq && (clp->o_sgl.num_elems > 0) &&
+            (SG_SGL_LINEAR != clp->o_sgl.linearity)) {
+            pr2serr("%sof2=%s can't follow a %s seek= list\n", my_name,
+                    fop->fn, sg_sgl_linearity_str(clp->o_sgl.linearity));
+            return SG_LIB_CONTRADICT;
+        }
+    }
+    return 0;
+}
+
+/* Invokes a SCSI STREAM CONTROL command (SBC-4) on sg_fd. When open is
+ * true a stream is opened and its ASSIGNED_STR_ID placed in *str_idp,
+ * otherwise stream *str_idp is closed. Returns 0 or a SG_LIB_CAT_* value,
+ * -1 for other errors. */
+static int
+stream_control(int sg_fd, bool open, uint16_t * str_idp, int verbose)
+{
+    int ret, res, sense_cat, resid;
+    uint8_t scCdb[16] = {SG_SERVICE_ACTION_IN_16, STREAM_CONTROL_SA,
+                         0, 0,  0, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0};
+    uint8_t resp[8] SG_C_CPP_ZERO_INIT;
+    uint8_t sense_b[SENSE_BUFF_LEN] SG_C_CPP_ZERO_INIT;
+    struct sg_pt_base * ptvp;
+    static const char * const cmd_name = "Stream control";
+
+    scCdb[1] |= (open ? 1 : 2) << 5;
+    if (! open)
+        sg_put_unaligned_be16(*str_idp, scCdb + 4);
+    sg_put_unaligned_be32(sizeof(resp), scCdb + 10);
+    if (verbose > 1) {
+        char b[128];
+
+        pr2serr("    %s cdb: %s\n", cmd_name,
+                sg_get_command_str(scCdb, (int)sizeof(scCdb), false,
+                                   sizeof(b), b));
+    }
+    ptvp = construct_scsi_pt_obj_with_fd(sg_fd, verbose);
+    if (NULL == ptvp) {
+        pr2serr("%s: out of memory\n", cmd_name);
+        return -1;
+    }
+    set_scsi_pt_cdb(ptvp, scCdb, sizeof(scCdb));
+    set_scsi_pt_data_in(ptvp, resp, sizeof(resp));
+    set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
+    res = do_scsi_pt(ptvp, -1, DEF_TIMEOUT / 1000, verbose);
+    ret = sg_cmds_process_resp(ptvp, cmd_name, res, true, verbose,
+                               &sense_cat);
+    if (-1 == ret) {
+        if (get_scsi_pt_transport_err(ptvp))
+            ret = SG_LIB_TRANSPORT_ERROR;
+        else
+            ret = sg_convert_errno(get_scsi_pt_os_err(ptvp));
+    } else if (-2 == ret) {
+        switch (sense_cat) {
+        case SG_LIB_CAT_RECOVERED:
+        case SG_LIB_CAT_NO_SENSE:
+            ret = 0;
+            break;
+        default:
+            ret = sense_cat;
+            break;
+        }
+    } else
+        ret = 0;
+    if ((0 == ret) && open) {
+        resid = get_scsi_pt_resid(ptvp);
+        if (((int)sizeof(resp) - resid) < 6) {
+            pr2serr("%s: response too short for assigned stream id\n",
+                    cmd_name);
+            ret = SG_LIB_CAT_MALFORMED;
+        } else
+            *str_idp = sg_get_unaligned_be16(resp + 4);
+    }
+    destruct_scsi_pt_obj(ptvp);
+    return ret;
+}
+
+/* streams=N[,MAP]: opens N streams on OFILE before the copy starts. If the
+ * device runs out of streams after the first, the copy uses those opened.
+ * Returns 0 or an exit status. */
+static int
+streams_open(struct opts_t * clp)
+{
+    int k, res;
+    int n = clp->num_streams;
+    uint16_t id = 0;
+    char b[80];
+
+    clp->num_streams = 0;
+    for (k = 0; k < n; ++k) {
+        res = stream_control(clp->outfd, true, &id, clp->debug);
+        if ((0 == res) && (0 == id))
+            res = SG_LIB_CAT_MALFORMED;
+        if (res) {
+            sg_get_category_sense_str(res, sizeof(b), b, clp->debug);
+            if (k > 0) {
+                pr2serr("%sopening stream %d: %s, continuing with %d "
+                        "streams\n", my_name, k + 1, b, k);
+                break;
+            }
+            if (SG_LIB_CAT_INVALID_OP == res)
+                pr2serr("%sOFILE does not support streams\n", my_name);
+            else
+                pr2serr("%sunable to open stream: %s\n", my_name, b);
+            return res;
+        }
+        clp->str_ids[clp->num_streams++] = id;
+        if (clp->debug)
+            pr2serr("opened stream id %u on %s\n", id, outfn);
+    }
+    return 0;
+}
+
+static void
+streams_close(struct opts_t * clp)
+{
+    int k, res;
+    char b[80];
+
+    for (k = 0; k < clp->num_streams; ++k) {
+        res = stream_control(clp->outfd, false, clp->str_ids + k,
+                             clp->debug);
+        if (res) {
+            sg_get_category_sense_str(res, sizeof(b), b, clp->debug);
+            pr2serr("%sclosing stream id %u: %s\n", my_name,
+                    clp->str_ids[k], b);
+        } else if (clp->debug)
+            pr2serr("closed stream id %u on %s\n", clp->str_ids[k], outfn);
+    }
+    clp->num_streams = 0;
+}
+
+/* Stream id for the write at block offset off, for the maps other than
+ * SGP_STR_THREAD which is fixed per worker thread */
+static uint16_t
+stream_pick(const struct opts_t * clp, int64_t off)
+{
+    int lo, hi, mid;
+    const struct sg_sgl * sglp = &clp->o_sgl;
+
+    if ((SGP_STR_SEG == clp->str_map) && (sglp->num_elems > 0)) {
+        /* last element whose start is <= off, as sg_sgl_idx_to_lba() */
+        for (lo = 0, hi = sglp->num_elems - 1; lo < hi; ) {
+            mid = (lo + hi + 1) / 2;
+            if (sglp->starts[mid] <= off)
+                lo = mid;
+            else
+                hi = mid - 1;
+        }
+        return clp->str_ids[lo % clp->num_streams];
+    }
+    if (dd_count <= 0)
+        return clp->str_ids[0];
+    lo = (int)((off * clp->num_streams) / dd_count);
+    if (lo >= clp->num_streams)
+        lo = clp->num_streams - 1;
+    return clp->str_ids[lo];
+}
+
+/* The --chkaddr and --genaddr pattern: each 4 bytes of a block holds the
+ * low 32 bits of the block's address, xor-ed with seed=S, big endian. On
+ * x86_64 that is filled and compared 32 bytes at a time with AVX2 when the
+ * CPU has it, otherwise 16 bytes at a time with SSE2; elsewhere 8 bytes at
+ * a time. Bytes after the last whole 4 bytes of a block are ignored. */
+static int addr_avx2 = -1;      /* -1: not checked yet */
+
+static void
+addr_pat_init(void)
+{
+#ifdef SGP_ADDR_X86
+    __builtin_cpu_init();
+    addr_avx2 = !! __builtin_cpu_supports("avx2");
+#else
+    addr_avx2 = 0;
+#endif
+}
+
+/* Returns addr as it appears in memory when stored big endian */
+static inline uint32_t
+addr_word(uint32_t addr)
+{
+    uint32_t w;
+    uint8_t b[4];
+
+    sg_put_unaligned_be32(addr, b);
+    memcpy(&w, b, sizeof(w));
+    return w;
+}
+
+#ifdef SGP_ADDR_X86
+__attribute__((target("avx2")))
+static int
+addr_blk_avx2(uint8_t * bp, int len, uint32_t w, bool fill)
+{
+    int j = 0;
+    const __m256i p = _mm256_set1_epi32((int)w);
+
+    if (fill) {
+        for ( ; j + 32 <= len; j += 32)
+            _mm256_storeu_si256((__m256i *)(bp + j), p);
+    } else {
+        for ( ; j + 32 <= len; j += 32) {
+            __m256i d = _mm256_loadu_si256((const __m256i *)(bp + j));
+
+            if (-1 != _mm256_movemask_epi8(_mm256_cmpeq_epi8(d, p)))
+                return -1;
+        }
+    }
+    return j;
+}
+#endif
+
+/* Fills (or checks) the len bytes at bp, len a multiple of 4, with w.
+ * Returns true if filling or all matched. */
+static bool
+addr_blk(uint8_t * bp, int len, uint32_t w, bool fill)
+{
+    int j = 0;
+
+#ifdef SGP_ADDR_X86
+    if (addr_avx2 > 0) {
+        j = addr_blk_avx2(bp, len, w, fill);
+        if (j < 0)
+            return false;
+    } else {
+        const __m128i p = _mm_set1_epi32((int)w);
+
+        if (fill) {
+            for ( ; j + 16 <= len; j += 16)
+                _mm_storeu_si128((__m128i *)(bp + j), p);
+        } else {
+            for ( ; j + 16 <= len; j += 16) {
+                __m128i d = _mm_loadu_si128((const __m128i *)(bp + j));
+
+                if (0xffff != _mm_movemask_epi8(_mm_cmpeq_epi8(d, p)))
+                    return false;
+            }
+        }
+    }
+#else
+    uint64_t p = ((uint64_t)w << 32) | w;
+    uint64_t d;
+
+    for ( ; j + 8 <= len; j += 8) {
+        if (fill)
+            memcpy(bp + j, &p, sizeof(p));
+        else {
+            memcpy(&d, bp + j, sizeof(d));
+            if (d != p)
+                return false;
+        }
+    }
+#endif
+    for ( ; j < len; j += 4) {
+        if (fill)
+            memcpy(bp + j, &w, sizeof(w));
+        else if (memcmp(bp + j, &w, sizeof(w)))
+            return false;
+    }
+    return true;
+}
+
+/* Places the pattern in num_blks blocks of bs bytes, the first at addr */
+static void
+addr_fill(const struct opts_t * clp, uint8_t * bp, int bs, int num_blks,
+          uint32_t addr)
+{
+    int m;
+
+    for (m = 0; m < num_blks; ++m, ++addr, bp += bs)
+        addr_blk(bp, bs & ~3, addr_word(addr ^ clp->addr_seed), true);
+}
+
+/* Returns the index of the first of num_blks blocks, the first at addr,
+ * that fails the check, or num_blks if all pass. When once is true only
+ * the first 4 bytes of each block are checked. */
+static int
+addr_check(const struct opts_t * clp, uint8_t * bp, int bs, int num_blks,
+           uint32_t addr, bool once)
+{
+    int m;
+    uint32_t w;
+
+    for (m = 0; m < num_blks; ++m, ++addr, bp += bs) {
+        w = addr_word(addr ^ clp->addr_seed);
+        if (once ? !! memcmp(bp, &w, sizeof(w)) :
+                   (! addr_blk(bp, bs & ~3, w, false)))
+            break;
+    }
+    return m;
+}
+
+/* Returns the number of leading elements of reps that were read without
+ * error and whose data passed the chkaddr check (if any). With --genaddr
+ * nothing is read: the pattern for each block's OFILE address is placed
+ * in the buffers instead. Likewise with if=pat:PAT, where a pattern that
+ * is the same for every block is only placed once in each buffer. */
+static int
+read_batch(struct opts_t * clp, Rq_elem * reps, const int64_t * offs, int n,
+           bool in_seq)
+{
+    int k, c_addr;
+    Rq_elem * rep;
+
+    c_addr = clp->chkaddr;
+    if (clp->genaddr) {
+        for (k = 0; k < n; ++k) {
+            rep = reps + k;
+            addr_fill(clp, rep->buffp, rep->bs, rep->num_blks,
+                      (uint32_t)out_lba(clp, offs[k]));
+            shard_add64(&rep->shp->in_blks, rep->num_blks);
+        }
+        return n;
+    }
+    if (SG_PAT_NONE != clp->pat.kind) {
+        for (k = 0; k < n; ++k) {
+            rep = reps + k;
+            if (! sg_pat_lba_indep(&clp->pat))
+                sg_pat_fill(&clp->pat, rep->buffp, rep->bs,
+                            out_lba(clp, offs[k]), rep->num_blks);
+            else if (rep->num_blks > rep->pat_blks) {
+                sg_pat_fill(&clp->pat, rep->buffp, rep->bs, 0,
+                            rep->num_blks);
+                rep->pat_blks = rep->num_blks;
+            }
+            shard_add64(&rep->shp->in_blks, rep->num_blks);
+        }
+        return n;
+    }
+    if (clp->in_flags.cimage)
+        return cimg_read_batch(clp, reps, n);
+    if ((FT_SG == clp->in_type) && (n > 1))
+        sg_in_batch(clp, reps, n);
+    else if (reps->urp && clp->in_flags.uring && (! in_seq) && (n > 1) &&
+             ((k = normal_in_batch(clp, reps, n)) >= 0))
+        n = k;
+    else {
+        for (k = 0; k < n; ++k) {
+            rep = reps + k;
+            /* sequential input (e.g. a pipe) must be read in block order */
+            if (in_seq && (! wait_turn(clp, &clp->in_turn, offs[k])))
+                break;
+            if (FT_SG == clp->in_type)
+                sg_in_operation(clp, rep);
+            else
+                normal_in_operation(clp, rep, rep->num_blks);
+            if (in_seq)
+                advance_turn(clp, &clp->in_turn, offs[k] + rep->num_blks);
+            if (rep->in_err || rep->in_stop) {
+                ++k;
+                break;
+            }
+        }
+        n = k;
+    }
+    for (k = 0; k < n; ++k) {
+        rep = reps + k;
+        if (rep->in_err)
+            break;
+        if (c_addr && (rep->bs > 3)) {
+            int m = addr_check(clp, rep->buffp, rep->bs, rep->num_blks,
+                               (uint32_t)rep->blk, (1 == c_addr));
+
+            if (m < rep->num_blks) {
+                pr2serr("%s: chkaddr failure at addr=0x%x\n", __func__,
+                        (uint32_t)rep->blk + m);
+                rep->in_err = true;
+                break;
+            }
+        }
+        if (rep->in_stop) {
+            ++k;        /* short read, but what was read is written */
+            break;
+        }
+    }
+    return k;
+}
 
-    res = ioctl(fd, SG_GET_VERSION_NUM, &t);
-    if ((res < 0) || (t < 30000)) {
-        pr2serr("%ssg driver prior to 3.x.y\n", my_name);
-        return 1;
+/* oflag=delta: returns true if OFILE already holds the data read into rep
+ * so its write can be skipped. A sg OFILE compares on the device with
+ * VERIFY (BYTCHK=1) so the data crosses the transport once; others are
+ * read back into rep->delta_bp and compared here. If OFILE can't be read
+ * the range is simply written. */
+static bool
+delta_same(struct opts_t * clp, Rq_elem * rep)
+{
+    int res;
+    int len = rep->num_blks * rep->bs;
+    int vb = (clp->debug > 1) ? clp->debug - 1 : 0;
+    off64_t pos;
+    char b[80];
+
+    if ((rep->num_blks <= 0) || (rep->in_bytes > 0))
+        return false;   /* nothing or a partial block, leave to write */
+    if (FT_SG == clp->out_type) {
+        if ((MAX_SCSI_CDBSZ == clp->cdbsz_out) || (rep->blk > UINT_MAX))
+            res = sg_ll_verify16(rep->outfd, 0, false, 1 /* BYTCHK */,
+                                 rep->blk, rep->num_blks, 0, rep->buffp,
+                                 len, NULL, false, vb);
+        else
+            res = sg_ll_verify10(rep->outfd, 0, false, 1 /* BYTCHK */,
+                                 (unsigned int)rep->blk, rep->num_blks,
+                                 rep->buffp, len, NULL, false, vb);
+        if (0 == res)
+            return true;
+        if ((SG_LIB_CAT_MISCOMPARE != res) && clp->debug) {
+            sg_get_category_sense_str(res, sizeof(b), b, clp->debug);
+            pr2serr(">> delta: VERIFY at OFILE blk=%" PRId64 " failed: "
+                    "%s, writing\n", rep->blk, b);
+        }
+        return false;
     }
-    t = bs * bpt;
-    res = ioctl(fd, SG_SET_RESERVED_SIZE, &t);
-    if (res < 0)
-        perror("sgp_dd: SG_SET_RESERVED_SIZE error");
-    t = 1;
-    res = ioctl(fd, SG_SET_FORCE_PACK_ID, &t);
-    if (res < 0)
-        perror("sgp_dd: SG_SET_FORCE_PACK_ID error");
-    return 0;
+    pos = clp->out_pos + (rep->blk - clp->seek) * rep->bs;
+    while (((res = pread(rep->outfd, rep->delta_bp, len, pos)) < 0) &&
+           ((EINTR == errno) || (EAGAIN == errno)))
+        ;
+    return (res == len) && (0 == memcmp(rep->delta_bp, rep->buffp, len));
 }
 
-static int
-sg_in_open(const char * fnp, struct flags_t * flagp, int bs, int bpt)
+/* Writes the first n elements of reps, stopping early on error. Returns
+ * false if the worker thread should stop. */
+static bool
+write_batch(struct opts_t * clp, Rq_elem * reps, const int64_t * offs, int n)
 {
-    int flags = O_RDWR;
-    int fd, err;
-    char ebuff[800];
+    int k;
+    Rq_elem * rep;
 
-    if (flagp->direct)
-        flags |= O_DIRECT;
-    if (flagp->excl)
-        flags |= O_EXCL;
-    if (flagp->dsync)
-        flags |= O_SYNC;
+    for (k = 0; k < n; ++k) {
+        rep = reps + k;
+        rep->wr = true;
+        rep->blk = out_lba(clp, offs[k]);
+        if ((clp->num_streams > 0) && (SGP_STR_THREAD != clp->str_map))
+            rep->str_id = stream_pick(clp, offs[k]);
+    }
+    if (clp->cimg_alg)
+        return cimg_write_batch(clp, reps, offs, n);
+    if (clp->out_flags.delta) {
+        /* ranges that differ are written one at a time, below */
+        for (k = 0; k < n; ++k) {
+            rep = reps + k;
+            if (0 == rep->num_blks)
+                return false;
+            if (threads_exiting())
+                return false;
+            if (delta_same(clp, rep)) {
+                shard_add64(&rep->shp->out_blks, rep->num_blks);
+                shard_add64(&rep->shp->same_blks, rep->num_blks);
+                if (0 == clp->num_fan)
+                    ckpt_mark(clp, offs[k]);
+                continue;
+            }
+            if (FT_SG == clp->out_type)
+                sg_out_operation(clp, rep);
+            else
+                normal_out_operation(clp, rep, rep->num_blks);
+            if (rep->out_err)
+                return false;
+            if (0 == clp->num_fan)
+                ckpt_mark(clp, offs[k]);
+            if (clp->vfyp)
+                vfy_queue(clp, rep);
+        }
+        return true;
+    }
+    if ((FT_SG == clp->out_type) && (n > 1)) {
+        bool ok = true;
+
+        sg_out_batch(clp, reps, n);
+        for (k = 0; k < n; ++k) {
+            if (reps[k].out_err)
+                ok = false;
+            else {
+                if (0 == clp->num_fan)  /* else after the of2= writes */
+                    ckpt_mark(clp, offs[k]);
+                if (clp->vfyp)
+                    vfy_queue(clp, reps + k);
+            }
+        }
+        return ok;
+    }
+    if (reps->urp && clp->out_flags.uring && (n > 1) &&
+        (FT_SG != clp->out_type) && (FT_DEV_NULL != clp->out_type) &&
+        (! clp->out_seq)) {
+        int m, j;
 
-    if ((fd = open(fnp, flags)) < 0) {
-        err = errno;
-        snprintf(ebuff, EBUFF_SZ, "%scould not open %s for sg "
-                 "reading", my_name, fnp);
-        perror(ebuff);
-        return -sg_convert_errno(err);
+        for (m = 0; (m < n) && (reps[m].num_blks > 0); ++m)
+            ;
+        if (threads_exiting())
+            return false;
+        if ((m > 0) && ((k = normal_out_batch(clp, reps, m)) >= 0)) {
+            for (j = 0; j < k; ++j) {
+                if (reps[j].out_err)
+                    return false;
+                if (0 == clp->num_fan)
+                    ckpt_mark(clp, offs[j]);
+                if (clp->vfyp)
+                    vfy_queue(clp, reps + j);
+            }
+            return (m == n);    /* read nothing after m so leave loop */
+        }
     }
-    if (sg_prepare(fd, bs, bpt)) {
-        close(fd);
-        return -SG_LIB_FILE_ERROR;
+    for (k = 0; k < n; ++k) {
+        rep = reps + k;
+        if (0 == rep->num_blks)
+            return false;       /* read nothing so leave loop */
+        /* only outputs that can't take positioned writes need ordering */
+        if (clp->out_seq && (! wait_turn(clp, &clp->out_turn, offs[k])))
+            return false;
+        if (threads_exiting())
+            return false;
+        if (FT_SG == clp->out_type)
+            sg_out_operation(clp, rep);
+        else if (FT_DEV_NULL == clp->out_type) {
+            /* skip actual write operation */
+            shard_add64(&rep->shp->out_blks, rep->num_blks);
+        }
+        else
+            normal_out_operation(clp, rep, rep->num_blks);
+        if (clp->out_seq)
+            advance_turn(clp, &clp->out_turn, offs[k] + rep->num_blks);
+        if (rep->out_err)
+            return false;
+        if (0 == clp->num_fan)
+            ckpt_mark(clp, offs[k]);
+        if (clp->vfyp)
+            vfy_queue(clp, rep);
     }
-    return fd;
+    return true;
 }
 
-static int
-sg_out_open(const char * fnp, struct flags_t * flagp, int bs, int bpt)
+/* Writes the n ranges in reps, just read, to of2= output fop. The buffers
+ * are shared with the worker thread and the other helpers so reps is
+ * copied for the per command state. Returns false on error. */
+static bool
+fan_write(struct opts_t * clp, struct fan_out * fop,
+          struct sg_err_stats * esp, const Rq_elem * reps,
+          const int64_t * offs, int n)
 {
-    int flags = O_RDWR;
-    int fd, err;
-    char ebuff[800];
-
-    if (flagp->direct)
-        flags |= O_DIRECT;
-    if (flagp->excl)
-        flags |= O_EXCL;
-    if (flagp->dsync)
-        flags |= O_SYNC;
+    bool ok = true;
+    int k, started, res, len, err;
+    Rq_elem * rep;
+    Rq_elem rel[MAX_QUEUE_DEPTH];
+    char strerr_buff[STRERR_BUFF_LEN + 1];
 
-    if ((fd = open(fnp, flags)) < 0) {
+    for (k = 0; (k < n) && (reps[k].num_blks > 0); ++k) {
+        rep = rel + k;
+        *rep = reps[k];
+        rep->wr = true;
+        rep->outfd = fop->fd;
+        rep->blk = out_lba(clp, offs[k]);
+        rep->cdbsz_out = fop->cdbsz;
+        rep->wr_tmplp = &fop->tmpl;
+        rep->out_flags.mmap = 0;    /* mmap-ed buffer is not of this fd */
+        rep->str_id = 0;            /* streams=N are only open on OFILE */
+        rep->out_err = false;
+        rep->esp = esp;
+    }
+    n = k;
+    if (FT_SG == fop->type) {
+        for (started = 0; started < n; ++started) {
+            if (0 != sg_start_io(rel + started)) {
+                ok = false;
+                break;
+            }
+        }
+        for (k = 0; k < started; ++k) {
+            rep = rel + k;
+            do {
+                res = sg_finish_io(true, rep, &clp->inout_mutex);
+                if (((SG_LIB_CAT_ABORTED_COMMAND == res) ||
+                     (SG_LIB_CAT_UNIT_ATTENTION == res)) &&
+                    (0 != sg_start_io(rep)))
+                    res = -1;
+            } while ((SG_LIB_CAT_ABORTED_COMMAND == res) ||
+                     (SG_LIB_CAT_UNIT_ATTENTION == res));
+            if ((SG_LIB_CAT_MEDIUM_HARD == res) && rep->out_flags.coe) {
+                pr2serr(">> ignored error for %s blk=%" PRId64 " for %d "
+                        "bytes\n", fop->fn, rep->blk, rep->num_blks * rep->bs);
+                res = 0;
+            }
+            if (res) {
+                pr2serr("%serror writing %s, blk=%" PRId64 " (%d)\n",
+                        my_name, fop->fn, rep->blk, res);
+                if (exit_status <= 0)
+                    exit_status = res;
+                ok = false;
+            } else
+                blk_fetch_add(&fop->out_blks, rep->num_blks);
+        }
+        return ok;
+    }
+    for (k = 0; ok && (k < n); ++k) {
+        rep = rel + k;
+        len = rep->num_blks * rep->bs;
+        if (fop->seq && (! wait_turn(clp, &fop->turn, offs[k])))
+            return false;
+        if (fop->pos >= 0) {
+            while (((res = pwrite(fop->fd, rep->buffp, len,
+                                  fop->pos + ((rep->blk - clp->seek) *
+                                              rep->bs))) < 0) &&
+                   ((EINTR == errno) || (EAGAIN == errno)))
+                ;
+        } else {
+            while (((res = write(fop->fd, rep->buffp, len)) < 0) &&
+                   ((EINTR == errno) || (EAGAIN == errno)))
+                ;
+        }
         err = errno;
-        snprintf(ebuff, EBUFF_SZ, "%scould not open %s for sg "
-                 "writing", my_name, fnp);
-        perror(ebuff);
-        return -sg_convert_errno(err);
+        sg_err_stats_cat(esp, (res < len) ? SG_LIB_FILE_ERROR : 0);
+        if (res < 0)
+            sg_err_stats_errno(esp, err);
+        if (fop->seq)
+            advance_turn(clp, &fop->turn, offs[k] + rep->num_blks);
+        if ((res < 0) && rep->out_flags.coe) {
+            pr2serr(">> ignored error for %s blk=%" PRId64 " for %d bytes, "
+                    "%s\n", fop->fn, rep->blk, len,
+                    tsafe_strerror(err, strerr_buff));
+            res = len;
+        }
+        if (res < len) {
+            pr2serr("%serror writing %s, blk=%" PRId64 ", %s\n", my_name,
+                    fop->fn, rep->blk, (res < 0) ?
+                    tsafe_strerror(err, strerr_buff) : "short write");
+            if (exit_status <= 0)
+                exit_status = SG_LIB_FILE_ERROR;
+            ok = false;
+        } else
+            blk_fetch_add(&fop->out_blks, rep->num_blks);
     }
-    if (sg_prepare(fd, bs, bpt)) {
-        close(fd);
-        return -SG_LIB_FILE_ERROR;
+    return ok;
+}
+
+static void *
+fan_thread(void * v_fap)
+{
+    struct fan_arg * fap = (struct fan_arg *)v_fap;
+    struct fan_batch * fbp = fap->fbp;
+    struct opts_t * clp = &my_opts;
+    bool ok;
+    int status;
+    unsigned int gen = 0;
+
+    while (1) {
+        status = pthread_mutex_lock(&fbp->mutex);
+        if (0 != status) err_exit(status, "lock fan mutex");
+        while ((gen == fbp->gen) && (! fbp->quit)) {
+            status = pthread_cond_wait(&fbp->cv, &fbp->mutex);
+            if (0 != status) err_exit(status, "cond fan cv");
+        }
+        gen = fbp->gen;
+        if (fbp->quit) {
+            pthread_mutex_unlock(&fbp->mutex);
+            break;
+        }
+        status = pthread_mutex_unlock(&fbp->mutex);
+        if (0 != status) err_exit(status, "unlock fan mutex");
+
+        ok = fan_write(clp, clp->fan + fap->idx, fap->esp, fbp->reps,
+                       fbp->offs, fbp->n);
+
+        status = pthread_mutex_lock(&fbp->mutex);
+        if (0 != status) err_exit(status, "lock fan mutex");
+        if (! ok)
+            fbp->err = true;
+        if (0 == --fbp->refs)
+            pthread_cond_broadcast(&fbp->cv);
+        status = pthread_mutex_unlock(&fbp->mutex);
+        if (0 != status) err_exit(status, "unlock fan mutex");
     }
-    return fd;
+    return NULL;
+}
+
+/* esp points to the worker's error statistics, those of its helpers
+ * follow */
+static void
+fan_start(struct opts_t * clp, struct fan_batch * fbp,
+          struct sg_err_stats * esp)
+{
+    int k, status;
+
+    memset(fbp, 0, sizeof(*fbp));
+    status = pthread_mutex_init(&fbp->mutex, NULL);
+    if (0 != status) err_exit(status, "init fan mutex");
+    status = pthread_cond_init(&fbp->cv, NULL);
+    if (0 != status) err_exit(status, "init fan cv");
+    for (k = 0; k < clp->num_fan; ++k) {
+        fbp->args[k].fbp = fbp;
+        fbp->args[k].idx = k;
+        fbp->args[k].esp = esp + 1 + k;
+        status = pthread_create(&fbp->args[k].id, NULL, fan_thread,
+                                (void *)(fbp->args + k));
+        if (0 != status) err_exit(status, "pthread_create, fan");
+    }
+}
+
+static void
+fan_stop(struct opts_t * clp, struct fan_batch * fbp)
+{
+    int k, status;
+
+    status = pthread_mutex_lock(&fbp->mutex);
+    if (0 != status) err_exit(status, "lock fan mutex");
+    fbp->quit = true;
+    pthread_cond_broadcast(&fbp->cv);
+    status = pthread_mutex_unlock(&fbp->mutex);
+    if (0 != status) err_exit(status, "unlock fan mutex");
+    for (k = 0; k < clp->num_fan; ++k) {
+        status = pthread_join(fbp->args[k].id, NULL);
+        if (0 != status) err_exit(status, "pthread_join, fan");
+    }
+    pthread_cond_destroy(&fbp->cv);
+    pthread_mutex_destroy(&fbp->mutex);
+}
+
+/* Hands the n ranges just read to the helper threads; the worker's own
+ * write of OFILE holds the last reference */
+static void
+fan_dispatch(struct opts_t * clp, struct fan_batch * fbp,
+             const Rq_elem * reps, const int64_t * offs, int n)
+{
+    int status;
+
+    status = pthread_mutex_lock(&fbp->mutex);
+    if (0 != status) err_exit(status, "lock fan mutex");
+    fbp->reps = reps;
+    fbp->offs = offs;
+    fbp->n = n;
+    fbp->refs = clp->num_fan + 1;
+    ++fbp->gen;
+    pthread_cond_broadcast(&fbp->cv);
+    status = pthread_mutex_unlock(&fbp->mutex);
+    if (0 != status) err_exit(status, "unlock fan mutex");
+}
+
+/* Called once the worker has written OFILE. Drops its reference then waits
+ * until the helpers are done with the buffers. Returns false if any of them
+ * failed. */
+static bool
+fan_wait(struct fan_batch * fbp)
+{
+    bool ok;
+    int status;
+
+    status = pthread_mutex_lock(&fbp->mutex);
+    if (0 != status) err_exit(status, "lock fan mutex");
+    --fbp->refs;
+    while (fbp->refs > 0) {
+        status = pthread_cond_wait(&fbp->cv, &fbp->mutex);
+        if (0 != status) err_exit(status, "cond fan cv");
+    }
+    ok = ! fbp->err;
+    status = pthread_mutex_unlock(&fbp->mutex);
+    if (0 != status) err_exit(status, "unlock fan mutex");
+    return ok;
 }
 
 static void *
@@ -806,22 +3820,32 @@ read_write_thread(void * v_tap)
 {
     struct thread_arg * tap = (struct thread_arg *)v_tap;
     struct opts_t * clp = &my_opts;
-    Rq_elem rel;
-    Rq_elem * rep = &rel;
-    volatile bool stop_after_write, bb;
-    bool enforce_write_ordering;
-    int sz, c_addr;
-    int64_t out_blk, out_count;
-    int64_t seek_skip = tap->seek_skip;
-    int blocks, status;
-
+    Rq_elem rel[MAX_QUEUE_DEPTH];
+    Rq_elem * rep = rel;
+    volatile bool stop_after_write, first_done, in_stop;
+    bool in_seq, wr_ok;
+    int sz, status;
+    volatile int own_infd = -1;
+    volatile int own_outfd = -1;
+    volatile int k, n, n_read;
+    uint8_t * volatile delta_alloc_bp = NULL;
+    uint8_t * volatile cimg_alloc_bp = NULL;
+    uint64_t nbytes;
+    int64_t offs[MAX_QUEUE_DEPTH];
+    struct fan_batch fb;
+    struct zone_cur zc;
+
+    zc.idx = -1;
+    zc.off = 0;
     stop_after_write = false;
-    enforce_write_ordering = (FT_DEV_NULL != clp->out_type) &&
-                             (FT_SG != clp->out_type);
-    c_addr = clp->chkaddr;
+    in_stop = false;
+    first_done = (0 != tap->id);
+    in_seq = (FT_SG != clp->in_type) && (clp->in_pos < 0);
     memset(rep, 0, sizeof(*rep));
     /* Following clp members are constant during lifetime of thread */
     rep->bs = clp->bs;
+    rep->esp = err_stats_a + (tap->id * (clp->num_fan + 1));
+    rep->shp = shard_a + tap->id;
     if ((clp->num_threads > 1) && clp->mmap_active) {
         /* sg devices need separate file descriptor */
         if (clp->in_flags.mmap && (FT_SG == clp->in_type)) {
@@ -836,6 +3860,20 @@ read_write_thread(void * v_tap)
 
         } else
             rep->outfd = clp->outfd;
+    } else if (clp->share_active) {
+        /* each worker shares the buffer of its own pair of sg fds */
+        rep->infd = sg_in_open(infn, &clp->in_flags, rep->bs, clp->bpt);
+        if (rep->infd < 0) err_exit(-rep->infd, "error opening infn");
+        rep->outfd = sg_out_open(outfn, &clp->out_flags, rep->bs, clp->bpt);
+        if (rep->outfd < 0) err_exit(-rep->outfd, "error opening outfn");
+        rep->share = sg_share_prepare(rep->outfd, rep->infd, tap->id,
+                                      ((0 == tap->id) || (clp->debug > 1)));
+        if ((! rep->share) && (0 == tap->id))
+            pr2serr("%sshare flag failed, copying via user space\n",
+                    my_name);
+        else if (rep->share && (clp->debug > 1))
+            pr2serr("thread=%d: read side fd=%d shared with write side "
+                    "fd=%d\n", tap->id, rep->infd, rep->outfd);
     } else {
         rep->infd = clp->infd;
         rep->outfd = clp->outfd;
@@ -844,141 +3882,204 @@ read_write_thread(void * v_tap)
     rep->debug = clp->debug;
     rep->cdbsz_in = clp->cdbsz_in;
     rep->cdbsz_out = clp->cdbsz_out;
+    rep->rd_tmplp = &clp->rd_tmpl;
+    rep->wr_tmplp = &clp->wr_tmpl;
     rep->in_flags = clp->in_flags;
     rep->out_flags = clp->out_flags;
-    rep->use_no_dxfer = (FT_DEV_NULL == clp->out_type);
+    if (clp->num_streams > 0)   /* other maps pick per write */
+        rep->str_id = clp->str_ids[tap->id % clp->num_streams];
+    /* hash=ALG needs the data that was read even if OFILE is /dev/null */
+    rep->use_no_dxfer = (FT_DEV_NULL == clp->out_type) &&
+                        (! clp->hash_alg) && (0 == clp->num_fan);
     if (clp->mmap_active) {
         int fd = clp->in_flags.mmap ? rep->infd : rep->outfd;
 
         status = sgp_mem_mmap(fd, sz, &rep->buffp);
         if (status) err_exit(status, "sgp_mem_mmap() failed");
-    } else {
-        rep->buffp = sg_memalign(sz, 0 /* page align */, &rep->alloc_bp,
-                                 false);
-        if (NULL == rep->buffp)
-            err_exit(ENOMEM, "out of memory creating user buffers\n");
     }
+    if ((clp->num_cpus > 0) || (clp->num_hwq > 0))
+        pin_worker_thread(clp, tap->id);
+    /* when mmap-ed, qd is 1 so only rel[0] is used */
+    for (k = 0; k < clp->qd; ++k) {
+        if (k > 0)
+            rel[k] = rel[0];
+        if (! clp->mmap_active) {
+            if (clp->in_flags.hugepage || clp->out_flags.hugepage)
+                rel[k].buffp = sg_memalign_hugepage(sz, &rel[k].alloc_bp,
+                                                    &rel[k].hp_kind,
+                                                    (0 == tap->id) &&
+                                                    (0 == k) &&
+                                                    (clp->debug > 0));
+            else
+                rel[k].buffp = sg_memalign(sz, 0 /* page align */,
+                                           &rel[k].alloc_bp, false);
+            if (NULL == rel[k].buffp)
+                err_exit(ENOMEM, "out of memory creating user buffers\n");
+            /* first touch, after pinning, places the pages locally */
+            if ((clp->num_cpus > 0) || (clp->num_hwq > 0))
+                memset(rel[k].buffp, 0, sz);
+        }
+    }
+    if (clp->out_flags.delta && (FT_SG != clp->out_type)) {
+        /* ranges are compared one at a time so one buffer will do */
+        uint8_t * free_bp = NULL;
+        uint8_t * bp = sg_memalign(sz, 0, &free_bp, false);
+
+        if (NULL == bp)
+            err_exit(ENOMEM, "out of memory creating delta buffer\n");
+        delta_alloc_bp = free_bp;
+        for (k = 0; k < clp->qd; ++k)
+            rel[k].delta_bp = bp;
+    }
+    if (clp->cimg_alg || clp->in_flags.cimage) {
+        /* ranges are (de)compressed one at a time so one of each will do */
+        int alg = clp->cimg_alg ? clp->cimg_alg : clp->cimg_hdr.alg;
+        uint8_t * free_bp = NULL;
+        uint8_t * bp = sg_memalign(sg_cimg_bound(alg, sz), 0, &free_bp,
+                                   false);
+        struct sg_cimg_ctx * czp = sg_cimg_ctx_new(alg, clp->cimg_level);
+
+        if ((NULL == bp) || (NULL == czp))
+            err_exit(ENOMEM, "out of memory creating compressor\n");
+        cimg_alloc_bp = free_bp;
+        for (k = 0; k < clp->qd; ++k) {
+            rel[k].cimg_bp = bp;
+            rel[k].czp = czp;
+        }
+    }
+    if ((clp->in_flags.uring || clp->out_flags.uring) && (clp->qd > 1)) {
+        /* one ring per worker, its buffers and both fds registered */
+        int fds[2];
+        uint8_t * bufs[MAX_QUEUE_DEPTH];
+        struct sg_dde_uring * urp;
+
+        if (clp->num_hwq > 0) {
+            /* and, with hwq=1, its own open of each block device */
+            if (clp->in_flags.uring && (FT_BLOCK == clp->in_type))
+                own_infd = reopen_blk(infn, rel[0].infd, &clp->in_flags);
+            if (clp->out_flags.uring && (FT_BLOCK == clp->out_type))
+                own_outfd = reopen_blk(outfn, rel[0].outfd,
+                                       &clp->out_flags);
+            for (k = 0; k < clp->qd; ++k) {
+                if (own_infd >= 0)
+                    rel[k].infd = own_infd;
+                if (own_outfd >= 0)
+                    rel[k].outfd = own_outfd;
+            }
+        }
+        fds[0] = rel[0].infd;
+        fds[1] = rel[0].outfd;
+        for (k = 0; k < clp->qd; ++k)
+            bufs[k] = rel[k].buffp;
+        urp = sg_dde_uring_new(clp->qd, fds, (fds[1] >= 0) ? 2 : 1, bufs,
+                               clp->qd, sz, (0 == tap->id) ? clp->debug : 0);
+        if ((NULL == urp) && (0 == tap->id))
+            pr2serr("%sio_uring not available, using read() and write()\n",
+                    my_name);
+        for (k = 0; k < clp->qd; ++k)
+            rel[k].urp = urp;
+    }
+    if (clp->num_fan > 0)
+        fan_start(clp, &fb, rep->esp);
 
     while(1) {
-        if ((rep->in_stop) || (rep->in_err) || (rep->out_err))
-            break;
-        status = pthread_mutex_lock(&clp->inout_mutex);
-        if (0 != status) err_exit(status, "lock inout_mutex");
-#ifdef HAVE_C11_ATOMICS
-        bb = atomic_load(&exit_threads);
-#else
-        bb = exit_threads;
-#endif
-        if (bb || (clp->in_count <= 0)) {
-            /* no more to do, exit loop then thread */
-            status = pthread_mutex_unlock(&clp->inout_mutex);
-            if (0 != status) err_exit(status, "unlock inout_mutex");
+        if (in_stop || threads_exiting())
             break;
+        /* claim up to qd ranges, each of up to bpt blocks */
+        for (n = 0; n < clp->qd; ++n) {
+            rep = rel + n;
+            if (clp->num_zones > 0)
+                rep->num_blks = zone_claim_blocks(clp, &zc, offs + n);
+            else
+                rep->num_blks = claim_blocks(clp, offs + n);
+            if (rep->num_blks <= 0)
+                break;
+            rep->wr = false;
+            rep->blk = in_lba(clp, offs[n]);
+            rep->off = offs[n];
+            rep->in_stop = false;
+            rep->in_bytes = 0;
+            SG_USDT4(dd_seg_start, tap->id, offs[n], rep->blk,
+                     rep->num_blks);
+        }
+        if (0 == n)
+            break;      /* no more to do, exit loop then thread */
+        if (clp->rate_arg) {
+            for (k = 0, nbytes = 0; k < n; ++k)
+                nbytes += (uint64_t)rel[k].num_blks * clp->bs;
+            sg_rate_lim_wait(&clp->rate_lim, nbytes, n);
         }
-        blocks = (clp->in_count > clp->bpt) ? clp->bpt : clp->in_count;
-        rep->wr = false;
-        rep->blk = clp->in_blk;
-        rep->num_blks = blocks;
-        clp->in_blk += blocks;
-        clp->in_count -= blocks;
-        /* while we have this lock, find corresponding out_blk */
-        out_blk = rep->blk + seek_skip;
-        out_count = clp->out_count;
-        if (! enforce_write_ordering)
-            clp->out_blk += blocks;
-        clp->out_count -= blocks;
-        status = pthread_mutex_unlock(&clp->inout_mutex);
-        if (0 != status) err_exit(status, "unlock inout_mutex");
 
         pthread_cleanup_push(cleanup_in, (void *)clp);
-        if (FT_SG == clp->in_type)
-            sg_in_operation(clp, rep);
-        else
-            normal_in_operation(clp, rep, blocks);
-        if (c_addr && (rep->bs > 3)) {
-            int k, j, off, num;
-            uint32_t addr = (uint32_t)rep->blk;
-
-            num = (1 == c_addr) ? 4 : (rep->bs - 3);
-            for (k = 0, off = 0; k < blocks; ++k, ++addr, off += rep->bs) {
-                for (j = 0; j < num; j += 4) {
-                    if (addr != sg_get_unaligned_be32(rep->buffp + off + j))
-                        break;
-                }
-                if (j < num)
-                    break;
-            }
-            if (k < blocks) {
-                pr2serr("%s: chkaddr failure at addr=0x%x\n", __func__, addr);
-                rep->in_err = true;
-            }
-        }
+        n_read = read_batch(clp, rel, offs, n, in_seq);
         pthread_cleanup_pop(0);
-        if (rep->in_err) {
-            status = pthread_mutex_lock(&clp->inout_mutex);
-            if (0 != status) err_exit(status, "lock inout_mutex");
-            /* write-side not done, so undo changes to out_blk + out_count */
-            if (! enforce_write_ordering)
-                clp->out_blk -= blocks;
-            clp->out_count += blocks;
-            status = pthread_mutex_unlock(&clp->inout_mutex);
-            if (0 != status) err_exit(status, "unlock inout_mutex");
-            break;
-        }
-
-        if (enforce_write_ordering) {
-            status = pthread_mutex_lock(&clp->inout_mutex);
-            if (0 != status) err_exit(status, "lock inout_mutex");
-#ifdef HAVE_C11_ATOMICS
-            bb = atomic_load(&exit_threads);
-#else
-            bb = exit_threads;
-#endif
-            while ((! bb) && (out_blk != clp->out_blk)) {
-                /* if write would be out of sequence then wait */
-                pthread_cleanup_push(cleanup_out, (void *)clp);
-                status = pthread_cond_wait(&clp->out_sync_cv,
-                                           &clp->inout_mutex);
-                if (0 != status) err_exit(status, "cond out_sync_cv");
-                pthread_cleanup_pop(0);
+        for (k = 0; k < n; ++k) {
+            if (rel[k].in_err) {
+                stop_after_write = true;
+                break;
             }
-            status = pthread_mutex_unlock(&clp->inout_mutex);
-            if (0 != status) err_exit(status, "unlock inout_mutex");
+            if (rel[k].in_stop)
+                in_stop = true;
         }
-
-#ifdef HAVE_C11_ATOMICS
-        bb = atomic_load(&exit_threads);
-#else
-        bb = exit_threads;
-#endif
-        if (bb || (out_count <= 0))
-            break;
-
-        rep->wr = true;
-        rep->blk = out_blk;
-
-        if (0 == rep->num_blks) {
-            break;      /* read nothing so leave loop */
+        if ((n_read < n) && (! in_stop))
+            stop_after_write = true;
+        if (clp->hash_alg && (n_read > 0)) {
+            pthread_cleanup_push(cleanup_in, (void *)clp);
+            hash_batch(clp, rel, offs, n_read);
+            pthread_cleanup_pop(0);
         }
+        if (clp->rate_arg && (FT_DEV_NULL != clp->out_type))
+            sg_rate_lim_wait(&clp->rate_lim, 0, n_read);
 
         pthread_cleanup_push(cleanup_out, (void *)clp);
-        if (FT_SG == clp->out_type)
-            sg_out_operation(clp, rep, enforce_write_ordering);
-        else if (FT_DEV_NULL == clp->out_type) {
-            /* skip actual write operation */
-            clp->out_rem_count -= blocks;
+        if ((clp->num_fan > 0) && (n_read > 0))
+            fan_dispatch(clp, &fb, rel, offs, n_read);
+        wr_ok = write_batch(clp, rel, offs, n_read);
+        if (! wr_ok)
+            in_stop = true;
+        if ((clp->num_fan > 0) && (n_read > 0)) {
+            if (! fan_wait(&fb))
+                stop_after_write = true;
+            else if (wr_ok) {
+                for (k = 0; k < n_read; ++k)
+                    ckpt_mark(clp, offs[k]);
+            }
         }
-        else
-            normal_out_operation(clp, rep, blocks, enforce_write_ordering);
         pthread_cleanup_pop(0);
-        if (enforce_write_ordering)
-            pthread_cond_broadcast(&clp->out_sync_cv);
+        for (k = 0; k < n_read; ++k) {
+            SG_USDT4(dd_seg_done, tap->id, offs[k], rel[k].num_blks,
+                     rel[k].out_err);
+            if (rel[k].out_err)
+                stop_after_write = true;
+        }
+        if (stop_after_write)
+            break;
+        if (! first_done) {
+            /* let main() know the first worker is up and running */
+            first_done = true;
+            wake_turn_waiters(clp);
+        }
     } /* end of while loop */
 
-    if (rep->alloc_bp)
-        free(rep->alloc_bp);
-    if (rep->in_err || rep->out_err) {
-        stop_after_write = true;
+    if (clp->num_fan > 0)
+        fan_stop(clp, &fb);
+    sg_dde_uring_free(rel[0].urp);
+    if (own_infd >= 0)
+        close(own_infd);
+    if (own_outfd >= 0)
+        close(own_outfd);
+    free(delta_alloc_bp);
+    free(cimg_alloc_bp);
+    sg_cimg_ctx_free(rel[0].czp);
+    for (k = 0; k < clp->qd; ++k) {
+        if (rel[k].alloc_bp)
+            sg_free_hugepage(rel[k].alloc_bp, sz, rel[k].hp_kind);
+    }
+    if (clp->share_active) {
+        close(rel[0].outfd);    /* write side first, undoes the share */
+        close(rel[0].infd);
+    }
+    if (stop_after_write) {
 #ifdef HAVE_C11_ATOMICS
         if (! atomic_load(&exit_threads))
             atomic_store(&exit_threads, true);
@@ -987,304 +4088,416 @@ read_write_thread(void * v_tap)
             exit_threads = true;
 #endif
     }
-    pthread_cond_broadcast(&clp->out_sync_cv);
-    return (stop_after_write || rep->in_stop) ? NULL : clp;
+    shard_add64(&shard_a[tap->id].cpu_ns, (int64_t)sg_cpu_thread_ns());
+    wake_turn_waiters(clp);
+    return (stop_after_write || in_stop) ? NULL : clp;
 }
 
+/* Accounts for a read of blocks at rep which returned res, negative with
+ * err holding errno on failure */
 static void
-normal_in_operation(struct opts_t * clp, Rq_elem * rep, int blocks)
+normal_in_done(struct opts_t * clp, Rq_elem * rep, int blocks, int res,
+               int err, uint64_t t0_ns)
 {
-    int res, status;
     char strerr_buff[STRERR_BUFF_LEN + 1];
 
-    while (((res = read(rep->infd, rep->buffp, blocks * rep->bs)) < 0) &&
-           ((EINTR == errno) || (EAGAIN == errno)))
-        ;
+    sg_err_stats_cat(rep->esp, (res < 0) ? sg_convert_errno(err) : 0);
     if (res < 0) {
+        sg_err_stats_errno(rep->esp, err);
         if (rep->in_flags.coe) {
             memset(rep->buffp, 0, rep->num_blks * rep->bs);
             pr2serr(">> substituted zeros for in blk=%" PRId64 " for %d "
                     "bytes, %s\n", rep->blk,
                     rep->num_blks * rep->bs,
-                    tsafe_strerror(errno, strerr_buff));
+                    tsafe_strerror(err, strerr_buff));
             res = rep->num_blks * rep->bs;
         }
         else {
             pr2serr("error in normal read, %s\n",
-                    tsafe_strerror(errno, strerr_buff));
+                    tsafe_strerror(err, strerr_buff));
             rep->in_stop = true;
             rep->in_err = true;
             return;
         }
     }
-    status = pthread_mutex_lock(&clp->inout_mutex);
-    if (0 != status) err_exit(status, "lock inout_mutex");
     if (res < blocks * rep->bs) {
-        int o_blocks = blocks;
-
         rep->in_stop = true;
         blocks = res / rep->bs;
         if ((res % rep->bs) > 0) {
             blocks++;
-            clp->in_partial++;
+            shard_add(&rep->shp->in_partial, 1);
         }
-        /* Reverse out + re-apply blocks on clp */
-        clp->in_blk -= o_blocks;
-        clp->in_count += o_blocks;
         rep->num_blks = blocks;
-        clp->in_blk += blocks;
-        clp->in_count -= blocks;
+        rep->in_bytes = res;
+        lower_in_end(clp, rep->off + blocks);
     }
-    clp->in_rem_count -= blocks;
-    status = pthread_mutex_unlock(&clp->inout_mutex);
-    if (0 != status) err_exit(status, "lock inout_mutex");
+    lat_add(LAT_IN_ID, t0_ns);
+    shard_add64(&rep->shp->in_blks, blocks);
 }
 
 static void
-normal_out_operation(struct opts_t * clp, Rq_elem * rep, int blocks,
-                     bool bump_out_blk)
+normal_in_operation(struct opts_t * clp, Rq_elem * rep, int blocks)
+{
+    int res;
+    off64_t pos = clp->in_pos;
+    uint64_t t0_ns = lat_start();
+
+    if (pos >= 0) {     /* positioned read so no need to be in order */
+        pos += (rep->blk - clp->skip) * rep->bs;
+        while (((res = pread(rep->infd, rep->buffp, blocks * rep->bs,
+                             pos)) < 0) &&
+               ((EINTR == errno) || (EAGAIN == errno)))
+            sg_err_stats_errno(rep->esp, errno);
+    } else {
+        while (((res = read(rep->infd, rep->buffp, blocks * rep->bs)) < 0) &&
+               ((EINTR == errno) || (EAGAIN == errno)))
+            sg_err_stats_errno(rep->esp, errno);
+    }
+    normal_in_done(clp, rep, blocks, res, (res < 0) ? errno : 0, t0_ns);
+}
+
+/* iflag=uring: reads the n elements of reps with one io_uring_enter(2)
+ * call. Like a loop of normal_in_operation() calls the outcomes are taken
+ * in order up to the first error or short read. Returns the number taken
+ * or -1 if the ring failed, then nothing is taken. */
+static int
+normal_in_batch(struct opts_t * clp, Rq_elem * reps, int n)
+{
+    int k, res;
+    uint64_t t0_ns = lat_start();
+    Rq_elem * rep;
+    struct sg_dde_uring_io io_arr[MAX_QUEUE_DEPTH];
+
+    for (k = 0; k < n; ++k) {
+        rep = reps + k;
+        io_arr[k].write_true = false;
+        io_arr[k].fd = rep->infd;
+        io_arr[k].len = rep->num_blks * rep->bs;
+        io_arr[k].off = clp->in_pos + (rep->blk - clp->skip) * rep->bs;
+        io_arr[k].bp = rep->buffp;
+    }
+    if (sg_dde_uring_rw(reps->urp, io_arr, n) < 0)
+        return -1;
+    for (k = 0; k < n; ++k) {
+        rep = reps + k;
+        res = io_arr[k].res;
+        normal_in_done(clp, rep, rep->num_blks, (res < 0) ? -1 : res,
+                       (res < 0) ? -res : 0, t0_ns);
+        if (rep->in_err || rep->in_stop) {
+            ++k;
+            break;
+        }
+    }
+    return k;
+}
+
+/* Accounts for a write of blocks at rep which returned res, negative with
+ * err holding errno on failure */
+static void
+normal_out_done(Rq_elem * rep, int blocks, int res, int err, uint64_t t0_ns)
 {
-    int res, status;
     char strerr_buff[STRERR_BUFF_LEN + 1];
 
-    while (((res = write(rep->outfd, rep->buffp, rep->num_blks * rep->bs))
-            < 0) && ((EINTR == errno) || (EAGAIN == errno)))
-        ;
+    sg_err_stats_cat(rep->esp, (res < 0) ? sg_convert_errno(err) : 0);
     if (res < 0) {
+        sg_err_stats_errno(rep->esp, err);
         if (rep->out_flags.coe) {
             pr2serr(">> ignored error for out blk=%" PRId64 " for %d bytes, "
                     "%s\n", rep->blk, rep->num_blks * rep->bs,
-                    tsafe_strerror(errno, strerr_buff));
+                    tsafe_strerror(err, strerr_buff));
             res = rep->num_blks * rep->bs;
         }
         else {
             pr2serr("error normal write, %s\n",
-                    tsafe_strerror(errno, strerr_buff));
+                    tsafe_strerror(err, strerr_buff));
             rep->out_err = true;
             return;
         }
     }
-    status = pthread_mutex_lock(&clp->inout_mutex);
-    if (0 != status) err_exit(status, "lock inout_mutex");
     if (res < blocks * rep->bs) {
         blocks = res / rep->bs;
         if ((res % rep->bs) > 0) {
             blocks++;
-            clp->out_partial++;
+            shard_add(&rep->shp->out_partial, 1);
         }
         rep->num_blks = blocks;
     }
-    clp->out_rem_count -= blocks;
-    if (bump_out_blk)
-        clp->out_blk += blocks;
-    status = pthread_mutex_unlock(&clp->inout_mutex);
-    if (0 != status) err_exit(status, "lock inout_mutex");
+    lat_add(LAT_OUT_ID, t0_ns);
+    shard_add64(&rep->shp->out_blks, blocks);
+}
+
+static void
+normal_out_operation(struct opts_t * clp, Rq_elem * rep, int blocks)
+{
+    int res;
+    off64_t pos = clp->out_pos;
+    uint64_t t0_ns = lat_start();
+
+    if (pos >= 0) {     /* positioned write so no need to be in order */
+        pos += (rep->blk - clp->seek) * rep->bs;
+        while (((res = pwrite(rep->outfd, rep->buffp,
+                              rep->num_blks * rep->bs, pos)) < 0) &&
+               ((EINTR == errno) || (EAGAIN == errno)))
+            sg_err_stats_errno(rep->esp, errno);
+    } else {
+        while (((res = write(rep->outfd, rep->buffp,
+                             rep->num_blks * rep->bs)) < 0) &&
+               ((EINTR == errno) || (EAGAIN == errno)))
+            sg_err_stats_errno(rep->esp, errno);
+    }
+    normal_out_done(rep, blocks, res, (res < 0) ? errno : 0, t0_ns);
 }
 
+/* oflag=uring: writes the n elements of reps with one io_uring_enter(2)
+ * call. The outcomes are taken in order up to the first error. Returns the
+ * number taken or -1 if the ring failed, then nothing is taken. */
 static int
-sg_build_scsi_cdb(uint8_t * cdbp, int cdb_sz, unsigned int blocks,
-                  int64_t start_block, bool write_true, bool fua, bool dpo)
+normal_out_batch(struct opts_t * clp, Rq_elem * reps, int n)
 {
-    int rd_opcode[] = {0x8, 0x28, 0xa8, 0x88};
-    int wr_opcode[] = {0xa, 0x2a, 0xaa, 0x8a};
-    int sz_ind;
+    int k, res;
+    uint64_t t0_ns = lat_start();
+    Rq_elem * rep;
+    struct sg_dde_uring_io io_arr[MAX_QUEUE_DEPTH];
+
+    for (k = 0; k < n; ++k) {
+        rep = reps + k;
+        io_arr[k].write_true = true;
+        io_arr[k].fd = rep->outfd;
+        io_arr[k].len = rep->num_blks * rep->bs;
+        io_arr[k].off = clp->out_pos + (rep->blk - clp->seek) * rep->bs;
+        io_arr[k].bp = rep->buffp;
+    }
+    if (sg_dde_uring_rw(reps->urp, io_arr, n) < 0)
+        return -1;
+    for (k = 0; k < n; ++k) {
+        rep = reps + k;
+        res = io_arr[k].res;
+        normal_out_done(rep, rep->num_blks, (res < 0) ? -1 : res,
+                        (res < 0) ? -res : 0, t0_ns);
+        if (rep->out_err) {
+            ++k;
+            break;
+        }
+    }
+    return k;
+}
 
-    memset(cdbp, 0, cdb_sz);
+/* WRITE STREAM(16) (SBC-4) has a 16 bit TRANSFER LENGTH, which streams=N
+ * checks bpt against, and the stream id in bytes 10 and 11 */
+static void
+sg_build_write_stream_cdb(uint8_t * cdbp, unsigned int blocks,
+                          int64_t start_block, uint16_t str_id, bool fua,
+                          bool dpo)
+{
+    memset(cdbp, 0, 16);
+    cdbp[0] = SGP_WRITE_STREAM16;
     if (dpo)
         cdbp[1] |= 0x10;
     if (fua)
         cdbp[1] |= 0x8;
-    switch (cdb_sz) {
-    case 6:
-        sz_ind = 0;
-        cdbp[0] = (uint8_t)(write_true ? wr_opcode[sz_ind] :
-                                               rd_opcode[sz_ind]);
-        sg_put_unaligned_be24(0x1fffff & start_block, cdbp + 1);
-        cdbp[4] = (256 == blocks) ? 0 : (uint8_t)blocks;
-        if (blocks > 256) {
-            pr2serr("%sfor 6 byte commands, maximum number of blocks is "
-                    "256\n", my_name);
-            return 1;
-        }
-        if ((start_block + blocks - 1) & (~0x1fffff)) {
-            pr2serr("%sfor 6 byte commands, can't address blocks beyond "
-                    "%d\n", my_name, 0x1fffff);
-            return 1;
-        }
-        if (dpo || fua) {
-            pr2serr("%sfor 6 byte commands, neither dpo nor fua bits "
-                    "supported\n", my_name);
-            return 1;
-        }
-        break;
-    case 10:
-        sz_ind = 1;
-        cdbp[0] = (uint8_t)(write_true ? wr_opcode[sz_ind] :
-                                               rd_opcode[sz_ind]);
-        sg_put_unaligned_be32((uint32_t)start_block, cdbp + 2);
-        sg_put_unaligned_be16((uint16_t)blocks, cdbp + 7);
-        if (blocks & (~0xffff)) {
-            pr2serr("%sfor 10 byte commands, maximum number of blocks is "
-                    "%d\n", my_name, 0xffff);
-            return 1;
-        }
-        break;
-    case 12:
-        sz_ind = 2;
-        cdbp[0] = (uint8_t)(write_true ? wr_opcode[sz_ind] :
-                                               rd_opcode[sz_ind]);
-        sg_put_unaligned_be32((uint32_t)start_block, cdbp + 2);
-        sg_put_unaligned_be32((uint32_t)blocks, cdbp + 6);
-        break;
-    case 16:
-        sz_ind = 3;
-        cdbp[0] = (uint8_t)(write_true ? wr_opcode[sz_ind] :
-                                               rd_opcode[sz_ind]);
-        sg_put_unaligned_be64((uint64_t)start_block, cdbp + 2);
-        sg_put_unaligned_be32((uint32_t)blocks, cdbp + 10);
-        break;
-    default:
-        pr2serr("%sexpected cdb size of 6, 10, 12, or 16 but got %d\n",
-                my_name, cdb_sz);
-        return 1;
+    sg_put_unaligned_be64((uint64_t)start_block, cdbp + 2);
+    sg_put_unaligned_be16(str_id, cdbp + 10);
+    sg_put_unaligned_be16((uint16_t)blocks, cdbp + 12);
+}
+
+/* Returns true if the READ has been submitted to the sg driver */
+static bool
+sg_in_start(Rq_elem * rep)
+{
+    int res;
+
+    rep->start_ns = lat_start();
+    res = sg_start_io(rep);
+
+    if (1 == res)
+        err_exit(ENOMEM, "sg starting in command");
+    else if (res < 0) {
+        pr2serr("%sinputting to sg failed, blk=%" PRId64 "\n", my_name,
+                rep->blk);
+        rep->in_stop = true;
+        rep->in_err = true;
+        return false;
     }
-    return 0;
+    return true;
 }
 
-static void
-sg_in_operation(struct opts_t * clp, Rq_elem * rep)
+/* Waits for the READ submitted by sg_in_start() to complete. Returns true
+ * if it needs to be re-submitted (e.g. after a Unit Attention). */
+static bool
+sg_in_finish(struct opts_t * clp, Rq_elem * rep)
 {
     int res;
-    int status;
 
-    while (1) {
-        res = sg_start_io(rep);
-        if (1 == res)
-            err_exit(ENOMEM, "sg starting in command");
-        else if (res < 0) {
-            pr2serr("%sinputting to sg failed, blk=%" PRId64 "\n", my_name,
-                    rep->blk);
+    res = sg_finish_io(rep->wr, rep, &clp->inout_mutex);
+    switch (res) {
+    case SG_LIB_CAT_ABORTED_COMMAND:
+    case SG_LIB_CAT_UNIT_ATTENTION:
+        /* try again with same addr, count info */
+        /* N.B. This re-read could now be out of read sequence */
+        return true;
+    case SG_LIB_CAT_MEDIUM_HARD:
+        if (0 == rep->in_flags.coe) {
+            pr2serr("error finishing sg in command (medium)\n");
+            if (exit_status <= 0)
+                exit_status = res;
             rep->in_stop = true;
             rep->in_err = true;
-            return;
+            return false;
+        } else {
+            memset(rep->buffp, 0, rep->num_blks * rep->bs);
+            pr2serr(">> substituted zeros for in blk=%" PRId64 " for %d "
+                    "bytes\n", rep->blk, rep->num_blks * rep->bs);
         }
-        res = sg_finish_io(rep->wr, rep, &clp->inout_mutex);
-        switch (res) {
-        case SG_LIB_CAT_ABORTED_COMMAND:
-        case SG_LIB_CAT_UNIT_ATTENTION:
-            /* try again with same addr, count info */
-            /* now re-acquire in mutex for balance */
-            /* N.B. This re-read could now be out of read sequence */
-            break;
-        case SG_LIB_CAT_MEDIUM_HARD:
-            if (0 == rep->in_flags.coe) {
-                pr2serr("error finishing sg in command (medium)\n");
-                if (exit_status <= 0)
-                    exit_status = res;
-                rep->in_stop = true;
-                rep->in_err = true;
-                return;
-            } else {
-                memset(rep->buffp, 0, rep->num_blks * rep->bs);
-                pr2serr(">> substituted zeros for in blk=%" PRId64 " for %d "
-                        "bytes\n", rep->blk, rep->num_blks * rep->bs);
-            }
 #if defined(__GNUC__)
 #if (__GNUC__ >= 7)
-            __attribute__((fallthrough));
-            /* FALL THROUGH */
+        __attribute__((fallthrough));
+        /* FALL THROUGH */
 #endif
 #endif
-        case 0:
-            status = pthread_mutex_lock(&clp->inout_mutex);
-            if (0 != status) err_exit(status, "lock inout_mutex");
-            if (rep->dio_incomplete_count || rep->resid) {
-                clp->dio_incomplete_count += rep->dio_incomplete_count;
-                clp->sum_of_resids += rep->resid;
-            }
-            clp->in_rem_count -= rep->num_blks;
-            status = pthread_mutex_unlock(&clp->inout_mutex);
-            if (0 != status) err_exit(status, "unlock inout_mutex");
-            return;
-        case SG_LIB_CAT_ILLEGAL_REQ:
-            if (clp->debug)
-                sg_print_command_len(rep->cdb, rep->cdbsz_in);
-            /* FALL THROUGH */
-        default:
-            pr2serr("error finishing sg in command (%d)\n", res);
-            if (exit_status <= 0)
-                exit_status = res;
-            rep->in_stop = true;
-            rep->in_err = true;
-            return;
+    case 0:
+        if (rep->dio_incomplete_count || rep->resid) {
+            shard_add(&rep->shp->dio_incomplete_count,
+                      rep->dio_incomplete_count);
+            shard_add(&rep->shp->sum_of_resids, rep->resid);
         }
-    }   /* end of while loop */
+        lat_add(LAT_IN_ID, rep->start_ns);
+        shard_add64(&rep->shp->in_blks, rep->num_blks);
+        return false;
+    case SG_LIB_CAT_ILLEGAL_REQ:
+        if (clp->debug)
+            sg_print_command_len(rep->cdb, rep->cdbsz_in);
+        /* FALL THROUGH */
+    default:
+        pr2serr("error finishing sg in command (%d)\n", res);
+        if (exit_status <= 0)
+            exit_status = res;
+        rep->in_stop = true;
+        rep->in_err = true;
+        return false;
+    }
 }
 
 static void
-sg_out_operation(struct opts_t * clp, Rq_elem * rep, bool bump_out_blk)
+sg_in_operation(struct opts_t * clp, Rq_elem * rep)
+{
+    do {
+        if (! sg_in_start(rep))
+            return;
+    } while (sg_in_finish(clp, rep));
+}
+
+/* Returns true if the WRITE has been submitted to the sg driver */
+static bool
+sg_out_start(Rq_elem * rep)
 {
     int res;
-    int status;
 
-    while (1) {
-        res = sg_start_io(rep);
-        if (1 == res)
-            err_exit(ENOMEM, "sg starting out command");
-        else if (res < 0) {
-            pr2serr("%soutputting from sg failed, blk=%" PRId64 "\n",
-                    my_name, rep->blk);
+    rep->start_ns = lat_start();
+    res = sg_start_io(rep);
+
+    if (1 == res)
+        err_exit(ENOMEM, "sg starting out command");
+    else if (res < 0) {
+        pr2serr("%soutputting from sg failed, blk=%" PRId64 "\n",
+                my_name, rep->blk);
+        rep->out_err = true;
+        return false;
+    }
+    return true;
+}
+
+/* Waits for the WRITE submitted by sg_out_start() to complete. Returns
+ * true if it needs to be re-submitted (e.g. after a Unit Attention). */
+static bool
+sg_out_finish(struct opts_t * clp, Rq_elem * rep)
+{
+    int res;
+
+    res = sg_finish_io(rep->wr, rep, &clp->inout_mutex);
+    switch (res) {
+    case SG_LIB_CAT_ABORTED_COMMAND:
+    case SG_LIB_CAT_UNIT_ATTENTION:
+        /* try again with same addr, count info */
+        /* N.B. This re-write could now be out of write sequence */
+        return true;
+    case SG_LIB_CAT_MEDIUM_HARD:
+        if (0 == rep->out_flags.coe) {
+            pr2serr("error finishing sg out command (medium)\n");
+            if (exit_status <= 0)
+                exit_status = res;
             rep->out_err = true;
-            return;
-        }
-        res = sg_finish_io(rep->wr, rep, &clp->inout_mutex);
-        switch (res) {
-        case SG_LIB_CAT_ABORTED_COMMAND:
-        case SG_LIB_CAT_UNIT_ATTENTION:
-            /* try again with same addr, count info */
-            /* now re-acquire out mutex for balance */
-            /* N.B. This re-write could now be out of write sequence */
-            break;
-        case SG_LIB_CAT_MEDIUM_HARD:
-            if (0 == rep->out_flags.coe) {
-                pr2serr("error finishing sg out command (medium)\n");
-                if (exit_status <= 0)
-                    exit_status = res;
-                rep->out_err = true;
-                return;
-            } else
-                pr2serr(">> ignored error for out blk=%" PRId64 " for %d "
-                        "bytes\n", rep->blk, rep->num_blks * rep->bs);
+            return false;
+        } else
+            pr2serr(">> ignored error for out blk=%" PRId64 " for %d "
+                    "bytes\n", rep->blk, rep->num_blks * rep->bs);
 #if defined(__GNUC__)
 #if (__GNUC__ >= 7)
-            __attribute__((fallthrough));
-            /* FALL THROUGH */
+        __attribute__((fallthrough));
+        /* FALL THROUGH */
 #endif
 #endif
-        case 0:
-            status = pthread_mutex_lock(&clp->inout_mutex);
-            if (0 != status) err_exit(status, "lock inout_mutex");
-            if (rep->dio_incomplete_count || rep->resid) {
-                clp->dio_incomplete_count += rep->dio_incomplete_count;
-                clp->sum_of_resids += rep->resid;
-            }
-            clp->out_rem_count -= rep->num_blks;
-            if (bump_out_blk)
-                clp->out_blk += rep->num_blks;
-            status = pthread_mutex_unlock(&clp->inout_mutex);
-            if (0 != status) err_exit(status, "unlock inout_mutex");
-            return;
-        case SG_LIB_CAT_ILLEGAL_REQ:
-            if (clp->debug)
-                sg_print_command_len(rep->cdb, rep->cdbsz_out);
-            /* FALL THROUGH */
-        default:
-            rep->out_err = true;
-            pr2serr("error finishing sg out command (%d)\n", res);
-            if (exit_status <= 0)
-                exit_status = res;
-            return;
+    case 0:
+        if (rep->dio_incomplete_count || rep->resid) {
+            shard_add(&rep->shp->dio_incomplete_count,
+                      rep->dio_incomplete_count);
+            shard_add(&rep->shp->sum_of_resids, rep->resid);
         }
+        lat_add(LAT_OUT_ID, rep->start_ns);
+        shard_add64(&rep->shp->out_blks, rep->num_blks);
+        return false;
+    case SG_LIB_CAT_ILLEGAL_REQ:
+        if (clp->debug)
+            sg_print_command_len(rep->cdb, rep->str_id ? 16 :
+                                                         rep->cdbsz_out);
+        /* FALL THROUGH */
+    default:
+        rep->out_err = true;
+        pr2serr("error finishing sg out command (%d)\n", res);
+        if (exit_status <= 0)
+            exit_status = res;
+        return false;
+    }
+}
+
+static void
+sg_out_operation(struct opts_t * clp, Rq_elem * rep)
+{
+    do {
+        if (! sg_out_start(rep))
+            return;
+    } while (sg_out_finish(clp, rep));
+}
+
+/* Keeps up to n sg READs outstanding on one file descriptor. The sg driver
+ * matches each response to its request by pack_id (SG_SET_FORCE_PACK_ID
+ * is active), so they are collected in submission order. */
+static void
+sg_in_batch(struct opts_t * clp, Rq_elem * reps, int n)
+{
+    int k, started;
+
+    for (started = 0; started < n; ++started) {
+        if (! sg_in_start(reps + started))
+            break;
+    }
+    for (k = 0; k < started; ++k) {
+        if (sg_in_finish(clp, reps + k))
+            sg_in_operation(clp, reps + k);
+    }
+}
+
+static void
+sg_out_batch(struct opts_t * clp, Rq_elem * reps, int n)
+{
+    int k, started;
+
+    for (started = 0; started < n; ++started) {
+        if (! sg_out_start(reps + started))
+            break;
+    }
+    for (k = 0; k < started; ++k) {
+        if (sg_out_finish(clp, reps + k))
+            sg_out_operation(clp, reps + k);
     }
 }
 
@@ -1300,8 +4513,12 @@ sg_start_io(Rq_elem * rep)
     int cdbsz = rep->wr ? rep->cdbsz_out : rep->cdbsz_in;
     int res;
 
-    if (sg_build_scsi_cdb(rep->cdb, cdbsz, rep->num_blks, rep->blk,
-                          rep->wr, fua, dpo)) {
+    if (rep->wr && rep->str_id) {
+        cdbsz = 16;
+        sg_build_write_stream_cdb(rep->cdb, rep->num_blks, rep->blk,
+                                  rep->str_id, fua, dpo);
+    } else if (sg_dde_cdb_tmpl_fill(rep->wr ? rep->wr_tmplp : rep->rd_tmplp,
+                                    rep->cdb, rep->num_blks, rep->blk)) {
         pr2serr("%sbad cdb build, start_blk=%" PRId64 ", blocks=%d\n",
                 my_name, rep->blk, rep->num_blks);
         return -1;
@@ -1325,6 +4542,8 @@ sg_start_io(Rq_elem * rep)
         hp->flags |= SG_FLAG_MMAP_IO;
     if (no_dxfer)
         hp->flags |= SG_FLAG_NO_DXFER;
+    if (rep->share)     /* data stays in the read side's reserve buffer */
+        hp->flags |= SGV4_FLAG_SHARE | SG_FLAG_NO_DXFER;
     if (rep->debug > 8) {
         pr2serr("%s: SCSI %s, blk=%" PRId64 " num_blks=%d\n", __func__,
                 rep->wr ? "WRITE" : "READ", rep->blk, rep->num_blks);
@@ -1333,19 +4552,13 @@ sg_start_io(Rq_elem * rep)
 
     while (((res = write(rep->wr ? rep->outfd : rep->infd, hp,
                          sizeof(struct sg_io_hdr))) < 0) &&
-           ((EINTR == errno) || (EAGAIN == errno) || (EBUSY == errno))) {
-#ifdef HAVE_C11_ATOMICS
-        if (EINTR == errno)
-            atomic_fetch_add(&num_eintr, 1);
-        else if (EAGAIN == errno)
-            atomic_fetch_add(&num_eagain, 1);
-        else
-            atomic_fetch_add(&num_ebusy, 1);
-#endif
-    }
+           ((EINTR == errno) || (EAGAIN == errno) || (EBUSY == errno)))
+        sg_err_stats_errno(rep->esp, errno);
     if (res < 0) {
+        sg_err_stats_errno(rep->esp, errno);
         if (ENOMEM == errno)
             return 1;
+        sg_err_stats_cat(rep->esp, sg_convert_errno(errno));
         perror("starting io on sg device, error");
         return -1;
     }
@@ -1374,8 +4587,10 @@ sg_finish_io(bool wr, Rq_elem * rep, pthread_mutex_t * a_mutp)
     while (((res = read(wr ? rep->outfd : rep->infd, &io_hdr,
                         sizeof(struct sg_io_hdr))) < 0) &&
            ((EINTR == errno) || (EAGAIN == errno) || (EBUSY == errno)))
-        ;
+        sg_err_stats_errno(rep->esp, errno);
     if (res < 0) {
+        sg_err_stats_errno(rep->esp, errno);
+        sg_err_stats_cat(rep->esp, sg_convert_errno(errno));
         perror("finishing io on sg device, error");
         return -1;
     }
@@ -1385,6 +4600,7 @@ sg_finish_io(bool wr, Rq_elem * rep, pthread_mutex_t * a_mutp)
     hp = &rep->io_hdr;
 
     res = sg_err_category3(hp);
+    sg_err_stats_cat(rep->esp, res);
     switch (res) {
         case SG_LIB_CAT_CLEAN:
             break;
@@ -1396,6 +4612,7 @@ sg_finish_io(bool wr, Rq_elem * rep, pthread_mutex_t * a_mutp)
         case SG_LIB_CAT_UNIT_ATTENTION:
             if (rep->debug)
                 sg_chk_n_print3((wr ? "writing": "reading"), hp, false);
+            sg_err_stats_retry(rep->esp);       /* callers resubmit */
             return res;
         case SG_LIB_CAT_NOT_READY:
         default:
@@ -1447,8 +4664,12 @@ process_flags(const char * arg, struct flags_t * fp)
             *np++ = '\0';
         if (0 == strcmp(cp, "append"))
             fp->append = true;
+        else if (0 == strcmp(cp, "cimage"))
+            fp->cimage = true;
         else if (0 == strcmp(cp, "coe"))
             fp->coe = true;
+        else if (0 == strcmp(cp, "delta"))
+            fp->delta = true;
         else if (0 == strcmp(cp, "dio"))
             fp->dio = true;
         else if (0 == strcmp(cp, "direct"))
@@ -1459,12 +4680,22 @@ process_flags(const char * arg, struct flags_t * fp)
             fp->dsync = true;
         else if (0 == strcmp(cp, "excl"))
             fp->excl = true;
+        else if (0 == strcmp(cp, "extents"))
+            fp->extents = true;
         else if (0 == strcmp(cp, "fua"))
             fp->fua = true;
+        else if (0 == strcmp(cp, "hugepage"))
+            fp->hugepage = true;
         else if (0 == strcmp(cp, "mmap"))
             fp->mmap = true;
         else if (0 == strcmp(cp, "null"))
             ;
+        else if (0 == strcmp(cp, "share"))
+            fp->share = true;
+        else if (0 == strcmp(cp, "uring"))
+            fp->uring = true;
+        else if (0 == strcmp(cp, "zoned"))
+            fp->zoned = true;
         else {
             pr2serr("unrecognised flag: %s\n", cp);
             return 1;
@@ -1624,6 +4855,8 @@ main(int argc, char * argv[])
 {
     bool verbose_given = false;
     bool version_given = false;
+    bool do_numa = false;
+    bool do_hwq = false;
     int64_t skip = 0;
     int64_t seek = 0;
     int ibs = 0;
@@ -1636,10 +4869,11 @@ main(int argc, char * argv[])
     int res, k, err, keylen;
     int64_t in_num_sect = 0;
     int64_t out_num_sect = 0;
-    int64_t seek_skip;
+    int64_t seek_skip, rem;
     int in_sect_sz, out_sect_sz, status, n, flags;
     void * vp;
     struct opts_t * clp = &my_opts;
+    struct sgp_shard tot;
     char ebuff[EBUFF_SZ];
 #if SG_LIB_ANDROID
     struct sigaction actions;
@@ -1652,6 +4886,8 @@ main(int argc, char * argv[])
 #endif
     memset(clp, 0, sizeof(*clp));
     clp->num_threads = DEF_NUM_THREADS;
+    clp->qd = DEF_QUEUE_DEPTH;
+    clp->numa_node = -1;
     clp->bpt = DEF_BLOCKS_PER_TRANSFER;
     clp->in_type = FT_OTHER;
     clp->out_type = FT_OTHER;
@@ -1675,12 +4911,16 @@ main(int argc, char * argv[])
             *buf++ = '\0';
         keylen = strlen(key);
         if (0 == strcmp(key,"bpt")) {
-            clp->bpt = sg_get_num(buf);
-            if ((clp->bpt < 0) || (clp->bpt > MAX_BPT_VALUE)) {
-                pr2serr("%sbad argument to 'bpt='\n", my_name);
-                return SG_LIB_SYNTAX_ERROR;
+            if (0 == strcmp(buf, "auto"))
+                clp->bpt_auto = true;
+            else {
+                clp->bpt = sg_get_num(buf);
+                if ((clp->bpt < 0) || (clp->bpt > MAX_BPT_VALUE)) {
+                    pr2serr("%sbad argument to 'bpt='\n", my_name);
+                    return SG_LIB_SYNTAX_ERROR;
+                }
+                bpt_given = 1;
             }
-            bpt_given = 1;
         } else if (0 == strcmp(key,"bs")) {
             clp->bs = sg_get_num(buf);
             if ((clp->bs < 0) || (clp->bs > MAX_BPT_VALUE)) {
@@ -1695,9 +4935,51 @@ main(int argc, char * argv[])
             }
             clp->cdbsz_out = clp->cdbsz_in;
             cdbsz_given = 1;
+        } else if (0 == strcmp(key,"ckpt")) {
+            char * cp = strrchr(buf, ',');
+
+            if (cp) {
+                *cp = '\0';
+                clp->ckpt_secs = sg_get_num(cp + 1);
+                if (clp->ckpt_secs < 0) {
+                    pr2serr("%sbad SECS argument to 'ckpt=CFILE,SECS'\n",
+                            my_name);
+                    return SG_LIB_SYNTAX_ERROR;
+                }
+            } else
+                clp->ckpt_secs = DEF_CKPT_SECS;
+            if ('\0' == buf[0]) {
+                pr2serr("%s'ckpt=' expects a file name\n", my_name);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            strncpy(ckptfn, buf, INOUTF_SZ);
+            ckptfn[INOUTF_SZ - 1] = '\0';
         } else if (0 == strcmp(key,"coe")) {
             clp->in_flags.coe = !! sg_get_num(buf);
             clp->out_flags.coe = clp->in_flags.coe;
+        } else if (0 == strcmp(key,"compress")) {
+            char * cp = strchr(buf, ',');
+
+            if (cp) {
+                *cp = '\0';
+                clp->cimg_level = sg_get_num(cp + 1);
+                if (clp->cimg_level < 1) {
+                    pr2serr("%sbad LEVEL in 'compress=ALG,LEVEL'\n",
+                            my_name);
+                    return SG_LIB_SYNTAX_ERROR;
+                }
+            }
+            clp->cimg_alg = sg_cimg_alg_from_name(buf);
+            if (clp->cimg_alg < 0) {
+                pr2serr("%sbad argument to 'compress=', expect zstd or "
+                        "lz4\n", my_name);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            if (! sg_cimg_alg_avail(clp->cimg_alg)) {
+                pr2serr("%s'compress=%s' is not supported by this build\n",
+                        my_name, buf);
+                return SG_LIB_SYNTAX_ERROR;
+            }
         } else if (0 == strcmp(key,"count")) {
             if (0 != strcmp("-1", buf)) {
                 dd_count = sg_get_llnum(buf);
@@ -1718,6 +5000,20 @@ main(int argc, char * argv[])
                 clp->out_flags.fua = true;
             if (n & 2)
                 clp->in_flags.fua = true;
+        } else if (0 == strcmp(key,"hash")) {
+            char * cp = strchr(buf, ',');
+
+            if (cp) {
+                *cp = '\0';
+                memcpy(hashfn, cp + 1, INOUTF_SZ - 1);
+                hashfn[INOUTF_SZ - 1] = '\0';
+            }
+            clp->hash_alg = sg_hash_alg_from_name(buf);
+            if (clp->hash_alg < 0) {
+                pr2serr("%sbad argument to 'hash=', expect crc32c, xxh64 "
+                        "or sha256\n", my_name);
+                return SG_LIB_SYNTAX_ERROR;
+            }
         } else if (0 == strcmp(key,"ibs")) {
             ibs = sg_get_num(buf);
             if ((ibs < 0) || (ibs > MAX_BPT_VALUE)) {
@@ -1732,11 +5028,21 @@ main(int argc, char * argv[])
                 memcpy(infn, buf, INOUTF_SZ);
                 infn[INOUTF_SZ - 1] = '\0';
             }
+            if (sg_pat_is_pat(buf) && (! sg_pat_parse(buf, &clp->pat))) {
+                pr2serr("%sbad pattern in 'if=%s'\n", my_name, buf);
+                return SG_LIB_SYNTAX_ERROR;
+            }
         } else if (0 == strcmp(key, "iflag")) {
             if (process_flags(buf, &clp->in_flags)) {
                 pr2serr("%sbad argument to 'iflag='\n", my_name);
                 return SG_LIB_SYNTAX_ERROR;
             }
+        } else if (0 == strcmp(key,"interval")) {
+            clp->interval = sg_get_num(buf);
+            if (clp->interval < 0) {
+                pr2serr("%sbad argument to 'interval='\n", my_name);
+                return SG_LIB_SYNTAX_ERROR;
+            }
         } else if (0 == strcmp(key,"obs")) {
             obs = sg_get_num(buf);
             if ((obs < 0) || (obs > MAX_BPT_VALUE)) {
@@ -1751,21 +5057,111 @@ main(int argc, char * argv[])
                 memcpy(outfn, buf, INOUTF_SZ);
                 outfn[INOUTF_SZ - 1] = '\0';
             }
+        } else if (0 == strcmp(key,"of2")) {
+            char * cp;
+            char * np;
+
+            for (cp = buf; cp; cp = np) {
+                np = strchr(cp, ',');
+                if (np)
+                    *np++ = '\0';
+                if ('\0' == *cp)
+                    continue;
+                if (clp->num_fan >= (MAX_FANOUT - 1)) {
+                    pr2serr("%sonly %d outputs may be given to 'of2='\n",
+                            my_name, MAX_FANOUT - 1);
+                    return SG_LIB_SYNTAX_ERROR;
+                }
+                snprintf(clp->fan[clp->num_fan++].fn, INOUTF_SZ, "%s", cp);
+            }
         } else if (0 == strcmp(key, "oflag")) {
             if (process_flags(buf, &clp->out_flags)) {
                 pr2serr("%sbad argument to 'oflag='\n", my_name);
                 return SG_LIB_SYNTAX_ERROR;
             }
+        } else if (0 == strcmp(key,"cpus")) {
+            clp->num_cpus = parse_cpu_list(buf, clp->cpus, MAX_CPU_LIST);
+            if (clp->num_cpus <= 0) {
+                pr2serr("%sbad argument to 'cpus=', expect list like "
+                        "0-3,8\n", my_name);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            clp->cpus_given = true;
+        } else if (0 == strcmp(key,"hwq"))
+            do_hwq = !! sg_get_num(buf);
+        else if (0 == strcmp(key,"numa"))
+            do_numa = !! sg_get_num(buf);
+        else if (0 == strcmp(key,"qd"))
+            clp->qd = sg_get_num(buf);
+        else if (0 == strcmp(key,"rate")) {
+            if (! sg_rate_lim_parse(&clp->rate_lim, buf)) {
+                pr2serr("%sbad argument to 'rate=', expect BPS[,IOPS] or "
+                        "@FN\n", my_name);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            clp->rate_arg = argv[k] + (buf - str);
         } else if (0 == strcmp(key,"seek")) {
-            seek = sg_get_llnum(buf);
-            if ((seek < 0) || (seek > MAX_COUNT_SKIP_SEEK)) {
-                pr2serr("%sbad argument to 'seek='\n", my_name);
+            if (sg_sgl_is_list(buf)) {
+                res = sg_sgl_parse(&clp->o_sgl, "seek", buf, true);
+                if (res) {
+                    pr2serr("%sbad scatter gather list to 'seek='\n",
+                            my_name);
+                    return res;
+                }
+                seek = (clp->o_sgl.sum > 0) ?
+                       sg_sgl_idx_to_lba(&clp->o_sgl, 0, NULL) : 0;
+            } else {
+                seek = sg_get_llnum(buf);
+                if ((seek < 0) || (seek > MAX_COUNT_SKIP_SEEK)) {
+                    pr2serr("%sbad argument to 'seek='\n", my_name);
+                    return SG_LIB_SYNTAX_ERROR;
+                }
+            }
+        } else if (0 == strcmp(key,"seed")) {
+            int64_t ll = sg_get_llnum(buf);
+
+            if ((ll < 0) || (ll > UINT32_MAX)) {
+                pr2serr("%sbad argument to 'seed=', expect 0 to "
+                        "0xffffffff\n", my_name);
                 return SG_LIB_SYNTAX_ERROR;
             }
+            clp->addr_seed = (uint32_t)ll;
         } else if (0 == strcmp(key,"skip")) {
-            skip = sg_get_llnum(buf);
-            if ((skip < 0) || (skip > MAX_COUNT_SKIP_SEEK)) {
-                pr2serr("%sbad argument to 'skip='\n", my_name);
+            if (sg_sgl_is_list(buf)) {
+                res = sg_sgl_parse(&clp->i_sgl, "skip", buf, true);
+                if (res) {
+                    pr2serr("%sbad scatter gather list to 'skip='\n",
+                            my_name);
+                    return res;
+                }
+                skip = (clp->i_sgl.sum > 0) ?
+                       sg_sgl_idx_to_lba(&clp->i_sgl, 0, NULL) : 0;
+            } else {
+                skip = sg_get_llnum(buf);
+                if ((skip < 0) || (skip > MAX_COUNT_SKIP_SEEK)) {
+                    pr2serr("%sbad argument to 'skip='\n", my_name);
+                    return SG_LIB_SYNTAX_ERROR;
+                }
+            }
+        } else if (0 == strcmp(key,"streams")) {
+            const char * ccp = strchr(buf, ',');
+
+            n = sg_get_num_nomult(buf);
+            if ((n < 1) || (n > MAX_STREAMS)) {
+                pr2serr("%sstreams=N expects N from 1 to %d\n", my_name,
+                        MAX_STREAMS);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            clp->num_streams = n;
+            if ((NULL == ccp) || (0 == strcmp(ccp + 1, "thread")))
+                clp->str_map = SGP_STR_THREAD;
+            else if (0 == strcmp(ccp + 1, "lba"))
+                clp->str_map = SGP_STR_LBA;
+            else if (0 == strcmp(ccp + 1, "seg"))
+                clp->str_map = SGP_STR_SEG;
+            else {
+                pr2serr("%sstreams=N,MAP expects MAP to be thread, lba or "
+                        "seg\n", my_name);
                 return SG_LIB_SYNTAX_ERROR;
             }
         } else if (0 == strcmp(key,"sync"))
@@ -1774,7 +5170,13 @@ main(int argc, char * argv[])
             clp->num_threads = sg_get_num(buf);
         else if (0 == strcmp(key,"time"))
             do_time = !! sg_get_num(buf);
-        else if ((keylen > 1) && ('-' == key[0]) && ('-' != key[1])) {
+        else if (0 == strcmp(key,"verify")) {
+            clp->verify_mb = sg_get_num(buf);
+            if (clp->verify_mb < 0) {
+                pr2serr("%sbad argument to 'verify=MB'\n", my_name);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+        } else if ((keylen > 1) && ('-' == key[0]) && ('-' != key[1])) {
             res = 0;
             n = num_chs_in_str(key + 1, keylen - 1, 'c');
             clp->chkaddr += n;
@@ -1782,6 +5184,10 @@ main(int argc, char * argv[])
             n = num_chs_in_str(key + 1, keylen - 1, 'd');
             clp->dry_run += n;
             res += n;
+            n = num_chs_in_str(key + 1, keylen - 1, 'g');
+            if (n > 0)
+                clp->genaddr = true;
+            res += n;
             n = num_chs_in_str(key + 1, keylen - 1, 'h');
             if (n > 0) {
                 usage();
@@ -1790,6 +5196,10 @@ main(int argc, char * argv[])
             n = num_chs_in_str(key + 1, keylen - 1, 'p');
             clp->progress += n;
             res += n;
+            n = num_chs_in_str(key + 1, keylen - 1, 'r');
+            if (n > 0)
+                clp->resume = true;
+            res += n;
             n = num_chs_in_str(key + 1, keylen - 1, 'v');
             if (n > 0)
                 verbose_given = true;
@@ -1810,12 +5220,20 @@ main(int argc, char * argv[])
         else if ((0 == strncmp(key, "--dry-run", 9)) ||
                    (0 == strncmp(key, "--dry_run", 9)))
             ++clp->dry_run;
+        else if (0 == strncmp(key, "--genaddr", 9))
+            clp->genaddr = true;
         else if ((0 == strncmp(key, "--help", 6)) ||
                    (0 == strcmp(key, "-?"))) {
             usage();
             return 0;
+        } else if (0 == strncmp(key, "--json", 6)) {
+            clp->do_json = true;
+            if (*buf)
+                clp->json_arg = argv[k] + (buf - str);
         } else if (0 == strncmp(key, "--prog", 6))
             ++clp->progress;
+        else if (0 == strncmp(key, "--resume", 8))
+            clp->resume = true;
         else if (0 == strncmp(key, "--verb", 6)) {
             verbose_given = true;
             ++clp->debug;      /* --verbose */
@@ -1829,6 +5247,28 @@ main(int argc, char * argv[])
     }
     if (clp->progress > 0)
         do_time = true;
+    if (clp->do_json) {
+        sgj_state * jsp = &clp->json_st;
+
+        if (! sgj_init_state(jsp, clp->json_arg)) {
+            int bad_char = jsp->first_bad_char;
+            char e[1500];
+
+            if (bad_char)
+                pr2serr("bad argument to --json= option, unrecognized "
+                        "character '%c'\n\n", bad_char);
+            sg_json_usage(0, e, sizeof(e));
+            pr2serr("%s", e);
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        /* each interval report is a JSON object on its own line */
+        jsp->pr_exit_status = false;
+        jsp->pr_leadin = false;
+        jsp->pr_pretty = false;
+        jsp->pr_rec_lines = false;
+    }
+    if (clp->interval > 0)
+        sg_pt_lat_enable(true);
 
 #ifdef DEBUG
     pr2serr("In DEBUG mode, ");
@@ -1851,6 +5291,20 @@ main(int argc, char * argv[])
         return 0;
     }
 
+    if (clp->in_flags.cimage) {
+        if (clp->cimg_alg) {
+            pr2serr("%siflag=cimage and compress= contradict\n", my_name);
+            return SG_LIB_CONTRADICT;
+        }
+        if ((! infn[0]) || ('-' == infn[0])) {
+            pr2serr("%siflag=cimage needs if=IFILE\n", my_name);
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        res = cimg_load(clp, bpt_given);
+        if (res)
+            return res;
+        bpt_given = 1;
+    }
     if (clp->bs <= 0) {
         clp->bs = DEF_BLOCK_SIZE;
         pr2serr("Assume default 'bs' ((logical) block size) of %d bytes\n",
@@ -1861,14 +5315,146 @@ main(int argc, char * argv[])
         usage();
         return SG_LIB_SYNTAX_ERROR;
     }
+    if (clp->resume) {
+        if ('\0' == ckptfn[0]) {
+            pr2serr("--resume needs ckpt=CFILE\n");
+            return SG_LIB_CONTRADICT;
+        }
+        res = ckpt_resume(clp, &skip, &seek);
+        if (res)
+            return res;
+    }
     if ((skip < 0) || (seek < 0)) {
         pr2serr("skip and seek cannot be negative\n");
         return SG_LIB_SYNTAX_ERROR;
     }
-    if (clp->out_flags.append && (seek > 0)) {
+    if (clp->out_flags.append && ((seek > 0) || (clp->o_sgl.num_elems > 0))) {
         pr2serr("Can't use both append and seek switches\n");
         return SG_LIB_SYNTAX_ERROR;
     }
+    clp->sgl_active = (clp->i_sgl.num_elems > 0) ||
+                      (clp->o_sgl.num_elems > 0);
+    if (clp->genaddr) {
+        if (infn[0]) {
+            pr2serr("%s--genaddr and if=%s contradict\n", my_name, infn);
+            return SG_LIB_CONTRADICT;
+        }
+        if (clp->in_flags.extents) {
+            pr2serr("%s--genaddr and iflag=extents contradict\n", my_name);
+            return SG_LIB_CONTRADICT;
+        }
+        if (clp->chkaddr) {
+            pr2serr("%s--chkaddr ignored with --genaddr\n", my_name);
+            clp->chkaddr = 0;
+        }
+        /* nothing is read from it, but gives a count-less input */
+        snprintf(infn, sizeof(infn), "%s", "/dev/zero");
+    }
+    if (SG_PAT_NONE != clp->pat.kind) {
+        if (clp->in_flags.extents) {
+            pr2serr("%sif=%s and iflag=extents contradict\n", my_name, infn);
+            return SG_LIB_CONTRADICT;
+        }
+        if (clp->chkaddr) {
+            pr2serr("%s--chkaddr ignored with if=%s\n", my_name, infn);
+            clp->chkaddr = 0;
+        }
+        if (clp->debug)
+            pr2serr("%sdata from %s\n", my_name,
+                    sg_pat_str(&clp->pat, ebuff, EBUFF_SZ));
+        /* as for --genaddr */
+        snprintf(infn, sizeof(infn), "%s", "/dev/zero");
+    }
+    if ((clp->cimg_alg || clp->in_flags.cimage) &&
+        (clp->sgl_active || clp->in_flags.extents || clp->genaddr ||
+         (SG_PAT_NONE != clp->pat.kind) || ckptfn[0] ||
+         (clp->verify_mb > 0))) {
+        pr2serr("compress= and iflag=cimage can't be used with skip= or "
+                "seek= lists, iflag=extents, --genaddr, if=%s..., ckpt= or "
+                "verify=\n", SG_PAT_PREFIX);
+        return SG_LIB_CONTRADICT;
+    }
+    if (clp->cimg_alg) {
+        if ((seek > 0) || clp->out_flags.append || clp->out_flags.delta ||
+            clp->out_flags.zoned || clp->out_flags.mmap) {
+            pr2serr("compress= writes an image from the start of OFILE so "
+                    "can't be used with seek= or the append, delta, zoned "
+                    "or mmap flags\n");
+            return SG_LIB_CONTRADICT;
+        }
+        if (clp->bpt_auto && (clp->debug > 0))
+            pr2serr("%sbpt=auto: the tuned size is also the chunk size of "
+                    "the image\n", my_name);
+    }
+    if (clp->in_flags.cimage) {
+        if (skip % clp->bpt) {
+            pr2serr("%swith iflag=cimage skip= must be a multiple of %d, "
+                    "the blocks per chunk\n", my_name, clp->bpt);
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        if (clp->in_flags.mmap || clp->in_flags.dio ||
+            clp->in_flags.share) {
+            pr2serr("%smmap, dio and share flags ignored with "
+                    "iflag=cimage\n", my_name);
+            clp->in_flags.mmap = false;
+            clp->in_flags.dio = false;
+            clp->in_flags.share = false;
+        }
+        if ((dd_count >= 0) && (dd_count > clp->cimg_in_blks - skip)) {
+            pr2serr("%scount reduced to %" PRId64 ", the blocks in %s "
+                    "after skip\n", my_name, clp->cimg_in_blks - skip,
+                    infn);
+            dd_count = clp->cimg_in_blks - skip;
+        }
+    }
+    if (clp->chkaddr || clp->genaddr)
+        addr_pat_init();
+    if (clp->out_flags.extents)
+        pr2serr("extents flag ignored for oflag\n");
+    if (clp->in_flags.extents && (clp->sgl_active || ckptfn[0])) {
+        pr2serr("iflag=extents can't be used with skip= or seek= lists, or "
+                "ckpt=\n");
+        return SG_LIB_CONTRADICT;
+    }
+    if (clp->in_flags.zoned)
+        pr2serr("zoned flag ignored for iflag\n");
+    if (clp->out_flags.zoned) {
+        if (clp->sgl_active || clp->in_flags.extents || ckptfn[0]) {
+            pr2serr("oflag=zoned can't be used with skip= or seek= lists, "
+                    "iflag=extents or ckpt=\n");
+            return SG_LIB_CONTRADICT;
+        }
+    }
+    if (clp->sgl_active) {
+        if (ckptfn[0]) {
+            pr2serr("ckpt=CFILE does not support scatter gather lists in "
+                    "skip= or seek=\n");
+            return SG_LIB_CONTRADICT;
+        }
+        if (clp->debug > 1) {
+            if (clp->i_sgl.num_elems > 0)
+                sg_sgl_print(&clp->i_sgl, "skip", (clp->debug > 2), stderr);
+            if (clp->o_sgl.num_elems > 0)
+                sg_sgl_print(&clp->o_sgl, "seek", (clp->debug > 2), stderr);
+        }
+        /* count defaults to the (smaller) sum of the list(s) */
+        if (dd_count < 0) {
+            if (0 == clp->i_sgl.num_elems)
+                dd_count = clp->o_sgl.sum;
+            else if ((0 == clp->o_sgl.num_elems) ||
+                     (clp->i_sgl.sum < clp->o_sgl.sum))
+                dd_count = clp->i_sgl.sum;
+            else
+                dd_count = clp->o_sgl.sum;
+        } else if (((clp->i_sgl.num_elems > 0) &&
+                    (dd_count > clp->i_sgl.sum)) ||
+                   ((clp->o_sgl.num_elems > 0) &&
+                    (dd_count > clp->o_sgl.sum))) {
+            pr2serr("count=%" PRId64 " exceeds the number of blocks in the "
+                    "skip= or seek= list\n", dd_count);
+            return SG_LIB_CONTRADICT;
+        }
+    }
     if ((clp->bpt < 1) || (clp->bpt > MAX_BPT_VALUE)) {
         pr2serr("bpt must be > 0 and <= %d\n", MAX_BPT_VALUE);
         return SG_LIB_SYNTAX_ERROR;
@@ -1888,6 +5474,34 @@ main(int argc, char * argv[])
         usage();
         return SG_LIB_SYNTAX_ERROR;
     }
+    if ((clp->qd < 1) || (clp->qd > MAX_QUEUE_DEPTH)) {
+        pr2serr("qd= expects 1 to %d\n", MAX_QUEUE_DEPTH);
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if ((clp->qd > 1) && clp->mmap_active) {
+        pr2serr("mmap-ed IO uses the sg reserve buffer so needs qd=1\n");
+        return SG_LIB_CONTRADICT;
+    }
+    if ((clp->qd > 1) && clp->out_flags.zoned) {
+        /* several WRITEs to one zone could arrive out of order */
+        pr2serr("%soflag=zoned writes each zone in order so qd set to 1\n",
+                my_name);
+        clp->qd = 1;
+    }
+    if ((clp->verify_mb > 0) && clp->mmap_active) {
+        pr2serr("verify=MB swaps buffers so can't be used with mmap flag\n");
+        return SG_LIB_CONTRADICT;
+    }
+    if (clp->in_flags.delta) {
+        pr2serr("delta flag only applies to oflag=\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if (clp->out_flags.delta && (clp->out_flags.zoned ||
+                                 clp->out_flags.append)) {
+        pr2serr("oflag=delta skips writes so can't be used with the zoned "
+                "or append flags\n");
+        return SG_LIB_CONTRADICT;
+    }
     if (clp->debug > 2)
         pr2serr("%sif=%s skip=%" PRId64 " of=%s seek=%" PRId64 " count=%"
                 PRId64 "\n", my_name, infn, skip, outfn, seek, dd_count);
@@ -1900,7 +5514,7 @@ main(int argc, char * argv[])
     clp->infd = STDIN_FILENO;
     clp->outfd = STDOUT_FILENO;
     if (infn[0] && ('-' != infn[0])) {
-        clp->in_type = dd_filetype(infn);
+        clp->in_type = sg_dde_filetype(infn, 0, 0);
 
         if (FT_ERROR == clp->in_type) {
             pr2serr("%sunable to access %s\n", my_name, infn);
@@ -1929,7 +5543,7 @@ main(int argc, char * argv[])
                 perror(ebuff);
                 return sg_convert_errno(err);
             }
-            else if (skip > 0) {
+            else if ((skip > 0) && (! clp->in_flags.cimage)) {
                 off64_t offset = skip;
 
                 offset *= clp->bs;       /* could exceed 32 bits here! */
@@ -1944,7 +5558,7 @@ main(int argc, char * argv[])
         }
     }
     if (outfn[0] && ('-' != outfn[0])) {
-        clp->out_type = dd_filetype(outfn);
+        clp->out_type = sg_dde_filetype(outfn, 0, 0);
 
         if (FT_ST == clp->out_type) {
             pr2serr("%sunable to use scsi tape device %s\n", my_name, outfn);
@@ -1958,7 +5572,10 @@ main(int argc, char * argv[])
             clp->outfd = -1; /* don't bother opening */
         else {
             if (FT_RAW != clp->out_type) {
-                flags = O_WRONLY | O_CREAT;
+                /* verify=MB and oflag=delta read OFILE */
+                flags = ((clp->verify_mb > 0) || clp->out_flags.delta) ?
+                        O_RDWR : O_WRONLY;
+                flags |= O_CREAT;
                 if (clp->out_flags.direct)
                     flags |= O_DIRECT;
                 if (clp->out_flags.excl)
@@ -1975,9 +5592,13 @@ main(int argc, char * argv[])
                     perror(ebuff);
                     return sg_convert_errno(err);
                 }
+                if (FT_ERROR == clp->out_type)
+                    clp->out_type = FT_OTHER;   /* file was just created */
             }
             else {      /* raw output file */
-                if ((clp->outfd = open(outfn, O_WRONLY)) < 0) {
+                flags = ((clp->verify_mb > 0) || clp->out_flags.delta) ?
+                         O_RDWR : O_WRONLY;
+                if ((clp->outfd = open(outfn, flags)) < 0) {
                     err = errno;
                     snprintf(ebuff, EBUFF_SZ, "%scould not open %s for raw "
                              "writing", my_name, outfn);
@@ -1999,6 +5620,47 @@ main(int argc, char * argv[])
             }
         }
     }
+    if (do_numa) {
+        n = infn[0] ? dev_numa_node(infn) : -1;
+        if ((n < 0) && outfn[0])
+            n = dev_numa_node(outfn);
+        if (n < 0)
+            pr2serr("%sunable to find NUMA node of IFILE or OFILE, numa=1 "
+                    "ignored\n", my_name);
+        else {
+            clp->numa_node = n;
+            if (! clp->cpus_given)
+                clp->num_cpus = node_cpu_list(n, clp->cpus, MAX_CPU_LIST);
+            if (clp->debug)
+                pr2serr("host adapter is on NUMA node %d%s\n", n,
+                        clp->cpus_given ? "" : ", workers pinned to its "
+                        "cpus");
+        }
+    }
+    if (do_hwq) {
+        n = 0;
+        if (infn[0] && ((FT_BLOCK == clp->in_type) ||
+                        (FT_SG == clp->in_type)))
+            n = dev_hwq_dir(infn, clp->hwq_dir, sizeof(clp->hwq_dir));
+        if ((n <= 0) && outfn[0] && ((FT_BLOCK == clp->out_type) ||
+                                     (FT_SG == clp->out_type)))
+            n = dev_hwq_dir(outfn, clp->hwq_dir, sizeof(clp->hwq_dir));
+        if (n <= 0)
+            pr2serr("%sunable to find hardware queues of IFILE or OFILE, "
+                    "hwq=1 ignored\n", my_name);
+        else {
+            clp->num_hwq = n;
+            if (clp->debug)
+                pr2serr("%d hardware queues in %s%s\n", n, clp->hwq_dir,
+                        clp->cpus_given ? "" : ", worker k pinned to the "
+                        "cpus of queue k");
+        }
+    }
+    if (clp->cimg_alg && (FT_OTHER != clp->out_type)) {
+        pr2serr("%scompress= needs OFILE to be a regular file or a pipe\n",
+                my_name);
+        return SG_LIB_FILE_ERROR;
+    }
     if ((STDIN_FILENO == clp->infd) && (STDOUT_FILENO == clp->outfd)) {
         pr2serr("Won't default both IFILE to stdin _and_ OFILE to stdout\n");
         pr2serr("For more information use '--help'\n");
@@ -2007,11 +5669,12 @@ main(int argc, char * argv[])
     if (dd_count < 0) {
         in_num_sect = -1;
         if (FT_SG == clp->in_type) {
-            res = scsi_read_capacity(clp->infd, &in_num_sect, &in_sect_sz);
+            res = sg_dde_read_capacity(clp->infd, &in_num_sect, &in_sect_sz,
+                                       false, 0);
             if (2 == res) {
                 pr2serr("Unit attention, media changed(in), continuing\n");
-                res = scsi_read_capacity(clp->infd, &in_num_sect,
-                                         &in_sect_sz);
+                res = sg_dde_read_capacity(clp->infd, &in_num_sect,
+                                           &in_sect_sz, false, 0);
             }
             if (0 != res) {
                 if (res == SG_LIB_CAT_INVALID_OP)
@@ -2023,8 +5686,8 @@ main(int argc, char * argv[])
                 in_num_sect = -1;
             }
         } else if (FT_BLOCK == clp->in_type) {
-            if (0 != read_blkdev_capacity(clp->infd, &in_num_sect,
-                                          &in_sect_sz)) {
+            if (0 != sg_dde_blkdev_capacity(clp->infd, &in_num_sect,
+                                            &in_sect_sz, 0)) {
                 pr2serr("Unable to read block capacity on %s\n", infn);
                 in_num_sect = -1;
             }
@@ -2033,17 +5696,19 @@ main(int argc, char * argv[])
                         "device=%d\n", infn, clp->bs, in_sect_sz);
                 in_num_sect = -1;
             }
-        }
+        } else if (clp->in_flags.cimage)
+            in_num_sect = clp->cimg_in_blks;
         if (in_num_sect > skip)
             in_num_sect -= skip;
 
         out_num_sect = -1;
         if (FT_SG == clp->out_type) {
-            res = scsi_read_capacity(clp->outfd, &out_num_sect, &out_sect_sz);
+            res = sg_dde_read_capacity(clp->outfd, &out_num_sect,
+                                       &out_sect_sz, false, 0);
             if (2 == res) {
                 pr2serr("Unit attention, media changed(out), continuing\n");
-                res = scsi_read_capacity(clp->outfd, &out_num_sect,
-                                         &out_sect_sz);
+                res = sg_dde_read_capacity(clp->outfd, &out_num_sect,
+                                           &out_sect_sz, false, 0);
             }
             if (0 != res) {
                 if (res == SG_LIB_CAT_INVALID_OP)
@@ -2055,8 +5720,8 @@ main(int argc, char * argv[])
                 out_num_sect = -1;
             }
         } else if (FT_BLOCK == clp->out_type) {
-            if (0 != read_blkdev_capacity(clp->outfd, &out_num_sect,
-                                          &out_sect_sz)) {
+            if (0 != sg_dde_blkdev_capacity(clp->outfd, &out_num_sect,
+                                            &out_sect_sz, 0)) {
                 pr2serr("Unable to read block capacity on %s\n", outfn);
                 out_num_sect = -1;
             }
@@ -2087,35 +5752,205 @@ main(int argc, char * argv[])
         pr2serr("Couldn't calculate count, please give one\n");
         return SG_LIB_CAT_OTHER;
     }
+    if (clp->in_flags.extents) {
+        res = extents_setup(clp, skip, seek, &dd_count);
+        if (res)
+            return res;
+    }
+    if (clp->out_flags.zoned) {
+        res = zones_setup(clp, seek, dd_count);
+        if (res)
+            return res;
+    }
     if (! cdbsz_given) {
         if ((FT_SG == clp->in_type) && (MAX_SCSI_CDBSZ != clp->cdbsz_in) &&
-            (((dd_count + skip) > UINT_MAX) || (clp->bpt > USHRT_MAX))) {
+            ((((clp->i_sgl.num_elems > 0) ? clp->i_sgl.high_lba_p1 :
+               (dd_count + skip)) > UINT_MAX) || (clp->bpt > USHRT_MAX))) {
             pr2serr("Note: SCSI command size increased to 16 bytes (for "
                     "'if')\n");
             clp->cdbsz_in = MAX_SCSI_CDBSZ;
         }
         if ((FT_SG == clp->out_type) && (MAX_SCSI_CDBSZ != clp->cdbsz_out) &&
-            (((dd_count + seek) > UINT_MAX) || (clp->bpt > USHRT_MAX))) {
+            ((((clp->o_sgl.num_elems > 0) ? clp->o_sgl.high_lba_p1 :
+               (dd_count + seek)) > UINT_MAX) || (clp->bpt > USHRT_MAX))) {
             pr2serr("Note: SCSI command size increased to 16 bytes (for "
                     "'of')\n");
             clp->cdbsz_out = MAX_SCSI_CDBSZ;
         }
     }
+    /* only the LBA and TRANSFER LENGTH change from one command to the next
+     * so the rest of each cdb is built once, here */
+    if ((FT_SG == clp->in_type) &&
+        sg_dde_cdb_tmpl_init(&clp->rd_tmpl, clp->cdbsz_in, false,
+                             clp->in_flags.fua, clp->in_flags.dpo, my_name))
+        return SG_LIB_SYNTAX_ERROR;
+    if ((FT_SG == clp->out_type) &&
+        sg_dde_cdb_tmpl_init(&clp->wr_tmpl, clp->cdbsz_out, true,
+                             clp->out_flags.fua, clp->out_flags.dpo, my_name))
+        return SG_LIB_SYNTAX_ERROR;
 
-    clp->in_count = dd_count;
+    clp->in_next = 0;
+    clp->in_end = dd_count;
     clp->in_rem_count = dd_count;
     clp->skip = skip;
-    clp->in_blk = skip;
-    clp->out_count = dd_count;
     clp->out_rem_count = dd_count;
     clp->seek = seek;
+    /* When the current file position can be found, later reads and writes
+     * are positioned relative to it and can be done in any order */
+    clp->in_pos = -1;
+    if ((FT_OTHER == clp->in_type) || (FT_BLOCK == clp->in_type) ||
+        (FT_RAW == clp->in_type))
+        clp->in_pos = lseek64(clp->infd, 0, SEEK_CUR);
+    clp->out_pos = -1;
+    if (((FT_OTHER == clp->out_type) || (FT_BLOCK == clp->out_type) ||
+         (FT_RAW == clp->out_type)) && (! clp->out_flags.append))
+        clp->out_pos = lseek64(clp->outfd, 0, SEEK_CUR);
+    clp->out_seq = (FT_DEV_NULL != clp->out_type) &&
+                   (FT_SG != clp->out_type) && (clp->out_pos < 0);
+    if (clp->in_flags.uring && ((FT_SG == clp->in_type) ||
+                                (clp->in_pos < 0) || (clp->qd < 2))) {
+        pr2serr("%siflag=uring needs IFILE to be a block device or regular "
+                "file and qd= > 1, ignored\n", my_name);
+        clp->in_flags.uring = false;
+    }
+    if (clp->out_flags.uring && ((FT_SG == clp->out_type) ||
+                                 (clp->out_pos < 0) || (clp->qd < 2))) {
+        pr2serr("%soflag=uring needs OFILE to be a block device or regular "
+                "file and qd= > 1, ignored\n", my_name);
+        clp->out_flags.uring = false;
+    }
+    /* in order transfers can only follow a list without holes */
+    if (((clp->i_sgl.num_elems > 0) && (FT_SG != clp->in_type) &&
+         (clp->in_pos < 0) && (SG_SGL_LINEAR != clp->i_sgl.linearity)) ||
+        (clp->out_seq && (clp->o_sgl.num_elems > 0) &&
+         (SG_SGL_LINEAR != clp->o_sgl.linearity))) {
+        pr2serr("%sa %s scatter gather list needs a file that can be "
+                "accessed by position\n", my_name,
+                sg_sgl_linearity_str((clp->out_seq &&
+                                      (clp->o_sgl.num_elems > 0)) ?
+                                     clp->o_sgl.linearity :
+                                     clp->i_sgl.linearity));
+        return SG_LIB_CONTRADICT;
+    }
+    if (clp->num_fan > 0) {
+        res = fan_open(clp, seek);
+        if (res)
+            return res;
+    }
+    num_err_stats = clp->num_threads * (clp->num_fan + 1);
+    err_stats_a = (struct sg_err_stats *)calloc(num_err_stats,
+                                                sizeof(struct sg_err_stats));
+    if (NULL == err_stats_a) {
+        pr2serr("%sout of memory for error statistics\n", my_name);
+        return SG_LIB_CAT_OTHER;
+    }
+    if (clp->num_threads > 0) {
+        uint8_t * free_shards = NULL;
+
+        /* page aligned (and zeroed) so no shard straddles cache lines;
+         * kept until exit as the signal thread may still read them */
+        shard_a = (struct sgp_shard *)
+                sg_memalign(clp->num_threads * sizeof(struct sgp_shard), 0,
+                            &free_shards, false);
+        if (NULL == shard_a) {
+            pr2serr("%sout of memory for counters\n", my_name);
+            return SG_LIB_CAT_OTHER;
+        }
+        num_shards = clp->num_threads;
+    }
+    if (clp->bpt_auto && (0 == clp->dry_run))
+        auto_bpt_tune(clp, dd_count);
+    if (clp->mmap_active || clp->in_flags.dio || clp->out_flags.dio) {
+        /* size the reserve buffers once, lowering bpt so that mmap-ed and
+         * direct IO fit; a checkpoint map fixes bpt so it is left alone */
+        int want;
+        struct sg_dde_resbuf rb;
+
+        if (FT_SG == clp->in_type) {
+            want = (clp->in_flags.mmap ? SG_DDE_RB_MMAP : 0) |
+                   (clp->in_flags.dio ? SG_DDE_RB_DIO : 0) |
+                   (ckptfn[0] ? 0 : SG_DDE_RB_FIT);
+            res = sg_dde_resbuf_size(clp->infd, clp->bs, &clp->bpt, want,
+                                     &rb, my_name, clp->debug);
+            if (res)
+                return res;
+            if (clp->in_flags.mmap && (0 == (SG_DDE_RB_MMAP & rb.got)))
+                return SG_LIB_CAT_OTHER;
+        }
+        if (FT_SG == clp->out_type) {
+            want = (clp->out_flags.mmap ? SG_DDE_RB_MMAP : 0) |
+                   (clp->out_flags.dio ? SG_DDE_RB_DIO : 0) |
+                   (ckptfn[0] ? 0 : SG_DDE_RB_FIT);
+            res = sg_dde_resbuf_size(clp->outfd, clp->bs, &clp->bpt, want,
+                                     &rb, my_name, clp->debug);
+            if (res)
+                return res;
+            if (clp->out_flags.mmap && (0 == (SG_DDE_RB_MMAP & rb.got)))
+                return SG_LIB_CAT_OTHER;
+        }
+    }
+    if (clp->in_flags.share || clp->out_flags.share)
+        share_setup(clp);
+    if ((clp->num_streams > 0) && ((FT_SG != clp->out_type) ||
+                                   (clp->bpt > USHRT_MAX))) {
+        pr2serr("streams=N needs OFILE to be a sg device and BPT to be "
+                "%d or less\n", USHRT_MAX);
+        return SG_LIB_CONTRADICT;
+    }
+    if ((clp->num_streams > 0) && (SGP_STR_SEG == clp->str_map) &&
+        (0 == clp->o_sgl.num_elems)) {
+        pr2serr("streams=N,seg needs seek=SGL or iflag=extents, using "
+                "streams=%d,lba\n", clp->num_streams);
+        clp->str_map = SGP_STR_LBA;
+    }
+    if ((clp->verify_mb > 0) && ((FT_DEV_NULL == clp->out_type) ||
+                                 ((FT_SG != clp->out_type) &&
+                                  (clp->out_pos < 0)))) {
+        pr2serr("verify=MB needs an OFILE that can be read back by "
+                "position\n");
+        return SG_LIB_CONTRADICT;
+    }
+    if (clp->out_flags.delta && ((FT_DEV_NULL == clp->out_type) ||
+                                 ((FT_SG != clp->out_type) &&
+                                  (clp->out_pos < 0)))) {
+        pr2serr("oflag=delta needs an OFILE that can be read back by "
+                "position\n");
+        return SG_LIB_CONTRADICT;
+    }
+    if (ckptfn[0]) {
+        if (! clp->resume) {
+            clp->ckpt_skip = skip;
+            clp->ckpt_seek = seek;
+            clp->ckpt_count = dd_count;
+        }
+        clp->ckpt_chunks = (dd_count + clp->bpt - 1) / clp->bpt;
+        clp->ckpt_map = (SGP_ATOMIC uint64_t *)
+                calloc((clp->ckpt_chunks / 64) + 1, sizeof(uint64_t));
+        if (NULL == clp->ckpt_map) {
+            pr2serr("%sunable to allocate checkpoint map\n", my_name);
+            return SG_LIB_OS_BASE_ERR + ENOMEM;
+        }
+        /* in order transfers can't pass over ranges, so redo them */
+        if (clp->ckpt_hex && (! clp->out_seq) &&
+            ((FT_SG == clp->in_type) || (clp->in_pos >= 0))) {
+            int64_t blks = ckpt_load_map(clp);
+
+            clp->in_rem_count -= blks;
+            clp->out_rem_count -= blks;
+            if (clp->debug)
+                pr2serr("checkpoint map: %" PRId64 " more blocks already "
+                        "copied\n", blks);
+        }
+        free(clp->ckpt_hex);
+        clp->ckpt_hex = NULL;
+    }
+    if (clp->debug > 1)
+        pr2serr("reads are %s, writes are %s\n",
+                ((FT_SG == clp->in_type) || (clp->in_pos >= 0)) ?
+                "unordered" : "in order",
+                clp->out_seq ? "in order" : "unordered");
     status = pthread_mutex_init(&clp->inout_mutex, NULL);
     if (0 != status) err_exit(status, "init inout_mutex");
-    status = pthread_mutex_lock(&clp->inout_mutex);
-    if (0 != status) err_exit(status, "lock inout_mutex");
-    clp->out_blk = seek;
-    status = pthread_mutex_unlock(&clp->inout_mutex);
-    if (0 != status) err_exit(status, "unlock inout_mutex");
 
     status = pthread_cond_init(&clp->out_sync_cv, NULL);
     if (0 != status) err_exit(status, "init out_sync_cv");
@@ -2126,8 +5961,15 @@ main(int argc, char * argv[])
     }
     sigemptyset(&signal_set);
     sigaddset(&signal_set, SIGINT);
+    if (clp->rate_arg && ('@' == clp->rate_arg[0]))
+        sigaddset(&signal_set, SIGHUP);     /* re-read rate=@FN */
+#if ! SG_LIB_ANDROID
+    sigaddset(&signal_set, SIGUSR1);    /* progress and error statistics */
+#endif
     status = pthread_sigmask(SIG_BLOCK, &signal_set, NULL);
     if (0 != status) err_exit(status, "pthread_sigmask");
+    if (ckptfn[0] && (! ckpt_write(clp, false)))
+        return SG_LIB_FILE_ERROR;
     status = pthread_create(&sig_listen_thread_id, NULL,
                             sig_listen_thread, (void *)clp);
     if (0 != status) err_exit(status, "pthread_create, sig...");
@@ -2137,9 +5979,30 @@ main(int argc, char * argv[])
         start_tm.tv_usec = 0;
         gettimeofday(&start_tm, NULL);
         start_tm_valid = true;
+        sg_cpu_snap(&start_cpu);
+    }
+    if (clp->verify_mb > 0)
+        vfy_start(clp);
+    if (clp->hash_alg && (! hash_open(clp))) {
+        clp->hash_alg = SG_HASH_NONE;
+        exit_status = SG_LIB_FILE_ERROR;
+        goto degen;
+    }
+    if ((clp->num_streams > 0) && (res = streams_open(clp))) {
+        exit_status = res;
+        goto degen;
+    }
+    if (clp->cimg_alg && (res = cimg_open(clp))) {
+        clp->cimg_alg = SG_CIMG_NONE;
+        exit_status = res;
+        goto degen;
     }
     if (FT_DEV_NULL == clp->in_type)
         goto degen;     /* corner case: if=/dev/null */
+    /* so worker threads do not block on stderr, or on each other, when
+     * reporting errors; drained at degen: and at exit() */
+    if (clp->num_threads > 1)
+        sg_log_start(0);
 
 /* vvvvvvvvvvv  Start worker threads  vvvvvvvvvvvvvvvvvvvvvvvv */
     if ((clp->out_rem_count > 0) && (clp->num_threads > 0)) {
@@ -2185,8 +6048,23 @@ main(int argc, char * argv[])
     }   /* started worker threads and here after they have all exited */
 
 degen:
-    if (do_time && (start_tm.tv_sec || start_tm.tv_usec))
+    if (clp->vfyp)
+        vfy_stop(clp);
+    if (clp->hash_alg)
+        hash_close(clp);
+    if (clp->num_streams > 0)
+        streams_close(clp);
+    if ((clp->cimg_alg || clp->in_flags.cimage) && (res = cimg_close(clp)) &&
+        (0 == exit_status))
+        exit_status = res;
+    sg_log_stop();
+    if (do_time && (start_tm.tv_sec || start_tm.tv_usec)) {
+        struct sg_cpu_cost cc;
+
         calc_duration_throughput(false);
+        if (cpu_cost_so_far(clp, &cc))
+            sg_cpu_cost_pr(&cc, "");
+    }
 
     if (do_sync) {
         if (FT_SG == clp->out_type) {
@@ -2200,6 +6078,19 @@ degen:
             if (0 != res)
                 pr2serr("Unable to synchronize cache\n");
         }
+        for (k = 0; k < clp->num_fan; ++k) {
+            if (FT_SG != clp->fan[k].type)
+                continue;
+            pr2serr(">> Synchronizing cache on %s\n", clp->fan[k].fn);
+            res = sg_ll_sync_cache_10(clp->fan[k].fd, 0, 0, 0, 0, 0, false,
+                                      0);
+            if (SG_LIB_CAT_UNIT_ATTENTION == res)
+                res = sg_ll_sync_cache_10(clp->fan[k].fd, 0, 0, 0, 0, 0,
+                                          false, 0);
+            if (0 != res)
+                pr2serr("Unable to synchronize cache on %s\n",
+                        clp->fan[k].fn);
+        }
     }
 
 #if 0
@@ -2219,6 +6110,23 @@ degen:
     if (0 != status) err_exit(status, "pthread_kill");
     /* valgrind says the above _kill() leaks; web says it needs a following
      * _join() to clear heap taken by associated _create() */
+    status = pthread_join(sig_listen_thread_id, &vp);
+    if (0 != status) err_exit(status, "pthread_join, sig...");
+    if (clp->interval > 0)
+        interval_report(clp, true);     /* the last, partial, interval */
+    if (ckptfn[0])
+        ckpt_write(clp, true);
+    if ((clp->ext_count > 0) && (clp->out_pos >= 0) &&
+        (0 == out_rem(clp))) {
+        struct stat st;
+        off64_t end = clp->out_pos +
+                      ((off64_t)clp->ext_count * clp->bs);
+
+        /* unmapped tail of IFILE: extend a regular OFILE to match */
+        if ((0 == fstat(clp->outfd, &st)) && S_ISREG(st.st_mode) &&
+            (st.st_size < end) && (ftruncate(clp->outfd, end) < 0))
+            perror("iflag=extents: ftruncate on output");
+    }
 
 fini:
     if ((STDIN_FILENO != clp->infd) && (clp->infd >= 0))
@@ -2227,20 +6135,33 @@ fini:
         if (clp->outfd >= 0)
             close(clp->outfd);
     }
+    for (k = 0; k < clp->num_fan; ++k) {
+        if (clp->fan[k].fd > 0)
+            close(clp->fan[k].fd);
+    }
+    sg_sgl_free(&clp->i_sgl);
+    sg_sgl_free(&clp->o_sgl);
+    free(clp->zones);
     res = exit_status;
-    if ((0 != clp->out_count) && (0 == clp->dry_run)) {
+    shards_sum(&tot);
+    /* blocks beyond a short read on the input are not counted as errors */
+    rem = clp->out_rem_count - tot.out_blks - (dd_count - clp->in_end);
+    if ((rem > 0) && (0 == clp->dry_run)) {
         pr2serr(">>>> Some error occurred, remaining blocks=%" PRId64 "\n",
-                clp->out_count);
+                rem);
         if (0 == res)
             res = SG_LIB_CAT_OTHER;
     }
     print_stats("");
-    if (clp->dio_incomplete_count) {
+    for (k = 0; k < clp->num_fan; ++k)
+        pr2serr("%" PRId64 " records out to %s\n",
+                (int64_t)clp->fan[k].out_blks, clp->fan[k].fn);
+    if (tot.dio_incomplete_count) {
         int fd;
         char c;
 
         pr2serr(">> Direct IO requested but incomplete %d times\n",
-                clp->dio_incomplete_count);
+                (int)tot.dio_incomplete_count);
         if ((fd = open(sg_allow_dio, O_RDONLY)) >= 0) {
             if (1 == read(fd, &c, 1)) {
                 if ('0' == c)
@@ -2250,20 +6171,9 @@ fini:
             close(fd);
         }
     }
-    if (clp->sum_of_resids)
+    if (tot.sum_of_resids)
         pr2serr(">> Non-zero sum of residual counts=%d\n",
-               clp->sum_of_resids);
-#ifdef HAVE_C11_ATOMICS
-    {
-        unsigned int ui;
-
-        if ((ui = atomic_load(&num_eagain)) > 0)
-            pr2serr(">> number of IO call yielding EAGAIN %u\n", ui);
-        if ((ui = atomic_load(&num_ebusy)) > 0)
-            pr2serr(">> number of IO call yielding EBUSY %u\n", ui);
-        if ((ui = atomic_load(&num_eintr)) > 0)
-            pr2serr(">> number of IO call yielding EINTR %u\n", ui);
-    }
-#endif
+               (int)tot.sum_of_resids);
+    err_stats_report(clp, ">> ");
     return (res >= 0) ? res : SG_LIB_CAT_OTHER;
 }
@@ -19,6 +19,8 @@
 /* This program was used to test SCSI mid level queue ordering.
    The default behaviour is to "queue at head" which is useful for
    error processing but not for streaming READ and WRITE commands.
+   To measure throughput and latency over a range of queue depths, at the
+   head or tail, see 'sg_iobench --qd-sweep=QL --queue=head|tail'.
 
 *  Copyright (C) 2010-2021 D. Gilbert
 *  This program is free software; you can redistribute it and/or modify
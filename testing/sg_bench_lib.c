@@ -0,0 +1,511 @@
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * This is a microbenchmark of the sense data, CDB and hex decoding
+ * functions of sg_lib and of the sgj_* JSON builders. Each benchmark
+ * cycles over a small corpus of sense buffers or CDBs of the kinds seen
+ * in practice and reports the average time per call in nanoseconds. No
+ * device is needed. With --json the result is a single JSON object so it
+ * can be kept and compared across releases.
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <inttypes.h>
+#include <getopt.h>
+#include <sys/utsname.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "sg_lib.h"
+#include "sg_pr2serr.h"
+#include "sg_json_sg_lib.h"
+
+#define MY_NAME "sg_bench_lib"
+
+static const char * version_str = "1.00 20261014";
+
+#define BENCH_DEF_MS 500        /* milliseconds per benchmark */
+#define BENCH_BUFF_LEN 4096
+#define BENCH_BLK_LEN 512
+
+struct sense_t {
+    const char * desc;
+    int len;
+    uint8_t b[32];
+};
+
+/* Fixed (0x70, 0x71) and descriptor (0x72) format sense data */
+static const struct sense_t sense_arr[] = {
+    {"power on reset", 18, {0x70, 0, 0x6, 0, 0, 0, 0, 0xa, 0, 0, 0, 0,
+                            0x29, 0, 0, 0, 0, 0}},
+    {"unrecovered read error, info", 18, {0xf0, 0, 0x3, 0, 0x12, 0x34, 0x56,
+                                          0xa, 0, 0, 0, 0, 0x11, 0, 0, 0, 0,
+                                          0}},
+    {"invalid field in cdb, sks", 18, {0x70, 0, 0x5, 0, 0, 0, 0, 0xa, 0, 0,
+                                       0, 0, 0x24, 0, 0, 0xc0, 0, 0x2}},
+    {"becoming ready", 18, {0x70, 0, 0x2, 0, 0, 0, 0, 0xa, 0, 0, 0, 0, 0x4,
+                            0x1, 0, 0, 0, 0}},
+    {"format in progress", 18, {0x70, 0, 0x2, 0, 0, 0, 0, 0xa, 0, 0, 0, 0,
+                                0x4, 0x4, 0, 0x80, 0x40, 0}},
+    {"write protected", 18, {0x70, 0, 0x7, 0, 0, 0, 0, 0xa, 0, 0, 0, 0,
+                             0x27, 0, 0, 0, 0, 0}},
+    {"internal target failure", 18, {0x70, 0, 0x4, 0, 0, 0, 0, 0xa, 0, 0, 0,
+                                     0, 0x44, 0, 0, 0, 0, 0}},
+    {"deferred write error", 18, {0x71, 0, 0x3, 0, 0, 0, 0, 0xa, 0, 0, 0, 0,
+                                  0xc, 0, 0, 0, 0, 0}},
+    {"desc: unrecovered read error, info", 20,
+     {0x72, 0x3, 0x11, 0, 0, 0, 0, 0xc, 0, 0xa, 0x80, 0, 0, 0, 0, 0, 0x12,
+      0x34, 0x56, 0x78}},
+    {"desc: invalid field in cdb, sks", 16,
+     {0x72, 0x5, 0x24, 0, 0, 0, 0, 0x8, 0x2, 0x6, 0, 0, 0xc0, 0, 0x2, 0}},
+    {"desc: ata pass-through info", 22,
+     {0x72, 0x1, 0, 0x1d, 0, 0, 0, 0xe, 0x9, 0xc, 0, 0, 0, 0x1, 0, 0, 0, 0,
+      0, 0, 0x40, 0x50}},
+    {"desc: miscompare, info", 20,
+     {0x72, 0xe, 0x1d, 0, 0, 0, 0, 0xc, 0, 0xa, 0x80, 0, 0, 0, 0, 0, 0, 0,
+      0x2, 0}},
+};
+
+struct cdb_t {
+    int len;
+    uint8_t b[32];
+};
+
+static const struct cdb_t cdb_arr[] = {
+    {6, {0}},                                           /* TUR */
+    {6, {0x12, 0, 0, 0, 0x24, 0}},                      /* INQUIRY */
+    {6, {0x12, 0x1, 0x83, 0, 0xfc, 0}},                 /* INQUIRY, VPD */
+    {10, {0x28, 0, 0, 0x12, 0x34, 0x56, 0, 0, 0x8, 0}}, /* READ(10) */
+    {10, {0x2a, 0, 0, 0x12, 0x34, 0x56, 0, 0, 0x8, 0}}, /* WRITE(10) */
+    {16, {0x88, 0, 0, 0, 0, 0, 0, 0x12, 0x34, 0x56, 0, 0, 0, 0x8, 0, 0}},
+    {16, {0x8a, 0, 0, 0, 0, 0, 0, 0x12, 0x34, 0x56, 0, 0, 0, 0x8, 0, 0}},
+    {16, {0x9e, 0x10, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x20, 0, 0}},
+    {12, {0xa0, 0, 0, 0, 0, 0, 0, 0, 0x10, 0, 0, 0}},   /* REPORT LUNS */
+    {10, {0x5a, 0, 0x3f, 0, 0, 0, 0, 0x10, 0, 0}},      /* MODE SENSE(10) */
+    {10, {0x4d, 0, 0x4d, 0, 0, 0, 0, 0x10, 0, 0}},      /* LOG SENSE */
+    {10, {0x35, 0, 0, 0, 0, 0, 0, 0, 0, 0}},            /* SYNC CACHE(10) */
+    {10, {0x42, 0, 0, 0, 0, 0, 0, 0, 0x18, 0}},         /* UNMAP */
+    {16, {0x85, 0x8, 0xe, 0, 0, 0, 0x1, 0, 0, 0, 0, 0, 0, 0x40, 0xec, 0}},
+    {16, {0x95, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x10, 0, 0, 0}},
+    {32, {0x7f, 0, 0, 0, 0, 0, 0, 0x18, 0, 0x9, 0, 0, 0, 0, 0, 0, 0, 0,
+          0x12, 0x34, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x8}}, /* READ(32) */
+};
+
+/* Additional sense codes: common, vendor specific and unknown */
+static const uint8_t asc_ascq_arr[][2] = {
+    {0x29, 0}, {0x11, 0}, {0x24, 0}, {0x4, 0x1}, {0x4, 0x4}, {0x27, 0},
+    {0x44, 0}, {0xc, 0}, {0x1d, 0}, {0, 0x1d}, {0x3a, 0x1}, {0x5d, 0x10},
+    {0x80, 0x1}, {0x4, 0xff}, {0x7f, 0x7f},
+};
+
+#define NUM_SENSE ((int)(sizeof(sense_arr) / sizeof(sense_arr[0])))
+#define NUM_CDB ((int)(sizeof(cdb_arr) / sizeof(cdb_arr[0])))
+#define NUM_ASC ((int)(sizeof(asc_ascq_arr) / sizeof(asc_ascq_arr[0])))
+
+struct opts_t {
+    bool do_json;
+    int count;                  /* passes over corpus, 0 -> use ms */
+    int ms;
+    int verbose;
+    const char * bench;         /* NULL -> all */
+    const char * json_arg;
+    sgj_state json_st;
+};
+
+/* Performs one pass over a corpus and returns the number of calls made.
+ * Adds something derived from each result to *sinkp so the calls cannot
+ * be optimized away. */
+typedef int (*bench_f)(uint64_t * sinkp);
+
+struct bench_t {
+    const char * name;
+    bench_f fn;
+    int corpus_size;
+};
+
+struct result_t {
+    uint64_t num_ops;
+    uint64_t elapsed_ns;
+};
+
+static uint8_t blk_buff[BENCH_BLK_LEN];
+static FILE * null_fp;
+static char out_b[BENCH_BUFF_LEN];
+
+static struct option long_options[] = {
+        {"bench", required_argument, 0, 'b'},
+        {"count", required_argument, 0, 'c'},
+        {"help", no_argument, 0, 'h'},
+        {"json", optional_argument, 0, 'j'},
+        {"time", required_argument, 0, 't'},
+        {"verbose", no_argument, 0, 'v'},
+        {"version", no_argument, 0, 'V'},
+        {0, 0, 0, 0},
+};
+
+
+static int bench_sense_str(uint64_t * sinkp);
+static int bench_additional_sense_str(uint64_t * sinkp);
+static int bench_command_str(uint64_t * sinkp);
+static int bench_err_category_sense(uint64_t * sinkp);
+static int bench_hex2str_sense(uint64_t * sinkp);
+static int bench_hex2str_512(uint64_t * sinkp);
+static int bench_sgj_build(uint64_t * sinkp);
+static int bench_sgj_js2file(uint64_t * sinkp);
+
+static const struct bench_t bench_arr[] = {
+    {"sg_get_sense_str", bench_sense_str, NUM_SENSE},
+    {"sg_get_additional_sense_str", bench_additional_sense_str, NUM_ASC},
+    {"sg_get_command_str", bench_command_str, NUM_CDB},
+    {"sg_err_category_sense", bench_err_category_sense, NUM_SENSE},
+    {"hex2str_sense", bench_hex2str_sense, NUM_SENSE},
+    {"hex2str_512", bench_hex2str_512, 1},
+    {"sgj_build", bench_sgj_build, NUM_SENSE},
+    {"sgj_js2file", bench_sgj_js2file, NUM_SENSE},
+    {NULL, NULL, 0},
+};
+
+
+static void
+usage(void)
+{
+    const struct bench_t * bp;
+
+    pr2serr("Usage: sg_bench_lib [--bench=NAME] [--count=N] [--help] "
+            "[--json[=JO]]\n"
+            "                    [--time=MS] [--verbose] [--version]\n"
+            "  where:\n"
+            "    --bench=NAME|-b NAME    only run benchmark NAME (def: run "
+            "all)\n"
+            "    --count=N|-c N      make N passes over the corpus in each "
+            "benchmark\n"
+            "                        (def: 0 -> run for MS instead)\n"
+            "    --help|-h           print usage information then exit\n"
+            "    --json[=JO]|-j[JO]    output in JSON instead of human "
+            "readable text\n"
+            "                          use --json=? for JSON help\n"
+            "    --time=MS|-t MS     run each benchmark for MS milliseconds "
+            "(def: %d)\n"
+            "    --verbose|-v        increase the level of verbosity\n"
+            "    --version|-V        print version number then exit\n\n"
+            "Microbenchmarks of sg_lib sense, CDB and hex decoding, and of "
+            "the sgj_*\nJSON builders, reporting nanoseconds per call. "
+            "Benchmarks:\n", BENCH_DEF_MS);
+    for (bp = bench_arr; bp->name; ++bp)
+        pr2serr("    %s\n", bp->name);
+}
+
+static int
+bench_sense_str(uint64_t * sinkp)
+{
+    int k;
+
+    for (k = 0; k < NUM_SENSE; ++k)
+        *sinkp += sg_get_sense_str("  ", sense_arr[k].b, sense_arr[k].len,
+                                   false, sizeof(out_b), out_b);
+    return NUM_SENSE;
+}
+
+static int
+bench_additional_sense_str(uint64_t * sinkp)
+{
+    int k;
+
+    for (k = 0; k < NUM_ASC; ++k) {
+        sg_get_additional_sense_str(asc_ascq_arr[k][0], asc_ascq_arr[k][1],
+                                    true, sizeof(out_b), out_b);
+        *sinkp += (uint8_t)out_b[0];
+    }
+    return NUM_ASC;
+}
+
+static int
+bench_command_str(uint64_t * sinkp)
+{
+    int k;
+
+    for (k = 0; k < NUM_CDB; ++k) {
+        sg_get_command_str(cdb_arr[k].b, cdb_arr[k].len, true, sizeof(out_b), out_b);
+        *sinkp += (uint8_t)out_b[0];
+    }
+    return NUM_CDB;
+}
+
+static int
+bench_err_category_sense(uint64_t * sinkp)
+{
+    int k;
+
+    for (k = 0; k < NUM_SENSE; ++k)
+        *sinkp += sg_err_category_sense(sense_arr[k].b, sense_arr[k].len);
+    return NUM_SENSE;
+}
+
+static int
+bench_hex2str_sense(uint64_t * sinkp)
+{
+    int k;
+
+    for (k = 0; k < NUM_SENSE; ++k)
+        *sinkp += hex2str(sense_arr[k].b, sense_arr[k].len, "  ", 1,
+                          sizeof(out_b), out_b);
+    return NUM_SENSE;
+}
+
+/* One 512 byte block with ASCII on the right, as 'sg_dd --verbose' and
+ * many utilities with --hex show a data-in buffer */
+static int
+bench_hex2str_512(uint64_t * sinkp)
+{
+    *sinkp += hex2str(blk_buff, sizeof(blk_buff), NULL, 0, sizeof(out_b), out_b);
+    return 1;
+}
+
+/* Builds the kind of JSON a utility emits for a failed command: an object
+ * per sense buffer with a few name:value pairs and the decoded sense. Each
+ * call starts a tree, adds one object and frees the tree. Since a tree's
+ * nodes come from a per-thread arena while it is being built, the JSON
+ * output of this utility is only started after all benchmarks are run. */
+static int
+build_tree(sgj_state * jsp, int k)
+{
+    sgj_opaque_p jop, jo2p;
+    const struct sense_t * sp = sense_arr + k;
+
+    sgj_init_state(jsp, NULL);
+    jop = sgj_start_r(NULL, NULL, 0, NULL, jsp);
+    if (NULL == jop)
+        return -1;
+    jo2p = sgj_named_subobject_r(jsp, jop, "command_status");
+    sgj_js_nv_s(jsp, jo2p, "description", sp->desc);
+    sgj_js_nv_ihex(jsp, jo2p, "opcode", cdb_arr[k % NUM_CDB].b[0]);
+    sgj_js_nv_i(jsp, jo2p, "scsi_status", 2);
+    sgj_js_nv_i(jsp, jo2p, "category",
+                sg_err_category_sense(sp->b, sp->len));
+    sgj_js_nv_hex_bytes(jsp, jo2p, "sense_data", sp->b, sp->len);
+    sgj_js_sense(jsp, jo2p, sp->b, sp->len);
+    return 0;
+}
+
+static int
+bench_sgj_build(uint64_t * sinkp)
+{
+    int k;
+    sgj_state js;
+
+    for (k = 0; k < NUM_SENSE; ++k) {
+        *sinkp += build_tree(&js, k) + 1;
+        sgj_finish(&js);
+    }
+    return NUM_SENSE;
+}
+
+/* As sgj_build plus serializing each tree (to /dev/null) */
+static int
+bench_sgj_js2file(uint64_t * sinkp)
+{
+    int k;
+    sgj_state js;
+
+    for (k = 0; k < NUM_SENSE; ++k) {
+        if (0 == build_tree(&js, k)) {
+            sgj_js2file(&js, NULL, 0, null_fp);
+            ++*sinkp;
+        }
+        sgj_finish(&js);
+    }
+    return NUM_SENSE;
+}
+
+static void
+run_bench(struct opts_t * op, const struct bench_t * bp,
+          struct result_t * rp)
+{
+    int k;
+    uint64_t start_ns, elapsed_ns, limit_ns;
+    uint64_t num_ops = 0;
+    uint64_t sink = 0;
+    double ns_per_op;
+    sgj_state * jsp = &op->json_st;
+
+    bp->fn(&sink);              /* warm up caches */
+    limit_ns = (uint64_t)op->ms * 1000000;
+    start_ns = sg_get_mono_ns();
+    if (op->count) {
+        for (k = 0; k < op->count; ++k)
+            num_ops += bp->fn(&sink);
+        elapsed_ns = sg_get_mono_ns() - start_ns;
+    } else {
+        do {
+            for (k = 0; k < 16; ++k)
+                num_ops += bp->fn(&sink);
+            elapsed_ns = sg_get_mono_ns() - start_ns;
+        } while (elapsed_ns < limit_ns);
+    }
+    ns_per_op = num_ops ? ((double)elapsed_ns / num_ops) : 0.0;
+    sgj_pr_hr(jsp, "  %-28s %10.1f ns/op  (%" PRIu64 " ops)\n", bp->name,
+              ns_per_op, num_ops);
+    if (op->verbose > 1)
+        pr2serr("    sink=%" PRIu64 "\n", sink);
+    rp->num_ops = num_ops;
+    rp->elapsed_ns = elapsed_ns;
+}
+
+
+int
+main(int argc, char * argv[])
+{
+    bool found;
+    int c, k;
+    int ret = 0;
+    const struct bench_t * bp;
+    struct result_t * rp;
+    struct opts_t opts;
+    struct opts_t * op = &opts;
+    sgj_state * jsp = &op->json_st;
+    sgj_opaque_p jop = NULL;
+    sgj_opaque_p jo2p;
+    sgj_opaque_p jap = NULL;
+    struct utsname uts;
+    struct result_t res_arr[sizeof(bench_arr) / sizeof(bench_arr[0])];
+
+    memset(op, 0, sizeof(*op));
+    memset(res_arr, 0, sizeof(res_arr));
+    op->ms = BENCH_DEF_MS;
+    while (1) {
+        int option_index = 0;
+
+        c = getopt_long(argc, argv, "b:c:hj::t:vV", long_options,
+                        &option_index);
+        if (c == -1)
+            break;
+
+        switch (c) {
+        case 'b':
+            op->bench = optarg;
+            break;
+        case 'c':
+            op->count = sg_get_num(optarg);
+            if (op->count < 0) {
+                pr2serr("bad argument to '--count='\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case 'h':
+        case '?':
+            usage();
+            return 0;
+        case 'j':
+            op->do_json = true;
+            op->json_arg = optarg;
+            break;
+        case 't':
+            op->ms = sg_get_num(optarg);
+            if (op->ms < 1) {
+                pr2serr("bad argument to '--time=', expect 1 or more\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case 'v':
+            ++op->verbose;
+            break;
+        case 'V':
+            pr2serr(MY_NAME " version: %s\n", version_str);
+            return 0;
+        default:
+            pr2serr("unrecognised option code 0x%x ??\n", c);
+            usage();
+            return SG_LIB_SYNTAX_ERROR;
+        }
+    }
+    if (optind < argc) {
+        pr2serr("unexpected extra argument: %s\n\n", argv[optind]);
+        usage();
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if (op->bench) {
+        found = false;
+        for (bp = bench_arr; bp->name; ++bp) {
+            if (0 == strcmp(op->bench, bp->name)) {
+                found = true;
+                break;
+            }
+        }
+        if (! found) {
+            pr2serr("unknown benchmark: %s, see --help\n", op->bench);
+            return SG_LIB_SYNTAX_ERROR;
+        }
+    }
+    null_fp = fopen("/dev/null", "w");
+    if (NULL == null_fp) {
+        pr2serr("unable to open /dev/null: %s\n", safe_strerror(errno));
+        return sg_convert_errno(errno);
+    }
+    for (k = 0; k < BENCH_BLK_LEN; ++k)       /* some printable, some not */
+        blk_buff[k] = (uint8_t)(k * 7);
+    if (op->do_json) {
+        if (! sgj_init_state(jsp, op->json_arg)) {
+            int bad_char = jsp->first_bad_char;
+            char e[1500];
+
+            if (bad_char)
+                pr2serr("bad argument to --json= option, unrecognized "
+                        "character '%c'\n\n", bad_char);
+            sg_json_usage(0, e, sizeof(e));
+            pr2serr("%s", e);
+            ret = SG_LIB_SYNTAX_ERROR;
+            goto fini;
+        }
+    }
+    sgj_pr_hr(jsp, "sg_lib version %s\n", sg_lib_version());
+    for (bp = bench_arr, rp = res_arr; bp->name; ++bp, ++rp) {
+        if (op->bench && strcmp(op->bench, bp->name))
+            continue;
+        run_bench(op, bp, rp);
+    }
+    if (jsp->pr_as_json) {
+        jop = sgj_start_r(MY_NAME, version_str, argc, argv, jsp);
+        jo2p = sgj_named_subobject_r(jsp, jop, "benchmark");
+        sgj_js_nv_s(jsp, jo2p, "library_version", sg_lib_version());
+        if (0 == uname(&uts)) {
+            sgj_js_nv_s(jsp, jo2p, "kernel_release", uts.release);
+            sgj_js_nv_s(jsp, jo2p, "machine", uts.machine);
+        }
+        jap = sgj_named_subarray_r(jsp, jo2p, "benchmark_list");
+        for (bp = bench_arr, rp = res_arr; bp->name; ++bp, ++rp) {
+            if (0 == rp->num_ops)
+                continue;
+            jo2p = sgj_new_unattached_object_r(jsp);
+            sgj_js_nv_s(jsp, jo2p, "benchmark", bp->name);
+            sgj_js_nv_i(jsp, jo2p, "corpus_size", bp->corpus_size);
+            sgj_js_nv_i(jsp, jo2p, "op_count", rp->num_ops);
+            sgj_js_nv_i(jsp, jo2p, "elapsed_ns", rp->elapsed_ns);
+            /* in picoseconds so the value is a JSON integer */
+            sgj_js_nv_i(jsp, jo2p, "picoseconds_per_op",
+                        (rp->elapsed_ns * 1000) / rp->num_ops);
+            sgj_js_nv_o(jsp, jap, NULL /* name */, jo2p);
+        }
+    }
+fini:
+    if (jsp->pr_as_json) {
+        sgj_js2file(jsp, NULL, ret, stdout);
+        sgj_finish(jsp);
+    }
+    fclose(null_fp);
+    return ret;
+}
@@ -0,0 +1,684 @@
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * This is a pass-through microbenchmark. It runs a fixed set of scenarios
+ * (TEST UNIT READY latency, 4 KiB random READ(16) at queue depth 1 and 32,
+ * and 1 MiB sequential READ(16)) against each DEVICE given and reports the
+ * command rate, data rate and latency percentiles of each. The output is
+ * meant to be compared across releases of this library and across kernels
+ * so with --json the result is a single JSON object. Each DEVICE is
+ * classified by the interface the library uses for it (sg v3, sg v4, bsg,
+ * NVMe generic char device or NVMe). Only commands that do not change the
+ * medium are sent. Suitable targets are scsi_debug and null_blk devices.
+ */
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <inttypes.h>
+#include <getopt.h>
+#include <sys/ioctl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/utsname.h>
+#include <scsi/sg.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "sg_lib.h"
+#include "sg_cmds_basic.h"
+#include "sg_pt.h"
+#include "sg_unaligned.h"
+#include "sg_pr2serr.h"
+#include "sg_json_sg_lib.h"
+
+#define MY_NAME "sg_bench_pt"
+
+static const char * version_str = "1.00 20261014";
+
+#define BENCH_MAX_DEVS 16
+#define BENCH_MAX_QD 32
+#define BENCH_DEF_SECS 3
+#define BENCH_CMD_TMO 20        /* seconds */
+#define BENCH_LAT_MAX 256       /* elements given to sg_pt_lat_snapshot() */
+#define SG_V4_VERSION_NUM 40000 /* sg driver versions from 4.0.0 use v4 */
+
+#define TUR_OPC 0x0
+#define READ16_OPC 0x88
+
+struct scenario_t {
+    const char * name;
+    uint8_t opcode;
+    bool is_random;
+    int qd;                     /* number of threads, each with 1 in flight */
+    uint32_t xfer_bytes;
+};
+
+static const struct scenario_t scenario_arr[] = {
+    {"tur", TUR_OPC, false, 1, 0},
+    {"randread_4k_qd1", READ16_OPC, true, 1, 4096},
+    {"randread_4k_qd32", READ16_OPC, true, 32, 4096},
+    {"seqread_1m", READ16_OPC, false, 1, 1024 * 1024},
+    {NULL, 0, false, 0, 0},
+};
+
+struct opts_t {
+    bool do_json;
+    int count;                  /* commands per thread, 0 -> use secs */
+    int secs;
+    int verbose;
+    int num_devs;
+    const char * scenario;      /* NULL -> all */
+    const char * json_arg;
+    const char * dev_arr[BENCH_MAX_DEVS];
+    sgj_state json_st;
+};
+
+struct dev_t {
+    const char * name;
+    const char * iface;
+    int sg_version;             /* 0 if not sg */
+    uint32_t block_size;
+    uint64_t num_blocks;
+};
+
+struct worker_t {
+    const struct opts_t * op;
+    const struct dev_t * dp;
+    const struct scenario_t * scp;
+    int id;
+    int res;
+    uint64_t deadline_ns;
+    uint64_t next_lba;
+    uint64_t num_done;
+    uint64_t num_errs;
+};
+
+static struct option long_options[] = {
+        {"count", required_argument, 0, 'c'},
+        {"help", no_argument, 0, 'h'},
+        {"json", optional_argument, 0, 'j'},
+        {"scenario", required_argument, 0, 's'},
+        {"time", required_argument, 0, 't'},
+        {"verbose", no_argument, 0, 'v'},
+        {"version", no_argument, 0, 'V'},
+        {0, 0, 0, 0},
+};
+
+
+static void
+usage(void)
+{
+    pr2serr("Usage: sg_bench_pt [--count=N] [--help] [--json[=JO]] "
+            "[--scenario=NAME]\n"
+            "                   [--time=SECS] [--verbose] [--version] "
+            "DEVICE*\n"
+            "  where:\n"
+            "    --count=N|-c N      send N commands per thread in each "
+            "scenario\n"
+            "                        (def: 0 -> run for SECS instead)\n"
+            "    --help|-h           print usage information then exit\n"
+            "    --json[=JO]|-j[JO]    output in JSON instead of human "
+            "readable text\n"
+            "                          use --json=? for JSON help\n"
+            "    --scenario=NAME|-s NAME    only run scenario NAME (def: run "
+            "all)\n"
+            "    --time=SECS|-t SECS    run each scenario for SECS seconds "
+            "(def: %d)\n"
+            "    --verbose|-v        increase the level of verbosity\n"
+            "    --version|-V        print version number then exit\n\n"
+            "Pass-through microbenchmark. Runs each scenario against each "
+            "DEVICE (up to\n%d) and reports commands/sec, bytes/sec and "
+            "latency percentiles. Only\ncommands that do not change the "
+            "medium are sent. Scenarios:\n", BENCH_DEF_SECS,
+            BENCH_MAX_DEVS);
+    pr2serr("    tur                TEST UNIT READY, queue depth 1\n"
+            "    randread_4k_qd1    4 KiB random READ(16), queue depth 1\n"
+            "    randread_4k_qd32   4 KiB random READ(16), queue depth 32\n"
+            "    seqread_1m         1 MiB sequential READ(16), queue depth "
+            "1\n"
+            "A queue depth of N is N threads each with its own file "
+            "descriptor and one\ncommand in flight. See 'make bench' in "
+            "the testing directory.\n");
+}
+
+/* Returns the name of the char device driver with major number 'maj' found
+ * in /proc/devices, or NULL */
+static const char *
+char_major_name(unsigned int maj, char * b, int blen)
+{
+    bool in_char = false;
+    unsigned int m;
+    char line[128];
+    char nm[64];
+    FILE * fp = fopen("/proc/devices", "r");
+
+    if (NULL == fp)
+        return NULL;
+    while (fgets(line, sizeof(line), fp)) {
+        if (0 == strncmp(line, "Character", 9))
+            in_char = true;
+        else if (0 == strncmp(line, "Block", 5))
+            in_char = false;
+        else if (in_char && (2 == sscanf(line, "%u %63s", &m, nm)) &&
+                 (m == maj)) {
+            snprintf(b, blen, "%s", nm);
+            fclose(fp);
+            return b;
+        }
+    }
+    fclose(fp);
+    return NULL;
+}
+
+/* Sets the interface name that the library will use for dp->name. The sg
+ * v3 and v4 interfaces are chosen by the sg driver version (unless the
+ * library was built with IGNORE_LINUX_SGV4). */
+static void
+classify_dev(int fd, struct dev_t * dp)
+{
+    const char * cp;
+    struct stat a_st;
+    char b[64];
+
+    dp->iface = "unknown";
+    dp->sg_version = 0;
+    if (fstat(fd, &a_st) < 0)
+        return;
+    if (S_ISBLK(a_st.st_mode)) {
+        cp = strrchr(dp->name, '/');
+        cp = cp ? cp + 1 : dp->name;
+        dp->iface = (0 == strncmp(cp, "nvme", 4)) ? "nvme" : "block_sg_v3";
+        return;
+    }
+    if (! S_ISCHR(a_st.st_mode))
+        return;
+    cp = char_major_name(major(a_st.st_rdev), b, sizeof(b));
+    if (NULL == cp)
+        return;
+    if (0 == strcmp(cp, "sg")) {
+        if (ioctl(fd, SG_GET_VERSION_NUM, &dp->sg_version) < 0)
+            dp->sg_version = 0;
+#ifdef IGNORE_LINUX_SGV4
+        dp->iface = "sg_v3";
+#else
+        dp->iface = (dp->sg_version >= SG_V4_VERSION_NUM) ? "sg_v4" :
+                                                            "sg_v3";
+#endif
+    } else if (0 == strcmp(cp, "bsg"))
+        dp->iface = "bsg";
+    else if (0 == strcmp(cp, "nvme-generic"))
+        dp->iface = "nvme_generic";
+    else if (0 == strncmp(cp, "nvme", 4))
+        dp->iface = "nvme";
+}
+
+/* Finds the block size and number of blocks of dp->name with READ
+ * CAPACITY(16). Returns 0 on success. */
+static int
+probe_dev(struct dev_t * dp, int verbose)
+{
+    int fd, res;
+    uint8_t rc_buff[32];
+
+    fd = sg_cmds_open_device(dp->name, true /* ro */, verbose);
+    if (fd < 0) {
+        pr2serr("%s: error opening %s: %s\n", __func__, dp->name,
+                safe_strerror(-fd));
+        return sg_convert_errno(-fd);
+    }
+    classify_dev(fd, dp);
+    memset(rc_buff, 0, sizeof(rc_buff));
+    res = sg_ll_readcap_16(fd, false, 0, rc_buff, sizeof(rc_buff), true,
+                           verbose);
+    sg_cmds_close_device(fd);
+    if (res) {
+        char b[80];
+
+        sg_get_category_sense_str(res, sizeof(b), b, verbose);
+        pr2serr("%s: READ CAPACITY(16): %s\n", dp->name, b);
+        return res;
+    }
+    dp->num_blocks = sg_get_unaligned_be64(rc_buff + 0) + 1;
+    dp->block_size = sg_get_unaligned_be32(rc_buff + 8);
+    if ((0 == dp->block_size) || (dp->block_size > 4096) ||
+        (4096 % dp->block_size)) {
+        pr2serr("%s: unsupported block size %u\n", dp->name,
+                dp->block_size);
+        return SG_LIB_CAT_OTHER;
+    }
+    return 0;
+}
+
+static uint64_t
+xorshift64(uint64_t * statep)
+{
+    uint64_t x = *statep;
+
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *statep = x;
+    return x;
+}
+
+/* Each worker has its own file descriptor and pass-through object which is
+ * re-used for every command, as a performance sensitive application would.
+ * The library's latency histograms (sg_pt_lat_*) do the timing. */
+static void *
+bench_worker(void * v_wp)
+{
+    struct worker_t * wp = (struct worker_t *)v_wp;
+    const struct scenario_t * scp = wp->scp;
+    const struct dev_t * dp = wp->dp;
+    int vb = wp->op->verbose;
+    int fd, res, cdb_len;
+    uint32_t nblks = scp->xfer_bytes / dp->block_size;
+    uint64_t k, lba, span, rnd;
+    uint64_t max_cmds = wp->op->count;
+    uint8_t * buff = NULL;
+    uint8_t * free_buff = NULL;
+    struct sg_pt_base * ptvp = NULL;
+    uint8_t cdb[16];
+    uint8_t sense_b[32];
+
+    fd = scsi_pt_open_device(dp->name, true /* ro */, vb);
+    if (fd < 0) {
+        pr2serr("%s: thread %d: open %s: %s\n", __func__, wp->id, dp->name,
+                safe_strerror(-fd));
+        wp->res = sg_convert_errno(-fd);
+        return NULL;
+    }
+    ptvp = construct_scsi_pt_obj_with_fd(fd, vb);
+    if (NULL == ptvp) {
+        pr2serr("%s: out of memory\n", __func__);
+        wp->res = sg_convert_errno(ENOMEM);
+        goto fini;
+    }
+    if (scp->xfer_bytes > 0) {
+        buff = sg_memalign(scp->xfer_bytes, 0 /* page */, &free_buff, false);
+        if (NULL == buff) {
+            pr2serr("%s: unable to allocate %u bytes\n", __func__,
+                    scp->xfer_bytes);
+            wp->res = sg_convert_errno(ENOMEM);
+            goto fini;
+        }
+    }
+    span = (nblks > 0) ? (dp->num_blocks / nblks) : 0;
+    if ((scp->xfer_bytes > 0) && (0 == span)) {
+        pr2serr("%s: %s is smaller than %u bytes\n", __func__, dp->name,
+                scp->xfer_bytes);
+        wp->res = SG_LIB_CAT_OTHER;
+        goto fini;
+    }
+    rnd = 0x9e3779b97f4a7c15ULL * (uint64_t)(wp->id + 1);
+    memset(cdb, 0, sizeof(cdb));
+    cdb[0] = scp->opcode;
+    if (READ16_OPC == scp->opcode) {
+        cdb_len = 16;
+        sg_put_unaligned_be32(nblks, cdb + 10);
+    } else
+        cdb_len = 6;
+
+    for (k = 0; max_cmds ? (k < max_cmds) :
+                           (sg_get_mono_ns() < wp->deadline_ns); ++k) {
+        if (READ16_OPC == scp->opcode) {
+            if (scp->is_random)
+                lba = (xorshift64(&rnd) % span) * nblks;
+            else {
+                lba = wp->next_lba;
+                wp->next_lba = (lba + (2 * nblks) > dp->num_blocks) ? 0 :
+                                                            lba + nblks;
+            }
+            sg_put_unaligned_be64(lba, cdb + 2);
+        }
+        partial_clear_scsi_pt_obj(ptvp);
+        set_scsi_pt_cdb(ptvp, cdb, cdb_len);
+        set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
+        if (buff)
+            set_scsi_pt_data_in(ptvp, buff, scp->xfer_bytes);
+        res = do_scsi_pt(ptvp, -1, BENCH_CMD_TMO, vb);
+        if (res || (SCSI_PT_RESULT_GOOD !=
+                    get_scsi_pt_result_category(ptvp))) {
+            ++wp->num_errs;
+            if (vb)
+                pr2serr("%s: thread %d: command %" PRIu64 " failed\n",
+                        __func__, wp->id, k);
+            if (res < 0) {      /* os error: give up */
+                wp->res = sg_convert_errno(-res);
+                break;
+            }
+        } else
+            ++wp->num_done;
+    }
+fini:
+    if (free_buff)
+        free(free_buff);
+    if (ptvp)
+        destruct_scsi_pt_obj(ptvp);
+    scsi_pt_close_device(fd);
+    return NULL;
+}
+
+/* Merges the histograms in arr (of num elements) for opcode into *hp */
+static void
+lat_merge(struct sg_pt_lat_hist * hp, const struct sg_pt_lat_hist * arr,
+          int num, uint8_t opcode)
+{
+    int k, j;
+    const struct sg_pt_lat_hist * ap;
+
+    memset(hp, 0, sizeof(*hp));
+    hp->opcode = opcode;
+    for (k = 0; k < num; ++k) {
+        ap = arr + k;
+        if ((ap->opcode != opcode) || (SG_PT_LAT_SCSI != ap->cmd_set) ||
+            (0 == ap->count))
+            continue;
+        if ((0 == hp->count) || (ap->min_ns < hp->min_ns))
+            hp->min_ns = ap->min_ns;
+        if (ap->max_ns > hp->max_ns)
+            hp->max_ns = ap->max_ns;
+        hp->count += ap->count;
+        hp->sum_ns += ap->sum_ns;
+        hp->dev_id = ap->dev_id;
+        for (j = 0; j < SG_PT_LAT_NUM_BUCKETS; ++j)
+            hp->bucket[j] += ap->bucket[j];
+    }
+}
+
+static int
+run_scenario(struct opts_t * op, const struct dev_t * dp,
+             const struct scenario_t * scp, sgj_opaque_p jap)
+{
+    int k, n, err;
+    int ret = 0;
+    uint64_t start_ns, elapsed_ns, num_done, num_errs;
+    double secs, cps, bps;
+    sgj_state * jsp = &op->json_st;
+    sgj_opaque_p jo2p;
+    struct sg_pt_lat_hist * hp;
+    struct sg_pt_lat_hist lh;
+    struct sg_pt_lat_hist lat_arr[BENCH_LAT_MAX];
+    struct worker_t w_arr[BENCH_MAX_QD];
+    pthread_t tid_arr[BENCH_MAX_QD];
+
+    memset(w_arr, 0, sizeof(w_arr));
+    sg_pt_lat_snapshot(NULL, 0, true);  /* reset counters */
+    start_ns = sg_get_mono_ns();
+    for (k = 0; k < scp->qd; ++k) {
+        w_arr[k].op = op;
+        w_arr[k].dp = dp;
+        w_arr[k].scp = scp;
+        w_arr[k].id = k;
+        w_arr[k].deadline_ns = start_ns + ((uint64_t)op->secs * 1000000000);
+        err = pthread_create(tid_arr + k, NULL, bench_worker, w_arr + k);
+        if (err) {
+            pr2serr("%s: pthread_create: %s\n", __func__,
+                    safe_strerror(err));
+            ret = sg_convert_errno(err);
+            break;
+        }
+    }
+    n = k;
+    for (k = 0; k < n; ++k)
+        pthread_join(tid_arr[k], NULL);
+    elapsed_ns = sg_get_mono_ns() - start_ns;
+    num_done = 0;
+    num_errs = 0;
+    for (k = 0; k < n; ++k) {
+        num_done += w_arr[k].num_done;
+        num_errs += w_arr[k].num_errs;
+        if (w_arr[k].res && (0 == ret))
+            ret = w_arr[k].res;
+    }
+    n = sg_pt_lat_snapshot(lat_arr, BENCH_LAT_MAX, false);
+    hp = &lh;
+    lat_merge(hp, lat_arr, n, scp->opcode);
+
+    secs = (double)elapsed_ns / 1000000000.0;
+    cps = (secs > 0.0) ? ((double)num_done / secs) : 0.0;
+    bps = cps * scp->xfer_bytes;
+    sgj_pr_hr(jsp, "  %-17s qd=%-2d %10.0f cmds/sec", scp->name, scp->qd,
+              cps);
+    if (scp->xfer_bytes > 0)
+        sgj_pr_hr(jsp, " %9.1f MB/sec", bps / 1000000.0);
+    sgj_pr_hr(jsp, "  p50/p99/p99.9: %.1f/%.1f/%.1f us",
+              sg_pt_lat_percentile(hp, 50.0) / 1000.0,
+              sg_pt_lat_percentile(hp, 99.0) / 1000.0,
+              sg_pt_lat_percentile(hp, 99.9) / 1000.0);
+    if (num_errs)
+        sgj_pr_hr(jsp, "  errors=%" PRIu64, num_errs);
+    sgj_pr_hr(jsp, "\n");
+    if (jsp->pr_as_json) {
+        jo2p = sgj_new_unattached_object_r(jsp);
+        sgj_js_nv_s(jsp, jo2p, "scenario", scp->name);
+        sgj_js_nv_ihex(jsp, jo2p, "opcode", scp->opcode);
+        sgj_js_nv_i(jsp, jo2p, "queue_depth", scp->qd);
+        sgj_js_nv_i(jsp, jo2p, "transfer_length", scp->xfer_bytes);
+        sgj_js_nv_i(jsp, jo2p, "elapsed_ns", elapsed_ns);
+        sgj_js_nv_i(jsp, jo2p, "command_count", num_done);
+        sgj_js_nv_i(jsp, jo2p, "error_count", num_errs);
+        sgj_js_nv_i(jsp, jo2p, "commands_per_sec", (int64_t)cps);
+        sgj_js_nv_i(jsp, jo2p, "bytes_per_sec", (int64_t)bps);
+        sgj_js_nv_i(jsp, jo2p, "latency_min_ns", hp->min_ns);
+        sgj_js_nv_i(jsp, jo2p, "latency_avg_ns", hp->count ?
+                    hp->sum_ns / hp->count : 0);
+        sgj_js_nv_i(jsp, jo2p, "latency_max_ns", hp->max_ns);
+        sgj_js_nv_i(jsp, jo2p, "latency_p50_ns",
+                    sg_pt_lat_percentile(hp, 50.0));
+        sgj_js_nv_i(jsp, jo2p, "latency_p90_ns",
+                    sg_pt_lat_percentile(hp, 90.0));
+        sgj_js_nv_i(jsp, jo2p, "latency_p99_ns",
+                    sg_pt_lat_percentile(hp, 99.0));
+        sgj_js_nv_i(jsp, jo2p, "latency_p99_9_ns",
+                    sg_pt_lat_percentile(hp, 99.9));
+        if (op->verbose)
+            sgj_js_pt_lat(jsp, jo2p, hp, 1);
+        sgj_js_nv_i(jsp, jo2p, "exit_status", ret);
+        sgj_js_nv_o(jsp, jap, NULL /* name */, jo2p);
+    }
+    return ret;
+}
+
+static int
+bench_dev(struct opts_t * op, struct dev_t * dp, sgj_opaque_p jap)
+{
+    int res;
+    int ret = 0;
+    const struct scenario_t * scp;
+    sgj_state * jsp = &op->json_st;
+    sgj_opaque_p jo2p = NULL;
+    sgj_opaque_p ja2p = NULL;
+
+    res = probe_dev(dp, op->verbose);
+    sgj_pr_hr(jsp, "%s: interface %s", dp->name, dp->iface ? dp->iface :
+              "unknown");
+    if (dp->sg_version)
+        sgj_pr_hr(jsp, " (sg driver %d.%d.%d)", dp->sg_version / 10000,
+                  (dp->sg_version / 100) % 100, dp->sg_version % 100);
+    if (0 == res)
+        sgj_pr_hr(jsp, ", %" PRIu64 " blocks of %u bytes", dp->num_blocks,
+                  dp->block_size);
+    sgj_pr_hr(jsp, "\n");
+    if (jsp->pr_as_json) {
+        jo2p = sgj_new_unattached_object_r(jsp);
+        sgj_js_nv_s(jsp, jo2p, "device_name", dp->name);
+        sgj_js_nv_s(jsp, jo2p, "interface", dp->iface ? dp->iface :
+                    "unknown");
+        if (dp->sg_version)
+            sgj_js_nv_i(jsp, jo2p, "sg_driver_version", dp->sg_version);
+        sgj_js_nv_i(jsp, jo2p, "logical_block_length", dp->block_size);
+        sgj_js_nv_i(jsp, jo2p, "number_of_logical_blocks", dp->num_blocks);
+        ja2p = sgj_named_subarray_r(jsp, jo2p, "scenario_list");
+    }
+    if (res)
+        ret = res;
+    else {
+        for (scp = scenario_arr; scp->name; ++scp) {
+            if (op->scenario && strcmp(op->scenario, scp->name))
+                continue;
+            res = run_scenario(op, dp, scp, ja2p);
+            if (res && (0 == ret))
+                ret = res;
+        }
+    }
+    if (jsp->pr_as_json) {
+        sgj_js_nv_i(jsp, jo2p, "exit_status", ret);
+        sgj_js_nv_o(jsp, jap, NULL /* name */, jo2p);
+    }
+    return ret;
+}
+
+
+int
+main(int argc, char * argv[])
+{
+    bool found;
+    int c, k, res;
+    int ret = 0;
+    const struct scenario_t * scp;
+    struct opts_t opts;
+    struct opts_t * op = &opts;
+    sgj_state * jsp = &op->json_st;
+    sgj_opaque_p jop = NULL;
+    sgj_opaque_p jo2p;
+    sgj_opaque_p jap = NULL;
+    struct utsname uts;
+    struct dev_t dev_arr[BENCH_MAX_DEVS];
+
+    memset(op, 0, sizeof(*op));
+    memset(dev_arr, 0, sizeof(dev_arr));
+    op->secs = BENCH_DEF_SECS;
+    while (1) {
+        int option_index = 0;
+
+        c = getopt_long(argc, argv, "c:hj::s:t:vV", long_options,
+                        &option_index);
+        if (c == -1)
+            break;
+
+        switch (c) {
+        case 'c':
+            op->count = sg_get_num(optarg);
+            if (op->count < 0) {
+                pr2serr("bad argument to '--count='\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case 'h':
+        case '?':
+            usage();
+            return 0;
+        case 'j':
+            op->do_json = true;
+            op->json_arg = optarg;
+            break;
+        case 's':
+            op->scenario = optarg;
+            break;
+        case 't':
+            op->secs = sg_get_num(optarg);
+            if (op->secs < 1) {
+                pr2serr("bad argument to '--time=', expect 1 or more\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case 'v':
+            ++op->verbose;
+            break;
+        case 'V':
+            pr2serr(MY_NAME " version: %s\n", version_str);
+            return 0;
+        default:
+            pr2serr("unrecognised option code 0x%x ??\n", c);
+            usage();
+            return SG_LIB_SYNTAX_ERROR;
+        }
+    }
+    for ( ; optind < argc; ++optind) {
+        if (op->num_devs >= BENCH_MAX_DEVS) {
+            pr2serr("too many DEVICEs, maximum is %d\n", BENCH_MAX_DEVS);
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        op->dev_arr[op->num_devs++] = argv[optind];
+    }
+    if (0 == op->num_devs) {
+        pr2serr("need at least one DEVICE\n\n");
+        usage();
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if (op->scenario) {
+        found = false;
+        for (scp = scenario_arr; scp->name; ++scp) {
+            if (0 == strcmp(op->scenario, scp->name)) {
+                found = true;
+                break;
+            }
+        }
+        if (! found) {
+            pr2serr("unknown scenario: %s, see --help\n", op->scenario);
+            return SG_LIB_SYNTAX_ERROR;
+        }
+    }
+    if (op->do_json) {
+        if (! sgj_init_state(jsp, op->json_arg)) {
+            int bad_char = jsp->first_bad_char;
+            char e[1500];
+
+            if (bad_char)
+                pr2serr("bad argument to --json= option, unrecognized "
+                        "character '%c'\n\n", bad_char);
+            sg_json_usage(0, e, sizeof(e));
+            pr2serr("%s", e);
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        jop = sgj_start_r(MY_NAME, version_str, argc, argv, jsp);
+    }
+    if (! sg_pt_lat_enable(true)) {
+        pr2serr("this build of the library does not support latency "
+                "histograms\n");
+        ret = SG_LIB_CAT_OTHER;
+        goto fini;
+    }
+    if (jsp->pr_as_json) {
+        jo2p = sgj_named_subobject_r(jsp, jop, "benchmark");
+        sgj_js_nv_s(jsp, jo2p, "library_version", sg_lib_version());
+        if (0 == uname(&uts)) {
+            sgj_js_nv_s(jsp, jo2p, "kernel_release", uts.release);
+            sgj_js_nv_s(jsp, jo2p, "machine", uts.machine);
+        }
+        sgj_js_nv_i(jsp, jo2p, "seconds_per_scenario",
+                    op->count ? 0 : op->secs);
+        sgj_js_nv_i(jsp, jo2p, "commands_per_thread", op->count);
+        jap = sgj_named_subarray_r(jsp, jo2p, "device_list");
+    }
+    for (k = 0; k < op->num_devs; ++k) {
+        dev_arr[k].name = op->dev_arr[k];
+        res = bench_dev(op, dev_arr + k, jap);
+        if (res && (0 == ret))
+            ret = res;
+    }
+fini:
+    if (jsp->pr_as_json) {
+        sgj_js2file(jsp, NULL, ret, stdout);
+        sgj_finish(jsp);
+    }
+    return (ret >= 0) ? ret : SG_LIB_CAT_OTHER;
+}
@@ -2,7 +2,7 @@
  * A utility program for copying files. Specialised for "files" that
  * represent devices that understand the SCSI command set.
  *
- * Copyright (C) 2018-2023 D. Gilbert
+ * Copyright (C) 2018-2026 D. Gilbert
  * This program is free software; you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
  * the Free Software Foundation; either version 2, or (at your option)
@@ -30,7 +30,7 @@
  *
  */
 
-static const char * version_str = "1.45 20230415";
+static const char * version_str = "1.51 20261015";
 
 #define _XOPEN_SOURCE 600
 #ifndef _GNU_SOURCE
@@ -70,6 +70,7 @@ static const char * version_str = "1.45 20230415";
 #include <random>
 #include <thread>       // needed for std::this_thread::yield()
 #include <mutex>
+#include <memory>       // for unique_ptr holding partitions (part=1)
 #include <condition_variable>   // for infant_cv: copy/verify first segment
                                 // single threaded
 #include <chrono>
@@ -111,6 +112,8 @@ static const char * version_str = "1.45 20230415";
 #include "sg_io_linux.h"
 #include "sg_unaligned.h"
 #include "sg_pr2serr.h"
+#include "sg_dd_eng.h"
+#include "sg_err_stats.h"
 
 
 using namespace std;
@@ -176,9 +179,6 @@ using namespace std;
 
 #define EBUFF_SZ 768
 
-#define PROC_SCSI_SG_VERSION "/proc/scsi/sg/version"
-#define SYS_SCSI_SG_VERSION "/sys/module/sg/version"
-
 
 struct flags_t {
     bool append;
@@ -212,10 +212,26 @@ struct flags_t {
 typedef pair<int64_t, int> get_next_res_t;      /* LBA, num */
 typedef array<uint8_t, MAX_SCSI_CDB_SZ> cdb_arr_t;
 
+/* With part=1 each worker thread of a IFILE,OFILE pair owns one of these:
+ * a contiguous range [next, end) of count positions, hence a contiguous
+ * part of the skip= and seek= scatter gather lists. The owner takes
+ * segments from the front. A thread whose partition is empty takes the
+ * back half of the partition with most left (i.e. work stealing) and
+ * makes it its own. next and end are only changed while mtx is held; they
+ * are atomic so other threads can pick a victim without locking. */
+struct cp_part_t {
+    mutex mtx;
+    atomic<int64_t> next {};
+    atomic<int64_t> end {};
+    int64_t num_stolen = 0;     /* blocks taken from others, under mtx */
+};
+
 struct cp_ver_pair_t {
     cp_ver_pair_t() {}
 
     get_next_res_t get_next(int desired_num_blks);
+    get_next_res_t get_next_part(int part_idx, int desired_num_blks);
+    bool make_parts(int n);
 
     enum class my_state {empty,
                          init,
@@ -236,6 +252,9 @@ struct cp_ver_pair_t {
     atomic<int> in_partial {};
     atomic<int> out_partial {};
     atomic<int> sum_of_resids {};
+
+    int num_parts = 0;          /* 0 unless part=1 */
+    unique_ptr<cp_part_t[]> part_arr;
 };
 
 typedef array<cp_ver_pair_t, MAX_SLICES> cp_ver_arr_t;
@@ -266,6 +285,7 @@ struct global_collection        /* one instance visible to all threads */
     int cdbsz_in;
     int help;
     struct flags_t in_flags;
+    struct sg_dde_cdb_tmpl rd_tmpl;   /* READ cdb, LBA and length patched */
     atomic<int> in_partial;           /*  | */
     off_t in_st_size;                 /* Only for FT_OTHER (regular) file */
     int mrq_num;                      /* if user gives 0, set this to 1 */
@@ -273,6 +293,7 @@ struct global_collection        /* one instance visible to all threads */
     int out_type;
     int cdbsz_out;
     struct flags_t out_flags;
+    struct sg_dde_cdb_tmpl wr_tmpl;   /* WRITE cdb, LBA and length patched */
     atomic<int> out_partial;          /*  | */
     off_t out_st_size;                /* Only for FT_OTHER (regular) file */
     condition_variable infant_cv;     /* after thread:0 does first segment */
@@ -281,6 +302,7 @@ struct global_collection        /* one instance visible to all threads */
     int bpt;
     int cmd_timeout;            /* in milliseconds */
     int elem_sz;
+    int num_slices;             /* number of IFILE,OFILE pairs */
     int outregfd;
     int outreg_type;
     off_t outreg_st_size;
@@ -301,6 +323,7 @@ struct global_collection        /* one instance visible to all threads */
     bool flexible;
     bool mrq_polled;
     bool ofile_given;
+    bool partition;             /* part=1: per thread partitions, stealing */
     bool unit_nanosec;          /* default duration unit is millisecond */
     bool verify;                /* don't copy, verify like Unix: cmp */
     bool prefetch;              /* for verify: do PF(b),RD(a),V(b)_a_data */
@@ -353,6 +376,7 @@ typedef struct request_element
     int out_local_partial;
     int in_resid_bytes;
     long seed;
+    struct sg_err_stats * esp;  /* this worker thread's */
 #ifdef HAVE_SRAND48_R   /* gcc extension. N.B. non-reentrant version slower */
     struct drand48_data drand;/* opaque, used by srand48_r and mrand48_r */
 #endif
@@ -386,10 +410,8 @@ private:
     default_random_engine dre;
 };
 
-static atomic<int> num_ebusy(0);
-static atomic<int> num_start_eagain(0);
-static atomic<int> num_fin_eagain(0);
-static atomic<int> num_miscompare(0);
+/* indexed by worker thread, merged for reports */
+static struct sg_err_stats err_stats_a[MAX_NUM_THREADS];
 static atomic<int> num_fallthru_sigusr2(0);
 static atomic<bool> vb_first_time(true);
 
@@ -415,7 +437,6 @@ static int do_normal_normal_segment(Rq_elem * rep, scat_gath_iter & i_sg_it,
 
 static mutex strerr_mut;
 
-static bool have_sg_version = false;
 static int sg_version = 0;
 static bool sg_version_ge_40045 = false;
 static atomic<bool> shutting_down{false};
@@ -443,15 +464,22 @@ static int pr2serr_lk(const char * fmt, ...);
 #endif
 
 
+/* When the async logger is active each thread has its own buffer, so no
+ * lock is needed (see sg_log_start() in sg_pr2serr.h) */
 static int
 pr2serr_lk(const char * fmt, ...)
 {
     int n;
     va_list args;
-    lock_guard<mutex> lk(strerr_mut);
 
     va_start(args, fmt);
-    n = vfprintf(stderr, fmt, args);
+    if (sg_log_active())
+        n = sg_log_vpr(fmt, args);
+    else {
+        lock_guard<mutex> lk(strerr_mut);
+
+        n = vfprintf(stderr, fmt, args);
+    }
     va_end(args);
     return n;
 }
@@ -555,6 +583,10 @@ page2:
             "ibs or bs\n"
             "    ofreg       OFREG is regular file or pipe to send what is "
             "read from\n"
+            "    part        0->threads share progress (def), 1->each "
+            "thread has own\n"
+            "                part of the copy, stealing from others when "
+            "done\n"
             "    polled      similar to mrq=NRQS operand but also sets "
             "polled flag\n"
             "                IFILE in the first half of each shared element\n"
@@ -950,37 +982,6 @@ v4hdr_out_lk(const char * leadin, const sg_io_v4 * h4p, int id, bool chk_info)
         pr2serr("  >>>> info: %s\n", sg_info_str(h4p->info, sizeof(b), b));
 }
 
-static void
-fetch_sg_version(void)
-{
-    FILE * fp;
-    char b[96];
-
-    have_sg_version = false;
-    sg_version = 0;
-    fp = fopen(PROC_SCSI_SG_VERSION, "r");
-    if (fp && fgets(b, sizeof(b) - 1, fp)) {
-        if (1 == sscanf(b, "%d", &sg_version))
-            have_sg_version = !!sg_version;
-    } else {
-        int j, k, l;
-
-        if (fp)
-            fclose(fp);
-        fp = fopen(SYS_SCSI_SG_VERSION, "r");
-        if (fp && fgets(b, sizeof(b) - 1, fp)) {
-            if (3 == sscanf(b, "%d.%d.%d", &j, &k, &l)) {
-                sg_version = (j * 10000) + (k * 100) + l;
-                have_sg_version = !!sg_version;
-            }
-        }
-        if (NULL == fp)
-                pr2serr("The sg driver may not be loaded\n");
-    }
-    if (fp)
-        fclose(fp);
-}
-
 static void
 calc_duration_throughput(int contin)
 {
@@ -1013,6 +1014,31 @@ calc_duration_throughput(int contin)
         pr2serr("\n");
 }
 
+/* Merges the error statistics of the worker threads then outputs them to
+ * stderr, each line starting with str */
+static void
+print_err_stats(const char * str)
+{
+    struct sg_err_stats es;
+
+    memset(&es, 0, sizeof(es));
+    for (int k = 0; k < num_threads; ++k)
+        sg_err_stats_merge(&es, err_stats_a + k);
+    sg_err_stats_pr(&es, str);
+}
+
+/* Counts the outcome of a completed sg v4 request */
+static void
+v4_err_stats(Rq_elem * rep, const struct sg_io_v4 * h4p)
+{
+    sg_err_stats_cat(rep->esp,
+                     sg_err_category_new(h4p->device_status,
+                                         h4p->transport_status,
+                                         h4p->driver_status,
+                                         (const uint8_t *)h4p->response,
+                                         h4p->response_len));
+}
+
 static void
 print_stats(const char * str)
 {
@@ -1074,6 +1100,7 @@ siginfo_handler(int sig)
     if (do_time > 0)
         calc_duration_throughput(1);
     print_stats("  ");
+    print_err_stats("  ");
 }
 
 /* Usually this signal (SIGUSR2) will be caught by the timed wait in the
@@ -1394,73 +1421,101 @@ cp_ver_pair_t::get_next(int desired_num_blks)
     return make_pair(expected, desired - expected);
 }
 
-/* Return of 0 -> success, see sg_ll_read_capacity*() otherwise */
-static int
-scsi_read_capacity(int sg_fd, int64_t * num_sect, int * sect_sz)
+/* Splits [0..dd_count) into n partitions of about the same size, one for
+ * each thread working on this IFILE,OFILE pair. Returns false if out of
+ * memory. */
+bool
+cp_ver_pair_t::make_parts(int n)
 {
-    int res;
-    uint8_t rcBuff[RCAP16_REPLY_LEN] = {};
-
-    res = sg_ll_readcap_10(sg_fd, 0, 0, rcBuff, READ_CAP_REPLY_LEN, false, 0);
-    if (0 != res)
-        goto bad;
+    part_arr.reset(new (nothrow) cp_part_t[n]);
+    if (! part_arr) {
+        num_parts = 0;
+        return false;
+    }
+    num_parts = n;
+    for (int k = 0; k < n; ++k) {
+        part_arr[k].next = (dd_count * k) / n;
+        part_arr[k].end = (dd_count * (k + 1)) / n;
+    }
+    return true;
+}
 
-    if ((0xff == rcBuff[0]) && (0xff == rcBuff[1]) && (0xff == rcBuff[2]) &&
-        (0xff == rcBuff[3])) {
+/* Like get_next() but takes segments from partition part_idx and, when it
+ * is empty, steals from the partition with the most blocks left. The only
+ * locks taken are that of part_idx (which its owner has nearly always to
+ * itself) and, when stealing, that of the victim; never both at once. */
+get_next_res_t
+cp_ver_pair_t::get_next_part(int part_idx, int desired_num_blks)
+{
+    int k, victim;
+    int64_t pos, n, rem, most, lo, hi;
+    cp_part_t & own = part_arr[part_idx];
+
+    if (desired_num_blks <= 0)
+        return get_next(desired_num_blks);
+    while (true) {
+        pos = next_count_pos.load();
+        if (pos < 0)    /* error in another thread or flag_all_stop() */
+            return make_pair(0, (int)pos);
+        {
+            lock_guard<mutex> lk(own.mtx);
+
+            pos = own.next.load();
+            n = own.end.load() - pos;
+            if (n > 0) {
+                if (n > desired_num_blks)
+                    n = desired_num_blks;
+                own.next = pos + n;
+                return make_pair(pos, (int)n);
+            }
+        }
+        victim = -1;
+        most = 0;
+        for (k = 0; k < num_parts; ++k) {
+            if (k == part_idx)
+                continue;
+            rem = part_arr[k].end.load() - part_arr[k].next.load();
+            if (rem > most) {
+                most = rem;
+                victim = k;
+            }
+        }
+        if (victim < 0)
+            return make_pair(dd_count, 0);      /* clean finish */
+        {
+            cp_part_t & vp = part_arr[victim];
+            lock_guard<mutex> lk(vp.mtx);
+
+            lo = vp.next.load();
+            hi = vp.end.load();
+            rem = hi - lo;
+            if (rem <= 0)
+                continue;       /* lost a race, look again */
+            if (rem > desired_num_blks)
+                lo = hi - (rem / 2);    /* leave the front half */
+            vp.end = lo;
+        }
+        {
+            lock_guard<mutex> lk(own.mtx);
 
-        res = sg_ll_readcap_16(sg_fd, 0, 0, rcBuff, RCAP16_REPLY_LEN, false,
-                               0);
-        if (0 != res)
-            goto bad;
-        *num_sect = sg_get_unaligned_be64(rcBuff + 0) + 1;
-        *sect_sz = sg_get_unaligned_be32(rcBuff + 8);
-    } else {
-        /* take care not to sign extend values > 0x7fffffff */
-        *num_sect = (int64_t)sg_get_unaligned_be32(rcBuff + 0) + 1;
-        *sect_sz = sg_get_unaligned_be32(rcBuff + 4);
+            own.next = lo;
+            own.end = hi;
+            own.num_stolen += hi - lo;
+        }
     }
-    return 0;
-bad:
-    *num_sect = 0;
-    *sect_sz = 0;
-    return res;
 }
 
-/* Return of 0 -> success, -1 -> failure. BLKGETSIZE64, BLKGETSIZE and */
-/* BLKSSZGET macros problematic (from <linux/fs.h> or <sys/mount.h>). */
+/* Return of 0 -> success, see sg_ll_read_capacity*() otherwise */
 static int
-read_blkdev_capacity(int sg_fd, int64_t * num_sect, int * sect_sz)
+scsi_read_capacity(int sg_fd, int64_t * num_sect, int * sect_sz)
 {
-#ifdef BLKSSZGET
-    if ((ioctl(sg_fd, BLKSSZGET, sect_sz) < 0) && (*sect_sz > 0)) {
-        perror("BLKSSZGET ioctl error");
-        return -1;
-    } else {
- #ifdef BLKGETSIZE64
-        uint64_t ull;
-
-        if (ioctl(sg_fd, BLKGETSIZE64, &ull) < 0) {
+    int res = sg_dde_read_capacity(sg_fd, num_sect, sect_sz, false, 0);
 
-            perror("BLKGETSIZE64 ioctl error");
-            return -1;
-        }
-        *num_sect = ((int64_t)ull / (int64_t)*sect_sz);
- #else
-        unsigned long ul;
-
-        if (ioctl(sg_fd, BLKGETSIZE, &ul) < 0) {
-            perror("BLKGETSIZE ioctl error");
-            return -1;
-        }
-        *num_sect = (int64_t)ul;
- #endif
+    if (res) {
+        *num_sect = 0;
+        *sect_sz = 0;
     }
-    return 0;
-#else
-    *num_sect = 0;
-    *sect_sz = 0;
-    return -1;
-#endif
+    return res;
 }
 
 static void
@@ -1589,6 +1644,8 @@ read_write_thread(struct global_collection * clp, int thr_idx, int slice_idx,
     int n, sz, fd, vb, err, seg_blks;
     int res = 0;
     int num_sg = 0;
+    /* threads of a slice are slice_idx, slice_idx + num_slices, ... */
+    int part_idx = thr_idx / clp->num_slices;
     bool own_infd = false;
     bool in_is_sg, in_mmap, out_is_sg, out_mmap;
     bool own_outfd = false;
@@ -1609,6 +1666,7 @@ read_write_thread(struct global_collection * clp, int thr_idx, int slice_idx,
     out_mmap = (out_is_sg && (clp->out_flags.mmap > 0));
     rep->clp = clp;
     rep->id = thr_idx;
+    rep->esp = err_stats_a + thr_idx;
     rep->bs = clp->bs;
 
     if (in_is_sg && out_is_sg)
@@ -1624,6 +1682,10 @@ read_write_thread(struct global_collection * clp, int thr_idx, int slice_idx,
     if (vb > 2) {
         pr2serr_lk("%d <-- Starting worker thread, slice=%d\n", thr_idx,
                    slice_idx);
+        if (cvp.num_parts > 0)
+            pr2serr_lk("   partition %d: [%" PRId64 "..%" PRId64 ")\n",
+                       part_idx, cvp.part_arr[part_idx].next.load(),
+                       cvp.part_arr[part_idx].end.load());
         if (vb > 3)
             pr2serr_lk("   %s ---> %s\n", inf.c_str(), outf.c_str());
     }
@@ -1749,7 +1811,9 @@ read_write_thread(struct global_collection * clp, int thr_idx, int slice_idx,
 
     /* vvvvvvvvvvvvvv  Main segment copy loop  vvvvvvvvvvvvvvvvvvvvvvv */
     while (! shutting_down) {
-        get_next_res_t gnr = cvp.get_next(clp->mrq_num * clp->bpt);
+        get_next_res_t gnr = (cvp.num_parts > 0) ?
+                cvp.get_next_part(part_idx, clp->mrq_num * clp->bpt) :
+                cvp.get_next(clp->mrq_num * clp->bpt);
 
         seg_blks = gnr.second;
         if (seg_blks <= 0) {
@@ -1881,6 +1945,12 @@ fini:
         }
         close(rep->outfd);
     }
+    if ((cvp.num_parts > 0) && (vb > 2)) {
+        lock_guard<mutex> lk(cvp.part_arr[part_idx].mtx);
+
+        pr2serr_lk("[%d]: stole %" PRId64 " blocks from other partitions\n",
+                   thr_idx, cvp.part_arr[part_idx].num_stolen);
+    }
     /* pass stats back to read-side */
     if (vb > 3)
         pr2serr_lk("%s: [%d] leaving: in/out local count=%" PRId64 "/%"
@@ -2162,6 +2232,25 @@ sg_build_scsi_cdb(uint8_t * cdbp, int cdb_sz, unsigned int blocks,
     return 0;
 }
 
+/* Everything in a READ or WRITE cdb other than its LBA and TRANSFER LENGTH
+ * fields is the same for every command on one side of the copy, so it is
+ * set up once here. Returns 0 or SG_LIB_SYNTAX_ERROR. */
+static int
+init_rw_tmpl(struct sg_dde_cdb_tmpl * tp, int cdb_sz, bool is_wr,
+             const struct flags_t * flagsp)
+{
+    if (sg_dde_cdb_tmpl_init(tp, cdb_sz, is_wr, flagsp->fua, flagsp->dpo,
+                             my_name))
+        return SG_LIB_SYNTAX_ERROR;
+    if ((16 == cdb_sz) && (flagsp->cdl > 0)) {
+        if (flagsp->cdl & 0x4)
+            tp->cdb[1] |= 0x1;
+        if (flagsp->cdl & 0x3)
+            tp->cdb[14] |= ((flagsp->cdl & 0x3) << 6);
+    }
+    return 0;
+}
+
 static int
 process_mrq_response(Rq_elem * rep, const struct sg_io_v4 * ctl_v4p,
                      const struct sg_io_v4 * a_v4p, int num_mrq,
@@ -2219,6 +2308,8 @@ process_mrq_response(Rq_elem * rep, const struct sg_io_v4 * ctl_v4p,
             ++hole_count;
         ok = true;
         f1 = !!(a_v4p->info);   /* want to skip n_subm count if info is 0x0 */
+        if (f1)
+            v4_err_stats(rep, a_v4p);
         if (SG_INFO_CHECK & a_v4p->info) {
             if ((0 == k) && (SGV4_FLAG_META_OUT_IF & ctl_v4p->flags) &&
                 (UINT32_MAX == a_v4p->info)) {
@@ -2254,8 +2345,6 @@ process_mrq_response(Rq_elem * rep, const struct sg_io_v4 * ctl_v4p,
                     last_err_on_in = false;
                 } else
                     cat = sg_err_category_sense(sbp, slen);
-                if (SPC_SK_MISCOMPARE == ssh.sense_key)
-                    ++num_miscompare;
 
                 pr2serr_lk("[%d] a_v4[%d]:\n", id, k);
                 if (vb)
@@ -2345,11 +2434,10 @@ sg_half_segment_mrq0(Rq_elem * rep, scat_gath_iter & sg_it, bool is_wr,
 
         /* First build the command/request for the read-side */
         cdbsz = is_wr ? clp->cdbsz_out : clp->cdbsz_in;
-        res = sg_build_scsi_cdb(t_cdb.data(), cdbsz, num, sg_it.current_lba(),
-                                false, is_wr, flagsp->fua, flagsp->dpo,
-                                flagsp->cdl);
+        res = sg_dde_cdb_tmpl_fill(is_wr ? &clp->wr_tmpl : &clp->rd_tmpl,
+                                   t_cdb.data(), num, sg_it.current_lba());
         if (res) {
-            pr2serr_lk("[%d] %s: sg_build_scsi_cdb() failed\n", id, __func__);
+            pr2serr_lk("[%d] %s: cdb build failed\n", id, __func__);
             break;
         } else if (vb > 3)
             lk_print_command_len("cdb: ", t_cdb.data(), cdbsz, true);
@@ -2383,14 +2471,17 @@ mrq0_again:
             if (E2BIG == err)
                 sg_take_snap(fd, id, true);
             else if (EBUSY == err) {
-                ++num_ebusy;
+                sg_err_stats_errno(rep->esp, EBUSY);
                 std::this_thread::yield();/* so other threads can progress */
                 goto mrq0_again;
             }
+            sg_err_stats_errno(rep->esp, err);
+            sg_err_stats_cat(rep->esp, sg_convert_errno(err));
             pr2serr_lk("[%d] %s: ioctl(SG_IO)-->%d, errno=%d: %s\n", id,
                        __func__, res, err, strerror(err));
             return -err;
         }
+        v4_err_stats(rep, t_v4p);
         if (t_v4p->device_status || t_v4p->transport_status ||
             t_v4p->driver_status) {
             rep->stop_now = true;
@@ -2467,11 +2558,10 @@ sg_half_segment(Rq_elem * rep, scat_gath_iter & sg_it, bool is_wr,
 
         /* First build the command/request for the read-side */
         cdbsz = is_wr ? clp->cdbsz_out : clp->cdbsz_in;
-        res = sg_build_scsi_cdb(t_cdb.data(), cdbsz, num, sg_it.current_lba(),
-                                false, is_wr, flagsp->fua, flagsp->dpo,
-                                flagsp->cdl);
+        res = sg_dde_cdb_tmpl_fill(is_wr ? &clp->wr_tmpl : &clp->rd_tmpl,
+                                   t_cdb.data(), num, sg_it.current_lba());
         if (res) {
-            pr2serr_lk("[%d] %s: sg_build_scsi_cdb() failed\n", id, __func__);
+            pr2serr_lk("[%d] %s: cdb build failed\n", id, __func__);
             break;
         } else if (vb > 3)
             lk_print_command_len("cdb: ", t_cdb.data(), cdbsz, true);
@@ -2567,7 +2657,7 @@ try_again:
         if (E2BIG == err)
             sg_take_snap(fd, id, true);
         else if (EBUSY == err) {
-            ++num_ebusy;
+            sg_err_stats_errno(rep->esp, EBUSY);
             std::this_thread::yield();/* allow another thread to progress */
             goto try_again;
         }
@@ -2900,11 +2990,10 @@ do_both_sg_segment_mrq0(Rq_elem * rep, scat_gath_iter & i_sg_it,
 
         /* First build the command/request for the read-side*/
         cdbsz = clp->cdbsz_in;
-        res = sg_build_scsi_cdb(t_cdb.data(), cdbsz, num,
-                                i_sg_it.current_lba(), false, false,
-                                iflagsp->fua, iflagsp->dpo, iflagsp->cdl);
+        res = sg_dde_cdb_tmpl_fill(&clp->rd_tmpl, t_cdb.data(), num,
+                                   i_sg_it.current_lba());
         if (res) {
-            pr2serr_lk("%s: t=%d: input sg_build_scsi_cdb() failed\n",
+            pr2serr_lk("%s: t=%d: input cdb build failed\n",
                        __func__, id);
             break;
         } else if (vb > 3)
@@ -2931,14 +3020,17 @@ mrq0_again:
             if (E2BIG == err)
                 sg_take_snap(rep->infd, id, true);
             else if (EBUSY == err) {
-                ++num_ebusy;
+                sg_err_stats_errno(rep->esp, EBUSY);
                 std::this_thread::yield();/* so other threads can progress */
                 goto mrq0_again;
             }
+            sg_err_stats_errno(rep->esp, err);
+            sg_err_stats_cat(rep->esp, sg_convert_errno(err));
             pr2serr_lk("[%d] %s: ioctl(SG_IO, read-side)-->%d, errno=%d: "
                        "%s\n", id, __func__, res, err, strerror(err));
             return -err;
         }
+        v4_err_stats(rep, t_v4p);
         if (t_v4p->device_status || t_v4p->transport_status ||
             t_v4p->driver_status) {
             rep->stop_now = true;
@@ -2951,11 +3043,15 @@ mrq0_again:
 
         /* Now build the command/request for write-side (WRITE or VERIFY) */
         cdbsz = clp->cdbsz_out;
-        res = sg_build_scsi_cdb(t_cdb.data(), cdbsz, num,
-                                o_sg_it.current_lba(), clp->verify, true,
-                                oflagsp->fua, oflagsp->dpo, oflagsp->cdl);
+        if (clp->verify)
+            res = sg_build_scsi_cdb(t_cdb.data(), cdbsz, num,
+                                    o_sg_it.current_lba(), true, true,
+                                    oflagsp->fua, oflagsp->dpo, oflagsp->cdl);
+        else
+            res = sg_dde_cdb_tmpl_fill(&clp->wr_tmpl, t_cdb.data(), num,
+                                       o_sg_it.current_lba());
         if (res) {
-            pr2serr_lk("%s: t=%d: output sg_build_scsi_cdb() failed\n",
+            pr2serr_lk("%s: t=%d: output cdb build failed\n",
                        __func__, id);
             break;
         } else if (vb > 3)
@@ -2982,14 +3078,17 @@ mrq0_again2:
             if (E2BIG == err)
                 sg_take_snap(rep->outfd, id, true);
             else if (EBUSY == err) {
-                ++num_ebusy;
+                sg_err_stats_errno(rep->esp, EBUSY);
                 std::this_thread::yield();/* so other threads can progress */
                 goto mrq0_again2;
             }
+            sg_err_stats_errno(rep->esp, err);
+            sg_err_stats_cat(rep->esp, sg_convert_errno(err));
             pr2serr_lk("[%d] %s: ioctl(SG_IO, write-side)-->%d, errno=%d: "
                        "%s\n", id, __func__, res, err, strerror(err));
             return -err;
         }
+        v4_err_stats(rep, t_v4p);
         if (t_v4p->device_status || t_v4p->transport_status ||
             t_v4p->driver_status) {
             rep->stop_now = true;
@@ -3084,11 +3183,10 @@ do_both_sg_segment(Rq_elem * rep, scat_gath_iter & i_sg_it,
 
         /* First build the command/request for the read-side*/
         cdbsz = clp->cdbsz_in;
-        res = sg_build_scsi_cdb(t_cdb.data(), cdbsz, num,
-                                i_sg_it.current_lba(), false, false,
-                                iflagsp->fua, iflagsp->dpo, iflagsp->cdl);
+        res = sg_dde_cdb_tmpl_fill(&clp->rd_tmpl, t_cdb.data(), num,
+                                   i_sg_it.current_lba());
         if (res) {
-            pr2serr_lk("%s: t=%d: input sg_build_scsi_cdb() failed\n",
+            pr2serr_lk("%s: t=%d: input cdb build failed\n",
                        __func__, id);
             break;
         } else if (vb > 3)
@@ -3112,11 +3210,15 @@ do_both_sg_segment(Rq_elem * rep, scat_gath_iter & i_sg_it,
 
         /* Now build the command/request for write-side (WRITE or VERIFY) */
         cdbsz = clp->cdbsz_out;
-        res = sg_build_scsi_cdb(t_cdb.data(), cdbsz, num,
-                                o_sg_it.current_lba(), clp->verify, true,
-                                oflagsp->fua, oflagsp->dpo, oflagsp->cdl);
+        if (clp->verify)
+            res = sg_build_scsi_cdb(t_cdb.data(), cdbsz, num,
+                                    o_sg_it.current_lba(), true, true,
+                                    oflagsp->fua, oflagsp->dpo, oflagsp->cdl);
+        else
+            res = sg_dde_cdb_tmpl_fill(&clp->wr_tmpl, t_cdb.data(), num,
+                                       o_sg_it.current_lba());
         if (res) {
-            pr2serr_lk("%s: t=%d: output sg_build_scsi_cdb() failed\n",
+            pr2serr_lk("%s: t=%d: output cdb build failed\n",
                        __func__, id);
             break;
         } else if (vb > 3)
@@ -3207,7 +3309,7 @@ try_again:
         if (E2BIG == err)
                 sg_take_snap(fd, id, true);
         else if (EBUSY == err) {
-            ++num_ebusy;
+            sg_err_stats_errno(rep->esp, EBUSY);
             std::this_thread::yield();/* allow another thread to progress */
             goto try_again;
         }
@@ -3741,6 +3843,14 @@ parse_cmdline_sanity(int argc, char * argv[], struct global_collection * clp,
                 pr2serr("%sbad argument to 'oflag='\n", my_name);
                 goto syn_err;
             }
+        } else if (0 == strcmp(key, "part")) {
+            n = sg_get_num(buf);
+            if ((n < 0) || (n > 1)) {
+                pr2serr("%sbad argument to 'part=', expect 0 or 1\n",
+                        my_name);
+                goto syn_err;
+            }
+            clp->partition = !! n;
         } else if (0 == strcmp(key, "sdt")) {
             ccp = strchr(buf, ',');
             n = sg_get_num(buf);
@@ -4031,8 +4141,8 @@ calc_count(struct global_collection * clp, const char * inf,
         if (FT_SG == clp->in_type)
             ;
         else if (FT_BLOCK == clp->in_type) {
-            if (0 != read_blkdev_capacity(clp->in0fd, &in_num_sect,
-                                          &in_sect_sz)) {
+            if (0 != sg_dde_blkdev_capacity(clp->in0fd, &in_num_sect,
+                                            &in_sect_sz, 0)) {
                 pr2serr("Unable to read block capacity on %s\n", inf);
                 in_num_sect = -1;
             }
@@ -4046,8 +4156,8 @@ calc_count(struct global_collection * clp, const char * inf,
         if (FT_SG == clp->out_type)
             ;
         else if (FT_BLOCK == clp->out_type) {
-            if (0 != read_blkdev_capacity(clp->out0fd, &out_num_sect,
-                                          &out_sect_sz)) {
+            if (0 != sg_dde_blkdev_capacity(clp->out0fd, &out_num_sect,
+                                            &out_sect_sz, 0)) {
                 pr2serr("Unable to read block capacity on %s\n", outf);
                 out_num_sect = -1;
             }
@@ -4237,10 +4347,12 @@ main(int argc, char * argv[])
     // inf[0] = '\0';
     // outf[0] = '\0';
     outregf[0] = '\0';
-    fetch_sg_version();
+    sg_version = sg_linux_get_caps(0)->sg_version;
     if (sg_version >= 40045)
         sg_version_ge_40045 = true;
     else {
+        if (0 == sg_version)
+            pr2serr("The sg driver may not be loaded\n");
         pr2serr(">>> %srequires an sg driver version of 4.0.45 or later\n\n",
                 my_name);
         fail_after_cli = true;
@@ -4507,6 +4619,12 @@ main(int argc, char * argv[])
             clp->cdbsz_out = MAX_SCSI_CDB_SZ;
         }
     }
+    if ((FT_SG == clp->in_type) &&
+        init_rw_tmpl(&clp->rd_tmpl, clp->cdbsz_in, false, &clp->in_flags))
+        return SG_LIB_SYNTAX_ERROR;
+    if ((FT_SG == clp->out_type) &&
+        init_rw_tmpl(&clp->wr_tmpl, clp->cdbsz_out, true, &clp->out_flags))
+        return SG_LIB_SYNTAX_ERROR;
 
     for (auto && cvp : clp->cp_ver_arr) {
         cvp.in_type = clp->in_type;
@@ -4515,6 +4633,21 @@ main(int argc, char * argv[])
         cvp.in_rem_count = clp->dd_count;
         cvp.out_rem_count = clp->dd_count;
     }
+    clp->num_slices = (int)num_slices;
+    if (clp->partition && (clp->dd_count > 0)) {
+        for (k = 0; k < (int)num_slices; ++k) {
+            /* thread j works on slice (j % num_slices) */
+            int n = (num_threads - k + (int)num_slices - 1) / (int)num_slices;
+            if (! clp->cp_ver_arr[k].make_parts(n)) {
+                pr2serr("%sout of memory for partitions\n", my_name);
+                res = sg_convert_errno(ENOMEM);
+                goto fini;
+            }
+        }
+        if (clp->verbose)
+            pr2serr("%scount split into %d partitions per slice\n", my_name,
+                    clp->cp_ver_arr[0].num_parts);
+    }
 
     if (clp->dry_run > 0) {
         pr2serr("Due to --dry-run option, bypass copy/read\n");
@@ -4546,6 +4679,9 @@ main(int argc, char * argv[])
     if (num_threads > 0) {
         auto & cvp = clp->cp_ver_arr[0];
 
+        if (num_threads > 1)
+            sg_log_start(0);
+
         cvp.in_fd = clp->in0fd;
         cvp.out_fd = clp->out0fd;
 
@@ -4576,6 +4712,7 @@ main(int argc, char * argv[])
         }
     }   /* worker threads hereafter have all exited */
 jump:
+    sg_log_stop();
     if (do_time && (start_tm.tv_sec || start_tm.tv_usec))
         calc_duration_throughput(0);
 
@@ -4647,15 +4784,7 @@ fini:
             pr2serr(">> slice: %d, Non-zero sum of residual counts=%d\n",
                     k, cvp.sum_of_resids.load());
     }
-    if (clp->verbose && (num_start_eagain > 0))
-        pr2serr("Number of start EAGAINs: %d\n", num_start_eagain.load());
-    if (clp->verbose && (num_fin_eagain > 0))
-        pr2serr("Number of finish EAGAINs: %d\n", num_fin_eagain.load());
-    if (clp->verbose && (num_ebusy > 0))
-        pr2serr("Number of EBUSYs: %d\n", num_ebusy.load());
-    if (clp->verbose && (num_miscompare > 0))
-        pr2serr("Number of miscompare%s: %d\n",
-                (num_miscompare > 1) ? "s" : "", num_miscompare.load());
+    print_err_stats(">> ");
     if (clp->verify && (SG_LIB_CAT_MISCOMPARE == res))
         pr2serr("Verify/compare failed due to miscompare\n");
     if (0 == res)
@@ -11,6 +11,8 @@
  * This program was used to test SCSI mid level queue ordering.
  * The default behaviour is to "queue at head" which is useful for
  * error processing but not for streaming READ and WRITE commands.
+ * To measure throughput and latency over a range of queue depths, at the
+ * head or tail, see 'sg_iobench --qd-sweep=QL --queue=head|tail'.
  *
  * Invocation: sg_queue_tst [-l=Q_LEN] [-t] <sg_device>
  *      -t      queue at tail
@@ -1,12 +1,12 @@
 /*
- * Copyright (c) 2014-2020 Douglas Gilbert.
+ * Copyright (c) 2014-2026 Douglas Gilbert.
  * All rights reserved.
  * Use of this source code is governed by a BSD-style
  * license that can be found in the BSD_LICENSE file.
  *
  * SPDX-License-Identifier: BSD-2-Clause
  *
- * Version 1.02 [20201124]
+ * Version 1.03 [20261014]
  */
 
 // C headers
@@ -21,9 +21,11 @@
 
 // C++ headers
 #include <array>
+#include <algorithm>
 
 #include "sg_scat_gath.h"
 #include "sg_lib.h"
+#include "sg_sgl.h"
 #include "sg_pr2serr.h"
 
 using namespace std;
@@ -354,7 +356,9 @@ err_out:
  * elements is pre-allocated; if it is exceeded sg_convert_errno(EDOM) is
  * placed in *errp (if it is non-NULL). One of the first actions is to write
  * 0 to *errp (if it is non-NULL) so the caller does not need to zero it
- * before calling. */
+ * before calling. If file_name is a binary sgl file (see sg_sgl.h) it is
+ * memory mapped and its elements copied; def_hex and flexible are then
+ * ignored and there is no limit on the number of elements. */
 bool
 scat_gath_list::load_from_file(const char * file_name, bool def_hex,
                                bool flexible, bool b_vb)
@@ -365,6 +369,25 @@ scat_gath_list::load_from_file(const char * file_name, bool def_hex,
     const char * fnp;
 
     have_stdin = ((1 == strlen(file_name)) && ('-' == file_name[0]));
+    if ((! have_stdin) && sg_sgl_is_bin_file(file_name)) {
+        int res;
+        struct sg_sgl_bin sb;
+        scat_gath_elem sge;
+
+        res = sg_sgl_bin_map(file_name, &sb, b_vb);
+        if (res) {
+            m_errno = EINVAL;
+            return false;
+        }
+        sgl.reserve(sgl.size() + sb.num_elems);
+        for (int64_t k = 0; k < sb.num_elems; ++k) {
+            sge.lba = sb.elems[k].lba;
+            sge.num = sb.elems[k].num;
+            sgl.push_back(sge);
+        }
+        sg_sgl_bin_unmap(&sb);
+        return true;
+    }
     if (have_stdin) {
         fp = stdin;
         fnp = "<stdin>";
@@ -547,10 +570,62 @@ scat_gath_list::sum_scan(const char * id_str, bool show_sgl, bool b_vb)
     } else
         high_lba_p1 = high;
     sum_hard = (elems > 0) ? ! degen : false;
+    build_index();
     if (b_vb)
         dbg_print(false, id_str, false, show_sgl);
 }
 
+void
+scat_gath_list::build_index()
+{
+    int k;
+    const int elems = sgl.size();
+    int64_t cum = 0;
+
+    blk_index.clear();
+    blk_index.reserve((elems + SG_SGL_IDX_STRIDE - 1) / SG_SGL_IDX_STRIDE);
+    for (k = 0; k < elems; ++k) {
+        if (0 == (k % SG_SGL_IDX_STRIDE))
+            blk_index.push_back(cum);
+        cum += sgl[k].num;
+    }
+}
+
+/* Since the block index is ascending, the last entry below blk is found
+ * with a binary search. That element is not past the one that a linear
+ * scan from the start of the list would stop on. */
+int
+scat_gath_list::idx_lookup(int64_t blk, int64_t & blks_before) const
+{
+    int j;
+
+    if (blk_index.empty())
+        return -1;
+    j = (int)(lower_bound(blk_index.begin(), blk_index.end(), blk) -
+              blk_index.begin()) - 1;
+    if (j < 0) {
+        blks_before = 0;
+        return 0;
+    }
+    blks_before = blk_index[j];
+    return j * SG_SGL_IDX_STRIDE;
+}
+
+int64_t
+scat_gath_list::blks_before_elem(int e_ind) const
+{
+    int k;
+    int j = e_ind / SG_SGL_IDX_STRIDE;
+    int64_t res;
+
+    if ((e_ind < 0) || (j >= (int)blk_index.size()))
+        return -1;
+    res = blk_index[j];
+    for (k = j * SG_SGL_IDX_STRIDE; k < e_ind; ++k)
+        res += sgl[k].num;
+    return res;
+}
+
 /* Usually will append (or add to start if empty) sge unless 'extra_blks'
  * exceeds MAX_SGL_NUM_VAL. In that case multiple sge_s are added with
  * sge.num = MAX_SGL_NUM_VAL or less (for final sge) until extra_blks is
@@ -602,6 +677,8 @@ scat_gath_list::append_1or(int64_t extra_blks, int64_t start_lba)
     }           /* always loops at least once */
     sum_hard = true;
     high_lba_p1 = sge.lba + sge.num;
+    if (! blk_index.empty())
+        build_index();
     return sgl.size();
 }
 
@@ -618,6 +695,209 @@ scat_gath_list::append_1or(int64_t extra_blks)
     return append_1or(extra_blks, sge.lba + sge.num);
 }
 
+/* Appends the LBA range [lba, end) to v, over several elements if it is
+ * longer than MAX_SGL_NUM_VAL blocks */
+static void
+sgl_push_range(vector<scat_gath_elem> & v, uint64_t lba, uint64_t end)
+{
+    class scat_gath_elem sge;
+
+    while (lba < end) {
+        sge.lba = lba;
+        sge.num = ((end - lba) > (uint64_t)MAX_SGL_NUM_VAL) ?
+                        (uint32_t)MAX_SGL_NUM_VAL : (uint32_t)(end - lba);
+        v.push_back(sge);
+        lba += sge.num;
+    }
+}
+
+/* Moves a last degenerate element out of sgl into last_sge and drops all
+ * other degenerate elements. Returns true if there was a last degenerate
+ * element. */
+static bool
+sgl_drop_degen(vector<scat_gath_elem> & v, class scat_gath_elem & last_sge)
+{
+    bool res = ((! v.empty()) && (0 == v.back().num));
+
+    if (res)
+        last_sge = v.back();
+    v.erase(remove_if(v.begin(), v.end(),
+                      [](const class scat_gath_elem & e)
+                      { return 0 == e.num; }), v.end());
+    return res;
+}
+
+void
+scat_gath_list::sort_by_lba()
+{
+    bool got_last;
+    class scat_gath_elem last_sge;
+
+    got_last = sgl_drop_degen(sgl, last_sge);
+    stable_sort(sgl.begin(), sgl.end(),
+                [](const class scat_gath_elem & a,
+                   const class scat_gath_elem & b) { return a.lba < b.lba; });
+    if (got_last)
+        sgl.push_back(last_sge);
+    linearity = SGL_LINEAR;     /* sum_scan() only weakens linearity */
+    sum_scan(NULL, false, false);
+}
+
+void
+scat_gath_list::merge_adjacent()
+{
+    bool got_last, have;
+    uint64_t lba, end, s_end;
+    vector<scat_gath_elem> v;
+    class scat_gath_elem last_sge;
+
+    got_last = sgl_drop_degen(sgl, last_sge);
+    v.reserve(sgl.size());
+    lba = 0;
+    end = 0;
+    have = false;
+    for (const class scat_gath_elem & sge : sgl) {
+        s_end = sge.lba + sge.num;
+        if (have && (sge.lba >= lba) && (sge.lba <= end)) {
+            if (s_end > end)
+                end = s_end;    /* touching or overlapping, so coalesce */
+            continue;
+        }
+        if (have)
+            sgl_push_range(v, lba, end);
+        lba = sge.lba;
+        end = s_end;
+        have = true;
+    }
+    if (have)
+        sgl_push_range(v, lba, end);
+    if (got_last)
+        v.push_back(last_sge);
+    sgl.swap(v);
+    linearity = SGL_LINEAR;
+    sum_scan(NULL, false, false);
+}
+
+void
+scat_gath_list::normalize()
+{
+    sort_by_lba();
+    merge_adjacent();
+}
+
+void
+scat_gath_list::split_at(uint32_t max_blks, bool align)
+{
+    uint32_t n;
+    uint64_t lba, end;
+    vector<scat_gath_elem> v;
+    class scat_gath_elem sge;
+
+    if (0 == max_blks)
+        return;
+    v.reserve(sgl.size());
+    for (const class scat_gath_elem & e : sgl) {
+        if (0 == e.num) {
+            v.push_back(e);
+            continue;
+        }
+        for (lba = e.lba, end = e.lba + e.num; lba < end; lba += n) {
+            n = max_blks;
+            if (align)
+                n = max_blks - (uint32_t)(lba % max_blks);
+            if ((end - lba) < n)
+                n = (uint32_t)(end - lba);
+            sge.lba = lba;
+            sge.num = n;
+            v.push_back(sge);
+        }
+    }
+    sgl.swap(v);
+    linearity = SGL_LINEAR;
+    sum_scan(NULL, false, false);
+}
+
+/* Sweeps over the boundaries of the (normalized) left and right lists,
+ * outputting the ranges that are in the result of op. */
+void
+sgls_set_op(const scat_gath_list & left, const scat_gath_list & right,
+            enum sgl_set_op_e op, scat_gath_list & res)
+{
+    bool in_l, in_r, want;
+    size_t i = 0;
+    size_t j = 0;
+    uint64_t pos, next;
+    scat_gath_list a(left);
+    scat_gath_list b(right);
+    class scat_gath_elem dummy;
+    vector<scat_gath_elem> v;
+
+    sgl_drop_degen(a.sgl, dummy);
+    sgl_drop_degen(b.sgl, dummy);
+    a.normalize();
+    b.normalize();
+    const size_t na = a.sgl.size();
+    const size_t nb = b.sgl.size();
+
+    if ((na > 0) && (nb > 0))
+        pos = (a.sgl[0].lba < b.sgl[0].lba) ? a.sgl[0].lba : b.sgl[0].lba;
+    else if (na > 0)
+        pos = a.sgl[0].lba;
+    else if (nb > 0)
+        pos = b.sgl[0].lba;
+    else
+        pos = 0;
+    while ((i < na) || (j < nb)) {
+        next = UINT64_MAX;
+        in_l = false;
+        in_r = false;
+        if (i < na) {
+            const class scat_gath_elem & e = a.sgl[i];
+
+            if (e.lba > pos)
+                next = e.lba;
+            else {
+                in_l = true;
+                next = e.lba + e.num;
+            }
+        }
+        if (j < nb) {
+            const class scat_gath_elem & e = b.sgl[j];
+
+            if (e.lba > pos) {
+                if (e.lba < next)
+                    next = e.lba;
+            } else {
+                in_r = true;
+                if ((e.lba + e.num) < next)
+                    next = e.lba + e.num;
+            }
+        }
+        switch (op) {
+        case SGL_UNION:
+            want = in_l || in_r;
+            break;
+        case SGL_INTERSECT:
+            want = in_l && in_r;
+            break;
+        case SGL_DIFFERENCE:
+        default:
+            want = in_l && (! in_r);
+            break;
+        }
+        if (want)
+            sgl_push_range(v, pos, next);
+        pos = next;
+        if ((i < na) && (pos >= (a.sgl[i].lba + a.sgl[i].num)))
+            ++i;
+        if ((j < nb) && (pos >= (b.sgl[j].lba + b.sgl[j].num)))
+            ++j;
+    }
+    res = scat_gath_list();
+    res.sgl.swap(v);
+    res.merge_adjacent();       /* ranges may touch at boundaries */
+}
+
 bool
 sgls_eq_off(const scat_gath_list & left, int l_e_ind, int l_blk_off,
             const scat_gath_list & right, int r_e_ind, int r_blk_off,
@@ -729,17 +1009,24 @@ scat_gath_iter::set_by_blk_idx(int64_t _blk_idx)
     const int elems = sglist.sgl.size();
     const int last_ind = elems - 1;
     int64_t bc = _blk_idx;
+    int64_t before = 0;
 
     if (bc < 0)
         return false;
 
     if (bc == blk_idx)
         return true;
-    else if (bc > blk_idx) {
+    k = sglist.idx_lookup(bc, before);
+    if ((k >= 0) && ((bc < blk_idx) || (k > it_el_ind))) {
+        bc -= before;   /* jump via block index */
+        it_blk_off = 0;
+    } else if (bc > blk_idx) {
         k = it_el_ind;
         bc -= blk_idx;
-    } else
+    } else {
         k = 0;
+        it_blk_off = 0;
+    }
     for (first = true; k < elems; ++k, first = false) {
         uint32_t num = ((k == last_ind) && extend_last) ? MAX_SGL_NUM_VAL :
                                                           sglist.sgl[k].num;
@@ -1022,6 +1309,14 @@ diff_between_iters(const class scat_gath_iter & left,
     } else if (l_e_ind == r_e_ind)
         return (int)left.it_blk_off - (int)right.it_blk_off;
     /* (l_e_ind > r_e_ind) so (lhs > rhs) */
+    if ((l_e_ind - r_e_ind) > SG_SGL_IDX_STRIDE) {
+        int64_t l_before = left.sglist.blks_before_elem(l_e_ind);
+        int64_t r_before = right.sglist.blks_before_elem(r_e_ind);
+
+        if ((l_before >= 0) && (r_before >= 0))
+            return (int)((l_before + left.it_blk_off) -
+                         (r_before + right.it_blk_off));
+    }
     res = (int)right.sglist.sgl[r_e_ind].num - right.it_blk_off;
     for (k = 1; (r_e_ind + k) < l_e_ind; ++k) {
         // pr2serr("%s: k=%d, res=%d, num=%d\n", __func__, k, res,
@@ -1047,3 +1342,147 @@ sgls_eq_from_iters(const class scat_gath_iter & left,
                        right.sglist, right.it_el_ind, right.it_blk_off,
                        allow_partial);
 }
+
+static void
+put_varint(vector<uint8_t> & v, uint64_t val)
+{
+    while (val >= 0x80) {
+        v.push_back((uint8_t)(val | 0x80));
+        val >>= 7;
+    }
+    v.push_back((uint8_t)val);
+}
+
+static uint64_t
+get_varint(const uint8_t * bp, size_t & off)
+{
+    int shift = 0;
+    uint64_t res = 0;
+    uint8_t b;
+
+    do {
+        b = bp[off++];
+        res |= (uint64_t)(b & 0x7f) << shift;
+        shift += 7;
+    } while ((b & 0x80) && (shift < 64));
+    return res;
+}
+
+/* Decodes the element at enc[off], off is moved to the next element and
+ * prev_end becomes the LBA after this element */
+static void
+get_packed_elem(const uint8_t * bp, size_t & off, uint64_t & prev_end,
+                class scat_gath_elem & sge)
+{
+    uint64_t z = get_varint(bp, off);
+    int64_t delta = (int64_t)(z >> 1) ^ -(int64_t)(z & 0x1);
+
+    sge.lba = prev_end + (uint64_t)delta;
+    sge.num = (uint32_t)get_varint(bp, off);
+    prev_end = sge.lba + sge.num;
+}
+
+void
+scat_gath_packed::pack(const scat_gath_list & src)
+{
+    int k;
+    uint64_t prev_end = 0;
+    int64_t cum = 0;
+    int64_t delta;
+    struct chk_pt cp;
+
+    num_el = src.sgl.size();
+    enc.clear();
+    chk.clear();
+    enc.reserve(num_el * 4);
+    chk.reserve((num_el + SG_SGL_IDX_STRIDE - 1) / SG_SGL_IDX_STRIDE);
+    for (k = 0; k < num_el; ++k) {
+        const class scat_gath_elem & sge = src.sgl[k];
+
+        if (0 == (k % SG_SGL_IDX_STRIDE)) {
+            cp.blks_before = cum;
+            cp.prev_end = prev_end;
+            cp.byte_off = enc.size();
+            chk.push_back(cp);
+        }
+        delta = (int64_t)(sge.lba - prev_end);
+        /* zigzag so small negative deltas are short too */
+        put_varint(enc, ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63));
+        put_varint(enc, sge.num);
+        prev_end = sge.lba + sge.num;
+        cum += sge.num;
+    }
+    enc.shrink_to_fit();
+    sum = cum;
+}
+
+void
+scat_gath_packed::unpack(scat_gath_list & out) const
+{
+    int k;
+    size_t off = 0;
+    uint64_t prev_end = 0;
+    class scat_gath_elem sge;
+
+    out = scat_gath_list();
+    out.sgl.reserve(num_el);
+    for (k = 0; k < num_el; ++k) {
+        get_packed_elem(enc.data(), off, prev_end, sge);
+        out.sgl.push_back(sge);
+    }
+    out.sum_scan(NULL, false, false);
+}
+
+bool
+scat_gath_packed::get_slice(int64_t blk_off, int64_t num_blks,
+                            scat_gath_list & out) const
+{
+    int j, k;
+    uint32_t n;
+    size_t off;
+    uint64_t prev_end;
+    int64_t pos;
+    class scat_gath_elem sge;
+    struct chk_pt key;
+
+    out = scat_gath_list();
+    if ((blk_off < 0) || (num_blks < 0) || ((blk_off + num_blks) > sum))
+        return false;
+    if (0 == num_blks)
+        return true;
+    key.blks_before = blk_off;
+    /* last checkpoint before blk_off, as in idx_lookup() */
+    j = (int)(lower_bound(chk.begin(), chk.end(), key,
+                          [](const struct chk_pt & a, const struct chk_pt & b)
+                          { return a.blks_before < b.blks_before; }) -
+              chk.begin()) - 1;
+    if (j < 0)
+        j = 0;
+    pos = chk[j].blks_before;
+    prev_end = chk[j].prev_end;
+    off = chk[j].byte_off;
+    for (k = j * SG_SGL_IDX_STRIDE; (k < num_el) && (num_blks > 0); ++k) {
+        get_packed_elem(enc.data(), off, prev_end, sge);
+        if ((pos + sge.num) <= blk_off) {
+            pos += sge.num;
+            continue;
+        }
+        /* this element holds blk_off, or follows it */
+        sge.lba += (blk_off - pos);
+        sge.num -= (uint32_t)(blk_off - pos);
+        n = (sge.num < num_blks) ? sge.num : (uint32_t)num_blks;
+        out.append_1or(n, sge.lba);
+        blk_off += n;
+        pos = blk_off;
+        num_blks -= n;
+    }
+    out.sum_scan(NULL, false, false);
+    return true;
+}
+
+size_t
+scat_gath_packed::mem_bytes() const
+{
+    return sizeof(*this) + enc.capacity() +
+           (chk.capacity() * sizeof(struct chk_pt));
+}
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2014-2020 Douglas Gilbert.
+ * Copyright (c) 2014-2026 Douglas Gilbert.
  * All rights reserved.
  * Use of this source code is governed by a BSD-style
  * license that can be found in the BSD_LICENSE file.
@@ -21,6 +21,10 @@
 
 #define SG_SGL_MAX_ELEMENTS 16384
 
+// Both the block index of a scat_gath_list and the checkpoints of a
+// scat_gath_packed are kept every this many elements
+#define SG_SGL_IDX_STRIDE 64
+
 #define SG_COUNT_INDEFINITE (-1)
 #define SG_LBA_INVALID SG_COUNT_INDEFINITE
 
@@ -45,6 +49,13 @@ enum sgl_linearity_e {
     SGL_NON_MONOTONIC   // weakest
 };
 
+// Set operations on two lists, see sgls_set_op()
+enum sgl_set_op_e {
+    SGL_UNION = 0,
+    SGL_INTERSECT,
+    SGL_DIFFERENCE      // blocks in left list but not in right list
+};
+
 
 // Holds one scatter gather list and its associated metadata
 class scat_gath_list {
@@ -74,12 +85,35 @@ public:
     int append_1or(int64_t extra_blks, int64_t start_lba);
     int append_1or(int64_t extra_blks);
 
+    // The following change the list in place, then call sum_scan(). All
+    // but split_at() remove degenerate (i.e. num==0) elements apart from a
+    // last one which stays last.
+    void sort_by_lba();         // stable, ascending LBA order
+    void merge_adjacent();      // coalesce touching or overlapping elements
+    void normalize();           // sort_by_lba() then merge_adjacent()
+    // Splits elements so none is longer than max_blks. If align is true
+    // elements are also split where an LBA is a multiple of max_blks.
+    void split_at(uint32_t max_blks, bool align);
+
+    // Treating each list as a set of LBAs, places the union, intersection
+    // or difference of left and right in res, normalized. Degenerate
+    // elements are ignored.
+    friend void sgls_set_op(const scat_gath_list & left,
+                            const scat_gath_list & right,
+                            enum sgl_set_op_e op, scat_gath_list & res);
+
     void dbg_print(bool skip_meta, const char * id_str, bool to_stdout,
                    bool show_sgl) const;
 
-    // calculates and sets following bool-s and int64_t-s
+    // calculates and sets following bool-s and int64_t-s, then builds the
+    // block index
     void sum_scan(const char * id_str, bool show_sgl, bool b_verbose);
 
+    // The block index holds the number of blocks before every
+    // SG_SGL_IDX_STRIDE-th element so a block offset can be found with a
+    // binary search. Built by sum_scan() and kept up to date by append_1or()
+    void build_index();
+
     void set_weaker_linearity(enum sgl_linearity_e lin);
     enum sgl_linearity_e linearity;
     const char * linearity_as_str() const;
@@ -95,11 +129,58 @@ public:
 
 private:
     friend class scat_gath_iter;
+    friend class scat_gath_packed;
 
     bool file2sgl_helper(FILE * fp, const char * fnp, bool def_hex,
                          bool flexible, bool b_vb);
+    // returns element index to start from for blk (with blocks before it
+    // in blks_before), or -1 if there is no block index
+    int idx_lookup(int64_t blk, int64_t & blks_before) const;
+    // returns the number of blocks before element e_ind or -1 if there is
+    // no block index covering it
+    int64_t blks_before_elem(int e_ind) const;
 
     std::vector<scat_gath_elem> sgl;  // an array on heap [0..num_elems())
+    // blk_index[j] is the number of blocks before sgl[j * SG_SGL_IDX_STRIDE]
+    std::vector<int64_t> blk_index;
+};
+
+// A compact, read-only copy of a scat_gath_list. Each element is held as
+// two variable length integers: the (zigzag encoded) difference between its
+// LBA and the end of the previous element, then its num. So sorted extent
+// lists typically need 2 to 6 bytes per element rather than 16. A checkpoint
+// is kept every SG_SGL_IDX_STRIDE elements so that get_slice() can start
+// decoding close to any block offset after a binary search. This allows
+// each of several workers to expand just its own part of a very long list.
+class scat_gath_packed {
+public:
+    scat_gath_packed() : num_el(0), sum(0) { }
+
+    void pack(const scat_gath_list & src);
+    // replaces the contents of out with all elements, then sum_scan()s it
+    void unpack(scat_gath_list & out) const;
+    // replaces the contents of out with the num_blks blocks starting
+    // blk_off blocks into the list (splitting elements at either end as
+    // needed), then sum_scan()s it. Returns false if that range is not
+    // within the list.
+    bool get_slice(int64_t blk_off, int64_t num_blks,
+                   scat_gath_list & out) const;
+
+    int num_elems() const { return num_el; }
+    int64_t sum_blks() const { return sum; }
+    size_t mem_bytes() const;
+
+private:
+    struct chk_pt {
+        int64_t blks_before;    // of the element at this checkpoint
+        uint64_t prev_end;      // LBA after the previous element
+        size_t byte_off;        // into enc
+    };
+
+    int num_el;
+    int64_t sum;
+    std::vector<uint8_t> enc;
+    std::vector<chk_pt> chk;
 };
 
 
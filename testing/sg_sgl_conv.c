@@ -0,0 +1,244 @@
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * This utility converts a scatter gather list between the text form
+ * (LBA,NUM pairs, as accepted by skip= and seek= of the dd family and by
+ * sg_write_x --scat-file=SF) and the binary sgl file form (see sg_sgl.h)
+ * which can be memory mapped so very long lists load quickly. The
+ * direction is chosen by looking at the input file. Unlike skip=@FN the
+ * text read here is not limited to SG_SGL_MAX_ELEMENTS pairs, that being
+ * the point of the binary form.
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+#include <getopt.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "sg_lib.h"
+#include "sg_sgl.h"
+#include "sg_pr2serr.h"
+
+static const char * version_str = "1.00 20261014";
+
+
+static struct option long_options[] = {
+    {"help", no_argument, 0, 'h'},
+    {"hex", no_argument, 0, 'H'},
+    {"verbose", no_argument, 0, 'v'},
+    {"version", no_argument, 0, 'V'},
+    {0, 0, 0, 0},
+};
+
+static void
+usage(void)
+{
+    pr2serr("Usage: sg_sgl_conv [--help] [--hex] [--verbose] [--version] "
+            "IFN OFN\n"
+            "  where:\n"
+            "    --help|-h       print usage information then exit\n"
+            "    --hex|-H        text is in hex: when IFN is text it is "
+            "read as\n"
+            "                    hex; when OFN is text it is written in "
+            "hex\n"
+            "    --verbose|-v    increase verbosity\n"
+            "    --version|-V    print version string then exit\n\n"
+            "Converts a scatter gather list in IFN from text (LBA,NUM "
+            "pairs) to the\nbinary sgl file format, or from that binary "
+            "format to text, into OFN.\nOFN of '-' writes text to "
+            "stdout.\n");
+}
+
+/* Reads LBA,NUM pairs from fn ('-' for stdin) into *sglp. Pairs may be
+ * split across lines; '#' starts a comment and a 'HEX' line before the
+ * first pair switches to hex. */
+static int
+text2sgl(struct sg_sgl * sglp, const char * fn, bool do_hex, int verbose)
+{
+    bool have_stdin = (0 == strcmp(fn, "-"));
+    int k, n;
+    int ret = 0;
+    int64_t ll;
+    int64_t half = -1;
+    FILE * fp;
+    char * cp;
+    char line[1024];
+
+    fp = have_stdin ? stdin : fopen(fn, "r");
+    if (NULL == fp) {
+        pr2serr("unable to open %s: %s\n", fn, safe_strerror(errno));
+        return SG_LIB_FILE_ERROR;
+    }
+    for (k = 1; fgets(line, sizeof(line), fp); ++k) {
+        cp = line + strspn(line, " \t");
+        if ((0 == sglp->num_elems) && (half < 0) &&
+            (0 == strncasecmp(cp, "hex", 3))) {
+            do_hex = true;
+            continue;
+        }
+        if ((cp = strchr(line, '#')))
+            *cp = '\0';
+        for (cp = strtok(line, " ,\t\r\n"); cp;
+             cp = strtok(NULL, " ,\t\r\n")) {
+            n = (int)strlen(cp);
+            if (do_hex) {
+                if (strspn(cp, "0123456789abcdefABCDEF") == (size_t)n)
+                    ll = (int64_t)strtoull(cp, NULL, 16);
+                else
+                    ll = -1;
+            } else
+                ll = sg_get_llnum(cp);
+            if (ll < 0) {
+                pr2serr("%s: line %d: bad number: %s\n", fn, k, cp);
+                ret = SG_LIB_SYNTAX_ERROR;
+                goto fini;
+            }
+            if (half < 0)
+                half = ll;
+            else {
+                if (! sg_sgl_append(sglp, (uint64_t)half, ll)) {
+                    pr2serr("%s: out of memory\n", __func__);
+                    ret = sg_convert_errno(ENOMEM);
+                    goto fini;
+                }
+                half = -1;
+            }
+        }
+    }
+    if (half >= 0) {
+        pr2serr("%s: expected even number of items: LBA0,NUM0,LBA1,"
+                "NUM1...\n", fn);
+        ret = SG_LIB_SYNTAX_ERROR;
+    } else if (! sg_sgl_sum_scan(sglp)) {
+        pr2serr("%s: out of memory\n", __func__);
+        ret = sg_convert_errno(ENOMEM);
+    } else if (verbose)
+        pr2serr("%s: %d elements read\n", fn, sglp->num_elems);
+fini:
+    if (! have_stdin)
+        fclose(fp);
+    return ret;
+}
+
+static int
+sgl2text(const struct sg_sgl_bin * sbp, const char * ofn, bool do_hex)
+{
+    bool to_stdout = (0 == strcmp(ofn, "-"));
+    int64_t k;
+    FILE * fp;
+    const struct sg_sgl_elem * ep;
+
+    fp = to_stdout ? stdout : fopen(ofn, "w");
+    if (NULL == fp) {
+        pr2serr("unable to open %s: %s\n", ofn, safe_strerror(errno));
+        return SG_LIB_FILE_ERROR;
+    }
+    fprintf(fp, "# %" PRId64 " elements, sum=%" PRId64 ", %s\n",
+            sbp->num_elems, sbp->sum,
+            sg_sgl_linearity_str(sbp->linearity));
+    if (do_hex)
+        fprintf(fp, "HEX\n");
+    for (k = 0, ep = sbp->elems; k < sbp->num_elems; ++k, ++ep) {
+        if (do_hex)
+            fprintf(fp, "%" PRIx64 ",%" PRIx32 "\n", ep->lba, ep->num);
+        else
+            fprintf(fp, "%" PRIu64 ",%" PRIu32 "\n", ep->lba, ep->num);
+    }
+    if (to_stdout)
+        return 0;
+    if (fclose(fp)) {
+        pr2serr("closing %s: %s\n", ofn, safe_strerror(errno));
+        return SG_LIB_FILE_ERROR;
+    }
+    return 0;
+}
+
+int
+main(int argc, char * argv[])
+{
+    bool do_hex = false;
+    int c, res;
+    int verbose = 0;
+    const char * ifn = NULL;
+    const char * ofn = NULL;
+    struct sg_sgl sgl;
+    struct sg_sgl_bin sb;
+
+    while (1) {
+        int option_index = 0;
+
+        c = getopt_long(argc, argv, "hHvV", long_options, &option_index);
+        if (c == -1)
+            break;
+
+        switch (c) {
+        case 'h':
+        case '?':
+            usage();
+            return 0;
+        case 'H':
+            do_hex = true;
+            break;
+        case 'v':
+            ++verbose;
+            break;
+        case 'V':
+            pr2serr("version: %s\n", version_str);
+            return 0;
+        default:
+            pr2serr("unrecognised option code 0x%x ??\n", c);
+            usage();
+            return SG_LIB_SYNTAX_ERROR;
+        }
+    }
+    if (optind < argc)
+        ifn = argv[optind++];
+    if (optind < argc)
+        ofn = argv[optind++];
+    if ((NULL == ofn) || (optind < argc)) {
+        pr2serr("expect exactly two file names: IFN and OFN\n\n");
+        usage();
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if (sg_sgl_is_bin_file(ifn)) {
+        res = sg_sgl_bin_map(ifn, &sb, true);
+        if (res)
+            return res;
+        if (verbose)
+            pr2serr("%s: binary with %" PRId64 " elements, converting to "
+                    "text\n", ifn, sb.num_elems);
+        res = sgl2text(&sb, ofn, do_hex);
+        sg_sgl_bin_unmap(&sb);
+        return res;
+    }
+    if (0 == strcmp(ofn, "-")) {
+        pr2serr("binary output cannot go to stdout\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    memset(&sgl, 0, sizeof(sgl));
+    res = text2sgl(&sgl, ifn, do_hex, verbose);
+    if (0 == res) {
+        if (verbose > 1)
+            sg_sgl_print(&sgl, ifn, verbose > 2, stderr);
+        res = sg_sgl_bin_save(&sgl, ofn);
+        if (res)
+            pr2serr("unable to write %s: %s\n", ofn, safe_strerror(errno));
+    }
+    sg_sgl_free(&sgl);
+    return res;
+}
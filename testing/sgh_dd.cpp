@@ -36,7 +36,7 @@
  * renamed [20181221]
  */
 
-static const char * version_str = "2.24 20230417";
+static const char * version_str = "2.31 20261015";
 
 #define _XOPEN_SOURCE 600
 #ifndef _GNU_SOURCE
@@ -55,6 +55,7 @@ static const char * version_str = "2.24 20230417";
 #include <poll.h>
 #include <limits.h>
 #include <pthread.h>
+#include <sched.h>              /* for sched_getcpu() and cpu_set_t */
 #include <signal.h>
 #define __STDC_FORMAT_MACROS 1
 #include <inttypes.h>
@@ -111,6 +112,8 @@ static const char * version_str = "2.24 20230417";
 #include "sg_io_linux.h"
 #include "sg_unaligned.h"
 #include "sg_pr2serr.h"
+#include "sg_dd_eng.h"
+#include "sg_hash.h"
 
 
 using namespace std;
@@ -151,6 +154,7 @@ using namespace std;
 #define SGP_WRITE10 0x2a
 #define DEF_NUM_THREADS 4
 #define MAX_NUM_THREADS 1024 /* was SG_MAX_QUEUE with v3 driver */
+#define MAX_CPU_LIST CPU_SETSIZE
 #define DEF_NUM_MRQS 0
 
 #define FT_OTHER 1              /* filetype other than one of the following */
@@ -169,9 +173,6 @@ using namespace std;
 
 #define EBUFF_SZ 768
 
-#define PROC_SCSI_SG_VERSION "/proc/scsi/sg/version"
-#define SYS_SCSI_SG_VERSION "/sys/module/sg/version"
-
 struct flags_t {
     bool append;
     bool coe;
@@ -217,6 +218,7 @@ struct global_collection
     int help;
     int elem_sz;
     struct flags_t in_flags;
+    struct sg_dde_cdb_tmpl rd_tmpl;   /* READ cdb, LBA and length patched */
     // int64_t in_blk;                /* -\ next block address to read */
     // int64_t in_count;              /*  | blocks remaining for next read */
     atomic<int64_t> in_rem_count;     /*  | count of remaining in blocks */
@@ -234,6 +236,7 @@ struct global_collection
     int aen;                          /* abort every nth command */
     int m_aen;                        /* abort mrq every nth command */
     struct flags_t out_flags;
+    struct sg_dde_cdb_tmpl wr_tmpl;   /* WRITE cdb, LBA and length patched */
     atomic<int64_t> out_blk;          /* -\ next block address to write */
     atomic<int64_t> out_count;        /*  | blocks remaining for next write */
     atomic<int64_t> out_rem_count;    /*  | count of remaining out blocks */
@@ -243,6 +246,7 @@ struct global_collection
     pthread_mutex_t out_mutex;        /*  | */
     pthread_cond_t out_sync_cv;       /*  | hold writes until "in order" */
     pthread_mutex_t out2_mutex;
+    pthread_mutex_t hash_mutex;     /* serializes lines written to MANIFEST */
     int bs;
     int bpt;
     int cmd_timeout;            /* in milliseconds */
@@ -257,7 +261,11 @@ struct global_collection
     int verbose;
     int dry_run;
     int chkaddr;
+    int num_cpus;               /* > 0 when worker threads are pinned */
+    int numa_node;              /* node worker buffers are on, -1: don't */
+    int cpus[MAX_CPU_LIST];     /* cpus=LIST or cpus of numa_node */
     bool aen_given;
+    bool cpus_given;            /* cpus=LIST: thread k on cpus[k % n] */
     bool cdbsz_given;
     bool is_mrq_i;
     bool is_mrq_o;
@@ -272,6 +280,12 @@ struct global_collection
     bool verify;                /* don't copy, verify like Unix: cmp */
     bool prefetch;              /* for verify: do PF(b),RD(a),V(b)_a_data */
     bool unshare;               /* let close() do file unshare operation */
+    bool numa;                  /* numa=1 given */
+    const char * rate_arg;      /* rate=BPS[,IOPS] or rate=@FN */
+    struct sg_rate_lim rate_lim;        /* shared by all worker threads */
+    int hash_alg;               /* hash=ALG,MANIFEST, SG_HASH_NONE: off */
+    FILE * hash_mfp;
+    const char * hash_mf;       /* MANIFEST file name */
     const char * infp;
     const char * outfp;
     const char * out2fp;
@@ -410,7 +424,6 @@ static int sgh_do_deferred_mrq(Rq_elem * rep, mrq_arr_t & def_arr);
 
 static pthread_mutex_t strerr_mut = PTHREAD_MUTEX_INITIALIZER;
 
-static bool have_sg_version = false;
 static int sg_version = 0;
 static bool sg_version_lt_4 = false;
 static bool sg_version_ge_40045 = false;
@@ -477,12 +490,14 @@ usage(int pg_num)
             "               [skip=SKIP] [--help] [--version]\n\n");
     pr2serr("               [ae=AEN[,MAEN]] [bpt=BPT] [cdbsz=6|10|12|16] "
             "[coe=0|1]\n"
-            "               [dio=0|1] [elemsz_kb=EKB] [fail_mask=FM] "
-            "[fua=0|1|2|3]\n"
-            "               [mrq=[I|O,]NRQS[,C]] [noshare=0|1] "
-            "[of2=OFILE2]\n"
-            "               [ofreg=OFREG] [ofsplit=OSP] [sdt=SDT] "
-            "[sync=0|1]\n"
+            "               [cpus=LIST] [dio=0|1] [elemsz_kb=EKB] "
+            "[fail_mask=FM]\n"
+            "               [fua=0|1|2|3] [mrq=[I|O,]NRQS[,C]] "
+            "[noshare=0|1]\n"
+            "               [hash=ALG,MANIFEST] [numa=0|1] [of2=OFILE2]\n"
+            "               [ofreg=OFREG] [ofsplit=OSP] [rate=BPS[,IOPS]] "
+            "[sdt=SDT]\n"
+            "               [sync=0|1]"
             "               [thr=THR] [time=0|1|2[,TO]] [unshare=1|0] "
             "[verbose=VERB]\n"
             "               [--compare] [--dry-run] [--prefetch] "
@@ -544,6 +559,8 @@ page2:
             "(default is 10)\n"
             "    coe         continue on error, 0->exit (def), "
             "1->zero + continue\n"
+            "    cpus        pin worker thread k to k-th cpu in LIST "
+            "(e.g. 0-3,8)\n"
             "    dio         is direct IO, 1->attempt, 0->indirect IO (def)\n"
             "    elemsz_kb    scatter gather list element size in kilobytes "
             "(def: 32[KB])\n"
@@ -551,6 +568,10 @@ page2:
             "    fua         force unit access: 0->don't(def), 1->OFILE, "
             "2->IFILE,\n"
             "                3->OFILE+IFILE\n"
+            "    hash        write ALG (crc32c, xxh64 or sha256) digest of "
+            "each segment\n"
+            "                read to MANIFEST; not with mrq= nor when "
+            "sharing\n"
             "    mrq         number of cmds placed in each sg call "
             "(def: 0);\n"
             "                may have trailing ',C', to send bulk cdb_s; "
@@ -558,11 +579,19 @@ page2:
             "                by 'I' then mrq only on IFILE, likewise 'O' "
             "for OFILE\n"
             "    noshare     0->use request sharing(def), 1->don't\n"
+            "    numa        1->run workers and place their buffers on "
+            "NUMA node of\n"
+            "                host adapter of IFILE (or OFILE)\n"
             "    ofreg       OFREG is regular file or pipe to send what is "
             "read from\n"
             "                IFILE in the first half of each shared element\n"
             "    ofsplit     split ofile write in two at block OSP (def: 0 "
             "(no split))\n"
+            "    rate        limit copy to BPS bytes per second and IOPS "
+            "commands\n"
+            "                per second (0 -> no limit); '@FN' reads "
+            "BPS[,IOPS] from\n"
+            "                file FN, re-read on SIGHUP\n"
             "    sdt         stall detection times: CRT[,ICT]. CRT: check "
             "repetition\n"
             "                time (after first) in seconds; ICT: initial "
@@ -945,35 +974,6 @@ v4hdr_out_lk(const char * leadin, const sg_io_v4 * h4p, int id)
     pthread_mutex_unlock(&strerr_mut);
 }
 
-static void
-fetch_sg_version(void)
-{
-    FILE * fp;
-    char b[96];
-
-    have_sg_version = false;
-    sg_version = 0;
-    fp = fopen(PROC_SCSI_SG_VERSION, "r");
-    if (fp && fgets(b, sizeof(b) - 1, fp)) {
-        if (1 == sscanf(b, "%d", &sg_version))
-            have_sg_version = !!sg_version;
-    } else {
-        int j, k, l;
-
-        if (fp)
-            fclose(fp);
-        fp = fopen(SYS_SCSI_SG_VERSION, "r");
-        if (fp && fgets(b, sizeof(b) - 1, fp)) {
-            if (3 == sscanf(b, "%d.%d.%d", &j, &k, &l)) {
-                sg_version = (j * 10000) + (k * 100) + l;
-                have_sg_version = !!sg_version;
-            }
-        }
-    }
-    if (fp)
-        fclose(fp);
-}
-
 static void
 calc_duration_throughput(int contin)
 {
@@ -1139,76 +1139,127 @@ dd_filetype(const char * filename, off_t & st_size)
     return FT_OTHER;
 }
 
-static inline void
-stop_both(struct global_collection * clp)
+/* Parses a list of CPU numbers such as "0-3,8,10-11" into cpus[]. Returns
+ * the number of CPUs placed in cpus[] or -1 if there is a syntax error. */
+static int
+parse_cpu_list(const char * cp, int * cpus, int max_cpus)
 {
-    clp->in_stop = true;
-    clp->out_stop = true;
+    int k, lo, hi, n;
+    char * ep;
+
+    for (n = 0; *cp; ) {
+        lo = (int)strtol(cp, &ep, 10);
+        if ((ep == cp) || (lo < 0))
+            return -1;
+        hi = lo;
+        if ('-' == *ep) {
+            cp = ep + 1;
+            hi = (int)strtol(cp, &ep, 10);
+            if ((ep == cp) || (hi < lo))
+                return -1;
+        }
+        for (k = lo; (k <= hi) && (n < max_cpus); ++k)
+            cpus[n++] = k;
+        if (',' == *ep)
+            ++ep;
+        else if (('\0' != *ep) && ('\n' != *ep))
+            return -1;
+        else
+            break;
+        cp = ep;
+    }
+    return n;
 }
 
-/* Return of 0 -> success, see sg_ll_read_capacity*() otherwise */
+/* Returns the NUMA node of the host adapter (or other bus device) that
+ * the device node fname hangs off, found by walking up its sysfs
+ * directory until a numa_node attribute is found. Returns -1 if that is
+ * not known. */
 static int
-scsi_read_capacity(int sg_fd, int64_t * num_sect, int * sect_sz)
+dev_numa_node(const char * fname)
 {
-    int res;
-    uint8_t rcBuff[RCAP16_REPLY_LEN] = {};
-
-    res = sg_ll_readcap_10(sg_fd, 0, 0, rcBuff, READ_CAP_REPLY_LEN, false, 0);
-    if (0 != res)
-        return res;
-
-    if ((0xff == rcBuff[0]) && (0xff == rcBuff[1]) && (0xff == rcBuff[2]) &&
-        (0xff == rcBuff[3])) {
+    int node = -1;
+    char * cp;
+    FILE * fp;
+    struct stat st;
+    char b[PATH_MAX + 16];
+    char path[PATH_MAX];
 
-        res = sg_ll_readcap_16(sg_fd, 0, 0, rcBuff, RCAP16_REPLY_LEN, false,
-                               0);
-        if (0 != res)
-            return res;
-        *num_sect = sg_get_unaligned_be64(rcBuff + 0) + 1;
-        *sect_sz = sg_get_unaligned_be32(rcBuff + 8);
-    } else {
-        /* take care not to sign extend values > 0x7fffffff */
-        *num_sect = (int64_t)sg_get_unaligned_be32(rcBuff + 0) + 1;
-        *sect_sz = sg_get_unaligned_be32(rcBuff + 4);
+    if ((stat(fname, &st) < 0) ||
+        ! (S_ISCHR(st.st_mode) || S_ISBLK(st.st_mode)))
+        return -1;
+    snprintf(b, sizeof(b), "/sys/dev/%s/%u:%u/device",
+             S_ISCHR(st.st_mode) ? "char" : "block", major(st.st_rdev),
+             minor(st.st_rdev));
+    if (nullptr == realpath(b, path))
+        return -1;
+    while ((cp = strrchr(path, '/')) && (cp > path)) {
+        snprintf(b, sizeof(b), "%s/numa_node", path);
+        if ((fp = fopen(b, "r"))) {
+            if (1 != fscanf(fp, "%d", &node))
+                node = -1;
+            fclose(fp);
+            break;
+        }
+        *cp = '\0';
     }
-    return 0;
+    return node;
 }
 
-/* Return of 0 -> success, -1 -> failure. BLKGETSIZE64, BLKGETSIZE and */
-/* BLKSSZGET macros problematic (from <linux/fs.h> or <sys/mount.h>). */
+/* Places the CPUs belonging to NUMA node 'node' in cpus[]. Returns the
+ * number of CPUs found, 0 if none or the node is unknown. */
 static int
-read_blkdev_capacity(int sg_fd, int64_t * num_sect, int * sect_sz)
+node_cpu_list(int node, int * cpus, int max_cpus)
 {
-#ifdef BLKSSZGET
-    if ((ioctl(sg_fd, BLKSSZGET, sect_sz) < 0) && (*sect_sz > 0)) {
-        perror("BLKSSZGET ioctl error");
-        return -1;
-    } else {
- #ifdef BLKGETSIZE64
-        uint64_t ull;
+    int n = 0;
+    FILE * fp;
+    char b[128];
 
-        if (ioctl(sg_fd, BLKGETSIZE64, &ull) < 0) {
+    snprintf(b, sizeof(b), "/sys/devices/system/node/node%d/cpulist", node);
+    if (nullptr == (fp = fopen(b, "r")))
+        return 0;
+    if (fgets(b, sizeof(b), fp))
+        n = parse_cpu_list(b, cpus, max_cpus);
+    fclose(fp);
+    return (n > 0) ? n : 0;
+}
 
-            perror("BLKGETSIZE64 ioctl error");
-            return -1;
-        }
-        *num_sect = ((int64_t)ull / (int64_t)*sect_sz);
- #else
-        unsigned long ul;
+/* Pins the calling worker thread: to one CPU from cpus=LIST (round robin
+ * on thread id) else to all CPUs of the NUMA node given by numa=1 . */
+static void
+pin_worker_thread(const struct global_collection * clp, int id)
+{
+    int k, status;
+    cpu_set_t cpuset;
 
-        if (ioctl(sg_fd, BLKGETSIZE, &ul) < 0) {
-            perror("BLKGETSIZE ioctl error");
-            return -1;
-        }
-        *num_sect = (int64_t)ul;
- #endif
+    CPU_ZERO(&cpuset);
+    if (clp->cpus_given)
+        CPU_SET(clp->cpus[id % clp->num_cpus], &cpuset);
+    else {
+        for (k = 0; k < clp->num_cpus; ++k)
+            CPU_SET(clp->cpus[k], &cpuset);
     }
-    return 0;
-#else
-    *num_sect = 0;
-    *sect_sz = 0;
-    return -1;
-#endif
+    status = pthread_setaffinity_np(pthread_self(), sizeof(cpuset),
+                                    &cpuset);
+    if (0 != status) {
+        char strerr_buff[STRERR_BUFF_LEN + 1];
+
+        pr2serr_lk("%sunable to set affinity of thread id=%d: %s\n",
+                   my_name, id, tsafe_strerror(status, strerr_buff));
+    } else if (clp->verbose) {
+        if (clp->numa_node >= 0)
+            pr2serr_lk("%d <-- running on cpu %d, buffers on numa node "
+                       "%d\n", id, sched_getcpu(), clp->numa_node);
+        else
+            pr2serr_lk("%d <-- running on cpu %d\n", id, sched_getcpu());
+    }
+}
+
+static inline void
+stop_both(struct global_collection * clp)
+{
+    clp->in_stop = true;
+    clp->out_stop = true;
 }
 
 static int
@@ -1277,6 +1328,15 @@ sig_listen_thread(void * v_clp)
             raise(SIGINT);
             break;
         }
+        if (SIGHUP == sig_number) {
+            if (! sg_rate_lim_parse(&clp->rate_lim, clp->rate_arg))
+                pr2serr_lk("SIGHUP: unable to re-read %s, rate unchanged\n",
+                           clp->rate_arg + 1);
+            else if (clp->verbose)
+                pr2serr_lk("SIGHUP: rate now %" PRId64 " bytes/sec, %"
+                           PRId64 " IOPS (0 -> no limit)\n",
+                           clp->rate_lim.bytes_ps, clp->rate_lim.iops);
+        }
         if (SIGUSR2 == sig_number) {
             if (clp->verbose > 2)
                 pr2serr_lk("%s: interrupted by SIGUSR2\n", __func__);
@@ -1474,6 +1534,30 @@ static void inline buffp_onto_next(Rq_elem * rep)
     }
 }
 
+/* hash=ALG,MANIFEST: digests the segment just read while it is in this
+ * thread's buffer. Segments complete in any order so each MANIFEST line
+ * carries its IFILE block address. */
+static void
+hash_segment(Rq_elem * rep)
+{
+    struct global_collection * clp = rep->clp;
+    int n, status;
+    struct sg_hash_ctx hc;
+    uint8_t d[SG_HASH_MAX_DIGEST_LEN];
+    char b[(2 * SG_HASH_MAX_DIGEST_LEN) + 1];
+
+    sg_hash_init(&hc, clp->hash_alg);
+    sg_hash_update(&hc, rep->buffp, rep->num_blks * rep->bs);
+    n = sg_hash_final(&hc, d);
+    sg_hash_hex(d, n, b, sizeof(b));
+    status = pthread_mutex_lock(&clp->hash_mutex);
+    if (0 != status) err_exit(status, "lock hash_mutex");
+    fprintf(clp->hash_mfp, "%" PRId64 " %d %s\n", rep->iblk, rep->num_blks,
+            b);
+    status = pthread_mutex_unlock(&clp->hash_mutex);
+    if (0 != status) err_exit(status, "unlock hash_mutex");
+}
+
 static inline uint8_t *
 get_buffp(Rq_elem * rep)
 {
@@ -1518,6 +1602,8 @@ read_write_thread(void * v_tip)
     rep->id = tip->id;
     if (vb > 2)
         pr2serr_lk("%d <-- Starting worker thread\n", rep->id);
+    if (clp->num_cpus > 0)
+        pin_worker_thread(clp, rep->id);
     if (! (in_mmap || out_mmap)) {
         n = sz;
         if (clp->unbalanced_mrq)
@@ -1526,6 +1612,9 @@ read_write_thread(void * v_tip)
                                  false);
         if (NULL == rep->buffp)
             err_exit(ENOMEM, "out of memory creating user buffers\n");
+        /* first touch, after pinning, places the pages locally */
+        if (clp->num_cpus > 0)
+            memset(rep->buffp, 0, n);
     }
     rep->infd = clp->infd;
     rep->outfd = clp->outfd;
@@ -1642,6 +1731,9 @@ read_write_thread(void * v_tip)
     while (1) {
         rep->wr = false;
         my_index = atomic_fetch_add(&pos_index, (long int)clp->bpt);
+        if (clp->rate_arg && ((dd_count < 0) || (my_index < dd_count)))
+            sg_rate_lim_wait(&clp->rate_lim,
+                             (uint64_t)clp->bpt * clp->bs, 1);
         /* Start of READ half of a segment */
         buffp_onto_next(rep);
         status = pthread_mutex_lock(&clp->in_mutex);
@@ -1706,9 +1798,14 @@ read_write_thread(void * v_tip)
         }
         pthread_cleanup_pop(0);
         ++rep->rep_count;
+        /* a shared read leaves the data in the driver's buffer */
+        if (clp->hash_mfp && (! rep->has_share) && (rep->num_blks > 0))
+            hash_segment(rep);
 
         /* Start of WRITE part of a segment */
         rep->wr = true;
+        if (clp->rate_arg && (FT_DEV_NULL != clp->out_type))
+            sg_rate_lim_wait(&clp->rate_lim, 0, 1);
         status = pthread_mutex_lock(&clp->out_mutex);
         if (0 != status) err_exit(status, "lock out_mutex");
 
@@ -3175,13 +3272,20 @@ sg_start_io(Rq_elem * rep, mrq_arr_t & def_arr, int & pack_id,
     if (qhead)
         qtail = false;          /* qhead takes precedence */
 
-    if (v4 && xtrp && xtrp->dout_is_split) {
-        res = sg_build_scsi_cdb(rep->cmd, cdbsz, xtrp->blks,
-                                blk + (unsigned int)xtrp->blk_offset,
-                                clp->verify, true, fua, dpo);
-    } else
-        res = sg_build_scsi_cdb(rep->cmd, cdbsz, rep->num_blks, blk,
-                                wr ? clp->verify : false, wr, fua, dpo);
+    if (wr && clp->verify) {
+        if (v4 && xtrp && xtrp->dout_is_split)
+            res = sg_build_scsi_cdb(rep->cmd, cdbsz, xtrp->blks,
+                                    blk + (unsigned int)xtrp->blk_offset,
+                                    true, true, fua, dpo);
+        else
+            res = sg_build_scsi_cdb(rep->cmd, cdbsz, rep->num_blks, blk,
+                                    true, true, fua, dpo);
+    } else if (v4 && xtrp && xtrp->dout_is_split)
+        res = sg_dde_cdb_tmpl_fill(&clp->wr_tmpl, rep->cmd, xtrp->blks,
+                                   blk + (unsigned int)xtrp->blk_offset);
+    else    /* only LBA and TRANSFER LENGTH differ between commands */
+        res = sg_dde_cdb_tmpl_fill(wr ? &clp->wr_tmpl : &clp->rd_tmpl,
+                                   rep->cmd, rep->num_blks, blk);
     if (res) {
         pr2serr_lk("%sbad cdb build, start_blk=%" PRId64 ", blocks=%d\n",
                    my_name, blk, rep->num_blks);
@@ -3710,25 +3814,16 @@ sg_prepare_resbuf(int fd, bool is_in, struct global_collection *clp,
     }
 bypass:
     if (! def_res) {
-        num = clp->bs * clp->bpt;
-        res = ioctl(fd, SG_SET_RESERVED_SIZE, &num);
-        if (res < 0) {
-            perror("sgh_dd: SG_SET_RESERVED_SIZE error");
-            return 0;
-        } else {
-            int nn;
+        int bpt = clp->bpt;     /* shared by all threads, not lowered */
+        struct sg_dde_resbuf rb;
 
-            res = ioctl(fd, SG_GET_RESERVED_SIZE, &nn);
-            if (res < 0) {
-                perror("sgh_dd: SG_GET_RESERVED_SIZE error");
-                return 0;
-            }
-            if (nn < num) {
-                pr2serr_lk("%s: SG_GET_RESERVED_SIZE shows size truncated, "
-                           "wanted %d got %d\n", __func__, num, nn);
-                return 0;
-            }
-        }
+        if (sg_dde_resbuf_size(fd, clp->bs, &bpt,
+                               mmpp ? SG_DDE_RB_MMAP : 0, &rb, my_name,
+                               clp->verbose))
+            return 0;
+        if (mmpp && (0 == (SG_DDE_RB_MMAP & rb.got)))
+            return 0;
+        num = rb.need;
         if (mmpp) {
             mmp = (uint8_t *)mmap(NULL, num, PROT_READ | PROT_WRITE,
                                   MAP_SHARED, fd, 0);
@@ -4087,6 +4182,14 @@ parse_cmdline_sanity(int argc, char * argv[], struct global_collection * clp,
                     return SG_LIB_SYNTAX_ERROR;
                 }
             }   /* treat 'count=-1' as calculate count (same as not given) */
+        } else if (0 == strcmp(key, "cpus")) {
+            clp->num_cpus = parse_cpu_list(buf, clp->cpus, MAX_CPU_LIST);
+            if (clp->num_cpus <= 0) {
+                pr2serr("%sbad argument to 'cpus=', expect list like "
+                        "0-3,8\n", my_name);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            clp->cpus_given = true;
         } else if (0 == strcmp(key, "dio")) {
             clp->in_flags.dio = !! sg_get_num(buf);
             clp->out_flags.dio = clp->in_flags.dio;
@@ -4159,6 +4262,8 @@ parse_cmdline_sanity(int argc, char * argv[], struct global_collection * clp,
                 clp->mrq_cmds = true;
         } else if (0 == strcmp(key, "noshare")) {
             clp->noshare = !! sg_get_num(buf);
+        } else if (0 == strcmp(key, "numa")) {
+            clp->numa = !! sg_get_num(buf);
         } else if (0 == strcmp(key, "obs")) {
             obs = sg_get_num(buf);
             if ((obs < 0) || (obs > MAX_BPT_VALUE)) {
@@ -4217,6 +4322,26 @@ parse_cmdline_sanity(int argc, char * argv[], struct global_collection * clp,
                 }
                 clp->sdt_ict = n;
             }
+        } else if (0 == strcmp(key, "hash")) {
+            char * cp = strchr(buf, ',');
+
+            if (cp)
+                *cp = '\0';
+            clp->hash_alg = sg_hash_alg_from_name(buf);
+            if ((clp->hash_alg < 0) || (NULL == cp) || ('\0' == cp[1])) {
+                pr2serr("%sbad argument to 'hash=', expect ALG,MANIFEST "
+                        "where ALG is\ncrc32c, xxh64 or sha256\n",
+                        my_name);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            clp->hash_mf = argv[k] + (cp + 1 - str);
+        } else if (0 == strcmp(key, "rate")) {
+            if (! sg_rate_lim_parse(&clp->rate_lim, buf)) {
+                pr2serr("%sbad argument to 'rate=', expect BPS[,IOPS] or "
+                        "@FN\n", my_name);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            clp->rate_arg = argv[k] + (buf - str);
         } else if (0 == strcmp(key, "seek")) {
             clp->seek = sg_get_llnum(buf);
             if (clp->seek < 0) {
@@ -4444,7 +4569,7 @@ main(int argc, char * argv[])
     int res, k, err;
     int64_t in_num_sect = 0;
     int64_t out_num_sect = 0;
-    int in_sect_sz, out_sect_sz, status, flags;
+    int in_sect_sz, out_sect_sz, status, flags, n;
     void * vp;
     const char * ccp = NULL;
     const char * cc2p;
@@ -4474,11 +4599,12 @@ main(int argc, char * argv[])
     clp->sdt_crt = DEF_SDT_CRT_SEC;
     clp->nmrqs = DEF_NUM_MRQS;
     clp->unshare = true;
+    clp->numa_node = -1;
     inf[0] = '\0';
     outf[0] = '\0';
     out2f[0] = '\0';
     outregf[0] = '\0';
-    fetch_sg_version();
+    sg_version = sg_linux_get_caps(0)->sg_version;
     if (sg_version >= 40045)
         sg_version_ge_40045 = true;
 
@@ -4772,6 +4898,23 @@ main(int argc, char * argv[])
     } else
         clp->outregfd = -1;
 
+    if (clp->numa) {
+        n = inf[0] ? dev_numa_node(inf) : -1;
+        if ((n < 0) && outf[0])
+            n = dev_numa_node(outf);
+        if (n < 0)
+            pr2serr("%sunable to find NUMA node of IFILE or OFILE, numa=1 "
+                    "ignored\n", my_name);
+        else {
+            clp->numa_node = n;
+            if (! clp->cpus_given)
+                clp->num_cpus = node_cpu_list(n, clp->cpus, MAX_CPU_LIST);
+            if (clp->verbose)
+                pr2serr("host adapter is on NUMA node %d%s\n", n,
+                        clp->cpus_given ? "" : ", workers pinned to its "
+                        "cpus");
+        }
+    }
     if ((STDIN_FILENO == clp->infd) && (STDOUT_FILENO == clp->outfd)) {
         pr2serr("Won't default both IFILE to stdin _and_ OFILE to "
                 "/dev/null\n");
@@ -4781,11 +4924,12 @@ main(int argc, char * argv[])
     if (dd_count < 0) {
         in_num_sect = -1;
         if (FT_SG == clp->in_type) {
-            res = scsi_read_capacity(clp->infd, &in_num_sect, &in_sect_sz);
+            res = sg_dde_read_capacity(clp->infd, &in_num_sect, &in_sect_sz,
+                                       false, 0);
             if (2 == res) {
                 pr2serr("Unit attention, media changed(in), continuing\n");
-                res = scsi_read_capacity(clp->infd, &in_num_sect,
-                                         &in_sect_sz);
+                res = sg_dde_read_capacity(clp->infd, &in_num_sect,
+                                           &in_sect_sz, false, 0);
             }
             if (0 != res) {
                 if (res == SG_LIB_CAT_INVALID_OP)
@@ -4802,8 +4946,8 @@ main(int argc, char * argv[])
                 return SG_LIB_FILE_ERROR;
             }
         } else if (FT_BLOCK == clp->in_type) {
-            if (0 != read_blkdev_capacity(clp->infd, &in_num_sect,
-                                          &in_sect_sz)) {
+            if (0 != sg_dde_blkdev_capacity(clp->infd, &in_num_sect,
+                                            &in_sect_sz, 0)) {
                 pr2serr("Unable to read block capacity on %s\n", inf);
                 in_num_sect = -1;
             }
@@ -4825,11 +4969,12 @@ main(int argc, char * argv[])
 
         out_num_sect = -1;
         if (FT_SG == clp->out_type) {
-            res = scsi_read_capacity(clp->outfd, &out_num_sect, &out_sect_sz);
+            res = sg_dde_read_capacity(clp->outfd, &out_num_sect,
+                                       &out_sect_sz, false, 0);
             if (2 == res) {
                 pr2serr("Unit attention, media changed(out), continuing\n");
-                res = scsi_read_capacity(clp->outfd, &out_num_sect,
-                                         &out_sect_sz);
+                res = sg_dde_read_capacity(clp->outfd, &out_num_sect,
+                                           &out_sect_sz, false, 0);
             }
             if (0 != res) {
                 if (res == SG_LIB_CAT_INVALID_OP)
@@ -4847,8 +4992,8 @@ main(int argc, char * argv[])
                 return SG_LIB_FILE_ERROR;
             }
         } else if (FT_BLOCK == clp->out_type) {
-            if (0 != read_blkdev_capacity(clp->outfd, &out_num_sect,
-                                          &out_sect_sz)) {
+            if (0 != sg_dde_blkdev_capacity(clp->outfd, &out_num_sect,
+                                            &out_sect_sz, 0)) {
                 pr2serr("Unable to read block capacity on %s\n", outf);
                 out_num_sect = -1;
             }
@@ -4900,6 +5045,14 @@ main(int argc, char * argv[])
             clp->cdbsz_out = MAX_SCSI_CDBSZ;
         }
     }
+    if ((FT_SG == clp->in_type) &&
+        sg_dde_cdb_tmpl_init(&clp->rd_tmpl, clp->cdbsz_in, false,
+                             clp->in_flags.fua, clp->in_flags.dpo, my_name))
+        return SG_LIB_SYNTAX_ERROR;
+    if (((FT_SG == clp->out_type) || (FT_SG == clp->out2_type)) &&
+        sg_dde_cdb_tmpl_init(&clp->wr_tmpl, clp->cdbsz_out, true,
+                             clp->out_flags.fua, clp->out_flags.dpo, my_name))
+        return SG_LIB_SYNTAX_ERROR;
 
     // clp->in_count = dd_count;
     clp->in_rem_count = dd_count;
@@ -4910,6 +5063,8 @@ main(int argc, char * argv[])
     if (0 != status) err_exit(status, "init in_mutex");
     status = pthread_mutex_init(&clp->out_mutex, NULL);
     if (0 != status) err_exit(status, "init out_mutex");
+    status = pthread_mutex_init(&clp->hash_mutex, NULL);
+    if (0 != status) err_exit(status, "init hash_mutex");
     status = pthread_mutex_init(&clp->out2_mutex, NULL);
     if (0 != status) err_exit(status, "init out2_mutex");
     status = pthread_cond_init(&clp->out_sync_cv, NULL);
@@ -4922,10 +5077,37 @@ main(int argc, char * argv[])
     if (! clp->ofile_given)
         pr2serr("of=OFILE not given so only read from IFILE, to output to "
                 "stdout use 'of=-'\n");
+    if (clp->hash_alg) {
+        struct sg_hash_ctx hc;
+
+        if (clp->nmrqs > 0) {
+            pr2serr("hash= can't be used with mrq=, data is not in the "
+                    "buffer in time\n");
+            return SG_LIB_CONTRADICT;
+        }
+        if ((FT_SG == clp->in_type) && (FT_SG == clp->out_type) &&
+            (! clp->noshare)) {
+            pr2serr("hash= on a sg->sg copy needs noshare=1\n");
+            return SG_LIB_CONTRADICT;
+        }
+        /* also builds lookup tables before worker threads start */
+        sg_hash_init(&hc, clp->hash_alg);
+        clp->hash_mfp = fopen(clp->hash_mf, "w");
+        if (NULL == clp->hash_mfp) {
+            pr2serr("%sunable to create hash manifest %s: %s\n", my_name,
+                    clp->hash_mf, strerror(errno));
+            return SG_LIB_FILE_ERROR;
+        }
+        fprintf(clp->hash_mfp, "# sg3_utils hash manifest: alg=%s bs=%d "
+                "if=%s\n# lba blocks digest\n",
+                sg_hash_alg_name(clp->hash_alg), clp->bs, inf);
+    }
 
     sigemptyset(&signal_set);
     sigaddset(&signal_set, SIGINT);
     sigaddset(&signal_set, SIGUSR2);
+    if (clp->rate_arg && ('@' == clp->rate_arg[0]))
+        sigaddset(&signal_set, SIGHUP);     /* re-read rate=@FN */
     status = pthread_sigmask(SIG_BLOCK, &signal_set, &orig_signal_set);
     if (0 != status) err_exit(status, "pthread_sigmask");
     status = pthread_create(&sig_listen_thread_id, NULL,
@@ -4982,6 +5164,12 @@ main(int argc, char * argv[])
 
     if (do_time && (start_tm.tv_sec || start_tm.tv_usec))
         calc_duration_throughput(0);
+    if (clp->hash_mfp) {
+        if (fclose(clp->hash_mfp))
+            pr2serr("%sproblem closing hash manifest %s: %s\n", my_name,
+                    clp->hash_mf, strerror(errno));
+        clp->hash_mfp = NULL;
+    }
 
     shutting_down = true;
     status = pthread_join(sig_listen_thread_id, &vp);